@@ -0,0 +1,432 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Small microbenchmark framework for the kernels of the layers.
+ *
+ * The benchmarks are registered statically with DLL_BENCHMARK and run by
+ * dll_bench::run_benchmarks. The number of iterations of each benchmark is
+ * calibrated so that one repetition runs for at least the minimum time, then
+ * several repetitions are measured. The results are printed to the console
+ * and can be written in the JSON format of Google Benchmark, so that the
+ * results of two versions of the library can be compared with its tools.
+ *
+ * The memory allocations (through the global operator new) of the timed loop
+ * are counted as well. The benchmarks registered in pairs, with the same name
+ * except for a "/static/" and a "/dyn/" part, are compared in a parity table
+ * after the results.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dll/util/layer_cost.hpp"
+#include "dll/version.hpp"
+
+namespace dll_bench {
+
+using clock      = std::chrono::steady_clock; ///< The clock used for the measures
+using time_point = clock::time_point;         ///< A point in time of the clock
+
+/*!
+ * \brief Returns the counter of the memory allocations of the program.
+ *
+ * The counter is incremented by the replacement of the global operator new
+ * of the benchmark executable (see main.cpp).
+ */
+inline std::atomic<size_t>& allocation_counter() {
+    static std::atomic<size_t> counter{0};
+    return counter;
+}
+
+/*!
+ * \brief Prevent the compiler from optimizing away the computation of the
+ * given value
+ */
+template <typename T>
+inline void do_not_optimize(T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/*!
+ * \brief The state of one run of a benchmark.
+ *
+ * The timed loop of a benchmark is `while (state.keep_running()) { ... }`,
+ * everything before is setup and is not measured.
+ */
+struct state {
+    size_t iterations; ///< The number of iterations of the run
+    size_t remaining;  ///< The number of iterations left
+    size_t flops = 0;  ///< The floating point operations of one iteration
+    size_t bytes = 0;  ///< The bytes moved by one iteration
+    size_t items = 0;  ///< The items (samples) processed by one iteration
+    time_point start;  ///< The start of the timed loop
+    time_point stop;   ///< The end of the timed loop
+
+    size_t allocations      = 0; ///< The memory allocations of the timed loop
+    size_t allocation_start = 0; ///< The allocation counter at the start of the timed loop
+
+    /*!
+     * \brief Create a state for the given number of iterations
+     */
+    explicit state(size_t iterations) : iterations(iterations), remaining(iterations) {}
+
+    /*!
+     * \brief Indicates if the timed loop must do another iteration
+     */
+    bool keep_running() {
+        if (remaining == iterations) {
+            allocation_start = allocation_counter().load(std::memory_order_relaxed);
+            start            = clock::now();
+        }
+
+        if (remaining == 0) {
+            stop        = clock::now();
+            allocations = allocation_counter().load(std::memory_order_relaxed) - allocation_start;
+            return false;
+        }
+
+        --remaining;
+        return true;
+    }
+
+    /*!
+     * \brief Set the analytical cost of one iteration
+     */
+    void set_cost(const dll::pass_cost& cost) {
+        flops = cost.flops;
+        bytes = cost.bytes;
+    }
+
+    /*!
+     * \brief Returns the duration of the timed loop, in nanoseconds
+     */
+    double duration() const {
+        return std::chrono::duration<double, std::nano>(stop - start).count();
+    }
+};
+
+/*!
+ * \brief A registered benchmark
+ */
+struct benchmark {
+    std::string name;                    ///< The name of the benchmark
+    std::function<void(state&)> functor; ///< The benchmark itself
+};
+
+/*!
+ * \brief Returns the registered benchmarks
+ */
+inline std::vector<benchmark>& benchmarks() {
+    static std::vector<benchmark> registry;
+    return registry;
+}
+
+/*!
+ * \brief Register a new benchmark
+ * \return always true, to allow registration in static initializers
+ */
+inline bool register_benchmark(std::string name, std::function<void(state&)> functor) {
+    benchmarks().push_back({std::move(name), std::move(functor)});
+    return true;
+}
+
+/*!
+ * \brief The measures of one benchmark
+ */
+struct result {
+    std::string name;  ///< The name of the benchmark
+    size_t iterations; ///< The iterations of each repetition
+    double mean;       ///< The mean time of one iteration, in nanoseconds
+    double min;        ///< The minimum time of one iteration, in nanoseconds
+    double stddev;     ///< The standard deviation of the time of one iteration, in nanoseconds
+    size_t flops;      ///< The floating point operations of one iteration
+    size_t bytes;      ///< The bytes moved by one iteration
+    size_t items;      ///< The items processed by one iteration
+    double allocs;     ///< The memory allocations of one iteration
+};
+
+/*!
+ * \brief The options of the benchmark runner
+ */
+struct options {
+    std::string filter;         ///< Only run the benchmarks whose name contain this string
+    std::string json;           ///< The file to write the JSON results into (empty for none)
+    double min_time    = 0.2;   ///< The minimum time of one repetition, in seconds
+    size_t repetitions = 3;     ///< The number of measured repetitions
+    bool list          = false; ///< Only list the benchmarks
+};
+
+/*!
+ * \brief Run a benchmark, calibrating the number of iterations first
+ */
+inline result run_benchmark(const benchmark& bench, const options& opts) {
+    const double min_time = opts.min_time * 1e9;
+
+    // Calibrate the number of iterations
+
+    size_t iterations = 1;
+
+    while (true) {
+        state s(iterations);
+        bench.functor(s);
+
+        if (s.duration() >= min_time || iterations >= 1000000000) {
+            break;
+        }
+
+        // Aim a bit above the minimum time, growing at most 10 times
+        double factor = s.duration() > 0.0 ? 1.4 * min_time / s.duration() : 10.0;
+        iterations    = std::max(iterations + 1, size_t(iterations * std::min(10.0, factor)));
+    }
+
+    // Measure the repetitions
+
+    result r{bench.name, iterations, 0.0, 0.0, 0.0, 0, 0, 0, 0.0};
+
+    std::vector<double> times;
+
+    for (size_t i = 0; i < std::max(opts.repetitions, size_t(1)); ++i) {
+        state s(iterations);
+        bench.functor(s);
+
+        times.push_back(s.duration() / iterations);
+
+        r.flops  = s.flops;
+        r.bytes  = s.bytes;
+        r.items  = s.items;
+        r.allocs = double(s.allocations) / iterations;
+    }
+
+    for (auto t : times) {
+        r.mean += t;
+    }
+
+    r.mean /= times.size();
+    r.min = *std::min_element(times.begin(), times.end());
+
+    for (auto t : times) {
+        r.stddev += (t - r.mean) * (t - r.mean);
+    }
+
+    r.stddev = times.size() > 1 ? std::sqrt(r.stddev / (times.size() - 1)) : 0.0;
+
+    return r;
+}
+
+/*!
+ * \brief Print the header of the console output
+ */
+inline void print_header() {
+    printf("%-60s %14s %12s %12s %10s %10s %10s %12s\n", "Benchmark", "Time", "Min", "Stddev", "GFLOP/s", "GB/s", "Allocs", "Iterations");
+    std::cout << std::string(147, '-') << std::endl;
+}
+
+/*!
+ * \brief Print the result of one benchmark to the console
+ */
+inline void print_result(const result& r) {
+    char gflops[32] = "-";
+    char gbs[32]    = "-";
+
+    // Nanoseconds per iteration gives directly G/s
+    if (r.flops) {
+        snprintf(gflops, 32, "%.2f", r.flops / r.min);
+    }
+
+    if (r.bytes) {
+        snprintf(gbs, 32, "%.2f", r.bytes / r.min);
+    }
+
+    printf("%-60s %11.0f ns %9.0f ns %9.0f ns %10s %10s %10.2f %12lu\n", r.name.c_str(), r.mean, r.min, r.stddev, gflops, gbs, r.allocs, r.iterations);
+    std::cout.flush();
+}
+
+/*!
+ * \brief Print the static and dynamic versions of the same benchmarks side
+ * by side (the benchmarks whose names only differ by "/static/" and "/dyn/")
+ */
+inline void print_parity(const std::vector<result>& results) {
+    const std::string static_part = "/static/";
+    const std::string dyn_part    = "/dyn/";
+
+    bool header = false;
+
+    for (auto& r : results) {
+        auto position = r.name.find(static_part);
+
+        if (position == std::string::npos) {
+            continue;
+        }
+
+        auto dyn_name = r.name.substr(0, position) + dyn_part + r.name.substr(position + static_part.size());
+
+        auto dyn = std::find_if(results.begin(), results.end(), [&dyn_name](auto& d) { return d.name == dyn_name; });
+
+        if (dyn == results.end()) {
+            continue;
+        }
+
+        if (!header) {
+            std::cout << std::endl;
+            printf("%-60s %14s %14s %10s %14s %14s\n", "Parity", "Static", "Dyn", "Dyn/Static", "Static allocs", "Dyn allocs");
+            std::cout << std::string(131, '-') << std::endl;
+
+            header = true;
+        }
+
+        auto name = r.name.substr(0, position) + "/" + r.name.substr(position + static_part.size());
+
+        printf("%-60s %11.0f ns %11.0f ns %10.2f %14.2f %14.2f\n", name.c_str(), r.min, dyn->min, dyn->min / r.min, r.allocs, dyn->allocs);
+    }
+
+    std::cout.flush();
+}
+
+/*!
+ * \brief Write the results in the JSON format of Google Benchmark
+ */
+inline bool write_json(const std::string& file, const std::vector<result>& results) {
+    std::ofstream os(file);
+
+    if (!os) {
+        return false;
+    }
+
+    char date[64];
+    auto now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    os << "{\n";
+    os << "  \"context\": {\n";
+    os << "    \"date\": \"" << date << "\",\n";
+    os << "    \"library\": \"dll\",\n";
+    os << "    \"library_version\": \"" << dll::version_major << "." << dll::version_minor << "." << dll::version_revision << "\",\n";
+    os << "    \"num_cpus\": " << std::thread::hardware_concurrency() << "\n";
+    os << "  },\n";
+    os << "  \"benchmarks\": [";
+
+    const char* comma = "\n";
+    char buffer[512];
+
+    for (auto& r : results) {
+        snprintf(buffer, 512,
+                 "    {\"name\": \"%s\", \"run_type\": \"iteration\", \"iterations\": %lu, \"real_time\": %.3f, \"cpu_time\": %.3f, \"min_time\": %.3f, \"stddev\": %.3f, \"time_unit\": \"ns\", \"flops\": %lu, \"bytes\": %lu, \"items\": %lu, \"allocations\": %.2f}",
+                 r.name.c_str(), r.iterations, r.mean, r.mean, r.min, r.stddev, r.flops, r.bytes, r.items, r.allocs);
+
+        os << comma << buffer;
+        comma = ",\n";
+    }
+
+    os << "\n  ]\n}\n";
+
+    return bool(os);
+}
+
+/*!
+ * \brief Parse the command line options
+ */
+inline options parse_options(int argc, char* argv[]) {
+    options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+
+        auto value = [&arg](const char* prefix) {
+            return arg.substr(std::strlen(prefix));
+        };
+
+        if (arg.rfind("--filter=", 0) == 0) {
+            opts.filter = value("--filter=");
+        } else if (arg.rfind("--json=", 0) == 0) {
+            opts.json = value("--json=");
+        } else if (arg.rfind("--min-time=", 0) == 0) {
+            opts.min_time = std::stod(value("--min-time="));
+        } else if (arg.rfind("--repetitions=", 0) == 0) {
+            opts.repetitions = std::stoul(value("--repetitions="));
+        } else if (arg == "--list") {
+            opts.list = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--filter=<substring>] [--json=<file>] [--min-time=<seconds>] [--repetitions=<n>] [--list]" << std::endl;
+            std::exit(1);
+        }
+    }
+
+    return opts;
+}
+
+/*!
+ * \brief Run all the registered benchmarks selected by the command line
+ * \return the exit code of the program
+ */
+inline int run_benchmarks(int argc, char* argv[]) {
+    auto opts = parse_options(argc, argv);
+
+    std::vector<const benchmark*> selected;
+
+    for (auto& bench : benchmarks()) {
+        if (bench.name.find(opts.filter) != std::string::npos) {
+            selected.push_back(&bench);
+        }
+    }
+
+    std::sort(selected.begin(), selected.end(), [](auto* lhs, auto* rhs) { return lhs->name < rhs->name; });
+
+    if (opts.list) {
+        for (auto* bench : selected) {
+            std::cout << bench->name << std::endl;
+        }
+
+        return 0;
+    }
+
+    std::vector<result> results;
+
+    print_header();
+
+    for (auto* bench : selected) {
+        results.push_back(run_benchmark(*bench, opts));
+        print_result(results.back());
+    }
+
+    print_parity(results);
+
+    if (!opts.json.empty() && !write_json(opts.json, results)) {
+        std::cerr << "Impossible to write the results to " << opts.json << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+} //end of dll_bench namespace
+
+#define DLL_BENCH_CONCAT_IMPL(a, b) a##b
+#define DLL_BENCH_CONCAT(a, b) DLL_BENCH_CONCAT_IMPL(a, b)
+
+/*!
+ * \brief Register a benchmark with the given name, the functor takes a
+ * dll_bench::state&
+ */
+#define DLL_BENCHMARK(name, ...) \
+    static const bool DLL_BENCH_CONCAT(dll_bench_registered_, __LINE__) = dll_bench::register_benchmark(name, __VA_ARGS__)
@@ -0,0 +1,228 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Benchmarks of the kernels of one layer (forward, backward and
+ * gradients) and of the updaters.
+ *
+ * Each layer is put alone in a network, with the batch size given, and the
+ * kernels are run on the training context built by the SGD trainer, filled
+ * with random values.
+ *
+ * The dynamic layers are initialized by a functor before the context is
+ * built. A static layer and its dynamic version can be registered together
+ * (register_parity), to compare them side by side.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "dll_bench.hpp"
+
+#include "dll/dbn.hpp"
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+
+namespace dll_bench {
+
+/*!
+ * \brief The initializer of the layers without runtime dimensions
+ */
+struct no_init {
+    template <typename Layer>
+    void operator()(Layer& /*layer*/) const {}
+};
+
+/*!
+ * \brief A layer alone in a network, with its training context
+ */
+template <typename Layer, size_t B, dll::updater_type UT = dll::updater_type::SGD>
+struct layer_fixture {
+    using dbn_t = typename dll::dbn_desc<
+        dll::dbn_layers<Layer>,
+        dll::updater<UT>, dll::batch_size<B>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    using trainer_t = dll::sgd_trainer<dbn_t>;
+    using weight    = typename dbn_t::weight;
+
+    std::unique_ptr<dbn_t> dbn;         ///< The network
+    std::unique_ptr<trainer_t> trainer; ///< The trainer, owning the context
+
+    /*!
+     * \brief Create the network and the context of the layer
+     * \param init The initializer of the dimensions of the layer
+     */
+    template <typename Init = no_init>
+    explicit layer_fixture(Init init = {}) : dbn(std::make_unique<dbn_t>()) {
+        // The context of the dynamic layers depends on their dimensions
+        init(dbn->template layer_get<0>());
+
+        trainer = std::make_unique<trainer_t>(*dbn);
+
+        auto& ctx = context();
+
+        ctx.input  = etl::normal_generator<weight>(0.0, 1.0);
+        ctx.output = etl::normal_generator<weight>(0.0, 1.0);
+        ctx.errors = etl::normal_generator<weight>(0.0, 0.1);
+    }
+
+    /*!
+     * \brief Returns the layer
+     */
+    auto& layer() {
+        return std::get<0>(trainer->full_context).first;
+    }
+
+    /*!
+     * \brief Returns the training context of the layer
+     */
+    auto& context() {
+        return *std::get<0>(trainer->full_context).second;
+    }
+};
+
+/*!
+ * \brief Returns the cost of the given layer for a batch, if the layer has a
+ * cost model
+ */
+template <typename Layer>
+dll::layer_cost batch_cost(const Layer& layer, size_t batch) {
+    if constexpr (dll::has_layer_cost<Layer>::value) {
+        return layer.cost(batch);
+    } else {
+        return {};
+    }
+}
+
+/*!
+ * \brief Register the benchmarks of the kernels of a layer with the batch
+ * size B: "<name>/forward/B:<B>", "<name>/backward/B:<B>" and, for the
+ * layers with weights, "<name>/gradients/B:<B>".
+ */
+template <typename Layer, size_t B, typename Init = no_init>
+bool register_layer(const std::string& name, Init init = {}) {
+    const std::string suffix = "/B:" + std::to_string(B);
+
+    register_benchmark(name + "/forward" + suffix, [init](state& s) {
+        layer_fixture<Layer, B> f(init);
+
+        auto& layer = f.layer();
+        auto& ctx   = f.context();
+
+        s.set_cost(batch_cost(layer, B).forward);
+        s.items = B;
+
+        while (s.keep_running()) {
+            layer.train_forward_batch(ctx.output, ctx.input);
+            do_not_optimize(ctx.output);
+        }
+    });
+
+    register_benchmark(name + "/backward" + suffix, [init](state& s) {
+        layer_fixture<Layer, B> f(init);
+
+        auto& layer = f.layer();
+        auto& ctx   = f.context();
+
+        // The errors of the previous layer have the shape of the input
+        auto output = ctx.input;
+
+        s.set_cost(batch_cost(layer, B).backward);
+        s.items = B;
+
+        while (s.keep_running()) {
+            layer.backward_batch(output, ctx);
+            do_not_optimize(output);
+        }
+    });
+
+    if constexpr (dll::decay_layer_traits<Layer>::is_neural_layer()) {
+        register_benchmark(name + "/gradients" + suffix, [init](state& s) {
+            layer_fixture<Layer, B> f(init);
+
+            auto& layer = f.layer();
+            auto& ctx   = f.context();
+
+            s.set_cost(batch_cost(layer, B).gradients);
+            s.items = B;
+
+            while (s.keep_running()) {
+                layer.compute_gradients(ctx);
+                do_not_optimize(ctx);
+            }
+        });
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Register the benchmarks of a layer for each of the given batch sizes
+ */
+template <typename Layer, size_t... B>
+bool register_layer_batches(const std::string& name) {
+    return (register_layer<Layer, B>(name) && ...);
+}
+
+/*!
+ * \brief Register the benchmark of the update of the weights of a layer with
+ * the updater UT: "<name>/update/<updater>/B:<B>".
+ */
+template <typename Layer, size_t B, dll::updater_type UT, typename Init = no_init>
+bool register_updater(const std::string& name, Init init = {}) {
+    return register_benchmark(name + "/update/" + dll::to_string(UT) + "/B:" + std::to_string(B), [init](state& s) {
+        layer_fixture<Layer, B, UT> f(init);
+
+        auto& layer = f.layer();
+        auto& ctx   = f.context();
+
+        layer.compute_gradients(ctx);
+
+        s.items = B;
+
+        size_t epoch = 0;
+
+        while (s.keep_running()) {
+            f.trainer->template update_weights<UT>(++epoch, layer, ctx, B);
+            do_not_optimize(layer);
+        }
+    });
+}
+
+/*!
+ * \brief Register the benchmarks of a static layer and of its dynamic
+ * version, with the batch size B: "<name>/static/..." and "<name>/dyn/...",
+ * including the update of the weights by SGD for the layers with weights.
+ *
+ * \param init The initializer of the dimensions of the dynamic layer, which
+ * must be the ones of the static layer
+ */
+template <typename Static, typename Dyn, size_t B, typename Init>
+bool register_parity(const std::string& name, Init init) {
+    register_layer<Static, B>(name + "/static");
+    register_layer<Dyn, B>(name + "/dyn", init);
+
+    if constexpr (dll::decay_layer_traits<Static>::is_neural_layer()) {
+        register_updater<Static, B, dll::updater_type::SGD>(name + "/static");
+        register_updater<Dyn, B, dll::updater_type::SGD>(name + "/dyn", init);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Register the parity benchmarks of a layer for each of the given
+ * batch sizes
+ */
+template <typename Static, typename Dyn, size_t... B, typename Init>
+bool register_parity_batches(const std::string& name, Init init) {
+    return (register_parity<Static, Dyn, B>(name, init) && ...);
+}
+
+} //end of dll_bench namespace
@@ -0,0 +1,33 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "layer_bench.hpp"
+
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/conv_same_layer.hpp"
+#include "dll/neural/batch_normalization_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/pooling/avgp_layer.hpp"
+
+namespace {
+
+using namespace dll_bench;
+
+// Convolutions of the usual MNIST and CIFAR sizes
+const bool conv_1 = register_layer_batches<dll::conv_layer<1, 28, 28, 8, 5, 5, dll::relu>, 32, 128>("conv/1x28x28/8x5x5");
+const bool conv_2 = register_layer_batches<dll::conv_layer<8, 12, 12, 16, 5, 5, dll::relu>, 32, 128>("conv/8x12x12/16x5x5");
+const bool conv_3 = register_layer_batches<dll::conv_layer<3, 32, 32, 32, 3, 3, dll::relu>, 32, 128>("conv/3x32x32/32x3x3");
+const bool conv_4 = register_layer_batches<dll::conv_layer<32, 16, 16, 64, 3, 3, dll::relu>, 32, 128>("conv/32x16x16/64x3x3");
+
+const bool conv_same_1 = register_layer_batches<dll::conv_same_layer<32, 16, 16, 32, 3, 3, dll::relu>, 32, 128>("conv_same/32x16x16/32x3x3");
+
+// Pooling and normalization of the convolutions
+const bool mp_1   = register_layer_batches<dll::mp_2d_layer<32, 32, 32, 2, 2>, 32, 128>("mp_2d/32x32x32/2x2");
+const bool avgp_1 = register_layer_batches<dll::avgp_2d_layer<32, 32, 32, 2, 2>, 32, 128>("avgp_2d/32x32x32/2x2");
+const bool bn_1   = register_layer_batches<dll::batch_normalization_4d_layer<32, 16, 16>, 32, 128>("bn_4d/32x16x16");
+
+} // end of anonymous namespace
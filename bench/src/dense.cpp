@@ -0,0 +1,26 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "layer_bench.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/batch_normalization_layer.hpp"
+
+namespace {
+
+using namespace dll_bench;
+
+// Dense layers of the usual MLP sizes
+const bool dense_1 = register_layer_batches<dll::dense_layer<784, 500, dll::relu>, 32, 128>("dense/784x500");
+const bool dense_2 = register_layer_batches<dll::dense_layer<500, 250, dll::relu>, 32, 128>("dense/500x250");
+const bool dense_3 = register_layer_batches<dll::dense_layer<1024, 1024, dll::relu>, 32, 128>("dense/1024x1024");
+const bool dense_4 = register_layer_batches<dll::dense_layer<250, 10, dll::softmax>, 32, 128>("dense/250x10");
+
+// Batch normalization after a dense layer
+const bool bn_1 = register_layer_batches<dll::batch_normalization_2d_layer<1024>, 32, 128>("bn_2d/1024");
+
+} // end of anonymous namespace
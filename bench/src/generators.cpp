@@ -0,0 +1,100 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <string>
+#include <vector>
+
+#include "dll_bench.hpp"
+
+#include "dll/generators.hpp"
+
+namespace {
+
+using namespace dll_bench;
+
+constexpr size_t samples = 1000; ///< The number of samples of the dataset
+
+using sample_t = etl::fast_dyn_matrix<float, 1, 28, 28>; ///< The type of one sample
+
+/*!
+ * \brief Returns a random dataset of MNIST-sized images
+ */
+const std::vector<sample_t>& dataset() {
+    static std::vector<sample_t> images = [] {
+        std::vector<sample_t> images(samples);
+
+        for (auto& image : images) {
+            image = etl::uniform_generator<float>(0.0, 255.0);
+        }
+
+        return images;
+    }();
+
+    return images;
+}
+
+/*!
+ * \brief Returns random labels for the dataset
+ */
+const std::vector<size_t>& labels() {
+    static std::vector<size_t> labels = [] {
+        std::vector<size_t> labels(samples);
+
+        for (size_t i = 0; i < samples; ++i) {
+            labels[i] = i % 10;
+        }
+
+        return labels;
+    }();
+
+    return labels;
+}
+
+/*!
+ * \brief Register the benchmark of one epoch of a generator alone, at full
+ * speed: "generator/<name>". The items are the samples, the throughput of
+ * the generator is given in samples per second.
+ */
+template <typename Desc>
+bool register_generator(const std::string& name) {
+    return register_benchmark("generator/" + name, [](state& s) {
+        auto generator = dll::make_generator(dataset(), labels(), samples, 10, Desc{});
+
+        generator->set_train();
+
+        s.items = samples;
+
+        while (s.keep_running()) {
+            generator->reset();
+
+            while (generator->has_next_batch()) {
+                auto data  = generator->data_batch();
+                auto label = generator->label_batch();
+
+                do_not_optimize(data);
+                do_not_optimize(label);
+
+                generator->next_batch();
+            }
+        }
+    });
+}
+
+const bool inmemory = register_generator<dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical>>("inmemory/plain")
+    && register_generator<dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>>>("inmemory/scale")
+    && register_generator<dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>, dll::noise<20>>>("inmemory/noise")
+    && register_generator<dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>, dll::random_crop<24, 24>>>("inmemory/crop")
+    && register_generator<dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>, dll::horizontal_mirroring>>("inmemory/mirror")
+    && register_generator<dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>, dll::elastic_distortion<3>>>("inmemory/elastic")
+    && register_generator<dll::inmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>, dll::random_crop<24, 24>, dll::noise<20>, dll::horizontal_mirroring>>("inmemory/all");
+
+const bool outmemory = register_generator<dll::outmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>>>("outmemory/plain")
+    && register_generator<dll::outmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>, dll::threaded>>("outmemory/threaded")
+    && register_generator<dll::outmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>, dll::noise<20>>>("outmemory/noise")
+    && register_generator<dll::outmemory_data_generator_desc<dll::batch_size<100>, dll::categorical, dll::scale_pre<255>, dll::random_crop<24, 24>, dll::noise<20>, dll::horizontal_mirroring>>("outmemory/all");
+
+} // end of anonymous namespace
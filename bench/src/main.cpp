@@ -0,0 +1,36 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdlib>
+#include <new>
+
+#include "dll_bench.hpp"
+
+// The global operator new is replaced to count the allocations of the
+// benchmarks (the array and sized versions use these ones)
+
+void* operator new(std::size_t size) {
+    dll_bench::allocation_counter().fetch_add(1, std::memory_order_relaxed);
+
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t /*size*/) noexcept {
+    std::free(memory);
+}
+
+int main(int argc, char* argv[]) {
+    return dll_bench::run_benchmarks(argc, argv);
+}
@@ -0,0 +1,91 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Parity benchmarks of the static layers and of their dynamic
+ * versions, for the same shapes.
+ *
+ * Run with --filter=parity/ to only compare the two paths.
+ */
+
+#include "layer_bench.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/batch_normalization_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/pooling/avgp_layer.hpp"
+
+namespace {
+
+using namespace dll_bench;
+
+/*!
+ * \brief Register the parity benchmarks of a dense layer of the given shape
+ */
+template <size_t V, size_t H, size_t... B>
+bool dense_parity() {
+    return register_parity_batches<dll::dense_layer<V, H, dll::relu>, dll::dyn_dense_layer<dll::relu>, B...>(
+        "parity/dense/" + std::to_string(V) + "x" + std::to_string(H), [](auto& layer) { layer.init_layer(V, H); });
+}
+
+/*!
+ * \brief Register the parity benchmarks of a convolutional layer of the
+ * given shape
+ */
+template <size_t C, size_t N, size_t K, size_t W, size_t... B>
+bool conv_parity() {
+    return register_parity_batches<dll::conv_layer<C, N, N, K, W, W, dll::relu>, dll::dyn_conv_layer<dll::relu>, B...>(
+        "parity/conv/" + std::to_string(C) + "x" + std::to_string(N) + "x" + std::to_string(N) + "/" + std::to_string(K) + "x" + std::to_string(W) + "x" + std::to_string(W),
+        [](auto& layer) { layer.init_layer(C, N, N, K, W, W); });
+}
+
+/*!
+ * \brief Register the parity benchmarks of the pooling layers of the given
+ * shape
+ */
+template <size_t C, size_t N, size_t P, size_t... B>
+bool pooling_parity() {
+    const std::string shape = std::to_string(C) + "x" + std::to_string(N) + "x" + std::to_string(N) + "/" + std::to_string(P) + "x" + std::to_string(P);
+
+    auto init = [](auto& layer) { layer.init_layer(C, N, N, P, P); };
+
+    return register_parity_batches<dll::mp_2d_layer<C, N, N, P, P>, dll::dyn_mp_2d_layer<>, B...>("parity/mp_2d/" + shape, init)
+           && register_parity_batches<dll::avgp_2d_layer<C, N, N, P, P>, dll::dyn_avgp_2d_layer<>, B...>("parity/avgp_2d/" + shape, init);
+}
+
+/*!
+ * \brief Register the parity benchmarks of the batch normalization layers
+ * of the given shape
+ */
+template <size_t C, size_t N, size_t... B>
+bool bn_parity() {
+    return register_parity_batches<dll::batch_normalization_2d_layer<C * N * N>, dll::dyn_batch_normalization_2d_layer<>, B...>(
+               "parity/bn_2d/" + std::to_string(C * N * N), [](auto& layer) { layer.init_layer(C * N * N); })
+           && register_parity_batches<dll::batch_normalization_4d_layer<C, N, N>, dll::dyn_batch_normalization_4d_layer<>, B...>(
+               "parity/bn_4d/" + std::to_string(C) + "x" + std::to_string(N) + "x" + std::to_string(N), [](auto& layer) { layer.init_layer(C, N, N); });
+}
+
+// Dense layers, from small to large
+const bool dense_1 = dense_parity<100, 10, 1, 32, 128>();
+const bool dense_2 = dense_parity<784, 500, 1, 32, 128>();
+const bool dense_3 = dense_parity<1024, 1024, 1, 32, 128>();
+
+// Convolutions of the usual MNIST and CIFAR sizes
+const bool conv_1 = conv_parity<1, 28, 8, 5, 1, 32, 128>();
+const bool conv_2 = conv_parity<3, 32, 32, 3, 1, 32, 128>();
+const bool conv_3 = conv_parity<32, 16, 64, 3, 1, 32, 128>();
+
+// Pooling and normalization of the convolutions
+const bool pooling_1 = pooling_parity<8, 24, 2, 1, 32, 128>();
+const bool pooling_2 = pooling_parity<32, 32, 2, 1, 32, 128>();
+
+const bool bn_1 = bn_parity<8, 12, 32, 128>();
+const bool bn_2 = bn_parity<32, 16, 32, 128>();
+
+} // end of anonymous namespace
@@ -0,0 +1,58 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <memory>
+
+#include "dll_bench.hpp"
+
+#include "dll/rbm/rbm.hpp"
+
+namespace {
+
+using namespace dll_bench;
+
+/*!
+ * \brief Register the benchmark of the training of a RBM on one batch with
+ * the given contrastive divergence trainer
+ */
+template <typename RBM, template <typename> class Trainer>
+bool register_cd(const std::string& name) {
+    return register_benchmark(name + "/B:" + std::to_string(RBM::batch_size), [](state& s) {
+        using weight = typename RBM::weight;
+
+        auto rbm     = std::make_unique<RBM>();
+        auto trainer = std::make_unique<Trainer<RBM>>(*rbm);
+
+        etl::fast_dyn_matrix<weight, RBM::batch_size, RBM::num_visible> input;
+        input = etl::uniform_generator<weight>(0.0, 1.0) > 0.5;
+
+        dll::rbm_training_context context;
+
+        s.set_cost(rbm->cost(RBM::batch_size).gradients);
+        s.items = RBM::batch_size;
+
+        while (s.keep_running()) {
+            trainer->train_batch(input, input, context);
+            do_not_optimize(rbm->w);
+        }
+    });
+}
+
+template <typename RBM>
+using cd2_trainer_t = dll::cd_trainer<2, RBM>;
+
+using rbm_1 = dll::rbm<784, 500, dll::batch_size<64>, dll::momentum>;
+using rbm_2 = dll::rbm<784, 500, dll::batch_size<256>, dll::momentum>;
+using rbm_3 = dll::rbm<500, 1000, dll::batch_size<64>, dll::momentum, dll::hidden<dll::unit_type::RELU>>;
+
+const bool cd1_1  = register_cd<rbm_1, dll::cd1_trainer_t>("rbm/784x500/cd1");
+const bool cd1_2  = register_cd<rbm_2, dll::cd1_trainer_t>("rbm/784x500/cd1");
+const bool cd2_1  = register_cd<rbm_1, cd2_trainer_t>("rbm/784x500/cd2");
+const bool pcd1_1 = register_cd<rbm_1, dll::pcd1_trainer_t>("rbm/784x500/pcd1");
+const bool cd1_3  = register_cd<rbm_3, dll::cd1_trainer_t>("rbm/500x1000/relu/cd1");
+
+} // end of anonymous namespace
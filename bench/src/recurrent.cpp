@@ -0,0 +1,22 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "layer_bench.hpp"
+
+#include "dll/neural/rnn_layer.hpp"
+#include "dll/neural/lstm_layer.hpp"
+
+namespace {
+
+using namespace dll_bench;
+
+// Recurrent layers over MNIST rows (28 time steps of 28 values)
+const bool rnn_1  = register_layer_batches<dll::rnn_layer<28, 28, 100, dll::last_only>, 32, 128>("rnn/28x28/100");
+const bool lstm_1 = register_layer_batches<dll::lstm_layer<28, 28, 100, dll::last_only>, 32, 128>("lstm/28x28/100");
+const bool lstm_2 = register_layer_batches<dll::lstm_layer<50, 64, 256, dll::last_only>, 32>("lstm/50x64/256");
+
+} // end of anonymous namespace
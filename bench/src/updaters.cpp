@@ -0,0 +1,32 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "layer_bench.hpp"
+
+#include "dll/neural/dense_layer.hpp"
+
+namespace {
+
+using namespace dll_bench;
+
+using layer_t = dll::dense_layer<1024, 1024, dll::relu>;
+
+// The update of one million weights by each updater
+const bool sgd          = register_updater<layer_t, 128, dll::updater_type::SGD>("dense/1024x1024");
+const bool momentum     = register_updater<layer_t, 128, dll::updater_type::MOMENTUM>("dense/1024x1024");
+const bool nesterov     = register_updater<layer_t, 128, dll::updater_type::NESTEROV>("dense/1024x1024");
+const bool adagrad      = register_updater<layer_t, 128, dll::updater_type::ADAGRAD>("dense/1024x1024");
+const bool rmsprop      = register_updater<layer_t, 128, dll::updater_type::RMSPROP>("dense/1024x1024");
+const bool adadelta     = register_updater<layer_t, 128, dll::updater_type::ADADELTA>("dense/1024x1024");
+const bool adam         = register_updater<layer_t, 128, dll::updater_type::ADAM>("dense/1024x1024");
+const bool adam_correct = register_updater<layer_t, 128, dll::updater_type::ADAM_CORRECT>("dense/1024x1024");
+const bool adamax       = register_updater<layer_t, 128, dll::updater_type::ADAMAX>("dense/1024x1024");
+const bool nadam        = register_updater<layer_t, 128, dll::updater_type::NADAM>("dense/1024x1024");
+const bool lars         = register_updater<layer_t, 128, dll::updater_type::LARS>("dense/1024x1024");
+const bool lamb         = register_updater<layer_t, 128, dll::updater_type::LAMB>("dense/1024x1024");
+
+} // end of anonymous namespace
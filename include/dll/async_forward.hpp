@@ -0,0 +1,277 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Asynchronous forward propagation on the scheduler of DLL.
+ *
+ * dbn::forward_async() copies the batch and forwards it in a detached task
+ * of the scheduler, with its own inference_session. The returned operation
+ * can be waited for, given a completion callback or, in C++20, awaited by a
+ * coroutine (co_await net.forward_async(batch)), which is then resumed by
+ * the thread that finished the forward propagation.
+ *
+ * An operation can be cancelled and can have a deadline. The forward
+ * propagation of a batch cannot be interrupted: an operation cancelled (or
+ * expired) before it starts is not run at all and an operation cancelled
+ * while running completes immediately, its output being discarded.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#define DLL_COROUTINES
+#endif
+
+#include "etl/etl.hpp"
+
+#include "dll/inference_session.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The status of an asynchronous forward propagation
+ */
+enum class forward_status {
+    DONE,      ///< The output is available
+    CANCELLED, ///< The operation has been cancelled
+    EXPIRED    ///< The deadline of the operation has passed before its output was available
+};
+
+/*!
+ * \brief The result of an asynchronous forward propagation
+ */
+template <typename Output>
+struct forward_result {
+    forward_status status; ///< The status of the operation
+    Output output;         ///< The output of the network (only valid if DONE)
+
+    /*!
+     * \brief Indicates if the output is available
+     */
+    explicit operator bool() const {
+        return status == forward_status::DONE;
+    }
+};
+
+/*!
+ * \brief An asynchronous forward propagation of a batch through a network.
+ *
+ * The operation can be destroyed at any time, the task then discards its
+ * output.
+ */
+template <typename DBN, typename Input>
+struct async_forward {
+    using dbn_t     = DBN;                       ///< The network type
+    using session_t = inference_session<dbn_t>;  ///< The type of inference session
+    using clock     = std::chrono::steady_clock; ///< The clock used for deadlines
+
+    using input_t  = std::decay_t<decltype(etl::force_temporary(std::declval<const Input&>()))>;                                              ///< The type of the copy of the batch
+    using output_t = std::decay_t<decltype(etl::force_temporary(std::declval<session_t&>().forward_batch(std::declval<const input_t&>())))>; ///< The type of the output
+    using result_t = forward_result<output_t>;                                                                                                ///< The type of the result
+
+    /*!
+     * \brief Start the forward propagation of the given batch, in a task of
+     * the local scheduler
+     *
+     * \param dbn The network, must not be modified until the end of the operation
+     * \param batch The batch to forward (copied)
+     * \param deadline The time after which the output is not wanted anymore
+     */
+    async_forward(const dbn_t& dbn, const Input& batch, clock::time_point deadline)
+            : state(std::make_shared<shared_state>(dbn, batch, deadline)) {
+        local_scheduler().spawn([state = this->state] { state->run(); });
+    }
+
+    /*!
+     * \brief Indicates if the operation is complete
+     */
+    bool ready() const {
+        std::lock_guard<std::mutex> l(state->lock);
+        return state->done;
+    }
+
+    /*!
+     * \brief Cancel the operation. The operation completes immediately as
+     * CANCELLED, unless it is already complete.
+     */
+    void cancel() {
+        state->complete(forward_status::CANCELLED);
+    }
+
+    /*!
+     * \brief Set the function to call when the operation completes, from the
+     * thread completing it (immediately if the operation is already
+     * complete). Only one function can be set.
+     */
+    void on_complete(std::function<void()> callback) {
+        std::unique_lock<std::mutex> l(state->lock);
+
+        if (state->done) {
+            l.unlock();
+            callback();
+            return;
+        }
+
+        state->continuation = std::move(callback);
+    }
+
+    /*!
+     * \brief Wait for the operation to complete
+     */
+    void wait() const {
+        std::unique_lock<std::mutex> l(state->lock);
+        state->condition.wait(l, [this] { return state->done; });
+    }
+
+    /*!
+     * \brief Wait for the operation to complete and return its result. The
+     * errors of the forward propagation are rethrown.
+     */
+    result_t get() {
+        wait();
+
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+
+        return {state->status, std::move(state->output)};
+    }
+
+#ifdef DLL_COROUTINES
+    /*!
+     * \brief Indicates if the awaiting coroutine can continue without
+     * suspension
+     */
+    bool await_ready() const {
+        return ready();
+    }
+
+    /*!
+     * \brief Suspend the awaiting coroutine until the completion of the
+     * operation
+     * \return false if the operation completed in the meantime
+     */
+    bool await_suspend(std::coroutine_handle<> handle) {
+        std::lock_guard<std::mutex> l(state->lock);
+
+        if (state->done) {
+            return false;
+        }
+
+        state->continuation = [handle] { handle.resume(); };
+
+        return true;
+    }
+
+    /*!
+     * \brief Returns the result to the awaiting coroutine
+     */
+    result_t await_resume() {
+        return get();
+    }
+#endif
+
+private:
+    /*!
+     * \brief The state shared by the operation and its task
+     */
+    struct shared_state {
+        session_t session;                ///< The session of the operation
+        input_t input;                    ///< The copy of the batch
+        const clock::time_point deadline; ///< The deadline of the operation
+
+        std::mutex lock;                              ///< The lock protecting the completion
+        std::condition_variable condition;            ///< The condition of the threads waiting for the completion
+        bool done             = false;                ///< Indicates if the operation is complete
+        forward_status status = forward_status::DONE; ///< The status of the operation
+        output_t output;                              ///< The output of the operation
+        std::exception_ptr error;                     ///< The error of the forward propagation, if any
+        std::function<void()> continuation;           ///< The function to call on completion
+
+        shared_state(const dbn_t& dbn, const Input& batch, clock::time_point deadline)
+                : session(dbn, etl::dim<0>(batch)), input(etl::force_temporary(batch)), deadline(deadline) {}
+
+        /*!
+         * \brief Forward the batch, unless the operation is already complete
+         */
+        void run() {
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                if (done) {
+                    return;
+                }
+            }
+
+            if (clock::now() > deadline) {
+                complete(forward_status::EXPIRED);
+                return;
+            }
+
+            dll::auto_timer timer("net:forward_async");
+
+            output_t result;
+            std::exception_ptr e;
+
+            try {
+                result = etl::force_temporary(session.forward_batch(input));
+            } catch (...) {
+                e = std::current_exception();
+            }
+
+            if (clock::now() > deadline) {
+                complete(forward_status::EXPIRED);
+            } else {
+                complete(forward_status::DONE, std::move(result), e);
+            }
+        }
+
+        /*!
+         * \brief Complete the operation, unless it is already complete, and
+         * call its continuation
+         */
+        void complete(forward_status s, output_t&& result = {}, std::exception_ptr e = nullptr) {
+            std::function<void()> next;
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                if (done) {
+                    return;
+                }
+
+                done   = true;
+                status = s;
+                output = std::move(result);
+                error  = e;
+
+                next = std::move(continuation);
+            }
+
+            condition.notify_all();
+
+            if (next) {
+                next();
+            }
+        }
+    };
+
+    std::shared_ptr<shared_state> state; ///< The state shared with the task
+};
+
+} //end of dll namespace
@@ -130,24 +130,46 @@ struct horizontal_id;
 struct vertical_id;
 struct shuffle_id;
 struct shuffle_pre_id;
+struct pipeline_pre_id;
+struct feature_store_id;
 struct svm_concatenate_id;
 struct svm_scale_id;
 struct init_weights_id;
 struct clip_gradients_id;
+struct clip_global_norm_id;
+struct lazy_decay_id;
+struct sync_batch_norm_id;
 struct weight_type_id;
 struct free_energy_id;
+struct sparse_input_id;
+struct bit_packed_id;
+struct sparse_gradients_id;
+struct mixed_precision_id;
 struct no_epoch_error_id;
 struct random_crop_id;
 struct batch_mode_id;
 struct dbn_only_id;
 struct last_only_id;
+struct stateful_id;
+struct embedding_input_id;
+struct time_major_id;
+struct reverse_id;
+struct argmax_indices_id;
 struct horizontal_mirroring_id;
 struct vertical_mirroring_id;
 struct categorical_id;
 struct threaded_id;
+struct augmentation_workers_id;
+struct uint8_storage_id;
+struct compressed_storage_id;
+struct shuffle_shards_id;
+struct read_threads_id;
+struct balanced_sampling_id;
+struct importance_sampling_id;
 struct nop_id;
 struct no_bias_id;
 struct elastic_distortion_id;
+struct elastic_bank_id;
 struct noise_id;
 struct scale_pre_id;
 struct normalize_pre_id;
@@ -157,6 +179,21 @@ struct updater_id;
 struct early_stopping_id;
 struct early_training_id;
 struct truncate_id;
+struct bf16_storage_id;
+struct checkpointing_id;
+struct data_parallel_id;
+struct pipeline_stages_id;
+struct fused_updater_id;
+struct flat_parameters_id;
+struct overlap_updates_id;
+struct accumulate_gradients_id;
+struct ema_weights_id;
+struct numa_id;
+struct threads_id;
+struct async_validation_id;
+struct check_finite_id;
+struct freeze_layers_id;
+struct memory_budget_id;
 
 /*!
  * \brief Sets the minibatch size
@@ -384,6 +421,55 @@ struct categorical : basic_conf_elt<categorical_id> {};
  */
 struct threaded : basic_conf_elt<threaded_id> {};
 
+/*!
+ * \brief Sets the number of threads used for data augmentation
+ * \tparam N The number of augmentation workers
+ */
+template <size_t N>
+struct augmentation_workers : value_conf_elt<augmentation_workers_id, size_t, N> {};
+
+/*!
+ * \brief Store the inputs of the generator in uint8 and convert them to the
+ * weight type only when a batch is produced.
+ */
+struct uint8_storage : basic_conf_elt<uint8_storage_id> {};
+
+/*!
+ * \brief Store the inputs of the generator in compressed uint8 samples and
+ * decompress them only when a batch is produced. This implies uint8_storage.
+ */
+struct compressed_storage : basic_conf_elt<compressed_storage_id> {};
+
+/*!
+ * \brief Shuffle the samples by shards of contiguous samples: the order of
+ * the shards and the order of the samples inside each shard are shuffled,
+ * so that the reads stay local.
+ * \tparam S The number of samples of a shard
+ */
+template <size_t S>
+struct shuffle_shards : value_conf_elt<shuffle_shards_id, size_t, S> {};
+
+/*!
+ * \brief Sets the number of threads reading the shards of a dataset
+ * \tparam N The number of reader threads
+ */
+template <size_t N>
+struct read_threads : value_conf_elt<read_threads_id, size_t, N> {};
+
+/*!
+ * \brief Draw class-balanced epochs: each sample is drawn from a class
+ * chosen with the same probability for all the classes (or with the weights
+ * set on the generator), instead of shuffling the samples.
+ */
+struct balanced_sampling : basic_conf_elt<balanced_sampling_id> {};
+
+/*!
+ * \brief Draw the epochs by importance: each sample is drawn with a
+ * probability growing with its last loss and its errors are weighted so
+ * that the gradient stays unbiased.
+ */
+struct importance_sampling : basic_conf_elt<importance_sampling_id> {};
+
 /*!
  * \brief Sets the elastic distortion kernel
  * \tparam K The elastic distortion kernel
@@ -391,6 +477,14 @@ struct threaded : basic_conf_elt<threaded_id> {};
 template <size_t K>
 struct elastic_distortion : value_conf_elt<elastic_distortion_id, size_t, K> {};
 
+/*!
+ * \brief Precompute a bank of displacement fields for the elastic
+ * distortion, instead of drawing and blurring a new field for each image
+ * \tparam N The number of fields of the bank
+ */
+template <size_t N>
+struct elastic_bank : value_conf_elt<elastic_bank_id, size_t, N> {};
+
 /*!
  * \brief Sets the noise
  * \tparam N The percent of noise
@@ -438,11 +532,63 @@ struct shuffle : basic_conf_elt<shuffle_id> {};
  */
 struct shuffle_pre : basic_conf_elt<shuffle_pre_id> {};
 
+/*!
+ * \brief dbn: Pretrain all the layers at the same time, each layer being
+ * trained on the features of the previous layer while it is still being
+ * trained (batch mode only).
+ */
+struct pipeline_pre : basic_conf_elt<pipeline_pre_id> {};
+
+/*!
+ * \brief dbn: Store the features of each pretrained layer in a memory-mapped
+ * file (spilled to disk), instead of in memory, to pretrain the next layer.
+ *
+ * In batch mode, the features computed by the lower layers during the first
+ * epoch of each layer are stored and read back in the next epochs, instead
+ * of being recomputed.
+ *
+ * \tparam Bits The number of bits of the stored values (32 or 16 for bfloat16)
+ */
+template <size_t Bits = 32>
+struct feature_store : value_conf_elt<feature_store_id, size_t, Bits> {};
+
 /*!
  * \brief Enable free energy computation
  */
 struct free_energy : basic_conf_elt<free_energy_id> {};
 
+/*!
+ * \brief Indicates that the inputs of the layer are very sparse. The
+ * products with the inputs are then computed on their compressed (CSR) form.
+ */
+struct sparse_input : basic_conf_elt<sparse_input_id> {};
+
+/*!
+ * \brief Pack the binary hidden samples of the RBM into bits for their
+ * products with the weights (the reconstruction of the visible units). The
+ * products then only add the weights of the active units.
+ */
+struct bit_packed : basic_conf_elt<bit_packed_id> {};
+
+/*!
+ * \brief Compute and apply the gradients of an embedding layer only on the
+ * rows of the words of the batch. With MOMENTUM and ADAM, the state of the
+ * other rows is not decayed (lazy updates), and the weight decay is only
+ * applied to the touched rows.
+ */
+struct sparse_gradients : basic_conf_elt<sparse_gradients_id> {};
+
+/*!
+ * \brief Keep the weights of the RBM in bfloat16 precision during training,
+ * with a single precision master copy in the trainer. The updates are
+ * applied to the master copy and stochastically rounded into the weights.
+ *
+ * On a network trained with SGD, the weights of the layers are kept in
+ * bfloat16 precision, the master copy is kept in the updater contexts, and
+ * dynamic loss scaling is used.
+ */
+struct mixed_precision : basic_conf_elt<mixed_precision_id> {};
+
 /*!
  * \brief Disable error calculation on epoch.
  */
@@ -453,6 +599,24 @@ struct no_epoch_error : basic_conf_elt<no_epoch_error_id> {};
  */
 struct clip_gradients : basic_conf_elt<clip_gradients_id> {};
 
+/*!
+ * \brief With clip_gradients, clip the gradients of all the layers together,
+ * by their global norm, instead of each tensor by its own norm.
+ */
+struct clip_global_norm : basic_conf_elt<clip_global_norm_id> {};
+
+/*!
+ * \brief Apply the weight decay of the layers with sparse gradients lazily,
+ * decoupled from the gradients, only to the rows touched by the batches.
+ */
+struct lazy_decay : basic_conf_elt<lazy_decay_id> {};
+
+/*!
+ * \brief Normalize the batch normalization layers with the statistics of the
+ * whole batch, synchronized over the data-parallel replicas and the ranks.
+ */
+struct sync_batch_norm : basic_conf_elt<sync_batch_norm_id> {};
+
 /*!
  * \brief Indicates that the layer is only made to be used in a DBN.
  *
@@ -467,6 +631,55 @@ struct dbn_only : basic_conf_elt<dbn_only_id> {};
  */
 struct last_only : basic_conf_elt<last_only_id> {};
 
+/*!
+ * \brief Carry the states of a recurrent layer from one batch to the next.
+ *
+ * Long sequences are fed chunk by chunk, each sample of a batch continuing
+ * the same sample of the previous batch. The gradients are truncated at the
+ * start of each chunk. The states must be reset (reset_state()) between
+ * independent sequences and the training data must not be shuffled.
+ */
+struct stateful : basic_conf_elt<stateful_id> {};
+
+/*!
+ * \brief Indicates that the input of a LSTM layer is the output of an
+ * embedding layer.
+ *
+ * The same token always gives the same input vector, so the input
+ * projections are only computed once per distinct vector of the batch and
+ * then looked up, instead of a GEMM over all the time steps.
+ */
+struct embedding_input : basic_conf_elt<embedding_input_id> {};
+
+/*!
+ * \brief Lay out the batches of a recurrent stack time step by time step.
+ *
+ * The batches keep their (Batch x time_steps x ...) shape but their memory
+ * holds all the samples of each time step contiguously, which is the layout
+ * used internally by the recurrent layers. The embedding, recurrent (RNN and
+ * LSTM) and recurrent last layers then exchange their batches without any
+ * rearrangement. All the layers between the embedding layer and the
+ * recurrent last layer must use the same layout.
+ */
+struct time_major : basic_conf_elt<time_major_id> {};
+
+/*!
+ * \brief Process the sequences of a recurrent layer from their last time step
+ * to their first one.
+ *
+ * The outputs (and the errors) keep the time steps of the input. Merged with
+ * a layer processing the sequences forward (merge_layer), this gives a
+ * bidirectional layer, the two directions being computed concurrently.
+ */
+struct reverse : basic_conf_elt<reverse_id> {};
+
+/*!
+ * \brief Record the position of the maximum of each window of a max pooling
+ * layer during training, the backward pass is then a scatter of the errors
+ * instead of a new scan of the input.
+ */
+struct argmax_indices : basic_conf_elt<argmax_indices_id> {};
+
 /*!
  * \brief Do nothing (for TMP)
  */
@@ -482,6 +695,11 @@ struct no_bias : basic_conf_elt<no_bias_id> {};
  */
 struct batch_mode : basic_conf_elt<batch_mode_id> {};
 
+/*!
+ * \brief Store (and load) the weights of the DBN in bfloat16
+ */
+struct bf16_storage : basic_conf_elt<bf16_storage_id> {};
+
 /*!
  * \brief Sets the BPTT steps to truncate
  * \tparam T The truncate steps
@@ -489,6 +707,148 @@ struct batch_mode : basic_conf_elt<batch_mode_id> {};
 template <size_t T>
 struct truncate : value_conf_elt<truncate_id, size_t, T> {};
 
+/*!
+ * \brief Only keep the activations of every N-th layer during SGD and
+ * recompute the other ones during the backward pass.
+ *
+ * The training forward pass of the recomputed layers is run twice per batch,
+ * stochastic layers (dropout) draw new masks when recomputed.
+ * \tparam N The number of layers between two checkpoints
+ */
+template <size_t N>
+struct checkpointing : value_conf_elt<checkpointing_id, size_t, N> {};
+
+/*!
+ * \brief Split each batch of SGD across N worker replicas and reduce their
+ * gradients before the update.
+ * \tparam N The number of workers
+ */
+template <size_t N>
+struct data_parallel : value_conf_elt<data_parallel_id, size_t, N> {};
+
+/*!
+ * \brief Pipeline the data-parallel SGD replicas over N stages of
+ * consecutive layers.
+ *
+ * The replicas are the micro-batches of the pipeline. Each stage runs on
+ * its own thread (pinned to a NUMA node, in turn) and a micro-batch enters
+ * a stage as soon as the previous stage has forwarded it. The partition and
+ * the schedule of the stages are set at runtime (pipeline_partition and
+ * pipeline).
+ *
+ * This has no effect without data-parallel SGD.
+ *
+ * \tparam N The number of stages
+ */
+template <size_t N>
+struct pipeline_stages : value_conf_elt<pipeline_stages_id, size_t, N> {};
+
+/*!
+ * \brief Apply the decay, the clipping and the updater of SGD to each
+ * parameter in a single sweep over the parameter and its state.
+ */
+struct fused_updater : basic_conf_elt<fused_updater_id> {};
+
+/*!
+ * \brief Keep a contiguous copy of all the gradients of the network (for the
+ * distributed reduction), so that they are reduced as a single buffer.
+ */
+struct flat_parameters : basic_conf_elt<flat_parameters_id> {};
+
+/*!
+ * \brief Compute, reduce and apply the gradients of each layer on a helper
+ * thread, as soon as its errors have been back-propagated during SGD.
+ *
+ * The gradients are reduced layer by layer. This has no effect with
+ * checkpointing or data-parallel SGD.
+ */
+struct overlap_updates : basic_conf_elt<overlap_updates_id> {};
+
+/*!
+ * \brief Accumulate the gradients of K batches before applying them once
+ * during SGD, for an effective batch size of K times the batch size.
+ *
+ * This has no effect with data-parallel SGD.
+ * \tparam K The number of batches of one update
+ */
+template <size_t K>
+struct accumulate_gradients : value_conf_elt<accumulate_gradients_id, size_t, K> {};
+
+/*!
+ * \brief Freeze the N first layers of the network during SGD, for
+ * fine-tuning only the top layers.
+ *
+ * The frozen layers are forwarded in inference mode, the errors are not
+ * back-propagated into them and they have neither gradients nor state of the
+ * updater.
+ * \tparam N The number of frozen layers
+ */
+template <size_t N>
+struct freeze_layers : value_conf_elt<freeze_layers_id, size_t, N> {};
+
+/*!
+ * \brief Maintain an exponential moving average of the weights during SGD,
+ * in a shadow copy of the network. With the fused updater, the average is
+ * updated in the same sweep as the weights.
+ */
+struct ema_weights : basic_conf_elt<ema_weights_id> {};
+
+/*!
+ * \brief Place the data-parallel SGD replicas on the NUMA nodes of the
+ * machine: each node holds its own copy of the weights and the contexts of
+ * its replicas, allocated and trained by threads pinned to the node. The
+ * gradients of the nodes are reduced once per step.
+ *
+ * This has no effect without data-parallel SGD.
+ */
+struct numa : basic_conf_elt<numa_id> {};
+
+/*!
+ * \brief Sets the number of threads of the network. The network then has
+ * its own scheduler, used during training and within its resource scopes.
+ * \tparam N The number of threads (0 for the thread budget of the process)
+ */
+template <size_t N>
+struct threads : value_conf_elt<threads_id, size_t, N> {};
+
+/*!
+ * \brief Validate the network in the background of the training: the
+ * validation of an epoch runs on a snapshot of the weights, on threads taken
+ * from the training, while the training error is computed or, by default,
+ * while the next epoch trains (the early stopping decision is then applied
+ * one epoch late).
+ *
+ * This has no effect on dynamic networks, with mixed precision or with
+ * distributed training.
+ */
+struct async_validation : basic_conf_elt<async_validation_id> {};
+
+/*!
+ * \brief Check that the outputs and the gradients of the layers are finite
+ * (no NaN and no infinity) every P batches of SGD, also in release builds.
+ * The first offending layer and tensor is reported and the update of the
+ * batch is skipped.
+ *
+ * With mixed precision, only the outputs are checked, the overflows of the
+ * gradients being already handled by the loss scaling. This has no effect
+ * with data-parallel or distributed SGD, with overlapped updates or with
+ * gradient accumulation.
+ * \tparam P The number of batches between two checks
+ */
+template <size_t P>
+struct check_finite : value_conf_elt<check_finite_id, size_t, P> {};
+
+/*!
+ * \brief Enable the runtime memory budget of the network (memory_limit).
+ *
+ * With a budget, the training helpers taking containers keep the dataset
+ * resident (in-memory generator) only if it fits in the memory left by the
+ * training of the network, and stream it (out-of-memory generator)
+ * otherwise. The pretraining streams the features of the lower layers from
+ * the feature store when they do not fit.
+ */
+struct memory_budget : basic_conf_elt<memory_budget_id> {};
+
 /*!
  * \brief Conditional shuffle (shuffle if Cond = true)
  */
@@ -7,7 +7,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include "cpp_utils/assert.hpp" //Assertions
 #include "cpp_utils/io.hpp"     // For binary writing
@@ -32,6 +37,12 @@ struct base_lstm_layer : layer<Derived> {
     using base_type = layer<Derived>;                          ///< The base type
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr bool stateful            = desc::parameters::template contains<dll::stateful>(); ///< Carry the states across batches
+    static constexpr bool embedding_input     = desc::parameters::template contains<dll::embedding_input>(); ///< The input vectors are embeddings
+    static constexpr bool time_major          = desc::parameters::template contains<dll::time_major>(); ///< The batches are time-major
+    static constexpr bool reverse             = desc::parameters::template contains<dll::reverse>(); ///< Process the sequences from the last time step
+
+    static_assert(!(stateful && reverse), "A reversed recurrent layer cannot be stateful");
 
     /*!
      * \brief Initialize the neural layer
@@ -47,6 +58,64 @@ struct base_lstm_layer : layer<Derived> {
     base_lstm_layer& operator=(const base_lstm_layer& rhs) = delete;
     base_lstm_layer& operator=(base_lstm_layer&& rhs) = delete;
 
+    mutable etl::dyn_matrix<float, 2> h_init; ///< The hidden state before the first time step (stateful)
+    mutable etl::dyn_matrix<float, 2> s_init; ///< The cell state before the first time step (stateful)
+    mutable bool has_init = false;            ///< Indicates if h_init and s_init are used by the current batch (stateful)
+    mutable bool carry    = false;            ///< Indicates if the last states must be carried to the next batch (stateful)
+
+    size_t active_steps = 0; ///< The number of time steps of the current batch, the next ones being padding (0 for all the time steps)
+
+    std::vector<size_t> sample_steps; ///< The length of each sequence of the current batch, by decreasing length (empty for all the time steps)
+
+    /*!
+     * \brief Reset the states carried across batches (stateful), the next
+     * batch starts new sequences
+     */
+    void reset_state() {
+        carry = false;
+    }
+
+    /*!
+     * \brief Returns the number of time steps to compute for the current
+     * batch (the stateful layers always compute all the time steps)
+     */
+    size_t batch_steps(size_t time_steps) const {
+        const size_t steps = active_steps && !stateful ? std::min(active_steps, time_steps) : time_steps;
+
+        return masked() ? std::min(steps, sample_steps.front()) : steps;
+    }
+
+    /*!
+     * \brief Indicates if the sequences of the current batch have their own
+     * lengths (the stateful layers always compute all the time steps)
+     */
+    bool masked() const {
+        return !stateful && !sample_steps.empty();
+    }
+
+    /*!
+     * \brief Returns the number of time steps of the given sequence of the
+     * current batch
+     */
+    size_t sample_length(size_t b, size_t steps) const {
+        return masked() ? std::min(sample_steps[b], steps) : steps;
+    }
+
+    /*!
+     * \brief Returns the number of sequences of the batch still running at
+     * the given time step.
+     *
+     * The sequences being sorted by decreasing length, the running sequences
+     * are always the first rows of the batch.
+     */
+    size_t active_rows(size_t t, size_t Batch) const {
+        if (!masked()) {
+            return Batch;
+        }
+
+        return std::partition_point(sample_steps.begin(), sample_steps.end(), [t](size_t length) { return length > t; }) - sample_steps.begin();
+    }
+
     /*!
      * \brief Backup the weights in the secondary weights matrix
      */
@@ -159,6 +228,789 @@ struct base_lstm_layer : layer<Derived> {
             std::cref(as_derived().w_o), std::cref(as_derived().u_o), std::cref(as_derived().b_o));
     }
 
+    /*!
+     * \brief Forward cache owned by the caller instead of the layer.
+     *
+     * This allows several threads to forward propagate through the same
+     * layer concurrently (see inference_session).
+     */
+    struct inference_cache_t {
+        etl::dyn_matrix<float, 3> g_t; ///< The input modulation gate activations
+        etl::dyn_matrix<float, 3> i_t; ///< The input gate activations
+        etl::dyn_matrix<float, 3> f_t; ///< The forget gate activations
+        etl::dyn_matrix<float, 3> o_t; ///< The output gate activations
+        etl::dyn_matrix<float, 3> x_t; ///< The input, rearranged by time steps
+        etl::dyn_matrix<float, 3> s_t; ///< The cell states
+        etl::dyn_matrix<float, 3> h_t; ///< The hidden states
+
+        etl::dyn_matrix<float, 2> z_t;     ///< The input projections of all the time steps (time_steps * Batch x 4 * hidden_units)
+        etl::dyn_matrix<float, 2> zh_t;    ///< The recurrent projections of one time step (Batch x 4 * hidden_units)
+        etl::dyn_matrix<float, 2> u_gates; ///< The concatenated U weights of the gates
+        etl::dyn_matrix<float, 2> w_gates; ///< The concatenated W weights of the gates
+        etl::dyn_matrix<float, 2> b_gates; ///< The concatenated biases of the gates
+
+        etl::dyn_matrix<float, 2> h_init; ///< The hidden state before the first time step (stateful)
+        etl::dyn_matrix<float, 2> s_init; ///< The cell state before the first time step (stateful)
+        bool has_init = false;            ///< Indicates if h_init and s_init are used by the current batch (stateful)
+        bool carry    = false;            ///< Indicates if the last states must be carried to the next batch (stateful)
+
+        /*!
+         * \brief Make sure the cache can hold a batch of the given size
+         */
+        void prepare(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) {
+            if (cpp_unlikely(etl::dim<1>(x_t) != Batch)) {
+                g_t.resize(time_steps, Batch, hidden_units);
+                i_t.resize(time_steps, Batch, hidden_units);
+                f_t.resize(time_steps, Batch, hidden_units);
+                o_t.resize(time_steps, Batch, hidden_units);
+
+                x_t.resize(time_steps, Batch, sequence_length);
+                s_t.resize(time_steps, Batch, hidden_units);
+                h_t.resize(time_steps, Batch, hidden_units);
+
+                carry = false;
+            }
+        }
+
+        /*!
+         * \brief Reset the states carried across batches (stateful), the next
+         * batch starts new sequences (of this stream)
+         */
+        void reset_state() {
+            carry = false;
+        }
+    };
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param cache The storage for the intermediate results (gates and states)
+     * \param time_steps The number of time steps
+     */
+    template <typename H, typename V, typename C>
+    void forward_batch_cache_impl(H&& output, const V& x, C& cache, size_t time_steps) const {
+        const auto Batch = etl::dim<0>(x);
+
+        // Only the time steps before the padding are computed
+        const size_t steps = batch_steps(time_steps);
+
+        cpp_assert(!masked() || sample_steps.size() == Batch, "Invalid number of lengths for the batch");
+        cpp_assert(!masked() || std::is_sorted(sample_steps.rbegin(), sample_steps.rend()), "The sequences must be sorted by decreasing length");
+
+        // 1. Rearrange input
+
+        if (masked()) {
+            rearrange_masked_input(cache.x_t, x, steps);
+        } else {
+            rearrange_input(cache, x, time_steps, steps);
+        }
+
+        // 2. Concatenate the weights of the four gates [g|i|f|o]
+
+        prepare_gates(cache, Batch, time_steps);
+
+        // 3. Input projections of all the time steps, in a single GEMM
+
+        project_input(cache, Batch, steps);
+
+        // 4. Start from the states of the previous batch (stateful)
+
+        if constexpr (stateful) {
+            start_chunk(cache, time_steps);
+        }
+
+        // 5. Forward propagation through time, the batch shrinking as the
+        // sequences end
+
+        for (size_t t = 0; t < steps; ++t) {
+            forward_step(cache, t, Batch, active_rows(t, Batch));
+        }
+
+        // 6. Rearrange the output
+
+        if (masked()) {
+            rearrange_masked_output(output, cache.h_t, time_steps, steps);
+        } else {
+            rearrange_output(output, cache, time_steps, steps);
+        }
+    }
+
+    /*!
+     * \brief Concatenate the weights of the four gates [g|i|f|o] and make
+     * sure the projections can hold a batch of the given size
+     */
+    template <typename C>
+    void prepare_gates(C& cache, size_t Batch, size_t time_steps) const {
+        auto& d = as_derived();
+
+        const size_t sequence_length = etl::dim<0>(d.u_i);
+        const size_t hidden_units    = etl::dim<1>(d.u_i);
+        const size_t gates           = 4 * hidden_units;
+
+        pack_gates(cache.u_gates, sequence_length, d.u_g, d.u_i, d.u_f, d.u_o);
+        pack_gates(cache.w_gates, hidden_units, d.w_g, d.w_i, d.w_f, d.w_o);
+        pack_gates(cache.b_gates, 1, d.b_g, d.b_i, d.b_f, d.b_o);
+
+        if (etl::dim<0>(cache.z_t) != time_steps * Batch || etl::dim<1>(cache.z_t) != gates) {
+            cache.z_t.resize(time_steps * Batch, gates);
+            cache.zh_t.resize(Batch, gates);
+        }
+    }
+
+    /*!
+     * \brief Compute the input projections of the first steps
+     */
+    template <typename C>
+    static void project_input(C& cache, size_t Batch, size_t steps) {
+        const size_t sequence_length = etl::dim<2>(cache.x_t);
+        const size_t rows            = steps * Batch;
+
+        if constexpr (embedding_input) {
+            project_distinct_rows(cache.z_t, cache.x_t, cache.u_gates, rows, sequence_length);
+        } else if (rows == etl::dim<0>(cache.z_t)) {
+            cache.z_t = etl::reshape(cache.x_t, rows, sequence_length) * cache.u_gates;
+        } else {
+            cache.x_t.ensure_cpu_up_to_date();
+            cache.z_t.ensure_cpu_up_to_date();
+
+            etl::custom_dyn_matrix<float, 2> x_n(cache.x_t.memory_start(), rows, sequence_length);
+            etl::custom_dyn_matrix<float, 2> z_n(cache.z_t.memory_start(), rows, etl::dim<1>(cache.z_t));
+
+            z_n = x_n * cache.u_gates;
+
+            cache.z_t.invalidate_gpu();
+        }
+    }
+
+    /*!
+     * \brief Compute the gates and the states of the given time step, the
+     * input projections being already computed
+     */
+    template <typename C>
+    static void forward_step(C& cache, size_t t, size_t Batch) {
+        forward_step(cache, t, Batch, Batch);
+    }
+
+    /*!
+     * \brief Compute the gates and the states of the first rows (the running
+     * sequences) of the given time step, the states of the ended sequences
+     * being zero
+     */
+    template <typename C>
+    static void forward_step(C& cache, size_t t, size_t Batch, size_t rows) {
+        const size_t hidden_units = etl::dim<2>(cache.h_t);
+
+        // The recurrent projections of the four gates, in a single GEMM
+        if (rows < Batch) {
+            if (t > 0) {
+                etl::slice(cache.zh_t, 0, rows) = etl::slice(cache.h_t(t - 1), 0, rows) * cache.w_gates;
+            }
+        } else if (t > 0) {
+            cache.zh_t = cache.h_t(t - 1) * cache.w_gates;
+        } else if (cache.has_init) {
+            cache.zh_t = cache.h_init * cache.w_gates;
+        }
+
+        cell_forward(cache, t, Batch, hidden_units, rows);
+    }
+
+    /*!
+     * \brief Returns the given time step of the given sample of a batch (the
+     * memory of a time-major batch being laid out time step by time step)
+     */
+    template <typename V>
+    static decltype(auto) sample_step(V&& x, size_t b, size_t t) {
+        if constexpr (time_major) {
+            const size_t r = t * etl::dim<0>(x) + b;
+
+            return x(r / etl::dim<1>(x))(r % etl::dim<1>(x));
+        } else {
+            return x(b)(t);
+        }
+    }
+
+    /*!
+     * \brief Rearrange the first steps of a batch of sequences of their own
+     * lengths by time steps, each sequence being followed by zeros
+     *
+     * \param to The rearranged batch (steps x Batch x N)
+     * \param x The batch of sequences
+     * \param steps The number of steps to rearrange
+     */
+    template <typename To, typename V>
+    void rearrange_masked_input(To& to, const V& x, size_t steps) const {
+        const size_t Batch = etl::dim<1>(to);
+
+        for (size_t b = 0; b < Batch; ++b) {
+            const size_t length = sample_length(b, steps);
+
+            for (size_t t = 0; t < length; ++t) {
+                to(t)(b) = sample_step(x, b, sequence_step(t, length));
+            }
+
+            for (size_t t = length; t < steps; ++t) {
+                to(t)(b) = 0;
+            }
+        }
+    }
+
+    /*!
+     * \brief Rearrange the first steps, by time steps, into a batch of
+     * sequences of their own lengths, the steps after the end of each
+     * sequence being zero
+     *
+     * \param output The batch of sequences
+     * \param from The rearranged batch (steps x Batch x N)
+     * \param time_steps The number of time steps of the output
+     * \param steps The number of steps to rearrange
+     */
+    template <typename H, typename From>
+    void rearrange_masked_output(H&& output, const From& from, size_t time_steps, size_t steps) const {
+        const size_t Batch = etl::dim<1>(from);
+
+        for (size_t b = 0; b < Batch; ++b) {
+            const size_t length = sample_length(b, steps);
+
+            for (size_t t = 0; t < length; ++t) {
+                sample_step(output, b, sequence_step(t, length)) = from(t)(b);
+            }
+
+            for (size_t t = length; t < time_steps; ++t) {
+                sample_step(output, b, t) = 0;
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the position, in the sequence, of the given time step of
+     * the layer (reverse processes the sequence from its end)
+     */
+    static size_t sequence_step(size_t t, size_t time_steps) {
+        return reverse ? time_steps - 1 - t : t;
+    }
+
+    /*!
+     * \brief Rearrange the first steps of a batch of input by time steps,
+     * into x_t
+     */
+    template <typename C, typename V>
+    static void rearrange_input(C& cache, const V& x, size_t time_steps, size_t steps) {
+        const size_t Batch           = etl::dim<0>(x);
+        const size_t sequence_length = etl::dim<2>(cache.x_t);
+
+        if constexpr (time_major) {
+            copy_steps(cache.x_t, x, time_steps, steps);
+        } else if constexpr (etl::is_dma<V>) {
+            x.ensure_cpu_up_to_date();
+
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < steps; ++t) {
+                    const auto* in = x.memory_start() + (b * time_steps + sequence_step(t, steps)) * sequence_length;
+
+                    std::copy(in, in + sequence_length, cache.x_t.memory_start() + (t * Batch + b) * sequence_length);
+                }
+            }
+
+            cache.x_t.invalidate_gpu();
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < steps; ++t) {
+                    cache.x_t(t)(b) = x(b)(sequence_step(t, steps));
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Rearrange the hidden states (h_t) of the first steps into a
+     * batch of output, the output of the padding steps being zero
+     */
+    template <typename H, typename C>
+    static void rearrange_output(H&& output, C& cache, size_t time_steps, size_t steps) {
+        const size_t Batch        = etl::dim<0>(output);
+        const size_t hidden_units = etl::dim<2>(cache.h_t);
+
+        if constexpr (time_major) {
+            copy_steps(output, cache.h_t, time_steps, steps);
+
+            if (steps < time_steps) {
+                std::fill(output.memory_start() + steps * Batch * hidden_units, output.memory_end(), 0.0f);
+            }
+        } else if constexpr (etl::is_dma<std::decay_t<H>>) {
+            cache.h_t.ensure_cpu_up_to_date();
+
+            for (size_t b = 0; b < Batch; ++b) {
+                auto* out = output.memory_start() + b * time_steps * hidden_units;
+
+                for (size_t t = 0; t < steps; ++t) {
+                    const auto* in = cache.h_t.memory_start() + (t * Batch + b) * hidden_units;
+
+                    std::copy(in, in + hidden_units, out + sequence_step(t, steps) * hidden_units);
+                }
+
+                std::fill(out + steps * hidden_units, out + time_steps * hidden_units, 0.0f);
+            }
+
+            output.invalidate_gpu();
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < steps; ++t) {
+                    output(b)(sequence_step(t, steps)) = cache.h_t(t)(b);
+                }
+
+                for (size_t t = steps; t < time_steps; ++t) {
+                    output(b)(t) = 0;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Copy the first steps of a time-major batch (time_major), the
+     * memory of both sides having the same layout, the steps being reversed
+     * (reverse)
+     *
+     * \param to The destination
+     * \param from The source
+     * \param time_steps The number of time steps
+     * \param steps The number of steps to copy
+     */
+    template <typename To, typename From>
+    static void copy_steps(To&& to, const From& from, size_t time_steps, size_t steps) {
+        cpp_assert(etl::size(to) == etl::size(from), "Invalid time-major copy");
+
+        from.ensure_cpu_up_to_date();
+
+        const size_t step = etl::size(from) / time_steps;
+
+        if constexpr (reverse) {
+            for (size_t t = 0; t < steps; ++t) {
+                const auto* in = from.memory_start() + (steps - 1 - t) * step;
+
+                std::copy(in, in + step, to.memory_start() + t * step);
+            }
+        } else {
+            std::copy(from.memory_start(), from.memory_start() + steps * step, to.memory_start());
+        }
+
+        to.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Concatenate the given weights of the four gates, column-wise,
+     * into a single matrix
+     *
+     * \param packed The matrix (rows x 4 * columns) to fill
+     * \param rows The number of rows of each weight matrix
+     * \param w The weights of each gate
+     */
+    template <typename M, typename... W>
+    static void pack_gates(M& packed, size_t rows, const W&... w) {
+        const size_t columns = etl::size(std::get<0>(std::tie(w...))) / rows;
+
+        if (etl::dim<0>(packed) != rows || etl::dim<1>(packed) != 4 * columns) {
+            packed.resize(rows, 4 * columns);
+        }
+
+        size_t gate = 0;
+
+        auto pack = [&](const auto& g) {
+            g.ensure_cpu_up_to_date();
+
+            for (size_t r = 0; r < rows; ++r) {
+                const auto* in = g.memory_start() + r * columns;
+
+                std::copy(in, in + columns, packed.memory_start() + r * 4 * columns + gate * columns);
+            }
+
+            ++gate;
+        };
+
+        (pack(w), ...);
+
+        packed.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the projections z = x * u of the given rows, with only one
+     * product per distinct row of x (embedding_input).
+     *
+     * The distinct rows are found by hashing, their projections computed
+     * with a single (smaller) GEMM and then copied to the rows of z.
+     *
+     * \param z The projections (n x columns of u)
+     * \param x The rows to project (n x sequence_length)
+     * \param u The projection matrix (sequence_length x columns)
+     */
+    template <typename Z, typename X, typename U>
+    static void project_distinct_rows(Z& z, const X& x, const U& u, size_t n, size_t sequence_length) {
+        const size_t columns = etl::dim<1>(u);
+
+        x.ensure_cpu_up_to_date();
+
+        const float* xm = x.memory_start();
+
+        std::vector<size_t> distinct; // The first row of each distinct row
+        std::vector<size_t> row_of(n); // The distinct row of each row
+
+        std::unordered_multimap<size_t, size_t> seen;
+
+        for (size_t r = 0; r < n; ++r) {
+            const float* x_r = xm + r * sequence_length;
+
+            size_t hash = 14695981039346656037UL;
+
+            for (size_t j = 0; j < sequence_length; ++j) {
+                hash = (hash ^ std::hash<float>()(x_r[j])) * 1099511628211UL;
+            }
+
+            bool found = false;
+            auto range = seen.equal_range(hash);
+
+            for (auto it = range.first; it != range.second; ++it) {
+                if (std::equal(x_r, x_r + sequence_length, xm + distinct[it->second] * sequence_length)) {
+                    row_of[r] = it->second;
+                    found     = true;
+                    break;
+                }
+            }
+
+            if (!found) {
+                row_of[r] = distinct.size();
+                seen.emplace(hash, distinct.size());
+                distinct.push_back(r);
+            }
+        }
+
+        etl::dyn_matrix<float, 2> x_d(distinct.size(), sequence_length);
+
+        for (size_t d = 0; d < distinct.size(); ++d) {
+            std::copy(xm + distinct[d] * sequence_length, xm + (distinct[d] + 1) * sequence_length, x_d.memory_start() + d * sequence_length);
+        }
+
+        x_d.invalidate_gpu();
+
+        etl::dyn_matrix<float, 2> z_d(distinct.size(), columns);
+
+        z_d = x_d * u;
+
+        z_d.ensure_cpu_up_to_date();
+
+        for (size_t r = 0; r < n; ++r) {
+            const float* z_r = z_d.memory_start() + row_of[r] * columns;
+
+            std::copy(z_r, z_r + columns, z.memory_start() + r * columns);
+        }
+
+        z.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Save the last states of the previous batch as the initial
+     * states of this batch (stateful), if they must be carried
+     */
+    template <typename C>
+    static void start_chunk(C& cache, size_t time_steps) {
+        cache.has_init = cache.carry;
+
+        if (cache.has_init) {
+            const size_t Batch        = etl::dim<1>(cache.h_t);
+            const size_t hidden_units = etl::dim<2>(cache.h_t);
+
+            if (etl::dim<0>(cache.h_init) != Batch || etl::dim<1>(cache.h_init) != hidden_units) {
+                cache.h_init.resize(Batch, hidden_units);
+                cache.s_init.resize(Batch, hidden_units);
+            }
+
+            cache.h_init = cache.h_t(time_steps - 1);
+            cache.s_init = cache.s_t(time_steps - 1);
+        }
+
+        cache.carry = true;
+    }
+
+    /*!
+     * \brief Returns a pointer to the cell states before the given time step,
+     * or nullptr if the time step has no previous states
+     */
+    template <typename C>
+    static const float* previous_cell_state(C& cache, size_t t, size_t Batch, size_t hidden_units) {
+        if (t > 0) {
+            return cache.s_t.memory_start() + (t - 1) * Batch * hidden_units;
+        } else if (cache.has_init) {
+            return cache.s_init.memory_start();
+        } else {
+            return nullptr;
+        }
+    }
+
+    /*!
+     * \brief Copy the columns of the packed matrix of the four gates back
+     * into the given matrices of each gate
+     *
+     * \param packed The matrix (rows x 4 * columns) to read
+     * \param rows The number of rows of each matrix
+     * \param w The matrix of each gate
+     */
+    template <typename M, typename... W>
+    static void unpack_gates(const M& packed, size_t rows, W&... w) {
+        const size_t columns = etl::size(std::get<0>(std::tie(w...))) / rows;
+
+        packed.ensure_cpu_up_to_date();
+
+        size_t gate = 0;
+
+        auto unpack = [&](auto& g) {
+            for (size_t r = 0; r < rows; ++r) {
+                const auto* in = packed.memory_start() + r * 4 * columns + gate * columns;
+
+                std::copy(in, in + columns, g.memory_start() + r * columns);
+            }
+
+            g.invalidate_gpu();
+
+            ++gate;
+        };
+
+        (unpack(w), ...);
+    }
+
+    /*!
+     * \brief Fused LSTM cell: compute the four gates from the projections
+     * and the biases, the cell state and the hidden state of the given time
+     * step, in a single sweep over the Batch x hidden_units block (only the
+     * first rows, the gates and the states of the others being zero)
+     */
+    template <typename C>
+    static void cell_forward(C& cache, size_t t, size_t Batch, size_t hidden_units, size_t rows) {
+        const size_t gates = 4 * hidden_units;
+        const size_t step  = t * Batch * hidden_units;
+
+        const float* z  = cache.z_t.memory_start() + t * Batch * gates;
+        const float* zh = cache.zh_t.memory_start();
+        const float* bg = cache.b_gates.memory_start();
+
+        float* g = cache.g_t.memory_start() + step;
+        float* i = cache.i_t.memory_start() + step;
+        float* f = cache.f_t.memory_start() + step;
+        float* o = cache.o_t.memory_start() + step;
+        float* s = cache.s_t.memory_start() + step;
+        float* h = cache.h_t.memory_start() + step;
+
+        const float* s_prev = previous_cell_state(cache, t, Batch, hidden_units);
+
+        for (size_t b = 0; b < rows; ++b) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                const size_t k = b * gates + j;
+
+                float v_g = z[k] + bg[j];
+                float v_i = z[k + hidden_units] + bg[j + hidden_units];
+                float v_f = z[k + 2 * hidden_units] + bg[j + 2 * hidden_units];
+                float v_o = z[k + 3 * hidden_units] + bg[j + 3 * hidden_units];
+
+                if (s_prev) {
+                    v_g += zh[k];
+                    v_i += zh[k + hidden_units];
+                    v_f += zh[k + 2 * hidden_units];
+                    v_o += zh[k + 3 * hidden_units];
+                }
+
+                const size_t x = b * hidden_units + j;
+
+                g[x] = std::tanh(v_g);
+                i[x] = f_activate_scalar<function::SIGMOID>(v_i);
+                f[x] = f_activate_scalar<function::SIGMOID>(v_f);
+                o[x] = f_activate_scalar<function::SIGMOID>(v_o);
+
+                if (!s_prev) {
+                    s[x] = g[x] * i[x];
+                    h[x] = f_activate_scalar<activation_function>(s[x]) * o[x];
+                } else {
+                    s[x] = f_activate_scalar<activation_function>(g[x] * i[x] + s_prev[x] * f[x]);
+                    h[x] = s[x] * o[x];
+                }
+            }
+        }
+
+        // The sequences that have ended
+        for (auto* v : {g, i, f, o, s, h}) {
+            std::fill(v + rows * hidden_units, v + Batch * hidden_units, 0.0f);
+        }
+
+        cache.g_t.invalidate_gpu();
+        cache.i_t.invalidate_gpu();
+        cache.f_t.invalidate_gpu();
+        cache.o_t.invalidate_gpu();
+        cache.s_t.invalidate_gpu();
+        cache.h_t.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Fused backward of the LSTM cell at the given time step.
+     *
+     * The errors of the hidden and cell states are combined with the errors
+     * of the next time step, and the errors of the four gates (before their
+     * activations) are written into cache.d_gates (Batch x 4 * hidden_units,
+     * in the [g|i|f|o] order of the packed weights), in a single sweep. The
+     * errors of the cell state are updated for the previous time step.
+     *
+     * \param cache The cache of the forward pass and of the errors
+     * \param delta The errors of the output at this time step
+     * \param t The time step
+     * \param last Indicates if this is the last time step of the sequence
+     * \param rows The number of running sequences (the others receive no errors)
+     */
+    template <typename C, typename D>
+    static void cell_backward(C& cache, const D& delta, size_t t, bool last, size_t Batch, size_t hidden_units, size_t rows) {
+        const size_t gates = 4 * hidden_units;
+        const size_t step  = t * Batch * hidden_units;
+        const size_t next  = (t + 1) * Batch * hidden_units;
+
+        delta.ensure_cpu_up_to_date();
+
+        const float* e = delta.memory_start();
+        const float* g = cache.g_t.memory_start() + step;
+        const float* i = cache.i_t.memory_start() + step;
+        const float* f = cache.f_t.memory_start() + step;
+        const float* o = cache.o_t.memory_start() + step;
+        const float* s = cache.s_t.memory_start() + step;
+
+        const float* s_prev = previous_cell_state(cache, t, Batch, hidden_units);
+
+        float* d_h = cache.d_h_t.memory_start();
+        float* d_c = cache.d_c_t.memory_start();
+        float* d_z = cache.d_gates.memory_start();
+
+        for (size_t b = 0; b < rows; ++b) {
+            for (size_t j = 0; j < hidden_units; ++j) {
+                const size_t x = b * hidden_units + j;
+                const size_t k = b * gates + j;
+
+                const float dh = last ? e[x] : e[x] + d_h[next + x];
+
+                float dc = o[x] * dh * f_derivative_scalar<activation_function>(s[x]);
+
+                if (!last) {
+                    dc += d_c[next + x];
+                }
+
+                d_z[k]                    = (1.0f - g[x] * g[x]) * (i[x] * dc);
+                d_z[k + hidden_units]     = i[x] * (1.0f - i[x]) * (g[x] * dc);
+                d_z[k + 2 * hidden_units] = s_prev ? f[x] * (1.0f - f[x]) * (s_prev[x] * dc) : 0.0f;
+                d_z[k + 3 * hidden_units] = o[x] * (1.0f - o[x]) * (s[x] * dh);
+
+                // Update for the next step
+                d_c[step + x] = f[x] * dc;
+            }
+        }
+
+        // The sequences that have ended
+        std::fill(d_z + rows * gates, d_z + Batch * gates, 0.0f);
+        std::fill(d_c + step + rows * hidden_units, d_c + step + Batch * hidden_units, 0.0f);
+
+        cache.d_c_t.invalidate_gpu();
+        cache.d_gates.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute to = d * trans(w) for the first rows of d (the running
+     * sequences), the other rows being zero
+     */
+    template <typename To, typename D, typename W>
+    static void running_product(To&& to, const D& d, const W& w, size_t rows) {
+        const size_t Batch = etl::dim<0>(d);
+
+        if (rows == Batch) {
+            to = d * trans(w);
+        } else {
+            etl::slice(to, 0, rows)     = etl::slice(d, 0, rows) * trans(w);
+            etl::slice(to, rows, Batch) = 0;
+        }
+    }
+
+    // Step by step forward propagation (see wavefront_forward)
+
+    /*!
+     * \brief Start the step by step forward propagation of a batch
+     * \param Batch The number of samples of the batch
+     */
+    void wavefront_begin(size_t Batch) const {
+        auto& d = as_derived();
+
+        d.prepare_cache(Batch);
+
+        prepare_gates(d, Batch, d.time_steps);
+
+        if constexpr (stateful) {
+            start_chunk(d, d.time_steps);
+        }
+    }
+
+    /*!
+     * \brief Set the complete input of the batch (first layer of a stack)
+     */
+    template <typename V>
+    void wavefront_input(const V& x) const {
+        auto& d = as_derived();
+
+        rearrange_input(d, x, d.time_steps, d.time_steps);
+        project_input(d, etl::dim<0>(x), d.time_steps);
+    }
+
+    /*!
+     * \brief Compute the given time step, from the input already set
+     */
+    void wavefront_step(size_t t) const {
+        auto& d = as_derived();
+
+        forward_step(d, t, etl::dim<1>(d.h_t));
+    }
+
+    /*!
+     * \brief Compute the given time step, from the given input at this step
+     * \param x The input at this time step (Batch x sequence_length)
+     */
+    template <typename X>
+    void wavefront_step(size_t t, const X& x) const {
+        auto& d = as_derived();
+
+        const size_t Batch = etl::dim<1>(d.h_t);
+        const size_t gates = etl::dim<1>(d.z_t);
+
+        d.x_t(t) = x;
+
+        // The input projections of this time step only
+        etl::dyn_matrix<float, 2> z(Batch, gates);
+
+        z = d.x_t(t) * d.u_gates;
+
+        z.ensure_cpu_up_to_date();
+        d.z_t.ensure_cpu_up_to_date();
+
+        std::copy(z.memory_start(), z.memory_end(), d.z_t.memory_start() + t * Batch * gates);
+
+        d.z_t.invalidate_gpu();
+
+        forward_step(d, t, Batch);
+    }
+
+    /*!
+     * \brief Returns the hidden states computed at the given time step
+     */
+    decltype(auto) wavefront_state(size_t t) const {
+        return as_derived().h_t(t);
+    }
+
+    /*!
+     * \brief Write the output of the batch, once all the steps are computed
+     */
+    template <typename H>
+    void wavefront_end(H&& output) const {
+        rearrange_output(output, as_derived(), as_derived().time_steps, as_derived().time_steps);
+    }
+
 private:
     //CRTP Deduction
 
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <fstream>
+#include <vector>
 
 #include "cpp_utils/assert.hpp" //Assertions
 #include "cpp_utils/io.hpp"     // For binary writing
@@ -32,6 +34,11 @@ struct base_rnn_layer : layer<Derived> {
     using base_type = layer<Derived>;                  ///< The base type
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr bool stateful            = desc::parameters::template contains<dll::stateful>(); ///< Carry the states across batches
+    static constexpr bool time_major          = desc::parameters::template contains<dll::time_major>(); ///< The batches are time-major
+    static constexpr bool reverse             = desc::parameters::template contains<dll::reverse>(); ///< Process the sequences from the last time step
+
+    static_assert(!(stateful && reverse), "A reversed recurrent layer cannot be stateful");
 
     /*!
      * \brief Initialize the neural layer
@@ -50,6 +57,98 @@ struct base_rnn_layer : layer<Derived> {
     mutable etl::dyn_matrix<float, 3> x_t;
     mutable etl::dyn_matrix<float, 3> s_t;
 
+    mutable etl::dyn_matrix<float, 2> s_init; ///< The state before the first time step (stateful)
+    mutable bool has_init = false;            ///< Indicates if s_init is used by the current batch (stateful)
+    mutable bool carry    = false;            ///< Indicates if the last states must be carried to the next batch (stateful)
+
+    size_t active_steps = 0; ///< The number of time steps of the current batch, the next ones being padding (0 for all the time steps)
+
+    std::vector<size_t> sample_steps; ///< The length of each sequence of the current batch, by decreasing length (empty for all the time steps)
+
+    /*!
+     * \brief Reset the state carried across batches (stateful), the next
+     * batch starts new sequences
+     */
+    void reset_state() {
+        carry = false;
+    }
+
+    /*!
+     * \brief Returns the number of time steps to compute for the current
+     * batch (the stateful layers always compute all the time steps)
+     */
+    size_t batch_steps(size_t time_steps) const {
+        const size_t steps = active_steps && !stateful ? std::min(active_steps, time_steps) : time_steps;
+
+        return masked() ? std::min(steps, sample_steps.front()) : steps;
+    }
+
+    /*!
+     * \brief Indicates if the sequences of the current batch have their own
+     * lengths (the stateful layers always compute all the time steps)
+     */
+    bool masked() const {
+        return !stateful && !sample_steps.empty();
+    }
+
+    /*!
+     * \brief Returns the number of time steps of the given sequence of the
+     * current batch
+     */
+    size_t sample_length(size_t b, size_t steps) const {
+        return masked() ? std::min(sample_steps[b], steps) : steps;
+    }
+
+    /*!
+     * \brief Returns the number of sequences of the batch still running at
+     * the given time step.
+     *
+     * The sequences being sorted by decreasing length, the running sequences
+     * are always the first rows of the batch.
+     */
+    size_t active_rows(size_t t, size_t Batch) const {
+        if (!masked()) {
+            return Batch;
+        }
+
+        return std::partition_point(sample_steps.begin(), sample_steps.end(), [t](size_t length) { return length > t; }) - sample_steps.begin();
+    }
+
+    /*!
+     * \brief Forward cache owned by the caller instead of the layer.
+     *
+     * This allows several threads to forward propagate through the same
+     * layer concurrently (see inference_session).
+     */
+    struct inference_cache_t {
+        etl::dyn_matrix<float, 3> x_t; ///< The input, rearranged by time steps
+        etl::dyn_matrix<float, 3> s_t; ///< The states
+
+        etl::dyn_matrix<float, 2> s_init; ///< The state before the first time step (stateful)
+        bool has_init = false;            ///< Indicates if s_init is used by the current batch (stateful)
+        bool carry    = false;            ///< Indicates if the last states must be carried to the next batch (stateful)
+
+        /*!
+         * \brief Make sure the cache can hold a batch of the given size
+         */
+        void prepare(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) {
+            if (cpp_unlikely(etl::dim<1>(x_t) != Batch)) {
+                x_t.resize(time_steps, Batch, sequence_length);
+                s_t.resize(time_steps, Batch, hidden_units);
+
+                carry = false;
+            }
+        }
+
+        /*!
+         * \brief Reset the state carried across batches (stateful), the next
+         * batch starts new sequences (of this stream)
+         */
+        void reset_state() {
+            carry = false;
+        }
+    };
+
     void prepare_cache(size_t Batch, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
         if (cpp_unlikely(!x_t.memory_start())) {
             x_t.resize(time_steps, Batch, sequence_length);
@@ -67,115 +166,464 @@ struct base_rnn_layer : layer<Derived> {
      */
     template <typename H, typename V, typename W, typename U, typename B>
     void forward_batch_impl(H&& output, const V& x, const W& w, const U& u, const B& b, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
-        const auto Batch = etl::dim<0>(x);
+        prepare_cache(etl::dim<0>(x), time_steps, sequence_length, hidden_units);
+
+        forward_batch_cache_impl(output, x, w, u, b, *this, time_steps);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, using an external
+     * cache.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param w The W weights matrix
+     * \param u The U weights matrix
+     * \param cache The cache to use for the intermediate results
+     */
+    template <typename H, typename V, typename W, typename U, typename B>
+    void forward_batch_impl(H&& output, const V& x, const W& w, const U& u, const B& b, inference_cache_t& cache, size_t time_steps, size_t sequence_length, size_t hidden_units) const {
+        cache.prepare(etl::dim<0>(x), time_steps, sequence_length, hidden_units);
+
+        forward_batch_cache_impl(output, x, w, u, b, cache, time_steps);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param w The W weights matrix
+     * \param u The U weights matrix
+     * \param cache The storage for the intermediate results (x_t and s_t)
+     */
+    template <typename H, typename V, typename W, typename U, typename B, typename C>
+    void forward_batch_cache_impl(H&& output, const V& x, const W& w, const U& u, const B& b, C& cache, size_t time_steps) const {
+        const size_t Batch = etl::dim<0>(x);
 
-        prepare_cache(Batch, time_steps, sequence_length, hidden_units);
+        // Only the time steps before the padding are computed
+        const size_t steps = batch_steps(time_steps);
+
+        cpp_assert(!masked() || sample_steps.size() == Batch, "Invalid number of lengths for the batch");
+        cpp_assert(!masked() || std::is_sorted(sample_steps.rbegin(), sample_steps.rend()), "The sequences must be sorted by decreasing length");
 
         // 1. Rearrange input
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                x_t(t)(b) = x(b)(t);
+        if (masked()) {
+            rearrange_masked_input(cache.x_t, x, steps);
+        } else {
+            rearrange_input(cache, x, time_steps, steps);
+        }
+
+        // 2. Start from the state of the previous batch (stateful)
+
+        if constexpr (stateful) {
+            start_chunk(cache, cache.s_t, time_steps);
+        }
+
+        // 3. Forward propagation through time, the batch shrinking as the
+        // sequences end
+
+        for (size_t t = 0; t < steps; ++t) {
+            const size_t rows = active_rows(t, Batch);
+
+            if (rows == Batch) {
+                forward_step(cache, t, w, u, b);
+            } else {
+                masked_forward_step(cache, t, w, u, b, rows);
             }
         }
 
-        // 2. Forward propagation through time
+        // 4. Rearrange the output
 
-        // t == 0
+        if (masked()) {
+            rearrange_masked_output(output, cache.s_t, time_steps, steps);
+        } else {
+            rearrange_output(output, cache, time_steps, steps);
+        }
+    }
 
-        s_t(0) = f_activate<activation_function>(bias_add_2d(x_t(0) * u, b));
+    /*!
+     * \brief Compute the states of the given time step, from the input at
+     * this time step and the states of the previous time step.
+     *
+     * \param cache The storage for the intermediate results (x_t and s_t)
+     * \param t The time step
+     */
+    template <typename C, typename W, typename U, typename B>
+    static void forward_step(C& cache, size_t t, const W& w, const U& u, const B& b) {
+        if (t > 0) {
+            cache.s_t(t) = f_activate<activation_function>(bias_add_2d(cache.x_t(t) * u + cache.s_t(t - 1) * w, b));
+        } else if (cache.has_init) {
+            cache.s_t(0) = f_activate<activation_function>(bias_add_2d(cache.x_t(0) * u + cache.s_init * w, b));
+        } else {
+            cache.s_t(0) = f_activate<activation_function>(bias_add_2d(cache.x_t(0) * u, b));
+        }
+    }
+
+    /*!
+     * \brief Compute the states of the first rows (the running sequences) of
+     * the given time step, the states of the ended sequences being zero
+     *
+     * \param cache The storage for the intermediate results (x_t and s_t)
+     * \param t The time step
+     * \param rows The number of running sequences
+     */
+    template <typename C, typename W, typename U, typename B>
+    static void masked_forward_step(C& cache, size_t t, const W& w, const U& u, const B& b, size_t rows) {
+        const size_t Batch = etl::dim<1>(cache.s_t);
+
+        auto s = etl::slice(cache.s_t(t), 0, rows);
+
+        if (t > 0) {
+            s = f_activate<activation_function>(bias_add_2d(etl::slice(cache.x_t(t), 0, rows) * u + etl::slice(cache.s_t(t - 1), 0, rows) * w, b));
+        } else {
+            s = f_activate<activation_function>(bias_add_2d(etl::slice(cache.x_t(0), 0, rows) * u, b));
+        }
 
-        for (size_t t = 1; t < time_steps; ++t) {
-            s_t(t) = f_activate<activation_function>(bias_add_2d(x_t(t) * u + s_t(t - 1) * w, b));
+        if (rows < Batch) {
+            etl::slice(cache.s_t(t), rows, Batch) = 0;
         }
+    }
 
-        // 3. Rearrange the output
+    /*!
+     * \brief Returns the given time step of the given sample of a batch (the
+     * memory of a time-major batch being laid out time step by time step)
+     */
+    template <typename V>
+    static decltype(auto) sample_step(V&& x, size_t b, size_t t) {
+        if constexpr (time_major) {
+            const size_t r = t * etl::dim<0>(x) + b;
+
+            return x(r / etl::dim<1>(x))(r % etl::dim<1>(x));
+        } else {
+            return x(b)(t);
+        }
+    }
+
+    /*!
+     * \brief Rearrange the first steps of a batch of sequences of their own
+     * lengths by time steps, each sequence being followed by zeros
+     *
+     * \param to The rearranged batch (steps x Batch x N)
+     * \param x The batch of sequences
+     * \param steps The number of steps to rearrange
+     */
+    template <typename To, typename V>
+    void rearrange_masked_input(To& to, const V& x, size_t steps) const {
+        const size_t Batch = etl::dim<1>(to);
+
+        for (size_t b = 0; b < Batch; ++b) {
+            const size_t length = sample_length(b, steps);
+
+            for (size_t t = 0; t < length; ++t) {
+                to(t)(b) = sample_step(x, b, sequence_step(t, length));
+            }
+
+            for (size_t t = length; t < steps; ++t) {
+                to(t)(b) = 0;
+            }
+        }
+    }
+
+    /*!
+     * \brief Rearrange the first steps, by time steps, into a batch of
+     * sequences of their own lengths, the steps after the end of each
+     * sequence being zero
+     *
+     * \param output The batch of sequences
+     * \param from The rearranged batch (steps x Batch x N)
+     * \param time_steps The number of time steps of the output
+     * \param steps The number of steps to rearrange
+     */
+    template <typename H, typename From>
+    void rearrange_masked_output(H&& output, const From& from, size_t time_steps, size_t steps) const {
+        const size_t Batch = etl::dim<1>(from);
 
         for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                output(b)(t) = s_t(t)(b);
+            const size_t length = sample_length(b, steps);
+
+            for (size_t t = 0; t < length; ++t) {
+                sample_step(output, b, sequence_step(t, length)) = from(t)(b);
+            }
+
+            for (size_t t = length; t < time_steps; ++t) {
+                sample_step(output, b, t) = 0;
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the position, in the sequence, of the given time step of
+     * the layer (reverse processes the sequence from its end)
+     */
+    static size_t sequence_step(size_t t, size_t time_steps) {
+        return reverse ? time_steps - 1 - t : t;
+    }
+
+    /*!
+     * \brief Rearrange the first steps of a batch of input by time steps,
+     * into x_t
+     */
+    template <typename C, typename V>
+    static void rearrange_input(C& cache, const V& x, size_t time_steps, size_t steps) {
+        if constexpr (time_major) {
+            copy_steps(cache.x_t, x, time_steps, steps);
+        } else {
+            const auto Batch = etl::dim<0>(x);
+
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < steps; ++t) {
+                    cache.x_t(t)(b) = x(b)(sequence_step(t, steps));
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Rearrange the states (s_t) of the first steps into a batch of
+     * output, the output of the padding steps being zero
+     */
+    template <typename H, typename C>
+    static void rearrange_output(H&& output, C& cache, size_t time_steps, size_t steps) {
+        if constexpr (time_major) {
+            copy_steps(output, cache.s_t, time_steps, steps);
+
+            if (steps < time_steps) {
+                const size_t step = etl::size(output) / time_steps;
+
+                std::fill(output.memory_start() + steps * step, output.memory_end(), 0.0f);
+            }
+        } else {
+            const auto Batch = etl::dim<0>(output);
+
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < steps; ++t) {
+                    output(b)(sequence_step(t, steps)) = cache.s_t(t)(b);
+                }
+
+                for (size_t t = steps; t < time_steps; ++t) {
+                    output(b)(t) = 0;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Copy the first steps of a time-major batch (time_major), the
+     * memory of both sides having the same layout, the steps being reversed
+     * (reverse)
+     *
+     * \param to The destination
+     * \param from The source
+     * \param time_steps The number of time steps
+     * \param steps The number of steps to copy
+     */
+    template <typename To, typename From>
+    static void copy_steps(To&& to, const From& from, size_t time_steps, size_t steps) {
+        cpp_assert(etl::size(to) == etl::size(from), "Invalid time-major copy");
+
+        from.ensure_cpu_up_to_date();
+
+        const size_t step = etl::size(from) / time_steps;
+
+        if constexpr (reverse) {
+            for (size_t t = 0; t < steps; ++t) {
+                const auto* in = from.memory_start() + (steps - 1 - t) * step;
+
+                std::copy(in, in + step, to.memory_start() + t * step);
+            }
+        } else {
+            std::copy(from.memory_start(), from.memory_start() + steps * step, to.memory_start());
+        }
+
+        to.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Save the last state of the previous batch as the initial state
+     * of this batch (stateful), if it must be carried
+     *
+     * \param cache The cache of the states
+     * \param states The states of the previous batch (time_steps x Batch x hidden_units)
+     * \param time_steps The number of time steps
+     */
+    template <typename C, typename S>
+    static void start_chunk(C& cache, S& states, size_t time_steps) {
+        cache.has_init = cache.carry;
+
+        if (cache.has_init) {
+            if (etl::dim<0>(cache.s_init) != etl::dim<1>(states) || etl::dim<1>(cache.s_init) != etl::dim<2>(states)) {
+                cache.s_init.resize(etl::dim<1>(states), etl::dim<2>(states));
             }
+
+            cache.s_init = states(time_steps - 1);
         }
+
+        cache.carry = true;
     }
 
     /*!
      * \brief Backpropagate the errors to the previous layers
+     *
+     * The errors are backpropagated through the last bptt_steps time steps
+     * in a single reverse sweep, each step receiving its own error plus the
+     * error carried from all the following steps. The gradients of the
+     * weights are then computed with one matrix multiplication over all the
+     * time steps of the window.
+     *
      * \param output The ETL expression into which write the output
      * \param context The training context
      */
     template <typename H, typename C, typename W, typename U>
     void backward_batch_impl(H&& output, C& context, const W& w, const U& u, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps, bool direct = true) const {
-        cpp_unused(sequence_length);
-
         const size_t Batch = etl::dim<0>(context.errors);
 
+        // The padding steps have not been computed
+        const size_t steps = batch_steps(time_steps);
+
+        // The first time step receiving errors
+        const size_t first = steps > bptt_steps ? steps - bptt_steps : 0;
+        const size_t n     = steps - first;
+
         etl::dyn_matrix<float, 3> delta_t(time_steps, Batch, hidden_units);
         etl::dyn_matrix<float, 3> d_h_t(time_steps, Batch, hidden_units);
-        etl::dyn_matrix<float, 3> d_x_t(time_steps, Batch, sequence_length);
+        etl::dyn_matrix<float, 2> d_next(Batch, hidden_units);
 
         // 1. Rearrange errors
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                delta_t(t)(b) = context.errors(b)(t);
+        if (masked()) {
+            rearrange_masked_input(delta_t, context.errors, steps);
+        } else if constexpr (time_major) {
+            copy_steps(delta_t, context.errors, time_steps, steps);
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < steps; ++t) {
+                    delta_t(t)(b) = context.errors(b)(sequence_step(t, steps));
+                }
             }
         }
 
-        // 2. Get the gradients from the context
-
-        auto& w_grad = std::get<0>(context.up.context)->grad;
-        auto& u_grad = std::get<1>(context.up.context)->grad;
-        auto& b_grad = std::get<2>(context.up.context)->grad;
-
-        w_grad = 0;
-        u_grad = 0;
-        b_grad = 0;
-
-        // 3. Backpropagation through time
-
-        size_t ttt = time_steps - 1;
-
-        do {
-            const size_t last_step = std::max(int(time_steps) - int(bptt_steps), 0);
+        // 2. Backpropagation through time, in a single reverse sweep
 
-            // Backpropagation through time
-            for (int tt = ttt; tt >= int(last_step); --tt) {
-                const size_t t = tt;
+        for (size_t t = steps; t-- > first;) {
+            const size_t rows = active_rows(t, Batch);
 
-                if(t == time_steps - 1){
+            if (rows == Batch) {
+                if (t == steps - 1) {
                     d_h_t(t) = delta_t(t) >> f_derivative<activation_function>(s_t(t));
                 } else {
-                    d_h_t(t) = (delta_t(t) + d_h_t(t + 1)) >> f_derivative<activation_function>(s_t(t));
+                    d_h_t(t) = (delta_t(t) + d_next) >> f_derivative<activation_function>(s_t(t));
                 }
 
-                if (t > 0) {
-                    w_grad += etl::batch_outer(s_t(t - 1), d_h_t(t));
+                if (t > first) {
+                    d_next = d_h_t(t) * trans(w);
                 }
+            } else {
+                // Only the running sequences receive errors
+                auto d = etl::slice(d_h_t(t), 0, rows);
 
-                u_grad += etl::batch_outer(x_t(t), d_h_t(t));
-                b_grad += etl::bias_batch_sum_2d(d_h_t(t));
+                if (t == steps - 1) {
+                    d = etl::slice(delta_t(t), 0, rows) >> f_derivative<activation_function>(etl::slice(s_t(t), 0, rows));
+                } else {
+                    d = (etl::slice(delta_t(t), 0, rows) + etl::slice(d_next, 0, rows)) >> f_derivative<activation_function>(etl::slice(s_t(t), 0, rows));
+                }
 
-                // Gradients to the input
-                d_x_t(t) = d_h_t(t) * trans(u);
+                etl::slice(d_h_t(t), rows, Batch) = 0;
 
-                // Update for next steps
-                d_h_t(t) = d_h_t(t) * trans(w);
+                if (t > first) {
+                    etl::slice(d_next, 0, rows) = d * trans(w);
+                    etl::slice(d_next, rows, Batch) = 0;
+                }
             }
+        }
+
+        // 3. Compute the gradients over all the time steps at once
+
+        const size_t rows = n * Batch;
+
+        etl::dyn_matrix<float, 2> d_h(rows, hidden_units);
+        etl::dyn_matrix<float, 2> x_n(rows, sequence_length);
+        etl::dyn_matrix<float, 2> s_n(rows, hidden_units);
 
-            --ttt;
+        const size_t h_size = Batch * hidden_units;
+        const size_t x_size = Batch * sequence_length;
 
-            // If only the last time step is used, no need to use the other errors
-            if constexpr (desc::parameters::template contains<last_only>()) {
-                break;
+        std::copy(d_h_t.memory_start() + first * h_size, d_h_t.memory_start() + steps * h_size, d_h.memory_start());
+        std::copy(x_t.memory_start() + first * x_size, x_t.memory_start() + steps * x_size, x_n.memory_start());
+
+        // The states before each time step
+
+        if (first > 0) {
+            std::copy(s_t.memory_start() + (first - 1) * h_size, s_t.memory_start() + (steps - 1) * h_size, s_n.memory_start());
+        } else {
+            if (has_init) {
+                std::copy(s_init.memory_start(), s_init.memory_end(), s_n.memory_start());
+            } else {
+                std::fill(s_n.memory_start(), s_n.memory_start() + h_size, 0.0f);
             }
-        } while (ttt != 0);
 
-        // 3. Rearrange for the output
+            std::copy(s_t.memory_start(), s_t.memory_start() + (steps - 1) * h_size, s_n.memory_start() + h_size);
+        }
+
+        auto& w_grad = std::get<0>(context.up.context)->grad;
+        auto& u_grad = std::get<1>(context.up.context)->grad;
+        auto& b_grad = std::get<2>(context.up.context)->grad;
+
+        w_grad = trans(s_n) * d_h;
+        u_grad = trans(x_n) * d_h;
+        b_grad = etl::bias_batch_sum_2d(d_h);
+
+        // 4. Gradients to the input, rearranged for the output (none for the
+        // padding steps)
 
         if (direct) {
-            for (size_t b = 0; b < Batch; ++b) {
+            etl::dyn_matrix<float, 2> d_x(rows, sequence_length);
+
+            d_x = d_h * trans(u);
+
+            if (masked()) {
+                for (size_t b = 0; b < Batch; ++b) {
+                    const size_t length = sample_length(b, steps);
+
+                    for (size_t t = 0; t < time_steps; ++t) {
+                        const size_t p = t < length ? sequence_step(t, length) : t;
+
+                        if (t < first || t >= length) {
+                            sample_step(output, b, p) = 0;
+                        } else {
+                            sample_step(output, b, p) = d_x((t - first) * Batch + b);
+                        }
+                    }
+                }
+            } else if constexpr (time_major) {
+                d_x.ensure_cpu_up_to_date();
+                output.ensure_cpu_up_to_date();
+
                 for (size_t t = 0; t < time_steps; ++t) {
-                    output(b)(t) = d_x_t(t)(b);
+                    auto* out = output.memory_start() + (t < steps ? sequence_step(t, steps) : t) * x_size;
+
+                    if (t < first || t >= steps) {
+                        std::fill(out, out + x_size, 0.0f);
+                    } else {
+                        std::copy(d_x.memory_start() + (t - first) * x_size, d_x.memory_start() + (t - first + 1) * x_size, out);
+                    }
+                }
+
+                output.invalidate_gpu();
+            } else {
+                for (size_t b = 0; b < Batch; ++b) {
+                    for (size_t t = 0; t < first; ++t) {
+                        output(b)(sequence_step(t, steps)) = 0;
+                    }
+
+                    for (size_t t = first; t < steps; ++t) {
+                        output(b)(sequence_step(t, steps)) = d_x((t - first) * Batch + b);
+                    }
+
+                    for (size_t t = steps; t < time_steps; ++t) {
+                        output(b)(t) = 0;
+                    }
                 }
             }
         }
@@ -183,13 +631,19 @@ struct base_rnn_layer : layer<Derived> {
 
     /*!
      * \brief Compute the gradients for this layer, if any
+     *
+     * When the errors have been backpropagated by backward_batch, the
+     * gradients have already been computed by the same sweep.
+     *
      * \param context The trainng context
      */
     template <typename C, typename W, typename U>
     void compute_gradients_impl(C& context, const W& w, const U& u, size_t time_steps, size_t sequence_length, size_t hidden_units, size_t bptt_steps) const {
-        if constexpr (!C::layer){
+        if (!context.gradients_ready) {
             backward_batch_impl(x_t, context, w, u, time_steps, sequence_length, hidden_units, bptt_steps, false);
         }
+
+        context.gradients_ready = false;
     }
 
     /*!
@@ -260,6 +714,63 @@ struct base_rnn_layer : layer<Derived> {
         return std::make_tuple(std::cref(as_derived().w), std::cref(as_derived().u), std::cref(as_derived().b));
     }
 
+    // Step by step forward propagation (see wavefront_forward)
+
+    /*!
+     * \brief Start the step by step forward propagation of a batch
+     * \param Batch The number of samples of the batch
+     */
+    void wavefront_begin(size_t Batch) const {
+        auto& d = as_derived();
+
+        prepare_cache(Batch, d.time_steps, d.sequence_length, d.hidden_units);
+
+        if constexpr (stateful) {
+            start_chunk(*this, s_t, d.time_steps);
+        }
+    }
+
+    /*!
+     * \brief Set the complete input of the batch (first layer of a stack)
+     */
+    template <typename V>
+    void wavefront_input(const V& x) const {
+        rearrange_input(*this, x, as_derived().time_steps, as_derived().time_steps);
+    }
+
+    /*!
+     * \brief Compute the given time step, from the input already set
+     */
+    void wavefront_step(size_t t) const {
+        forward_step(*this, t, as_derived().w, as_derived().u, as_derived().b);
+    }
+
+    /*!
+     * \brief Compute the given time step, from the given input at this step
+     * \param x The input at this time step (Batch x sequence_length)
+     */
+    template <typename X>
+    void wavefront_step(size_t t, const X& x) const {
+        x_t(t) = x;
+
+        wavefront_step(t);
+    }
+
+    /*!
+     * \brief Returns the states computed at the given time step
+     */
+    decltype(auto) wavefront_state(size_t t) const {
+        return s_t(t);
+    }
+
+    /*!
+     * \brief Write the output of the batch, once all the steps are computed
+     */
+    template <typename H>
+    void wavefront_end(H&& output) const {
+        rearrange_output(output, *this, as_derived().time_steps, as_derived().time_steps);
+    }
+
 private:
     //CRTP Deduction
 
@@ -0,0 +1,443 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Micro-batching front-end for online inference.
+ *
+ * Single-sample requests are queued and gathered into batches, either until
+ * the maximum batch size is reached or until the oldest request reaches its
+ * deadline. Each batch is forwarded at once through the network and the
+ * results are given back to the callers with futures.
+ *
+ * The batches are forwarded by several lanes (GPU streams and CPU threads),
+ * each with its own session. Each lane measures its throughput and the
+ * slower lanes collect proportionally smaller batches, so that they do not
+ * hold the requests longer than the faster lanes.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "dll/inference_session.hpp"
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+namespace server_detail {
+
+/*!
+ * \brief Return the name of the latency histogram bucket for the given latency
+ * \param us The latency in microseconds
+ */
+inline const char* latency_bucket(size_t us) {
+    if (us < 100) {
+        return "server:latency:<100us";
+    } else if (us < 1000) {
+        return "server:latency:<1ms";
+    } else if (us < 10000) {
+        return "server:latency:<10ms";
+    } else if (us < 100000) {
+        return "server:latency:<100ms";
+    } else {
+        return "server:latency:>=100ms";
+    }
+}
+
+/*!
+ * \brief Return the name of the batch fill histogram bucket for the given
+ * batch
+ * \param n The number of samples in the batch
+ * \param max The maximum number of samples in the batch
+ */
+inline const char* fill_bucket(size_t n, size_t max) {
+    const size_t percent = (100 * n) / max;
+
+    if (percent <= 25) {
+        return "server:fill:0-25%";
+    } else if (percent <= 50) {
+        return "server:fill:25-50%";
+    } else if (percent <= 75) {
+        return "server:fill:50-75%";
+    } else if (percent < 100) {
+        return "server:fill:75-99%";
+    } else {
+        return "server:fill:100%";
+    }
+}
+
+/*!
+ * \brief Return the share of a lane of the given throughput in a batch of
+ * the given maximum size
+ * \param max The maximum number of samples in a batch
+ * \param throughput The measured throughput of the lane (0 if not measured)
+ * \param best The best measured throughput of the lanes
+ */
+inline size_t lane_share(size_t max, double throughput, double best) {
+    if (throughput <= 0.0 || best <= 0.0) {
+        return max;
+    }
+
+    return std::max(size_t(1), std::min(max, size_t(max * (throughput / best) + 0.5)));
+}
+
+} //end of server_detail namespace
+
+/*!
+ * \brief The lanes of a batch server
+ *
+ * Without GPU support (ETL_GPU), the GPU streams are CPU threads as well.
+ * With GPU support, the CPU threads evaluate on the CPU. All the streams run
+ * on the device of ETL.
+ */
+struct server_devices {
+    size_t gpu_streams = 0; ///< The number of lanes forwarding on the GPU
+    size_t cpu_threads = 1; ///< The number of lanes forwarding on the CPU
+};
+
+/*!
+ * \brief A micro-batching inference server for a network.
+ *
+ * The server uses one or more worker threads (lanes), each with its own
+ * inference_session on the shared (read-only) network.
+ *
+ * The latency of the requests and the fill ratio of the batches are recorded
+ * as histograms in the timers registry (server:latency:* and server:fill:*),
+ * to be displayed with dump_timers().
+ */
+template <typename DBN>
+struct batch_server {
+    using dbn_t        = DBN;                                                                   ///< The network type
+    using weight       = typename dbn_t::weight;                                                ///< The data type of the network
+    using input_one_t  = typename dbn_t::input_one_t;                                           ///< The type of one input
+    using output_one_t = typename session_detail::types<dbn_t, dbn_t::layers - 1>::output_one_t; ///< The type of one output
+    using session_t    = inference_session<dbn_t>;                                              ///< The type of inference session
+    using clock        = std::chrono::steady_clock;                                             ///< The clock used for deadlines
+
+    using input_batch_t = etl::dyn_matrix<weight, etl::decay_traits<input_one_t>::dimensions() + 1>; ///< The type of a batch of input
+
+    /*!
+     * \brief Create a new server on the given network.
+     *
+     * \param dbn The network, must not be modified while the server is running
+     * \param max_batch The maximum number of samples in a batch
+     * \param max_delay The maximum time a request can wait for its batch to be filled
+     * \param threads The number of worker threads
+     */
+    batch_server(const dbn_t& dbn, size_t max_batch = dbn_t::batch_size, std::chrono::microseconds max_delay = std::chrono::microseconds(1000), size_t threads = 1)
+            : batch_server(dbn, max_batch, max_delay, server_devices{0, threads}) {}
+
+    /*!
+     * \brief Create a new server on the given network, with the given lanes.
+     *
+     * \param dbn The network, must not be modified while the server is running
+     * \param max_batch The maximum number of samples in a batch
+     * \param max_delay The maximum time a request can wait for its batch to be filled
+     * \param devices The GPU streams and the CPU threads of the server
+     */
+    batch_server(const dbn_t& dbn, size_t max_batch, std::chrono::microseconds max_delay, server_devices devices)
+            : dbn(dbn), max_batch(max_batch), max_delay(max_delay), lanes(devices.gpu_streams + devices.cpu_threads) {
+        cpp_assert(max_batch > 0, "The batches cannot be empty");
+        cpp_assert(!lanes.empty(), "The server needs at least one worker");
+
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            lanes[i].gpu = i < devices.gpu_streams;
+        }
+
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            workers.emplace_back([this, i] { worker_main(i); });
+        }
+    }
+
+    batch_server(const batch_server& rhs) = delete;
+    batch_server& operator=(const batch_server& rhs) = delete;
+
+    /*!
+     * \brief Stop the server, after all the pending requests are processed.
+     */
+    ~batch_server() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+
+        condition.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /*!
+     * \brief Submit a sample for inference.
+     * \param sample The sample to forward through the network
+     * \return a future to the output of the network for the sample
+     */
+    std::future<output_one_t> submit(const input_one_t& sample) {
+        std::future<output_one_t> future;
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            queue.emplace_back(sample);
+            future = queue.back().promise.get_future();
+        }
+
+        condition.notify_one();
+
+        return future;
+    }
+
+    /*!
+     * \brief Submit a sample for inference and wait for its result
+     * \param sample The sample to forward through the network
+     * \return the output of the network for the sample
+     */
+    output_one_t forward_one(const input_one_t& sample) {
+        return submit(sample).get();
+    }
+
+    /*!
+     * \brief Returns the number of requests waiting to be processed
+     */
+    size_t pending() const {
+        std::lock_guard<std::mutex> l(lock);
+        return queue.size();
+    }
+
+    /*!
+     * \brief Returns the measured throughput of each lane (samples per
+     * second, 0 if the lane has not forwarded any batch yet). The GPU
+     * streams are the first lanes.
+     */
+    std::vector<double> throughputs() const {
+        std::lock_guard<std::mutex> l(lock);
+
+        std::vector<double> values;
+
+        for (auto& lane : lanes) {
+            values.push_back(lane.throughput);
+        }
+
+        return values;
+    }
+
+private:
+    /*!
+     * \brief One request
+     */
+    struct request {
+        input_one_t sample;                    ///< The sample to forward
+        std::promise<output_one_t> promise;    ///< The promise of the output
+        clock::time_point arrival;             ///< The arrival time of the request
+
+        /*!
+         * \brief Create a new request for the given sample
+         */
+        explicit request(const input_one_t& sample) : sample(sample), arrival(clock::now()) {}
+    };
+
+    /*!
+     * \brief One lane of the server
+     */
+    struct lane {
+        bool gpu          = false; ///< Indicates if the lane forwards on the GPU
+        double throughput = 0.0;   ///< The moving average of the throughput of the lane (samples per second)
+    };
+
+    /*!
+     * \brief Returns the number of samples the given lane collects in one
+     * batch (under the lock)
+     */
+    size_t lane_batch(size_t index) const {
+        double best = 0.0;
+
+        for (auto& lane : lanes) {
+            best = std::max(best, lane.throughput);
+        }
+
+        return server_detail::lane_share(max_batch, lanes[index].throughput, best);
+    }
+
+    /*!
+     * \brief The main function of each worker
+     * \param index The lane of the worker
+     */
+    void worker_main(size_t index) {
+#ifdef ETL_GPU
+        // The CPU lanes leave the device to the GPU streams
+        if (!lanes[index].gpu) {
+            etl::local_context().cpu = true;
+        }
+#endif
+
+        session_t session(dbn, max_batch);
+
+        input_batch_t batch;
+
+        std::vector<request> current;
+        current.reserve(max_batch);
+
+        while (true) {
+            bool more = false;
+
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                condition.wait(l, [this] { return stop || !queue.empty(); });
+
+                if (queue.empty()) {
+                    // Only possible when stopping
+                    return;
+                }
+
+                // Wait for the batch to be filled or for the deadline of the oldest request
+
+                auto deadline = queue.front().arrival + max_delay;
+
+                const size_t batch_size = lane_batch(index);
+
+                condition.wait_until(l, deadline, [this, batch_size] { return stop || queue.size() >= batch_size; });
+
+                const size_t n = std::min(queue.size(), batch_size);
+
+                for (size_t i = 0; i < n; ++i) {
+                    current.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+
+                more = !queue.empty();
+            }
+
+            // Another worker may have collected the requests in the meantime
+            if (current.empty()) {
+                continue;
+            }
+
+            // Let the other workers collect the remaining requests
+            if (more) {
+                condition.notify_one();
+            }
+
+            auto start = clock::now();
+
+            if (process(session, batch, current)) {
+                const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+                if (seconds > 0.0) {
+                    update_throughput(index, current.size() / seconds);
+                }
+            }
+
+            current.clear();
+        }
+    }
+
+    /*!
+     * \brief Update the moving average of the throughput of the given lane
+     */
+    void update_throughput(size_t index, double throughput) {
+        std::lock_guard<std::mutex> l(lock);
+
+        auto& lane = lanes[index];
+
+        if (lane.throughput > 0.0) {
+            lane.throughput = 0.8 * lane.throughput + 0.2 * throughput;
+        } else {
+            lane.throughput = throughput;
+        }
+    }
+
+    /*!
+     * \brief Forward a batch of requests through the network and fulfill
+     * their promises
+     * \return true if the batch was forwarded, false on error
+     */
+    bool process(session_t& session, input_batch_t& batch, std::vector<request>& current) {
+        dll::auto_timer timer("server:batch");
+
+        const size_t n = current.size();
+
+        if (cpp_unlikely(etl::dim<0>(batch) < max_batch)) {
+            prepare_batch(batch, current.front().sample);
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            batch(i) = current[i].sample;
+        }
+
+        try {
+            auto output = session.forward_batch(etl::slice(batch, 0, n));
+
+            for (size_t i = 0; i < n; ++i) {
+                auto result = dbn.template prepare_one_output<input_one_t>();
+
+                if constexpr (!etl::is_fast<output_one_t>) {
+                    result.inherit_if_null(output(i));
+                }
+
+                result = output(i);
+
+                current[i].promise.set_value(std::move(result));
+            }
+        } catch (...) {
+            for (auto& r : current) {
+                r.promise.set_exception(std::current_exception());
+            }
+
+            return false;
+        }
+
+        increment_timer(server_detail::fill_bucket(n, max_batch), n);
+
+        auto now = clock::now();
+
+        for (auto& r : current) {
+            auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - r.arrival).count();
+            increment_timer(server_detail::latency_bucket(latency / 1000), latency);
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Allocate the input batch for the given sample type
+     */
+    void prepare_batch(input_batch_t& batch, const input_one_t& one) {
+        constexpr size_t D = etl::decay_traits<input_one_t>::dimensions();
+
+        if constexpr (D == 1) {
+            batch.resize(max_batch, etl::dim<0>(one));
+        } else if constexpr (D == 2) {
+            batch.resize(max_batch, etl::dim<0>(one), etl::dim<1>(one));
+        } else if constexpr (D == 3) {
+            batch.resize(max_batch, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one));
+        }
+    }
+
+    const dbn_t& dbn;                     ///< The network
+    const size_t max_batch;               ///< The maximum number of samples in a batch
+    const std::chrono::microseconds max_delay; ///< The maximum waiting time of a request
+
+    mutable std::mutex lock;              ///< The lock protecting the queue
+    std::condition_variable condition;    ///< The condition variable to wake up the workers
+    std::deque<request> queue;            ///< The pending requests
+    bool stop = false;                    ///< Indicates if the server is stopping
+    std::vector<lane> lanes;              ///< The lanes of the server (protected by the lock)
+
+    std::vector<std::thread> workers; ///< The worker threads
+};
+
+} //end of dll namespace
@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "cpp_utils/assert.hpp"         //Assertions
-#include "cpp_utils/maybe_parallel.hpp" //conditional parallel loops
 #include "cpp_utils/static_if.hpp"      //static_if for compile-time reduction
 
 #include "etl/etl.hpp"
@@ -27,6 +29,11 @@
 #include "decay_type.hpp"
 #include "layer_traits.hpp"
 #include "util/blas.hpp"
+#include "util/fft_conv.hpp"
+#include "util/sparse.hpp"
+#include "util/bfloat16.hpp"
+#include "util/random.hpp"
+#include "util/parallel.hpp"
 
 namespace dll {
 
@@ -66,6 +73,152 @@ void apply_clip_gradients(Grad& grad, T t, size_t n){
     }
 }
 
+/*!
+ * \brief Round the master weights of a mixed precision trainer into the
+ * weights of the RBM, stochastically, so that they remain representable in
+ * bfloat16.
+ */
+template <typename RBM, typename Trainer>
+void round_weights(RBM& rbm, Trainer& t) {
+    using weight = typename RBM::weight;
+
+    static_assert(std::is_same<weight, float>::value, "Mixed precision training is only supported for float weights");
+
+    t.w_master.ensure_cpu_up_to_date();
+    rbm.w.ensure_cpu_up_to_date();
+
+    const float* m = t.w_master.memory_start();
+    float* w       = rbm.w.memory_start();
+    const size_t n = etl::size(rbm.w);
+
+    float noise[256];
+
+    for (size_t i = 0; i < n; i += 256) {
+        const size_t c = std::min<size_t>(256, n - i);
+
+        t.rounding.generate(noise, c);
+
+        for (size_t j = 0; j < c; ++j) {
+            w[i + j] = round_bf16_stochastic(m[i + j], uint32_t(noise[j] * 65536.0f));
+        }
+    }
+
+    rbm.w.invalidate_gpu();
+}
+
+/*!
+ * \brief Apply the given increment to the weights of the RBM.
+ *
+ * With mixed precision, the increment is accumulated in the full precision
+ * master weights of the trainer, which are then rounded into the RBM.
+ */
+template <typename RBM, typename Trainer, typename Inc>
+void update_weights(RBM& rbm, Trainer& t, const Inc& inc) {
+    if constexpr (rbm_layer_traits<RBM>::mixed_precision()) {
+        t.w_master += inc;
+
+        round_weights(rbm, t);
+    } else {
+        rbm.w += inc;
+    }
+}
+
+/* The sparsity penalties */
+
+/*!
+ * \brief Update the moving average of the local sparsity of a
+ * fully-connected RBM and apply its penalty to the gradients of the hidden
+ * biases and of the weights, in a single pass over the gradients.
+ */
+template <typename RBM, typename Trainer>
+void local_sparsity_normal(const RBM& rbm, Trainer& t) {
+    using weight = typename RBM::weight;
+
+    const weight decay_rate = rbm.decay_rate;
+    const weight p          = rbm.sparsity_target;
+    const weight cost       = rbm.sparsity_cost;
+
+    const size_t V = etl::dim<0>(t.w_grad);
+    const size_t H = etl::dim<1>(t.w_grad);
+
+    t.q_local_batch.ensure_cpu_up_to_date();
+    t.q_local_t.ensure_cpu_up_to_date();
+    t.b_grad.ensure_cpu_up_to_date();
+    t.w_grad.ensure_cpu_up_to_date();
+
+    const weight* q_batch = t.q_local_batch.memory_start();
+    weight* q             = t.q_local_t.memory_start();
+    weight* b             = t.b_grad.memory_start();
+    weight* w             = t.w_grad.memory_start();
+
+    for (size_t j = 0; j < H; ++j) {
+        q[j] = decay_rate * q[j] + (weight(1) - decay_rate) * q_batch[j];
+        b[j] -= cost * (q[j] - p);
+    }
+
+    // The penalty of a hidden unit is applied to all its weights
+    for (size_t v = 0; v < V; ++v) {
+        weight* row = w + v * H;
+
+        for (size_t j = 0; j < H; ++j) {
+            row[j] -= cost * (q[j] - p);
+        }
+    }
+
+    t.q_local_t.invalidate_gpu();
+    t.b_grad.invalidate_gpu();
+    t.w_grad.invalidate_gpu();
+}
+
+/*!
+ * \brief Update the moving average of the local sparsity of a
+ * convolutional RBM and apply its penalty to the gradients of the hidden
+ * biases and of the weights, in a single pass over the gradients.
+ *
+ * The penalty of a filter is the sum of the penalties of its hidden units.
+ */
+template <typename RBM, typename Trainer>
+void local_sparsity_conv(const RBM& rbm, Trainer& t) {
+    using weight = typename RBM::weight;
+
+    const weight decay_rate = rbm.decay_rate;
+    const weight p          = rbm.sparsity_target;
+    const weight cost       = rbm.sparsity_cost;
+
+    const size_t K  = etl::dim<0>(t.w_grad);
+    const size_t NH = etl::size(t.q_local_t) / K;
+    const size_t NW = etl::size(t.w_grad) / K;
+
+    t.q_local_batch.ensure_cpu_up_to_date();
+    t.q_local_t.ensure_cpu_up_to_date();
+    t.b_grad.ensure_cpu_up_to_date();
+    t.w_grad.ensure_cpu_up_to_date();
+
+    const weight* q_batch = t.q_local_batch.memory_start();
+    weight* q             = t.q_local_t.memory_start();
+    weight* b             = t.b_grad.memory_start();
+    weight* w             = t.w_grad.memory_start();
+
+    for (size_t k = 0; k < K; ++k) {
+        weight penalty = 0;
+
+        for (size_t i = k * NH; i < (k + 1) * NH; ++i) {
+            q[i] = decay_rate * q[i] + (weight(1) - decay_rate) * q_batch[i];
+            penalty += cost * (q[i] - p);
+        }
+
+        b[k] -= penalty;
+
+        for (size_t i = k * NW; i < (k + 1) * NW; ++i) {
+            w[i] -= penalty;
+        }
+    }
+
+    t.q_local_t.invalidate_gpu();
+    t.b_grad.invalidate_gpu();
+    t.w_grad.invalidate_gpu();
+}
+
 /* The update weights procedure */
 
 /*!
@@ -102,21 +255,7 @@ void update_normal(RBM& rbm, Trainer& t) {
 
     //Local sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        auto decay_rate = rbm.decay_rate;
-        auto p          = rbm.sparsity_target;
-        auto cost       = rbm.sparsity_cost;
-
-        t.q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
-
-        auto q_local_penalty = cost * (t.q_local_t - p);
-
-        t.b_grad -= q_local_penalty;
-
-        for (size_t i = 0; i < num_hidden(rbm); ++i) {
-            for (size_t j = 0; j < num_visible(rbm); ++j) {
-                t.w_grad(j, i) -= q_local_penalty(i);
-            }
-        }
+        local_sparsity_normal(rbm, t);
     }
 
     //TODO the batch is not necessary full!
@@ -142,13 +281,13 @@ void update_normal(RBM& rbm, Trainer& t) {
         t.b_inc = momentum * t.b_inc + eps * t.b_grad;
         t.c_inc = momentum * t.c_inc + eps * t.c_grad;
 
-        rbm.w += t.w_inc;
+        update_weights(rbm, t, t.w_inc);
         rbm.b += t.b_inc;
         rbm.c += t.c_inc;
     }
     //Apply the learning rate
     else {
-        rbm.w += eps * t.w_grad;
+        update_weights(rbm, t, eps * t.w_grad);
         rbm.b += eps * t.b_grad;
         rbm.c += eps * t.c_grad;
     }
@@ -192,29 +331,12 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 
     //Local sparsity method
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        auto decay_rate = rbm.decay_rate;
-        auto p          = rbm.sparsity_target;
-        auto cost       = rbm.sparsity_cost;
-
-        t.q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
-
-        auto q_local_penalty = cost * (t.q_local_t - p);
-
-        t.b_grad -= sum_r(q_local_penalty);
-
-        const auto K   = get_k(rbm);
-
-        auto k_penalty = sum_r(q_local_penalty);
-        for (size_t k = 0; k < K; ++k) {
-            t.w_grad(k) = t.w_grad(k) - k_penalty(k);
-        }
+        local_sparsity_conv(rbm, t);
     }
 
-    //Honglak Lee's sparsity method
+    //Honglak Lee's sparsity method (only the hidden biases are penalized)
     if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE) {
-        t.w_grad -= rbm.pbias_lambda * t.w_bias;
         t.b_grad -= rbm.pbias_lambda * t.b_bias;
-        t.c_grad -= rbm.pbias_lambda * t.c_bias;
     }
 
     constexpr auto n_samples = RBM::batch_size;
@@ -228,13 +350,13 @@ void update_convolutional(RBM& rbm, Trainer& t) {
         t.b_inc = momentum * t.b_inc + eps * t.b_grad;
         t.c_inc = momentum * t.c_inc + eps * t.c_grad;
 
-        rbm.w += t.w_inc;
+        update_weights(rbm, t, t.w_inc);
         rbm.b += t.b_inc;
         rbm.c += t.c_inc;
     }
     //Apply learning rate only
     else {
-        rbm.w += eps * t.w_grad;
+        update_weights(rbm, t, eps * t.w_grad);
         rbm.b += eps * t.b_grad;
         rbm.c += eps * t.c_grad;
     }
@@ -248,12 +370,11 @@ void update_convolutional(RBM& rbm, Trainer& t) {
 /* The training procedures */
 
 /*!
- * \brief Compute the gradients for a fully-connected RBM
+ * \brief Copy a batch in the trainer of a fully-connected RBM and compute the
+ * first hidden step (positive phase).
  */
-template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
-void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
-    dll::auto_timer timer("cd:gradients:normal:batch");
-
+template <bool Persistent, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
+void positive_phase_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
     cpp_assert(etl::dim<0>(input_batch) == etl::dim<0>(expected_batch), "Invalid batch sizes");
     cpp_assert(etl::dim<0>(t.v1) >= etl::dim<0>(input_batch), "Invalid batch sizes");
     cpp_assert(etl::dim<0>(t.vf) >= etl::dim<0>(expected_batch), "Invalid batch sizes");
@@ -262,7 +383,6 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
     cpp_assert(etl::size(t.v1) >= etl::size(input_batch), "Invalid input to compute_gradients_normal");
     cpp_assert(etl::size(t.vf) >= etl::size(expected_batch), "Invalid input to compute_gradients_normal");
 
-    const auto B          = etl::dim<0>(t.v1);
     const size_t IB       = etl::dim<0>(input_batch);
     const bool full_batch = (IB == RBM::batch_size);
 
@@ -285,6 +405,80 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
         t.p_h_a = t.h1_a;
         t.p_h_s = t.h1_s;
     }
+}
+
+/*!
+ * \brief Compute the sparsity of a batch of a fully-connected RBM (the mean
+ * activations of its hidden units in the positive phase) from the sums of the
+ * hidden activations of the positive phase, in b_grad.
+ */
+template <typename Trainer>
+void positive_sparsity_normal(Trainer& t) {
+    using weight = typename Trainer::weight;
+
+    const size_t B = etl::dim<0>(t.h1_a);
+    const size_t H = etl::size(t.b_grad);
+
+    t.b_grad.ensure_cpu_up_to_date();
+
+    const weight* sums = t.b_grad.memory_start();
+
+    weight total = 0;
+
+    for (size_t j = 0; j < H; ++j) {
+        total += sums[j];
+    }
+
+    t.q_global_batch = total / weight(B * H);
+
+    if constexpr (rbm_layer_traits<typename Trainer::rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
+        weight* q = t.q_local_batch.memory_start();
+
+        for (size_t j = 0; j < H; ++j) {
+            q[j] = sums[j] / weight(B);
+        }
+
+        t.q_local_batch.invalidate_gpu();
+    }
+}
+
+/*!
+ * \brief Compute the gradients of a fully-connected RBM from the first step
+ * (h1_a) and the last step (v2_a, h2_a) of the chain.
+ */
+template <typename Trainer>
+void chain_gradients_normal(Trainer& t) {
+    dll::auto_timer timer("cd:batch_compute_gradients:std");
+
+    if constexpr (Trainer::rbm_t::sparse_input) {
+        sparse_batch<typename Trainer::weight> sv;
+        sv.compress(t.vf);
+        sv.outer(t.w_grad, t.h1_a);
+    } else {
+        t.w_grad = batch_outer(t.vf, t.h1_a);
+    }
+
+    t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+
+    t.b_grad = etl::bias_batch_sum_2d(t.h1_a);
+
+    // The sums of the positive phase are also the sparsity of the batch
+    positive_sparsity_normal(t);
+
+    t.b_grad -= etl::bias_batch_sum_2d(t.h2_a);
+
+    t.c_grad = etl::bias_batch_sum_2d(t.vf);
+    t.c_grad -= etl::bias_batch_sum_2d(t.v2_a);
+}
+
+/*!
+ * \brief Compute the gradients for a fully-connected RBM
+ */
+template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch, typename RBM, typename Trainer>
+void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("cd:gradients:normal:batch");
+
+    positive_phase_normal<Persistent>(input_batch, expected_batch, rbm, t);
 
     //CD-1
     if constexpr (Persistent) {
@@ -302,23 +496,71 @@ void compute_gradients_normal(InputBatch& input_batch, ExpectedBatch& expected_b
     }
 
     //Compute the gradients
+    chain_gradients_normal(t);
+}
 
-    {
-        dll::auto_timer timer("cd:batch_compute_gradients:std");
+/*!
+ * \brief Compute the sum of the free energies of the first n samples of the
+ * batch, from the hidden activations of the positive phase.
+ *
+ * With binary hidden units, log(1 + e^x) = -log(1 - sigmoid(x)) and the
+ * free energy does not need another product with the weights.
+ */
+template <typename RBM, typename Trainer>
+double batch_free_energy_normal(const RBM& rbm, const Trainer& t, size_t n) {
+    using namespace etl;
 
-        t.w_grad = batch_outer(t.vf, t.h1_a);
-        t.w_grad -= batch_outer(t.v2_a, t.h2_a);
+    using weight = typename RBM::weight;
 
-        t.b_grad = t.h1_a(0) - t.h2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.b_grad += t.h1_a(b) - t.h2_a(b);
-        }
+    if constexpr (RBM::hidden_unit == unit_type::BINARY) {
+        auto v = slice(t.v1, 0, n);
+
+        const double hidden = sum(log(max(1.0 - slice(t.h1_a, 0, n), weight(1e-7))));
 
-        t.c_grad = t.vf(0) - t.v2_a(0);
-        for (size_t b = 1; b < B; b++) {
-            t.c_grad += t.vf(b) - t.v2_a(b);
+        if constexpr (RBM::visible_unit == unit_type::BINARY) {
+            //F(v) = -sum(ai*vi) - sum(log(1 + e^(xj)))
+            return -dot(bias_batch_sum_2d(v), rbm.c) + hidden;
+        } else if constexpr (RBM::visible_unit == unit_type::GAUSSIAN) {
+            //F(v) = sum((vi-ai)^2/2) - sum(log(1 + e^(xj)))
+            return sum(pow(v - rep_l(rbm.c, n), 2) / 2.0) + hidden;
+        } else {
+            return 0.0;
         }
+    } else {
+        cpp_unused(rbm);
+        cpp_unused(t);
+        cpp_unused(n);
+
+        return 0.0;
+    }
+}
+
+/*!
+ * \brief Compute the statistics of a batch of a fully-connected RBM from its
+ * gradients and update it.
+ * \param n The number of samples of the batch
+ */
+template <typename RBM, typename Trainer>
+void finalize_normal(rbm_training_context& context, RBM& rbm, Trainer& t, size_t n) {
+    using namespace etl;
+
+    using rbm_t  = RBM;                    ///< The type of the RBM being trained
+
+    context.batch_error = mean((t.vf - t.v2_a) >> (t.vf - t.v2_a));
+
+    if constexpr (rbm_layer_traits<rbm_t>::free_energy()) {
+        context.batch_free_energy = batch_free_energy_normal(rbm, t, n);
+    } else {
+        cpp_unused(n);
     }
+
+    nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
+
+    // The sparsity has been computed with the gradients
+    context.batch_sparsity = t.q_global_batch;
+
+    //Update the weights and biases based on the gradients
+    t.update(rbm);
 }
 
 /*!
@@ -328,10 +570,6 @@ template <bool Persistent, size_t K, typename InputBatch, typename ExpectedBatch
 void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t) {
     dll::auto_timer timer("cd:train:normal");
 
-    using namespace etl;
-
-    using rbm_t  = RBM;                    ///< The type of the RBM being trained
-
     compute_gradients_normal<Persistent, K>(input_batch, expected_batch, rbm, t);
 
     if (Persistent) {
@@ -341,21 +579,185 @@ void train_normal(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_tr
         t.init = false;
     }
 
-    context.batch_error = mean((t.vf - t.v2_a) >> (t.vf - t.v2_a));
+    finalize_normal(context, rbm, t, etl::dim<0>(input_batch));
+}
 
-    nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
+/*!
+ * \brief Returns the number of slices of a batch of a Convolutional RBM to
+ * train in parallel.
+ *
+ * On small feature maps, the ETL operations are too small to be parallelized
+ * efficiently, so the batch is split between the threads instead.
+ *
+ * \param batch The batch size
+ * \param nh The number of hidden units of one feature map
+ */
+inline size_t conv_batch_slices(size_t batch, size_t nh) {
+    const size_t threads = kernel_threads();
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
+    if (threads < 2 || batch < 2 || nh > 32 * 32) {
+        return 1;
+    }
 
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        t.q_local_batch = mean_l(t.h2_a);
+    return std::min<size_t>(threads, batch);
+}
+
+/*!
+ * \brief Compute the gradients for a Convolutional RBM, with the batch split
+ * into slices trained in parallel.
+ *
+ * Each thread runs the Gibbs chain of its own slice of the batch, with serial
+ * ETL operations, and accumulates the gradients of its slice in private
+ * matrices. They are summed once all the slices are done.
+ */
+template <bool Persistent, size_t N, typename Trainer, typename RBM>
+void compute_gradients_conv_slices(RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("cd:gradients:conv:slices");
+
+    using weight = typename Trainer::weight;
+
+    const size_t B         = etl::dim<0>(t.v1);
+    const size_t slices    = t.slices;
+    const size_t per_slice = (B + slices - 1) / slices;
+
+    if (t.w_pos_slices.size() != slices) {
+        t.w_pos_slices.assign(slices, etl::dyn_matrix<weight, 4>(etl::dim<0>(t.w_pos), etl::dim<1>(t.w_pos), etl::dim<2>(t.w_pos), etl::dim<3>(t.w_pos)));
+        t.w_neg_slices = t.w_pos_slices;
     }
 
-    context.batch_sparsity = t.q_global_batch;
+    auto work = [&](size_t s) {
+        const size_t first = std::min(B, s * per_slice);
+        const size_t last  = std::min(B, first + per_slice);
 
-    //Update the weights and biases based on the gradients
-    t.update(rbm);
+        if (first == last) {
+            t.w_pos_slices[s] = 0;
+            t.w_neg_slices[s] = 0;
+            return;
+        }
+
+        SERIAL_SECTION {
+            auto v1   = etl::slice(t.v1, first, last);
+            auto vf   = etl::slice(t.vf, first, last);
+            auto h1_a = etl::slice(t.h1_a, first, last);
+            auto h1_s = etl::slice(t.h1_s, first, last);
+            auto v2_a = etl::slice(t.v2_a, first, last);
+            auto v2_s = etl::slice(t.v2_s, first, last);
+            auto h2_a = etl::slice(t.h2_a, first, last);
+            auto h2_s = etl::slice(t.h2_s, first, last);
+
+            //First step
+            rbm.template batch_activate_hidden<true, true>(h1_a, h1_s, v1, v1);
+
+            //CD-1
+            if constexpr (Persistent) {
+                auto p_h_a = etl::slice(t.p_h_a, first, last);
+                auto p_h_s = etl::slice(t.p_h_s, first, last);
+
+                if (t.init) {
+                    p_h_a = h1_a;
+                    p_h_s = h1_s;
+                }
+
+                rbm.template batch_activate_visible<true, false>(p_h_a, p_h_s, v2_a, v2_s);
+                rbm.template batch_activate_hidden<true, true>(h2_a, h2_s, v2_a, v2_a);
+            } else {
+                rbm.template batch_activate_visible<true, false>(h1_a, h1_s, v2_a, v2_s);
+                rbm.template batch_activate_hidden<true, (N > 1)>(h2_a, h2_s, v2_a, v2_a);
+            }
+
+            //CD-k
+            for (size_t k = 1; k < N; ++k) {
+                rbm.template batch_activate_visible<true, false>(h2_a, h2_s, v2_a, v2_s);
+                rbm.template batch_activate_hidden<true, true>(h2_a, h2_s, v2_a, v2_a);
+            }
+
+            t.w_pos_slices[s] = conv_4d_valid_filter_flipped(vf, h1_a);
+            t.w_neg_slices[s] = conv_4d_valid_filter_flipped(v2_a, h2_a);
+        }
+    };
+
+    dll::parallel_for(slices, work);
+
+    //Merge the gradients of the slices
+    t.w_pos = t.w_pos_slices[0];
+    t.w_neg = t.w_neg_slices[0];
+
+    for (size_t s = 1; s < slices; ++s) {
+        t.w_pos += t.w_pos_slices[s];
+        t.w_neg += t.w_neg_slices[s];
+    }
+}
+
+/*!
+ * \brief Compute the gradients for a Convolutional RBM, with the convolutions
+ * computed in the frequency domain.
+ *
+ * The spectra of the filters are computed once for the batch, the spectra
+ * of the input are shared by the first step and the positive gradients and
+ * the spectra of the last visible step are shared by the last hidden step
+ * and the negative gradients.
+ */
+template <bool Persistent, size_t N, typename Trainer, typename RBM>
+void compute_gradients_conv_fft(RBM& rbm, Trainer& t) {
+    dll::auto_timer timer("cd:gradients:conv:fft");
+
+    auto& fft = t.fft;
+
+    fft.prepare(rbm.w, get_nv1(rbm), get_nv2(rbm));
+
+    //First step
+    fft.forward(fft.v_fft, t.v1);
+    fft.valid(t.h1_a, fft.v_fft);
+    rbm.template batch_activate_hidden_conv<true, true>(t.h1_a, t.h1_s, t.v1);
+
+    //The expected spectra are only different for denoising training
+    if (std::equal(t.v1.memory_start(), t.v1.memory_end(), t.vf.memory_start())) {
+        fft.vf_fft = fft.v_fft;
+    } else {
+        fft.forward(fft.vf_fft, t.vf);
+    }
+
+    if (Persistent && t.init) {
+        t.p_h_a = t.h1_a;
+        t.p_h_s = t.h1_s;
+    }
+
+    //CD-1
+    if constexpr (Persistent) {
+        fft.forward(fft.h_fft, t.p_h_s);
+    } else {
+        fft.forward(fft.h_fft, t.h1_s);
+    }
+
+    fft.full(t.v2_a, fft.h_fft);
+    rbm.template batch_activate_visible_conv<true, false>(t.h1_s, t.v2_a, t.v2_s);
+
+    fft.forward(fft.v_fft, t.v2_a);
+    fft.valid(t.h2_a, fft.v_fft);
+    rbm.template batch_activate_hidden_conv<true, (Persistent || N > 1)>(t.h2_a, t.h2_s, t.v2_a);
+
+    //CD-k
+    for (size_t k = 1; k < N; ++k) {
+        fft.forward(fft.h_fft, t.h2_s);
+        fft.full(t.v2_a, fft.h_fft);
+        rbm.template batch_activate_visible_conv<true, false>(t.h2_s, t.v2_a, t.v2_s);
+
+        fft.forward(fft.v_fft, t.v2_a);
+        fft.valid(t.h2_a, fft.v_fft);
+        rbm.template batch_activate_hidden_conv<true, true>(t.h2_a, t.h2_s, t.v2_a);
+    }
+
+    //Compute gradients
+
+    {
+        dll::auto_timer timer("cd:batch_compute_gradients_conv:fft");
+
+        fft.forward(fft.h_fft, t.h1_a);
+        fft.valid_filter(t.w_pos, fft.vf_fft, fft.h_fft);
+
+        fft.forward(fft.h_fft, t.h2_a);
+        fft.valid_filter(t.w_neg, fft.v_fft, fft.h_fft);
+    }
 }
 
 /*!
@@ -382,6 +784,16 @@ void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_bat
         etl::slice(t.vf, 0, B) = expected_batch;
     }
 
+    if (t.fft.enabled) {
+        compute_gradients_conv_fft<Persistent, N>(rbm, t);
+        return;
+    }
+
+    if (t.slices > 1) {
+        compute_gradients_conv_slices<Persistent, N>(rbm, t);
+        return;
+    }
+
     //First step
     rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1);
 
@@ -415,6 +827,61 @@ void compute_gradients_conv(InputBatch& input_batch, ExpectedBatch& expected_bat
     }
 }
 
+/*!
+ * \brief Compute the sparsity of a batch of a convolutional RBM (the mean
+ * activations of its hidden units in the positive phase) and the biases for
+ * sparsity, from the sums of the hidden activations of the positive phase
+ * (h_sums).
+ */
+template <typename RBM, typename Trainer>
+void positive_sparsity_conv(const RBM& rbm, Trainer& t) {
+    using rbm_t  = RBM;
+    using weight = typename rbm_t::weight;
+
+    const size_t B  = etl::dim<0>(t.h1_a);
+    const size_t K  = etl::dim<0>(t.h_sums);
+    const size_t NH = etl::size(t.h_sums) / K;
+
+    t.h_sums.ensure_cpu_up_to_date();
+
+    const weight* sums = t.h_sums.memory_start();
+
+    weight total = 0;
+
+    for (size_t k = 0; k < K; ++k) {
+        weight k_total = 0;
+
+        for (size_t i = k * NH; i < (k + 1) * NH; ++i) {
+            k_total += sums[i];
+        }
+
+        //Only b_bias are supported for now
+        if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE && rbm_layer_traits<rbm_t>::bias_mode() == bias_mode::SIMPLE) {
+            t.b_bias.memory_start()[k] = k_total / weight(B * NH) - rbm.pbias;
+        }
+
+        total += k_total;
+    }
+
+    t.q_global_batch = total / weight(B * K * NH);
+
+    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
+        weight* q = t.q_local_batch.memory_start();
+
+        for (size_t i = 0; i < K * NH; ++i) {
+            q[i] = sums[i] / weight(B);
+        }
+
+        t.q_local_batch.invalidate_gpu();
+    }
+
+    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE && rbm_layer_traits<rbm_t>::bias_mode() == bias_mode::SIMPLE) {
+        t.b_bias.invalidate_gpu();
+    } else {
+        cpp_unused(rbm);
+    }
+}
+
 /*!
  * \brief Train a convolutional RBM
  */
@@ -434,27 +901,18 @@ void train_convolutional(InputBatch& input_batch, ExpectedBatch& expected_batch,
     }
 
     //Compute the gradients
+    t.h_sums = sum_l(t.h1_a);
+
     t.w_grad = t.w_pos - t.w_neg;
-    t.b_grad = mean_r(sum_l(t.h1_a - t.h2_a));
+    t.b_grad = mean_r(t.h_sums - sum_l(t.h2_a));
     t.c_grad = mean_r(sum_l(t.vf - t.v2_a));
 
     nan_check_deep(t.w_grad);
     nan_check_deep(t.b_grad);
     nan_check_deep(t.c_grad);
 
-    //Compute the mean activation probabilities
-    t.q_global_batch = mean(t.h2_a);
-
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
-        t.q_local_batch = mean_l(t.h2_a);
-    }
-
-    //Compute the biases for sparsity
-
-    //Only b_bias are supported for now
-    if constexpr (rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LEE && rbm_layer_traits<rbm_t>::bias_mode() == bias_mode::SIMPLE) {
-        t.b_bias = mean_r(mean_l(t.h2_a)) - rbm.pbias;
-    }
+    //Compute the sparsity of the batch and the biases for sparsity
+    positive_sparsity_conv(rbm, t);
 
     //Accumulate the sparsity
     context.batch_sparsity = t.q_global_batch;
@@ -524,6 +982,13 @@ struct base_cd_trainer : base_trainer<RBM> {
     etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    //{{{ Mixed precision
+
+    conditional_fast_matrix_t<rbm_layer_traits<rbm_t>::mixed_precision(), weight, num_visible, num_hidden> w_master; ///< The full precision weights
+    fast_uniform_generator rounding{dll::rand_engine()}; ///< The noise of the stochastic rounding (mixed precision)
+
+    //}}} Mixed precision end
+
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm), q_global_t(0.0), q_local_t(0.0) {
         if constexpr (rbm_layer_traits<rbm_t>::has_momentum()) {
@@ -531,6 +996,11 @@ struct base_cd_trainer : base_trainer<RBM> {
             b_inc = 0;
             c_inc = 0;
         }
+
+        if constexpr (rbm_layer_traits<rbm_t>::mixed_precision()) {
+            w_master = rbm.w;
+            round_weights(rbm, *this);
+        }
     }
 
     /*!
@@ -610,6 +1080,13 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
     etl::dyn_matrix<weight> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::dyn_matrix<weight> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    //{{{ Mixed precision
+
+    typename rbm_t::w_type w_master;                     ///< The full precision weights
+    fast_uniform_generator rounding{dll::rand_engine()}; ///< The noise of the stochastic rounding (mixed precision)
+
+    //}}} Mixed precision end
+
     template <bool M = rbm_layer_traits<rbm_t>::has_momentum(), cpp_disable_iff(M)>
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm),
@@ -633,6 +1110,11 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
               p_h_a(batch_size, rbm.num_hidden),
               p_h_s(batch_size, rbm.num_hidden){
         static_assert(!rbm_layer_traits<rbm_t>::has_momentum(), "This constructor should only be used without momentum support");
+
+        if constexpr (rbm_layer_traits<rbm_t>::mixed_precision()) {
+            w_master = rbm.w;
+            round_weights(rbm, *this);
+        }
     }
 
     template <bool M = rbm_layer_traits<rbm_t>::has_momentum(), cpp_enable_iff(M)>
@@ -658,6 +1140,11 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
               p_h_a(batch_size, rbm.num_hidden),
               p_h_s(batch_size, rbm.num_hidden){
         static_assert(rbm_layer_traits<rbm_t>::has_momentum(), "This constructor should only be used with momentum support");
+
+        if constexpr (rbm_layer_traits<rbm_t>::mixed_precision()) {
+            w_master = rbm.w;
+            round_weights(rbm, *this);
+        }
     }
 
     /*!
@@ -731,6 +1218,8 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::
     conditional_fast_matrix_t<rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET, weight, K, NH1, NH2> q_local_batch; ///< The local batch sparsity
     conditional_fast_matrix_t<rbm_layer_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET, weight, K, NH1, NH2> q_local_t;     ///< The local batch sparsity penalty
 
+    etl::fast_matrix<weight, K, NH1, NH2> h_sums; ///< The sums of the hidden activations of the positive phase over the batch
+
     //}}} Sparsity end
 
     //{{{ Sparsity biases
@@ -744,6 +1233,13 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::
     conditional_fast_matrix_t<Persistent, weight, batch_size, K, NH1, NH2> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     conditional_fast_matrix_t<Persistent, weight, batch_size, K, NH1, NH2> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    //{{{ Mixed precision
+
+    conditional_fast_matrix_t<rbm_layer_traits<rbm_t>::mixed_precision(), weight, W_DIMS> w_master; ///< The full precision weights
+    fast_uniform_generator rounding{dll::rand_engine()}; ///< The noise of the stochastic rounding (mixed precision)
+
+    //}}} Mixed precision end
+
     etl::fast_matrix<weight, W_DIMS> w_pos; ///< The positive gradients
     etl::fast_matrix<weight, W_DIMS> w_neg; ///< The negative gradients
 
@@ -759,6 +1255,12 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::
     etl::fast_matrix<weight, batch_size, K, NH1, NH2> h2_a;                                 ///< The hidden activation at step K
     conditional_fast_matrix_t<(Persistent || N > 1), weight, batch_size, K, NH1, NH2> h2_s; ///< The hidden samples at step K
 
+    fft_conv_engine<weight> fft; ///< The engine for the convolutions in the frequency domain
+
+    size_t slices = 1;                                    ///< The number of slices of the batch trained in parallel
+    std::vector<etl::dyn_matrix<weight, 4>> w_pos_slices; ///< The positive gradients of each slice
+    std::vector<etl::dyn_matrix<weight, 4>> w_neg_slices; ///< The negative gradients of each slice
+
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm),
               w_inc(0.0),
@@ -774,6 +1276,14 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<!layer_traits<RBM>::
             b_inc = 0;
             c_inc = 0;
         }
+
+        fft.enabled = fft_conv_engine<weight>::preferred(NC, K, NV1, NV2, NW1, NW2);
+        slices      = conv_batch_slices(batch_size, NH1 * NH2);
+
+        if constexpr (rbm_layer_traits<rbm_t>::mixed_precision()) {
+            w_master = rbm.w;
+            round_weights(rbm, *this);
+        }
     }
 
     /*!
@@ -838,6 +1348,8 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
     etl::dyn_matrix<weight, 3> q_local_batch; ///< The local batch sparsity
     etl::dyn_matrix<weight, 3> q_local_t;     ///< The local batch penalty
 
+    etl::dyn_matrix<weight, 3> h_sums; ///< The sums of the hidden activations of the positive phase over the batch
+
     //}}} Sparsity end
 
     //{{{ Sparsity biases
@@ -851,6 +1363,13 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
     etl::dyn_matrix<weight, 4> p_h_a; ///< Beginning of the contrastive divergence chain (activations)
     etl::dyn_matrix<weight, 4> p_h_s; ///< Beginning of the contrastive divergence chain (samples)
 
+    //{{{ Mixed precision
+
+    typename rbm_t::w_type w_master;                     ///< The full precision weights
+    fast_uniform_generator rounding{dll::rand_engine()}; ///< The noise of the stochastic rounding (mixed precision)
+
+    //}}} Mixed precision end
+
     etl::dyn_matrix<weight, 4> w_pos; ///< The positive gradients
     etl::dyn_matrix<weight, 4> w_neg; ///< The negative gradients
 
@@ -866,6 +1385,12 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
     etl::dyn_matrix<weight, 4> h2_a; ///< The hidden activations at the last step
     etl::dyn_matrix<weight, 4> h2_s; ///< The hidden samples at the last step
 
+    fft_conv_engine<weight> fft; ///< The engine for the convolutions in the frequency domain
+
+    size_t slices = 1;                                    ///< The number of slices of the batch trained in parallel
+    std::vector<etl::dyn_matrix<weight, 4>> w_pos_slices; ///< The positive gradients of each slice
+    std::vector<etl::dyn_matrix<weight, 4>> w_neg_slices; ///< The negative gradients of each slice
+
     base_cd_trainer(rbm_t& rbm)
             : rbm(rbm),
              w_grad(DYN_W_DIMS, 0.0),
@@ -877,6 +1402,7 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
              q_global_t(0.0),
              q_local_batch(rbm.k, rbm.nh1, rbm.nh2),
              q_local_t(rbm.k, rbm.nh1, rbm.nh2, 0.0),
+             h_sums(rbm.k, rbm.nh1, rbm.nh2),
              w_bias(DYN_W_DIMS, 0.0),
              b_bias(rbm.k, 0.0),
              c_bias(rbm.nc, 0.0),
@@ -893,7 +1419,13 @@ struct base_cd_trainer<N, RBM, Persistent, std::enable_if_t<layer_traits<RBM>::i
              h2_a(batch_size, rbm.k, rbm.nh1, rbm.nh2),
              h2_s(batch_size, rbm.k, rbm.nh1, rbm.nh2)
              {
-        //Nothign else to init
+        fft.enabled = fft_conv_engine<weight>::preferred(rbm.nc, rbm.k, rbm.nv1, rbm.nv2, rbm.nw1, rbm.nw2);
+        slices      = conv_batch_slices(batch_size, rbm.nh1 * rbm.nh2);
+
+        if constexpr (rbm_layer_traits<rbm_t>::mixed_precision()) {
+            w_master = rbm.w;
+            round_weights(rbm, *this);
+        }
     }
 
     /*!
@@ -9,6 +9,8 @@
 
 #include "cifar/cifar10_reader.hpp"
 
+#include "dll/datasets/raw_reader.hpp"
+
 namespace dll {
 
 /*!
@@ -25,20 +27,25 @@ auto make_cifar10_generator_train(const std::string& folder, size_t limit, Param
     float label;
 
     size_t n = 50000;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    generator->label_cache = 0;
+    std::vector<std::string> files;
+
+    for(size_t i = 1; i <= 5; ++i){
+        files.push_back(folder + "/data_batch_" + std::to_string(i) + ".bin");
+    }
 
-    // Read all the necessary images and labels
-    cifar::read_training_categorical(folder, m, generator->input_cache, generator->label_cache);
+    // Decode all the necessary images and labels directly into the caches
+    if(!read_cifar10_categorical(generator->input_cache, generator->label_cache, files)){
+        std::cerr << "Something went wrong, impossible to load CIFAR-10 training set" << std::endl;
+        return generator;
+    }
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
@@ -60,20 +67,19 @@ auto make_cifar10_generator_test(const std::string& folder, size_t limit, Parame
     float label;
 
     size_t n = 10000;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    generator->label_cache = 0;
-
-    // Read all the necessary images and labels
-    cifar::read_test_categorical(folder, m, generator->input_cache, generator->label_cache);
+    // Decode all the necessary images and labels directly into the caches
+    if(!read_cifar10_categorical(generator->input_cache, generator->label_cache, {folder + "/test_batch.bin"})){
+        std::cerr << "Something went wrong, impossible to load CIFAR-10 test set" << std::endl;
+        return generator;
+    }
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
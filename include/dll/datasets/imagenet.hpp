@@ -8,9 +8,17 @@
 #pragma once
 
 #include <vector>
+#include <deque>
+#include <algorithm>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
 
 #include <dirent.h>
 
@@ -58,50 +66,167 @@ inline void read_files(std::vector<std::pair<size_t, size_t>>& files, std::unord
     }
 }
 
-struct image_iterator : std::iterator<
-                                     std::input_iterator_tag,
-                                     etl::fast_dyn_matrix<float, 3, 256, 256>,
-                                     ptrdiff_t,
-                                     etl::fast_dyn_matrix<float, 3, 256, 256>*,
-                                     etl::fast_dyn_matrix<float, 3, 256, 256>&
-                                 > {
+/*!
+ * \brief The options of the decoding of the ImageNet images
+ */
+struct decoder_options {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency()); ///< The number of decoding threads
+    size_t ahead   = 128;                                               ///< The number of images decoded ahead of the iterator
+    std::string cache;                                                  ///< If not empty, the folder of the decoded images cache
+};
 
-    using value_type = etl::fast_dyn_matrix<float, 3, 256, 256>;
+/*!
+ * \brief Decoder of the ImageNet images, on a pool of threads.
+ *
+ * The images following the last requested one are decoded ahead by the
+ * workers, so that the consumer of the iterator does not wait on the disk and
+ * the JPEG decoding. Optionally, the decoded images are stored as raw
+ * channel-planar uint8 files in a cache folder (ideally on a local SSD), and
+ * read from there in the next epochs instead of being decoded again.
+ */
+struct image_decoder {
+    using value_type = etl::fast_dyn_matrix<float, 3, 256, 256>; ///< The type of decoded image
+
+    static constexpr size_t pixels = 3 * 256 * 256; ///< The number of values of an image
+
+    /*!
+     * \brief Create a new decoder and start its workers
+     * \param imagenet_path The path to the ImageNet dataset
+     * \param files The images files (label, image)
+     * \param options The decoding options
+     */
+    image_decoder(std::string imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, decoder_options options)
+            : imagenet_path(std::move(imagenet_path)), files(std::move(files)), options(std::move(options)) {
+        for (size_t t = 0; t < this->options.threads; ++t) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
 
-    std::string imagenet_path;
-    std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files;
-    std::shared_ptr<std::unordered_map<size_t, float>> labels;
+    image_decoder(const image_decoder& rhs) = delete;
+    image_decoder& operator=(const image_decoder& rhs) = delete;
 
-    size_t index;
+    /*!
+     * \brief Stop and join the workers
+     */
+    ~image_decoder() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
 
-    image_iterator(const std::string& imagenet_path, std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files, std::shared_ptr<std::unordered_map<size_t, float>> labels, size_t index) :
-        imagenet_path(imagenet_path), files(files), labels(labels), index(index)
-    {
-        // Nothing else to init
+        work_condition.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
     }
 
-    image_iterator(image_iterator&& rhs) = default;
-    image_iterator(const image_iterator& rhs) = default;
+    /*!
+     * \brief Returns the image at the given index, waiting for its decoding
+     * if necessary, and schedules the decoding of the next images.
+     */
+    value_type get(size_t index) {
+        std::unique_lock<std::mutex> l(lock);
 
-    image_iterator& operator=(image_iterator&& rhs) = default;
-    image_iterator& operator=(const image_iterator& rhs) = default;
+        const size_t last = std::min(index + std::max<size_t>(options.ahead, 1), files->size());
 
-    image_iterator& operator++(){
-        ++index;
-        return *this;
+        // The iterator moved backward (new epoch) or jumped, restart the
+        // window, only keeping the images that are still in the window
+        if (!wanted.count(index)) {
+            auto outside = [index, last](size_t i) { return i < index || i >= last; };
+
+            queue.erase(std::remove_if(queue.begin(), queue.end(), outside), queue.end());
+
+            for (auto it = wanted.begin(); it != wanted.end();) {
+                if (outside(*it)) {
+                    ready.erase(*it);
+                    it = wanted.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            next = index;
+        }
+
+        for (; next < last; ++next) {
+            if (wanted.insert(next).second) {
+                queue.push_back(next);
+            }
+        }
+
+        work_condition.notify_all();
+
+        ready_condition.wait(l, [this, index] { return ready.count(index); });
+
+        auto image = std::move(ready[index]);
+
+        ready.erase(index);
+        wanted.erase(index);
+
+        return std::move(*image);
     }
 
-    // Note: DLL will never call this function because in batch mode, but must
-    // still compile
-    image_iterator operator++(int){
-        cpp_unreachable("Should never be called");
+private:
+    /*!
+     * \brief The loop of a decoding worker
+     */
+    void work() {
+        while (true) {
+            size_t index;
 
-        return *this;
+            {
+                std::unique_lock<std::mutex> l(lock);
+
+                work_condition.wait(l, [this] { return stop || !queue.empty(); });
+
+                if (stop) {
+                    return;
+                }
+
+                index = queue.front();
+                queue.pop_front();
+            }
+
+            auto image = std::make_unique<value_type>();
+
+            decode(index, *image);
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                // The image may not be wanted anymore after a restart
+                if (wanted.count(index)) {
+                    ready[index] = std::move(image);
+                }
+            }
+
+            ready_condition.notify_all();
+        }
     }
 
-    value_type operator*() {
+    /*!
+     * \brief Decode the image at the given index into the given image,
+     * either from the cache or from the JPEG file
+     */
+    void decode(size_t index, value_type& image) const {
         auto& image_file = (*files)[index];
 
+        std::vector<uint8_t> planar(pixels);
+
+        std::string cache_path;
+
+        if (!options.cache.empty()) {
+            cache_path = options.cache + "/" + std::to_string(image_file.first) + "_" + std::to_string(image_file.second) + ".raw";
+
+            std::ifstream is(cache_path, std::ifstream::binary);
+
+            if (is && is.read(reinterpret_cast<char*>(planar.data()), pixels)) {
+                to_image(planar, image);
+                return;
+            }
+        }
+
         auto label = std::string("/n") + (image_file.first < 10000000 ? "0" : "") + std::to_string(image_file.first);
 
         auto image_path =
@@ -110,42 +235,119 @@ struct image_iterator : std::iterator<
 
         auto mat = cv::imread(image_path.c_str(), cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
 
-        value_type image;
-
         if (!mat.data || mat.empty()) {
             std::cerr << "ERROR: Failed to read image: " << image_path << std::endl;
             image = 0;
-            return image;
+            return;
         }
 
         if (mat.cols != 256 || mat.rows != 256) {
             std::cerr << "ERROR: Image of invalid size: " << image_path << std::endl;
             image = 0;
-            return image;
+            return;
         }
 
+        // Deinterleave the pixels, in the (channel, x, y) order of the images
+
         if (cpp_likely(mat.channels() == 3)) {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    auto pixel = mat.at<cv::Vec3b>(y, x);
+            for (size_t y = 0; y < 256; ++y) {
+                const uint8_t* row = mat.ptr<uint8_t>(y);
 
-                    image(0, x, y) = pixel.val[0];
-                    image(1, x, y) = pixel.val[1];
-                    image(2, x, y) = pixel.val[2];
+                for (size_t x = 0; x < 256; ++x) {
+                    planar[(0 * 256 + x) * 256 + y] = row[3 * x + 0];
+                    planar[(1 * 256 + x) * 256 + y] = row[3 * x + 1];
+                    planar[(2 * 256 + x) * 256 + y] = row[3 * x + 2];
                 }
             }
         } else {
-            for (size_t x = 0; x < 256; ++x) {
-                for (size_t y = 0; y < 256; ++y) {
-                    image(0, x, y) = mat.at<unsigned char>(y, x);
+            std::fill(planar.begin(), planar.end(), 0);
+
+            for (size_t y = 0; y < 256; ++y) {
+                const uint8_t* row = mat.ptr<uint8_t>(y);
+
+                for (size_t x = 0; x < 256; ++x) {
+                    planar[x * 256 + y] = row[x];
                 }
             }
+        }
 
-            image(1) = 0;
-            image(2) = 0;
+        if (!cache_path.empty()) {
+            std::ofstream os(cache_path, std::ofstream::binary);
+            os.write(reinterpret_cast<const char*>(planar.data()), pixels);
         }
 
-        return image;
+        to_image(planar, image);
+    }
+
+    /*!
+     * \brief Convert the planar pixels into the image
+     */
+    static void to_image(const std::vector<uint8_t>& planar, value_type& image) {
+        float* out = image.memory_start();
+
+        for (size_t i = 0; i < pixels; ++i) {
+            out[i] = planar[i];
+        }
+    }
+
+    const std::string imagenet_path;                               ///< The path to the dataset
+    std::shared_ptr<std::vector<std::pair<size_t, size_t>>> files; ///< The image files
+    const decoder_options options;                                 ///< The decoding options
+
+    std::mutex lock;                         ///< The lock protecting the queue and the decoded images
+    std::condition_variable work_condition;  ///< The condition variable for the workers to wait for work
+    std::condition_variable ready_condition; ///< The condition variable for the consumer to wait for an image
+
+    std::deque<size_t> queue;                                      ///< The indices to decode
+    std::unordered_set<size_t> wanted;                             ///< The indices in the window
+    std::unordered_map<size_t, std::unique_ptr<value_type>> ready; ///< The decoded images
+    size_t next = 0;                                               ///< The next index to schedule
+    bool stop   = false;                                           ///< Indicates to the workers to stop
+
+    std::vector<std::thread> workers; ///< The decoding threads
+};
+
+struct image_iterator : std::iterator<
+                                     std::input_iterator_tag,
+                                     etl::fast_dyn_matrix<float, 3, 256, 256>,
+                                     ptrdiff_t,
+                                     etl::fast_dyn_matrix<float, 3, 256, 256>*,
+                                     etl::fast_dyn_matrix<float, 3, 256, 256>&
+                                 > {
+
+    using value_type = etl::fast_dyn_matrix<float, 3, 256, 256>;
+
+    std::shared_ptr<image_decoder> decoder;
+
+    size_t index;
+
+    image_iterator(std::shared_ptr<image_decoder> decoder, size_t index) :
+        decoder(decoder), index(index)
+    {
+        // Nothing else to init
+    }
+
+    image_iterator(image_iterator&& rhs) = default;
+    image_iterator(const image_iterator& rhs) = default;
+
+    image_iterator& operator=(image_iterator&& rhs) = default;
+    image_iterator& operator=(const image_iterator& rhs) = default;
+
+    image_iterator& operator++(){
+        ++index;
+        return *this;
+    }
+
+    // Note: DLL will never call this function because in batch mode, but must
+    // still compile
+    image_iterator operator++(int){
+        cpp_unreachable("Should never be called");
+
+        return *this;
+    }
+
+    value_type operator*() {
+        return decoder->get(index);
     }
 
     bool operator==(const image_iterator& rhs) const {
@@ -209,13 +411,14 @@ struct label_iterator : std::iterator<
 } // end of namespace imagenet
 
 /*!
- * \brief Creates a dataset around CIFAR-10
- * \param folder The folder in which the CIFAR-10 files are
+ * \brief Creates a dataset around ImageNet
+ * \param folder The folder in which the ImageNet files are
+ * \param options The options of the decoding of the images
  * \param parameters The parameters of the generator
- * \return The CIFAR-10 dataset
+ * \return The ImageNet dataset
  */
 template<typename... Parameters>
-auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*parameters*/){
+auto make_imagenet_dataset(const std::string& folder, const imagenet::decoder_options& options, Parameters&&... /*parameters*/){
     auto train_files = std::make_shared<std::vector<std::pair<size_t, size_t>>>();
     auto labels      = std::make_shared<std::unordered_map<size_t, float>>();
 
@@ -226,9 +429,16 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
     std::default_random_engine engine(rd());
     std::shuffle(train_files->begin(), train_files->end(), engine);
 
+    // The decoders, shared by the copies of the iterators of each generator
+    auto train_decoder = std::make_shared<imagenet::image_decoder>(folder, train_files, options);
+    auto test_decoder  = std::make_shared<imagenet::image_decoder>(folder, train_files, options);
+
     // The image iterators
-    imagenet::image_iterator iit(folder, train_files, labels, 0);
-    imagenet::image_iterator iend(folder, train_files, labels, train_files->size());
+    imagenet::image_iterator iit(train_decoder, 0);
+    imagenet::image_iterator iend(train_decoder, train_files->size());
+
+    imagenet::image_iterator test_iit(test_decoder, 0);
+    imagenet::image_iterator test_iend(test_decoder, train_files->size());
 
     // The label iterators
     imagenet::label_iterator lit(train_files, labels, 0);
@@ -237,7 +447,18 @@ auto make_imagenet_dataset(const std::string& folder, Parameters&&... /*paramete
     return make_dataset_holder(
         "imagenet",
         make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}),
-        make_generator(iit, iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
+        make_generator(test_iit, test_iend, lit, lend, train_files->size(), 1000, dll::outmemory_data_generator_desc<Parameters..., dll::categorical>{}));
+}
+
+/*!
+ * \brief Creates a dataset around ImageNet, with the default decoding options
+ * \param folder The folder in which the ImageNet files are
+ * \param parameters The parameters of the generator
+ * \return The ImageNet dataset
+ */
+template<typename... Parameters, cpp_enable_iff((!std::is_same<std::decay_t<Parameters>, imagenet::decoder_options>::value && ...))>
+auto make_imagenet_dataset(const std::string& folder, Parameters&&... parameters){
+    return make_imagenet_dataset(folder, imagenet::decoder_options(), std::forward<Parameters>(parameters)...);
 }
 
 } // end of namespace dll
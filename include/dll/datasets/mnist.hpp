@@ -9,6 +9,8 @@
 
 #include "mnist/mnist_reader.hpp"
 
+#include "dll/datasets/raw_reader.hpp"
+
 namespace dll {
 
 using mnist_example_t = etl::fast_dyn_matrix<float, 1, 28, 28>;
@@ -28,25 +30,22 @@ auto make_mnist_generator_train_impl(const std::string& folder, size_t start, si
     float label;
 
     size_t n = 60000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
+    // Decode all the necessary images directly into the cache
+    if(!read_idx_images(generator->input_cache, folder + "/train-images-idx3-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST training images" << std::endl;
         return generator;
     }
 
     // Read all the labels (categorical)
-    generator->label_cache = 0;
-    if(!mnist::read_mnist_label_file_categorical(generator->label_cache, folder + "/train-labels-idx1-ubyte", m, start)){
+    if(!read_idx_labels_categorical(generator->label_cache, folder + "/train-labels-idx1-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST training labels" << std::endl;
         return generator;
     }
@@ -71,25 +70,22 @@ auto make_mnist_generator_test_impl(const std::string& folder, size_t start, siz
     float label;
 
     size_t n = 10000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, label, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::categorical>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
+    // Decode all the necessary images directly into the cache
+    if(!read_idx_images(generator->input_cache, folder + "/t10k-images-idx3-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST test images" << std::endl;
         return generator;
     }
 
     // Read all the labels (categorical)
-    generator->label_cache = 0;
-    if(!mnist::read_mnist_label_file_categorical(generator->label_cache, folder + "/t10k-labels-idx1-ubyte", m, start)){
+    if(!read_idx_labels_categorical(generator->label_cache, folder + "/t10k-labels-idx1-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST test labels" << std::endl;
         return generator;
     }
@@ -9,6 +9,8 @@
 
 #include "mnist/mnist_reader.hpp"
 
+#include "dll/datasets/raw_reader.hpp"
+
 namespace dll {
 
 /*!
@@ -24,23 +26,21 @@ auto make_mnist_ae_generator_train(const std::string& folder, size_t start, size
     etl::fast_dyn_matrix<float, 1, 28, 28> input;
 
     size_t n = 60000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, input, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::autoencoder>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/train-images-idx3-ubyte", m, start)){
+    // Decode all the necessary images directly into the cache
+    if(!read_idx_images(generator->input_cache, folder + "/train-images-idx3-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST training images" << std::endl;
         return generator;
     }
 
-    generator->label_cache = generator->input_cache;
+    // The labels are the images themselves, they are not duplicated
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
@@ -61,23 +61,21 @@ auto make_mnist_ae_generator_test(const std::string& folder, size_t start, size_
     etl::fast_dyn_matrix<float, 1, 28, 28> input;
 
     size_t n = 10000 - start;
-    size_t m = 0;
 
     if(limit > 0 && limit < n){
         n = limit;
-        m = limit;
     }
 
     // Prepare the empty generator
     auto generator = prepare_generator(input, input, n, 10, dll::inmemory_data_generator_desc<Parameters..., dll::autoencoder>{});
 
-    // Read all the necessary images
-    if(!mnist::read_mnist_image_file_flat(generator->input_cache, folder + "/t10k-images-idx3-ubyte", m, start)){
+    // Decode all the necessary images directly into the cache
+    if(!read_idx_images(generator->input_cache, folder + "/t10k-images-idx3-ubyte", start)){
         std::cerr << "Something went wrong, impossible to load MNIST test images" << std::endl;
         return generator;
     }
 
-    generator->label_cache = generator->input_cache;
+    // The labels are the images themselves, they are not duplicated
 
     // Apply the transformations on the input
     generator->finalize_prepared_data();
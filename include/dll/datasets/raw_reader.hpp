@@ -0,0 +1,308 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Readers of the raw dataset files (MNIST IDX and CIFAR-10 binary
+ * files) directly into the caches of the generators.
+ *
+ * The files are memory-mapped and their records are decoded in parallel
+ * chunks, straight into the contiguous cache of the generator. There is
+ * no intermediate copy of the dataset.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace raw_detail {
+
+/*!
+ * \brief A read-only memory-mapped file
+ */
+struct mapped_file {
+    /*!
+     * \brief Map the given file
+     * \param path The path to the file
+     */
+    explicit mapped_file(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+
+        if (::fstat(fd, &st) < 0 || !st.st_size) {
+            return;
+        }
+
+        void* mapping = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapping == MAP_FAILED) {
+            return;
+        }
+
+        memory = static_cast<const uint8_t*>(mapping);
+        length = st.st_size;
+
+        ::madvise(mapping, length, MADV_SEQUENTIAL);
+    }
+
+    mapped_file(const mapped_file& rhs) = delete;
+    mapped_file& operator=(const mapped_file& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~mapped_file() {
+        if (memory) {
+            ::munmap(const_cast<uint8_t*>(memory), length);
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the file was correctly mapped
+     */
+    bool valid() const {
+        return memory;
+    }
+
+    /*!
+     * \brief Returns a pointer to the contents of the file
+     */
+    const uint8_t* data() const {
+        return memory;
+    }
+
+    /*!
+     * \brief Returns the size of the file, in bytes
+     */
+    size_t size() const {
+        return length;
+    }
+
+private:
+    int fd                = -1;      ///< The file descriptor
+    const uint8_t* memory = nullptr; ///< The mapped memory
+    size_t length         = 0;       ///< The length of the mapping
+};
+
+/*!
+ * \brief Read a big endian 32 bits integer (IDX headers)
+ */
+inline uint32_t read_big_endian(const uint8_t* data) {
+    return uint32_t(data[0]) << 24 | uint32_t(data[1]) << 16 | uint32_t(data[2]) << 8 | uint32_t(data[3]);
+}
+
+/*!
+ * \brief Decode n records into the rows [first, first + n) of the cache, in
+ * parallel.
+ *
+ * \param cache The cache to fill (one sample per row)
+ * \param records The first record to decode
+ * \param n The number of records
+ * \param record_size The size of a record, in bytes
+ * \param first The first row of the cache to fill
+ */
+template <typename Cache>
+void decode_images(Cache& cache, const uint8_t* records, size_t n, size_t record_size, size_t first) {
+    using value_type = etl::value_t<Cache>;
+
+    const size_t pixels = etl::size(cache) / etl::dim<0>(cache);
+
+    value_type* out = cache.memory_start() + first * pixels;
+
+    parallel_chunks(n, std::max(size_t(1), kernel_threads()), [=](size_t /*chunk*/, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            std::copy(records + i * record_size, records + i * record_size + pixels, out + i * pixels);
+        }
+    });
+}
+
+/*!
+ * \brief Decode n labels into the rows [first, first + n) of a categorical
+ * label cache
+ *
+ * \param labels The label cache to fill (one row of classes per sample)
+ * \param records The label of the first record
+ * \param n The number of records
+ * \param record_size The size of a record, in bytes
+ * \param first The first row of the cache to fill
+ */
+template <typename Cache>
+void decode_categorical(Cache& labels, const uint8_t* records, size_t n, size_t record_size, size_t first) {
+    using value_type = etl::value_t<Cache>;
+
+    const size_t classes = etl::dim<1>(labels);
+
+    value_type* out = labels.memory_start() + first * classes;
+
+    std::fill(out, out + n * classes, value_type(0));
+
+    for (size_t i = 0; i < n; ++i) {
+        const size_t label = records[i * record_size];
+
+        if (label < classes) {
+            out[i * classes + label] = value_type(1);
+        }
+    }
+}
+
+} //end of namespace raw_detail
+
+/*!
+ * \brief Read the images of an IDX file (MNIST) into the cache of a
+ * generator.
+ *
+ * \param cache The cache to fill, its first dimension is the number of
+ * images to read
+ * \param path The path to the IDX images file
+ * \param start The index of the first image to read
+ *
+ * \return true if the images were read, false otherwise
+ */
+template <typename Cache>
+bool read_idx_images(Cache& cache, const std::string& path, size_t start = 0) {
+    raw_detail::mapped_file file(path);
+
+    if (!file.valid() || file.size() < 16 || raw_detail::read_big_endian(file.data()) != 0x803) {
+        std::cerr << "ERROR: Invalid IDX images file: " << path << std::endl;
+        return false;
+    }
+
+    const size_t count  = raw_detail::read_big_endian(file.data() + 4);
+    const size_t pixels = size_t(raw_detail::read_big_endian(file.data() + 8)) * raw_detail::read_big_endian(file.data() + 12);
+
+    const size_t n = etl::dim<0>(cache);
+
+    if (start + n > count || file.size() < 16 + count * pixels || etl::size(cache) != n * pixels) {
+        std::cerr << "ERROR: The IDX images file does not match the cache: " << path << std::endl;
+        return false;
+    }
+
+    raw_detail::decode_images(cache, file.data() + 16 + start * pixels, n, pixels, 0);
+
+    cache.invalidate_gpu();
+
+    return true;
+}
+
+/*!
+ * \brief Read the labels of an IDX file (MNIST) into the categorical cache
+ * of a generator.
+ *
+ * \param labels The label cache to fill, its first dimension is the number
+ * of labels to read
+ * \param path The path to the IDX labels file
+ * \param start The index of the first label to read
+ *
+ * \return true if the labels were read, false otherwise
+ */
+template <typename Cache>
+bool read_idx_labels_categorical(Cache& labels, const std::string& path, size_t start = 0) {
+    raw_detail::mapped_file file(path);
+
+    if (!file.valid() || file.size() < 8 || raw_detail::read_big_endian(file.data()) != 0x801) {
+        std::cerr << "ERROR: Invalid IDX labels file: " << path << std::endl;
+        return false;
+    }
+
+    const size_t count = raw_detail::read_big_endian(file.data() + 4);
+    const size_t n     = etl::dim<0>(labels);
+
+    if (start + n > count || file.size() < 8 + count) {
+        std::cerr << "ERROR: The IDX labels file does not match the cache: " << path << std::endl;
+        return false;
+    }
+
+    raw_detail::decode_categorical(labels, file.data() + 8 + start, n, 1, 0);
+
+    labels.invalidate_gpu();
+
+    return true;
+}
+
+/*!
+ * \brief Read the images and the labels from CIFAR-10 binary files into the
+ * caches of a generator.
+ *
+ * Each record is made of the label (one byte) and of the 3x32x32 pixels.
+ * The files are read in order until the caches are full.
+ *
+ * \param images The image cache to fill
+ * \param labels The categorical label cache to fill
+ * \param files The paths to the binary files
+ *
+ * \return true if the caches were filled, false otherwise
+ */
+template <typename Cache, typename LCache>
+bool read_cifar10_categorical(Cache& images, LCache& labels, const std::vector<std::string>& files) {
+    constexpr size_t pixels      = 3 * 32 * 32;
+    constexpr size_t record_size = 1 + pixels;
+
+    const size_t n = etl::dim<0>(images);
+
+    if (etl::size(images) != n * pixels || etl::dim<0>(labels) != n) {
+        std::cerr << "ERROR: Invalid caches for CIFAR-10" << std::endl;
+        return false;
+    }
+
+    size_t read = 0;
+
+    for (auto& path : files) {
+        if (read == n) {
+            break;
+        }
+
+        raw_detail::mapped_file file(path);
+
+        if (!file.valid() || file.size() % record_size) {
+            std::cerr << "ERROR: Invalid CIFAR-10 file: " << path << std::endl;
+            return false;
+        }
+
+        const size_t m = std::min(n - read, file.size() / record_size);
+
+        raw_detail::decode_images(images, file.data() + 1, m, record_size, read);
+        raw_detail::decode_categorical(labels, file.data(), m, record_size, read);
+
+        read += m;
+    }
+
+    images.invalidate_gpu();
+    labels.invalidate_gpu();
+
+    if (read != n) {
+        std::cerr << "ERROR: Not enough samples in the CIFAR-10 files" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+} //end of dll namespace
@@ -16,11 +16,19 @@
 
 #pragma once
 
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include "cpp_utils/maybe_parallel.hpp"
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "generators.hpp"
 #include "unit_type.hpp"
+#include "lr_schedule.hpp"
 #include "trainer/dbn_trainer.hpp"
 #include "trainer/rbm_trainer_fwd.hpp"
 #include "dll/trainer/rbm_training_context.hpp"
@@ -28,8 +36,30 @@
 #include "svm_common.hpp"
 #include "util/export.hpp"
 #include "util/timers.hpp"
+#include "util/memory.hpp"
+#include "util/pipeline.hpp"
 #include "util/random.hpp"
 #include "util/ready.hpp"
+#include "util/feature_queue.hpp"
+#include "inference_session.hpp"
+#include "async_forward.hpp"
+#include "exit_head.hpp"
+#include "neural/batch_normalization_fold.hpp"
+#include "util/inplace.hpp"
+#include "util/quantization.hpp"
+#include "util/pruning.hpp"
+#include "util/low_rank.hpp"
+#include "util/feature_cache.hpp"
+#include "util/ann_index.hpp"
+#include "util/bfloat16.hpp"
+#include "util/flat_buffer.hpp"
+#include "util/converter.hpp"
+#include "util/model_file.hpp"
+#include "util/winograd_conv.hpp"
+#include "util/tuning.hpp"
+#include "util/budget.hpp"
+#include "util/batch_metrics.hpp"
+#include "trainer/distributed.hpp"
 #include "dbn_detail.hpp" // dbn_detail namespace
 
 namespace dll {
@@ -88,6 +118,8 @@ struct dbn final {
         "batch_mode dbn does not support shuffle in layers");
     static_assert(!dbn_traits<this_type>::shuffle_pretrain() || dbn_traits<this_type>::batch_mode(),
         "shuffle_pre is only compatible with batch mode, for normal mode, use shuffle in layers");
+    static_assert(!dbn_traits<this_type>::pipeline_pretrain() || dbn_traits<this_type>::batch_mode(),
+        "pipeline_pre is only compatible with batch mode");
 
     template <size_t N>
     using layer_type = detail::layer_type_t<N, layers_t>; ///< The type of the layer at index Nth
@@ -138,11 +170,17 @@ public:
     static constexpr auto updater          = desc::Updater;      ///< The Updater type
     static constexpr auto early            = desc::Early;        ///< The Early Stopping stragy
 
+    static constexpr size_t serial_one_parameters = 1UL << 18; ///< The number of parameters below which forward_one is not parallelized
+
     layers_t tuples; ///< The layers
 
     weight learning_rate       = 0.1; ///< The learning rate for finetuning
     weight learning_rate_decay = 0.0; ///< The learning rate decay
 
+    lr_schedule schedule; ///< The schedule of the learning rate for finetuning
+
+    pruning_schedule pruning; ///< The schedule of the structured pruning during finetuning
+
     weight initial_momentum     = 0.9; ///< The initial momentum
     weight final_momentum       = 0.9; ///< The final momentum applied after *final_momentum_epoch* epoch
     weight final_momentum_epoch = 6;   ///< The epoch at which momentum change
@@ -156,12 +194,56 @@ public:
     weight adam_beta1           = 0.9;   ///< Adam's beta1 factor
     weight adam_beta2           = 0.999; ///< Adam's beta1 factor
     weight nadam_schedule_decay = 0.004; ///< NAdam's schedule decay
+    weight lars_eta             = 0.001; ///< LARS's trust coefficient
 
     weight gradient_clip = 5.0; ///< The gradient clipping
 
+    double loss_scale          = 65536.0; ///< The initial loss scale (mixed precision)
+    size_t loss_scale_interval = 2000;    ///< The number of updates without overflow before the loss scale is doubled
+
+    weight ema_decay    = 0.999; ///< The decay of the moving average of the weights
+    size_t ema_interval = 1;     ///< The number of updates between two updates of the moving average of the weights
+
+    communicator* comm = nullptr; ///< The communicator for distributed training (nullptr for local training)
+
+    resource_budget budget{dbn_traits<this_type>::threads(), {}}; ///< The threads and the CPUs of the network (set with set_threads and set_affinity)
+
+    flat_buffer<weight> flat_backup;    ///< The contiguous backup of the weights (allocated by the first backup)
+    background_pack<weight> backup_copy; ///< The asynchronous copy of the weights into the backup
+    flat_buffer<weight> ema;            ///< The moving average of the weights (with ema_weights)
+
+    mutable std::array<memory_record, layers> weights_memory; ///< The accounting of the weights of each layer
+
     weight goal     = 0.0; ///< The learning goal
     size_t patience = 1;   ///< The patience for early stopping goals
 
+    bool validation_lag       = true; ///< Apply the early stopping one epoch late, to validate during the next epoch (with async_validation)
+    size_t validation_threads = 1;    ///< The number of threads taken from the training by the validation (with async_validation)
+
+    std::string checkpoint_file;   ///< The file of the training checkpoints (empty to disable them)
+    size_t checkpoint_batches = 0; ///< The number of batches between two training checkpoints (0 for one checkpoint per epoch)
+    bool resume               = false; ///< Resume the training from checkpoint_file, if it exists
+
+    bool cache_trunk   = false;   ///< Train the layers after the frozen layers from the cached features of the frozen layers (with freeze_layers)
+    bool compact_trunk = false;   ///< Store the cached features of the frozen layers in bfloat16
+    std::string trunk_cache_file; ///< The file memory-mapping the cached features of the frozen layers (empty to keep them in memory)
+
+    uint64_t model_version = 0; ///< The version of the weights, incremented at each training (keys of the feature cache)
+
+    size_t memory_limit = 0; ///< The memory budget of the training, in bytes (0 for no budget, with memory_budget)
+
+    std::vector<size_t> pipeline_partition;                     ///< The first layer of each pipeline stage after the first (empty to balance the parameters, with pipeline_stages)
+    pipeline_schedule pipeline = pipeline_schedule::ONE_F_ONE_B; ///< The schedule of the micro-batches through the stages (with pipeline_stages)
+
+    std::vector<bool> cpu_placement; ///< The layers placed on the CPU, with ETL_GPU (empty for all the layers on the GPU, see autoplace())
+
+    mutable std::unique_ptr<feature_cache<weight>> features_cache; ///< The cache of the output features (with enable_feature_cache)
+
+    mutable std::mutex one_sessions_lock;                                            ///< The lock of the pool of single-sample sessions
+    mutable std::vector<std::unique_ptr<inference_session<this_type>>> one_sessions; ///< The idle single-sample sessions of forward_one (created by the first calls)
+
+    std::vector<exit_head<weight>> exit_heads; ///< The intermediate classifier heads, sorted by layer (with fit_exit_head)
+
 #ifdef DLL_SVM_SUPPORT
     //TODO Ideally these fields should be private
     svm::model svm_model;    ///< The learned model
@@ -171,20 +253,20 @@ public:
 
     mutable output_policy_t out; ///< The output policy instance
 
-    using categorical_generator_t = std::conditional_t<
-        !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+    using categorical_inmemory_t  = inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>;
+    using categorical_outmemory_t = outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::categorical, dll::scale_pre<desc::ScalePre>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>;
 
-    using ae_generator_t = std::conditional_t<
-        !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+    using categorical_generator_t = std::conditional_t<!dbn_traits<this_type>::batch_mode(), categorical_inmemory_t, categorical_outmemory_t>;
 
-    using reg_generator_t = std::conditional_t<
-        !dbn_traits<this_type>::batch_mode(),
-        inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>,
-        outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>>;
+    using ae_inmemory_t  = inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>;
+    using ae_outmemory_t = outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>;
+
+    using ae_generator_t = std::conditional_t<!dbn_traits<this_type>::batch_mode(), ae_inmemory_t, ae_outmemory_t>;
+
+    using reg_inmemory_t  = inmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>;
+    using reg_outmemory_t = outmemory_data_generator_desc<dll::batch_size<batch_size>, dll::big_batch_size<big_batch_size>, dll::scale_pre<desc::ScalePre>, dll::autoencoder, dll::noise<desc::Noise>, dll::binarize_pre<desc::BinarizePre>, dll::normalize_pre_cond<desc::NormalizePre>>;
+
+    using reg_generator_t = std::conditional_t<!dbn_traits<this_type>::batch_mode(), reg_inmemory_t, reg_outmemory_t>;
 
     template<size_t B>
     using rbm_generator_fast_t = std::conditional_t<
@@ -195,6 +277,9 @@ public:
     template<size_t B>
     using rbm_ingenerator_fast_inner_t = inmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder>;
 
+    template<size_t B>
+    using rbm_feature_store_inner_t = mmap_data_generator_desc<dll::batch_size<B>, dll::autoencoder>;
+
     template<size_t B>
     using rbm_generator_fast_inner_t = std::conditional_t<
         !dbn_traits<this_type>::batch_mode(),
@@ -217,7 +302,7 @@ public:
         outmemory_data_generator_desc<dll::batch_size<B>, dll::big_batch_size<big_batch_size>, dll::autoencoder, dll::noise<desc::Noise>>>;
 
 private:
-    cpp::thread_pool<!dbn_traits<this_type>::is_serial()> pool;
+    std::unique_ptr<task_scheduler> budget_scheduler; ///< The scheduler of the restricted budget of the network
 
     template<size_t I, cpp_disable_iff(I == layers)>
     void dyn_init(){
@@ -233,6 +318,25 @@ private:
     template<size_t I, cpp_enable_iff(I == layers)>
     void dyn_init(){}
 
+    /*!
+     * \brief Bind the weights of the layers tied to another layer of the
+     * network, from the layer I
+     */
+    template <size_t I>
+    void tie_layers() {
+        if constexpr (I < layers) {
+            if constexpr (has_tied_weights<layer_type<I>>::value) {
+                static_assert(layer_type<I>::tied_layer < I, "A layer can only be tied to a previous layer");
+                static_assert(decay_layer_traits<layer_type<layer_type<I>::tied_layer>>::is_standard_dense_layer(),
+                              "A layer can only be tied to a dense layer");
+
+                layer_get<I>().tie(layer_get<layer_type<I>::tied_layer>());
+            }
+
+            tie_layers<I + 1>();
+        }
+    }
+
     template<size_t L = rbm_layer_n>
     auto get_rbm_generator_desc(){
         static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_generator_desc");
@@ -261,6 +365,13 @@ private:
         return rbm_ingenerator_fast_inner_t<layer_type<L>::batch_size>{};
     }
 
+    template<size_t L = rbm_layer_n>
+    auto get_rbm_feature_store_inner_desc(){
+        static_assert(decay_layer_traits<layer_type<L>>::is_rbm_layer(), "Invalid use of get_rbm_feature_store_inner_desc");
+
+        return rbm_feature_store_inner_t<layer_type<L>::batch_size>{};
+    }
+
     template <size_t L, cpp_enable_iff((L < layers - 1) && decay_layer_traits<layer_type<L>>::is_rbm_layer())>
     void validate_pretraining_base() const {
         static_assert(layer_type<L>::batch_size == layer_type<rbm_layer_n>::batch_size, "Incoherent batch sizes in network");
@@ -300,13 +411,21 @@ public:
      *
      * This is the only way to create a DBN.
      */
-    dbn() : pool(etl::threads) {
+    dbn() {
         //Nothing else to init
 
         if constexpr (!std::is_same<typename desc::base_layers, typename desc::layers>::value) {
             this->template dyn_init<0>();
         }
 
+        tie_layers<0>();
+
+        for (size_t I = 0; I < layers; ++I) {
+            weights_memory[I] = memory_record(memory_subsystem::WEIGHTS, I, 0);
+        }
+
+        account_memory();
+
         // Update defaults for each updater type
 
         if(updater == updater_type::RMSPROP){
@@ -328,6 +447,10 @@ public:
         if(updater == updater_type::NADAM){
             learning_rate = 0.002;
         }
+
+        if(updater == updater_type::LAMB){
+            learning_rate = 0.001;
+        }
     }
 
     //No copying
@@ -494,189 +617,906 @@ public:
         snprintf(buffer, 512, "  %*s: %*lu\n", int(column_length[0] + column_length[1] + 5), "Total Parameters", int(column_length[2]), parameters);
 
         out << buffer;
+
+        // The dynamic layers may have been initialized since the construction
+        account_memory();
+
+        for (size_t s = 0; s < memory_subsystems; ++s) {
+            auto subsystem = memory_subsystem(s);
+
+            if (memory_peak(subsystem)) {
+                std::string name = std::string("Memory (") + to_string(subsystem) + ")";
+
+                snprintf(buffer, 512, "  %*s: %s (peak %s)\n", int(column_length[0] + column_length[1] + 5), name.c_str(),
+                         memory_str(memory_current(subsystem)).c_str(), memory_str(memory_peak(subsystem)).c_str());
+
+                out << buffer;
+            }
+        }
     }
 
     /*!
-     * \brief Backup the weights of all the layers into a temporary storage.
+     * \brief Update the accounting of the memory of the weights of each
+     * layer.
      *
-     * Only one temporary storage is available, i.e. calling this function
-     * twice will erase the first saved weights.
+     * This must be called again after the initialization of dynamic layers,
+     * which is done by the trainers and by display_pretty.
      */
-    void backup_weights() {
-        for_each_layer([](auto& layer) {
-            layer.backup_weights();
+    void account_memory() const {
+        for_each_layer_i([this](size_t I, auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                weights_memory[I].resize(layer.parameters() * sizeof(weight));
+            } else {
+                cpp_unused(I);
+                cpp_unused(layer);
+            }
         });
     }
 
     /*!
-     * \brief Restore the weights previously saved.
+     * \brief Predict the memory of the training of the network with batches
+     * of the given size, without allocating the training contexts.
      *
-     * This function has no effect if the weights were not saved before.
-     * Calling this function twice will restore the same weights.
+     * The activations are the input, output and errors of each layer, the
+     * gradients and the state of the updater have the size of the
+     * parameters. The layers whose sizes cannot be queried (or dynamic layers
+     * that are not initialized yet) are marked as unknown.
+     *
+     * \param batch The number of samples in the batch
      */
-    void restore_weights() {
-        for_each_layer([](auto& layer) {
-            layer.restore_weights();
+    memory_estimate estimate_memory(size_t batch = batch_size) const {
+        memory_estimate estimate;
+
+        for_each_layer([&estimate, batch](auto& layer) {
+            using layer_t = std::decay_t<decltype(layer)>;
+
+            memory_estimate::layer l;
+            l.name = layer.to_short_string("");
+
+            if constexpr (decay_layer_traits<layer_t>::is_neural_layer()) {
+                const size_t parameters = layer.parameters() * sizeof(weight);
+
+                l.weights   = parameters;
+                l.gradients = parameters;
+                l.optimizer = parameters * (updater_state_arrays(updater) + (dbn_traits<this_type>::has_mixed_precision() ? 1 : 0));
+            }
+
+            if constexpr (has_layer_sizes<layer_t>::value) {
+                l.activations = batch * (layer.input_size() + 2 * layer.output_size()) * sizeof(weight);
+                l.known       = l.activations > 0;
+            } else {
+                l.known = false;
+            }
+
+            estimate.layers.push_back(l);
         });
-    }
 
-    /*!
-     * \brief Store the network weights to the given file.
-     * \param file The path to the file
-     */
-    void store(const std::string& file) const {
-        std::ofstream os(file, std::ofstream::binary);
-        store(os);
+        return estimate;
     }
 
     /*!
-     * \brief Load the network weights from the given file.
-     * \param file The path to the file
+     * \brief Decide if a dataset of the given size can be kept in memory
+     * under the memory budget of the network (memory_limit).
+     *
+     * The training itself is predicted by estimate_memory().
+     *
+     * \param dataset The memory taken by the dataset once resident, in bytes
      */
-    void load(const std::string& file) {
-        std::ifstream is(file, std::ifstream::binary);
-        load(is);
+    memory_plan plan_memory(size_t dataset) const {
+        memory_plan plan;
+
+        plan.budget  = memory_limit;
+        plan.dataset = dataset;
+
+        if (memory_limit) {
+            plan.fixed = estimate_memory().peak();
+        }
+
+        return plan;
     }
 
     /*!
-     * \brief Store the network weights using the given output stream.
-     * \param os The stream to output the network weights to.
+     * \brief Prints the analytical cost of each layer of the network for a
+     * batch of the given size: the floating point operations and the bytes
+     * moved by each pass and the arithmetic intensity of the forward pass.
+     *
+     * \param batch The number of samples in the batch
      */
-    void store(std::ostream& os) const {
-        for_each_layer([&os](auto& layer) {
-            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
-                layer.store(os);
-            }
+    void display_cost(size_t batch = 1) const {
+        constexpr size_t columns = 8;
+
+        out << '\n';
+
+        std::array<std::string, columns> column_name;
+        column_name[0] = "Index";
+        column_name[1] = "Layer";
+        column_name[2] = "Forward FLOP";
+        column_name[3] = "Forward Bytes";
+        column_name[4] = "Backward FLOP";
+        column_name[5] = "Gradients FLOP";
+        column_name[6] = "Gradients Bytes";
+        column_name[7] = "FLOP/B";
+
+        std::vector<std::array<std::string, columns>> rows;
+
+        size_t forward_flops = 0;
+        size_t train_flops   = 0;
+
+        std::vector<size_t> output;
+
+        for_each_layer_i([&](size_t I, auto& layer) {
+            auto cost = cost_of_layer<weight>(layer, output, batch);
+
+            forward_flops += cost.forward.flops;
+            train_flops += cost.forward.flops + cost.backward.flops + cost.gradients.flops;
+
+            output = layer.output_shape(output);
+
+            char intensity[32];
+            snprintf(intensity, 32, "%.2f", cost.forward.intensity());
+
+            rows.emplace_back();
+            auto& row = rows.back();
+
+            row[0] = std::to_string(I);
+            row[1] = layer.to_short_string("");
+            row[2] = std::to_string(cost.forward.flops);
+            row[3] = std::to_string(cost.forward.bytes);
+            row[4] = std::to_string(cost.backward.flops);
+            row[5] = std::to_string(cost.gradients.flops);
+            row[6] = std::to_string(cost.gradients.bytes);
+            row[7] = intensity;
         });
 
-#ifdef DLL_SVM_SUPPORT
-        svm_store(*this, os);
-#endif //DLL_SVM_SUPPORT
-    }
+        std::array<size_t, columns> column_length;
 
-    /*!
-     * \brief Load the network weights using the given output stream.
-     * \param is The stream to load the network weights from.
-     */
-    void load(std::istream& is) {
-        for_each_layer([&is](auto& layer) {
-            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
-                layer.load(is);
+        for (size_t i = 0; i < columns; ++i) {
+            column_length[i] = column_name[i].size();
+
+            for (auto& row : rows) {
+                column_length[i] = std::max(column_length[i], row[i].size());
             }
-        });
+        }
 
-#ifdef DLL_SVM_SUPPORT
-        svm_load(*this, is);
-#endif //DLL_SVM_SUPPORT
+        const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length.begin(), column_length.end(), 0);
+
+        out << " " << std::string(line_length, '-') << '\n';
+
+        auto print_row = [&](const std::array<std::string, columns>& row, bool header) {
+            std::string line = " |";
+
+            for (size_t i = 0; i < columns; ++i) {
+                std::string padding(column_length[i] - row[i].size(), ' ');
+
+                // The names are left-aligned and the numbers right-aligned
+                line += " " + (header || i < 2 ? row[i] + padding : padding + row[i]) + " |";
+            }
+
+            out << line << '\n';
+        };
+
+        print_row(column_name, true);
+
+        out << " " << std::string(line_length, '-') << '\n';
+
+        for (auto& row : rows) {
+            print_row(row, false);
+        }
+
+        out << " " << std::string(line_length, '-') << '\n';
+
+        char buffer[512];
+
+        snprintf(buffer, 512, "  %*s: %lu\n", int(column_length[0] + column_length[1] + 5), "Forward FLOP", forward_flops);
+        out << buffer;
+
+        snprintf(buffer, 512, "  %*s: %lu\n", int(column_length[0] + column_length[1] + 5), "Training FLOP", train_flops);
+        out << buffer;
     }
 
     /*!
-     * \brief Returns the Nth layer.
-     * \return The Nth layer
-     * \tparam N The index of the layer to return (from 0)
+     * \brief Set the number of threads of the network (0 for the number of
+     * CPUs of its affinity, or the thread budget of the process)
      */
-    template <size_t N>
-    layer_type<N>& layer_get() {
-        return detail::layer_get<N>(tuples);
+    void set_threads(size_t threads) {
+        budget.threads = threads;
+        budget_scheduler.reset();
     }
 
     /*!
-     * \brief Returns the Nth layer.
-     * \return The Nth layer
-     * \tparam N The index of the layer to return (from 0)
+     * \brief Pin the threads of the network to the given CPUs (not pinned if
+     * empty)
      */
-    template <size_t N>
-    constexpr const layer_type<N>& layer_get() const {
-        return detail::layer_get<N>(tuples);
+    void set_affinity(const std::vector<size_t>& cpus) {
+        budget.cpus = cpus;
+        budget_scheduler.reset();
     }
 
     /*!
-     * \brief Initialize the Nth layer  with the given args. The Nth layer must
-     * be a dynamic layer.
-     * \tparam N The index of the layer to return (from 0)
-     * \param args The arguments for initialization of the layer.
+     * \brief Returns the scheduler of the parallel kernels of the network:
+     * its own scheduler with a restricted budget, or the shared one
      */
-    template <size_t N, typename... Args>
-    void init_layer(Args&&... args){
-        layer_get<N>().init_layer(std::forward<Args>(args)...);
-    }
+    task_scheduler& scheduler() {
+        if (!budget.restricted()) {
+            return get_scheduler();
+        }
 
-    template <size_t N>
-    size_t layer_input_size() const noexcept {
-        return dll::input_size(layer_get<N>());
-    }
+        if (!budget_scheduler) {
+            budget_scheduler = budget.make_scheduler();
+        }
 
-    template <size_t N>
-    size_t layer_output_size() const noexcept {
-        return dll::output_size(layer_get<N>());
+        return *budget_scheduler;
     }
 
     /*!
-     * \brief Returns the input size expected by the network
-     * \return The input size of the network
+     * \brief Run the current thread within the budget of the network for the
+     * lifetime of the returned scope. The training of the network is always
+     * run within its budget, this is for inference.
      */
-    size_t input_size() const noexcept {
-        return dll::input_size(layer_get<input_layer_n>());
+    dll::resource_scope budget_scope() {
+        return dll::resource_scope(budget, scheduler());
     }
 
     /*!
-     * \brief Returns the output size generated by the network
-     * \return The output size of the network
+     * \brief Backup the weights of all the layers into a temporary storage.
+     *
+     * Only one temporary storage is available, i.e. calling this function
+     * twice will erase the first saved weights.
      */
-    size_t output_size() const noexcept {
-        return dll::output_size(layer_get<output_layer_n>());
+    void backup_weights() {
+        backup_weights_async();
+        wait_backup();
     }
 
-    size_t full_output_size() const noexcept {
-        size_t output = 0;
-        for_each_layer([&output](auto& layer) {
-            output += layer.output_size();
+    /*!
+     * \brief Start the backup of the weights of all the layers into the
+     * temporary storage.
+     *
+     * The trainable parameters of the neural layers are copied back to back
+     * into a single buffer by a background thread. Since the copy only reads
+     * the weights, it can overlap the computations of the network, but
+     * wait_backup() must be called before the weights are modified. The
+     * other layers are saved before this function returns.
+     */
+    void backup_weights_async() {
+        wait_backup();
+
+        flat_backup.resize(parameters_size());
+
+        for_each_layer([this](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                cpp::for_each(layer.trainable_parameters(), [this](auto& w) {
+                    backup_copy.add(w);
+                });
+            } else {
+                layer.backup_weights();
+            }
         });
-        return output;
+
+        backup_copy.start(flat_backup);
     }
 
     /*!
-     * \brief Indicates if training should save memory (true) or run as efficiently as possible (false).
-     *
-     * \return true if the training should save memory, false otherwise.
+     * \brief Wait for the end of the backup of the weights started by
+     * backup_weights_async(), if any.
      */
-    static constexpr bool batch_mode() noexcept {
-        return dbn_traits<this_type>::batch_mode();
+    void wait_backup() {
+        backup_copy.wait();
     }
 
-    /* pretrain */
-
     /*!
-     * \brief Pretrain the network by training all layers in an unsupervised
-     * manner.
+     * \brief Restore the weights previously saved.
+     *
+     * This function has no effect if the weights were not saved before.
+     * Calling this function twice will restore the same weights.
      */
-    template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
-    void pretrain(Generator& generator, size_t max_epochs) {
-        static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
-
-        validate_pretraining();
-
-        dll::auto_timer timer("net:pretrain");
+    void restore_weights() {
+        wait_backup();
 
-        watcher_t watcher;
+        // The neural layers are only restored if they were saved
+        const bool saved = flat_backup.size();
 
-        watcher.pretraining_begin(*this, max_epochs);
+        flat_backup.rewind();
 
-        //Pretrain each layer one-by-one
-        if constexpr (batch_mode()) {
-            out << "DBN: Pretraining done in batch mode" << std::endl;
+        for_each_layer([this, saved](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                if (saved) {
+                    cpp::for_each(layer.trainable_parameters(), [this](auto& w) {
+                        flat_backup.unpack(w);
+                    });
 
-            if (layers_t::has_shuffle_layer) {
-                out << "warning: batch_mode dbn does not support shuffle in layers (will be ignored)";
+                    dll::invalidate_transforms(layer);
+                }
+            } else {
+                layer.restore_weights();
             }
+        });
+    }
 
-            pretrain_layer_batch<0>(generator, watcher, max_epochs);
-        } else {
-            pretrain_layer<0>(generator, watcher, max_epochs);
+    /*!
+     * \brief Swap the weights of the layers with their moving average,
+     * maintained during training (with ema_weights).
+     *
+     * The values are exchanged in place, no copy of the network is made.
+     * Swapping a second time restores the trained weights.
+     */
+    void swap_ema_weights() {
+        if (!ema.size()) {
+            return;
         }
 
-        watcher.pretraining_end(*this);
-    }
+        ema.rewind();
+
+        for_each_layer([this](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                cpp::for_each(layer.trainable_parameters(), [this](auto& w) {
+                    ema.swap(w);
+                });
+
+                dll::invalidate_transforms(layer);
+            }
+        });
+    }
+
+    /*!
+     * \brief Returns the total number of trainable parameters of the
+     * (neural) layers of the network.
+     */
+    size_t parameters_size() {
+        size_t n = 0;
+
+        for_each_layer([&n](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                cpp::for_each(layer.trainable_parameters(), [&n](auto& w) {
+                    n += etl::size(w);
+                });
+            }
+        });
+
+        return n;
+    }
+
+    /*!
+     * \brief Quantize the dense and convolutional layers of the network for
+     * INT8 inference.
+     *
+     * The generator is used for calibration: it is forwarded through the
+     * network in floating point to record the range of the input of each
+     * layer. Once quantized, the forward propagation of these layers use
+     * the INT8 weights and kernels.
+     *
+     * \param generator The generator to use for calibration
+     */
+    template <typename Generator>
+    void quantize(Generator& generator) {
+        dll::auto_timer timer("net:quantize");
+
+        set_quantized(false);
+
+        std::array<float, layers> ranges;
+        ranges.fill(0.0f);
+
+        generator.reset();
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            calibrate_impl<0>(generator.data_batch(), ranges);
+
+            generator.next_batch();
+        }
+
+        for_each_layer_i([&ranges](size_t I, auto& layer) {
+            using layer_t = std::decay_t<decltype(layer)>;
+
+            if constexpr (is_quantizable_layer<layer_t>::value) {
+                using quantized_t = typename decltype(layer.quantized)::element_type;
+
+                layer.quantized = std::make_unique<quantized_t>();
+                layer.quantized->quantize(layer.w, ranges[I]);
+            }
+        });
+    }
+
+    /*!
+     * \brief Quantize the tables of the embedding layers of the network
+     * row-wise, for inference.
+     *
+     * Once quantized, the forward propagation of these layers gathers and
+     * dequantizes the rows of the quantized tables. The quantized tables are
+     * stored with the network in the model file format.
+     *
+     * \param bits The number of bits per value (8 or 4)
+     */
+    void quantize_embeddings(size_t bits = 8) {
+        dll::auto_timer timer("net:quantize:embeddings");
+
+        for_each_layer([bits](auto& layer) {
+            if constexpr (is_quantizable_embedding<std::decay_t<decltype(layer)>>::value) {
+                layer.quantized_table = std::make_unique<quantized_embedding_table>();
+                layer.quantized_table->quantize(layer.w, bits);
+            }
+        });
+    }
+
+    /*!
+     * \brief Enable or disable the INT8 path of the layers that have been
+     * quantized (and the quantized tables of the embedding layers).
+     */
+    void set_quantized(bool enabled) {
+        for_each_layer([enabled](auto& layer) {
+            if constexpr (is_quantizable_layer<std::decay_t<decltype(layer)>>::value) {
+                if (layer.quantized) {
+                    layer.quantized->enabled = enabled;
+                }
+            }
+
+            if constexpr (is_quantizable_embedding<std::decay_t<decltype(layer)>>::value) {
+                if (layer.quantized_table) {
+                    layer.quantized_table->enabled = enabled;
+                }
+            }
+        });
+    }
+
+    /*!
+     * \brief Indicates if at least one layer of the network uses INT8
+     * inference (or a quantized embedding table).
+     */
+    bool is_quantized() const {
+        bool quantized = false;
+
+        for_each_layer([&quantized](auto& layer) {
+            if constexpr (is_quantizable_layer<std::decay_t<decltype(layer)>>::value) {
+                quantized |= layer.quantized && layer.quantized->enabled;
+            }
+
+            if constexpr (is_quantizable_embedding<std::decay_t<decltype(layer)>>::value) {
+                quantized |= layer.quantized_table && layer.quantized_table->enabled;
+            }
+        });
+
+        return quantized;
+    }
+
+    /*!
+     * \brief Prune the units with the smallest norms of the dense (hidden
+     * units) and convolutional (filters) layers of the network.
+     *
+     * The units of the last dense or convolutional layer (the outputs of the
+     * network) are never pruned. The pruned units are set to zero and can
+     * be removed with compact().
+     *
+     * \param ratio The ratio of the units of each layer to prune
+     *
+     * \return The total number of pruned units
+     */
+    size_t prune(double ratio) {
+        dll::auto_timer timer("net:prune");
+
+        size_t pruned = 0;
+
+        for_each_layer_i([ratio, &pruned](size_t I, auto& layer) {
+            if constexpr (is_prunable_layer<decltype(layer)>()) {
+                if (I != last_prunable_layer()) {
+                    pruned += prune_units(layer, ratio);
+                }
+            }
+        });
+
+        return pruned;
+    }
+
+    /*!
+     * \brief Prune the blocks of weights with the smallest norms of the dense
+     * layers of the network.
+     *
+     * \param ratio The ratio of the blocks of each layer to prune
+     *
+     * \return The total number of pruned blocks
+     */
+    size_t prune_weight_blocks(double ratio) {
+        dll::auto_timer timer("net:prune");
+
+        size_t pruned = 0;
+
+        for_each_layer([ratio, &pruned](auto& layer) {
+            if constexpr (is_prunable_layer<decltype(layer)>() && decay_layer_traits<decltype(layer)>::is_dense_layer()) {
+                pruned += prune_blocks(layer, ratio);
+            }
+        });
+
+        return pruned;
+    }
+
+    /*!
+     * \brief Store the weights of the sparse enough dense layers in
+     * block-sparse format, for faster inference.
+     *
+     * The block-sparse weights are a copy of the weights, they must be
+     * created again if the network is trained again.
+     *
+     * \param max_density The maximum ratio of non-zero blocks for a layer to use the block-sparse weights
+     */
+    void sparsify(double max_density = 0.5) {
+        for_each_layer([max_density](auto& layer) {
+            if constexpr (is_prunable_layer<decltype(layer)>() && decay_layer_traits<decltype(layer)>::is_dense_layer()) {
+                using sparse_t = typename decltype(layer.block_sparse)::element_type;
+
+                layer.block_sparse = std::make_unique<sparse_t>();
+                layer.block_sparse->compress(layer.w);
+
+                if (layer.block_sparse->density() > max_density) {
+                    layer.block_sparse.reset();
+                }
+            }
+        });
+    }
+
+    /*!
+     * \brief Enable or disable the block-sparse path of the layers that have
+     * been sparsified.
+     */
+    void set_block_sparse(bool enabled) {
+        for_each_layer([enabled](auto& layer) {
+            if constexpr (is_prunable_layer<decltype(layer)>() && decay_layer_traits<decltype(layer)>::is_dense_layer()) {
+                if (layer.block_sparse) {
+                    layer.block_sparse->enabled = enabled;
+                }
+            }
+        });
+    }
+
+    /*!
+     * \brief Copy the network without its pruned units into the given
+     * dynamic network.
+     *
+     * The target network must have the dynamic versions of the layers of
+     * this network. Its dense and convolutional layers are initialized with
+     * the units that have not been pruned and the inputs of the next layers
+     * are reduced accordingly. The other layers of the target network are
+     * not modified and therefore must not depend on the number of units
+     * (activation, dropout or pooling layers for instance).
+     *
+     * \param target The dynamic network to initialize
+     */
+    template <typename Target>
+    void compact(Target& target) const {
+        static_assert(Target::layers == layers, "The compact network must have the same layers");
+
+        std::vector<size_t> kept;
+
+        compact_impl<0>(target, kept, 0);
+    }
+
+    /*!
+     * \brief Copy the network into the given dynamic network, replacing each
+     * of the dense layers L... by two chained dense layers of lower rank.
+     *
+     * Each factorized layer takes two layers in the target network: a dense
+     * layer without activation function, from the visible units to the rank,
+     * and a dense layer with the activation function of the original layer,
+     * from the rank to the hidden units. The rank of each layer is chosen
+     * from the budget. The other dense and convolutional layers are copied,
+     * the other layers of the target network are not modified.
+     *
+     * \tparam L The indices of the dense layers to factorize
+     * \param target The dynamic network to initialize
+     * \param budget The budget of the factorization of each layer
+     *
+     * \return The rank of each factorized layer
+     */
+    template <size_t... L, typename Target>
+    std::vector<size_t> low_rank(Target& target, const low_rank_budget& budget = {}) const {
+        static_assert(Target::layers == layers + sizeof...(L), "Each factorized layer must be replaced by two layers");
+
+        dll::auto_timer timer("net:low_rank");
+
+        std::vector<size_t> ranks;
+
+        low_rank_impl<0, 0, L...>(target, budget, ranks);
+
+        return ranks;
+    }
+
+    /*!
+     * \brief Copy the network into the given dynamic network, replacing each
+     * of the dense layers L... by two chained dense layers of lower rank, and
+     * fine-tune the target network for a few epochs.
+     *
+     * \tparam L The indices of the dense layers to factorize
+     * \param target The dynamic network to initialize
+     * \param budget The budget of the factorization of each layer
+     * \param samples The container containing the samples
+     * \param labels The container containing the labels
+     * \param epochs The number of epochs of fine-tuning
+     *
+     * \return The rank of each factorized layer
+     */
+    template <size_t... L, typename Target, typename Samples, typename Labels>
+    std::vector<size_t> low_rank(Target& target, const low_rank_budget& budget, const Samples& samples, const Labels& labels, size_t epochs) const {
+        auto ranks = low_rank<L...>(target, budget);
+
+        target.fine_tune(samples, labels, epochs);
+
+        return ranks;
+    }
+
+    /*!
+     * \brief Prepare the network for inference.
+     *
+     * Each Batch Normalization layer directly following a dense or
+     * convolutional layer without activation function is folded into the
+     * weights and biases of this layer and then skipped during forward
+     * propagation. With an inference_session, activation layers are also
+     * applied in-place on the output of the previous layer.
+     *
+     * The network should not be trained after this.
+     *
+     * \return The number of folded layers
+     */
+    size_t freeze_for_inference() {
+        size_t folded = 0;
+
+        for_each_layer_pair([&folded](auto& layer_1, auto& layer_2) {
+            if (fold_batch_normalization(layer_1, layer_2)) {
+                ++folded;
+            }
+        });
+
+        return folded;
+    }
+
+    /*!
+     * \brief Store the network weights to the given file.
+     *
+     * The file is written in the model file format (see util/model_file.hpp),
+     * with one checksummed tensor per layer.
+     *
+     * \param file The path to the file
+     * \return true if the file was written, false otherwise
+     */
+    bool store(const std::string& file) const {
+        model_file_writer writer;
+
+        add_model_tensors(writer);
+
+        return writer.write(file, sizeof(weight));
+    }
+
+    /*!
+     * \brief Store the network weights and the given nearest-neighbour index
+     * to the given file.
+     *
+     * The index is written as one more tensor, after the layers. The file
+     * can still be loaded with load(file), the index being ignored.
+     *
+     * \param file The path to the file
+     * \param index The index of the features of the network
+     * \return true if the file was written, false otherwise
+     */
+    bool store(const std::string& file, const ann_index<weight>& index) const {
+        model_file_writer writer;
+
+        add_model_tensors(writer);
+
+        writer.add(index.serialize(), "ANN");
+
+        return writer.write(file, sizeof(weight));
+    }
+
+    /*!
+     * \brief Load the network weights from the given file.
+     *
+     * A model file is memory-mapped and the layers read their weights
+     * directly from the mapping. The description of the layers and the
+     * checksums of the tensors are verified. Raw files (written with
+     * store(std::ostream&)) are also supported. A nearest-neighbour index
+     * stored with the network is ignored.
+     *
+     * \param file The path to the file
+     * \return true if the weights were loaded, false otherwise
+     */
+    bool load(const std::string& file) {
+        if (!is_model_file(file)) {
+            std::ifstream is(file, std::ifstream::binary);
+            load(is);
+            return bool(is);
+        }
+
+        mapped_model_file model(file);
+
+        size_t i = 0;
+
+        bool valid = load_model_tensors(model, i);
+
+        if (valid && i + 1 == model.size() && model.check(i, "ANN")) {
+            ++i;
+        }
+
+        if (!valid || i != model.size()) {
+            std::cerr << "ERROR: The model file " << file << " does not match the network" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Load the network weights and the nearest-neighbour index from
+     * the given file, written by store(file, index).
+     *
+     * \param file The path to the file
+     * \param index The index to load
+     * \return true if the weights and the index were loaded, false otherwise
+     */
+    bool load(const std::string& file, ann_index<weight>& index) {
+        if (!is_model_file(file)) {
+            std::cerr << "ERROR: The file " << file << " is not a model file" << std::endl;
+            return false;
+        }
+
+        mapped_model_file model(file);
+
+        size_t i = 0;
+
+        bool valid = load_model_tensors(model, i);
+
+        if (!valid || i + 1 != model.size() || !model.check(i, "ANN") || !index.deserialize(model.data(i), model.entry(i).size)) {
+            std::cerr << "ERROR: The model file " << file << " does not match the network and the index" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Store the network weights using the given output stream.
+     * \param os The stream to output the network weights to.
+     */
+    void store(std::ostream& os) const {
+        for_each_layer([&os](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                store_layer(os, layer);
+            }
+        });
+
+#ifdef DLL_SVM_SUPPORT
+        svm_store(*this, os);
+#endif //DLL_SVM_SUPPORT
+    }
+
+    /*!
+     * \brief Load the network weights using the given output stream.
+     * \param is The stream to load the network weights from.
+     */
+    void load(std::istream& is) {
+        ++model_version;
+
+        for_each_layer([&is](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                load_layer(is, layer);
+            }
+        });
+
+#ifdef DLL_SVM_SUPPORT
+        svm_load(*this, is);
+#endif //DLL_SVM_SUPPORT
+    }
+
+    /*!
+     * \brief Returns the Nth layer.
+     * \return The Nth layer
+     * \tparam N The index of the layer to return (from 0)
+     */
+    template <size_t N>
+    layer_type<N>& layer_get() {
+        return detail::layer_get<N>(tuples);
+    }
+
+    /*!
+     * \brief Returns the Nth layer.
+     * \return The Nth layer
+     * \tparam N The index of the layer to return (from 0)
+     */
+    template <size_t N>
+    constexpr const layer_type<N>& layer_get() const {
+        return detail::layer_get<N>(tuples);
+    }
+
+    /*!
+     * \brief Initialize the Nth layer  with the given args. The Nth layer must
+     * be a dynamic layer.
+     * \tparam N The index of the layer to return (from 0)
+     * \param args The arguments for initialization of the layer.
+     */
+    template <size_t N, typename... Args>
+    void init_layer(Args&&... args){
+        layer_get<N>().init_layer(std::forward<Args>(args)...);
+    }
+
+    template <size_t N>
+    size_t layer_input_size() const noexcept {
+        return dll::input_size(layer_get<N>());
+    }
+
+    template <size_t N>
+    size_t layer_output_size() const noexcept {
+        return dll::output_size(layer_get<N>());
+    }
+
+    /*!
+     * \brief Returns the input size expected by the network
+     * \return The input size of the network
+     */
+    size_t input_size() const noexcept {
+        return dll::input_size(layer_get<input_layer_n>());
+    }
+
+    /*!
+     * \brief Returns the output size generated by the network
+     * \return The output size of the network
+     */
+    size_t output_size() const noexcept {
+        return dll::output_size(layer_get<output_layer_n>());
+    }
+
+    size_t full_output_size() const noexcept {
+        size_t output = 0;
+        for_each_layer([&output](auto& layer) {
+            output += layer.output_size();
+        });
+        return output;
+    }
+
+    /*!
+     * \brief Indicates if training should save memory (true) or run as efficiently as possible (false).
+     *
+     * \return true if the training should save memory, false otherwise.
+     */
+    static constexpr bool batch_mode() noexcept {
+        return dbn_traits<this_type>::batch_mode();
+    }
+
+    /* pretrain */
+
+    /*!
+     * \brief Pretrain the network by training all layers in an unsupervised
+     * manner.
+     */
+    template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    void pretrain(Generator& generator, size_t max_epochs) {
+        static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+
+        validate_pretraining();
+
+        dll::auto_timer timer("net:pretrain");
+
+        // Pretrain within the threads and the CPUs of the network
+        auto scope = budget_scope();
+
+        watcher_t watcher;
+
+        watcher.pretraining_begin(*this, max_epochs);
+
+        //Pretrain each layer one-by-one
+        if constexpr (batch_mode()) {
+            out << "DBN: Pretraining done in batch mode" << std::endl;
+
+            if (layers_t::has_shuffle_layer) {
+                out << "warning: batch_mode dbn does not support shuffle in layers (will be ignored)";
+            }
+
+            if constexpr (dbn_traits<this_type>::pipeline_pretrain()) {
+                pretrain_layer_pipelined<next_batch_layer<0>::value>(generator, watcher, max_epochs);
+            } else {
+                pretrain_layer_batch<0>(generator, watcher, max_epochs);
+            }
+        } else {
+            pretrain_layer<0>(generator, watcher, max_epochs);
+        }
+
+        watcher.pretraining_end(*this);
+    }
 
     /*!
      * \brief Pretrain the network by training all layers in an unsupervised
@@ -871,6 +1711,133 @@ public:
             std::max_element(std::prev(output_a.end(), labels), output_a.end()));
     }
 
+    /*!
+     * \brief Predict the labels of all the samples of the given generator
+     * (only when pretrained with labels).
+     *
+     * Instead of a reconstruction of the label units, each sample is given
+     * the class with the lowest free energy in the top RBM. The hidden
+     * activations of the features are computed once per batch, in one
+     * matrix multiplication, and the free energy of each class only adds
+     * the weights of its label unit. This assumes binary hidden units in
+     * the top RBM.
+     *
+     * \param generator The generator of the samples (the labels are not used)
+     * \param labels The number of label units
+     *
+     * \return The predicted label of each sample
+     */
+    template <typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    std::vector<size_t> predict_labels_batch(Generator& generator, size_t labels) const {
+        static_assert(pretrain_possible, "Only networks with RBM can be pretrained");
+        static_assert(layers > 1, "The labels units must be after a layer of features");
+
+        cpp_assert(dll::input_size(layer_get<layers - 1>()) == dll::output_size(layer_get<layers - 2>()) + labels, "There is no room for the labels units");
+
+        decltype(auto) rbm = layer_get<layers - 1>();
+
+        const size_t m = dll::output_size(layer_get<layers - 2>());
+        const size_t h = dll::output_size(rbm);
+
+        // Split the weights between the features and the label units
+        etl::dyn_matrix<weight, 2> w_x(m, h);
+        etl::dyn_matrix<weight, 2> w_y(labels, h);
+
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t j = 0; j < h; ++j) {
+                w_x(i, j) = rbm.w(i, j);
+            }
+        }
+
+        for (size_t l = 0; l < labels; ++l) {
+            for (size_t j = 0; j < h; ++j) {
+                w_y(l, j) = rbm.w(m + l, j);
+            }
+        }
+
+        std::vector<size_t> predictions;
+        predictions.reserve(generator.size());
+
+        generator.reset();
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            decltype(auto) features = forward_batch<layers - 2>(generator.data_batch());
+
+            const size_t n = etl::dim<0>(features);
+
+            etl::dyn_matrix<weight, 2> a(n, h);
+
+            a = features * w_x;
+
+            for (size_t i = 0; i < n; ++i) {
+                size_t best   = 0;
+                weight best_f = std::numeric_limits<weight>::max();
+
+                // The contribution of the features to the free energy is the same for all the labels
+                for (size_t l = 0; l < labels; ++l) {
+                    weight f = -rbm.c[m + l];
+
+                    for (size_t j = 0; j < h; ++j) {
+                        const weight x = a(i, j) + rbm.b[j] + w_y(l, j);
+
+                        // softplus(x), without overflow
+                        f -= x > 0 ? x + std::log1p(std::exp(-x)) : std::log1p(std::exp(x));
+                    }
+
+                    if (f < best_f) {
+                        best   = l;
+                        best_f = f;
+                    }
+                }
+
+                predictions.push_back(best);
+            }
+
+            generator.next_batch();
+        }
+
+        return predictions;
+    }
+
+    /*!
+     * \brief Predict the labels of all the given samples (only when
+     * pretrained with labels).
+     *
+     * \param first The beginning of the range of the samples
+     * \param last The end of the range of the samples
+     * \param labels The number of label units
+     *
+     * \return The predicted label of each sample
+     */
+    template <typename Iterator>
+    std::vector<size_t> predict_labels_batch(Iterator first, Iterator last, size_t labels) const {
+        const size_t n = std::distance(first, last);
+
+        // The labels are not used
+        std::vector<size_t> fake_labels(n, 0);
+
+        auto generator = make_generator(first, last, fake_labels.begin(), fake_labels.end(), n, labels, categorical_generator_t{});
+
+        generator->set_safe();
+
+        return predict_labels_batch(*generator, labels);
+    }
+
+    /*!
+     * \brief Predict the labels of all the given samples (only when
+     * pretrained with labels).
+     *
+     * \param samples The container containing the samples
+     * \param labels The number of label units
+     *
+     * \return The predicted label of each sample
+     */
+    template <typename Samples, cpp_disable_iff(is_generator<Samples>)>
+    std::vector<size_t> predict_labels_batch(const Samples& samples, size_t labels) const {
+        return predict_labels_batch(std::begin(samples), std::end(samples), labels);
+    }
+
     //Note: features_sub are alias functions for forward_one
 
     /*!
@@ -886,37 +1853,156 @@ public:
     }
 
     /*!
-     * \brief Returns the output features of the Ith layer for the given sample
-     * \param sample The sample to get features from
-     * \tparam I The index of the layer for features (starts at 0)
-     * \return the output features of the Ith layer of the network
+     * \brief Returns the output features of the Ith layer for the given sample
+     * \param sample The sample to get features from
+     * \tparam I The index of the layer for features (starts at 0)
+     * \return the output features of the Ith layer of the network
+     */
+    template <size_t I, typename Input>
+    auto features_sub(const Input& sample) const {
+        return forward_one<I>(sample);
+    }
+
+    //Note: features functions are alias functions for forward_one
+
+    /*!
+     * \brief Computes the output features for the given sample and saves them in the given container
+     * \param sample The sample to get features from
+     * \param result The container where to save the features
+     * \return result
+     */
+    template <typename Output>
+    auto features(const input_one_t& sample, Output& result) const {
+        return result = features(sample);
+    }
+
+    /*!
+     * \brief Returns the output features for the given sample
+     *
+     * When the feature cache is enabled, the features of the inputs that
+     * have already been seen (with the same model version) are not
+     * computed again.
+     *
+     * \param sample The sample to get features from
+     * \return the output features of the last layer of the network
+     */
+    template<typename Input>
+    auto features(const Input& sample) const {
+        if (features_cache) {
+            return cached_features(sample);
+        }
+
+        return forward_one(sample);
+    }
+
+    /*!
+     * \brief Enable the cache of the output features of features().
+     *
+     * The features are keyed by the bytes of the input samples and by the
+     * model_version of the network, which is incremented at each training.
+     * It must be incremented when the weights are modified otherwise.
+     *
+     * \param max_bytes The memory limit of the cache
+     * \param shards The number of independent shards of the cache
+     */
+    void enable_feature_cache(size_t max_bytes, size_t shards = 16) {
+        features_cache = std::make_unique<feature_cache<weight>>(max_bytes, shards);
+    }
+
+    /*!
+     * \brief Disable (and release) the cache of the output features.
+     */
+    void disable_feature_cache() {
+        features_cache.reset();
+    }
+
+    /*!
+     * \brief Build an approximate nearest-neighbour index of the output
+     * features of the given layer for all the samples of the generator.
+     *
+     * The samples are identified by their position in the generator. The
+     * features are computed batch by batch and the quantizers of the index
+     * are trained and applied in parallel.
+     *
+     * \param generator The generator of the samples
+     * \param config The configuration of the index
+     * \tparam LS The index of the layer of the features
+     *
+     * \return The index of the features
+     */
+    template <size_t LS = layers - 1, typename Generator, cpp_enable_iff(is_generator<Generator>)>
+    ann_index<weight> build_ann_index(Generator& generator, const ann_config& config = {}) const {
+        std::vector<weight> embeddings;
+        size_t d = 0;
+
+        generator.reset();
+        generator.set_test();
+
+        while (generator.has_next_batch()) {
+            decltype(auto) features = forward_batch<LS>(generator.data_batch());
+
+            d = etl::size(features) / etl::dim<0>(features);
+
+            embeddings.insert(embeddings.end(), features.memory_start(), features.memory_end());
+
+            generator.next_batch();
+        }
+
+        ann_index<weight> index;
+
+        if (embeddings.empty()) {
+            std::cerr << "ERROR: Cannot build an index without samples" << std::endl;
+            return index;
+        }
+
+        index.build(embeddings.data(), embeddings.size() / d, d, config);
+
+        return index;
+    }
+
+    /*!
+     * \brief Build an approximate nearest-neighbour index of the output
+     * features of the given layer for all the given samples.
+     *
+     * \param samples The container containing the samples
+     * \param config The configuration of the index
+     * \tparam LS The index of the layer of the features
+     *
+     * \return The index of the features
      */
-    template <size_t I, typename Input>
-    auto features_sub(const Input& sample) const {
-        return forward_one<I>(sample);
-    }
+    template <size_t LS = layers - 1, typename Samples, cpp_disable_iff(is_generator<Samples>)>
+    ann_index<weight> build_ann_index(const Samples& samples, const ann_config& config = {}) const {
+        const size_t n = std::size(samples);
 
-    //Note: features functions are alias functions for forward_one
+        // The labels are not used
+        std::vector<size_t> fake_labels(n, 0);
 
-    /*!
-     * \brief Computes the output features for the given sample and saves them in the given container
-     * \param sample The sample to get features from
-     * \param result The container where to save the features
-     * \return result
-     */
-    template <typename Output>
-    auto features(const input_one_t& sample, Output& result) const {
-        return result = forward_one(sample);
+        auto generator = make_generator(samples, fake_labels, n, 1, categorical_generator_t{});
+
+        generator->set_safe();
+
+        return build_ann_index<LS>(*generator, config);
     }
 
     /*!
-     * \brief Returns the output features for the given sample
-     * \param sample The sample to get features from
-     * \return the output features of the last layer of the network
+     * \brief Search the samples of the index whose features are the nearest
+     * to the features of the given sample.
+     *
+     * \param index The index, built with build_ann_index<LS>
+     * \param sample The sample to search for
+     * \param k The number of neighbours
+     * \tparam LS The index of the layer of the features
+     *
+     * \return The positions of the neighbours and their (approximate)
+     * squared distances, the nearest first
      */
-    template<typename Input>
-    auto features(const Input& sample) const {
-        return forward_one(sample);
+    template <size_t LS = layers - 1, typename Input>
+    std::vector<std::pair<size_t, weight>> ann_search(const ann_index<weight>& index, const Input& sample, size_t k) const {
+        auto features = forward_one<LS>(sample);
+
+        cpp_assert(etl::size(features) == index.dimension, "The index does not match the features of the layer");
+
+        return index.search(features.memory_start(), k);
     }
 
     // Forward one batch at a time
@@ -1014,6 +2100,20 @@ public:
     // larger range of input. The rationale being that time should
     // be spent in forward_batch
 
+    /*
+     * \brief Return the given sample as an input of the L layer: ETL
+     * samples are used directly, and the STL samples are viewed (without
+     * copy when possible) or converted.
+     */
+    template <size_t L, typename Input>
+    decltype(auto) input_one(const Input& sample) const {
+        if constexpr (etl::is_etl_expr<Input>) {
+            return sample;
+        } else {
+            return convert_input(layer_get<L>(), sample);
+        }
+    }
+
     /*
      * \brief Return the test representation for the given input sample.
      *
@@ -1066,7 +2166,7 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
     decltype(auto) test_forward_one(Input&& sample) const {
-        return test_forward_one_impl<LS, L>(sample);
+        return test_forward_one_impl<LS, L>(input_one<L>(sample));
     }
 
     /*
@@ -1087,6 +2187,10 @@ public:
     /*
      * \brief Return the test representation for the given input sample.
      *
+     * A sample forwarded through the whole network uses a single-sample
+     * inference session of the network, without allocation of the
+     * intermediate outputs.
+     *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
@@ -1096,7 +2200,91 @@ public:
      */
     template <size_t LS = layers - 1, size_t L = 0, typename Input>
     decltype(auto) forward_one(Input&& sample) const {
-        return test_forward_one_impl<LS, L>(sample);
+        if constexpr (LS + 1 == layers && L == 0) {
+            return forward_one_session(input_one<0>(sample));
+        } else {
+            return test_forward_one_impl<LS, L>(input_one<L>(sample));
+        }
+    }
+
+private:
+    /*!
+     * \brief Forward one sample through the whole network with one of the
+     * single-sample sessions of the network.
+     *
+     * The intermediate outputs are in the preallocated buffers of the
+     * session, only the output of the network is allocated. A small network
+     * is forwarded serially, the cost of waking the threads being larger
+     * than the products of a single sample.
+     */
+    template <typename Input>
+    auto forward_one_session(const Input& sample) const {
+        using output_t = std::decay_t<decltype(test_forward_one_impl<layers - 1, 0>(sample))>;
+
+        size_t parameters = 0;
+
+        for_each_layer([&parameters](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                parameters += layer.parameters();
+            } else {
+                cpp_unused(layer);
+            }
+        });
+
+        tuning_scope scope(layer_tuning{conv_kernel::AUTO, parameters < serial_one_parameters ? size_t(1) : size_t(0)});
+
+        auto session = acquire_one_session();
+
+        output_t output(session->forward_one(sample));
+
+        release_one_session(std::move(session));
+
+        return output;
+    }
+
+    /*!
+     * \brief Take an idle single-sample session from the pool, or create a
+     * new one if all the sessions are in use
+     */
+    std::unique_ptr<inference_session<this_type>> acquire_one_session() const {
+        {
+            std::lock_guard<std::mutex> l(one_sessions_lock);
+
+            if (!one_sessions.empty()) {
+                auto session = std::move(one_sessions.back());
+                one_sessions.pop_back();
+                return session;
+            }
+        }
+
+        return std::make_unique<inference_session<this_type>>(*this, 1);
+    }
+
+    /*!
+     * \brief Give back a single-sample session to the pool
+     */
+    void release_one_session(std::unique_ptr<inference_session<this_type>> session) const {
+        std::lock_guard<std::mutex> l(one_sessions_lock);
+        one_sessions.push_back(std::move(session));
+    }
+
+public:
+
+    /*
+     * \brief Return the test representation for the given range of samples
+     * (STL or ETL containers), converted in a single pass into one batch.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     *
+     * \param first The beginning of the range of samples
+     * \param last The end of the range of samples
+     *
+     * \return The test representation of the LS layer, for each sample
+     */
+    template <size_t LS = layers - 1, typename Iterator>
+    auto forward_range(Iterator first, Iterator last) const {
+        auto batch = convert_batch(layer_get<0>(), first, last);
+        return test_forward_batch_impl<LS, 0>(batch);
     }
 
     // Forward a collection of samples at a time
@@ -1104,26 +2292,69 @@ public:
     // larger range of input. The rationale being that time should
     // be spent in forward_batch
 
+    /*
+     * \brief Forward a collection of inputs through the given layer.
+     *
+     * When the inputs are owned by the network (outputs of the previous
+     * layer) and have the type of the outputs, identity layers return them
+     * directly and element-wise layers overwrite them.
+     *
+     * \tparam Train Indicates if the train representation is computed
+     * \tparam Owned Indicates if the inputs can be overwritten
+     *
+     * \return The collection of outputs of the layer
+     */
+    template <bool Train, bool Owned, typename Layer, typename Inputs>
+    static auto forward_many_layer(Layer& layer, Inputs&& samples) {
+        using layer_t = std::decay_t<Layer>;
+        using next_t  = decltype(prepare_many_ready_output(layer, samples[0], samples.size()));
+
+        constexpr bool reuse = Owned && std::is_same<std::decay_t<Inputs>, next_t>::value;
+
+        if constexpr (reuse && is_identity_layer<layer_t>::value && !(Train && is_inplace_layer<layer_t>::value)) {
+            return next_t(std::move(samples));
+        } else if constexpr (reuse && is_inplace_layer<layer_t>::value) {
+            next_t next(std::move(samples));
+
+            if constexpr (Train) {
+                layer.train_forward_many(next, next);
+            } else {
+                layer.test_forward_many(next, next);
+            }
+
+            return next;
+        } else {
+            auto next = prepare_many_ready_output(layer, samples[0], samples.size());
+
+            if constexpr (Train) {
+                layer.train_forward_many(next, samples);
+            } else {
+                layer.test_forward_many(next, samples);
+            }
+
+            return next;
+        }
+    }
+
     /*
      * \brief Return the test representation for the given collection of inputs.
      *
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
+     * \tparam Owned Indicates if the inputs are owned by the network
      *
      * \param samples The collection of inputs to the layer L
      *
      * \return The test representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Inputs>
+    template <size_t LS, size_t L, bool Owned = false, typename Inputs>
     decltype(auto) test_forward_many_impl(Inputs&& samples) const {
         decltype(auto) layer = layer_get<L>();
 
-        auto next = prepare_many_ready_output(layer, samples[0], samples.size());
-
-        layer.test_forward_many(next, samples);
+        auto next = forward_many_layer<false, Owned>(layer, samples);
 
         if constexpr (L != LS) {
-            return test_forward_many_impl<LS, L + 1>(next);
+            return test_forward_many_impl<LS, L + 1, true>(next);
         } else {
             return next;
         }
@@ -1135,20 +2366,20 @@ public:
      * \tparam LS The layer from which the representation is extracted
      * \tparam L The layer to which the input is given
      *
+     * \tparam Owned Indicates if the inputs are owned by the network
+     *
      * \param samples The collection of inputs to the layer L
      *
      * \return The train representation of the LS layer forwarded from L
      */
-    template <size_t LS, size_t L, typename Inputs>
+    template <size_t LS, size_t L, bool Owned = false, typename Inputs>
     decltype(auto) train_forward_many_impl(Inputs&& samples) {
         decltype(auto) layer = layer_get<L>();
 
-        auto next = prepare_many_ready_output(layer, samples[0], samples.size());
-
-        layer.train_forward_many(next, samples);
+        auto next = forward_many_layer<true, Owned>(layer, samples);
 
         if constexpr (L != LS) {
-            return train_forward_many_impl<LS, L + 1>(next);
+            return train_forward_many_impl<LS, L + 1, true>(next);
         } else {
             return next;
         }
@@ -1227,7 +2458,7 @@ public:
         });
 
         if constexpr (L != LS) {
-            return test_forward_many_impl<LS, L + 1>(next);
+            return test_forward_many_impl<LS, L + 1, true>(next);
         } else {
             return next;
         }
@@ -1250,93 +2481,343 @@ public:
 
         auto n = std::distance(first, last);
 
-        auto next = prepare_many_ready_output(layer, *first, n);
+        auto next = prepare_many_ready_output(layer, *first, n);
+
+        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
+            layer.train_forward_one(next[i], sample);
+        });
+
+        if constexpr (L != LS) {
+            return train_forward_many_impl<LS, L + 1, true>(next);
+        } else {
+            return next;
+        }
+    }
+
+    /*
+     * \brief Return the test representation for the given collection of inputs.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param first Iterator to the first element of the collection of inputs
+     * \param last Iterator to the past-the-end element of the collection of inputs
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
+    decltype(auto) test_forward_many(const Iterator& first, const Iterator& last) const {
+        return test_forward_many_impl<LS, L>(first, last);
+    }
+
+    /*
+     * \brief Return the train representation for the given collection of inputs.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param first Iterator to the first element of the collection of inputs
+     * \param last Iterator to the past-the-end element of the collection of inputs
+     *
+     * \return The train representation of the LS layer forwarded from L
+     */
+    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
+    decltype(auto) train_forward_many(const Iterator& first, const Iterator& last) {
+        return train_forward_many_impl<LS, L>(first, last);
+    }
+
+    /*
+     * \brief Return the test representation for the given collection of inputs.
+     *
+     * \tparam LS The layer from which the representation is extracted
+     * \tparam L The layer to which the input is given
+     *
+     * \param first Iterator to the first element of the collection of inputs
+     * \param last Iterator to the past-the-end element of the collection of inputs
+     *
+     * \return The test representation of the LS layer forwarded from L
+     */
+    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
+    decltype(auto) forward_many(const Iterator& first, const Iterator& last) const {
+        return test_forward_many_impl<LS, L>(first, last);
+    }
+
+    /*!
+     * \brief Create a new inference session on this network.
+     *
+     * The session owns all the intermediate batches and can be used from
+     * any thread, concurrently with other sessions, as long as the network
+     * is not modified.
+     *
+     * \param max_batch The maximum number of samples forwarded at once
+     *
+     * \return A new inference session on this network.
+     */
+    inference_session<this_type> make_inference_session(size_t max_batch = batch_size) const {
+        return inference_session<this_type>(*this, max_batch);
+    }
+
+    /*!
+     * \brief Forward propagate a batch of samples asynchronously, in a task
+     * of the scheduler, with its own inference session.
+     *
+     * The operation can be waited for or awaited by a coroutine. The
+     * network must not be modified until the end of the operation.
+     *
+     * \param batch The batch of samples (copied)
+     * \param deadline The time after which the output is not wanted anymore
+     *
+     * \return The asynchronous operation
+     */
+    template <typename Input>
+    async_forward<this_type, Input> forward_async(const Input& batch, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) const {
+        return async_forward<this_type, Input>(*this, batch, deadline);
+    }
+
+    /*!
+     * \brief Save the features generated for the given sample in the given file.
+     * \param sample The sample to get features from
+     * \param file The output file
+     * \param f The format of the exported features
+     */
+    template<typename Input>
+    void save_features(const Input& sample, const std::string& file, format f = format::DLL) const {
+        decltype(auto) probs = features(sample);
+
+        if (f == format::DLL) {
+            export_features_dll(probs, file);
+        } else if (f == format::BINARY) {
+            export_features_binary(probs, file);
+        } else {
+            export_features_mmap(probs, file);
+        }
+    }
+
+    /*!
+     * \brief Export the features of all the samples of the given generator in
+     * the given file.
+     *
+     * The features are computed a batch at a time with forward_batch, while
+     * the features of the previous batch are written by a helper thread.
+     *
+     * \param generator The generator of samples
+     * \param file The output file
+     * \param f The format of the exported features
+     *
+     * \return true if all the features were exported, false otherwise
+     */
+    template <typename Generator>
+    bool export_features(Generator& generator, const std::string& file, format f = format::BINARY) const {
+        dll::auto_timer timer("net:export_features");
+
+        generator.reset();
+        generator.set_test();
+
+        if (!generator.has_next_batch()) {
+            std::cerr << "ERROR: No samples to export to " << file << std::endl;
+            return false;
+        }
+
+        // Need one output in order to know the dimensions of the features
+
+        std::vector<size_t> dims;
+        size_t n_classes = 0;
+
+        {
+            decltype(auto) output = forward_batch(generator.data_batch());
+
+            for (size_t d = 1; d < etl::dimensions(output); ++d) {
+                dims.push_back(etl::dim(output, d));
+            }
+
+            decltype(auto) label_batch = generator.label_batch();
+
+            if (etl::dimensions(label_batch) == 2) {
+                n_classes = etl::dim(label_batch, 1);
+            }
+        }
+
+        feature_exporter exporter;
+
+        if (!exporter.open(file, f, generator.size(), dims, n_classes)) {
+            return false;
+        }
+
+        // The features of a batch are written while the next one is computed
+
+        std::vector<weight> values[2];
+        std::vector<uint32_t> labels[2];
+
+        std::thread writer;
+        size_t current = 0;
+
+        while (generator.has_next_batch()) {
+            auto input_batch = generator.data_batch();
+            auto label_batch = generator.label_batch();
+
+            const size_t n = etl::dim<0>(input_batch);
+
+            decltype(auto) output = forward_batch(input_batch);
+
+            auto& v = values[current];
+            auto& l = labels[current];
+
+            v.resize(etl::size(output));
+            l.resize(n);
+
+            for (size_t i = 0; i < v.size(); ++i) {
+                v[i] = output[i];
+            }
+
+            for (size_t b = 0; b < n; ++b) {
+                if constexpr (etl::decay_traits<decltype(label_batch)>::dimensions() == 2) {
+                    l[b] = etl::max_index(label_batch(b));
+                } else {
+                    l[b] = label_batch[b];
+                }
+            }
+
+            if (writer.joinable()) {
+                writer.join();
+            }
+
+            writer = std::thread([&exporter, &v, &l, n] {
+                exporter.write(v.data(), l.data(), n);
+            });
+
+            current = 1 - current;
+
+            generator.next_batch();
+        }
+
+        if (writer.joinable()) {
+            writer.join();
+        }
+
+        return exporter.close();
+    }
 
-        cpp::foreach_i(first, last, [&](auto& sample, size_t i) {
-            layer.train_forward_one(next[i], sample);
-        });
+    template <typename Output>
+    size_t predict_label(const Output& result) const {
+        return std::distance(result.begin(), std::max_element(result.begin(), result.end()));
+    }
 
-        if constexpr (L != LS) {
-            return train_forward_many_impl<LS, L + 1>(next);
-        } else {
-            return next;
-        }
+    template <typename Input>
+    size_t predict(const Input& item) const {
+        auto result = forward_one(item);
+        return predict_label(result);
     }
 
-    /*
-     * \brief Return the test representation for the given collection of inputs.
+    /*!
+     * \brief Returns the k best classes of each sample of the given batch,
+     * in decreasing order of probability.
      *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
+     * The order of the outputs of a softmax is the order of its logits, so
+     * only the k best outputs of each sample are selected and sorted.
      *
-     * \param first Iterator to the first element of the collection of inputs
-     * \param last Iterator to the past-the-end element of the collection of inputs
+     * \param batch The batch of samples
+     * \param k The number of classes to return for each sample
      *
-     * \return The test representation of the LS layer forwarded from L
+     * \return The k best classes of each sample
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
-    decltype(auto) test_forward_many(const Iterator& first, const Iterator& last) const {
-        return test_forward_many_impl<LS, L>(first, last);
+    template <typename Input>
+    std::vector<std::vector<size_t>> predict_topk(const Input& batch, size_t k) const {
+        auto output = etl::force_temporary(forward_batch(batch));
+
+        const size_t n       = etl::dim<0>(output);
+        const size_t classes = etl::size(output) / n;
+
+        std::vector<std::vector<size_t>> predictions(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            select_topk(output.memory_start() + i * classes, classes, k, predictions[i]);
+        }
+
+        return predictions;
     }
 
-    /*
-     * \brief Return the train representation for the given collection of inputs.
-     *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
+    /*!
+     * \brief Train a classifier head after the layer L, from which the
+     * samples can exit with predict_early_exit().
      *
-     * \param first Iterator to the first element of the collection of inputs
-     * \param last Iterator to the past-the-end element of the collection of inputs
+     * The layers of the network are not modified, the head is a softmax
+     * classifier trained on the features of the layer L of the given
+     * samples. A head already attached to the layer L is replaced.
      *
-     * \return The train representation of the LS layer forwarded from L
+     * \tparam L The layer after which the head is attached
+     * \param samples The container containing the samples
+     * \param labels The container containing the labels
+     * \param classes The number of classes
+     * \param threshold The confidence above which the samples exit at this head
+     * \param epochs The number of epochs to train the head
+     * \param rate The learning rate of the head
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
-    decltype(auto) train_forward_many(const Iterator& first, const Iterator& last) {
-        return train_forward_many_impl<LS, L>(first, last);
+    template <size_t L, typename Samples, typename Labels>
+    void fit_exit_head(const Samples& samples, const Labels& labels, size_t classes, weight threshold, size_t epochs = 100, weight rate = 0.1) {
+        static_assert(L < layers - 1, "The exit heads must be before the last layer");
+
+        const size_t n = samples.size();
+        const size_t s = dll::output_size(layer_get<L>());
+
+        etl::dyn_matrix<weight, 2> x(n, s);
+
+        auto generator = make_generator(samples, labels, n, classes, categorical_generator_t{});
+
+        generator->set_safe();
+        generator->set_test();
+
+        size_t done = 0;
+
+        while (generator->has_next_batch()) {
+            auto features = etl::force_temporary(forward_batch<L>(generator->data_batch()));
+
+            std::copy_n(features.memory_start(), etl::size(features), x.memory_start() + done * s);
+
+            done += etl::dim<0>(features);
+
+            generator->next_batch();
+        }
+
+        exit_head<weight> head(L, s, classes, threshold);
+
+        head.fit(x, labels, epochs, rate);
+
+        auto it = std::find_if(exit_heads.begin(), exit_heads.end(), [](auto& h) { return h.layer >= L; });
+
+        if (it != exit_heads.end() && it->layer == L) {
+            *it = std::move(head);
+        } else {
+            exit_heads.insert(it, std::move(head));
+        }
     }
 
-    /*
-     * \brief Return the test representation for the given collection of inputs.
+    /*!
+     * \brief Predict the class of each sample of the given batch, letting
+     * the confident samples exit at the intermediate heads.
      *
-     * \tparam LS The layer from which the representation is extracted
-     * \tparam L The layer to which the input is given
+     * After each layer with a head, the samples classified by the head with
+     * a confidence of at least its threshold are given its class and the
+     * other samples are compacted into a smaller batch for the next layer.
+     * Without heads, this is the same as predict() on each sample.
      *
-     * \param first Iterator to the first element of the collection of inputs
-     * \param last Iterator to the past-the-end element of the collection of inputs
+     * \param batch The batch of samples
      *
-     * \return The test representation of the LS layer forwarded from L
+     * \return The predicted class of each sample
      */
-    template <size_t LS = layers - 1, size_t L = 0, typename Iterator>
-    decltype(auto) forward_many(const Iterator& first, const Iterator& last) const {
-        return test_forward_many_impl<LS, L>(first, last);
-    }
+    template <typename Input>
+    std::vector<size_t> predict_early_exit(const Input& batch) const {
+        const size_t n = etl::dim<0>(batch);
 
-    /*!
-     * \brief Save the features generated for the given sample in the given file.
-     * \param sample The sample to get features from
-     * \param file The output file
-     * \param f The format of the exported features
-     */
-    template<typename Input>
-    void save_features(const Input& sample, const std::string& file, format f = format::DLL) const {
-        cpp_assert(f == format::DLL, "Only DLL format is supported for now");
+        std::vector<size_t> ids(n);
+        std::vector<size_t> predictions(n);
 
-        decltype(auto) probs = features(sample);
+        std::iota(ids.begin(), ids.end(), 0);
 
-        if (f == format::DLL) {
-            export_features_dll(probs, file);
+        if (n) {
+            early_exit_forward<0>(batch, ids, predictions);
         }
-    }
-
-    template <typename Output>
-    size_t predict_label(const Output& result) const {
-        return std::distance(result.begin(), std::max_element(result.begin(), result.end()));
-    }
 
-    template <typename Input>
-    size_t predict(const Input& item) const {
-        auto result = forward_one(item);
-        return predict_label(result);
+        return predictions;
     }
 
     /*!
@@ -1368,6 +2849,41 @@ public:
         return trainer.train(*this, generator, max_epochs);
     }
 
+    /*!
+     * \brief Fine tune the network online, on a never-ending generator
+     * (see stream_generator and dbn_trainer::train_stream).
+     *
+     * \param generator The generator of the stream
+     * \param steps The maximum number of steps (0 until the end of the stream)
+     * \param publish_steps The number of steps between two publications (0 for none)
+     * \param publish The functor publishing the network, called with (network, step)
+     *
+     * \return The running average of the errors of the batches
+     */
+    template <typename Generator, typename Publisher>
+    weight fine_tune_stream(Generator& generator, size_t steps, size_t publish_steps, Publisher&& publish) {
+        dll::auto_timer timer("net:train:ft:stream");
+
+        validate_generator(generator);
+
+        dll::dbn_trainer<this_type> trainer;
+        return trainer.train_stream(*this, generator, steps, publish_steps, std::forward<Publisher>(publish));
+    }
+
+    /*!
+     * \brief Fine tune the network online, on a never-ending generator,
+     * without publishing it.
+     *
+     * \param generator The generator of the stream
+     * \param steps The maximum number of steps (0 until the end of the stream)
+     *
+     * \return The running average of the errors of the batches
+     */
+    template <typename Generator>
+    weight fine_tune_stream(Generator& generator, size_t steps) {
+        return fine_tune_stream(generator, steps, 0, [](const this_type& /*dbn*/, size_t /*step*/) {});
+    }
+
     /*!
      * \brief Fine tune the network for classifcation with a generator.
      *
@@ -1398,13 +2914,9 @@ public:
     template <typename Input, typename Labels>
     weight fine_tune(const Input& training_data, Labels& labels, size_t max_epochs) {
         // Create generator around the containers
-        auto generator = dll::make_generator(
-            training_data, labels,
-            training_data.size(), output_size(), categorical_generator_t{});
-
-        generator->set_safe();
-
-        return fine_tune(*generator, max_epochs);
+        return train_containers<categorical_inmemory_t, categorical_outmemory_t>(training_data, labels, [&](auto& generator) {
+            return fine_tune(generator, max_epochs);
+        });
     }
 
     /*!
@@ -1458,13 +2970,9 @@ public:
     template <typename Samples, cpp_disable_iff(is_generator<Samples>)>
     weight fine_tune_ae(const Samples& training_data, size_t max_epochs) {
         // Create generator around the containers
-        auto generator = dll::make_generator(
-            training_data, training_data,
-            training_data.size(), output_size(), ae_generator_t{});
-
-        generator->set_safe();
-
-        return fine_tune_ae(*generator, max_epochs);
+        return train_containers<ae_inmemory_t, ae_outmemory_t>(training_data, training_data, [&](auto& generator) {
+            return fine_tune_ae(generator, max_epochs);
+        });
     }
 
     /*!
@@ -1517,15 +3025,51 @@ public:
         // Create generator around the containers
         cpp_assert(inputs.size() == outputs.size(), "The number of inputs does not match the number of outputs for training.");
 
-        auto generator = dll::make_generator(
-            inputs, outputs,
-            inputs.size(), output_size(), reg_generator_t{});
+        return train_containers<reg_inmemory_t, reg_outmemory_t>(inputs, outputs, [&](auto& generator) {
+            return fine_tune_reg(generator, max_epochs);
+        });
+    }
+
+private:
+    /*!
+     * \brief Train the network on generators created around the given
+     * containers.
+     *
+     * With a memory budget, the dataset is only kept in memory if it fits
+     * in the memory left by the training, it is streamed from the containers
+     * otherwise. Without a budget, the generator follows the batch mode.
+     *
+     * \param inputs The container of the inputs
+     * \param outputs The container of the outputs (labels)
+     * \param train The training functor, called with the generator
+     */
+    template <typename InDesc, typename OutDesc, typename Inputs, typename Outputs, typename Train>
+    decltype(auto) train_containers(const Inputs& inputs, const Outputs& outputs, Train&& train) {
+        using generator_desc = std::conditional_t<!dbn_traits<this_type>::batch_mode(), InDesc, OutDesc>;
+
+        if constexpr (dbn_traits<this_type>::has_memory_budget() && !dbn_traits<this_type>::batch_mode()) {
+            auto plan = plan_memory(inputs.size() * (input_size() + output_size()) * sizeof(weight));
+
+            if (plan.streaming()) {
+                out << "Stream the dataset (" << memory_str(plan.dataset) << ") over the memory budget (" << memory_str(plan.budget) << ")" << std::endl;
+
+                auto generator = dll::make_generator(inputs, outputs, inputs.size(), output_size(), OutDesc{});
+
+                generator->set_safe();
+
+                return train(*generator);
+            }
+        }
+
+        auto generator = dll::make_generator(inputs, outputs, inputs.size(), output_size(), generator_desc{});
 
         generator->set_safe();
 
-        return fine_tune_reg(*generator, max_epochs);
+        return train(*generator);
     }
 
+public:
+
     /*!
      * \brief Fine tune the network for regression.
      * \param in_first Iterator to the first sample
@@ -1592,6 +3136,20 @@ public:
         out << buffer;
         snprintf(buffer, 512, "evaluation took %dms \n", int(watch.elapsed()));
         out << buffer;
+
+        // Report the accuracy delta of the quantization
+        if (is_quantized()) {
+            set_quantized(false);
+
+            auto float_metrics = evaluate_metrics(generator);
+
+            set_quantized(true);
+
+            snprintf(buffer, 512, "   float error: %.5f (INT8 delta: %+.5f) \n", std::get<0>(float_metrics), std::get<0>(metrics) - std::get<0>(float_metrics));
+            out << buffer;
+            snprintf(buffer, 512, "    float loss: %.5f (INT8 delta: %+.5f) \n", std::get<1>(float_metrics), std::get<1>(metrics) - std::get<1>(float_metrics));
+            out << buffer;
+        }
     }
 
     /*!
@@ -1897,15 +3455,81 @@ public:
 
     using metrics_t = std::tuple<double, double>; ///< The metrics returned by evaluate_metrics
 
+    /*!
+     * \brief Indicates if the metrics of the given outputs and (dense) labels
+     * are computed by the single pass kernels
+     */
+    template <typename Output, typename Labels>
+    static constexpr bool fused_metrics = etl::is_dma<std::decay_t<Output>> && etl::is_dma<std::decay_t<Labels>> && etl::dimensions<std::decay_t<Labels>>() > 1;
+
+    /*!
+     * \brief Add the (not normalized) error and loss of the n first samples of
+     * the given output batch to the accumulator
+     *
+     * \param acc The accumulator
+     * \param output The output of the network
+     * \param labels The expected labels
+     * \param n The size of the batch
+     */
+    template <typename Output, typename Labels>
+    void accumulate_metrics(metrics_accumulator& acc, Output&& output, Labels&& labels, size_t n) {
+        if constexpr (fused_metrics<Output, Labels>) {
+            dll::auto_timer timer("net:compute_loss:fused");
+
+            output.ensure_cpu_up_to_date();
+            labels.ensure_cpu_up_to_date();
+
+            const size_t m = etl::size(output) / etl::dim<0>(output);
+
+            cpp_assert(etl::size(labels) >= n * m, "Invalid sizes");
+
+            if constexpr (loss == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+                cce_metrics(acc, output.memory_start(), labels.memory_start(), n, m);
+            } else if constexpr (loss == loss_function::BINARY_CROSS_ENTROPY) {
+                bce_metrics(acc, output.memory_start(), labels.memory_start(), n, m);
+            } else { // MEAN_SQUARED_ERROR
+                mse_metrics(acc, output.memory_start(), labels.memory_start(), n, m);
+            }
+        } else {
+            auto [batch_error, batch_loss] = compute_loss(n, n == etl::dim<0>(output), 1.0, output, labels);
+
+            acc.error += batch_error;
+            acc.loss += batch_loss;
+        }
+    }
+
     template <typename Output, typename Labels>
     std::tuple<double, double> compute_loss(size_t n, bool full_batch, double s, Output&& output, Labels&& labels) {
         double batch_loss;
         double batch_error;
 
-        if constexpr (loss == loss_function::CATEGORICAL_CROSS_ENTROPY) {
+        if constexpr (fused_metrics<Output, Labels>) {
+            cpp_unused(full_batch);
+
+            metrics_accumulator acc;
+
+            accumulate_metrics(acc, output, labels, n);
+
+            batch_error = acc.error / s;
+            batch_loss  = acc.loss / s;
+        } else if constexpr (loss == loss_function::CATEGORICAL_CROSS_ENTROPY) {
             dll::auto_timer timer("net:compute_loss:CCE");
 
-            if (cpp_unlikely(!full_batch)) {
+            if constexpr (etl::dimensions<std::decay_t<Labels>>() == 1) {
+                // Sparse labels (the index of the class of each sample)
+                double log_sum = 0.0;
+                size_t errors  = 0;
+
+                for (size_t i = 0; i < n; ++i) {
+                    const size_t label = labels[i];
+
+                    log_sum += std::log(output(i, label));
+                    errors += etl::max_index(output(i)) != label;
+                }
+
+                batch_loss  = -log_sum / s;
+                batch_error = errors / s;
+            } else if (cpp_unlikely(!full_batch)) {
                 auto soutput = slice(output, 0, n);
 
                 batch_loss  = etl::ml::cce_loss(soutput, labels, -1.0 / s);
@@ -1984,13 +3608,152 @@ public:
     metrics_t evaluate_metrics(Generator& generator){
         validate_generator(generator);
 
-        auto forward_helper = [this](auto&& input_batch){
-            return this->forward_batch(input_batch);
-        };
+        // The time steps of the batches are set on the layers themselves
+        if (kernel_threads() > 1 && !has_batch_steps<Generator>::value && !has_batch_lengths<Generator>::value) {
+            return evaluate_metrics_parallel(generator);
+        }
+
+        auto forward_helper = [this](auto&& input_batch){
+            return this->forward_batch(input_batch);
+        };
+
+        return evaluate_metrics(generator, forward_helper);
+    }
+
+    /*!
+     * \brief Evaluate the network on the given classification task, with
+     * the batches split between the threads, and return the evaluation
+     * metrics.
+     *
+     * \param generator The data generator
+     *
+     * \return The evaluation metrics
+     */
+    template <typename Generator>
+    metrics_t evaluate_metrics_parallel(Generator& generator) {
+        validate_generator(generator);
+
+        dll::auto_timer timer("net:evaluate:parallel");
+
+        std::vector<metrics_accumulator> accumulators(kernel_threads());
+
+        accumulate_parallel(generator, accumulators, [this](auto& acc, auto&& output, auto& labels, size_t n) {
+            this->accumulate_metrics(acc, output, labels, n);
+        });
+
+        for (size_t t = 1; t < accumulators.size(); ++t) {
+            accumulators[0].merge(accumulators[t]);
+        }
+
+        return std::make_tuple(accumulators[0].error / generator.size(), accumulators[0].loss / generator.size());
+    }
+
+    /*!
+     * \brief Evaluate the network on the given classification task and
+     * return its confusion matrix and its top-k accuracy.
+     *
+     * The batches are split between the threads, each thread accumulating
+     * the metrics of its batches, directly from the output of its inference
+     * session.
+     *
+     * \param generator The data generator
+     * \param k The number of best classes of the top-k accuracy
+     *
+     * \return The classification metrics
+     */
+    template <typename Generator>
+    classification_accumulator evaluate_classification(Generator& generator, size_t k = 5) {
+        validate_generator(generator);
+
+        dll::auto_timer timer("net:evaluate:classification");
+
+        std::vector<classification_accumulator> accumulators(std::max<size_t>(1, kernel_threads()), classification_accumulator(output_size(), k));
+
+        accumulate_parallel(generator, accumulators, [](auto& acc, auto&& output, auto& labels, size_t n) {
+            constexpr bool sparse = etl::dimensions<std::decay_t<decltype(labels)>>() == 1;
+
+            labels.ensure_cpu_up_to_date();
+
+            if constexpr (etl::is_dma<std::decay_t<decltype(output)>>) {
+                output.ensure_cpu_up_to_date();
+
+                acc.add(output.memory_start(), labels.memory_start(), n, sparse);
+            } else {
+                auto features = etl::force_temporary(output);
+
+                acc.add(features.memory_start(), labels.memory_start(), n, sparse);
+            }
+        });
+
+        for (size_t t = 1; t < accumulators.size(); ++t) {
+            accumulators[0].merge(accumulators[t]);
+        }
+
+        return accumulators[0];
+    }
+
+private:
+    /*!
+     * \brief Forward propagate all the batches of the generator, split
+     * between the threads, and accumulate their metrics.
+     *
+     * The batches are read from the generator one wave at a time (one batch
+     * per thread), each thread forward propagating its batch through its
+     * own inference session and updating its own accumulator with
+     * f(accumulator, output, labels, n). The tth batch of each wave is
+     * always given to the tth thread, the accumulators are therefore the
+     * same from run to run.
+     *
+     * \param generator The data generator
+     * \param accumulators The accumulators, one per thread
+     * \param f The functor updating an accumulator with a batch
+     */
+    template <typename Generator, typename Accumulator, typename F>
+    void accumulate_parallel(Generator& generator, std::vector<Accumulator>& accumulators, F&& f) {
+        // Starts a new
+        generator.reset();
+
+        // Set the generator in test mode
+        generator.set_test();
+
+        const size_t threads = accumulators.size();
+
+        using inputs_t = std::decay_t<decltype(etl::force_temporary(generator.data_batch()))>;
+        using labels_t = std::decay_t<decltype(etl::force_temporary(generator.label_batch()))>;
+
+        std::vector<inference_session<this_type>> sessions;
+        std::vector<inputs_t> inputs;
+        std::vector<labels_t> labels;
+
+        sessions.reserve(threads);
+        inputs.reserve(threads);
+        labels.reserve(threads);
+
+        for (size_t t = 0; t < threads; ++t) {
+            sessions.emplace_back(*this, batch_size);
+        }
+
+        while (generator.has_next_batch()) {
+            inputs.clear();
+            labels.clear();
+
+            // The generator itself is not thread-safe
+            while (inputs.size() < threads && generator.has_next_batch()) {
+                inputs.push_back(etl::force_temporary(generator.data_batch()));
+                labels.push_back(etl::force_temporary(generator.label_batch()));
+
+                generator.next_batch();
+            }
+
+            dll::parallel_for(inputs.size(), [&](size_t t) {
+                decltype(auto) output = sessions[t].forward_batch(inputs[t]);
 
-        return evaluate_metrics(generator, forward_helper);
+                f(accumulators[t], output, labels[t], etl::dim<0>(inputs[t]));
+            });
+        }
     }
 
+public:
     /*!
      * \brief Evaluate the network on the given classification task
      * and return the evaluation metrics.
@@ -2010,27 +3773,24 @@ public:
         // Set the generator in test mode
         generator.set_test();
 
-        double error = 0.0;
-        double loss  = 0.0;
+        metrics_accumulator acc;
 
         while(generator.has_next_batch()){
             auto input_batch = generator.data_batch();
             auto label_batch = generator.label_batch();
 
-            decltype(auto) output = helper(input_batch);
+            set_batch_steps(generator);
 
-            auto [batch_error, batch_loss] = evaluate_metrics_batch(output, label_batch, etl::dim<0>(input_batch), false);
+            decltype(auto) output = helper(input_batch);
 
-            error += batch_error;
-            loss += batch_loss;
+            accumulate_metrics(acc, output, label_batch, etl::dim<0>(input_batch));
 
             generator.next_batch();
         }
 
-        error /= generator.size();
-        loss /= generator.size();
+        reset_batch_steps(generator);
 
-        return std::make_tuple(error, loss);
+        return std::make_tuple(acc.error / generator.size(), acc.loss / generator.size());
     }
 
 public:
@@ -2059,6 +3819,122 @@ public:
         return result;
     }
 
+    /*!
+     * \brief Compute the concatenated outputs of all the layers for a batch
+     * of samples, in a single pass through the network.
+     *
+     * Each layer forwards the whole batch and its output is copied once into
+     * its columns of the result.
+     *
+     * \param input The batch of samples
+     * \param result The concatenated outputs (batch x full_output_size())
+     */
+    template <typename Input, typename Result>
+    void full_activation_probabilities_batch(const Input& input, Result&& result) const {
+        result.ensure_cpu_up_to_date();
+
+        full_activation_probabilities_batch<0>(input, result, 0);
+
+        result.invalidate_gpu();
+    }
+
+private:
+    template <size_t I, typename Input, typename Result>
+    void full_activation_probabilities_batch(const Input& input, Result& result, size_t offset) const {
+        auto output = layer_get<I>().test_forward_batch(input);
+
+        output.ensure_cpu_up_to_date();
+
+        const size_t n     = etl::dim<0>(output);
+        const size_t size  = etl::size(output) / n;
+        const size_t width = etl::dim<1>(result);
+
+        const weight* out = output.memory_start();
+        weight* features  = result.memory_start();
+
+        parallel_range(n, n * size, [=](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                std::copy_n(out + i * size, size, features + i * width + offset);
+            }
+        });
+
+        if constexpr (I + 1 < layers) {
+            full_activation_probabilities_batch<I + 1>(output, result, offset + size);
+        }
+    }
+
+public:
+    /*!
+     * \brief Set the number of time steps computed by the recurrent layers
+     * for the next batches, the following steps being padding.
+     *
+     * \param steps The number of time steps (0 for all the time steps)
+     */
+    void set_active_steps(size_t steps) {
+        for_each_layer([steps](auto& layer) {
+            if constexpr (has_active_steps<std::decay_t<decltype(layer)>>::value) {
+                layer.active_steps = steps;
+            } else {
+                cpp_unused(layer);
+            }
+        });
+    }
+
+    /*!
+     * \brief Set the length of each sequence of the next batches, the
+     * recurrent layers only computing the time steps of the running
+     * sequences.
+     *
+     * \param lengths The length of each sequence, by decreasing length (empty for all the time steps)
+     */
+    void set_sample_steps(const std::vector<size_t>& lengths) {
+        cpp_assert(std::is_sorted(lengths.rbegin(), lengths.rend()), "The sequences must be sorted by decreasing length");
+
+        for_each_layer([&lengths](auto& layer) {
+            if constexpr (has_sample_steps<std::decay_t<decltype(layer)>>::value) {
+                layer.sample_steps = lengths;
+            } else {
+                cpp_unused(layer);
+            }
+        });
+    }
+
+    /*!
+     * \brief Set the time steps of the next batch of the given generator
+     * on the recurrent layers.
+     *
+     * The data-parallel replicas train parts of the batch through the same
+     * layers, the lengths of the sequences are therefore only used with a
+     * single worker.
+     */
+    template <typename Generator>
+    void set_batch_steps(const Generator& generator) {
+        if constexpr (has_batch_lengths<Generator>::value && dbn_traits<this_type>::data_parallel_workers() == 1) {
+            set_sample_steps(generator.batch_lengths());
+        }
+
+        if constexpr (has_batch_steps<Generator>::value) {
+            set_active_steps(generator.batch_steps());
+        } else {
+            cpp_unused(generator);
+        }
+    }
+
+    /*!
+     * \brief Reset the time steps of the recurrent layers after the batches
+     * of the given generator
+     */
+    template <typename Generator>
+    void reset_batch_steps(const Generator& /*generator*/) {
+        if constexpr (has_batch_lengths<Generator>::value && dbn_traits<this_type>::data_parallel_workers() == 1) {
+            set_sample_steps({});
+        }
+
+        if constexpr (has_batch_steps<Generator>::value) {
+            set_active_steps(0);
+        }
+    }
+
     template <typename Functor>
     void for_each_layer(Functor&& functor) {
         for_each_impl_t(*this).for_each_layer(std::forward<Functor>(functor));
@@ -2183,47 +4059,44 @@ public:
         return true;
     }
 
+    /*!
+     * \brief Search the best C and gamma of the RBF SVM on the features of
+     * the given samples, with cross-validation (see svm_parallel_grid_search).
+     */
     template <typename Samples, typename Labels>
     bool svm_grid_search(const Samples& training_data, const Labels& labels, size_t n_fold = 5, const svm::rbf_grid& g = svm::rbf_grid()) {
-        make_problem(training_data, labels, dbn_traits<this_type>::scale());
-
-        //Make libsvm quiet
-        svm::make_quiet();
-
-        auto parameters = default_svm_parameters();
-
-        //Make sure parameters are not messed up
-        if (!svm::check(problem, parameters)) {
-            return false;
-        }
-
-        //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
-
-        return true;
+        return svm_grid_search(std::begin(training_data), std::end(training_data), std::begin(labels), std::end(labels), n_fold, g);
     }
 
+    /*!
+     * \brief Search the best C and gamma of the RBF SVM on the features of
+     * the given samples, with cross-validation (see svm_parallel_grid_search).
+     */
     template <typename It, typename LIt>
     bool svm_grid_search(It&& first, It&& last, LIt&& lfirst, LIt&& llast, size_t n_fold = 5, const svm::rbf_grid& g = svm::rbf_grid()) {
-        make_problem(
-            std::forward<It>(first), std::forward<It>(last),
-            std::forward<LIt>(lfirst), std::forward<LIt>(llast),
-            dbn_traits<this_type>::scale());
+        auto features = svm_features(first, last);
 
-        //Make libsvm quiet
-        svm::make_quiet();
+        if constexpr (dbn_traits<this_type>::scale()) {
+            svm_detail::scale_features(features);
+        }
 
-        auto parameters = default_svm_parameters();
+        std::vector<double> labels;
 
-        //Make sure parameters are not messed up
-        if (!svm::check(problem, parameters)) {
+        for (auto it = lfirst; it != llast; ++it) {
+            labels.push_back(*it);
+        }
+
+        if (labels.size() != etl::dim<0>(features)) {
+            std::cerr << "ERROR: The number of labels does not match the number of samples" << std::endl;
             return false;
         }
 
-        //Perform a grid-search
-        svm::rbf_grid_search(problem, parameters, n_fold, g);
+        //Make libsvm quiet
+        svm::make_quiet();
+
+        auto result = svm_parallel_grid_search(features, labels, n_fold, g, default_svm_parameters());
 
-        return true;
+        return result.accuracy > 0.0;
     }
 
     template <typename Input>
@@ -2232,9 +4105,196 @@ public:
         return svm::predict(svm_model, features);
     }
 
+    /*!
+     * \brief Predict the labels of the given samples with the SVM.
+     *
+     * The features of the samples are computed a batch at a time with
+     * forward_batch.
+     *
+     * \param samples The container of samples
+     * \return The predicted label of each sample
+     */
+    template <typename Samples>
+    std::vector<double> svm_predict_batch(const Samples& samples) {
+        std::vector<double> predictions;
+        predictions.reserve(samples.size());
+
+        if constexpr (dbn_traits<this_type>::concatenate()) {
+            // The features of all the layers are not available in batch
+            for (auto& sample : samples) {
+                predictions.push_back(svm_predict(sample));
+            }
+        } else {
+            // The labels are not used
+            std::vector<size_t> labels(samples.size(), 0);
+
+            auto generator = make_generator(samples, labels, samples.size(), output_size(), categorical_generator_t{});
+
+            generator->set_safe();
+            generator->set_test();
+
+            etl::dyn_vector<weight> features(output_size());
+
+            while (generator->has_next_batch()) {
+                auto input_batch = generator->data_batch();
+
+                decltype(auto) output = forward_batch(input_batch);
+
+                for (size_t b = 0; b < etl::dim<0>(input_batch); ++b) {
+                    auto sample_output = output(b);
+
+                    for (size_t j = 0; j < etl::size(features); ++j) {
+                        features[j] = sample_output[j];
+                    }
+
+                    predictions.push_back(svm::predict(svm_model, features));
+                }
+
+                generator->next_batch();
+            }
+        }
+
+        return predictions;
+    }
+
 #endif //DLL_SVM_SUPPORT
 
 private:
+    /*!
+     * \brief Store the weights of the given layer, in the storage precision
+     * of the network
+     */
+    template <typename Layer>
+    static void store_layer(std::ostream& os, const Layer& layer) {
+        if constexpr (dbn_traits<this_type>::is_bf16_storage()) {
+            std::ostringstream buffer;
+            layer.store(buffer);
+            binary_write_bf16<weight>(os, buffer.str());
+        } else {
+            layer.store(os);
+        }
+    }
+
+    /*!
+     * \brief Load the weights of the given layer, in the storage precision
+     * of the network
+     */
+    template <typename Layer>
+    static void load_layer(std::istream& is, Layer& layer) {
+        if constexpr (dbn_traits<this_type>::is_bf16_storage()) {
+            // The size of the layer is given by its full precision serialization
+            std::ostringstream full;
+            layer.store(full);
+
+            std::istringstream buffer(binary_load_bf16<weight>(is, full.str().size() / sizeof(weight)));
+            layer.load(buffer);
+        } else {
+            layer.load(is);
+        }
+    }
+
+    /*!
+     * \brief Add the tensors of the layers (and of the SVM) to the given
+     * model file
+     */
+    void add_model_tensors(model_file_writer& writer) const {
+        for_each_layer([&writer](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                std::ostringstream os;
+                store_layer(os, layer);
+                writer.add(os.str(), layer.to_short_string());
+            }
+
+            // The quantized table follows the tensor of its layer
+            if constexpr (is_quantizable_embedding<std::decay_t<decltype(layer)>>::value) {
+                if (layer.quantized_table) {
+                    writer.add(layer.quantized_table->serialize(), "Quantized " + layer.to_short_string());
+                }
+            }
+        });
+
+#ifdef DLL_SVM_SUPPORT
+        std::ostringstream os;
+        svm_store(*this, os);
+        writer.add(os.str(), "SVM");
+#endif //DLL_SVM_SUPPORT
+    }
+
+    /*!
+     * \brief Load the layers (and the SVM) from the tensors of the given
+     * model file
+     *
+     * \param model The memory-mapped model file
+     * \param i The index of the next tensor, updated
+     * \return true if the tensors match the network, false otherwise
+     */
+    bool load_model_tensors(const mapped_model_file& model, size_t& i) {
+        if (!model.valid()) {
+            return false;
+        }
+
+        ++model_version;
+
+        bool valid = model.header.weight_size == sizeof(weight);
+
+        for_each_layer([&](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                if (!valid || i >= model.size() || !model.check(i, layer.to_short_string())) {
+                    valid = false;
+                    return;
+                }
+
+                memory_streambuf buffer(model.data(i), model.entry(i).size);
+                std::istream is(&buffer);
+
+                load_layer(is, layer);
+
+                valid = is && buffer.consumed() == model.entry(i).size;
+
+                ++i;
+            }
+
+            if constexpr (is_quantizable_embedding<std::decay_t<decltype(layer)>>::value) {
+                layer.quantized_table.reset();
+
+                if (valid && i < model.size() && model.check(i, "Quantized " + layer.to_short_string())) {
+                    layer.quantized_table = std::make_unique<quantized_embedding_table>();
+
+                    valid = layer.quantized_table->deserialize(model.data(i), model.entry(i).size);
+
+                    ++i;
+                }
+            }
+        });
+
+#ifdef DLL_SVM_SUPPORT
+        if (valid && i < model.size() && model.check(i, "SVM")) {
+            memory_streambuf buffer(model.data(i), model.entry(i).size);
+            std::istream is(&buffer);
+
+            svm_load(*this, is);
+
+            ++i;
+        }
+#endif //DLL_SVM_SUPPORT
+
+        return valid;
+    }
+
+    /*!
+     * \brief Record the range of the input of each layer for the given batch
+     * and forward it to the next layer
+     */
+    template <size_t I, typename Input>
+    void calibrate_impl(const Input& input, std::array<float, layers>& ranges) const {
+        if constexpr (I < layers) {
+            ranges[I] = std::max(ranges[I], float(etl::max(etl::abs(input))));
+
+            decltype(auto) next = layer_get<I>().test_forward_batch(input);
+            calibrate_impl<I + 1>(next, ranges);
+        }
+    }
+
     //By default all layer are trained
     template <size_t I, typename Enable = void>
     struct train_next : std::true_type {};
@@ -2321,6 +4381,26 @@ private:
                 generator.reset();
                 generator.set_test();
 
+                if constexpr (desc::FeatureStore > 0 || dbn_traits<this_type>::has_memory_budget()) {
+                    // With a memory budget, the features are only spilled to
+                    // disk when they do not fit in memory
+                    if (desc::FeatureStore > 0 || !fits_features(layer, generator)) {
+                        auto next_generator = store_features(layer, generator);
+
+                        if (!next_generator) {
+                            return;
+                        }
+
+                        // Release the memory if possible
+                        generator.clear();
+
+                        //Pass the output to the next layer
+                        this->template pretrain_layer<I + 1>(*next_generator, watcher, max_epochs);
+
+                        return;
+                    }
+                }
+
                 // Need one output in order to create the generator
                 auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
 
@@ -2335,25 +4415,149 @@ private:
                 // Compute the input of the next layer
                 // using batch activation
 
-                size_t i = 0;
-                while (generator.has_next_batch()) {
-                    auto next_batch = layer.train_forward_batch(generator.data_batch());
+                size_t i = 0;
+                while (generator.has_next_batch()) {
+                    auto next_batch = layer.train_forward_batch(generator.data_batch());
+
+                    next_generator->set_data_batch(i, next_batch);
+                    next_generator->set_label_batch(i, next_batch);
+
+                    i += etl::dim<0>(next_batch);
+
+                    generator.next_batch();
+                }
+
+                // Release the memory if possible
+                generator.clear();
+
+                //Pass the output to the next layer
+                this->template pretrain_layer<I + 1>(*next_generator, watcher, max_epochs);
+            }
+        }
+    }
+
+    /*!
+     * \brief Create a temporary file and open a writer of features into it,
+     * in bfloat16 if the feature store has 16 bits values.
+     *
+     * \param writer The writer to open
+     * \param path The path of the created file
+     * \param one One sample of the features
+     * \param samples The number of samples to write
+     *
+     * \return true if the writer was opened, false otherwise
+     */
+    template <typename Sample>
+    static bool open_feature_store(mmap_dataset_writer& writer, std::string& path, const Sample& one, size_t samples) {
+        static constexpr size_t D = etl::decay_traits<Sample>::dimensions();
+
+        std::vector<size_t> dims(D);
+
+        for (size_t d = 0; d < D; ++d) {
+            dims[d] = etl::dim(one, d);
+        }
+
+        const char* tmp = std::getenv("TMPDIR");
+
+        path = std::string(tmp ? tmp : "/tmp") + "/dll_features_XXXXXX";
+
+        int fd = ::mkstemp(&path[0]);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to create the feature store in " << path << std::endl;
+            return false;
+        }
+
+        ::close(fd);
+
+        auto type = desc::FeatureStore == 16 ? mmap_dataset_type::BFLOAT16 : mmap_dataset_type::FLOAT;
+
+        if (!writer.open(path, samples, dims, 0, type)) {
+            ::unlink(path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Map the written feature store of the layer L and return a
+     * generator over it. The file is removed as soon as it is mapped, the
+     * mapping remaining valid until the generator is destroyed.
+     *
+     * \param path The path of the feature store
+     * \param written Indicates if the features were correctly written
+     *
+     * \return a generator over the stored features, nullptr if the features
+     * were not written
+     */
+    template <size_t D, size_t L = rbm_layer_n>
+    auto map_feature_store(const std::string& path, bool written) {
+        using generator_t = typename decltype(get_rbm_feature_store_inner_desc<L>())::template generator_t<weight, D>;
+
+        std::unique_ptr<generator_t> next_generator;
+
+        if (written) {
+            next_generator = make_mmap_generator<D, weight>(path, get_rbm_feature_store_inner_desc<L>());
+            next_generator->set_safe();
+        }
+
+        ::unlink(path.c_str());
+
+        return next_generator;
+    }
+
+    /*!
+     * \brief Indicates if the features of the given layer for all the samples
+     * of the generator fit in the memory budget of the network. The in-memory
+     * generator of the next layer holds them twice (data and labels).
+     */
+    template <typename Layer, typename Generator>
+    bool fits_features(Layer& layer, Generator& generator) const {
+        auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
+
+        auto plan = plan_memory(2 * generator.size() * etl::size(one) * sizeof(weight));
+
+        if (plan.streaming()) {
+            out << "Stream the features (" << memory_str(plan.dataset) << ") over the memory budget (" << memory_str(plan.budget) << ")" << std::endl;
+        }
+
+        return plan.resident();
+    }
+
+    /*!
+     * \brief Write the features of the given layer for all the samples of the
+     * generator into a memory-mapped file and return a generator over them.
+     *
+     * The features are stored in bfloat16 if the feature store has 16 bits
+     * values.
+     *
+     * \return a generator over the stored features, nullptr if the file
+     * could not be written
+     */
+    template <typename Layer, typename Generator>
+    auto store_features(Layer& layer, Generator& generator) {
+        dll::auto_timer timer("dbn:pretrain:store");
+
+        // Need one output in order to know the dimensions of the features
+        auto one = prepare_one_ready_output(layer, generator.data_batch()(0));
 
-                    next_generator->set_data_batch(i, next_batch);
-                    next_generator->set_label_batch(i, next_batch);
+        static constexpr size_t D = etl::decay_traits<decltype(one)>::dimensions();
 
-                    i += etl::dim<0>(next_batch);
+        std::string path;
+        mmap_dataset_writer writer;
 
-                    generator.next_batch();
-                }
+        if (!open_feature_store(writer, path, one, generator.size())) {
+            return map_feature_store<D>(path, false);
+        }
 
-                // Release the memory if possible
-                generator.clear();
+        while (generator.has_next_batch()) {
+            writer.write_batch(layer.train_forward_batch(generator.data_batch()));
 
-                //Pass the output to the next layer
-                this->template pretrain_layer<I + 1>(*next_generator, watcher, max_epochs);
-            }
+            generator.next_batch();
         }
+
+        return map_feature_store<D>(path, writer.close());
     }
 
     /* Pretrain with denoising */
@@ -2477,6 +4681,15 @@ private:
         //Get the specific trainer (CD)
         auto trainer = rbm_trainer_t::get_trainer(rbm);
 
+        // With a feature store, the activations of the lower layers are
+        // written to disk during the first epoch and only read back in the
+        // next epochs
+        using sample_t = std::decay_t<decltype(forward_batch<I - 1>(generator.data_batch())(0))>;
+
+        static constexpr size_t D = etl::decay_traits<sample_t>::dimensions();
+
+        decltype(map_feature_store<D, I>(std::string(), false)) cache;
+
         //Train for max_epochs epoch
         for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
             size_t big_batch = 0;
@@ -2486,12 +4699,48 @@ private:
 
             r_trainer.init_epoch();
 
+            if (cache) {
+                cache->reset();
+                cache->set_train();
+
+                while (cache->has_next_batch()) {
+                    auto next_batch = cache->data_batch();
+
+                    r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
+
+                    if (dbn_traits<this_type>::is_verbose()) {
+                        watcher.pretraining_batch(*this, big_batch);
+                    }
+
+                    cache->next_batch();
+                }
+
+                r_trainer.finalize_epoch(epoch, context, rbm);
+
+                continue;
+            }
+
             generator.reset();
             generator.set_train();
 
+            std::string path;
+            mmap_dataset_writer writer;
+
+            bool store = false;
+
             while (generator.has_next_batch()) {
                 auto next_batch = forward_batch<I - 1>(generator.data_batch());
 
+                if constexpr (desc::FeatureStore > 0) {
+                    if (epoch == 0 && epoch + 1 < max_epochs && generator.current_batch() == 0) {
+                        store = open_feature_store(writer, path, next_batch(0), generator.size());
+                    }
+
+                    if (store) {
+                        writer.write_batch(next_batch);
+                    }
+                }
+
                 r_trainer.train_batch(next_batch, next_batch, trainer, context, rbm);
 
                 if (dbn_traits<this_type>::is_verbose()) {
@@ -2501,6 +4750,10 @@ private:
                 generator.next_batch();
             }
 
+            if (store) {
+                cache = map_feature_store<D, I>(path, writer.close());
+            }
+
             r_trainer.finalize_epoch(epoch, context, rbm);
         }
 
@@ -2514,6 +4767,118 @@ private:
     template <size_t I, typename Generator, cpp_enable_iff(I == layers)>
     void pretrain_layer_batch(Generator&, watcher_t&, size_t) {}
 
+    /* Pretrain in pipelined mode */
+
+    //The first layer trained in batch mode, starting from I
+    template <size_t I, typename Enable = void>
+    struct next_batch_layer : std::integral_constant<size_t, I> {};
+
+    template <size_t I>
+    struct next_batch_layer<I, std::enable_if_t<(I < layers && batch_layer_ignore<I>::value)>> : next_batch_layer<I + 1> {};
+
+    //The type of a batch of features given to the layer I by the pipeline
+    template <size_t I>
+    using pipeline_batch_t = etl::dyn_matrix<weight, etl::decay_traits<typename layer_type<I>::input_one_t>::dimensions() + 1>;
+
+    /*!
+     * \brief Pretrain the layer I and, at the same time, the next layers.
+     *
+     * The next trained layer is trained, on its own thread, on the features
+     * computed by this layer after each of its batches. The features are
+     * passed through a bounded queue. Therefore, the next layer is trained on
+     * the features of a snapshot of this layer which is always at most a few
+     * batches old.
+     *
+     * \param source The generator for the first trained layer, the queue of
+     * features of the previous layer otherwise
+     */
+    template <size_t I, typename Source>
+    void pretrain_layer_pipelined(Source& source, watcher_t& watcher, size_t max_epochs) {
+        if constexpr (I < layers) {
+            static constexpr size_t J = next_batch_layer<I + 1>::value;
+
+            watcher.pretrain_layer(*this, I, layer_get<I>(), 0);
+
+            if constexpr (J < layers) {
+                feature_queue<pipeline_batch_t<J>> features(big_batch_size, source.size(), source.batches());
+
+                std::thread next([&]() {
+                    pretrain_layer_pipelined<J>(features, watcher, max_epochs);
+                });
+
+                train_layer_pipelined<I, J>(source, &features, max_epochs);
+
+                features.close();
+
+                next.join();
+            } else {
+                train_layer_pipelined<I, J>(source, nullptr, max_epochs);
+            }
+        }
+    }
+
+    /*!
+     * \brief Train the layer I in the pipeline and push its features for the
+     * layer J, if any.
+     */
+    template <size_t I, size_t J, typename Source, typename Queue>
+    void train_layer_pipelined(Source& source, Queue features, size_t max_epochs) {
+        using layer_t = layer_type<I>;
+
+        decltype(auto) rbm = layer_get<I>();
+
+        using rbm_trainer_t = dll::rbm_trainer<layer_t, !watcher_t::ignore_sub, dbn_detail::rbm_watcher_t<watcher_t>>;
+
+        //Initialize the RBM trainer
+        rbm_trainer_t r_trainer;
+
+        //Init the RBM and training parameters
+        r_trainer.init_training(rbm, source);
+
+        //Get the specific trainer (CD)
+        auto trainer = rbm_trainer_t::get_trainer(rbm);
+
+        auto train = [&](auto&& input, rbm_training_context& context) {
+            r_trainer.train_batch(input, input, trainer, context, rbm);
+
+            if constexpr (J < layers) {
+                features->push(pipeline_batch_t<J>(test_forward_batch_impl<J - 1, I>(input)));
+            }
+        };
+
+        for (size_t epoch = 0; epoch < max_epochs; ++epoch) {
+            //Create a new context for this epoch
+            rbm_training_context context;
+
+            r_trainer.init_epoch();
+
+            if constexpr (is_generator<Source>) {
+                source.reset();
+                source.set_train();
+
+                while (source.has_next_batch()) {
+                    if constexpr (I == 0) {
+                        train(source.data_batch(), context);
+                    } else {
+                        train(forward_batch<I - 1>(source.data_batch()), context);
+                    }
+
+                    source.next_batch();
+                }
+            } else {
+                pipeline_batch_t<I> input;
+
+                for (size_t b = 0; b < source.batches() && source.pop(input); ++b) {
+                    train(input, context);
+                }
+            }
+
+            r_trainer.finalize_epoch(epoch, context, rbm);
+        }
+
+        r_trainer.finalize_training(rbm);
+    }
+
     /* Pretrain layer denoising batch  */
 
     //Special handling for the layer 0
@@ -2700,40 +5065,359 @@ private:
     template <size_t I, typename Input, typename Output>
     std::enable_if_t<(I == layers)> predict_labels(const Input&, Output&, size_t) const {}
 
-    /* Activation Probabilities */
+    /*!
+     * \brief Returns the output features for the given sample, from the
+     * feature cache if possible.
+     */
+    template <typename Input>
+    auto cached_features(const Input& sample) const {
+        using result_t = std::decay_t<decltype(forward_one(sample))>;
 
-#ifdef DLL_SVM_SUPPORT
+        auto input = etl::force_temporary(input_one<0>(sample));
 
-    template <typename Samples, typename Input>
-    void add_activation_probabilities(Samples& result, const Input& sample) {
-        if constexpr (dbn_traits<this_type>::concatenate()) {
-            result.emplace_back(full_output_size());
-            full_activation_probabilities(sample, result.back());
+        const void* key = input.memory_start();
+        const size_t n  = etl::size(input) * sizeof(etl::value_t<decltype(input)>);
+
+        if (auto hit = features_cache->template get<result_t>(key, n, model_version)) {
+            return std::move(*hit);
+        }
+
+        result_t result = test_forward_one_impl<layers - 1, 0>(input);
+
+        features_cache->put(key, n, model_version, result);
+
+        return result;
+    }
+
+    /* Pruning */
+
+    /*!
+     * \brief Returns the index of the last dense or convolutional layer
+     */
+    template <size_t I = 0>
+    static constexpr size_t last_prunable_layer(size_t last = layers) {
+        if constexpr (I == layers) {
+            return last;
         } else {
-            result.push_back(forward_one(sample));
+            return last_prunable_layer<I + 1>(is_prunable_layer<layer_type<I>>() ? I : last);
         }
     }
 
-    template <typename Input>
-    using svm_sample_t = std::conditional_t<
-        dbn_traits<this_type>::concatenate(),
-        etl::dyn_vector<weight>,                             //In full mode, use a simple 1D vector
-        typename types_helper<layers - 1, Input>::output_t>; //In normal mode, use the output of the last layer
+    /*!
+     * \brief Copy the units of the layer I that have not been pruned into
+     * the target network.
+     *
+     * \param target The dynamic network to initialize
+     * \param kept The kept units of the previous dense or convolutional layer
+     * \param units The number of units of the previous dense or convolutional layer (0 for the input of the network)
+     */
+    template <size_t I, typename Target>
+    void compact_impl(Target& target, std::vector<size_t>& kept, size_t units) const {
+        if constexpr (I < layers) {
+            using layer_t = layer_type<I>;
 
-    template <typename Input>
-    using svm_samples_t = std::vector<svm_sample_t<Input>>;
+            if constexpr (is_prunable_layer<layer_t>()) {
+                decltype(auto) source = layer_get<I>();
+                decltype(auto) dest   = target.template layer_get<I>();
 
-    template <typename Samples, typename Labels>
-    void make_problem(const Samples& training_data, const Labels& labels, bool scale = false) {
-        svm_samples_t<safe_value_t<Samples>> svm_samples;
+                const size_t n_inputs = prune_detail::inputs(source);
+                const size_t n_units  = prune_detail::units(source);
+
+                std::vector<size_t> in;
+
+                if (!units) {
+                    in.resize(n_inputs);
+                    std::iota(in.begin(), in.end(), 0);
+                } else if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+                    // Each unit of the previous layer gives several inputs (the pixels of a feature map)
+                    const size_t unit_size = n_inputs / units;
+
+                    for (auto c : kept) {
+                        for (size_t r = 0; r < unit_size; ++r) {
+                            in.push_back(c * unit_size + r);
+                        }
+                    }
+                } else {
+                    in = kept;
+                }
+
+                std::vector<size_t> out;
+
+                if (I == last_prunable_layer()) {
+                    out.resize(n_units);
+                    std::iota(out.begin(), out.end(), 0);
+                } else {
+                    out = kept_units(source);
+                }
+
+                if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+                    dest.init_layer(in.size(), out.size());
+
+                    for (size_t i = 0; i < in.size(); ++i) {
+                        for (size_t j = 0; j < out.size(); ++j) {
+                            dest.w(i, j) = source.w(in[i], out[j]);
+                        }
+                    }
+                } else {
+                    const auto nv = prune_detail::visible_dims(source);
+
+                    dest.init_layer(in.size(), nv.first, nv.second, out.size(), etl::dim<2>(source.w), etl::dim<3>(source.w));
+
+                    for (size_t k = 0; k < out.size(); ++k) {
+                        for (size_t c = 0; c < in.size(); ++c) {
+                            dest.w(k)(c) = source.w(out[k])(in[c]);
+                        }
+                    }
+                }
+
+                dll::invalidate_transforms(dest);
+
+                for (size_t j = 0; j < out.size(); ++j) {
+                    dest.b[j] = source.b[out[j]];
+                }
+
+                kept  = std::move(out);
+                units = n_units;
+            }
+
+            compact_impl<I + 1>(target, kept, units);
+        }
+    }
+
+    /* Low-rank factorization */
+
+    /*!
+     * \brief Copy the layer I into the layer J of the target network, or
+     * factorize it into the layers J and J + 1 when it is one of the L...
+     * layers.
+     *
+     * \param target The dynamic network to initialize
+     * \param budget The budget of the factorization of each layer
+     * \param ranks The rank of each factorized layer
+     */
+    template <size_t I, size_t J, size_t... L, typename Target>
+    void low_rank_impl(Target& target, const low_rank_budget& budget, std::vector<size_t>& ranks) const {
+        if constexpr (I < layers) {
+            using layer_t = layer_type<I>;
+
+            decltype(auto) source = layer_get<I>();
+
+            if constexpr (((I == L) || ...)) {
+                static_assert(is_prunable_layer<layer_t>() && decay_layer_traits<layer_t>::is_dense_layer(), "Only the dense layers can be factorized");
+
+                using first_t  = typename Target::template layer_type<J>;
+                using second_t = typename Target::template layer_type<J + 1>;
+
+                static_assert(first_t::activation_function == function::IDENTITY, "The first factor must not have an activation function");
+                static_assert(second_t::activation_function == layer_t::activation_function, "The second factor must have the activation function of the layer");
+
+                decltype(auto) first  = target.template layer_get<J>();
+                decltype(auto) second = target.template layer_get<J + 1>();
+
+                auto factors = factorize_low_rank<weight>(source.w, budget);
+
+                first.init_layer(etl::dim<0>(source.w), factors.rank);
+                second.init_layer(factors.rank, etl::dim<1>(source.w));
+
+                first.w  = factors.first;
+                first.b  = 0;
+                second.w = factors.second;
+                second.b = source.b;
+
+                ranks.push_back(factors.rank);
+
+                low_rank_impl<I + 1, J + 2, L...>(target, budget, ranks);
+            } else {
+                if constexpr (is_prunable_layer<layer_t>()) {
+                    decltype(auto) dest = target.template layer_get<J>();
+
+                    if constexpr (decay_layer_traits<layer_t>::is_dense_layer()) {
+                        dest.init_layer(etl::dim<0>(source.w), etl::dim<1>(source.w));
+                    } else {
+                        const auto nv = prune_detail::visible_dims(source);
+
+                        dest.init_layer(etl::dim<1>(source.w), nv.first, nv.second, etl::dim<0>(source.w), etl::dim<2>(source.w), etl::dim<3>(source.w));
+                    }
+
+                    dest.w = source.w;
+                    dest.b = source.b;
+
+                    dll::invalidate_transforms(dest);
+                } else {
+                    static_assert(!decay_layer_traits<layer_t>::is_neural_layer(), "Only the dense and convolutional layers can be copied");
+                }
+
+                low_rank_impl<I + 1, J + 1, L...>(target, budget, ranks);
+            }
+        } else {
+            cpp_unused(target);
+            cpp_unused(budget);
+            cpp_unused(ranks);
+        }
+    }
+
+    /* Early exit */
+
+    /*!
+     * \brief Forward the remaining samples through the layer L, let the
+     * confident samples exit at the head of this layer and forward the
+     * others to the next layer.
+     *
+     * \param input The remaining samples
+     * \param ids The index of each remaining sample in the full batch
+     * \param predictions The predictions of the full batch
+     */
+    template <size_t L, typename Input>
+    void early_exit_forward(const Input& input, std::vector<size_t>& ids, std::vector<size_t>& predictions) const {
+        auto output = etl::force_temporary(layer_get<L>().test_forward_batch(input));
+
+        const size_t n = ids.size();
+        const size_t s = etl::size(output) / etl::dim<0>(output);
+
+        if constexpr (L == layers - 1) {
+            for (size_t i = 0; i < n; ++i) {
+                const auto* values = output.memory_start() + i * s;
 
-        //Get all the activation probabilities
-        for (auto& sample : training_data) {
-            add_activation_probabilities(svm_samples, sample);
+                predictions[ids[i]] = std::distance(values, std::max_element(values, values + s));
+            }
+        } else {
+            auto head = std::find_if(exit_heads.begin(), exit_heads.end(), [](auto& h) { return h.layer == L; });
+
+            if (head == exit_heads.end()) {
+                early_exit_forward<L + 1>(output, ids, predictions);
+                return;
+            }
+
+            etl::dyn_matrix<weight, 2> x(n, s);
+
+            std::copy_n(output.memory_start(), n * s, x.memory_start());
+
+            std::vector<size_t> labels;
+            std::vector<weight> confidence;
+
+            head->classify(x, labels, confidence);
+
+            // Compact the remaining samples at the beginning of the batch
+            size_t j = 0;
+
+            for (size_t i = 0; i < n; ++i) {
+                if (confidence[i] >= head->threshold) {
+                    predictions[ids[i]] = labels[i];
+                } else {
+                    if (j != i) {
+                        output(j) = output(i);
+                    }
+
+                    ids[j++] = ids[i];
+                }
+            }
+
+            ids.resize(j);
+
+            if (j == n) {
+                early_exit_forward<L + 1>(output, ids, predictions);
+            } else if (j) {
+                early_exit_forward<L + 1>(etl::slice(output, 0, j), ids, predictions);
+            }
+        }
+    }
+
+    /* Activation Probabilities */
+
+#ifdef DLL_SVM_SUPPORT
+
+    /*!
+     * \brief Compute the SVM features of the given samples into one
+     * contiguous matrix, one row per sample.
+     *
+     * The features are computed a batch at a time and several batches are
+     * forwarded in parallel, each in its own inference session. The
+     * concatenated features (svm_concatenate) are the outputs of all the
+     * layers for the whole batch (full_activation_probabilities_batch).
+     *
+     * \param first The first sample
+     * \param last The past-the-end sample
+     *
+     * \return The matrix of features
+     */
+    template <typename Iterator>
+    etl::dyn_matrix<weight, 2> svm_features(Iterator first, Iterator last) {
+        const size_t n = std::distance(first, last);
+
+        constexpr bool concatenate = dbn_traits<this_type>::concatenate();
+
+        etl::dyn_matrix<weight, 2> features(n, concatenate ? full_output_size() : output_size());
+
+        // The labels are not used
+        std::vector<size_t> labels(n, 0);
+
+        auto generator = make_generator(first, last, labels.begin(), labels.end(), n, output_size(), categorical_generator_t{});
+
+        generator->set_safe();
+        generator->set_test();
+
+        const size_t threads = std::max(size_t(1), kernel_threads());
+
+        using inputs_t = std::decay_t<decltype(etl::force_temporary(generator->data_batch()))>;
+
+        std::vector<inference_session<this_type>> sessions;
+        std::vector<inputs_t> inputs;
+        std::vector<size_t> offsets;
+
+        sessions.reserve(threads);
+        inputs.reserve(threads);
+
+        // The outputs of all the layers are not in the sessions
+        for (size_t t = 0; t < (concatenate ? 0 : threads); ++t) {
+            sessions.emplace_back(*this, batch_size);
+        }
+
+        size_t done = 0;
+
+        while (generator->has_next_batch()) {
+            inputs.clear();
+            offsets.clear();
+
+            // The generator itself is not thread-safe
+            while (inputs.size() < threads && generator->has_next_batch()) {
+                inputs.push_back(etl::force_temporary(generator->data_batch()));
+                offsets.push_back(done);
+
+                done += etl::dim<0>(inputs.back());
+
+                generator->next_batch();
+            }
+
+            dll::parallel_for(inputs.size(), [&](size_t t) {
+                if constexpr (concatenate) {
+                    full_activation_probabilities_batch(inputs[t], etl::slice(features, offsets[t], offsets[t] + etl::dim<0>(inputs[t])));
+                } else {
+                    decltype(auto) output = sessions[t].forward_batch(inputs[t]);
+
+                    for (size_t b = 0; b < etl::dim<0>(inputs[t]); ++b) {
+                        auto sample_output = output(b);
+
+                        for (size_t j = 0; j < etl::dim<1>(features); ++j) {
+                            features(offsets[t] + b, j) = sample_output[j];
+                        }
+                    }
+                }
+            });
         }
 
+        return features;
+    }
+
+    /*!
+     * \brief Create the svm problem for this dbn
+     */
+    template <typename Samples, typename Labels>
+    void make_problem(const Samples& training_data, const Labels& labels, bool scale = false) {
+        auto features = svm_features(std::begin(training_data), std::end(training_data));
+        auto rows     = svm_detail::feature_rows(features);
+
         //static_cast ensure using the correct overload
-        problem = svm::make_problem(labels, static_cast<const svm_samples_t<safe_value_t<Samples>>&>(svm_samples), scale);
+        problem = svm::make_problem(labels, static_cast<const decltype(rows)&>(rows), scale);
     }
 
     /*!
@@ -2741,17 +5425,12 @@ private:
      */
     template <typename Iterator, typename LIterator>
     void make_problem(Iterator first, Iterator last, LIterator&& lfirst, LIterator&& llast, bool scale = false) {
-        svm_samples_t<safe_value_t<Iterator>> svm_samples;
-
-        //Get all the activation probabilities
-        std::for_each(first, last, [this, &svm_samples](auto& sample) {
-            this->add_activation_probabilities(svm_samples, sample);
-        });
+        auto features = svm_features(first, last);
+        auto rows     = svm_detail::feature_rows(features);
 
-        //static_cast ensure using the correct overload
         problem = svm::make_problem(
             std::forward<LIterator>(lfirst), std::forward<LIterator>(llast),
-            svm_samples.begin(), svm_samples.end(),
+            rows.begin(), rows.end(),
             scale);
     }
 
@@ -79,6 +79,14 @@ struct dbn_traits {
         return desc::parameters::template contains<dll::shuffle_pre>();
     }
 
+    /*!
+     * \brief Indicates if the DBN pretrains all its layers at the same time,
+     * in a pipeline.
+     */
+    static constexpr bool pipeline_pretrain() noexcept {
+        return desc::parameters::template contains<dll::pipeline_pre>();
+    }
+
     /*!
      * \brief Indicates if the DBN features are concatenated from all levels
      */
@@ -114,6 +122,149 @@ struct dbn_traits {
         return desc::parameters::template contains<clip_gradients>();
     }
 
+    /*!
+     * \brief Indicates if the DBN clip its gradients by their global norm
+     */
+    static constexpr bool has_clip_global_norm() noexcept {
+        return desc::parameters::template contains<clip_global_norm>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN applies the decay of its sparse layers lazily
+     */
+    static constexpr bool has_lazy_decay() noexcept {
+        return desc::parameters::template contains<lazy_decay>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN synchronizes the statistics of its batch
+     * normalization layers
+     */
+    static constexpr bool has_sync_batch_norm() noexcept {
+        return desc::parameters::template contains<sync_batch_norm>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN applies its updates with fused kernels
+     */
+    static constexpr bool has_fused_updater() noexcept {
+        return desc::parameters::template contains<fused_updater>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN is trained in mixed precision
+     */
+    static constexpr bool has_mixed_precision() noexcept {
+        return desc::parameters::template contains<mixed_precision>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN maintains a moving average of its weights
+     * during training
+     */
+    static constexpr bool has_ema_weights() noexcept {
+        return desc::parameters::template contains<ema_weights>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN keeps its parameters and gradients in
+     * contiguous buffers
+     */
+    static constexpr bool has_flat_parameters() noexcept {
+        return desc::parameters::template contains<flat_parameters>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN applies the gradients of each layer during
+     * the backward pass of SGD
+     */
+    static constexpr bool has_overlap_updates() noexcept {
+        return desc::parameters::template contains<overlap_updates>();
+    }
+
+    /*!
+     * \brief Indicates if the data-parallel SGD replicas are placed on the
+     * NUMA nodes
+     */
+    static constexpr bool is_numa() noexcept {
+        return desc::parameters::template contains<numa>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN weights are serialized in bfloat16
+     */
+    static constexpr bool is_bf16_storage() noexcept {
+        return desc::parameters::template contains<bf16_storage>();
+    }
+
+    /*!
+     * \brief Returns the number of layers between two checkpoints of the
+     * activations during SGD
+     */
+    static constexpr size_t checkpoint_interval() noexcept {
+        return get_value_l_v<checkpointing<1>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of data-parallel workers of SGD
+     */
+    static constexpr size_t data_parallel_workers() noexcept {
+        return get_value_l_v<data_parallel<1>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of pipeline stages of data-parallel SGD
+     */
+    static constexpr size_t pipeline_stages() noexcept {
+        return get_value_l_v<dll::pipeline_stages<1>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of threads of the network (0 for the thread
+     * budget of the process)
+     */
+    static constexpr size_t threads() noexcept {
+        return get_value_l_v<dll::threads<0>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Indicates if the DBN has a runtime memory budget
+     */
+    static constexpr bool has_memory_budget() noexcept {
+        return desc::parameters::template contains<memory_budget>();
+    }
+
+    /*!
+     * \brief Indicates if the DBN is validated in the background of the
+     * training
+     */
+    static constexpr bool has_async_validation() noexcept {
+        return desc::parameters::template contains<async_validation>();
+    }
+
+    /*!
+     * \brief Returns the number of batches whose gradients are accumulated
+     * before each update of SGD
+     */
+    static constexpr size_t gradient_accumulation() noexcept {
+        return get_value_l_v<accumulate_gradients<1>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of batches between two finite checks of SGD
+     * (0 when the values are not checked)
+     */
+    static constexpr size_t check_finite_interval() noexcept {
+        return get_value_l_v<check_finite<0>, typename desc::parameters>;
+    }
+
+    /*!
+     * \brief Returns the number of first layers frozen during SGD
+     */
+    static constexpr size_t frozen_layers() noexcept {
+        return get_value_l_v<freeze_layers<0>, typename desc::parameters>;
+    }
+
     /*!
      * \brief Returns the type of weight decay used during training
      */
@@ -0,0 +1,369 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Batched inference of an ensemble of networks of the same type.
+ *
+ * The batch is converted once into the data type of the networks and given
+ * to all the members, which are forwarded concurrently on the scheduler.
+ * When the first layer of the networks is a dense layer, the first layers of
+ * all the members are computed together, as one wider matrix product with
+ * the stacked weights of the members. The outputs of the members are
+ * averaged (or their votes counted) in a single pass.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/inference_session.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief An ensemble of networks of the same type, forwarded together.
+ *
+ * The networks are only accessed in read-only mode. When the networks are
+ * modified, restack() must be called before the next forward propagation.
+ *
+ * The ensemble is not thread-safe itself: it must not be used by several
+ * threads at the same time.
+ */
+template <typename DBN>
+struct dbn_ensemble {
+    using dbn_t  = DBN;                    ///< The network type
+    using weight = typename dbn_t::weight; ///< The data type of the network
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers of each member
+
+    using first_layer_t = typename dbn_t::template layer_type<0>;                                                    ///< The type of the first layer
+    using batch_t       = etl::dyn_matrix<weight, etl::decay_traits<typename dbn_t::input_one_t>::dimensions() + 1>; ///< The type of a converted input batch
+
+    /*!
+     * \brief Indicates if the first layers of the members can be computed as
+     * one matrix product (static dense layers with dense inputs)
+     */
+    static constexpr bool stackable = decay_layer_traits<first_layer_t>::is_standard_dense_layer() && !decay_layer_traits<first_layer_t>::is_dynamic()
+                                      && !first_layer_t::sparse_input;
+
+    std::vector<const dbn_t*> members;                               ///< The networks of the ensemble
+    std::vector<std::unique_ptr<inference_session<dbn_t>>> sessions; ///< The inference session of each member
+    size_t max_batch;                                                ///< The maximum number of samples, for the sessions
+
+    batch_t batch;                                   ///< The converted input batch
+    std::vector<etl::dyn_matrix<weight, 2>> outputs; ///< The (flattened) output of each member
+    etl::dyn_matrix<weight, 2> average;              ///< The averaged output of the members
+    std::vector<size_t> votes;                       ///< The voted class of each sample
+
+    bool stacked = false;                           ///< Indicates if the first layers are computed together
+    etl::dyn_matrix<weight, 2> stacked_w;           ///< The stacked weights of the first layers (inputs x members * outputs)
+    etl::dyn_matrix<weight, 1> stacked_b;           ///< The stacked biases of the first layers
+    etl::dyn_matrix<weight, 2> stacked_output;      ///< The output of the stacked product
+    std::vector<etl::dyn_matrix<weight, 2>> firsts; ///< The output of the first layer of each member
+
+    /*!
+     * \brief Create an empty ensemble
+     * \param max_batch The maximum number of samples in a batch
+     */
+    explicit dbn_ensemble(size_t max_batch = dbn_t::batch_size) : max_batch(max_batch) {}
+
+    /*!
+     * \brief Create an ensemble of the given networks
+     * \param networks The networks, that must not be modified while the ensemble is in use
+     * \param max_batch The maximum number of samples in a batch
+     */
+    explicit dbn_ensemble(const std::vector<const dbn_t*>& networks, size_t max_batch = dbn_t::batch_size) : max_batch(max_batch) {
+        for (auto* network : networks) {
+            members.push_back(network);
+        }
+
+        restack();
+    }
+
+    /*!
+     * \brief Add a network to the ensemble
+     * \param network The network, that must not be modified while the ensemble is in use
+     */
+    void add(const dbn_t& network) {
+        members.push_back(&network);
+
+        restack();
+    }
+
+    /*!
+     * \brief Returns the number of networks of the ensemble
+     */
+    size_t size() const noexcept {
+        return members.size();
+    }
+
+    /*!
+     * \brief Stack the weights of the first layers of the members again,
+     * once the members have been modified.
+     */
+    void restack() {
+        outputs.resize(members.size());
+
+        stacked = false;
+
+        if constexpr (stackable) {
+            constexpr size_t K = first_layer_t::num_visible;
+            constexpr size_t M = first_layer_t::num_hidden;
+
+            stacked = !members.empty();
+
+            // The layers with runtime inference modes are forwarded alone
+            for (auto* member : members) {
+                auto& layer = member->template layer_get<0>();
+
+                if ((layer.quantized && layer.quantized->enabled) || (layer.block_sparse && layer.block_sparse->enabled)) {
+                    stacked = false;
+                }
+            }
+
+            if (stacked) {
+                const size_t m = members.size();
+
+                stacked_w = etl::dyn_matrix<weight, 2>(K, m * M);
+                stacked_b = etl::dyn_matrix<weight, 1>(m * M);
+
+                stacked_b = 0;
+
+                for (size_t j = 0; j < m; ++j) {
+                    auto& layer = members[j]->template layer_get<0>();
+
+                    for (size_t k = 0; k < K; ++k) {
+                        for (size_t h = 0; h < M; ++h) {
+                            stacked_w(k, j * M + h) = layer.w(k, h);
+                        }
+                    }
+
+                    if constexpr (!first_layer_t::no_bias) {
+                        for (size_t h = 0; h < M; ++h) {
+                            stacked_b(j * M + h) = layer.b(h);
+                        }
+                    }
+                }
+
+                firsts.resize(m);
+            }
+        }
+
+        if (!stacked) {
+            while (sessions.size() < members.size()) {
+                sessions.push_back(std::make_unique<inference_session<dbn_t>>(*members[sessions.size()], max_batch));
+            }
+        }
+    }
+
+    /*!
+     * \brief Forward propagate a batch through all the members of the
+     * ensemble and average their outputs.
+     *
+     * \param input The batch of samples
+     *
+     * \return A view on the averaged (flattened) outputs of the members. This
+     * view remains valid until the next forward propagation through the
+     * ensemble.
+     */
+    template <typename Input>
+    auto forward_batch(const Input& input) {
+        const size_t n = forward_members(input);
+        const size_t m = members.size();
+        const size_t o = m ? etl::dim<1>(outputs[0]) : 0;
+
+        if (etl::dim<0>(average) < n || etl::dim<1>(average) != o) {
+            average = etl::dyn_matrix<weight, 2>(std::max(n, max_batch), o);
+        }
+
+        // The outputs of all the members are averaged in a single pass
+
+        const weight scale = m ? weight(1.0) / weight(m) : weight(0);
+
+        weight* out = average.memory_start();
+
+        for (size_t i = 0; i < n * o; ++i) {
+            weight sum(0);
+
+            for (size_t j = 0; j < m; ++j) {
+                sum += outputs[j].memory_start()[i];
+            }
+
+            out[i] = sum * scale;
+        }
+
+        average.invalidate_gpu();
+
+        return etl::slice(average, 0, n);
+    }
+
+    /*!
+     * \brief Forward propagate a batch through all the members of the
+     * ensemble and count their votes: each member votes for the class of
+     * its highest output.
+     *
+     * \param input The batch of samples
+     *
+     * \return The class with the most votes for each sample (the lowest
+     * class in case of a tie). The reference remains valid until the next
+     * forward propagation through the ensemble.
+     */
+    template <typename Input>
+    const std::vector<size_t>& vote(const Input& input) {
+        const size_t n = forward_members(input);
+        const size_t m = members.size();
+        const size_t o = m ? etl::dim<1>(outputs[0]) : 0;
+
+        votes.assign(n, 0);
+
+        std::vector<size_t> counts(o);
+
+        for (size_t i = 0; i < n; ++i) {
+            std::fill(counts.begin(), counts.end(), 0);
+
+            for (size_t j = 0; j < m; ++j) {
+                const weight* row = outputs[j].memory_start() + i * o;
+
+                ++counts[std::max_element(row, row + o) - row];
+            }
+
+            votes[i] = std::max_element(counts.begin(), counts.end()) - counts.begin();
+        }
+
+        return votes;
+    }
+
+private:
+    /*!
+     * \brief Convert the batch once and forward it through all the members,
+     * concurrently, into their outputs
+     * \return The number of samples of the batch
+     */
+    template <typename Input>
+    size_t forward_members(const Input& input) {
+        const size_t n = etl::dim<0>(input);
+
+        if constexpr (std::is_same<etl::value_t<Input>, weight>::value && etl::is_dma<Input>) {
+            forward_converted(input, n);
+        } else {
+            if (etl::size(batch) != etl::size(input)) {
+                batch = batch_t(input);
+            } else {
+                batch = input;
+            }
+
+            forward_converted(batch, n);
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Forward the converted batch through all the members
+     */
+    template <typename Input>
+    void forward_converted(const Input& input, size_t n) {
+        if constexpr (stackable) {
+            if (stacked) {
+                forward_stacked(input, n);
+                return;
+            }
+        }
+
+        parallel_for(members.size(), [&](size_t j) {
+            decltype(auto) output = sessions[j]->forward_batch(input);
+
+            store_output(j, output, n);
+        });
+    }
+
+    /*!
+     * \brief Forward the batch through the members, with the first layers
+     * of all the members computed as one matrix product
+     */
+    template <typename Input>
+    void forward_stacked(const Input& input, size_t n) {
+        constexpr size_t K = first_layer_t::num_visible;
+        constexpr size_t M = first_layer_t::num_hidden;
+        constexpr auto F   = first_layer_t::activation_function;
+
+        const size_t m = members.size();
+
+        if (etl::dim<0>(stacked_output) != n) {
+            stacked_output = etl::dyn_matrix<weight, 2>(n, m * M);
+        }
+
+        stacked_output = etl::reshape(input, n, K) * stacked_w;
+
+        parallel_for(m, [&](size_t j) {
+            auto& first = firsts[j];
+
+            if (etl::dim<0>(first) != n) {
+                first = etl::dyn_matrix<weight, 2>(n, M);
+            }
+
+            // Split the columns of the member and add its biases
+
+            const weight* in = stacked_output.memory_start();
+            const weight* b  = stacked_b.memory_start() + j * M;
+            weight* out      = first.memory_start();
+
+            for (size_t i = 0; i < n; ++i) {
+                const weight* row = in + i * m * M + j * M;
+
+                for (size_t h = 0; h < M; ++h) {
+                    out[i * M + h] = row[h] + b[h];
+                }
+            }
+
+            first.invalidate_gpu();
+
+            if constexpr (F != function::IDENTITY) {
+                first = f_activate<F>(first);
+            }
+
+            if constexpr (layers > 1) {
+                auto output = members[j]->template forward_batch<layers - 1, 1>(first);
+
+                store_output(j, output, n);
+            } else {
+                store_output(j, first, n);
+            }
+        });
+    }
+
+    /*!
+     * \brief Store the flattened output of the member j
+     */
+    template <typename Output>
+    void store_output(size_t j, const Output& output, size_t n) {
+        const size_t o = n ? etl::size(output) / etl::dim<0>(output) : 0;
+
+        auto& target = outputs[j];
+
+        if (etl::dim<0>(target) != n || etl::dim<1>(target) != o) {
+            target = etl::dyn_matrix<weight, 2>(n, o);
+        }
+
+        output.ensure_cpu_up_to_date();
+
+        std::copy_n(output.memory_start(), n * o, target.memory_start());
+
+        target.invalidate_gpu();
+    }
+};
+
+} //end of dll namespace
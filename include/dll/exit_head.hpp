@@ -0,0 +1,204 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Intermediate classifier heads for confidence-based early exit and
+ * partial selection of the best classes.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Select the indices of the k largest values, in decreasing order of
+ * value.
+ *
+ * Only the k best indices are sorted, the other values are only partitioned.
+ *
+ * \param values The values
+ * \param n The number of values
+ * \param k The number of indices to select
+ * \param indices The selected indices
+ */
+template <typename T>
+void select_topk(const T* values, size_t n, size_t k, std::vector<size_t>& indices) {
+    k = std::min(k, n);
+
+    indices.resize(n);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    auto greater = [values](size_t a, size_t b) {
+        return values[a] > values[b] || (values[a] == values[b] && a < b);
+    };
+
+    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), greater);
+
+    indices.resize(k);
+}
+
+/*!
+ * \brief A softmax classifier attached to the output of an intermediate
+ * layer of a network.
+ *
+ * When the probability of the best class of this head is at least the
+ * threshold, the sample is classified by the head and does not go through
+ * the following layers.
+ */
+template <typename W>
+struct exit_head {
+    using weight = W; ///< The data type of the head
+
+    size_t layer     = 0;   ///< The layer after which the head is attached
+    weight threshold = 0.9; ///< The confidence above which the samples exit at this head
+
+    etl::dyn_matrix<weight, 2> w; ///< The weights (features x classes)
+    etl::dyn_vector<weight> b;    ///< The biases (one per class)
+
+    exit_head() = default;
+
+    /*!
+     * \brief Create a head (initialized to zero)
+     * \param layer The layer after which the head is attached
+     * \param features The number of features of the layer
+     * \param classes The number of classes
+     * \param threshold The exit confidence
+     */
+    exit_head(size_t layer, size_t features, size_t classes, weight threshold)
+            : layer(layer), threshold(threshold), w(features, classes), b(classes) {
+        w = 0;
+        b = 0;
+    }
+
+    /*!
+     * \brief Returns the number of features of the head
+     */
+    size_t features() const {
+        return etl::dim<0>(w);
+    }
+
+    /*!
+     * \brief Returns the number of classes of the head
+     */
+    size_t classes() const {
+        return etl::dim<1>(w);
+    }
+
+    /*!
+     * \brief Compute the class probabilities of the given features, in place
+     * of the logits.
+     *
+     * \param x The features (one sample per row)
+     * \param p The probabilities (one sample per row)
+     */
+    template <typename X, typename P>
+    void probabilities(const X& x, P& p) const {
+        p = x * w;
+
+        for (size_t i = 0; i < etl::dim<0>(p); ++i) {
+            weight max = p(i, 0) + b[0];
+
+            for (size_t c = 0; c < classes(); ++c) {
+                p(i, c) += b[c];
+                max = std::max(max, p(i, c));
+            }
+
+            weight sum = 0;
+
+            for (size_t c = 0; c < classes(); ++c) {
+                p(i, c) = std::exp(p(i, c) - max);
+                sum += p(i, c);
+            }
+
+            for (size_t c = 0; c < classes(); ++c) {
+                p(i, c) /= sum;
+            }
+        }
+    }
+
+    /*!
+     * \brief Classify the given features.
+     *
+     * \param x The features (one sample per row)
+     * \param labels The best class of each sample
+     * \param confidence The probability of the best class of each sample
+     */
+    template <typename X>
+    void classify(const X& x, std::vector<size_t>& labels, std::vector<weight>& confidence) const {
+        const size_t n = etl::dim<0>(x);
+
+        etl::dyn_matrix<weight, 2> p(n, classes());
+
+        probabilities(x, p);
+
+        labels.resize(n);
+        confidence.resize(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            size_t best = 0;
+
+            for (size_t c = 1; c < classes(); ++c) {
+                if (p(i, c) > p(i, best)) {
+                    best = c;
+                }
+            }
+
+            labels[i]     = best;
+            confidence[i] = p(i, best);
+        }
+    }
+
+    /*!
+     * \brief Train the head by gradient descent on the cross-entropy of the
+     * given features.
+     *
+     * \param x The features (one sample per row)
+     * \param labels The label of each sample
+     * \param epochs The number of epochs
+     * \param learning_rate The learning rate
+     */
+    template <typename X, typename Labels>
+    void fit(const X& x, const Labels& labels, size_t epochs, weight learning_rate) {
+        const size_t n = etl::dim<0>(x);
+
+        etl::dyn_matrix<weight, 2> p(n, classes());
+        etl::dyn_matrix<weight, 2> g(features(), classes());
+
+        for (size_t epoch = 0; epoch < epochs; ++epoch) {
+            probabilities(x, p);
+
+            // The gradient of the cross-entropy with respect to the logits
+            for (size_t i = 0; i < n; ++i) {
+                p(i, size_t(labels[i])) -= 1.0;
+            }
+
+            g = etl::transpose(x) * p;
+
+            w -= (learning_rate / n) * g;
+
+            for (size_t c = 0; c < classes(); ++c) {
+                weight s = 0;
+
+                for (size_t i = 0; i < n; ++i) {
+                    s += p(i, c);
+                }
+
+                b[c] -= (learning_rate / n) * s;
+            }
+        }
+    }
+};
+
+} //end of dll namespace
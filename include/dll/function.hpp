@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include <cmath>
+
 namespace dll {
 
 /*!
@@ -95,4 +97,48 @@ decltype(auto) f_derivative(E&& expr) {
     }
 }
 
+/*!
+ * \brief Computes the activation of a single value using the specified
+ * element-wise activation function
+ * \param x The input value
+ * \tparam F The activation function to use
+ * \return The result of the activation function
+ */
+template <function F, typename T>
+T f_activate_scalar(T x) {
+    static_assert(F != function::SOFTMAX, "Softmax is not an element-wise function");
+
+    if constexpr (F == function::IDENTITY) {
+        return x;
+    } else if constexpr (F == function::SIGMOID) {
+        return T(1) / (T(1) + std::exp(-x));
+    } else if constexpr (F == function::TANH) {
+        return std::tanh(x);
+    } else {
+        return x > T(0) ? x : T(0);
+    }
+}
+
+/*!
+ * \brief Computes the derivative of a single value from its output using
+ * the specified element-wise activation function
+ * \param y The output value
+ * \tparam F The activation function to use
+ * \return The derivative of the activation function
+ */
+template <function F, typename T>
+T f_derivative_scalar(T y) {
+    static_assert(F != function::SOFTMAX, "Softmax is not an element-wise function");
+
+    if constexpr (F == function::IDENTITY) {
+        return T(1);
+    } else if constexpr (F == function::SIGMOID) {
+        return y * (T(1) - y);
+    } else if constexpr (F == function::TANH) {
+        return T(1) - y * y;
+    } else {
+        return y > T(0) ? T(1) : T(0);
+    }
+}
+
 } //end of dll namespace
@@ -11,12 +11,21 @@
 
 #include "dll/util/tmp.hpp"
 #include "dll/base_conf.hpp"
+#include "dll/util/memory.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/labels.hpp"
+#include "dll/util/batch.hpp"
 
 // Common helpers
+#include "dll/generators/compressed_cache.hpp"
 #include "dll/generators/cache_helper.hpp"
 #include "dll/generators/label_cache_helper.hpp"
 #include "dll/generators/augmenters.hpp"
 #include "dll/generators/transformers.hpp"
+#include "dll/generators/device_batches.hpp"
+#include "dll/generators/stall_timer.hpp"
+#include "dll/generators/class_sampler.hpp"
+#include "dll/generators/importance_sampler.hpp"
 
 namespace dll {
 
@@ -38,6 +47,37 @@ struct is_generator_impl<T, decltype((void)T::dll_generator, 0)> : std::true_typ
 template <typename T>
 constexpr bool is_generator = is_generator_impl<T>::value;
 
+/*!
+ * \brief Traits to test if a generator gives the number of time steps of
+ * each of its batches (see sequence_generator)
+ */
+template <typename Generator, typename Enable = void>
+struct has_batch_steps : std::false_type {};
+
+template <typename Generator>
+struct has_batch_steps<Generator, std::void_t<decltype(std::declval<const Generator&>().batch_steps())>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a generator gives the length of each sequence of
+ * its batches (see sequence_generator)
+ */
+template <typename Generator, typename Enable = void>
+struct has_batch_lengths : std::false_type {};
+
+template <typename Generator>
+struct has_batch_lengths<Generator, std::void_t<decltype(std::declval<const Generator&>().batch_lengths())>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a generator draws its samples by importance: it
+ * gives the weights of the samples of its batches and takes back their
+ * losses (see importance_sampling)
+ */
+template <typename Generator, typename Enable = void>
+struct has_sample_importance : std::false_type {};
+
+template <typename Generator>
+struct has_sample_importance<Generator, std::enable_if_t<Generator::desc::ImportanceSampling>> : std::true_type {};
+
 /*!
  * \brief Helper to tell from the generator description if it is
  * augmenting the data
@@ -58,3 +98,8 @@ static constexpr bool is_threaded = Desc::Threaded;
 
 #include "dll/generators/inmemory_data_generator.hpp"
 #include "dll/generators/outmemory_data_generator.hpp"
+#include "dll/generators/mmap_data_generator.hpp"
+#include "dll/generators/sharded_data_generator.hpp"
+#include "dll/generators/pipeline.hpp"
+#include "dll/generators/stream_generator.hpp"
+#include "dll/generators/sequence_generator.hpp"
@@ -9,11 +9,29 @@
 
 #include <atomic>
 #include <thread>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include "dll/util/random.hpp"
 
 namespace dll {
 
+/*!
+ * \brief The mirroring of one image, drawn by random_mirrorer
+ */
+struct mirror_flips {
+    bool horizontal = false; ///< Indicates if the columns are reversed
+    bool vertical   = false; ///< Indicates if the rows are reversed
+
+    /*!
+     * \brief Indicates if the image is mirrored at all
+     */
+    bool any() const {
+        return horizontal || vertical;
+    }
+};
+
 /*!
  * \brief Randomly extract crops of a certain size from images
  */
@@ -64,16 +82,46 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x != 0 && Desc::r
      *
      * \param target The target output
      * \param image The input image
+     * \param g The random engine
+     */
+    template <typename O, typename T>
+    void transform_first(O&& target, const T& image, random_engine& g) {
+        gather(target, image, draw(g), mirror_flips{});
+    }
+
+    /*!
+     * \brief Draw the offsets of a crop
+     * \param g The random engine
+     * \return a pair containing the offsets of the crop in y and in x
+     */
+    std::pair<size_t, size_t> draw(random_engine& g) {
+        const size_t y_offset = dist_y(g);
+        const size_t x_offset = dist_x(g);
+
+        return {y_offset, x_offset};
+    }
+
+    /*!
+     * \brief Gather a crop of an image, mirrored, into the target.
+     *
+     * The crop and the mirroring are only index transforms, each pixel of
+     * the target is written once.
+     *
+     * \param target The target output
+     * \param image The input image
+     * \param offset The offsets of the crop in y and in x
+     * \param flips The mirroring of the crop
      */
     template <typename O, typename T>
-    void transform_first(O&& target, const T& image) {
-        const size_t y_offset = dist_y(dll::rand_engine());
-        const size_t x_offset = dist_x(dll::rand_engine());
+    void gather(O&& target, const T& image, std::pair<size_t, size_t> offset, mirror_flips flips) {
+        const auto [y_offset, x_offset] = offset;
 
         for (size_t c = 0; c < etl::dim<0>(image); ++c) {
             for (size_t y = 0; y < random_crop_y; ++y) {
+                const size_t sy = y_offset + (flips.vertical ? random_crop_y - 1 - y : y);
+
                 for (size_t x = 0; x < random_crop_x; ++x) {
-                    target(c, y, x) = image(c, y_offset + y, x_offset + x);
+                    target(c, y, x) = image(c, sy, x_offset + (flips.horizontal ? random_crop_x - 1 - x : x));
                 }
             }
         }
@@ -131,10 +179,60 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x == 0 || Desc::r
      *
      * \param target The target output
      * \param image The input image
+     * \param g The random engine
      */
     template <typename O, typename T>
-    void transform_first(O&& target, const T& image) {
-        target = image;
+    void transform_first(O&& target, const T& image, random_engine& g) {
+        cpp_unused(g);
+
+        convert_sample(target, image);
+    }
+
+    /*!
+     * \brief Draw the offsets of a crop (always zero)
+     * \param g The random engine
+     */
+    static std::pair<size_t, size_t> draw(random_engine& g) {
+        cpp_unused(g);
+
+        return {0, 0};
+    }
+
+    /*!
+     * \brief Gather an image, mirrored, into the target.
+     *
+     * The mirroring is only an index transform, each pixel of the target is
+     * written once.
+     *
+     * \param target The target output
+     * \param image The input image
+     * \param offset The offsets of the crop (always zero)
+     * \param flips The mirroring of the image
+     */
+    template <typename O, typename T>
+    void gather(O&& target, const T& image, std::pair<size_t, size_t> offset, mirror_flips flips) {
+        cpp_unused(offset);
+
+        if constexpr (etl::dimensions<T>() == 3) {
+            if (flips.any()) {
+                const size_t rows    = etl::dim<1>(image);
+                const size_t columns = etl::dim<2>(image);
+
+                for (size_t c = 0; c < etl::dim<0>(image); ++c) {
+                    for (size_t y = 0; y < rows; ++y) {
+                        const size_t sy = flips.vertical ? rows - 1 - y : y;
+
+                        for (size_t x = 0; x < columns; ++x) {
+                            target(c, y, x) = image(c, sy, flips.horizontal ? columns - 1 - x : x);
+                        }
+                    }
+                }
+
+                return;
+            }
+        }
+
+        convert_sample(target, image);
     }
 
     /*!
@@ -147,7 +245,7 @@ struct random_cropper<Desc, std::enable_if_t<Desc::random_crop_x == 0 || Desc::r
      */
     template <typename O, typename T>
     void transform_first_test(O&& target, const T& image) {
-        target = image;
+        convert_sample(target, image);
     }
 };
 
@@ -199,30 +297,75 @@ struct random_mirrorer<Desc, std::enable_if_t<Desc::HorizontalMirroring || Desc:
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    void transform(O&& target) {
-        auto choice = dist(dll::rand_engine());
+    void transform(O&& target, random_engine& g) {
+        auto flips = draw(g);
 
-        if (horizontal && vertical && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = vflip(target(c));
-            }
-        } else if (horizontal && vertical && choice == 2) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = hflip(target(c));
-            }
+        if (flips.vertical) {
+            vertical_flip(target);
         }
 
-        if (horizontal && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = hflip(target(c));
-            }
+        if (flips.horizontal) {
+            horizontal_flip(target);
         }
+    }
+
+    /*!
+     * \brief Draw the mirroring of an image, without applying it
+     * \param g The random engine
+     */
+    mirror_flips draw(random_engine& g) {
+        auto choice = dist(g);
+
+        mirror_flips flips;
+
+        if (horizontal && vertical) {
+            flips.vertical   = choice == 1;
+            flips.horizontal = choice == 2;
+        } else if (horizontal) {
+            flips.horizontal = choice == 1;
+        } else {
+            flips.vertical = choice == 1;
+        }
+
+        return flips;
+    }
+
+private:
+    /*!
+     * \brief Mirror each channel of the image horizontally, in place.
+     *
+     * Each row is reversed in place, without any temporary.
+     */
+    template <typename O>
+    static void horizontal_flip(O& target) {
+        const size_t rows    = etl::dim<0>(target) * etl::dim<1>(target);
+        const size_t columns = etl::dim<2>(target);
+
+        auto* memory = target.memory_start();
+
+        for (size_t r = 0; r < rows; ++r) {
+            std::reverse(memory + r * columns, memory + (r + 1) * columns);
+        }
+    }
+
+    /*!
+     * \brief Mirror each channel of the image vertically, in place.
+     *
+     * The rows are swapped two by two as contiguous blocks.
+     */
+    template <typename O>
+    static void vertical_flip(O& target) {
+        const size_t rows    = etl::dim<1>(target);
+        const size_t columns = etl::dim<2>(target);
+
+        for (size_t c = 0; c < etl::dim<0>(target); ++c) {
+            auto* memory = target.memory_start() + c * rows * columns;
 
-        if (vertical && choice == 1) {
-            for (size_t c = 0; c < etl::dim<0>(target); ++c) {
-                target(c) = vflip(target(c));
+            for (size_t r = 0; r < rows / 2; ++r) {
+                std::swap_ranges(memory + r * columns, memory + (r + 1) * columns, memory + (rows - 1 - r) * columns);
             }
         }
     }
@@ -253,10 +396,22 @@ struct random_mirrorer<Desc, std::enable_if_t<!Desc::HorizontalMirroring && !Des
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    static void transform(O&& target) {
+    static void transform(O&& target, random_engine& g) {
         cpp_unused(target);
+        cpp_unused(g);
+    }
+
+    /*!
+     * \brief Draw the mirroring of an image (never mirrored)
+     * \param g The random engine
+     */
+    static mirror_flips draw(random_engine& g) {
+        cpp_unused(g);
+
+        return {};
     }
 };
 
@@ -273,14 +428,12 @@ template <typename Desc>
 struct random_noise<Desc, std::enable_if_t<Desc::Noise != 0>> {
     static constexpr size_t N = Desc::Noise; ///< The amount of noise (in percent)
 
-    std::uniform_int_distribution<size_t> dist; ///< The random distribution
-
     /*!
      * \brief Initialize the random_noise
      * \param image The image to crop from
      */
     template <typename T>
-    random_noise(const T& image) : dist(0, 1000) {
+    random_noise(const T& image) {
         cpp_unused(image);
     }
 
@@ -295,13 +448,22 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise != 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    void transform(O&& target) {
-        auto& g = dll::rand_engine();
+    void transform(O&& target, random_engine& g) {
+        using value_type = etl::value_t<std::decay_t<O>>;
 
-        for (auto& v : target) {
-            v *= dist(g) < N * 10 ? 0.0 : 1.0;
+        // The raw output of the engine is compared to a threshold, which is
+        // much cheaper than going through a distribution for each value
+        const auto range     = double(random_engine::max() - random_engine::min());
+        const auto threshold = random_engine::result_type(range * (N / 100.0));
+
+        const size_t n = etl::size(target);
+        auto* memory   = target.memory_start();
+
+        for (size_t i = 0; i < n; ++i) {
+            memory[i] *= value_type(g() - random_engine::min() >= threshold);
         }
     }
 };
@@ -331,10 +493,12 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    static void transform(O&& target) {
+    static void transform(O&& target, random_engine& g) {
         cpp_unused(target);
+        cpp_unused(g);
     }
 };
 
@@ -344,20 +508,36 @@ struct random_noise<Desc, std::enable_if_t<Desc::Noise == 0>> {
 template <typename Desc, typename Enable = void>
 struct elastic_distorter;
 
-// TODO This needs to be made MUCH faster
-
 /*!
  * \copydoc elastic_distorter
+ *
+ * With elastic_bank, a bank of blurred displacement fields is computed once
+ * and each image is distorted by one of them, picked at random, mirrored,
+ * with its displacements flipped and scaled at random.
  */
 template <typename Desc>
 struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
-    using weight = typename Desc::weight; ///< The data type
+    using weight = float; ///< The type of the displacement fields
 
     static constexpr size_t K     = Desc::ElasticDistortion;         ///< size of elastic distortion kernel
+    static constexpr size_t N     = Desc::ElasticBank;               ///< The number of precomputed fields (0 for a new field per image)
     static constexpr size_t mid   = K / 2;                           ///< Half of the kernel
     static constexpr double sigma = 0.8 + 0.3 * ((K - 1) * 0.5 - 1); ///< Sigma for gaussian kernel
 
-    etl::fast_dyn_matrix<weight, K, K> kernel; ///< The precomputed kernel
+    etl::fast_dyn_matrix<weight, K> kernel; ///< The precomputed (separable) kernel
+
+    etl::dyn_matrix<weight> d_x;      ///< The random displacement field for x
+    etl::dyn_matrix<weight> d_y;      ///< The random displacement field for y
+    etl::dyn_matrix<weight> d_x_blur; ///< The blurred displacement field for x
+    etl::dyn_matrix<weight> d_y_blur; ///< The blurred displacement field for y
+    etl::dyn_matrix<weight> d_tmp;    ///< The result of the first pass of the blur
+    etl::dyn_matrix<weight> source;   ///< The channel being warped
+
+    std::vector<etl::dyn_matrix<weight>> bank_x; ///< The bank of blurred displacement fields for x (with elastic_bank)
+    std::vector<etl::dyn_matrix<weight>> bank_y; ///< The bank of blurred displacement fields for y (with elastic_bank)
+
+    std::vector<size_t> corners;      ///< The four source pixels of each pixel of the warp
+    std::vector<weight> coefficients; ///< The four bilinear coefficients of each pixel of the warp
 
     static_assert(K % 2 == 1, "The kernel size must be odd");
 
@@ -366,22 +546,28 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
      * \param image The image to distort
      */
     template <typename T>
-    elastic_distorter(const T& image) {
+    elastic_distorter(const T& image)
+            : d_x(etl::dim<1>(image), etl::dim<2>(image)),
+              d_y(etl::dim<1>(image), etl::dim<2>(image)),
+              d_x_blur(etl::dim<1>(image), etl::dim<2>(image)),
+              d_y_blur(etl::dim<1>(image), etl::dim<2>(image)),
+              d_tmp(etl::dim<1>(image), etl::dim<2>(image)),
+              source(etl::dim<1>(image), etl::dim<2>(image)) {
         static_assert(etl::dimensions<T>() == 3, "elastic_distorter can only be used with 3D images");
 
-        cpp_unused(image);
-
         // Precompute the gaussian kernel
+        //
+        // The 2D gaussian is the product of two 1D gaussians, each kernel
+        // value is the square root of the 2D normalization factor times the
+        // 1D gaussian
 
-        auto gaussian = [](double x, double y) {
+        auto gaussian = [](double x) {
             auto Z = 2.0 * M_PI * sigma * sigma;
-            return (1.0 / Z) * std::exp(-((x * x + y * y) / (2.0 * sigma * sigma)));
+            return (1.0 / std::sqrt(Z)) * std::exp(-((x * x) / (2.0 * sigma * sigma)));
         };
 
         for (size_t i = 0; i < K; ++i) {
-            for (size_t j = 0; j < K; ++j) {
-                kernel(i, j) = gaussian(double(i) - mid, double(j) - mid);
-            }
+            kernel(i) = gaussian(double(i) - mid);
         }
     }
 
@@ -396,24 +582,96 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    void transform(O&& target) {
+    void transform(O&& target, random_engine& g) {
         const size_t width  = etl::dim<1>(target);
         const size_t height = etl::dim<2>(target);
 
-        // 0. Generate random displacement fields
+        // The fields are allocated for the input images, which may be
+        // larger than the target (random crop)
+        if (etl::dim<0>(d_x) != width || etl::dim<1>(d_x) != height) {
+            d_x      = etl::dyn_matrix<weight>(width, height);
+            d_y      = etl::dyn_matrix<weight>(width, height);
+            d_x_blur = etl::dyn_matrix<weight>(width, height);
+            d_y_blur = etl::dyn_matrix<weight>(width, height);
+            d_tmp    = etl::dyn_matrix<weight>(width, height);
+            source   = etl::dyn_matrix<weight>(width, height);
+
+            bank_x.clear();
+            bank_y.clear();
+        }
 
-        etl::dyn_matrix<weight> d_x(width, height);
-        etl::dyn_matrix<weight> d_y(width, height);
+        if constexpr (N > 0) {
+            if (bank_x.empty()) {
+                fill_bank();
+            }
 
-        d_x = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
-        d_y = etl::uniform_generator(dll::rand_engine(), -1.0, 1.0);
+            std::uniform_int_distribution<size_t> field_dist(0, N - 1);
+            std::uniform_int_distribution<int> flip_dist(0, 1);
+            std::uniform_real_distribution<weight> scale_dist(0.5, 1.5);
 
-        // 1. Gaussian blur the displacement fields
+            auto& f_x = bank_x[field_dist(g)];
+            auto& f_y = bank_y[field_dist(g)];
+
+            const bool mirror_x = flip_dist(g);
+            const bool mirror_y = flip_dist(g);
 
-        etl::dyn_matrix<weight> d_x_blur(width, height);
-        etl::dyn_matrix<weight> d_y_blur(width, height);
+            const weight s_x = (flip_dist(g) ? weight(-1) : weight(1)) * scale_dist(g);
+            const weight s_y = (flip_dist(g) ? weight(-1) : weight(1)) * scale_dist(g);
+
+            prepare_warp(width, height, [&](size_t x, size_t y) {
+                const size_t fx = mirror_x ? width - 1 - x : x;
+                const size_t fy = mirror_y ? height - 1 - y : y;
+
+                return std::make_pair(s_x * f_x(fx, fy), s_y * f_y(fx, fy));
+            });
+        } else {
+            random_field(g);
+
+            prepare_warp(width, height, [this](size_t x, size_t y) {
+                return std::make_pair(d_x_blur(x, y), d_y_blur(x, y));
+            });
+        }
+
+        apply_warp(target);
+    }
+
+    /*!
+     * \brief Compute the bank of displacement fields.
+     *
+     * The bank is drawn from its own engine, seeded from the DLL seed, so
+     * that all the workers share the same bank.
+     */
+    void fill_bank() {
+        random_engine bank_engine;
+
+        std::seed_seq seq{dll::seed(), uint32_t(K), uint32_t(N)};
+        bank_engine.seed(seq);
+
+        bank_x.clear();
+        bank_y.clear();
+
+        for (size_t i = 0; i < N; ++i) {
+            random_field(bank_engine);
+
+            bank_x.push_back(d_x_blur);
+            bank_y.push_back(d_y_blur);
+        }
+    }
+
+    /*!
+     * \brief Draw a new blurred displacement field in d_x_blur and d_y_blur
+     * \param g The random engine
+     */
+    void random_field(random_engine& g) {
+        // 0. Generate random displacement fields
+
+        d_x = etl::uniform_generator(g, -1.0, 1.0);
+        d_y = etl::uniform_generator(g, -1.0, 1.0);
+
+        // 1. Gaussian blur the displacement fields
 
         gaussian_blur(d_x, d_x_blur);
         gaussian_blur(d_y, d_y_blur);
@@ -422,66 +680,143 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion != 0>> {
 
         d_x_blur *= (weight(8) / sum(d_x_blur));
         d_y_blur *= (weight(8) / sum(d_y_blur));
+    }
 
-        // 3. Apply the displacement field (using bilinear interpolation)
-
-        auto safe = [&](size_t channel, weight x, weight y) {
-            if (x < 0 || y < 0 || x > width - 1 || y > height - 1) {
-                return target(channel, 0UL, 0UL);
+    /*!
+     * \brief Compute the four source pixels and the four bilinear
+     * coefficients of each pixel of the warp.
+     *
+     * The source pixels outside of the image are replaced by its first
+     * pixel. The gather is shared by all the channels of the image.
+     *
+     * \param field A functor returning the displacement of a pixel
+     */
+    template <typename Field>
+    void prepare_warp(size_t width, size_t height, Field&& field) {
+        corners.resize(4 * width * height);
+        coefficients.resize(4 * width * height);
+
+        auto safe = [&](long x, long y) -> size_t {
+            if (x < 0 || y < 0 || x > long(width) - 1 || y > long(height) - 1) {
+                return 0;
             } else {
-                return target(channel, size_t(x), size_t(y));
+                return size_t(x) * height + size_t(y);
             }
         };
 
-        for (size_t channel = 0; channel < etl::dim<0>(target); ++channel) {
-            for (int x = 0; x < int(width); ++x) {
-                for (int y = 0; y < int(height); ++y) {
-                    auto dx = d_x_blur(x, y);
-                    auto dy = d_y_blur(x, y);
+        for (size_t x = 0; x < width; ++x) {
+            for (size_t y = 0; y < height; ++y) {
+                auto [dx, dy] = field(x, y);
+
+                const weight px = weight(x) + dx;
+                const weight py = weight(y) + dy;
 
-                    weight px = x + dx;
-                    weight py = y + dy;
+                const weight fx = std::floor(px);
+                const weight fy = std::floor(py);
 
-                    weight a = safe(channel, std::floor(px), std::floor(py));
-                    weight b = safe(channel, std::ceil(px), std::floor(py));
-                    weight c = safe(channel, std::ceil(px), std::ceil(py));
-                    weight d = safe(channel, std::floor(px), std::ceil(py));
+                const weight ax = px - fx;
+                const weight ay = py - fy;
+
+                const long x0 = long(fx);
+                const long y0 = long(fy);
+
+                const size_t p = 4 * (x * height + y);
+
+                corners[p + 0] = safe(x0, y0);
+                corners[p + 1] = safe(x0 + 1, y0);
+                corners[p + 2] = safe(x0, y0 + 1);
+                corners[p + 3] = safe(x0 + 1, y0 + 1);
+
+                coefficients[p + 0] = (1 - ax) * (1 - ay);
+                coefficients[p + 1] = ax * (1 - ay);
+                coefficients[p + 2] = (1 - ax) * ay;
+                coefficients[p + 3] = ax * ay;
+            }
+        }
+    }
+
+    /*!
+     * \brief Warp each channel of the target with the prepared gather
+     */
+    template <typename O>
+    void apply_warp(O&& target) {
+        const size_t width  = etl::dim<1>(target);
+        const size_t height = etl::dim<2>(target);
+
+        const size_t* c = corners.data();
+        const weight* w = coefficients.data();
+
+        for (size_t channel = 0; channel < etl::dim<0>(target); ++channel) {
+            for (size_t x = 0; x < width; ++x) {
+                for (size_t y = 0; y < height; ++y) {
+                    source(x, y) = target(channel, x, y);
+                }
+            }
 
-                    auto e = a * (1.0 - (px - std::floor(px))) + d * (px - std::floor(px));
-                    auto f = b * (1.0 - (px - std::floor(px))) + c * (px - std::floor(px));
+            const weight* in = source.memory_start();
 
-                    auto value = e * (1.0 - (py - std::floor(py))) + f * (py - std::floor(py));
+            for (size_t x = 0; x < width; ++x) {
+                for (size_t y = 0; y < height; ++y) {
+                    const size_t p = 4 * (x * height + y);
 
-                    target(channel, x, y) = value;
+                    target(channel, x, y) = w[p + 0] * in[c[p + 0]] + w[p + 1] * in[c[p + 1]] + w[p + 2] * in[c[p + 2]] + w[p + 3] * in[c[p + 3]];
                 }
             }
         }
     }
 
     /*!
-     * \brief Apply a gaussian blur on the distortion matrix
+     * \brief Apply a gaussian blur on the distortion matrix.
+     *
+     * The kernel is separable, so the blur is done in two 1D passes (first
+     * along the rows, then along the columns), with the same zero padding
+     * as a 2D convolution. The inner loops of the second pass are over
+     * contiguous rows, which the compiler can vectorize.
      */
     void gaussian_blur(const etl::dyn_matrix<weight>& d, etl::dyn_matrix<weight>& d_blur) {
         const size_t width  = etl::dim<0>(d);
         const size_t height = etl::dim<1>(d);
 
+        // 1. Blur along the second dimension
+
         for (size_t j = 0; j < width; ++j) {
             for (size_t k = 0; k < height; ++k) {
+                const size_t q_first = k < mid ? mid - k : 0;
+                const size_t q_last  = std::min(K, height + mid - k);
+
                 weight sum(0.0);
 
-                for (size_t p = 0; p < K; ++p) {
-                    if (long(j) + p - mid >= 0 && long(j) + p - mid < width) {
-                        for (size_t q = 0; q < K; ++q) {
-                            if (long(k) + q - mid >= 0 && long(k) + q - mid < height) {
-                                sum += kernel(p, q) * d(j + p - mid, k + q - mid);
-                            }
-                        }
-                    }
+                for (size_t q = q_first; q < q_last; ++q) {
+                    sum += kernel(q) * d(j, k + q - mid);
                 }
 
-                d_blur(j, k) = d(j, k) - (sum / (K * K));
+                d_tmp(j, k) = sum;
             }
         }
+
+        // 2. Blur along the first dimension
+
+        d_blur = 0;
+
+        for (size_t j = 0; j < width; ++j) {
+            const size_t p_first = j < mid ? mid - j : 0;
+            const size_t p_last  = std::min(K, width + mid - j);
+
+            auto* out = d_blur.memory_start() + j * height;
+
+            for (size_t p = p_first; p < p_last; ++p) {
+                const weight w = kernel(p);
+                const auto* in = d_tmp.memory_start() + (j + p - mid) * height;
+
+                for (size_t k = 0; k < height; ++k) {
+                    out[k] += w * in[k];
+                }
+            }
+        }
+
+        // 3. Subtract the blur from the field
+
+        d_blur = d - (d_blur / weight(K * K));
     }
 };
 
@@ -510,10 +845,78 @@ struct elastic_distorter<Desc, std::enable_if_t<Desc::ElasticDistortion == 0>> {
     /*!
      * \brief Apply the transform on the input
      * \param target The input to transform
+     * \param g The random engine
      */
     template <typename O>
-    static void transform(O&& target) {
+    static void transform(O&& target, random_engine& g) {
         cpp_unused(target);
+        cpp_unused(g);
+    }
+};
+
+/*!
+ * \brief The augmenters of one augmentation worker.
+ *
+ * Each worker has its own random stream, derived from the DLL seed and the
+ * index of the worker, so that the workers never share a random engine.
+ */
+template <typename Desc>
+struct augmentation_worker {
+    random_engine engine; ///< The random engine of the worker
+
+    random_cropper<Desc> cropper;      ///< The random cropper
+    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
+    elastic_distorter<Desc> distorter; ///< The elastic distorter
+    random_noise<Desc> noiser;         ///< The random noiser
+
+    /*!
+     * \brief Initialize the augmenters of a worker
+     * \param image An image of the dataset
+     * \param id The index of the worker
+     */
+    template <typename T>
+    augmentation_worker(const T& image, size_t id)
+            : cropper(image), mirrorer(image), distorter(image), noiser(image) {
+        std::seed_seq seq{dll::seed(), id};
+        engine.seed(seq);
+    }
+
+    /*!
+     * \brief Reseed the engine of the worker from the given stream.
+     *
+     * The workers claim the batches in any order, so the engine is reseeded
+     * with the stream of each batch for the augmentations to be
+     * reproducible.
+     *
+     * \param stream The random stream of the batch
+     */
+    void reseed(const random_stream& stream) {
+        const uint64_t key = stream.stream_key();
+
+        std::seed_seq seq{uint32_t(key), uint32_t(key >> 32)};
+        engine.seed(seq);
+    }
+
+    /*!
+     * \brief Crop and mirror an image at random, while gathering it into
+     * the target, so that each pixel is written once
+     * \param target The target output
+     * \param image The input image
+     */
+    template <typename O, typename T>
+    void crop_mirror(O&& target, const T& image) {
+        auto offset = cropper.draw(engine);
+        auto flips  = mirrorer.draw(engine);
+
+        cropper.gather(target, image, offset, flips);
+    }
+
+    /*!
+     * \brief The number of generated images from one input image
+     * \return The augmentation factor
+     */
+    size_t scaling() const {
+        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling();
     }
 };
 
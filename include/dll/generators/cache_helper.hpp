@@ -8,14 +8,48 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <thread>
 
 namespace dll {
 
+/*!
+ * \brief Copy a sample into another one, converting its values if the two
+ * types are different.
+ *
+ * Both samples must be contiguous and of the same size. The conversion is
+ * done in a single flat loop, which the compiler can vectorize.
+ *
+ * \param target The sample to fill
+ * \param source The sample to copy
+ */
+template <typename O, typename I>
+void convert_sample(O&& target, const I& source) {
+    using o_type = etl::value_t<std::decay_t<O>>;
+    using i_type = etl::value_t<I>;
+
+    if constexpr (std::is_same<o_type, i_type>::value) {
+        target = source;
+    } else {
+        cpp_assert(etl::size(target) == etl::size(source), "Cannot convert samples of different sizes");
+
+        const size_t n = etl::size(source);
+
+        auto* out      = target.memory_start();
+        const auto* in = source.memory_start();
+
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = o_type(in[i]);
+        }
+    }
+}
+
 /*!
  * \brief Helper to create and initialize a cache for inputs
  *
- * The cache is for putting all the inputs inside.
+ * The cache is for putting all the inputs inside, it is stored in uint8 when
+ * the generator is configured with uint8_storage and in compressed uint8
+ * samples when it is configured with compressed_storage.
  * The big cache is for storing several batches.
  */
 template <typename Desc, typename Iterator, typename Enable = void>
@@ -28,7 +62,9 @@ template <typename Desc, typename Iterator>
 struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_1d<typename std::iterator_traits<Iterator>::value_type>>> {
     using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
 
-    using cache_type     = etl::dyn_matrix<T, 2>; ///< The type of the cache
+    using S = std::conditional_t<Desc::Uint8Storage, uint8_t, T>; ///< Storage type of the cache
+
+    using cache_type     = std::conditional_t<Desc::CompressedStorage, compressed_cache<2>, etl::dyn_matrix<S, 2>>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 3>; ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
@@ -63,7 +99,9 @@ template <typename Desc, typename Iterator>
 struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_3d<typename std::iterator_traits<Iterator>::value_type>>> {
     using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
 
-    using cache_type     = etl::dyn_matrix<T, 4>; ///< The type of the cache
+    using S = std::conditional_t<Desc::Uint8Storage, uint8_t, T>; ///< Storage type of the cache
+
+    using cache_type     = std::conditional_t<Desc::CompressedStorage, compressed_cache<4>, etl::dyn_matrix<S, 4>>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 5>; ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
@@ -103,7 +141,9 @@ template <typename Desc, typename Iterator>
 struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_2d<typename std::iterator_traits<Iterator>::value_type>>> {
     using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
 
-    using cache_type     = etl::dyn_matrix<T, 3>; ///< The type of the cache
+    using S = std::conditional_t<Desc::Uint8Storage, uint8_t, T>; ///< Storage type of the cache
+
+    using cache_type     = std::conditional_t<Desc::CompressedStorage, compressed_cache<3>, etl::dyn_matrix<S, 3>>; ///< The type of the cache
     using big_cache_type = etl::dyn_matrix<T, 4>; ///< The type of the big cache
 
     static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
@@ -136,4 +176,45 @@ struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_2d<typename std::it
     }
 };
 
+/*!
+ * \brief cache_helper implementation for 4D inputs (volumes)
+ *
+ * Volumes are never cropped, the crops are only defined for images.
+ */
+template <typename Desc, typename Iterator>
+struct cache_helper<Desc, Iterator, std::enable_if_t<etl::is_4d<typename std::iterator_traits<Iterator>::value_type>>> {
+    using T = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< Input type
+
+    using S = std::conditional_t<Desc::Uint8Storage, uint8_t, T>; ///< Storage type of the cache
+
+    using cache_type     = std::conditional_t<Desc::CompressedStorage, compressed_cache<5>, etl::dyn_matrix<S, 5>>; ///< The type of the cache
+    using big_cache_type = etl::dyn_matrix<T, 6>; ///< The type of the big cache
+
+    static constexpr size_t batch_size     = Desc::BatchSize;    ///< The size of the generated batches
+    static constexpr size_t big_batch_size = Desc::BigBatchSize; ///< The number of batches kept in cache
+
+    static_assert(!Desc::random_crop_x && !Desc::random_crop_y, "Volumes cannot be randomly cropped");
+
+    /*!
+     * \brief Init the cache
+     * \param n The size of the cache
+     * \param it An iterator to an element
+     * \param cache The cache to initialize
+     */
+    static void init(size_t n, const Iterator& it, cache_type& cache) {
+        auto one = *it;
+        cache    = cache_type(n, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one), etl::dim<3>(one));
+    }
+
+    /*!
+     * \brief Init the big cache
+     * \param it An iterator to an element
+     * \param cache The big cache to initialize
+     */
+    static void init_big(Iterator& it, big_cache_type& cache) {
+        auto one = *it;
+        cache    = big_cache_type(big_batch_size, batch_size, etl::dim<0>(one), etl::dim<1>(one), etl::dim<2>(one), etl::dim<3>(one));
+    }
+};
+
 } //end of dll namespace
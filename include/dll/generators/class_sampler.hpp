@@ -0,0 +1,172 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Class-balanced (or weighted) sampling of the samples of a dataset
+ */
+
+#pragma once
+
+#include <vector>
+#include <random>
+#include <algorithm>
+
+namespace dll {
+
+/*!
+ * \brief A sampler drawing the samples of a dataset by class.
+ *
+ * The indices of the samples of each class are gathered once, then each
+ * sample is drawn in constant time: the class is drawn from an alias table
+ * of the class weights and the sample is drawn uniformly among the samples
+ * of its class. By default, all the classes that have samples are drawn
+ * with the same probability (class-balanced batches).
+ *
+ * Only the order of the samples is drawn, the records themselves are never
+ * duplicated.
+ */
+struct class_sampler {
+    std::vector<std::vector<size_t>> classes; ///< The indices of the samples of each class
+    std::vector<double> probability;          ///< The probability of each column of the alias table
+    std::vector<size_t> alias;                ///< The alias of each column of the alias table
+
+    class_sampler() = default;
+
+    /*!
+     * \brief Gather the samples of each class
+     * \param n The number of samples
+     * \param n_classes The number of classes
+     * \param label A functor returning the label of the i-th sample
+     */
+    template <typename Label>
+    class_sampler(size_t n, size_t n_classes, Label&& label) : classes(n_classes) {
+        for (size_t i = 0; i < n; ++i) {
+            const size_t l = label(i);
+
+            if (l < n_classes) {
+                classes[l].push_back(i);
+            }
+        }
+
+        set_weights(std::vector<double>(n_classes, 1.0));
+    }
+
+    /*!
+     * \brief Indicates if no sample can be drawn
+     */
+    bool empty() const {
+        return alias.empty();
+    }
+
+    /*!
+     * \brief Set the weights of the classes.
+     *
+     * The classes without any sample are never drawn. The weights do not
+     * need to be normalized.
+     *
+     * \param weights The weight of each class
+     */
+    void set_weights(const std::vector<double>& weights) {
+        const size_t K = classes.size();
+
+        probability.assign(K, 0.0);
+        alias.assign(K, 0);
+
+        double total = 0.0;
+
+        for (size_t c = 0; c < K; ++c) {
+            if (c < weights.size() && !classes[c].empty()) {
+                probability[c] = std::max(weights[c], 0.0);
+                total += probability[c];
+            }
+        }
+
+        if (total <= 0.0) {
+            probability.clear();
+            alias.clear();
+            return;
+        }
+
+        // Vose's alias method
+
+        std::vector<size_t> small;
+        std::vector<size_t> large;
+
+        for (size_t c = 0; c < K; ++c) {
+            probability[c] *= K / total;
+
+            if (probability[c] < 1.0) {
+                small.push_back(c);
+            } else {
+                large.push_back(c);
+            }
+        }
+
+        while (!small.empty() && !large.empty()) {
+            const size_t s = small.back();
+            const size_t l = large.back();
+
+            small.pop_back();
+
+            alias[s] = l;
+            probability[l] -= 1.0 - probability[s];
+
+            if (probability[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+
+        // The remaining columns are full (up to rounding errors)
+
+        for (auto c : large) {
+            probability[c] = 1.0;
+        }
+
+        for (auto c : small) {
+            probability[c] = 1.0;
+            alias[c]       = c;
+        }
+    }
+
+    /*!
+     * \brief Draw the index of one sample
+     * \param g The random engine
+     */
+    template <typename G>
+    size_t operator()(G& g) const {
+        std::uniform_real_distribution<double> column_dist(0.0, double(classes.size()));
+
+        const double u = column_dist(g);
+        const size_t k = std::min(size_t(u), classes.size() - 1);
+        const size_t c = u - k < probability[k] ? k : alias[k];
+
+        auto& samples = classes[c];
+
+        std::uniform_int_distribution<size_t> sample_dist(0, samples.size() - 1);
+
+        return samples[sample_dist(g)];
+    }
+
+    /*!
+     * \brief Draw the order of the samples of an epoch
+     * \param order The order to fill
+     * \param n The number of samples to draw
+     * \param g The random engine
+     */
+    template <typename G>
+    void fill(std::vector<size_t>& order, size_t n, G& g) const {
+        order.resize(n);
+
+        for (auto& i : order) {
+            i = (*this)(g);
+        }
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,242 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief A compressed in-memory cache of uint8 samples
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace dll {
+
+namespace compression {
+
+constexpr size_t max_literals = 128; ///< The maximum length of a literal sequence
+constexpr size_t min_run      = 3;   ///< The minimum length of an encoded run
+constexpr size_t max_run      = 130; ///< The maximum length of an encoded run
+
+/*!
+ * \brief Compress a sequence of bytes, appending the compressed bytes to the
+ * given output.
+ *
+ * The sequence is encoded as a sequence of tokens. A token lower than 128
+ * is followed by token + 1 literal bytes. A token of 128 or more encodes a
+ * run of token - 125 copies of the next byte. The samples of images have
+ * long runs of the background value, which are each encoded in two bytes.
+ *
+ * \param in The bytes to compress
+ * \param n The number of bytes
+ * \param out The compressed bytes
+ */
+inline void compress(const uint8_t* in, size_t n, std::vector<uint8_t>& out) {
+    size_t i = 0;
+
+    while (i < n) {
+        // Length of the run starting at i
+        size_t run = 1;
+
+        while (i + run < n && run < max_run && in[i + run] == in[i]) {
+            ++run;
+        }
+
+        if (run >= min_run) {
+            out.push_back(uint8_t(128 + run - min_run));
+            out.push_back(in[i]);
+
+            i += run;
+        } else {
+            // Gather literals until the next run
+            size_t literals = 0;
+
+            while (i + literals < n && literals < max_literals) {
+                const size_t j = i + literals;
+
+                if (j + 2 < n && in[j] == in[j + 1] && in[j] == in[j + 2]) {
+                    break;
+                }
+
+                ++literals;
+            }
+
+            out.push_back(uint8_t(literals - 1));
+            out.insert(out.end(), in + i, in + i + literals);
+
+            i += literals;
+        }
+    }
+}
+
+/*!
+ * \brief Decompress a compressed sequence, converting the bytes to the type
+ * of the output.
+ *
+ * \param in The compressed bytes
+ * \param out The decompressed sequence
+ * \param n The size of the decompressed sequence
+ */
+template <typename T>
+void decompress(const uint8_t* in, T* out, size_t n) {
+    size_t i = 0;
+
+    while (i < n) {
+        const size_t token = *in++;
+
+        if (token < 128) {
+            for (size_t j = 0; j <= token; ++j) {
+                out[i++] = T(*in++);
+            }
+        } else {
+            const T value = T(*in++);
+
+            std::fill_n(out + i, token - 128 + min_run, value);
+
+            i += token - 128 + min_run;
+        }
+    }
+}
+
+} //end of namespace compression
+
+/*!
+ * \brief A cache of uint8 samples, each sample being compressed on its own.
+ *
+ * The samples are appended in order and can then be decompressed in any
+ * order, concurrently. Since each sample is compressed independently, the
+ * samples of a shuffled batch are decompressed without decompressing their
+ * neighbours. The decompression is converting the bytes to the type of the
+ * output directly.
+ *
+ * \tparam D The number of dimensions of the cache (including the samples)
+ */
+template <size_t D>
+struct compressed_cache {
+    using value_type = uint8_t; ///< The type of the stored bytes
+
+    std::array<size_t, D> dims{};  ///< The dimensions of the cache
+    std::vector<size_t> offsets;   ///< The offset of each sample in the bytes (and the end of the last sample)
+    std::vector<uint8_t> bytes;    ///< The compressed samples
+    std::vector<uint8_t> scratch;  ///< The conversion buffer of the samples being appended
+
+    compressed_cache() = default;
+
+    /*!
+     * \brief Create an empty cache for the given number of samples
+     * \param n The number of samples of the cache
+     * \param sample_dims The dimensions of one sample
+     */
+    template <typename... Dims>
+    explicit compressed_cache(size_t n, Dims... sample_dims) : dims{{n, size_t(sample_dims)...}} {
+        static_assert(sizeof...(Dims) + 1 == D, "Invalid number of dimensions for the compressed cache");
+
+        offsets.reserve(n + 1);
+        offsets.push_back(0);
+    }
+
+    /*!
+     * \brief Returns the number of values of one sample
+     */
+    size_t sample_size() const {
+        size_t s = 1;
+
+        for (size_t d = 1; d < D; ++d) {
+            s *= dims[d];
+        }
+
+        return s;
+    }
+
+    /*!
+     * \brief Returns the number of samples appended to the cache
+     */
+    size_t rows() const {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    /*!
+     * \brief Returns the number of compressed bytes
+     */
+    size_t size() const {
+        return bytes.size();
+    }
+
+    /*!
+     * \brief Returns the compression ratio of the cache (the ratio between
+     * the size of the uint8 samples and their compressed size)
+     */
+    double ratio() const {
+        return bytes.empty() ? 1.0 : double(rows() * sample_size()) / bytes.size();
+    }
+
+    /*!
+     * \brief Compress and append a sample to the cache. Each value of the
+     * sample is converted to uint8.
+     *
+     * \param sample The sample to append
+     */
+    template <typename Sample>
+    void push(const Sample& sample) {
+        cpp_assert(size_t(etl::size(sample)) == sample_size(), "Invalid sample size for the compressed cache");
+
+        const size_t n = sample_size();
+
+        scratch.resize(n);
+
+        const auto* in = sample.memory_start();
+
+        for (size_t i = 0; i < n; ++i) {
+            scratch[i] = uint8_t(in[i]);
+        }
+
+        compression::compress(scratch.data(), n, bytes);
+
+        offsets.push_back(bytes.size());
+    }
+
+    /*!
+     * \brief Release the memory reserved but not used by the compressed
+     * samples, once all the samples have been appended
+     */
+    void shrink() {
+        bytes.shrink_to_fit();
+        offsets.shrink_to_fit();
+
+        scratch.clear();
+        scratch.shrink_to_fit();
+    }
+
+    /*!
+     * \brief Decompress a sample into the given (contiguous) output
+     * \param i The index of the sample
+     * \param out The output sample
+     */
+    template <typename O>
+    void decompress(size_t i, O&& out) const {
+        cpp_assert(i < rows(), "Invalid sample index for the compressed cache");
+        cpp_assert(size_t(etl::size(out)) == sample_size(), "Invalid output size for the compressed cache");
+
+        compression::decompress(bytes.data() + offsets[i], out.memory_start(), sample_size());
+    }
+
+    /*!
+     * \brief Release all the memory of the cache
+     */
+    void clear() {
+        offsets.clear();
+        offsets.shrink_to_fit();
+
+        bytes.clear();
+        bytes.shrink_to_fit();
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,133 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Device-resident copies of the batches prepared by the generators
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief Device-resident copies of the batches prepared in the background
+ * by a generator.
+ *
+ * With GPU support (ETL_GPU), each prepared batch is copied into its own
+ * container and uploaded to the device by the thread that prepared it, so
+ * that the transfer of the next batches overlaps with the training on the
+ * current batch. The batches given to the trainer are then already on the
+ * device.
+ *
+ * Without GPU support, nothing is copied and the batches are directly
+ * views on the batch cache of the generator.
+ *
+ * \tparam T The type of the values
+ * \tparam D The number of dimensions of a batch
+ * \tparam Slots The number of batches prepared ahead (0 if only known at
+ * runtime, see resize)
+ */
+template <typename T, size_t D, size_t Slots>
+struct device_batches {
+#ifdef ETL_GPU
+    using batch_type = etl::dyn_matrix<T, D>; ///< The type of a device batch
+
+    std::conditional_t<Slots == 0, std::vector<batch_type>, std::array<batch_type, Slots>> batches; ///< The device copy of each batch
+
+    /*!
+     * \brief Set the number of batches prepared ahead, when only known
+     * at runtime
+     * \param n The number of batches
+     */
+    void resize(size_t n) {
+        if constexpr (Slots == 0) {
+            batches.resize(n);
+        } else {
+            cpp_assert(n == Slots, "Invalid number of device batches");
+            cpp_unused(n);
+        }
+    }
+
+    /*!
+     * \brief Upload the given prepared batch to the device.
+     *
+     * This is called by the thread that prepared the batch, before it is
+     * marked as ready.
+     *
+     * \param b The index of the batch
+     * \param batch The prepared (host) batch
+     */
+    template <typename Batch>
+    void upload(size_t b, const Batch& batch) {
+        if (etl::size(batches[b]) != etl::size(batch)) {
+            batches[b] = batch_type(batch);
+        } else {
+            batches[b] = batch;
+        }
+
+        batches[b].ensure_gpu_up_to_date();
+    }
+
+    /*!
+     * \brief Returns the batch to give to the trainer
+     * \param b The index of the batch
+     * \param batch The prepared (host) batch
+     * \param n The number of samples in the batch
+     */
+    template <typename Batch>
+    auto get(size_t b, Batch&& batch, size_t n) const {
+        cpp_unused(batch);
+
+        return etl::slice(batches[b], 0, n);
+    }
+#else
+    /*!
+     * \brief Set the number of batches prepared ahead, when only known
+     * at runtime
+     *
+     * Without GPU support, there is nothing to allocate.
+     *
+     * \param n The number of batches
+     */
+    void resize(size_t n) {
+        cpp_unused(n);
+    }
+
+    /*!
+     * \brief Upload the given prepared batch to the device.
+     *
+     * Without GPU support, there is nothing to upload.
+     *
+     * \param b The index of the batch
+     * \param batch The prepared (host) batch
+     */
+    template <typename Batch>
+    void upload(size_t b, const Batch& batch) {
+        cpp_unused(b);
+        cpp_unused(batch);
+    }
+
+    /*!
+     * \brief Returns the batch to give to the trainer
+     * \param b The index of the batch
+     * \param batch The prepared (host) batch
+     * \param n The number of samples in the batch
+     */
+    template <typename Batch>
+    auto get(size_t b, Batch&& batch, size_t n) const {
+        cpp_unused(b);
+
+        return etl::slice(std::forward<Batch>(batch), 0, n);
+    }
+#endif
+};
+
+} //end of dll namespace
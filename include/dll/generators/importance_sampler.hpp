@@ -0,0 +1,128 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Importance sampling of the samples of a dataset from their last
+ * loss
+ */
+
+#pragma once
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace dll {
+
+/*!
+ * \brief A sampler drawing the samples of a dataset proportionally to their
+ * last score (their loss or the norm of their gradient).
+ *
+ * The distribution is a mix of the normalized scores and of the uniform
+ * distribution, so that each sample keeps a probability of at least
+ * uniform / N and its weight is bounded. The weight of a drawn sample,
+ * 1 / (N p_i), makes the weighted gradient of a batch an unbiased estimate
+ * of the gradient of the dataset.
+ *
+ * As long as some samples have never been scored, the epochs are plain
+ * permutations of the samples, with a weight of one.
+ */
+struct importance_sampler {
+    std::vector<double> scores;      ///< The last score of each sample (negative when not scored yet)
+    std::vector<double> probability; ///< The probability of each sample in the current epoch
+    std::vector<double> cumulative;  ///< The cumulative distribution of the current epoch
+
+    double uniform = 0.2; ///< The part of the distribution that is uniform
+    size_t unseen  = 0;   ///< The number of samples without a score
+
+    importance_sampler() = default;
+
+    /*!
+     * \brief Create a sampler for n samples, none scored yet
+     */
+    explicit importance_sampler(size_t n) : scores(n, -1.0), unseen(n) {}
+
+    /*!
+     * \brief Indicates if the samples are drawn from their scores
+     */
+    bool active() const {
+        return !cumulative.empty();
+    }
+
+    /*!
+     * \brief Set the score of the sample i (non-finite scores are ignored)
+     */
+    void update(size_t i, double score) {
+        if (i >= scores.size() || !std::isfinite(score)) {
+            return;
+        }
+
+        if (scores[i] < 0.0) {
+            --unseen;
+        }
+
+        scores[i] = std::max(score, 0.0);
+    }
+
+    /*!
+     * \brief Returns the weight of the sample i in the current epoch
+     */
+    double weight(size_t i) const {
+        return active() ? 1.0 / (scores.size() * probability[i]) : 1.0;
+    }
+
+    /*!
+     * \brief Draw the order of the samples of an epoch
+     * \param order The order to fill
+     * \param n The number of samples to draw
+     * \param g The random engine
+     */
+    template <typename G>
+    void fill(std::vector<size_t>& order, size_t n, G& g) {
+        order.resize(n);
+
+        const size_t N = scores.size();
+
+        const double total = std::accumulate(scores.begin(), scores.end(), 0.0);
+
+        if (unseen || !N || total <= 0.0) {
+            probability.clear();
+            cumulative.clear();
+
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), g);
+
+            return;
+        }
+
+        const double u = std::min(std::max(uniform, 0.0), 1.0);
+
+        probability.resize(N);
+        cumulative.resize(N);
+
+        double acc = 0.0;
+
+        for (size_t i = 0; i < N; ++i) {
+            probability[i] = (1.0 - u) * scores[i] / total + u / N;
+
+            acc += probability[i];
+            cumulative[i] = acc;
+        }
+
+        std::uniform_real_distribution<double> dist(0.0, acc);
+
+        for (auto& i : order) {
+            auto it = std::upper_bound(cumulative.begin(), cumulative.end(), dist(g));
+            i       = std::min(size_t(std::distance(cumulative.begin(), it)), N - 1);
+        }
+    }
+};
+
+} //end of dll namespace
@@ -14,6 +14,11 @@
 
 #include <atomic>
 #include <thread>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "dll/util/arena.hpp"
 
 namespace dll {
 
@@ -24,7 +29,24 @@ template <typename Iterator, typename LIterator, typename Desc, typename Enable
 struct inmemory_data_generator;
 
 /*!
- * \copydoc inmemory_data_generator
+ * \brief In-memory data generator without augmentation.
+ *
+ * All the pre-transformations (scaling, normalization and binarization) of
+ * the data and of the labels are applied once, when the generator is filled.
+ * data_batch() and label_batch() then only return views on the caches,
+ * without any copy, so there is no batch preparation to overlap with the
+ * training (contrary to the augmented generator, which prepares its batches
+ * in a pool of background threads).
+ *
+ * With uint8_storage, the inputs are kept in uint8 (a quarter of the memory of
+ * float inputs) and the pre-transformations are applied when the current
+ * batch is converted to the weight type, in data_batch(). Since the batches
+ * are copied anyway, shuffling only permutes a vector of indices, the
+ * samples are gathered into the batch buffers.
+ *
+ * With compressed_storage, each uint8 sample is furthermore compressed in
+ * memory and the samples of the current batch are decompressed in parallel
+ * in data_batch().
  */
 template <typename Iterator, typename LIterator, typename Desc>
 struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_augmented<Desc>>> {
@@ -33,24 +55,59 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     using data_cache_helper_t  = cache_helper<Desc, Iterator>;                                      ///< The helper for the data cache
     using label_cache_helper_t = label_cache_helper<Desc, weight, LIterator>;                       ///< The helper for the label cache
 
-    using data_cache_type  = typename data_cache_helper_t::cache_type;  ///< The type of the data cache
-    using label_cache_type = typename label_cache_helper_t::cache_type; ///< The type of the label cache
+    using data_cache_type  = typename data_cache_helper_t::cache_type;     ///< The type of the data cache
+    using big_cache_type   = typename data_cache_helper_t::big_cache_type; ///< The type of big data cache
+    using label_cache_type = typename label_cache_helper_t::cache_type;    ///< The type of the label cache
+
+    using label_big_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
 
     static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
 
     static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
 
-    data_cache_type input_cache;  ///< The input cache
-    label_cache_type label_cache; ///< The label cache
+    /*!
+     * \brief Indicates if the labels may be aliased to the inputs (an
+     * auto-encoder trained on its own samples)
+     */
+    static constexpr bool shareable_labels = desc::AutoEncoder && std::is_same<Iterator, LIterator>::value;
+
+    data_cache_type input_cache;                    ///< The input cache
+    mutable big_cache_type batch_cache;             ///< The converted batch (only with uint8 storage)
+    label_cache_type label_cache;                   ///< The label cache
+    mutable label_big_cache_type label_batch_cache; ///< The gathered label batch (only with uint8 storage)
 
-    size_t current = 0;     ///< The current index
-    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+    memory_record memory{memory_subsystem::GENERATORS, no_memory_layer, 0}; ///< The accounting of the caches
+
+    std::vector<size_t> order; ///< The order of the samples, when shuffled (only with uint8 storage)
+
+    size_t current     = 0;     ///< The current index
+    bool is_safe       = false; ///< Indicates if the generator is safe to reclaim memory from
+    bool shared_labels = false; ///< Indicates if the labels are the inputs themselves (no label cache)
 
     template <typename Input, typename Label>
     inmemory_data_generator(const Input& input, const Label& label, size_t n, size_t n_classes){
+        static_assert(!desc::CompressedStorage, "A prepared generator cannot use compressed storage");
+
+        if constexpr (shareable_labels) {
+            shared_labels = &input == &label;
+        }
+
         // Initialize both caches for enough elements
         data_cache_helper_t::init(n, &input, input_cache);
-        label_cache_helper_t::init(n, n_classes, &label, label_cache);
+
+        if (!shared_labels) {
+            label_cache_helper_t::init(n, n_classes, &label, label_cache);
+        }
+
+        advise_caches();
+
+        if constexpr (desc::Uint8Storage) {
+            auto it = &input;
+            data_cache_helper_t::init_big(it, batch_cache);
+            label_cache_helper_t::init_big(n_classes, &label, label_batch_cache);
+        }
+
+        memory.resize(memory_size(input_cache, batch_cache, label_cache, label_batch_cache));
     }
 
     /*!
@@ -59,38 +116,106 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes){
         const size_t n = std::distance(first, last);
 
+        if constexpr (shareable_labels) {
+            shared_labels = first == lfirst;
+        }
+
         data_cache_helper_t::init(n, first, input_cache);
-        label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+
+        if (!shared_labels) {
+            label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        }
+
+        advise_caches();
+
+        if constexpr (desc::Uint8Storage) {
+            data_cache_helper_t::init_big(first, batch_cache);
+            label_cache_helper_t::init_big(n_classes, lfirst, label_batch_cache);
+        }
 
         // Fill the cache
 
         size_t i = 0;
         while (first != last) {
-            input_cache(i) = *first;
+            store_sample(i, *first);
 
-            label_cache_helper_t::set(i, lfirst, label_cache);
+            if (!shared_labels) {
+                label_cache_helper_t::set(i, lfirst, label_cache);
+            }
 
             ++i;
             ++first;
             ++lfirst;
         }
 
-        // Transform if necessary
+        // Transform if necessary (uint8 inputs are transformed batch by batch)
 
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
+        if constexpr (!desc::Uint8Storage) {
+            pre_scaler<desc>::transform_all(input_cache);
+            pre_normalizer<desc>::transform_all(input_cache);
+            pre_binarizer<desc>::transform_all(input_cache);
+        }
 
         // In case of auto-encoders, the label images also need to be transformed
         if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
+            if (!shared_labels) {
+                pre_scaler<desc>::transform_all(label_cache);
+                pre_normalizer<desc>::transform_all(label_cache);
+                pre_binarizer<desc>::transform_all(label_cache);
+            }
+        }
+
+        if constexpr (desc::CompressedStorage) {
+            input_cache.shrink();
         }
 
+        memory.resize(memory_size(input_cache, batch_cache, label_cache, label_batch_cache));
+
         cpp_unused(llast);
     }
 
+    /*!
+     * \brief Advise the kernel to back the (large) caches with huge pages,
+     * before they are filled
+     */
+    void advise_caches() {
+        advise_huge_pages(input_cache);
+
+        if (!shared_labels) {
+            advise_huge_pages(label_cache);
+        }
+    }
+
+    /*!
+     * \brief Store a sample into the input cache
+     * \param i The index of the sample
+     * \param sample The sample to store
+     */
+    template <typename Sample>
+    void store_sample(size_t i, const Sample& sample) {
+        if constexpr (desc::CompressedStorage) {
+            cpp_unused(i);
+            input_cache.push(sample);
+        } else {
+            convert_sample(input_cache(i), sample);
+        }
+    }
+
+    /*!
+     * \brief Load a sample of the input cache, converted to the type of the
+     * given output (without any pre-transformation)
+     * \param out The output sample
+     * \param s The index of the sample in the cache
+     */
+    template <typename Out>
+    void load_sample(Out&& out, size_t s) const {
+        if constexpr (desc::CompressedStorage) {
+            input_cache.decompress(s, out);
+        } else {
+            convert_sample(out, input_cache(s));
+        }
+    }
+
     inmemory_data_generator(const inmemory_data_generator& rhs) = delete;
     inmemory_data_generator operator=(const inmemory_data_generator& rhs) = delete;
 
@@ -111,6 +236,10 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
             stream << "    Augmented Size: " << augmented_size() << std::endl;
         }
 
+        if constexpr (desc::CompressedStorage) {
+            stream << "       Compression: " << input_cache.ratio() << "x" << std::endl;
+        }
+
         return stream;
     }
 
@@ -129,6 +258,15 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
         is_safe = true;
     }
 
+    /*!
+     * \brief Pin the threads of the generator to the given CPUs. The batches
+     * of this generator are prepared by the thread of the training, so this
+     * has no effect.
+     */
+    void set_affinity(const std::vector<size_t>& cpus) {
+        cpp_unused(cpus);
+    }
+
     /*!
      * \brier Clear the memory of the generator.
      *
@@ -137,7 +275,11 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     void clear() {
         if (is_safe) {
             input_cache.clear();
+            batch_cache.clear();
             label_cache.clear();
+            label_batch_cache.clear();
+
+            memory.resize(0);
         }
     }
 
@@ -173,20 +315,47 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
     /*!
      * \brief Shuffle the order of the samples.
      *
+     * The batches are views on the caches, so the caches are shuffled in
+     * place. With uint8 storage, only the order of the samples is shuffled.
+     *
      * This should only be done when the generator is at the beginning.
      */
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        if constexpr (desc::Uint8Storage) {
+            if (order.size() != size()) {
+                order.resize(size());
+                std::iota(order.begin(), order.end(), 0);
+            }
+
+            std::shuffle(order.begin(), order.end(), dll::rand_engine());
+        } else if (shared_labels) {
+            etl::shuffle(input_cache, dll::random_engine());
+        } else {
+            etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        }
+    }
+
+    /*!
+     * \brief Returns the index, in the caches, of the ith sample of the
+     * generation
+     */
+    size_t sample(size_t i) const {
+        return order.empty() ? i : order[i];
     }
 
     /*!
      * \brief Prepare the dataset for an epoch
      */
     void prepare_epoch(){
-        input_cache.ensure_gpu_up_to_date();
-        label_cache.ensure_gpu_up_to_date();
+        if constexpr (!desc::CompressedStorage) {
+            input_cache.ensure_gpu_up_to_date();
+        }
+
+        if (!shared_labels) {
+            label_cache.ensure_gpu_up_to_date();
+        }
     }
 
     /*!
@@ -202,7 +371,11 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return The number of elements in the generator
      */
     size_t size() const {
-        return etl::dim<0>(input_cache);
+        if constexpr (desc::CompressedStorage) {
+            return input_cache.rows();
+        } else {
+            return etl::dim<0>(input_cache);
+        }
     }
 
     /*!
@@ -214,7 +387,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return etl::dim<0>(input_cache);
+        return size();
     }
 
     /*!
@@ -247,7 +420,32 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return a a batch of data.
      */
     auto data_batch() const {
-        return etl::slice(input_cache, current, std::min(current + batch_size, size()));
+        const size_t last = std::min(current + batch_size, size());
+
+        if constexpr (desc::Uint8Storage) {
+            auto convert = [this](size_t /*chunk*/, size_t first, size_t end) {
+                for (size_t i = current + first; i < current + end; ++i) {
+                    auto sample = batch_cache(0)(i - current);
+
+                    load_sample(sample, this->sample(i));
+
+                    pre_scaler<desc>::transform(sample);
+                    pre_normalizer<desc>::transform(sample);
+                    pre_binarizer<desc>::transform(sample);
+                }
+            };
+
+            // The decompression of the samples is worth spreading over threads
+            if constexpr (desc::CompressedStorage) {
+                parallel_chunks(last - current, std::max(size_t(1), kernel_threads()), convert);
+            } else {
+                convert(0, 0, last - current);
+            }
+
+            return etl::slice(batch_cache(0), 0, last - current);
+        } else {
+            return etl::slice(input_cache, current, last);
+        }
     }
 
     /*!
@@ -255,7 +453,49 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      * \return a a batch of label.
      */
     auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
+        const size_t last = std::min(current + batch_size, size());
+
+        if constexpr (desc::Uint8Storage) {
+            gather_labels(label_batch_cache(0), last - current, [this](size_t i) { return sample(current + i); });
+
+            return etl::slice(label_batch_cache(0), 0, last - current);
+        } else if constexpr (shareable_labels) {
+            return etl::slice(shared_labels ? input_cache : label_cache, current, last);
+        } else {
+            return etl::slice(label_cache, current, last);
+        }
+    }
+
+    /*!
+     * \brief Gather the labels of some samples into a label batch.
+     *
+     * When the labels are shared with the inputs, the labels are converted
+     * from the input cache, on demand. Otherwise, the rows of the label
+     * cache are copied.
+     *
+     * \param labels The label batch to fill
+     * \param n The number of labels to gather
+     * \param index A functor returning the index, in the caches, of the i-th sample
+     */
+    template <typename Labels, typename Index>
+    void gather_labels(Labels&& labels, size_t n, Index&& index) const {
+        if constexpr (shareable_labels) {
+            if (shared_labels) {
+                for (size_t i = 0; i < n; ++i) {
+                    auto label = labels(i);
+
+                    load_sample(label, index(i));
+
+                    pre_scaler<desc>::transform(label);
+                    pre_normalizer<desc>::transform(label);
+                    pre_binarizer<desc>::transform(label);
+                }
+
+                return;
+            }
+        }
+
+        gather_rows(labels, label_cache, n, index);
     }
 
     /*!
@@ -265,29 +505,45 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_a
      */
     template <typename Input>
     void set_data_batch(size_t i, Input&& input_batch) {
+        static_assert(!desc::Uint8Storage, "set_data_batch() is not supported with uint8 storage");
+
         etl::slice(input_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
     }
 
     /*!
-     * \brief Set some part of the labels to a new set of value
+     * \brief Set some part of the labels to a new set of value.
+     *
+     * When the labels are shared with the inputs, the labels are the data
+     * set with set_data_batch() and nothing is stored.
+     *
      * \param i The beginning at which to start storing the new data
      * \param input_batch A label batch
      */
     template <typename Input>
     void set_label_batch(size_t i, Input&& input_batch) {
-        etl::slice(label_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+        static_assert(!desc::Uint8Storage, "set_label_batch() is not supported with uint8 storage");
+
+        if (!shared_labels) {
+            etl::slice(label_cache, i, i + etl::dim<0>(input_batch)) = input_batch;
+        }
     }
 
     /*!
      * \brief Finalize the dataset if it was filled directly after having being prepared.
      */
     void finalize_prepared_data() {
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
+        if constexpr (!desc::Uint8Storage) {
+            pre_scaler<desc>::transform_all(input_cache);
+            pre_normalizer<desc>::transform_all(input_cache);
+            pre_binarizer<desc>::transform_all(input_cache);
+        }
 
         // In case of auto-encoders, the label images also need to be transformed
         if constexpr (desc::AutoEncoder) {
+            if (shared_labels) {
+                return;
+            }
+
             pre_scaler<desc>::transform_all(label_cache);
             pre_normalizer<desc>::transform_all(label_cache);
             pre_binarizer<desc>::transform_all(label_cache);
@@ -317,162 +573,358 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     using big_cache_type   = typename data_cache_helper_t::big_cache_type; ///< The type of big data cache
     using label_cache_type = typename label_cache_helper_t::cache_type;    ///< The type of the label cache
 
+    using label_big_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
+
     static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
 
     static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
 
-    data_cache_type input_cache;  ///< The data cache
-    big_cache_type batch_cache;   ///< The data batch cache
-    label_cache_type label_cache; ///< The label cache
+    /*!
+     * \brief Indicates if the labels may be aliased to the inputs (an
+     * auto-encoder trained on its own samples)
+     */
+    static constexpr bool shareable_labels = desc::AutoEncoder && std::is_same<Iterator, LIterator>::value;
+
+    data_cache_type input_cache;            ///< The data cache
+    big_cache_type batch_cache;             ///< The data batch cache
+    label_cache_type label_cache;           ///< The label cache
+    label_big_cache_type label_batch_cache; ///< The label batch cache
 
-    random_cropper<Desc> cropper;      ///< The random cropper
-    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
-    elastic_distorter<Desc> distorter; ///< The elastic distorter
-    random_noise<Desc> noiser;         ///< The random noiser
+    memory_record memory{memory_subsystem::GENERATORS, no_memory_layer, 0}; ///< The accounting of the caches
 
+    device_batches<weight, etl::dimensions<big_cache_type>() - 1, big_batch_size> device_data;         ///< The device copies of the data batches
+    device_batches<weight, etl::dimensions<label_big_cache_type>() - 1, big_batch_size> device_labels; ///< The device copies of the label batches
 
-    size_t current = 0;     ///< The current index
-    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+    std::vector<size_t> order; ///< The order of the samples in the generation
+
+    static constexpr size_t workers_n = desc::AugmentationWorkers; ///< The number of augmentation workers
+
+    std::vector<augmentation_worker<Desc>> augmenters; ///< The augmenters of each worker
+    random_stream augment_stream;                      ///< The random stream of the augmentations
+
+    size_t current     = 0;     ///< The current index
+    bool is_safe       = false; ///< Indicates if the generator is safe to reclaim memory from
+    bool shared_labels = false; ///< Indicates if the labels are the clean inputs themselves (no label cache)
 
     mutable volatile bool status[big_batch_size];    ///< Status of each batch
+    mutable volatile bool working[big_batch_size];   ///< Indicates if a worker is filling each batch
     mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
 
+    size_t generation = 0; ///< The generation, incremented on each reset
+
     mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
+    mutable std::condition_variable condition;       ///< The condition variable for the threads to wait for some space
     mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+    mutable stall_timer stall;                       ///< The time spent waiting for the batches
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
+    volatile bool stop_flag = false; ///< Boolean flag indicating to the threads to stop
 
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    std::vector<std::thread> threads; ///< The augmentation threads
+    bool train_mode = false;          ///< The train mode status
+
+    std::unique_ptr<thread_reservation> reservation; ///< The threads of the scheduler left to the augmentation threads
 
     /*!
      * \brief Construct an inmemory data generator
      */
-    inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes)
-            : cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+    inmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes) {
         const size_t n = std::distance(first, last);
 
+        if constexpr (shareable_labels) {
+            shared_labels = first == lfirst;
+        }
+
         data_cache_helper_t::init(n, first, input_cache);
         data_cache_helper_t::init_big(first, batch_cache);
 
-        label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        if (!shared_labels) {
+            label_cache_helper_t::init(n, n_classes, lfirst, label_cache);
+        }
+
+        label_cache_helper_t::init_big(n_classes, lfirst, label_batch_cache);
+
+        advise_caches();
+
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+
+        augmenters.reserve(workers_n);
+
+        augment_stream = make_random_stream(size_t(rand_engine()()));
+
+        for (size_t t = 0; t < workers_n; ++t) {
+            augmenters.emplace_back(*first, t);
+        }
 
         // Fill the cache
 
         size_t i = 0;
         while (first != last) {
-            input_cache(i) = *first;
+            store_sample(i, *first);
 
-            label_cache_helper_t::set(i, lfirst, label_cache);
+            if (!shared_labels) {
+                label_cache_helper_t::set(i, lfirst, label_cache);
+            }
 
             ++i;
             ++first;
             ++lfirst;
         }
 
-        // Transform if necessary
+        // Transform if necessary (uint8 inputs are transformed batch by batch)
 
-        pre_scaler<desc>::transform_all(input_cache);
-        pre_normalizer<desc>::transform_all(input_cache);
-        pre_binarizer<desc>::transform_all(input_cache);
+        if constexpr (!desc::Uint8Storage) {
+            pre_scaler<desc>::transform_all(input_cache);
+            pre_normalizer<desc>::transform_all(input_cache);
+            pre_binarizer<desc>::transform_all(input_cache);
+        }
 
         // In case of auto-encoders, the label images also need to be transformed
         if constexpr (desc::AutoEncoder) {
-            pre_scaler<desc>::transform_all(label_cache);
-            pre_normalizer<desc>::transform_all(label_cache);
-            pre_binarizer<desc>::transform_all(label_cache);
+            if (!shared_labels) {
+                pre_scaler<desc>::transform_all(label_cache);
+                pre_normalizer<desc>::transform_all(label_cache);
+                pre_binarizer<desc>::transform_all(label_cache);
+            }
         }
 
         for (size_t b = 0; b < big_batch_size; ++b) {
             status[b]  = false;
+            working[b] = false;
             indices[b] = b;
         }
 
+        if constexpr (desc::CompressedStorage) {
+            input_cache.shrink();
+        }
+
+        memory.resize(memory_size(input_cache, batch_cache, label_cache, label_batch_cache));
+
         cpp_unused(llast);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
+        for (size_t t = 0; t < workers_n; ++t) {
+            threads.emplace_back([this, t] { work(augmenters[t]); });
+        }
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+        // The augmentation threads are not scheduled, they take the place of workers
+        reservation = std::make_unique<thread_reservation>(get_scheduler(), workers_n);
+    }
+
+    /*!
+     * \brief Advise the kernel to back the (large) caches with huge pages,
+     * before they are filled
+     */
+    void advise_caches() {
+        advise_huge_pages(input_cache);
 
-                    bool found = false;
+        if (!shared_labels) {
+            advise_huge_pages(label_cache);
+        }
+    }
 
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < size()) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
+    /*!
+     * \brief Store a sample into the input cache
+     * \param i The index of the sample
+     * \param sample The sample to store
+     */
+    template <typename Sample>
+    void store_sample(size_t i, const Sample& sample) {
+        if constexpr (desc::CompressedStorage) {
+            cpp_unused(i);
+            input_cache.push(sample);
+        } else {
+            convert_sample(input_cache(i), sample);
+        }
+    }
+
+    /*!
+     * \brief Load a sample of the input cache, converted to the type of the
+     * given output (without any pre-transformation)
+     * \param out The output sample
+     * \param s The index of the sample in the cache
+     */
+    template <typename Out>
+    void load_sample(Out&& out, size_t s) const {
+        if constexpr (desc::CompressedStorage) {
+            input_cache.decompress(s, out);
+        } else {
+            convert_sample(out, input_cache(s));
+        }
+    }
+
+    /*!
+     * \brief Wait for a batch of the cache to fill and claim it.
+     * \param index The index of the claimed batch inside the batch cache
+     * \param gen The generation of the claimed batch
+     * \param batch The index of the claimed batch in the generation
+     * \param samples The indices, in the caches, of the samples of the batch
+     * \return false if the generator is stopping, true otherwise
+     */
+    bool claim(size_t& index, size_t& gen, size_t& batch, std::vector<size_t>& samples) {
+        std::unique_lock<std::mutex> ulock(main_lock);
 
-                    // if not found, wait for a ready to compute batch
+        condition.wait(ulock, [this, &index] {
+            if (stop_flag) {
+                return true;
+            }
 
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
+            for (size_t b = 0; b < big_batch_size; ++b) {
+                if (!status[b] && !working[b] && indices[b] * batch_size < size()) {
+                    index = b;
+                    return true;
+                }
+            }
 
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < size()) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
+            return false;
+        });
 
-                            return false;
-                        });
+        if (stop_flag) {
+            return false;
+        }
 
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
+        working[index] = true;
+        gen            = generation;
+        batch          = indices[index];
+
+        // The order may be shuffled as soon as the lock is released
+        const size_t first = indices[index] * batch_size;
+        const size_t last  = std::min(first + batch_size, size());
+
+        samples.assign(order.begin() + first, order.begin() + last);
+
+        return true;
+    }
+
+    /*!
+     * \brief Apply the pre-transformations on a sample of the batch cache.
+     *
+     * This is only necessary with uint8 storage, otherwise the input cache
+     * has already been transformed once and for all.
+     *
+     * \param sample The sample to transform
+     */
+    template <typename Sample>
+    static void pre_transform(Sample&& sample) {
+        if constexpr (desc::Uint8Storage) {
+            pre_scaler<desc>::transform(sample);
+            pre_normalizer<desc>::transform(sample);
+            pre_binarizer<desc>::transform(sample);
+        } else {
+            cpp_unused(sample);
+        }
+    }
+
+    /*!
+     * \brief Gather the labels of some samples into a label batch.
+     *
+     * When the labels are shared with the inputs, the labels are the clean
+     * inputs, converted from the input cache, independently of the
+     * augmentations (or the noise) applied on the inputs of the batch.
+     * Otherwise, the rows of the label cache are copied.
+     *
+     * \param labels The label batch to fill
+     * \param samples The indices, in the caches, of the samples
+     */
+    template <typename Labels>
+    void gather_labels(Labels&& labels, const std::vector<size_t>& samples) const {
+        if constexpr (shareable_labels) {
+            if (shared_labels) {
+                for (size_t i = 0; i < samples.size(); ++i) {
+                    auto label = labels(i);
+
+                    load_sample(label, samples[i]);
+                    pre_transform(label);
                 }
 
-                // Get the batch that needs to be read
-                const size_t batch = indices[index];
+                return;
+            }
+        }
+
+        gather_rows(labels, label_cache, samples.size(), [&samples](size_t i) { return samples[i]; });
+    }
 
-                // Get the index from where to read inside the input cache
-                const size_t input_n = batch * batch_size;
+    /*!
+     * \brief The loop of an augmentation worker
+     * \param w The augmenters of the worker
+     */
+    void work(augmentation_worker<Desc>& w) {
+        // The workers already run concurrently, there is no need to
+        // parallelize each transformation
+        SERIAL_SECTION {
+            // The index of the batch inside the batch cache
+            size_t index = 0;
+            size_t gen   = 0;
+            size_t batch = 0;
+
+            // The samples of the batch
+            std::vector<size_t> samples;
+
+            while (claim(index, gen, batch, samples)) {
+                if (train_mode) {
+                    w.reseed(augment_stream.split(gen).split(batch));
+                }
+
+                // Gather the labels
+                gather_labels(label_batch_cache(index), samples);
 
-                for (size_t i = 0; i < batch_size && input_n + i < size(); ++i) {
+                for (size_t i = 0; i < samples.size(); ++i) {
                     if (train_mode) {
-                        // Random crop the image
-                        cropper.transform_first(batch_cache(index)(i), input_cache(input_n + i));
+                        // Random crop and mirror the image while gathering
+                        // it (the compressed samples are never cropped, they
+                        // are decompressed and mirrored in the batch)
+                        if constexpr (desc::CompressedStorage) {
+                            load_sample(batch_cache(index)(i), samples[i]);
+
+                            pre_transform(batch_cache(index)(i));
+
+                            w.mirrorer.transform(batch_cache(index)(i), w.engine);
+                        } else {
+                            w.crop_mirror(batch_cache(index)(i), input_cache(samples[i]));
 
-                        // Mirror the image
-                        mirrorer.transform(batch_cache(index)(i));
+                            // Transform the converted uint8 image
+                            pre_transform(batch_cache(index)(i));
+                        }
 
                         // Distort the image
-                        distorter.transform(batch_cache(index)(i));
+                        w.distorter.transform(batch_cache(index)(i), w.engine);
 
                         // Noise the image
-                        noiser.transform(batch_cache(index)(i));
+                        w.noiser.transform(batch_cache(index)(i), w.engine);
                     } else {
                         // Center crop the image
-                        cropper.transform_first_test(batch_cache(index)(i), input_cache(input_n + i));
+                        if constexpr (desc::CompressedStorage) {
+                            load_sample(batch_cache(index)(i), samples[i]);
+                        } else {
+                            w.cropper.transform_first_test(batch_cache(index)(i), input_cache(samples[i]));
+                        }
+
+                        // Transform the converted uint8 image
+                        pre_transform(batch_cache(index)(i));
                     }
                 }
 
-                // Notify a waiter that one batch is ready
+                // Start the transfer of the batch to the device
+                device_data.upload(index, batch_cache(index));
+                device_labels.upload(index, label_batch_cache(index));
+
+                // Notify the waiters that one batch is ready
 
                 {
                     std::unique_lock<std::mutex> ulock(main_lock);
 
-                    status[index] = true;
+                    working[index] = false;
 
-                    ready_condition.notify_one();
+                    // A batch filled before a reset is not valid anymore
+                    if (gen == generation) {
+                        status[index] = true;
+                    }
+
+                    ready_condition.notify_all();
+                    condition.notify_one();
                 }
             }
-        });
+        }
     }
 
     inmemory_data_generator(const inmemory_data_generator& rhs) = delete;
@@ -495,6 +947,10 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
             stream << "    Augmented Size: " << augmented_size() << std::endl;
         }
 
+        if constexpr (desc::CompressedStorage) {
+            stream << "       Compression: " << input_cache.ratio() << "x" << std::endl;
+        }
+
         return stream;
     }
 
@@ -523,6 +979,9 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
             input_cache.clear();
             batch_cache.clear();
             label_cache.clear();
+            label_batch_cache.clear();
+
+            memory.resize(0);
         }
     }
 
@@ -548,7 +1007,9 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
 
         condition.notify_all();
 
-        main_thread.join();
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
 
     /*!
@@ -557,12 +1018,14 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     void reset_generation() {
         std::unique_lock<std::mutex> ulock(main_lock);
 
+        ++generation;
+
         for (size_t b = 0; b < big_batch_size; ++b) {
             status[b]  = false;
             indices[b] = b;
         }
 
-        condition.notify_one();
+        condition.notify_all();
     }
 
     /*!
@@ -585,12 +1048,17 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
     /*!
      * \brief Shuffle the order of the samples.
      *
+     * The caches are never moved, only the order in which the workers
+     * gather the samples into the batch caches is shuffled.
+     *
      * This should only be done when the generator is at the beginning.
      */
     void shuffle() {
         cpp_assert(!current, "Shuffle should only be performed on start of generation");
 
-        etl::parallel_shuffle(input_cache, label_cache, dll::random_engine());
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
     }
 
     /*!
@@ -613,7 +1081,11 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return The number of elements in the generator
      */
     size_t size() const {
-        return etl::dim<0>(input_cache);
+        if constexpr (desc::CompressedStorage) {
+            return input_cache.rows();
+        } else {
+            return etl::dim<0>(input_cache);
+        }
     }
 
     /*!
@@ -625,7 +1097,7 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling() * etl::dim<0>(input_cache);
+        return augmenters.front().scaling() * size();
     }
 
     /*!
@@ -644,6 +1116,62 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
         return current < size();
     }
 
+    /*!
+     * \brief Returns the number of batches that are ready ahead of the
+     * training (the depth of the read-ahead queue)
+     */
+    size_t ready_batches() const {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        size_t ready = 0;
+
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            ready += status[b] ? 1 : 0;
+        }
+
+        return ready;
+    }
+
+    /*!
+     * \brief Returns the time spent waiting for batches not yet ready, in
+     * seconds, since the last reset
+     */
+    double stall_time() const {
+        return stall.seconds();
+    }
+
+    /*!
+     * \brief Returns the number of waits for batches not yet ready since the
+     * last reset
+     */
+    size_t stall_count() const {
+        return stall.count();
+    }
+
+    /*!
+     * \brief Reset the measure of the time spent waiting for the batches
+     */
+    void reset_stall() {
+        stall.reset();
+    }
+
+    /*!
+     * \brief Pin the augmentation threads to the given CPUs (all the allowed
+     * CPUs if empty). Pinned to their own CPUs, the threads do not take the
+     * place of workers of the scheduler anymore.
+     */
+    void set_affinity(const std::vector<size_t>& cpus) {
+        for (auto& thread : threads) {
+            pin_thread(thread, cpus.empty() ? allowed_cpus() : cpus);
+        }
+
+        if (cpus.empty() && !reservation) {
+            reservation = std::make_unique<thread_reservation>(get_scheduler(), workers_n);
+        } else if (!cpus.empty()) {
+            reservation.reset();
+        }
+    }
+
     /*!
      * \brief Moves to the next batch.
      *
@@ -671,42 +1199,52 @@ struct inmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_au
      * \return a a batch of data.
      */
     auto data_batch() const {
+        const auto b = wait_batch();
+
+        return device_data.get(b, batch_cache(b), current_size(b));
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        const auto b = wait_batch();
+
+        return device_labels.get(b, label_batch_cache(b), current_size(b));
+    }
+
+    /*!
+     * \brief Wait for the current batch to be ready
+     * \return The index of the current batch inside the batch caches
+     */
+    size_t wait_batch() const {
         std::unique_lock<std::mutex> ulock(main_lock);
 
         const auto batch = current / batch_size;
         const auto b     = batch % big_batch_size;
 
-        if (status[b]) {
-            const auto input_n = indices[b] * batch_size + batch_size;
-
-            if (input_n > size()) {
-                return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
-            } else {
-                return etl::slice(batch_cache(b), 0, batch_size);
-            }
-        }
-
-        ready_condition.wait(ulock, [this, b] {
+        stall.wait(ready_condition, ulock, [this, b] {
             return status[b];
         });
 
+        return b;
+    }
+
+    /*!
+     * \brief Returns the number of samples of the given (ready) batch
+     * \param b The index of the batch inside the batch caches
+     */
+    size_t current_size(size_t b) const {
         const auto input_n = indices[b] * batch_size + batch_size;
 
         if (input_n > size()) {
-            return etl::slice(batch_cache(b), 0, batch_size - (input_n - size()));
+            return batch_size - (input_n - size());
         } else {
-            return etl::slice(batch_cache(b), 0, batch_size);
+            return batch_size;
         }
     }
 
-    /*!
-     * \brief Returns the current label batch
-     * \return a a batch of label.
-     */
-    auto label_batch() const {
-        return etl::slice(label_cache, current, std::min(current + batch_size, size()));
-    }
-
     /*!
      * \brief Returns the number of dimensions of the input.
      * \return The number of dimensions of the input.
@@ -756,6 +1294,11 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of threads filling the batch cache
+     */
+    static constexpr size_t AugmentationWorkers = detail::get_value_v<augmentation_workers<1>, Parameters...>;
+
     /*!
      * \brief Indicates if the generators must make the labels categorical
      */
@@ -786,6 +1329,11 @@ struct inmemory_data_generator_desc {
      */
     static constexpr size_t ElasticDistortion = detail::get_value_v<elastic_distortion<0>, Parameters...>;
 
+    /*!
+     * \brief The number of precomputed elastic displacement fields
+     */
+    static constexpr size_t ElasticBank = detail::get_value_v<elastic_bank<0>, Parameters...>;
+
     /*!
      * \brief The noise
      */
@@ -811,16 +1359,29 @@ struct inmemory_data_generator_desc {
      */
     static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
 
+    /*!
+     * \brief Indicates if the inputs are stored in compressed uint8 samples
+     */
+    static constexpr bool CompressedStorage = parameters::template contains<compressed_storage>();
+
+    /*!
+     * \brief Indicates if the inputs are stored in uint8
+     */
+    static constexpr bool Uint8Storage = parameters::template contains<uint8_storage>() || CompressedStorage;
+
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(AugmentationWorkers > 0, "There must be at least one augmentation worker");
+    static_assert(!ElasticBank || ElasticDistortion, "elastic_bank needs elastic_distortion");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
+    static_assert(!(CompressedStorage && (random_crop_x || random_crop_y)), "compressed storage is not compatible with random crop");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
-                batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
-                categorical_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                batch_size_id, big_batch_size_id, augmentation_workers_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id, elastic_distortion_id,
+                elastic_bank_id, categorical_id, noise_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, uint8_storage_id, compressed_storage_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
@@ -70,7 +70,9 @@ struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<Desc::Categorical
 /*!
  * \brief Helper to create and initialize a cache for labels.
  *
- * This version keeps the flat label as such.
+ * This version keeps the flat label as such. With the categorical cross
+ * entropy loss, these labels are used as sparse labels (the index of the
+ * class of each sample), without expanding them to one-hot vectors.
  */
 template <typename Desc, typename T, typename LIterator>
 struct label_cache_helper<Desc, T, LIterator, std::enable_if_t<!Desc::Categorical && !etl::is_etl_expr<typename std::iterator_traits<LIterator>::value_type>>> {
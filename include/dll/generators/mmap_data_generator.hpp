@@ -0,0 +1,574 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator over a memory-mapped dataset
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "dll/generators/mmap_dataset.hpp"
+#include "dll/generators/class_sampler.hpp"
+#include "dll/generators/importance_sampler.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A data generator over a memory-mapped dataset file.
+ *
+ * The dataset is never loaded in memory: the pages of the file are brought
+ * in by the kernel when the batches are read. When the records are stored in
+ * the weight type and no pre-transformation is necessary, the batches are
+ * directly views on the mapping, without any copy. Otherwise (uint8 records,
+ * pre-transformations or shuffled order), each batch is converted in a
+ * single batch buffer when it is requested.
+ *
+ * \tparam T The weight type of the batches
+ * \tparam D The number of dimensions of one sample
+ * \tparam Desc The generator descriptor
+ */
+template <typename T, size_t D, typename Desc>
+struct mmap_data_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    using data_view_type   = etl::custom_dyn_matrix<weight, D + 1>; ///< The type of the views on the data
+    using label_cache_type = std::conditional_t<desc::Categorical, etl::dyn_matrix<weight, 2>, etl::dyn_matrix<weight, 1>>; ///< The type of the label batch
+
+    static constexpr bool dll_generator = true;            ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size  = desc::BatchSize; ///< The size of the generated batches
+
+    /*!
+     * \brief Indicates if the samples must be transformed before being used
+     */
+    static constexpr bool transformed = desc::ScalePre || desc::BinarizePre || desc::NormalizePre;
+
+    static_assert(D > 0 && D <= mmap_dataset_header::max_rank, "Invalid number of dimensions for mmap_data_generator");
+
+    mmap_dataset dataset; ///< The mapped dataset
+
+    std::unique_ptr<data_view_type> data_view;  ///< The view on all the records (zero-copy)
+    mutable std::vector<weight> batch_memory;   ///< The memory of the batch buffer
+    std::unique_ptr<data_view_type> batch_view; ///< The view on the batch buffer
+    mutable label_cache_type label_cache;       ///< The label batch
+
+    std::vector<size_t> order;     ///< The order of the samples, when shuffled
+    class_sampler sampler;         ///< The sampler of the samples, with balanced_sampling
+    importance_sampler importance; ///< The sampler of the samples, with importance_sampling
+
+    size_t current = 0;     ///< The current index
+    bool zero_copy = false; ///< Indicates if the batches are served directly from the mapping
+
+    mutable size_t filled_data  = size_t(-1); ///< The index of the batch in the batch buffer
+    mutable size_t filled_label = size_t(-1); ///< The index of the batch in the label batch
+
+    /*!
+     * \brief Construct a mmap_data_generator
+     * \param path The path to the dataset file
+     */
+    explicit mmap_data_generator(const std::string& path) : dataset(path) {
+        if (!dataset.valid()) {
+            return;
+        }
+
+        if (dataset.header.rank != D) {
+            std::cerr << "ERROR: Dataset " << path << " has samples of " << dataset.header.rank << " dimensions, expected " << D << std::endl;
+            dataset.header.samples = 0;
+            return;
+        }
+
+        zero_copy = !transformed && dataset.header.type == mmap_dataset_type::FLOAT && std::is_same<weight, float>::value;
+
+        std::array<size_t, D + 1> dims;
+        dims[0] = dataset.size();
+
+        for (size_t d = 0; d < D; ++d) {
+            dims[d + 1] = dataset.header.dims[d];
+        }
+
+        if (zero_copy) {
+            data_view = make_view(reinterpret_cast<weight*>(dataset.data()), dims, std::make_index_sequence<D + 1>());
+        }
+
+        dims[0] = batch_size;
+
+        batch_memory.resize(batch_size * dataset.header.sample_size());
+        batch_view = make_view(batch_memory.data(), dims, std::make_index_sequence<D + 1>());
+
+        if constexpr (desc::Categorical) {
+            label_cache = label_cache_type(batch_size, dataset.header.n_classes);
+        } else {
+            label_cache = label_cache_type(batch_size);
+        }
+
+        // Only the labels of the file are read to gather the classes
+        if constexpr (desc::BalancedSampling) {
+            sampler = class_sampler(dataset.size(), dataset.header.n_classes, [this](size_t i) { return dataset.label(i); });
+            shuffle();
+        }
+
+        if constexpr (desc::ImportanceSampling) {
+            importance = importance_sampler(dataset.size());
+        }
+    }
+
+    mmap_data_generator(const mmap_data_generator& rhs) = delete;
+    mmap_data_generator operator=(const mmap_data_generator& rhs) = delete;
+
+    mmap_data_generator(mmap_data_generator&& rhs) = delete;
+    mmap_data_generator operator=(mmap_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Memory-Mapped Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "         Zero-Copy: " << (zero_copy ? "yes" : "no") << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing is kept in memory
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing is kept in memory
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current      = 0;
+        filled_data  = size_t(-1);
+        filled_label = size_t(-1);
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        reset();
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * The records are never moved, only the order in which they are read is
+     * shuffled. A shuffled generator cannot serve its batches without a copy.
+     *
+     * With shuffle_shards, the order of the shards and the order of the
+     * samples inside each shard are shuffled, so the records are still read
+     * from one contiguous region of the file at a time.
+     *
+     * With balanced_sampling, the samples of the epoch are drawn again from
+     * the classes.
+     *
+     * With importance_sampling, the samples of the epoch are drawn again
+     * from their last losses, once all of them have been seen.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        order.resize(size());
+
+        auto& g = dll::rand_engine();
+
+        if constexpr (desc::BalancedSampling) {
+            if (sampler.empty()) {
+                std::iota(order.begin(), order.end(), 0);
+            } else {
+                sampler.fill(order, size(), g);
+            }
+        } else if constexpr (desc::ImportanceSampling) {
+            importance.fill(order, size(), g);
+        } else if constexpr (desc::ShuffleShards) {
+            constexpr size_t S = desc::ShuffleShards;
+
+            std::vector<size_t> shards((size() + S - 1) / S);
+            std::iota(shards.begin(), shards.end(), 0);
+            std::shuffle(shards.begin(), shards.end(), g);
+
+            auto it = order.begin();
+
+            for (auto shard : shards) {
+                auto first = it;
+
+                for (size_t i = shard * S; i < std::min((shard + 1) * S, size()); ++i) {
+                    *it++ = i;
+                }
+
+                std::shuffle(first, it, g);
+            }
+        } else {
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), g);
+        }
+    }
+
+    /*!
+     * \brief Set the weights of the classes for balanced_sampling and draw
+     * the order of the samples again.
+     *
+     * This should only be done when the generator is at the beginning.
+     *
+     * \param weights The weight of each class
+     */
+    void set_class_weights(const std::vector<double>& weights) {
+        static_assert(desc::BalancedSampling, "Class weights are only used with balanced_sampling");
+
+        sampler.set_weights(weights);
+        shuffle();
+    }
+
+    /*!
+     * \brief Returns the weights of the samples of the current batch, for
+     * importance_sampling.
+     *
+     * The weighted gradient of the batch is an unbiased estimate of the
+     * gradient over the dataset.
+     */
+    std::vector<weight> sample_weights() const {
+        static_assert(desc::ImportanceSampling, "Sample weights are only used with importance_sampling");
+
+        const size_t n = std::min(batch_size, size() - current);
+
+        std::vector<weight> weights(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            weights[i] = weight(importance.weight(index(i)));
+        }
+
+        return weights;
+    }
+
+    /*!
+     * \brief Record the losses of the samples of the current batch, for
+     * importance_sampling. They are used to draw the next epochs.
+     *
+     * \param losses The loss of each sample of the current batch
+     */
+    void update_sample_losses(const std::vector<double>& losses) {
+        static_assert(desc::ImportanceSampling, "Sample losses are only used with importance_sampling");
+
+        const size_t n = std::min({batch_size, size() - current, losses.size()});
+
+        for (size_t i = 0; i < n; ++i) {
+            importance.update(index(i), losses[i]);
+        }
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current / batch_size;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return dataset.size();
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return size() / batch_size + (size() % batch_size == 0 ? 0 : 1);
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < size();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        current += batch_size;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        const size_t n = std::min(batch_size, size() - current);
+
+        if (zero_copy && order.empty()) {
+            return etl::slice(*data_view, current, current + n);
+        }
+
+        if (filled_data != current) {
+            fill_data(n);
+            filled_data = current;
+        }
+
+        return etl::slice(*batch_view, 0, n);
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        if constexpr (desc::AutoEncoder) {
+            return data_batch();
+        } else {
+            const size_t n = std::min(batch_size, size() - current);
+
+            if (filled_label != current) {
+                if constexpr (desc::Categorical) {
+                    one_hot_scatter(label_cache, n, [this](size_t i) { return size_t(dataset.label(index(i))); });
+                } else {
+                    for (size_t i = 0; i < n; ++i) {
+                        label_cache[i] = weight(dataset.label(index(i)));
+                    }
+                }
+
+                filled_label = current;
+            }
+
+            return etl::slice(label_cache, 0, n);
+        }
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Create a view on the given memory
+     */
+    template <size_t... I>
+    static std::unique_ptr<data_view_type> make_view(weight* memory, const std::array<size_t, D + 1>& dims, std::index_sequence<I...> /*seq*/) {
+        return std::make_unique<data_view_type>(memory, dims[I]...);
+    }
+
+    /*!
+     * \brief Returns the index of the ith sample of the current batch
+     */
+    size_t index(size_t i) const {
+        return order.empty() ? current + i : order[current + i];
+    }
+
+    /*!
+     * \brief Convert the current batch into the batch buffer
+     * \param n The number of samples in the batch
+     */
+    void fill_data(size_t n) const {
+        const size_t s = dataset.header.sample_size();
+
+        weight* out = batch_memory.data();
+
+        for (size_t i = 0; i < n; ++i) {
+            const char* record = dataset.data() + index(i) * s * dataset.header.value_size();
+
+            if (dataset.header.type == mmap_dataset_type::UINT8) {
+                auto* in = reinterpret_cast<const uint8_t*>(record);
+
+                for (size_t j = 0; j < s; ++j) {
+                    out[i * s + j] = weight(in[j]);
+                }
+            } else if (dataset.header.type == mmap_dataset_type::BFLOAT16) {
+                for (size_t j = 0; j < s; ++j) {
+                    uint16_t value;
+                    std::memcpy(&value, record + j * sizeof(uint16_t), sizeof(value));
+                    out[i * s + j] = weight(from_bf16(value));
+                }
+            } else {
+                auto* in = reinterpret_cast<const float*>(record);
+
+                for (size_t j = 0; j < s; ++j) {
+                    out[i * s + j] = weight(in[j]);
+                }
+            }
+
+            auto sub = (*batch_view)(i);
+
+            pre_scaler<desc>::transform(sub);
+            pre_normalizer<desc>::transform(sub);
+            pre_binarizer<desc>::transform(sub);
+        }
+    }
+};
+
+template <typename T, size_t D, typename Desc>
+const size_t mmap_data_generator<T, D, Desc>::batch_size;
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename T, size_t D, typename Desc>
+std::ostream& operator<<(std::ostream& os, mmap_data_generator<T, D, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Descriptor for a mmap_data_generator
+ */
+template <typename... Parameters>
+struct mmap_data_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the generators must make the labels categorical
+     */
+    static constexpr bool Categorical = parameters::template contains<categorical>();
+
+    /*!
+     * \brief The scaling
+     */
+    static constexpr size_t ScalePre = detail::get_value_v<scale_pre<0>, Parameters...>;
+
+    /*!
+     * \brief The binarization threshold
+     */
+    static constexpr size_t BinarizePre = detail::get_value_v<binarize_pre<0>, Parameters...>;
+
+    /*!
+     * \brief Indicates if input are normalized
+     */
+    static constexpr bool NormalizePre = parameters::template contains<normalize_pre>();
+
+    /*!
+     * \brief Indicates if this is an auto-encoder task
+     */
+    static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
+
+    /*!
+     * \brief The number of samples of a shard for shuffling (0 for a
+     * complete shuffle)
+     */
+    static constexpr size_t ShuffleShards = detail::get_value_v<shuffle_shards<0>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the epochs are drawn from the classes
+     */
+    static constexpr bool BalancedSampling = parameters::template contains<balanced_sampling>();
+
+    /*!
+     * \brief Indicates if the epochs are drawn from the losses of the samples
+     */
+    static constexpr bool ImportanceSampling = parameters::template contains<importance_sampling>();
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+    static_assert(!BalancedSampling || !ImportanceSampling, "balanced_sampling and importance_sampling cannot be combined");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<
+            cpp::type_list<batch_size_id, categorical_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, shuffle_shards_id, balanced_sampling_id, importance_sampling_id>,
+            Parameters...>,
+        "Invalid parameters type for mmap_data_generator_desc");
+
+    /*!
+     * The generator type
+     */
+    template <typename T, size_t D>
+    using generator_t = mmap_data_generator<T, D, mmap_data_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a generator over a memory-mapped dataset file
+ * \tparam D The number of dimensions of one sample
+ * \tparam T The weight type of the batches
+ * \param path The path to the dataset file
+ * \return a unique_ptr around the created generator
+ */
+template <size_t D, typename T = float, typename... Parameters>
+auto make_mmap_generator(const std::string& path, const mmap_data_generator_desc<Parameters...>& /*desc*/) {
+    using generator_t = typename mmap_data_generator_desc<Parameters...>::template generator_t<T, D>;
+    return std::make_unique<generator_t>(path);
+}
+
+} //end of dll namespace
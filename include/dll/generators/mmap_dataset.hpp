@@ -0,0 +1,416 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Binary dataset format designed to be memory-mapped.
+ *
+ * A file is made of a fixed header, followed by the records of all the
+ * samples, stored contiguously (uint8 or float), and then by the labels of
+ * all the samples (uint32). The records start on a page boundary, so that a
+ * mapping of the file can directly be used as a tensor of samples.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/bfloat16.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The type of the values of the records of a memory-mapped dataset
+ */
+enum class mmap_dataset_type : uint32_t {
+    UINT8    = 0, ///< Unsigned 8 bits integers (raw pixels)
+    FLOAT    = 1, ///< Single-precision floating point
+    BFLOAT16 = 2  ///< bfloat16 (upper half of single-precision)
+};
+
+/*!
+ * \brief The header of a memory-mapped dataset file
+ */
+struct mmap_dataset_header {
+    static constexpr uint32_t current_version = 1;    ///< The version of the format
+    static constexpr size_t max_rank          = 3;    ///< The maximum number of dimensions of a sample
+    static constexpr size_t data_alignment    = 4096; ///< The alignment of the records
+
+    char magic[4];           ///< The magic number ("DLLD")
+    uint32_t version;        ///< The version of the format
+    mmap_dataset_type type;  ///< The type of the values
+    uint32_t rank;           ///< The number of dimensions of a sample
+    uint64_t samples;        ///< The number of samples
+    uint64_t dims[max_rank]; ///< The dimensions of a sample
+    uint64_t n_classes;      ///< The number of classes
+    uint64_t data_offset;    ///< The offset of the records in the file
+    uint64_t label_offset;   ///< The offset of the labels in the file
+
+    /*!
+     * \brief Returns the number of values of one sample
+     */
+    size_t sample_size() const {
+        size_t s = 1;
+
+        for (size_t d = 0; d < rank; ++d) {
+            s *= dims[d];
+        }
+
+        return s;
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of one value
+     */
+    size_t value_size() const {
+        switch (type) {
+            case mmap_dataset_type::UINT8:
+                return sizeof(uint8_t);
+            case mmap_dataset_type::BFLOAT16:
+                return sizeof(uint16_t);
+            default:
+                return sizeof(float);
+        }
+    }
+
+    /*!
+     * \brief Returns the expected size of the file
+     */
+    size_t file_size() const {
+        return label_offset + samples * sizeof(uint32_t);
+    }
+
+    /*!
+     * \brief Indicates if the header is valid for a file of the given length
+     * \param length The length of the file, in bytes
+     */
+    bool valid(size_t length) const {
+        return std::memcmp(magic, "DLLD", 4) == 0 && version == current_version && rank <= max_rank && file_size() <= length;
+    }
+};
+
+/*!
+ * \brief Incremental writer of a dataset in the memory-mapped format.
+ *
+ * The number of samples and their dimensions must be known when the file is
+ * opened. The records are then appended one by one (or batch by batch) and
+ * the labels are written when the writer is closed. This makes it possible
+ * to write datasets that could not be held in memory.
+ */
+struct mmap_dataset_writer {
+    /*!
+     * \brief Open the given file for writing
+     * \param path The path of the file to write
+     * \param samples The number of samples of the dataset
+     * \param dims The dimensions of one sample
+     * \param n_classes The number of classes
+     * \param type The type of value to store in the file
+     * \return true if the file was opened, false otherwise
+     */
+    bool open(const std::string& path, size_t samples, const std::vector<size_t>& dims, size_t n_classes, mmap_dataset_type type = mmap_dataset_type::FLOAT) {
+        this->path = path;
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "DLLD", 4);
+
+        header.version   = mmap_dataset_header::current_version;
+        header.type      = type;
+        header.rank      = dims.size();
+        header.samples   = samples;
+        header.n_classes = n_classes;
+
+        if (header.rank > mmap_dataset_header::max_rank) {
+            std::cerr << "ERROR: Samples of too many dimensions for " << path << std::endl;
+            return false;
+        }
+
+        for (size_t d = 0; d < header.rank; ++d) {
+            header.dims[d] = dims[d];
+        }
+
+        auto align = [](size_t offset, size_t alignment) { return ((offset + alignment - 1) / alignment) * alignment; };
+
+        header.data_offset  = align(sizeof(header), mmap_dataset_header::data_alignment);
+        header.label_offset = align(header.data_offset + header.samples * header.sample_size() * header.value_size(), 64);
+
+        os.open(path, std::ofstream::binary);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return false;
+        }
+
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.seekp(header.data_offset);
+
+        record.resize(header.sample_size() * header.value_size());
+        labels.clear();
+        labels.reserve(samples);
+
+        return true;
+    }
+
+    /*!
+     * \brief Append one sample to the dataset
+     * \param sample The sample to append
+     * \param label The label of the sample
+     */
+    template <typename Sample>
+    void write(const Sample& sample, size_t label = 0) {
+        const size_t n = header.sample_size();
+
+        cpp_assert(etl::size(sample) == n, "All the samples must have the same size");
+        cpp_assert(labels.size() < header.samples, "Too many samples written");
+
+        encode(record.data(), sample, n);
+
+        os.write(record.data(), record.size());
+
+        labels.push_back(uint32_t(label));
+    }
+
+    /*!
+     * \brief Append n samples, stored contiguously, to the dataset, with a
+     * single write
+     * \param values The values of the samples (n x sample size)
+     * \param sample_labels The label of each sample
+     * \param n The number of samples
+     */
+    template <typename T>
+    void write_records(const T* values, const uint32_t* sample_labels, size_t n) {
+        const size_t size = n * header.sample_size();
+
+        cpp_assert(labels.size() + n <= header.samples, "Too many samples written");
+
+        records.resize(size * header.value_size());
+
+        encode(records.data(), values, size);
+
+        os.write(records.data(), records.size());
+
+        labels.insert(labels.end(), sample_labels, sample_labels + n);
+    }
+
+    /*!
+     * \brief Append a batch of samples (without labels) to the dataset
+     */
+    template <typename Batch>
+    void write_batch(const Batch& batch) {
+        for (size_t i = 0; i < etl::dim<0>(batch); ++i) {
+            write(batch(i));
+        }
+    }
+
+    /*!
+     * \brief Write the labels and close the file
+     * \return true if the dataset was completely written, false otherwise
+     */
+    bool close() {
+        if (labels.size() != header.samples) {
+            std::cerr << "ERROR: Incomplete dataset " << path << std::endl;
+            return false;
+        }
+
+        os.seekp(header.label_offset);
+        os.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(uint32_t));
+        os.close();
+
+        return bool(os);
+    }
+
+private:
+    /*!
+     * \brief Encode n values in the type of the dataset
+     */
+    template <typename Values>
+    void encode(char* out, const Values& values, size_t n) const {
+        if (header.type == mmap_dataset_type::UINT8) {
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = char(uint8_t(std::min(255.0, std::max(0.0, std::round(double(values[i]))))));
+            }
+        } else if (header.type == mmap_dataset_type::BFLOAT16) {
+            for (size_t i = 0; i < n; ++i) {
+                uint16_t value = to_bf16(float(values[i]));
+                std::memcpy(out + i * sizeof(uint16_t), &value, sizeof(uint16_t));
+            }
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                float value = values[i];
+                std::memcpy(out + i * sizeof(float), &value, sizeof(float));
+            }
+        }
+    }
+
+    std::string path;             ///< The path of the file
+    mmap_dataset_header header;   ///< The header of the dataset
+    std::ofstream os;             ///< The output stream
+    std::vector<char> record;     ///< The buffer for one record
+    std::vector<char> records;    ///< The buffer for several records
+    std::vector<uint32_t> labels; ///< The labels of the written samples
+};
+
+/*!
+ * \brief Write a dataset in the memory-mapped format.
+ *
+ * \param path The path of the file to write
+ * \param samples The samples (ETL containers, all of the same dimensions)
+ * \param labels The label (class index) of each sample
+ * \param n_classes The number of classes
+ * \param type The type of value to store in the file
+ *
+ * \return true if the dataset was written, false otherwise
+ */
+template <typename Samples, typename Labels>
+bool write_mmap_dataset(const std::string& path, const Samples& samples, const Labels& labels, size_t n_classes, mmap_dataset_type type = mmap_dataset_type::FLOAT) {
+    if (samples.empty() || samples.size() != labels.size()) {
+        std::cerr << "ERROR: Invalid dataset for " << path << std::endl;
+        return false;
+    }
+
+    auto& first = *samples.begin();
+
+    std::vector<size_t> dims(etl::dimensions(first));
+
+    for (size_t d = 0; d < dims.size(); ++d) {
+        dims[d] = etl::dim(first, d);
+    }
+
+    mmap_dataset_writer writer;
+
+    if (!writer.open(path, samples.size(), dims, n_classes, type)) {
+        return false;
+    }
+
+    auto label = labels.begin();
+
+    for (auto& sample : samples) {
+        writer.write(sample, *label++);
+    }
+
+    return writer.close();
+}
+
+/*!
+ * \brief A read-only mapping of a memory-mapped dataset file.
+ *
+ * The file is mapped privately, so the records can be exposed through
+ * mutable views without any risk of modifying the file.
+ */
+struct mmap_dataset {
+    mmap_dataset_header header; ///< The header of the dataset
+
+    /*!
+     * \brief Map the given file
+     * \param path The path to the dataset file
+     */
+    explicit mmap_dataset(const std::string& path) {
+        std::memset(&header, 0, sizeof(header));
+
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+
+        if (::fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(header)) {
+            std::cerr << "ERROR: Invalid dataset file: " << path << std::endl;
+            return;
+        }
+
+        length = st.st_size;
+        memory = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+        if (memory == MAP_FAILED) {
+            memory = nullptr;
+            std::cerr << "ERROR: Impossible to map " << path << std::endl;
+            return;
+        }
+
+        std::memcpy(&header, memory, sizeof(header));
+
+        if (!header.valid(length)) {
+            std::cerr << "ERROR: Invalid dataset file: " << path << std::endl;
+            std::memset(&header, 0, sizeof(header));
+            return;
+        }
+
+        // The records are generally read in order
+        ::madvise(memory, length, MADV_SEQUENTIAL);
+    }
+
+    mmap_dataset(const mmap_dataset& rhs) = delete;
+    mmap_dataset& operator=(const mmap_dataset& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~mmap_dataset() {
+        if (memory) {
+            ::munmap(memory, length);
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the dataset was correctly mapped
+     */
+    bool valid() const {
+        return header.version == mmap_dataset_header::current_version;
+    }
+
+    /*!
+     * \brief Returns the number of samples in the dataset
+     */
+    size_t size() const {
+        return header.samples;
+    }
+
+    /*!
+     * \brief Returns a pointer to the records of the dataset
+     */
+    char* data() const {
+        return static_cast<char*>(memory) + header.data_offset;
+    }
+
+    /*!
+     * \brief Returns the label of the given sample
+     */
+    uint32_t label(size_t i) const {
+        uint32_t value;
+        std::memcpy(&value, static_cast<const char*>(memory) + header.label_offset + i * sizeof(uint32_t), sizeof(value));
+        return value;
+    }
+
+private:
+    int fd        = -1;      ///< The file descriptor
+    void* memory  = nullptr; ///< The mapped memory
+    size_t length = 0;       ///< The length of the mapping
+};
+
+} //end of dll namespace
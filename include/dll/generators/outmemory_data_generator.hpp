@@ -14,6 +14,7 @@
 
 #include <atomic>
 #include <thread>
+#include <vector>
 
 namespace dll {
 
@@ -43,6 +44,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
 
+    memory_record memory{memory_subsystem::GENERATORS, no_memory_layer, 0}; ///< The accounting of the caches
+
     size_t current      = 0;     ///< The current index
     size_t current_real = 0;     ///< The current real index
     size_t current_b    = 0;     ///< The current batch
@@ -68,6 +71,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
             : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit) {
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
+        memory.resize(memory_size(batch_cache, label_cache));
 
         reset();
 
@@ -113,6 +117,15 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         is_safe = true;
     }
 
+    /*!
+     * \brief Pin the threads of the generator to the given CPUs. The batches
+     * of this generator are prepared by the thread of the training, so this
+     * has no effect.
+     */
+    void set_affinity(const std::vector<size_t>& cpus) {
+        cpp_unused(cpus);
+    }
+
     /*!
      * \brier Clear the memory of the generator.
      *
@@ -122,6 +135,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<!is_
         if (is_safe) {
             batch_cache.clear();
             label_cache.clear();
+
+            memory.resize(0);
         }
     }
 
@@ -309,24 +324,39 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
     static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches kept in cache
 
+    static constexpr size_t workers_n = desc::AugmentationWorkers; ///< The number of augmentation workers
+
     big_data_cache_type batch_cache;  ///< The data batch cache
     big_label_cache_type label_cache; ///< The label batch cache
 
+    memory_record memory{memory_subsystem::GENERATORS, no_memory_layer, 0}; ///< The accounting of the caches
+
+    device_batches<weight, etl::dimensions<big_data_cache_type>() - 1, big_batch_size> device_data;    ///< The device copies of the data batches
+    device_batches<weight, etl::dimensions<big_label_cache_type>() - 1, big_batch_size> device_labels; ///< The device copies of the label batches
+
     size_t current      = 0;     ///< The current index
     size_t current_read = 0;     ///< The current index read
     bool is_safe        = false; ///< Indicates if the generator is safe to reclaim memory from
 
     mutable volatile bool status[big_batch_size];    ///< Status of each batch
+    mutable volatile bool working[big_batch_size];   ///< Indicates if a worker is filling each batch
     mutable volatile size_t indices[big_batch_size]; ///< Indices of each batch
 
+    size_t generation = 0; ///< The generation, incremented on each reset
+
     mutable std::mutex main_lock;                    ///< The main lock
-    mutable std::condition_variable condition;       ///< The condition variable for the thread to wait for some space
+    mutable std::condition_variable condition;       ///< The condition variable for the threads to wait for some space
     mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+    mutable stall_timer stall;                       ///< The time spent waiting for the batches
 
-    volatile bool stop_flag = false; ///< Boolean flag indicating to the thread to stop
+    std::mutex read_lock; ///< The lock protecting the (sequential) reading of the input iterators
 
-    std::thread main_thread; ///< The main thread
-    bool train_mode = false; ///< The train mode status
+    volatile bool stop_flag = false; ///< Boolean flag indicating to the threads to stop
+
+    std::vector<std::thread> threads; ///< The augmentation threads
+    bool train_mode = false;          ///< The train mode status
+
+    std::unique_ptr<thread_reservation> reservation; ///< The threads of the scheduler left to the augmentation threads
 
     const size_t _size; ///< The size of the dataset
     Iterator orig_it;   ///< The original first iterator on data
@@ -334,10 +364,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
     Iterator it;        ///< The current iterator on data
     LIterator lit;      ///< The current iterator on label
 
-    random_cropper<Desc> cropper;      ///< The random cropper
-    random_mirrorer<Desc> mirrorer;    ///< The random mirrorer
-    elastic_distorter<Desc> distorter; ///< The elastic distorter
-    random_noise<Desc> noiser;         ///< The random noiser
+    std::vector<augmentation_worker<Desc>> augmenters; ///< The augmenters of each worker
 
     /*!
      * \brief Construct an outmemory_data_generator
@@ -349,113 +376,158 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \param size The size of the entire dataset
      */
     outmemory_data_generator(Iterator first, Iterator last, LIterator lfirst, LIterator llast, size_t n_classes, size_t size)
-            : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit), cropper(*first), mirrorer(*first), distorter(*first), noiser(*first) {
+            : _size(size), orig_it(first), orig_lit(lfirst), it(orig_it), lit(orig_lit) {
         data_cache_helper_t::init_big(first, batch_cache);
         label_cache_helper_t::init_big(n_classes, lfirst, label_cache);
+        memory.resize(memory_size(batch_cache, label_cache));
 
         cpp_unused(last);
         cpp_unused(llast);
 
-        main_thread = std::thread([this] {
-            while (true) {
-                // The index of the batch inside the batch cache
-                size_t index = 0;
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            status[b]  = false;
+            working[b] = false;
+            indices[b] = b;
+        }
 
-                {
-                    std::unique_lock<std::mutex> ulock(main_lock);
+        augmenters.reserve(workers_n);
 
-                    bool found = false;
+        for (size_t t = 0; t < workers_n; ++t) {
+            augmenters.emplace_back(*first, t);
+        }
 
-                    // Try to find a read batch first
-                    for (size_t b = 0; b < big_batch_size; ++b) {
-                        if (!status[b] && indices[b] * batch_size < _size) {
-                            index = b;
-                            found = true;
-                            break;
-                        }
-                    }
+        for (size_t t = 0; t < workers_n; ++t) {
+            threads.emplace_back([this, t] { work(augmenters[t]); });
+        }
 
-                    // if not found, wait for a ready to compute batch
-
-                    if (!found) {
-                        // Wait for the end or for some work
-                        condition.wait(ulock, [this, &index] {
-                            if (stop_flag) {
-                                return true;
-                            }
-
-                            for (size_t b = 0; b < big_batch_size; ++b) {
-                                if (!status[b] && indices[b] * batch_size < _size) {
-                                    index = b;
-                                    return true;
-                                }
-                            }
-
-                            return false;
-                        });
-
-                        // If there is no more thread for the thread, exit
-                        if (stop_flag) {
-                            return;
-                        }
-                    }
+        // The augmentation threads are not scheduled, they take the place of workers
+        reservation = std::make_unique<thread_reservation>(get_scheduler(), workers_n);
+    }
+
+    /*!
+     * \brief Wait for a batch of the cache to fill and claim it.
+     * \param index The index of the claimed batch inside the batch cache
+     * \param gen The generation of the claimed batch
+     * \return false if the generator is stopping, true otherwise
+     */
+    bool claim(size_t& index, size_t& gen) {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        condition.wait(ulock, [this, &index] {
+            if (stop_flag) {
+                return true;
+            }
+
+            for (size_t b = 0; b < big_batch_size; ++b) {
+                if (!status[b] && !working[b] && indices[b] * batch_size < _size) {
+                    index = b;
+                    return true;
                 }
+            }
 
-                SERIAL_SECTION {
-                    for (size_t i = 0; i < batch_size && current_read < _size; ++i) {
-                        auto sub = batch_cache(index)(i);
+            return false;
+        });
 
-                        if (train_mode) {
-                            // Random crop the image
-                            cropper.transform_first(sub, *it);
+        if (stop_flag) {
+            return false;
+        }
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
+        working[index] = true;
+        gen            = generation;
 
-                            // Mirror the image
-                            mirrorer.transform(sub);
+        return true;
+    }
 
-                            // Distort the image
-                            distorter.transform(sub);
+    /*!
+     * \brief The loop of an augmentation worker.
+     *
+     * The input iterators can only be read sequentially, so the batches are
+     * claimed and read in order, under the read lock. The transformations of
+     * the images are then done concurrently with the other workers.
+     *
+     * \param w The augmenters of the worker
+     */
+    void work(augmentation_worker<Desc>& w) {
+        // The workers already run concurrently, there is no need to
+        // parallelize each transformation
+        SERIAL_SECTION {
+            // The index of the batch inside the batch cache
+            size_t index = 0;
+            size_t gen   = 0;
 
-                            // Noise the image
-                            noiser.transform(sub);
-                        } else {
-                            // Center crop the image
-                            cropper.transform_first_test(sub, *it);
+            while (true) {
+                std::unique_lock<std::mutex> rlock(read_lock);
 
-                            pre_scaler<desc>::transform(sub);
-                            pre_normalizer<desc>::transform(sub);
-                            pre_binarizer<desc>::transform(sub);
-                        }
+                if (!claim(index, gen)) {
+                    return;
+                }
 
-                        label_cache_helper_t::set(i, lit, label_cache(index));
+                const bool train = train_mode;
 
-                        // In case of auto-encoders, the label images also need to be transformed
-                        if constexpr (desc::AutoEncoder){
-                            pre_scaler<desc>::transform(label_cache(index)(i));
-                            pre_normalizer<desc>::transform(label_cache(index)(i));
-                            pre_binarizer<desc>::transform(label_cache(index)(i));
-                        }
+                size_t n = 0;
 
-                        ++it;
-                        ++lit;
-                        ++current_read;
+                for (; n < batch_size && current_read < _size; ++n) {
+                    if (train) {
+                        // Random crop and mirror the image while gathering it
+                        w.crop_mirror(batch_cache(index)(n), *it);
+                    } else {
+                        // Center crop the image
+                        w.cropper.transform_first_test(batch_cache(index)(n), *it);
                     }
+
+                    label_cache_helper_t::set(n, lit, label_cache(index));
+
+                    ++it;
+                    ++lit;
+                    ++current_read;
                 }
 
-                // Notify a waiter that one batch is ready
+                rlock.unlock();
+
+                for (size_t i = 0; i < n; ++i) {
+                    auto sub = batch_cache(index)(i);
+
+                    pre_scaler<desc>::transform(sub);
+                    pre_normalizer<desc>::transform(sub);
+                    pre_binarizer<desc>::transform(sub);
+
+                    if (train) {
+                        // Distort the image
+                        w.distorter.transform(sub, w.engine);
+
+                        // Noise the image
+                        w.noiser.transform(sub, w.engine);
+                    }
+
+                    // In case of auto-encoders, the label images also need to be transformed
+                    if constexpr (desc::AutoEncoder){
+                        pre_scaler<desc>::transform(label_cache(index)(i));
+                        pre_normalizer<desc>::transform(label_cache(index)(i));
+                        pre_binarizer<desc>::transform(label_cache(index)(i));
+                    }
+                }
+
+                // Start the transfer of the batch to the device
+                device_data.upload(index, batch_cache(index));
+                device_labels.upload(index, label_cache(index));
+
+                // Notify the waiters that one batch is ready
 
                 {
                     std::unique_lock<std::mutex> ulock(main_lock);
 
-                    status[index] = true;
+                    working[index] = false;
+
+                    // A batch filled before a reset is not valid anymore
+                    if (gen == generation) {
+                        status[index] = true;
+                    }
 
-                    ready_condition.notify_one();
+                    ready_condition.notify_all();
+                    condition.notify_one();
                 }
             }
-        });
+        }
     }
 
     outmemory_data_generator(const outmemory_data_generator& rhs) = delete;
@@ -472,7 +544,9 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
 
         condition.notify_all();
 
-        main_thread.join();
+        for (auto& thread : threads) {
+            thread.join();
+        }
     }
 
     /*!
@@ -516,6 +590,8 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         if (is_safe) {
             batch_cache.clear();
             label_cache.clear();
+
+            memory.resize(0);
         }
     }
 
@@ -543,12 +619,14 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         it           = orig_it;
         lit          = orig_lit;
 
+        ++generation;
+
         for (size_t b = 0; b < big_batch_size; ++b) {
             status[b]  = false;
             indices[b] = b;
         }
 
-        condition.notify_one();
+        condition.notify_all();
     }
 
     /*!
@@ -607,7 +685,7 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
      * \return The augmented number of elements in the generator
      */
     size_t augmented_size() const {
-        return cropper.scaling() * mirrorer.scaling() * noiser.scaling() * distorter.scaling() * size();
+        return augmenters.front().scaling() * size();
     }
 
     /*!
@@ -626,6 +704,62 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         return current < size();
     }
 
+    /*!
+     * \brief Returns the number of batches that are ready ahead of the
+     * training (the depth of the read-ahead queue)
+     */
+    size_t ready_batches() const {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        size_t ready = 0;
+
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            ready += status[b] ? 1 : 0;
+        }
+
+        return ready;
+    }
+
+    /*!
+     * \brief Returns the time spent waiting for batches not yet ready, in
+     * seconds, since the last reset
+     */
+    double stall_time() const {
+        return stall.seconds();
+    }
+
+    /*!
+     * \brief Returns the number of waits for batches not yet ready since the
+     * last reset
+     */
+    size_t stall_count() const {
+        return stall.count();
+    }
+
+    /*!
+     * \brief Reset the measure of the time spent waiting for the batches
+     */
+    void reset_stall() {
+        stall.reset();
+    }
+
+    /*!
+     * \brief Pin the augmentation threads to the given CPUs (all the allowed
+     * CPUs if empty). Pinned to their own CPUs, the threads do not take the
+     * place of workers of the scheduler anymore.
+     */
+    void set_affinity(const std::vector<size_t>& cpus) {
+        for (auto& thread : threads) {
+            pin_thread(thread, cpus.empty() ? allowed_cpus() : cpus);
+        }
+
+        if (cpus.empty() && !reservation) {
+            reservation = std::make_unique<thread_reservation>(get_scheduler(), workers_n);
+        } else if (!cpus.empty()) {
+            reservation.reset();
+        }
+    }
+
     /*!
      * \brief Moves to the next batch.
      *
@@ -659,14 +793,14 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         const auto b     = batch % big_batch_size;
 
         if (status[b]) {
-            return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
+            return device_data.get(b, batch_cache(b), std::min(batch_size, _size - current));
         }
 
-        ready_condition.wait(ulock, [this, b] {
+        stall.wait(ready_condition, ulock, [this, b] {
             return status[b];
         });
 
-        return etl::slice(batch_cache(b), 0, std::min(batch_size, _size - current));
+        return device_data.get(b, batch_cache(b), std::min(batch_size, _size - current));
     }
 
     /*!
@@ -680,14 +814,14 @@ struct outmemory_data_generator<Iterator, LIterator, Desc, std::enable_if_t<is_a
         const auto b     = batch % big_batch_size;
 
         if (status[b]) {
-            return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
+            return device_labels.get(b, label_cache(b), std::min(batch_size, _size - current));
         }
 
-        ready_condition.wait(ulock, [this, b] {
+        stall.wait(ready_condition, ulock, [this, b] {
             return status[b];
         });
 
-        return etl::slice(label_cache(b), 0, std::min(batch_size, _size - current));
+        return device_labels.get(b, label_cache(b), std::min(batch_size, _size - current));
     }
 
     /*!
@@ -744,6 +878,11 @@ struct outmemory_data_generator_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of threads filling the batch cache
+     */
+    static constexpr size_t AugmentationWorkers = detail::get_value_v<augmentation_workers<1>, Parameters...>;
+
     /*!
      * \brief Indicates if the generators must make the labels categorical
      */
@@ -762,7 +901,7 @@ struct outmemory_data_generator_desc {
     /*!
      * \brief Indicates if the generator is threaded
      */
-    static constexpr bool Threaded = parameters::template contains<threaded>();
+    static constexpr bool Threaded = parameters::template contains<threaded>() || AugmentationWorkers > 1;
 
     /*!
      * \brief The random cropping X
@@ -779,6 +918,11 @@ struct outmemory_data_generator_desc {
      */
     static constexpr size_t ElasticDistortion = detail::get_value_v<elastic_distortion<0>, Parameters...>;
 
+    /*!
+     * \brief The number of precomputed elastic displacement fields
+     */
+    static constexpr size_t ElasticBank = detail::get_value_v<elastic_bank<0>, Parameters...>;
+
     /*!
      * \brief The noise
      */
@@ -804,16 +948,29 @@ struct outmemory_data_generator_desc {
      */
     static constexpr bool AutoEncoder = parameters::template contains<autoencoder>();
 
+    /*!
+     * \brief The out-of-memory generator only caches batches, which are never
+     * stored in uint8
+     */
+    static constexpr bool Uint8Storage = false;
+
+    /*!
+     * \brief The out-of-memory generator never compresses its batches
+     */
+    static constexpr bool CompressedStorage = false;
+
     static_assert(BatchSize > 0, "The batch size must be larger than one");
     static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(AugmentationWorkers > 0, "There must be at least one augmentation worker");
+    static_assert(!ElasticBank || ElasticDistortion, "elastic_bank needs elastic_distortion");
     static_assert(!(AutoEncoder && (random_crop_x || random_crop_y)), "autoencoder mode is not compatible with random crop");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
-                batch_size_id, big_batch_size_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
-                elastic_distortion_id, categorical_id, noise_id, threaded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
+                batch_size_id, big_batch_size_id, augmentation_workers_id, horizontal_mirroring_id, vertical_mirroring_id, random_crop_id,
+                elastic_distortion_id, elastic_bank_id, categorical_id, noise_id, threaded_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id>,
             Parameters...>,
         "Invalid parameters type for rbm_desc");
 
@@ -0,0 +1,1164 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Runtime pipelines of data, built stage by stage, usable as DLL
+ * generators.
+ *
+ * A pipeline is made of a source (a memory-mapped dataset, a set of shards
+ * or a range of samples), decoded into the weight type, then of a sequence
+ * of stages applied to each sample (the static kernels scale, normalize and
+ * binarize, and the runtime map and augment functors), then of a shuffle,
+ * of the batching, of the prefetching and of the upload to the device:
+ *
+ * \code
+ * auto generator = dll::make_mmap_pipeline<1>("train.dlld")
+ *     .scale(255.0f)
+ *     .augment(noise)
+ *     .shuffle(4096)
+ *     .prefetch(8)
+ *     .threads(4)
+ *     .batch<64>();
+ * \endcode
+ *
+ * Each worker thread decodes and transforms a complete batch, the batches
+ * being prepared in parallel in a bounded set of prefetch slots. A worker
+ * waits when all the slots are ready but not consumed yet, so the pipeline
+ * never runs more than prefetch batches ahead of the training.
+ */
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "dll/generators/mmap_dataset.hpp"
+#include "dll/generators/device_batches.hpp"
+#include "dll/generators/class_sampler.hpp"
+#include "dll/generators/stall_timer.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A source of samples of a pipeline.
+ *
+ * The samples are read by several workers at the same time, so read must
+ * be thread-safe.
+ *
+ * \tparam T The weight type of the decoded samples
+ */
+template <typename T>
+struct pipeline_source {
+    virtual ~pipeline_source() = default;
+
+    /*!
+     * \brief Returns the number of samples of the source
+     */
+    virtual size_t size() const = 0;
+
+    /*!
+     * \brief Returns the number of classes of the labels
+     */
+    virtual size_t classes() const = 0;
+
+    /*!
+     * \brief Returns the dimensions of one sample
+     */
+    virtual std::vector<size_t> dims() const = 0;
+
+    /*!
+     * \brief Returns the label of the given sample
+     */
+    virtual size_t label(size_t i) const = 0;
+
+    /*!
+     * \brief Read and decode the given samples, contiguously
+     * \param indices The indices of the samples to read
+     * \param n The number of samples to read
+     * \param out The decoded samples (n x sample size)
+     * \param labels The labels of the samples
+     */
+    virtual void read(const size_t* indices, size_t n, T* out, size_t* labels) const = 0;
+};
+
+namespace pipeline_detail {
+
+/*!
+ * \brief Decode n values of the given records into the weight type
+ */
+template <typename T>
+void decode(T* out, const char* records, mmap_dataset_type type, size_t n) {
+    if (type == mmap_dataset_type::UINT8) {
+        auto* in = reinterpret_cast<const uint8_t*>(records);
+
+        for (size_t j = 0; j < n; ++j) {
+            out[j] = T(in[j]);
+        }
+    } else if (type == mmap_dataset_type::BFLOAT16) {
+        for (size_t j = 0; j < n; ++j) {
+            uint16_t value;
+            std::memcpy(&value, records + j * sizeof(uint16_t), sizeof(uint16_t));
+            out[j] = T(from_bf16(value));
+        }
+    } else {
+        for (size_t j = 0; j < n; ++j) {
+            float value;
+            std::memcpy(&value, records + j * sizeof(float), sizeof(float));
+            out[j] = T(value);
+        }
+    }
+}
+
+/*!
+ * \brief Divide the n values of a sample by the given factor
+ */
+template <typename T>
+void scale(T* x, size_t n, T factor) {
+    const T inv = T(1) / factor;
+
+    for (size_t j = 0; j < n; ++j) {
+        x[j] *= inv;
+    }
+}
+
+/*!
+ * \brief Binarize the n values of a sample with the given threshold
+ */
+template <typename T>
+void binarize(T* x, size_t n, T threshold) {
+    for (size_t j = 0; j < n; ++j) {
+        x[j] = x[j] > threshold ? T(1) : T(0);
+    }
+}
+
+/*!
+ * \brief Normalize the n values of a sample to zero mean and unit variance
+ */
+template <typename T>
+void normalize(T* x, size_t n) {
+    double mean = 0.0;
+
+    for (size_t j = 0; j < n; ++j) {
+        mean += x[j];
+    }
+
+    mean /= n;
+
+    double var = 0.0;
+
+    for (size_t j = 0; j < n; ++j) {
+        var += (x[j] - mean) * (x[j] - mean);
+    }
+
+    const double s = std::sqrt(var / n);
+
+    for (size_t j = 0; j < n; ++j) {
+        x[j] = s == 0.0 ? T(x[j] - mean) : T((x[j] - mean) / s);
+    }
+}
+
+/*!
+ * \brief Create a view of the given dimensions on the given memory
+ */
+template <typename T, size_t D, size_t... I>
+etl::custom_dyn_matrix<T, D> make_view(T* memory, const std::array<size_t, D>& dims, std::index_sequence<I...> /*seq*/) {
+    return etl::custom_dyn_matrix<T, D>(memory, dims[I]...);
+}
+
+} //end of namespace pipeline_detail
+
+/*!
+ * \brief A pipeline source over a memory-mapped dataset file
+ */
+template <typename T>
+struct mmap_pipeline_source final : pipeline_source<T> {
+    mmap_dataset dataset; ///< The mapped dataset
+
+    /*!
+     * \brief Map the given dataset file
+     */
+    explicit mmap_pipeline_source(const std::string& path) : dataset(path) {}
+
+    size_t size() const override {
+        return dataset.size();
+    }
+
+    size_t classes() const override {
+        return dataset.header.n_classes;
+    }
+
+    std::vector<size_t> dims() const override {
+        return std::vector<size_t>(dataset.header.dims, dataset.header.dims + dataset.header.rank);
+    }
+
+    size_t label(size_t i) const override {
+        return dataset.label(i);
+    }
+
+    void read(const size_t* indices, size_t n, T* out, size_t* labels) const override {
+        const size_t sample_size = dataset.header.sample_size();
+        const size_t record_size = sample_size * dataset.header.value_size();
+
+        for (size_t i = 0; i < n; ++i) {
+            pipeline_detail::decode(out + i * sample_size, dataset.data() + indices[i] * record_size, dataset.header.type, sample_size);
+
+            labels[i] = dataset.label(indices[i]);
+        }
+    }
+};
+
+/*!
+ * \brief A pipeline source over several shards, in the memory-mapped
+ * dataset format. The samples of the shards are concatenated.
+ */
+template <typename T>
+struct sharded_pipeline_source final : pipeline_source<T> {
+    std::vector<std::unique_ptr<mmap_dataset>> shards; ///< The mapped shards
+    std::vector<size_t> offsets;                        ///< The index of the first sample of each shard
+
+    /*!
+     * \brief Map the shards of the given rank
+     * \param files The paths to all the shard files
+     * \param rank The rank of this process
+     * \param ranks The number of ranks sharing the shards
+     */
+    sharded_pipeline_source(const std::vector<std::string>& files, size_t rank, size_t ranks) {
+        cpp_assert(rank < ranks, "Invalid rank");
+
+        size_t samples = 0;
+
+        for (size_t i = rank; i < files.size(); i += ranks) {
+            auto shard = std::make_unique<mmap_dataset>(files[i]);
+
+            if (!shard->valid()) {
+                continue;
+            }
+
+            if (!shards.empty() && (shard->header.type != shards.front()->header.type || shard->header.sample_size() != shards.front()->header.sample_size())) {
+                std::cerr << "ERROR: Shard " << files[i] << " is not compatible with the first shard" << std::endl;
+                continue;
+            }
+
+            offsets.push_back(samples);
+            samples += shard->size();
+
+            shards.push_back(std::move(shard));
+        }
+
+        offsets.push_back(samples);
+    }
+
+    size_t size() const override {
+        return offsets.back();
+    }
+
+    size_t classes() const override {
+        return shards.empty() ? 0 : shards.front()->header.n_classes;
+    }
+
+    std::vector<size_t> dims() const override {
+        if (shards.empty()) {
+            return {};
+        }
+
+        auto& header = shards.front()->header;
+
+        return std::vector<size_t>(header.dims, header.dims + header.rank);
+    }
+
+    size_t label(size_t i) const override {
+        const size_t s = std::upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin() - 1;
+
+        return shards[s]->label(i - offsets[s]);
+    }
+
+    void read(const size_t* indices, size_t n, T* out, size_t* labels) const override {
+        auto& header = shards.front()->header;
+
+        const size_t sample_size = header.sample_size();
+        const size_t record_size = sample_size * header.value_size();
+
+        for (size_t i = 0; i < n; ++i) {
+            const size_t s     = std::upper_bound(offsets.begin(), offsets.end(), indices[i]) - offsets.begin() - 1;
+            const size_t local = indices[i] - offsets[s];
+
+            pipeline_detail::decode(out + i * sample_size, shards[s]->data() + local * record_size, header.type, sample_size);
+
+            labels[i] = shards[s]->label(local);
+        }
+    }
+};
+
+/*!
+ * \brief A pipeline source over a range of samples (ETL containers) and
+ * their labels, held by the user.
+ */
+template <typename T, typename Iterator, typename LIterator>
+struct range_pipeline_source final : pipeline_source<T> {
+    Iterator first;   ///< The first sample
+    LIterator labels; ///< The label of the first sample
+    size_t samples;   ///< The number of samples
+    size_t n_classes; ///< The number of classes
+
+    /*!
+     * \brief Create a source over the given range of samples
+     */
+    range_pipeline_source(Iterator first, Iterator last, LIterator lfirst, LIterator llast) : first(first), labels(lfirst), samples(std::distance(first, last)) {
+        cpp_assert(samples == size_t(std::distance(lfirst, llast)), "There must be the same number of samples and labels");
+        cpp_unused(llast);
+
+        n_classes = 0;
+
+        for (size_t i = 0; i < samples; ++i) {
+            n_classes = std::max(n_classes, size_t(*std::next(labels, i)) + 1);
+        }
+    }
+
+    size_t size() const override {
+        return samples;
+    }
+
+    size_t classes() const override {
+        return n_classes;
+    }
+
+    std::vector<size_t> dims() const override {
+        if (!samples) {
+            return {};
+        }
+
+        auto& sample = *first;
+
+        std::vector<size_t> d(etl::dimensions<std::decay_t<decltype(sample)>>());
+
+        for (size_t i = 0; i < d.size(); ++i) {
+            d[i] = etl::dim(sample, i);
+        }
+
+        return d;
+    }
+
+    size_t label(size_t i) const override {
+        return size_t(*std::next(labels, i));
+    }
+
+    void read(const size_t* indices, size_t n, T* out, size_t* out_labels) const override {
+        for (size_t i = 0; i < n; ++i) {
+            auto& sample = *std::next(first, indices[i]);
+
+            sample.ensure_cpu_up_to_date();
+
+            std::transform(sample.begin(), sample.end(), out, [](auto value) { return T(value); });
+            out += etl::size(sample);
+
+            out_labels[i] = size_t(*std::next(labels, indices[i]));
+        }
+    }
+};
+
+/*!
+ * \brief The kind of a stage of a pipeline
+ */
+enum class pipeline_stage_kind {
+    SCALE,     ///< Divide the values by a factor (static kernel)
+    NORMALIZE, ///< Normalize each sample to zero mean and unit variance (static kernel)
+    BINARIZE,  ///< Binarize the values with a threshold (static kernel)
+    MAP,       ///< Apply a functor on the sample and its label
+    AUGMENT    ///< Apply a random functor on the sample, only in train mode
+};
+
+/*!
+ * \brief A stage of a pipeline, applied to each sample
+ */
+template <typename T, size_t D>
+struct pipeline_stage {
+    using sample_type = etl::custom_dyn_matrix<T, D>; ///< The type of the view on a sample
+
+    pipeline_stage_kind kind; ///< The kind of stage
+    T value{};                ///< The factor or the threshold of the static kernels
+
+    std::function<void(sample_type&, size_t&)> map;              ///< The functor of a map stage
+    std::function<void(sample_type&, random_engine&)> augment; ///< The functor of an augment stage
+};
+
+/*!
+ * \brief A DLL generator reading its batches from a pipeline.
+ *
+ * \tparam T The weight type of the batches
+ * \tparam D The number of dimensions of one sample
+ * \tparam B The size of the batches
+ * \tparam Categorical Indicates if the labels are categorical (one-hot)
+ */
+template <typename T, size_t D, size_t B, bool Categorical>
+struct pipeline_generator {
+    using weight = T; ///< The data type
+
+    using data_view_type   = etl::custom_dyn_matrix<weight, D + 1>; ///< The type of the views on the batches
+    using label_cache_type = std::conditional_t<Categorical, etl::dyn_matrix<weight, 2>, etl::dyn_matrix<weight, 1>>; ///< The type of a label batch
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size  = B;    ///< The size of the generated batches
+
+    std::shared_ptr<const pipeline_source<T>> source; ///< The source of the samples
+    std::vector<pipeline_stage<T, D>> stages;          ///< The stages applied to each sample
+
+    const size_t shuffle_window; ///< The window of the shuffle (0 for a complete shuffle)
+    const bool shuffled;         ///< Indicates if each epoch is shuffled
+    const size_t slots;          ///< The number of batches prepared ahead
+
+    size_t samples     = 0; ///< The number of samples
+    size_t sample_size = 0; ///< The number of values of one sample
+    size_t n_classes   = 0; ///< The number of classes
+
+    std::array<size_t, D> dims; ///< The dimensions of one sample
+
+    std::vector<size_t> order; ///< The order of the samples, when shuffled
+    class_sampler sampler;     ///< The sampler of the samples, when balanced
+
+    std::vector<weight> batch_memory;                         ///< The memory of the prepared batches
+    std::vector<std::unique_ptr<data_view_type>> batch_views; ///< The view on each batch
+    std::vector<label_cache_type> label_caches;               ///< The labels of each batch
+
+    device_batches<weight, D + 1, 0> device_data;                                 ///< The device copies of the data batches
+    device_batches<weight, etl::dimensions<label_cache_type>(), 0> device_labels; ///< The device copies of the label batches
+
+    size_t current = 0; ///< The current batch
+
+    std::vector<char> status;    ///< Status of each slot
+    std::vector<char> working;   ///< Indicates if a worker is filling each slot
+    std::vector<size_t> indices; ///< Index of the batch of each slot
+    std::vector<size_t> sizes;   ///< Number of samples of each slot
+
+    size_t generation = 0; ///< The generation, incremented on each reset
+    bool train        = true; ///< Indicates if the augment stages are applied
+
+    mutable std::mutex main_lock;                    ///< The main lock
+    mutable std::condition_variable condition;       ///< The condition variable for the workers to wait for some space
+    mutable std::condition_variable ready_condition; ///< The condition variable to wait for ready batches
+    mutable stall_timer stall;                       ///< The time spent waiting for the batches
+
+    bool stop_flag = false; ///< Boolean flag indicating to the threads to stop
+
+    std::vector<std::thread> threads; ///< The worker threads
+
+    random_stream augment_stream; ///< The random stream of the augment stages
+
+    /*!
+     * \brief Construct a pipeline_generator
+     * \param source The source of the samples
+     * \param stages The stages applied to each sample
+     * \param shuffled Indicates if each epoch is shuffled
+     * \param shuffle_window The window of the shuffle
+     * \param prefetch The number of batches prepared ahead
+     * \param workers The number of worker threads
+     * \param balanced Indicates if each epoch is drawn from the classes
+     * \param class_weights The weights of the classes (empty for balanced classes)
+     */
+    pipeline_generator(std::shared_ptr<const pipeline_source<T>> source, std::vector<pipeline_stage<T, D>> stages, bool shuffled, size_t shuffle_window, size_t prefetch, size_t workers,
+                       bool balanced = false, const std::vector<double>& class_weights = {})
+            : source(std::move(source)), stages(std::move(stages)), shuffle_window(shuffle_window), shuffled(shuffled || balanced), slots(std::max(size_t(1), prefetch)) {
+        auto source_dims = this->source->dims();
+
+        samples   = this->source->size();
+        n_classes = this->source->classes();
+
+        if (source_dims.size() != D) {
+            std::cerr << "ERROR: Invalid dimensions of the pipeline source" << std::endl;
+            samples = 0;
+            source_dims.assign(D, 0);
+        }
+
+        std::copy(source_dims.begin(), source_dims.end(), dims.begin());
+
+        sample_size = std::accumulate(dims.begin(), dims.end(), size_t(1), std::multiplies<size_t>());
+
+        // Allocate the slots
+
+        batch_memory.resize(slots * B * sample_size);
+
+        std::array<size_t, D + 1> batch_dims;
+        batch_dims[0] = B;
+        std::copy(dims.begin(), dims.end(), batch_dims.begin() + 1);
+
+        for (size_t b = 0; b < slots; ++b) {
+            batch_views.push_back(std::make_unique<data_view_type>(
+                pipeline_detail::make_view(batch_memory.data() + b * B * sample_size, batch_dims, std::make_index_sequence<D + 1>())));
+
+            if constexpr (Categorical) {
+                label_caches.emplace_back(B, n_classes);
+            } else {
+                label_caches.emplace_back(B);
+            }
+        }
+
+        device_data.resize(slots);
+        device_labels.resize(slots);
+
+        status.assign(slots, false);
+        working.assign(slots, false);
+        sizes.assign(slots, 0);
+        indices.resize(slots);
+        std::iota(indices.begin(), indices.end(), 0);
+
+        // Only the labels of the source are read to gather the classes
+        if (balanced) {
+            sampler = class_sampler(samples, n_classes, [this](size_t i) { return this->source->label(i); });
+
+            if (!class_weights.empty()) {
+                sampler.set_weights(class_weights);
+            }
+        }
+
+        if (shuffled) {
+            shuffle();
+        }
+
+        augment_stream = make_random_stream(size_t(dll::rand_engine()()));
+
+        for (size_t t = 0; t < std::max(size_t(1), workers); ++t) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    pipeline_generator(const pipeline_generator& rhs) = delete;
+    pipeline_generator operator=(const pipeline_generator& rhs) = delete;
+
+    pipeline_generator(pipeline_generator&& rhs) = delete;
+    pipeline_generator operator=(pipeline_generator&& rhs) = delete;
+
+    /*!
+     * \brief Destructs the pipeline_generator
+     */
+    ~pipeline_generator() {
+        cpp::with_lock(main_lock, [this] { stop_flag = true; });
+
+        condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Pipeline Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "            Stages: " << stages.size() << std::endl;
+        stream << "          Prefetch: " << slots << std::endl;
+        stream << "           Workers: " << threads.size() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing is kept in memory
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing is kept in memory
+    }
+
+    /*!
+     * brief Sets the generator in test mode, the augment stages are not
+     * applied anymore
+     */
+    void set_test() {
+        cpp::with_lock(main_lock, [this] { train = false; });
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        cpp::with_lock(main_lock, [this] { train = true; });
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning (shuffled again if the
+     * pipeline has a shuffle stage)
+     */
+    void reset() {
+        current = 0;
+
+        if (shuffled) {
+            shuffle();
+        }
+
+        reset_generation();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+        reset_generation();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * With a window, the order of the windows and the order of the samples
+     * inside each window are shuffled, so the samples are still read from
+     * one region of the source at a time.
+     *
+     * When the pipeline is balanced, the samples of the epoch are drawn
+     * again from the classes instead.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        order.resize(samples);
+
+        auto& g = dll::rand_engine();
+
+        if (!sampler.empty()) {
+            sampler.fill(order, samples, g);
+        } else if (shuffle_window) {
+            const size_t S = shuffle_window;
+
+            std::vector<size_t> windows((samples + S - 1) / S);
+            std::iota(windows.begin(), windows.end(), 0);
+            std::shuffle(windows.begin(), windows.end(), g);
+
+            auto it = order.begin();
+
+            for (auto window : windows) {
+                auto first = it;
+
+                for (size_t i = window * S; i < std::min((window + 1) * S, samples); ++i) {
+                    *it++ = i;
+                }
+
+                std::shuffle(first, it, g);
+            }
+        } else {
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), g);
+        }
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return samples;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return samples;
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return (samples + B - 1) / B;
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < batches();
+    }
+
+    /*!
+     * \brief Returns the number of batches that are ready ahead of the
+     * training (the depth of the prefetch queue)
+     */
+    size_t ready_batches() const {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        return std::count(status.begin(), status.end(), true);
+    }
+
+    /*!
+     * \brief Returns the time spent waiting for batches not yet ready, in
+     * seconds, since the last reset
+     */
+    double stall_time() const {
+        return stall.seconds();
+    }
+
+    /*!
+     * \brief Returns the number of waits for batches not yet ready since the
+     * last reset
+     */
+    size_t stall_count() const {
+        return stall.count();
+    }
+
+    /*!
+     * \brief Reset the measure of the time spent waiting for the batches
+     */
+    void reset_stall() {
+        stall.reset();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        const auto b = current % slots;
+
+        {
+            std::unique_lock<std::mutex> ulock(main_lock);
+
+            status[b] = false;
+            indices[b] += slots;
+
+            condition.notify_one();
+        }
+
+        ++current;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        const auto b = wait_batch();
+
+        return device_data.get(b, *batch_views[b], sizes[b]);
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        const auto b = wait_batch();
+
+        return device_labels.get(b, label_caches[b], sizes[b]);
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Reset the generation to its beginning
+     */
+    void reset_generation() {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        ++generation;
+
+        for (size_t b = 0; b < slots; ++b) {
+            status[b]  = false;
+            indices[b] = b;
+        }
+
+        condition.notify_all();
+    }
+
+    /*!
+     * \brief Wait for the current batch to be ready
+     * \return The index of the slot of the current batch
+     */
+    size_t wait_batch() const {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        const auto b = current % slots;
+
+        stall.wait(ready_condition, ulock, [this, b] {
+            return bool(status[b]);
+        });
+
+        return b;
+    }
+
+    /*!
+     * \brief Wait for a slot to fill and claim it.
+     * \param index The index of the claimed slot
+     * \param gen The generation of the claimed batch
+     * \param number The index of the claimed batch in the generation
+     * \param batch The indices of the samples of the batch
+     * \param augment Indicates if the augment stages must be applied
+     * \return false if the generator is stopping, true otherwise
+     */
+    bool claim(size_t& index, size_t& gen, size_t& number, std::vector<size_t>& batch, bool& augment) {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        condition.wait(ulock, [this, &index] {
+            if (stop_flag) {
+                return true;
+            }
+
+            for (size_t b = 0; b < slots; ++b) {
+                if (!status[b] && !working[b] && indices[b] < batches()) {
+                    index = b;
+                    return true;
+                }
+            }
+
+            return false;
+        });
+
+        if (stop_flag) {
+            return false;
+        }
+
+        working[index] = true;
+        gen            = generation;
+        number         = indices[index];
+        augment        = train;
+
+        const size_t first = indices[index] * B;
+        const size_t n     = std::min(B, samples - first);
+
+        batch.resize(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            batch[i] = order.empty() ? first + i : order[first + i];
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Apply the stages to one sample
+     */
+    void transform(weight* x, size_t& label, bool augment, random_engine& engine) const {
+        auto sample = pipeline_detail::make_view(x, dims, std::make_index_sequence<D>());
+
+        for (auto& stage : stages) {
+            switch (stage.kind) {
+                case pipeline_stage_kind::SCALE:
+                    pipeline_detail::scale(x, sample_size, stage.value);
+                    break;
+                case pipeline_stage_kind::NORMALIZE:
+                    pipeline_detail::normalize(x, sample_size);
+                    break;
+                case pipeline_stage_kind::BINARIZE:
+                    pipeline_detail::binarize(x, sample_size, stage.value);
+                    break;
+                case pipeline_stage_kind::MAP:
+                    stage.map(sample, label);
+                    break;
+                case pipeline_stage_kind::AUGMENT:
+                    if (augment) {
+                        stage.augment(sample, engine);
+                    }
+                    break;
+            }
+        }
+    }
+
+    /*!
+     * \brief The loop of a worker thread
+     */
+    void work() {
+        // Each worker already runs concurrently
+        SERIAL_SECTION {
+            random_engine engine;
+
+            size_t index  = 0;
+            size_t gen    = 0;
+            size_t number = 0;
+            bool augment  = true;
+
+            std::vector<size_t> batch;
+            std::vector<size_t> labels;
+
+            while (claim(index, gen, number, batch, augment)) {
+                const size_t n = batch.size();
+
+                // The engine only depends on the batch, not on the worker
+                if (augment) {
+                    const uint64_t key = augment_stream.split(gen).split(number).stream_key();
+
+                    std::seed_seq seq{uint32_t(key), uint32_t(key >> 32)};
+                    engine.seed(seq);
+                }
+
+                weight* out = batch_memory.data() + index * B * sample_size;
+
+                labels.resize(n);
+
+                source->read(batch.data(), n, out, labels.data());
+
+                auto& label_cache = label_caches[index];
+
+                for (size_t i = 0; i < n; ++i) {
+                    transform(out + i * sample_size, labels[i], augment, engine);
+                }
+
+                if constexpr (Categorical) {
+                    one_hot_scatter(label_cache, n, [&labels](size_t i) { return labels[i]; });
+                } else {
+                    for (size_t i = 0; i < n; ++i) {
+                        label_cache[i] = weight(labels[i]);
+                    }
+                }
+
+                // The batch is written through its memory
+                batch_views[index]->invalidate_gpu();
+                label_cache.invalidate_gpu();
+
+                // Start the transfer of the batch to the device
+                device_data.upload(index, *batch_views[index]);
+                device_labels.upload(index, label_cache);
+
+                // Notify the waiters that one batch is ready
+
+                {
+                    std::unique_lock<std::mutex> ulock(main_lock);
+
+                    working[index] = false;
+                    sizes[index]   = n;
+
+                    // A batch prepared before a reset is not valid anymore
+                    if (gen == generation) {
+                        status[index] = true;
+                    }
+
+                    ready_condition.notify_all();
+                    condition.notify_one();
+                }
+            }
+        }
+    }
+};
+
+/*!
+ * \brief A pipeline of data, built stage by stage, and turned into a
+ * generator by its batch stage.
+ *
+ * \tparam T The weight type of the samples
+ * \tparam D The number of dimensions of one sample
+ */
+template <typename T, size_t D>
+struct data_pipeline {
+    using sample_type = typename pipeline_stage<T, D>::sample_type; ///< The type of the view on a sample
+
+    std::shared_ptr<const pipeline_source<T>> source; ///< The source of the samples
+    std::vector<pipeline_stage<T, D>> stages;          ///< The stages applied to each sample
+
+    bool shuffled         = false; ///< Indicates if each epoch is shuffled
+    size_t shuffle_window = 0;     ///< The window of the shuffle
+    bool balanced         = false; ///< Indicates if each epoch is drawn from the classes
+
+    std::vector<double> class_weights; ///< The weights of the classes, when balanced
+    size_t prefetch_n     = 4;     ///< The number of batches prepared ahead
+    size_t threads_n      = 2;     ///< The number of worker threads
+
+    /*!
+     * \brief Create a pipeline over the given source
+     */
+    explicit data_pipeline(std::shared_ptr<const pipeline_source<T>> source) : source(std::move(source)) {}
+
+    /*!
+     * \brief Divide the values of each sample by the given factor
+     */
+    data_pipeline& scale(T factor) {
+        stages.push_back({pipeline_stage_kind::SCALE, factor, {}, {}});
+        return *this;
+    }
+
+    /*!
+     * \brief Normalize each sample to zero mean and unit variance
+     */
+    data_pipeline& normalize() {
+        stages.push_back({pipeline_stage_kind::NORMALIZE, T(0), {}, {}});
+        return *this;
+    }
+
+    /*!
+     * \brief Binarize the values of each sample with the given threshold
+     */
+    data_pipeline& binarize(T threshold) {
+        stages.push_back({pipeline_stage_kind::BINARIZE, threshold, {}, {}});
+        return *this;
+    }
+
+    /*!
+     * \brief Apply functor(sample, label) on each sample, the label being
+     * modifiable
+     */
+    template <typename Functor>
+    data_pipeline& map(Functor&& functor) {
+        stages.push_back({pipeline_stage_kind::MAP, T(0), std::forward<Functor>(functor), {}});
+        return *this;
+    }
+
+    /*!
+     * \brief Apply functor(sample, engine) on each sample, in train mode
+     * only. The engine is the random engine of the worker.
+     */
+    template <typename Functor>
+    data_pipeline& augment(Functor&& functor) {
+        stages.push_back({pipeline_stage_kind::AUGMENT, T(0), {}, std::forward<Functor>(functor)});
+        return *this;
+    }
+
+    /*!
+     * \brief Shuffle the samples at each epoch, inside windows of the given
+     * number of samples (0 for a complete shuffle)
+     */
+    data_pipeline& shuffle(size_t window = 0) {
+        shuffled       = true;
+        shuffle_window = window;
+        return *this;
+    }
+
+    /*!
+     * \brief Draw the samples of each epoch from the classes, all the
+     * classes with the same probability. The data is never duplicated,
+     * only the order of the samples is drawn.
+     */
+    data_pipeline& balance() {
+        balanced = true;
+        class_weights.clear();
+        return *this;
+    }
+
+    /*!
+     * \brief Draw the samples of each epoch from the classes, each class
+     * with the given weight
+     */
+    data_pipeline& balance(std::vector<double> weights) {
+        balanced      = true;
+        class_weights = std::move(weights);
+        return *this;
+    }
+
+    /*!
+     * \brief Prepare the given number of batches ahead of the training
+     */
+    data_pipeline& prefetch(size_t n) {
+        prefetch_n = n;
+        return *this;
+    }
+
+    /*!
+     * \brief Prepare the batches with the given number of threads
+     */
+    data_pipeline& threads(size_t n) {
+        threads_n = n;
+        return *this;
+    }
+
+    /*!
+     * \brief Group the samples into batches and make the generator of the
+     * pipeline
+     *
+     * \tparam B The size of the batches
+     * \tparam Categorical Indicates if the labels are categorical (one-hot)
+     *
+     * \return a unique_ptr around the created generator
+     */
+    template <size_t B, bool Categorical = false>
+    auto batch() const {
+        using generator_t = pipeline_generator<T, D, B, Categorical>;
+        return std::make_unique<generator_t>(source, stages, shuffled, shuffle_window, prefetch_n, threads_n, balanced, class_weights);
+    }
+};
+
+/*!
+ * \brief Make a pipeline over a memory-mapped dataset file
+ * \tparam D The number of dimensions of one sample
+ * \tparam T The weight type of the batches
+ * \param path The path to the dataset file
+ */
+template <size_t D, typename T = float>
+data_pipeline<T, D> make_mmap_pipeline(const std::string& path) {
+    return data_pipeline<T, D>(std::make_shared<mmap_pipeline_source<T>>(path));
+}
+
+/*!
+ * \brief Make a pipeline over several shards of a dataset
+ * \tparam D The number of dimensions of one sample
+ * \tparam T The weight type of the batches
+ * \param files The paths to all the shard files
+ * \param rank The rank of this process
+ * \param ranks The number of ranks sharing the shards
+ */
+template <size_t D, typename T = float>
+data_pipeline<T, D> make_sharded_pipeline(const std::vector<std::string>& files, size_t rank = 0, size_t ranks = 1) {
+    return data_pipeline<T, D>(std::make_shared<sharded_pipeline_source<T>>(files, rank, ranks));
+}
+
+/*!
+ * \brief Make a pipeline over a range of samples and their labels. The
+ * samples must stay alive as long as the generator.
+ * \tparam D The number of dimensions of one sample
+ * \tparam T The weight type of the batches
+ */
+template <size_t D, typename T = float, typename Iterator, typename LIterator>
+data_pipeline<T, D> make_range_pipeline(Iterator first, Iterator last, LIterator lfirst, LIterator llast) {
+    return data_pipeline<T, D>(std::make_shared<range_pipeline_source<T, Iterator, LIterator>>(first, last, lfirst, llast));
+}
+
+} //end of dll namespace
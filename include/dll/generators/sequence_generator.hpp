@@ -0,0 +1,461 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief In-memory generator of length-bucketed batches of sequences
+ */
+
+#pragma once
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+namespace dll {
+
+/*!
+ * \brief In-memory generator of batches of variable-length sequences.
+ *
+ * The sequences are padded, at their end, to the same number of time steps
+ * and the length of each sequence is given with the samples. The samples are
+ * grouped by length, so that each batch holds sequences of similar lengths,
+ * and each batch tells its number of time steps (the length of its longest
+ * sequence) with batch_steps() and the length of each of its sequences with
+ * batch_lengths(). The recurrent layers of the network then only compute the
+ * time steps of each sequence, not its padding.
+ *
+ * The sequences of each batch are sorted by decreasing length, the sequences
+ * still running at a time step are therefore the first rows of the batch.
+ *
+ * When shuffled, the samples of the same length are shuffled together and
+ * the order of the batches is shuffled as well.
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+struct sequence_generator {
+    using desc                 = Desc;                                                              ///< The generator descriptor
+    using weight               = etl::value_t<typename std::iterator_traits<Iterator>::value_type>; ///< The data type
+    using data_cache_helper_t  = cache_helper<Desc, Iterator>;                                      ///< The helper for the data cache
+    using label_cache_helper_t = label_cache_helper<Desc, weight, LIterator>;                       ///< The helper for the label cache
+
+    using data_cache_type      = typename data_cache_helper_t::cache_type;      ///< The type of the data cache
+    using big_cache_type       = typename data_cache_helper_t::big_cache_type;  ///< The type of big data cache
+    using label_cache_type     = typename label_cache_helper_t::cache_type;     ///< The type of the label cache
+    using label_big_cache_type = typename label_cache_helper_t::big_cache_type; ///< The type of the big label cache
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+
+    static constexpr size_t batch_size = desc::BatchSize; ///< The size of the generated batches
+
+    data_cache_type input_cache;                    ///< The input cache
+    mutable big_cache_type batch_cache;             ///< The gathered data batch
+    label_cache_type label_cache;                   ///< The label cache
+    mutable label_big_cache_type label_batch_cache; ///< The gathered label batch
+
+    memory_record memory{memory_subsystem::GENERATORS, no_memory_layer, 0}; ///< The accounting of the caches
+
+    std::vector<size_t> lengths; ///< The length of each sequence
+    std::vector<size_t> order;   ///< The order of the samples, grouped by length
+    std::vector<size_t> batch;   ///< The first sample (in the order) of each batch
+    std::vector<size_t> steps;   ///< The number of time steps of each batch
+
+    mutable std::vector<size_t> current_lengths; ///< The lengths of the sequences of the current batch
+
+    size_t current = 0;     ///< The current batch
+    bool is_safe   = false; ///< Indicates if the generator is safe to reclaim memory from
+
+    /*!
+     * \brief Construct a sequence generator
+     * \param first The beginning of the (padded) sequences
+     * \param last The end of the sequences
+     * \param lfirst The beginning of the lengths of the sequences
+     * \param labels The beginning of the labels
+     * \param n_classes The number of classes
+     */
+    template <typename SIterator>
+    sequence_generator(Iterator first, Iterator last, SIterator lfirst, LIterator labels, size_t n_classes){
+        const size_t n = std::distance(first, last);
+
+        data_cache_helper_t::init(n, first, input_cache);
+        label_cache_helper_t::init(n, n_classes, labels, label_cache);
+
+        data_cache_helper_t::init_big(first, batch_cache);
+        label_cache_helper_t::init_big(n_classes, labels, label_batch_cache);
+
+        const size_t time_steps = etl::dim<0>(*first);
+
+        lengths.resize(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            convert_sample(input_cache(i), *first);
+            label_cache_helper_t::set(i, labels, label_cache);
+
+            lengths[i] = std::max(size_t(1), std::min(size_t(*lfirst), time_steps));
+
+            ++first;
+            ++lfirst;
+            ++labels;
+        }
+
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+
+        bucket();
+
+        memory.resize(memory_size(input_cache, batch_cache, label_cache, label_batch_cache));
+    }
+
+    sequence_generator(const sequence_generator& rhs) = delete;
+    sequence_generator operator=(const sequence_generator& rhs) = delete;
+
+    sequence_generator(sequence_generator&& rhs) = delete;
+    sequence_generator operator=(sequence_generator&& rhs) = delete;
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Sequence Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "        Time steps: " << etl::dim<1>(input_cache) << std::endl;
+        stream << "     Average steps: " << average_steps() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        is_safe = true;
+    }
+
+    /*!
+     * \brief Pin the threads of the generator to the given CPUs. The batches
+     * of this generator are prepared by the thread of the training, so this
+     * has no effect.
+     */
+    void set_affinity(const std::vector<size_t>& cpus) {
+        cpp_unused(cpus);
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     *
+     * This is only done if the generator is marked as safe.
+     */
+    void clear() {
+        if (is_safe) {
+            input_cache.clear();
+            batch_cache.clear();
+            label_cache.clear();
+            label_batch_cache.clear();
+
+            memory.resize(0);
+        }
+    }
+
+    /*!
+     * \brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+    }
+
+    /*!
+     * \brief Shuffle the order of the samples.
+     *
+     * The samples are shuffled and then grouped again by length (the
+     * sequences of the same length are therefore in a different order)
+     * and the batches are shuffled. Only the order is shuffled, the caches
+     * are never moved.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::shuffle(order.begin(), order.end(), dll::rand_engine());
+
+        bucket();
+
+        // Shuffle the batches, each batch keeping its samples
+
+        std::vector<size_t> batch_order(batches());
+        std::iota(batch_order.begin(), batch_order.end(), 0);
+        std::shuffle(batch_order.begin(), batch_order.end(), dll::rand_engine());
+
+        std::vector<size_t> new_order;
+        std::vector<size_t> new_batch;
+        std::vector<size_t> new_steps;
+
+        new_order.reserve(size());
+        new_batch.reserve(batches());
+        new_steps.reserve(batches());
+
+        for (auto b : batch_order) {
+            new_batch.push_back(new_order.size());
+            new_steps.push_back(steps[b]);
+
+            new_order.insert(new_order.end(), order.begin() + batch[b], order.begin() + batch_end(b));
+        }
+
+        order = std::move(new_order);
+        batch = std::move(new_batch);
+        steps = std::move(new_steps);
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch(){
+        // Nothing to do, the batches are gathered on demand
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return etl::dim<0>(input_cache);
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return size();
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return batch.size();
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < batches();
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        ++current;
+    }
+
+    /*!
+     * \brief Returns the number of time steps of the current batch (the
+     * length of its longest sequence)
+     */
+    size_t batch_steps() const {
+        return steps[current];
+    }
+
+    /*!
+     * \brief Returns the length of each sequence of the current batch, by
+     * decreasing length
+     */
+    const std::vector<size_t>& batch_lengths() const {
+        current_lengths.clear();
+
+        for (size_t i = batch[current]; i < batch_end(current); ++i) {
+            current_lengths.push_back(lengths[order[i]]);
+        }
+
+        return current_lengths;
+    }
+
+    /*!
+     * \brief Returns the average number of time steps of the batches,
+     * weighted by their number of samples
+     */
+    double average_steps() const {
+        double total = 0.0;
+
+        for (size_t b = 0; b < batches(); ++b) {
+            total += double(steps[b]) * (batch_end(b) - batch[b]);
+        }
+
+        return size() ? total / size() : 0.0;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a batch of data.
+     */
+    auto data_batch() const {
+        const size_t n = batch_end(current) - batch[current];
+
+        gather_rows(batch_cache(0), input_cache, n, [this](size_t i) { return order[batch[current] + i]; });
+
+        return etl::slice(batch_cache(0), 0, n);
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a batch of label.
+     */
+    auto label_batch() const {
+        const size_t n = batch_end(current) - batch[current];
+
+        gather_rows(label_batch_cache(0), label_cache, n, [this](size_t i) { return order[batch[current] + i]; });
+
+        return etl::slice(label_batch_cache(0), 0, n);
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return etl::dimensions<data_cache_type>() - 1;
+    }
+
+private:
+    /*!
+     * \brief Returns the end (in the order) of the given batch
+     */
+    size_t batch_end(size_t b) const {
+        return b + 1 < batch.size() ? batch[b + 1] : order.size();
+    }
+
+    /*!
+     * \brief Group the samples by decreasing length, keeping the current
+     * order of the samples of the same length, and split them into batches
+     */
+    void bucket() {
+        std::stable_sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) { return lengths[lhs] > lengths[rhs]; });
+
+        batch.clear();
+        steps.clear();
+
+        for (size_t first = 0; first < order.size(); first += batch_size) {
+            batch.push_back(first);
+            steps.push_back(lengths[order[first]]);
+        }
+    }
+};
+
+/*!
+ * \brief Display the given generator on the given stream
+ * \param os The output stream
+ * \param generator The generator to display
+ * \return os
+ */
+template <typename Iterator, typename LIterator, typename Desc>
+std::ostream& operator<<(std::ostream& os, sequence_generator<Iterator, LIterator, Desc>& generator) {
+    return generator.display(os);
+}
+
+/*!
+ * \brief Descriptor for a sequence_generator
+ */
+template <typename... Parameters>
+struct sequence_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the generators must make the labels categorical
+     */
+    static constexpr bool Categorical = parameters::template contains<categorical>();
+
+    // The sequences are gathered one batch at a time, without augmentation
+
+    static constexpr size_t BigBatchSize    = 1;     ///< The number of batches gathered at once
+    static constexpr bool Uint8Storage      = false; ///< The sequences are stored in their own type
+    static constexpr bool CompressedStorage = false; ///< The sequences are not compressed
+    static constexpr bool AutoEncoder       = false; ///< The labels are never the sequences
+    static constexpr size_t random_crop_x   = 0;     ///< The sequences are never cropped
+    static constexpr size_t random_crop_y   = 0;     ///< The sequences are never cropped
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<batch_size_id, categorical_id, nop_id>, Parameters...>,
+        "Invalid parameters type for sequence_generator_desc");
+
+    /*!
+     * The generator type
+     */
+    template <typename Iterator, typename LIterator>
+    using generator_t = sequence_generator<Iterator, LIterator, sequence_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a sequence generator from containers
+ * \param container The sequences, padded at their end
+ * \param lengths The length of each sequence
+ * \param lcontainer The labels
+ * \param n_classes The number of classes
+ */
+template <typename Container, typename SContainer, typename LContainer, typename... Parameters>
+auto make_generator(const Container& container, const SContainer& lengths, const LContainer& lcontainer, size_t n_classes, const sequence_generator_desc<Parameters...>& /*desc*/) {
+    using generator_t = typename sequence_generator_desc<Parameters...>::template generator_t<typename Container::const_iterator, typename LContainer::const_iterator>;
+    return std::make_unique<generator_t>(container.begin(), container.end(), lengths.begin(), lcontainer.begin(), n_classes);
+}
+
+} //end of dll namespace
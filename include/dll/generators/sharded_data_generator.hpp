@@ -0,0 +1,750 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Implementation of a data generator over several dataset shards
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dll/generators/mmap_dataset.hpp"
+#include "dll/generators/stall_timer.hpp"
+#include "dll/util/numa.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A data generator over a list of shard files, in the memory-mapped
+ * dataset format, read with positioned reads.
+ *
+ * The generation is a sequence of chunks, each being the samples of one
+ * batch, contiguous in one shard. The chunks of the different shards are
+ * interleaved, and shuffling the generator shuffles the order of all the
+ * chunks, so consecutive batches come from different shards while each read
+ * stays sequential inside a file.
+ *
+ * A pool of reader threads reads the next big_batch_size batches ahead of
+ * the training, with pread, and converts them to the weight type. Several
+ * shards are therefore read at the same time, which hides the latency of
+ * network storage.
+ *
+ * For distributed training, each rank only reads its own shards (the shards
+ * i such that i % ranks == rank).
+ *
+ * \tparam T The weight type of the batches
+ * \tparam D The number of dimensions of one sample
+ * \tparam Desc The generator descriptor
+ */
+template <typename T, size_t D, typename Desc>
+struct sharded_data_generator {
+    using desc   = Desc; ///< The generator descriptor
+    using weight = T;    ///< The data type
+
+    using data_view_type   = etl::custom_dyn_matrix<weight, D + 1>; ///< The type of the views on the batches
+    using label_cache_type = std::conditional_t<desc::Categorical, etl::dyn_matrix<weight, 2>, etl::dyn_matrix<weight, 1>>; ///< The type of a label batch
+
+    static constexpr bool dll_generator    = true;               ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size     = desc::BatchSize;    ///< The size of the generated batches
+    static constexpr size_t big_batch_size = desc::BigBatchSize; ///< The number of batches read ahead
+    static constexpr size_t readers_n      = desc::ReadThreads;  ///< The number of reader threads
+
+    static_assert(D > 0 && D <= mmap_dataset_header::max_rank, "Invalid number of dimensions for sharded_data_generator");
+
+    /*!
+     * \brief A shard of the dataset
+     */
+    struct shard {
+        std::string path;           ///< The path to the shard file
+        int fd = -1;                ///< The file descriptor
+        mmap_dataset_header header; ///< The header of the shard
+    };
+
+    /*!
+     * \brief A batch of contiguous samples of one shard
+     */
+    struct chunk {
+        size_t shard; ///< The index of the shard
+        size_t first; ///< The first sample, in the shard
+        size_t n;     ///< The number of samples
+    };
+
+    std::vector<shard> shards; ///< The shards of this rank
+    std::vector<chunk> chunks; ///< The chunks of the generation, in order
+
+    size_t samples     = 0; ///< The number of samples
+    size_t sample_size = 0; ///< The number of values of one sample
+    size_t n_classes   = 0; ///< The number of classes
+
+    std::vector<weight> batch_memory;                         ///< The memory of the batches read ahead
+    std::vector<std::unique_ptr<data_view_type>> batch_views; ///< The view on each batch
+    std::vector<label_cache_type> label_caches;               ///< The labels of each batch
+
+    device_batches<weight, D + 1, big_batch_size> device_data;                                 ///< The device copies of the data batches
+    device_batches<weight, etl::dimensions<label_cache_type>(), big_batch_size> device_labels; ///< The device copies of the label batches
+
+    size_t current = 0; ///< The current batch
+
+    mutable volatile bool status[big_batch_size];    ///< Status of each batch
+    mutable volatile bool working[big_batch_size];   ///< Indicates if a reader is filling each batch
+    mutable volatile size_t indices[big_batch_size]; ///< Index of the chunk of each batch
+    mutable volatile size_t sizes[big_batch_size];   ///< Number of samples of each batch
+
+    size_t generation = 0; ///< The generation, incremented on each reset
+
+    mutable std::mutex main_lock;                    ///< The main lock
+    mutable std::condition_variable condition;       ///< The condition variable for the readers to wait for some space
+    mutable std::condition_variable ready_condition; ///< The condition variable for a reader to wait for ready data
+    mutable stall_timer stall;                       ///< The time spent waiting for the batches
+
+    volatile bool stop_flag = false; ///< Boolean flag indicating to the threads to stop
+
+    std::vector<std::thread> threads; ///< The reader threads
+
+    /*!
+     * \brief Construct a sharded_data_generator
+     * \param files The paths to all the shard files
+     * \param rank The rank of this process
+     * \param ranks The number of ranks sharing the shards
+     */
+    explicit sharded_data_generator(const std::vector<std::string>& files, size_t rank = 0, size_t ranks = 1) {
+        cpp_assert(rank < ranks, "Invalid rank");
+
+        for (size_t i = rank; i < files.size(); i += ranks) {
+            open_shard(files[i]);
+        }
+
+        // Interleave the chunks of the shards
+
+        for (size_t first = 0; ; first += batch_size) {
+            bool found = false;
+
+            for (size_t s = 0; s < shards.size(); ++s) {
+                if (first < shards[s].header.samples) {
+                    chunks.push_back({s, first, std::min(batch_size, size_t(shards[s].header.samples) - first)});
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                break;
+            }
+        }
+
+        // Allocate the batches
+
+        batch_memory.resize(big_batch_size * batch_size * sample_size);
+
+        std::array<size_t, D + 1> dims;
+        dims[0] = batch_size;
+
+        for (size_t d = 0; d < D; ++d) {
+            dims[d + 1] = shards.empty() ? 0 : shards.front().header.dims[d];
+        }
+
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            batch_views.push_back(make_view(batch_memory.data() + b * batch_size * sample_size, dims, std::make_index_sequence<D + 1>()));
+
+            if constexpr (desc::Categorical) {
+                label_caches.emplace_back(batch_size, n_classes);
+            } else {
+                label_caches.emplace_back(batch_size);
+            }
+
+            status[b]  = false;
+            working[b] = false;
+            indices[b] = b;
+            sizes[b]   = 0;
+        }
+
+        for (size_t t = 0; t < readers_n; ++t) {
+            threads.emplace_back([this] { read(); });
+        }
+    }
+
+    sharded_data_generator(const sharded_data_generator& rhs) = delete;
+    sharded_data_generator operator=(const sharded_data_generator& rhs) = delete;
+
+    sharded_data_generator(sharded_data_generator&& rhs) = delete;
+    sharded_data_generator operator=(sharded_data_generator&& rhs) = delete;
+
+    /*!
+     * \brief Destructs the sharded_data_generator
+     */
+    ~sharded_data_generator() {
+        cpp::with_lock(main_lock, [this] { stop_flag = true; });
+
+        condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        for (auto& s : shards) {
+            ::close(s.fd);
+        }
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Sharded Data Generator" << std::endl;
+        stream << "              Size: " << size() << std::endl;
+        stream << "           Batches: " << batches() << std::endl;
+        stream << "            Shards: " << shards.size() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing is kept in memory
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing is kept in memory
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator to the beginning
+     */
+    void reset() {
+        current = 0;
+        reset_generation();
+    }
+
+    /*!
+     * \brief Reset the generator and shuffle the order of samples
+     */
+    void reset_shuffle() {
+        current = 0;
+        shuffle();
+        reset_generation();
+    }
+
+    /*!
+     * \brief Shuffle the order of the chunks.
+     *
+     * This should only be done when the generator is at the beginning.
+     */
+    void shuffle() {
+        cpp_assert(!current, "Shuffle should only be performed on start of generation");
+
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        std::shuffle(chunks.begin(), chunks.end(), dll::rand_engine());
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing can be done here
+    }
+
+    /*!
+     * \brief Return the index of the current batch in the generation
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the generator
+     * \return The number of elements in the generator
+     */
+    size_t size() const {
+        return samples;
+    }
+
+    /*!
+     * \brief Returns the augmented number of elements in the generator.
+     * \return The augmented number of elements in the generator
+     */
+    size_t augmented_size() const {
+        return samples;
+    }
+
+    /*!
+     * \brief Returns the number of batches in the generator.
+     *
+     * The last chunk of each shard may be smaller than a batch.
+     *
+     * \return The number of batches in the generator
+     */
+    size_t batches() const {
+        return chunks.size();
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        return current < chunks.size();
+    }
+
+    /*!
+     * \brief Returns the number of batches that are ready ahead of the
+     * training (the depth of the read-ahead queue)
+     */
+    size_t ready_batches() const {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        size_t ready = 0;
+
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            ready += status[b] ? 1 : 0;
+        }
+
+        return ready;
+    }
+
+    /*!
+     * \brief Returns the time spent waiting for batches not yet ready, in
+     * seconds, since the last reset
+     */
+    double stall_time() const {
+        return stall.seconds();
+    }
+
+    /*!
+     * \brief Returns the number of waits for batches not yet ready since the
+     * last reset
+     */
+    size_t stall_count() const {
+        return stall.count();
+    }
+
+    /*!
+     * \brief Reset the measure of the time spent waiting for the batches
+     */
+    void reset_stall() {
+        stall.reset();
+    }
+
+    /*!
+     * \brief Pin the reader threads to the given CPUs (all the allowed CPUs
+     * if empty).
+     */
+    void set_affinity(const std::vector<size_t>& cpus) {
+        for (auto& thread : threads) {
+            pin_thread(thread, cpus.empty() ? allowed_cpus() : cpus);
+        }
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     *
+     * This should only be called if the generator has a next batch.
+     */
+    void next_batch() {
+        const auto b = current % big_batch_size;
+
+        {
+            std::unique_lock<std::mutex> ulock(main_lock);
+
+            status[b] = false;
+            indices[b] += big_batch_size;
+
+            condition.notify_one();
+        }
+
+        ++current;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        const auto b = wait_batch();
+
+        return device_data.get(b, *batch_views[b], sizes[b]);
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        const auto b = wait_batch();
+
+        return device_labels.get(b, label_caches[b], sizes[b]);
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief Open a shard and add it to the generator
+     * \param path The path to the shard file
+     */
+    void open_shard(const std::string& path) {
+        shard s;
+        s.path = path;
+        s.fd   = ::open(path.c_str(), O_RDONLY);
+
+        if (s.fd < 0) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+
+        if (::fstat(s.fd, &st) < 0 || !read_fully(s.fd, &s.header, sizeof(s.header), 0) || !s.header.valid(st.st_size) || s.header.rank != D) {
+            std::cerr << "ERROR: Invalid dataset shard: " << path << std::endl;
+            ::close(s.fd);
+            return;
+        }
+
+        if (!shards.empty()) {
+            auto& first = shards.front().header;
+
+            if (first.type != s.header.type || first.n_classes != s.header.n_classes || !std::equal(first.dims, first.dims + D, s.header.dims)) {
+                std::cerr << "ERROR: Shard " << path << " is not compatible with " << shards.front().path << std::endl;
+                ::close(s.fd);
+                return;
+            }
+        }
+
+        // Only the samples of the shard are going to be read
+        ::posix_fadvise(s.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        samples += s.header.samples;
+        sample_size = s.header.sample_size();
+        n_classes   = s.header.n_classes;
+
+        shards.push_back(s);
+    }
+
+    /*!
+     * \brief Read the given number of bytes from the given offset
+     * \return true if all the bytes have been read, false otherwise
+     */
+    static bool read_fully(int fd, void* data, size_t bytes, size_t offset) {
+        char* out = static_cast<char*>(data);
+
+        while (bytes) {
+            auto r = ::pread(fd, out, bytes, offset);
+
+            if (r <= 0) {
+                return false;
+            }
+
+            out += r;
+            offset += r;
+            bytes -= r;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Create a view on the given memory
+     */
+    template <size_t... I>
+    static std::unique_ptr<data_view_type> make_view(weight* memory, const std::array<size_t, D + 1>& dims, std::index_sequence<I...> /*seq*/) {
+        return std::make_unique<data_view_type>(memory, dims[I]...);
+    }
+
+    /*!
+     * \brief Reset the generation to its beginning
+     */
+    void reset_generation() {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        ++generation;
+
+        for (size_t b = 0; b < big_batch_size; ++b) {
+            status[b]  = false;
+            indices[b] = b;
+        }
+
+        condition.notify_all();
+    }
+
+    /*!
+     * \brief Wait for the current batch to be ready
+     * \return The index of the current batch inside the batches read ahead
+     */
+    size_t wait_batch() const {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        const auto b = current % big_batch_size;
+
+        stall.wait(ready_condition, ulock, [this, b] {
+            return status[b];
+        });
+
+        return b;
+    }
+
+    /*!
+     * \brief Wait for a batch to read and claim it.
+     * \param index The index of the claimed batch
+     * \param gen The generation of the claimed batch
+     * \param c The chunk to read
+     * \return false if the generator is stopping, true otherwise
+     */
+    bool claim(size_t& index, size_t& gen, chunk& c) {
+        std::unique_lock<std::mutex> ulock(main_lock);
+
+        condition.wait(ulock, [this, &index] {
+            if (stop_flag) {
+                return true;
+            }
+
+            for (size_t b = 0; b < big_batch_size; ++b) {
+                if (!status[b] && !working[b] && indices[b] < chunks.size()) {
+                    index = b;
+                    return true;
+                }
+            }
+
+            return false;
+        });
+
+        if (stop_flag) {
+            return false;
+        }
+
+        working[index] = true;
+        gen            = generation;
+        c              = chunks[indices[index]];
+
+        return true;
+    }
+
+    /*!
+     * \brief The loop of a reader thread
+     */
+    void read() {
+        // Each reader already runs concurrently
+        SERIAL_SECTION {
+            size_t index = 0;
+            size_t gen   = 0;
+            chunk c{0, 0, 0};
+
+            std::vector<char> records;
+            std::vector<uint32_t> labels;
+
+            while (claim(index, gen, c)) {
+                auto& s = shards[c.shard];
+
+                const size_t record_size = sample_size * s.header.value_size();
+
+                records.resize(c.n * record_size);
+                labels.resize(c.n);
+
+                bool valid = read_fully(s.fd, records.data(), records.size(), s.header.data_offset + c.first * record_size)
+                          && read_fully(s.fd, labels.data(), labels.size() * sizeof(uint32_t), s.header.label_offset + c.first * sizeof(uint32_t));
+
+                if (!valid) {
+                    std::cerr << "ERROR: Impossible to read shard " << s.path << std::endl;
+                    std::fill(records.begin(), records.end(), 0);
+                    std::fill(labels.begin(), labels.end(), 0);
+                }
+
+                // Convert the records
+
+                weight* out = batch_memory.data() + index * batch_size * sample_size;
+
+                if (s.header.type == mmap_dataset_type::UINT8) {
+                    auto* in = reinterpret_cast<const uint8_t*>(records.data());
+
+                    for (size_t j = 0; j < c.n * sample_size; ++j) {
+                        out[j] = weight(in[j]);
+                    }
+                } else if (s.header.type == mmap_dataset_type::BFLOAT16) {
+                    auto* in = reinterpret_cast<const uint16_t*>(records.data());
+
+                    for (size_t j = 0; j < c.n * sample_size; ++j) {
+                        out[j] = weight(from_bf16(in[j]));
+                    }
+                } else {
+                    auto* in = reinterpret_cast<const float*>(records.data());
+
+                    for (size_t j = 0; j < c.n * sample_size; ++j) {
+                        out[j] = weight(in[j]);
+                    }
+                }
+
+                auto& label_cache = label_caches[index];
+
+                for (size_t i = 0; i < c.n; ++i) {
+                    auto sub = (*batch_views[index])(i);
+
+                    pre_scaler<desc>::transform(sub);
+                    pre_normalizer<desc>::transform(sub);
+                    pre_binarizer<desc>::transform(sub);
+                }
+
+                if constexpr (desc::Categorical) {
+                    one_hot_scatter(label_cache, c.n, [&labels](size_t i) { return size_t(labels[i]); });
+                } else {
+                    for (size_t i = 0; i < c.n; ++i) {
+                        label_cache[i] = weight(labels[i]);
+                    }
+                }
+
+                // Start the transfer of the batch to the device
+                device_data.upload(index, *batch_views[index]);
+                device_labels.upload(index, label_caches[index]);
+
+                // Notify the waiters that one batch is ready
+
+                {
+                    std::unique_lock<std::mutex> ulock(main_lock);
+
+                    working[index] = false;
+                    sizes[index]   = c.n;
+
+                    // A batch read before a reset is not valid anymore
+                    if (gen == generation) {
+                        status[index] = true;
+                    }
+
+                    ready_condition.notify_all();
+                    condition.notify_one();
+                }
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Descriptor for a sharded_data_generator
+ */
+template <typename... Parameters>
+struct sharded_data_generator_desc {
+    /*!
+     * A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    /*!
+     * \brief The size of a batch
+     */
+    static constexpr size_t BatchSize = detail::get_value_v<batch_size<1>, Parameters...>;
+
+    /*!
+     * \brief The number of batches read ahead
+     */
+    static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<4>, Parameters...>;
+
+    /*!
+     * \brief The number of reader threads
+     */
+    static constexpr size_t ReadThreads = detail::get_value_v<read_threads<2>, Parameters...>;
+
+    /*!
+     * \brief Indicates if the generators must make the labels categorical
+     */
+    static constexpr bool Categorical = parameters::template contains<categorical>();
+
+    /*!
+     * \brief The scaling
+     */
+    static constexpr size_t ScalePre = detail::get_value_v<scale_pre<0>, Parameters...>;
+
+    /*!
+     * \brief The binarization threshold
+     */
+    static constexpr size_t BinarizePre = detail::get_value_v<binarize_pre<0>, Parameters...>;
+
+    /*!
+     * \brief Indicates if input are normalized
+     */
+    static constexpr bool NormalizePre = parameters::template contains<normalize_pre>();
+
+    static_assert(BatchSize > 0, "The batch size must be larger than one");
+    static_assert(BigBatchSize > 0, "The big batch size must be larger than one");
+    static_assert(ReadThreads > 0, "There must be at least one reader thread");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<
+            cpp::type_list<batch_size_id, big_batch_size_id, read_threads_id, categorical_id, nop_id, normalize_pre_id, binarize_pre_id, scale_pre_id>,
+            Parameters...>,
+        "Invalid parameters type for sharded_data_generator_desc");
+
+    /*!
+     * The generator type
+     */
+    template <typename T, size_t D>
+    using generator_t = sharded_data_generator<T, D, sharded_data_generator_desc<Parameters...>>;
+};
+
+/*!
+ * \brief Make a generator over several shards of a dataset
+ * \tparam D The number of dimensions of one sample
+ * \tparam T The weight type of the batches
+ * \param files The paths to all the shard files
+ * \param rank The rank of this process
+ * \param ranks The number of ranks sharing the shards
+ * \return a unique_ptr around the created generator
+ */
+template <size_t D, typename T = float, typename... Parameters>
+auto make_sharded_generator(const std::vector<std::string>& files, const sharded_data_generator_desc<Parameters...>& /*desc*/, size_t rank = 0, size_t ranks = 1) {
+    using generator_t = typename sharded_data_generator_desc<Parameters...>::template generator_t<T, D>;
+    return std::make_unique<generator_t>(files, rank, ranks);
+}
+
+} //end of dll namespace
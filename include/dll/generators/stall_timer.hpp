@@ -0,0 +1,96 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Measure of the time the training waits for the batches of the
+ * generators reading ahead.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace dll {
+
+/*!
+ * \brief The fraction of an epoch spent waiting for the generator above
+ * which the epoch is considered generator-bound
+ */
+constexpr double generator_bound_ratio = 0.1;
+
+/*!
+ * \brief Accumulates the time spent waiting for the batches of a
+ * generator.
+ *
+ * Only the waits for a batch that is not ready yet are timed, reading an
+ * already ready batch is not a stall.
+ */
+struct stall_timer {
+    std::atomic<size_t> nanoseconds{0}; ///< The total time spent waiting
+    std::atomic<size_t> stalls{0};      ///< The number of waits for a batch not yet ready
+
+    /*!
+     * \brief Wait on the condition until the predicate is true, timing the
+     * wait if the predicate is not true already.
+     *
+     * \param condition The condition variable to wait on
+     * \param lock The lock held on the mutex of the condition
+     * \param ready The predicate indicating that the batch is ready
+     */
+    template <typename Predicate>
+    void wait(std::condition_variable& condition, std::unique_lock<std::mutex>& lock, Predicate&& ready) {
+        if (ready()) {
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        condition.wait(lock, ready);
+
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+        nanoseconds.fetch_add(duration.count(), std::memory_order_relaxed);
+        stalls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Returns the total time spent waiting, in seconds
+     */
+    double seconds() const {
+        return nanoseconds.load(std::memory_order_relaxed) / 1e9;
+    }
+
+    /*!
+     * \brief Returns the number of waits for a batch not yet ready
+     */
+    size_t count() const {
+        return stalls.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Reset the accumulated time
+     */
+    void reset() {
+        nanoseconds.store(0, std::memory_order_relaxed);
+        stalls.store(0, std::memory_order_relaxed);
+    }
+};
+
+/*!
+ * \brief Indicates if an epoch is generator-bound
+ * \param stall The time spent waiting for the generator during the epoch, in seconds
+ * \param duration The duration of the epoch, in seconds
+ */
+inline bool is_generator_bound(double stall, double duration) {
+    return duration > 0.0 && stall > generator_bound_ratio * duration;
+}
+
+} //end of dll namespace
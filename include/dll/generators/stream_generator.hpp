@@ -0,0 +1,458 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief A never-ending generator fed by a continuous stream of samples
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace dll {
+
+/*!
+ * \brief A generator over a continuous stream of samples, for online
+ * training (see dbn_trainer::train_stream).
+ *
+ * The samples are pushed by any number of producer threads into a bounded
+ * lock-free ring (a Vyukov queue) and are consumed batch by batch by the
+ * training. The memory is bounded by the capacity of the ring: when it is
+ * full, try_push fails and push waits for some space.
+ *
+ * The generator has no epochs: it does not reset, shuffle or restart, and it
+ * only ends when it is closed and all the pushed samples are consumed. The
+ * last batch can be partial.
+ *
+ * \tparam T The weight type of the batches
+ * \tparam D The number of dimensions of one sample
+ * \tparam B The size of the batches
+ * \tparam Categorical Indicates if the labels are categorical (one-hot)
+ */
+template <typename T, size_t D, size_t B, bool Categorical = false>
+struct stream_generator {
+    using weight = T; ///< The data type
+
+    using data_view_type   = etl::custom_dyn_matrix<weight, D + 1>; ///< The type of the view on the batch
+    using label_cache_type = std::conditional_t<Categorical, etl::dyn_matrix<weight, 2>, etl::dyn_matrix<weight, 1>>; ///< The type of a label batch
+
+    static constexpr bool dll_generator = true; ///< Simple flag to indicate that the class is a DLL generator
+    static constexpr size_t batch_size  = B;    ///< The size of the generated batches
+
+    /*!
+     * \brief Construct a stream_generator
+     * \param capacity The maximum number of samples waiting in the ring (rounded to a power of two)
+     * \param dims The dimensions of one sample
+     * \param n_classes The number of classes
+     */
+    stream_generator(size_t capacity, const std::array<size_t, D>& dims, size_t n_classes) {
+        capacity = std::max(capacity, B);
+
+        while (mask + 1 < capacity) {
+            mask = 2 * mask + 1;
+        }
+
+        sample_size = std::accumulate(dims.begin(), dims.end(), size_t(1), std::multiplies<size_t>());
+
+        cells  = std::make_unique<cell[]>(mask + 1);
+        values.resize((mask + 1) * sample_size);
+
+        for (size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        std::array<size_t, D + 1> batch_dims;
+        batch_dims[0] = B;
+        std::copy(dims.begin(), dims.end(), batch_dims.begin() + 1);
+
+        batch_memory.resize(B * sample_size);
+        batch_view = std::make_unique<data_view_type>(make_view(batch_memory.data(), batch_dims, std::make_index_sequence<D + 1>()));
+
+        if constexpr (Categorical) {
+            label_cache = label_cache_type(B, n_classes);
+        } else {
+            label_cache = label_cache_type(B);
+        }
+    }
+
+    stream_generator(const stream_generator& rhs) = delete;
+    stream_generator operator=(const stream_generator& rhs) = delete;
+
+    stream_generator(stream_generator&& rhs) = delete;
+    stream_generator operator=(stream_generator&& rhs) = delete;
+
+    /*!
+     * \brief Push a sample into the stream, if there is some space.
+     *
+     * This can be called by several threads at once.
+     *
+     * \param sample The sample (an ETL container of the dimensions of the stream)
+     * \param label The label of the sample
+     * \return true if the sample was pushed, false if the ring is full
+     */
+    template <typename Sample>
+    bool try_push(const Sample& sample, size_t label) {
+        cpp_assert(etl::size(sample) == sample_size, "Invalid size of the sample of the stream");
+
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+
+        cell* c;
+
+        while (true) {
+            c = &cells[pos & mask];
+
+            const size_t seq = c->sequence.load(std::memory_order_acquire);
+            const auto diff  = std::intptr_t(seq) - std::intptr_t(pos);
+
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        sample.ensure_cpu_up_to_date();
+
+        std::copy(sample.begin(), sample.end(), values.begin() + (pos & mask) * sample_size);
+        c->label = label;
+
+        c->sequence.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /*!
+     * \brief Push a sample into the stream, waiting for some space if the
+     * ring is full.
+     *
+     * \param sample The sample (an ETL container of the dimensions of the stream)
+     * \param label The label of the sample
+     */
+    template <typename Sample>
+    void push(const Sample& sample, size_t label) {
+        while (!try_push(sample, label)) {
+            std::this_thread::yield();
+        }
+    }
+
+    /*!
+     * \brief Close the stream: no more samples will be pushed. The
+     * generator ends once the samples of the ring are consumed.
+     */
+    void close() {
+        closed.store(true, std::memory_order_release);
+    }
+
+    /*!
+     * \brief Returns the number of samples waiting in the ring
+     */
+    size_t pending() const {
+        return enqueue_pos.load(std::memory_order_relaxed) - dequeue_pos.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Display a description of the generator in the given stream
+     * \param stream The stream to print to
+     * \return stream
+     */
+    std::ostream& display(std::ostream& stream) const {
+        stream << "Stream Data Generator" << std::endl;
+        stream << "          Capacity: " << (mask + 1) << std::endl;
+        stream << "          Consumed: " << size() << std::endl;
+
+        return stream;
+    }
+
+    /*!
+     * \brief Display a description of the generator in the standard output.
+     */
+    void display() const {
+        display(std::cout);
+    }
+
+    /*!
+     * \brief Indicates that it is safe to destroy the memory of the generator
+     * when not used by the pretraining phase
+     */
+    void set_safe() {
+        // Nothing is kept in memory
+    }
+
+    /*!
+     * \brief Clear the memory of the generator.
+     */
+    void clear() {
+        // Nothing is kept in memory
+    }
+
+    /*!
+     * brief Sets the generator in test mode
+     */
+    void set_test() {
+        // Nothing to do
+    }
+
+    /*!
+     * brief Sets the generator in train mode
+     */
+    void set_train() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator, a stream cannot be restarted
+     */
+    void reset() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Reset the generator, a stream cannot be shuffled
+     */
+    void reset_shuffle() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Shuffle the generator, a stream cannot be shuffled
+     */
+    void shuffle() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Prepare the dataset for an epoch
+     */
+    void prepare_epoch() {
+        // Nothing to do
+    }
+
+    /*!
+     * \brief Return the index of the current batch
+     * \return The current batch index
+     */
+    size_t current_batch() const {
+        return current;
+    }
+
+    /*!
+     * \brief Returns the number of samples consumed so far
+     */
+    size_t size() const {
+        return consumed;
+    }
+
+    /*!
+     * \brief Returns the number of samples consumed so far
+     */
+    size_t augmented_size() const {
+        return consumed;
+    }
+
+    /*!
+     * \brief Returns the number of batches of the stream, which is unknown
+     */
+    size_t batches() const {
+        return std::numeric_limits<size_t>::max();
+    }
+
+    /*!
+     * \brief Indicates if the generator has a next batch or not.
+     *
+     * This waits until a complete batch has been pushed or the stream is
+     * closed.
+     *
+     * \return true if the generator has a next batch, false otherwise
+     */
+    bool has_next_batch() const {
+        fill();
+
+        return filled_n > 0;
+    }
+
+    /*!
+     * \brief Moves to the next batch.
+     */
+    void next_batch() {
+        fill();
+
+        consumed += filled_n;
+        ++current;
+    }
+
+    /*!
+     * \brief Returns the current data batch
+     * \return a a batch of data.
+     */
+    auto data_batch() const {
+        fill();
+
+        return etl::slice(*batch_view, 0, filled_n);
+    }
+
+    /*!
+     * \brief Returns the current label batch
+     * \return a a batch of label.
+     */
+    auto label_batch() const {
+        fill();
+
+        return etl::slice(label_cache, 0, filled_n);
+    }
+
+    /*!
+     * \brief Returns the number of dimensions of the input.
+     * \return The number of dimensions of the input.
+     */
+    static constexpr size_t dimensions() {
+        return D;
+    }
+
+private:
+    /*!
+     * \brief A cell of the ring
+     */
+    struct cell {
+        std::atomic<size_t> sequence; ///< The sequence of the cell
+        size_t label;                 ///< The label of the sample of the cell
+    };
+
+    /*!
+     * \brief Create a view of the given dimensions on the given memory
+     */
+    template <size_t... I>
+    static data_view_type make_view(weight* memory, const std::array<size_t, D + 1>& dims, std::index_sequence<I...> /*seq*/) {
+        return data_view_type(memory, dims[I]...);
+    }
+
+    /*!
+     * \brief Pop one sample from the ring
+     * \param out The memory of the sample
+     * \param label The label of the sample
+     * \return true if a sample was popped, false if the ring is empty
+     */
+    bool try_pop(weight* out, size_t& label) const {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+
+        cell* c;
+
+        while (true) {
+            c = &cells[pos & mask];
+
+            const size_t seq = c->sequence.load(std::memory_order_acquire);
+            const auto diff  = std::intptr_t(seq) - std::intptr_t(pos + 1);
+
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        auto first = values.begin() + (pos & mask) * sample_size;
+        std::copy(first, first + sample_size, out);
+        label = c->label;
+
+        c->sequence.store(pos + mask + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /*!
+     * \brief Fill the current batch from the ring, if not already done
+     */
+    void fill() const {
+        if (filled == current) {
+            return;
+        }
+
+        size_t n = 0;
+        size_t label;
+
+        while (n < B) {
+            if (try_pop(batch_memory.data() + n * sample_size, label)) {
+                if constexpr (Categorical) {
+                    label_cache(n) = weight(0);
+                    label_cache(n, label) = weight(1);
+                } else {
+                    label_cache[n] = weight(label);
+                }
+
+                ++n;
+            } else if (closed.load(std::memory_order_acquire) && !pending()) {
+                // All the samples pushed before the close are consumed
+                break;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        batch_view->invalidate_gpu();
+        label_cache.invalidate_gpu();
+
+        filled   = current;
+        filled_n = n;
+    }
+
+    size_t sample_size = 0; ///< The number of values of one sample
+    size_t mask        = 0; ///< The mask of the positions in the ring
+
+    mutable std::unique_ptr<cell[]> cells; ///< The cells of the ring
+    std::vector<weight> values;            ///< The samples of the cells of the ring
+
+    alignas(64) std::atomic<size_t> enqueue_pos{0};         ///< The next position to push to
+    alignas(64) mutable std::atomic<size_t> dequeue_pos{0}; ///< The next position to pop from
+    alignas(64) std::atomic<bool> closed{false};            ///< Indicates if the stream is closed
+
+    mutable std::vector<weight> batch_memory;   ///< The memory of the current batch
+    std::unique_ptr<data_view_type> batch_view; ///< The view on the current batch
+    mutable label_cache_type label_cache;       ///< The labels of the current batch
+
+    size_t current  = 0; ///< The current batch
+    size_t consumed = 0; ///< The number of samples consumed
+
+    mutable size_t filled   = size_t(-1); ///< The index of the batch in the batch memory
+    mutable size_t filled_n = 0;          ///< The number of samples of the batch in the batch memory
+};
+
+/*!
+ * \brief Make a generator over a continuous stream of samples
+ * \tparam B The size of the batches
+ * \tparam Categorical Indicates if the labels are categorical (one-hot)
+ * \tparam T The weight type of the batches
+ * \param capacity The maximum number of samples waiting in the stream
+ * \param n_classes The number of classes
+ * \param dims The dimensions of one sample
+ * \return a unique_ptr around the created generator
+ */
+template <size_t B, bool Categorical = false, typename T = float, typename... Dims>
+auto make_stream_generator(size_t capacity, size_t n_classes, Dims... dims) {
+    using generator_t = stream_generator<T, sizeof...(Dims), B, Categorical>;
+    return std::make_unique<generator_t>(capacity, std::array<size_t, sizeof...(Dims)>{{size_t(dims)...}}, n_classes);
+}
+
+} //end of dll namespace
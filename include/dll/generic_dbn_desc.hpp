@@ -48,6 +48,12 @@ struct generic_dbn_desc {
      */
     static constexpr size_t BigBatchSize = detail::get_value_v<big_batch_size<1>, Parameters...>;
 
+    /*!
+     * \brief The number of bits of the values of the feature store, 0 if the
+     * features are kept in memory
+     */
+    static constexpr size_t FeatureStore = detail::get_value_v<feature_store<0>, Parameters...>;
+
     /*!
      * \brief The pre scaling factor
      */
@@ -106,15 +112,20 @@ struct generic_dbn_desc {
 
     static_assert(BatchSize > 0, "Batch size must be at least 1");
     static_assert(BigBatchSize > 0, "Big Batch size must be at least 1");
+    static_assert(FeatureStore == 0 || FeatureStore == 16 || FeatureStore == 32, "The feature store only supports 16 or 32 bits values");
+    static_assert(detail::get_value_v<checkpointing<1>, Parameters...> > 0, "Checkpointing interval must be at least 1");
+    static_assert(detail::get_value_v<data_parallel<1>, Parameters...> > 0, "Data parallel SGD needs at least 1 worker");
+    static_assert(detail::get_value_v<accumulate_gradients<1>, Parameters...> > 0, "Gradient accumulation needs at least 1 batch");
+    static_assert(detail::get_value_v<check_finite<1>, Parameters...> > 0, "The finite checks need an interval of at least 1 batch");
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<
             cpp::type_list<
                 trainer_id, watcher_id, weight_decay_id, big_batch_size_id, batch_size_id, verbose_id, no_epoch_error_id,
-                batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, shuffle_id, shuffle_pre_id, loss_id,
+                batch_mode_id, svm_concatenate_id, svm_scale_id, serial_id, shuffle_id, shuffle_pre_id, pipeline_pre_id, feature_store_id, loss_id,
                 normalize_pre_id, binarize_pre_id, scale_pre_id, autoencoder_id, noise_id, updater_id,
-                early_stopping_id, early_training_id, clip_gradients_id, output_policy_id>,
+                early_stopping_id, early_training_id, clip_gradients_id, clip_global_norm_id, lazy_decay_id, sync_batch_norm_id, output_policy_id, bf16_storage_id, checkpointing_id, data_parallel_id, fused_updater_id, flat_parameters_id, overlap_updates_id, accumulate_gradients_id, mixed_precision_id, ema_weights_id, numa_id, threads_id, async_validation_id, check_finite_id, freeze_layers_id, memory_budget_id, pipeline_stages_id>,
             Parameters...>,
         "Invalid parameters type");
 };
@@ -124,3 +135,5 @@ struct generic_dbn_desc {
 // Include the trainers
 #include "dll/trainer/conjugate_gradient.hpp"
 #include "dll/trainer/stochastic_gradient_descent.hpp"
+#include "dll/trainer/async_sgd_trainer.hpp"
+#include "dll/trainer/lbfgs_trainer.hpp"
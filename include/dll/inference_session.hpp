@@ -0,0 +1,428 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Thread-safe inference on a read-only network.
+ *
+ * An inference session owns all the intermediate activations (and the
+ * forward caches of the recurrent layers) needed to forward propagate
+ * through a network. Batch Normalization layers folded by
+ * dbn::freeze_for_inference() are skipped, element-wise layers (activation,
+ * scale, ...) are applied in-place and identity layers (shape layers and
+ * dropout) forward their input, without their own buffer. The activation
+ * layers following a dense or convolutional layer without activation
+ * function are fused into the forward pass of this layer and the upsample
+ * layers preceding a convolutional layer are fused into its forward pass,
+ * which reads the input before the upsampling. Several sessions
+ * can share the same network, as long as the network is not modified
+ * (trained) at the same time.
+ */
+
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/ready.hpp"
+#include "dll/util/batch_reshape.hpp"
+#include "dll/neural/batch_normalization_fold.hpp"
+#include "dll/util/inplace.hpp"
+
+namespace dll {
+
+namespace session_detail {
+
+/*!
+ * \brief Empty cache used for the layers without forward state
+ */
+struct no_cache {};
+
+/*!
+ * \brief Extract the type of the external forward cache of a layer
+ */
+template <typename Layer, typename Enable = void>
+struct layer_cache {
+    using type = no_cache;                   ///< The type of the cache
+    static constexpr bool value = false; ///< Indicates if the layer needs a cache
+};
+
+/*!
+ * \copydoc layer_cache
+ */
+template <typename Layer>
+struct layer_cache<Layer, std::void_t<typename Layer::inference_cache_t>> {
+    using type = typename Layer::inference_cache_t; ///< The type of the cache
+    static constexpr bool value = true;             ///< Indicates if the layer needs a cache
+};
+
+/*!
+ * \brief Compute the type of one output of each layer of the network.
+ */
+template <typename DBN, size_t I>
+struct types {
+    using input_one_t  = typename types<DBN, I - 1>::output_one_t; ///< The type of one input of the layer
+    using output_one_t = std::decay_t<decltype(std::declval<typename DBN::template layer_type<I>>().template prepare_one_output<input_one_t>())>; ///< The type of one output of the layer
+};
+
+/*!
+ * \copydoc types
+ */
+template <typename DBN>
+struct types<DBN, 0> {
+    using input_one_t  = typename DBN::input_one_t; ///< The type of one input of the layer
+    using output_one_t = std::decay_t<decltype(std::declval<typename DBN::template layer_type<0>>().template prepare_one_output<input_one_t>())>; ///< The type of one output of the layer
+};
+
+/*!
+ * \brief Indicates if the layer I forwards its input as its output (identity
+ * layers with the same dimensions as their input)
+ */
+template <typename DBN, size_t I>
+constexpr bool aliases_input() {
+    using layer_t = typename DBN::template layer_type<I>;
+    using input_t = typename types<DBN, I>::input_one_t;
+    using output_t = typename types<DBN, I>::output_one_t;
+
+    return I + 1 < DBN::layers && is_identity_layer<layer_t>::value && etl::decay_traits<input_t>::dimensions() == etl::decay_traits<output_t>::dimensions();
+}
+
+/*!
+ * \brief Indicates if the activation layer following the layer I is fused
+ * into its forward pass (layers without activation function followed by an
+ * activation layer)
+ */
+template <typename DBN, size_t I>
+constexpr bool fuses_next() {
+    if constexpr (I + 1 < DBN::layers) {
+        return is_activation_fusable_layer<typename DBN::template layer_type<I>>::value
+               && is_activation_layer<typename DBN::template layer_type<I + 1>>::value;
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Indicates if the layer I is an activation layer fused into the
+ * forward pass of the previous layer
+ */
+template <typename DBN, size_t I>
+constexpr bool fused_into_previous() {
+    if constexpr (I > 0) {
+        return fuses_next<DBN, I - 1>();
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Indicates if the layer I is an upsample layer fused into the
+ * forward pass of the next layer, which reads the input before the
+ * upsampling
+ */
+template <typename DBN, size_t I>
+constexpr bool fuses_upsample() {
+    if constexpr (I + 1 < DBN::layers) {
+        return is_fusable_upsample_layer<typename DBN::template layer_type<I>>::value
+               && is_upsample_fusable_layer<typename DBN::template layer_type<I + 1>>::value
+               && !fuses_next<DBN, I + 1>();
+    } else {
+        return false;
+    }
+}
+
+template <typename DBN, size_t I>
+constexpr bool needs_buffer();
+
+/*!
+ * \brief Indicates if the input of the layer I is always owned by the session
+ * (one of the previous layers always writes into its own buffer)
+ */
+template <typename DBN, size_t I>
+constexpr bool owned_input() {
+    if constexpr (I == 0) {
+        return false;
+    } else {
+        // Folded batch normalization layers forward their input
+        return owned_input<DBN, I - 1>() || (needs_buffer<DBN, I - 1>() && !is_batch_normalization_layer<typename DBN::template layer_type<I - 1>>::value);
+    }
+}
+
+/*!
+ * \brief Indicates if the layer I needs its own output buffer. The output of
+ * the last layer is always in its buffer.
+ */
+template <typename DBN, size_t I>
+constexpr bool needs_buffer() {
+    using layer_t = typename DBN::template layer_type<I>;
+
+    if constexpr (I + 1 == DBN::layers) {
+        return true;
+    } else if constexpr (fuses_next<DBN, I>()) {
+        // The fused layer writes directly in the buffer of the activation
+        return false;
+    } else if constexpr (fuses_upsample<DBN, I>()) {
+        // The upsampled input is never computed
+        return false;
+    } else if constexpr (fused_into_previous<DBN, I>()) {
+        return true;
+    } else if constexpr (aliases_input<DBN, I>()) {
+        return false;
+    } else {
+        return !(is_inplace_layer<layer_t>::value && owned_input<DBN, I>());
+    }
+}
+
+template <typename DBN, typename Sequence>
+struct buffers;
+
+/*!
+ * \brief The type of the output buffers (one batch per layer) and of the
+ * layer caches of the network.
+ */
+template <typename DBN, size_t... I>
+struct buffers<DBN, std::index_sequence<I...>> {
+    using weight = typename DBN::weight; ///< The data type of the network
+
+    template <size_t L>
+    using batch_t = etl::dyn_matrix<weight, etl::decay_traits<typename types<DBN, L>::output_one_t>::dimensions() + 1>; ///< The type of a batch of output
+
+    using outputs_t = std::tuple<batch_t<I>...>;                                                     ///< The output buffers
+    using caches_t  = std::tuple<typename layer_cache<typename DBN::template layer_type<I>>::type...>; ///< The layer caches
+};
+
+} //end of session_detail namespace
+
+/*!
+ * \brief An inference session on a network.
+ *
+ * The session preallocates every intermediate batch for a maximum batch size
+ * and then forwards batches through the network without any allocation. The
+ * network is only accessed in read-only mode and therefore many sessions
+ * (typically one per thread) can share the same network.
+ *
+ * The session is not thread-safe itself: it must not be used by several
+ * threads at the same time.
+ */
+template <typename DBN>
+struct inference_session {
+    using dbn_t  = DBN;                   ///< The network type
+    using weight = typename dbn_t::weight; ///< The data type of the network
+
+    static constexpr size_t layers = dbn_t::layers; ///< The number of layers
+
+    using buffers_t = session_detail::buffers<dbn_t, std::make_index_sequence<layers>>; ///< The type of the buffers
+    using outputs_t = typename buffers_t::outputs_t;                                      ///< The type of the output buffers
+    using caches_t  = typename buffers_t::caches_t;                                       ///< The type of the layer caches
+
+    /*!
+     * \brief Create a new session on the given network
+     * \param dbn The network, that must not be modified while the session is in use
+     * \param max_batch The maximum number of samples in a batch
+     */
+    explicit inference_session(const dbn_t& dbn, size_t max_batch = dbn_t::batch_size) : dbn(dbn), max_batch(max_batch) {
+        // Fast networks can be be preallocated directly
+        if constexpr (etl::is_fast<typename dbn_t::input_one_t>) {
+            typename dbn_t::input_one_t one;
+            reserve_impl<0>(one, max_batch);
+        }
+    }
+
+    /*!
+     * \brief Make sure the session can hold batches of n samples.
+     *
+     * This is the only function that allocates memory. It is called
+     * automatically the first time a batch is forwarded and when a batch
+     * bigger than the current capacity is forwarded.
+     *
+     * \param one One sample, used to compute the dimensions of dynamic layers
+     * \param n The number of samples
+     */
+    template <typename Input>
+    void reserve(const Input& one, size_t n) {
+        reserve_impl<0>(one, n);
+        max_batch = n;
+    }
+
+    /*!
+     * \brief Returns the current capacity (in samples) of the session
+     */
+    size_t capacity() const noexcept {
+        return max_batch;
+    }
+
+    /*!
+     * \brief Forward propagate a batch of samples through the network.
+     *
+     * \param input The batch of samples
+     *
+     * \return A view on the output of the network. This view remains valid
+     * until the next forward propagation through this session.
+     */
+    template <typename Input>
+    decltype(auto) forward_batch(const Input& input) {
+        const size_t n = etl::dim<0>(input);
+
+        if (cpp_unlikely(!ready || n > max_batch)) {
+            reserve(input(0), std::max(n, max_batch));
+        }
+
+        forward_impl<0, false>(input, n);
+
+        return etl::slice(std::get<layers - 1>(outputs), 0, n);
+    }
+
+    /*!
+     * \brief Forward propagate one sample through the network.
+     *
+     * \param sample The sample
+     *
+     * \return A view on the output of the network. This view remains valid
+     * until the next forward propagation through this session.
+     */
+    template <typename Input>
+    decltype(auto) forward_one(const Input& sample) {
+        if (cpp_unlikely(!ready)) {
+            reserve(sample, max_batch);
+        }
+
+        forward_impl<0, false>(batch_reshape(sample), 1);
+
+        return std::get<layers - 1>(outputs)(0);
+    }
+
+    /*!
+     * \brief Returns the network used by this session
+     */
+    const dbn_t& network() const noexcept {
+        return dbn;
+    }
+
+private:
+    template <size_t I, typename One>
+    void reserve_impl(const One& one, size_t n) {
+        if constexpr (I < layers) {
+            auto next = prepare_one_ready_output(dbn.template layer_get<I>(), one);
+
+            // The layers running in-place do not have their own buffer
+            if constexpr (session_detail::needs_buffer<dbn_t, I>()) {
+                auto& output = std::get<I>(outputs);
+
+                constexpr size_t D = etl::decay_traits<decltype(next)>::dimensions();
+
+                if constexpr (D == 1) {
+                    output.resize(n, etl::dim<0>(next));
+                } else if constexpr (D == 2) {
+                    output.resize(n, etl::dim<0>(next), etl::dim<1>(next));
+                } else if constexpr (D == 3) {
+                    output.resize(n, etl::dim<0>(next), etl::dim<1>(next), etl::dim<2>(next));
+                }
+            }
+
+            reserve_impl<I + 1>(next, n);
+        } else {
+            ready = true;
+        }
+    }
+
+    /*!
+     * \brief Forward propagate the input through the layer I and the next
+     * layers.
+     *
+     * The layers without buffer (see session_detail::needs_buffer) always
+     * take one of the branches that do not use it.
+     *
+     * \tparam Owned Indicates if the input is owned by the session (and
+     * therefore can be overwritten)
+     */
+    template <size_t I, bool Owned, typename Input>
+    void forward_impl(const Input& input, size_t n) {
+        decltype(auto) layer = dbn.template layer_get<I>();
+
+        using layer_t = std::decay_t<decltype(layer)>;
+
+        // Folded batch normalization is the identity
+        if constexpr (is_batch_normalization_layer<layer_t>::value) {
+            if (layer.folded) {
+                forward_next<I, Owned>(input, n);
+                return;
+            }
+        }
+
+        if constexpr (session_detail::fuses_upsample<dbn_t, I>()) {
+            // The next layer convolves the input of this layer directly
+            decltype(auto) next = dbn.template layer_get<I + 1>();
+
+            using next_t = std::decay_t<decltype(next)>;
+
+            auto output = etl::slice(std::get<I + 1>(outputs), 0, n);
+
+            next.template forward_batch_upsampled<next_t::activation_function>(output, input, layer_t::C2, layer_t::C3);
+
+            forward_next<I + 1, true>(output, n);
+        } else if constexpr (session_detail::fuses_next<dbn_t, I>()) {
+            // The activation of the next layer is applied by this layer,
+            // directly in the output of the next layer
+            using next_t = typename dbn_t::template layer_type<I + 1>;
+
+            auto output = etl::slice(std::get<I + 1>(outputs), 0, n);
+
+            layer.template forward_batch_activated<next_t::activation_function>(output, input);
+
+            forward_next<I + 1, true>(output, n);
+        } else if constexpr (session_detail::aliases_input<dbn_t, I>()) {
+            // Identity layers forward their input directly
+            forward_next<I, Owned>(input, n);
+        } else if constexpr (Owned && is_inplace_layer<layer_t>::value) {
+            // Element-wise layers are applied in-place
+            auto output = input;
+            layer.test_forward_batch(output, input);
+            forward_next<I, Owned>(output, n);
+        } else {
+            static_assert(session_detail::needs_buffer<dbn_t, I>(), "The output of the layer has no buffer");
+
+            auto output = etl::slice(std::get<I>(outputs), 0, n);
+
+            if constexpr (session_detail::layer_cache<layer_t>::value) {
+                layer.forward_batch(output, input, std::get<I>(caches));
+            } else {
+                layer.test_forward_batch(output, input);
+            }
+
+            forward_next<I, true>(output, n);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate the output of the layer I to the next layers.
+     *
+     * The output of the last layer is made available in the last buffer.
+     */
+    template <size_t I, bool Owned, typename Output>
+    void forward_next(const Output& output, size_t n) {
+        if constexpr (I + 1 < layers) {
+            forward_impl<I + 1, Owned>(output, n);
+        } else {
+            auto& last = std::get<layers - 1>(outputs);
+
+            if (output.memory_start() != last.memory_start()) {
+                etl::slice(last, 0, n) = output;
+            }
+        }
+    }
+
+    const dbn_t& dbn; ///< The network
+    size_t max_batch; ///< The capacity of the session
+    bool ready = false; ///< Indicates if the buffers are allocated
+
+    outputs_t outputs; ///< The output of each layer
+    caches_t caches;   ///< The forward caches of the layers
+};
+
+} //end of dll namespace
@@ -6,15 +6,92 @@
 //=======================================================================
 
 #include "dll/util/random.hpp"
+#include "dll/util/parallel.hpp"
 
 /*!
  * \brief Initialization methods
+ *
+ * The random initializations of the tensors are generated by chunks, each
+ * chunk from its own random stream, split from a stream drawn once per
+ * tensor from dll::rand_engine(). The chunks are generated in parallel,
+ * which also places the pages of large tensors on the NUMA nodes of the
+ * threads first touching them. The values only depend on dll::seed() and on
+ * the order in which the tensors are initialized, not on the number of
+ * threads.
  */
 
 #pragma once
 
 namespace dll {
 
+namespace init_detail {
+
+constexpr size_t chunk_size = 1UL << 16; ///< The number of values generated from the same stream
+
+/*!
+ * \brief Fill the given tensor with gen(stream, memory, n), by chunks
+ * generated in parallel
+ */
+template <typename B, typename Gen>
+void fill_chunks(B& b, Gen&& gen) {
+    auto& engine = dll::rand_engine();
+
+    const uint64_t high = uint64_t(engine());
+    const uint64_t low  = uint64_t(engine());
+
+    random_stream stream(mix_key((high << 32) ^ low));
+
+    auto* out      = b.memory_start();
+    const size_t n = etl::size(b);
+
+    const size_t chunks = (n + chunk_size - 1) / chunk_size;
+
+    parallel_range(chunks, n, [&stream, &gen, out, n](size_t first, size_t last) {
+        for (size_t c = first; c < last; ++c) {
+            auto chunk_stream = stream.split(c);
+
+            gen(chunk_stream, out + c * chunk_size, std::min(chunk_size, n - c * chunk_size));
+        }
+    });
+
+    b.invalidate_gpu();
+}
+
+/*!
+ * \brief Fill the given tensor with values drawn from a normal distribution
+ */
+template <typename B>
+void normal(B& b, double mean, double stddev) {
+    using T = etl::value_t<B>;
+
+    if constexpr (etl::is_dma<B>) {
+        fill_chunks(b, [mean, stddev](random_stream& stream, T* out, size_t n) {
+            stream.normal(out, n, T(mean), T(stddev));
+        });
+    } else {
+        b = etl::normal_generator<T>(dll::rand_engine(), mean, stddev);
+    }
+}
+
+/*!
+ * \brief Fill the given tensor with values drawn from a uniform distribution
+ * in [a, b)
+ */
+template <typename W>
+void uniform(W& w, double a, double b) {
+    using T = etl::value_t<W>;
+
+    if constexpr (etl::is_dma<W>) {
+        fill_chunks(w, [a, b](random_stream& stream, T* out, size_t n) {
+            stream.uniform(out, n, T(a), T(b));
+        });
+    } else {
+        w = etl::uniform_generator<T>(dll::rand_engine(), a, b);
+    }
+}
+
+} //end of namespace init_detail
+
 /*!
  * \brief Initialization function no-op
  */
@@ -85,7 +162,7 @@ struct init_normal {
         constexpr auto mean   = etl::value_t<B>(Mean::num) / etl::value_t<B>(Mean::den);
         constexpr auto stddev = etl::value_t<B>(Std::num) / etl::value_t<B>(Std::den);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), mean, stddev);
+        init_detail::normal(b, mean, stddev);
     }
 };
 
@@ -109,7 +186,7 @@ struct init_uniform {
         constexpr auto a = etl::value_t<W>(A::num) / etl::value_t<W>(A::den);
         constexpr auto b = etl::value_t<W>(B::num) / etl::value_t<W>(B::den);
 
-        w = etl::uniform_generator<etl::value_t<W>>(dll::rand_engine(), a, b);
+        init_detail::uniform(w, a, b);
     }
 };
 
@@ -130,7 +207,7 @@ struct init_lecun {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) / sqrt(double(nin));
+        init_detail::normal(b, 0.0, 1.0 / sqrt(double(nin)));
     }
 };
 
@@ -149,7 +226,7 @@ struct init_xavier {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(1.0 / nin);
+        init_detail::normal(b, 0.0, sqrt(1.0 / nin));
     }
 };
 
@@ -166,7 +243,7 @@ struct init_xavier_full {
      */
     template<typename B>
     static void initialize(B& b, size_t nin, size_t nout){
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / (nin + nout));
+        init_detail::normal(b, 0.0, sqrt(2.0 / (nin + nout)));
     }
 };
 
@@ -185,7 +262,7 @@ struct init_he {
     static void initialize(B& b, size_t nin, size_t nout){
         cpp_unused(nout);
 
-        b = etl::normal_generator<etl::value_t<B>>(dll::rand_engine(), 0.0, 1.0) * sqrt(2.0 / nin);
+        init_detail::normal(b, 0.0, sqrt(2.0 / nin));
     }
 };
 
@@ -15,6 +15,7 @@
 #include "dll/trainer/context_fwd.hpp" // Forward declaration of the context classes
 #include "dll/util/batch_extend.hpp"   // For easy batch creation
 #include "dll/util/batch_reshape.hpp"  // For easy batch reshaping
+#include "dll/util/layer_cost.hpp"     // For the cost of the layers
 #include "dll/util/ready.hpp"          // To create ready output
 #include "dll/util/tmp.hpp"            // Every layer description needs TMP
 
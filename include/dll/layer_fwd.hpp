@@ -68,18 +68,51 @@ struct dyn_lcn_layer_impl;
 template <typename Desc>
 struct scale_layer_impl;
 
+template <typename Desc>
+struct shape_1d_layer_impl;
+
+template <typename Desc>
+struct dyn_shape_1d_layer_impl;
+
+template <typename Desc>
+struct shape_3d_layer_impl;
+
+template <typename Desc>
+struct dyn_shape_3d_layer_impl;
+
 template <typename Desc>
 struct dense_layer_impl;
 
 template <typename Desc>
 struct dyn_dense_layer_impl;
 
+template <typename Desc>
+struct tied_dense_layer_impl;
+
+template <typename Desc>
+struct hashed_embedding_layer_impl;
+
 template <typename Desc>
 struct conv_layer_impl;
 
 template <typename Desc>
 struct dyn_conv_layer_impl;
 
+template <typename Desc>
+struct conv_3d_layer_impl;
+
+template <typename Desc>
+struct dyn_conv_3d_layer_impl;
+
+template <typename Desc>
+struct grouped_conv_layer_impl;
+
+template <typename Desc>
+struct dyn_grouped_conv_layer_impl;
+
+template <typename Desc>
+struct separable_conv_layer_impl;
+
 template <typename Desc>
 struct deconv_layer_impl;
 
@@ -89,6 +122,24 @@ struct dyn_deconv_layer_impl;
 template <typename Desc>
 struct activation_layer_impl;
 
+template <typename Desc>
+struct dropout_layer_impl;
+
+template <typename Desc>
+struct dyn_dropout_layer_impl;
+
+template <typename Desc>
+struct batch_normalization_2d_layer_impl;
+
+template <typename Desc>
+struct dyn_batch_normalization_2d_layer_impl;
+
+template <typename Desc>
+struct batch_normalization_4d_layer_impl;
+
+template <typename Desc>
+struct dyn_batch_normalization_4d_layer_impl;
+
 template <typename... Layers>
 struct group_layer_desc;
 
@@ -172,6 +172,14 @@ struct rbm_layer_traits {
         return base_traits::has_clip_gradients;
     }
 
+    /*!
+     * \brief Indicates if the RBM weights are kept in bfloat16 precision
+     * during training, with a single precision master copy.
+     */
+    static constexpr bool mixed_precision() {
+        return base_traits::has_mixed_precision;
+    }
+
     /*!
      * \brief Indicates if the RBM training is made verbose.
      */
@@ -239,6 +247,36 @@ struct rbm_layer_traits {
 template <typename T>
 using decay_layer_traits = layer_traits<std::decay_t<T>>;
 
+/*!
+ * \brief Traits to test if a layer can skip the padding time steps at the
+ * end of the batches (see active_steps).
+ */
+template <typename Layer, typename Enable = void>
+struct has_active_steps : std::false_type {};
+
+template <typename Layer>
+struct has_active_steps<Layer, std::void_t<decltype(std::declval<Layer&>().active_steps)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer can use the length of each sequence of
+ * the batches (see sample_steps).
+ */
+template <typename Layer, typename Enable = void>
+struct has_sample_steps : std::false_type {};
+
+template <typename Layer>
+struct has_sample_steps<Layer, std::void_t<decltype(std::declval<Layer&>().sample_steps)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer uses the weights of another layer of the
+ * network (see tied_layer).
+ */
+template <typename Layer, typename Enable = void>
+struct has_tied_weights : std::false_type {};
+
+template <typename Layer>
+struct has_tied_weights<Layer, std::void_t<decltype(Layer::tied_layer)>> : std::true_type {};
+
 /*!
  * \brief Return the number of input channels of the given CRBM
  */
@@ -0,0 +1,132 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Schedules of the learning rate during fine-tuning
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+namespace dll {
+
+/*!
+ * \brief The type of schedule of the learning rate
+ */
+enum class lr_schedule_type {
+    CONSTANT, ///< The learning rate is not changed (except during warmup)
+    STEP,     ///< The learning rate is multiplied by gamma every step_size batches
+    COSINE,   ///< The learning rate follows a cosine down to min_factor
+    ONE_CYCLE ///< The learning rate goes up to max_factor and then down to min_factor
+};
+
+/*!
+ * \brief Returns a string representation of a schedule type
+ * \param s The schedule type to transform to string
+ * \return a string representation of a schedule type
+ */
+inline std::string to_string(lr_schedule_type s) {
+    switch (s) {
+        case lr_schedule_type::CONSTANT:
+            return "CONSTANT";
+        case lr_schedule_type::STEP:
+            return "STEP";
+        case lr_schedule_type::COSINE:
+            return "COSINE";
+        case lr_schedule_type::ONE_CYCLE:
+            return "ONE_CYCLE";
+    }
+
+    cpp_unreachable("Unreachable code");
+
+    return "UNDEFINED";
+}
+
+/*!
+ * \brief A schedule of the learning rate, evaluated before each batch of
+ * fine-tuning.
+ *
+ * The schedule gives a factor of the base learning rate (the learning rate
+ * of the network when the training starts). It is configured at runtime,
+ * the network does not need to be recompiled to change it.
+ */
+struct lr_schedule {
+    lr_schedule_type type = lr_schedule_type::CONSTANT; ///< The type of schedule
+
+    size_t warmup       = 0;   ///< The number of batches of linear warmup
+    double warmup_start = 0.0; ///< The factor at the start of the warmup
+
+    size_t step_size = 1000; ///< The number of batches between two decays (STEP)
+    double gamma     = 0.1;  ///< The decay factor (STEP)
+
+    double min_factor = 0.0;  ///< The final factor (COSINE and ONE_CYCLE)
+    double max_factor = 10.0; ///< The peak factor (ONE_CYCLE)
+    double peak       = 0.3;  ///< The fraction of the batches before the peak (ONE_CYCLE)
+
+    /*!
+     * \brief Indicates if the schedule changes the learning rate
+     */
+    bool enabled() const {
+        return type != lr_schedule_type::CONSTANT || warmup > 0;
+    }
+
+    /*!
+     * \brief Returns the factor of the base learning rate for the given batch
+     * \param step The index of the batch since the start of the training
+     * \param total The total number of batches of the training
+     */
+    double factor(size_t step, size_t total) const {
+        if (step < warmup) {
+            return warmup_start + (1.0 - warmup_start) * double(step) / double(warmup);
+        }
+
+        const double s = double(step - warmup);
+        const double t = total > warmup ? double(total - warmup) : 1.0;
+        const double p = std::min(s / t, 1.0);
+
+        switch (type) {
+            case lr_schedule_type::CONSTANT:
+                return 1.0;
+
+            case lr_schedule_type::STEP:
+                return std::pow(gamma, double((step - warmup) / step_size));
+
+            case lr_schedule_type::COSINE:
+                return min_factor + (1.0 - min_factor) * 0.5 * (1.0 + std::cos(M_PI * p));
+
+            case lr_schedule_type::ONE_CYCLE:
+                if (p < peak) {
+                    return 1.0 + (max_factor - 1.0) * p / peak;
+                } else {
+                    const double q = (p - peak) / (1.0 - peak);
+
+                    return min_factor + (max_factor - min_factor) * 0.5 * (1.0 + std::cos(M_PI * q));
+                }
+        }
+
+        return 1.0;
+    }
+};
+
+/*!
+ * \brief Returns a string representation of a schedule
+ */
+inline std::string to_string(const lr_schedule& s) {
+    std::string result = to_string(s.type);
+
+    if (s.warmup) {
+        result += " (warmup " + std::to_string(s.warmup) + " batches)";
+    }
+
+    return result;
+}
+
+} //end of dll namespace
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -37,6 +38,8 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     etl::fast_matrix<weight, Input> mean;
     etl::fast_matrix<weight, Input> var;
 
+    bool folded = false; ///< Indicates if the layer has been folded into the previous layer (inference only)
+
     etl::fast_matrix<weight, Input> last_mean;
     etl::fast_matrix<weight, Input> last_var;
     etl::fast_matrix<weight, Input> inv_var;
@@ -80,6 +83,13 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         return 4 * Input;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return elementwise_layer_cost(sizeof(weight), batch, input_size(), output_size(), 8, 10, 4, parameters());
+    }
+
     /*!
      * \brief Return the size of the input of this layer
      * \return The size of the input of this layer
@@ -118,6 +128,11 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
     void test_forward_batch(Output& output, const Input& input) const {
         dll::auto_timer timer("bn:2d:test:forward");
 
+        if (folded) {
+            output = input;
+            return;
+        }
+
         const auto B = etl::dim<0>(input);
 
         auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
@@ -137,16 +152,39 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         dll::auto_timer timer("bn:2d:train:forward");
 
         const auto B = etl::dim<0>(input);
-
-        last_mean = etl::bias_batch_mean_2d(input);
-        last_var  = etl::bias_batch_var_2d(input, last_mean);
-        inv_var   = 1.0 / etl::sqrt(last_var + e);
+        const auto K = etl::dim<1>(input);
 
         input_pre.inherit_if_null(input);
 
-        for(size_t b = 0; b < B; ++b){
-            input_pre(b) = (input(b) - last_mean) >> inv_var;
-            output(b)    = (input_pre(b) >> gamma) + beta;
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            input.ensure_cpu_up_to_date();
+
+            // Compute the mean and the variance of the mini-batch, in a single pass
+            batch_norm_2d_stats(input.memory_start(), last_mean.memory_start(), last_var.memory_start(), B, K);
+
+            last_mean.invalidate_gpu();
+            last_var.invalidate_gpu();
+
+            inv_var = 1.0 / etl::sqrt(last_var + e);
+
+            inv_var.ensure_cpu_up_to_date();
+            gamma.ensure_cpu_up_to_date();
+            beta.ensure_cpu_up_to_date();
+
+            batch_norm_2d_forward(output.memory_start(), input_pre.memory_start(), input.memory_start(),
+                                  last_mean.memory_start(), inv_var.memory_start(), gamma.memory_start(), beta.memory_start(), B, K);
+
+            input_pre.invalidate_gpu();
+            output.invalidate_gpu();
+        } else {
+            last_mean = etl::bias_batch_mean_2d(input);
+            last_var  = etl::bias_batch_var_2d(input, last_mean);
+            inv_var   = 1.0 / etl::sqrt(last_var + e);
+
+            for(size_t b = 0; b < B; ++b){
+                input_pre(b) = (input(b) - last_mean) >> inv_var;
+                output(b)    = (input_pre(b) >> gamma) + beta;
+            }
         }
 
         // Update the current mean and variance
@@ -180,11 +218,24 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         auto& dgamma = std::get<0>(context.up.context)->grad;
         auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        dbeta  = bias_batch_sum_2d(context.errors);
-        dgamma = bias_batch_sum_2d(input_pre >> context.errors);
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            context.errors.ensure_cpu_up_to_date();
+            input_pre.ensure_cpu_up_to_date();
 
-        for(size_t b = 0; b < B; ++b){
-            output(b) = (1.0 / B) >> inv_var >> gamma >> ((B >> context.errors(b)) - (input_pre(b) >> dgamma) - dbeta);
+            // Gradients of gamma and beta and errors of the input, in a single kernel
+            batch_norm_2d_backward(output.memory_start(), dgamma.memory_start(), dbeta.memory_start(), context.errors.memory_start(),
+                                   input_pre.memory_start(), gamma.memory_start(), inv_var.memory_start(), B, etl::dim<1>(context.errors));
+
+            dgamma.invalidate_gpu();
+            dbeta.invalidate_gpu();
+            output.invalidate_gpu();
+        } else {
+            dbeta  = bias_batch_sum_2d(context.errors);
+            dgamma = bias_batch_sum_2d(input_pre >> context.errors);
+
+            for(size_t b = 0; b < B; ++b){
+                output(b) = (1.0 / B) >> inv_var >> gamma >> ((B >> context.errors(b)) - (input_pre(b) >> dgamma) - dbeta);
+            }
         }
     }
 
@@ -199,12 +250,164 @@ struct batch_normalization_2d_layer_impl : neural_layer<batch_normalization_2d_l
         if (!C::layer) {
             dll::unsafe_auto_timer timer("bn:2d:gradients");
 
-            // Gradients of gamma
-            std::get<0>(context.up.context)->grad = bias_batch_sum_2d(input_pre >> context.errors);
+            auto& g_gamma = std::get<0>(context.up.context)->grad;
+            auto& g_beta  = std::get<1>(context.up.context)->grad;
+
+            context.errors.ensure_cpu_up_to_date();
+            input_pre.ensure_cpu_up_to_date();
+
+            // Gradients of gamma and beta, in a single sweep
+            batch_norm_2d_backward(static_cast<weight*>(nullptr), g_gamma.memory_start(), g_beta.memory_start(), context.errors.memory_start(),
+                                   input_pre.memory_start(), gamma.memory_start(), inv_var.memory_start(),
+                                   etl::dim<0>(context.errors), etl::dim<1>(context.errors));
+
+            g_gamma.invalidate_gpu();
+            g_beta.invalidate_gpu();
+        }
+    }
+
+    /*!
+     * \brief Compute the sums of the statistics of the part of the batch in
+     * the context, for the synchronized statistics (sync_batch_norm): the
+     * sums of (x - mean) and of (x - mean)^2 of each feature, shifted by the
+     * running mean, followed by the number of values of each feature.
+     *
+     * The sums of all the parts are then added before sync_statistics().
+     *
+     * \param context The training context, with its input
+     */
+    template <typename C>
+    void sync_input_sums(C& context) const {
+        dll::auto_timer timer("bn:2d:sync:sums");
+
+        const auto B = etl::dim<0>(context.input);
+
+        context.input.ensure_cpu_up_to_date();
+
+        weight* sums = context.sums.memory_start();
+
+        batch_norm_2d_sums(context.input.memory_start(), mean.memory_start(), sums, B, Input);
+
+        sums[2 * Input] = weight(B);
+
+        context.sums.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the statistics of the whole batch from the sums of all
+     * its parts and update the running mean and variance
+     *
+     * \param sums The added sums of the parts (see sync_input_sums())
+     */
+    void sync_statistics(const weight* sums) {
+        const weight n = sums[2 * Input];
+
+        mean.ensure_cpu_up_to_date();
+
+        const weight* shift = mean.memory_start();
+        weight* m           = last_mean.memory_start();
+        weight* v           = last_var.memory_start();
 
-            // Gradients of beta
-            std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+        for (size_t k = 0; k < Input; ++k) {
+            const weight d = sums[k] / n;
+
+            m[k] = shift[k] + d;
+            v[k] = std::max(sums[Input + k] / n - d * d, weight(0));
         }
+
+        last_mean.invalidate_gpu();
+        last_var.invalidate_gpu();
+
+        inv_var = 1.0 / etl::sqrt(last_var + e);
+
+        // Update the current mean and variance
+        mean = momentum * mean + (1.0 - momentum) * last_mean;
+        var  = momentum * var + (1.0 - momentum) * (n / (n - 1) * last_var);
+
+        // The parts are then processed concurrently, from the CPU
+        mean.ensure_cpu_up_to_date();
+        inv_var.ensure_cpu_up_to_date();
+        gamma.ensure_cpu_up_to_date();
+        beta.ensure_cpu_up_to_date();
+    }
+
+    /*!
+     * \brief Normalize the part of the batch in the context with the
+     * statistics of the whole batch (see sync_statistics())
+     *
+     * \param context The training context, with its input
+     */
+    template <typename C>
+    void sync_forward(C& context) const {
+        dll::auto_timer timer("bn:2d:sync:forward");
+
+        const auto B = etl::dim<0>(context.input);
+
+        context.pre.inherit_if_null(context.input);
+
+        batch_norm_2d_forward(context.output.memory_start(), context.pre.memory_start(), context.input.memory_start(),
+                              last_mean.memory_start(), inv_var.memory_start(), gamma.memory_start(), beta.memory_start(), B, Input);
+
+        context.pre.invalidate_gpu();
+        context.output.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the sums of the errors of the part of the batch in the
+     * context, for the synchronized statistics: the sums of the errors and of
+     * the errors times the normalized input of each feature, followed by
+     * the number of values of each feature.
+     *
+     * These sums are also the gradients of beta and gamma for the part, which
+     * are added over the parts with the gradients of the other layers.
+     *
+     * \param context The training context, with its errors
+     */
+    template <typename C>
+    void sync_error_sums(C& context) const {
+        dll::auto_timer timer("bn:2d:sync:error_sums");
+
+        auto& g_gamma = std::get<0>(context.up.context)->grad;
+        auto& g_beta  = std::get<1>(context.up.context)->grad;
+
+        const auto B = etl::dim<0>(context.errors);
+
+        context.errors.ensure_cpu_up_to_date();
+
+        weight* sums = context.sums.memory_start();
+
+        batch_norm_2d_backward(static_cast<weight*>(nullptr), sums + Input, sums, context.errors.memory_start(), context.pre.memory_start(),
+                               gamma.memory_start(), inv_var.memory_start(), B, Input);
+
+        sums[2 * Input] = weight(B);
+
+        context.sums.invalidate_gpu();
+
+        std::copy_n(sums + Input, Input, g_gamma.memory_start());
+        std::copy_n(sums, Input, g_beta.memory_start());
+
+        g_gamma.invalidate_gpu();
+        g_beta.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the part of the batch in the context
+     * to the previous layers, with the sums of the errors of the whole batch
+     *
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     * \param sums The added sums of the parts (see sync_error_sums())
+     */
+    template <typename HH, typename C>
+    void sync_backward(HH&& output, C& context, const weight* sums) const {
+        dll::auto_timer timer("bn:2d:sync:backward");
+
+        const auto B = etl::dim<0>(context.errors);
+
+        batch_norm_sync_backward(output.memory_start(), context.errors.memory_start(), context.pre.memory_start(),
+                                 gamma.memory_start(), inv_var.memory_start(), sums, B, Input, 1);
+
+        output.invalidate_gpu();
     }
 
     /*!
@@ -306,6 +509,9 @@ struct sgd_context<DBN, batch_normalization_2d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, Desc::Input> output; ///< A batch of output
     etl::fast_matrix<weight, batch_size, Desc::Input> errors; ///< A batch of errors
 
+    etl::dyn_matrix<weight, 2> pre;                      ///< The normalized input (with sync_batch_norm)
+    etl::fast_matrix<weight, 2 * Desc::Input + 1> sums; ///< The sums of the synchronized statistics (with sync_batch_norm)
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
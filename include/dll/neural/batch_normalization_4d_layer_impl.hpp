@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -39,6 +40,8 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     etl::fast_matrix<weight, Kernels> mean;
     etl::fast_matrix<weight, Kernels> var;
 
+    bool folded = false; ///< Indicates if the layer has been folded into the previous layer (inference only)
+
     etl::fast_matrix<weight, Kernels> last_mean;
     etl::fast_matrix<weight, Kernels> last_var;
     etl::fast_matrix<weight, Kernels> inv_var;
@@ -82,6 +85,13 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
         return 4 * Kernels;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return elementwise_layer_cost(sizeof(weight), batch, input_size(), output_size(), 8, 10, 4, parameters());
+    }
+
     /*!
      * \brief Return the size of the input of this layer
      * \return The size of the input of this layer
@@ -118,13 +128,28 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
      */
     template <typename Input, typename Output>
     void test_forward_batch(Output& output, const Input& input) const {
+        if (folded) {
+            output = input;
+            return;
+        }
+
         const auto B = etl::dim<0>(input);
 
         auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
 
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = (gamma(k) >> ((input(b)(k) - mean(k)) >> inv_var(k))) + beta(k);
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            input.ensure_cpu_up_to_date();
+            inv_var.ensure_cpu_up_to_date();
+
+            batch_norm_4d_forward(output.memory_start(), static_cast<weight*>(nullptr), input.memory_start(),
+                                  mean.memory_start(), inv_var.memory_start(), gamma.memory_start(), beta.memory_start(), B, Kernels, W * H);
+
+            output.invalidate_gpu();
+        } else {
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t k = 0; k < Kernels; ++k) {
+                    output(b)(k) = (gamma(k) >> ((input(b)(k) - mean(k)) >> inv_var(k))) + beta(k);
+                }
             }
         }
     }
@@ -141,28 +166,48 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
         const auto B = etl::dim<0>(input);
         const auto S = B * W * H;
 
-        // Compute the mean of the mini-batch
-        last_mean = etl::bias_batch_mean_4d(input);
+        input_pre.inherit_if_null(input);
 
-        // Compute the variance of the mini-batch
-        last_var  = 0;
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            input.ensure_cpu_up_to_date();
 
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
-            }
-        }
+            // Compute the mean and the variance of the mini-batch
+            batch_norm_4d_stats(input.memory_start(), last_mean.memory_start(), last_var.memory_start(), B, Kernels, W * H);
 
-        last_var /= S;
+            last_mean.invalidate_gpu();
+            last_var.invalidate_gpu();
 
-        inv_var  = 1.0 / etl::sqrt(last_var + e);
+            inv_var = 1.0 / etl::sqrt(last_var + e);
 
-        input_pre.inherit_if_null(input);
+            inv_var.ensure_cpu_up_to_date();
+
+            batch_norm_4d_forward(output.memory_start(), input_pre.memory_start(), input.memory_start(),
+                                  last_mean.memory_start(), inv_var.memory_start(), gamma.memory_start(), beta.memory_start(), B, Kernels, W * H);
+
+            input_pre.invalidate_gpu();
+            output.invalidate_gpu();
+        } else {
+            // Compute the mean of the mini-batch
+            last_mean = etl::bias_batch_mean_4d(input);
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
-                output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
+            // Compute the variance of the mini-batch
+            last_var  = 0;
+
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t k = 0; k < Kernels; ++k) {
+                    last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
+                }
+            }
+
+            last_var /= S;
+
+            inv_var  = 1.0 / etl::sqrt(last_var + e);
+
+            for(size_t b = 0; b < B; ++b){
+                for (size_t k = 0; k < Kernels; ++k) {
+                    input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
+                    output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
+                }
             }
         }
 
@@ -191,25 +236,35 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
         const auto B = etl::dim<0>(context.input);
-        const auto S = B * W * H;
 
-        auto dxhat = etl::force_temporary_dim_only(context.errors);
+        if constexpr (etl::is_dma<std::decay_t<HH>>) {
+            context.errors.ensure_cpu_up_to_date();
+
+            batch_norm_4d_backward(output.memory_start(), context.errors.memory_start(), input_pre.memory_start(),
+                                   gamma.memory_start(), inv_var.memory_start(), B, Kernels, W * H);
+
+            output.invalidate_gpu();
+        } else {
+            const auto S = B * W * H;
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                dxhat(b)(k) = context.errors(b)(k) >> gamma(k);
+            auto dxhat = etl::force_temporary_dim_only(context.errors);
+
+            for(size_t b = 0; b < B; ++b){
+                for (size_t k = 0; k < Kernels; ++k) {
+                    dxhat(b)(k) = context.errors(b)(k) >> gamma(k);
+                }
             }
-        }
 
-        auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
-        auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
+            auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
+            auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
 
-        *dxhat_l;
-        *dxhat_xhat_l;
+            *dxhat_l;
+            *dxhat_xhat_l;
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = ((1.0 / S) * inv_var(k)) >> (S * dxhat(b)(k) - dxhat_l(k) - (input_pre(b)(k) >> dxhat_xhat_l(k)));
+            for(size_t b = 0; b < B; ++b){
+                for (size_t k = 0; k < Kernels; ++k) {
+                    output(b)(k) = ((1.0 / S) * inv_var(k)) >> (S * dxhat(b)(k) - dxhat_l(k) - (input_pre(b)(k) >> dxhat_xhat_l(k)));
+                }
             }
         }
     }
@@ -220,11 +275,160 @@ struct batch_normalization_4d_layer_impl : neural_layer<batch_normalization_4d_l
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        // Gradients of gamma
-        std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
+        auto& g_gamma = std::get<0>(context.up.context)->grad;
+        auto& g_beta  = std::get<1>(context.up.context)->grad;
+
+        context.errors.ensure_cpu_up_to_date();
 
-        // Gradients of beta
-        std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        // Gradients of gamma and beta, in a single sweep
+        batch_norm_4d_gradients(g_gamma.memory_start(), g_beta.memory_start(), context.errors.memory_start(), input_pre.memory_start(),
+                                etl::dim<0>(context.errors), Kernels, W * H);
+
+        g_gamma.invalidate_gpu();
+        g_beta.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the sums of the statistics of the part of the batch in
+     * the context, for the synchronized statistics (sync_batch_norm): the
+     * sums of (x - mean) and of (x - mean)^2 of each feature map, shifted by the
+     * running mean, followed by the number of values of each feature map.
+     *
+     * The sums of all the parts are then added before sync_statistics().
+     *
+     * \param context The training context, with its input
+     */
+    template <typename C>
+    void sync_input_sums(C& context) const {
+        dll::auto_timer timer("bn:4d:sync:sums");
+
+        const auto B = etl::dim<0>(context.input);
+
+        context.input.ensure_cpu_up_to_date();
+
+        weight* sums = context.sums.memory_start();
+
+        batch_norm_4d_sums(context.input.memory_start(), mean.memory_start(), sums, B, Kernels, W * H);
+
+        sums[2 * Kernels] = weight(B * W * H);
+
+        context.sums.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the statistics of the whole batch from the sums of all
+     * its parts and update the running mean and variance
+     *
+     * \param sums The added sums of the parts (see sync_input_sums())
+     */
+    void sync_statistics(const weight* sums) {
+        const weight n = sums[2 * Kernels];
+
+        mean.ensure_cpu_up_to_date();
+
+        const weight* shift = mean.memory_start();
+        weight* m           = last_mean.memory_start();
+        weight* v           = last_var.memory_start();
+
+        for (size_t k = 0; k < Kernels; ++k) {
+            const weight d = sums[k] / n;
+
+            m[k] = shift[k] + d;
+            v[k] = std::max(sums[Kernels + k] / n - d * d, weight(0));
+        }
+
+        last_mean.invalidate_gpu();
+        last_var.invalidate_gpu();
+
+        inv_var = 1.0 / etl::sqrt(last_var + e);
+
+        // Update the current mean and variance
+        mean = momentum * mean + (1.0 - momentum) * last_mean;
+        var  = momentum * var + (1.0 - momentum) * (n / (n - 1) * last_var);
+
+        // The parts are then processed concurrently, from the CPU
+        mean.ensure_cpu_up_to_date();
+        inv_var.ensure_cpu_up_to_date();
+        gamma.ensure_cpu_up_to_date();
+        beta.ensure_cpu_up_to_date();
+    }
+
+    /*!
+     * \brief Normalize the part of the batch in the context with the
+     * statistics of the whole batch (see sync_statistics())
+     *
+     * \param context The training context, with its input
+     */
+    template <typename C>
+    void sync_forward(C& context) const {
+        dll::auto_timer timer("bn:4d:sync:forward");
+
+        const auto B = etl::dim<0>(context.input);
+
+        context.pre.inherit_if_null(context.input);
+
+        batch_norm_4d_forward(context.output.memory_start(), context.pre.memory_start(), context.input.memory_start(),
+                              last_mean.memory_start(), inv_var.memory_start(), gamma.memory_start(), beta.memory_start(), B, Kernels, W * H);
+
+        context.pre.invalidate_gpu();
+        context.output.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the sums of the errors of the part of the batch in the
+     * context, for the synchronized statistics: the sums of the errors and of
+     * the errors times the normalized input of each feature map, followed by
+     * the number of values of each feature map.
+     *
+     * These sums are also the gradients of beta and gamma for the part, which
+     * are added over the parts with the gradients of the other layers.
+     *
+     * \param context The training context, with its errors
+     */
+    template <typename C>
+    void sync_error_sums(C& context) const {
+        dll::auto_timer timer("bn:4d:sync:error_sums");
+
+        auto& g_gamma = std::get<0>(context.up.context)->grad;
+        auto& g_beta  = std::get<1>(context.up.context)->grad;
+
+        const auto B = etl::dim<0>(context.errors);
+
+        context.errors.ensure_cpu_up_to_date();
+
+        weight* sums = context.sums.memory_start();
+
+        batch_norm_4d_gradients(sums + Kernels, sums, context.errors.memory_start(), context.pre.memory_start(), B, Kernels, W * H);
+
+        sums[2 * Kernels] = weight(B * W * H);
+
+        context.sums.invalidate_gpu();
+
+        std::copy_n(sums + Kernels, Kernels, g_gamma.memory_start());
+        std::copy_n(sums, Kernels, g_beta.memory_start());
+
+        g_gamma.invalidate_gpu();
+        g_beta.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the part of the batch in the context
+     * to the previous layers, with the sums of the errors of the whole batch
+     *
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     * \param sums The added sums of the parts (see sync_error_sums())
+     */
+    template <typename HH, typename C>
+    void sync_backward(HH&& output, C& context, const weight* sums) const {
+        dll::auto_timer timer("bn:4d:sync:backward");
+
+        const auto B = etl::dim<0>(context.errors);
+
+        batch_norm_sync_backward(output.memory_start(), context.errors.memory_start(), context.pre.memory_start(),
+                                 gamma.memory_start(), inv_var.memory_start(), sums, B, Kernels, W * H);
+
+        output.invalidate_gpu();
     }
 
     /*!
@@ -325,6 +529,9 @@ struct sgd_context<DBN, batch_normalization_4d_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, layer_t::Kernels, layer_t::W, layer_t::H> output; ///< A batch of output
     etl::fast_matrix<weight, batch_size, layer_t::Kernels, layer_t::W, layer_t::H> errors; ///< A batch of errors
 
+    etl::dyn_matrix<weight, 4> pre;                            ///< The normalized input (with sync_batch_norm)
+    etl::fast_matrix<weight, 2 * layer_t::Kernels + 1> sums; ///< The sums of the synchronized statistics (with sync_batch_norm)
+
     sgd_context(const layer_t& /*layer*/){}
 };
 
@@ -0,0 +1,166 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Folding of Batch Normalization layers into the previous layer.
+ *
+ * At inference time, a batch normalization layer is only an affine
+ * transformation of its input. When it follows a dense or convolutional
+ * layer, without activation function, it can be folded into the weights and
+ * biases of this layer.
+ */
+
+#pragma once
+
+#include "dll/layer_fwd.hpp"
+#include "dll/layer_traits.hpp"
+#include "dll/util/winograd_conv.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Traits to test if a layer is a Batch Normalization layer
+ */
+template <typename Layer>
+struct is_batch_normalization_layer : std::false_type {};
+
+template <typename Desc>
+struct is_batch_normalization_layer<batch_normalization_2d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_batch_normalization_layer<dyn_batch_normalization_2d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_batch_normalization_layer<batch_normalization_4d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_batch_normalization_layer<dyn_batch_normalization_4d_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer is an activation layer
+ */
+template <typename Layer>
+struct is_activation_layer : std::false_type {};
+
+template <typename Desc>
+struct is_activation_layer<activation_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer can receive a folded Batch Normalization
+ */
+template <typename Layer>
+struct is_bn_foldable_layer : std::false_type {};
+
+template <typename Desc>
+struct is_bn_foldable_layer<dense_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_bn_foldable_layer<dyn_dense_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_bn_foldable_layer<conv_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_bn_foldable_layer<dyn_conv_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Indicates if a Batch Normalization layer can be folded into the
+ * given layer.
+ *
+ * This is only possible for dense and convolutional layers without activation
+ * function.
+ */
+template <typename Layer, typename BN>
+constexpr bool can_fold_batch_normalization() {
+    if constexpr (is_batch_normalization_layer<BN>::value && is_bn_foldable_layer<Layer>::value) {
+        return Layer::activation_function == function::IDENTITY;
+    } else {
+        return false;
+    }
+}
+
+/*!
+ * \brief Fold the batch normalization layer bn into the given layer.
+ *
+ * After this, the weights and biases of layer contain the normalization and
+ * the batch normalization layer is deactivated (replaced by the identity).
+ * If the layer has no biases, only the scaling is folded into the weights
+ * and the batch normalization layer only adds the remaining shift.
+ * The network should not be trained anymore after this.
+ *
+ * \param layer The layer preceding the batch normalization
+ * \param bn The batch normalization layer
+ *
+ * \return true if the layer was folded, false otherwise
+ */
+template <typename Layer, typename BN>
+bool fold_batch_normalization(Layer& layer, BN& bn) {
+    if constexpr (can_fold_batch_normalization<Layer, BN>()) {
+        if (bn.folded) {
+            return false;
+        }
+
+        // Per-output scaling factor
+        auto s = etl::force_temporary(bn.gamma / etl::sqrt(bn.var + BN::e));
+
+        // Per-output shift, after scaling
+        auto shift = etl::force_temporary(bn.beta - (bn.mean >> s));
+
+        if constexpr (decay_layer_traits<Layer>::is_dense_layer()) {
+            // W is [visible x hidden], scale each column
+            if (etl::dim<1>(layer.w) != etl::size(s)) {
+                return false;
+            }
+
+            for (size_t i = 0; i < etl::dim<0>(layer.w); ++i) {
+                layer.w(i) = layer.w(i) >> s;
+            }
+
+            if constexpr (!Layer::no_bias) {
+                layer.b = (layer.b >> s) + shift;
+            }
+        } else {
+            // W is [K x C x NW1 x NW2], scale each kernel
+            if (etl::dim<0>(layer.w) != etl::size(s)) {
+                return false;
+            }
+
+            for (size_t k = 0; k < etl::dim<0>(layer.w); ++k) {
+                layer.w(k) = layer.w(k) * s(k);
+
+                if constexpr (!Layer::no_bias) {
+                    layer.b(k) = layer.b(k) * s(k) + shift(k);
+                }
+            }
+        }
+
+        dll::invalidate_transforms(layer);
+
+        bn.gamma = 1.0;
+        bn.mean  = 0.0;
+        bn.var   = 1.0 - BN::e;
+
+        if constexpr (Layer::no_bias) {
+            // Only the shift remains
+            bn.beta = shift;
+        } else {
+            // The layer is now the identity
+            bn.beta   = 0.0;
+            bn.folded = true;
+        }
+
+        return true;
+    } else {
+        cpp_unused(layer);
+        cpp_unused(bn);
+
+        return false;
+    }
+}
+
+} //end of dll namespace
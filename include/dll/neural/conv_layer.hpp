@@ -12,3 +12,10 @@
 
 #include "dll/neural/conv_layer_impl.hpp"
 #include "dll/neural/conv_layer_desc.hpp"
+
+#include "dll/util/precompiled.hpp"
+
+// The common (single precision) configurations of the convolutional layers
+// are precompiled on demand
+DLL_PRECOMPILED_TEMPLATE(struct dll::conv_layer_impl<dll::conv_layer_desc<1, 28, 28, 8, 5, 5>>)
+DLL_PRECOMPILED_TEMPLATE(struct dll::conv_layer_impl<dll::conv_layer_desc<8, 12, 12, 8, 5, 5>>)
@@ -8,6 +8,8 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/winograd_conv.hpp"
+#include "dll/util/tuning.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
 
@@ -39,6 +41,7 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     static constexpr size_t P2 = (NW2 - 1) / 2;
 
     static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+    static constexpr bool winograd            = winograd_conv_engine<weight>::supported(NW1, NW2); ///< Use Winograd convolutions
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -62,6 +65,10 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    mutable winograd_conv_engine<weight> winograd_engine; ///< The Winograd transforms of the filters
+
+    layer_tuning tuning; ///< The runtime tuning of the kernels (set by the auto-tuner)
+
     /*!
      * \brief Initialize a conv layer with basic weights.
      */
@@ -94,6 +101,13 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
         return K * NW1 * NW2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, NC * NV1 * NV2, K * NH1 * NH2, K * NC * NW1 * NW2, K, K * NC * NW1 * NW2 * NH1 * NH2);
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -137,8 +151,13 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
+        timer.work(cost(etl::dim<0>(v)).forward);
+
+        tuning_scope scope(tuning);
 
-        if constexpr (etl::dimensions<V>() == 4) {
+        if (winograd_forward(output, v)) {
+            // Computed by the Winograd engine
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward<1, 1, P1, P2>(v, w);
         } else {
             output = etl::ml::convolution_forward<1, 1, P1, P2>(etl::reshape(v, etl::dim<0>(v), NC, NV1, NV2), w);
@@ -199,8 +218,70 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv_same:backward_batch");
+        timer.work(cost(etl::dim<0>(context.errors)).backward);
+
+        tuning_scope scope(tuning);
+
+        if (winograd_backward(output, context.errors)) {
+            // Computed by the Winograd engine
+        } else {
+            output = etl::ml::convolution_backward<1, 1, P1, P2>(context.errors, w);
+        }
+    }
+
+    /*!
+     * \brief Invalidate the cached transforms of the filters, must be called
+     * after the weights have been changed
+     */
+    void invalidate_transforms() {
+        winograd_engine.invalidate();
+    }
+
+    /*!
+     * \brief Indicates if the Winograd convolutions can be used by this layer
+     */
+    bool winograd_supported() const {
+        return winograd;
+    }
+
+    /*!
+     * \brief Compute the forward convolution with the Winograd engine, if
+     * the filters and the types are supported and the tuning allows it
+     * \return true if the output was computed, false otherwise
+     */
+    template <typename H1, typename V>
+    bool winograd_forward(H1& output, const V& v) const {
+        if constexpr (winograd && etl::is_dma<V> && etl::is_dma<std::decay_t<H1>>) {
+            if (tuning.kernel != conv_kernel::DIRECT) {
+                winograd_engine.forward(output, v, w, NV1, NV2, P1);
+                return true;
+            }
+        }
+
+        cpp_unused(output);
+        cpp_unused(v);
 
-        output = etl::ml::convolution_backward<1, 1, P1, P2>(context.errors, w);
+        return false;
+    }
+
+    /*!
+     * \brief Compute the backward convolution with the Winograd engine, if
+     * the filters and the types are supported and the tuning allows it
+     * \return true if the output was computed, false otherwise
+     */
+    template <typename H, typename E>
+    bool winograd_backward(H& output, const E& errors) const {
+        if constexpr (winograd && etl::is_dma<std::decay_t<H>>) {
+            if (tuning.kernel != conv_kernel::DIRECT) {
+                winograd_engine.backward(output, errors, w, NH1, NH2, P1);
+                return true;
+            }
+        }
+
+        cpp_unused(output);
+        cpp_unused(errors);
+
+        return false;
     }
 
     /*!
@@ -210,6 +291,9 @@ struct conv_same_layer_impl final : neural_layer<conv_same_layer_impl<Desc>, Des
     template<typename C>
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv_same:compute_gradients");
+        timer.work(cost(etl::dim<0>(context.errors)).gradients);
+
+        tuning_scope scope(tuning);
 
         std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter<1, 1, P1, P2>(context.input, context.errors);
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
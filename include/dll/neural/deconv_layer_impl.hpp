@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/deconv.hpp"
 
 namespace dll {
 
@@ -86,6 +87,13 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
         return K * NW1 * NW2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, NC * NV1 * NV2, K * NH1 * NH2, parameters(), K, K * NC * NW1 * NW2 * NV1 * NV2);
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -128,7 +136,11 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        if constexpr (direct_deconv<H1, V>) {
+            deconv_forward(output, v, w);
+        } else {
+            output = etl::conv_4d_full_flipped(v, w);
+        }
 
         if constexpr (etl::decay_traits<H1>::is_fast) {
             static constexpr auto batch_size = etl::decay_traits<H1>::template dim<0>();
@@ -199,7 +211,9 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        if constexpr (etl::decay_traits<H>::dimensions() == 4) {
+        if constexpr (direct_deconv<H, decltype(context.errors)>) {
+            deconv_backward(output, context.errors, w);
+        } else if constexpr (etl::decay_traits<H>::dimensions() == 4) {
             output = etl::conv_4d_valid_flipped(context.errors, w);
         } else {
             static constexpr auto B               = etl::decay_traits<H>::template dim<0>();
@@ -213,7 +227,12 @@ struct deconv_layer_impl final : neural_layer<deconv_layer_impl<Desc>, Desc> {
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        std::get<0>(context.up.context)->grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input);
+        if constexpr (direct_deconv<decltype(context.errors), decltype(context.input)>) {
+            deconv_gradients(std::get<0>(context.up.context)->grad, context.errors, context.input);
+        } else {
+            std::get<0>(context.up.context)->grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input);
+        }
+
         std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
     }
 };
@@ -12,3 +12,11 @@
 
 #include "dll/neural/dense_layer_impl.hpp"
 #include "dll/neural/dense_layer_desc.hpp"
+
+#include "dll/util/precompiled.hpp"
+
+// The common (single precision) configurations of the dense layers are
+// precompiled on demand
+DLL_PRECOMPILED_TEMPLATE(struct dll::dense_layer_impl<dll::dense_layer_desc<28 * 28, 500>>)
+DLL_PRECOMPILED_TEMPLATE(struct dll::dense_layer_impl<dll::dense_layer_desc<500, 250>>)
+DLL_PRECOMPILED_TEMPLATE(struct dll::dense_layer_impl<dll::dense_layer_desc<250, 10, dll::activation<dll::function::SOFTMAX>>>)
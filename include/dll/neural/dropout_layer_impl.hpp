@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/dropout.hpp"
 
 namespace dll {
 
@@ -24,9 +25,10 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
 
     static constexpr float p = float(desc::Drop) / 100.0f; ///< The dropout rate
 
-    mutable decltype(etl::state_inverted_dropout_mask(dll::rand_engine(), p)) dropout; ///< The dropout mask generator (ETL)
+    uint64_t seed;             ///< The seed of the masks of this layer
+    mutable uint64_t step = 0; ///< The index of the current batch
 
-    dropout_layer_impl() : dropout(dll::rand_engine(), p) {
+    dropout_layer_impl() : seed(uint64_t(dll::rand_engine()()) << 32 | uint64_t(dll::rand_engine()())) {
         // Nothing else to init
     }
 
@@ -93,12 +95,23 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
      * \param input The batch of input to apply the layer to
      */
     template <typename Input, typename Output>
-    void train_forward_batch(Output& output, const Input& input) const noexcept {
+    void train_forward_batch(Output& output, const Input& input) const {
         dll::auto_timer timer("dropout:train:forward");
 
-        // Note: For now, cannot do on one pass because of state_inverted dropout not copy-able
-        output = dropout;
-        output = output >> input;
+        // A new mask for each batch, regenerated by the backward pass
+        ++step;
+
+        if constexpr (etl::is_dma<Input>) {
+            input.ensure_cpu_up_to_date();
+
+            counter_dropout(output.memory_start(), input.memory_start(), etl::size(output), p, seed, step);
+        } else {
+            output = input;
+
+            counter_dropout(output.memory_start(), output.memory_start(), etl::size(output), p, seed, step);
+        }
+
+        output.invalidate_gpu();
     }
 
     /*!
@@ -122,7 +135,22 @@ struct dropout_layer_impl : transform_layer<dropout_layer_impl<Desc>> {
     void backward_batch(H&& output, C& context) const {
         dll::unsafe_auto_timer timer("dropout:backward");
 
-        output = context.errors;
+        context.errors.ensure_cpu_up_to_date();
+
+        // The same mask as the forward pass of this batch
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            counter_dropout(output.memory_start(), context.errors.memory_start(), etl::size(output), p, seed, step);
+
+            output.invalidate_gpu();
+        } else {
+            auto errors = etl::force_temporary(context.errors);
+
+            counter_dropout(errors.memory_start(), errors.memory_start(), etl::size(errors), p, seed, step);
+
+            errors.invalidate_gpu();
+
+            output = errors;
+        }
     }
 
     /*!
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -36,6 +37,8 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
     etl::dyn_matrix<weight, 1> mean;
     etl::dyn_matrix<weight, 1> var;
 
+    bool folded = false; ///< Indicates if the layer has been folded into the previous layer (inference only)
+
     etl::dyn_matrix<weight, 1> last_mean;
     etl::dyn_matrix<weight, 1> last_var;
     etl::dyn_matrix<weight, 1> inv_var;
@@ -98,6 +101,13 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
         return 4 * Input;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return elementwise_layer_cost(sizeof(weight), batch, input_size(), output_size(), 8, 10, 4, parameters());
+    }
+
     /*!
      * \brief Return the size of the input of this layer
      * \return The size of the input of this layer
@@ -136,6 +146,11 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
     void test_forward_batch(Output& output, const Input& input) const {
         dll::auto_timer timer("bn:2d:test:forward");
 
+        if (folded) {
+            output = input;
+            return;
+        }
+
         const auto B = etl::dim<0>(input);
 
         auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
@@ -155,16 +170,39 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
         dll::auto_timer timer("bn:2d:train:forward");
 
         const auto B = etl::dim<0>(input);
-
-        last_mean = etl::bias_batch_mean_2d(input);
-        last_var  = etl::bias_batch_var_2d(input, last_mean);
-        inv_var   = 1.0 / etl::sqrt(last_var + e);
+        const auto K = etl::dim<1>(input);
 
         input_pre.inherit_if_null(input);
 
-        for(size_t b = 0; b < B; ++b){
-            input_pre(b) = (input(b) - last_mean) >> inv_var;
-            output(b)    = (input_pre(b) >> gamma) + beta;
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            input.ensure_cpu_up_to_date();
+
+            // Compute the mean and the variance of the mini-batch, in a single pass
+            batch_norm_2d_stats(input.memory_start(), last_mean.memory_start(), last_var.memory_start(), B, K);
+
+            last_mean.invalidate_gpu();
+            last_var.invalidate_gpu();
+
+            inv_var = 1.0 / etl::sqrt(last_var + e);
+
+            inv_var.ensure_cpu_up_to_date();
+            gamma.ensure_cpu_up_to_date();
+            beta.ensure_cpu_up_to_date();
+
+            batch_norm_2d_forward(output.memory_start(), input_pre.memory_start(), input.memory_start(),
+                                  last_mean.memory_start(), inv_var.memory_start(), gamma.memory_start(), beta.memory_start(), B, K);
+
+            input_pre.invalidate_gpu();
+            output.invalidate_gpu();
+        } else {
+            last_mean = etl::bias_batch_mean_2d(input);
+            last_var  = etl::bias_batch_var_2d(input, last_mean);
+            inv_var   = 1.0 / etl::sqrt(last_var + e);
+
+            for(size_t b = 0; b < B; ++b){
+                input_pre(b) = (input(b) - last_mean) >> inv_var;
+                output(b)    = (input_pre(b) >> gamma) + beta;
+            }
         }
 
         // Update the current mean and variance
@@ -198,11 +236,24 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
         auto& dgamma = std::get<0>(context.up.context)->grad;
         auto& dbeta  = std::get<1>(context.up.context)->grad;
 
-        dbeta  = bias_batch_sum_2d(context.errors);
-        dgamma = bias_batch_sum_2d(input_pre >> context.errors);
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            context.errors.ensure_cpu_up_to_date();
+            input_pre.ensure_cpu_up_to_date();
 
-        for(size_t b = 0; b < B; ++b){
-            output(b) = (1.0 / B) >> inv_var >> gamma >> ((B >> context.errors(b)) - (input_pre(b) >> dgamma) - dbeta);
+            // Gradients of gamma and beta and errors of the input, in a single kernel
+            batch_norm_2d_backward(output.memory_start(), dgamma.memory_start(), dbeta.memory_start(), context.errors.memory_start(),
+                                   input_pre.memory_start(), gamma.memory_start(), inv_var.memory_start(), B, etl::dim<1>(context.errors));
+
+            dgamma.invalidate_gpu();
+            dbeta.invalidate_gpu();
+            output.invalidate_gpu();
+        } else {
+            dbeta  = bias_batch_sum_2d(context.errors);
+            dgamma = bias_batch_sum_2d(input_pre >> context.errors);
+
+            for(size_t b = 0; b < B; ++b){
+                output(b) = (1.0 / B) >> inv_var >> gamma >> ((B >> context.errors(b)) - (input_pre(b) >> dgamma) - dbeta);
+            }
         }
     }
 
@@ -217,11 +268,19 @@ struct dyn_batch_normalization_2d_layer_impl : neural_layer<dyn_batch_normalizat
         if (!C::layer) {
             dll::unsafe_auto_timer timer("bn:2d:gradients");
 
-            // Gradients of gamma
-            std::get<0>(context.up.context)->grad = bias_batch_sum_2d(input_pre >> context.errors);
+            auto& g_gamma = std::get<0>(context.up.context)->grad;
+            auto& g_beta  = std::get<1>(context.up.context)->grad;
+
+            context.errors.ensure_cpu_up_to_date();
+            input_pre.ensure_cpu_up_to_date();
+
+            // Gradients of gamma and beta, in a single sweep
+            batch_norm_2d_backward(static_cast<weight*>(nullptr), g_gamma.memory_start(), g_beta.memory_start(), context.errors.memory_start(),
+                                   input_pre.memory_start(), gamma.memory_start(), inv_var.memory_start(),
+                                   etl::dim<0>(context.errors), etl::dim<1>(context.errors));
 
-            // Gradients of beta
-            std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+            g_gamma.invalidate_gpu();
+            g_beta.invalidate_gpu();
         }
     }
 
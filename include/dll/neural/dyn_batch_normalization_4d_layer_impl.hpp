@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/neural_layer.hpp"
+#include "dll/util/batch_norm.hpp"
 
 namespace dll {
 
@@ -36,6 +37,8 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
     etl::dyn_matrix<weight, 1> mean;
     etl::dyn_matrix<weight, 1> var;
 
+    bool folded = false; ///< Indicates if the layer has been folded into the previous layer (inference only)
+
     etl::dyn_matrix<weight, 1> last_mean;
     etl::dyn_matrix<weight, 1> last_var;
     etl::dyn_matrix<weight, 1> inv_var;
@@ -102,6 +105,13 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         return 4 * Kernels;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return elementwise_layer_cost(sizeof(weight), batch, input_size(), output_size(), 8, 10, 4, parameters());
+    }
+
     /*!
      * \brief Return the size of the input of this layer
      * \return The size of the input of this layer
@@ -138,13 +148,28 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template <typename Input, typename Output>
     void test_forward_batch(Output& output, const Input& input) const {
+        if (folded) {
+            output = input;
+            return;
+        }
+
         const auto B = etl::dim<0>(input);
 
         auto inv_var = etl::force_temporary(1.0 / etl::sqrt(var + e));
 
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = (gamma(k) >> ((input(b)(k) - mean(k)) >> inv_var(k))) + beta(k);
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            input.ensure_cpu_up_to_date();
+            inv_var.ensure_cpu_up_to_date();
+
+            batch_norm_4d_forward(output.memory_start(), static_cast<weight*>(nullptr), input.memory_start(),
+                                  mean.memory_start(), inv_var.memory_start(), gamma.memory_start(), beta.memory_start(), B, Kernels, W * H);
+
+            output.invalidate_gpu();
+        } else {
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t k = 0; k < Kernels; ++k) {
+                    output(b)(k) = (gamma(k) >> ((input(b)(k) - mean(k)) >> inv_var(k))) + beta(k);
+                }
             }
         }
     }
@@ -161,28 +186,48 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
         const auto B = etl::dim<0>(input);
         const auto S = B * W * H;
 
-        // Compute the mean of the mini-batch
-        last_mean = etl::bias_batch_mean_4d(input);
+        input_pre.inherit_if_null(input);
 
-        // Compute the variance of the mini-batch
-        last_var  = 0;
+        if constexpr (etl::is_dma<Input> && etl::is_dma<Output>) {
+            input.ensure_cpu_up_to_date();
 
-        for (size_t b = 0; b < B; ++b) {
-            for (size_t k = 0; k < Kernels; ++k) {
-                last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
-            }
-        }
+            // Compute the mean and the variance of the mini-batch
+            batch_norm_4d_stats(input.memory_start(), last_mean.memory_start(), last_var.memory_start(), B, Kernels, W * H);
 
-        last_var /= S;
+            last_mean.invalidate_gpu();
+            last_var.invalidate_gpu();
 
-        inv_var  = 1.0 / etl::sqrt(last_var + e);
+            inv_var = 1.0 / etl::sqrt(last_var + e);
 
-        input_pre.inherit_if_null(input);
+            inv_var.ensure_cpu_up_to_date();
+
+            batch_norm_4d_forward(output.memory_start(), input_pre.memory_start(), input.memory_start(),
+                                  last_mean.memory_start(), inv_var.memory_start(), gamma.memory_start(), beta.memory_start(), B, Kernels, W * H);
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
-                output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
+            input_pre.invalidate_gpu();
+            output.invalidate_gpu();
+        } else {
+            // Compute the mean of the mini-batch
+            last_mean = etl::bias_batch_mean_4d(input);
+
+            // Compute the variance of the mini-batch
+            last_var  = 0;
+
+            for (size_t b = 0; b < B; ++b) {
+                for (size_t k = 0; k < Kernels; ++k) {
+                    last_var(k) += etl::sum((input(b)(k) - last_mean(k)) >> (input(b)(k) - last_mean(k)));
+                }
+            }
+
+            last_var /= S;
+
+            inv_var  = 1.0 / etl::sqrt(last_var + e);
+
+            for(size_t b = 0; b < B; ++b){
+                for (size_t k = 0; k < Kernels; ++k) {
+                    input_pre(b)(k) = (input(b)(k) - last_mean(k)) >> inv_var(k);
+                    output(b)(k)    = (gamma(k) >> input_pre(b)(k)) + beta(k);
+                }
             }
         }
 
@@ -211,25 +256,35 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
     template<typename HH, typename C>
     void backward_batch(HH&& output, C& context) const {
         const auto B = etl::dim<0>(context.input);
-        const auto S = B * W * H;
 
-        auto dxhat = etl::force_temporary_dim_only(context.errors);
+        if constexpr (etl::is_dma<std::decay_t<HH>>) {
+            context.errors.ensure_cpu_up_to_date();
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                dxhat(b)(k) = context.errors(b)(k) >> gamma(k);
+            batch_norm_4d_backward(output.memory_start(), context.errors.memory_start(), input_pre.memory_start(),
+                                   gamma.memory_start(), inv_var.memory_start(), B, Kernels, W * H);
+
+            output.invalidate_gpu();
+        } else {
+            const auto S = B * W * H;
+
+            auto dxhat = etl::force_temporary_dim_only(context.errors);
+
+            for(size_t b = 0; b < B; ++b){
+                for (size_t k = 0; k < Kernels; ++k) {
+                    dxhat(b)(k) = context.errors(b)(k) >> gamma(k);
+                }
             }
-        }
 
-        auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
-        auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
+            auto dxhat_l      = etl::bias_batch_sum_4d(dxhat);
+            auto dxhat_xhat_l = etl::bias_batch_sum_4d(dxhat >> input_pre);
 
-        *dxhat_l;
-        *dxhat_xhat_l;
+            *dxhat_l;
+            *dxhat_xhat_l;
 
-        for(size_t b = 0; b < B; ++b){
-            for (size_t k = 0; k < Kernels; ++k) {
-                output(b)(k) = ((1.0 / S) * inv_var(k)) >> (S * dxhat(b)(k) - dxhat_l(k) - (input_pre(b)(k) >> dxhat_xhat_l(k)));
+            for(size_t b = 0; b < B; ++b){
+                for (size_t k = 0; k < Kernels; ++k) {
+                    output(b)(k) = ((1.0 / S) * inv_var(k)) >> (S * dxhat(b)(k) - dxhat_l(k) - (input_pre(b)(k) >> dxhat_xhat_l(k)));
+                }
             }
         }
     }
@@ -240,11 +295,17 @@ struct dyn_batch_normalization_4d_layer_impl : neural_layer<dyn_batch_normalizat
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        // Gradients of gamma
-        std::get<0>(context.up.context)->grad = etl::bias_batch_sum_4d(input_pre >> context.errors);
+        auto& g_gamma = std::get<0>(context.up.context)->grad;
+        auto& g_beta  = std::get<1>(context.up.context)->grad;
+
+        context.errors.ensure_cpu_up_to_date();
+
+        // Gradients of gamma and beta, in a single sweep
+        batch_norm_4d_gradients(g_gamma.memory_start(), g_beta.memory_start(), context.errors.memory_start(), input_pre.memory_start(),
+                                etl::dim<0>(context.errors), Kernels, W * H);
 
-        // Gradients of beta
-        std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+        g_gamma.invalidate_gpu();
+        g_beta.invalidate_gpu();
     }
 
     /*!
@@ -9,7 +9,12 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
+#include "dll/util/winograd_conv.hpp"
+#include "dll/util/tuning.hpp"
+#include "dll/util/upsample.hpp"
+#include "dll/util/quantization.hpp"
 
+#include "dll/util/epilogue.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -48,6 +53,12 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    mutable winograd_conv_engine<weight> winograd_engine; ///< The Winograd transforms of the filters
+
+    layer_tuning tuning; ///< The runtime tuning of the kernels (set by the auto-tuner)
+
+    std::unique_ptr<quantized_conv_weights> quantized; ///< The quantized weights (INT8 inference)
+
     size_t nv1; ///< The first visible dimension
     size_t nv2; ///< The second visible dimension
     size_t nh1; ///< The first output dimension
@@ -82,6 +93,8 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
 
         w_initializer::initialize(w, input_size(), output_size());
         b_initializer::initialize(b, input_size(), output_size());
+
+        winograd_engine.invalidate();
     }
 
     /*!
@@ -108,6 +121,13 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
         return k * nw1 * nw2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, nc * nv1 * nv2, k * nh1 * nh2, k * nc * nw1 * nw2, k, k * nc * nw1 * nw2 * nh1 * nh2);
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -162,20 +182,87 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
+        forward_batch_activated<activation_function>(output, v);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, with the given
+     * activation function instead of the activation function of the layer.
+     *
+     * An activation layer following a layer without activation function is
+     * fused into its forward pass this way (see inference_session).
+     *
+     * \param v A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <function F, typename H1, typename V>
+    void forward_batch_activated(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
+        timer.work(cost(etl::dim<0>(v)).forward);
 
-        if constexpr (etl::dimensions<V>() == 4) {
+        tuning_scope scope(tuning);
+
+        if (cpp_unlikely(quantized && quantized->enabled)) {
+            quantized->forward(output, v, nv1, nv2);
+        } else if (winograd_forward(output, v)) {
+            // Computed by the Winograd engine
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward(v, w);
         } else {
             output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w);
         }
 
-        if constexpr (!no_bias) {
-            output = bias_add_4d(output, b);
+        activate_output<F>(output);
+    }
+
+    /*!
+     * \brief Apply the layer, with the given activation function, to a batch
+     * of input upsampled (nearest neighbour) by s1 x s2 in its spatial
+     * dimensions, without upsampling the input.
+     *
+     * An upsample layer preceding the layer is fused into its forward pass
+     * this way (see inference_session).
+     *
+     * \param output A batch of output that will be filled
+     * \param v A batch of input, before the upsampling
+     * \param s1 The upsampling factor of the first spatial dimension
+     * \param s2 The upsampling factor of the second spatial dimension
+     */
+    template <function F, typename H1, typename V>
+    void forward_batch_upsampled(H1&& output, const V& v, size_t s1, size_t s2) const {
+        auto input = etl::reshape(v, etl::dim<0>(v), nc, nv1 / s1, nv2 / s2);
+
+        if (cpp_unlikely(quantized && quantized->enabled)) {
+            // The quantized kernels need the upsampled input
+            forward_batch_activated<F>(output, etl::force_temporary(etl::upsample_3d(input, 1, s1, s2)));
+            return;
         }
 
-        if constexpr (activation_function != function::IDENTITY) {
-            output = f_activate<activation_function>(output);
+        dll::auto_timer timer("conv:forward_batch_upsampled");
+
+        upsample_conv_forward(output, input, w, s1, s2);
+
+        activate_output<F>(output);
+    }
+
+    /*!
+     * \brief Apply the bias and the given activation function to the output
+     * of the convolution
+     */
+    template <function F, typename H1>
+    void activate_output(H1& output) const {
+        // The bias and the element-wise activation functions are applied in
+        // a single pass
+        if constexpr (!no_bias && F != function::IDENTITY && F != function::SOFTMAX) {
+            output = f_activate<F>(bias_add_4d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_4d(output, b);
+            }
+
+            if constexpr (F != function::IDENTITY) {
+                output = f_activate<F>(output);
+            }
         }
     }
 
@@ -232,7 +319,10 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     void adapt_errors(C& context) const {
         dll::auto_timer timer("conv:adapt_errors");
 
-        if constexpr (activation_function != function::IDENTITY){
+        if constexpr (fused_bias_errors<activation_function, no_bias>) {
+            // The gradients of the biases are computed in the same pass
+            adapt_errors_bias<activation_function>(context);
+        } else if constexpr (activation_function != function::IDENTITY) {
             context.errors = f_derivative<activation_function>(context.output) >> context.errors;
         }
     }
@@ -245,14 +335,74 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("conv:backward_batch");
+        timer.work(cost(etl::dim<0>(context.errors)).backward);
+
+        tuning_scope scope(tuning);
 
-        if constexpr (etl::dimensions<H>() == 4) {
+        if (winograd_backward(output, context.errors)) {
+            // Computed by the Winograd engine
+        } else if constexpr (etl::dimensions<H>() == 4) {
             output = etl::ml::convolution_backward(context.errors, w);
         } else {
             etl::reshape(output, etl::dim<0>(output), nc, nv1, nv2) = etl::ml::convolution_backward(context.errors, w);
         }
     }
 
+    /*!
+     * \brief Invalidate the cached transforms of the filters, must be called
+     * after the weights have been changed
+     */
+    void invalidate_transforms() {
+        winograd_engine.invalidate();
+    }
+
+    /*!
+     * \brief Indicates if the Winograd convolutions can be used by this layer
+     */
+    bool winograd_supported() const {
+        return winograd_conv_engine<weight>::supported(nw1, nw2);
+    }
+
+    /*!
+     * \brief Compute the forward convolution with the Winograd engine, if
+     * the filters and the types are supported and the tuning allows it
+     * \return true if the output was computed, false otherwise
+     */
+    template <typename H1, typename V>
+    bool winograd_forward(H1& output, const V& v) const {
+        if constexpr (etl::is_dma<V> && etl::is_dma<H1>) {
+            if (winograd_supported() && tuning.kernel != conv_kernel::DIRECT) {
+                winograd_engine.forward(output, v, w, nv1, nv2, 0);
+                return true;
+            }
+        }
+
+        cpp_unused(output);
+        cpp_unused(v);
+
+        return false;
+    }
+
+    /*!
+     * \brief Compute the backward convolution with the Winograd engine, if
+     * the filters and the types are supported and the tuning allows it
+     * \return true if the output was computed, false otherwise
+     */
+    template <typename H, typename E>
+    bool winograd_backward(H& output, const E& errors) const {
+        if constexpr (etl::is_dma<E> && etl::is_dma<H>) {
+            if (winograd_supported() && tuning.kernel != conv_kernel::DIRECT) {
+                winograd_engine.backward(output, errors, w, nh1, nh2, 0);
+                return true;
+            }
+        }
+
+        cpp_unused(output);
+        cpp_unused(errors);
+
+        return false;
+    }
+
     /*!
      * \brief Compute the gradients for this layer, if any
      * \param context The trainng context
@@ -260,11 +410,19 @@ struct dyn_conv_layer_impl final : neural_layer<dyn_conv_layer_impl<Desc>, Desc>
     template<typename C>
     void compute_gradients(C& context) const {
         dll::auto_timer timer("conv:compute_gradients");
+        timer.work(cost(etl::dim<0>(context.errors)).gradients);
+
+        tuning_scope scope(tuning);
 
         std::get<0>(context.up.context)->grad = etl::ml::convolution_backward_filter(context.input, context.errors);
 
         if constexpr (!no_bias) {
-            std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+            // The gradients of the biases may have been computed with the errors
+            if (context.bias_reduced) {
+                context.bias_reduced = false;
+            } else {
+                std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+            }
         }
     }
 };
@@ -303,6 +461,8 @@ struct sgd_context<DBN, dyn_conv_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 4> output;
     etl::dyn_matrix<weight, 4> errors;
 
+    bool bias_reduced = false; ///< Indicates if the gradients of the biases were computed by adapt_errors
+
     sgd_context(const layer_t& layer)
             : input(batch_size, layer.nc, layer.nv1, layer.nv2),
               output(batch_size, layer.k, layer.nh1, layer.nh2), errors(batch_size, layer.k, layer.nh1, layer.nh2) {}
@@ -9,6 +9,7 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
+#include "dll/util/winograd_conv.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
 
@@ -47,6 +48,8 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    mutable winograd_conv_engine<weight> winograd_engine; ///< The Winograd transforms of the filters
+
     size_t nv1; ///< The first visible dimension
     size_t nv2; ///< The second visible dimension
     size_t nh1; ///< The first output dimension
@@ -87,6 +90,8 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
 
         w_initializer::initialize(w, input_size(), output_size());
         b_initializer::initialize(b, input_size(), output_size());
+
+        winograd_engine.invalidate();
     }
 
     /*!
@@ -113,6 +118,13 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
         return k * nw1 * nw2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, nc * nv1 * nv2, k * nh1 * nh2, k * nc * nw1 * nw2, k, k * nc * nw1 * nw2 * nh1 * nh2);
+    }
+
     /*!
      * \brief Return the size, in bytes, used by this layer
      * \return the size, in bytes, used by this layer
@@ -174,8 +186,11 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("conv:forward_batch");
+        timer.work(cost(etl::dim<0>(v)).forward);
 
-        if constexpr (etl::dimensions<V>() == 4) {
+        if (winograd_forward(output, v)) {
+            // Computed by the Winograd engine
+        } else if constexpr (etl::dimensions<V>() == 4) {
             output = etl::ml::convolution_forward(v, w, 1, 1, p1, p2);
         } else {
             output = etl::ml::convolution_forward(etl::reshape(v, etl::dim<0>(v), nc, nv1, nv2), w, 1, 1, p1, p2);
@@ -248,7 +263,57 @@ struct dyn_conv_same_layer_impl final : neural_layer<dyn_conv_same_layer_impl<De
      */
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
+        if (!winograd_backward(output, context.errors)) {
+            output = etl::ml::convolution_backward(context.errors, w, 1, 1, p1, p2);
+        }
+    }
+
+    /*!
+     * \brief Invalidate the cached transforms of the filters, must be called
+     * after the weights have been changed
+     */
+    void invalidate_transforms() {
+        winograd_engine.invalidate();
+    }
+
+    /*!
+     * \brief Compute the forward convolution with the Winograd engine, if
+     * the filters and the types are supported
+     * \return true if the output was computed, false otherwise
+     */
+    template <typename H1, typename V>
+    bool winograd_forward(H1& output, const V& v) const {
+        if constexpr (etl::is_dma<V> && etl::is_dma<H1>) {
+            if (winograd_conv_engine<weight>::supported(nw1, nw2)) {
+                winograd_engine.forward(output, v, w, nv1, nv2, p1);
+                return true;
+            }
+        }
+
+        cpp_unused(output);
+        cpp_unused(v);
+
+        return false;
+    }
+
+    /*!
+     * \brief Compute the backward convolution with the Winograd engine, if
+     * the filters and the types are supported
+     * \return true if the output was computed, false otherwise
+     */
+    template <typename H, typename E>
+    bool winograd_backward(H& output, const E& errors) const {
+        if constexpr (etl::is_dma<E> && etl::is_dma<H>) {
+            if (winograd_conv_engine<weight>::supported(nw1, nw2)) {
+                winograd_engine.backward(output, errors, w, nh1, nh2, p1);
+                return true;
+            }
+        }
+
+        cpp_unused(output);
+        cpp_unused(errors);
+
+        return false;
     }
 
     /*!
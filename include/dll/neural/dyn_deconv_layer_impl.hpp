@@ -9,6 +9,7 @@
 
 #include "dll/base_traits.hpp"
 #include "dll/neural_layer.hpp"
+#include "dll/util/deconv.hpp"
 
 namespace dll {
 
@@ -108,6 +109,13 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
         return k * nw1 * nw2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, nc * nv1 * nv2, k * nh1 * nh2, parameters(), k, k * nc * nw1 * nw2 * nv1 * nv2);
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -150,7 +158,11 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& v) const {
-        output = etl::conv_4d_full_flipped(v, w);
+        if constexpr (direct_deconv<H1, V>) {
+            deconv_forward(output, v, w);
+        } else {
+            output = etl::conv_4d_full_flipped(v, w);
+        }
 
         const auto batch_size = etl::dim<0>(output);
 
@@ -222,7 +234,9 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
-        if constexpr (etl::decay_traits<H>::dimensions() == 4) {
+        if constexpr (direct_deconv<H, decltype(context.errors)>) {
+            deconv_backward(output, context.errors, w);
+        } else if constexpr (etl::decay_traits<H>::dimensions() == 4) {
             output = etl::conv_4d_valid_flipped(context.errors, w);
         } else {
             const auto B                          = etl::dim<0>(output);
@@ -236,7 +250,12 @@ struct dyn_deconv_layer_impl final : neural_layer<dyn_deconv_layer_impl<Desc>, D
      */
     template<typename C>
     void compute_gradients(C& context) const {
-        //TODO Update the gradients (probably with conv_4d_valid_filter)
+        if constexpr (direct_deconv<decltype(context.errors), decltype(context.input)>) {
+            deconv_gradients(std::get<0>(context.up.context)->grad, context.errors, context.input);
+        } else {
+            std::get<0>(context.up.context)->grad = etl::conv_4d_valid_filter_flipped(context.errors, context.input);
+        }
+
         std::get<1>(context.up.context)->grad = etl::mean_r(etl::sum_l(context.errors));
     }
 };
@@ -9,3 +9,14 @@
 
 #include "dll/neural/dyn_dense_layer_impl.hpp"
 #include "dll/neural/dyn_dense_layer_desc.hpp"
+
+#include "dll/util/precompiled.hpp"
+
+// The common (single precision) configurations of the dynamic dense layers
+// are precompiled on demand, with their forward pass on dynamic batches
+DLL_PRECOMPILED_TEMPLATE(struct dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<>>)
+DLL_PRECOMPILED_TEMPLATE(struct dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>>)
+DLL_PRECOMPILED_TEMPLATE(struct dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>>)
+DLL_PRECOMPILED_TEMPLATE(void dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<>>::forward_batch<etl::dyn_matrix<float, 2>&, etl::dyn_matrix<float, 2>>(etl::dyn_matrix<float, 2>& output, const etl::dyn_matrix<float, 2>& input) const)
+DLL_PRECOMPILED_TEMPLATE(void dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<dll::activation<dll::function::RELU>>>::forward_batch<etl::dyn_matrix<float, 2>&, etl::dyn_matrix<float, 2>>(etl::dyn_matrix<float, 2>& output, const etl::dyn_matrix<float, 2>& input) const)
+DLL_PRECOMPILED_TEMPLATE(void dll::dyn_dense_layer_impl<dll::dyn_dense_layer_desc<dll::activation<dll::function::SOFTMAX>>>::forward_batch<etl::dyn_matrix<float, 2>&, etl::dyn_matrix<float, 2>>(etl::dyn_matrix<float, 2>& output, const etl::dyn_matrix<float, 2>& input) const)
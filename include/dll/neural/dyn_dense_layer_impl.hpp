@@ -8,7 +8,13 @@
 #pragma once
 
 #include "dll/base_traits.hpp"  // The traits
-#include "dll/neural_layer.hpp" // The base class
+#include "dll/neural_layer.hpp"
+#include "dll/util/quantization.hpp" // The base class
+#include "dll/util/pruning.hpp"  // For block_sparse_weights
+#include "dll/util/sparse.hpp"  // For sparse_batch
+#include "dll/util/tuning.hpp"   // For layer_tuning
+#include "dll/util/epilogue.hpp" // For adapt_errors_bias
+#include "dll/util/packed_gemm.hpp" // For packed_dense_engine
 #include "dll/util/timers.hpp"  // For auto_timer
 
 namespace dll {
@@ -27,6 +33,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
     static constexpr auto activation_function = desc::activation_function;                           ///< The layer's activation function
     static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+    static constexpr auto sparse_input        = desc::parameters::template contains<dll::sparse_input>(); ///< Sparse inputs
+    static constexpr bool packed              = packed_dense_engine<weight>::supported && !sparse_input; ///< Use the packed weights for small batches
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
     using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
@@ -47,6 +55,13 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
     std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
 
+    std::unique_ptr<quantized_dense_weights> quantized; ///< The quantized weights (INT8 inference)
+    std::unique_ptr<block_sparse_weights<weight>> block_sparse; ///< The block-sparse weights (pruned inference)
+
+    mutable packed_dense_engine<weight> packed_engine; ///< The packed panels of the weights (small batches)
+
+    layer_tuning tuning; ///< The runtime tuning of the kernels (set by the auto-tuner)
+
     size_t num_visible; ///< The number of visible units
     size_t num_hidden;  ///< The number of hidden units
 
@@ -62,6 +77,8 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
         w = etl::dyn_matrix<weight, 2>(num_visible, num_hidden);
         b = etl::dyn_matrix<weight, 1>(num_hidden);
 
+        packed_engine.invalidate();
+
         w_initializer::initialize(w, input_size(), output_size());
         b_initializer::initialize(b, input_size(), output_size());
     }
@@ -88,6 +105,13 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
         return num_visible * num_hidden + num_hidden;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, num_visible, num_hidden, num_visible * num_hidden, num_hidden, num_visible * num_hidden);
+    }
+
     /*!
      * \brief Returns a full description of the layer
      * \return an std::string containing a full description of the layer
@@ -140,7 +164,25 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
      */
     template <typename H, typename V>
     void forward_batch(H&& output, const V& input) const {
+        forward_batch_activated<activation_function>(output, input);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, with the given
+     * activation function instead of the activation function of the layer.
+     *
+     * An activation layer following a layer without activation function is
+     * fused into its forward pass this way (see inference_session).
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <function F, typename H, typename V>
+    void forward_batch_activated(H&& output, const V& input) const {
         dll::auto_timer timer("dense:forward");
+        timer.work(cost(etl::dim<0>(input)).forward);
+
+        tuning_scope scope(tuning);
 
         const auto Batch = etl::dim<0>(input);
 
@@ -149,13 +191,33 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        output = etl::reshape(input, Batch, num_visible) * w;
-
-        if constexpr (!no_bias) {
-            output = bias_add_2d(output, b);
+        if (cpp_unlikely(quantized && quantized->enabled)) {
+            quantized->forward(output, input);
+        } else if (cpp_unlikely(block_sparse && block_sparse->enabled)) {
+            block_sparse->forward(output, input);
+        } else if constexpr (sparse_input) {
+            sparse_batch<weight> sv;
+            sv.compress(input);
+            sv.multiply(output, w);
+        } else if (packed_forward(output, input)) {
+            // Computed with the packed weights
+        } else {
+            output = etl::reshape(input, Batch, num_visible) * w;
         }
 
-        output = f_activate<activation_function>(output);
+        // The bias and the element-wise activation functions are applied in
+        // a single pass
+        if constexpr (!no_bias && F != function::IDENTITY && F != function::SOFTMAX) {
+            output = f_activate<F>(bias_add_2d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_2d(output, b);
+            }
+
+            if constexpr (F != function::IDENTITY) {
+                output = f_activate<F>(output);
+            }
+        }
     }
 
     /*!
@@ -211,7 +273,12 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     void adapt_errors(C& context) const {
         dll::unsafe_auto_timer timer("dense:errors");
 
-        context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        if constexpr (fused_bias_errors<activation_function, no_bias>) {
+            // The gradients of the biases are computed in the same pass
+            adapt_errors_bias<activation_function>(context);
+        } else {
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
     }
 
     /*!
@@ -222,12 +289,82 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         dll::unsafe_auto_timer timer("dense:backward");
+        timer.work(cost(etl::dim<0>(context.errors)).backward);
+
+        tuning_scope scope(tuning);
+
+        if (packed_backward(output, context.errors)) {
+            // Computed with the packed transposed weights
+            return;
+        }
 
         // The reshape has no overhead, so better than SFINAE for nothing
         auto batch_size = etl::dim<0>(output);
         etl::reshape(output, batch_size, num_visible) = context.errors * etl::transpose(w);
     }
 
+    /*!
+     * \brief Invalidate the packed panels of the weights, must be called
+     * after the weights have been changed
+     */
+    void invalidate_transforms() {
+        packed_engine.invalidate();
+    }
+
+    /*!
+     * \brief Compute the forward product with the packed weights, if the
+     * batch is small enough
+     * \return true if the output was computed, false otherwise
+     */
+    template <typename H, typename V>
+    bool packed_forward(H& output, const V& input) const {
+        if constexpr (packed && etl::is_dma<std::decay_t<V>> && etl::is_dma<std::decay_t<H>>) {
+            const size_t n = etl::dim<0>(input);
+
+            if (n <= packed_dense_engine<weight>::max_batch) {
+                input.ensure_cpu_up_to_date();
+
+                packed_engine.forward(output.memory_start(), input.memory_start(), w, n);
+
+                output.invalidate_gpu();
+
+                return true;
+            }
+        }
+
+        cpp_unused(output);
+        cpp_unused(input);
+
+        return false;
+    }
+
+    /*!
+     * \brief Compute the backward product with the packed transposed
+     * weights, if the batch is small enough
+     * \return true if the output was computed, false otherwise
+     */
+    template <typename H, typename E>
+    bool packed_backward(H& output, const E& errors) const {
+        if constexpr (packed && etl::is_dma<std::decay_t<E>> && etl::is_dma<std::decay_t<H>>) {
+            const size_t n = etl::dim<0>(errors);
+
+            if (n <= packed_dense_engine<weight>::max_batch) {
+                errors.ensure_cpu_up_to_date();
+
+                packed_engine.backward(output.memory_start(), errors.memory_start(), w, n);
+
+                output.invalidate_gpu();
+
+                return true;
+            }
+        }
+
+        cpp_unused(output);
+        cpp_unused(errors);
+
+        return false;
+    }
+
     /*!
      * \brief Compute the gradients for this layer, if any
      * \param context The trainng context
@@ -235,11 +372,25 @@ struct dyn_dense_layer_impl final : neural_layer<dyn_dense_layer_impl<Desc>, Des
     template<typename C>
     void compute_gradients(C& context) const {
         dll::unsafe_auto_timer timer("dense:gradients");
+        timer.work(cost(etl::dim<0>(context.errors)).gradients);
 
-        std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        tuning_scope scope(tuning);
+
+        if constexpr (sparse_input) {
+            sparse_batch<weight> sv;
+            sv.compress(context.input);
+            sv.outer(std::get<0>(context.up.context)->grad, context.errors);
+        } else {
+            std::get<0>(context.up.context)->grad = batch_outer(context.input, context.errors);
+        }
 
         if constexpr (!no_bias) {
-            std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+            // The gradients of the biases may have been computed with the errors
+            if (context.bias_reduced) {
+                context.bias_reduced = false;
+            } else {
+                std::get<1>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+            }
         }
     }
 };
@@ -278,6 +429,8 @@ struct sgd_context<DBN, dyn_dense_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 2> output;
     etl::dyn_matrix<weight, 2> errors;
 
+    bool bias_reduced = false; ///< Indicates if the gradients of the biases were computed by adapt_errors
+
     sgd_context(const layer_t& layer) : input(batch_size, layer.num_visible, 0.0), output(batch_size, layer.num_hidden, 0.0), errors(batch_size, layer.num_hidden, 0.0) {}
 };
 
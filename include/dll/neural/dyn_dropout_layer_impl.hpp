@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/transform/transform_layer.hpp"
+#include "dll/util/dropout.hpp"
 
 namespace dll {
 
@@ -24,28 +25,18 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
 
     float p; ///< The dropout probability
 
-    using dropout_t = decltype(etl::state_inverted_dropout_mask(dll::rand_engine(), p));
-
-    dropout_t* dropout = nullptr; ///< The dropout mask generator (ETL)
+    uint64_t seed = 0;         ///< The seed of the masks of this layer
+    mutable uint64_t step = 0; ///< The index of the current batch
 
     dyn_dropout_layer_impl() = default;
 
-    /*!
-     * \brief Delete the layer and frees all allocated resources
-     */
-    ~dyn_dropout_layer_impl() {
-        if (dropout) {
-            delete dropout;
-        }
-    }
-
     /*!
      * \brief Initialize the dynamic layer
      */
     void init_layer(float p) {
         this->p = p;
 
-        dropout = new dropout_t(dll::rand_engine(), p);
+        seed = uint64_t(dll::rand_engine()()) << 32 | uint64_t(dll::rand_engine()());
     }
 
     /*!
@@ -103,9 +94,20 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
     void train_forward_batch(Output& output, const Input& input) const {
         dll::auto_timer timer("dropout:train:forward");
 
-        // Note: For now, cannot do on one pass because of state_inverted dropout not copy-able
-        output = *dropout;
-        output = output >> input;
+        // A new mask for each batch, regenerated by the backward pass
+        ++step;
+
+        if constexpr (etl::is_dma<Input>) {
+            input.ensure_cpu_up_to_date();
+
+            counter_dropout(output.memory_start(), input.memory_start(), etl::size(output), p, seed, step);
+        } else {
+            output = input;
+
+            counter_dropout(output.memory_start(), output.memory_start(), etl::size(output), p, seed, step);
+        }
+
+        output.invalidate_gpu();
     }
 
     /*!
@@ -129,7 +131,22 @@ struct dyn_dropout_layer_impl : transform_layer<dyn_dropout_layer_impl<Desc>> {
     void backward_batch(H&& output, C& context) const {
         dll::unsafe_auto_timer timer("dropout:backward");
 
-        output = context.errors;
+        context.errors.ensure_cpu_up_to_date();
+
+        // The same mask as the forward pass of this batch
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            counter_dropout(output.memory_start(), context.errors.memory_start(), etl::size(output), p, seed, step);
+
+            output.invalidate_gpu();
+        } else {
+            auto errors = etl::force_temporary(context.errors);
+
+            counter_dropout(errors.memory_start(), errors.memory_start(), etl::size(errors), p, seed, step);
+
+            errors.invalidate_gpu();
+
+            output = errors;
+        }
     }
 
     /*!
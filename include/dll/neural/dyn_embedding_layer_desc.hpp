@@ -27,6 +27,9 @@ struct dyn_embedding_layer_desc {
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
+    /*! Indicates if the gradients are only computed and applied on the touched rows */
+    static constexpr bool sparse_gradients = parameters::template contains<dll::sparse_gradients>();
+
     /*! The embedding type */
     using layer_t = dyn_embedding_layer_impl<dyn_embedding_layer_desc<Parameters...>>;
 
@@ -35,7 +38,7 @@ struct dyn_embedding_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, initializer_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, initializer_id, sparse_gradients_id, time_major_id>, Parameters...>,
         "Invalid parameters type for dyn_embedding_layer_desc");
 };
 
@@ -9,6 +9,8 @@
 
 #include "dll/neural_layer_no_bias.hpp"
 
+#include "dll/util/sparse.hpp"       // for sparse_rows and gather_rows
+#include "dll/util/quantization.hpp" // for quantized_embedding_table
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -27,6 +29,9 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
 
+    static constexpr bool sparse_gradients = desc::sparse_gradients; ///< Indicates if the gradients are sparse
+    static constexpr bool time_major       = desc::parameters::template contains<dll::time_major>(); ///< The output batches are time-major
+
     using input_one_t  = etl::dyn_matrix<weight, 1>; ///< The type of one input
     using output_one_t = etl::dyn_matrix<weight, 2>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;   ///< The type of the input
@@ -40,6 +45,8 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
     //Backup weights and biases
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
 
+    std::unique_ptr<quantized_embedding_table> quantized_table; ///< The quantized table (8 or 4 bits inference)
+
     size_t V; ///< The vocabulary size
     size_t I; ///< The input size
     size_t K; ///< The embedding size
@@ -130,7 +137,25 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("embedding:forward_batch");
 
-        output = batch_embedding_lookup(v, w);
+        if (cpp_unlikely(quantized_table && quantized_table->enabled)) {
+            if constexpr (time_major) {
+                quantized_table->gather(output, time_major_indices(v));
+            } else {
+                quantized_table->gather(output, v);
+            }
+
+            return;
+        }
+
+        if constexpr (time_major) {
+            // The rows of the output are ordered by time step
+            auto indices = time_major_indices(v);
+            gather_rows(output, indices, w);
+        } else if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<H1>>) {
+            gather_rows(output, v, w);
+        } else {
+            output = batch_embedding_lookup(v, w);
+        }
     }
 
     void prepare_input(input_one_t& input) const {
@@ -197,7 +222,21 @@ struct dyn_embedding_layer_impl final : neural_layer_no_bias<dyn_embedding_layer
     void compute_gradients(C& context) const {
         dll::auto_timer timer("embedding:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+        if constexpr (time_major) {
+            auto indices = time_major_indices(context.input);
+
+            if constexpr (sparse_gradients) {
+                context.sparse.gradients(std::get<0>(context.up.context)->grad, indices, context.errors);
+            } else {
+                // All the rows of the gradients are reset
+                sparse_rows<weight> rows;
+                rows.gradients(std::get<0>(context.up.context)->grad, indices, context.errors);
+            }
+        } else if constexpr (sparse_gradients) {
+            context.sparse.gradients(std::get<0>(context.up.context)->grad, context.input, context.errors);
+        } else {
+            std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);
+        }
     }
 };
 
@@ -235,6 +274,8 @@ struct sgd_context<DBN, dyn_embedding_layer_impl<Desc>, L> {
     etl::dyn_matrix<weight, 3> output;
     etl::dyn_matrix<weight, 3> errors;
 
+    sparse_rows<weight> sparse; ///< The rows touched by the batch (sparse gradients)
+
     sgd_context(const dyn_embedding_layer_impl<Desc>&  layer )
             : input(batch_size, layer.I), output(batch_size, layer.I, layer.K), errors(batch_size, layer.I, layer.K) {
         output = weight(0);
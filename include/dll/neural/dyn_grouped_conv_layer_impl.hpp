@@ -0,0 +1,366 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_traits.hpp"
+#include "dll/neural_layer.hpp"
+#include "dll/util/grouped_conv.hpp"
+#include "dll/util/tuning.hpp"
+
+#include "dll/util/epilogue.hpp"
+#include "dll/util/timers.hpp" // for auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Dynamic grouped convolutional layer of neural network.
+ */
+template <typename Desc>
+struct dyn_grouped_conv_layer_impl final : neural_layer<dyn_grouped_conv_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                              ///< The descriptor type
+    using weight      = typename desc::weight;             ///< The weight type
+    using this_type   = dyn_grouped_conv_layer_impl<desc>; ///< This type
+    using base_type   = neural_layer<this_type, desc>;     ///< The layer's base type
+    using layer_t     = this_type;                         ///< The type of this layer
+    using dyn_layer_t = typename desc::dyn_layer_t;        ///< The dynamic type of this layer
+
+    static constexpr auto activation_function = desc::activation_function; ///< The activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::dyn_matrix<weight, 3>; ///< The type for one input
+    using output_one_t = etl::dyn_matrix<weight, 3>; ///< The type for one output
+    using input_t      = std::vector<input_one_t>;   ///< The type for many input
+    using output_t     = std::vector<output_one_t>;  ///< The type for many output
+
+    using w_type = etl::dyn_matrix<weight, 4>; ///< The type of the weights
+    using b_type = etl::dyn_matrix<weight, 1>; ///< The type of the biases
+
+    //Weights and biases
+    w_type w; ///< Weights
+    b_type b; ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    layer_tuning tuning; ///< The runtime tuning of the kernels (set by the auto-tuner)
+
+    size_t nv1; ///< The first dimension of the input
+    size_t nv2; ///< The second dimension of the input
+    size_t nc;  ///< The number of input channels
+    size_t k;   ///< The number of filters
+    size_t g;   ///< The number of groups
+
+    size_t nw1; ///< The first dimension of the filters
+    size_t nw2; ///< The second dimension of the filters
+
+    dyn_grouped_conv_layer_impl(): base_type() {
+        // Nothing else to init
+    }
+
+    /*!
+     * \brief Initialize the dynamic layer
+     */
+    void init_layer(size_t nc, size_t nv1, size_t nv2, size_t k, size_t nw1, size_t nw2, size_t g){
+        cpp_assert(nw1 % 2 == 1 && nw2 % 2 == 1, "The filters of a grouped convolution must have odd dimensions");
+        cpp_assert(g > 0 && nc % g == 0 && k % g == 0, "The channels and the filters must be divisible by the number of groups");
+
+        this->nv1 = nv1;
+        this->nv2 = nv2;
+        this->nw1 = nw1;
+        this->nw2 = nw2;
+        this->nc  = nc;
+        this->k   = k;
+        this->g   = g;
+
+        w = etl::dyn_matrix<weight, 4>(k, nc / g, nw1, nw2);
+
+        b = etl::dyn_vector<weight>(k);
+
+        w_initializer::initialize(w, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    /*!
+     * \brief Returns the geometry of the convolution
+     */
+    grouped_conv_shape shape() const noexcept {
+        return {nc, nv1, nv2, k, nw1, nw2, g};
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    size_t input_size() const noexcept {
+        return nc * nv1 * nv2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    size_t output_size() const noexcept {
+        return k * nv1 * nv2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    size_t parameters() const noexcept {
+        return k * (nc / g) * nw1 * nw2;
+    }
+
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, input_size(), output_size(), parameters(), k, parameters() * nv1 * nv2);
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    std::string to_short_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "GroupedConv (dyn)";
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "GroupedConv(%s)(dyn)", to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    std::string to_full_string(std::string pre = "") const {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if constexpr (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "GroupedConv(dyn): %lux%lux%lu -> (%lux%lux%lu, %lu groups) -> %lux%lux%lu",
+                     nc, nv1, nv2, k, nw1, nw2, g, k, nv1, nv2);
+        } else {
+            snprintf(buffer, 512, "GroupedConv(dyn): %lux%lux%lu -> (%lux%lux%lu, %lu groups) -> %s -> %lux%lux%lu",
+                     nc, nv1, nv2, k, nw1, nw2, g, to_string(activation_function).c_str(), k, nv1, nv2);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {k, nv1, nv2};
+    }
+
+    using base_type::forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void forward_batch(H1&& output, const V& v) const {
+        forward_batch_activated<activation_function>(output, v);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, with the given
+     * activation function instead of the activation function of the layer.
+     *
+     * \param v A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <function F, typename H1, typename V>
+    void forward_batch_activated(H1&& output, const V& v) const {
+        dll::auto_timer timer("grouped_conv:forward_batch");
+        timer.work(cost(etl::dim<0>(v)).forward);
+
+        tuning_scope scope(tuning);
+
+        // The kernels work on the memory of the batch, of any shape
+        if constexpr (etl::is_dma<V>) {
+            grouped_conv_forward(output, v, w, shape());
+        } else {
+            grouped_conv_forward(output, etl::force_temporary(v), w, shape());
+        }
+
+        // The bias and the element-wise activation functions are applied in
+        // a single pass
+        if constexpr (!no_bias && F != function::IDENTITY && F != function::SOFTMAX) {
+            output = f_activate<F>(bias_add_4d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_4d(output, b);
+            }
+
+            if constexpr (F != function::IDENTITY) {
+                output = f_activate<F>(output);
+            }
+        }
+    }
+
+    void prepare_input(input_one_t& input) const {
+        input = input_one_t(nc, nv1, nv2);
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    output_t prepare_output(size_t samples) const {
+        output_t output;
+        output.reserve(samples);
+        for(size_t i = 0; i < samples; ++i){
+            output.emplace_back(k, nv1, nv2);
+        }
+        return output;
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return output_one_t(k, nv1, nv2);
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM&){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("grouped_conv:adapt_errors");
+
+        if constexpr (fused_bias_errors<activation_function, no_bias>) {
+            // The gradients of the biases are computed in the same pass
+            adapt_errors_bias<activation_function>(context);
+        } else if constexpr (activation_function != function::IDENTITY) {
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("grouped_conv:backward_batch");
+        timer.work(cost(etl::dim<0>(context.errors)).backward);
+
+        tuning_scope scope(tuning);
+
+        grouped_conv_backward(output, context.errors, w, shape());
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("grouped_conv:compute_gradients");
+        timer.work(cost(etl::dim<0>(context.errors)).gradients);
+
+        tuning_scope scope(tuning);
+
+        grouped_conv_gradients(std::get<0>(context.up.context)->grad, context.input, context.errors, shape());
+
+        if constexpr (!no_bias) {
+            // The gradients of the biases may have been computed with the errors
+            if (context.bias_reduced) {
+                context.bias_reduced = false;
+            } else {
+                std::get<1>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+            }
+        }
+    }
+};
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<dyn_grouped_conv_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true;  ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = true ; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of sgd_context for dyn_grouped_conv_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, dyn_grouped_conv_layer_impl<Desc>, L> {
+    using layer_t = dyn_grouped_conv_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::dyn_matrix<weight, 4> input;
+    etl::dyn_matrix<weight, 4> output;
+    etl::dyn_matrix<weight, 4> errors;
+
+    bool bias_reduced = false; ///< Indicates if the gradients of the biases were computed by adapt_errors
+
+    sgd_context(const layer_t& layer)
+            : input(batch_size, layer.nc, layer.nv1, layer.nv2),
+              output(batch_size, layer.k, layer.nv1, layer.nv2), errors(batch_size, layer.k, layer.nv1, layer.nv2) {}
+};
+
+} //end of dll namespace
@@ -34,7 +34,7 @@ struct dyn_recurrent_last_layer_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-            weight_type_id>,
+            weight_type_id, time_major_id>,
             Parameters...>,
         "Invalid parameters type for recurrent_last_layer_desc");
 };
@@ -30,9 +30,31 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
     using input_t      = std::vector<input_one_t>;   ///< The type of the input
     using output_t     = std::vector<output_one_t>;  ///< The type of the output
 
+    static constexpr bool time_major = desc::parameters::template contains<dll::time_major>(); ///< The input batches are time-major
+
     size_t time_steps;   ///< The number of time steps
     size_t hidden_units; ///< The number of hidden units
 
+    size_t active_steps = 0; ///< The number of time steps of the current batch, the next ones being padding (0 for all the time steps)
+
+    std::vector<size_t> sample_steps; ///< The length of each sequence of the current batch (empty for all the time steps)
+
+    /*!
+     * \brief Returns the last time step of the current batch, before the
+     * padding steps
+     */
+    size_t last_step() const {
+        return (active_steps ? std::min(active_steps, time_steps) : time_steps) - 1;
+    }
+
+    /*!
+     * \brief Returns the last time step of the given sequence of the current
+     * batch
+     */
+    size_t last_step(size_t b) const {
+        return sample_steps.empty() ? last_step() : std::min(std::max(sample_steps[b], size_t(1)) - 1, last_step());
+    }
+
     /*!
      * \brief Initialize the dynamic layer
      */
@@ -108,8 +130,32 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
 
         cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b) = input(b)(time_steps - 1);
+        if (!sample_steps.empty()) {
+            cpp_assert(sample_steps.size() == Batch, "Invalid number of lengths for the batch");
+
+            // Each sequence has its own last step
+            for (size_t b = 0; b < Batch; ++b) {
+                if constexpr (time_major) {
+                    const size_t r = last_step(b) * Batch + b;
+
+                    output(b) = input(r / time_steps)(r % time_steps);
+                } else {
+                    output(b) = input(b)(last_step(b));
+                }
+            }
+        } else if constexpr (time_major) {
+            // The last time step is contiguous
+            input.ensure_cpu_up_to_date();
+
+            const auto* last = input.memory_start() + last_step() * Batch * hidden_units;
+
+            std::copy(last, last + Batch * hidden_units, output.memory_start());
+
+            output.invalidate_gpu();
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                output(b) = input(b)(last_step());
+            }
         }
     }
 
@@ -177,8 +223,28 @@ struct dyn_recurrent_last_layer_impl final : layer<dyn_recurrent_last_layer_impl
 
         output = 0;
 
-        for(size_t b = 0; b < Batch; ++b){
-            output(b)(time_steps - 1) = context.errors(b);
+        if (!sample_steps.empty()) {
+            for (size_t b = 0; b < Batch; ++b) {
+                if constexpr (time_major) {
+                    const size_t r = last_step(b) * Batch + b;
+
+                    output(r / time_steps)(r % time_steps) = context.errors(b);
+                } else {
+                    output(b)(last_step(b)) = context.errors(b);
+                }
+            }
+        } else if constexpr (time_major) {
+            context.errors.ensure_cpu_up_to_date();
+            output.ensure_cpu_up_to_date();
+
+            std::copy(context.errors.memory_start(), context.errors.memory_start() + Batch * hidden_units,
+                      output.memory_start() + last_step() * Batch * hidden_units);
+
+            output.invalidate_gpu();
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                output(b)(last_step()) = context.errors(b);
+            }
         }
     }
 
@@ -48,7 +48,7 @@ struct dyn_rnn_layer_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<
-            weight_type_id, activation_id, rnn_initializer_w_id, rnn_initializer_u_id, initializer_bias_id, truncate_id, last_only_id>,
+            weight_type_id, activation_id, rnn_initializer_w_id, rnn_initializer_u_id, initializer_bias_id, truncate_id, last_only_id, stateful_id, time_major_id, reverse_id>,
             Parameters...>,
         "Invalid parameters type for dyn_rnn_layer_desc");
 };
@@ -31,6 +31,9 @@ struct embedding_layer_desc {
     /*! The type used to store the weights */
     using weight = detail::get_type_t<weight_type<float>, Parameters...>;
 
+    /*! Indicates if the gradients are only computed and applied on the touched rows */
+    static constexpr bool sparse_gradients = parameters::template contains<dll::sparse_gradients>();
+
     /*! The embedding type */
     using layer_t = embedding_layer_impl<embedding_layer_desc<V, I, K, Parameters...>>;
 
@@ -43,7 +46,7 @@ struct embedding_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id, initializer_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, initializer_id, sparse_gradients_id, time_major_id>, Parameters...>,
         "Invalid parameters type for embedding_layer_desc");
 };
 
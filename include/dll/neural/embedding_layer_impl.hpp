@@ -9,6 +9,8 @@
 
 #include "dll/neural_layer_no_bias.hpp"
 
+#include "dll/util/sparse.hpp"       // for sparse_rows and gather_rows
+#include "dll/util/quantization.hpp" // for quantized_embedding_table
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -31,6 +33,9 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
 
     using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
 
+    static constexpr bool sparse_gradients = desc::sparse_gradients; ///< Indicates if the gradients are sparse
+    static constexpr bool time_major       = desc::parameters::template contains<dll::time_major>(); ///< The output batches are time-major
+
     using input_one_t  = etl::fast_dyn_matrix<weight, I>;    ///< The type of one input
     using output_one_t = etl::fast_dyn_matrix<weight, I, K>; ///< The type of one output
     using input_t      = std::vector<input_one_t>;           ///< The type of the input
@@ -44,6 +49,8 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     //Backup weights and biases
     std::unique_ptr<w_type> bak_w; ///< Backup Weights
 
+    std::unique_ptr<quantized_embedding_table> quantized_table; ///< The quantized table (8 or 4 bits inference)
+
     /*!
      * \brief Initialize a embedding layer with basic weights.
      */
@@ -117,7 +124,25 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     void forward_batch(H1&& output, const V& v) const {
         dll::auto_timer timer("embedding:forward_batch");
 
-        output = batch_embedding_lookup(v, w);
+        if (cpp_unlikely(quantized_table && quantized_table->enabled)) {
+            if constexpr (time_major) {
+                quantized_table->gather(output, time_major_indices(v));
+            } else {
+                quantized_table->gather(output, v);
+            }
+
+            return;
+        }
+
+        if constexpr (time_major) {
+            // The rows of the output are ordered by time step
+            auto indices = time_major_indices(v);
+            gather_rows(output, indices, w);
+        } else if constexpr (etl::is_dma<V> && etl::is_dma<std::decay_t<H1>>) {
+            gather_rows(output, v, w);
+        } else {
+            output = batch_embedding_lookup(v, w);
+        }
     }
 
     /*!
@@ -172,7 +197,21 @@ struct embedding_layer_impl final : neural_layer_no_bias<embedding_layer_impl<De
     void compute_gradients(C& context) const {
         dll::auto_timer timer("embedding:compute_gradients");
 
-        std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);;
+        if constexpr (time_major) {
+            auto indices = time_major_indices(context.input);
+
+            if constexpr (sparse_gradients) {
+                context.sparse.gradients(std::get<0>(context.up.context)->grad, indices, context.errors);
+            } else {
+                // All the rows of the gradients are reset
+                sparse_rows<weight> rows;
+                rows.gradients(std::get<0>(context.up.context)->grad, indices, context.errors);
+            }
+        } else if constexpr (sparse_gradients) {
+            context.sparse.gradients(std::get<0>(context.up.context)->grad, context.input, context.errors);
+        } else {
+            std::get<0>(context.up.context)->grad = batch_embedding_gradients(context.input, context.errors, w);
+        }
     }
 };
 
@@ -225,6 +264,8 @@ struct sgd_context<DBN, embedding_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, I, K> output;
     etl::fast_matrix<weight, batch_size, I, K> errors;
 
+    sparse_rows<weight> sparse; ///< The rows touched by the batch (sparse gradients)
+
     sgd_context(const embedding_layer_impl<Desc>& /* layer */)
             : output(0.0), errors(0.0) {}
 };
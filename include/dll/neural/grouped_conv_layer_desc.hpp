@@ -0,0 +1,83 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Describe a grouped convolutional layer.
+ *
+ * The channels and the filters are split into G groups, each filter only
+ * sees the NC / G channels of its group. The convolution is computed with
+ * 'same' padding.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, size_t NW_1, size_t NW_2, size_t G_T, typename... Parameters>
+struct grouped_conv_layer_desc {
+    static constexpr size_t NV1 = NV_1; ///< The height of the input
+    static constexpr size_t NV2 = NV_2; ///< The width of the input
+    static constexpr size_t NW1 = NW_1; ///< The height of the filters
+    static constexpr size_t NW2 = NW_2; ///< The width of the filters
+    static constexpr size_t NC  = NC_T; ///< The number of input channels
+    static constexpr size_t K   = K_T;  ///< The number of filters
+    static constexpr size_t G   = G_T;  ///< The number of groups
+
+    /*!
+     * \brief A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    static constexpr auto activation_function = detail::get_value_v<activation<function::SIGMOID>, Parameters...>; ///< The layer's activation function
+
+    using w_initializer = detail::get_type_t<initializer<init_lecun>, Parameters...>;     ///< The initializer for the weights
+    using b_initializer = detail::get_type_t<initializer_bias<init_zero>, Parameters...>; ///< The initializer for the biases
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! The conv type */
+    using layer_t = grouped_conv_layer_impl<grouped_conv_layer_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, G_T, Parameters...>>;
+
+    /*! The conv type */
+    using dyn_layer_t = dyn_grouped_conv_layer_impl<dyn_grouped_conv_layer_desc<Parameters...>>;
+
+    static_assert(NV1 > 0 && NV2 > 0, "A matrix of at least 1x1 is necessary for the visible units");
+    static_assert(NW1 % 2 == 1 && NW2 % 2 == 1, "The filters of a grouped convolution must have odd dimensions");
+    static_assert(NW1 <= NV1 && NW2 <= NV2, "The filters cannot be larger than the input");
+    static_assert(NC > 0, "At least one channel is necessary");
+    static_assert(K > 0, "At least one filter is necessary");
+    static_assert(G > 0 && NC % G == 0 && K % G == 0, "The channels and the filters must be divisible by the number of groups");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, initializer_id, initializer_bias_id, no_bias_id>, Parameters...>,
+        "Invalid parameters type for grouped_conv_layer_desc");
+};
+
+/*!
+ * \brief Describe a grouped convolutional layer.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t K_T, size_t NW_1, size_t NW_2, size_t G_T, typename... Parameters>
+using grouped_conv_layer = typename grouped_conv_layer_desc<NC_T, NV_1, NV_2, K_T, NW_1, NW_2, G_T, Parameters...>::layer_t;
+
+/*!
+ * \brief Describe a depthwise convolutional layer: one filter per channel,
+ * each filter only seeing its own channel.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t NW_1, size_t NW_2, typename... Parameters>
+using depthwise_conv_layer_desc = grouped_conv_layer_desc<NC_T, NV_1, NV_2, NC_T, NW_1, NW_2, NC_T, Parameters...>;
+
+/*!
+ * \brief Describe a depthwise convolutional layer.
+ */
+template <size_t NC_T, size_t NV_1, size_t NV_2, size_t NW_1, size_t NW_2, typename... Parameters>
+using depthwise_conv_layer = typename depthwise_conv_layer_desc<NC_T, NV_1, NV_2, NW_1, NW_2, Parameters...>::layer_t;
+
+} //end of dll namespace
@@ -0,0 +1,64 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/base_conf.hpp"
+#include "dll/util/tmp.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Describe a hashed embedding layer.
+ *
+ * The token ids are mapped by H hash functions into a shared table of B
+ * rows, whatever the size of the vocabulary.
+ */
+template <size_t B_T, size_t I_T, size_t K_T, size_t H_T = 2, typename... Parameters>
+struct hashed_embedding_layer_desc {
+    static constexpr size_t B = B_T; ///< The number of rows of the table (buckets)
+    static constexpr size_t I = I_T; ///< The size of each input
+    static constexpr size_t K = K_T; ///< The size of embeddings
+    static constexpr size_t H = H_T; ///< The number of hash functions
+
+    /*!
+     * \brief A list of all the parameters of the descriptor
+     */
+    using parameters = cpp::type_list<Parameters...>;
+
+    using w_initializer = detail::get_type_t<initializer<init_uniform<constant(-1.0), constant(1.0)>>, Parameters...>; ///< The initializer for the weights
+
+    /*! The type used to store the weights */
+    using weight = detail::get_type_t<weight_type<float>, Parameters...>;
+
+    /*! Indicates if the gradients are only computed and applied on the touched rows */
+    static constexpr bool sparse_gradients = parameters::template contains<dll::sparse_gradients>();
+
+    /*! The embedding type */
+    using layer_t = hashed_embedding_layer_impl<hashed_embedding_layer_desc<B, I, K, H, Parameters...>>;
+
+    /*! The embedding type (no dynamic version) */
+    using dyn_layer_t = layer_t;
+
+    static_assert(B > 0, "At least one bucket is necessary");
+    static_assert(I > 0, "At least one input is necessary");
+    static_assert(K > 0, "At least one embedding is necessary");
+    static_assert(H > 0, "At least one hash function is necessary");
+
+    //Make sure only valid types are passed to the configuration list
+    static_assert(
+        detail::is_valid_v<cpp::type_list<weight_type_id, initializer_id, sparse_gradients_id>, Parameters...>,
+        "Invalid parameters type for hashed_embedding_layer_desc");
+};
+
+/*!
+ * \brief Describe a hashed embedding layer.
+ */
+template <size_t B_T, size_t I_T, size_t K_T, size_t H_T = 2, typename... Parameters>
+using hashed_embedding_layer = typename hashed_embedding_layer_desc<B_T, I_T, K_T, H_T, Parameters...>::layer_t;
+
+} //end of dll namespace
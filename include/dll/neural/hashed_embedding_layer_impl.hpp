@@ -0,0 +1,307 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <cstdint>
+
+#include "dll/neural_layer_no_bias.hpp"
+
+#include "dll/util/sparse.hpp" // for sparse_rows and gather_hashed_rows
+#include "dll/util/timers.hpp" // for auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Hashed embedding layer of neural network (feature hashing).
+ *
+ * Each token id is mapped by H hash functions to H rows (buckets) of a
+ * shared table of B rows and its embedding is the sum of these rows. The
+ * memory of the table does not depend on the size of the vocabulary.
+ *
+ * The token ids are the integer values of the inputs, exact up to 2^24 with
+ * float weights and up to 2^53 with double weights.
+ */
+template <typename Desc>
+struct hashed_embedding_layer_impl final : neural_layer_no_bias<hashed_embedding_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                                  ///< The descriptor of the layer
+    using weight      = typename desc::weight;                 ///< The data type of the layer
+    using this_type   = hashed_embedding_layer_impl<desc>;     ///< The type of this layer
+    using base_type   = neural_layer_no_bias<this_type, desc>; ///< The base type of the layer
+    using layer_t     = this_type;                             ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;            ///< The dynamic version of this layer
+
+    static constexpr size_t B = desc::B; ///< The number of rows of the table
+    static constexpr size_t I = desc::I; ///< The input size
+    static constexpr size_t K = desc::K; ///< The embedding size
+    static constexpr size_t H = desc::H; ///< The number of hash functions
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+
+    static constexpr bool sparse_gradients = desc::sparse_gradients; ///< Indicates if the gradients are sparse
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, I>;    ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, I, K>; ///< The type of one output
+    using input_t      = std::vector<input_one_t>;           ///< The type of the input
+    using output_t     = std::vector<output_one_t>;          ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, B, K>; ///< The type of the weights
+
+    //Weights and biases
+    w_type w; ///< Weights
+
+    //Backup weights and biases
+    std::unique_ptr<w_type> bak_w; ///< Backup Weights
+
+    /*!
+     * \brief Initialize a hashed embedding layer with basic weights.
+     */
+    hashed_embedding_layer_impl() : base_type() {
+        w_initializer::initialize(w, input_size(), output_size());
+
+        // The embedding of a token sums H rows
+        w *= weight(1.0) / weight(H);
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return I;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return I * K;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return B * K;
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        return "HashedEmbedding";
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[256];
+        snprintf(buffer, 256, "HashedEmbedding: %lu -> (%lux%lu, %lu hashes) -> %lu", I, B, K, H, K);
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {K};
+    }
+
+    /*!
+     * \brief Returns the bucket of the given token id for the hash function h
+     */
+    static size_t bucket(uint64_t id, size_t h) noexcept {
+        // splitmix64 finalizer, seeded by the hash function
+        uint64_t z = id + (h + 1) * 0x9E3779B97F4A7C15UL;
+
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+        z = z ^ (z >> 31);
+
+        return z % B;
+    }
+
+    /*!
+     * \brief Compute the buckets of all the token ids of the given batch
+     * \param v The batch of token ids
+     * \return The H buckets of each token id
+     */
+    template <typename V>
+    static std::vector<size_t> hash_buckets(const V& v) {
+        const size_t m = etl::size(v);
+
+        v.ensure_cpu_up_to_date();
+
+        std::vector<size_t> buckets(m * H);
+
+        for (size_t i = 0; i < m; ++i) {
+            const auto id = uint64_t(v[i]);
+
+            for (size_t h = 0; h < H; ++h) {
+                buckets[i * H + h] = bucket(id, h);
+            }
+        }
+
+        return buckets;
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void forward_batch(H1&& output, const V& v) const {
+        dll::auto_timer timer("hashed_embedding:forward_batch");
+
+        auto buckets = hash_buckets(v);
+
+        if constexpr (etl::is_dma<std::decay_t<H1>>) {
+            gather_hashed_rows(output, buckets, H, w);
+        } else {
+            etl::dyn_matrix<weight, 2> gathered(etl::size(v), K);
+            gather_hashed_rows(gathered, buckets, H, w);
+
+            for (size_t i = 0; i < etl::size(gathered); ++i) {
+                output[i] = gathered[i];
+            }
+        }
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer (there is no dynamic version)
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM& dyn){
+        cpp_unused(dyn);
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        cpp_unused(context);
+
+        // Nothing to adapt
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("hashed_embedding:compute_gradients");
+
+        auto buckets = hash_buckets(context.input);
+
+        if constexpr (sparse_gradients) {
+            context.sparse.hashed_gradients(std::get<0>(context.up.context)->grad, buckets, H, context.errors);
+        } else {
+            // All the rows of the gradients are reset
+            sparse_rows<weight> rows;
+            rows.hashed_gradients(std::get<0>(context.up.context)->grad, buckets, H, context.errors);
+        }
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t hashed_embedding_layer_impl<Desc>::B;
+
+template <typename Desc>
+const size_t hashed_embedding_layer_impl<Desc>::I;
+
+template <typename Desc>
+const size_t hashed_embedding_layer_impl<Desc>::K;
+
+template <typename Desc>
+const size_t hashed_embedding_layer_impl<Desc>::H;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<hashed_embedding_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for hashed_embedding_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, hashed_embedding_layer_impl<Desc>, L> {
+    using layer_t = hashed_embedding_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t I = layer_t::I;
+    static constexpr size_t K = layer_t::K;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, I> input;
+    etl::fast_matrix<weight, batch_size, I, K> output;
+    etl::fast_matrix<weight, batch_size, I, K> errors;
+
+    sparse_rows<weight> sparse; ///< The rows touched by the batch (sparse gradients)
+
+    sgd_context(const hashed_embedding_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
@@ -122,6 +122,13 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
         return 4 * hidden_units * hidden_units + 4 * hidden_units * sequence_length;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, input_size(), 4 * output_size(), parameters(), 0, 4 * time_steps * (sequence_length + hidden_units) * hidden_units);
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -175,24 +182,20 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     mutable etl::dyn_matrix<float, 3> s_t;
     mutable etl::dyn_matrix<float, 3> h_t;
 
+    mutable etl::dyn_matrix<float, 2> z_t;
+    mutable etl::dyn_matrix<float, 2> zh_t;
+    mutable etl::dyn_matrix<float, 2> u_gates;
+    mutable etl::dyn_matrix<float, 2> w_gates;
+    mutable etl::dyn_matrix<float, 2> b_gates;
+
     mutable etl::dyn_matrix<float, 3> d_h_t;
     mutable etl::dyn_matrix<float, 3> d_c_t;
     mutable etl::dyn_matrix<float, 3> d_x_t;
 
-    mutable etl::dyn_matrix<float, 3> d_h_o_t;
-    mutable etl::dyn_matrix<float, 3> d_h_f_t;
-    mutable etl::dyn_matrix<float, 3> d_h_i_t;
-    mutable etl::dyn_matrix<float, 3> d_h_c_t;
-
-    mutable etl::dyn_matrix<float, 3> d_x_o_t;
-    mutable etl::dyn_matrix<float, 3> d_x_f_t;
-    mutable etl::dyn_matrix<float, 3> d_x_i_t;
-    mutable etl::dyn_matrix<float, 3> d_x_c_t;
-
-    mutable etl::dyn_matrix<float, 3> d_xh_o_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_f_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_i_t;
-    mutable etl::dyn_matrix<float, 3> d_xh_c_t;
+    mutable etl::dyn_matrix<float, 2> d_gates;
+    mutable etl::dyn_matrix<float, 2> u_gates_grad;
+    mutable etl::dyn_matrix<float, 2> w_gates_grad;
+    mutable etl::dyn_matrix<float, 1> b_gates_grad;
 
     void prepare_cache(size_t Batch) const {
         if (cpp_unlikely(!i_t.memory_start())) {
@@ -209,20 +212,10 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
             d_c_t.resize(time_steps, Batch, hidden_units);
             d_x_t.resize(time_steps, Batch, sequence_length);
 
-            d_h_o_t.resize(time_steps, Batch, hidden_units);
-            d_h_f_t.resize(time_steps, Batch, hidden_units);
-            d_h_i_t.resize(time_steps, Batch, hidden_units);
-            d_h_c_t.resize(time_steps, Batch, hidden_units);
-
-            d_x_o_t.resize(time_steps, Batch, sequence_length);
-            d_x_f_t.resize(time_steps, Batch, sequence_length);
-            d_x_i_t.resize(time_steps, Batch, sequence_length);
-            d_x_c_t.resize(time_steps, Batch, sequence_length);
-
-            d_xh_o_t.resize(time_steps, Batch, hidden_units);
-            d_xh_f_t.resize(time_steps, Batch, hidden_units);
-            d_xh_i_t.resize(time_steps, Batch, hidden_units);
-            d_xh_c_t.resize(time_steps, Batch, hidden_units);
+            d_gates.resize(Batch, 4 * hidden_units);
+            u_gates_grad.resize(sequence_length, 4 * hidden_units);
+            w_gates_grad.resize(hidden_units, 4 * hidden_units);
+            b_gates_grad.resize(4 * hidden_units);
         }
     }
 
@@ -235,6 +228,7 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     template <typename H, typename V>
     void forward_batch(H&& output, const V& x) const {
         dll::auto_timer timer("lstm:forward_batch");
+        timer.work(cost(etl::dim<0>(x)).forward);
 
         const auto Batch = etl::dim<0>(x);
 
@@ -242,43 +236,29 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
 
         prepare_cache(Batch);
 
-        // 1. Rearrange input
-
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                x_t(t)(b) = x(b)(t);
-            }
-        }
-
-        // 2. Forward propagation through time
-
-        // t == 0
-
-        g_t(0) =    etl::tanh(bias_add_2d(x_t(0) * (u_g), b_g));
-        i_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_i), b_i));
-        f_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_f), b_f));
-        o_t(0) = etl::sigmoid(bias_add_2d(x_t(0) * (u_o), b_o));
+        base_type::forward_batch_cache_impl(output, x, *this, time_steps);
+    }
 
-        s_t(0) = g_t(0) >> i_t(0);
-        h_t(0) = f_activate<activation_function>(s_t(0)) >> o_t(0);
+    /*!
+     * \brief Apply the layer to the given batch of input, using the given
+     * cache instead of the cache of the layer.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param cache The cache for the intermediate results
+     */
+    template <typename H, typename V>
+    void forward_batch(H&& output, const V& x, typename base_type::inference_cache_t& cache) const {
+        dll::auto_timer timer("lstm:forward_batch");
+        timer.work(cost(etl::dim<0>(x)).forward);
 
-        for (size_t t = 1; t < time_steps; ++t) {
-            g_t(t) =    etl::tanh(bias_add_2d(x_t(t) * u_g + h_t(t - 1) * w_g, b_g));
-            i_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_i + h_t(t - 1) * w_i, b_i));
-            f_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_f + h_t(t - 1) * w_f, b_f));
-            o_t(t) = etl::sigmoid(bias_add_2d(x_t(t) * u_o + h_t(t - 1) * w_o, b_o));
+        const auto Batch = etl::dim<0>(x);
 
-            s_t(t) = f_activate<activation_function>( (g_t(t) >> i_t(t)) + (s_t(t - 1) >> f_t(t)) );
-            h_t(t) = s_t(t) >> o_t(t);
-        }
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
 
-        // 3. Rearrange the output
+        cache.prepare(Batch, time_steps, sequence_length, hidden_units);
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                output(b)(t) = h_t(t)(b);
-            }
-        }
+        base_type::forward_batch_cache_impl(output, x, cache, time_steps);
     }
 
     /*!
@@ -331,123 +311,115 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     void backward_pass(Output& output, C& context, bool direct = true) const {
         const size_t Batch = etl::dim<0>(context.errors);
 
+        // The padding steps have not been computed
+        const size_t steps = this->batch_steps(time_steps);
+
         // 1. Rearrange input/errors
 
         etl::dyn_matrix<float, 3> delta_t(time_steps, Batch, hidden_units);
 
-        for (size_t b = 0; b < Batch; ++b) {
-            for (size_t t = 0; t < time_steps; ++t) {
-                delta_t(t)(b) = context.errors(b)(t);
+        if (this->masked()) {
+            this->rearrange_masked_input(delta_t, context.errors, steps);
+        } else if constexpr (base_type::time_major) {
+            this->copy_steps(delta_t, context.errors, time_steps, steps);
+        } else {
+            for (size_t b = 0; b < Batch; ++b) {
+                for (size_t t = 0; t < steps; ++t) {
+                    delta_t(t)(b) = context.errors(b)(this->sequence_step(t, steps));
+                }
             }
         }
 
-        // 2. Get gradients from the context
-
-        auto& w_i_grad = std::get<0>(context.up.context)->grad;
-        auto& u_i_grad = std::get<1>(context.up.context)->grad;
-        auto& b_i_grad = std::get<2>(context.up.context)->grad;
-        auto& w_g_grad = std::get<3>(context.up.context)->grad;
-        auto& u_g_grad = std::get<4>(context.up.context)->grad;
-        auto& b_g_grad = std::get<5>(context.up.context)->grad;
-        auto& w_f_grad = std::get<6>(context.up.context)->grad;
-        auto& u_f_grad = std::get<7>(context.up.context)->grad;
-        auto& b_f_grad = std::get<8>(context.up.context)->grad;
-        auto& w_o_grad = std::get<9>(context.up.context)->grad;
-        auto& u_o_grad = std::get<10>(context.up.context)->grad;
-        auto& b_o_grad = std::get<11>(context.up.context)->grad;
-
-        w_i_grad = 0;
-        u_i_grad = 0;
-        b_i_grad = 0;
-        w_g_grad = 0;
-        u_g_grad = 0;
-        b_g_grad = 0;
-        w_f_grad = 0;
-        u_f_grad = 0;
-        b_f_grad = 0;
-        w_o_grad = 0;
-        u_o_grad = 0;
-        b_o_grad = 0;
+        // 2. Backpropagation through time
 
-        // 3. Backpropagation through time
+        u_gates_grad = 0;
+        w_gates_grad = 0;
+        b_gates_grad = 0;
 
-        size_t ttt = time_steps - 1;
+        size_t ttt = steps - 1;
 
         do {
-            const size_t last_step = std::max(int(time_steps) - int(bptt_steps), 0);
+            const size_t last_step = std::max(int(steps) - int(bptt_steps), 0);
 
             // Backpropagation through time
             for(int tt = ttt; tt >= int(last_step); --tt){
                 const size_t t = tt;
 
-                if (t == time_steps - 1) {
-                    d_h_t(t) = delta_t(t);
-                    d_c_t(t) = (o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t));
-                } else {
-                    d_h_t(t) = delta_t(t) + d_h_t(t + 1);
-                    d_c_t(t) = ((o_t(t) >> d_h_t(t)) >> f_derivative<activation_function>(s_t(t))) + d_c_t(t + 1);
-                }
-
-                d_h_o_t(t) = etl::ml::sigmoid_backward(o_t(t), s_t(t) >> d_h_t(t));
-                d_h_i_t(t) = etl::ml::sigmoid_backward(i_t(t), g_t(t) >> d_c_t(t));
-                d_h_c_t(t) = etl::ml::tanh_backward(g_t(t), i_t(t) >> d_c_t(t));
-
-                if (t == 0) {
-                    d_h_f_t(t) = 0;
-                } else {
-                    d_h_f_t(t) = etl::ml::sigmoid_backward(f_t(t), s_t(t - 1) >> d_c_t(t));
-                }
+                const size_t rows = this->active_rows(t, Batch);
 
-                b_o_grad += bias_batch_sum_2d(d_h_o_t(t));
-                b_i_grad += bias_batch_sum_2d(d_h_i_t(t));
-                b_f_grad += bias_batch_sum_2d(d_h_f_t(t));
-                b_g_grad += bias_batch_sum_2d(d_h_c_t(t));
+                // The errors of the four gates, in a single sweep
+                this->cell_backward(*this, delta_t(t), t, t == steps - 1, Batch, hidden_units, rows);
 
-                u_o_grad += batch_outer(x_t(t), d_h_o_t(t));
-                u_i_grad += batch_outer(x_t(t), d_h_i_t(t));
-                u_f_grad += batch_outer(x_t(t), d_h_f_t(t));
-                u_g_grad += batch_outer(x_t(t), d_h_c_t(t));
+                b_gates_grad += bias_batch_sum_2d(d_gates);
+                u_gates_grad += batch_outer(x_t(t), d_gates);
 
                 if(t > 0){
-                    w_o_grad += batch_outer(h_t(t - 1), d_h_o_t(t));
-                    w_i_grad += batch_outer(h_t(t - 1), d_h_i_t(t));
-                    w_f_grad += batch_outer(h_t(t - 1), d_h_f_t(t));
-                    w_g_grad += batch_outer(h_t(t - 1), d_h_c_t(t));
+                    w_gates_grad += batch_outer(h_t(t - 1), d_gates);
+                } else if (this->has_init) {
+                    w_gates_grad += batch_outer(this->h_init, d_gates);
                 }
 
                 // The part going back to x
-                d_x_o_t(t) = d_h_o_t(t) * trans(u_o);
-                d_x_i_t(t) = d_h_i_t(t) * trans(u_i);
-                d_x_f_t(t) = d_h_f_t(t) * trans(u_f);
-                d_x_c_t(t) = d_h_c_t(t) * trans(u_g);
-
-                d_x_t(t) = d_x_o_t(t) + d_x_i_t(t) + d_x_f_t(t) + d_x_c_t(t);
-
-                // The part going back to h
-                d_xh_o_t(t) = d_h_o_t(t) * trans(w_o);
-                d_xh_i_t(t) = d_h_i_t(t) * trans(w_i);
-                d_xh_f_t(t) = d_h_f_t(t) * trans(w_f);
-                d_xh_c_t(t) = d_h_c_t(t) * trans(w_g);
-
-                // Update for the next step
-                d_h_t(t) = d_xh_o_t(t) + d_xh_i_t(t) + d_xh_f_t(t) + d_xh_c_t(t);
-                d_c_t(t) = f_t(t) >> d_c_t(t);
-            }
+                if (direct) {
+                    this->running_product(d_x_t(t), d_gates, u_gates, rows);
+                }
 
-            --ttt;
+                // The part going back to h (for the next step)
+                this->running_product(d_h_t(t), d_gates, w_gates, rows);
+            }
 
             // If only the last time step is used, no need to use the other errors
             if constexpr (desc::parameters::template contains<last_only>()) {
                 break;
             }
+
+            // A single step has been back-propagated entirely
+            if (!ttt) {
+                break;
+            }
+
+            --ttt;
         } while (ttt != 0);
 
-        // 3. Rearrange for the output
+        // 3. Split the gradients between the gates
+
+        auto& w_i_grad = std::get<0>(context.up.context)->grad;
+        auto& u_i_grad = std::get<1>(context.up.context)->grad;
+        auto& b_i_grad = std::get<2>(context.up.context)->grad;
+        auto& w_g_grad = std::get<3>(context.up.context)->grad;
+        auto& u_g_grad = std::get<4>(context.up.context)->grad;
+        auto& b_g_grad = std::get<5>(context.up.context)->grad;
+        auto& w_f_grad = std::get<6>(context.up.context)->grad;
+        auto& u_f_grad = std::get<7>(context.up.context)->grad;
+        auto& b_f_grad = std::get<8>(context.up.context)->grad;
+        auto& w_o_grad = std::get<9>(context.up.context)->grad;
+        auto& u_o_grad = std::get<10>(context.up.context)->grad;
+        auto& b_o_grad = std::get<11>(context.up.context)->grad;
+
+        this->unpack_gates(u_gates_grad, sequence_length, u_g_grad, u_i_grad, u_f_grad, u_o_grad);
+        this->unpack_gates(w_gates_grad, hidden_units, w_g_grad, w_i_grad, w_f_grad, w_o_grad);
+        this->unpack_gates(b_gates_grad, 1, b_g_grad, b_i_grad, b_f_grad, b_o_grad);
+
+        // 4. Rearrange for the output
 
         if (direct) {
-            for (size_t b = 0; b < Batch; ++b) {
-                for (size_t t = 0; t < time_steps; ++t) {
-                    output(b)(t) = d_x_t(t)(b);
+            if (this->masked()) {
+                this->rearrange_masked_output(output, d_x_t, time_steps, steps);
+            } else if constexpr (base_type::time_major) {
+                this->copy_steps(output, d_x_t, time_steps, steps);
+
+                if (steps < time_steps) {
+                    std::fill(output.memory_start() + steps * Batch * sequence_length, output.memory_end(), 0.0f);
+                }
+            } else {
+                for (size_t b = 0; b < Batch; ++b) {
+                    for (size_t t = 0; t < steps; ++t) {
+                        output(b)(this->sequence_step(t, steps)) = d_x_t(t)(b);
+                    }
+
+                    for (size_t t = steps; t < time_steps; ++t) {
+                        output(b)(t) = 0;
+                    }
                 }
             }
         }
@@ -461,8 +433,11 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("lstm:backward_batch");
+        timer.work(cost(etl::dim<0>(context.errors)).backward);
 
         backward_pass(output, context, true);
+
+        context.gradients_ready = true;
     }
 
     /*!
@@ -471,10 +446,14 @@ struct lstm_layer_impl final : base_lstm_layer<lstm_layer_impl<Desc>, Desc> {
      */
     template <typename C>
     void compute_gradients(C& context) const {
-        if constexpr (!C::layer) {
+        // The gradients are computed by the sweep of backward_batch, if any
+        if (!context.gradients_ready) {
             dll::auto_timer timer("lstm:compute_gradients");
+            timer.work(cost(etl::dim<0>(context.errors)).gradients);
             backward_pass(x_t, context, false);
         }
+
+        context.gradients_ready = false;
     }
 };
 
@@ -527,6 +506,8 @@ struct sgd_context<DBN, lstm_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> output;
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> errors;
 
+    bool gradients_ready = false; ///< Indicates if backward_batch already computed the gradients of the current batch
+
     sgd_context(const lstm_layer_impl<Desc>& /* layer */)
             : output(0.0), errors(0.0) {}
 };
@@ -91,6 +91,13 @@ struct rnn_layer_impl final : base_rnn_layer<rnn_layer_impl<Desc>, Desc> {
         return hidden_units * hidden_units + hidden_units * sequence_length + hidden_units;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, input_size(), output_size(), parameters() - hidden_units, hidden_units, time_steps * (sequence_length + hidden_units) * hidden_units);
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -144,12 +151,31 @@ struct rnn_layer_impl final : base_rnn_layer<rnn_layer_impl<Desc>, Desc> {
     template <typename H, typename V>
     void forward_batch(H&& output, const V& x) const {
         dll::auto_timer timer("rnn:forward_batch");
+        timer.work(cost(etl::dim<0>(x)).forward);
 
         cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
 
         base_type::forward_batch_impl(output, x, w, u, b, time_steps, sequence_length, hidden_units);
     }
 
+    /*!
+     * \brief Apply the layer to the given batch of input, using the given
+     * cache instead of the cache of the layer.
+     *
+     * \param x A batch of input
+     * \param output A batch of output that will be filled
+     * \param cache The cache for the intermediate results
+     */
+    template <typename H, typename V>
+    void forward_batch(H&& output, const V& x, typename base_type::inference_cache_t& cache) const {
+        dll::auto_timer timer("rnn:forward_batch");
+        timer.work(cost(etl::dim<0>(x)).forward);
+
+        cpp_assert(etl::dim<0>(output) == etl::dim<0>(x), "The number of samples must be consistent");
+
+        base_type::forward_batch_impl(output, x, w, u, b, cache, time_steps, sequence_length, hidden_units);
+    }
+
     /*!
      * \brief Prepare one empty output for this layer
      * \return an empty ETL matrix suitable to store one output of this layer
@@ -204,8 +230,11 @@ struct rnn_layer_impl final : base_rnn_layer<rnn_layer_impl<Desc>, Desc> {
     template <typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("rnn:backward_batch");
+        timer.work(cost(etl::dim<0>(context.errors)).backward);
 
         base_type::backward_batch_impl(output, context, w, u, time_steps, sequence_length, hidden_units, bptt_steps);
+
+        context.gradients_ready = true;
     }
 
     /*!
@@ -215,6 +244,7 @@ struct rnn_layer_impl final : base_rnn_layer<rnn_layer_impl<Desc>, Desc> {
     template <typename C>
     void compute_gradients(C& context) const {
         dll::auto_timer timer("rnn:compute_gradients");
+        timer.work(cost(etl::dim<0>(context.errors)).gradients);
 
         base_type::compute_gradients_impl(context, w, u, time_steps, sequence_length, hidden_units, bptt_steps);
     }
@@ -270,6 +300,8 @@ struct sgd_context<DBN, rnn_layer_impl<Desc>, L> {
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> output;
     etl::fast_matrix<weight, batch_size, time_steps, hidden_units> errors;
 
+    bool gradients_ready = false; ///< Indicates if backward_batch already computed the gradients of the current batch
+
     sgd_context(const rnn_layer_impl<Desc>& /* layer */)
             : output(0.0), errors(0.0) {}
 };
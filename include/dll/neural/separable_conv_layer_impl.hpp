@@ -0,0 +1,445 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/neural_layer.hpp"
+#include "dll/util/grouped_conv.hpp"
+#include "dll/util/tuning.hpp"
+
+#include "dll/util/epilogue.hpp"
+#include "dll/util/timers.hpp" // for auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Depthwise-separable convolutional layer of neural network.
+ *
+ * Each channel of the input (NC x NV1 x NV2) is convolved, with 'same'
+ * padding, with its own depthwise filter (NW1 x NW2), then the channels are
+ * combined by K pointwise filters (NC). The output of the depthwise
+ * convolution is never stored for the batch, it is consumed sample by sample
+ * by the pointwise product and computed again for the training.
+ */
+template <typename Desc>
+struct separable_conv_layer_impl final : neural_layer<separable_conv_layer_impl<Desc>, Desc> {
+    using desc        = Desc;                            ///< The descriptor of the layer
+    using weight      = typename desc::weight;           ///< The data type of the layer
+    using this_type   = separable_conv_layer_impl<desc>; ///< The type of this layer
+    using base_type   = neural_layer<this_type, desc>;   ///< The base type of the layer
+    using layer_t     = this_type;                       ///< The type of this layer
+    using dyn_layer_t = typename desc::dyn_layer_t;      ///< The type of this layer
+
+    static constexpr size_t NV1 = desc::NV1; ///< The first dimension of the visible units
+    static constexpr size_t NV2 = desc::NV2; ///< The second dimension of the visible units
+    static constexpr size_t NW1 = desc::NW1; ///< The first dimension of the depthwise filters
+    static constexpr size_t NW2 = desc::NW2; ///< The second dimension of the depthwise filters
+    static constexpr size_t NC  = desc::NC;  ///< The number of input channels
+    static constexpr size_t K   = desc::K;   ///< The number of pointwise filters
+
+    static constexpr auto activation_function = desc::activation_function; ///< The activation function
+    static constexpr auto no_bias             = desc::parameters::template contains<dll::no_bias>(); ///< Disable the biases
+
+    using w_initializer = typename desc::w_initializer; ///< The initializer for the weights
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, NC, NV1, NV2>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, K, NV1, NV2>;  ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                   ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                  ///< The type of the output
+
+    using dw_type = etl::fast_matrix<weight, NC, 1, NW1, NW2>; ///< The type of the depthwise filters
+    using pw_type = etl::fast_matrix<weight, K, NC>;           ///< The type of the pointwise filters
+    using b_type  = etl::fast_matrix<weight, K>;               ///< The type of the biases
+
+    //Weights and biases
+    dw_type dw; ///< Depthwise filters
+    pw_type pw; ///< Pointwise filters
+    b_type b;   ///< Hidden biases
+
+    //Backup weights and biases
+    std::unique_ptr<dw_type> bak_dw; ///< Backup depthwise filters
+    std::unique_ptr<pw_type> bak_pw; ///< Backup pointwise filters
+    std::unique_ptr<b_type> bak_b;   ///< Backup Hidden biases
+
+    layer_tuning tuning; ///< The runtime tuning of the kernels (set by the auto-tuner)
+
+    /*!
+     * \brief Initialize a separable conv layer with basic weights.
+     */
+    separable_conv_layer_impl() : base_type() {
+        w_initializer::initialize(dw, input_size(), input_size());
+        w_initializer::initialize(pw, input_size(), output_size());
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    // No copying or moving
+    separable_conv_layer_impl(const separable_conv_layer_impl& rhs) = delete;
+    separable_conv_layer_impl& operator=(const separable_conv_layer_impl& rhs) = delete;
+
+    // No copying or moving
+    separable_conv_layer_impl(const separable_conv_layer_impl&& rhs) = delete;
+    separable_conv_layer_impl& operator=(const separable_conv_layer_impl&& rhs) = delete;
+
+    /*!
+     * \brief Returns the geometry of the depthwise convolution
+     */
+    static constexpr grouped_conv_shape shape() noexcept {
+        return {NC, NV1, NV2, NC, NW1, NW2, NC};
+    }
+
+    /*!
+     * \brief Return the size of the input of this layer
+     * \return The size of the input of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return NC * NV1 * NV2;
+    }
+
+    /*!
+     * \brief Return the size of the output of this layer
+     * \return The size of the output of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return K * NV1 * NV2;
+    }
+
+    /*!
+     * \brief Return the number of trainable parameters of this network.
+     * \return The the number of trainable parameters of this network.
+     */
+    static constexpr size_t parameters() noexcept {
+        return NC * NW1 * NW2 + K * NC;
+    }
+
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, input_size(), output_size(), parameters(), K, parameters() * NV1 * NV2);
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "SeparableConv";
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "SeparableConv (%s)", to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "SeparableConv: %lux%lux%lu -> (%lux%lu, %lux1x1) -> %lux%lux%lu",
+                     NC, NV1, NV2, NW1, NW2, K, K, NV1, NV2);
+        } else {
+            snprintf(buffer, 512, "SeparableConv: %lux%lux%lu -> (%lux%lu, %lux1x1) -> %s -> %lux%lux%lu",
+                     NC, NV1, NV2, NW1, NW2, K, to_string(activation_function).c_str(), K, NV1, NV2);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {K, NV1, NV2};
+    }
+
+    using base_type::forward_batch;
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void forward_batch(H1&& output, const V& v) const {
+        forward_batch_activated<activation_function>(output, v);
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input, with the given
+     * activation function instead of the activation function of the layer.
+     *
+     * \param v A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <function F, typename H1, typename V>
+    void forward_batch_activated(H1&& output, const V& v) const {
+        dll::auto_timer timer("separable_conv:forward_batch");
+        timer.work(cost(etl::dim<0>(v)).forward);
+
+        tuning_scope scope(tuning);
+
+        // The kernels work on the memory of the batch, of any shape
+        if constexpr (etl::is_dma<V>) {
+            separable_conv_forward(output, v, dw, pw, shape());
+        } else {
+            separable_conv_forward(output, etl::force_temporary(v), dw, pw, shape());
+        }
+
+        // The bias and the element-wise activation functions are applied in
+        // a single pass
+        if constexpr (!no_bias && F != function::IDENTITY && F != function::SOFTMAX) {
+            output = f_activate<F>(bias_add_4d(output, b));
+        } else {
+            if constexpr (!no_bias) {
+                output = bias_add_4d(output, b);
+            }
+
+            if constexpr (F != function::IDENTITY) {
+                output = f_activate<F>(output);
+            }
+        }
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DRBM>
+    static void dyn_init(DRBM&){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::auto_timer timer("separable_conv:adapt_errors");
+
+        if constexpr (fused_bias_errors<activation_function, no_bias>) {
+            // The gradients of the biases are computed in the same pass
+            adapt_errors_bias<activation_function, 2>(context);
+        } else if constexpr (activation_function != function::IDENTITY) {
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::auto_timer timer("separable_conv:backward_batch");
+        timer.work(cost(etl::dim<0>(context.errors)).backward);
+
+        tuning_scope scope(tuning);
+
+        separable_conv_backward(output, context.errors, dw, pw, shape());
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::auto_timer timer("separable_conv:compute_gradients");
+        timer.work(cost(etl::dim<0>(context.errors)).gradients);
+
+        tuning_scope scope(tuning);
+
+        auto& dw_grad = std::get<0>(context.up.context)->grad;
+        auto& pw_grad = std::get<1>(context.up.context)->grad;
+
+        separable_conv_gradients(dw_grad, pw_grad, context.input, context.errors, dw, pw, shape());
+
+        if constexpr (!no_bias) {
+            // The gradients of the biases may have been computed with the errors
+            if (context.bias_reduced) {
+                context.bias_reduced = false;
+            } else {
+                std::get<2>(context.up.context)->grad = etl::bias_batch_sum_4d(context.errors);
+            }
+        }
+    }
+
+    /*!
+     * \brief Backup the weights in the secondary weights matrix
+     */
+    void backup_weights() {
+        unique_safe_get(bak_dw) = dw;
+        unique_safe_get(bak_pw) = pw;
+        unique_safe_get(bak_b)  = b;
+    }
+
+    /*!
+     * \brief Restore the weights from the secondary weights matrix
+     */
+    void restore_weights() {
+        dw = *bak_dw;
+        pw = *bak_pw;
+        b  = *bak_b;
+    }
+
+    /*!
+     * \brief Load the weigts into the given stream
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write_all(os, dw);
+        cpp::binary_write_all(os, pw);
+        cpp::binary_write_all(os, b);
+    }
+
+    /*!
+     * \brief Load the weigts from the given stream
+     */
+    void load(std::istream& is) {
+        cpp::binary_load_all(is, dw);
+        cpp::binary_load_all(is, pw);
+        cpp::binary_load_all(is, b);
+    }
+
+    /*!
+     * \brief Load the weigts into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the weigts from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters(){
+        return std::make_tuple(std::ref(dw), std::ref(pw), std::ref(b));
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters() const {
+        return std::make_tuple(std::cref(dw), std::cref(pw), std::cref(b));
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t separable_conv_layer_impl<Desc>::NV1;
+
+template <typename Desc>
+const size_t separable_conv_layer_impl<Desc>::NV2;
+
+template <typename Desc>
+const size_t separable_conv_layer_impl<Desc>::NC;
+
+template <typename Desc>
+const size_t separable_conv_layer_impl<Desc>::NW1;
+
+template <typename Desc>
+const size_t separable_conv_layer_impl<Desc>::NW2;
+
+template <typename Desc>
+const size_t separable_conv_layer_impl<Desc>::K;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<separable_conv_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = false; ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = true;  ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = true;  ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief Specialization of the sgd_context for separable_conv_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, separable_conv_layer_impl<Desc>, L> {
+    using layer_t = separable_conv_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr size_t NV1 = layer_t::NV1;
+    static constexpr size_t NV2 = layer_t::NV2;
+    static constexpr size_t NC  = layer_t::NC;
+    static constexpr size_t K   = layer_t::K;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, NC, NV1, NV2> input;
+    etl::fast_matrix<weight, batch_size, K, NV1, NV2> output;
+    etl::fast_matrix<weight, batch_size, K, NV1, NV2> errors;
+
+    bool bias_reduced = false; ///< Indicates if the gradients of the biases were computed by adapt_errors
+
+    sgd_context(const separable_conv_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0) {}
+};
+
+} //end of dll namespace
@@ -0,0 +1,13 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include "dll/neural/dense_layer.hpp"
+
+#include "dll/neural/tied_dense_layer_impl.hpp"
+#include "dll/neural/tied_dense_layer_desc.hpp"
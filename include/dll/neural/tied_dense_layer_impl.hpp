@@ -0,0 +1,395 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <fstream>
+
+#include "cpp_utils/io.hpp" // For binary writing
+
+#include "dll/base_traits.hpp"
+#include "dll/layer.hpp"
+#include "dll/layer_traits.hpp"
+
+#include "dll/util/timers.hpp" // for auto_timer
+
+namespace dll {
+
+/*!
+ * \brief Dense layer of neural network using the transposed weights of a
+ * previous dense layer of the network (tied weights).
+ *
+ * This is typically the decoder of an autoencoder, tied to its encoder. The
+ * layer only owns its biases. The weights are bound by the network when it
+ * is constructed and are trained with the layer owning them: the gradients
+ * of the two layers are summed into the gradients of the owning layer, so
+ * that a single updater context is used for the shared weights.
+ */
+template <typename Desc>
+struct tied_dense_layer_impl final : layer<tied_dense_layer_impl<Desc>> {
+    using desc        = Desc;                          ///< The descriptor of the layer
+    using weight      = typename desc::weight;         ///< The data type for this layer
+    using this_type   = tied_dense_layer_impl<desc>;   ///< The type of this layer
+    using base_type   = layer<this_type>;              ///< The base type
+    using layer_t     = this_type;                     ///< This layer's type
+    using dyn_layer_t = typename desc::dyn_layer_t;    ///< The dynamic version of this layer
+
+    static constexpr size_t num_visible = desc::num_visible; ///< The number of visible units
+    static constexpr size_t num_hidden  = desc::num_hidden;  ///< The number of hidden units
+    static constexpr size_t tied_layer  = desc::tied_layer;  ///< The index of the layer owning the weights
+
+    static constexpr auto activation_function = desc::activation_function; ///< The layer's activation function
+
+    using b_initializer = typename desc::b_initializer; ///< The initializer for the biases
+
+    using input_one_t  = etl::fast_dyn_matrix<weight, num_visible>; ///< The type of one input
+    using output_one_t = etl::fast_dyn_matrix<weight, num_hidden>;  ///< The type of one output
+    using input_t      = std::vector<input_one_t>;                  ///< The type of the input
+    using output_t     = std::vector<output_one_t>;                 ///< The type of the output
+
+    using w_type = etl::fast_matrix<weight, num_hidden, num_visible>; ///< The type of the tied weights (as stored by the owning layer)
+    using b_type = etl::fast_matrix<weight, num_hidden>;              ///< The type of the biases
+
+    const w_type* w = nullptr; ///< The tied weights, owned by the tied layer
+    b_type b;                  ///< Hidden biases
+
+    std::unique_ptr<b_type> bak_b; ///< Backup Hidden biases
+
+    /*!
+     * \brief Initialize a tied dense layer, the weights are bound later
+     * by the network.
+     */
+    tied_dense_layer_impl() : base_type() {
+        b_initializer::initialize(b, input_size(), output_size());
+    }
+
+    tied_dense_layer_impl(const tied_dense_layer_impl& rhs) = delete;
+    tied_dense_layer_impl(tied_dense_layer_impl&& rhs) = delete;
+
+    tied_dense_layer_impl& operator=(const tied_dense_layer_impl& rhs) = delete;
+    tied_dense_layer_impl& operator=(tied_dense_layer_impl&& rhs) = delete;
+
+    /*!
+     * \brief Bind the weights of the given layer to this layer
+     * \param owner The dense layer owning the weights
+     */
+    template <typename Layer>
+    void tie(const Layer& owner) {
+        static_assert(Layer::num_visible == num_hidden && Layer::num_hidden == num_visible,
+                      "The tied layer must have the transposed dimensions of this layer");
+
+        w = &owner.w;
+    }
+
+    /*!
+     * \brief Returns the input size of this layer
+     */
+    static constexpr size_t input_size() noexcept {
+        return num_visible;
+    }
+
+    /*!
+     * \brief Returns the output size of this layer
+     */
+    static constexpr size_t output_size() noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns the number of parameters of this layer
+     *
+     * The weights are counted by the layer owning them.
+     */
+    static constexpr size_t parameters() noexcept {
+        return num_hidden;
+    }
+
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return weighted_layer_cost(sizeof(weight), batch, num_visible, num_hidden, num_visible * num_hidden, num_hidden, num_visible * num_hidden);
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_short_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            return "Dense (tied)";
+        } else {
+            char buffer[512];
+            snprintf(buffer, 512, "Dense (tied) (%s)", to_string(activation_function).c_str());
+            return {buffer};
+        }
+    }
+
+    /*!
+     * \brief Returns a short description of the layer
+     * \return an std::string containing a short description of the layer
+     */
+    static std::string to_full_string(std::string pre = "") {
+        cpp_unused(pre);
+
+        char buffer[512];
+
+        if constexpr (activation_function == function::IDENTITY) {
+            snprintf(buffer, 512, "Dense (tied to %lu): %lu -> %lu", tied_layer, num_visible, num_hidden);
+        } else {
+            snprintf(buffer, 512, "Dense (tied to %lu): %lu -> %s -> %lu", tied_layer, num_visible, to_string(activation_function).c_str(), num_hidden);
+        }
+
+        return {buffer};
+    }
+
+    /*!
+     * \brief Returns the output shape
+     * \return an std::string containing the description of the output shape
+     */
+    std::vector<size_t> output_shape(const std::vector<size_t>& input_shape) const {
+        cpp_unused(input_shape);
+
+        return {num_hidden};
+    }
+
+    /*!
+     * \brief Apply the layer to the given batch of input.
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H, typename V>
+    void forward_batch(H&& output, const V& input) const {
+        dll::auto_timer timer("tied_dense:forward_batch");
+        timer.work(cost(etl::dim<0>(input)).forward);
+
+        cpp_assert(w, "The weights of the layer have not been tied");
+
+        const auto Batch = etl::dim<0>(input);
+
+        cpp_assert(etl::dim<0>(output) == Batch, "The number of samples must be consistent");
+
+        output = etl::reshape(input, Batch, num_visible) * etl::transpose(*w);
+
+        // The bias and the element-wise activation functions are applied in
+        // a single pass
+        if constexpr (activation_function != function::IDENTITY && activation_function != function::SOFTMAX) {
+            output = f_activate<activation_function>(bias_add_2d(output, b));
+        } else {
+            output = bias_add_2d(output, b);
+
+            if constexpr (activation_function != function::IDENTITY) {
+                output = f_activate<activation_function>(output);
+            }
+        }
+    }
+
+    /*!
+     * \brief Prepare one empty output for this layer
+     * \return an empty ETL matrix suitable to store one output of this layer
+     *
+     * \tparam Input The type of one Input
+     */
+    template <typename Input>
+    output_one_t prepare_one_output() const {
+        return {};
+    }
+
+    /*!
+     * \brief Prepare a set of empty outputs for this layer
+     * \param samples The number of samples to prepare the output for
+     * \return a container containing empty ETL matrices suitable to store samples output of this layer
+     * \tparam Input The type of one input
+     */
+    template <typename Input>
+    static output_t prepare_output(size_t samples) {
+        return output_t{samples};
+    }
+
+    /*!
+     * \brief Initialize the dynamic version of the layer from the
+     * fast version of the layer
+     * \param dyn Reference to the dynamic version of the layer that
+     * needs to be initialized
+     */
+    template<typename DLayer>
+    static void dyn_init(DLayer&){
+        //Nothing to change
+    }
+
+    /*!
+     * \brief Adapt the errors, called before backpropagation of the errors.
+     *
+     * This must be used by layers that have both an activation fnction and a non-linearity.
+     *
+     * \param context the training context
+     */
+    template<typename C>
+    void adapt_errors(C& context) const {
+        dll::unsafe_auto_timer timer("tied_dense:adapt_errors");
+
+        if constexpr (activation_function != function::IDENTITY) {
+            context.errors = f_derivative<activation_function>(context.output) >> context.errors;
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors to the previous layers
+     *
+     * The gradients of the tied weights are computed here, since they must
+     * be summed into the gradients of the owning layer, which are computed
+     * after this layer has been back-propagated.
+     *
+     * \param output The ETL expression into which write the output
+     * \param context The training context
+     */
+    template<typename H, typename C>
+    void backward_batch(H&& output, C& context) const {
+        dll::unsafe_auto_timer timer("tied_dense:backward_batch");
+        timer.work(cost(etl::dim<0>(context.errors)).backward);
+
+        // The reshape has no overhead, so better than SFINAE for nothing
+        constexpr auto Batch = etl::decay_traits<decltype(context.errors)>::template dim<0>();
+        etl::reshape<Batch, num_visible>(output) = context.errors * *w;
+
+        context.tied_gradients = batch_outer(context.errors, context.input);
+    }
+
+    /*!
+     * \brief Compute the gradients for this layer, if any
+     * \param context The trainng context
+     */
+    template<typename C>
+    void compute_gradients(C& context) const {
+        dll::unsafe_auto_timer timer("tied_dense:compute_gradients");
+
+        std::get<0>(context.up.context)->grad = bias_batch_sum_2d(context.errors);
+    }
+
+    /*!
+     * \brief Backup the weights in the secondary weights matrix
+     */
+    void backup_weights() {
+        unique_safe_get(bak_b) = b;
+    }
+
+    /*!
+     * \brief Restore the weights from the secondary weights matrix
+     */
+    void restore_weights() {
+        b = *bak_b;
+    }
+
+    /*!
+     * \brief Store the biases into the given stream (the weights are
+     * stored by the owning layer)
+     */
+    void store(std::ostream& os) const {
+        cpp::binary_write_all(os, b);
+    }
+
+    /*!
+     * \brief Load the biases from the given stream (the weights are
+     * loaded by the owning layer)
+     */
+    void load(std::istream& is) {
+        cpp::binary_load_all(is, b);
+    }
+
+    /*!
+     * \brief Store the biases into the given file
+     */
+    void store(const std::string& file) const {
+        std::ofstream os(file, std::ofstream::binary);
+        store(os);
+    }
+
+    /*!
+     * \brief Load the biases from the given file
+     */
+    void load(const std::string& file) {
+        std::ifstream is(file, std::ifstream::binary);
+        load(is);
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer, only the
+     * biases, the weights are trained by the owning layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters(){
+        return std::make_tuple(std::ref(b));
+    }
+
+    /*!
+     * \brief Returns the trainable variables of this layer, only the
+     * biases, the weights are trained by the owning layer.
+     * \return a tuple containing references to the variables of this layer
+     */
+    decltype(auto) trainable_parameters() const {
+        return std::make_tuple(std::cref(b));
+    }
+};
+
+//Allow odr-use of the constexpr static members
+
+template <typename Desc>
+const size_t tied_dense_layer_impl<Desc>::num_visible;
+
+template <typename Desc>
+const size_t tied_dense_layer_impl<Desc>::num_hidden;
+
+template <typename Desc>
+const size_t tied_dense_layer_impl<Desc>::tied_layer;
+
+// Declare the traits for the Layer
+
+template<typename Desc>
+struct layer_base_traits<tied_dense_layer_impl<Desc>> {
+    static constexpr bool is_neural     = true;  ///< Indicates if the layer is a neural layer
+    static constexpr bool is_dense      = true;  ///< Indicates if the layer is dense
+    static constexpr bool is_conv       = false; ///< Indicates if the layer is convolutional
+    static constexpr bool is_deconv     = false; ///< Indicates if the layer is deconvolutional
+    static constexpr bool is_standard   = false; ///< Indicates if the layer is standard
+    static constexpr bool is_rbm        = false; ///< Indicates if the layer is RBM
+    static constexpr bool is_pooling    = false; ///< Indicates if the layer is a pooling layer
+    static constexpr bool is_unpooling  = false; ///< Indicates if the layer is an unpooling laye
+    static constexpr bool is_transform  = false; ///< Indicates if the layer is a transform layer
+    static constexpr bool is_recurrent  = false; ///< Indicates if the layer is a recurrent layer
+    static constexpr bool is_multi      = false; ///< Indicates if the layer is a multi-layer layer
+    static constexpr bool is_dynamic    = false; ///< Indicates if the layer is dynamic
+    static constexpr bool pretrain_last = false; ///< Indicates if the layer is dynamic
+    static constexpr bool sgd_supported = true;  ///< Indicates if the layer is supported by SGD
+};
+
+/*!
+ * \brief specialization of sgd_context for tied_dense_layer_impl
+ */
+template <typename DBN, typename Desc, size_t L>
+struct sgd_context<DBN, tied_dense_layer_impl<Desc>, L> {
+    using layer_t = tied_dense_layer_impl<Desc>;
+    using weight  = typename layer_t::weight; ///< The data type for this layer
+
+    static constexpr auto num_visible = layer_t::num_visible;
+    static constexpr auto num_hidden  = layer_t::num_hidden;
+
+    static constexpr auto batch_size = DBN::batch_size;
+
+    etl::fast_matrix<weight, batch_size, num_visible> input;
+    etl::fast_matrix<weight, batch_size, num_hidden> output;
+    etl::fast_matrix<weight, batch_size, num_hidden> errors;
+
+    etl::fast_matrix<weight, num_hidden, num_visible> tied_gradients; ///< The gradients of the tied weights, summed by the owning layer
+
+    sgd_context(const tied_dense_layer_impl<Desc>& /* layer */)
+            : output(0.0), errors(0.0), tied_gradients(0.0) {}
+};
+
+} //end of dll namespace
@@ -16,6 +16,7 @@
 
 #include "layer.hpp"
 #include "util/tmp.hpp"
+#include "util/winograd_conv.hpp"
 #include "layer_traits.hpp"
 
 namespace dll {
@@ -58,6 +59,8 @@ struct neural_layer : layer<Derived> {
     void restore_weights() {
         as_derived().w = *as_derived().bak_w;
         as_derived().b = *as_derived().bak_b;
+
+        dll::invalidate_transforms(as_derived());
     }
 
     /*!
@@ -74,6 +77,8 @@ struct neural_layer : layer<Derived> {
     void load(std::istream& is) {
         cpp::binary_load_all(is, as_derived().w);
         cpp::binary_load_all(is, as_derived().b);
+
+        dll::invalidate_transforms(as_derived());
     }
 
     /*!
@@ -13,6 +13,13 @@
 #include "dbn_traits.hpp"
 
 #ifndef DLL_DETAIL_ONLY
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
 #include <opencv2/opencv.hpp>
 #endif
 
@@ -126,6 +133,160 @@ constexpr inline size_t best_width(const size_t total) {
 
 #ifndef DLL_DETAIL_ONLY
 
+/*!
+ * \brief Renders and displays the frames of a visualizer on its own thread.
+ *
+ * The training thread only copies the data of a frame (the weights) and
+ * submits it. The frames are double-buffered: the display thread renders
+ * the last submitted frame into its own image while the next one is being
+ * submitted, the frames that were not displayed in time being dropped. The
+ * frames are displayed at most at the given frame rate.
+ *
+ * Note: Some HighGUI backends (Cocoa) only support the main thread.
+ */
+struct ocv_renderer {
+    using frame_t = std::function<void(cv::Mat&)>; ///< The renderer of a frame
+
+    const std::string window;               ///< The name of the window
+    const std::chrono::milliseconds period; ///< The minimum time between two frames
+
+    /*!
+     * \brief Create a renderer, the display thread is started with the
+     * first frame
+     * \param window The name of the window
+     * \param fps The maximum frame rate
+     */
+    explicit ocv_renderer(std::string window, size_t fps = 10)
+            : window(std::move(window)), period(1000 / std::max(fps, size_t(1))) {
+        //Nothing to init
+    }
+
+    ocv_renderer(const ocv_renderer&) = delete;
+    ocv_renderer& operator=(const ocv_renderer&) = delete;
+
+    /*!
+     * \brief Display the last frame and stop the display thread
+     */
+    ~ocv_renderer() {
+        stop();
+    }
+
+    /*!
+     * \brief Indicates if a new frame would be displayed, so that the data
+     * of the frames are only copied at the frame rate
+     */
+    bool due() const {
+        return std::chrono::steady_clock::now() - last_submit >= period;
+    }
+
+    /*!
+     * \brief Submit a new frame, replacing the frame not yet displayed
+     * \param frame The renderer of the frame
+     */
+    void submit(frame_t frame) {
+        start();
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            pending = std::move(frame);
+        }
+
+        last_submit = std::chrono::steady_clock::now();
+    }
+
+    /*!
+     * \brief Display the last frame and wait for a key to be pressed in the
+     * window
+     */
+    void wait_key() {
+        start();
+
+        std::unique_lock<std::mutex> l(lock);
+
+        waiting = true;
+        condition.wait(l, [this] { return !waiting; });
+    }
+
+    /*!
+     * \brief Display the last frame and stop the display thread
+     */
+    void stop() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                done = true;
+            }
+
+            thread.join();
+        }
+    }
+
+private:
+    /*!
+     * \brief Start the display thread, if necessary
+     */
+    void start() {
+        if (!thread.joinable()) {
+            done   = false;
+            thread = std::thread([this] { run(); });
+        }
+    }
+
+    /*!
+     * \brief The loop of the display thread
+     */
+    void run() {
+        cv::namedWindow(window, cv::WINDOW_NORMAL);
+
+        while (true) {
+            frame_t frame;
+            bool key;
+            bool last;
+
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                std::swap(frame, pending);
+                key  = waiting;
+                last = done;
+            }
+
+            if (frame) {
+                frame(image);
+                cv::imshow(window, image);
+            }
+
+            if (key) {
+                cv::waitKey(0);
+
+                {
+                    std::lock_guard<std::mutex> l(lock);
+                    waiting = false;
+                }
+
+                condition.notify_all();
+            } else if (last) {
+                break;
+            } else if (image.empty()) {
+                std::this_thread::sleep_for(period);
+            } else {
+                // Also processes the events of the window
+                cv::waitKey(std::max(int(period.count()), 1));
+            }
+        }
+    }
+
+    std::mutex lock;                    ///< The lock of the pending frame
+    std::condition_variable condition;  ///< Signals the end of wait_key
+    frame_t pending;                    ///< The last submitted frame (back buffer)
+    cv::Mat image;                      ///< The displayed image (front buffer), only used by the display thread
+    bool waiting = false;               ///< Indicates that a key is waited for
+    bool done    = false;               ///< Indicates that the display thread must stop
+    std::thread thread;                 ///< The display thread
+
+    std::chrono::steady_clock::time_point last_submit; ///< The time of the last submitted frame
+};
+
 /*!
  * \brief The base type for an OpenCV visualizer
  */
@@ -136,7 +297,11 @@ struct base_ocv_rbm_visualizer {
     const size_t width;  ///< The width of the view
     const size_t height; ///< The height of the view
 
-    cv::Mat buffer_image; ///< The OpenCV buffer image
+    cv::Mat buffer_image; ///< The OpenCV buffer image (of visualize_rbm)
+
+    size_t epoch = 0; ///< The current epoch
+
+    ocv_renderer display{"RBM Training"}; ///< The display of the weights
 
     /*!
      * \brief Initialize the base_ocv_rbm_visualizer
@@ -175,10 +340,6 @@ struct base_ocv_rbm_visualizer {
         } else if (rbm_layer_traits<RBM>::sparsity_method() == sparsity_method::LOCAL_TARGET) {
             std::cout << "   sparsity_target(Local)=" << rbm.sparsity_target << std::endl;
         }
-
-        cv::namedWindow("RBM Training", cv::WINDOW_NORMAL);
-
-        refresh();
     }
 
     /*!
@@ -189,7 +350,7 @@ struct base_ocv_rbm_visualizer {
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window..." << std::endl;
-        cv::waitKey(0);
+        display.wait_key();
 
         cpp_unused(rbm);
     }
@@ -209,7 +370,7 @@ struct base_ocv_rbm_visualizer {
     }
 
     /*!
-     * \brief Refresh the view
+     * \brief Refresh the view with the buffer image (on the calling thread)
      */
     void refresh() {
         cv::imshow("RBM Training", buffer_image);
@@ -247,6 +408,8 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
 
     using base_type = base_ocv_rbm_visualizer<RBM>;
     using base_type::buffer_image;
+    using base_type::display;
+    using base_type::epoch;
     using base_type::refresh;
 
     opencv_rbm_visualizer()
@@ -254,7 +417,11 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                   filter_shape.width * tile_shape.width + (tile_shape.height + 1) * 1 + 2 * padding,
                   filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding) {}
 
-    void draw_weights(const RBM& rbm) {
+    /*!
+     * \brief Draw the given weights into the given image
+     */
+    template <typename W>
+    static void draw_weights(cv::Mat& image, const W& w) {
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
             for (size_t hj = 0; hj < tile_shape.height; ++hj) {
                 auto real_h = hi * tile_shape.height + hj;
@@ -267,8 +434,8 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                 typename RBM::weight max;
 
                 if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
+                    min = etl::min(w);
+                    max = etl::max(w);
                 }
 
                 for (size_t i = 0; i < filter_shape.width; ++i) {
@@ -279,14 +446,14 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
                             break;
                         }
 
-                        auto value = rbm.w(real_v, real_h);
+                        auto value = w(real_v, real_h);
 
                         if (scale) {
                             value -= min;
                             value *= 1.0 / (max + 1e-8);
                         }
 
-                        buffer_image.template at<uint8_t>(
+                        image.template at<uint8_t>(
                             padding + 1 + hi * (filter_shape.height + 1) + i,
                             padding + 1 + hj * (filter_shape.width + 1) + j) = value * 255;
                     }
@@ -295,6 +462,43 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
         }
     }
 
+    /*!
+     * \brief Draw the weights of the given RBM into the buffer image
+     */
+    void draw_weights(const RBM& rbm) {
+        draw_weights(buffer_image, rbm.w);
+    }
+
+    /*!
+     * \brief Display a snapshot of the weights of the given RBM, rendered on
+     * the display thread
+     */
+    void show(const std::string& label, const RBM& rbm) {
+        display.submit([size = buffer_image.size(), label, w = rbm.w](cv::Mat& image) {
+            image.create(size, CV_8UC1);
+            image = cv::Scalar(255);
+
+            cv::putText(image, label, cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+
+            draw_weights(image, w);
+        });
+    }
+
+    /*!
+     * \brief Indicates the end of a pretraining batch
+     * \param rbm The RBM being trained
+     * \param context The training context
+     * \param batch The batch that ended
+     * \param batches The total number of batches
+     */
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
+        base_type::batch_end(rbm, context, batch, batches);
+
+        if (display.due()) {
+            show("epoch " + std::to_string(epoch) + " batch " + std::to_string(batch), rbm);
+        }
+    }
+
     /*!
      * \brief Indicates the end of an epoch of pretraining.
      * \param epoch The epoch that just finished training
@@ -305,13 +509,9 @@ struct opencv_rbm_visualizer : base_ocv_rbm_visualizer<RBM> {
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
-        buffer_image = cv::Scalar(255);
-
-        cv::putText(buffer_image, "epoch " + std::to_string(epoch), cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+        this->epoch = epoch + 1;
 
-        draw_weights(rbm);
-
-        refresh();
+        show("epoch " + std::to_string(epoch), rbm);
     }
 };
 
@@ -334,6 +534,8 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
 
     using base_type = base_ocv_rbm_visualizer<RBM>;
     using base_type::buffer_image;
+    using base_type::display;
+    using base_type::epoch;
     using base_type::refresh;
 
     opencv_rbm_visualizer()
@@ -341,7 +543,11 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
                   filter_shape.width * tile_shape.width + (tile_shape.height + 1) * 1 + 2 * padding,
                   filter_shape.height * tile_shape.height + (tile_shape.height + 1) * 1 + 2 * padding) {}
 
-    void draw_weights(const RBM& rbm) {
+    /*!
+     * \brief Draw the given weights into the given image
+     */
+    template <typename W>
+    static void draw_weights(cv::Mat& image, const W& w) {
         size_t channel = 0;
 
         for (size_t hi = 0; hi < tile_shape.width; ++hi) {
@@ -356,20 +562,20 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
                 typename RBM::weight max;
 
                 if (scale) {
-                    min = etl::min(rbm.w(channel)(real_k));
-                    max = etl::max(rbm.w(channel)(real_k));
+                    min = etl::min(w(channel)(real_k));
+                    max = etl::max(w(channel)(real_k));
                 }
 
                 for (size_t fi = 0; fi < filter_shape.width; ++fi) {
                     for (size_t fj = 0; fj < filter_shape.height; ++fj) {
-                        auto value = rbm.w(channel, real_k, fi, fj);
+                        auto value = w(channel, real_k, fi, fj);
 
                         if (scale) {
                             value -= min;
                             value *= 1.0 / (max + 1e-8);
                         }
 
-                        buffer_image.template at<uint8_t>(
+                        image.template at<uint8_t>(
                             padding + 1 + hi * (filter_shape.width + 1) + fi,
                             padding + 1 + hj * (filter_shape.height + 1) + fj) = value * 255;
                     }
@@ -378,6 +584,43 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
         }
     }
 
+    /*!
+     * \brief Draw the weights of the given RBM into the buffer image
+     */
+    void draw_weights(const RBM& rbm) {
+        draw_weights(buffer_image, rbm.w);
+    }
+
+    /*!
+     * \brief Display a snapshot of the weights of the given RBM, rendered on
+     * the display thread
+     */
+    void show(const std::string& label, const RBM& rbm) {
+        display.submit([size = buffer_image.size(), label, w = rbm.w](cv::Mat& image) {
+            image.create(size, CV_8UC1);
+            image = cv::Scalar(255);
+
+            cv::putText(image, label, cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+
+            draw_weights(image, w);
+        });
+    }
+
+    /*!
+     * \brief Indicates the end of a pretraining batch
+     * \param rbm The RBM being trained
+     * \param context The training context
+     * \param batch The batch that ended
+     * \param batches The total number of batches
+     */
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
+        base_type::batch_end(rbm, context, batch, batches);
+
+        if (display.due()) {
+            show("epoch " + std::to_string(epoch) + " batch " + std::to_string(batch), rbm);
+        }
+    }
+
     /*!
      * \brief Indicates the end of an epoch of pretraining.
      * \param epoch The epoch that just finished training
@@ -388,13 +631,9 @@ struct opencv_rbm_visualizer<RBM, C, std::enable_if_t<layer_traits<RBM>::is_conv
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
-        buffer_image = cv::Scalar(255);
-
-        cv::putText(buffer_image, "epoch " + std::to_string(epoch), cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+        this->epoch = epoch + 1;
 
-        draw_weights(rbm);
-
-        refresh();
+        show("epoch " + std::to_string(epoch), rbm);
     }
 };
 
@@ -410,6 +649,10 @@ struct opencv_dbn_visualizer {
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    size_t epoch = 0; ///< The current epoch of the layer being trained
+
+    ocv_renderer display{"DBN Training"}; ///< The display of the weights
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -423,8 +666,6 @@ struct opencv_dbn_visualizer {
         cpp_unused(dbn);
 
         std::cout << "DBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
-
-        cv::namedWindow("DBN Training", cv::WINDOW_NORMAL);
     }
 
     /*!
@@ -491,7 +732,7 @@ struct opencv_dbn_visualizer {
             std::cout << "   sparsity_target=" << rbm.sparsity_target << std::endl;
         }
 
-        refresh();
+        epoch = 0;
     }
 
     /*!
@@ -505,6 +746,19 @@ struct opencv_dbn_visualizer {
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
+        this->epoch = epoch + 1;
+
+        show("layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch), rbm);
+    }
+
+    /*!
+     * \brief Display a snapshot of the weights of the given RBM, rendered on
+     * the display thread
+     * \param label The label of the view
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM>
+    void show(const std::string& label, const RBM& rbm) {
         using rbm_t = RBM;
 
         static constexpr detail::shape filter_shape{
@@ -516,67 +770,68 @@ struct opencv_dbn_visualizer {
         static constexpr auto scale   = C::scale;
         static constexpr auto padding = C::padding;
 
-        auto& buffer_image = buffer_images[current_image];
+        display.submit([=, size = buffer_images[current_image].size(), w = rbm.w](cv::Mat& buffer_image) {
+            buffer_image.create(size, CV_8UC1);
+            buffer_image = cv::Scalar(255);
 
-        buffer_image = cv::Scalar(255);
+            cv::putText(buffer_image, label, cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        cv::putText(buffer_image,
-                    "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
-                    cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+            for (size_t hi = 0; hi < tile_shape.width; ++hi) {
+                for (size_t hj = 0; hj < tile_shape.height; ++hj) {
+                    auto real_h = hi * tile_shape.height + hj;
 
-        for (size_t hi = 0; hi < tile_shape.width; ++hi) {
-            for (size_t hj = 0; hj < tile_shape.height; ++hj) {
-                auto real_h = hi * tile_shape.height + hj;
+                    if (real_h >= rbm_t::num_hidden) {
+                        break;
+                    }
 
-                if (real_h >= rbm_t::num_hidden) {
-                    break;
-                }
+                    typename RBM::weight min;
+                    typename RBM::weight max;
 
-                typename RBM::weight min;
-                typename RBM::weight max;
+                    if (scale) {
+                        min = etl::min(w);
+                        max = etl::max(w);
+                    }
 
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
+                    for (size_t i = 0; i < filter_shape.width; ++i) {
+                        for (size_t j = 0; j < filter_shape.height; ++j) {
+                            auto real_v = i * filter_shape.height + j;
 
-                for (size_t i = 0; i < filter_shape.width; ++i) {
-                    for (size_t j = 0; j < filter_shape.height; ++j) {
-                        auto real_v = i * filter_shape.height + j;
+                            if (real_v >= rbm_t::num_visible) {
+                                break;
+                            }
 
-                        if (real_v >= rbm_t::num_visible) {
-                            break;
-                        }
+                            auto value = w(real_v, real_h);
 
-                        auto value = rbm.w(real_v, real_h);
+                            if (scale) {
+                                value -= min;
+                                value *= 1.0 / (max + 1e-8);
+                            }
 
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
+                            buffer_image.template at<uint8_t>(
+                                padding + 1 + hi * (filter_shape.width + 1) + i,
+                                padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
                         }
-
-                        buffer_image.template at<uint8_t>(
-                            padding + 1 + hi * (filter_shape.width + 1) + i,
-                            padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
                     }
                 }
             }
-        }
-
-        refresh();
+        });
     }
 
     /*!
      * \brief Indicates the end of a pretraining batch
-     * \param rbm The RBM stopped training
+     * \param rbm The RBM being trained
      * \param context The training context
      * \param batch The batch that ended
      * \param batches The total number of batches
      */
     template <typename RBM>
-    void batch_end(const RBM& /* rbm */, const rbm_training_context& context, size_t batch, size_t batches) {
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
         printf("Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f\n", batch, batches,
                context.batch_error, context.batch_sparsity);
+
+        if (display.due()) {
+            show("layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch) + " batch " + std::to_string(batch), rbm);
+        }
     }
 
     /*!
@@ -588,7 +843,7 @@ struct opencv_dbn_visualizer {
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        display.wait_key();
     }
 
     /*!
@@ -647,17 +902,7 @@ struct opencv_dbn_visualizer {
         std::cout << "Total training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window" << std::endl;
-        cv::waitKey(0);
-    }
-
-    //Utility functions
-
-    /*!
-     * \brief Refresh the view
-     */
-    void refresh() {
-        cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
+        display.wait_key();
     }
 };
 
@@ -679,6 +924,10 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    size_t epoch = 0; ///< The current epoch of the layer being trained
+
+    ocv_renderer display{"DBN Training"}; ///< The display of the weights
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -692,8 +941,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
     void pretraining_begin(const DBN& dbn, size_t max_epochs) {
         std::cout << "DBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("DBN Training", cv::WINDOW_NORMAL);
-
         cpp_unused(dbn);
     }
 
@@ -753,7 +1000,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
             std::cout << "   sparsity_target=" << rbm.sparsity_target << std::endl;
         }
 
-        refresh();
+        epoch = 0;
     }
 
     template <typename RBM>
@@ -761,6 +1008,19 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
+        this->epoch = epoch + 1;
+
+        show("layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch), rbm);
+    }
+
+    /*!
+     * \brief Display a snapshot of the weights of the given RBM, rendered on
+     * the display thread
+     * \param label The label of the view
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM>
+    void show(const std::string& label, const RBM& rbm) {
         auto visible = input_size(rbm);
         auto hidden  = output_size(rbm);
 
@@ -770,67 +1030,68 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
         static constexpr auto scale   = C::scale;
         static constexpr auto padding = C::padding;
 
-        auto& buffer_image = buffer_images[current_image];
+        display.submit([=, size = buffer_images[current_image].size(), w = rbm.w](cv::Mat& buffer_image) {
+            buffer_image.create(size, CV_8UC1);
+            buffer_image = cv::Scalar(255);
 
-        buffer_image = cv::Scalar(255);
+            cv::putText(buffer_image, label, cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        cv::putText(buffer_image,
-                    "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
-                    cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+            for (size_t hi = 0; hi < tile_shape.width; ++hi) {
+                for (size_t hj = 0; hj < tile_shape.height; ++hj) {
+                    auto real_h = hi * tile_shape.height + hj;
 
-        for (size_t hi = 0; hi < tile_shape.width; ++hi) {
-            for (size_t hj = 0; hj < tile_shape.height; ++hj) {
-                auto real_h = hi * tile_shape.height + hj;
+                    if (real_h >= hidden) {
+                        break;
+                    }
 
-                if (real_h >= hidden) {
-                    break;
-                }
+                    typename RBM::weight min;
+                    typename RBM::weight max;
 
-                typename RBM::weight min;
-                typename RBM::weight max;
+                    if (scale) {
+                        min = etl::min(w);
+                        max = etl::max(w);
+                    }
 
-                if (scale) {
-                    min = etl::min(rbm.w);
-                    max = etl::max(rbm.w);
-                }
+                    for (size_t i = 0; i < filter_shape.width; ++i) {
+                        for (size_t j = 0; j < filter_shape.height; ++j) {
+                            auto real_v = i * filter_shape.height + j;
 
-                for (size_t i = 0; i < filter_shape.width; ++i) {
-                    for (size_t j = 0; j < filter_shape.height; ++j) {
-                        auto real_v = i * filter_shape.height + j;
+                            if (real_v >= visible) {
+                                break;
+                            }
 
-                        if (real_v >= visible) {
-                            break;
-                        }
+                            auto value = w(real_v, real_h);
 
-                        auto value = rbm.w(real_v, real_h);
+                            if (scale) {
+                                value -= min;
+                                value *= 1.0 / (max + 1e-8);
+                            }
 
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
+                            buffer_image.template at<uint8_t>(
+                                padding + 1 + hi * (filter_shape.width + 1) + i,
+                                padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
                         }
-
-                        buffer_image.template at<uint8_t>(
-                            padding + 1 + hi * (filter_shape.width + 1) + i,
-                            padding + 1 + hj * (filter_shape.height + 1) + j) = value * 255;
                     }
                 }
             }
-        }
-
-        refresh();
+        });
     }
 
     /*!
      * \brief Indicates the end of a pretraining batch
-     * \param rbm The RBM stopped training
+     * \param rbm The RBM being trained
      * \param context The training context
      * \param batch The batch that ended
      * \param batches The total number of batches
      */
     template <typename RBM>
-    void batch_end(const RBM& /* rbm */, const rbm_training_context& context, size_t batch, size_t batches) {
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
         printf("Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f\n", batch, batches,
                context.batch_error, context.batch_sparsity);
+
+        if (display.due()) {
+            show("layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch) + " batch " + std::to_string(batch), rbm);
+        }
     }
 
     /*!
@@ -842,7 +1103,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        display.wait_key();
     }
 
     /*!
@@ -860,16 +1121,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_dynami
 
         cpp_unused(dbn);
     }
-
-    //Utility functions
-
-    /*!
-     * \brief Refresh the view
-     */
-    void refresh() {
-        cv::imshow("DBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
-    }
 };
 
 template <typename DBN, typename C>
@@ -890,6 +1141,10 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     static std::vector<cv::Mat> buffer_images; ///< The buffer images
     static size_t current_image;               ///< The current images
 
+    size_t epoch = 0; ///< The current epoch of the layer being trained
+
+    ocv_renderer display{"CDBN Training"}; ///< The display of the weights
+
     opencv_dbn_visualizer() = default;
 
     //Pretraining phase
@@ -903,8 +1158,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     void pretraining_begin(const DBN& dbn, size_t max_epochs) {
         std::cout << "CDBN: Pretraining begin for " << max_epochs << " epochs" << std::endl;
 
-        cv::namedWindow("CDBN Training", cv::WINDOW_NORMAL);
-
         cpp_unused(dbn);
     }
 
@@ -968,7 +1221,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
             std::cout << "   sparsity_target=" << rbm.sparsity_target << std::endl;
         }
 
-        refresh();
+        epoch = 0;
     }
 
     template <typename RBM>
@@ -976,6 +1229,19 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
         printf("epoch %ld - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n", epoch,
                context.reconstruction_error, context.free_energy, context.sparsity);
 
+        this->epoch = epoch + 1;
+
+        show("layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch), rbm);
+    }
+
+    /*!
+     * \brief Display a snapshot of the weights of the given RBM, rendered on
+     * the display thread
+     * \param label The label of the view
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM>
+    void show(const std::string& label, const RBM& rbm) {
         using rbm_t = RBM;
 
         static constexpr detail::shape filter_shape{rbm_t::NW1, rbm_t::NW2};
@@ -984,63 +1250,64 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
         static constexpr auto scale   = C::scale;
         static constexpr auto padding = C::padding;
 
-        auto& buffer_image = buffer_images[current_image];
+        display.submit([=, size = buffer_images[current_image].size(), w = rbm.w](cv::Mat& buffer_image) {
+            buffer_image.create(size, CV_8UC1);
+            buffer_image = cv::Scalar(255);
 
-        buffer_image = cv::Scalar(255);
+            cv::putText(buffer_image, label, cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
 
-        cv::putText(buffer_image,
-                    "layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch),
-                    cv::Point(10, 12), CV_FONT_NORMAL, 0.3, cv::Scalar(0), 1, 2);
+            size_t channel = 0;
 
-        size_t channel = 0;
+            for (size_t hi = 0; hi < tile_shape.width; ++hi) {
+                for (size_t hj = 0; hj < tile_shape.height; ++hj) {
+                    auto real_k = hi * tile_shape.height + hj;
 
-        for (size_t hi = 0; hi < tile_shape.width; ++hi) {
-            for (size_t hj = 0; hj < tile_shape.height; ++hj) {
-                auto real_k = hi * tile_shape.height + hj;
+                    if (real_k >= rbm_t::K) {
+                        break;
+                    }
 
-                if (real_k >= rbm_t::K) {
-                    break;
-                }
+                    typename RBM::weight min;
+                    typename RBM::weight max;
 
-                typename RBM::weight min;
-                typename RBM::weight max;
+                    if (scale) {
+                        min = etl::min(w(channel)(real_k));
+                        max = etl::max(w(channel)(real_k));
+                    }
 
-                if (scale) {
-                    min = etl::min(rbm.w(channel)(real_k));
-                    max = etl::max(rbm.w(channel)(real_k));
-                }
+                    for (size_t fi = 0; fi < filter_shape.width; ++fi) {
+                        for (size_t fj = 0; fj < filter_shape.height; ++fj) {
+                            auto value = w(channel, real_k, fi, fj);
 
-                for (size_t fi = 0; fi < filter_shape.width; ++fi) {
-                    for (size_t fj = 0; fj < filter_shape.height; ++fj) {
-                        auto value = rbm.w(channel, real_k, fi, fj);
+                            if (scale) {
+                                value -= min;
+                                value *= 1.0 / (max + 1e-8);
+                            }
 
-                        if (scale) {
-                            value -= min;
-                            value *= 1.0 / (max + 1e-8);
+                            buffer_image.template at<uint8_t>(
+                                padding + 1 + hi * (filter_shape.width + 1) + fi,
+                                padding + 1 + hj * (filter_shape.height + 1) + fj) = value * 255;
                         }
-
-                        buffer_image.template at<uint8_t>(
-                            padding + 1 + hi * (filter_shape.width + 1) + fi,
-                            padding + 1 + hj * (filter_shape.height + 1) + fj) = value * 255;
                     }
                 }
             }
-        }
-
-        refresh();
+        });
     }
 
     /*!
      * \brief Indicates the end of a pretraining batch
-     * \param rbm The RBM stopped training
+     * \param rbm The RBM being trained
      * \param context The training context
      * \param batch The batch that ended
      * \param batches The total number of batches
      */
     template <typename RBM>
-    void batch_end(const RBM& /* rbm */, const rbm_training_context& context, size_t batch, size_t batches) {
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
         printf("Batch %ld/%ld - Reconstruction error: %.5f - Sparsity: %.5f\n", batch, batches,
                context.batch_error, context.batch_sparsity);
+
+        if (display.due()) {
+            show("layer: " + std::to_string(current_image) + " epoch " + std::to_string(epoch) + " batch " + std::to_string(batch), rbm);
+        }
     }
 
     /*!
@@ -1052,7 +1319,7 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
         std::cout << "Training took " << watch.elapsed() << "s" << std::endl;
 
         std::cout << "Press on any key to close the window and continue training..." << std::endl;
-        cv::waitKey(0);
+        display.wait_key();
     }
 
     /*!
@@ -1061,13 +1328,6 @@ struct opencv_dbn_visualizer<DBN, C, std::enable_if_t<dbn_traits<DBN>::is_convol
     void pretraining_end(const DBN& /*dbn*/) {
         std::cout << "CDBN: Pretraining end" << std::endl;
     }
-
-    //Utility functions
-
-    void refresh() {
-        cv::imshow("CDBN Training", buffer_images[current_image]);
-        cv::waitKey(30);
-    }
 };
 
 template <typename DBN, typename C>
@@ -0,0 +1,219 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Parallel Tempering training of fully-connected RBM
+ *
+ * Several persistent chains are run at different temperatures, each on its
+ * own thread. After the Gibbs steps, the states of neighbouring chains are
+ * swapped with the Metropolis criterion. The chains at high temperature mix
+ * quickly and their states are propagated down to the chain at temperature
+ * one, which is used for the negative phase of the gradients.
+ */
+
+#pragma once
+
+#include <thread>
+#include <vector>
+
+#include "dll/contrastive_divergence.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Parallel Tempering trainer for fully-connected RBM with binary units.
+ *
+ * \tparam K The number of Gibbs steps per batch in each chain
+ * \tparam Chains The number of tempered chains (including the model chain)
+ */
+template <size_t K, size_t Chains, typename RBM>
+struct pt_cd_trainer : base_cd_trainer<K, RBM, true> {
+    static_assert(K > 0, "PT-0 is not a valid training method");
+    static_assert(Chains > 0, "Parallel Tempering needs at least one chain");
+    static_assert(!layer_traits<RBM>::is_convolutional_rbm_layer(), "Parallel Tempering is only implemented for dense RBM");
+    static_assert(RBM::desc::visible_unit == unit_type::BINARY && RBM::desc::hidden_unit == unit_type::BINARY,
+                  "Parallel Tempering is only implemented for binary units");
+
+    using base_type = base_cd_trainer<K, RBM, true>; ///< The base trainer
+    using rbm_t     = RBM;                           ///< The type of RBM being trained
+    using weight    = typename rbm_t::weight;        ///< The data type for this layer
+
+    static constexpr auto batch_size = rbm_t::batch_size; ///< The batch size of the RBM
+
+    /*!
+     * \brief The state of one tempered chain
+     */
+    struct chain {
+        weight beta;                    ///< The inverse temperature of the chain
+        etl::dyn_matrix<weight, 2> v_a; ///< The visible activations
+        etl::dyn_matrix<weight, 2> v_s; ///< The visible samples
+        etl::dyn_matrix<weight, 2> h_a; ///< The hidden activations
+        etl::dyn_matrix<weight, 2> h_s; ///< The hidden samples
+        etl::dyn_vector<weight> energy; ///< The energy of each state
+        fast_uniform_generator g;       ///< The generator for sampling
+
+        chain(weight beta, size_t nv, size_t nh)
+                : beta(beta), v_a(batch_size, nv), v_s(batch_size, nv), h_a(batch_size, nh), h_s(batch_size, nh), energy(batch_size), g(dll::rand_engine()) {}
+    };
+
+    std::vector<chain> chains; ///< The tempered chains, from the coldest (beta=1)
+    size_t swap_parity = 0;    ///< The parity of the pairs of chains to swap
+
+    explicit pt_cd_trainer(rbm_t& rbm) : base_type(rbm) {
+        chains.reserve(Chains);
+
+        for (size_t c = 0; c < Chains; ++c) {
+            chains.emplace_back(weight(1.0) - weight(c) / Chains, num_visible(rbm), num_hidden(rbm));
+        }
+    }
+
+    /*!
+     * \brief Train the RBM with one batch of data
+     */
+    template <typename InputBatch, typename ExpectedBatch>
+    void train_batch(InputBatch& input_batch, ExpectedBatch& expected_batch, rbm_training_context& context) {
+        dll::auto_timer timer("pt:train:normal");
+
+        auto& rbm = this->rbm;
+
+        positive_phase_normal<true>(input_batch, expected_batch, rbm, *this);
+
+        if (this->init) {
+            for (auto& c : chains) {
+                c.h_s = this->h1_s;
+            }
+
+            this->init = false;
+        }
+
+        // Run the Gibbs steps of each chain on its own thread
+
+        auto work = [this](size_t c) {
+            SERIAL_SECTION {
+                gibbs(chains[c]);
+            }
+        };
+
+        {
+            dll::auto_timer timer("pt:gibbs");
+
+            std::vector<std::thread> threads;
+
+            for (size_t c = 1; c < Chains; ++c) {
+                threads.emplace_back(work, c);
+            }
+
+            work(0);
+
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+        swap_chains();
+
+        // The negative phase is given by the model chain
+
+        this->v2_a = chains[0].v_a;
+
+        rbm.template batch_activate_hidden<true, false>(this->h2_a, this->h2_s, this->v2_a, this->v2_a);
+
+        chain_gradients_normal(*this);
+
+        finalize_normal(context, rbm, *this, etl::dim<0>(input_batch));
+    }
+
+    /*!
+     * \brief Return the name of the trainer
+     */
+    static std::string name() {
+        return "Parallel Tempering (" + std::to_string(Chains) + " chains)";
+    }
+
+private:
+    /*!
+     * \brief Run the Gibbs steps of one chain and compute the energy of its
+     * new states
+     */
+    void gibbs(chain& c) {
+        auto& rbm = this->rbm;
+
+        for (size_t k = 0; k < K; ++k) {
+            c.v_a = c.h_s * etl::transpose(rbm.w);
+            rbm_t::template batch_bias_sigmoid<true>(c.v_a, c.v_s, rbm.c, c.beta, c.g);
+
+            c.h_a = c.v_s * rbm.w;
+            rbm_t::template batch_bias_sigmoid<true>(c.h_a, c.h_s, rbm.b, c.beta, c.g);
+        }
+
+        // E(v,h) = -v.c - h.b - v.W.h
+        auto vw = etl::force_temporary(c.v_s * rbm.w);
+
+        for (size_t i = 0; i < batch_size; ++i) {
+            c.energy[i] = -etl::dot(c.v_s(i), rbm.c) - etl::dot(c.h_s(i), rbm.b) - etl::dot(vw(i), c.h_s(i));
+        }
+    }
+
+    /*!
+     * \brief Swap the states of neighbouring chains with the Metropolis
+     * criterion.
+     *
+     * The even pairs and the odd pairs are swapped alternatively.
+     */
+    void swap_chains() {
+        dll::auto_timer timer("pt:swap");
+
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+        auto& g = dll::rand_engine();
+
+        for (size_t c = swap_parity; c + 1 < Chains; c += 2) {
+            auto& lhs = chains[c];
+            auto& rhs = chains[c + 1];
+
+            for (size_t i = 0; i < batch_size; ++i) {
+                const double r = std::exp((lhs.beta - rhs.beta) * (lhs.energy[i] - rhs.energy[i]));
+
+                if (r >= 1.0 || dist(g) < r) {
+                    swap_row(lhs.v_a, rhs.v_a, i);
+                    swap_row(lhs.v_s, rhs.v_s, i);
+                    swap_row(lhs.h_a, rhs.h_a, i);
+                    swap_row(lhs.h_s, rhs.h_s, i);
+
+                    std::swap(lhs.energy[i], rhs.energy[i]);
+                }
+            }
+        }
+
+        swap_parity = 1 - swap_parity;
+    }
+
+    /*!
+     * \brief Swap the given row of two matrices
+     */
+    static void swap_row(etl::dyn_matrix<weight, 2>& lhs, etl::dyn_matrix<weight, 2>& rhs, size_t i) {
+        const size_t n = etl::dim<1>(lhs);
+
+        lhs.ensure_cpu_up_to_date();
+        rhs.ensure_cpu_up_to_date();
+
+        std::swap_ranges(lhs.memory_start() + i * n, lhs.memory_start() + (i + 1) * n, rhs.memory_start() + i * n);
+
+        lhs.invalidate_gpu();
+        rhs.invalidate_gpu();
+    }
+};
+
+/*!
+ * \brief Parallel Tempering trainer with one Gibbs step and four chains
+ */
+template <typename RBM>
+using pt1_trainer_t = pt_cd_trainer<1, 4, RBM>;
+
+} //end of dll namespace
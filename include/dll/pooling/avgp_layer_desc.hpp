@@ -21,6 +21,10 @@ struct avgp_2d_layer_desc : pooling_2d_layer_desc<T_I1, T_I2, T_I3, T_C1, T_C2,
      */
     using parameters = cpp::type_list<Parameters...>;
 
+    static_assert(detail::get_value_v<activation<function::IDENTITY>, Parameters...> == function::IDENTITY,
+                  "An activation function cannot be fused in average pooling");
+    static_assert(!parameters::template contains<argmax_indices>(), "argmax_indices is only supported by max pooling");
+
     /*! The layer type */
     using layer_t = avgp_2d_layer_impl<avgp_2d_layer_desc<T_I1, T_I2, T_I3, T_C1, T_C2, Parameters...>>;
 
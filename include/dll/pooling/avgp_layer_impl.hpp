@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "dll/util/avg_pool.hpp"
 #include "pooling_layer.hpp"
 
 namespace dll {
@@ -68,7 +69,16 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = etl::ml::avg_pool_forward<base::C1, base::C2>(input);
+        if constexpr (etl::is_dma<std::decay_t<Input>> && etl::is_dma<std::decay_t<Output>>) {
+            input.ensure_cpu_up_to_date();
+
+            avg_pool_2d_forward<base::C1, base::C2>(output.memory_start(), input.memory_start(), etl::dim<0>(input) * base::I1,
+                                                    base::I2, base::I3, base::C1, base::C2);
+
+            output.invalidate_gpu();
+        } else {
+            output = etl::ml::avg_pool_forward<base::C1, base::C2>(input);
+        }
     }
 
     /*!
@@ -103,9 +113,17 @@ struct avgp_2d_layer_impl final : pooling_2d_layer<avgp_2d_layer_impl<Desc>, Des
     void backward_batch(H&& output, C& context) const {
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
-        static constexpr size_t C3 = base::C3; ///< The pooling second dimension
 
-        output = etl::ml::avg_pool_backward<C1, C2, C3>(context.input, context.output, context.errors);
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            context.errors.ensure_cpu_up_to_date();
+
+            avg_pool_2d_backward<C1, C2>(output.memory_start(), context.errors.memory_start(), etl::dim<0>(output) * base::I1,
+                                         base::I2, base::I3, C1, C2);
+
+            output.invalidate_gpu();
+        } else {
+            output = etl::ml::avg_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        }
     }
 
     /*!
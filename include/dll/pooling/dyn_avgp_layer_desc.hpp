@@ -21,6 +21,10 @@ struct dyn_avgp_2d_layer_desc : dyn_pooling_2d_layer_desc<Parameters...> {
      */
     using parameters = cpp::type_list<Parameters...>;
 
+    static_assert(detail::get_value_v<activation<function::IDENTITY>, Parameters...> == function::IDENTITY,
+                  "An activation function cannot be fused in average pooling");
+    static_assert(!parameters::template contains<argmax_indices>(), "argmax_indices is only supported by max pooling");
+
     /*! The layer type */
     using layer_t = dyn_avgp_2d_layer_impl<dyn_avgp_2d_layer_desc<Parameters...>>;
 
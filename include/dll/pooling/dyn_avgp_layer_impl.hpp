@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "dll/util/avg_pool.hpp"
 #include "pooling_layer.hpp"
 
 namespace dll {
@@ -28,8 +29,20 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    avg_pool_2d_kernels<weight> kernels; ///< The kernels, specialised for the window if possible
+
     dyn_avgp_2d_layer_impl() = default;
 
+    /*!
+     * \brief Initialize the dimensions of the layer and select the kernels
+     * specialised for its window
+     */
+    void init_layer(size_t i1, size_t i2, size_t i3, size_t c1, size_t c2){
+        base::init_layer(i1, i2, i3, c1, c2);
+
+        kernels.select(c1, c2);
+    }
+
     /*!
      * \brief Get a string representation of the layer
      */
@@ -68,7 +81,15 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = etl::ml::avg_pool_forward(input, base::c1, base::c2);
+        if constexpr (etl::is_dma<std::decay_t<Input>> && etl::is_dma<std::decay_t<Output>>) {
+            input.ensure_cpu_up_to_date();
+
+            kernels.forward(output.memory_start(), input.memory_start(), etl::dim<0>(input) * base::i1, base::i2, base::i3, base::c1, base::c2);
+
+            output.invalidate_gpu();
+        } else {
+            output = etl::ml::avg_pool_forward(input, base::c1, base::c2);
+        }
     }
 
     /*!
@@ -104,7 +125,15 @@ struct dyn_avgp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_avgp_2d_layer_imp
         size_t c1 = base::c1;
         size_t c2 = base::c2;
 
-        output = etl::ml::avg_pool_backward(context.input, context.output, context.errors, c1, c2);
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            context.errors.ensure_cpu_up_to_date();
+
+            kernels.backward(output.memory_start(), context.errors.memory_start(), etl::dim<0>(output) * base::i1, base::i2, base::i3, c1, c2);
+
+            output.invalidate_gpu();
+        } else {
+            output = etl::ml::avg_pool_backward(context.input, context.output, context.errors, c1, c2);
+        }
     }
 
     /*!
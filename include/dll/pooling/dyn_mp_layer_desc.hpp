@@ -21,6 +21,14 @@ struct dyn_mp_2d_layer_desc : dyn_pooling_2d_layer_desc<Parameters...> {
      */
     using parameters = cpp::type_list<Parameters...>;
 
+    /*!
+     * The activation function applied on the pooled values (fused pooling
+     * of the output of the previous layer)
+     */
+    static constexpr auto activation_function = detail::get_value_v<activation<function::IDENTITY>, Parameters...>;
+
+    static_assert(activation_function != function::SOFTMAX, "Softmax cannot be fused in max pooling");
+
     /*! The RBM type */
     using layer_t = dyn_mp_2d_layer_impl<dyn_mp_2d_layer_desc<Parameters...>>;
 
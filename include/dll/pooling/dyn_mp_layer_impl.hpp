@@ -9,6 +9,8 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/max_pool.hpp"
+
 namespace dll {
 
 /*!
@@ -28,8 +30,26 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    static constexpr function activation_function = desc::activation_function;                               ///< The fused activation function
+    static constexpr bool record_indices          = desc::parameters::template contains<dll::argmax_indices>(); ///< Record the argmax of the windows
+
+    using index_t = uint16_t; ///< The type of the index of a maximum
+
+    mutable std::vector<index_t> indices;                           ///< The argmax of each window of the last training batch
+    max_pool_2d_kernels<activation_function, weight, index_t> kernels; ///< The kernels, specialised for the window if possible
+
     dyn_mp_2d_layer_impl() = default;
 
+    /*!
+     * \brief Initialize the dimensions of the layer and select the kernels
+     * specialised for its window
+     */
+    void init_layer(size_t i1, size_t i2, size_t i3, size_t c1, size_t c2){
+        base::init_layer(i1, i2, i3, c1, c2);
+
+        kernels.select(c1, c2);
+    }
+
     /*!
      * \brief Get a string representation of the layer
      */
@@ -68,7 +88,40 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = etl::ml::max_pool_forward(input, base::c1, base::c2);
+        if constexpr (etl::is_dma<std::decay_t<Input>> && etl::is_dma<std::decay_t<Output>>) {
+            input.ensure_cpu_up_to_date();
+
+            kernels.forward(output.memory_start(), nullptr, input.memory_start(), etl::dim<0>(input) * base::i1, base::i2, base::i3, base::c1, base::c2);
+
+            output.invalidate_gpu();
+        } else if constexpr (activation_function == function::IDENTITY) {
+            output = etl::ml::max_pool_forward(input, base::c1, base::c2);
+        } else {
+            output = f_activate<activation_function>(etl::ml::max_pool_forward(input, base::c1, base::c2));
+        }
+    }
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, for
+     * training
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output&& output, const Input& input) const {
+        if constexpr (record_indices && etl::is_dma<std::decay_t<Input>> && etl::is_dma<std::decay_t<Output>>) {
+            indices.resize(etl::size(output));
+
+            input.ensure_cpu_up_to_date();
+
+            kernels.forward(output.memory_start(), indices.data(), input.memory_start(), etl::dim<0>(input) * base::i1, base::i2, base::i3, base::c1, base::c2);
+
+            output.invalidate_gpu();
+        } else {
+            indices.clear();
+
+            forward_batch(output, input);
+        }
     }
 
     /*!
@@ -104,7 +157,28 @@ struct dyn_mp_2d_layer_impl final : dyn_pooling_2d_layer<dyn_mp_2d_layer_impl<De
         size_t c1 = base::c1;
         size_t c2 = base::c2;
 
-        output = etl::ml::max_pool_backward(context.input, context.output, context.errors, c1, c2);
+        if constexpr (record_indices && etl::is_dma<std::decay_t<H>>) {
+            if (indices.size() == etl::size(context.output)) {
+                context.errors.ensure_cpu_up_to_date();
+                context.output.ensure_cpu_up_to_date();
+
+                kernels.backward(output.memory_start(), context.errors.memory_start(), context.output.memory_start(), indices.data(),
+                                 etl::dim<0>(context.input) * base::i1, base::i2, base::i3, c1, c2);
+
+                output.invalidate_gpu();
+
+                return;
+            }
+        }
+
+        if constexpr (activation_function == function::IDENTITY) {
+            output = etl::ml::max_pool_backward(context.input, context.output, context.errors, c1, c2);
+        } else {
+            // The output is activated, the maxima are computed again
+            auto pooled = etl::force_temporary(etl::ml::max_pool_forward(context.input, c1, c2));
+
+            output = etl::ml::max_pool_backward(context.input, pooled, f_derivative<activation_function>(context.output) >> context.errors, c1, c2);
+        }
     }
 
     /*!
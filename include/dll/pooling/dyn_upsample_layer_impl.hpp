@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "dll/util/upsample.hpp"
 #include "unpooling_layer.hpp"
 
 namespace dll {
@@ -28,8 +29,20 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    upsample_3d_kernels<weight> kernels; ///< The kernels, specialised for the window if possible
+
     dyn_upsample_3d_layer_impl() = default;
 
+    /*!
+     * \brief Initialize the dimensions of the layer and select the kernels
+     * specialised for its window
+     */
+    void init_layer(size_t i1, size_t i2, size_t i3, size_t c1, size_t c2, size_t c3){
+        base::init_layer(i1, i2, i3, c1, c2, c3);
+
+        kernels.select(c2, c3);
+    }
+
     /*!
      * \brief Get a string representation of the layer
      */
@@ -68,7 +81,15 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
      */
     template <typename Input, typename Output>
     void forward_batch(Output& output, const Input& input) const {
-        output = etl::upsample_3d(input, base::c1, base::c2, base::c3);
+        if constexpr (etl::is_dma<std::decay_t<Input>> && etl::is_dma<std::decay_t<Output>>) {
+            input.ensure_cpu_up_to_date();
+
+            kernels.forward(output.memory_start(), input.memory_start(), etl::dim<0>(input), base::i1, base::i2, base::i3, base::c1, base::c2, base::c3);
+
+            output.invalidate_gpu();
+        } else {
+            output = etl::upsample_3d(input, base::c1, base::c2, base::c3);
+        }
     }
 
     /*!
@@ -105,7 +126,13 @@ struct dyn_upsample_3d_layer_impl final : dyn_unpooling_3d_layer<dyn_upsample_3d
         const size_t c2 = base::c2;
         const size_t c3 = base::c3;
 
-        if constexpr (etl::decay_traits<H>::dimensions() == 4) {
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            context.errors.ensure_cpu_up_to_date();
+
+            kernels.backward(output.memory_start(), context.errors.memory_start(), etl::dim<0>(output), base::i1, base::i2, base::i3, c1, c2, c3);
+
+            output.invalidate_gpu();
+        } else if constexpr (etl::decay_traits<H>::dimensions() == 4) {
             output = etl::max_pool_3d(context.errors, c1, c2, c3);
         } else {
             const size_t B = etl::dim<0>(output);
@@ -21,6 +21,14 @@ struct mp_2d_layer_desc : pooling_2d_layer_desc<T_I1, T_I2, T_I3, T_C1, T_C2, Pa
      */
     using parameters = cpp::type_list<Parameters...>;
 
+    /*!
+     * The activation function applied on the pooled values (fused pooling
+     * of the output of the previous layer)
+     */
+    static constexpr auto activation_function = detail::get_value_v<activation<function::IDENTITY>, Parameters...>;
+
+    static_assert(activation_function != function::SOFTMAX, "Softmax cannot be fused in max pooling");
+
     /*! The RBM type */
     using layer_t = mp_2d_layer_impl<mp_2d_layer_desc<T_I1, T_I2, T_I3, T_C1, T_C2, Parameters...>>;
 
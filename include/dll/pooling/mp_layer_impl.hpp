@@ -9,6 +9,7 @@
 
 #include "pooling_layer.hpp"
 
+#include "dll/util/max_pool.hpp"
 #include "dll/util/timers.hpp" // for auto_timer
 
 namespace dll {
@@ -30,6 +31,13 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     using input_t      = typename base::input_t;      ///< The type of many input
     using output_t     = typename base::output_t;     ///< The type of many output
 
+    static constexpr function activation_function = desc::activation_function;                               ///< The fused activation function
+    static constexpr bool record_indices          = desc::parameters::template contains<dll::argmax_indices>(); ///< Record the argmax of the windows
+
+    using index_t = max_pool_index_t<base::C1 * base::C2>; ///< The type of the index of a maximum
+
+    mutable std::vector<index_t> indices; ///< The argmax of each window of the last training batch
+
     mp_2d_layer_impl() = default;
 
     /*!
@@ -71,8 +79,40 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
         dll::auto_timer timer("mp:forward_batch");
+        timer.work(base::cost(etl::dim<0>(input)).forward);
+
+        if constexpr (activation_function == function::IDENTITY) {
+            output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
+        } else {
+            output = f_activate<activation_function>(etl::ml::max_pool_forward<base::C1, base::C2>(input));
+        }
+    }
+
+    /*!
+     * \brief Forward activation of the layer for one batch of sample, for
+     * training
+     * \param output The output matrix
+     * \param input The input matrix
+     */
+    template <typename Input, typename Output>
+    void train_forward_batch(Output&& output, const Input& input) const {
+        if constexpr (record_indices && etl::is_dma<std::decay_t<Input>> && etl::is_dma<std::decay_t<Output>>) {
+            dll::auto_timer timer("mp:train:forward_batch");
+            timer.work(base::cost(etl::dim<0>(input)).forward);
+
+            indices.resize(etl::size(output));
+
+            input.ensure_cpu_up_to_date();
+
+            max_pool_2d_forward<activation_function, base::C1, base::C2>(output.memory_start(), indices.data(), input.memory_start(),
+                                                                         etl::dim<0>(input) * base::I1, base::I2, base::I3, base::C1, base::C2);
+
+            output.invalidate_gpu();
+        } else {
+            indices.clear();
 
-        output = etl::ml::max_pool_forward<base::C1, base::C2>(input);
+            forward_batch(output, input);
+        }
     }
 
     /*!
@@ -106,11 +146,33 @@ struct mp_2d_layer_impl final : pooling_2d_layer<mp_2d_layer_impl<Desc>, Desc> {
     template<typename H, typename C>
     void backward_batch(H&& output, C& context) const {
         dll::auto_timer timer("mp:backward_batch");
+        timer.work(base::cost(etl::dim<0>(context.errors)).backward);
 
         static constexpr size_t C1 = base::C1; ///< The pooling first dimension
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
 
-        output = etl::ml::max_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        if constexpr (record_indices && etl::is_dma<std::decay_t<H>>) {
+            if (indices.size() == etl::size(context.output)) {
+                context.errors.ensure_cpu_up_to_date();
+                context.output.ensure_cpu_up_to_date();
+
+                max_pool_2d_backward<activation_function, C1, C2>(output.memory_start(), context.errors.memory_start(), context.output.memory_start(), indices.data(),
+                                                                  etl::dim<0>(context.input) * base::I1, base::I2, base::I3, C1, C2);
+
+                output.invalidate_gpu();
+
+                return;
+            }
+        }
+
+        if constexpr (activation_function == function::IDENTITY) {
+            output = etl::ml::max_pool_backward<C1, C2>(context.input, context.output, context.errors);
+        } else {
+            // The output is activated, the maxima are computed again
+            auto pooled = etl::force_temporary(etl::ml::max_pool_forward<C1, C2>(context.input));
+
+            output = etl::ml::max_pool_backward<C1, C2>(context.input, pooled, f_derivative<activation_function>(context.output) >> context.errors);
+        }
     }
 
     /*!
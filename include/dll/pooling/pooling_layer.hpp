@@ -64,6 +64,13 @@ struct pooling_2d_layer : layer<Parent> {
         return 0;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return elementwise_layer_cost(sizeof(weight), batch, input_size(), output_size(), 1, 1);
+    }
+
     /*!
      * \brief Prepare a set of empty outputs for this layer
      * \param samples The number of samples to prepare the output for
@@ -161,6 +168,13 @@ struct dyn_pooling_2d_layer : layer<Parent> {
         return 0;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return elementwise_layer_cost(sizeof(weight), batch, input_size(), output_size(), 1, 1);
+    }
+
     /*!
      * \brief Prepare a set of empty outputs for this layer
      * \param samples The number of samples to prepare the output for
@@ -250,6 +264,13 @@ struct pooling_3d_layer : layer<Parent> {
         return 0;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return elementwise_layer_cost(sizeof(weight), batch, input_size(), output_size(), 1, 1);
+    }
+
     /*!
      * \brief Prepare a set of empty outputs for this layer
      * \param samples The number of samples to prepare the output for
@@ -349,6 +370,13 @@ struct dyn_pooling_3d_layer : layer<Parent> {
         return 0;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return elementwise_layer_cost(sizeof(weight), batch, input_size(), output_size(), 1, 1);
+    }
+
     /*!
      * \brief Prepare a set of empty outputs for this layer
      * \param samples The number of samples to prepare the output for
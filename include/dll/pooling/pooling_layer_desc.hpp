@@ -30,7 +30,7 @@ struct pooling_2d_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, argmax_indices_id>, Parameters...>,
         "Invalid parameters type for pooling_layer");
 };
 
@@ -44,7 +44,7 @@ struct dyn_pooling_2d_layer_desc {
 
     //Make sure only valid types are passed to the configuration list
     static_assert(
-        detail::is_valid_v<cpp::type_list<weight_type_id>, Parameters...>,
+        detail::is_valid_v<cpp::type_list<weight_type_id, activation_id, argmax_indices_id>, Parameters...>,
         "Invalid parameters type for pooling_layer");
 };
 
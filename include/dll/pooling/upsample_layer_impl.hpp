@@ -8,6 +8,7 @@
 #pragma once
 
 #include "dll/base_traits.hpp"
+#include "dll/util/upsample.hpp"
 #include "unpooling_layer.hpp"
 
 namespace dll {
@@ -70,7 +71,16 @@ struct upsample_3d_layer_impl final : unpooling_3d_layer<upsample_3d_layer_impl<
      */
     template <typename Input, typename Output>
     static void forward_batch(Output& output, const Input& input) {
-        output = etl::upsample_3d<base::C1, base::C2, base::C3>(input);
+        if constexpr (etl::is_dma<std::decay_t<Input>> && etl::is_dma<std::decay_t<Output>>) {
+            input.ensure_cpu_up_to_date();
+
+            upsample_3d_forward<base::C2, base::C3>(output.memory_start(), input.memory_start(), etl::dim<0>(input),
+                                                    base::I1, base::I2, base::I3, base::C1, base::C2, base::C3);
+
+            output.invalidate_gpu();
+        } else {
+            output = etl::upsample_3d<base::C1, base::C2, base::C3>(input);
+        }
     }
 
     /*!
@@ -107,7 +117,14 @@ struct upsample_3d_layer_impl final : unpooling_3d_layer<upsample_3d_layer_impl<
         static constexpr size_t C2 = base::C2; ///< The pooling second dimension
         static constexpr size_t C3 = base::C3; ///< The pooling third dimension
 
-        if constexpr (etl::decay_traits<H>::dimensions() == 4) {
+        if constexpr (etl::is_dma<std::decay_t<H>>) {
+            context.errors.ensure_cpu_up_to_date();
+
+            upsample_3d_backward<C2, C3>(output.memory_start(), context.errors.memory_start(), etl::dim<0>(output),
+                                         base::I1, base::I2, base::I3, C1, C2, C3);
+
+            output.invalidate_gpu();
+        } else if constexpr (etl::decay_traits<H>::dimensions() == 4) {
             output = etl::max_pool_3d<C1, C2, C3>(context.errors);
         } else {
             constexpr auto B = etl::decay_traits<H>::template dim<0>();
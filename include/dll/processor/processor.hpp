@@ -16,6 +16,7 @@
 #include <vector>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 
 #include "dll/rbm/rbm.hpp"
 #include "dll/rbm/conv_rbm.hpp"
@@ -32,11 +33,15 @@ namespace dll {
 namespace processor {
 
 struct options {
-    bool quiet  = false;
-    bool mkl    = false;
-    bool cublas = false;
-    bool cufft  = false;
-    bool cache  = false;
+    bool quiet   = false;
+    bool mkl     = false;
+    bool cublas  = false;
+    bool cufft   = false;
+    bool cache   = true;
+    bool dynamic = false;
+
+    std::string profile; ///< The compilation profile (overrides the one of the configuration)
+    size_t jobs = 0;     ///< The maximum number of tasks running at the same time (0 for all)
 };
 
 template <typename LastLayer, typename Enable = void>
@@ -52,6 +57,7 @@ struct sgd_possible<LastLayer, std::enable_if_t<decay_layer_traits<LastLayer>::b
 //These functions are only exposed to be able to unit-test the program
 int process_file(const options& opt, const std::vector<std::string>& actions, const std::string& source_file);
 std::string process_file_result(const options& opt, const std::vector<std::string>& actions, const std::string& source_file);
+int process_files(const options& opt, const std::vector<std::string>& actions, const std::vector<std::string>& source_files);
 
 constexpr double stupid_default = -666.0;
 
@@ -70,12 +76,33 @@ struct datasource {
 
     long limit = -1;
 
+    std::vector<std::string> shards; ///< The shard files of a streaming datasource (reader mmap)
+    size_t prefetch = 0;             ///< The number of batches read ahead from the shards (0 for the default)
+    size_t workers  = 0;             ///< The number of reader threads of the shards (0 for the default)
+
     datasource() {}
     datasource(std::string source_file, std::string reader)
             : source_file(std::move(source_file)), reader(std::move(reader)) {}
 
     bool empty() const {
-        return source_file.empty();
+        return source_file.empty() && shards.empty();
+    }
+
+    /*!
+     * \brief Indicates if the datasource is streamed from dataset files in
+     * the memory-mapped format, instead of being loaded in memory. The
+     * labels are read from the same files as the samples.
+     */
+    bool streaming() const {
+        return reader == "mmap";
+    }
+
+    /*!
+     * \brief Indicates if the datasource is streamed by reader threads from a
+     * list of shards (otherwise, the single file is mapped in memory)
+     */
+    bool sharded() const {
+        return streaming() && (!shards.empty() || prefetch || workers);
     }
 };
 
@@ -87,6 +114,7 @@ struct datasource_pack {
 struct general_desc {
     bool batch_mode       = false;
     size_t big_batch = 1;
+    std::string profile   = "default";
 };
 
 struct pretraining_desc {
@@ -127,6 +155,88 @@ struct task {
     dll::processor::general_desc general_desc;
 };
 
+/*!
+ * \brief The values passed at runtime to a program generated in dynamic mode
+ * (one value per line)
+ */
+struct parameters {
+    std::vector<std::string> values; ///< The values
+
+    /*!
+     * \brief Load the values from the given file
+     * \return true if the file was read, false otherwise
+     */
+    bool load(const std::string& file) {
+        std::ifstream stream(file);
+
+        if (!stream) {
+            return false;
+        }
+
+        std::string line;
+
+        while (std::getline(stream, line)) {
+            values.push_back(line);
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Returns the ith value as a floating point number
+     */
+    double real(size_t i) const {
+        return std::stod(values.at(i));
+    }
+
+    /*!
+     * \brief Returns the ith value as an integer
+     */
+    long integer(size_t i) const {
+        return std::stol(values.at(i));
+    }
+
+    /*!
+     * \brief Returns the ith value as a string
+     */
+    const std::string& string(size_t i) const {
+        return values.at(i);
+    }
+};
+
+/*!
+ * \brief The absence of streaming generators for a datasource of the
+ * generated program
+ */
+struct no_stream {};
+
+/*!
+ * \brief The streaming generator of a datasource of the generated program.
+ *
+ * The settings of the datasource that are known at generation time (batch
+ * size, prefetch, workers and the pre-transformations) are in the descriptor
+ * of the generator, the files are taken from the datasource at runtime.
+ *
+ * \tparam Sharded Indicates if the generator reads a list of shards with reader threads
+ * \tparam Desc The generator descriptor (sharded_data_generator_desc or mmap_data_generator_desc)
+ */
+template <bool Sharded, typename Desc>
+struct stream {
+    /*!
+     * \brief Create the generator of the given datasource
+     * \tparam D The number of dimensions of one sample
+     * \tparam T The weight type of the batches
+     */
+    template <size_t D, typename T>
+    static auto make(const datasource& ds) {
+        if constexpr (Sharded) {
+            return dll::make_sharded_generator<D, T>(ds.shards.empty() ? std::vector<std::string>{ds.source_file} : ds.shards, Desc{});
+        } else {
+            return dll::make_mmap_generator<D, T>(ds.source_file, Desc{});
+        }
+    }
+};
+
 template <bool Three, typename Sample>
 bool read_samples(const datasource& ds, std::vector<Sample>& samples) {
     size_t limit = 0;
@@ -216,12 +326,23 @@ inline void print_title(const std::string& value) {
     std::cout << std::string(25, ' ') << std::endl;
 }
 
-template <typename Container, bool Three, typename DBN>
+/*!
+ * \brief Execute the actions of the task on the network.
+ *
+ * The streaming datasources are read by the generators of PT (pretraining),
+ * FT (training) and TE (testing), the other datasources are loaded in
+ * memory before the action.
+ */
+template <typename Container, bool Three, typename PT = no_stream, typename FT = no_stream, typename TE = no_stream, typename DBN>
 void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
     print_title("Network");
     dbn.display();
 
-    using dbn_t = std::decay_t<DBN>;
+    using dbn_t  = std::decay_t<DBN>;
+    using weight = typename dbn_t::weight;
+
+    // The dimensions of one sample in the dataset files
+    static constexpr size_t D = Three ? 3 : 1;
 
     //Execute all the actions sequentially
     for (auto& action : actions) {
@@ -233,6 +354,32 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
+            if (task.pretraining.samples.streaming()) {
+                if (task.pt_desc.denoising) {
+                    std::cout << "dllp: error: denoising pretraining is not possible with a streaming input" << std::endl;
+                    return;
+                }
+
+                if constexpr (!std::is_same<PT, no_stream>::value) {
+                    auto generator = PT::template make<D, weight>(task.pretraining.samples);
+
+                    if (!generator->size()) {
+                        std::cout << "dllp: error: failed to open the pretraining dataset" << std::endl;
+                        return;
+                    }
+
+                    if constexpr (dbn_t::pretrain_possible) {
+                        //Pretrain the network
+                        dbn.pretrain(*generator, task.pt_desc.epochs);
+                    }
+                } else {
+                    std::cout << "dllp: error: no streaming generator for the datasource" << std::endl;
+                    return;
+                }
+
+                continue;
+            }
+
             std::vector<Container> pt_samples;
 
             //Try to read the samples
@@ -263,11 +410,40 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
         } else if (action == "train") {
             print_title("Training");
 
-            if (task.training.samples.empty() || task.training.labels.empty()) {
+            if (task.training.samples.empty() || (task.training.labels.empty() && !task.training.samples.streaming())) {
                 std::cout << "dllp: error: train is not possible without samples and labels" << std::endl;
                 return;
             }
 
+            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
+
+            if(!sgd_possible<last_layer>::value){
+                std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
+                return;
+            }
+
+            if (task.training.samples.streaming()) {
+                if constexpr (!std::is_same<FT, no_stream>::value) {
+                    auto generator = FT::template make<D, weight>(task.training.samples);
+
+                    if (!generator->size()) {
+                        std::cout << "dllp: error: failed to open the training dataset" << std::endl;
+                        return;
+                    }
+
+                    //Train the network
+                    if constexpr (sgd_possible<last_layer>::value) {
+                        auto ft_error = dbn.fine_tune(*generator, task.ft_desc.epochs);
+                        std::cout << "Train Classification Error:" << ft_error << std::endl;
+                    }
+                } else {
+                    std::cout << "dllp: error: no streaming generator for the datasource" << std::endl;
+                    return;
+                }
+
+                continue;
+            }
+
             std::vector<Container> ft_samples;
             std::vector<size_t> ft_labels;
 
@@ -283,13 +459,6 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
                 return;
             }
 
-            using last_layer = typename dbn_t::template layer_type<dbn_t::layers - 1>;
-
-            if(!sgd_possible<last_layer>::value){
-                std::cout << "dllp: error: The network is not trainable by SGD" << std::endl;
-                return;
-            }
-
             //Train the network
             if constexpr(sgd_possible<last_layer>::value) {
                 auto ft_error = dbn.fine_tune(ft_samples, ft_labels, task.ft_desc.epochs);
@@ -298,11 +467,35 @@ void execute(DBN& dbn, task& task, const std::vector<std::string>& actions) {
         } else if (action == "test") {
             print_title("Testing");
 
-            if (task.testing.samples.empty() || task.testing.labels.empty()) {
+            if (task.testing.samples.empty() || (task.testing.labels.empty() && !task.testing.samples.streaming())) {
                 std::cout << "dllp: error: test is not possible without samples and labels" << std::endl;
                 return;
             }
 
+            // The results per class need all the labels, only the error is
+            // computed on a streaming input
+            if (task.testing.samples.streaming()) {
+                if constexpr (!std::is_same<TE, no_stream>::value) {
+                    auto generator = TE::template make<D, weight>(task.testing.samples);
+
+                    if (!generator->size()) {
+                        std::cout << "dllp: error: failed to open the test dataset" << std::endl;
+                        return;
+                    }
+
+                    double test_error = dbn.evaluate_error(*generator);
+
+                    std::cout << "Error rate: " << test_error << std::endl;
+                    std::cout << "Accuracy: " << (1.0 - test_error) << std::endl
+                              << std::endl;
+                } else {
+                    std::cout << "dllp: error: no streaming generator for the datasource" << std::endl;
+                    return;
+                }
+
+                continue;
+            }
+
             std::vector<Container> test_samples;
             std::vector<size_t> test_labels;
 
@@ -109,6 +109,13 @@ struct conv_rbm_impl final : public standard_crbm<conv_rbm_impl<Desc>, Desc> {
         return NC * K * NW1 * NW2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return rbm_layer_cost(sizeof(weight), batch, NC * NV1 * NV2, K * NH1 * NH2, NC * K * NW1 * NW2, NC + K, NC * K * NW1 * NW2 * NH1 * NH2);
+    }
+
     /*!
      * \brief Return a textual representation of the layer
      */
@@ -366,6 +373,7 @@ struct rbm_layer_base_traits<conv_rbm_impl<Desc>> {
     static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
     static constexpr bool has_init_weights   = param::template contains<init_weights>();                   ///< Does the RBM use weights initialization
     static constexpr bool has_free_energy    = param::template contains<free_energy>();                    ///< Does the RBM displays the free energy
+    static constexpr bool has_mixed_precision = param::template contains<mixed_precision>();                ///< Does the RBM use mixed precision training
     static constexpr auto sparsity_method    = get_value_l_v<sparsity<dll::sparsity_method::NONE>, param>; ///< The RBM's sparsity method
     static constexpr auto bias_mode          = get_value_l_v<bias<dll::bias_mode::NONE>, param>;           ///< The RBM's sparsity bias mode
     static constexpr auto decay              = get_value_l_v<weight_decay<dll::decay_type::NONE>, param>;  ///< The RBM's sparsity decay type
@@ -109,7 +109,7 @@ public:
         detail::is_valid_v<cpp::type_list<
                              momentum_id, batch_size_id, visible_id, hidden_id, pooling_id, dbn_only_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id, bias_id, clip_gradients_id,
-                             weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             weight_type_id, shuffle_id, verbose_id, nop_id, mixed_precision_id>,
                          Parameters...>,
         "Invalid parameters type");
 
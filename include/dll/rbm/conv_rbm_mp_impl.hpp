@@ -116,6 +116,13 @@ struct conv_rbm_mp_impl final : public standard_crbm_mp<conv_rbm_mp_impl<Desc>,
         return NC * K * NW1 * NW2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return rbm_layer_cost(sizeof(weight), batch, NC * NV1 * NV2, K * NH1 * NH2, NC * K * NW1 * NW2, NC + K, NC * K * NW1 * NW2 * NH1 * NH2);
+    }
+
     /*!
      * \brief Return a textual representation of the layer
      */
@@ -227,9 +234,14 @@ private:
     }
 
     template<typename H>
-    auto get_batch_c_rep(H&& /*h*/) const {
-        static constexpr auto batch_size = etl::decay_traits<H>::template dim<0>();
-        return etl::force_temporary(etl::rep_l<batch_size>(etl::rep<NV1, NV2>(c)));
+    auto get_batch_c_rep(H&& h) const {
+        if constexpr (etl::all_fast<H>) {
+            static constexpr auto batch_size = etl::decay_traits<H>::template dim<0>();
+            return etl::force_temporary(etl::rep_l<batch_size>(etl::rep<NV1, NV2>(c)));
+        } else {
+            const auto batch_size = etl::dim<0>(h);
+            return etl::force_temporary(etl::rep_l(etl::rep<NV1, NV2>(c), batch_size));
+        }
     }
 
     template<typename H>
@@ -329,6 +341,7 @@ struct rbm_layer_base_traits<conv_rbm_mp_impl<Desc>> {
     static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
     static constexpr bool has_init_weights   = param::template contains<init_weights>();                   ///< Does the RBM use weights initialization
     static constexpr bool has_free_energy    = param::template contains<free_energy>();                    ///< Does the RBM displays the free energy
+    static constexpr bool has_mixed_precision = param::template contains<mixed_precision>();                ///< Does the RBM use mixed precision training
     static constexpr auto sparsity_method    = get_value_l_v<sparsity<dll::sparsity_method::NONE>, param>; ///< The RBM's sparsity method
     static constexpr auto bias_mode          = get_value_l_v<bias<dll::bias_mode::NONE>, param>;           ///< The RBM's sparsity bias mode
     static constexpr auto decay              = get_value_l_v<weight_decay<dll::decay_type::NONE>, param>;  ///< The RMB's sparsity decay type
@@ -143,6 +143,13 @@ struct dyn_conv_rbm_impl final : public standard_crbm<dyn_conv_rbm_impl<Desc>, D
         return nc * k * nw1 * nw2;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    layer_cost cost(size_t batch = 1) const noexcept {
+        return rbm_layer_cost(sizeof(weight), batch, nc * nv1 * nv2, k * nh1 * nh2, nc * k * nw1 * nw2, nc + k, nc * k * nw1 * nw2 * nh1 * nh2);
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -368,6 +375,7 @@ struct rbm_layer_base_traits<dyn_conv_rbm_impl<Desc>> {
     static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
     static constexpr bool has_init_weights   = param::template contains<init_weights>();                   ///< Does the RBM use weights initialization
     static constexpr bool has_free_energy    = param::template contains<free_energy>();                    ///< Does the RBM displays the free energy
+    static constexpr bool has_mixed_precision = param::template contains<mixed_precision>();                ///< Does the RBM use mixed precision training
     static constexpr auto sparsity_method    = get_value_l_v<sparsity<dll::sparsity_method::NONE>, param>; ///< The RBM's sparsity method
     static constexpr auto bias_mode          = get_value_l_v<bias<dll::bias_mode::NONE>, param>;           ///< The RBM's sparsity bias mode
     static constexpr auto decay              = get_value_l_v<weight_decay<dll::decay_type::NONE>, param>;  ///< The RMB's sparsity decay type
@@ -78,7 +78,7 @@ struct dyn_conv_rbm_mp_desc {
         detail::is_valid_v<cpp::type_list<
                              batch_size_id, momentum_id, visible_id, hidden_id, pooling_id, dbn_only_id,
                              weight_decay_id, sparsity_id, trainer_rbm_id, watcher_id, clip_gradients_id,
-                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id>,
+                             bias_id, weight_type_id, shuffle_id, verbose_id, nop_id, mixed_precision_id>,
                          Parameters...>,
         "Invalid parameters type");
 
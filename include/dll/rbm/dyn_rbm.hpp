@@ -11,3 +11,12 @@
 #include "dll/trainer/rbm_training_context.hpp"
 #include "dll/rbm/dyn_rbm_desc.hpp"
 #include "dll/trainer/rbm_trainer.hpp"
+
+#include "dll/util/precompiled.hpp"
+
+// The common (single precision) configurations of the dynamic RBMs are
+// precompiled on demand, with their forward pass on dynamic batches
+DLL_PRECOMPILED_TEMPLATE(struct dll::dyn_rbm_impl<dll::dyn_rbm_desc<>>)
+DLL_PRECOMPILED_TEMPLATE(struct dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::momentum>>)
+DLL_PRECOMPILED_TEMPLATE(void dll::dyn_rbm_impl<dll::dyn_rbm_desc<>>::forward_batch<etl::dyn_matrix<float, 2>, etl::dyn_matrix<float, 2>>(etl::dyn_matrix<float, 2>& output, const etl::dyn_matrix<float, 2>& input) const)
+DLL_PRECOMPILED_TEMPLATE(void dll::dyn_rbm_impl<dll::dyn_rbm_desc<dll::momentum>>::forward_batch<etl::dyn_matrix<float, 2>, etl::dyn_matrix<float, 2>>(etl::dyn_matrix<float, 2>& output, const etl::dyn_matrix<float, 2>& input) const)
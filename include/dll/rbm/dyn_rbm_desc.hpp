@@ -9,6 +9,7 @@
 
 #include "dll/base_conf.hpp"
 #include "dll/contrastive_divergence.hpp"
+#include "dll/parallel_tempering.hpp"
 #include "dll/watcher.hpp"
 #include "dll/util/tmp.hpp"
 
@@ -67,7 +68,7 @@ struct dyn_rbm_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid_v<cpp::type_list<batch_size_id, momentum_id, visible_id, hidden_id, weight_decay_id, verbose_id,
-                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id, clip_gradients_id>,
+                                        init_weights_id, sparsity_id, trainer_rbm_id, weight_type_id, shuffle_id, nop_id, free_energy_id, clip_gradients_id, sparse_input_id, bit_packed_id, mixed_precision_id>,
                          Parameters...>,
         "Invalid parameters type");
 
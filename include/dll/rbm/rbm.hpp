@@ -19,3 +19,10 @@
 #include "dll/trainer/rbm_training_context.hpp"
 #include "dll/rbm/rbm_desc.hpp"
 #include "dll/trainer/rbm_trainer.hpp"
+
+#include "dll/util/precompiled.hpp"
+
+// The common (single precision) configurations of the RBMs are precompiled on
+// demand
+DLL_PRECOMPILED_TEMPLATE(struct dll::rbm_impl<dll::rbm_desc<28 * 28, 500, dll::batch_size<50>, dll::momentum>>)
+DLL_PRECOMPILED_TEMPLATE(struct dll::rbm_impl<dll::rbm_desc<500, 250, dll::batch_size<50>, dll::momentum>>)
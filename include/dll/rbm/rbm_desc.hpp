@@ -9,6 +9,7 @@
 
 #include "dll/base_conf.hpp"
 #include "dll/contrastive_divergence.hpp"
+#include "dll/parallel_tempering.hpp"
 #include "dll/watcher.hpp"
 #include "dll/util/tmp.hpp"
 
@@ -74,7 +75,7 @@ struct rbm_desc {
     static_assert(
         detail::is_valid_v<cpp::type_list<momentum_id, verbose_id, batch_size_id, visible_id,
                                         hidden_id, weight_decay_id, init_weights_id, sparsity_id, trainer_rbm_id, watcher_id,
-                                        weight_type_id, shuffle_id, free_energy_id, dbn_only_id, nop_id, clip_gradients_id>,
+                                        weight_type_id, shuffle_id, free_energy_id, dbn_only_id, nop_id, clip_gradients_id, sparse_input_id, bit_packed_id, mixed_precision_id>,
                          Parameters...>,
         "Invalid parameters type for rbm_desc");
 
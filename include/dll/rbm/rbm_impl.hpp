@@ -113,6 +113,13 @@ struct rbm_impl final : public standard_rbm<rbm_impl<Desc>, Desc> {
         return num_visible * num_hidden;
     }
 
+    /*!
+     * \brief Returns the analytical cost of the layer for a batch of the given size
+     */
+    static layer_cost cost(size_t batch = 1) noexcept {
+        return rbm_layer_cost(sizeof(weight), batch, num_visible, num_hidden, num_visible * num_hidden, num_visible + num_hidden, num_visible * num_hidden);
+    }
+
     /*!
      * \brief Returns a short description of the layer
      * \return an std::string containing a short description of the layer
@@ -267,6 +274,7 @@ struct rbm_layer_base_traits<rbm_impl<Desc>> {
     static constexpr bool is_dbn_only        = param::template contains<dbn_only>();                       ///< Does the RBM is only used inside a DBN
     static constexpr bool has_init_weights   = param::template contains<init_weights>();                   ///< Does the RBM use weights initialization
     static constexpr bool has_free_energy    = param::template contains<free_energy>();                    ///< Does the RBM displays the free energy
+    static constexpr bool has_mixed_precision = param::template contains<mixed_precision>();                ///< Does the RBM use mixed precision training
     static constexpr auto sparsity_method    = get_value_l_v<sparsity<dll::sparsity_method::NONE>, param>; ///< The RBM's sparsity method
     static constexpr auto bias_mode          = get_value_l_v<bias<dll::bias_mode::NONE>, param>;           ///< The RBM's sparsity bias mode
     static constexpr auto decay              = get_value_l_v<weight_decay<dll::decay_type::NONE>, param>;  ///< The RMB's sparsity decay type
@@ -328,8 +336,9 @@ struct cg_context<rbm_impl<Desc>> {
     etl::fast_matrix<weight, num_visible, num_hidden> gr_w_tmp;
     etl::fast_vector<weight, num_hidden> gr_b_tmp;
 
-    std::vector<etl::dyn_vector<weight>> gr_probs_a;
-    std::vector<etl::dyn_vector<weight>> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_probs_a;
+    etl::dyn_matrix<weight, 2> gr_probs_s;
+    etl::dyn_matrix<weight, 2> gr_diffs;
 };
 
 } //end of dll namespace
@@ -137,6 +137,17 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
 
+        batch_activate_hidden_conv<P, S>(h_a, h_s, v_a);
+    }
+
+    /*!
+     * \brief Compute the hidden activation of a batch from the convolutions of
+     * the visible units with the filters, already stored in h_a.
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename V1>
+    void batch_activate_hidden_conv(H1&& h_a, H2&& h_s, const V1& v_a) const {
+        using namespace etl;
+
         auto b_rep = as_derived().get_batch_b_rep(v_a);
 
         // Need to be done before h_a is computed!
@@ -170,6 +181,17 @@ struct standard_crbm : public standard_conv_rbm<Derived, Desc> {
 
         v_a = etl::conv_4d_full(h_s, as_derived().w);
 
+        batch_activate_visible_conv<P, S>(h_s, v_a, v_s);
+    }
+
+    /*!
+     * \brief Compute the visible activation of a batch from the full
+     * convolutions of the hidden units with the filters, already stored in v_a.
+     */
+    template <bool P = true, bool S = true, typename H2, typename V1, typename V2>
+    void batch_activate_visible_conv(const H2& h_s, V1&& v_a, V2&& v_s) const {
+        using namespace etl;
+
         auto c_rep = as_derived().get_batch_c_rep(h_s);
 
         V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(c_rep + v_a));
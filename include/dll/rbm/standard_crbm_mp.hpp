@@ -25,6 +25,7 @@
 #include "dll/rbm/standard_conv_rbm.hpp" //The base class
 #include "dll/base_conf.hpp"             //The configuration helpers
 #include "dll/rbm/rbm_tmp.hpp"           // static_if macros
+#include "dll/util/p_max_pool.hpp"       // p_max_pool_kernel
 
 namespace dll {
 
@@ -161,6 +162,17 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
 
         h_a = etl::conv_4d_valid_flipped(v_a, as_derived().w);
 
+        batch_activate_hidden_conv<P, S>(h_a, h_s, v_a);
+    }
+
+    /*!
+     * \brief Compute the hidden activation of a batch from the convolutions of
+     * the visible units with the filters, already stored in h_a.
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename V1>
+    void batch_activate_hidden_conv(H1&& h_a, H2&& h_s, const V1& v_a) const {
+        using namespace etl;
+
         auto b_rep = as_derived().get_batch_b_rep(v_a);
 
         // Note: this is wrong because of PMP
@@ -170,13 +182,16 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b_rep + h_a, 6.0), 0.0), 6.0));
         H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b_rep + h_a, 1.0), 0.0), 1.0));
 
-        H_PROBS2(unit_type::BINARY, unit_type::BINARY, h_a = etl::p_max_pool_h(b_rep + h_a, this->C(), this->C()));
-        H_PROBS2(unit_type::BINARY, unit_type::GAUSSIAN, h_a = etl::p_max_pool_h((1.0 / (0.1 * 0.1)) >> (b_rep + h_a), this->C(), this->C()));
+        // Binary units: the block softmax and the samples are computed in a
+        // single sweep over the blocks
+        H_PROBS(unit_type::BINARY, batch_p_max_pool(h_a, S ? h_s.memory_start() : nullptr, nullptr, nullptr));
         H_PROBS(unit_type::RELU, h_a = max(b_rep + h_a, 0.0));
         H_PROBS(unit_type::RELU6, h_a = min(max(b_rep + h_a, 0.0), 6.0));
         H_PROBS(unit_type::RELU1, h_a = min(max(b_rep + h_a, 0.0), 1.0));
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
+        if constexpr (S && hidden_unit == unit_type::BINARY) {
+            h_s.invalidate_gpu();
+        }
 
         nan_check_deep(h_a);
 
@@ -198,25 +213,45 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         cpp_assert(etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
-        auto b_rep = as_derived().get_batch_b_rep(v_a);
-
         auto h_a = etl::force_temporary(etl::conv_4d_valid_flipped(v_a, as_derived().w));
 
         if (pooling_unit == unit_type::BINARY) {
-            p_a = etl::p_max_pool_p(b_rep + h_a, C(), C());
+            batch_p_max_pool(h_a, nullptr, p_a.memory_start(), S ? p_s.memory_start() : nullptr);
         }
 
+        p_a.invalidate_gpu();
+
         nan_check_etl(p_a);
 
         if (S) {
-            if (pooling_unit == unit_type::BINARY) {
-                p_s = r_bernoulli(p_a);
-            }
+            p_s.invalidate_gpu();
 
             nan_check_etl(p_s);
         }
     }
 
+    /*!
+     * \brief Compute the probabilistic max pooling of a batch of
+     * convolutions with the p_max_pool_kernel.
+     *
+     * \param h_a The convolutions, replaced by the hidden probabilities
+     * \param h_s The output hidden samples, or nullptr
+     * \param p_a The output pooled probabilities, or nullptr
+     * \param p_s The output pooled samples, or nullptr
+     */
+    template <typename H>
+    void batch_p_max_pool(H& h_a, weight* h_s, weight* p_a, weight* p_s) const {
+        const weight scale = visible_unit == unit_type::GAUSSIAN ? 1.0 / (0.1 * 0.1) : 1.0;
+
+        h_a.ensure_cpu_up_to_date();
+        as_derived().b.ensure_cpu_up_to_date();
+
+        p_max_pool_kernel(h_a.memory_start(), h_s, p_a, p_s, as_derived().b.memory_start(),
+                          etl::dim<0>(h_a), etl::dim<1>(h_a), etl::dim<2>(h_a), etl::dim<3>(h_a), C(), scale);
+
+        h_a.invalidate_gpu();
+    }
+
     template <bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2>
     void batch_activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s) const {
         dll::auto_timer timer("crbm:mp:batch_activate_visible");
@@ -224,16 +259,27 @@ struct standard_crbm_mp : public standard_conv_rbm<Derived, Desc> {
         static_assert(visible_unit == unit_type::BINARY || visible_unit == unit_type::GAUSSIAN, "Invalid visible unit type");
         static_assert(P, "Computing S without P is not implemented");
 
-        v_a = etl::conv_4d_full(h_s, as_derived().w);
-
-        auto c_rep = as_derived().get_batch_c_rep(h_s);
-
         const auto Batch = etl::dim<0>(h_a);
         cpp_assert(etl::dim<0>(h_s) == Batch, "The number of batch must be consistent");
         cpp_assert(etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
         cpp_assert(etl::dim<0>(v_s) == Batch, "The number of batch must be consistent");
         cpp_unused(Batch);
 
+        v_a = etl::conv_4d_full(h_s, as_derived().w);
+
+        batch_activate_visible_conv<P, S>(h_s, v_a, v_s);
+    }
+
+    /*!
+     * \brief Compute the visible activation of a batch from the full
+     * convolutions of the hidden units with the filters, already stored in v_a.
+     */
+    template <bool P = true, bool S = true, typename H2, typename V1, typename V2>
+    void batch_activate_visible_conv(const H2& h_s, V1&& v_a, V2&& v_s) const {
+        using namespace etl;
+
+        auto c_rep = as_derived().get_batch_c_rep(h_s);
+
         V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(c_rep + v_a));
         V_PROBS(unit_type::GAUSSIAN, v_a = c_rep + v_a);
 
@@ -20,6 +20,9 @@
 
 #include "dll/util/checks.hpp"    //NaN checks
 #include "dll/util/timers.hpp"    //auto_timer
+#include "dll/util/random.hpp"    //fast_uniform_generator
+#include "dll/util/sparse.hpp"    //sparse_batch
+#include "dll/util/bit_pack.hpp"  //packed_binary_batch
 #include "dll/rbm/rbm_base.hpp"       //The base class
 #include "dll/base_conf.hpp"      //Descriptor configuration
 #include "dll/rbm/rbm_tmp.hpp"        // static_if macros
@@ -51,6 +54,11 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
     static_assert(visible_unit != unit_type::SOFTMAX, "Softmax Visible units are not support");
     static_assert(hidden_unit != unit_type::GAUSSIAN, "Gaussian hidden units are not supported");
 
+    static constexpr bool sparse_input = desc::parameters::template contains<dll::sparse_input>(); ///< Indicates if the inputs are sparse
+    static constexpr bool bit_packed   = desc::parameters::template contains<dll::bit_packed>();   ///< Indicates if the hidden samples are bit-packed
+
+    static_assert(!bit_packed || hidden_unit == unit_type::BINARY, "Only binary hidden samples can be bit-packed");
+
     /*!
      * \brief Construct empty standard_rbm
      */
@@ -187,6 +195,21 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, as_derived().b, as_derived().w);
     }
 
+    /*!
+     * \brief Compute the hidden representation from the given batch of input,
+     * with the given weights and biases
+     * \param h_a The batch output to set the activation probabilities of the hidden representation
+     * \param h_s The batch output to set the activation samples of the hidden representation
+     * \param v_a The batch input activation probabilities of the visible representation
+     * \param v_s The batch input the activation samples of the visible representation
+     * \param b The hidden biases
+     * \param w The weights
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const B& b, const W& w) const {
+        batch_std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w);
+    }
+
     /*!
      * \brief Compute the hidden representation from a given batch of input
      *
@@ -499,8 +522,7 @@ private:
             H_PROBS(unit_type::SOFTMAX, h_a = stable_softmax(b + (v_a * w)));
 
             //Sample values from input
-            H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
-            H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b + (v_a * w)), 0.0));
+                H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(b + (v_a * w)), 0.0));
             H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(b + (v_a * w), 1.0), 0.0), 1.0));
             H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(b + (v_a * w), 6.0), 0.0), 6.0));
             H_SAMPLE_PROBS(unit_type::SOFTMAX, h_s = one_if_max(h_a));
@@ -552,41 +574,63 @@ private:
     static void batch_std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w) {
         dll::auto_timer timer("rbm:std:batch_activate_hidden");
 
+        cpp_assert(etl::dim<0>(h_s) == etl::dim<0>(h_a) && etl::dim<0>(v_a) == etl::dim<0>(h_a), "The number of batch must be consistent");
+
+        if constexpr (sparse_input) {
+            // Only the rows of the weights of the non-zero inputs are used
+            sparse_batch<weight> sv;
+            sv.compress(v_a);
+
+            etl::dyn_matrix<weight, 2> vw(etl::dim<0>(h_a), etl::dim<1>(h_a));
+            sv.multiply(vw, w);
+
+            batch_std_activate_hidden_input<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), vw, b);
+        } else {
+            batch_std_activate_hidden_input<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a * w, b);
+        }
+    }
+
+    /*!
+     * \brief Compute the hidden activations from the product of the visible
+     * units with the weights
+     * \param vw The product v * w, either computed or a lazy expression
+     */
+    template <bool P = true, bool S = true, typename H1, typename H2, typename VW, typename B>
+    static void batch_std_activate_hidden_input(H1&& h_a, H2&& h_s, const VW& vw, const B& b) {
         using namespace etl;
 
         const auto Batch = etl::dim<0>(h_a);
 
-        cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
-
-        H_PROBS(unit_type::BINARY, h_a = etl::sigmoid(rep_l(b, Batch) + v_a * w));
-        H_PROBS(unit_type::RELU, h_a = max(rep_l(b, Batch) + v_a * w, 0.0));
-        H_PROBS(unit_type::RELU1, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 1.0));
-        H_PROBS(unit_type::RELU6, h_a = min(max(rep_l(b, Batch) + v_a * w, 0.0), 6.0));
+        // Binary units: the product is computed directly in the output and
+        // the bias, the sigmoid and the sampling are done in one pass
+        H_PROBS(unit_type::BINARY, h_a = vw; batch_bias_sigmoid<S>(h_a, h_s, b));
+        H_PROBS(unit_type::RELU, h_a = max(rep_l(b, Batch) + vw, 0.0));
+        H_PROBS(unit_type::RELU1, h_a = min(max(rep_l(b, Batch) + vw, 0.0), 1.0));
+        H_PROBS(unit_type::RELU6, h_a = min(max(rep_l(b, Batch) + vw, 0.0), 6.0));
 
         H_PROBS_MULTI(unit_type::SOFTMAX){
-            auto x = etl::force_temporary(rep_l(b, Batch) + v_a * w);
+            auto x = etl::force_temporary(rep_l(b, Batch) + vw);
 
             for (size_t b = 0; b < Batch; ++b) {
                 h_a(b) = stable_softmax(x(b));
             }
         }
 
-        H_SAMPLE_PROBS(unit_type::BINARY, h_s = bernoulli(h_a));
-        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
-        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
-        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
+        H_SAMPLE_PROBS(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + vw), 0.0));
+        H_SAMPLE_PROBS(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + vw, 1.0), 0.0), 1.0));
+        H_SAMPLE_PROBS(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + vw, 6.0), 0.0), 6.0));
         H_SAMPLE_PROBS_MULTI(unit_type::SOFTMAX){
             for (size_t b = 0; b < Batch; ++b) {
                 h_s(b) = stable_softmax(h_a(b));
             }
         }
 
-        H_SAMPLE_INPUT(unit_type::BINARY, h_s = bernoulli(etl::sigmoid(rep_l(b, Batch) + v_a * w)));
-        H_SAMPLE_INPUT(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + v_a * w), 0.0));
-        H_SAMPLE_INPUT(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 1.0), 0.0), 1.0));
-        H_SAMPLE_INPUT(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + v_a * w, 6.0), 0.0), 6.0));
+        H_SAMPLE_INPUT(unit_type::BINARY, h_s = vw; batch_bias_sigmoid<true>(h_s, h_s, b));
+        H_SAMPLE_INPUT(unit_type::RELU, h_s = max(logistic_noise(rep_l(b, Batch) + vw), 0.0));
+        H_SAMPLE_INPUT(unit_type::RELU1, h_s = min(max(ranged_noise(rep_l(b, Batch) + vw, 1.0), 0.0), 1.0));
+        H_SAMPLE_INPUT(unit_type::RELU6, h_s = min(max(ranged_noise(rep_l(b, Batch) + vw, 6.0), 0.0), 6.0));
         H_SAMPLE_INPUT_MULTI(unit_type::RELU1){
-            auto x = etl::force_temporary(rep_l(b, Batch) + v_a * w);
+            auto x = etl::force_temporary(rep_l(b, Batch) + vw);
 
             for (size_t b = 0; b < Batch; ++b) {
                 h_s(b) = one_if_max(stable_softmax(x(b)));
@@ -612,13 +656,37 @@ private:
 
         cpp_assert(etl::dim<0>(h_s) == Batch && etl::dim<0>(v_a) == Batch, "The number of batch must be consistent");
 
-        V_PROBS(unit_type::BINARY, v_a = etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s))));
-        V_PROBS(unit_type::GAUSSIAN, v_a = rep_l(c, Batch) + transpose(w * transpose(h_s)));
-        V_PROBS(unit_type::RELU, v_a = max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0));
+        if constexpr (bit_packed) {
+            // Only the weights of the active hidden units are added
+            packed_binary_batch<weight> hp;
+            hp.pack(h_s);
+
+            etl::dyn_matrix<weight, 2> hw(Batch, etl::dim<0>(w));
+            hp.multiply_transpose(hw, w);
+
+            batch_std_activate_visible_input<P, S>(std::forward<V>(v_a), std::forward<V>(v_s), hw, c);
+        } else {
+            // h_s * w^T is computed directly, without transposing the product
+            batch_std_activate_visible_input<P, S>(std::forward<V>(v_a), std::forward<V>(v_s), h_s * transpose(w), c);
+        }
+    }
+
+    /*!
+     * \brief Compute the visible activations from the product of the hidden
+     * units with the transposed weights
+     * \param hw The product h * w^T, either computed or a lazy expression
+     */
+    template <bool P = true, bool S = true, typename V, typename HW, typename C>
+    static void batch_std_activate_visible_input(V&& v_a, V&& v_s, const HW& hw, const C& c) {
+        using namespace etl;
 
-        V_SAMPLE_INPUT(unit_type::BINARY, v_s = bernoulli(etl::sigmoid(rep_l(c, Batch) + transpose(w * transpose(h_s)))));
-        V_SAMPLE_INPUT(unit_type::GAUSSIAN, v_s = normal_noise(rep_l(c, Batch) + transpose(w * transpose(h_s))));
-        V_SAMPLE_INPUT(unit_type::RELU, v_s = logistic_noise(max(rep_l(c, Batch) + transpose(w * transpose(h_s)), 0.0)));
+        V_PROBS(unit_type::BINARY, v_a = hw; batch_bias_sigmoid<false>(v_a, v_a, c));
+        V_PROBS(unit_type::GAUSSIAN, v_a = bias_add_2d(hw, c));
+        V_PROBS(unit_type::RELU, v_a = max(bias_add_2d(hw, c), 0.0));
+
+        V_SAMPLE_INPUT(unit_type::BINARY, v_s = hw; batch_bias_sigmoid<true>(v_s, v_s, c));
+        V_SAMPLE_INPUT(unit_type::GAUSSIAN, v_s = normal_noise(bias_add_2d(hw, c)));
+        V_SAMPLE_INPUT(unit_type::RELU, v_s = logistic_noise(max(bias_add_2d(hw, c), 0.0)));
 
         if (P) {
             nan_check_deep(v_a);
@@ -629,6 +697,104 @@ private:
         }
     }
 
+    /*!
+     * \brief Compute the activation probabilities of binary units from their
+     * input and, optionally, sample them, in a single pass.
+     *
+     * The input of the units must already be stored in x. x is overwritten
+     * with the probabilities and s receives the samples. x and s can be the
+     * same container, in which case only the samples are kept.
+     *
+     * \tparam Sample Indicates if the units must be sampled
+     * \param x The input of the units, then their probabilities
+     * \param s The samples of the units
+     * \param bias The biases of the units
+     */
+    template <bool Sample, typename X, typename S, typename Bias>
+    static void batch_bias_sigmoid(X&& x, S&& s, const Bias& bias) {
+        fast_uniform_generator g(dll::rand_engine());
+
+        batch_bias_sigmoid<Sample>(x, s, bias, 1.0, g);
+    }
+
+    /*!
+     * \brief Compute the activation probabilities of binary units at the
+     * given inverse temperature and, optionally, sample them with the given
+     * generator, in a single pass.
+     *
+     * \tparam Sample Indicates if the units must be sampled
+     * \param x The input of the units, then their probabilities
+     * \param s The samples of the units
+     * \param bias The biases of the units
+     * \param beta The inverse temperature
+     * \param g The generator used for sampling
+     */
+    template <bool Sample, typename X, typename S, typename Bias>
+    static void batch_bias_sigmoid(X&& x, S&& s, const Bias& bias, double beta, fast_uniform_generator& g) {
+        using value_t = etl::value_t<std::decay_t<X>>;
+
+        static constexpr size_t block = 256;
+
+        const size_t N = etl::size(bias);
+        const size_t n = etl::size(x);
+
+        cpp_assert(n % N == 0, "Invalid number of units");
+
+        // With CUDA, the units stay on the device: the bias, the sigmoid and
+        // the sampling are done by the device kernels of ETL, instead of a
+        // round trip to the host at each activation
+        if constexpr (etl::cuda_enabled) {
+            cpp_unused(g);
+
+            auto x_b = etl::reshape(x, n / N, N);
+
+            x_b = etl::sigmoid(value_t(beta) * (x_b + etl::rep_l(bias, n / N)));
+
+            if (Sample) {
+                auto s_b = etl::reshape(s, n / N, N);
+
+                s_b = etl::bernoulli(x_b);
+            }
+
+            return;
+        }
+
+        x.ensure_cpu_up_to_date();
+        bias.ensure_cpu_up_to_date();
+
+        auto* x_ptr       = x.memory_start();
+        auto* s_ptr       = s.memory_start();
+        const auto* b_ptr = bias.memory_start();
+
+        const value_t t = beta;
+
+        value_t u[block];
+
+        for (size_t i = 0; i < n; i += block) {
+            const size_t m = std::min(block, n - i);
+
+            if (Sample) {
+                g.generate(u, m);
+            }
+
+            for (size_t j = 0; j < m; ++j) {
+                const value_t p = value_t(1) / (value_t(1) + std::exp(-t * (x_ptr[i + j] + b_ptr[(i + j) % N])));
+
+                x_ptr[i + j] = p;
+
+                if (Sample) {
+                    s_ptr[i + j] = u[j] < p ? value_t(1) : value_t(0);
+                }
+            }
+        }
+
+        x.invalidate_gpu();
+
+        if (Sample) {
+            s.invalidate_gpu();
+        }
+    }
+
     /*!
      * \brief Returns a reference to the derived object, i.e. the object using the CRTP injector.
      * \return a reference to the derived object.
@@ -12,7 +12,14 @@
 
 #ifdef DLL_SVM_SUPPORT
 
-#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
 
 #include "cpp_utils/io.hpp"
 #include "nice_svm.hpp"
@@ -31,31 +38,504 @@ inline svm_parameter default_svm_parameters() {
     return parameters;
 }
 
+namespace svm_detail {
+
+/*!
+ * \brief Write an array of n values to the stream
+ */
+template <typename T>
+void write_array(std::ostream& os, const T* values, size_t n) {
+    os.write(reinterpret_cast<const char*>(values), n * sizeof(T));
+}
+
+/*!
+ * \brief Read an array of n values (allocated with malloc, as libsvm
+ * expects) from the stream
+ */
+template <typename T>
+T* read_array(std::istream& is, size_t n) {
+    auto* values = static_cast<T*>(std::malloc(std::max<size_t>(n, 1) * sizeof(T)));
+    is.read(reinterpret_cast<char*>(values), n * sizeof(T));
+    return values;
+}
+
+/*!
+ * \brief A view on one row of a feature matrix, as a sample for building a
+ * libsvm problem
+ */
+template <typename T>
+struct feature_row {
+    const T* values; ///< The features of the sample
+    size_t n;        ///< The number of features
+
+    /*!
+     * \brief Returns the number of features
+     */
+    size_t size() const {
+        return n;
+    }
+
+    /*!
+     * \brief Returns the ith feature
+     */
+    T operator[](size_t i) const {
+        return values[i];
+    }
+};
+
+/*!
+ * \brief Returns the views on the rows of a feature matrix (one row per
+ * sample), without copying the features
+ */
+template <typename Features>
+std::vector<feature_row<etl::value_t<Features>>> feature_rows(const Features& features) {
+    std::vector<feature_row<etl::value_t<Features>>> rows;
+
+    const size_t n = etl::dim<0>(features);
+    const size_t m = etl::dim<1>(features);
+
+    rows.reserve(n);
+
+    features.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < n; ++i) {
+        rows.push_back({features.memory_start() + i * m, m});
+    }
+
+    return rows;
+}
+
+/*!
+ * \brief A libsvm problem whose memory is owned by the problem itself
+ */
+struct owned_problem {
+    std::vector<svm_node> nodes;  ///< The nodes of all the samples
+    std::vector<svm_node*> rows;  ///< The first node of each sample
+    std::vector<double> labels;   ///< The label of each sample
+    svm_problem sub;              ///< The libsvm view of the problem
+
+    /*!
+     * \brief Point the libsvm view to the samples of the problem
+     */
+    void finalize() {
+        sub.l = rows.size();
+        sub.y = labels.data();
+        sub.x = rows.data();
+    }
+};
+
+/*!
+ * \brief Build a dense problem (one node per feature) from a feature matrix
+ */
+template <typename Features>
+void dense_problem(owned_problem& problem, const Features& features, const std::vector<double>& labels) {
+    const size_t n = etl::dim<0>(features);
+    const size_t m = etl::dim<1>(features);
+
+    problem.nodes.resize(n * (m + 1));
+    problem.rows.resize(n);
+    problem.labels = labels;
+
+    for (size_t i = 0; i < n; ++i) {
+        svm_node* row = problem.nodes.data() + i * (m + 1);
+
+        for (size_t j = 0; j < m; ++j) {
+            row[j].index = j + 1;
+            row[j].value = features(i, j);
+        }
+
+        row[m].index = -1;
+
+        problem.rows[i] = row;
+    }
+
+    problem.finalize();
+}
+
+/*!
+ * \brief Build a problem with a precomputed RBF kernel from the squared
+ * distances between the samples.
+ *
+ * The first node of each sample is its serial number, as libsvm expects
+ * for precomputed kernels. Any subset of the samples is then a valid problem
+ * on the same kernel.
+ */
+template <typename Distances>
+void kernel_problem(owned_problem& problem, const Distances& distances, const std::vector<double>& labels, double gamma) {
+    const size_t n = etl::dim<0>(distances);
+
+    problem.nodes.resize(n * (n + 2));
+    problem.rows.resize(n);
+    problem.labels = labels;
+
+    dll::parallel_for(n, [&](size_t i) {
+        svm_node* row = problem.nodes.data() + i * (n + 2);
+
+        row[0].index = 0;
+        row[0].value = i + 1;
+
+        for (size_t j = 0; j < n; ++j) {
+            row[j + 1].index = j + 1;
+            row[j + 1].value = std::exp(-gamma * distances(i, j));
+        }
+
+        row[n + 1].index = -1;
+
+        problem.rows[i] = row;
+    });
+
+    problem.finalize();
+}
+
+/*!
+ * \brief Assign each sample to a fold, the classes being stratified over the
+ * folds
+ */
+inline std::vector<size_t> make_folds(const std::vector<double>& labels, size_t n_fold) {
+    std::vector<size_t> order(labels.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    std::shuffle(order.begin(), order.end(), dll::rand_engine());
+    std::stable_sort(order.begin(), order.end(), [&labels](size_t a, size_t b) { return labels[a] < labels[b]; });
+
+    std::vector<size_t> folds(labels.size());
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        folds[order[i]] = i % n_fold;
+    }
+
+    return folds;
+}
+
+/*!
+ * \brief Train on all the folds but one and count the correct predictions
+ * on the remaining fold
+ */
+inline size_t evaluate_fold(const svm_problem& problem, const std::vector<size_t>& folds, size_t fold, const svm_parameter& parameters) {
+    std::vector<svm_node*> rows;
+    std::vector<double> labels;
+
+    for (int i = 0; i < problem.l; ++i) {
+        if (folds[i] != fold) {
+            rows.push_back(problem.x[i]);
+            labels.push_back(problem.y[i]);
+        }
+    }
+
+    svm_problem sub;
+    sub.l = rows.size();
+    sub.y = labels.data();
+    sub.x = rows.data();
+
+    svm_model* model = svm_train(&sub, &parameters);
+
+    size_t correct = 0;
+
+    for (int i = 0; i < problem.l; ++i) {
+        if (folds[i] == fold && svm_predict(model, problem.x[i]) == problem.y[i]) {
+            ++correct;
+        }
+    }
+
+    svm_free_and_destroy_model(&model);
+
+    return correct;
+}
+
+/*!
+ * \brief Scale each feature to [0, 1] (min-max scaling over the samples)
+ */
+template <typename Features>
+void scale_features(Features& features) {
+    using weight = etl::value_t<Features>;
+
+    const size_t n = etl::dim<0>(features);
+    const size_t m = etl::dim<1>(features);
+
+    for (size_t j = 0; j < m; ++j) {
+        weight min = std::numeric_limits<weight>::max();
+        weight max = std::numeric_limits<weight>::lowest();
+
+        for (size_t i = 0; i < n; ++i) {
+            min = std::min(min, features(i, j));
+            max = std::max(max, features(i, j));
+        }
+
+        const weight range = max > min ? max - min : weight(1);
+
+        for (size_t i = 0; i < n; ++i) {
+            features(i, j) = (features(i, j) - min) / range;
+        }
+    }
+}
+
+/*!
+ * \brief Returns steps values from first to last (included), spaced in log
+ * scale
+ */
+inline std::vector<double> log_values(double first, double last, size_t steps) {
+    std::vector<double> values;
+
+    if (steps < 2) {
+        values.push_back(first);
+        return values;
+    }
+
+    const double a = std::log(first);
+    const double b = std::log(last);
+
+    for (size_t i = 0; i < steps; ++i) {
+        values.push_back(std::exp(a + (b - a) * i / (steps - 1)));
+    }
+
+    return values;
+}
+
+} // end of namespace svm_detail
+
+/*!
+ * \brief The result of a grid search
+ */
+struct svm_grid_result {
+    double C        = 0.0; ///< The best value of C
+    double gamma    = 0.0; ///< The best value of gamma
+    double accuracy = 0.0; ///< The cross-validated accuracy of the best point
+};
+
+/*!
+ * \brief Search the best C and gamma of an RBF SVM on the given features,
+ * with cross-validation.
+ *
+ * All the (C, fold) trainings of a gamma run in parallel. When the samples
+ * are not too numerous, the squared distances between the samples are
+ * computed once (with a matrix product) and each gamma uses the RBF kernel
+ * precomputed from them, shared by all its trainings. The grid is explored
+ * in log scale. The best point is then refined on a grid twice as fine
+ * around it, until a refinement does not improve the accuracy anymore.
+ *
+ * \param features The features of the samples (one row per sample)
+ * \param labels The label of each sample
+ * \param n_fold The number of folds
+ * \param g The grid of C and gamma values
+ * \param parameters The parameters of the SVM
+ *
+ * \return The best point of the grid
+ */
+template <typename Features>
+svm_grid_result svm_parallel_grid_search(const Features& features, const std::vector<double>& labels, size_t n_fold, const svm::rbf_grid& g, svm_parameter parameters) {
+    // The maximum number of samples for a precomputed kernel
+    constexpr size_t max_precomputed = 2048;
+
+    // The maximum number of refinements of the best point
+    constexpr size_t refinements = 3;
+
+    using weight = etl::value_t<Features>;
+
+    const size_t n = etl::dim<0>(features);
+
+    svm_grid_result best;
+
+    if (!n || n_fold < 2 || n_fold > n) {
+        std::cerr << "ERROR: Invalid number of folds for the grid search" << std::endl;
+        return best;
+    }
+
+    // Only the accuracy is necessary, not the probabilities
+    parameters.probability = 0;
+
+    const bool precomputed = n <= max_precomputed;
+
+    etl::dyn_matrix<weight, 2> distances;
+    svm_detail::owned_problem problem;
+
+    if (precomputed) {
+        etl::dyn_matrix<weight, 2> products = features * etl::transpose(features);
+
+        distances = etl::dyn_matrix<weight, 2>(n, n);
+
+        dll::parallel_for(n, [&](size_t i) {
+            for (size_t j = 0; j < n; ++j) {
+                distances(i, j) = std::max(weight(0), products(i, i) + products(j, j) - 2 * products(i, j));
+            }
+        });
+
+        parameters.kernel_type = PRECOMPUTED;
+    } else {
+        svm_detail::dense_problem(problem, features, labels);
+
+        parameters.kernel_type = RBF;
+    }
+
+    const auto folds = svm_detail::make_folds(labels, n_fold);
+
+    // The points to evaluate: the C values of each gamma
+    using points_t = std::vector<std::pair<double, std::vector<double>>>;
+
+    // Evaluate the given points, returns true if the best point improved
+    auto evaluate = [&](const points_t& points) {
+        bool improved = false;
+
+        for (auto& [gamma, c_values] : points) {
+            if (precomputed) {
+                svm_detail::kernel_problem(problem, distances, labels, gamma);
+            }
+
+            std::vector<size_t> correct(c_values.size() * n_fold);
+
+            dll::parallel_for(correct.size(), [&, gamma = gamma](size_t t) {
+                auto task_parameters  = parameters;
+                task_parameters.C     = c_values[t / n_fold];
+                task_parameters.gamma = gamma;
+
+                correct[t] = svm_detail::evaluate_fold(problem.sub, folds, t % n_fold, task_parameters);
+            });
+
+            for (size_t c = 0; c < c_values.size(); ++c) {
+                const double accuracy = std::accumulate(correct.begin() + c * n_fold, correct.begin() + (c + 1) * n_fold, size_t(0)) / double(n);
+
+                std::cout << "C=" << c_values[c] << " gamma=" << gamma << " accuracy=" << 100.0 * accuracy << "%" << std::endl;
+
+                if (accuracy > best.accuracy) {
+                    best.C        = c_values[c];
+                    best.gamma    = gamma;
+                    best.accuracy = accuracy;
+                    improved      = true;
+                }
+            }
+        }
+
+        return improved;
+    };
+
+    const auto c_values = svm_detail::log_values(g.c_first, g.c_last, g.c_steps);
+
+    points_t grid;
+
+    for (auto gamma : svm_detail::log_values(g.gamma_first, g.gamma_last, g.gamma_steps)) {
+        grid.emplace_back(gamma, c_values);
+    }
+
+    evaluate(grid);
+
+    // Refine around the best point, with twice finer steps each time
+
+    double c_step     = g.c_steps > 1 ? std::pow(g.c_last / g.c_first, 1.0 / (g.c_steps - 1)) : 2.0;
+    double gamma_step = g.gamma_steps > 1 ? std::pow(g.gamma_last / g.gamma_first, 1.0 / (g.gamma_steps - 1)) : 2.0;
+
+    for (size_t r = 0; r < refinements; ++r) {
+        c_step     = std::sqrt(c_step);
+        gamma_step = std::sqrt(gamma_step);
+
+        const double C     = best.C;
+        const double gamma = best.gamma;
+
+        // The eight neighbours of the best point
+        const points_t neighbours{
+            {gamma / gamma_step, {C / c_step, C, C * c_step}},
+            {gamma, {C / c_step, C * c_step}},
+            {gamma * gamma_step, {C / c_step, C, C * c_step}}};
+
+        // The region around the best point is worse, stop early
+        if (!evaluate(neighbours)) {
+            break;
+        }
+    }
+
+    std::cout << "Best: C=" << best.C << " gamma=" << best.gamma << " accuracy=" << 100.0 * best.accuracy << "%" << std::endl;
+
+    return best;
+}
+
+/*!
+ * \brief Store the SVM model of the network directly into the stream.
+ *
+ * The model is written in binary form: the kernel parameters, the classes,
+ * the decision functions and the support vectors (all in one array of nodes,
+ * each vector being terminated by a -1 index, as in libsvm).
+ */
 template <typename DBN>
 void svm_store(const DBN& dbn, std::ostream& os) {
     if (dbn.svm_loaded) {
         cpp::binary_write(os, true);
 
-        svm::save(dbn.svm_model, "..tmp.svm");
+        const svm_model* model = const_cast<DBN&>(dbn).svm_model.get_model();
+
+        const size_t k = model->nr_class;
+        const size_t l = model->l;
+        const size_t p = k * (k - 1) / 2;
 
-        std::ifstream svm_is("..tmp.svm", std::ios::binary);
+        cpp::binary_write(os, model->param.svm_type);
+        cpp::binary_write(os, model->param.kernel_type);
+        cpp::binary_write(os, model->param.degree);
+        cpp::binary_write(os, model->param.gamma);
+        cpp::binary_write(os, model->param.coef0);
 
-        char buffer[1024];
+        cpp::binary_write(os, model->nr_class);
+        cpp::binary_write(os, model->l);
 
-        while (true) {
-            svm_is.read(buffer, 1024);
+        svm_detail::write_array(os, model->rho, p);
+
+        cpp::binary_write(os, bool(model->label));
+        cpp::binary_write(os, bool(model->probA));
+        cpp::binary_write(os, bool(model->probB));
+        cpp::binary_write(os, bool(model->nSV));
+
+        if (model->label) {
+            svm_detail::write_array(os, model->label, k);
+        }
+
+        if (model->probA) {
+            svm_detail::write_array(os, model->probA, p);
+        }
 
-            if (svm_is.gcount() == 0) {
-                break;
+        if (model->probB) {
+            svm_detail::write_array(os, model->probB, p);
+        }
+
+        if (model->nSV) {
+            svm_detail::write_array(os, model->nSV, k);
+        }
+
+        for (size_t c = 0; c + 1 < k; ++c) {
+            svm_detail::write_array(os, model->sv_coef[c], l);
+        }
+
+        // All the support vectors, with their terminators
+
+        size_t nodes = 0;
+
+        for (size_t i = 0; i < l; ++i) {
+            const svm_node* node = model->SV[i];
+
+            while (node[0].index != -1) {
+                ++node;
+            }
+
+            nodes += node - model->SV[i] + 1;
+        }
+
+        cpp::binary_write(os, nodes);
+
+        for (size_t i = 0; i < l; ++i) {
+            const svm_node* node = model->SV[i];
+
+            while (node[0].index != -1) {
+                ++node;
             }
 
-            os.write(buffer, svm_is.gcount());
+            svm_detail::write_array(os, model->SV[i], node - model->SV[i] + 1);
         }
     } else {
         cpp::binary_write(os, false);
     }
 }
 
+/*!
+ * \brief Load the SVM model of the network directly from the stream.
+ *
+ * The model is rebuilt in memory as libsvm builds it when loading a model
+ * file, so that it is freed by libsvm.
+ */
 template <typename DBN>
 void svm_load(DBN& dbn, std::istream& is) {
     dbn.svm_loaded = false;
@@ -65,25 +545,99 @@ void svm_load(DBN& dbn, std::istream& is) {
         cpp::binary_load(is, svm);
 
         if (svm) {
-            std::ofstream svm_os("..tmp.svm", std::ios::binary);
+            auto* model = static_cast<svm_model*>(std::malloc(sizeof(svm_model)));
+            std::memset(model, 0, sizeof(svm_model));
+
+            cpp::binary_load(is, model->param.svm_type);
+            cpp::binary_load(is, model->param.kernel_type);
+            cpp::binary_load(is, model->param.degree);
+            cpp::binary_load(is, model->param.gamma);
+            cpp::binary_load(is, model->param.coef0);
+
+            cpp::binary_load(is, model->nr_class);
+            cpp::binary_load(is, model->l);
+
+            if (!is || model->nr_class < 1 || model->l < 0) {
+                std::free(model);
+                std::cerr << "ERROR: Invalid SVM model" << std::endl;
+                return;
+            }
+
+            const size_t k = model->nr_class;
+            const size_t l = model->l;
+            const size_t p = k * (k - 1) / 2;
+
+            model->rho = svm_detail::read_array<double>(is, p);
 
-            char buffer[1024];
+            bool label;
+            bool prob_a;
+            bool prob_b;
+            bool n_sv;
 
-            while (true) {
-                is.read(buffer, 1024);
+            cpp::binary_load(is, label);
+            cpp::binary_load(is, prob_a);
+            cpp::binary_load(is, prob_b);
+            cpp::binary_load(is, n_sv);
+
+            if (label) {
+                model->label = svm_detail::read_array<int>(is, k);
+            }
 
-                if (is.gcount() == 0) {
-                    break;
+            if (prob_a) {
+                model->probA = svm_detail::read_array<double>(is, p);
+            }
+
+            if (prob_b) {
+                model->probB = svm_detail::read_array<double>(is, p);
+            }
+
+            if (n_sv) {
+                model->nSV = svm_detail::read_array<int>(is, k);
+            }
+
+            model->sv_coef = static_cast<double**>(std::malloc(std::max<size_t>(k - 1, 1) * sizeof(double*)));
+
+            for (size_t c = 0; c + 1 < k; ++c) {
+                model->sv_coef[c] = svm_detail::read_array<double>(is, l);
+            }
+
+            // All the support vectors are in a single block, freed by libsvm
+            // with the model (free_sv)
+
+            size_t nodes = 0;
+            cpp::binary_load(is, nodes);
+
+            auto* x_space = svm_detail::read_array<svm_node>(is, is ? nodes : 0);
+
+            model->SV      = static_cast<svm_node**>(std::malloc(std::max<size_t>(l, 1) * sizeof(svm_node*)));
+            model->free_sv = 1;
+
+            size_t j = 0;
+
+            for (size_t i = 0; i < l; ++i) {
+                model->SV[i] = x_space + j;
+
+                while (is && j < nodes && x_space[j].index != -1) {
+                    ++j;
                 }
 
-                svm_os.write(buffer, is.gcount());
+                ++j;
             }
 
-            svm_os.close();
+            if (!is || j != nodes) {
+                std::cerr << "ERROR: Invalid SVM model" << std::endl;
+
+                // Make sure libsvm does not read invalid vectors
+                model->l = 0;
+            }
+
+            if (!model->l) {
+                std::free(x_space);
+            }
 
-            dbn.svm_model = svm::load("..tmp.svm");
+            dbn.svm_model = svm::model(model);
 
-            dbn.svm_loaded = true;
+            dbn.svm_loaded = bool(is) && j == nodes;
         }
     }
 }
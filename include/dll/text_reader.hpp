@@ -8,6 +8,10 @@
 /*!
  * \file
  * \brief Contains reader functions to read from a "text" format
+ *
+ * Each sample is stored in its own file (<id>.dat, starting from 1), one
+ * line of values (separated by ';') per row. The files are read and parsed
+ * in parallel, each thread parsing into its own reusable buffer.
  */
 
 #pragma once
@@ -18,22 +22,48 @@
 #include <vector>
 #include <cstdint>
 #include <memory>
+#include <atomic>
+#include <algorithm>
+#include <charconv>
 
 #include <dirent.h>
 
 #include "cpp_utils/tmp.hpp"
 #include "etl/etl_light.hpp"
 
+#include "dll/util/parallel.hpp"
+#include "dll/generators/mmap_dataset.hpp"
+
 namespace dll {
 namespace text {
 
-template<typename Container, typename Functor>
-void read_images(Container& images, const std::string& path, size_t limit, Functor func){
-    using Image = typename Container::value_type;
+namespace detail {
+
+/*!
+ * \brief A file of the text format
+ */
+struct text_file {
+    size_t id;        ///< The id of the file (starting from 1)
+    std::string path; ///< The full path of the file
+};
+
+/*!
+ * \brief List the files of the given directory, sorted by id.
+ * \param path The path of the directory
+ * \param limit The maximum id of the files (0 for all files)
+ */
+inline std::vector<text_file> list_files(const std::string& path, size_t limit) {
+    std::vector<text_file> files;
 
-    struct dirent* entry;
     auto dir = opendir(path.c_str());
 
+    if (!dir) {
+        std::cerr << "ERROR: Impossible to open " << path << std::endl;
+        return files;
+    }
+
+    struct dirent* entry;
+
     while ((entry = readdir(dir))) {
         std::string file_name(entry->d_name);
 
@@ -43,77 +73,162 @@ void read_images(Container& images, const std::string& path, size_t limit, Funct
 
         int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
 
-        if(!limit || id - 1 < (int) limit){
-            std::vector<double> temp;
+        if (id > 0 && (!limit || size_t(id) <= limit)) {
+            files.push_back({size_t(id), path + "/" + file_name});
+        }
+    }
+
+    closedir(dir);
 
-            std::string full_path(path + "/" + file_name);
+    std::sort(files.begin(), files.end(), [](auto& lhs, auto& rhs) { return lhs.id < rhs.id; });
 
-            std::ifstream file(full_path);
+    return files;
+}
 
-            size_t lines = 0;
-            size_t columns = 0;
+/*!
+ * \brief Read the complete contents of a file into the given buffer
+ * \return true if the file was read, false otherwise
+ */
+inline bool read_file(const std::string& path, std::string& buffer) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
 
-            // There is a bug in G++7.1 that causes this false positive
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstrict-aliasing"
-            std::string line;
-            while (std::getline(file, line)) {
-                std::istringstream ss(line);
-                std::string value;
+    if (!file) {
+        return false;
+    }
 
-                while (std::getline(ss, value, ';')) {
-                    auto v = std::atof(value.c_str());
-                    temp.push_back(v);
+    buffer.resize(size_t(file.tellg()));
 
-                    if(lines == 0){
-                        ++columns;
-                    }
-                }
+    file.seekg(0);
+    file.read(&buffer[0], buffer.size());
 
-                ++lines;
-            }
-#pragma GCC diagnostic pop
+    return bool(file);
+}
+
+/*!
+ * \brief Parse the values of a file, separated by ';', one row per line.
+ *
+ * The values that cannot be parsed are read as zero.
+ *
+ * \param buffer The contents of the file
+ * \param values The parsed values
+ * \param lines The number of lines of the file
+ * \param columns The number of values of the first line
+ */
+inline void parse_values(const std::string& buffer, std::vector<double>& values, size_t& lines, size_t& columns) {
+    values.clear();
+
+    lines   = 0;
+    columns = 0;
+
+    const char* it  = buffer.data();
+    const char* end = it + buffer.size();
 
-            if((int) images.size() < id){
-                images.resize(id);
+    while (it != end) {
+        const char c = *it;
+
+        if (c == '\n') {
+            ++lines;
+            ++it;
+        } else if (c == ';' || c == ' ' || c == '\t' || c == '\r') {
+            ++it;
+        } else {
+            double value = 0.0;
+
+            auto result = std::from_chars(it, end, value);
+
+            if (result.ec == std::errc()) {
+                it = result.ptr;
+            } else {
+                value = 0.0;
+
+                while (it != end && *it != ';' && *it != '\n') {
+                    ++it;
+                }
             }
 
-            images[id - 1] = func(1, lines, columns);
+            values.push_back(value);
 
-            size_t i = 0;
-            for (auto& value : temp) {
-                images[id - 1][i++] = static_cast<typename Image::value_type>(value);
+            if (lines == 0) {
+                ++columns;
             }
         }
     }
+
+    if (!buffer.empty() && buffer.back() != '\n') {
+        ++lines;
+    }
 }
 
-template<template<typename...> typename  Container = std::vector, typename Label = uint8_t>
-void read_labels(Container<Label>& labels, const std::string& path, size_t limit = 0){
-    struct dirent* entry;
-    auto dir = opendir(path.c_str());
+/*!
+ * \brief Call work(file, values, lines, columns) for each file, with its
+ * parsed values, in parallel.
+ */
+template <typename Functor>
+void parse_files(const std::vector<text_file>& files, size_t first, size_t last, Functor&& work) {
+    parallel_chunks(last - first, std::max(size_t(1), kernel_threads()), [&](size_t /*chunk*/, size_t begin, size_t end) {
+        std::string buffer;
+        std::vector<double> values;
+
+        size_t lines   = 0;
+        size_t columns = 0;
+
+        for (size_t f = first + begin; f < first + end; ++f) {
+            if (!read_file(files[f].path, buffer)) {
+                buffer.clear();
+            }
 
-    while ((entry = readdir(dir))) {
-        std::string file_name(entry->d_name);
+            parse_values(buffer, values, lines, columns);
 
-        if (file_name.size() <= 3 || file_name.find(".dat") != file_name.size() - 4) {
-            continue;
+            work(f, values, lines, columns);
         }
+    });
+}
 
-        int id = std::atoi(std::string(file_name.begin(), file_name.begin() + file_name.size() - 4).c_str());
+} //end of namespace detail
+
+template<typename Container, typename Functor>
+void read_images(Container& images, const std::string& path, size_t limit, Functor func){
+    using Image = typename Container::value_type;
+
+    auto files = detail::list_files(path, limit);
+
+    if (files.empty()) {
+        return;
+    }
+
+    if (images.size() < files.back().id) {
+        images.resize(files.back().id);
+    }
+
+    // Each thread constructs its own images, in place
+    detail::parse_files(files, 0, files.size(), [&](size_t f, const std::vector<double>& values, size_t lines, size_t columns) {
+        auto& image = images[files[f].id - 1];
 
-        if((int) labels.size() < id){
-            labels.resize(id);
+        image = func(1, lines, columns);
+
+        size_t i = 0;
+        for (auto& value : values) {
+            image[i++] = static_cast<typename Image::value_type>(value);
         }
+    });
+}
+
+template<template<typename...> typename  Container = std::vector, typename Label = uint8_t>
+void read_labels(Container<Label>& labels, const std::string& path, size_t limit = 0){
+    auto files = detail::list_files(path, limit);
 
-        std::string full_path(path + "/" + file_name);
+    if (files.empty()) {
+        return;
+    }
 
-        std::ifstream file(full_path);
-        int value;
-        file >> value;
-        labels[id - 1] = static_cast<Label>(value);
+    if (labels.size() < files.back().id) {
+        labels.resize(files.back().id);
     }
 
+    detail::parse_files(files, 0, files.size(), [&](size_t f, const std::vector<double>& values, size_t /*lines*/, size_t /*columns*/) {
+        labels[files[f].id - 1] = static_cast<Label>(values.empty() ? 0 : int(values.front()));
+    });
+
     if(limit && labels.size() > limit){
         labels.resize(limit);
     }
@@ -148,5 +263,88 @@ Container<Label> read_labels(const std::string& path, size_t limit){
     return labels;
 }
 
+/*!
+ * \brief Convert a dataset in the text format into the memory-mapped
+ * format, to be used with dll::make_mmap_generator.
+ *
+ * The samples are parsed in parallel, block by block, directly into the
+ * contiguous records of the block, and the samples are never all held in
+ * memory. The samples are stored in the order of their ids (1 x rows x
+ * columns), all the files must have the same dimensions as the first one.
+ *
+ * \param output The path of the file to write
+ * \param images_path The directory of the images
+ * \param labels_path The directory of the labels
+ * \param n_classes The number of classes
+ * \param type The type of value to store in the file
+ * \param limit The maximum id of the samples (0 for all samples)
+ *
+ * \return true if the dataset was written, false otherwise
+ */
+inline bool convert_to_mmap(const std::string& output, const std::string& images_path, const std::string& labels_path, size_t n_classes,
+                            mmap_dataset_type type = mmap_dataset_type::FLOAT, size_t limit = 0) {
+    // The number of samples parsed at once
+    constexpr size_t block = 4096;
+
+    auto files  = detail::list_files(images_path, limit);
+    auto labels = read_labels<std::vector, uint32_t>(labels_path, limit);
+
+    if (files.empty() || labels.size() < files.back().id) {
+        std::cerr << "ERROR: Invalid text dataset for " << output << std::endl;
+        return false;
+    }
+
+    // The dimensions of all the samples are the dimensions of the first one
+
+    std::string buffer;
+    std::vector<double> first_values;
+    size_t rows    = 0;
+    size_t columns = 0;
+
+    if (!detail::read_file(files.front().path, buffer)) {
+        std::cerr << "ERROR: Impossible to read " << files.front().path << std::endl;
+        return false;
+    }
+
+    detail::parse_values(buffer, first_values, rows, columns);
+
+    const size_t n = first_values.size();
+
+    mmap_dataset_writer writer;
+
+    if (!writer.open(output, files.size(), {1, rows, columns}, n_classes, type)) {
+        return false;
+    }
+
+    std::vector<float> records(std::min(block, files.size()) * n);
+    std::vector<uint32_t> block_labels(std::min(block, files.size()));
+
+    std::atomic<bool> invalid(false);
+
+    for (size_t first = 0; first < files.size(); first += block) {
+        const size_t last = std::min(files.size(), first + block);
+
+        detail::parse_files(files, first, last, [&](size_t f, const std::vector<double>& values, size_t /*lines*/, size_t /*columns*/) {
+            if (values.size() != n) {
+                std::cerr << "ERROR: Invalid dimensions for " << files[f].path << std::endl;
+                invalid = true;
+                return;
+            }
+
+            std::copy(values.begin(), values.end(), records.begin() + (f - first) * n);
+
+            block_labels[f - first] = labels[files[f].id - 1];
+        });
+
+        if (invalid) {
+            return false;
+        }
+
+        writer.write_records(records.data(), block_labels.data(), last - first);
+    }
+
+    return writer.close();
+}
+
 } //end of namespace text
 } //end of namespace dll
@@ -0,0 +1,139 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file async_sgd_trainer.hpp
+ * \brief Asynchronous (Hogwild) Stochastic Gradient Descent
+ *
+ * Several workers pull batches from the same generator and each of them
+ * trains the shared network with its own SGD contexts. The weights are
+ * updated by the workers without any synchronization, as in the Hogwild
+ * algorithm: updates from different workers can overlap, which is
+ * tolerated by SGD, especially when the updates are sparse.
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "dll/util/parallel.hpp"
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Asynchronous lock-free gradient descent trainer
+ */
+template <typename DBN>
+struct async_sgd_trainer {
+    using dbn_t     = DBN;                         ///< The type of DBN being trained
+    using weight    = typename dbn_t::weight;      ///< The data type for this layer
+    using this_type = async_sgd_trainer<dbn_t>;    ///< The type of this trainer
+    using worker_t  = sgd_trainer<dbn_t>;          ///< The trainer of each worker
+
+    static constexpr bool asynchronous = true; ///< Indicates that this trainer trains complete epochs
+
+    static_assert(dbn_traits<dbn_t>::data_parallel_workers() == 1, "Asynchronous SGD cannot be combined with data-parallel SGD");
+
+    dbn_t& dbn;                                     ///< The DBN being trained
+    std::vector<std::unique_ptr<worker_t>> workers; ///< The trainer of each worker
+
+    /*!
+     * \brief construct a new async_sgd_trainer
+     * \param dbn The DBN being trained
+     * \param threads The number of workers
+     */
+    explicit async_sgd_trainer(dbn_t& dbn, size_t threads = etl::threads) : dbn(dbn) {
+        cpp_assert(threads > 0, "Asynchronous SGD needs at least one worker");
+
+        for (size_t t = 0; t < threads; ++t) {
+            workers.push_back(std::make_unique<worker_t>(dbn));
+        }
+    }
+
+    /*!
+     * \brief Initialize the training
+     */
+    void init_training(size_t batch_size) {
+        for (auto& worker : workers) {
+            worker->init_training(batch_size);
+        }
+    }
+
+    /*!
+     * \brief Train a batch of data, with the first worker
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        return workers.front()->train_batch(epoch, inputs, labels);
+    }
+
+    /*!
+     * \brief Train a complete epoch of the generator.
+     *
+     * Each worker extracts the next batch of the generator (under a lock) and
+     * then trains on it without any synchronization with the other workers.
+     *
+     * \param epoch The current epoch
+     * \param generator The generator of training data
+     */
+    template <typename Generator>
+    void train_epoch(size_t epoch, Generator& generator) {
+        dll::auto_timer timer("async_sgd::train_epoch");
+
+        cpp_assert(!dbn.comm, "Asynchronous SGD does not support distributed training");
+
+        std::mutex lock;
+
+        auto work = [&](worker_t& worker) {
+            while (true) {
+                std::unique_lock<std::mutex> l(lock);
+
+                if (!generator.has_next_batch()) {
+                    return;
+                }
+
+                auto inputs = etl::force_temporary(generator.data_batch());
+                auto labels = etl::force_temporary(generator.label_batch());
+
+                generator.next_batch();
+
+                l.unlock();
+
+                worker.train_batch(epoch, inputs, labels);
+            }
+        };
+
+        // The workers pull the batches until the epoch is done, the ones
+        // started late by the scheduler have nothing left to train
+        dll::parallel_for(workers.size(), [&](size_t t) {
+            work(*workers[t]);
+        });
+    }
+
+    /*!
+     * \brief Forward a batch of inputs through the network (with the first
+     * worker)
+     */
+    template <bool Train, typename Inputs>
+    auto& forward_batch_helper(dbn_t& dbn, Inputs&& inputs) {
+        return workers.front()->template forward_batch_helper<Train>(dbn, inputs);
+    }
+
+    /*!
+     * \brief Return the name of the trainer
+     */
+    static std::string name() {
+        return "Asynchronous Stochastic Gradient Descent (Hogwild)";
+    }
+};
+
+} //end of dll namespace
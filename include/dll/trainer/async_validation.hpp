@@ -0,0 +1,210 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file async_validation.hpp
+ * \brief Validation of the network in the background of the training.
+ *
+ * At the end of an epoch, the weights of the network are copied into a
+ * snapshot network, which is evaluated on the validation set by a background
+ * thread while the training goes on. The thread reserves threads of the
+ * scheduler of the training, so the raw kernels of the training leave these
+ * cores to the validation.
+ */
+
+#pragma once
+
+#include <exception>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/numa.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/winograd_conv.hpp" // For invalidate_transforms
+
+namespace dll {
+
+/*!
+ * \brief Traits to test if a layer normalizes with running statistics
+ * (batch normalization layers), which are not trainable parameters but are
+ * used at test time.
+ */
+template <typename Layer, typename Enable = void>
+struct has_batch_statistics : std::false_type {};
+
+template <typename Layer>
+struct has_batch_statistics<Layer, std::void_t<decltype(std::declval<Layer&>().mean), decltype(std::declval<Layer&>().var)>> : std::true_type {};
+
+/*!
+ * \brief Copy each trainable variable of the src layer into the dst layer
+ */
+template <typename Layer, size_t... I>
+void copy_layer_parameters(Layer& dst, Layer& src, std::index_sequence<I...> /*seq*/) {
+    ((std::get<I>(dst.trainable_parameters()) = std::get<I>(src.trainable_parameters())), ...);
+}
+
+/*!
+ * \brief Copy the weights of the src layer into the dst layer, with the
+ * running statistics used at test time, if any
+ */
+template <typename Layer>
+void copy_layer_state(Layer& dst, Layer& src) {
+    if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+        constexpr size_t N = std::tuple_size<decltype(src.trainable_parameters())>();
+
+        copy_layer_parameters(dst, src, std::make_index_sequence<N>());
+
+        if constexpr (has_batch_statistics<Layer>::value) {
+            dst.mean = src.mean;
+            dst.var  = src.var;
+        }
+
+        dll::invalidate_transforms(dst);
+    } else {
+        cpp_unused(dst);
+        cpp_unused(src);
+    }
+}
+
+/*!
+ * \brief Copy the state of each layer of the src network into the dst
+ * network
+ */
+template <typename DBN, size_t... I>
+void copy_network_state(DBN& dst, DBN& src, std::index_sequence<I...> /*seq*/) {
+    (copy_layer_state(dst.template layer_get<I>(), src.template layer_get<I>()), ...);
+}
+
+/*!
+ * \brief Copy the state of the src network (the weights and the running
+ * statistics of the layers) into the dst network
+ */
+template <typename DBN>
+void copy_network_state(DBN& dst, DBN& src) {
+    copy_network_state(dst, src, std::make_index_sequence<DBN::layers>());
+}
+
+/*!
+ * \brief Evaluate snapshots of a network in a background thread.
+ *
+ * Only one validation can be pending at a time. The validation generator
+ * must not be used by the training while a validation is pending.
+ */
+template <typename DBN>
+struct async_validator {
+    using dbn_t = DBN; ///< The type of the network
+
+    /*!
+     * \brief Create a validator for the given network
+     * \param dbn The network being trained
+     */
+    explicit async_validator(dbn_t& dbn) : dbn(dbn), snapshot(std::make_unique<dbn_t>()) {}
+
+    async_validator(const async_validator& rhs) = delete;
+    async_validator& operator=(const async_validator& rhs) = delete;
+
+    /*!
+     * \brief Wait for the pending validation, if any
+     */
+    ~async_validator() {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Take a snapshot of the weights of the network and start its
+     * validation on the given generator.
+     *
+     * This must be called from the training thread, inside the resource
+     * scope of the training.
+     *
+     * \param generator The validation generator
+     */
+    template <typename Generator>
+    void start(Generator& generator) {
+        cpp_assert(!thread.joinable(), "Only one validation can be pending");
+
+        {
+            dll::auto_timer timer("net:trainer:validation:snapshot");
+
+            copy_network_state(*snapshot, dbn);
+        }
+
+        task_scheduler& scheduler = local_scheduler();
+
+        const size_t threads = std::max(size_t(1), dbn.validation_threads);
+
+        error = nullptr;
+
+        // The training leaves the threads of the validation (its own thread
+        // included) until the end of the validation
+        reservation = std::make_unique<thread_reservation>(scheduler, threads);
+
+        thread = std::thread([this, &generator, &scheduler, threads] {
+            pin_thread(dbn.budget.cpus);
+
+            task_scheduler::current()   = &scheduler;
+            thread_limit()              = threads;
+            etl::local_context().serial = true;
+
+            try {
+                dll::auto_timer timer("net:trainer:validation");
+
+                std::tie(metrics.first, metrics.second) = snapshot->evaluate_metrics(generator);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        });
+    }
+
+    /*!
+     * \brief Indicates if a validation is pending
+     */
+    bool pending() const {
+        return thread.joinable();
+    }
+
+    /*!
+     * \brief Wait for the pending validation
+     * \return a pair containing the (error, loss) of the snapshot
+     */
+    std::pair<double, double> wait() {
+        dll::auto_timer timer("net:trainer:validation:wait");
+
+        thread.join();
+        reservation.reset();
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Returns the snapshot network (the weights of the last
+     * validation)
+     */
+    dbn_t& network() {
+        return *snapshot;
+    }
+
+private:
+    dbn_t& dbn;                                      ///< The network being trained
+    std::unique_ptr<dbn_t> snapshot;                 ///< The snapshot of the weights being validated
+    std::unique_ptr<thread_reservation> reservation; ///< The threads reserved for the pending validation
+    std::thread thread;                              ///< The thread of the pending validation
+    std::pair<double, double> metrics;               ///< The (error, loss) of the last validation
+    std::exception_ptr error;                        ///< The error of the last validation, if any
+};
+
+} //end of dll namespace
@@ -0,0 +1,336 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file autotune.hpp
+ * \brief Auto-tuning of the kernels and of the threads of the layers of a
+ * network.
+ *
+ * For each layer that can be tuned, the training batch of the layer
+ * (forward, backward and gradients) is timed with each candidate kernel and
+ * thread count, on the context of the SGD trainer. The fastest candidate is
+ * applied to the layer and cached in the tuning file, keyed by the CPU model
+ * and the shape of the layer, so that the next runs only read the file.
+ *
+ * With GPU support, the placement of the layers on the CPU or on the GPU is
+ * chosen in the same way, from the time of each layer on both devices and
+ * the time of the transfers between them (see autoplace()).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "dll/util/tuning.hpp"
+#include "dll/util/placement.hpp"
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+
+namespace dll {
+
+namespace tuning_detail {
+
+/*!
+ * \brief Returns the best time of the given function over the given number
+ * of timed runs, in milliseconds, after a warmup run
+ */
+template <typename Functor>
+double best_time(Functor&& run, size_t repetitions) {
+    // Warmup (and preparation of the cached transforms)
+    run();
+
+    double time = std::numeric_limits<double>::max();
+
+    for (size_t i = 0; i < std::max(repetitions, size_t(1)); ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+
+        time = std::min(time, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    return time;
+}
+
+} //end of namespace tuning_detail
+
+/*!
+ * \brief Returns the candidate tunings of the given layer
+ */
+template <typename Layer>
+std::vector<layer_tuning> tuning_candidates(const Layer& layer) {
+    std::vector<conv_kernel> kernels{conv_kernel::AUTO};
+
+    if constexpr (has_conv_kernels<Layer>::value) {
+        if (layer.winograd_supported()) {
+            kernels = {conv_kernel::WINOGRAD, conv_kernel::DIRECT};
+        }
+    } else {
+        cpp_unused(layer);
+    }
+
+    // All the threads, half of them and serial
+    const size_t budget = kernel_threads();
+
+    std::vector<size_t> threads{0};
+
+    if (budget >= 4) {
+        threads.push_back(budget / 2);
+    }
+
+    if (budget > 1) {
+        threads.push_back(1);
+    }
+
+    std::vector<layer_tuning> candidates;
+
+    for (auto kernel : kernels) {
+        for (auto t : threads) {
+            candidates.push_back({kernel, t});
+        }
+    }
+
+    return candidates;
+}
+
+/*!
+ * \brief Tune the layers of the given network, reading and updating the
+ * tuning file.
+ *
+ * The layers whose shape is already in the tuning file for this CPU are not
+ * timed again, unless retune is set.
+ *
+ * \param dbn The network to tune
+ * \param file The tuning file
+ * \param repetitions The number of timed runs of each candidate
+ * \param retune Time all the layers again, even the ones in the file
+ *
+ * \return The number of layers that have been timed
+ */
+template <typename DBN>
+size_t autotune(DBN& dbn, const std::string& file = default_tuning_file(), size_t repetitions = 3, bool retune = false) {
+    using weight = typename DBN::weight;
+
+    tuning_cache cache;
+    cache.load(file);
+
+    // The trainer holds a training context of the right shape for each layer
+    auto trainer = std::make_unique<sgd_trainer<DBN>>(dbn);
+
+    size_t timed = 0;
+
+    cpp::for_each(trainer->full_context, [&](auto& layer_ctx) {
+        auto& layer = layer_ctx.first;
+        auto& ctx   = *layer_ctx.second;
+
+        using layer_t = std::decay_t<decltype(layer)>;
+
+        if constexpr (has_layer_tuning<layer_t>::value) {
+            const std::string key = layer.to_short_string() + " B:" + std::to_string(DBN::batch_size);
+
+            if (auto* record = cache.find(key); record && !retune) {
+                layer.tuning = record->tuning;
+                return;
+            }
+
+            ctx.input  = etl::normal_generator<weight>(0.0, 1.0);
+            ctx.errors = etl::normal_generator<weight>(0.0, 0.1);
+
+            // The errors of the previous layer have the shape of the input
+            auto output = ctx.input;
+
+            auto run = [&]() {
+                layer.train_forward_batch(ctx.output, ctx.input);
+                layer.backward_batch(output, ctx);
+                layer.compute_gradients(ctx);
+            };
+
+            tuning_record best;
+            best.time = std::numeric_limits<double>::max();
+
+            for (auto& candidate : tuning_candidates(layer)) {
+                layer.tuning = candidate;
+
+                const double time = tuning_detail::best_time(run, repetitions);
+
+                if (time < best.time) {
+                    best.tuning = candidate;
+                    best.time   = time;
+                }
+            }
+
+            layer.tuning = best.tuning;
+            cache.set(key, best);
+
+            std::cout << "Tuning: " << key << " -> " << to_string(best.tuning.kernel) << " threads:" << best.tuning.threads << " (" << best.time << "ms)" << std::endl;
+
+            ++timed;
+        } else {
+            cpp_unused(layer);
+            cpp_unused(ctx);
+        }
+    });
+
+    if (timed && !cache.store(file)) {
+        std::cerr << "Tuning: impossible to write " << file << std::endl;
+    }
+
+    return timed;
+}
+
+#ifdef ETL_GPU
+
+namespace tuning_detail {
+
+/*!
+ * \brief Returns the time to move the given values to the CPU and back to
+ * the GPU, in milliseconds
+ */
+template <typename E>
+double transfer_time(E& values, size_t repetitions) {
+    return best_time([&values]() {
+        values.ensure_gpu_up_to_date();
+
+        values.invalidate_cpu();
+        values.ensure_cpu_up_to_date();
+
+        values.invalidate_gpu();
+        values.ensure_gpu_up_to_date();
+    }, repetitions);
+}
+
+/*!
+ * \brief Profile the training batch of the layer L, and of the next layers,
+ * on both devices, with the contexts of the given trainer
+ */
+template <size_t L, typename Trainer>
+void profile_layers(Trainer& trainer, std::vector<placement_costs>& costs, size_t repetitions) {
+    if constexpr (L < Trainer::layers) {
+        auto& layer_ctx = std::get<L>(trainer.full_context);
+        auto& layer     = layer_ctx.first;
+        auto& ctx       = *layer_ctx.second;
+
+        constexpr bool frozen = std::decay_t<decltype(ctx)>::frozen;
+
+        auto run = [&]() {
+            if constexpr (L == 0) {
+                Trainer::template forward_layer<!frozen>(layer, ctx.input, ctx);
+            } else {
+                auto& prev_ctx = *std::get<L - 1>(trainer.full_context).second;
+
+                Trainer::template forward_layer<!frozen>(layer, Trainer::get_output(prev_ctx), ctx);
+
+                // The errors are not back-propagated into the frozen layers
+                if constexpr (L > Trainer::frozen_layers) {
+                    bool last = true;
+                    Trainer::backward_layer(layer, ctx, Trainer::get_errors(prev_ctx), last);
+                }
+            }
+
+            Trainer::compute_layer_gradients(layer, ctx);
+        };
+
+        auto place = [](bool cpu) {
+            return [cpu](auto& /*layer*/, auto& context) {
+                context.cpu = cpu;
+            };
+        };
+
+        auto on_cpu = place(true);
+        auto on_gpu = place(false);
+
+        placement_costs& cost = costs[L];
+
+        Trainer::for_each_sub_layer(layer, ctx, on_gpu);
+        cost.gpu = best_time(run, repetitions);
+
+        Trainer::for_each_sub_layer(layer, ctx, on_cpu);
+        cost.cpu = best_time(run, repetitions);
+
+        Trainer::for_each_sub_layer(layer, ctx, on_gpu);
+
+        // The output goes to the next layer and its errors come back
+        cost.transfer = transfer_time(Trainer::get_output(ctx), repetitions);
+
+        std::cout << "Placement: " << layer.to_short_string() << " gpu:" << cost.gpu << "ms cpu:" << cost.cpu << "ms transfer:" << cost.transfer << "ms" << std::endl;
+
+        profile_layers<L + 1>(trainer, costs, repetitions);
+    }
+}
+
+} //end of namespace tuning_detail
+
+#endif
+
+/*!
+ * \brief Place the layers of the given network on the CPU or on the GPU.
+ *
+ * Each layer is timed on both devices, on the context of the SGD trainer,
+ * as well as the transfer of its output between the devices. The layers are
+ * then placed so that the time of a training batch, transfers included, is
+ * minimal (see best_placement()). Small heads, normalization and shape
+ * layers often end up on the CPU. The training moves the values between the
+ * devices only at the boundaries of the placement.
+ *
+ * Without GPU support (ETL_GPU), all the layers are on the CPU and nothing
+ * is timed.
+ *
+ * \param dbn The network to place
+ * \param repetitions The number of timed runs of each layer on each device
+ *
+ * \return The layers placed on the CPU, also set in dbn.cpu_placement
+ */
+template <typename DBN>
+std::vector<bool> autoplace(DBN& dbn, size_t repetitions = 3) {
+    dbn.cpu_placement.clear();
+
+#ifdef ETL_GPU
+    using weight    = typename DBN::weight;
+    using trainer_t = sgd_trainer<DBN>;
+
+    // The trainer holds a training context of the right shape for each layer
+    auto trainer = std::make_unique<trainer_t>(dbn);
+
+    auto& first_ctx = *std::get<0>(trainer->full_context).second;
+    auto& last_ctx  = *std::get<DBN::layers - 1>(trainer->full_context).second;
+
+    // A first training pass fills all the contexts
+
+    auto batch = first_ctx.input;
+
+    batch = etl::normal_generator<weight>(0.0, 1.0);
+
+    trainer->template forward_batch_helper<true>(batch);
+
+    trainer_t::get_errors(last_ctx) = etl::normal_generator<weight>(0.0, 0.1);
+
+    bool last = true;
+    trainer_t::backward_context(trainer->full_context, last);
+
+    std::vector<placement_costs> costs(DBN::layers);
+
+    tuning_detail::profile_layers<0>(*trainer, costs, repetitions);
+
+    // The batches come from the GPU, half a round trip
+    const double input = tuning_detail::transfer_time(first_ctx.input, repetitions) / 2.0;
+
+    dbn.cpu_placement = best_placement(costs, input);
+
+    std::cout << "Placement: " << placement_time(costs, dbn.cpu_placement, input) << "ms per batch (" << placement_time(costs, std::vector<bool>(DBN::layers, false), input)
+              << "ms on the GPU only)" << std::endl;
+#else
+    cpp_unused(repetitions);
+#endif
+
+    return dbn.cpu_placement;
+}
+
+} //end of dll namespace
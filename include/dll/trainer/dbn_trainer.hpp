@@ -15,11 +15,127 @@
 #include "dll/util/timers.hpp"
 #include "dll/util/random.hpp"
 #include "dll/util/batch.hpp" // For make_batch
+#include "dll/util/checkpoint.hpp"
+#include "dll/util/winograd_conv.hpp" // For invalidate_transforms
+#include "dll/util/parallel.hpp" // For kernel_threads
 #include "dll/test.hpp"
 #include "dll/dbn_traits.hpp"
+#include "dll/trainer/distributed.hpp"
+#include "dll/trainer/async_validation.hpp"
+#include "dll/trainer/trunk_cache.hpp"
 
 namespace dll {
 
+/*!
+ * \brief Traits to test if a trainer trains complete epochs by itself
+ * (asynchronous trainers).
+ */
+template <typename Trainer, typename Enable = void>
+struct is_asynchronous_trainer : std::false_type {};
+
+template <typename Trainer>
+struct is_asynchronous_trainer<Trainer, std::void_t<decltype(Trainer::asynchronous)>> : std::bool_constant<Trainer::asynchronous> {};
+
+/*!
+ * \brief Traits to test if the state of a trainer (updater state, ...) can
+ * be checkpointed.
+ */
+template <typename Trainer, typename Enable = void>
+struct is_checkpointable_trainer : std::false_type {};
+
+template <typename Trainer>
+struct is_checkpointable_trainer<Trainer, std::void_t<decltype(Trainer::checkpointable)>> : std::bool_constant<Trainer::checkpointable> {};
+
+/*!
+ * \brief Traits to test if a trainer waits for the asynchronous backup of the
+ * weights (wait_backup) before it modifies them.
+ */
+template <typename Trainer, typename Enable = void>
+struct is_backup_fenced_trainer : std::false_type {};
+
+template <typename Trainer>
+struct is_backup_fenced_trainer<Trainer, std::void_t<decltype(Trainer::backup_fenced)>> : std::bool_constant<Trainer::backup_fenced> {};
+
+/*!
+ * \brief Traits to test if a trainer can train the network from the cached
+ * features of its frozen layers.
+ */
+template <typename Trainer, typename Enable = void>
+struct is_trunk_cached_trainer : std::false_type {};
+
+template <typename Trainer>
+struct is_trunk_cached_trainer<Trainer, std::void_t<decltype(Trainer::trunk_cached)>> : std::bool_constant<Trainer::trunk_cached> {};
+
+/*!
+ * \brief Traits to test if a trainer updates the weights lazily, needing
+ * flush_weights() before the weights are read as a whole.
+ */
+template <typename Trainer, typename Enable = void>
+struct is_lazy_weights_trainer : std::false_type {};
+
+template <typename Trainer>
+struct is_lazy_weights_trainer<Trainer, std::void_t<decltype(Trainer::lazy_weights)>> : std::bool_constant<Trainer::lazy_weights> {};
+
+/*!
+ * \brief Traits to test if a generator description augments the inputs
+ * (the descriptions without augmentation parameters never do).
+ */
+template <typename Desc, typename Enable = void>
+struct is_augmented_desc : std::false_type {};
+
+template <typename Desc>
+struct is_augmented_desc<Desc, std::void_t<decltype(Desc::Noise)>> : std::bool_constant<is_augmented<Desc>> {};
+
+/*!
+ * \brief Traits to test if a generator always generates the same samples at
+ * each epoch (up to their order).
+ */
+template <typename Generator, typename Enable = void>
+struct is_constant_generator : std::false_type {};
+
+template <typename Generator>
+struct is_constant_generator<Generator, std::void_t<typename Generator::desc>> : std::bool_constant<!is_augmented_desc<typename Generator::desc>::value> {};
+
+/*!
+ * \brief Traits to test if a watcher follows the depth of the read-ahead
+ * queue of the generator.
+ */
+template <typename Watcher, typename Enable = void>
+struct has_ft_batch_queue : std::false_type {};
+
+template <typename Watcher>
+struct has_ft_batch_queue<Watcher, std::void_t<decltype(std::declval<Watcher&>().ft_batch_queue(size_t(0)))>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a generator reads its batches ahead of the
+ * training.
+ */
+template <typename Generator, typename Enable = void>
+struct has_ready_batches : std::false_type {};
+
+template <typename Generator>
+struct has_ready_batches<Generator, std::void_t<decltype(std::declval<const Generator&>().ready_batches())>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a generator measures the time the training waits
+ * for its batches.
+ */
+template <typename Generator, typename Enable = void>
+struct has_stall_time : std::false_type {};
+
+template <typename Generator>
+struct has_stall_time<Generator, std::void_t<decltype(std::declval<const Generator&>().stall_time())>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a watcher wants to know the time the training
+ * waited for the generator during an epoch.
+ */
+template <typename Watcher, typename Enable = void>
+struct has_ft_epoch_stall : std::false_type {};
+
+template <typename Watcher>
+struct has_ft_epoch_stall<Watcher, std::void_t<decltype(std::declval<Watcher&>().ft_epoch_stall(size_t(0), 0.0, 0.0))>> : std::true_type {};
+
 /*!
  * \brief A generic trainer for Deep Belief Network
  *
@@ -60,6 +176,36 @@ struct dbn_trainer {
     size_t best_epoch     = 0;   ///< The best epoch
     size_t patience       = 0;   ///< The current patience
 
+    size_t max_epochs         = 0;   ///< The number of epochs of the training
+    weight base_learning_rate = 0.0; ///< The learning rate before the schedule
+    size_t schedule_step      = 0;   ///< The number of batches trained since the start
+    size_t schedule_total     = 0;   ///< The number of batches of the training
+
+    std::unique_ptr<checkpoint_writer<weight>> checkpoints; ///< The background writer of the checkpoints
+    size_t first_epoch     = 0;                              ///< The first epoch of the training (resumed training)
+    size_t skip_batches    = 0;                              ///< The number of batches of the first epoch already trained (resumed training)
+    size_t checkpoint_step = 0;                              ///< The number of batches trained since the last checkpoint
+
+    /*!
+     * \brief Indicates if the network can be validated in the background
+     * (the snapshot needs a static network, and the weights of the network
+     * are the ones of the trainer)
+     */
+    static constexpr bool async_validated = dbn_traits<dbn_t>::has_async_validation() && !dbn_traits<dbn_t>::is_dynamic() && !dbn_traits<dbn_t>::has_mixed_precision();
+
+    async_validator<dbn_t>* validator = nullptr; ///< The background validation of the current training (with async_validation)
+    bool lagged                       = false;   ///< Indicates if the early stopping is applied to the snapshot of the validator (one epoch late)
+
+    std::unique_ptr<trunk_cache<weight>> trunk; ///< The cached features of the frozen layers (with cache_trunk)
+    bool trunk_failed = false;                  ///< Indicates if the features of the frozen layers could not be cached
+
+    /*!
+     * \brief Indicates if the layers after the frozen layers can be trained
+     * from the cached features of the frozen layers, for the given generator
+     */
+    template <typename Generator>
+    static constexpr bool trunk_cacheable = is_trunk_cached_trainer<trainer_t<dbn_t>>::value && is_constant_generator<Generator>::value && !has_batch_steps<Generator>::value && !has_batch_lengths<Generator>::value;
+
     /*!
      * \brief Initialize the training
      * \param dbn The network to train
@@ -69,9 +215,18 @@ struct dbn_trainer {
     void start_training(dbn_t& dbn, size_t max_epochs){
         constexpr auto batch_size = std::decay_t<dbn_t>::batch_size;
 
+        // The features computed before the training are not valid anymore
+        ++dbn.model_version;
+
         //Initialize the momentum
         dbn.momentum = dbn.initial_momentum;
 
+        // The schedule is relative to the initial learning rate
+        this->max_epochs   = max_epochs;
+        base_learning_rate = dbn.learning_rate;
+        schedule_step      = 0;
+        schedule_total     = 0;
+
         watcher.fine_tuning_begin(dbn, max_epochs);
 
         trainer = std::make_unique<trainer_t<dbn_t>>(dbn);
@@ -85,6 +240,165 @@ struct dbn_trainer {
 
         current_val_error = 0.0;
         current_val_loss = 0.0;
+
+        first_epoch     = 0;
+        skip_batches    = 0;
+        checkpoint_step = 0;
+
+        validator = nullptr;
+        lagged    = false;
+
+        trunk.reset();
+        trunk_failed = false;
+
+        // Only one rank writes the checkpoints
+        if (!dbn.checkpoint_file.empty() && (!dbn.comm || dbn.comm->rank() == 0)) {
+            checkpoints = std::make_unique<checkpoint_writer<weight>>();
+        }
+
+        if (dbn.resume && !dbn.checkpoint_file.empty()) {
+            resume_checkpoint(dbn);
+        }
+    }
+
+    /*!
+     * \brief Apply the functor to each variable of the state of the training:
+     * its progress, the weights of the network and the state of the trainer.
+     *
+     * \param dbn The network being trained
+     * \param epoch The epoch of the checkpoint
+     * \param batch The number of batches of the epoch already trained
+     */
+    template <typename Functor>
+    void for_each_checkpoint_state(dbn_t& dbn, size_t& epoch, size_t& batch, Functor&& functor) {
+        functor(epoch);
+        functor(batch);
+        functor(schedule_step);
+        functor(base_learning_rate);
+        functor(dbn.learning_rate);
+        functor(dbn.momentum);
+
+        functor(best_error);
+        functor(best_loss);
+        functor(best_epoch);
+        functor(patience);
+
+        functor(current_error);
+        functor(current_loss);
+        functor(current_val_error);
+        functor(current_val_loss);
+
+        dbn.for_each_layer([&functor](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                cpp::for_each(layer.trainable_parameters(), [&functor](auto& w) {
+                    functor(w);
+                });
+            }
+        });
+
+        if constexpr (is_checkpointable_trainer<trainer_t<dbn_t>>::value) {
+            trainer->for_each_state(functor);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the trainer is in a state that can be checkpointed
+     */
+    bool checkpoint_ready() const {
+        if constexpr (is_checkpointable_trainer<trainer_t<dbn_t>>::value) {
+            return trainer->checkpoint_ready();
+        } else {
+            return true;
+        }
+    }
+
+    /*!
+     * \brief Bring the weights of the network up to date when the trainer
+     * applies its updates lazily, before they are read as a whole
+     */
+    void flush_weights() {
+        if constexpr (is_lazy_weights_trainer<trainer_t<dbn_t>>::value) {
+            trainer->flush_weights();
+        }
+    }
+
+    /*!
+     * \brief Take a checkpoint of the training.
+     *
+     * The state is copied into the staging buffer and written to
+     * dbn.checkpoint_file by the background writer.
+     *
+     * \param dbn The network being trained
+     * \param epoch The epoch to resume the training at
+     * \param batch The number of batches of the epoch already trained
+     */
+    void save_checkpoint(dbn_t& dbn, size_t epoch, size_t batch) {
+        if (!checkpoints) {
+            return;
+        }
+
+        dll::auto_timer timer("net:trainer:checkpoint");
+
+        flush_weights();
+
+        auto& state = checkpoints->staging;
+
+        state.clear();
+
+        for_each_checkpoint_state(dbn, epoch, batch, [&state](auto& variable) {
+            state.store(variable);
+        });
+
+        checkpoints->submit(dbn.checkpoint_file);
+
+        checkpoint_step = 0;
+    }
+
+    /*!
+     * \brief Resume the training from dbn.checkpoint_file, if it exists
+     * \param dbn The network being trained
+     * \return true if the training was resumed, false otherwise
+     */
+    bool resume_checkpoint(dbn_t& dbn) {
+        checkpoint_state<weight> state;
+
+        if (!read_checkpoint(dbn.checkpoint_file, state)) {
+            return false;
+        }
+
+        // Make sure that the checkpoint matches the network before touching it
+
+        size_t scalars = 0;
+        size_t values  = 0;
+        size_t epoch   = 0;
+        size_t batch   = 0;
+
+        for_each_checkpoint_state(dbn, epoch, batch, [&scalars, &values](auto& variable) {
+            if constexpr (std::is_arithmetic_v<std::decay_t<decltype(variable)>>) {
+                ++scalars;
+            } else {
+                values += etl::size(variable);
+            }
+        });
+
+        if (scalars != state.scalars.size() || values != state.values.size()) {
+            std::cerr << "ERROR: The checkpoint " << dbn.checkpoint_file << " does not match the network" << std::endl;
+            return false;
+        }
+
+        for_each_checkpoint_state(dbn, first_epoch, skip_batches, [&state](auto& variable) {
+            state.load(variable);
+        });
+
+        dbn.for_each_layer([](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                dll::invalidate_transforms(layer);
+            }
+        });
+
+        dbn.out << "Resume the training at epoch " << first_epoch << ", batch " << skip_batches << std::endl;
+
+        return true;
     }
 
     /*!
@@ -97,6 +411,16 @@ struct dbn_trainer {
      * \return the final error
      */
     error_type stop_training(dbn_t& dbn, size_t epoch, size_t max_epochs){
+        // The weights are modified from now on
+        dbn.wait_backup();
+
+        // In mixed precision, the weights are the master weights of the trainer
+        if constexpr (dbn_traits<dbn_t>::has_mixed_precision()) {
+            trainer->restore_master_weights();
+        }
+
+        flush_weights();
+
         // Depending on the strategy, try to restore the best weights
 
         if(epoch == max_epochs){
@@ -105,7 +429,7 @@ struct dbn_trainer {
 
             if constexpr (s != strategy::NONE) {
                 if(best_epoch < max_epochs - 1){
-                    dbn.restore_weights();
+                    restore_best_weights(dbn);
 
                     if (is_error(s)) {
                         dbn.out << "Restore the best (error) weights from epoch " << best_epoch << std::endl;
@@ -116,11 +440,65 @@ struct dbn_trainer {
             }
         }
 
+        // Restore the base learning rate
+        if (dbn.schedule.enabled()) {
+            dbn.learning_rate = base_learning_rate;
+        }
+
+        // Make sure the last checkpoint is on disk
+        if (checkpoints) {
+            checkpoints->wait();
+            checkpoints.reset();
+        }
+
+        // Nor the features computed during the training
+        ++dbn.model_version;
+
         watcher.fine_tuning_end(dbn);
 
         return current_error;
     }
 
+    /*!
+     * \brief Save the weights of the epoch being decided as the best weights.
+     *
+     * When the early stopping is lagging, the weights of this epoch are the
+     * ones of the snapshot of the validator. Otherwise, if the trainer waits
+     * for the backup before its updates, the weights are copied in the
+     * background, during the next batch.
+     */
+    void backup_best_weights(dbn_t& dbn){
+        if constexpr (async_validated) {
+            if (lagged) {
+                validator->network().backup_weights();
+                return;
+            }
+        }
+
+        if constexpr (is_backup_fenced_trainer<trainer_t<dbn_t>>::value) {
+            dbn.backup_weights_async();
+        } else {
+            dbn.backup_weights();
+        }
+    }
+
+    /*!
+     * \brief Restore the best weights into the network
+     */
+    void restore_best_weights(dbn_t& dbn){
+        if constexpr (async_validated) {
+            if (lagged) {
+                auto& snapshot = validator->network();
+
+                snapshot.restore_weights();
+                copy_network_state(dbn, snapshot);
+                return;
+            }
+        }
+
+        dbn.restore_weights();
+    }
+
     /*!
      * \brief Start a new epoch
      * \param dbn The network that is trained
@@ -157,14 +535,14 @@ struct dbn_trainer {
                     best_error = error;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    backup_best_weights(dbn);
                 }
             } else {
                 if(!epoch || loss < best_loss){
                     best_loss = loss;
                     best_epoch = epoch;
 
-                    dbn.backup_weights();
+                    backup_best_weights(dbn);
                 }
             }
         }
@@ -178,7 +556,7 @@ struct dbn_trainer {
                     dbn.out << "Stopping: Loss below goal";
 
                     if(epoch != best_epoch){
-                        dbn.restore_weights();
+                        restore_best_weights(dbn);
 
                         dbn.out << ", restore weights from epoch " << best_epoch;
                     }
@@ -194,7 +572,7 @@ struct dbn_trainer {
                     dbn.out << "Stopping: Error below goal";
 
                     if(epoch != best_epoch){
-                        dbn.restore_weights();
+                        restore_best_weights(dbn);
 
                         dbn.out << ", restore weights from epoch " << best_epoch;
                     }
@@ -213,7 +591,7 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Loss has been increasing for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best_weights(dbn);
 
                             dbn.out << ", restore weights from epoch " << best_epoch;
                         }
@@ -235,7 +613,7 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Error has been increasing for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best_weights(dbn);
 
                             dbn.out << ", restore weights from epoch " << best_epoch;
                         }
@@ -257,7 +635,7 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Loss has been increasing (from best) for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best_weights(dbn);
 
                             dbn.out << ", restore weights from epoch " << best_epoch;
                         }
@@ -279,7 +657,7 @@ struct dbn_trainer {
                         dbn.out << "Stopping: Error has been increasing (from best) for " << dbn.patience << " epochs";
 
                         if (epoch != best_epoch) {
-                            dbn.restore_weights();
+                            restore_best_weights(dbn);
 
                             dbn.out << ", restore weights from epoch " << best_epoch;
                         }
@@ -298,6 +676,18 @@ struct dbn_trainer {
         return false;
     }
 
+    /*!
+     * \brief Prune the units of the network at the end of the epoch,
+     * following its pruning schedule
+     * \param dbn The network that is trained
+     * \param epoch The current epoch
+     */
+    void prune_epoch(dbn_t& dbn, size_t epoch) {
+        if (dbn.pruning.step(epoch)) {
+            dbn.prune(dbn.pruning.ratio_at(epoch));
+        }
+    }
+
     /*!
      * \brief Indicates the end of an epoch
      * \param dbn The network that is trained
@@ -308,10 +698,12 @@ struct dbn_trainer {
      */
     bool stop_epoch(dbn_t& dbn, size_t epoch, double error, double loss){
         //After some time increase the momentum
-        if (dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM && epoch == dbn.final_momentum_epoch) {
+        if ((dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM || dbn_traits<dbn_t>::updater() == updater_type::LARS) && epoch == dbn.final_momentum_epoch) {
             dbn.momentum = dbn.final_momentum;
         }
 
+        prune_epoch(dbn, epoch);
+
         watcher.ft_epoch_end(epoch, error, loss, dbn);
 
         // Early stopping with training error/loss
@@ -336,10 +728,12 @@ struct dbn_trainer {
         double error = train_stats.first;
 
         //After some time increase the momentum
-        if (dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM && epoch == dbn.final_momentum_epoch) {
+        if ((dbn_traits<dbn_t>::updater() == updater_type::MOMENTUM || dbn_traits<dbn_t>::updater() == updater_type::LARS) && epoch == dbn.final_momentum_epoch) {
             dbn.momentum = dbn.final_momentum;
         }
 
+        prune_epoch(dbn, epoch);
+
         watcher.ft_epoch_end(epoch, error, train_stats.second, val_stats.first, val_stats.second, dbn);
 
         // Early stopping with validation (or training) error/loss
@@ -376,16 +770,274 @@ struct dbn_trainer {
         if constexpr (dbn_traits<dbn_t>::error_on_epoch()){
             dll::auto_timer timer("net:trainer:train:epoch:error");
 
-            auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
-                return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
-            };
+            if (kernel_threads() > 1) {
+                // The batches are split between the threads
+                std::tie(new_error, new_loss) = dbn.evaluate_metrics_parallel(generator);
+            } else {
+                auto forward_helper = [this, &dbn](auto&& input_batch) -> decltype(auto) {
+                    return this->trainer->template forward_batch_helper<false>(dbn, input_batch);
+                };
+
+                std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper);
+            }
+
+            // Aggregate the metrics of all the ranks
+            if (dbn.comm) {
+                double metrics[3] = {new_error * generator.size(), new_loss * generator.size(), double(generator.size())};
+
+                all_reduce_sum(*dbn.comm, metrics, 3);
+
+                new_error = metrics[0] / metrics[2];
+                new_loss  = metrics[1] / metrics[2];
+            }
+        }
+
+        return std::make_pair(new_error, new_loss);
+    }
+
+    /*!
+     * \brief Compute error and loss on the given training generator, from
+     * the cached features of the frozen layers if possible.
+     */
+    template<typename Generator>
+    std::pair<double, double> train_error_loss(dbn_t& dbn, Generator& generator){
+        if constexpr (trunk_cacheable<Generator>) {
+            if (trunk) {
+                return trunk_error_loss<Generator>(dbn);
+            }
+        }
+
+        return compute_error_loss(dbn, generator);
+    }
+
+    /*!
+     * \brief Compute error and loss on the cached features of the frozen
+     * layers.
+     */
+    template<typename Generator>
+    std::pair<double, double> trunk_error_loss(dbn_t& dbn){
+        double new_error =  1.0;
+        double new_loss  = -1.0;
+
+        if constexpr (dbn_traits<dbn_t>::error_on_epoch()){
+            dll::auto_timer timer("net:trainer:train:epoch:error");
+
+            constexpr size_t batch_size = dbn_t::batch_size;
+
+            auto& cache    = *trunk;
+            auto& features = trainer->trunk_batch();
+            auto labels    = cache.template make_labels<trunk_labels_dimensions<Generator>>(batch_size);
+
+            double errors = 0.0;
+            double losses = 0.0;
+
+            for (size_t first = 0; first < cache.samples; first += batch_size) {
+                const size_t n = std::min(batch_size, cache.samples - first);
+
+                for (size_t s = 0; s < n; ++s) {
+                    cache.load(first + s, features.memory_start() + s * cache.sample_size, labels.memory_start() + s * cache.label_size);
+                }
 
-            std::tie(new_error, new_loss) = dbn.evaluate_metrics(generator, forward_helper);
+                auto [batch_error, batch_loss] = trainer->evaluate_trunk_batch(n, labels);
+
+                errors += batch_error;
+                losses += batch_loss;
+            }
+
+            double metrics[3] = {errors, losses, double(cache.samples)};
+
+            // Aggregate the metrics of all the ranks
+            if (dbn.comm) {
+                all_reduce_sum(*dbn.comm, metrics, 3);
+            }
+
+            new_error = metrics[0] / metrics[2];
+            new_loss  = metrics[1] / metrics[2];
+        } else {
+            cpp_unused(dbn);
         }
 
         return std::make_pair(new_error, new_loss);
     }
 
+    /*!
+     * \brief The number of dimensions of the label batches of the given
+     * generator
+     */
+    template <typename Generator>
+    static constexpr size_t trunk_labels_dimensions = etl::decay_traits<decltype(etl::force_temporary(std::declval<Generator&>().label_batch()))>::dimensions();
+
+    /*!
+     * \brief Prepare the cached features of the frozen layers for an epoch
+     * on the given generator.
+     *
+     * The features are computed once, in inference mode, for all the samples
+     * of the generator. They are computed again when the weights of the
+     * frozen layers have changed.
+     *
+     * \return true if the epoch can be trained from the cache, false otherwise
+     */
+    template <typename Generator>
+    bool prepare_trunk(dbn_t& dbn, Generator& generator) {
+        if (!dbn.cache_trunk || trunk_failed) {
+            trunk.reset();
+            return false;
+        }
+
+        const uint64_t weights = trunk_fingerprint<trainer_t<dbn_t>::frozen_layers>(dbn);
+
+        if (trunk && trunk->weights == weights) {
+            if (dbn_traits<dbn_t>::shuffle()) {
+                std::shuffle(trunk->order.begin(), trunk->order.end(), dll::rand_engine());
+            }
+
+            return true;
+        }
+
+        dll::auto_timer timer("net:trainer:trunk");
+
+        trunk = std::make_unique<trunk_cache<weight>>();
+
+        auto& cache    = *trunk;
+        auto& features = trainer->trunk_batch();
+
+        const size_t sample_size = etl::size(features) / etl::dim<0>(features);
+
+        // The samples are cached in the order of the generator
+        generator.reset();
+
+        size_t i = 0;
+
+        for (; generator.has_next_batch(); generator.next_batch()) {
+            auto inputs = generator.data_batch();
+            auto labels = etl::force_temporary(generator.label_batch());
+
+            const size_t n          = etl::dim<0>(inputs);
+            const size_t label_size = etl::size(labels) / n;
+
+            if (!i) {
+                std::vector<size_t> label_dims;
+
+                for (size_t d = 1; d < etl::decay_traits<decltype(labels)>::dimensions(); ++d) {
+                    label_dims.push_back(etl::dim(labels, d));
+                }
+
+                if (!cache.init(generator.size(), sample_size, label_dims, dbn.compact_trunk, dbn.trunk_cache_file)) {
+                    break;
+                }
+            }
+
+            if (i + n > cache.samples) {
+                break;
+            }
+
+            trainer->forward_trunk(inputs);
+
+            for (size_t s = 0; s < n; ++s) {
+                cache.store(i + s, features.memory_start() + s * sample_size, labels.memory_start() + s * label_size);
+            }
+
+            i += n;
+        }
+
+        generator.reset();
+
+        // The generator must have generated all its samples
+        if (!i || i != cache.samples) {
+            std::cerr << "WARNING: The features of the frozen layers cannot be cached" << std::endl;
+
+            trunk.reset();
+            trunk_failed = true;
+
+            return false;
+        }
+
+        cache.weights = weights;
+
+        if (dbn_traits<dbn_t>::shuffle()) {
+            std::shuffle(cache.order.begin(), cache.order.end(), dll::rand_engine());
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Train the layers after the frozen layers for one epoch, from
+     * the cached features of the frozen layers
+     * \param epoch The current epoch
+     */
+    template <typename Generator>
+    void train_epoch_trunk(dbn_t& dbn, size_t epoch) {
+        constexpr size_t batch_size = dbn_t::batch_size;
+
+        auto& cache    = *trunk;
+        auto& features = trainer->trunk_batch();
+        auto labels    = cache.template make_labels<trunk_labels_dimensions<Generator>>(batch_size);
+
+        size_t batches = (cache.samples + batch_size - 1) / batch_size;
+
+        // In distributed training, all the ranks train the same number of batches
+        if (dbn.comm) {
+            double local_batches = batches;
+            all_reduce_min(*dbn.comm, &local_batches, 1);
+            batches = size_t(local_batches);
+        }
+
+        // Skip the batches already trained before the checkpoint
+        const size_t first_batch = std::min(skip_batches, batches);
+
+        skip_batches = 0;
+
+        for (size_t b = first_batch; b < batches; ++b) {
+            dll::auto_timer timer("net:trainer:train:epoch:batch");
+
+            const size_t first = b * batch_size;
+            const size_t n     = std::min(batch_size, cache.samples - first);
+
+            for (size_t s = 0; s < n; ++s) {
+                cache.load(cache.order[first + s], features.memory_start() + s * cache.sample_size, labels.memory_start() + s * cache.label_size);
+            }
+
+            update_learning_rate(dbn, batches);
+
+            watcher.ft_batch_start(epoch, dbn);
+
+            auto [batch_error, batch_loss] = trainer->train_trunk_batch(epoch, n, labels);
+
+            watcher.ft_batch_end(epoch, b, batches, batch_error, batch_loss, dbn);
+
+            // The cache has no queue
+            if constexpr (has_ft_batch_queue<watcher_t<dbn_t>>::value) {
+                watcher.ft_batch_queue(0);
+            }
+
+            // Periodic checkpoint (the end of the epoch is always checkpointed)
+            if (checkpoints && dbn.checkpoint_batches && ++checkpoint_step >= dbn.checkpoint_batches
+                && b + 1 < batches && checkpoint_ready()) {
+                save_checkpoint(dbn, epoch, b + 1);
+            }
+        }
+
+        // The weights are evaluated at the end of the epoch
+        flush_weights();
+    }
+
+    /*!
+     * \brief Set the learning rate of the network for the next batch,
+     * following its schedule
+     * \param dbn The network being trained
+     * \param batches The number of batches of one epoch
+     */
+    void update_learning_rate(dbn_t& dbn, size_t batches) {
+        if (dbn.schedule.enabled()) {
+            if (!schedule_total) {
+                schedule_total = max_epochs * batches;
+            }
+
+            dbn.learning_rate = base_learning_rate * dbn.schedule.factor(schedule_step++, schedule_total);
+        }
+    }
+
     /*!
      * \brief Train the network for one epoch
      * \param generator The generator for training data
@@ -396,20 +1048,103 @@ struct dbn_trainer {
         // Set the generator in train mode
         generator.set_train();
 
+        // Asynchronous trainers consume the generator by themselves
+        if constexpr (is_asynchronous_trainer<trainer_t<dbn_t>>::value) {
+            trainer->train_epoch(epoch, generator);
+
+            return;
+        }
+
+        // The trained layers are trained from the cached features of the frozen layers
+        if constexpr (trunk_cacheable<Generator>) {
+            if (prepare_trunk(dbn, generator)) {
+                train_epoch_trunk<Generator>(dbn, epoch);
+
+                return;
+            }
+        }
+
+        // In distributed training, all the ranks train the same number of batches
+        size_t batches = std::numeric_limits<size_t>::max();
+
+        if (dbn.comm) {
+            double local_batches = generator.batches();
+            all_reduce_min(*dbn.comm, &local_batches, 1);
+            batches = size_t(local_batches);
+        }
+
+        // Skip the batches already trained before the checkpoint
+        for (; skip_batches && generator.has_next_batch(); --skip_batches) {
+            generator.next_batch();
+        }
+
+        // Measure whether the epoch is bound by the generator or by the compute
+        if constexpr (has_stall_time<Generator>::value) {
+            generator.reset_stall();
+        }
+
+        auto epoch_start = std::chrono::steady_clock::now();
+
         //Train one mini-batch at a time
-        while(generator.has_next_batch()){
+        while(generator.has_next_batch() && generator.current_batch() < batches){
             dll::auto_timer timer("net:trainer:train:epoch:batch");
 
+            update_learning_rate(dbn, std::min(batches, generator.batches()));
+
             watcher.ft_batch_start(epoch, dbn);
 
+            // The recurrent layers only compute the time steps of the batch
+            dbn.set_batch_steps(generator);
+
+            // The samples drawn by importance are weighted
+            if constexpr (has_sample_importance<Generator>::value) {
+                trainer->set_sample_weights(generator.sample_weights());
+            }
+
             auto [batch_error, batch_loss] = trainer->train_batch(
                 epoch,
                 generator.data_batch(),
                 generator.label_batch());
 
+            // The losses of the samples are used to draw the next epochs
+            if constexpr (has_sample_importance<Generator>::value) {
+                generator.update_sample_losses(trainer->sample_losses);
+            }
+
             watcher.ft_batch_end(epoch, generator.current_batch(), generator.batches(), batch_error, batch_loss, dbn);
 
+            // The generators without read-ahead have no queue
+            if constexpr (has_ft_batch_queue<watcher_t<dbn_t>>::value) {
+                if constexpr (has_ready_batches<Generator>::value) {
+                    watcher.ft_batch_queue(generator.ready_batches());
+                } else {
+                    watcher.ft_batch_queue(0);
+                }
+            }
+
             generator.next_batch();
+
+            // Periodic checkpoint (the end of the epoch is always checkpointed)
+            if (checkpoints && dbn.checkpoint_batches && ++checkpoint_step >= dbn.checkpoint_batches
+                && generator.has_next_batch() && checkpoint_ready()) {
+                save_checkpoint(dbn, epoch, generator.current_batch());
+            }
+        }
+
+        dbn.reset_batch_steps(generator);
+
+        // The weights are evaluated at the end of the epoch
+        flush_weights();
+
+        if constexpr (has_sample_importance<Generator>::value) {
+            trainer->clear_sample_weights();
+        }
+
+        if constexpr (has_ft_epoch_stall<watcher_t<dbn_t>>::value && has_stall_time<Generator>::value) {
+            double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch_start).count();
+            watcher.ft_epoch_stall(epoch, generator.stall_time(), duration);
+        } else {
+            cpp_unused(epoch_start);
         }
     }
 
@@ -428,7 +1163,7 @@ struct dbn_trainer {
         train_epoch_only(dbn, generator, epoch);
 
         // Compute the error at this epoch
-        return compute_error_loss(dbn, generator);
+        return train_error_loss(dbn, generator);
     }
 
     /*!
@@ -448,7 +1183,7 @@ struct dbn_trainer {
         train_epoch_only(dbn, train_generator, epoch);
 
         // Compute the training error at this epoch
-        auto train_stats = compute_error_loss(dbn, train_generator);
+        auto train_stats = train_error_loss(dbn, train_generator);
 
         // Compute the training error at this epoch
         auto val_stats = compute_error_loss(dbn, val_generator);
@@ -479,12 +1214,15 @@ struct dbn_trainer {
     error_type train(DBN& dbn, Generator& generator, size_t max_epochs) {
         dll::auto_timer timer("net:trainer:train");
 
+        // Train within the threads and the CPUs of the network
+        auto scope = dbn.budget_scope();
+
         // Initialization steps
         start_training(dbn, max_epochs);
 
         //Train the model for max_epochs epoch
 
-        size_t epoch = 0;
+        size_t epoch = first_epoch;
         for (; epoch < max_epochs; ++epoch) {
             dll::auto_timer timer("net:trainer:train:epoch");
 
@@ -502,7 +1240,11 @@ struct dbn_trainer {
 
             auto [error, loss] = train_epoch(dbn, generator, epoch);
 
-            if(stop_epoch(dbn, epoch, error, loss)){
+            bool stop = stop_epoch(dbn, epoch, error, loss);
+
+            save_checkpoint(dbn, epoch + 1, 0);
+
+            if (stop) {
                 break;
             }
         }
@@ -526,15 +1268,25 @@ struct dbn_trainer {
     error_type train(DBN& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
         dll::auto_timer timer("net:trainer:train");
 
+        // Train within the threads and the CPUs of the network
+        auto scope = dbn.budget_scope();
+
         // The validation generator is always in test mode
         val_generator.set_test();
 
         // Initialization steps
         start_training(dbn, max_epochs);
 
+        // The generators must be distinct to validate during the training
+        if constexpr (async_validated) {
+            if (!dbn.comm && static_cast<void*>(&train_generator) != static_cast<void*>(&val_generator)) {
+                return train_async_validation(dbn, train_generator, val_generator, max_epochs);
+            }
+        }
+
         //Train the model for max_epochs epoch
 
-        size_t epoch = 0;
+        size_t epoch = first_epoch;
         for (; epoch < max_epochs; ++epoch) {
             dll::auto_timer timer("net:trainer:train:epoch");
 
@@ -549,7 +1301,11 @@ struct dbn_trainer {
 
             auto [train_stats, val_stats] = train_epoch(dbn, train_generator, val_generator, epoch);
 
-            if (stop_epoch(dbn, epoch, train_stats, val_stats)) {
+            bool stop = stop_epoch(dbn, epoch, train_stats, val_stats);
+
+            save_checkpoint(dbn, epoch + 1, 0);
+
+            if (stop) {
                 break;
             }
         }
@@ -558,6 +1314,165 @@ struct dbn_trainer {
 
         return stop_training(dbn, epoch, max_epochs);
     }
+
+    /*!
+     * \brief Train the network online, on a never-ending generator (see
+     * stream_generator).
+     *
+     * The network is trained in fixed-size steps (one batch per step), until
+     * the given number of steps or the end of the stream. There are no
+     * epochs: the generator is never reset nor shuffled and the error and
+     * the loss are never computed over the generator, the returned error is
+     * a running average of the errors of the batches. The learning rate
+     * schedule and the early stopping are not used.
+     *
+     * Every publish_steps steps, publish(dbn, step) is called with the network
+     * being trained, for instance to store a snapshot in a model_registry.
+     *
+     * \param dbn The network to be trained
+     * \param generator The generator of the stream
+     * \param steps The maximum number of steps (0 until the end of the stream)
+     * \param publish_steps The number of steps between two publications (0 for none)
+     * \param publish The functor publishing the network
+     *
+     * \return The running average of the errors of the batches
+     */
+    template <typename Generator, typename Publisher>
+    error_type train_stream(DBN& dbn, Generator& generator, size_t steps, size_t publish_steps, Publisher&& publish) {
+        static_assert(!is_asynchronous_trainer<trainer_t<dbn_t>>::value, "Asynchronous trainers cannot train on a stream");
+
+        dll::auto_timer timer("net:trainer:train:stream");
+
+        // Train within the threads and the CPUs of the network
+        auto scope = dbn.budget_scope();
+
+        // Initialization steps (a stream is a single epoch)
+        start_training(dbn, 1);
+
+        generator.set_train();
+
+        // The weight of the last batch in the running averages
+        constexpr double decay = 0.01;
+
+        size_t step = 0;
+
+        while ((!steps || step < steps) && generator.has_next_batch()) {
+            dll::auto_timer timer("net:trainer:train:stream:step");
+
+            watcher.ft_batch_start(0, dbn);
+
+            auto [batch_error, batch_loss] = trainer->train_batch(0, generator.data_batch(), generator.label_batch());
+
+            watcher.ft_batch_end(0, step, steps ? steps : step + 1, batch_error, batch_loss, dbn);
+
+            generator.next_batch();
+
+            current_error = step ? (1.0 - decay) * current_error + decay * batch_error : batch_error;
+            current_loss  = step ? (1.0 - decay) * current_loss + decay * batch_loss : batch_loss;
+
+            ++step;
+
+            if (publish_steps && step % publish_steps == 0) {
+                dll::auto_timer timer("net:trainer:train:stream:publish");
+
+                publish(static_cast<const dbn_t&>(dbn), step);
+            }
+        }
+
+        // Finalization (there is no best epoch to restore)
+
+        return stop_training(dbn, 0, 1);
+    }
+
+    /*!
+     * \brief Train the network for max_epochs, with the validation of each
+     * epoch in the background.
+     *
+     * The validation of an epoch runs on a snapshot of its weights. Without
+     * lag, it overlaps the computation of the training error. With lag, it
+     * overlaps the next epoch: the end of the epoch (watcher and early
+     * stopping) is then processed after the next epoch, on the weights of
+     * the snapshot. When the training stops early, the network is left with
+     * the weights of the decided epoch (or the best weights).
+     *
+     * \param dbn The network to be trained
+     * \param train_generator The generator for the training data
+     * \param val_generator The generator for the validation data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error
+     */
+    template <typename TrainGenerator, typename ValGenerator>
+    error_type train_async_validation(DBN& dbn, TrainGenerator& train_generator, ValGenerator& val_generator, size_t max_epochs) {
+        // The validator waits for its pending validation, even on errors
+        async_validator<dbn_t> background(dbn);
+
+        validator = &background;
+        lagged    = dbn.validation_lag;
+
+        std::pair<double, double> train_stats; // The training metrics of the pending validation
+        size_t pending_epoch = 0;              // The epoch of the pending validation
+
+        // Process the end of the validated epoch
+        auto finish_validation = [&]() {
+            auto val_stats = validator->wait();
+
+            bool stop = stop_epoch(dbn, pending_epoch, train_stats, val_stats);
+
+            // The last weights of the training are not the decided ones
+            if (stop && lagged && best_epoch == pending_epoch) {
+                copy_network_state(dbn, validator->network());
+            }
+
+            return stop;
+        };
+
+        bool stop    = false;
+        size_t epoch = first_epoch;
+
+        for (; epoch < max_epochs; ++epoch) {
+            dll::auto_timer timer("net:trainer:train:epoch");
+
+            reset_shuffle(train_generator);
+
+            start_epoch(dbn, epoch);
+
+            train_epoch_only(dbn, train_generator, epoch);
+
+            // The previous epoch is validated during this epoch
+            if (validator->pending() && finish_validation()) {
+                stop = true;
+                break;
+            }
+
+            validator->start(val_generator);
+
+            train_stats   = train_error_loss(dbn, train_generator);
+            pending_epoch = epoch;
+
+            if (!lagged && finish_validation()) {
+                stop = true;
+            }
+
+            save_checkpoint(dbn, epoch + 1, 0);
+
+            if (stop) {
+                break;
+            }
+        }
+
+        // The last epoch has not been validated yet
+        if (!stop && validator->pending()) {
+            stop = finish_validation();
+        }
+
+        auto error = stop_training(dbn, stop ? pending_epoch : epoch, max_epochs);
+
+        validator = nullptr;
+        lagged    = false;
+
+        return error;
+    }
 };
 
 } //end of dll namespace
@@ -0,0 +1,271 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file distributed.hpp
+ * \brief Communication layer for distributed (multi-process) training.
+ *
+ * The training only needs point-to-point transfers between ranks, from which
+ * the collective operations (ring all-reduce and broadcast) are built. A
+ * backend (MPI, sockets, ...) only has to implement the communicator
+ * interface. An in-process backend (local_group) is provided, where each rank
+ * is a thread.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Interface of a communicator between the ranks of a distributed
+ * training.
+ */
+struct communicator {
+    virtual ~communicator() = default;
+
+    /*!
+     * \brief Returns the rank of this process
+     */
+    virtual size_t rank() const = 0;
+
+    /*!
+     * \brief Returns the number of ranks
+     */
+    virtual size_t size() const = 0;
+
+    /*!
+     * \brief Send bytes to the given rank
+     */
+    virtual void send(size_t dst, const void* data, size_t bytes) = 0;
+
+    /*!
+     * \brief Receive bytes from the given rank
+     */
+    virtual void receive(size_t src, void* data, size_t bytes) = 0;
+
+    /*!
+     * \brief Send bytes to a rank while receiving bytes from another rank.
+     *
+     * The default implementation is only valid for buffered transports,
+     * blocking backends should override it (MPI_Sendrecv for instance).
+     */
+    virtual void send_receive(size_t dst, const void* send_data, size_t send_bytes, size_t src, void* recv_data, size_t recv_bytes) {
+        send(dst, send_data, send_bytes);
+        receive(src, recv_data, recv_bytes);
+    }
+};
+
+/*!
+ * \brief Ring all-reduce of the given values.
+ *
+ * The values are split in one chunk per rank. During the reduce-scatter
+ * phase, each rank sends one chunk to the next rank and reduces the chunk
+ * received from the previous one. After size - 1 steps, each rank owns one
+ * completely reduced chunk, which are then passed along the ring during the
+ * all-gather phase. Each rank sends and receives 2 * (size - 1) / size of the
+ * data, regardless of the number of ranks.
+ *
+ * \param comm The communicator
+ * \param values The values to reduce, in place
+ * \param n The number of values
+ * \param op The reduction operation
+ */
+template <typename T, typename Op>
+void ring_all_reduce(communicator& comm, T* values, size_t n, Op op) {
+    const size_t size = comm.size();
+
+    if (size == 1 || n == 0) {
+        return;
+    }
+
+    const size_t rank = comm.rank();
+    const size_t next = (rank + 1) % size;
+    const size_t prev = (rank + size - 1) % size;
+
+    auto chunk_first = [n, size](size_t c) { return (n * c) / size; };
+    auto chunk_size  = [&](size_t c) { return chunk_first(c + 1) - chunk_first(c); };
+
+    std::vector<T> buffer(chunk_size(0) + 1);
+
+    // Reduce-scatter
+
+    for (size_t step = 0; step < size - 1; ++step) {
+        const size_t send_chunk = (rank + size - step) % size;
+        const size_t recv_chunk = (rank + size - step - 1) % size;
+
+        buffer.resize(chunk_size(recv_chunk));
+
+        comm.send_receive(
+            next, values + chunk_first(send_chunk), chunk_size(send_chunk) * sizeof(T),
+            prev, buffer.data(), buffer.size() * sizeof(T));
+
+        T* target = values + chunk_first(recv_chunk);
+
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            target[i] = op(target[i], buffer[i]);
+        }
+    }
+
+    // All-gather
+
+    for (size_t step = 0; step < size - 1; ++step) {
+        const size_t send_chunk = (rank + 1 + size - step) % size;
+        const size_t recv_chunk = (rank + size - step) % size;
+
+        comm.send_receive(
+            next, values + chunk_first(send_chunk), chunk_size(send_chunk) * sizeof(T),
+            prev, values + chunk_first(recv_chunk), chunk_size(recv_chunk) * sizeof(T));
+    }
+}
+
+/*!
+ * \brief Sum the given values over all the ranks
+ */
+template <typename T>
+void all_reduce_sum(communicator& comm, T* values, size_t n) {
+    ring_all_reduce(comm, values, n, [](T a, T b) { return a + b; });
+}
+
+/*!
+ * \brief Compute the minimum of the given values over all the ranks
+ */
+template <typename T>
+void all_reduce_min(communicator& comm, T* values, size_t n) {
+    ring_all_reduce(comm, values, n, [](T a, T b) { return a < b ? a : b; });
+}
+
+/*!
+ * \brief Sum the given ETL container over all the ranks
+ */
+template <typename E>
+void all_reduce_sum(communicator& comm, E& values) {
+    all_reduce_sum(comm, values.memory_start(), etl::size(values));
+}
+
+/*!
+ * \brief Broadcast the given values from the root rank to the other ranks,
+ * along the ring.
+ */
+template <typename T>
+void broadcast(communicator& comm, T* values, size_t n, size_t root = 0) {
+    const size_t size = comm.size();
+    const size_t rank = comm.rank();
+
+    if (size == 1) {
+        return;
+    }
+
+    if (rank != root) {
+        comm.receive((rank + size - 1) % size, values, n * sizeof(T));
+    }
+
+    if ((rank + 1) % size != root) {
+        comm.send((rank + 1) % size, values, n * sizeof(T));
+    }
+}
+
+/*!
+ * \brief Broadcast the given ETL container from the root rank
+ */
+template <typename E>
+void broadcast(communicator& comm, E& values, size_t root = 0) {
+    broadcast(comm, values.memory_start(), etl::size(values), root);
+}
+
+/*!
+ * \brief A group of in-process ranks (one per thread), communicating
+ * through shared memory.
+ */
+struct local_group {
+    /*!
+     * \brief The communicator of one rank of the group
+     */
+    struct local_communicator final : communicator {
+        local_group& group; ///< The group
+        size_t id;          ///< The rank
+
+        /*!
+         * \brief Create the communicator of the given rank
+         */
+        local_communicator(local_group& group, size_t id) : group(group), id(id) {}
+
+        size_t rank() const override {
+            return id;
+        }
+
+        size_t size() const override {
+            return group.ranks;
+        }
+
+        void send(size_t dst, const void* data, size_t bytes) override {
+            auto* begin = static_cast<const char*>(data);
+
+            {
+                std::lock_guard<std::mutex> l(group.lock);
+                group.box(id, dst).emplace_back(begin, begin + bytes);
+            }
+
+            group.condition.notify_all();
+        }
+
+        void receive(size_t src, void* data, size_t bytes) override {
+            std::unique_lock<std::mutex> l(group.lock);
+
+            auto& box = group.box(src, id);
+
+            group.condition.wait(l, [&box] { return !box.empty(); });
+
+            cpp_assert(box.front().size() == bytes, "Invalid message size");
+
+            std::memcpy(data, box.front().data(), bytes);
+            box.pop_front();
+        }
+    };
+
+    /*!
+     * \brief Create a group of the given number of ranks
+     */
+    explicit local_group(size_t ranks) : ranks(ranks), boxes(ranks * ranks) {
+        for (size_t r = 0; r < ranks; ++r) {
+            communicators.emplace_back(*this, r);
+        }
+    }
+
+    local_group(const local_group& rhs) = delete;
+    local_group& operator=(const local_group& rhs) = delete;
+
+    /*!
+     * \brief Returns the communicator of the given rank
+     */
+    communicator& get(size_t rank) {
+        return communicators[rank];
+    }
+
+private:
+    std::deque<std::vector<char>>& box(size_t src, size_t dst) {
+        return boxes[src * ranks + dst];
+    }
+
+    const size_t ranks;                                 ///< The number of ranks
+    std::mutex lock;                                    ///< The lock protecting the mailboxes
+    std::condition_variable condition;                  ///< The condition variable for the receivers
+    std::vector<std::deque<std::vector<char>>> boxes;   ///< The mailboxes (src x dst)
+    std::deque<local_communicator> communicators;       ///< The communicator of each rank
+};
+
+} //end of dll namespace
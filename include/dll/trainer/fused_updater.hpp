@@ -0,0 +1,64 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Single-sweep element-wise kernels for the updaters of SGD
+ */
+
+#pragma once
+
+#include "etl/etl.hpp"
+
+#include "dll/util/cpu_dispatch.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Apply the functor to each element of the given memory blocks
+ * \param n The number of elements of each block
+ * \param f The functor
+ * \param p The memory blocks
+ */
+template <typename F, typename... P>
+DLL_CPU_BODY void fused_sweep_impl_body(size_t n, F& f, P*... p) {
+    for (size_t i = 0; i < n; ++i) {
+        f(p[i]...);
+    }
+}
+
+DLL_CPU_KERNEL(fused_sweep_impl)
+
+} //end of namespace detail
+
+/*!
+ * \brief Apply the functor to the elements of the given parameter and of its
+ * state tensors (gradients, moments, ...), in a single sweep.
+ *
+ * The functor receives a reference to the i-th element of each tensor. All
+ * the tensors must have the same size as the parameter. The ETL expressions
+ * of the updaters, on the other hand, read the gradients and the moments once
+ * per statement.
+ *
+ * \param f The functor
+ * \param w The parameter
+ * \param s The state tensors
+ */
+template <typename F, typename W, typename... S>
+void fused_sweep(F&& f, W& w, S&... s) {
+    w.ensure_cpu_up_to_date();
+    (s.ensure_cpu_up_to_date(), ...);
+
+    detail::fused_sweep_impl(etl::size(w), f, w.memory_start(), s.memory_start()...);
+
+    w.invalidate_gpu();
+    (s.invalidate_gpu(), ...);
+}
+
+} //end of dll namespace
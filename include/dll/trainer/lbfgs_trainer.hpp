@@ -0,0 +1,474 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file lbfgs_trainer.hpp
+ * \brief Full-batch Limited-memory BFGS (L-BFGS)
+ *
+ * Each epoch is one iteration of L-BFGS on the mean loss of the complete
+ * training set. The full-batch gradient is a parallel reduction: several
+ * workers pull batches from the generator and sum their gradients into their
+ * own flat buffer, the buffers of the workers being summed at the end of the
+ * pass. The parameters, the gradients and the history of L-BFGS are flat
+ * buffers in the order of the trainable variables of the network, the
+ * oldest pair of the history being overwritten by the new one.
+ *
+ * The step is found by a backtracking line search on the full-batch loss
+ * (one more pass over the generator per trial step). The weight decay of the
+ * network is not applied by this trainer.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "dll/util/flat_buffer.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/winograd_conv.hpp" // For invalidate_transforms
+#include "dll/trainer/stochastic_gradient_descent.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Full-batch L-BFGS trainer
+ */
+template <typename DBN>
+struct lbfgs_trainer {
+    using dbn_t     = DBN;                     ///< The type of DBN being trained
+    using weight    = typename dbn_t::weight;  ///< The data type for this layer
+    using this_type = lbfgs_trainer<dbn_t>;    ///< The type of this trainer
+    using worker_t  = sgd_trainer<dbn_t>;      ///< The trainer computing the gradients of each worker
+
+    static constexpr bool asynchronous = true; ///< Indicates that this trainer trains complete epochs
+
+    static constexpr size_t history_size = 10;   ///< The number of (s, y) pairs kept by L-BFGS
+    static constexpr size_t line_search  = 20;   ///< The maximum number of trial steps of the line search
+    static constexpr double armijo       = 1e-4; ///< The sufficient decrease factor of the line search
+
+    static_assert(dbn_traits<dbn_t>::data_parallel_workers() == 1, "L-BFGS cannot be combined with data-parallel SGD");
+
+    dbn_t& dbn;                                     ///< The DBN being trained
+    std::vector<std::unique_ptr<worker_t>> workers; ///< The trainer of each worker
+    std::vector<flat_buffer<weight>> sums;          ///< The sum of the gradients of each worker over the pass
+
+    flat_buffer<weight> x;         ///< The parameters of the current iterate
+    flat_buffer<weight> g;         ///< The gradient of the loss at the current iterate
+    flat_buffer<weight> x_trial;   ///< The parameters of the trial step
+    flat_buffer<weight> g_trial;   ///< The gradient of the loss at the trial step
+    flat_buffer<weight> direction; ///< The search direction
+
+    std::vector<flat_buffer<weight>> s; ///< The history of the steps
+    std::vector<flat_buffer<weight>> y; ///< The history of the differences of gradients
+    std::vector<double> rho;            ///< The inverse of the curvature (1 / s.y) of each pair
+    std::vector<double> alpha;          ///< The coefficients of the two-loop recursion
+    size_t head  = 0;                   ///< The slot of the next pair of the history
+    size_t pairs = 0;                   ///< The number of pairs of the history
+
+    double e       = 0.0;   ///< The error at the current iterate
+    double f       = 0.0;   ///< The loss at the current iterate
+    bool evaluated = false; ///< Indicates if e, f and g are the ones of the current weights
+
+    /*!
+     * \brief construct a new lbfgs_trainer
+     * \param dbn The DBN being trained
+     * \param threads The number of workers of the gradient evaluation
+     */
+    explicit lbfgs_trainer(dbn_t& dbn, size_t threads = etl::threads) : dbn(dbn), sums(threads), s(history_size), y(history_size), rho(history_size), alpha(history_size) {
+        cpp_assert(threads > 0, "L-BFGS needs at least one worker");
+
+        for (size_t t = 0; t < threads; ++t) {
+            workers.push_back(std::make_unique<worker_t>(dbn));
+        }
+    }
+
+    /*!
+     * \brief Initialize the training
+     */
+    void init_training(size_t batch_size) {
+        for (auto& worker : workers) {
+            worker->init_training(batch_size);
+        }
+
+        size_t n = 0;
+
+        for_each_parameter([&n](auto& w) {
+            n += etl::size(w);
+        });
+
+        for (auto& sum : sums) {
+            sum.resize(n);
+        }
+
+        for (auto* buffer : {&x, &g, &x_trial, &g_trial, &direction}) {
+            buffer->resize(n);
+        }
+
+        for (size_t i = 0; i < history_size; ++i) {
+            s[i].resize(n);
+            y[i].resize(n);
+        }
+
+        head      = 0;
+        pairs     = 0;
+        evaluated = false;
+    }
+
+    /*!
+     * \brief Train a batch of data: the gradients of the batch are computed
+     * and one step of L-BFGS is taken on the loss of this batch
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        cpp_unused(epoch);
+
+        std::mutex lock;
+        bool taken = false;
+
+        auto reset = [&taken] { taken = false; };
+
+        // The batch is given to the first worker asking for it
+        auto pull = [&](auto&& pass) {
+            {
+                std::lock_guard<std::mutex> l(lock);
+
+                if (taken) {
+                    return;
+                }
+
+                taken = true;
+            }
+
+            pass(inputs, labels);
+        };
+
+        // The loss of the batch is not the one of the full batch
+        evaluated = false;
+
+        auto metrics = iterate(reset, pull);
+
+        evaluated = false;
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Train a complete epoch of the generator: one iteration of
+     * L-BFGS on the full-batch loss.
+     *
+     * \param epoch The current epoch
+     * \param generator The generator of training data
+     */
+    template <typename Generator>
+    void train_epoch(size_t epoch, Generator& generator) {
+        dll::auto_timer timer("lbfgs::train_epoch");
+
+        cpp_unused(epoch);
+
+        cpp_assert(!dbn.comm, "L-BFGS does not support distributed training");
+
+        std::mutex lock;
+
+        auto reset = [&generator] { generator.reset(); };
+
+        // Each worker extracts the next batch of the generator (under a lock)
+        // and computes its gradients concurrently with the other workers
+        auto pull = [&](auto&& pass) {
+            while (true) {
+                std::unique_lock<std::mutex> l(lock);
+
+                if (!generator.has_next_batch()) {
+                    return;
+                }
+
+                auto inputs = etl::force_temporary(generator.data_batch());
+                auto labels = etl::force_temporary(generator.label_batch());
+
+                generator.next_batch();
+
+                l.unlock();
+
+                pass(inputs, labels);
+            }
+        };
+
+        iterate(reset, pull);
+    }
+
+    /*!
+     * \brief Forward a batch of inputs through the network (with the first
+     * worker)
+     */
+    template <bool Train, typename Inputs>
+    auto& forward_batch_helper(dbn_t& dbn, Inputs&& inputs) {
+        return workers.front()->template forward_batch_helper<Train>(dbn, inputs);
+    }
+
+    /*!
+     * \brief Return the name of the trainer
+     */
+    static std::string name() {
+        return "Limited-memory BFGS (L-BFGS)";
+    }
+
+private:
+    /*!
+     * \brief One iteration of L-BFGS on the loss of the batches given by
+     * pull (after reset)
+     * \return a pair containing the error and the loss at the new iterate
+     */
+    template <typename Reset, typename Pull>
+    std::pair<double, double> iterate(Reset& reset, Pull& pull) {
+        pack_parameters(x);
+
+        if (!evaluated) {
+            std::tie(e, f) = evaluate(reset, pull, g);
+            evaluated      = true;
+        }
+
+        compute_direction();
+
+        double slope = etl::dot(g.values, direction.values);
+
+        // Without a descent direction, the history is forgotten
+        if (!(slope < 0.0)) {
+            pairs            = 0;
+            direction.values = -g.values;
+            slope            = etl::dot(g.values, direction.values);
+        }
+
+        // Without curvature information, the first step is scaled by the gradient
+        double t = pairs ? 1.0 : std::min(1.0, 1.0 / std::sqrt(std::max(-slope, 1e-12)));
+
+        for (size_t trial = 0; trial < line_search; ++trial, t *= 0.5) {
+            x_trial.values = x.values + weight(t) * direction.values;
+
+            unpack_parameters(x_trial);
+
+            auto [error, loss] = evaluate(reset, pull, g_trial);
+
+            if (std::isfinite(loss) && loss <= f + armijo * t * slope) {
+                update_history();
+
+                e = error;
+                f = loss;
+
+                return {error, loss};
+            }
+        }
+
+        // No sufficient decrease: the weights are restored and the next
+        // iteration restarts from the gradient
+        unpack_parameters(x);
+
+        pairs = 0;
+
+        return {e, f};
+    }
+
+    /*!
+     * \brief Compute the search direction (-H * g) with the two-loop
+     * recursion on the history
+     */
+    void compute_direction() {
+        direction.values = -g.values;
+
+        for (size_t k = 0; k < pairs; ++k) {
+            const size_t i = (head + history_size - 1 - k) % history_size;
+
+            alpha[i] = rho[i] * etl::dot(s[i].values, direction.values);
+            direction.values -= weight(alpha[i]) * y[i].values;
+        }
+
+        // Scale by the curvature of the last pair
+        if (pairs) {
+            const size_t last = (head + history_size - 1) % history_size;
+
+            direction.values *= weight(1.0 / (rho[last] * etl::dot(y[last].values, y[last].values)));
+        }
+
+        for (size_t k = pairs; k > 0; --k) {
+            const size_t i = (head + history_size - k) % history_size;
+
+            const double beta = rho[i] * etl::dot(y[i].values, direction.values);
+            direction.values += weight(alpha[i] - beta) * s[i].values;
+        }
+    }
+
+    /*!
+     * \brief Record the accepted step in the history (in place of the oldest
+     * pair) and move to the trial iterate
+     */
+    void update_history() {
+        auto& s_new = s[head];
+        auto& y_new = y[head];
+
+        s_new.values = x_trial.values - x.values;
+        y_new.values = g_trial.values - g.values;
+
+        const double sy = etl::dot(s_new.values, y_new.values);
+
+        // The pair is only kept if it keeps the approximation positive definite
+        if (sy > 1e-10 * etl::dot(y_new.values, y_new.values)) {
+            rho[head] = 1.0 / sy;
+            head      = (head + 1) % history_size;
+            pairs     = std::min(pairs + 1, history_size);
+        }
+
+        std::swap(x.values, x_trial.values);
+        std::swap(g.values, g_trial.values);
+    }
+
+    /*!
+     * \brief Compute the mean loss and its gradient over all the batches
+     * given by pull, at the current weights of the network.
+     *
+     * \param reset The functor rewinding the batches
+     * \param pull The functor calling the given pass for the next batches, until there is none left
+     * \param gradient The flat buffer receiving the gradient of the loss
+     * \return a pair containing the mean error and the mean loss
+     */
+    template <typename Reset, typename Pull>
+    std::pair<double, double> evaluate(Reset& reset, Pull& pull, flat_buffer<weight>& gradient) {
+        dll::auto_timer timer("lbfgs::evaluate");
+
+        const size_t threads = workers.size();
+
+        std::vector<double> errors(threads);
+        std::vector<double> losses(threads);
+        std::vector<size_t> samples(threads);
+
+        for (auto& sum : sums) {
+            sum.values = weight(0);
+        }
+
+        auto work = [&](size_t t) {
+            pull([&](const auto& inputs, const auto& labels) {
+                auto [error, loss] = workers[t]->compute_batch_gradients(inputs, labels);
+
+                errors[t] += error;
+                losses[t] += loss;
+                samples[t] += etl::dim<0>(inputs);
+
+                sums[t].rewind();
+
+                workers[t]->for_each_gradients([&sum = sums[t]](auto& grad) {
+                    sum.add(grad);
+                });
+            });
+        };
+
+        reset();
+
+        // The workers pull the batches until there is none left, the ones
+        // started late by the scheduler have nothing left to compute
+        dll::parallel_for(threads, work);
+
+        double error = 0.0;
+        double loss  = 0.0;
+        size_t n     = 0;
+
+        for (size_t t = 0; t < threads; ++t) {
+            error += errors[t];
+            loss += losses[t];
+            n += samples[t];
+        }
+
+        cpp_assert(n > 0, "L-BFGS needs at least one sample");
+
+        // The sums of the workers are reduced by chunks, in parallel
+        const size_t size   = gradient.size();
+        const size_t chunks = std::max<size_t>(1, std::min(kernel_threads(), size / 4096));
+        const weight scale  = weight(-1.0 / n);
+
+        dll::parallel_for(chunks, [&](size_t c) {
+            const size_t first = c * size / chunks;
+            const size_t last  = (c + 1) * size / chunks;
+
+            weight* out = gradient.data();
+
+            for (size_t i = first; i < last; ++i) {
+                weight value = 0;
+
+                for (auto& sum : sums) {
+                    value += sum.data()[i];
+                }
+
+                // The gradients of SGD are in the direction of the descent
+                out[i] = scale * value;
+            }
+        });
+
+        return {error / n, loss / n};
+    }
+
+    /*!
+     * \brief Apply the functor to each trainable variable of each layer of
+     * the network, in the order of the gradients of the workers.
+     *
+     * \tparam Write Indicates if the functor modifies the variables
+     */
+    template <bool Write = false, typename Functor>
+    void for_each_parameter(Functor&& functor) {
+        auto visit = [&functor](auto& layer, auto& /*context*/) {
+            using layer_t = std::decay_t<decltype(layer)>;
+
+            if constexpr (decay_layer_traits<layer_t>::is_neural_layer()) {
+                static_assert(!has_sparse_gradients<layer_t>::value, "L-BFGS needs the dense gradients of the layers");
+
+                constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+                this_type::for_each_variable(layer, functor, std::make_index_sequence<N>());
+
+                if constexpr (Write) {
+                    dll::invalidate_transforms(layer);
+                }
+            }
+        };
+
+        cpp::for_each(workers.front()->full_context, [&visit](auto& layer_ctx) {
+            worker_t::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, visit);
+        });
+    }
+
+    /*!
+     * \brief Apply the functor to each trainable variable of a layer
+     */
+    template <typename Layer, typename Functor, size_t... I>
+    static void for_each_variable(Layer& layer, Functor& functor, std::index_sequence<I...> /*seq*/) {
+        (functor(std::get<I>(layer.trainable_parameters())), ...);
+    }
+
+    /*!
+     * \brief Copy the weights of the network into the given flat buffer
+     */
+    void pack_parameters(flat_buffer<weight>& buffer) {
+        buffer.rewind();
+
+        for_each_parameter([&buffer](auto& w) {
+            buffer.pack(w);
+        });
+    }
+
+    /*!
+     * \brief Copy the given flat buffer into the weights of the network
+     */
+    void unpack_parameters(flat_buffer<weight>& buffer) {
+        buffer.rewind();
+
+        for_each_parameter<true>([&buffer](auto& w) {
+            buffer.unpack(w);
+        });
+    }
+};
+
+} //end of dll namespace
@@ -185,6 +185,7 @@ struct rbm_trainer {
     template <typename InputBatch, typename ExpectedBatch>
     void train_batch(InputBatch&& input, ExpectedBatch&& expected, trainer_type& trainer, rbm_training_context& context, rbm_t& rbm) {
         ++batches;
+        samples += etl::dim<0>(input);
 
         trainer->train_batch(input, expected, context);
 
@@ -192,8 +193,13 @@ struct rbm_trainer {
         context.sparsity += context.batch_sparsity;
 
         if constexpr (EnableWatcher && rbm_layer_traits<rbm_t>::free_energy()) {
-            for (auto& v : input) {
-                context.free_energy += rbm.free_energy(v);
+            if constexpr (layer_traits<rbm_t>::is_convolutional_rbm_layer()) {
+                for (auto& v : input) {
+                    context.free_energy += rbm.free_energy(v);
+                }
+            } else {
+                // Computed by the trainer from the positive phase
+                context.free_energy += context.batch_free_energy;
             }
         }
 
@@ -23,6 +23,8 @@ struct rbm_training_context {
 
     double batch_error    = 0.0; ///< The mean reconstruction error for the last batch
     double batch_sparsity = 0.0; ///< The mean sparsity for the last batch
+
+    double batch_free_energy = 0.0; ///< The total free energy of the last batch (dense RBM only)
 };
 
 } //end of dll namespace
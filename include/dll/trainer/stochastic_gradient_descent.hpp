@@ -15,11 +15,39 @@
 
 #pragma once
 
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <numeric>
+#include <unordered_map>
+#include <limits>
+#include <algorithm>
+
+#include <thread>
+#include <functional>
+
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "dll/trainer/context_fwd.hpp" // For sgd_context
+#include "dll/trainer/distributed.hpp" // For all_reduce_sum
+#include "dll/trainer/fused_updater.hpp" // For fused_sweep
+#include "dll/neural/batch_normalization_fold.hpp" // For layer traits
+#include "dll/util/bfloat16.hpp"       // For round_bf16
+#include "dll/util/cce.hpp"            // For cce_errors_metrics
+#include "dll/util/sample_errors.hpp"  // For weight_sample_errors
 #include "dll/util/checks.hpp"         // For NaN checks
+#include "dll/util/flat_buffer.hpp"    // For flat_buffer
+#include "dll/util/memory.hpp"         // For memory_record
+#include "dll/util/parallel.hpp"       // For parallel_for and parallel_nodes
+#include "dll/util/pipeline.hpp"       // For pipeline_passes
+#include "dll/util/placement.hpp"      // For placement_scope
+#include "dll/util/sparse.hpp"         // For lazy_row_decay
+#include "dll/util/branches.hpp"       // For for_each_branch
+#include "dll/util/feature_queue.hpp"  // For feature_queue
+#include "dll/util/inplace.hpp"        // For keeps_input
 #include "dll/util/timers.hpp"         // For auto_timer
+#include "dll/util/winograd_conv.hpp"  // For invalidate_transforms
+#include "dll/util/wavefront.hpp"      // For wavefront_forward
 
 namespace dll {
 
@@ -32,6 +60,82 @@ static constexpr bool is_merge_layer = cpp::is_specialization_of_v<dll::merge_la
 template <typename Layer>
 static constexpr bool is_utility_layer = is_group_layer<Layer> || is_merge_layer<Layer>;
 
+/*!
+ * \brief Indicates if a pooling layer records the argmax of its windows
+ * during training.
+ */
+template <typename Layer, typename Enable = void>
+struct records_pool_indices : std::false_type {};
+
+template <typename Layer>
+struct records_pool_indices<Layer, std::enable_if_t<Layer::record_indices>> : std::true_type {};
+
+/*!
+ * \brief Indicates if a layer can normalize the parts of a batch with the
+ * statistics of the whole batch (see sync_batch_norm).
+ */
+template <typename Layer, typename Enable = void>
+struct is_sync_bn_layer : std::false_type {};
+
+template <typename Layer>
+struct is_sync_bn_layer<Layer, std::void_t<decltype(&Layer::sync_statistics)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if a layer can be trained by several data-parallel
+ * replicas at the same time.
+ *
+ * This is not the case of the layers with state modified by the training
+ * forward or backward passes (batch normalization, dropout, noise,
+ * recurrent layers and max pooling layers recording their argmax).
+ */
+template <typename Layer>
+static constexpr bool is_data_parallel_layer =
+       is_bn_foldable_layer<Layer>::value
+    || is_activation_layer<Layer>::value
+    || (decay_layer_traits<Layer>::is_pooling_layer() && !records_pool_indices<Layer>::value)
+    || (decay_layer_traits<Layer>::is_transform_layer()
+        && !cpp::is_specialization_of_v<dll::dropout_layer_impl, Layer>
+        && !cpp::is_specialization_of_v<dll::dyn_dropout_layer_impl, Layer>
+        && !cpp::is_specialization_of_v<dll::random_layer_impl, Layer>);
+
+/*!
+ * \brief Indicates if the gradients of a layer are sparse (only some rows of
+ * its weights are touched by each batch).
+ */
+template <typename Layer, typename Enable = void>
+struct has_sparse_gradients : std::false_type {};
+
+template <typename Layer>
+struct has_sparse_gradients<Layer, std::enable_if_t<Layer::sparse_gradients>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the layer of the given SGD context is trained: a neural
+ * layer which is not frozen, with gradients and a context for the updater.
+ */
+template <typename Layer, typename Context>
+static constexpr bool is_trained_layer = decay_layer_traits<Layer>::is_neural_layer() && !std::decay_t<Context>::frozen;
+
+/*!
+ * \brief Indicates if the updater has a lazy variant, applied only to the
+ * touched rows of sparse gradients.
+ */
+constexpr bool is_lazy_updater(updater_type UT) {
+    return UT == updater_type::SGD || UT == updater_type::MOMENTUM || UT == updater_type::ADAGRAD || UT == updater_type::ADAM;
+}
+
+/*!
+ * \brief A network with a smaller batch size, used to build the contexts of
+ * the data-parallel SGD replicas.
+ *
+ * The replicas only compute the gradients, so they always use the SGD updater
+ * context.
+ */
+template <typename DBN, size_t B>
+struct sgd_replica_network : DBN {
+    static constexpr size_t batch_size = B;                   ///< The batch size of the replica
+    static constexpr auto updater      = updater_type::SGD; ///< The updater of the replica
+};
+
 /*!
  * \brief Build the sub context for a updater context
  *
@@ -85,6 +189,13 @@ struct updater_sub_context <Layer, I, updater_type::SGD> {
     updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())) {
         grad = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tuple<>();
+    }
 };
 
 /*!
@@ -108,6 +219,13 @@ struct updater_sub_context <Layer, I, updater_type::MOMENTUM> {
         grad = 0;
         inc = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(inc);
+    }
 };
 
 /*!
@@ -133,6 +251,13 @@ struct updater_sub_context <Layer, I, updater_type::NESTEROV> {
         inc = 0;
         inc_prev = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(inc, inc_prev);
+    }
 };
 
 /*!
@@ -156,6 +281,13 @@ struct updater_sub_context <Layer, I, updater_type::RMSPROP> {
         grad = 0;
         inc = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(inc);
+    }
 };
 
 /*!
@@ -179,6 +311,13 @@ struct updater_sub_context <Layer, I, updater_type::ADAGRAD> {
         grad = 0;
         inc = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(inc);
+    }
 };
 
 /*!
@@ -206,6 +345,13 @@ struct updater_sub_context <Layer, I, updater_type::ADADELTA> {
         x = 0;
         v = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(g, x, v);
+    }
 };
 
 /*!
@@ -231,6 +377,13 @@ struct updater_sub_context <Layer, I, updater_type::ADAM> {
         m = 0;
         v = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(m, v);
+    }
 };
 
 /*!
@@ -260,6 +413,13 @@ struct updater_sub_context <Layer, I, updater_type::ADAM_CORRECT> {
         v = 0;
         vt = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(m, mt, v, vt);
+    }
 };
 
 /*!
@@ -293,6 +453,13 @@ struct updater_sub_context <Layer, I, updater_type::NADAM> {
 
         m_schedule = 1.0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(m, mt, v, vt, m_schedule);
+    }
 };
 
 /*!
@@ -318,13 +485,114 @@ struct updater_sub_context <Layer, I, updater_type::ADAMAX> {
         m = 0;
         v = 0;
     }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(m, v);
+    }
+};
+
+/*!
+ * \brief The context for the LARS updater
+ */
+template<typename Layer, size_t I>
+struct updater_sub_context <Layer, I, updater_type::LARS> {
+    /*!
+     * \brief The type of the variable to optimize
+     */
+    using type = std::remove_reference_t<decltype(std::get<I>(std::declval<Layer>().trainable_parameters()))>;
+
+    type grad; ///< The gradients of the variable
+    type inc;  ///< The accumulated momentum cache
+
+    /*!
+     * \brief Construct the sub_context for the given layer
+     * \param layer The layer to build the context for
+     */
+    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), inc(grad) {
+        grad = 0;
+        inc = 0;
+    }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(inc);
+    }
+};
+
+/*!
+ * \brief The context for the LAMB updater
+ */
+template<typename Layer, size_t I>
+struct updater_sub_context <Layer, I, updater_type::LAMB> {
+    /*!
+     * \brief The type of the variable to optimize
+     */
+    using type = std::remove_reference_t<decltype(std::get<I>(std::declval<Layer>().trainable_parameters()))>;
+
+    type grad; ///< The gradients of the variable
+    type m;    ///< Estimates of the first moment of the gradient
+    type v;    ///< Estimates of the second moment of the gradient
+    type r;    ///< The Adam update, before the trust ratio
+
+    /*!
+     * \brief Construct the sub_context for the given layer
+     * \param layer The layer to build the context for
+     */
+    updater_sub_context(const Layer& layer) : grad(std::get<I>(layer.trainable_parameters())), m(grad), v(grad), r(grad) {
+        grad = 0;
+        m = 0;
+        v = 0;
+        r = 0;
+    }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tie(m, v, r);
+    }
 };
 
 
+/*!
+ * \brief The sub context of an updater in mixed precision, with the single
+ * precision master copy of the variable.
+ *
+ * The updater is applied to the master copy, which is then rounded into the
+ * variable of the layer.
+ */
+template<typename Layer, size_t I, updater_type UT>
+struct mixed_sub_context : updater_sub_context<Layer, I, UT> {
+    using base_type = updater_sub_context<Layer, I, UT>; ///< The sub context of the updater
+    using type      = typename base_type::type;          ///< The type of the variable to optimize
+
+    type master; ///< The master copy of the variable
+
+    /*!
+     * \brief Construct the sub_context for the given layer
+     * \param layer The layer to build the context for
+     */
+    mixed_sub_context(const Layer& layer) : base_type(layer), master(std::get<I>(layer.trainable_parameters())) {
+        // Nothing else to init
+    }
+
+    /*!
+     * \brief Returns the state of the updater, to be checkpointed
+     */
+    auto state() {
+        return std::tuple_cat(base_type::state(), std::tie(master));
+    }
+};
+
 /*!
  * \brief The context for the base updater (no update).
  */
-template <updater_type UT, bool Neural, typename Layer>
+template <updater_type UT, bool Neural, typename Layer, bool Mixed = false>
 struct updater_context {
     /*!
      * \brief Construct a new updater_context using the parent context
@@ -338,7 +606,7 @@ struct updater_context {
  * \brief The context for the real updaters.
  */
 template <updater_type UT, typename Layer>
-struct updater_context<UT, true, Layer> {
+struct updater_context<UT, true, Layer, false> {
     /*!
      * \brief The context for the updater and for each variable of the layer
      */
@@ -352,6 +620,24 @@ struct updater_context<UT, true, Layer> {
     }
 };
 
+/*!
+ * \brief The context for the real updaters, in mixed precision.
+ */
+template <updater_type UT, typename Layer>
+struct updater_context<UT, true, Layer, true> {
+    /*!
+     * \brief The context for the updater and for each variable of the layer
+     */
+    decltype(build_sub_context<mixed_sub_context, UT>(std::declval<Layer&>())) context;
+
+    /*!
+     * \brief Construct a new updater_context using the parent context
+     */
+    updater_context(const Layer& layer) : context(build_sub_context<mixed_sub_context, UT>(layer)) {
+        // Nothing else to init
+    }
+};
+
 /*!
  * \brief The full SGD context, it contains the context of the layer as well as
  * the context for the SGD updater
@@ -360,10 +646,14 @@ template <typename DBN, typename Layer, size_t L>
 struct full_sgd_context : sgd_context<DBN, Layer, L> {
     using context_type = sgd_context<DBN, Layer, L>; ///< The parent context type
 
+    static constexpr bool frozen = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
+
     /*!
-     * \brief The updater context
+     * \brief The updater context (none for the frozen layers)
      */
-    updater_context<DBN::updater, decay_layer_traits<Layer>::is_neural_layer(), Layer> up;
+    updater_context<DBN::updater, decay_layer_traits<Layer>::is_neural_layer() && !frozen, Layer, dbn_traits<DBN>::has_mixed_precision()> up;
+
+    bool cpu = false; ///< Indicates if the layer is placed on the CPU (see autoplace())
 
     /*!
      * \brief Construct the full_sgd_context for the given layer
@@ -382,7 +672,8 @@ struct full_sgd_context <DBN, group_layer_impl<group_layer_desc<Layers...>>, L>
     using layer_t      = group_layer_impl<group_layer_desc<Layers...>>; ///< The layer
     using context_type = sgd_context<DBN, layer_t, L>;                  ///< The parent context type
 
-    static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t n_layers = sizeof...(Layers);                   ///< The number of layers
+    static constexpr bool frozen      = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
@@ -403,7 +694,8 @@ struct full_sgd_context <DBN, dyn_group_layer_impl<dyn_group_layer_desc<Layers..
     using layer_t      = dyn_group_layer_impl<dyn_group_layer_desc<Layers...>>; ///< The layer
     using context_type = sgd_context<DBN, layer_t, L>;                  ///< The parent context type
 
-    static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t n_layers = sizeof...(Layers);                   ///< The number of layers
+    static constexpr bool frozen      = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
@@ -424,7 +716,8 @@ struct full_sgd_context<DBN, merge_layer_impl<merge_layer_desc<D, Layers...>>, L
     using layer_t      = merge_layer_impl<merge_layer_desc<D, Layers...>>; ///< The layer
     using context_type = sgd_context<DBN, layer_t, L>;                     ///< The parent context type
 
-    static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t n_layers = sizeof...(Layers);                   ///< The number of layers
+    static constexpr bool frozen      = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
@@ -445,7 +738,8 @@ struct full_sgd_context<DBN, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers
     using layer_t      = dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers...>>; ///< The layer
     using context_type = sgd_context<DBN, layer_t, L>;                     ///< The parent context type
 
-    static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t n_layers = sizeof...(Layers);                   ///< The number of layers
+    static constexpr bool frozen      = L < dbn_traits<DBN>::frozen_layers(); ///< Indicates if the layer is frozen
 
     std::tuple<full_sgd_context<DBN, Layers, L>...> sub_contexts; ///< The sub contexts
 
@@ -457,6 +751,106 @@ struct full_sgd_context<DBN, dyn_merge_layer_impl<dyn_merge_layer_desc<D, Layers
     }
 };
 
+/*!
+ * \brief Liveness-based memory plan of the activation buffers of the SGD
+ * contexts.
+ *
+ * Each buffer (input, output and errors of each layer) is alive from the step
+ * of the training schedule that first writes it to the last step that reads it.
+ * Buffers are assigned (greedily, from the largest) to offsets of a single
+ * arena so that buffers with overlapping lifetimes never share memory.
+ */
+struct sgd_memory_plan {
+    /*!
+     * \brief One activation buffer
+     */
+    struct buffer {
+        const char* name; ///< The name of the buffer (input, output or errors)
+        size_t layer;     ///< The index of the layer
+        size_t size;      ///< The size of the buffer, in bytes
+        size_t first;     ///< The first step using the buffer
+        size_t last;      ///< The last step using the buffer
+        size_t offset;    ///< The offset of the buffer inside the arena
+    };
+
+    std::vector<buffer> buffers; ///< The buffers of the plan
+    size_t arena_size = 0;       ///< The size of the arena, in bytes
+
+    /*!
+     * \brief Add a new buffer to the plan
+     */
+    void add(const char* name, size_t layer, size_t size, size_t first, size_t last) {
+        buffers.push_back({name, layer, size, first, last, 0});
+    }
+
+    /*!
+     * \brief Returns the memory used without sharing, in bytes
+     */
+    size_t total_size() const {
+        size_t total = 0;
+
+        for (auto& b : buffers) {
+            total += b.size;
+        }
+
+        return total;
+    }
+
+    /*!
+     * \brief Assign an offset to each buffer
+     */
+    void plan() {
+        std::vector<size_t> order(buffers.size());
+        std::iota(order.begin(), order.end(), 0);
+
+        std::stable_sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) {
+            return buffers[lhs].size > buffers[rhs].size;
+        });
+
+        std::vector<size_t> placed;
+
+        arena_size = 0;
+
+        for (size_t i : order) {
+            auto& b = buffers[i];
+
+            // Collect the placed buffers alive at the same time, by offset
+
+            std::vector<size_t> alive;
+
+            for (size_t j : placed) {
+                if (buffers[j].first <= b.last && b.first <= buffers[j].last) {
+                    alive.push_back(j);
+                }
+            }
+
+            std::sort(alive.begin(), alive.end(), [this](size_t lhs, size_t rhs) {
+                return buffers[lhs].offset < buffers[rhs].offset;
+            });
+
+            // Find the smallest gap that can hold the buffer
+
+            size_t best      = std::numeric_limits<size_t>::max();
+            size_t best_gap  = std::numeric_limits<size_t>::max();
+            size_t current   = 0;
+
+            for (size_t j : alive) {
+                if (buffers[j].offset >= current + b.size && buffers[j].offset - current < best_gap) {
+                    best     = current;
+                    best_gap = buffers[j].offset - current;
+                }
+
+                current = std::max(current, buffers[j].offset + buffers[j].size);
+            }
+
+            b.offset   = best == std::numeric_limits<size_t>::max() ? current : best;
+            arena_size = std::max(arena_size, b.offset + b.size);
+
+            placed.push_back(i);
+        }
+    }
+};
+
 /*!
  * \brief Build the context for a DBN for the given sequence of layers
  * \param dbn The DBN to build the context from
@@ -481,6 +875,30 @@ auto build_context(DBN& dbn){
     return build_context<Context>(dbn, std::make_index_sequence<DBN::layers>());
 }
 
+/*!
+ * \brief Build the context of a replica network R for a DBN
+ * \param dbn The DBN to build the context from
+ */
+template<template<typename, typename, size_t> typename Context, typename R, typename DBN, size_t... I>
+auto build_replica_context(DBN& dbn, std::index_sequence<I...> /*seq*/){
+    return std::make_tuple
+        (
+            (std::make_pair(
+                std::ref(dbn.template layer_get<I>()),  // Reference to the layer
+                std::make_shared<Context<R, typename DBN::template layer_type<I>, I>>(dbn.template layer_get<I>()))
+            )...
+        );
+}
+
+/*!
+ * \brief Build the context of a replica network R for a DBN
+ * \param dbn The DBN to build the context from
+ */
+template<template<typename, typename, size_t> typename Context, typename R, typename DBN>
+auto build_replica_context(DBN& dbn){
+    return build_replica_context<Context, R>(dbn, std::make_index_sequence<DBN::layers>());
+}
+
 /*!
  * \brief Simple gradient descent trainer
  */
@@ -493,9 +911,68 @@ struct sgd_trainer {
     static constexpr auto layers     = dbn_t::layers;     ///< The number of layers
     static constexpr auto batch_size = dbn_t::batch_size; ///< The batch size for training
 
+    static constexpr size_t workers       = dbn_traits<dbn_t>::data_parallel_workers(); ///< The number of data-parallel workers
+    static constexpr size_t replica_batch = batch_size / workers;                       ///< The batch size of each worker
+    static constexpr bool numa            = workers > 1 && dbn_traits<dbn_t>::is_numa(); ///< Indicates if the workers are placed on the NUMA nodes
+    static constexpr size_t stages        = workers > 1 ? dbn_traits<dbn_t>::pipeline_stages() : 1; ///< The number of pipeline stages of the workers
+
+    using replica_t         = sgd_replica_network<dbn_t, replica_batch>;                                  ///< The network type of the replicas
+    using replica_context_t = decltype(build_replica_context<full_sgd_context, replica_t>(std::declval<dbn_t&>())); ///< The context of a replica
+
+    static constexpr size_t accumulation = dbn_traits<dbn_t>::gradient_accumulation(); ///< The number of micro-batches of one update
+    static constexpr bool checkpointable = true;                                        ///< Indicates that the state of the trainer can be checkpointed
+    static constexpr bool backup_fenced  = true;                                        ///< Indicates that the trainer waits for the backup of the weights before its updates
+    static constexpr bool lazy_weights   = dbn_traits<dbn_t>::has_lazy_decay();        ///< Indicates that the decay of the weights is applied lazily
+
+    static constexpr size_t check_interval = accumulation == 1 ? dbn_traits<dbn_t>::check_finite_interval() : 0; ///< The number of batches between two finite checks (0 for none)
+    static constexpr size_t frozen_layers  = dbn_traits<dbn_t>::frozen_layers();                                 ///< The number of first layers not trained
+
+    /*!
+     * \brief Indicates if the gradients of all the layers are clipped
+     * together by their global norm, see global_clip().
+     */
+    static constexpr bool global_clipping = dbn_traits<dbn_t>::has_clip_gradients() && dbn_traits<dbn_t>::has_clip_global_norm();
+
+    /*!
+     * \brief Indicates if the batch normalization layers are normalized with
+     * the statistics of the whole batch, over the replicas and the ranks, see
+     * sync_forward() and sync_backward().
+     */
+    static constexpr bool sync_batch_norm = dbn_traits<dbn_t>::has_sync_batch_norm();
+
+    /*!
+     * \brief Indicates if the trainer can train the network from the cached
+     * features of its frozen layers (the trunk), see train_trunk_batch().
+     *
+     * The data-parallel workers and the checkpointed activations need the
+     * inputs of the network.
+     */
+    static constexpr bool trunk_cached = frozen_layers > 0 && workers == 1 && dbn_traits<dbn_t>::checkpoint_interval() == 1 && !sync_batch_norm;
+
+    static_assert(batch_size % workers == 0, "The batch size must be divisible by the number of data-parallel workers");
+    static_assert(frozen_layers < layers, "At least the last layer must be trained");
+
     dbn_t& dbn;                                                  ///< The DBN being trained
     decltype(build_context<full_sgd_context>(dbn)) full_context; ///< The context
+    std::vector<replica_context_t> replicas;                     ///< The contexts of the data-parallel workers
+    std::vector<std::unique_ptr<dbn_t>> node_networks;           ///< The copies of the network on each NUMA node (with numa)
+    std::vector<size_t> node_replicas;                           ///< The first replica of each NUMA node, and the end (with numa)
     size_t iteration;                                            ///< The current iteration
+    flat_buffer<weight> flat_grads;                              ///< The contiguous gradients of all the layers (with flat_parameters)
+    flat_buffer<weight> accumulated_grads;                       ///< The gradients accumulated over the micro-batches
+    size_t micro_batch         = 0;                              ///< The current micro-batch of the accumulation
+    size_t accumulated_samples = 0;                              ///< The number of samples of the accumulated gradients
+    double loss_scale          = 1.0;                            ///< The current loss scale (mixed precision)
+    size_t scaled_updates      = 0;                              ///< The number of updates without overflow at the current loss scale
+    size_t checked_batches     = 0;                              ///< The number of batches since the last finite check
+    weight clip_scale          = 1.0;                            ///< The scale of the gradients of the current update (with clip_global_norm)
+    std::vector<weight> sample_weights;                          ///< The weights of the samples of the batch (empty if not weighted)
+    std::vector<double> sample_losses;                           ///< The losses of the samples of the batch, when weighted
+
+    std::unordered_map<const void*, weight*> ema_shadows; ///< The moving average of each variable, in the shadow copy of the network
+    std::unordered_map<const void*, lazy_row_decay> lazy_decays; ///< The lazy decay of the rows of each sparse variable (with lazy_decay)
+    std::vector<weight> bn_sums;                                 ///< The added sums of the parts of a synchronized normalization layer (with sync_batch_norm)
+    std::vector<memory_record> memory;                    ///< The accounting of the contexts
 
     // Transform layers need to inherit dimensions from back
 
@@ -527,58 +1004,407 @@ struct sgd_trainer {
     explicit sgd_trainer(dbn_t& dbn) : dbn(dbn), full_context(build_context<full_sgd_context>(dbn)), iteration(1) {
         // Inherit dimensions from front to end (for transform layers)
 
-        cpp::for_each_pair(full_context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
-            constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
+        inherit_contexts(full_context);
 
-            if (l2_transform) {
-                this_type::inherit_from_front(layer_ctx_1, layer_ctx_2);
-            }
-        });
-    }
+        tie_contexts(full_context);
 
-    /*!
-     * \brief Initialize the training
-     */
-    void init_training(size_t) {}
+        apply_placement();
 
-    // CPP17 Replace SFINAE with if constexpr
+        static_assert(!dbn_traits<dbn_t>::has_mixed_precision() || (workers == 1 && accumulation == 1),
+                      "Mixed precision is not supported with data-parallel SGD or gradient accumulation");
 
-    /*!
-     * \brief Compute the errors of the last layer given the loss function
-     */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+        static_assert(!sync_batch_norm || dbn_traits<dbn_t>::checkpoint_interval() == 1,
+                      "Synchronized batch normalization is not supported with checkpointing");
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+        if constexpr (workers > 1) {
+            static_assert(dbn_traits<dbn_t>::checkpoint_interval() == 1, "Checkpointing is not supported with data-parallel SGD");
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = labels(i) - last_ctx.output(i);
+            cpp::for_each(full_context, [](auto& layer_ctx) {
+                using layer_t = std::decay_t<decltype(layer_ctx.first)>;
+
+                // The synchronized normalization layers only share their statistics
+                static_assert(is_data_parallel_layer<layer_t> || (sync_batch_norm && is_sync_bn_layer<layer_t>::value),
+                              "This layer does not support data-parallel SGD");
+            });
+
+            static_assert(!sync_batch_norm || (stages == 1 && !numa), "Synchronized batch normalization is not supported with pipeline stages or NUMA replicas");
+
+            static_assert(stages <= layers, "The pipeline cannot have more stages than layers");
+            static_assert(stages == 1 || !numa, "The pipeline stages are placed on the NUMA nodes, the replicas cannot be");
+
+            if constexpr (numa) {
+                static_assert(!dbn_traits<dbn_t>::is_dynamic(), "NUMA replicas need a network with static layers");
+
+                build_node_replicas();
+            } else {
+                for (size_t w = 0; w < workers; ++w) {
+                    replicas.push_back(build_replica_context<full_sgd_context, replica_t>(dbn));
+                    inherit_contexts(replicas.back());
+                }
             }
-        } else {
-            last_ctx.errors = labels - last_ctx.output;
         }
 
-        // Note: No need to multiply by the derivative of
-        // the activation function since the terms are
-        // canceling out in the derivative of the loss
+        // The weights of the dynamic layers are only known now
+        dbn.account_memory();
+
+        account_memory(full_context);
+
+        for (auto& replica : replicas) {
+            account_memory(replica);
+        }
+    }
+
+    /*!
+     * \brief Returns the size, in bytes, of the given buffer (or scalar) of
+     * a context
+     */
+    template <typename T>
+    static size_t memory_bytes(const T& value) {
+        if constexpr (etl::is_etl_expr<T>) {
+            return etl::size(value) * sizeof(etl::value_t<T>);
+        } else {
+            cpp_unused(value);
+            return sizeof(T);
+        }
+    }
+
+    /*!
+     * \brief Account the memory of the given contexts: the activations, the
+     * gradients and the state of the updater of each layer
+     */
+    template <typename Contexts>
+    void account_memory(Contexts& context) {
+        cpp::for_each_i(context, [this](size_t l, auto& layer_ctx) {
+            size_t activations = 0;
+            size_t gradients   = 0;
+            size_t optimizer   = 0;
+
+            auto visit = [&](auto& layer, auto& ctx) {
+                activations += memory_bytes(ctx.input) + memory_bytes(ctx.output) + memory_bytes(ctx.errors);
+
+                if constexpr (is_trained_layer<decltype(layer), decltype(ctx)>) {
+                    cpp::for_each(ctx.up.context, [&](auto& sub_context) {
+                        gradients += this_type::memory_bytes(sub_context->grad);
+
+                        std::apply([&](auto&... state) { optimizer += (size_t(0) + ... + this_type::memory_bytes(state)); }, sub_context->state());
+                    });
+                } else {
+                    cpp_unused(layer);
+                }
+            };
+
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, visit);
+
+            memory.emplace_back(memory_subsystem::ACTIVATIONS, l, activations);
+            memory.emplace_back(memory_subsystem::GRADIENTS, l, gradients);
+            memory.emplace_back(memory_subsystem::OPTIMIZER, l, optimizer);
+        });
+    }
+
+    /*!
+     * \brief Build the copies of the network and the contexts of the
+     * replicas on the NUMA nodes.
+     *
+     * The replicas are split in contiguous blocks between the nodes. Each
+     * node allocates its copy and its contexts from a thread pinned to the
+     * node, so that their pages are first touched (and placed) on the node.
+     */
+    void build_node_replicas() {
+        const size_t nodes = std::min(numa_nodes().size(), workers);
+
+        node_replicas.resize(nodes + 1);
+
+        for (size_t k = 0; k <= nodes; ++k) {
+            node_replicas[k] = k * workers / nodes;
+        }
+
+        node_networks.resize(nodes);
+
+        std::vector<std::vector<replica_context_t>> contexts(nodes);
+
+        parallel_nodes(nodes, [this, &contexts](size_t k) {
+            node_networks[k] = std::make_unique<dbn_t>();
+
+            copy_weights(*node_networks[k], dbn);
+
+            for (size_t w = node_replicas[k]; w < node_replicas[k + 1]; ++w) {
+                contexts[k].push_back(build_replica_context<full_sgd_context, replica_t>(*node_networks[k]));
+                inherit_contexts(contexts[k].back());
+            }
+        });
+
+        for (auto& node_contexts : contexts) {
+            for (auto& context : node_contexts) {
+                replicas.push_back(std::move(context));
+            }
+        }
+    }
+
+    /*!
+     * \brief Copy the weights of the src network into the dst network
+     */
+    static void copy_weights(dbn_t& dst, dbn_t& src) {
+        copy_weights(dst, src, std::make_index_sequence<layers>());
+    }
+
+    /*!
+     * \brief Copy the weights of each layer of the src network into the dst
+     * network
+     */
+    template <size_t... I>
+    static void copy_weights(dbn_t& dst, dbn_t& src, std::index_sequence<I...> /*seq*/) {
+        (copy_layer_weights(dst.template layer_get<I>(), src.template layer_get<I>()), ...);
+    }
+
+    /*!
+     * \brief Copy the number of time steps computed by the recurrent layers
+     * of the src network into the dst network
+     */
+    template <size_t... I>
+    static void copy_active_steps(dbn_t& dst, dbn_t& src, std::index_sequence<I...> /*seq*/) {
+        (copy_layer_active_steps(dst.template layer_get<I>(), src.template layer_get<I>()), ...);
+    }
+
+    /*!
+     * \brief Copy the number of time steps computed by the src layer into the
+     * dst layer
+     */
+    template <typename Layer>
+    static void copy_layer_active_steps(Layer& dst, Layer& src) {
+        if constexpr (has_active_steps<Layer>::value) {
+            dst.active_steps = src.active_steps;
+        }
+
+        if constexpr (has_sample_steps<Layer>::value) {
+            dst.sample_steps = src.sample_steps;
+        }
+
+        cpp_unused(dst);
+        cpp_unused(src);
+    }
+
+    /*!
+     * \brief Copy the weights of the src layer into the dst layer
+     */
+    template <typename Layer>
+    static void copy_layer_weights(Layer& dst, Layer& src) {
+        if constexpr (decay_layer_traits<Layer>::is_neural_layer()) {
+            constexpr size_t N = std::tuple_size<decltype(src.trainable_parameters())>();
+
+            copy_layer_weights(dst, src, std::make_index_sequence<N>());
+
+            dll::invalidate_transforms(dst);
+        } else {
+            cpp_unused(dst);
+            cpp_unused(src);
+        }
+    }
+
+    /*!
+     * \brief Copy each trainable variable of the src layer into the dst layer
+     */
+    template <typename Layer, size_t... I>
+    static void copy_layer_weights(Layer& dst, Layer& src, std::index_sequence<I...> /*seq*/) {
+        ((std::get<I>(dst.trainable_parameters()) = std::get<I>(src.trainable_parameters())), ...);
     }
 
+    /*!
+     * \brief Inherit the dimensions of the given contexts from front to end
+     * (for transform layers)
+     */
+    template <typename Contexts>
+    static void inherit_contexts(Contexts& context) {
+        cpp::for_each_pair(context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
+            constexpr bool l2_transform = decay_layer_traits<decltype(layer_ctx_2.first)>::is_transform_layer();
+
+            if (l2_transform) {
+                this_type::inherit_from_front(layer_ctx_1, layer_ctx_2);
+            }
+        });
+    }
+
+    /*!
+     * \brief Bind the gradients of the tied weights of the given contexts
+     * to the contexts of the layers owning the weights, which sum them into
+     * their own gradients.
+     */
+    template <typename Contexts>
+    static void tie_contexts(Contexts& context) {
+        cpp::for_each(context, [&context](auto& layer_ctx) {
+            using layer_t = std::decay_t<decltype(layer_ctx.first)>;
+
+            if constexpr (has_tied_weights<layer_t>::value) {
+                std::get<layer_t::tied_layer>(context).second->tied_gradients = &layer_ctx.second->tied_gradients;
+            }
+        });
+    }
+
+    /*!
+     * \brief Initialize the training
+     */
+    void init_training(size_t) {
+        // All the ranks must start from the same weights
+        if (dbn.comm) {
+            dbn.for_each_layer([this](auto& layer) {
+                if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                    auto parameters = layer.trainable_parameters();
+
+                    cpp::for_each(parameters, [this](auto& w) {
+                        broadcast(*dbn.comm, w);
+                    });
+
+                    dll::invalidate_transforms(layer);
+                }
+            });
+        }
+
+        // The moving average starts from the initial weights
+        if constexpr (dbn_traits<dbn_t>::has_ema_weights()) {
+            dbn.ema.resize(dbn.parameters_size());
+
+            dbn.for_each_layer([this](auto& layer) {
+                if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                    cpp::for_each(layer.trainable_parameters(), [this](auto& w) {
+                        dbn.ema.pack(w);
+                    });
+                }
+            });
+
+            dbn.ema.rewind();
+            ema_shadows.clear();
+
+            dbn.for_each_layer([this](auto& layer) {
+                if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                    cpp::for_each(layer.trainable_parameters(), [this](auto& w) {
+                        ema_shadows[&w] = dbn.ema.skip(w);
+                    });
+                }
+            });
+        }
+
+        // The master weights are the initial weights, the weights of the
+        // layers are rounded to bfloat16
+        if constexpr (dbn_traits<dbn_t>::has_mixed_precision()) {
+            loss_scale     = dbn.loss_scale;
+            scaled_updates = 0;
+
+            for_each_master([](auto& w, auto& master) {
+                master = w;
+                this_type::round_weights(w);
+            });
+        }
+
+        if constexpr (dbn_traits<dbn_t>::is_verbose()) {
+            auto plan = memory_plan();
+
+            std::cout << "SGD: activations use " << plan.total_size() / 1024 << "KB, "
+                      << plan.arena_size / 1024 << "KB with lifetime sharing" << std::endl;
+        }
+    }
+
+    /*!
+     * \brief Compute the liveness-based memory plan of the activation buffers
+     * of the training contexts.
+     *
+     * The schedule of a batch is the forward pass (steps 0 to L - 1), the
+     * backward pass (steps L to 2L - 1) and the gradients (steps 2L to 3L - 1).
+     * Utility layers (group and merge) are not part of the plan.
+     */
+    sgd_memory_plan memory_plan() {
+        sgd_memory_plan plan;
+
+        constexpr size_t L = layers;
+
+        cpp::for_each_i(full_context, [&plan](size_t l, auto& layer_ctx) {
+            using layer_t = std::decay_t<decltype(layer_ctx.first)>;
+
+            if constexpr (!is_utility_layer<layer_t>) {
+                auto& ctx = *layer_ctx.second;
+
+                const size_t forward  = l;
+                const size_t backward = 2 * L - 1 - l;
+                const size_t gradient = 2 * L + l;
+
+                // The input is used for the gradients (not copied for the in-place layers)
+                if constexpr (keeps_input<layer_t>) {
+                    plan.add("input", l, etl::size(ctx.input) * sizeof(weight), forward, gradient);
+                }
+
+                // The output is needed by the next layer and for the derivative of the activation
+                plan.add("output", l, etl::size(ctx.output) * sizeof(weight), forward, l == L - 1 ? L : backward);
+
+                // The errors are computed by the next layer (or by the loss)
+                plan.add("errors", l, etl::size(ctx.errors) * sizeof(weight), l == L - 1 ? L : backward - 1, gradient);
+            }
+        });
+
+        plan.plan();
+
+        return plan;
+    }
+
+    /*!
+     * \brief Assign the expression to the first n samples of the given
+     * buffer and clear the remaining samples.
+     *
+     * This lets a batch of any size up to the capacity of the contexts be
+     * computed in the already allocated buffers, in a single pass over the
+     * samples.
+     */
+    template <typename T, typename E>
+    static void assign_samples(T& buffer, size_t n, E&& expr) {
+        const size_t capacity = etl::dim<0>(buffer);
+
+        etl::slice(buffer, 0, n) = expr;
+
+        if (n < capacity) {
+            etl::slice(buffer, n, capacity) = 0;
+        }
+    }
+
+    // CPP17 Replace SFINAE with if constexpr
+
     /*!
      * \brief Compute the errors of the last layer given the loss function
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
+    template<loss_function F, typename Layer, typename Context, typename Labels, cpp_enable_iff(F == loss_function::CATEGORICAL_CROSS_ENTROPY)>
+    static void last_errors(Layer& /*last_layer*/, Context& last_ctx, bool full_batch, size_t n, const Labels& labels){
+        if constexpr (etl::dimensions<Labels>() == 1) {
+            // Sparse labels (the index of the class of each sample): the
+            // errors are computed without the one-hot matrix
+            static_assert(etl::dimensions<decltype(last_ctx.output)>() == 2, "Sparse labels are only supported for 2D outputs");
+
+            if (cpp_unlikely(!full_batch)) {
+                assign_samples(last_ctx.errors, n, -etl::slice(last_ctx.output, 0, n));
+            } else {
+                last_ctx.errors = -last_ctx.output;
+            }
 
-        if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+            last_ctx.errors.ensure_cpu_up_to_date();
 
             for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = 2.0 * (labels(i) - last_ctx.output(i));
+                last_ctx.errors(i, size_t(labels[i])) += 1.0;
             }
+
+            last_ctx.errors.invalidate_gpu();
+        } else if (cpp_unlikely(!full_batch)) {
+            assign_samples(last_ctx.errors, n, labels - etl::slice(last_ctx.output, 0, n));
+        } else {
+            last_ctx.errors = labels - last_ctx.output;
+        }
+
+        // Note: No need to multiply by the derivative of
+        // the activation function since the terms are
+        // canceling out in the derivative of the loss
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer given the loss function
+     */
+    template<loss_function F, typename Layer, typename Context, typename Labels, cpp_enable_iff(F == loss_function::MEAN_SQUARED_ERROR)>
+    static void last_errors(Layer& last_layer, Context& last_ctx, bool full_batch, size_t n, const Labels& labels){
+        if (cpp_unlikely(!full_batch)) {
+            assign_samples(last_ctx.errors, n, 2.0 * (labels - etl::slice(last_ctx.output, 0, n)));
         } else {
             last_ctx.errors = 2.0 * (labels - last_ctx.output);
         }
@@ -590,20 +1416,15 @@ struct sgd_trainer {
     /*!
      * \brief Compute the errors of the last layer given the loss function
      */
-    template<loss_function F, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
-    void last_errors(bool full_batch, size_t n, const Labels& labels){
-        auto& last_layer = std::get<layers - 1>(full_context).first;
-        auto& last_ctx   = *std::get<layers - 1>(full_context).second;
-
+    template<loss_function F, typename Layer, typename Context, typename Labels, cpp_enable_iff(F == loss_function::BINARY_CROSS_ENTROPY)>
+    static void last_errors(Layer& last_layer, Context& last_ctx, bool full_batch, size_t n, const Labels& labels){
         // Avoid Nan from division by ((1 - out) * out)
         auto out = etl::force_temporary(etl::clip(last_ctx.output, 0.001, 0.999));
 
         if (cpp_unlikely(!full_batch)) {
-            last_ctx.errors = 0;
+            auto out_n = etl::slice(out, 0, n);
 
-            for (size_t i = 0; i < n; ++i) {
-                last_ctx.errors(i) = (labels(i) - out(i)) / ((1.0 - out(i)) >> out(i));
-            }
+            assign_samples(last_ctx.errors, n, (labels - out_n) / ((1.0 - out_n) >> out_n));
         } else {
             last_ctx.errors = (labels - out) / ((1.0 - out) >> out);
         }
@@ -618,6 +1439,95 @@ struct sgd_trainer {
         nan_check_etl(last_ctx.errors);
     }
 
+    /*!
+     * \brief Set the weights of the samples of the next batch.
+     *
+     * The errors of each sample are multiplied by its weight and the loss of
+     * each sample is recorded in sample_losses (see importance_sampling).
+     *
+     * \param weights The weight of each sample of the batch
+     */
+    void set_sample_weights(std::vector<weight> weights) {
+        sample_weights = std::move(weights);
+        sample_losses.assign(sample_weights.size(), 0.0);
+    }
+
+    /*!
+     * \brief Stop weighting the samples of the batches
+     */
+    void clear_sample_weights() {
+        sample_weights.clear();
+        sample_losses.clear();
+    }
+
+    /*!
+     * \brief Compute the errors of the last layer and the metrics of the
+     * batch.
+     *
+     * With the categorical cross entropy, the errors, the loss and the
+     * classification error are computed in a single pass over each sample.
+     *
+     * When the samples are weighted, the loss of each sample is recorded
+     * (with the categorical cross entropy, within the same pass, otherwise
+     * the norm of its errors) and its errors are weighted. The metrics are
+     * not weighted.
+     *
+     * \param normalize Indicates if the metrics must be normalized by the size of the batch
+     * \param first The index of the first sample in the complete batch
+     * \return a pair containing the error and the loss of the batch
+     */
+    template <typename Layer, typename Context, typename Labels>
+    std::pair<double, double> output_errors(Layer& last_layer, Context& last_ctx, bool full_batch, size_t n, const Labels& labels, bool normalize, size_t first = 0) {
+        const bool weighted = !sample_weights.empty();
+
+        cpp_assert(!weighted || first + n <= sample_weights.size(), "Invalid number of sample weights");
+
+        std::pair<double, double> metrics;
+
+        if constexpr (dbn_t::loss == loss_function::CATEGORICAL_CROSS_ENTROPY && fused_cce<decltype(last_ctx.output), decltype(last_ctx.errors), Labels>) {
+            dll::auto_timer timer("sgd::cce");
+
+            auto [misses, log_sum] = cce_errors_metrics(last_ctx.errors, last_ctx.output, labels, n, weighted ? sample_losses.data() + first : nullptr);
+
+            const double s = normalize ? double(n) : 1.0;
+
+            metrics = std::make_pair(misses / s, -log_sum / s);
+        } else {
+            last_errors<dbn_t::loss>(last_layer, last_ctx, full_batch, n, labels);
+
+            auto [error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, normalize);
+
+            metrics = std::make_pair(error, loss);
+
+            if (weighted) {
+                sample_error_norms(last_ctx.errors, n, sample_losses.data() + first);
+            }
+        }
+
+        if (weighted) {
+            weight_sample_errors(last_ctx.errors, n, sample_weights.data() + first);
+        }
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Place the layers of the contexts on the devices chosen for the
+     * network (cpu_placement), the layers of a utility layer being placed
+     * with it.
+     */
+    void apply_placement() {
+        cpp::for_each_i(full_context, [this](size_t l, auto& layer_ctx) {
+            const bool cpu = l < dbn.cpu_placement.size() && dbn.cpu_placement[l];
+
+            auto place = [cpu](auto& /*layer*/, auto& context) {
+                context.cpu = cpu;
+            };
+
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, place);
+        });
+    }
+
     /*!
      * \brief Train a batch of data
      * \param epoch The current epoch
@@ -627,14 +1537,21 @@ struct sgd_trainer {
      */
     template <typename Inputs, typename Labels>
     std::pair<double, double> train_batch(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        if constexpr (workers > 1) {
+            return train_batch_parallel(epoch, inputs, labels);
+        }
+
+        // The global norm is only known once all the gradients are computed
+        if constexpr (dbn_traits<dbn_t>::has_overlap_updates() && dbn_traits<dbn_t>::checkpoint_interval() == 1 && accumulation == 1
+                      && !dbn_traits<dbn_t>::has_mixed_precision() && !global_clipping && !sync_batch_norm) {
+            return train_batch_overlapped(epoch, inputs, labels);
+        }
+
         dll::auto_timer timer("sgd::train_batch");
 
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+        auto& first_ctx = *std::get<0>(full_context).second;
 
-        const auto n          = etl::dim<0>(inputs);
-        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+        const auto n = etl::dim<0>(inputs);
 
         // Ensure that the data batch and the label batch are of the same size
         cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
@@ -650,65 +1567,1830 @@ struct sgd_trainer {
             forward_batch_helper<true>(inputs);
         }
 
+        return train_forwarded(epoch, n, labels);
+    }
+
+    /*!
+     * \brief Train a batch of features of the trunk (the output of the
+     * last frozen layer), written in trunk_batch().
+     *
+     * Only the trained layers are forwarded.
+     *
+     * \param epoch The current epoch
+     * \param n The number of samples of the batch
+     * \param labels A batch of labels (at least n)
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Labels>
+    std::pair<double, double> train_trunk_batch(size_t epoch, size_t n, const Labels& labels) {
+        static_assert(trunk_cached, "The trainer cannot train from the features of the trunk");
+
+        dll::auto_timer timer("sgd::train_batch");
+
         {
-            dll::auto_timer timer("sgd::backward");
+            dll::auto_timer timer("sgd::forward");
 
-            //Compute the errors of the last layer
+            forward_range<true, frozen_layers, layers>();
+        }
 
-            last_errors<dbn_t::loss>(full_batch, n, labels);
+        return train_forwarded(epoch, n, labels);
+    }
 
-            // Backpropagate the error
+    /*!
+     * \brief Compute the features of the trunk for the given inputs, in
+     * inference mode
+     * \return a reference to the features, see trunk_batch()
+     */
+    template <typename Inputs>
+    auto& forward_trunk(const Inputs& inputs) {
+        static_assert(trunk_cached, "The trainer cannot compute the features of the trunk");
 
-            bool last = true;
+        auto& first_layer = std::get<0>(full_context).first;
+        auto& first_ctx   = *std::get<0>(full_context).second;
 
-            cpp::for_each_rpair(full_context, [&last](auto& layer_ctx_1, auto& layer_ctx_2) {
-                backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
-            });
+        const auto n = etl::dim<0>(inputs);
 
-            first_layer.adapt_errors(first_ctx);
+        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+
+        if (cpp_unlikely(n != etl::dim<0>(first_ctx.input))) {
+            assign_samples(first_ctx.input, n, inputs);
+        } else {
+            first_ctx.input = inputs;
         }
 
-        // Compute and apply the gradients
+        first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
 
-        {
-            dll::auto_timer timer("sgd::grad");
+        forward_range<false, 1, frozen_layers>();
 
-            cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
-                this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second);
-            });
-        }
+        return trunk_batch();
+    }
 
-        // Update the counter of iterations
-        ++iteration;
+    /*!
+     * \brief Compute the metrics of a batch of features of the trunk,
+     * written in trunk_batch(), without training
+     * \param n The number of samples of the batch
+     * \param labels A batch of labels (at least n)
+     * \return a pair containing the (not normalized) error and loss of the batch
+     */
+    template <typename Labels>
+    std::pair<double, double> evaluate_trunk_batch(size_t n, const Labels& labels) {
+        static_assert(trunk_cached, "The trainer cannot evaluate the features of the trunk");
+
+        forward_range<false, frozen_layers, layers>();
 
-        // Compute error and loss
+        auto [error, loss] = dbn.evaluate_metrics_batch(std::get<layers - 1>(full_context).second->output, labels, n, false);
+
+        return std::make_pair(error, loss);
+    }
+
+    /*!
+     * \brief Returns the features of the trunk (the output of the last
+     * frozen layer) in the contexts
+     */
+    auto& trunk_batch() {
+        return get_output(*std::get<frozen_layers - 1>(full_context).second);
+    }
+
+    /*!
+     * \brief Train the batch whose forward pass has been done in the
+     * contexts: back-propagate its errors and apply its gradients
+     */
+    template <typename Labels>
+    std::pair<double, double> train_forwarded(size_t epoch, size_t n, const Labels& labels) {
+        auto& first_ctx = *std::get<0>(full_context).second;
+        auto& last_ctx  = *std::get<layers - 1>(full_context).second;
+
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        // Check the values of the sampled batches
+
+        const bool check = check_interval && !dbn.comm && ++checked_batches == check_interval;
+
+        finite_report report;
+
+        if (check) {
+            checked_batches = 0;
+
+            report = check_outputs();
+
+            if (!report.finite) {
+                report_non_finite(report, "outputs");
+            }
+        }
+
+        std::pair<double, double> metrics;
 
         {
-            dll::auto_timer timer("sgd::error");
+            dll::auto_timer timer("sgd::backward");
+
+            //Compute the errors of the last layer and the metrics
+
+            metrics = output_errors(std::get<layers - 1>(full_context).first, last_ctx, full_batch, n, labels, true);
+
+            // Scale the errors so that small gradients are not lost in
+            // reduced precision
+            if constexpr (dbn_traits<dbn_t>::has_mixed_precision()) {
+                last_ctx.errors *= weight(loss_scale);
+            }
+
+            // Backpropagate the error
+
+            bool last = true;
 
-            auto[error, loss] = dbn.evaluate_metrics_batch(last_ctx.output, labels, n, true);
+            if constexpr (dbn_traits<dbn_t>::checkpoint_interval() > 1) {
+                backward_checkpointed<layers - 1>(last);
+            } else if constexpr (sync_batch_norm) {
+                sync_backward(full_parts(), last);
+            } else {
+                backward_context(full_context, last);
+            }
 
-            return std::make_pair(error, loss);
+            adapt_trained_errors(full_context, last);
         }
-    }
 
-    template <typename Layer, typename Context>
-    void apply_gradients_layer(size_t epoch, size_t n, Layer& layer, Context& context){
-        if constexpr (is_utility_layer<Layer>) {
-            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n](auto& sub_layer, auto& sub_context) {
-                this->apply_gradients_layer(epoch, n, sub_layer, sub_context);
-            });
-        } else {
-            // Compute the gradients
-            layer.compute_gradients(context);
+        // Compute and apply the gradients
+
+        bool applied = true;
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            // The weights may still be copied into their backup
+            dbn.wait_backup();
+
+            if (!report.finite) {
+                // The update of a batch with non-finite outputs is skipped
+                applied = false;
+            } else if constexpr (accumulation > 1) {
+                applied = apply_gradients_accumulated(epoch, n);
+            } else if constexpr (dbn_traits<dbn_t>::has_mixed_precision()) {
+                applied = apply_gradients_mixed(epoch, global_samples(n));
+            } else {
+                const size_t global_n = global_samples(n);
+
+                if (dbn_traits<dbn_t>::has_flat_parameters() && dbn.comm) {
+                    apply_gradients_flat(epoch, global_n);
+                } else if (check) {
+                    applied = apply_gradients_checked(epoch, global_n);
+                } else if constexpr (global_clipping) {
+                    apply_gradients_global(epoch, global_n);
+                } else {
+                    cpp::for_each(full_context, [this, epoch, global_n](auto& layer_ctx) {
+                        this->apply_gradients_layer(epoch, global_n, layer_ctx.first, *layer_ctx.second);
+                    });
+                }
+            }
+        }
+
+        // Update the counter of iterations
+        if (applied) {
+            ++iteration;
+        }
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Train a batch of data, applying the gradients of each layer
+     * while the errors are back-propagated to the previous layers.
+     *
+     * Once the errors of a layer have been back-propagated, its weights are
+     * not used anymore during this batch. Its gradients are then computed,
+     * reduced over the ranks and applied on a helper thread, in the order of
+     * the backward pass, while the main thread back-propagates the errors of
+     * the previous layers.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_overlapped(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        dll::auto_timer timer("sgd::train_batch");
+
+        auto& first_ctx = *std::get<0>(full_context).second;
+        auto& last_ctx  = *std::get<layers - 1>(full_context).second;
+
+        const auto n          = etl::dim<0>(inputs);
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the context can hold the inputs
+        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+
+        //Feedforward pass
+
+        {
+            dll::auto_timer timer("sgd::forward");
+
+            forward_batch_helper<true>(inputs);
+        }
+
+        // The communicator is only used by the helper thread from now on
+        const size_t global_n = global_samples(n);
+
+        feature_queue<std::function<void()>> updates(layers, n, layers);
+
+        // The weights may still be copied into their backup
+        dbn.wait_backup();
+
+        std::thread updater([&updates] {
+            // The main thread is still using the parallel ETL kernels
+            SERIAL_SECTION {
+                std::function<void()> update;
+
+                while (updates.pop(update)) {
+                    update();
+                }
+            }
+        });
+
+        std::pair<double, double> metrics;
+
+        {
+            dll::auto_timer timer("sgd::backward");
+
+            //Compute the errors of the last layer and the metrics
+
+            metrics = output_errors(std::get<layers - 1>(full_context).first, last_ctx, full_batch, n, labels, true);
+
+            // Backpropagate the error and apply the gradients of each layer
+
+            bool last = true;
+
+            auto push_update = [this, &updates, epoch, global_n](auto& layer_ctx) {
+                updates.push([this, &layer_ctx, epoch, global_n] {
+                    this->apply_gradients_layer(epoch, global_n, layer_ctx.first, *layer_ctx.second);
+                });
+            };
+
+            backward_context<layers - 1>(full_context, last, push_update);
+
+            adapt_trained_errors(full_context, last);
+
+            push_update(std::get<frozen_layers>(full_context));
+        }
+
+        // Wait for the last updates
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            updates.close();
+            updater.join();
+        }
+
+        // Update the counter of iterations
+        ++iteration;
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Train a batch of data, split across the data-parallel workers.
+     *
+     * Each worker forward and backward propagates its part of the batch
+     * in its own contexts and computes its gradients, in tasks of the shared
+     * scheduler. The gradients are then tree-reduced (one level of the tree
+     * at a time, each worker adding the gradients of its sibling) and
+     * applied once with the updater of the main context.
+     *
+     * With numa, the workers of each node run on the threads of the node and
+     * their gradients are reduced on the node, the nodes being reduced
+     * together once per step. Each node then reads the updated weights into
+     * its copy of the network.
+     *
+     * \param epoch The current epoch
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the error and the loss for the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_batch_parallel(size_t epoch, const Inputs& inputs, const Labels& labels) {
+        dll::auto_timer timer("sgd::train_batch");
+
+        const size_t n = etl::dim<0>(inputs);
+
+        // Ensure that the data batch and the label batch are of the same size
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+
+        // Ensure that the workers can hold the inputs
+        cpp_assert(n <= batch_size, "Invalid sizes");
+
+        const size_t active = (n + replica_batch - 1) / replica_batch;
+
+        std::vector<std::pair<double, double>> metrics(active);
+
+        // Forward and backward propagate a part of the batch in each replica
+        auto train = [&](size_t w) {
+            const size_t first = w * replica_batch;
+            const size_t last  = std::min(n, first + replica_batch);
+
+            metrics[w] = train_replica(replicas[w], etl::slice(inputs, first, last), etl::slice(labels, first, last), first);
+        };
+
+        if constexpr (numa) {
+            dll::auto_timer timer("sgd::parallel");
+
+            // Each node trains and reduces its replicas
+
+            size_t nodes = 0;
+
+            while (nodes < node_networks.size() && node_replicas[nodes] < active) {
+                ++nodes;
+            }
+
+            // The copies compute the same time steps as the network
+            for (size_t k = 0; k < nodes; ++k) {
+                copy_active_steps(*node_networks[k], dbn, std::make_index_sequence<layers>());
+            }
+
+            parallel_nodes(nodes, [&](size_t k) {
+                const size_t first = node_replicas[k];
+                const size_t last  = std::min(node_replicas[k + 1], active);
+
+                dll::parallel_for(last - first, [&](size_t i) { train(first + i); });
+
+                reduce_replicas(first, last);
+            });
+
+            // Add the gradients of the nodes, once per step
+
+            for (size_t s = 1; s < nodes; s *= 2) {
+                parallel_nodes(nodes, [&, s](size_t k) {
+                    if (k % (2 * s) == 0 && k + s < nodes) {
+                        accumulate_gradients(replicas[node_replicas[k]], replicas[node_replicas[k + s]]);
+                    }
+                });
+            }
+        } else if constexpr (stages > 1) {
+            dll::auto_timer timer("sgd::pipeline");
+
+            train_pipelined(inputs, labels, metrics, active);
+
+            reduce_replicas(0, active);
+        } else if constexpr (sync_batch_norm) {
+            dll::auto_timer timer("sgd::parallel");
+
+            train_synchronized(inputs, labels, metrics, active);
+
+            reduce_replicas(0, active);
+        } else {
+            dll::auto_timer timer("sgd::parallel");
+
+            dll::parallel_for(active, train);
+
+            reduce_replicas(0, active);
+        }
+
+        // Apply the reduced gradients
+
+        {
+            dll::auto_timer timer("sgd::grad");
+
+            // The weights may still be copied into their backup
+            dbn.wait_backup();
+
+            const size_t global_n = global_samples(n);
+
+            // With flat parameters, all the gradients are reduced at once
+            const bool flat = dbn_traits<dbn_t>::has_flat_parameters() && dbn.comm;
+
+            // With global clipping, all the gradients are reduced before the updates
+            const bool deferred = flat || global_clipping;
+
+            cpp::for_each(full_context, replicas[0], [this, epoch, global_n, flat, deferred](auto& layer_ctx, auto& replica_ctx) {
+                using layer_t = std::decay_t<decltype(layer_ctx.first)>;
+
+                if constexpr (is_trained_layer<layer_t, decltype(*layer_ctx.second)>) {
+                    copy_gradients(*layer_ctx.second, *replica_ctx.second, std::make_index_sequence<std::tuple_size<decltype(layer_ctx.first.trainable_parameters())>()>());
+
+                    if (!flat) {
+                        this->reduce_gradients(layer_ctx.first, *layer_ctx.second);
+                    }
+
+                    if (!deferred) {
+                        this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer_ctx.first, *layer_ctx.second, global_n);
+                    }
+                }
+            });
+
+            if (deferred) {
+                if (flat) {
+                    reduce_gradients_flat();
+                }
+
+                if constexpr (global_clipping) {
+                    global_clip(flat ? flat_grads.squared_norm() : gradients_squared_norm(), global_n);
+                }
+
+                cpp::for_each(full_context, [this, epoch, global_n](auto& layer_ctx) {
+                    this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer_ctx.first, *layer_ctx.second, global_n);
+                });
+            }
+        }
+
+        // Each node reads the updated weights into its copy
+
+        if constexpr (numa) {
+            dll::auto_timer timer("sgd::numa_weights");
+
+            parallel_nodes(node_networks.size(), [this](size_t k) {
+                copy_weights(*node_networks[k], dbn);
+            });
+        }
+
+        // Update the counter of iterations
+        ++iteration;
+
+        double error = 0.0;
+        double loss  = 0.0;
+
+        for (auto& m : metrics) {
+            error += m.first;
+            loss += m.second;
+        }
+
+        return std::make_pair(error / n, loss / n);
+    }
+
+    /*!
+     * \brief Forward and backward propagate a part of a batch through the
+     * contexts of a replica and compute its gradients
+     * \param first The index of the first sample of the part in the batch
+     * \return a pair containing the (non-normalized) error and loss
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> train_replica(replica_context_t& context, const Inputs& inputs, const Labels& labels, size_t first) {
+        auto& last_ctx = *std::get<layers - 1>(context).second;
+
+        const size_t n        = etl::dim<0>(inputs);
+        const bool full_batch = n == replica_batch;
+
+        forward_context<true>(context, inputs);
+
+        auto metrics = output_errors(std::get<layers - 1>(context).first, last_ctx, full_batch, n, labels, false, first);
+
+        bool last = true;
+
+        backward_context(context, last);
+
+        adapt_trained_errors(context, last);
+
+        cpp::for_each(context, [](auto& layer_ctx) {
+            if constexpr (is_trained_layer<decltype(layer_ctx.first), decltype(*layer_ctx.second)>) {
+                layer_ctx.first.compute_gradients(*layer_ctx.second);
+            }
+        });
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Returns the first layer of each pipeline stage, followed by the
+     * number of layers.
+     *
+     * Without a partition of the network, the stages are balanced by the
+     * number of parameters of their layers.
+     */
+    std::vector<size_t> stage_bounds() const {
+        if (!dbn.pipeline_partition.empty()) {
+            std::vector<size_t> bounds(1, 0);
+
+            for (auto first : dbn.pipeline_partition) {
+                cpp_assert(first > bounds.back() && first < layers, "Invalid partition of the pipeline");
+
+                bounds.push_back(first);
+            }
+
+            bounds.push_back(layers);
+
+            cpp_assert(bounds.size() == stages + 1, "The partition of the pipeline does not match the number of stages");
+
+            return bounds;
+        }
+
+        std::vector<size_t> costs;
+
+        dbn.for_each_layer([&costs](auto& layer) {
+            if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+                costs.push_back(layer.parameters() + 1);
+            } else {
+                costs.push_back(1);
+            }
+        });
+
+        return balance_stages(costs, stages);
+    }
+
+    /*!
+     * \brief Forward, backward propagate and compute the gradients of the
+     * micro-batches (the replicas) through the pipeline stages.
+     *
+     * Each stage runs on its own thread and follows the schedule of the
+     * network. A micro-batch enters a stage as soon as the previous stage has
+     * forwarded it (or the next stage has back-propagated it), so that the
+     * transfer of each micro-batch overlaps the work on the others.
+     *
+     * \param metrics The (non-normalized) error and loss of each micro-batch
+     * \param active The number of micro-batches
+     */
+    template <typename Inputs, typename Labels>
+    void train_pipelined(const Inputs& inputs, const Labels& labels, std::vector<std::pair<double, double>>& metrics, size_t active) {
+        const size_t n = etl::dim<0>(inputs);
+
+        const auto bounds = stage_bounds();
+
+        pipeline_board board(stages, active);
+
+        auto& nodes = numa_nodes();
+
+        std::vector<std::thread> threads;
+
+        for (size_t s = 0; s < stages; ++s) {
+            threads.emplace_back([&, s] {
+                // The stages already run concurrently
+                SERIAL_SECTION {
+                    for (auto& pass : pipeline_passes(dbn.pipeline, s, stages, active)) {
+                        const size_t m     = pass.micro;
+                        const size_t first = m * replica_batch;
+                        const size_t last  = std::min(n, first + replica_batch);
+
+                        auto& context = replicas[m];
+
+                        if (pass.forward) {
+                            if (s > 0) {
+                                board.wait(true, s - 1, m);
+                            }
+
+                            forward_stage<0>(context, etl::slice(inputs, first, last), bounds[s], bounds[s + 1]);
+
+                            if (s == stages - 1) {
+                                auto& last_ctx = *std::get<layers - 1>(context).second;
+
+                                metrics[m] = output_errors(std::get<layers - 1>(context).first, last_ctx, last - first == replica_batch, last - first,
+                                                           etl::slice(labels, first, last), false, first);
+                            }
+                        } else {
+                            if (s < stages - 1) {
+                                board.wait(false, s + 1, m);
+                            }
+
+                            backward_stage<layers - 1>(context, bounds[s], bounds[s + 1], s == stages - 1);
+                        }
+
+                        board.done(pass.forward, s, m);
+                    }
+                }
+            });
+
+            if (nodes.size() > 1) {
+                pin_thread(threads.back(), nodes[s % nodes.size()]);
+            }
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Forward propagate the layers [first, last) of the given
+     * contexts, from the inputs for the first layer and from the output of
+     * the previous layer otherwise
+     */
+    template <size_t I, typename Contexts, typename Inputs>
+    static void forward_stage(Contexts& context, Inputs&& inputs, size_t first, size_t last) {
+        if constexpr (I < layers) {
+            if (I >= last) {
+                return;
+            }
+
+            if (I >= first) {
+                constexpr bool frozen = std::decay_t<decltype(*std::get<I>(context).second)>::frozen;
+
+                auto& layer_ctx = std::get<I>(context);
+
+                if constexpr (I == 0) {
+                    auto& ctx = *layer_ctx.second;
+
+                    if (cpp_unlikely(etl::dim<0>(inputs) != etl::dim<0>(ctx.input))) {
+                        assign_samples(ctx.input, etl::dim<0>(inputs), inputs);
+                    } else {
+                        ctx.input = inputs;
+                    }
+
+                    if constexpr (!frozen) {
+                        layer_ctx.first.train_forward_batch(ctx.output, ctx.input);
+                    } else {
+                        layer_ctx.first.test_forward_batch(ctx.output, ctx.input);
+                    }
+                } else {
+                    forward_layer<!frozen>(layer_ctx.first, get_output(*std::get<I - 1>(context).second), *layer_ctx.second);
+                }
+            }
+
+            forward_stage<I + 1>(context, inputs, first, last);
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the layers [first, last) of the
+     * given contexts, from the last one, and compute their gradients
+     *
+     * \param last_stage Indicates if the stage holds the last layer, whose
+     * errors are already adapted to the loss
+     */
+    template <size_t I, typename Contexts>
+    static void backward_stage(Contexts& context, size_t first, size_t last, bool last_stage) {
+        bool adapted = last_stage;
+
+        backward_stage_impl<I>(context, first, last, adapted);
+
+        if (first <= frozen_layers && frozen_layers < last) {
+            adapt_trained_errors(context, adapted);
+        }
+
+        cpp::for_each_i(context, [first, last](size_t l, auto& layer_ctx) {
+            if constexpr (is_trained_layer<decltype(layer_ctx.first), decltype(*layer_ctx.second)>) {
+                if (l >= first && l < last) {
+                    layer_ctx.first.compute_gradients(*layer_ctx.second);
+                }
+            }
+        });
+    }
+
+    /*!
+     * \copydoc backward_stage
+     */
+    template <size_t I, typename Contexts>
+    static void backward_stage_impl(Contexts& context, size_t first, size_t last, bool& adapted) {
+        if constexpr (I > frozen_layers) {
+            if (I < first) {
+                return;
+            }
+
+            if (I < last) {
+                auto& layer_ctx_1 = std::get<I - 1>(context);
+                auto& layer_ctx_2 = std::get<I>(context);
+
+                backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), adapted);
+            }
+
+            backward_stage_impl<I - 1>(context, first, last, adapted);
+        }
+    }
+
+    /*!
+     * \brief Forward, backward propagate and compute the gradients of the
+     * parts of a batch (one per replica), with the statistics of the batch
+     * normalization layers synchronized over all the parts.
+     *
+     * \param metrics The (non-normalized) error and loss of each part
+     * \param active The number of parts
+     */
+    template <typename Inputs, typename Labels>
+    void train_synchronized(const Inputs& inputs, const Labels& labels, std::vector<std::pair<double, double>>& metrics, size_t active) {
+        const size_t n = etl::dim<0>(inputs);
+
+        std::vector<replica_context_t*> parts;
+
+        for (size_t w = 0; w < active; ++w) {
+            parts.push_back(&replicas[w]);
+        }
+
+        sync_forward(parts, inputs, replica_batch);
+
+        dll::parallel_for(active, [&](size_t w) {
+            const size_t first = w * replica_batch;
+            const size_t last  = std::min(n, first + replica_batch);
+
+            auto& context = replicas[w];
+
+            metrics[w] = output_errors(std::get<layers - 1>(context).first, *std::get<layers - 1>(context).second, last - first == replica_batch, last - first,
+                                       etl::slice(labels, first, last), false, first);
+        });
+
+        bool last = true;
+
+        sync_backward(parts, last);
+
+        dll::parallel_for(active, [&](size_t w) {
+            adapt_trained_errors(replicas[w], last);
+
+            cpp::for_each(replicas[w], [](auto& layer_ctx) {
+                if constexpr (is_trained_layer<decltype(layer_ctx.first), decltype(*layer_ctx.second)>) {
+                    this_type::compute_trained_gradients(layer_ctx.first, *layer_ctx.second);
+                }
+            });
+        });
+    }
+
+    /*!
+     * \brief Returns the main contexts as the only part of the batch
+     */
+    std::vector<std::decay_t<decltype(full_context)>*> full_parts() {
+        return {&full_context};
+    }
+
+    /*!
+     * \brief Forward propagate the parts of a batch through the given
+     * contexts (one part per context), with the statistics of the batch
+     * normalization layers synchronized over all the parts and all the ranks.
+     *
+     * The parts are forwarded concurrently up to each normalization layer.
+     * The sums of the parts are then added, and sent over the ranks in a
+     * single message per layer, before each part is normalized with the
+     * statistics of the whole batch.
+     *
+     * \param parts The contexts of the parts
+     * \param inputs The batch of inputs
+     * \param part The number of samples of each part
+     */
+    template <typename Contexts, typename Inputs>
+    void sync_forward(const std::vector<Contexts*>& parts, const Inputs& inputs, size_t part) {
+        sync_forward_impl<0>(parts, inputs, part, 0);
+    }
+
+    /*!
+     * \copydoc sync_forward
+     *
+     * \param first The first layer not yet forwarded
+     */
+    template <size_t I, typename Contexts, typename Inputs>
+    void sync_forward_impl(const std::vector<Contexts*>& parts, const Inputs& inputs, size_t part, size_t first) {
+        const size_t n = etl::dim<0>(inputs);
+
+        if constexpr (I == layers) {
+            dll::parallel_for(parts.size(), [&](size_t w) {
+                const size_t begin = w * part;
+                const size_t end   = std::min(n, begin + part);
+
+                forward_stage<0>(*parts[w], etl::slice(inputs, begin, end), first, layers);
+            });
+        } else {
+            using layer_t   = std::decay_t<decltype(std::get<I>(*parts[0]).first)>;
+            using context_t = std::decay_t<decltype(*std::get<I>(*parts[0]).second)>;
+
+            if constexpr (is_sync_bn_layer<layer_t>::value && !context_t::frozen) {
+                auto& layer = std::get<I>(*parts[0]).first;
+
+                // Forward the previous layers and compute the sums of each part
+
+                dll::parallel_for(parts.size(), [&](size_t w) {
+                    const size_t begin = w * part;
+                    const size_t end   = std::min(n, begin + part);
+
+                    auto part_inputs = etl::slice(inputs, begin, end);
+
+                    forward_stage<0>(*parts[w], part_inputs, first, I);
+
+                    auto& ctx = *std::get<I>(*parts[w]).second;
+
+                    if constexpr (I == 0) {
+                        if (cpp_unlikely(end - begin != etl::dim<0>(ctx.input))) {
+                            assign_samples(ctx.input, end - begin, part_inputs);
+                        } else {
+                            ctx.input = part_inputs;
+                        }
+                    } else {
+                        ctx.input = get_output(*std::get<I - 1>(*parts[w]).second);
+                    }
+
+                    layer.sync_input_sums(ctx);
+                });
+
+                reduce_bn_sums<I>(parts);
+
+                layer.sync_statistics(bn_sums.data());
+
+                dll::parallel_for(parts.size(), [&](size_t w) {
+                    layer.sync_forward(*std::get<I>(*parts[w]).second);
+                });
+
+                sync_forward_impl<I + 1>(parts, inputs, part, I + 1);
+            } else {
+                sync_forward_impl<I + 1>(parts, inputs, part, first);
+            }
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the parts of a batch through the
+     * given contexts, down to the lowest trained layer, with the sums of the
+     * errors of the batch normalization layers synchronized over all the
+     * parts and all the ranks (see sync_forward()).
+     *
+     * The gradients of the normalization layers are computed for each part,
+     * the gradients of the other layers are not computed.
+     *
+     * \param parts The contexts of the parts
+     * \param last Set to false once errors have been back-propagated, see
+     * adapt_trained_errors()
+     */
+    template <typename Contexts>
+    void sync_backward(const std::vector<Contexts*>& parts, bool& last) {
+        sync_backward_impl<layers>(parts, layers, last);
+    }
+
+    /*!
+     * \copydoc sync_backward
+     *
+     * \param end The end of the layers not yet back-propagated
+     */
+    template <size_t I, typename Contexts>
+    void sync_backward_impl(const std::vector<Contexts*>& parts, size_t end, bool& last) {
+        if constexpr (I == 0) {
+            sync_backward_stage(parts, 0, end, last, [](auto& /*context*/) {});
+        } else {
+            constexpr size_t L = I - 1;
+
+            using layer_t   = std::decay_t<decltype(std::get<L>(*parts[0]).first)>;
+            using context_t = std::decay_t<decltype(*std::get<L>(*parts[0]).second)>;
+
+            if constexpr (is_sync_bn_layer<layer_t>::value && !context_t::frozen) {
+                auto& layer = std::get<L>(*parts[0]).first;
+
+                // Backpropagate the next layers and compute the sums of each part
+
+                const bool adapted = last;
+
+                sync_backward_stage(parts, L + 1, end, last, [&layer, adapted](auto& context) {
+                    auto& ctx = *std::get<L>(context).second;
+
+                    if (!adapted) {
+                        layer.adapt_errors(ctx);
+                    }
+
+                    layer.sync_error_sums(ctx);
+                });
+
+                // The errors are not back-propagated into the frozen layers
+                if constexpr (L > frozen_layers) {
+                    reduce_bn_sums<L>(parts);
+
+                    dll::parallel_for(parts.size(), [&](size_t w) {
+                        auto& context = *parts[w];
+
+                        layer.sync_backward(get_errors(*std::get<L - 1>(context).second), *std::get<L>(context).second, bn_sums.data());
+                    });
+
+                    last = false;
+                }
+
+                sync_backward_impl<L>(parts, L, last);
+            } else {
+                sync_backward_impl<L>(parts, end, last);
+            }
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the layers [first, end) of each part
+     * concurrently, then call the functor with the contexts of each part
+     */
+    template <typename Contexts, typename Functor>
+    static void sync_backward_stage(const std::vector<Contexts*>& parts, size_t first, size_t end, bool& last, Functor&& functor) {
+        const bool adapted = last;
+
+        dll::parallel_for(parts.size(), [&](size_t w) {
+            bool part_last = adapted;
+
+            backward_stage_impl<layers - 1>(*parts[w], first, end, part_last);
+
+            functor(*parts[w]);
+        });
+
+        // All the parts have back-propagated the same layers
+        if (std::max(first, frozen_layers + 1) < end) {
+            last = false;
+        }
+    }
+
+    /*!
+     * \brief Add the sums of the normalization layer I of all the parts into
+     * bn_sums, and over all the ranks, in a single message
+     */
+    template <size_t I, typename Contexts>
+    void reduce_bn_sums(const std::vector<Contexts*>& parts) {
+        auto& sums = std::get<I>(*parts[0]).second->sums;
+
+        const size_t size = etl::size(sums);
+
+        bn_sums.assign(sums.memory_start(), sums.memory_start() + size);
+
+        for (size_t w = 1; w < parts.size(); ++w) {
+            const weight* part_sums = std::get<I>(*parts[w]).second->sums.memory_start();
+
+            for (size_t i = 0; i < size; ++i) {
+                bn_sums[i] += part_sums[i];
+            }
+        }
+
+        if (dbn.comm) {
+            dll::auto_timer timer("sgd::bn_all_reduce");
+
+            all_reduce_sum(*dbn.comm, bn_sums.data(), size);
+        }
+    }
+
+    /*!
+     * \brief Forward and backward propagate a batch and compute the
+     * gradients of all the layers, without applying them.
+     *
+     * The gradients are the sums over the samples of the batch, in the
+     * direction of the descent (the opposite of the derivatives of the loss).
+     *
+     * \param inputs A batch of inputs
+     * \param labels A batch of labels
+     * \return a pair containing the (non-normalized) error and loss of the batch
+     */
+    template <typename Inputs, typename Labels>
+    std::pair<double, double> compute_batch_gradients(const Inputs& inputs, const Labels& labels) {
+        static_assert(workers == 1, "The gradients of a batch cannot be computed with data-parallel SGD");
+
+        dll::auto_timer timer("sgd::compute_batch_gradients");
+
+        auto& first_ctx = *std::get<0>(full_context).second;
+        auto& last_ctx  = *std::get<layers - 1>(full_context).second;
+
+        const auto n          = etl::dim<0>(inputs);
+        const bool full_batch = n == etl::dim<0>(first_ctx.input);
+
+        cpp_assert(n == etl::dim<0>(labels), "Invalid sizes");
+        cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
+
+        forward_batch_helper<true>(inputs);
+
+        auto metrics = output_errors(std::get<layers - 1>(full_context).first, last_ctx, full_batch, n, labels, false);
+
+        bool last = true;
+
+        if constexpr (dbn_traits<dbn_t>::checkpoint_interval() > 1) {
+            backward_checkpointed<layers - 1>(last);
+        } else if constexpr (sync_batch_norm) {
+            sync_backward(full_parts(), last);
+        } else {
+            backward_context(full_context, last);
+        }
+
+        adapt_trained_errors(full_context, last);
+
+        cpp::for_each(full_context, [](auto& layer_ctx) {
+            compute_layer_gradients(layer_ctx.first, *layer_ctx.second);
+        });
+
+        return metrics;
+    }
+
+    /*!
+     * \brief Tree-reduce the gradients of the replicas [first, last) into the
+     * first one, one level of the tree at a time
+     */
+    void reduce_replicas(size_t first, size_t last) {
+        const size_t active = last - first;
+
+        for (size_t s = 1; s < active; s *= 2) {
+            const size_t pairs = (active - s + 2 * s - 1) / (2 * s);
+
+            dll::parallel_for(pairs, [&, s](size_t p) {
+                accumulate_gradients(replicas[first + 2 * s * p], replicas[first + 2 * s * p + s]);
+            });
+        }
+    }
+
+    /*!
+     * \brief Add the gradients of the rhs replica to the lhs replica
+     */
+    static void accumulate_gradients(replica_context_t& lhs, replica_context_t& rhs) {
+        cpp::for_each(lhs, rhs, [](auto& lhs_ctx, auto& rhs_ctx) {
+            using layer_t = std::decay_t<decltype(lhs_ctx.first)>;
+
+            if constexpr (is_trained_layer<layer_t, decltype(*lhs_ctx.second)>) {
+                constexpr size_t N = std::tuple_size<decltype(lhs_ctx.first.trainable_parameters())>();
+
+                add_gradients(*lhs_ctx.second, *rhs_ctx.second, std::make_index_sequence<N>());
+            }
+        });
+    }
+
+    /*!
+     * \brief Add the gradients of each variable of rhs to lhs
+     */
+    template <typename C, size_t... I>
+    static void add_gradients(C& lhs, C& rhs, std::index_sequence<I...> /*seq*/) {
+        ((std::get<I>(lhs.up.context)->grad += std::get<I>(rhs.up.context)->grad), ...);
+    }
+
+    /*!
+     * \brief Copy the gradients of each variable of the replica context into
+     * the main context
+     */
+    template <typename C, typename R, size_t... I>
+    static void copy_gradients(C& context, R& replica, std::index_sequence<I...> /*seq*/) {
+        ((std::get<I>(context.up.context)->grad = std::get<I>(replica.up.context)->grad), ...);
+    }
+
+    /*!
+     * \brief Returns the number of samples of the batch over all the ranks
+     * of the distributed training
+     */
+    size_t global_samples(size_t n) {
+        if (!dbn.comm) {
+            return n;
+        }
+
+        double samples = n;
+        all_reduce_sum(*dbn.comm, &samples, 1);
+        return size_t(samples);
+    }
+
+    /*!
+     * \brief Sum the gradients of the given layer over all the ranks of the
+     * distributed training
+     */
+    template <typename Layer, typename Context>
+    void reduce_gradients(Layer& layer, Context& context) {
+        if constexpr (is_trained_layer<Layer, Context>) {
+            if (dbn.comm) {
+                dll::auto_timer timer("sgd::all_reduce");
+
+                constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+                reduce_variables(context, std::make_index_sequence<N>());
+            }
+        } else {
+            cpp_unused(layer);
+            cpp_unused(context);
+        }
+    }
+
+    /*!
+     * \brief Sum the gradients of each variable over all the ranks
+     */
+    template <typename C, size_t... I>
+    void reduce_variables(C& context, std::index_sequence<I...> /*seq*/) {
+        (all_reduce_sum(*dbn.comm, std::get<I>(context.up.context)->grad), ...);
+    }
+
+    /*!
+     * \brief Apply the functor to each layer and its context, the layers of
+     * the utility layers (group and merge) being visited recursively.
+     */
+    template <typename Layer, typename Context, typename Functor>
+    static void for_each_sub_layer(Layer& layer, Context& context, Functor& functor) {
+        if constexpr (is_utility_layer<Layer>) {
+            cpp::for_each(layer.layers, context.sub_contexts, [&functor](auto& sub_layer, auto& sub_context) {
+                this_type::for_each_sub_layer(sub_layer, sub_context, functor);
+            });
+        } else {
+            functor(layer, context);
+        }
+    }
+
+    /*!
+     * \brief Apply the functor to the gradients of each variable of each
+     * layer of the network, always in the same order
+     */
+    template <typename Functor>
+    void for_each_gradients(Functor&& functor) {
+        auto visit = [&functor](auto& layer, auto& context) {
+            if constexpr (is_trained_layer<decltype(layer), decltype(context)>) {
+                constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+                this_type::for_each_variable_gradients(context, functor, std::make_index_sequence<N>());
+            }
+        };
+
+        cpp::for_each(full_context, [&visit](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, visit);
+        });
+    }
+
+    /*!
+     * \brief Apply the functor to the gradients of each variable of a layer
+     */
+    template <typename C, typename Functor, size_t... I>
+    static void for_each_variable_gradients(C& context, Functor& functor, std::index_sequence<I...> /*seq*/) {
+        (functor(std::get<I>(context.up.context)->grad), ...);
+    }
+
+    /*!
+     * \brief Sum the gradients of all the layers over all the ranks, with a
+     * single reduction of a contiguous buffer.
+     */
+    void reduce_gradients_flat() {
+        dll::auto_timer timer("sgd::all_reduce");
+
+        if (!flat_grads.size()) {
+            size_t n = 0;
+
+            for_each_gradients([&n](auto& grad) {
+                n += etl::size(grad);
+            });
+
+            flat_grads.resize(n);
+        }
+
+        flat_grads.rewind();
+
+        for_each_gradients([this](auto& grad) {
+            flat_grads.pack(grad);
+        });
+
+        all_reduce_sum(*dbn.comm, flat_grads.data(), flat_grads.size());
+
+        flat_grads.rewind();
+
+        for_each_gradients([this](auto& grad) {
+            flat_grads.unpack(grad);
+        });
+    }
+
+    /*!
+     * \brief Compute the gradients of all the layers and add them to the
+     * gradients accumulated over the previous micro-batches. After the last
+     * micro-batch, the sum is reduced over the ranks and applied once.
+     *
+     * \return true if the gradients have been applied, false otherwise
+     */
+    bool apply_gradients_accumulated(size_t epoch, size_t n) {
+        cpp::for_each(full_context, [](auto& layer_ctx) {
+            this_type::compute_layer_gradients(layer_ctx.first, *layer_ctx.second);
+        });
+
+        if (!accumulated_grads.size()) {
+            size_t size = 0;
+
+            for_each_gradients([&size](auto& grad) {
+                size += etl::size(grad);
+            });
+
+            accumulated_grads.resize(size);
+        }
+
+        accumulated_grads.rewind();
+
+        if (micro_batch == 0) {
+            for_each_gradients([this](auto& grad) {
+                accumulated_grads.pack(grad);
+            });
+        } else {
+            for_each_gradients([this](auto& grad) {
+                accumulated_grads.add(grad);
+            });
+        }
+
+        accumulated_samples += n;
+
+        if (++micro_batch < accumulation) {
+            return false;
+        }
+
+        // The gradients of the last micro-batch are replaced by the sum
+
+        accumulated_grads.rewind();
+
+        for_each_gradients([this](auto& grad) {
+            accumulated_grads.unpack(grad);
+        });
+
+        const size_t global_n = global_samples(accumulated_samples);
+
+        micro_batch         = 0;
+        accumulated_samples = 0;
+
+        // With flat parameters, all the gradients are reduced at once
+        const bool flat = dbn_traits<dbn_t>::has_flat_parameters() && dbn.comm;
+
+        if (flat) {
+            reduce_gradients_flat();
+        }
+
+        // The global norm is taken on the buffer holding the reduced sum
+        if constexpr (global_clipping) {
+            if (flat) {
+                global_clip(flat_grads.squared_norm(), global_n);
+            } else if (!dbn.comm) {
+                global_clip(accumulated_grads.squared_norm(), global_n);
+            } else {
+                auto reduce = [this](auto& layer, auto& context) {
+                    this->reduce_gradients(layer, context);
+                };
+
+                cpp::for_each(full_context, [&reduce](auto& layer_ctx) {
+                    this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, reduce);
+                });
+
+                global_clip(gradients_squared_norm(), global_n);
+            }
+        }
+
+        auto update = [this, epoch, global_n, flat](auto& layer, auto& context) {
+            if (!flat && !global_clipping) {
+                this->reduce_gradients(layer, context);
+            }
+
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, global_n);
+        };
+
+        cpp::for_each(full_context, [&update](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, update);
+        });
+
+        return true;
+    }
+
+    /*!
+     * \brief Compute the gradients of all the layers, reduce them all at once
+     * and then apply them.
+     */
+    void apply_gradients_flat(size_t epoch, size_t n) {
+        cpp::for_each(full_context, [](auto& layer_ctx) {
+            this_type::compute_layer_gradients(layer_ctx.first, *layer_ctx.second);
+        });
+
+        reduce_gradients_flat();
+
+        if constexpr (global_clipping) {
+            global_clip(flat_grads.squared_norm(), n);
+        }
+
+        auto update = [this, epoch, n](auto& layer, auto& context) {
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+        };
+
+        cpp::for_each(full_context, [&update](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, update);
+        });
+    }
+
+    /*!
+     * \brief Compute the gradients of all the layers, check that they are
+     * finite and apply them.
+     *
+     * \param epoch The current epoch
+     * \param n The number of samples of the update
+     *
+     * \return true if the gradients have been applied, false otherwise
+     */
+    bool apply_gradients_checked(size_t epoch, size_t n) {
+        cpp::for_each(full_context, [](auto& layer_ctx) {
+            this_type::compute_layer_gradients(layer_ctx.first, *layer_ctx.second);
+        });
+
+        auto report = check_gradients();
+
+        if (!report.finite) {
+            report_non_finite(report, "gradients");
+            return false;
+        }
+
+        if constexpr (global_clipping) {
+            apply_gradients_global(epoch, n, true);
+        } else {
+            cpp::for_each(full_context, [this, epoch, n](auto& layer_ctx) {
+                this->apply_gradients_layer(epoch, n, layer_ctx.first, *layer_ctx.second, true);
+            });
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Compute the gradients of all the layers, reduce them and clip
+     * them all by their global norm before applying them.
+     *
+     * The squares of the gradients of each layer are summed as soon as they
+     * have been reduced, and the scale is folded into the updates.
+     *
+     * \param epoch The current epoch
+     * \param n The number of samples of the update
+     * \param computed Indicates if the gradients have already been computed
+     */
+    void apply_gradients_global(size_t epoch, size_t n, bool computed = false) {
+        if (!computed) {
+            cpp::for_each(full_context, [](auto& layer_ctx) {
+                this_type::compute_layer_gradients(layer_ctx.first, *layer_ctx.second);
+            });
+        }
+
+        double sum = 0.0;
+
+        auto square = [&sum](auto& grad) {
+            sum += etl::sum(grad >> grad);
+        };
+
+        auto reduce = [this, &square](auto& layer, auto& context) {
+            this->reduce_gradients(layer, context);
+
+            if constexpr (is_trained_layer<decltype(layer), decltype(context)>) {
+                constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+                this_type::for_each_variable_gradients(context, square, std::make_index_sequence<N>());
+            }
+        };
+
+        cpp::for_each(full_context, [&reduce](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, reduce);
+        });
+
+        global_clip(sum, n);
+
+        auto update = [this, epoch, n](auto& layer, auto& context) {
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+        };
+
+        cpp::for_each(full_context, [&update](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, update);
+        });
+    }
+
+    /*!
+     * \brief Returns the sum of the squares of the gradients of all the
+     * layers
+     */
+    double gradients_squared_norm() {
+        double sum = 0.0;
+
+        for_each_gradients([&sum](auto& grad) {
+            sum += etl::sum(grad >> grad);
+        });
+
+        return sum;
+    }
+
+    /*!
+     * \brief Compute the scale of the gradients of the current update from
+     * their global norm (with clip_global_norm).
+     *
+     * The scale is applied to the (reduced) gradients by the updates, before
+     * the decay, in the same sweep.
+     *
+     * \param sum The sum of the squares of the gradients of all the layers
+     * \param n The number of samples of the update
+     */
+    void global_clip(double sum, size_t n) {
+        const auto t           = dbn.gradient_clip;
+        const auto global_norm = std::sqrt(sum / (double(n) * double(n)));
+
+        clip_scale = global_norm > t ? weight(t / global_norm) : weight(1.0);
+    }
+
+    /*!
+     * \brief Check that the outputs of all the layers are finite
+     * \return The report of the check, with the first offending layer
+     */
+    finite_report check_outputs() {
+        dll::auto_timer timer("sgd::check_finite");
+
+        finite_report report;
+
+        cpp::for_each_i(full_context, [&report](size_t l, auto& layer_ctx) {
+            report.check(layer_ctx.second->output, l, 0);
+        });
+
+        return report;
+    }
+
+    /*!
+     * \brief Check that the gradients of all the layers are finite.
+     *
+     * The variables of the sub layers of a utility layer are numbered in
+     * order, as variables of the utility layer.
+     *
+     * \return The report of the check, with the first offending layer and
+     * variable
+     */
+    finite_report check_gradients() {
+        dll::auto_timer timer("sgd::check_finite");
+
+        finite_report report;
+
+        cpp::for_each_i(full_context, [&report](size_t l, auto& layer_ctx) {
+            size_t v = 0;
+
+            auto check = [&report, l, &v](auto& grad) {
+                report.check(grad, l, v++);
+            };
+
+            auto visit = [&check](auto& layer, auto& context) {
+                if constexpr (is_trained_layer<decltype(layer), decltype(context)>) {
+                    constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+                    this_type::for_each_variable_gradients(context, check, std::make_index_sequence<N>());
+                }
+            };
+
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, visit);
+        });
+
+        return report;
+    }
+
+    /*!
+     * \brief Report the first non-finite value found by a check
+     */
+    void report_non_finite(const finite_report& report, const char* values) const {
+        std::cerr << "ERROR: Non-finite " << values << " in layer " << report.layer << " (tensor " << report.variable
+                  << ", element " << report.index << ") at iteration " << iteration << ", the update is skipped" << std::endl;
+    }
+
+    /*!
+     * \brief Compute the gradients of all the layers and apply them to the
+     * master weights, with dynamic loss scaling.
+     *
+     * The gradients have been computed from scaled errors. If they overflow,
+     * the update is skipped and the loss scale is halved. Otherwise, they are
+     * unscaled and applied to the single precision master weights, which are
+     * then rounded into the weights of the layers. The loss scale is doubled
+     * after loss_scale_interval updates without overflow.
+     *
+     * \param epoch The current epoch
+     * \param n The number of samples of the update
+     *
+     * \return true if the gradients have been applied, false otherwise
+     */
+    bool apply_gradients_mixed(size_t epoch, size_t n) {
+        auto compute = [this](auto& layer, auto& context) {
+            // Compute the gradients
+            this_type::compute_trained_gradients(layer, context);
+
+            // Sum the gradients of all the ranks
+            this->reduce_gradients(layer, context);
+        };
+
+        cpp::for_each(full_context, [&compute](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, compute);
+        });
+
+        // Detect the overflows (with global clipping, an overflow makes the
+        // sum of the squares non-finite)
+
+        bool finite = true;
+
+        double sum = 0.0;
+
+        if constexpr (global_clipping) {
+            sum    = gradients_squared_norm();
+            finite = std::isfinite(sum);
+        } else {
+            for_each_gradients([&finite](auto& grad) {
+                finite = finite && is_finite_etl(grad);
+            });
+        }
+
+        if (!finite) {
+            loss_scale     = std::max(loss_scale / 2.0, 1.0);
+            scaled_updates = 0;
+
+            return false;
+        }
+
+        // Unscale the gradients (and clip them in the same pass)
+
+        weight inv_scale = 1.0 / loss_scale;
+
+        if constexpr (global_clipping) {
+            global_clip(sum / (loss_scale * loss_scale), n);
+
+            inv_scale *= clip_scale;
+            clip_scale = 1.0;
+        }
+
+        for_each_gradients([inv_scale](auto& grad) {
+            grad *= inv_scale;
+        });
+
+        // Apply the gradients to the master weights
+
+        auto update = [this, epoch, n](auto& layer, auto& context) {
+            this_type::for_each_variable_master(layer, context, [](auto& w, auto& master) {
+                w = master;
+            });
+
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+
+            this_type::for_each_variable_master(layer, context, [](auto& w, auto& master) {
+                master = w;
+                this_type::round_weights(w);
+            });
+        };
+
+        cpp::for_each(full_context, [&update](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, update);
+        });
+
+        if (++scaled_updates == dbn.loss_scale_interval) {
+            loss_scale *= 2.0;
+            scaled_updates = 0;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Copy the master weights into the weights of the layers, at the
+     * end of a training in mixed precision.
+     */
+    void restore_master_weights() {
+        for_each_master([](auto& w, auto& master) {
+            w = master;
+        });
+    }
+
+    /*!
+     * \brief Indicates if the state of the trainer can be checkpointed, i.e.
+     * if no gradients are being accumulated.
+     */
+    bool checkpoint_ready() const {
+        return micro_batch == 0;
+    }
+
+    /*!
+     * \brief Apply the functor to each variable of the state of the trainer:
+     * its scalar state, the state of the updater of each variable of each
+     * layer and the moving average of the weights.
+     *
+     * The variables are always visited in the same order, so that the same
+     * functor can be used to store and to restore the state.
+     */
+    template <typename Functor>
+    void for_each_state(Functor&& functor) {
+        functor(iteration);
+        functor(loss_scale);
+        functor(scaled_updates);
+
+        auto visit = [&functor](auto& layer, auto& context) {
+            if constexpr (is_trained_layer<decltype(layer), decltype(context)>) {
+                constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+                this_type::for_each_variable_state(context, functor, std::make_index_sequence<N>());
+            }
+        };
+
+        cpp::for_each(full_context, [&visit](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, visit);
+        });
+
+        if constexpr (dbn_traits<dbn_t>::has_ema_weights()) {
+            functor(dbn.ema.values);
+        }
+    }
+
+    /*!
+     * \brief Apply the functor to the state of the updater of each variable
+     * of a layer
+     */
+    template <typename C, typename Functor, size_t... I>
+    static void for_each_variable_state(C& context, Functor& functor, std::index_sequence<I...> /*seq*/) {
+        auto visit = [&functor](auto&&... state) {
+            (functor(state), ...);
+        };
+
+        (std::apply(visit, std::get<I>(context.up.context)->state()), ...);
+    }
+
+    /*!
+     * \brief Round the given weights to bfloat16
+     */
+    template <typename W>
+    static void round_weights(W& w) {
+        w.ensure_cpu_up_to_date();
+
+        for (auto& x : w) {
+            x = round_bf16(x);
+        }
+
+        w.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Apply the functor to each variable of each layer of the network
+     * and to its master copy (mixed precision)
+     */
+    template <typename Functor>
+    void for_each_master(Functor&& functor) {
+        auto visit = [&functor](auto& layer, auto& context) {
+            this_type::for_each_variable_master(layer, context, functor);
+        };
+
+        cpp::for_each(full_context, [&visit](auto& layer_ctx) {
+            this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, visit);
+        });
+    }
+
+    /*!
+     * \brief Apply the functor to each variable of the layer and to its
+     * master copy (mixed precision)
+     */
+    template <typename Layer, typename Context, typename Functor>
+    static void for_each_variable_master(Layer& layer, Context& context, Functor&& functor) {
+        if constexpr (is_trained_layer<Layer, Context>) {
+            constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
+
+            for_each_variable_master(layer, context, functor, std::make_index_sequence<N>());
+        } else {
+            cpp_unused(layer);
+            cpp_unused(context);
+            cpp_unused(functor);
+        }
+    }
+
+    /*!
+     * \brief Apply the functor to each variable of the layer and to its
+     * master copy (mixed precision)
+     */
+    template <typename Layer, typename Context, typename Functor, size_t... I>
+    static void for_each_variable_master(Layer& layer, Context& context, Functor& functor, std::index_sequence<I...> /*seq*/) {
+        (functor(std::get<I>(layer.trainable_parameters()), std::get<I>(context.up.context)->master), ...);
+
+        dll::invalidate_transforms(layer);
+    }
+
+    /*!
+     * \brief Compute the gradients of the given layer. The gradients of the
+     * sub layers of the utility layers are independent and computed in
+     * concurrent tasks.
+     */
+    template <typename Layer, typename Context>
+    static void compute_layer_gradients(Layer& layer, Context& context) {
+        if constexpr (is_utility_layer<Layer>) {
+            std::vector<std::function<void()>> computations;
+
+            auto collect = [&computations](auto& sub_layer, auto& sub_context) {
+                computations.push_back([&sub_layer, &sub_context] { this_type::compute_trained_gradients(sub_layer, sub_context); });
+            };
+
+            for_each_sub_layer(layer, context, collect);
+
+            if (parallel_branches(computations.size())) {
+                parallel_for(computations.size(), [&computations](size_t c) { computations[c](); });
+            } else {
+                for (auto& computation : computations) {
+                    computation();
+                }
+            }
+        } else {
+            compute_trained_gradients(layer, context);
+        }
+    }
+
+    /*!
+     * \brief Compute the gradients of the given layer, unless it is frozen
+     */
+    template <typename Layer, typename Context>
+    static void compute_trained_gradients(Layer& layer, Context& context) {
+        // The gradients of the synchronized layers are computed with their sums
+        if constexpr (!Context::frozen && !(sync_batch_norm && is_sync_bn_layer<Layer>::value)) {
+            placement_scope scope(placed_on_cpu(context));
+
+            layer.compute_gradients(context);
+        } else {
+            cpp_unused(layer);
+            cpp_unused(context);
+        }
+    }
+
+    template <typename Layer, typename Context>
+    void apply_gradients_layer(size_t epoch, size_t n, Layer& layer, Context& context, bool computed = false){
+        if constexpr (is_utility_layer<Layer>) {
+            // The reductions of the gradients of the ranks are done in order
+            if (!computed && !dbn.comm) {
+                compute_layer_gradients(layer, context);
+                computed = true;
+            }
+
+            cpp::for_each(layer.layers, context.sub_contexts, [this, epoch, n, computed](auto& sub_layer, auto& sub_context) {
+                this->apply_gradients_layer(epoch, n, sub_layer, sub_context, computed);
+            });
+        } else {
+            // Compute the gradients
+            if (!computed) {
+                compute_trained_gradients(layer, context);
+            }
+
+            // Sum the gradients of all the ranks
+            reduce_gradients(layer, context);
+
+            // Apply the gradients
+            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors from the layer I down to the lowest
+     * trained layer, with checkpointing.
+     *
+     * When the backward pass enters a segment (except the last one), the
+     * activations of the segment are recomputed from the output of its
+     * checkpoint (its first layer).
+     */
+    template <size_t I>
+    void backward_checkpointed(bool& last) {
+        if constexpr (I > frozen_layers) {
+            constexpr size_t N     = dbn_traits<dbn_t>::checkpoint_interval();
+            constexpr size_t first = I - I % N;
+
+            if constexpr (I == first + N - 1 && I < layers - 1) {
+                recompute_forward<first + 1, I>();
+            }
+
+            auto& layer_ctx_1 = std::get<I - 1>(full_context);
+            auto& layer_ctx_2 = std::get<I>(full_context);
+
+            backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+
+            backward_checkpointed<I - 1>(last);
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the given contexts from the layer I
+     * down to the lowest trained layer, the errors are not back-propagated
+     * into the frozen layers.
+     *
+     * \param functor Called with each layer (and its context) once its errors
+     * have been back-propagated
+     */
+    template <size_t I, typename Contexts, typename Functor>
+    static void backward_context(Contexts& context, bool& last, Functor&& functor) {
+        if constexpr (I > frozen_layers) {
+            auto& layer_ctx_1 = std::get<I - 1>(context);
+            auto& layer_ctx_2 = std::get<I>(context);
+
+            backward_layer(layer_ctx_2.first, *layer_ctx_2.second, get_errors(*layer_ctx_1.second), last);
+
+            functor(layer_ctx_2);
+
+            backward_context<I - 1>(context, last, functor);
+        }
+    }
+
+    /*!
+     * \brief Backpropagate the errors of the given contexts from the last
+     * layer down to the lowest trained layer
+     */
+    template <typename Contexts>
+    static void backward_context(Contexts& context, bool& last) {
+        backward_context<layers - 1>(context, last, [](auto& /*layer_ctx*/) {});
+    }
+
+    /*!
+     * \brief Adapt the errors of the lowest trained layer, at the end of the
+     * backward pass (its errors are not back-propagated).
+     *
+     * The errors of the last layer are adapted with the errors of the loss.
+     */
+    template <typename Contexts>
+    static void adapt_trained_errors(Contexts& context, bool last) {
+        auto& layer_ctx = std::get<frozen_layers>(context);
+
+        if (frozen_layers == 0 || !last) {
+            layer_ctx.first.adapt_errors(*layer_ctx.second);
+        }
+    }
+
+    /*!
+     * \brief Recompute the forward activations of the layers [I, Last]
+     */
+    template <size_t I, size_t Last>
+    void recompute_forward() {
+        if constexpr (I <= Last) {
+            dll::auto_timer timer("sgd::recompute");
+
+            auto& layer_ctx = std::get<I>(full_context);
+
+            forward_layer<(I >= frozen_layers)>(layer_ctx.first, get_output(*std::get<I - 1>(full_context).second), *layer_ctx.second);
+
+            recompute_forward<I + 1, Last>();
+        }
+    }
+
+    /*!
+     * \brief Forward the layers [I, Last) from the output of the layer I - 1
+     * in the contexts
+     */
+    template <bool Train, size_t I, size_t Last>
+    void forward_range() {
+        if constexpr (I < Last) {
+            auto& layer_ctx = std::get<I>(full_context);
+
+            forward_layer<Train>(layer_ctx.first, get_output(*std::get<I - 1>(full_context).second), *layer_ctx.second);
 
-            // Apply the gradients
-            this->update_weights<dbn_traits<dbn_t>::updater()>(epoch, layer, context, n);
+            forward_range<Train, I + 1, Last>();
         }
     }
 
     template <typename Layer, typename Context, typename Errors, cpp_disable_iff(is_utility_layer<Layer>)>
     static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
+        placement_scope scope(placed_on_cpu(context));
+
+        place_values(placed_on_cpu(context), context.errors);
+
         if(!last){
             layer.adapt_errors(context);
         }
@@ -723,6 +3405,10 @@ struct sgd_trainer {
         auto& sub_layer   = std::get<L>(layer.layers);
         auto& sub_context = std::get<L>(context.sub_contexts);
 
+        placement_scope scope(placed_on_cpu(sub_context));
+
+        place_values(placed_on_cpu(sub_context), sub_context.errors);
+
         if (!last) {
             sub_layer.adapt_errors(sub_context);
         }
@@ -747,32 +3433,62 @@ struct sgd_trainer {
 
     template <typename Layer, typename Context, typename Errors, cpp_enable_iff(is_merge_layer<Layer>)>
     static void backward_layer(Layer& layer, Context& context, Errors&& errors, bool& last){
-        errors = 0;
+        const size_t blocks = merge_blocks<Layer::merge_dim>(context.errors);
+        const auto offsets  = branch_offsets(context.sub_contexts, blocks, [](auto& sub_context) { return etl::size(get_errors(sub_context)); });
+
+        context.errors.ensure_cpu_up_to_date();
+
+        // The first branch is backpropagated directly into the errors, the
+        // others into their own errors
+        std::vector<std::decay_t<Errors>> back_errors(Layer::n_layers - 1, errors);
 
-        // Dispatch all the sub contexts
+        // Each branch reads its slice of the errors, the branches are independent
 
-        cpp::for_each_i(layer.layers, context.sub_contexts, [&context, &errors, &last](size_t i, auto& sub_layer, auto& sub_context){
-            batch_dispatch(get_errors(sub_context), context.errors, i);
+        for_each_branch<Layer::n_layers>([&](auto b) {
+            constexpr size_t I = decltype(b)::value;
 
-            auto back_errors = errors;
+            auto& sub_context = std::get<I>(context.sub_contexts);
+
+            dispatch_branch(get_errors(sub_context), context.errors, blocks, offsets[I]);
 
             bool sub_last = last;
-            backward_layer(sub_layer, sub_context, back_errors, sub_last);
 
-            errors += back_errors;
+            if constexpr (I == 0) {
+                this_type::backward_layer(std::get<I>(layer.layers), sub_context, errors, sub_last);
+            } else {
+                this_type::backward_layer(std::get<I>(layer.layers), sub_context, back_errors[I - 1], sub_last);
+            }
         });
 
+        // Sum the errors of the branches, always in the same order
+        for (auto& branch_errors : back_errors) {
+            errors += branch_errors;
+        }
+
         last = false;
     }
 
     template <bool Train, typename Layer, typename Inputs, typename Context, cpp_disable_iff(is_utility_layer<Layer>)>
     static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
-        context.input = inputs;
+        placement_scope scope(placed_on_cpu(context));
+
+        place_values(placed_on_cpu(context), inputs);
+
+        // The layers not needing their input are forwarded without a copy
+        if constexpr (keeps_input<Layer>) {
+            context.input = inputs;
 
-        if constexpr (Train) {
-            layer.train_forward_batch(context.output, context.input);
+            if constexpr (Train) {
+                layer.train_forward_batch(context.output, context.input);
+            } else {
+                layer.test_forward_batch(context.output, context.input);
+            }
         } else {
-            layer.test_forward_batch(context.output, context.input);
+            if constexpr (Train) {
+                layer.train_forward_batch(context.output, inputs);
+            } else {
+                layer.test_forward_batch(context.output, inputs);
+            }
         }
     }
 
@@ -782,32 +3498,62 @@ struct sgd_trainer {
             auto& sub_layer   = std::get<L>(layer.layers);
             auto& sub_context = std::get<L>(context.sub_contexts);
 
-            sub_context.input = inputs;
+            using sub_layer_t = std::decay_t<decltype(sub_layer)>;
 
-            if constexpr (Train) {
-                sub_layer.train_forward_batch(sub_context.output, sub_context.input);
+            placement_scope scope(placed_on_cpu(sub_context));
+
+            place_values(placed_on_cpu(sub_context), inputs);
+
+            if constexpr (keeps_input<sub_layer_t>) {
+                sub_context.input = inputs;
+
+                if constexpr (Train) {
+                    sub_layer.train_forward_batch(sub_context.output, sub_context.input);
+                } else {
+                    sub_layer.test_forward_batch(sub_context.output, sub_context.input);
+                }
             } else {
-                sub_layer.test_forward_batch(sub_context.output, sub_context.input);
+                if constexpr (Train) {
+                    sub_layer.train_forward_batch(sub_context.output, inputs);
+                } else {
+                    sub_layer.test_forward_batch(sub_context.output, inputs);
+                }
             }
 
             forward_layer_group<Train, L + 1>(layer, sub_context.output, context);
         }
     }
 
-    template <bool Train, typename Layer, typename Inputs, typename Context, cpp_enable_iff(is_group_layer<Layer>)>
-    static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
-        forward_layer_group<Train, 0>(layer, inputs, context);
-    }
+    template <typename Layer, typename Inputs, typename Context>
+    static void forward_layer_wavefront(Layer& layer, Inputs&& inputs, Context& context) {
+        // The layers of a group are all placed on the same device
+        placement_scope scope(placed_on_cpu(std::get<0>(context.sub_contexts)));
 
-    template <bool Train, size_t L, typename Layer, typename Inputs, typename Context>
-    static void forward_layer_merge(Layer& layer, Inputs&& inputs, Context& context) {
-        if constexpr (L < Layer::n_layers) {
-            auto& sub_layer   = std::get<L>(layer.layers);
-            auto& sub_context = std::get<L>(context.sub_contexts);
+        // All the recurrent layers are computed together, their outputs
+        // (and inputs) are written once they are all done
+        wavefront_forward(layer.layers, inputs, [&](auto i, auto& sub_layer) {
+            constexpr size_t I = decltype(i)::value;
+
+            auto& sub_context = std::get<I>(context.sub_contexts);
+
+            if constexpr (keeps_input<std::decay_t<decltype(sub_layer)>>) {
+                if constexpr (I == 0) {
+                    sub_context.input = inputs;
+                } else {
+                    sub_context.input = std::get<I - 1>(context.sub_contexts).output;
+                }
+            }
 
-            forward_layer<Train>(sub_layer, inputs, sub_context);
+            sub_layer.wavefront_end(sub_context.output);
+        });
+    }
 
-            forward_layer_merge<Train, L + 1>(layer, inputs, context);
+    template <bool Train, typename Layer, typename Inputs, typename Context, cpp_enable_iff(is_group_layer<Layer>)>
+    static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
+        if constexpr (Layer::wavefront) {
+            forward_layer_wavefront(layer, inputs, context);
+        } else {
+            forward_layer_group<Train, 0>(layer, inputs, context);
         }
     }
 
@@ -815,15 +3561,23 @@ struct sgd_trainer {
     static void forward_layer(Layer& layer, Inputs&& inputs, Context& context) {
         context.input = inputs;
 
-        // Fully forward each group
+        const size_t blocks = merge_blocks<Layer::merge_dim>(context.output);
+        const auto offsets  = branch_offsets(context.sub_contexts, blocks, [](auto& sub_context) { return etl::size(get_output(sub_context)); });
+
+        // Fully forward each group into its slice of the output, the
+        // branches are independent
 
-        forward_layer_merge<Train, 0>(layer, context.input, context);
+        for_each_branch<Layer::n_layers>([&](auto b) {
+            constexpr size_t I = decltype(b)::value;
 
-        // Concatenate all the sub contexts
+            auto& sub_context = std::get<I>(context.sub_contexts);
 
-        cpp::for_each_i(context.sub_contexts, [&context](size_t i, auto& sub_context){
-            batch_merge(context.output, get_output(sub_context), i);
+            this_type::template forward_layer<Train>(std::get<I>(layer.layers), context.input, sub_context);
+
+            merge_branch(context.output, get_output(sub_context), blocks, offsets[I]);
         });
+
+        context.output.invalidate_gpu();
     }
 
     template <typename Context>
@@ -854,9 +3608,24 @@ struct sgd_trainer {
 
     template <bool Train, typename Inputs>
     auto& forward_batch_helper(Inputs&& inputs) {
-        auto& first_layer = std::get<0>(full_context).first;
-        auto& first_ctx   = *std::get<0>(full_context).second;
-        auto& last_ctx    = *std::get<layers - 1>(full_context).second;
+        if constexpr (Train && sync_batch_norm) {
+            sync_forward(full_parts(), inputs, etl::dim<0>(inputs));
+
+            return std::get<layers - 1>(full_context).second->output;
+        } else {
+            return forward_context<Train>(full_context, inputs);
+        }
+    }
+
+    /*!
+     * \brief Forward propagate the inputs through the given contexts
+     * \return a reference to the output of the last context
+     */
+    template <bool Train, typename Contexts, typename Inputs>
+    static auto& forward_context(Contexts& context, Inputs&& inputs) {
+        auto& first_layer = std::get<0>(context).first;
+        auto& first_ctx   = *std::get<0>(context).second;
+        auto& last_ctx    = *std::get<layers - 1>(context).second;
 
         const auto n          = etl::dim<0>(inputs);
         const bool full_batch = n == etl::dim<0>(first_ctx.input);
@@ -864,25 +3633,32 @@ struct sgd_trainer {
         // Ensure that the context can hold the inputs
         cpp_assert(n <= etl::dim<0>(first_ctx.input), "Invalid sizes");
 
+        // A smaller batch uses the first samples of the contexts, the output
+        // is entirely written by the forward pass
         if (cpp_unlikely(!full_batch)) {
-            first_ctx.input  = 0;
-            first_ctx.output = 0;
-
-            for (size_t i = 0; i < etl::dim<0>(inputs); ++i) {
-                first_ctx.input(i) = inputs(i);
-            }
+            assign_samples(first_ctx.input, n, inputs);
         } else {
             first_ctx.input = inputs;
         }
 
-        if constexpr (Train) {
-            first_layer.train_forward_batch(first_ctx.output, first_ctx.input);
-        } else {
-            first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
+        // The frozen layers are forwarded in inference mode
+
+        {
+            placement_scope scope(placed_on_cpu(first_ctx));
+
+            place_values(placed_on_cpu(first_ctx), first_ctx.input);
+
+            if constexpr (Train && !frozen_layers) {
+                first_layer.train_forward_batch(first_ctx.output, first_ctx.input);
+            } else {
+                first_layer.test_forward_batch(first_ctx.output, first_ctx.input);
+            }
         }
 
-        cpp::for_each_pair(full_context, [this](auto& layer_ctx_1, auto& layer_ctx_2) {
-            this->template forward_layer<Train>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
+        cpp::for_each_pair(context, [](auto& layer_ctx_1, auto& layer_ctx_2) {
+            constexpr bool frozen = std::decay_t<decltype(*layer_ctx_2.second)>::frozen;
+
+            this_type::template forward_layer<Train && !frozen>(layer_ctx_2.first, get_output(*layer_ctx_1.second), *layer_ctx_2.second);
         });
 
         return last_ctx.output;
@@ -893,14 +3669,19 @@ struct sgd_trainer {
      */
     template <updater_type UT, typename L, typename C>
     void update_weights([[maybe_unused]] size_t epoch, [[maybe_unused]] L& layer, [[maybe_unused]] C& context, [[maybe_unused]] size_t n) {
-        if constexpr (decay_layer_traits<L>::is_neural_layer()) {
+        if constexpr (is_trained_layer<L, C>) {
             dll::auto_timer timer("sgd::update_weights");
 
+            // The weights are updated on the device of the layer
+            placement_scope scope(placed_on_cpu(context));
+
             // Update all variables of the layer
 
             static constexpr size_t N = std::tuple_size<decltype(layer.trainable_parameters())>();
 
             update_variables<UT>(epoch, layer, context, n, std::make_index_sequence<N>());
+
+            dll::invalidate_transforms(layer);
         }
     }
 
@@ -920,21 +3701,513 @@ struct sgd_trainer {
             eps *= 1.0 / (1.0 + eps_decay * iteration);
         }
 
-        //2. Update the gradients (L1/L2 and gradient clipping)
+        weight* ema = ema_shadow(std::get<I>(layer.trainable_parameters()));
 
-        auto& w      = std::get<I>(layer.trainable_parameters());
-        auto& w_grad = std::get<I>(context.up.context)->grad;
+        if constexpr (I == 0 && has_sparse_gradients<L>::value) {
+            // The lazy updates are only valid if the gradients are exactly
+            // the ones computed on the touched rows
+            if constexpr (is_lazy_updater(UT) && workers == 1 && accumulation == 1) {
+                if (!dbn.comm) {
+                    sparse_apply_gradients<UT>(layer, context, n, eps);
 
-        // Note the distinction for w and b for decay is far from optimal...
-        if constexpr (I == 0) {
-            this->update_grad<w_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+                    // The average of the other rows still moves
+                    if (ema) {
+                        update_ema(std::get<I>(layer.trainable_parameters()), ema);
+                    }
+
+                    cpp_unused(epoch);
+
+                    return;
+                }
+            }
+
+            // The dense update modifies all the rows of the gradients
+            context.sparse.dense = true;
+
+            // The dense update decays all the rows
+            flush_decay(layer);
+        }
+
+        if constexpr (dbn_traits<dbn_t>::has_fused_updater()) {
+            fused_apply_gradients<I, UT>(layer, context, n, eps, ema);
+
+            cpp_unused(epoch);
         } else {
-            this->update_grad<b_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            //2. Update the gradients (L1/L2 and gradient clipping)
+
+            auto& w      = std::get<I>(layer.trainable_parameters());
+            auto& w_grad = std::get<I>(context.up.context)->grad;
+
+            // Note the distinction for w and b for decay is far from optimal...
+            if constexpr (I == 0) {
+                this->update_grad<w_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            } else {
+                this->update_grad<b_decay(dbn_traits<dbn_t>::decay())>(w, w_grad, n);
+            }
+
+            // 3. Apply the gradients
+
+            apply_gradients<I, UT>(epoch, layer, context, n, eps);
+
+            // 4. Update the moving average of the variable
+
+            if (ema) {
+                update_ema(w, ema);
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the moving average of the given variable if it must be
+     * updated at this iteration, nullptr otherwise
+     */
+    template <typename W>
+    weight* ema_shadow([[maybe_unused]] const W& w) {
+        if constexpr (dbn_traits<dbn_t>::has_ema_weights()) {
+            if (iteration % dbn.ema_interval == 0) {
+                auto it = ema_shadows.find(&w);
+
+                if (it != ema_shadows.end()) {
+                    return it->second;
+                }
+            }
+        }
+
+        return nullptr;
+    }
+
+    /*!
+     * \brief Update the moving average of the given variable
+     */
+    template <typename W>
+    void update_ema(const W& w, weight* ema) {
+        dll::auto_timer timer("sgd::ema");
+
+        const weight decay = dbn.ema_decay;
+        const size_t size  = etl::size(w);
+
+        w.ensure_cpu_up_to_date();
+
+        const weight* x = w.memory_start();
+
+        for (size_t i = 0; i < size; ++i) {
+            ema[i] = decay * ema[i] + (1.0 - decay) * x[i];
+        }
+    }
+
+    /*!
+     * \brief Fold the pending lazy decay into all the rows of the weights of
+     * the given layer (with lazy_decay)
+     */
+    template <typename L>
+    void flush_decay([[maybe_unused]] L& layer) {
+        if constexpr (dbn_traits<dbn_t>::has_lazy_decay()) {
+            auto& w = std::get<0>(layer.trainable_parameters());
+
+            if (auto it = lazy_decays.find(&w); it != lazy_decays.end()) {
+                it->second.flush(w);
+            }
+        }
+    }
+
+    /*!
+     * \brief Fold the pending lazy decay into the weights of all the layers,
+     * before the weights are read as a whole (evaluation, checkpoint, end of
+     * the training).
+     */
+    void flush_weights() {
+        if constexpr (dbn_traits<dbn_t>::has_lazy_decay()) {
+            auto flush = [this](auto& layer, auto& context) {
+                if constexpr (is_trained_layer<decltype(layer), decltype(context)> && has_sparse_gradients<std::decay_t<decltype(layer)>>::value) {
+                    this->flush_decay(layer);
+                }
+            };
+
+            cpp::for_each(full_context, [&flush](auto& layer_ctx) {
+                this_type::for_each_sub_layer(layer_ctx.first, *layer_ctx.second, flush);
+            });
+        }
+    }
+
+    /*!
+     * \brief Decay the gradients, clip them and apply them only to the rows
+     * of the weights touched by the batch (lazy updaters).
+     *
+     * The state of the updater (momentum, moments, ...) of the other rows is
+     * left untouched.
+     */
+    template <updater_type UT, typename L, typename C>
+    void sparse_apply_gradients(L& layer, C& context, size_t n, weight eps) {
+        dll::auto_timer timer("sgd::apply_grad:sparse");
+
+        auto& w          = std::get<0>(layer.trainable_parameters());
+        auto& sub        = *std::get<0>(context.up.context);
+        const auto& rows = context.sparse.rows;
+
+        const size_t k = etl::dim<1>(w);
+
+        constexpr decay_type decay = w_decay(dbn_traits<dbn_t>::decay());
+
+        weight l1 = decay == decay_type::L1 || decay == decay_type::L1L2 ? weight(dbn.l1_weight_cost) : weight(0);
+        weight l2 = decay == decay_type::L2 || decay == decay_type::L1L2 ? weight(dbn.l2_weight_cost) : weight(0);
+
+        w.ensure_cpu_up_to_date();
+        sub.grad.ensure_cpu_up_to_date();
+
+        weight* wm = w.memory_start();
+        weight* gm = sub.grad.memory_start();
+
+        // 0. With lazy decay, the decay of the step is decoupled from the
+        // gradients and only folded into the touched rows
+
+        if constexpr (dbn_traits<dbn_t>::has_lazy_decay()) {
+            auto& lazy = lazy_decays[&w];
+
+            lazy.resize(etl::dim<0>(w));
+            lazy.step(eps * l1, eps * l2);
+
+            for (auto r : rows) {
+                lazy.apply(wm + r * k, k, r);
+            }
+
+            l1 = 0.0;
+            l2 = 0.0;
+        }
+
+        // 1. Decay the gradients of the touched rows (the global scale is
+        // applied in the same pass)
+
+        const weight s = global_clipping ? clip_scale : weight(1.0);
+
+        double sum = 0.0;
+
+        for (auto r : rows) {
+            for (size_t i = r * k; i < (r + 1) * k; ++i) {
+                gm[i] = s * gm[i] - l1 * std::abs(wm[i]) - l2 * wm[i];
+                sum += double(gm[i]) * double(gm[i]);
+            }
+        }
+
+        // 2. Clip the gradients
+
+        weight scale = 1.0;
+
+        if constexpr (dbn_traits<dbn_t>::has_clip_gradients() && !global_clipping) {
+            const auto t            = dbn.gradient_clip;
+            const auto grad_l2_norm = std::sqrt(sum / (n * n));
+
+            if (grad_l2_norm > t) {
+                scale = t / grad_l2_norm;
+            }
+        }
+
+        cpp_unused(sum);
+
+        // 3. Apply the gradients to the touched rows
+
+        auto sweep = [&](auto f, auto&... s) {
+            (s.ensure_cpu_up_to_date(), ...);
+
+            for (auto r : rows) {
+                for (size_t i = r * k; i < (r + 1) * k; ++i) {
+                    f(wm[i], scale * gm[i], s.memory_start()[i]...);
+                }
+            }
+
+            (s.invalidate_gpu(), ...);
+        };
+
+        const weight e = 1e-8;
+
+        if constexpr (UT == updater_type::SGD) {
+            const weight f = eps / n;
+
+            sweep([=](auto& x, weight d) {
+                x += f * d;
+            });
+        } else if constexpr (UT == updater_type::MOMENTUM) {
+            const weight momentum = dbn.momentum;
+            const weight f        = eps / n;
+
+            sweep([=](auto& x, weight d, auto& inc) {
+                inc = momentum * inc + f * d;
+                x += inc;
+            }, sub.inc);
+        } else if constexpr (UT == updater_type::ADAGRAD) {
+            sweep([=](auto& x, weight d, auto& inc) {
+                inc = inc + d * d;
+                x += (eps * d) / std::sqrt(inc + e);
+            }, sub.inc);
+        } else if constexpr (UT == updater_type::ADAM) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+
+            sweep([=](auto& x, weight d, auto& m, auto& v) {
+                m = beta1 * m + (1.0 - beta1) * d;
+                v = beta2 * v + (1.0 - beta2) * d * d;
+                x += (eps * m) / (std::sqrt(v) + e);
+            }, sub.m, sub.v);
+        }
+
+        w.invalidate_gpu();
+        sub.grad.invalidate_gpu();
+
+        nan_check_deep(w);
+    }
+
+    /*!
+     * \brief Decay the gradients, clip them and apply them to the given
+     * variable, in a single sweep over the variable and its state.
+     *
+     * The update is the same as the one of update_grad and apply_gradients.
+     * When the gradients are clipped per tensor, their norm is computed in a
+     * first sweep, while the global scale (clip_global_norm) is simply
+     * folded into the update. The moving average of the variable, if any, is updated in the
+     * same sweep as the variable.
+     */
+    template <size_t I, updater_type UT, typename L, typename C>
+    void fused_apply_gradients(L& layer, C& context, size_t n, weight eps, weight* ema) {
+        dll::auto_timer timer("sgd::apply_grad:fused");
+
+        auto& w   = std::get<I>(layer.trainable_parameters());
+        auto& sub = *std::get<I>(context.up.context);
+
+        // Note the distinction for w and b for decay is far from optimal...
+        constexpr decay_type decay = I == 0 ? w_decay(dbn_traits<dbn_t>::decay()) : b_decay(dbn_traits<dbn_t>::decay());
+
+        weight l1 = decay == decay_type::L1 || decay == decay_type::L1L2 ? weight(dbn.l1_weight_cost) : weight(0);
+        weight l2 = decay == decay_type::L2 || decay == decay_type::L1L2 ? weight(dbn.l2_weight_cost) : weight(0);
+
+        weight scale = 1.0;
+
+        if constexpr (global_clipping) {
+            // The global norm is already known, no sweep is necessary
+            scale = clip_scale;
+        } else if constexpr (dbn_traits<dbn_t>::has_clip_gradients()) {
+            double sum = 0.0;
+
+            fused_sweep([&](auto& x, auto& g) {
+                g = g - l1 * std::abs(x) - l2 * x;
+                sum += double(g) * double(g);
+            }, w, sub.grad);
+
+            const auto t            = dbn.gradient_clip;
+            const auto grad_l2_norm = std::sqrt(sum / (n * n));
+
+            if (grad_l2_norm > t) {
+                scale = t / grad_l2_norm;
+            }
+
+            // The decay has already been applied
+            l1 = 0.0;
+            l2 = 0.0;
         }
 
-        // 3. Apply the gradients
+        // Returns the clipped and decayed gradient, and store it
+        auto gradient = [=](auto& x, auto& g) {
+            g = scale * g - l1 * std::abs(x) - l2 * x;
+            return g;
+        };
+
+        // The sweep updating the variable, and its moving average
+        auto sweep = [this, ema](auto f, auto& x, auto&... s) {
+            if (ema) {
+                const weight decay = dbn.ema_decay;
+
+                weight* a = ema;
+
+                fused_sweep([=, &a](auto& xx, auto&... ss) {
+                    f(xx, ss...);
+
+                    *a = decay * *a + (1.0 - decay) * xx;
+                    ++a;
+                }, x, s...);
+            } else {
+                fused_sweep(f, x, s...);
+            }
+        };
+
+        const weight e = 1e-8;
+
+        if constexpr (UT == updater_type::SGD) {
+            const weight f = eps / n;
+
+            sweep([=](auto& x, auto& g) {
+                x += f * gradient(x, g);
+            }, w, sub.grad);
+        } else if constexpr (UT == updater_type::MOMENTUM) {
+            const weight momentum = dbn.momentum;
+            const weight f        = eps / n;
+
+            sweep([=](auto& x, auto& g, auto& inc) {
+                inc = momentum * inc + f * gradient(x, g);
+                x += inc;
+            }, w, sub.grad, sub.inc);
+        } else if constexpr (UT == updater_type::NESTEROV) {
+            const weight momentum = dbn.momentum;
+            const weight f        = eps / n;
+
+            sweep([=](auto& x, auto& g, auto& inc, auto& inc_prev) {
+                inc_prev = inc;
+                inc      = momentum * inc + f * gradient(x, g);
+                x += -momentum * inc_prev + (1.0 + momentum) * inc;
+            }, w, sub.grad, sub.inc, sub.inc_prev);
+        } else if constexpr (UT == updater_type::ADAGRAD) {
+            sweep([=](auto& x, auto& g, auto& inc) {
+                const weight d = gradient(x, g);
+
+                inc = inc + d * d;
+                x += (eps * d) / std::sqrt(inc + e);
+            }, w, sub.grad, sub.inc);
+        } else if constexpr (UT == updater_type::RMSPROP) {
+            const weight decay_rate = dbn.rmsprop_decay;
+
+            sweep([=](auto& x, auto& g, auto& inc) {
+                const weight d = gradient(x, g);
+
+                inc = decay_rate * inc + (1 - decay_rate) * d * d;
+                x += (eps * d) / std::sqrt(inc + e);
+            }, w, sub.grad, sub.inc);
+        } else if constexpr (UT == updater_type::ADADELTA) {
+            const weight beta = dbn.adadelta_beta;
+
+            sweep([=](auto& x, auto& g, auto& acc_g, auto& acc_x, auto& v) {
+                const weight d = gradient(x, g);
+
+                acc_g = beta * acc_g + (1.0 - beta) * d * d;
+                v     = (std::sqrt(acc_x + e) * d) / std::sqrt(acc_g + e);
+                acc_x = beta * acc_x + (1.0 - beta) * v * v;
+                x += v;
+            }, w, sub.grad, sub.g, sub.x, sub.v);
+        } else if constexpr (UT == updater_type::ADAM) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+
+            sweep([=](auto& x, auto& g, auto& m, auto& v) {
+                const weight d = gradient(x, g);
+
+                m = beta1 * m + (1.0 - beta1) * d;
+                v = beta2 * v + (1.0 - beta2) * d * d;
+                x += (eps * m) / (std::sqrt(v) + e);
+            }, w, sub.grad, sub.m, sub.v);
+        } else if constexpr (UT == updater_type::ADAM_CORRECT) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+            const weight c1    = 1.0 / (1.0 - std::pow(beta1, iteration));
+            const weight c2    = 1.0 / (1.0 - std::pow(beta2, iteration));
+
+            sweep([=](auto& x, auto& g, auto& m, auto& mt, auto& v, auto& vt) {
+                const weight d = gradient(x, g);
+
+                m  = beta1 * m + (1.0 - beta1) * d;
+                v  = beta2 * v + (1.0 - beta2) * d * d;
+                mt = m * c1;
+                vt = v * c2;
+                x += (eps * m) / (std::sqrt(v) + e);
+            }, w, sub.grad, sub.m, sub.mt, sub.v, sub.vt);
+        } else if constexpr (UT == updater_type::ADAMAX) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+
+            sweep([=](auto& x, auto& g, auto& m, auto& v) {
+                const weight d = gradient(x, g);
+
+                m = beta1 * m + (1.0 - beta1) * d;
+                v = std::max(weight(beta2 * v), weight(std::abs(d)));
+                x += (eps * m) / v;
+            }, w, sub.grad, sub.m, sub.v);
+        } else if constexpr (UT == updater_type::LARS) {
+            const weight momentum = dbn.momentum;
+            const weight eta      = dbn.lars_eta;
+
+            // The norms are computed in the sweep that decays the gradients
+
+            double w_norm = 0.0;
+            double g_norm = 0.0;
+
+            fused_sweep([&](auto& x, auto& g) {
+                const weight d = gradient(x, g);
+
+                w_norm += double(x) * double(x);
+                g_norm += double(d) * double(d);
+            }, w, sub.grad);
+
+            w_norm = std::sqrt(w_norm);
+            g_norm = std::sqrt(g_norm) / n;
+
+            const weight f = eps * eta * trust_ratio(w_norm, g_norm) / n;
+
+            sweep([=](auto& x, auto& g, auto& inc) {
+                inc = momentum * inc + f * g;
+                x += inc;
+            }, w, sub.grad, sub.inc);
+        } else if constexpr (UT == updater_type::LAMB) {
+            const weight beta1 = dbn.adam_beta1;
+            const weight beta2 = dbn.adam_beta2;
+            const weight c1    = 1.0 / (1.0 - std::pow(beta1, iteration));
+            const weight c2    = 1.0 / (1.0 - std::pow(beta2, iteration));
+            const weight f     = 1.0 / n;
+            const weight e6    = 1e-6;
+
+            // The norms are computed in the sweep that updates the moments
+
+            double w_norm = 0.0;
+            double r_norm = 0.0;
+
+            fused_sweep([&](auto& x, auto& g, auto& m, auto& v, auto& r) {
+                const weight d = f * gradient(x, g);
+
+                m = beta1 * m + (1.0 - beta1) * d;
+                v = beta2 * v + (1.0 - beta2) * d * d;
+                r = (c1 * m) / (std::sqrt(c2 * v) + e6);
+
+                w_norm += double(x) * double(x);
+                r_norm += double(r) * double(r);
+            }, w, sub.grad, sub.m, sub.v, sub.r);
+
+            const weight ratio = eps * trust_ratio(std::sqrt(w_norm), std::sqrt(r_norm));
+
+            sweep([=](auto& x, auto& r) {
+                x += ratio * r;
+            }, w, sub.r);
+        } else if constexpr (UT == updater_type::NADAM) {
+            const weight beta1          = dbn.adam_beta1;
+            const weight beta2          = dbn.adam_beta2;
+            const weight schedule_decay = dbn.nadam_schedule_decay;
+            const weight t              = iteration;
+
+            auto& m_schedule = sub.m_schedule;
+
+            // Compute the schedule for momentum
+
+            weight momentum_cache_t   = beta1 * (1.0 - 0.5 * (std::pow(0.96, t * schedule_decay)));
+            weight momentum_cache_t_1 = beta1 * (1.0 - 0.5 * (std::pow(0.96, (t + 1) * schedule_decay)));
+
+            weight m_schedule_new  = m_schedule * momentum_cache_t;
+            weight m_schedule_next = m_schedule * momentum_cache_t * momentum_cache_t_1;
+
+            if constexpr (I == 0) {
+                m_schedule = m_schedule_new;
+            }
+
+            const weight c1 = 1.0 / (1.0 - m_schedule_next);
+            const weight c2 = 1.0 / (1.0 - std::pow(beta2, t));
+
+            const weight m1 = eps * ((1.0 - momentum_cache_t) / (1.0 - m_schedule_new));
+            const weight m2 = eps * momentum_cache_t_1;
+
+            sweep([=](auto& x, auto& g, auto& m, auto& mt, auto& v, auto& vt) {
+                const weight d = gradient(x, g);
+
+                m  = beta1 * m + (1.0 - beta1) * d;
+                v  = beta2 * v + (1.0 - beta2) * d * d;
+                mt = m * c1;
+                vt = v * c2;
+                x += (m1 * d + m2 * mt) / (std::sqrt(vt) + e);
+            }, w, sub.grad, sub.m, sub.mt, sub.v, sub.vt);
+        }
 
-        apply_gradients<I, UT>(epoch, layer, context, n, eps);
+        nan_check_deep(w);
     }
 
     /*!
@@ -1243,6 +4516,86 @@ struct sgd_trainer {
         cpp_unused(epoch);
     }
 
+    /*!
+     * \brief Returns the layer-wise trust ratio of the given norms of a
+     * variable and of its update
+     */
+    static weight trust_ratio(double w_norm, double u_norm) {
+        return w_norm > 0.0 && u_norm > 0.0 ? weight(w_norm / u_norm) : weight(1.0);
+    }
+
+    /*!
+     * \brief Apply the gradients to the given layer
+     */
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::LARS)>
+    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+        dll::auto_timer timer("sgd::apply_grad:lars");
+
+        const auto momentum = dbn.momentum;
+        const auto eta      = dbn.lars_eta;
+
+        auto& w      = std::get<I>(layer.trainable_parameters());
+        auto& w_grad = std::get<I>(context.up.context)->grad;
+        auto& w_inc  = std::get<I>(context.up.context)->inc;
+
+        // The local learning rate depends on the norms of the weights and of
+        // the (mean) gradients of the layer
+
+        const double w_norm = std::sqrt(etl::sum(w >> w));
+        const double g_norm = std::sqrt(etl::sum(w_grad >> w_grad)) / n;
+
+        const weight local_eps = eps * eta * trust_ratio(w_norm, g_norm);
+
+        w_inc = momentum * w_inc + (local_eps / n) * w_grad;
+
+        w += w_inc;
+
+        nan_check_deep(w);
+
+        cpp_unused(epoch);
+    }
+
+    /*!
+     * \brief Apply the gradients to the given layer
+     */
+    template <size_t I, updater_type UT, typename L, typename C, cpp_enable_iff(UT == updater_type::LAMB)>
+    void apply_gradients(size_t epoch, L& layer, C& context, size_t n, weight eps) {
+        dll::auto_timer timer("sgd::apply_grad:lamb");
+
+        const weight beta1 = dbn.adam_beta1;
+        const weight beta2 = dbn.adam_beta2;
+        const weight e     = 1e-6;
+        const weight c1    = 1.0 / (1.0 - std::pow(beta1, iteration));
+        const weight c2    = 1.0 / (1.0 - std::pow(beta2, iteration));
+        const weight f     = 1.0 / n;
+
+        auto& w      = std::get<I>(layer.trainable_parameters());
+        auto& w_grad = std::get<I>(context.up.context)->grad;
+        auto& w_m    = std::get<I>(context.up.context)->m;
+        auto& w_v    = std::get<I>(context.up.context)->v;
+        auto& w_r    = std::get<I>(context.up.context)->r;
+
+        // Adam estimations of the first and second moments of the mean gradients
+
+        w_m = beta1 * w_m + ((1.0 - beta1) * f) * w_grad;
+        w_v = beta2 * w_v + ((1.0 - beta2) * f * f) * (w_grad >> w_grad);
+
+        // The bias-corrected Adam update
+
+        w_r = (c1 * w_m) / (etl::sqrt(c2 * w_v) + e);
+
+        // The update is scaled by the layer-wise trust ratio
+
+        const double w_norm = std::sqrt(etl::sum(w >> w));
+        const double r_norm = std::sqrt(etl::sum(w_r >> w_r));
+
+        w += (eps * trust_ratio(w_norm, r_norm)) * w_r;
+
+        nan_check_deep(w);
+
+        cpp_unused(epoch);
+    }
+
     /*!
      * \brief Update the given gradients according to the given decay function
      */
@@ -1263,15 +4616,32 @@ struct sgd_trainer {
      */
     template <decay_type decay, typename V, typename G>
     void update_grad(const V& value, G& grad, size_t n) {
-        if constexpr (decay == decay_type::L1) {
-            grad = grad - dbn.l1_weight_cost * abs(value);
-        } else if constexpr (decay == decay_type::L2) {
-            grad = grad - dbn.l2_weight_cost * value;
-        } else if constexpr (decay == decay_type::L1L2) {
-            grad = grad - dbn.l1_weight_cost * abs(value) - dbn.l2_weight_cost * value;
-        }
+        if constexpr (global_clipping) {
+            // The global scale is applied in the same pass as the decay
+            const weight s = clip_scale;
+
+            if constexpr (decay == decay_type::L1) {
+                grad = s * grad - dbn.l1_weight_cost * abs(value);
+            } else if constexpr (decay == decay_type::L2) {
+                grad = s * grad - dbn.l2_weight_cost * value;
+            } else if constexpr (decay == decay_type::L1L2) {
+                grad = s * grad - dbn.l1_weight_cost * abs(value) - dbn.l2_weight_cost * value;
+            } else if (s != weight(1.0)) {
+                grad *= s;
+            }
 
-        clip_gradients(grad, n);
+            cpp_unused(n);
+        } else {
+            if constexpr (decay == decay_type::L1) {
+                grad = grad - dbn.l1_weight_cost * abs(value);
+            } else if constexpr (decay == decay_type::L2) {
+                grad = grad - dbn.l2_weight_cost * value;
+            } else if constexpr (decay == decay_type::L1L2) {
+                grad = grad - dbn.l1_weight_cost * abs(value) - dbn.l2_weight_cost * value;
+            }
+
+            clip_gradients(grad, n);
+        }
     }
 
     /*!
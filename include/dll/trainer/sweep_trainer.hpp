@@ -0,0 +1,183 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file sweep_trainer.hpp
+ * \brief Fine-tuning of several replicas of a network at once (hyperparameter
+ * sweeps)
+ *
+ * The replicas are networks of the same type, with their own weights and
+ * hyperparameters (learning rate, momentum, ...). Each batch of the generator
+ * is read once and trained by all the replicas, in parallel, so that the
+ * dataset is only read once per epoch for all the replicas.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "dll/trainer/dbn_trainer.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Trainer for several replicas of the same network, sharing the same
+ * generator pass.
+ *
+ * Each replica has its own dbn_trainer (and watcher), so early stopping,
+ * learning rate schedules and reporting are done independently for each
+ * replica. The replicas are trained in parallel on the batches, in tasks of
+ * the shared scheduler, each of them with serial ETL operations.
+ */
+template <typename DBN>
+struct sweep_trainer {
+    using dbn_t      = DBN;                    ///< The type of network being trained
+    using weight     = typename dbn_t::weight; ///< The data type of the network
+    using error_type = typename dbn_t::weight; ///< The error type
+    using trainer_t  = dbn_trainer<dbn_t>;     ///< The trainer of each replica
+
+    static_assert(!is_asynchronous_trainer<typename trainer_t::template trainer_t<dbn_t>>::value,
+                  "Asynchronous trainers cannot be used in a sweep");
+
+    std::vector<dbn_t*> replicas;                     ///< The replicas being trained
+    std::vector<std::unique_ptr<trainer_t>> trainers; ///< The trainer of each replica
+
+    /*!
+     * \brief Construct a new sweep_trainer
+     * \param replicas The replicas to train
+     */
+    explicit sweep_trainer(std::vector<dbn_t*> replicas) : replicas(std::move(replicas)) {
+        cpp_assert(!this->replicas.empty(), "A sweep needs at least one replica");
+
+        for (size_t i = 0; i < this->replicas.size(); ++i) {
+            trainers.push_back(std::make_unique<trainer_t>());
+        }
+    }
+
+    /*!
+     * \brief Train all the replicas for max_epochs
+     *
+     * \param generator The generator for the training data
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error of each replica
+     */
+    template <typename Generator>
+    std::vector<error_type> train(Generator& generator, size_t max_epochs) {
+        dll::auto_timer timer("net:sweep:train");
+
+        const size_t n = replicas.size();
+
+        for (size_t i = 0; i < n; ++i) {
+            trainers[i]->start_training(*replicas[i], max_epochs);
+        }
+
+        // The epoch at which each replica stopped (max_epochs while it is trained)
+        std::vector<size_t> epochs(n, max_epochs);
+        size_t active = n;
+
+        for (size_t epoch = 0; epoch < max_epochs && active; ++epoch) {
+            dll::auto_timer timer("net:sweep:train:epoch");
+
+            // Shuffle before the epoch if necessary
+            trainers.front()->reset_shuffle(generator);
+
+            generator.prepare_epoch();
+            generator.set_train();
+
+            for (size_t i = 0; i < n; ++i) {
+                if (epochs[i] == max_epochs) {
+                    trainers[i]->start_epoch(*replicas[i], epoch);
+                }
+            }
+
+            // Train each batch with all the replicas
+
+            while (generator.has_next_batch()) {
+                dll::auto_timer timer("net:sweep:train:epoch:batch");
+
+                const auto& data_batch  = generator.data_batch();
+                const auto& label_batch = generator.label_batch();
+
+                const size_t batch   = generator.current_batch();
+                const size_t batches = generator.batches();
+
+                dll::parallel_for(n, [&](size_t i) {
+                    if (epochs[i] != max_epochs) {
+                        return;
+                    }
+
+                    auto& net     = *replicas[i];
+                    auto& trainer = *trainers[i];
+
+                    // The replicas are already trained in parallel
+                    SERIAL_SECTION {
+                        trainer.update_learning_rate(net, batches);
+
+                        trainer.watcher.ft_batch_start(epoch, net);
+
+                        auto [batch_error, batch_loss] = trainer.trainer->train_batch(epoch, data_batch, label_batch);
+
+                        trainer.watcher.ft_batch_end(epoch, batch, batches, batch_error, batch_loss, net);
+                    }
+                });
+
+                generator.next_batch();
+            }
+
+            // Compute the error of each replica and decide to stop them
+
+            for (size_t i = 0; i < n; ++i) {
+                if (epochs[i] != max_epochs) {
+                    continue;
+                }
+
+                auto [error, loss] = trainers[i]->compute_error_loss(*replicas[i], generator);
+
+                if (trainers[i]->stop_epoch(*replicas[i], epoch, error, loss)) {
+                    epochs[i] = epoch;
+                    --active;
+                }
+            }
+        }
+
+        // Finalization
+
+        std::vector<error_type> errors(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            errors[i] = trainers[i]->stop_training(*replicas[i], epochs[i], max_epochs);
+        }
+
+        return errors;
+    }
+
+    /*!
+     * \brief Train all the replicas for max_epochs
+     *
+     * \param training_data A container containing all the samples
+     * \param labels A container containing all the labels
+     * \param max_epochs The maximum number of epochs
+     *
+     * \return The final error of each replica
+     */
+    template <typename Input, typename Labels>
+    std::vector<error_type> train(const Input& training_data, Labels& labels, size_t max_epochs) {
+        // Create generator around the containers
+        auto generator = dll::make_generator(
+            training_data, labels,
+            training_data.size(), replicas.front()->output_size(), typename dbn_t::categorical_generator_t{});
+
+        generator->set_safe();
+
+        return train(*generator, max_epochs);
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,260 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Cache of the features of the frozen layers of a network (its
+ * trunk) during fine-tuning.
+ *
+ * When the first layers of a network are frozen and its inputs are not
+ * augmented, the output of the last frozen layer is the same at each epoch.
+ * It is computed once for all the samples and the trained layers are then
+ * trained from the cache.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_traits.hpp"
+#include "dll/util/bfloat16.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns a fingerprint of the weights of the first Layers layers of
+ * the given network.
+ *
+ * The fingerprint changes as soon as one of the weights is modified, it is
+ * used to invalidate the cached features of the trunk.
+ */
+template <size_t Layers, typename DBN>
+uint64_t trunk_fingerprint(DBN& dbn) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    dbn.for_each_layer_i([&hash](size_t I, auto& layer) {
+        if constexpr (decay_layer_traits<decltype(layer)>::is_neural_layer()) {
+            if (I < Layers) {
+                cpp::for_each(layer.trainable_parameters(), [&hash](auto& w) {
+                    for (size_t i = 0; i < etl::size(w); ++i) {
+                        const float value = w[i];
+
+                        uint32_t bits;
+                        std::memcpy(&bits, &value, sizeof(bits));
+
+                        hash = (hash ^ bits) * 1099511628211ULL;
+                    }
+                });
+            }
+        }
+    });
+
+    return hash;
+}
+
+/*!
+ * \brief The cached features of the trunk of a network, with the labels of
+ * the samples.
+ *
+ * The features are stored in single precision or, compacted, in bfloat16.
+ * They are kept in memory or in a memory-mapped file, when they do not fit
+ * in memory. The file is removed when the cache is released.
+ */
+template <typename T>
+struct trunk_cache {
+    size_t samples     = 0;     ///< The number of cached samples
+    size_t sample_size = 0;     ///< The number of features of a sample
+    size_t label_size  = 0;     ///< The number of values of a label
+    bool compact       = false; ///< Indicates if the features are stored in bfloat16
+    uint64_t weights   = 0;     ///< The fingerprint of the weights of the trunk
+
+    std::vector<size_t> label_dims; ///< The dimensions of a label
+    std::vector<size_t> order;      ///< The order of the samples in the current epoch
+
+    trunk_cache() = default;
+
+    trunk_cache(const trunk_cache& rhs) = delete;
+    trunk_cache& operator=(const trunk_cache& rhs) = delete;
+
+    /*!
+     * \brief Release the memory (and the file) of the cache
+     */
+    ~trunk_cache() {
+        if (mapping) {
+            ::munmap(mapping, mapping_bytes);
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+            ::unlink(path.c_str());
+        }
+    }
+
+    /*!
+     * \brief Allocate the cache
+     *
+     * \param samples The number of samples
+     * \param sample_size The number of features of a sample
+     * \param label_dims The dimensions of a label
+     * \param compact Indicates if the features are stored in bfloat16
+     * \param file The file to memory-map (empty for a cache in memory)
+     *
+     * \return true if the cache was allocated, false otherwise
+     */
+    bool init(size_t samples, size_t sample_size, const std::vector<size_t>& label_dims, bool compact, const std::string& file) {
+        this->samples     = samples;
+        this->sample_size = sample_size;
+        this->label_dims  = label_dims;
+        this->compact     = compact;
+
+        label_size = 1;
+
+        for (auto d : label_dims) {
+            label_size *= d;
+        }
+
+        const size_t bytes = samples * sample_size * value_size();
+
+        if (!bytes) {
+            return false;
+        }
+
+        if (file.empty()) {
+            buffer.resize(bytes);
+            features = buffer.data();
+        } else {
+            fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+            if (fd < 0) {
+                return false;
+            }
+
+            path = file;
+
+            if (::ftruncate(fd, bytes) < 0) {
+                return false;
+            }
+
+            void* memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+            if (memory == MAP_FAILED) {
+                return false;
+            }
+
+            mapping       = memory;
+            mapping_bytes = bytes;
+            features      = static_cast<uint8_t*>(memory);
+        }
+
+        labels.resize(samples * label_size);
+
+        order.resize(samples);
+
+        for (size_t i = 0; i < samples; ++i) {
+            order[i] = i;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Store the features and the label of the sample i
+     */
+    void store(size_t i, const T* sample_features, const T* sample_label) {
+        cpp_assert(i < samples, "Invalid sample");
+
+        if (compact) {
+            auto* out = reinterpret_cast<uint16_t*>(features) + i * sample_size;
+
+            for (size_t j = 0; j < sample_size; ++j) {
+                out[j] = to_bf16(float(sample_features[j]));
+            }
+        } else {
+            std::memcpy(features + i * sample_size * sizeof(T), sample_features, sample_size * sizeof(T));
+        }
+
+        std::copy_n(sample_label, label_size, labels.begin() + i * label_size);
+    }
+
+    /*!
+     * \brief Load the features and the label of the sample i
+     */
+    void load(size_t i, T* sample_features, T* sample_label) const {
+        cpp_assert(i < samples, "Invalid sample");
+
+        if (compact) {
+            const auto* in = reinterpret_cast<const uint16_t*>(features) + i * sample_size;
+
+            for (size_t j = 0; j < sample_size; ++j) {
+                sample_features[j] = from_bf16(in[j]);
+            }
+        } else {
+            std::memcpy(sample_features, features + i * sample_size * sizeof(T), sample_size * sizeof(T));
+        }
+
+        std::copy_n(labels.begin() + i * label_size, label_size, sample_label);
+    }
+
+    /*!
+     * \brief Returns a tensor for a batch of n labels (D dimensions,
+     * including the batch)
+     */
+    template <size_t D>
+    etl::dyn_matrix<T, D> make_labels(size_t n) const {
+        cpp_assert(label_dims.size() == D - 1, "Invalid dimensions of the labels");
+
+        return make_labels<D>(n, std::make_index_sequence<D - 1>());
+    }
+
+    /*!
+     * \brief Returns the number of bytes of the cached features
+     */
+    size_t bytes() const {
+        return samples * sample_size * value_size();
+    }
+
+private:
+    std::vector<uint8_t> buffer; ///< The features, when kept in memory
+    std::vector<T> labels;       ///< The labels of the samples
+
+    uint8_t* features = nullptr; ///< The features of the samples
+
+    int fd               = -1;      ///< The descriptor of the file of the features
+    void* mapping        = nullptr; ///< The mapping of the file
+    size_t mapping_bytes = 0;       ///< The size of the mapping
+    std::string path;               ///< The path of the file of the features
+
+    /*!
+     * \brief Returns a tensor for a batch of n labels
+     */
+    template <size_t D, size_t... I>
+    etl::dyn_matrix<T, D> make_labels(size_t n, std::index_sequence<I...> /*seq*/) const {
+        return etl::dyn_matrix<T, D>(n, label_dims[I]...);
+    }
+
+    /*!
+     * \brief Returns the size of a stored feature
+     */
+    size_t value_size() const {
+        return compact ? sizeof(uint16_t) : sizeof(T);
+    }
+};
+
+} //end of dll namespace
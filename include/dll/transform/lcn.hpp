@@ -7,6 +7,13 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "dll/util/arena.hpp"
+#include "dll/util/parallel.hpp"
+
 namespace dll {
 
 inline double gaussian(double x, double y, double sigma) {
@@ -25,6 +32,123 @@ void lcn_filter(W& w, size_t K, size_t Mid, double sigma){
     w /= etl::sum(w);
 }
 
+/*!
+ * \brief Compute the 1D Gaussian filter g such that the outer product g * g'
+ * is the 2D filter of lcn_filter
+ */
+template <typename T>
+void lcn_filter_1d(T* g, size_t K, size_t Mid, double sigma){
+    double sum = 0.0;
+
+    for (size_t i = 0; i < K; ++i) {
+        const double x = double(i) - double(Mid);
+
+        g[i] = T(std::exp(-(x * x) / (2.0 * sigma * sigma)));
+        sum += g[i];
+    }
+
+    for (size_t i = 0; i < K; ++i) {
+        g[i] = T(g[i] / sum);
+    }
+}
+
+/*!
+ * \brief Apply the local contrast normalization to a batch of images,
+ * with the separable filter g
+ *
+ * The local sums of x and x^2 are computed with a horizontal pass and a
+ * vertical pass of the 1D filter, with the borders of the images (out of
+ * range values are zero) handled outside of the inner loops. The images
+ * (and their channels) are processed in parallel.
+ *
+ * \param y The output (n x channels x rows x cols)
+ * \param x The input (n x channels x rows x cols)
+ * \param g The 1D filter (K)
+ * \param n The number of images
+ */
+template <typename T>
+void lcn_compute_separable(T* y, const T* x, const T* g, size_t n, size_t channels, size_t rows, size_t cols, size_t K, size_t Mid){
+    const size_t plane = rows * cols;
+
+    parallel_range(n * channels, n * channels * plane * K, [=](size_t first, size_t last) {
+        arena_scope scope;
+
+        T* h1 = scope.allocate<T>(plane); // Horizontal sums of x
+        T* h2 = scope.allocate<T>(plane); // Horizontal sums of x^2
+        T* s1 = scope.allocate<T>(plane); // Local sums of x
+        T* s2 = scope.allocate<T>(plane); // Local sums of x^2
+
+        for (size_t image = first; image < last; ++image) {
+            const T* in = x + image * plane;
+            T* out      = y + image * plane;
+
+            // 1. Horizontal pass
+
+            for (size_t j = 0; j < rows; ++j) {
+                const T* in_j = in + j * cols;
+
+                for (size_t k = 0; k < cols; ++k) {
+                    // The range of the filter inside the image
+                    const size_t p_first = k < Mid ? Mid - k : 0;
+                    const size_t p_last  = std::min(K, cols + Mid - k);
+
+                    T sum_1(0);
+                    T sum_2(0);
+
+                    for (size_t p = p_first; p < p_last; ++p) {
+                        const T v = in_j[k + p - Mid];
+
+                        sum_1 += g[p] * v;
+                        sum_2 += g[p] * v * v;
+                    }
+
+                    h1[j * cols + k] = sum_1;
+                    h2[j * cols + k] = sum_2;
+                }
+            }
+
+            // 2. Vertical pass, on full rows
+
+            std::fill(s1, s1 + plane, T(0));
+            std::fill(s2, s2 + plane, T(0));
+
+            for (size_t j = 0; j < rows; ++j) {
+                const size_t p_first = j < Mid ? Mid - j : 0;
+                const size_t p_last  = std::min(K, rows + Mid - j);
+
+                T* s1_j = s1 + j * cols;
+                T* s2_j = s2 + j * cols;
+
+                for (size_t p = p_first; p < p_last; ++p) {
+                    const T gp    = g[p];
+                    const T* h1_p = h1 + (j + p - Mid) * cols;
+                    const T* h2_p = h2 + (j + p - Mid) * cols;
+
+                    for (size_t k = 0; k < cols; ++k) {
+                        s1_j[k] += gp * h1_p[k];
+                        s2_j[k] += gp * h2_p[k];
+                    }
+                }
+            }
+
+            // 3. Remove the local mean and scale down by the local norm
+
+            T mean_norm(0);
+
+            for (size_t i = 0; i < plane; ++i) {
+                s2[i] = std::sqrt(s2[i]);
+                mean_norm += s2[i];
+            }
+
+            mean_norm /= T(plane);
+
+            for (size_t i = 0; i < plane; ++i) {
+                out[i] = (in[i] - s1[i]) / std::max(s2[i], mean_norm);
+            }
+        }
+    });
+}
+
 /*!
  * \brief Apply the layer to the input
  * \param y The output
@@ -34,8 +158,14 @@ template <typename Input, typename Output, typename W>
 void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
     using weight_t = etl::value_t<Input>;
 
-    auto v = etl::force_temporary(x(0));
-    auto o = etl::force_temporary(x(0));
+    const size_t cols  = etl::dim<2>(x);
+    const size_t plane = etl::dim<1>(x) * cols;
+
+    // The temporary planes are in the arena of the thread
+    arena_scope scope;
+
+    weight_t* v = scope.allocate<weight_t>(plane);
+    weight_t* o = scope.allocate<weight_t>(plane);
 
     for (size_t c = 0; c < etl::dim<0>(x); ++c) {
         //1. For each pixel, remove mean of 9x9 neighborhood
@@ -53,7 +183,7 @@ void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
                     }
                 }
 
-                v(j, k) = x(c, j, k) - sum;
+                v[j * cols + k] = x(c, j, k) - sum;
             }
         }
 
@@ -73,12 +203,17 @@ void lcn_compute(Output&& y, const Input& x, const W& w, size_t K, size_t Mid){
                     }
                 }
 
-                o(j, k) = std::sqrt(sum);
+                o[j * cols + k] = std::sqrt(sum);
             }
         }
 
-        auto cst = etl::mean(o);
-        y(c) = v / etl::max(o, cst);
+        const weight_t cst = std::accumulate(o, o + plane, weight_t(0)) / weight_t(plane);
+
+        for (size_t j = 0; j < etl::dim<1>(x); ++j) {
+            for (size_t k = 0; k < cols; ++k) {
+                y(c, j, k) = v[j * cols + k] / std::max(o[j * cols + k], cst);
+            }
+        }
     }
 }
 
@@ -74,10 +74,23 @@ struct lcn_layer_impl : transform_layer<lcn_layer_impl<Desc>> {
 
         using weight_t = etl::value_t<Input>;
 
-        auto w = filter<weight_t>(sigma);
+        if constexpr (etl::is_dma<std::decay_t<Input>> && etl::is_dma<std::decay_t<Output>> && etl::decay_traits<Input>::dimensions() == 4) {
+            // The Gaussian filter is separable
+            std::vector<weight_t> g(K);
+            lcn_filter_1d(g.data(), K, Mid, sigma);
 
-        for (size_t b = 0; b < etl::dim<0>(input); ++b) {
-            lcn_compute(output(b), input(b), w, K, Mid);
+            input.ensure_cpu_up_to_date();
+
+            lcn_compute_separable(output.memory_start(), input.memory_start(), g.data(),
+                                  etl::dim<0>(input), etl::dim<1>(input), etl::dim<2>(input), etl::dim<3>(input), K, Mid);
+
+            output.invalidate_gpu();
+        } else {
+            auto w = filter<weight_t>(sigma);
+
+            for (size_t b = 0; b < etl::dim<0>(input); ++b) {
+                lcn_compute(output(b), input(b), w, K, Mid);
+            }
         }
     }
 
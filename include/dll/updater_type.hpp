@@ -22,7 +22,9 @@ enum class updater_type {
     ADAM_CORRECT, ///< Use Adam with bias correction for SGD
     ADAMAX,       ///< Use Adamax for SGD
     NADAM,        ///< Use Nesterov Adam for SGD
-    ADADELTA      ///< Use Adadelta for SGD
+    ADADELTA,     ///< Use Adadelta for SGD
+    LARS,         ///< Use LARS (layer-wise trust ratio with momentum) for SGD
+    LAMB          ///< Use LAMB (layer-wise trust ratio with Adam) for SGD
 };
 
 /*!
@@ -52,6 +54,10 @@ inline std::string to_string(updater_type f) {
             return "NADAM";
         case updater_type::ADADELTA:
             return "ADADELTA";
+        case updater_type::LARS:
+            return "LARS";
+        case updater_type::LAMB:
+            return "LAMB";
     }
 
     cpp_unreachable("Unreachable code");
@@ -0,0 +1,526 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Approximate nearest-neighbour index (IVF-PQ) of feature embeddings.
+ *
+ * The embeddings are partitioned into lists by a coarse k-means quantizer.
+ * In each list, the residual of each embedding to the centroid of its list
+ * is encoded by product quantization: the residual is split into subspaces
+ * and each subspace is replaced by the index (one byte) of its nearest
+ * codeword. A query only scans the nearest lists and the distances to the
+ * encoded embeddings are computed from one table per subspace.
+ */
+
+#pragma once
+
+#include <queue>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <numeric>
+#include <algorithm>
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The configuration of an approximate nearest-neighbour index
+ */
+struct ann_config {
+    size_t lists            = 64;    ///< The number of lists (coarse centroids)
+    size_t subspaces        = 8;     ///< The number of subspaces of the product quantization
+    size_t codewords        = 256;   ///< The number of codewords per subspace (at most 256)
+    size_t iterations       = 10;    ///< The number of iterations of k-means
+    size_t probes           = 8;     ///< The number of lists scanned by a query
+    size_t training_samples = 20000; ///< The maximum number of embeddings used to train the quantizers
+};
+
+namespace ann_detail {
+
+/*!
+ * \brief Compute the squared euclidean distance between two vectors.
+ *
+ * The independent accumulators let the compiler vectorize the loop.
+ */
+template <typename T>
+T squared_l2(const T* a, const T* b, size_t n) {
+    T acc[8] = {};
+
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        for (size_t j = 0; j < 8; ++j) {
+            const T d = a[i + j] - b[i + j];
+            acc[j] += d * d;
+        }
+    }
+
+    T sum = 0;
+
+    for (; i < n; ++i) {
+        const T d = a[i] - b[i];
+        sum += d * d;
+    }
+
+    for (size_t j = 0; j < 8; ++j) {
+        sum += acc[j];
+    }
+
+    return sum;
+}
+
+/*!
+ * \brief Returns the index of the nearest of the given centroids
+ */
+template <typename T>
+size_t nearest(const T* x, const T* centroids, size_t k, size_t d) {
+    size_t best   = 0;
+    T best_d      = std::numeric_limits<T>::max();
+
+    for (size_t c = 0; c < k; ++c) {
+        const T dc = squared_l2(x, centroids + c * d, d);
+
+        if (dc < best_d) {
+            best   = c;
+            best_d = dc;
+        }
+    }
+
+    return best;
+}
+
+/*!
+ * \brief Compute k centroids of the given vectors with k-means (the
+ * assignment step is parallel).
+ *
+ * \param data The vectors (n x stride), the first d values of each being used
+ * \param n The number of vectors
+ * \param stride The distance between two vectors
+ * \param d The dimension of the vectors
+ * \param k The number of centroids
+ * \param iterations The number of iterations
+ * \param centroids The centroids (k x d)
+ */
+template <typename T>
+void kmeans(const T* data, size_t n, size_t stride, size_t d, size_t k, size_t iterations, std::vector<T>& centroids) {
+    auto& g = dll::rand_engine();
+
+    centroids.assign(k * d, T(0));
+
+    // Initialize the centroids from distinct random vectors
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), g);
+
+    for (size_t c = 0; c < k; ++c) {
+        std::copy_n(data + order[c % n] * stride, d, centroids.data() + c * d);
+    }
+
+    const size_t chunks = std::max(size_t(1), std::min(kernel_threads(), n));
+
+    std::vector<size_t> assignment(n);
+    std::vector<std::vector<double>> sums(chunks, std::vector<double>(k * d));
+    std::vector<std::vector<size_t>> counts(chunks, std::vector<size_t>(k));
+
+    for (size_t it = 0; it < iterations; ++it) {
+        dll::parallel_chunks(n, chunks, [&](size_t chunk, size_t first, size_t last) {
+            auto& s = sums[chunk];
+            auto& c = counts[chunk];
+
+            std::fill(s.begin(), s.end(), 0.0);
+            std::fill(c.begin(), c.end(), 0);
+
+            for (size_t i = first; i < last; ++i) {
+                const T* x = data + i * stride;
+
+                const size_t a = nearest(x, centroids.data(), k, d);
+
+                assignment[i] = a;
+                ++c[a];
+
+                for (size_t j = 0; j < d; ++j) {
+                    s[a * d + j] += x[j];
+                }
+            }
+        });
+
+        std::uniform_int_distribution<size_t> dist(0, n - 1);
+
+        for (size_t c = 0; c < k; ++c) {
+            size_t count = 0;
+
+            for (size_t t = 0; t < chunks; ++t) {
+                count += counts[t][c];
+            }
+
+            if (!count) {
+                // Reseed the empty clusters
+                std::copy_n(data + dist(g) * stride, d, centroids.data() + c * d);
+                continue;
+            }
+
+            for (size_t j = 0; j < d; ++j) {
+                double s = 0.0;
+
+                for (size_t t = 0; t < chunks; ++t) {
+                    s += sums[t][c * d + j];
+                }
+
+                centroids[c * d + j] = T(s / count);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Append the bytes of the given values to the given string
+ */
+template <typename V>
+void write_values(std::string& out, const V* values, size_t n) {
+    out.append(reinterpret_cast<const char*>(values), n * sizeof(V));
+}
+
+/*!
+ * \brief Read the given number of values from the given memory
+ * \return false if there are not enough bytes left
+ */
+template <typename V>
+bool read_values(const char*& in, const char* end, V* values, size_t n) {
+    if (size_t(end - in) < n * sizeof(V)) {
+        return false;
+    }
+
+    std::memcpy(values, in, n * sizeof(V));
+    in += n * sizeof(V);
+
+    return true;
+}
+
+} //end of namespace ann_detail
+
+/*!
+ * \brief An approximate nearest-neighbour index (IVF-PQ) of embeddings.
+ *
+ * \tparam T The type of the embeddings
+ */
+template <typename T>
+struct ann_index {
+    size_t dimension = 0; ///< The dimension of the embeddings
+    size_t lists     = 0; ///< The number of lists
+    size_t subspaces = 0; ///< The number of subspaces
+    size_t codewords = 0; ///< The number of codewords per subspace
+    size_t probes    = 1; ///< The number of lists scanned by a query
+
+    std::vector<T> centroids; ///< The coarse centroids (lists x dimension)
+    std::vector<T> codebooks; ///< The codewords (subspaces x codewords x sub_dimension)
+
+    std::vector<std::vector<size_t>> ids;    ///< The identifiers of the embeddings of each list
+    std::vector<std::vector<uint8_t>> codes; ///< The codes of the embeddings of each list (subspaces bytes per embedding)
+
+    /*!
+     * \brief Returns the dimension of one subspace
+     */
+    size_t sub_dimension() const {
+        return subspaces ? dimension / subspaces : 0;
+    }
+
+    /*!
+     * \brief Returns the number of embeddings in the index
+     */
+    size_t size() const {
+        size_t n = 0;
+
+        for (auto& l : ids) {
+            n += l.size();
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Build the index of the given embeddings, identified by their
+     * position.
+     *
+     * \param data The embeddings (n x d, row-major)
+     * \param n The number of embeddings
+     * \param d The dimension of the embeddings
+     * \param config The configuration of the index
+     */
+    void build(const T* data, size_t n, size_t d, const ann_config& config = {}) {
+        dimension = d;
+        lists     = std::max(size_t(1), std::min(config.lists, n));
+        codewords = std::max(size_t(1), std::min({config.codewords, size_t(256), n}));
+        probes    = std::max(size_t(1), std::min(config.probes, lists));
+
+        // The subspaces must split the embeddings evenly
+        subspaces = std::max(size_t(1), std::min(config.subspaces, d));
+
+        while (d % subspaces) {
+            --subspaces;
+        }
+
+        const size_t sd = sub_dimension();
+
+        // The quantizers are trained on a subset of the embeddings
+        const size_t t = std::min(n, std::max(config.training_samples, lists));
+
+        std::vector<size_t> sample(n);
+        std::iota(sample.begin(), sample.end(), 0);
+        std::shuffle(sample.begin(), sample.end(), dll::rand_engine());
+        sample.resize(t);
+
+        std::vector<T> training(t * d);
+
+        for (size_t i = 0; i < t; ++i) {
+            std::copy_n(data + sample[i] * d, d, training.data() + i * d);
+        }
+
+        ann_detail::kmeans(training.data(), t, d, d, lists, config.iterations, centroids);
+
+        // The residuals of the training embeddings to their centroids
+        dll::parallel_range(t, t * d * lists, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                T* x = training.data() + i * d;
+
+                const size_t l = ann_detail::nearest(x, centroids.data(), lists, d);
+
+                for (size_t j = 0; j < d; ++j) {
+                    x[j] -= centroids[l * d + j];
+                }
+            }
+        });
+
+        codebooks.assign(subspaces * codewords * sd, T(0));
+
+        std::vector<T> book;
+
+        for (size_t s = 0; s < subspaces; ++s) {
+            ann_detail::kmeans(training.data() + s * sd, t, d, sd, codewords, config.iterations, book);
+
+            std::copy(book.begin(), book.end(), codebooks.begin() + s * codewords * sd);
+        }
+
+        // Encode all the embeddings, in parallel
+
+        std::vector<size_t> list_of(n);
+        std::vector<uint8_t> all_codes(n * subspaces);
+
+        dll::parallel_range(n, n * d * (lists + codewords), [&](size_t first, size_t last) {
+            std::vector<T> r(d);
+
+            for (size_t i = first; i < last; ++i) {
+                const T* x = data + i * d;
+
+                const size_t l = ann_detail::nearest(x, centroids.data(), lists, d);
+
+                list_of[i] = l;
+
+                for (size_t j = 0; j < d; ++j) {
+                    r[j] = x[j] - centroids[l * d + j];
+                }
+
+                for (size_t s = 0; s < subspaces; ++s) {
+                    all_codes[i * subspaces + s] = uint8_t(ann_detail::nearest(r.data() + s * sd, codebooks.data() + s * codewords * sd, codewords, sd));
+                }
+            }
+        });
+
+        ids.assign(lists, {});
+        codes.assign(lists, {});
+
+        for (size_t i = 0; i < n; ++i) {
+            ids[list_of[i]].push_back(i);
+            codes[list_of[i]].insert(codes[list_of[i]].end(), all_codes.begin() + i * subspaces, all_codes.begin() + (i + 1) * subspaces);
+        }
+    }
+
+    /*!
+     * \brief Search the approximate nearest neighbours of the given query
+     *
+     * \param query The query (dimension values)
+     * \param k The number of neighbours
+     *
+     * \return The identifiers of the neighbours and their (approximate)
+     * squared distances to the query, nearest first
+     */
+    std::vector<std::pair<size_t, T>> search(const T* query, size_t k) const {
+        const size_t d  = dimension;
+        const size_t sd = sub_dimension();
+
+        // The nearest lists
+        std::vector<std::pair<T, size_t>> nearest_lists(lists);
+
+        for (size_t l = 0; l < lists; ++l) {
+            nearest_lists[l] = {ann_detail::squared_l2(query, centroids.data() + l * d, d), l};
+        }
+
+        std::partial_sort(nearest_lists.begin(), nearest_lists.begin() + probes, nearest_lists.end());
+
+        // The k best candidates, the worst on top
+        std::priority_queue<std::pair<T, size_t>> best;
+
+        std::vector<T> r(d);
+        std::vector<T> table(subspaces * codewords);
+
+        for (size_t p = 0; p < probes; ++p) {
+            const size_t l = nearest_lists[p].second;
+
+            for (size_t j = 0; j < d; ++j) {
+                r[j] = query[j] - centroids[l * d + j];
+            }
+
+            for (size_t s = 0; s < subspaces; ++s) {
+                for (size_t c = 0; c < codewords; ++c) {
+                    table[s * codewords + c] = ann_detail::squared_l2(r.data() + s * sd, codebooks.data() + (s * codewords + c) * sd, sd);
+                }
+            }
+
+            const uint8_t* list_codes = codes[l].data();
+
+            for (size_t i = 0; i < ids[l].size(); ++i) {
+                T dist = 0;
+
+                for (size_t s = 0; s < subspaces; ++s) {
+                    dist += table[s * codewords + list_codes[i * subspaces + s]];
+                }
+
+                if (best.size() < k) {
+                    best.emplace(dist, ids[l][i]);
+                } else if (dist < best.top().first) {
+                    best.pop();
+                    best.emplace(dist, ids[l][i]);
+                }
+            }
+        }
+
+        std::vector<std::pair<size_t, T>> result(best.size());
+
+        for (size_t i = result.size(); i > 0; --i) {
+            result[i - 1] = {best.top().second, best.top().first};
+            best.pop();
+        }
+
+        return result;
+    }
+
+    /*!
+     * \brief Search the approximate nearest neighbours of several queries,
+     * in parallel
+     *
+     * \param queries The queries (n x dimension, row-major)
+     * \param n The number of queries
+     * \param k The number of neighbours
+     *
+     * \return The neighbours of each query
+     */
+    std::vector<std::vector<std::pair<size_t, T>>> search(const T* queries, size_t n, size_t k) const {
+        std::vector<std::vector<std::pair<size_t, T>>> result(n);
+
+        dll::parallel_range(n, n * dimension * lists, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                result[i] = search(queries + i * dimension, k);
+            }
+        });
+
+        return result;
+    }
+
+    /*!
+     * \brief Returns the bytes of the index
+     */
+    std::string serialize() const {
+        std::string out;
+
+        const uint64_t header[6] = {sizeof(T), dimension, lists, subspaces, codewords, probes};
+
+        ann_detail::write_values(out, header, 6);
+        ann_detail::write_values(out, centroids.data(), centroids.size());
+        ann_detail::write_values(out, codebooks.data(), codebooks.size());
+
+        for (size_t l = 0; l < lists; ++l) {
+            const uint64_t n = ids[l].size();
+
+            ann_detail::write_values(out, &n, 1);
+
+            for (auto id : ids[l]) {
+                const uint64_t id64 = id;
+                ann_detail::write_values(out, &id64, 1);
+            }
+
+            ann_detail::write_values(out, codes[l].data(), codes[l].size());
+        }
+
+        return out;
+    }
+
+    /*!
+     * \brief Read the index from the given bytes
+     *
+     * \param data The bytes of the index
+     * \param n The number of bytes
+     *
+     * \return true if the index was read, false otherwise
+     */
+    bool deserialize(const char* data, size_t n) {
+        const char* end = data + n;
+
+        uint64_t header[6];
+
+        if (!ann_detail::read_values(data, end, header, 6) || header[0] != sizeof(T)) {
+            return false;
+        }
+
+        dimension = header[1];
+        lists     = header[2];
+        subspaces = header[3];
+        codewords = header[4];
+        probes    = header[5];
+
+        if (!subspaces || dimension % subspaces) {
+            return false;
+        }
+
+        centroids.resize(lists * dimension);
+        codebooks.resize(subspaces * codewords * sub_dimension());
+
+        if (!ann_detail::read_values(data, end, centroids.data(), centroids.size()) || !ann_detail::read_values(data, end, codebooks.data(), codebooks.size())) {
+            return false;
+        }
+
+        ids.assign(lists, {});
+        codes.assign(lists, {});
+
+        for (size_t l = 0; l < lists; ++l) {
+            uint64_t count;
+
+            if (!ann_detail::read_values(data, end, &count, 1) || size_t(end - data) < count * (sizeof(uint64_t) + subspaces)) {
+                return false;
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t id;
+                ann_detail::read_values(data, end, &id, 1);
+                ids[l].push_back(id);
+            }
+
+            codes[l].resize(count * subspaces);
+            ann_detail::read_values(data, end, codes[l].data(), codes[l].size());
+        }
+
+        return data == end;
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,277 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Memory of the large persistent buffers and of the temporaries of the
+ * kernels
+ *
+ * The large persistent buffers (flat buffers of the trainers, caches of the
+ * generators) are advised to the kernel to be backed by transparent huge
+ * pages (2MB on x86), which reduces the misses of the TLB on large working
+ * sets.
+ *
+ * The temporaries of the raw kernels are allocated in a per-thread bump
+ * arena: an allocation only moves a cursor and all the allocations of a
+ * scope are released at once at the end of the scope. The arena keeps its
+ * memory, so that the kernels do not allocate anything once the arena has
+ * grown to the peak of the temporaries.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+constexpr size_t huge_page_size = 2UL << 20; ///< The size of a (transparent) huge page
+
+/*!
+ * \brief Advise the kernel to back the given memory with transparent huge
+ * pages.
+ *
+ * Only the huge pages entirely inside the memory are advised, a memory
+ * smaller than a huge page is left alone. The advice is best done before the
+ * memory is first written, otherwise the pages are only merged later by the
+ * kernel.
+ *
+ * \return true if some memory was advised, false otherwise
+ */
+inline bool advise_huge_pages(void* memory, size_t bytes) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const auto start      = reinterpret_cast<uintptr_t>(memory);
+    const uintptr_t first = (start + huge_page_size - 1) & ~(huge_page_size - 1);
+    const uintptr_t last  = (start + bytes) & ~(huge_page_size - 1);
+
+    if (last <= first) {
+        return false;
+    }
+
+    return !madvise(reinterpret_cast<void*>(first), last - first, MADV_HUGEPAGE);
+#else
+    cpp_unused(memory);
+    cpp_unused(bytes);
+
+    return false;
+#endif
+}
+
+/*!
+ * \brief Advise the kernel to back the memory of the given tensor with
+ * transparent huge pages (only done for tensors with direct memory access)
+ *
+ * \return true if some memory was advised, false otherwise
+ */
+template <typename E>
+bool advise_huge_pages(E& e) {
+    if constexpr (etl::is_dma<E>) {
+        return advise_huge_pages(e.memory_start(), etl::size(e) * sizeof(etl::value_t<E>));
+    } else {
+        cpp_unused(e);
+        return false;
+    }
+}
+
+/*!
+ * \brief A bump allocator for the temporaries of the kernels.
+ *
+ * The memory is allocated in blocks, and an allocation only moves the cursor
+ * of the current block. The allocations are released by rewinding the arena
+ * to a previous mark (see arena_scope). Once the arena is empty again, the
+ * blocks are merged into a single block big enough for the peak of the
+ * allocations.
+ *
+ * Only trivially destructible values can be allocated in the arena, no
+ * destructor is ever called.
+ */
+struct scratch_arena {
+    static constexpr size_t alignment = 64;        ///< The alignment of the allocations
+    static constexpr size_t min_block = 1UL << 20; ///< The minimum size of a block
+
+    /*!
+     * \brief A position in the arena
+     */
+    struct mark {
+        size_t block;  ///< The current block
+        size_t cursor; ///< The cursor in the current block
+        size_t used;   ///< The number of allocated bytes
+    };
+
+    scratch_arena() = default;
+
+    scratch_arena(const scratch_arena& rhs) = delete;
+    scratch_arena& operator=(const scratch_arena& rhs) = delete;
+
+    /*!
+     * \brief Allocate n (uninitialized) values in the arena
+     */
+    template <typename T>
+    T* allocate(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "The arena does not destroy its values");
+
+        const size_t bytes = (n * sizeof(T) + alignment - 1) & ~(alignment - 1);
+
+        // Use the next blocks (kept from the previous allocations) first
+        while (current < blocks.size() && cursor + bytes > blocks[current].size) {
+            ++current;
+            cursor = 0;
+        }
+
+        if (current == blocks.size()) {
+            const size_t last = blocks.empty() ? 0 : blocks.back().size;
+
+            blocks.push_back(make_block(std::max({min_block, bytes, 2 * last})));
+
+            current = blocks.size() - 1;
+            cursor  = 0;
+        }
+
+        auto* memory = blocks[current].memory.get() + cursor;
+
+        cursor += bytes;
+        used += bytes;
+        peak = std::max(peak, used);
+
+        return reinterpret_cast<T*>(memory);
+    }
+
+    /*!
+     * \brief Returns the current position of the arena
+     */
+    mark position() const {
+        return {current, cursor, used};
+    }
+
+    /*!
+     * \brief Release all the allocations done after the given position
+     */
+    void rewind(const mark& m) {
+        current = m.block;
+        cursor  = m.cursor;
+        used    = m.used;
+
+        // Merge the blocks once the arena is empty
+        if (!used && blocks.size() > 1) {
+            blocks.clear();
+            blocks.push_back(make_block((peak + alignment - 1) & ~(alignment - 1)));
+        }
+    }
+
+    /*!
+     * \brief Returns the number of bytes currently allocated in the arena
+     */
+    size_t allocated() const {
+        return used;
+    }
+
+    /*!
+     * \brief Returns the number of bytes reserved by the arena
+     */
+    size_t capacity() const {
+        size_t bytes = 0;
+
+        for (auto& block : blocks) {
+            bytes += block.size;
+        }
+
+        return bytes;
+    }
+
+private:
+    /*!
+     * \brief Release the memory of a block
+     */
+    struct block_deleter {
+        void operator()(char* memory) const {
+            std::free(memory);
+        }
+    };
+
+    /*!
+     * \brief A block of memory of the arena
+     */
+    struct block {
+        std::unique_ptr<char, block_deleter> memory; ///< The memory of the block
+        size_t size;                                 ///< The size of the block
+    };
+
+    std::vector<block> blocks; ///< The blocks of the arena
+    size_t current = 0;        ///< The current block
+    size_t cursor  = 0;        ///< The cursor in the current block
+    size_t used    = 0;        ///< The number of allocated bytes
+    size_t peak    = 0;        ///< The largest number of allocated bytes
+
+    /*!
+     * \brief Allocate a new block of the given size (a multiple of the
+     * alignment)
+     */
+    static block make_block(size_t size) {
+        auto* memory = static_cast<char*>(std::aligned_alloc(alignment, size));
+
+        cpp_assert(memory, "Impossible to allocate a block of the arena");
+
+        advise_huge_pages(memory, size);
+
+        return {std::unique_ptr<char, block_deleter>(memory), size};
+    }
+};
+
+/*!
+ * \brief Returns the arena of the current thread
+ */
+inline scratch_arena& local_arena() {
+    static thread_local scratch_arena arena;
+    return arena;
+}
+
+/*!
+ * \brief A scope of allocations in the arena of the current thread: all the
+ * allocations of the scope are released at its end.
+ *
+ * The scopes of a thread must be nested, a scope must end on the thread
+ * where it started.
+ */
+struct arena_scope {
+    arena_scope() : arena(local_arena()), start(arena.position()) {}
+
+    arena_scope(const arena_scope& rhs) = delete;
+    arena_scope& operator=(const arena_scope& rhs) = delete;
+
+    /*!
+     * \brief Release the allocations of the scope
+     */
+    ~arena_scope() {
+        arena.rewind(start);
+    }
+
+    /*!
+     * \brief Allocate n (uninitialized) values in the scope
+     */
+    template <typename T>
+    T* allocate(size_t n) {
+        return arena.template allocate<T>(n);
+    }
+
+private:
+    scratch_arena& arena;      ///< The arena of the thread
+    scratch_arena::mark start; ///< The position of the arena at the start of the scope
+};
+
+} //end of dll namespace
@@ -0,0 +1,316 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Asynchronous logging of the training progress.
+ *
+ * The training thread only pushes compact binary records (the kind of event,
+ * the counters and the values) into a lock-free single-producer
+ * single-consumer ring. A background thread drains the ring, formats the
+ * records as text or as JSON lines and writes them. The batch records are
+ * rate-limited: only one batch line is written per interval (and the last
+ * batch of each epoch), the other batch records are discarded after being
+ * popped. The epoch records are always written.
+ *
+ * The output can be configured from the environment:
+ *  - DLL_LOG_FORMAT=text|json
+ *  - DLL_LOG_INTERVAL=milliseconds between two batch lines
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "dll/util/metrics.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The format of the log lines
+ */
+enum class log_format : uint8_t {
+    TEXT, ///< Human-readable lines
+    JSON  ///< One JSON object per line
+};
+
+/*!
+ * \brief The kind of a log record
+ */
+enum class log_event : uint8_t {
+    RBM_BATCH,    ///< The end of a batch of pretraining
+    RBM_EPOCH,    ///< The end of an epoch of pretraining
+    FT_BATCH,     ///< The end of a batch of fine-tuning
+    FT_EPOCH,     ///< The end of an epoch of fine-tuning
+    FT_VAL_EPOCH, ///< The end of an epoch of fine-tuning, with validation
+    MESSAGE       ///< A static message
+};
+
+/*!
+ * \brief A compact record of the training progress
+ *
+ * The meaning of the values depends on the event:
+ *  - RBM_BATCH: reconstruction error, sparsity
+ *  - RBM_EPOCH: reconstruction error, sparsity, free energy
+ *  - FT_BATCH / FT_EPOCH: error, loss
+ *  - FT_VAL_EPOCH: error, loss, validation error, validation loss
+ */
+struct log_record {
+    log_event event;     ///< The kind of event
+    bool flag;           ///< RBM_EPOCH: has free energy, FT_*: has error
+    uint32_t epoch;      ///< The current epoch
+    uint32_t epochs;     ///< The total number of epochs
+    uint32_t batch;      ///< The current batch
+    uint32_t batches;    ///< The total number of batches
+    uint32_t duration;   ///< The duration of the batch or epoch, in milliseconds
+    double values[4];    ///< The values of the record
+    const char* message; ///< MESSAGE: the message (a static string)
+};
+
+/*!
+ * \brief The configuration of the asynchronous logger
+ */
+struct log_config {
+    log_format format  = log_format::TEXT; ///< The format of the lines
+    std::FILE* output  = stdout;           ///< The output of the lines
+    size_t interval_ms = 200;              ///< The minimum time between two batch lines (0 to write all of them)
+
+    /*!
+     * \brief Returns the configuration from the environment
+     */
+    static log_config from_environment() {
+        log_config config;
+
+        if (const char* value = std::getenv("DLL_LOG_FORMAT")) {
+            if (std::strcmp(value, "json") == 0) {
+                config.format = log_format::JSON;
+            }
+        }
+
+        if (const char* value = std::getenv("DLL_LOG_INTERVAL")) {
+            config.interval_ms = size_t(std::atoll(value));
+        }
+
+        return config;
+    }
+};
+
+/*!
+ * \brief Asynchronous logger of the training progress, writing from a
+ * background thread.
+ *
+ * push() must always be called from the same (training) thread.
+ */
+struct async_logger {
+    static constexpr size_t ring_size = 1 << 12; ///< The number of records that can be waiting
+
+    log_config config;                       ///< The configuration
+    metric_ring<ring_size, log_record> ring; ///< The records waiting for the logger
+
+    std::thread thread;               ///< The logger thread
+    std::atomic<bool> running{false}; ///< Indicates if the logger thread must continue
+
+    std::chrono::steady_clock::time_point last_batch; ///< The time of the last written batch line (logger thread)
+
+    /*!
+     * \brief Create a logger with the given configuration
+     */
+    explicit async_logger(log_config config = log_config::from_environment()) : config(config) {}
+
+    async_logger(const async_logger& rhs) = delete;
+    async_logger& operator=(const async_logger& rhs) = delete;
+
+    /*!
+     * \brief Stop the logger
+     */
+    ~async_logger() {
+        stop();
+    }
+
+    /*!
+     * \brief Push a record (training thread)
+     */
+    void push(const log_record& record) {
+        ring.push(record);
+    }
+
+    /*!
+     * \brief Start the logger thread
+     */
+    void start() {
+        if (running.load()) {
+            return;
+        }
+
+        running.store(true);
+        thread = std::thread([this] { run(); });
+    }
+
+    /*!
+     * \brief Stop the logger thread, after writing the last records
+     */
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+
+        thread.join();
+    }
+
+    /*!
+     * \brief Drain the ring and write the lines (logger thread, or any
+     * thread once the logger is stopped)
+     * \param last Indicates if this is the last drain, in which case the last
+     * batch record is always written
+     */
+    void drain(bool last = false) {
+        std::string text;
+        log_record record;
+        log_record pending;
+        bool has_pending = false;
+
+        char line[512];
+
+        while (ring.pop(record)) {
+            const bool batch = record.event == log_event::RBM_BATCH || record.event == log_event::FT_BATCH;
+
+            if (batch) {
+                auto now = std::chrono::steady_clock::now();
+
+                const bool due = config.interval_ms == 0
+                                 || record.batch + 1 >= record.batches
+                                 || now - last_batch >= std::chrono::milliseconds(config.interval_ms);
+
+                if (!due) {
+                    // Only the last skipped batch may be written at the end
+                    pending     = record;
+                    has_pending = true;
+                    continue;
+                }
+
+                last_batch = now;
+            }
+
+            has_pending = false;
+
+            format(record, line, sizeof(line));
+            text += line;
+        }
+
+        if (last && has_pending) {
+            format(pending, line, sizeof(line));
+            text += line;
+        }
+
+        if (!text.empty()) {
+            std::fwrite(text.data(), 1, text.size(), config.output);
+            std::fflush(config.output);
+        }
+    }
+
+    /*!
+     * \brief Format the given record as one line
+     */
+    void format(const log_record& r, char* line, size_t n) const {
+        if (config.format == log_format::JSON) {
+            switch (r.event) {
+                case log_event::RBM_BATCH:
+                    snprintf(line, n, "{\"event\":\"rbm_batch\",\"batch\":%u,\"batches\":%u,\"reconstruction_error\":%.6g,\"sparsity\":%.6g}\n",
+                             r.batch, r.batches, r.values[0], r.values[1]);
+                    break;
+                case log_event::RBM_EPOCH:
+                    if (r.flag) {
+                        snprintf(line, n, "{\"event\":\"rbm_epoch\",\"epoch\":%u,\"reconstruction_error\":%.6g,\"sparsity\":%.6g,\"free_energy\":%.6g}\n",
+                                 r.epoch, r.values[0], r.values[1], r.values[2]);
+                    } else {
+                        snprintf(line, n, "{\"event\":\"rbm_epoch\",\"epoch\":%u,\"reconstruction_error\":%.6g,\"sparsity\":%.6g}\n",
+                                 r.epoch, r.values[0], r.values[1]);
+                    }
+                    break;
+                case log_event::FT_BATCH:
+                    snprintf(line, n, "{\"event\":\"batch\",\"epoch\":%u,\"epochs\":%u,\"batch\":%u,\"batches\":%u,\"error\":%.6g,\"loss\":%.6g,\"time_ms\":%u}\n",
+                             r.epoch, r.epochs, r.batch + 1, r.batches, r.values[0], r.values[1], r.duration);
+                    break;
+                case log_event::FT_EPOCH:
+                    snprintf(line, n, "{\"event\":\"epoch\",\"epoch\":%u,\"epochs\":%u,\"error\":%.6g,\"loss\":%.6g,\"time_ms\":%u}\n",
+                             r.epoch, r.epochs, r.values[0], r.values[1], r.duration);
+                    break;
+                case log_event::FT_VAL_EPOCH:
+                    snprintf(line, n, "{\"event\":\"epoch\",\"epoch\":%u,\"epochs\":%u,\"error\":%.6g,\"loss\":%.6g,\"val_error\":%.6g,\"val_loss\":%.6g,\"time_ms\":%u}\n",
+                             r.epoch, r.epochs, r.values[0], r.values[1], r.values[2], r.values[3], r.duration);
+                    break;
+                case log_event::MESSAGE:
+                    snprintf(line, n, "{\"event\":\"message\",\"message\":\"%s\"}\n", r.message);
+                    break;
+            }
+        } else {
+            switch (r.event) {
+                case log_event::RBM_BATCH:
+                    snprintf(line, n, "Batch %u/%u - Reconstruction error: %.5f - Sparsity: %.5f\n",
+                             r.batch, r.batches, r.values[0], r.values[1]);
+                    break;
+                case log_event::RBM_EPOCH:
+                    if (r.flag) {
+                        snprintf(line, n, "epoch %u - Reconstruction error: %.5f - Free energy: %.3f - Sparsity: %.5f\n",
+                                 r.epoch, r.values[0], r.values[2], r.values[1]);
+                    } else {
+                        snprintf(line, n, "epoch %u - Reconstruction error: %.5f - Sparsity: %.5f\n",
+                                 r.epoch, r.values[0], r.values[1]);
+                    }
+                    break;
+                case log_event::FT_BATCH:
+                    snprintf(line, n, "epoch %3u/%u batch %4u/%4u - error: %.5f loss: %.5f time %ums\n",
+                             r.epoch, r.epochs, r.batch + 1, r.batches, r.values[0], r.values[1], r.duration);
+                    break;
+                case log_event::FT_EPOCH:
+                    if (r.flag) {
+                        snprintf(line, n, "epoch %3u/%u - error: %.5f loss: %.5f time %ums\n",
+                                 r.epoch, r.epochs, r.values[0], r.values[1], r.duration);
+                    } else {
+                        snprintf(line, n, "epoch %3u/%u - loss: %.5f time %ums\n",
+                                 r.epoch, r.epochs, r.values[1], r.duration);
+                    }
+                    break;
+                case log_event::FT_VAL_EPOCH:
+                    if (r.flag) {
+                        snprintf(line, n, "epoch %3u/%u - error: %.5f loss: %.5f val_error: %.5f val_loss: %.5f time %ums\n",
+                                 r.epoch, r.epochs, r.values[0], r.values[1], r.values[2], r.values[3], r.duration);
+                    } else {
+                        snprintf(line, n, "epoch %3u/%u - loss: %.5f val_loss: %.5f time %ums\n",
+                                 r.epoch, r.epochs, r.values[1], r.values[3], r.duration);
+                    }
+                    break;
+                case log_event::MESSAGE:
+                    snprintf(line, n, "%s\n", r.message);
+                    break;
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief The loop of the logger thread
+     */
+    void run() {
+        while (running.load(std::memory_order_relaxed)) {
+            drain();
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+
+        // Write the last records
+        drain(true);
+    }
+};
+
+} //end of dll namespace
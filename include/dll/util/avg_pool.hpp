@@ -0,0 +1,233 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Average pooling kernels
+ *
+ * The windows of the pooling layers do not overlap, each input value is
+ * therefore read once: the forward kernel sums the rows of a window
+ * element-wise, in contiguous memory, before summing the columns of the
+ * window, and the backward kernel broadcasts the scaled errors of a row of
+ * windows once and copies it for the other rows of the windows.
+ *
+ * The global average pooling (a single window covering the whole image, the
+ * head of most convolutional networks) is a plain reduction of each image in
+ * the forward pass and a fill in the backward pass.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "dll/util/arena.hpp"
+#include "dll/util/cpu_dispatch.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/shape_dispatch.hpp"
+
+namespace dll {
+
+namespace avg_pool_detail {
+
+/*!
+ * \brief Returns the sum of the n contiguous values, with several
+ * independent accumulators (which can be vectorized)
+ */
+template <typename T>
+DLL_CPU_BODY T sum_body(const T* values, size_t n) {
+    constexpr size_t L = 8;
+
+    T acc[L] = {};
+
+    size_t i = 0;
+
+    for (; i + L <= n; i += L) {
+        for (size_t l = 0; l < L; ++l) {
+            acc[l] += values[i + l];
+        }
+    }
+
+    T total = 0;
+
+    for (; i < n; ++i) {
+        total += values[i];
+    }
+
+    for (size_t l = 0; l < L; ++l) {
+        total += acc[l];
+    }
+
+    return total;
+}
+
+DLL_CPU_KERNEL(sum)
+
+} //end of namespace avg_pool_detail
+
+/*!
+ * \brief Average pool the input, with non-overlapping windows
+ *
+ * \param out The output (n x i2 / c1 x i3 / c2)
+ * \param in The input (n x i2 x i3)
+ * \param n The number of images (batch x channels)
+ *
+ * \tparam C1 The first dimension of the window, if known at compile time (0 otherwise)
+ * \tparam C2 The second dimension of the window, if known at compile time (0 otherwise)
+ */
+template <size_t C1 = 0, size_t C2 = 0, typename T>
+void avg_pool_2d_forward(T* out, const T* in, size_t n, size_t i2, size_t i3, size_t c1, size_t c2) {
+    const size_t o2 = i2 / c1;
+    const size_t o3 = i3 / c2;
+
+    const T scale = T(1) / T(c1 * c2);
+
+    // Global average pooling
+    if (o2 == 1 && o3 == 1 && c1 == i2 && c2 == i3) {
+        parallel_range(n, n * i2 * i3, [=](size_t first, size_t last) {
+            for (size_t image = first; image < last; ++image) {
+                out[image] = scale * avg_pool_detail::sum(in + image * i2 * i3, i2 * i3);
+            }
+        });
+
+        return;
+    }
+
+    parallel_range(n, n * i2 * i3, [=](size_t first, size_t last) {
+        // Constants for the specialised windows
+        const size_t w1 = C1 ? C1 : c1;
+        const size_t w2 = C2 ? C2 : c2;
+
+        // The sum of the rows of the windows of the current row
+        arena_scope scope;
+        T* acc = scope.allocate<T>(i3);
+
+        for (size_t image = first; image < last; ++image) {
+            const T* x = in + image * i2 * i3;
+            T* y       = out + image * o2 * o3;
+
+            for (size_t j = 0; j < o2; ++j) {
+                const T* rows = x + j * w1 * i3;
+
+                std::copy(rows, rows + i3, acc);
+
+                for (size_t jj = 1; jj < w1; ++jj) {
+                    for (size_t k = 0; k < i3; ++k) {
+                        acc[k] += rows[jj * i3 + k];
+                    }
+                }
+
+                for (size_t k = 0; k < o3; ++k) {
+                    T sum = 0;
+
+                    for (size_t kk = 0; kk < w2; ++kk) {
+                        sum += acc[k * w2 + kk];
+                    }
+
+                    y[j * o3 + k] = scale * sum;
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Backpropagate the errors of an average pooling, with
+ * non-overlapping windows: each input receives the error of its window,
+ * divided by the size of the window
+ *
+ * \param out The errors of the input (n x i2 x i3)
+ * \param errors The errors of the output (n x i2 / c1 x i3 / c2)
+ * \param n The number of images (batch x channels)
+ *
+ * \tparam C1 The first dimension of the window, if known at compile time (0 otherwise)
+ * \tparam C2 The second dimension of the window, if known at compile time (0 otherwise)
+ */
+template <size_t C1 = 0, size_t C2 = 0, typename T>
+void avg_pool_2d_backward(T* out, const T* errors, size_t n, size_t i2, size_t i3, size_t c1, size_t c2) {
+    const size_t o2 = i2 / c1;
+    const size_t o3 = i3 / c2;
+
+    const T scale = T(1) / T(c1 * c2);
+
+    // Global average pooling
+    if (o2 == 1 && o3 == 1 && c1 == i2 && c2 == i3) {
+        parallel_range(n, n * i2 * i3, [=](size_t first, size_t last) {
+            for (size_t image = first; image < last; ++image) {
+                std::fill(out + image * i2 * i3, out + (image + 1) * i2 * i3, scale * errors[image]);
+            }
+        });
+
+        return;
+    }
+
+    parallel_range(n, n * i2 * i3, [=](size_t first, size_t last) {
+        // Constants for the specialised windows
+        const size_t w1 = C1 ? C1 : c1;
+        const size_t w2 = C2 ? C2 : c2;
+
+        for (size_t image = first; image < last; ++image) {
+            T* x       = out + image * i2 * i3;
+            const T* e = errors + image * o2 * o3;
+
+            for (size_t j = 0; j < o2; ++j) {
+                T* row = x + j * w1 * i3;
+
+                for (size_t k = 0; k < o3; ++k) {
+                    const T value = scale * e[j * o3 + k];
+
+                    for (size_t kk = 0; kk < w2; ++kk) {
+                        row[k * w2 + kk] = value;
+                    }
+                }
+
+                // The columns not covered by a window have no error
+                std::fill(row + o3 * w2, row + i3, T(0));
+
+                for (size_t jj = 1; jj < w1; ++jj) {
+                    std::copy(row, row + i3, row + jj * i3);
+                }
+            }
+
+            // The rows not covered by a window have no error
+            std::fill(x + o2 * w1 * i3, x + i2 * i3, T(0));
+        }
+    });
+}
+
+/*!
+ * \brief The windows with specialised average pooling kernels in the dynamic
+ * layers
+ */
+using avg_pool_2d_shapes = shape_list<shape_2d<2, 2>, shape_2d<3, 3>, shape_2d<4, 4>>;
+
+/*!
+ * \brief The average pooling kernels of a dynamic layer, specialised for its
+ * window if it is a common one
+ */
+template <typename T>
+struct avg_pool_2d_kernels {
+    using forward_t  = void (*)(T*, const T*, size_t, size_t, size_t, size_t, size_t); ///< The type of the forward kernel
+    using backward_t = void (*)(T*, const T*, size_t, size_t, size_t, size_t, size_t); ///< The type of the backward kernel
+
+    forward_t forward   = &avg_pool_2d_forward<0, 0, T>;  ///< The forward kernel
+    backward_t backward = &avg_pool_2d_backward<0, 0, T>; ///< The backward kernel
+
+    /*!
+     * \brief Select the kernels for the given window
+     * \return true if the kernels are specialised for the window, false otherwise
+     */
+    bool select(size_t c1, size_t c2) {
+        return dispatch_shape(avg_pool_2d_shapes(), c1, c2, [this](auto shape) {
+            using shape_t = decltype(shape);
+
+            forward  = &avg_pool_2d_forward<shape_t::dim1, shape_t::dim2, T>;
+            backward = &avg_pool_2d_backward<shape_t::dim1, shape_t::dim2, T>;
+        });
+    }
+};
+
+} //end of dll namespace
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <iterator>
+#include <cstring>
 
 #include "cpp_utils/assert.hpp"
 
@@ -68,4 +69,49 @@ batch<Iterator> make_batch(Iterator&& first, Iterator&& last) {
     return {std::forward<Iterator>(first), std::forward<Iterator>(last)};
 }
 
+/*!
+ * \brief Gather rows of a cache into the first rows of a batch.
+ *
+ * Each row is copied at once and the next source row is prefetched while
+ * the current one is copied, since the gathered rows are generally not
+ * contiguous (shuffled samples).
+ *
+ * \param batch The batch to fill (contiguous rows)
+ * \param cache The cache to gather the rows from (contiguous rows)
+ * \param n The number of rows to gather
+ * \param index A functor returning the index, in the cache, of the i-th row
+ */
+template <typename Batch, typename Cache, typename Index>
+void gather_rows(Batch&& batch, const Cache& cache, size_t n, Index&& index) {
+    using value_type = etl::value_t<std::decay_t<Batch>>;
+
+    static_assert(std::is_same<value_type, etl::value_t<Cache>>::value, "gather_rows() cannot convert the rows");
+
+    if (!n) {
+        return;
+    }
+
+    const size_t row = etl::size(cache) / etl::dim<0>(cache);
+
+    cpp_assert(n * row <= etl::size(batch), "Too many rows for the batch");
+
+    auto* out      = batch.memory_start();
+    const auto* in = cache.memory_start();
+
+    size_t next = index(0);
+
+    for (size_t i = 0; i < n; ++i) {
+        const size_t current = next;
+
+        if (i + 1 < n) {
+            next = index(i + 1);
+            __builtin_prefetch(in + next * row);
+        }
+
+        std::memcpy(out + i * row, in + current * row, row * sizeof(value_type));
+    }
+
+    batch.invalidate_gpu();
+}
+
 } //end of dll namespace
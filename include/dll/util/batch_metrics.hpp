@@ -0,0 +1,248 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Evaluation metrics accumulated batch by batch
+ *
+ * The kernels read each output and each label once: the error and the loss
+ * of a sample (and its class, for the classification metrics) are computed
+ * in a single pass over its row. The accumulators only hold sums, they can
+ * be updated on different threads and merged at the end of the evaluation.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief The sums of the errors and of the losses of a set of samples
+ */
+struct metrics_accumulator {
+    double error = 0.0; ///< The sum of the errors
+    double loss  = 0.0; ///< The sum of the losses
+
+    /*!
+     * \brief Add the sums of another accumulator to this one
+     */
+    void merge(const metrics_accumulator& rhs) {
+        error += rhs.error;
+        loss += rhs.loss;
+    }
+};
+
+namespace batch_metrics_detail {
+
+/*!
+ * \brief Returns the index of the (first) largest of the m values
+ */
+template <typename T>
+size_t max_index(const T* values, size_t m) {
+    size_t best = 0;
+
+    for (size_t k = 1; k < m; ++k) {
+        if (values[k] > values[best]) {
+            best = k;
+        }
+    }
+
+    return best;
+}
+
+} //end of namespace batch_metrics_detail
+
+/*!
+ * \brief Accumulate the categorical cross entropy metrics of n samples: the
+ * number of samples whose best output is not their label, and the sum of
+ * -log(output) of their labels
+ *
+ * \param acc The accumulator
+ * \param output The outputs (n x m)
+ * \param labels The one-hot labels (n x m)
+ */
+template <typename T, typename L>
+void cce_metrics(metrics_accumulator& acc, const T* output, const L* labels, size_t n, size_t m) {
+    double error = 0.0;
+    double loss  = 0.0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const T* o = output + i * m;
+        const L* l = labels + i * m;
+
+        size_t best_o = 0;
+        size_t best_l = 0;
+
+        for (size_t k = 0; k < m; ++k) {
+            best_o = o[k] > o[best_o] ? k : best_o;
+            best_l = l[k] > l[best_l] ? k : best_l;
+
+            if (l[k] != L(0)) {
+                loss -= l[k] * std::log(o[k]);
+            }
+        }
+
+        error += best_o != best_l;
+    }
+
+    acc.error += error;
+    acc.loss += loss;
+}
+
+/*!
+ * \brief Accumulate the binary cross entropy metrics of n samples: the mean
+ * absolute difference between the outputs and the labels of each sample, and
+ * the mean cross entropy of the outputs of each sample (the outputs being
+ * clipped to [0.001, 0.999])
+ *
+ * \param acc The accumulator
+ * \param output The outputs (n x m)
+ * \param labels The labels (n x m)
+ */
+template <typename T, typename L>
+void bce_metrics(metrics_accumulator& acc, const T* output, const L* labels, size_t n, size_t m) {
+    double error = 0.0;
+    double loss  = 0.0;
+
+    for (size_t i = 0; i < n * m; ++i) {
+        const double o = output[i];
+        const double l = labels[i];
+        const double c = std::min(std::max(o, 0.001), 0.999);
+
+        error += std::abs(l - o);
+        loss -= l * std::log(c) + (1.0 - l) * std::log(1.0 - c);
+    }
+
+    acc.error += error / m;
+    acc.loss += loss / m;
+}
+
+/*!
+ * \brief Accumulate the mean squared error metrics of n samples: the sum of
+ * the absolute differences between outputs and labels, and half the sum of
+ * their squared differences
+ *
+ * \param acc The accumulator
+ * \param output The outputs (n x m)
+ * \param labels The labels (n x m)
+ */
+template <typename T, typename L>
+void mse_metrics(metrics_accumulator& acc, const T* output, const L* labels, size_t n, size_t m) {
+    double error = 0.0;
+    double loss  = 0.0;
+
+    for (size_t i = 0; i < n * m; ++i) {
+        const double d = double(output[i]) - double(labels[i]);
+
+        error += std::abs(d);
+        loss += 0.5 * d * d;
+    }
+
+    acc.error += error;
+    acc.loss += loss;
+}
+
+/*!
+ * \brief The classification metrics of a set of samples: the confusion
+ * matrix and the top-k accuracy
+ */
+struct classification_accumulator {
+    size_t classes = 0; ///< The number of classes
+    size_t k       = 1; ///< The number of best classes of the top-k accuracy
+    size_t samples = 0; ///< The number of samples
+    size_t top_k   = 0; ///< The number of samples whose label is in their k best classes
+
+    std::vector<size_t> confusion; ///< The confusion matrix (label x prediction)
+
+    classification_accumulator() = default;
+
+    /*!
+     * \brief Create an empty accumulator
+     * \param classes The number of classes
+     * \param k The number of best classes of the top-k accuracy
+     */
+    classification_accumulator(size_t classes, size_t k) : classes(classes), k(k), confusion(classes * classes) {}
+
+    /*!
+     * \brief Add n samples to the metrics.
+     *
+     * The label of a sample is in its k best classes if less than k outputs
+     * are strictly larger than the output of the label, no sort is needed.
+     *
+     * \param output The outputs (n x classes)
+     * \param labels The labels of the samples
+     * \param n The number of samples
+     * \param sparse Indicates if the labels are indices (n) rather than one-hot (n x classes)
+     */
+    template <typename T, typename L>
+    void add(const T* output, const L* labels, size_t n, bool sparse) {
+        for (size_t i = 0; i < n; ++i) {
+            const T* o = output + i * classes;
+
+            const size_t label      = sparse ? size_t(labels[i]) : batch_metrics_detail::max_index(labels + i * classes, classes);
+            const size_t prediction = batch_metrics_detail::max_index(o, classes);
+
+            size_t larger = 0;
+
+            for (size_t c = 0; c < classes; ++c) {
+                larger += o[c] > o[label];
+            }
+
+            top_k += larger < k;
+
+            ++confusion[label * classes + prediction];
+        }
+
+        samples += n;
+    }
+
+    /*!
+     * \brief Add the metrics of another accumulator to this one
+     */
+    void merge(const classification_accumulator& rhs) {
+        samples += rhs.samples;
+        top_k += rhs.top_k;
+
+        for (size_t i = 0; i < confusion.size(); ++i) {
+            confusion[i] += rhs.confusion[i];
+        }
+    }
+
+    /*!
+     * \brief Returns the number of samples with the given label predicted
+     * as the given class
+     */
+    size_t count(size_t label, size_t prediction) const {
+        return confusion[label * classes + prediction];
+    }
+
+    /*!
+     * \brief Returns the ratio of correctly classified samples
+     */
+    double accuracy() const {
+        size_t correct = 0;
+
+        for (size_t c = 0; c < classes; ++c) {
+            correct += count(c, c);
+        }
+
+        return samples ? correct / double(samples) : 0.0;
+    }
+
+    /*!
+     * \brief Returns the ratio of samples whose label is in their k best
+     * classes
+     */
+    double top_k_accuracy() const {
+        return samples ? top_k / double(samples) : 0.0;
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,501 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Single-pass kernels of the Batch Normalization layers
+ *
+ * The 4D kernels work directly on the (Batch x K x W x H) memory. Each
+ * feature map of each sample is a contiguous plane, so the kernels sweep
+ * contiguous memory, with the reductions of a channel kept in a few lanes of
+ * accumulators, and the channels are processed in parallel.
+ *
+ * The 2D kernels work on the (Batch x K) memory. The channels are
+ * contiguous, so the kernels sweep the rows and keep the statistics of a
+ * block of channels side by side, and the blocks of channels are processed
+ * in parallel.
+ *
+ * The mean and the variance are computed in a single pass over the input
+ * (Welford updates, with Chan's merge of the partial statistics of each
+ * plane for the 4D layers).
+ *
+ * With synchronized statistics, the layers only compute the sums of their
+ * part of the batch, shifted by the running mean, which are then added over
+ * all the parts before the normalization.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/cpu_dispatch.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+namespace bn_detail {
+
+constexpr size_t lanes = 8; ///< The number of independent accumulators of the reductions
+
+/*!
+ * \brief Compute the sums of (x - shift) and of (x - shift)^2 over n values
+ */
+template <typename T>
+DLL_CPU_BODY void shifted_sums_body(const T* x, size_t n, T shift, T& sum, T& sq) {
+    T s[lanes] = {};
+    T q[lanes] = {};
+
+    size_t i = 0;
+
+    for (; i + lanes <= n; i += lanes) {
+        for (size_t l = 0; l < lanes; ++l) {
+            const T d = x[i + l] - shift;
+
+            s[l] += d;
+            q[l] += d * d;
+        }
+    }
+
+    for (; i < n; ++i) {
+        const T d = x[i] - shift;
+
+        s[0] += d;
+        q[0] += d * d;
+    }
+
+    sum = 0;
+    sq  = 0;
+
+    for (size_t l = 0; l < lanes; ++l) {
+        sum += s[l];
+        sq += q[l];
+    }
+}
+
+DLL_CPU_KERNEL(shifted_sums)
+
+/*!
+ * \brief Compute the sums of e and of e * p over n values
+ */
+template <typename T>
+DLL_CPU_BODY void error_sums_body(const T* e, const T* p, size_t n, T& sum_e, T& sum_ep) {
+    T s[lanes] = {};
+    T q[lanes] = {};
+
+    size_t i = 0;
+
+    for (; i + lanes <= n; i += lanes) {
+        for (size_t l = 0; l < lanes; ++l) {
+            s[l] += e[i + l];
+            q[l] += e[i + l] * p[i + l];
+        }
+    }
+
+    for (; i < n; ++i) {
+        s[0] += e[i];
+        q[0] += e[i] * p[i];
+    }
+
+    for (size_t l = 0; l < lanes; ++l) {
+        sum_e += s[l];
+        sum_ep += q[l];
+    }
+}
+
+DLL_CPU_KERNEL(error_sums)
+
+} // end of namespace bn_detail
+
+/*!
+ * \brief Compute the mean and the (biased) variance of each feature map over
+ * the batch, in a single pass over the input
+ *
+ * \param in The input (batch x k x plane)
+ * \param mean The output mean (k)
+ * \param var The output variance (k)
+ */
+template <typename T>
+void batch_norm_4d_stats(const T* in, T* mean, T* var, size_t batch, size_t k, size_t plane) {
+    parallel_range(k, batch * k * plane, [=](size_t first, size_t last) {
+        for (size_t kk = first; kk < last; ++kk) {
+            // Shift the values of the planes to keep the sums small
+            const T shift = in[kk * plane];
+
+            T n  = 0;
+            T m  = 0;
+            T m2 = 0;
+
+            for (size_t b = 0; b < batch; ++b) {
+                T sum;
+                T sq;
+                bn_detail::shifted_sums(in + (b * k + kk) * plane, plane, shift, sum, sq);
+
+                // Merge the statistics of the plane into the running statistics
+                const T n_p  = T(plane);
+                const T m_p  = shift + sum / n_p;
+                const T m2_p = sq - sum * sum / n_p;
+
+                const T delta = m_p - m;
+                const T n_new = n + n_p;
+
+                m += delta * n_p / n_new;
+                m2 += m2_p + delta * delta * n * n_p / n_new;
+                n = n_new;
+            }
+
+            mean[kk] = m;
+            var[kk]  = std::max(m2 / n, T(0));
+        }
+    });
+}
+
+/*!
+ * \brief Normalize the input, scale and shift it
+ *
+ * \param out The output (batch x k x plane)
+ * \param pre The normalized input (batch x k x plane), or nullptr
+ * \param in The input (batch x k x plane)
+ * \param mean The mean of each feature map
+ * \param inv_var The inverse of the standard deviation of each feature map
+ * \param gamma The scale of each feature map
+ * \param beta The shift of each feature map
+ */
+template <typename T>
+void batch_norm_4d_forward(T* out, T* pre, const T* in, const T* mean, const T* inv_var, const T* gamma, const T* beta, size_t batch, size_t k, size_t plane) {
+    parallel_range(batch * k, batch * k * plane, [=](size_t first, size_t last) {
+        for (size_t bk = first; bk < last; ++bk) {
+            const size_t kk     = bk % k;
+            const size_t offset = bk * plane;
+
+            const T m  = mean[kk];
+            const T iv = inv_var[kk];
+            const T g  = gamma[kk];
+            const T bb = beta[kk];
+
+            const T* x = in + offset;
+            T* y       = out + offset;
+
+            if (pre) {
+                T* p = pre + offset;
+
+                for (size_t i = 0; i < plane; ++i) {
+                    p[i] = (x[i] - m) * iv;
+                    y[i] = g * p[i] + bb;
+                }
+            } else {
+                for (size_t i = 0; i < plane; ++i) {
+                    y[i] = g * ((x[i] - m) * iv) + bb;
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Backpropagate the errors through the normalization
+ *
+ * \param out The errors of the input (batch x k x plane)
+ * \param errors The errors of the output (batch x k x plane)
+ * \param pre The normalized input (batch x k x plane)
+ * \param gamma The scale of each feature map
+ * \param inv_var The inverse of the standard deviation of each feature map
+ */
+template <typename T>
+void batch_norm_4d_backward(T* out, const T* errors, const T* pre, const T* gamma, const T* inv_var, size_t batch, size_t k, size_t plane) {
+    const T s = T(batch * plane);
+
+    parallel_range(k, 2 * batch * k * plane, [=](size_t first, size_t last) {
+        for (size_t kk = first; kk < last; ++kk) {
+            const T g = gamma[kk];
+
+            // Sums of dxhat and dxhat * xhat over the feature map
+
+            T sum_e  = 0;
+            T sum_ep = 0;
+
+            for (size_t b = 0; b < batch; ++b) {
+                const size_t offset = (b * k + kk) * plane;
+
+                bn_detail::error_sums(errors + offset, pre + offset, plane, sum_e, sum_ep);
+            }
+
+            const T dxhat_l      = g * sum_e;
+            const T dxhat_xhat_l = g * sum_ep;
+            const T factor       = inv_var[kk] / s;
+
+            for (size_t b = 0; b < batch; ++b) {
+                const size_t offset = (b * k + kk) * plane;
+
+                const T* e = errors + offset;
+                const T* p = pre + offset;
+                T* y       = out + offset;
+
+                for (size_t i = 0; i < plane; ++i) {
+                    y[i] = factor * (s * g * e[i] - dxhat_l - p[i] * dxhat_xhat_l);
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the gradients of gamma and beta
+ *
+ * \param g_gamma The gradients of gamma (k)
+ * \param g_beta The gradients of beta (k)
+ * \param errors The errors of the output (batch x k x plane)
+ * \param pre The normalized input (batch x k x plane)
+ */
+template <typename T>
+void batch_norm_4d_gradients(T* g_gamma, T* g_beta, const T* errors, const T* pre, size_t batch, size_t k, size_t plane) {
+    parallel_range(k, batch * k * plane, [=](size_t first, size_t last) {
+        for (size_t kk = first; kk < last; ++kk) {
+            T sum_e  = 0;
+            T sum_ep = 0;
+
+            for (size_t b = 0; b < batch; ++b) {
+                const size_t offset = (b * k + kk) * plane;
+
+                bn_detail::error_sums(errors + offset, pre + offset, plane, sum_e, sum_ep);
+            }
+
+            g_gamma[kk] = sum_ep;
+            g_beta[kk]  = sum_e;
+        }
+    });
+}
+
+/*!
+ * \brief Compute the sums of (x - shift) and of (x - shift)^2 of each feature
+ * map over the batch
+ *
+ * \param in The input (batch x k x plane)
+ * \param shift The shift of each feature map (k)
+ * \param sums The output sums (2 * k), the sums of (x - shift) first
+ */
+template <typename T>
+void batch_norm_4d_sums(const T* in, const T* shift, T* sums, size_t batch, size_t k, size_t plane) {
+    parallel_range(k, batch * k * plane, [=](size_t first, size_t last) {
+        for (size_t kk = first; kk < last; ++kk) {
+            T s = 0;
+            T q = 0;
+
+            for (size_t b = 0; b < batch; ++b) {
+                T sum;
+                T sq;
+                bn_detail::shifted_sums(in + (b * k + kk) * plane, plane, shift[kk], sum, sq);
+
+                s += sum;
+                q += sq;
+            }
+
+            sums[kk]     = s;
+            sums[k + kk] = q;
+        }
+    });
+}
+
+/*!
+ * \brief Compute the mean and the (biased) variance of each feature over the
+ * batch, in a single pass over the input (Welford)
+ *
+ * \param in The input (batch x k)
+ * \param mean The output mean (k)
+ * \param var The output variance (k)
+ */
+template <typename T>
+void batch_norm_2d_stats(const T* in, T* mean, T* var, size_t batch, size_t k) {
+    parallel_range(k, batch * k, [=](size_t first, size_t last) {
+        T* m  = mean + first;
+        T* m2 = var + first;
+
+        const size_t n = last - first;
+
+        std::fill_n(m, n, T(0));
+        std::fill_n(m2, n, T(0));
+
+        for (size_t b = 0; b < batch; ++b) {
+            const T* x    = in + b * k + first;
+            const T inv_n = T(1) / T(b + 1);
+
+            for (size_t i = 0; i < n; ++i) {
+                const T d = x[i] - m[i];
+
+                m[i] += d * inv_n;
+                m2[i] += d * (x[i] - m[i]);
+            }
+        }
+
+        const T inv_batch = T(1) / T(batch);
+
+        for (size_t i = 0; i < n; ++i) {
+            m2[i] *= inv_batch;
+        }
+    });
+}
+
+/*!
+ * \brief Compute the sums of (x - shift) and of (x - shift)^2 of each feature
+ * over the batch
+ *
+ * \param in The input (batch x k)
+ * \param shift The shift of each feature (k)
+ * \param sums The output sums (2 * k), the sums of (x - shift) first
+ */
+template <typename T>
+void batch_norm_2d_sums(const T* in, const T* shift, T* sums, size_t batch, size_t k) {
+    parallel_range(k, batch * k, [=](size_t first, size_t last) {
+        T* s = sums + first;
+        T* q = sums + k + first;
+
+        const size_t n = last - first;
+
+        std::fill_n(s, n, T(0));
+        std::fill_n(q, n, T(0));
+
+        for (size_t b = 0; b < batch; ++b) {
+            const T* x = in + b * k + first;
+            const T* m = shift + first;
+
+            for (size_t i = 0; i < n; ++i) {
+                const T d = x[i] - m[i];
+
+                s[i] += d;
+                q[i] += d * d;
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Normalize the input, scale and shift it
+ *
+ * \param out The output (batch x k)
+ * \param pre The normalized input (batch x k), or nullptr
+ * \param in The input (batch x k)
+ * \param mean The mean of each feature
+ * \param inv_var The inverse of the standard deviation of each feature
+ * \param gamma The scale of each feature
+ * \param beta The shift of each feature
+ */
+template <typename T>
+void batch_norm_2d_forward(T* out, T* pre, const T* in, const T* mean, const T* inv_var, const T* gamma, const T* beta, size_t batch, size_t k) {
+    parallel_range(batch, batch * k, [=](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b) {
+            const T* x = in + b * k;
+            T* y       = out + b * k;
+
+            if (pre) {
+                T* p = pre + b * k;
+
+                for (size_t i = 0; i < k; ++i) {
+                    p[i] = (x[i] - mean[i]) * inv_var[i];
+                    y[i] = gamma[i] * p[i] + beta[i];
+                }
+            } else {
+                for (size_t i = 0; i < k; ++i) {
+                    y[i] = gamma[i] * ((x[i] - mean[i]) * inv_var[i]) + beta[i];
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the gradients of gamma and beta and, if out is not
+ * nullptr, backpropagate the errors through the normalization
+ *
+ * \param out The errors of the input (batch x k), or nullptr
+ * \param g_gamma The gradients of gamma (k)
+ * \param g_beta The gradients of beta (k)
+ * \param errors The errors of the output (batch x k)
+ * \param pre The normalized input (batch x k)
+ * \param gamma The scale of each feature
+ * \param inv_var The inverse of the standard deviation of each feature
+ */
+template <typename T>
+void batch_norm_2d_backward(T* out, T* g_gamma, T* g_beta, const T* errors, const T* pre, const T* gamma, const T* inv_var, size_t batch, size_t k) {
+    parallel_range(k, 2 * batch * k, [=](size_t first, size_t last) {
+        T* dg = g_gamma + first;
+        T* db = g_beta + first;
+
+        const size_t n = last - first;
+
+        std::fill_n(dg, n, T(0));
+        std::fill_n(db, n, T(0));
+
+        for (size_t b = 0; b < batch; ++b) {
+            const T* e = errors + b * k + first;
+            const T* p = pre + b * k + first;
+
+            for (size_t i = 0; i < n; ++i) {
+                db[i] += e[i];
+                dg[i] += e[i] * p[i];
+            }
+        }
+
+        if (!out) {
+            return;
+        }
+
+        const T s = T(batch);
+
+        for (size_t b = 0; b < batch; ++b) {
+            const T* e = errors + b * k + first;
+            const T* p = pre + b * k + first;
+            T* y       = out + b * k + first;
+
+            const T* g  = gamma + first;
+            const T* iv = inv_var + first;
+
+            for (size_t i = 0; i < n; ++i) {
+                y[i] = (iv[i] * g[i] / s) * (s * e[i] - p[i] * dg[i] - db[i]);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Backpropagate the errors through the normalization, from the sums
+ * of the errors over the whole (synchronized) batch
+ *
+ * \param out The errors of the input (batch x k x plane)
+ * \param errors The errors of the output (batch x k x plane)
+ * \param pre The normalized input (batch x k x plane)
+ * \param gamma The scale of each feature map
+ * \param inv_var The inverse of the standard deviation of each feature map
+ * \param sums The sums of the errors and of the errors times the normalized
+ * input of each feature map over the whole batch (2 * k), followed by the
+ * number of values of each feature map
+ */
+template <typename T>
+void batch_norm_sync_backward(T* out, const T* errors, const T* pre, const T* gamma, const T* inv_var, const T* sums, size_t batch, size_t k, size_t plane) {
+    const T s = sums[2 * k];
+
+    parallel_range(batch * k, batch * k * plane, [=](size_t first, size_t last) {
+        for (size_t bk = first; bk < last; ++bk) {
+            const size_t kk     = bk % k;
+            const size_t offset = bk * plane;
+
+            const T factor = inv_var[kk] * gamma[kk] / s;
+            const T sum_e  = sums[kk];
+            const T sum_ep = sums[k + kk];
+
+            const T* e = errors + offset;
+            const T* p = pre + offset;
+            T* y       = out + offset;
+
+            for (size_t i = 0; i < plane; ++i) {
+                y[i] = factor * (s * e[i] - p[i] * sum_ep - sum_e);
+            }
+        }
+    });
+}
+
+} //end of dll namespace
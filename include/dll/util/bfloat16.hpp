@@ -0,0 +1,130 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Conversions between floating point values and bfloat16.
+ *
+ * A bfloat16 value is the upper half of an IEEE 754 single precision value:
+ * it keeps the same exponent range as float, with only 8 bits of mantissa.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <sstream>
+
+namespace dll {
+
+/*!
+ * \brief Convert a single precision value to bfloat16 (round to nearest even)
+ */
+inline uint16_t to_bf16(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    // NaN must remain NaN after truncation
+    if ((bits & 0x7FFFFFFFu) > 0x7F800000u) {
+        return uint16_t((bits >> 16) | 0x0040u);
+    }
+
+    bits += 0x7FFFu + ((bits >> 16) & 1u);
+
+    return uint16_t(bits >> 16);
+}
+
+/*!
+ * \brief Convert a bfloat16 value to single precision
+ */
+inline float from_bf16(uint16_t value) {
+    uint32_t bits = uint32_t(value) << 16;
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/*!
+ * \brief Round a single precision value to the nearest bfloat16 value
+ */
+inline float round_bf16(float value) {
+    return from_bf16(to_bf16(value));
+}
+
+/*!
+ * \brief Round a single precision value to one of the two bfloat16 values
+ * surrounding it, with a probability proportional to its proximity to each.
+ *
+ * On average, the rounding is exact, which lets small updates accumulate
+ * instead of being always rounded away.
+ *
+ * \param value The value to round
+ * \param noise Uniform random bits, only the 16 lower bits are used
+ */
+inline float round_bf16_stochastic(float value, uint32_t noise) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    // Infinities and NaN are left untouched
+    if ((bits & 0x7F800000u) == 0x7F800000u) {
+        return value;
+    }
+
+    bits += noise & 0xFFFFu;
+    bits &= 0xFFFF0000u;
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+/*!
+ * \brief Write the given binary buffer of values of type T into the stream,
+ * converted to bfloat16.
+ *
+ * \param os The output stream
+ * \param buffer The binary buffer, containing only values of type T
+ */
+template <typename T>
+void binary_write_bf16(std::ostream& os, const std::string& buffer) {
+    const size_t n = buffer.size() / sizeof(T);
+
+    for (size_t i = 0; i < n; ++i) {
+        T value;
+        std::memcpy(&value, buffer.data() + i * sizeof(T), sizeof(T));
+
+        uint16_t half = to_bf16(float(value));
+        os.write(reinterpret_cast<const char*>(&half), sizeof(half));
+    }
+}
+
+/*!
+ * \brief Read n bfloat16 values from the stream and returns them as a
+ * binary buffer of values of type T.
+ *
+ * \param is The input stream
+ * \param n The number of values to read
+ */
+template <typename T>
+std::string binary_load_bf16(std::istream& is, size_t n) {
+    std::string buffer(n * sizeof(T), '\0');
+
+    for (size_t i = 0; i < n; ++i) {
+        uint16_t half = 0;
+        is.read(reinterpret_cast<char*>(&half), sizeof(half));
+
+        T value = T(from_bf16(half));
+        std::memcpy(&buffer[i * sizeof(T)], &value, sizeof(T));
+    }
+
+    return buffer;
+}
+
+} //end of dll namespace
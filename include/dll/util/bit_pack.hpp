@@ -0,0 +1,185 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bit-packed batches of binary samples
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A batch of binary samples packed into 64 bits words, one bit per
+ * unit.
+ *
+ * The packed batch is 32 times smaller than the batch of single precision
+ * values. The products with the weights only add the rows (or columns) of
+ * the weights of the active units, without any multiplication.
+ *
+ * \tparam T The type of the values of the unpacked samples
+ */
+template <typename T>
+struct packed_binary_batch {
+    static constexpr size_t word_bits = 64; ///< The number of units per word
+
+    size_t rows    = 0; ///< The number of samples of the batch
+    size_t columns = 0; ///< The number of units of one sample
+    size_t words   = 0; ///< The number of words of one sample
+
+    std::vector<uint64_t> bits; ///< The packed units, sample by sample
+
+    /*!
+     * \brief Pack the given batch of binary samples, a unit being active if
+     * its value is at least 0.5
+     * \param x The batch, its first dimension being the samples
+     */
+    template <typename X>
+    void pack(const X& x) {
+        rows    = etl::dim<0>(x);
+        columns = etl::size(x) / rows;
+        words   = (columns + word_bits - 1) / word_bits;
+
+        bits.assign(rows * words, 0);
+
+        x.ensure_cpu_up_to_date();
+
+        const T* xm = x.memory_start();
+
+        for (size_t r = 0; r < rows; ++r) {
+            const T* x_r = xm + r * columns;
+            uint64_t* b_r = bits.data() + r * words;
+
+            for (size_t c = 0; c < columns; ++c) {
+                if (x_r[c] >= T(0.5)) {
+                    b_r[c / word_bits] |= uint64_t(1) << (c % word_bits);
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the number of active units of the batch
+     */
+    size_t active() const {
+        size_t n = 0;
+
+        for (auto word : bits) {
+            n += __builtin_popcountll(word);
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Compute out = X * w
+     * \param out The output (rows x N)
+     * \param w The weights (columns x N)
+     */
+    template <typename O, typename W>
+    void multiply(O&& out, const W& w) const {
+        const size_t n = etl::dim<1>(w);
+
+        cpp_assert(etl::size(out) == rows * n, "Invalid output of packed product");
+        cpp_assert(etl::dim<0>(w) == columns, "Invalid weights of packed product");
+
+        w.ensure_cpu_up_to_date();
+
+        out = T(0);
+        out.ensure_cpu_up_to_date();
+
+        const T* wm = w.memory_start();
+        T* o        = out.memory_start();
+
+        for (size_t r = 0; r < rows; ++r) {
+            T* o_r = o + r * n;
+
+            for_each_active(r, [=](size_t c) {
+                const T* w_c = wm + c * n;
+
+                for (size_t j = 0; j < n; ++j) {
+                    o_r[j] += w_c[j];
+                }
+            });
+        }
+
+        out.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute out = X * w^T
+     * \param out The output (rows x N)
+     * \param w The weights (N x columns)
+     */
+    template <typename O, typename W>
+    void multiply_transpose(O&& out, const W& w) const {
+        const size_t n = etl::dim<0>(w);
+
+        cpp_assert(etl::size(out) == rows * n, "Invalid output of packed product");
+        cpp_assert(etl::dim<1>(w) == columns, "Invalid weights of packed product");
+
+        w.ensure_cpu_up_to_date();
+        out.ensure_cpu_up_to_date();
+
+        const T* wm = w.memory_start();
+        T* o        = out.memory_start();
+
+        // The active units of a sample are decoded once for all the outputs
+        std::vector<size_t> active_r;
+        active_r.reserve(columns);
+
+        for (size_t r = 0; r < rows; ++r) {
+            active_r.clear();
+
+            for_each_active(r, [&active_r](size_t c) { active_r.push_back(c); });
+
+            for (size_t i = 0; i < n; ++i) {
+                const T* w_i = wm + i * columns;
+
+                T acc = 0;
+
+                for (auto c : active_r) {
+                    acc += w_i[c];
+                }
+
+                o[r * n + i] = acc;
+            }
+        }
+
+        out.invalidate_gpu();
+    }
+
+private:
+    /*!
+     * \brief Call functor(c) for each active unit c of the sample r, in
+     * increasing order
+     */
+    template <typename Functor>
+    void for_each_active(size_t r, Functor&& functor) const {
+        const uint64_t* b_r = bits.data() + r * words;
+
+        for (size_t k = 0; k < words; ++k) {
+            uint64_t word = b_r[k];
+
+            while (word) {
+                functor(k * word_bits + __builtin_ctzll(word));
+
+                word &= word - 1;
+            }
+        }
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,184 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Concurrent execution of the independent branches of the merge
+ * layers (and of the sub layers of the utility layers)
+ *
+ * The kernels of the layers write contiguous outputs and the slice of a
+ * branch in the merged tensor is strided (one block per sample, and per
+ * dimension before the merge dimension), so each branch still computes into
+ * its own tensor. Each branch copies it into its slice (or reads its slice of
+ * the merged errors) inside its own task, without an intermediate tensor.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if independent branches of work are run concurrently
+ * from the current thread
+ */
+inline bool parallel_branches(size_t n) {
+    return n > 1 && can_parallelize() && kernel_threads() > 1;
+}
+
+/*!
+ * \brief Call functor(std::integral_constant<size_t, I>()) for each
+ * branch I, in concurrent tasks of the scheduler if possible
+ */
+template <typename Functor, size_t... I>
+void for_each_branch(Functor& functor, std::index_sequence<I...> /*seq*/) {
+    if (!parallel_branches(sizeof...(I))) {
+        (functor(std::integral_constant<size_t, I>()), ...);
+        return;
+    }
+
+    parallel_for(sizeof...(I), [&functor](size_t b) {
+        ((b == I ? void(functor(std::integral_constant<size_t, I>())) : void()), ...);
+    });
+}
+
+/*!
+ * \brief Call functor(std::integral_constant<size_t, I>()) for each
+ * branch I in [0, N), in concurrent tasks of the scheduler if possible.
+ *
+ * \tparam N The number of branches
+ * \param functor The functor to call for each branch
+ */
+template <size_t N, typename Functor>
+void for_each_branch(Functor&& functor) {
+    for_each_branch(functor, std::make_index_sequence<N>());
+}
+
+/*!
+ * \brief Returns the number of blocks of a tensor merged along the dimension
+ * D of its samples: the merged tensor is a sequence of blocks, each being the
+ * concatenation of one block of each branch.
+ */
+template <size_t D, typename Merged>
+size_t merge_blocks(const Merged& merged) {
+    size_t blocks = 1;
+
+    // The batch dimension and the dimensions before D
+    for (size_t d = 0; d <= D; ++d) {
+        blocks *= etl::dim(merged, d);
+    }
+
+    return blocks;
+}
+
+/*!
+ * \brief Returns the offset of each branch inside the blocks of the merged
+ * tensor
+ *
+ * \param branches The tuple of the branches
+ * \param blocks The number of blocks of the merged tensor
+ * \param size The functor returning the number of elements of the output of a branch
+ */
+template <typename Branches, typename Size>
+auto branch_offsets(Branches& branches, size_t blocks, Size&& size) {
+    std::array<size_t, std::tuple_size<std::decay_t<Branches>>::value> offsets;
+
+    size_t offset = 0;
+
+    cpp::for_each_i(branches, [&](size_t i, auto& branch) {
+        offsets[i] = offset;
+        offset += size(branch) / blocks;
+    });
+
+    return offsets;
+}
+
+/*!
+ * \brief Copy the output of one branch into its slice of the merged tensor.
+ *
+ * Only the memory of the slice is written, so that the branches can be
+ * merged concurrently, the merged tensor being invalidated on the GPU once
+ * all the branches are merged.
+ */
+template <typename Merged, typename Sub>
+void merge_branch(Merged& merged, const Sub& sub, size_t blocks, size_t offset) {
+    sub.ensure_cpu_up_to_date();
+
+    const size_t n      = etl::size(sub) / blocks;
+    const size_t stride = etl::size(merged) / blocks;
+
+    const auto* src = sub.memory_start();
+    auto* dst       = merged.memory_start() + offset;
+
+    for (size_t b = 0; b < blocks; ++b) {
+        std::copy_n(src + b * n, n, dst + b * stride);
+    }
+}
+
+/*!
+ * \brief Copy the slice of one branch of the merged tensor into the tensor
+ * of the branch. The merged tensor must be up to date on the CPU.
+ */
+template <typename Sub, typename Merged>
+void dispatch_branch(Sub& sub, const Merged& merged, size_t blocks, size_t offset) {
+    const size_t n      = etl::size(sub) / blocks;
+    const size_t stride = etl::size(merged) / blocks;
+
+    const auto* src = merged.memory_start() + offset;
+    auto* dst       = sub.memory_start();
+
+    for (size_t b = 0; b < blocks; ++b) {
+        std::copy_n(src + b * stride, n, dst + b * n);
+    }
+
+    sub.invalidate_gpu();
+}
+
+/*!
+ * \brief Forward the input through each branch (each layer of the tuple)
+ * and merge their outputs along the dimension D of the samples.
+ *
+ * When the kernels can be parallelized, the branches are forwarded in
+ * concurrent tasks of the scheduler. Each task copies the output of its
+ * branch into its slice of the merged output while it is still in cache.
+ *
+ * \param layers The tuple of the branches
+ * \param output The merged output
+ * \param forward The functor forwarding the input through one branch
+ */
+template <size_t D, typename Layers, typename Output, typename Forward>
+void forward_branches(const Layers& layers, Output&& output, Forward&& forward) {
+    constexpr size_t N = std::tuple_size<Layers>::value;
+
+    const size_t batch  = etl::dim<0>(output);
+    const size_t blocks = merge_blocks<D>(output);
+
+    const auto offsets = branch_offsets(layers, blocks, [batch](auto& layer) { return layer.output_size() * batch; });
+
+    for_each_branch<N>([&](auto b) {
+        constexpr size_t B = decltype(b)::value;
+
+        auto sub_output = forward(std::get<B>(layers));
+
+        merge_branch(output, sub_output, blocks, offsets[B]);
+    });
+
+    output.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,125 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Budget of threads and cores of a network.
+ *
+ * A network with a budget (threads<N> or a runtime affinity) has its own
+ * scheduler, whose workers are pinned to its CPUs. During training (or any
+ * resource scope of the network), the calling thread is pinned to the same
+ * CPUs and the parallel kernels of DLL run on this scheduler. The thread
+ * pool of ETL cannot be restricted, so ETL runs serially inside the scope
+ * when the budget is smaller than the ETL threads.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <sched.h>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The threads and the cores allowed to a network
+ */
+struct resource_budget {
+    size_t threads = 0;       ///< The number of threads (0 for the number of CPUs, or the thread budget of the process)
+    std::vector<size_t> cpus; ///< The CPUs the threads are pinned to (not pinned if empty)
+
+    /*!
+     * \brief Indicates if the budget differs from the default of the process
+     */
+    bool restricted() const {
+        return !cpus.empty() || (threads && threads != thread_budget());
+    }
+
+    /*!
+     * \brief Returns the number of threads of the budget
+     */
+    size_t effective_threads() const {
+        if (threads) {
+            return threads;
+        } else if (!cpus.empty()) {
+            return cpus.size();
+        }
+
+        return thread_budget();
+    }
+
+    /*!
+     * \brief Returns a new scheduler for this budget (the thread running
+     * the tasks takes one of the threads of the budget)
+     */
+    std::unique_ptr<task_scheduler> make_scheduler() const {
+        return std::make_unique<task_scheduler>(effective_threads() - 1, cpus);
+    }
+};
+
+/*!
+ * \brief Run the current thread within a budget for the lifetime of the
+ * object: the parallel kernels of DLL run on the scheduler of the budget and
+ * the thread is pinned to its CPUs.
+ */
+struct resource_scope {
+    /*!
+     * \brief Enter the given budget, using the given scheduler
+     */
+    resource_scope(const resource_budget& budget, task_scheduler& scheduler)
+            : active(budget.restricted()), previous(task_scheduler::current()), serial(etl::local_context().serial) {
+        CPU_ZERO(&affinity);
+
+        // Without restriction, the thread keeps the defaults of the process
+        if (!active) {
+            return;
+        }
+
+        pinned = !budget.cpus.empty() && !sched_getaffinity(0, sizeof(affinity), &affinity) && pin_thread(budget.cpus);
+
+        task_scheduler::current() = &scheduler;
+
+        // ETL cannot be parallelized within the budget
+        if (budget.effective_threads() < size_t(etl::threads)) {
+            etl::local_context().serial = true;
+        }
+    }
+
+    resource_scope(const resource_scope& rhs) = delete;
+    resource_scope& operator=(const resource_scope& rhs) = delete;
+
+    /*!
+     * \brief Restore the previous scheduler, affinity and ETL state of the
+     * thread
+     */
+    ~resource_scope() {
+        if (!active) {
+            return;
+        }
+
+        etl::local_context().serial = serial;
+        task_scheduler::current()   = previous;
+
+        if (pinned) {
+            sched_setaffinity(0, sizeof(affinity), &affinity);
+        }
+    }
+
+private:
+    bool active;              ///< Indicates if the budget is restricted
+    task_scheduler* previous; ///< The previous scheduler of the thread
+    bool serial;              ///< The previous serial state of ETL
+    bool pinned = false;      ///< Indicates if the thread has been pinned
+    cpu_set_t affinity;       ///< The previous affinity of the thread
+};
+
+} //end of dll namespace
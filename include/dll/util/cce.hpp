@@ -0,0 +1,135 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused errors and metrics of a softmax output trained with the
+ * categorical cross entropy
+ *
+ * The errors of the output, the loss and the classification error of each
+ * sample are computed in a single pass over its row, instead of one pass
+ * for the errors, one for the loss and one for the classification error.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the errors and the metrics of the given output can be
+ * computed with the fused kernel
+ */
+template <typename O, typename E, typename L>
+constexpr bool fused_cce = etl::is_dma<std::decay_t<O>> && etl::is_dma<std::decay_t<E>> && etl::is_dma<std::decay_t<L>>
+                           && etl::dimensions<std::decay_t<O>>() == 2 && etl::dimensions<std::decay_t<E>>() == 2;
+
+/*!
+ * \brief Compute the errors of the first n samples of a softmax output for
+ * the categorical cross entropy (labels - output), the sum of the log
+ * likelihoods of the labels and the number of misclassified samples. The
+ * errors of the remaining samples are cleared.
+ *
+ * \param errors The errors to compute (B x C)
+ * \param output The softmax output (B x C)
+ * \param labels The labels, either one-hot (n x C) or the index of the class of each sample (n)
+ * \param n The number of samples
+ * \param losses If not null, filled with the loss of each of the n samples
+ *
+ * \return a pair containing the number of misclassified samples and the
+ * sum of the log likelihoods
+ */
+template <typename E, typename O, typename L>
+std::pair<double, double> cce_errors_metrics(E& errors, const O& output, const L& labels, size_t n, double* losses = nullptr) {
+    using T = etl::value_t<std::decay_t<O>>;
+
+    const size_t batch   = etl::dim<0>(output);
+    const size_t classes = etl::dim<1>(output);
+
+    output.ensure_cpu_up_to_date();
+    labels.ensure_cpu_up_to_date();
+
+    const T* out = output.memory_start();
+    T* err       = errors.memory_start();
+
+    const auto* lab = labels.memory_start();
+
+    size_t misses  = 0;
+    double log_sum = 0.0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const T* out_i = out + i * classes;
+        T* err_i       = err + i * classes;
+
+        size_t max_out = 0;
+
+        if constexpr (etl::dimensions<std::decay_t<L>>() == 1) {
+            const size_t label = size_t(lab[i]);
+
+            for (size_t j = 0; j < classes; ++j) {
+                err_i[j] = -out_i[j];
+
+                if (out_i[j] > out_i[max_out]) {
+                    max_out = j;
+                }
+            }
+
+            err_i[label] += T(1);
+
+            const double log_p = std::log(out_i[label]);
+
+            if (losses) {
+                losses[i] = -log_p;
+            }
+
+            log_sum += log_p;
+            misses += max_out != label;
+        } else {
+            const auto* lab_i = lab + i * classes;
+
+            size_t max_label = 0;
+
+            double log_p = 0.0;
+
+            for (size_t j = 0; j < classes; ++j) {
+                err_i[j] = lab_i[j] - out_i[j];
+
+                if (lab_i[j] != 0) {
+                    log_p += lab_i[j] * std::log(out_i[j]);
+                }
+
+                if (out_i[j] > out_i[max_out]) {
+                    max_out = j;
+                }
+
+                if (lab_i[j] > lab_i[max_label]) {
+                    max_label = j;
+                }
+            }
+
+            if (losses) {
+                losses[i] = -log_p;
+            }
+
+            log_sum += log_p;
+            misses += max_out != max_label;
+        }
+    }
+
+    std::fill(err + n * classes, err + batch * classes, T(0));
+
+    errors.invalidate_gpu();
+
+    return {double(misses), log_sum};
+}
+
+} //end of dll namespace
@@ -0,0 +1,368 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Training checkpoints written in the background
+ *
+ * A checkpoint is a flat snapshot of the training: the progress (epoch,
+ * batch, schedule, ...) and the scalar state of the trainer are stored as
+ * scalars, the weights and the state of the updater (moments, master
+ * weights, ...) are copied back to back into a single buffer of values.
+ *
+ * The training thread only copies the state into a staging buffer. The file
+ * is written by a background thread, into a temporary file that is synced
+ * and then atomically renamed over the previous checkpoint, so that a
+ * checkpoint is never left half-written.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/model_file.hpp" // For model_checksum
+
+namespace dll {
+
+/*!
+ * \brief The header of a checkpoint file
+ */
+struct checkpoint_header {
+    static constexpr uint32_t current_version = 1; ///< The version of the format
+
+    char magic[4];        ///< The magic number ("DLLC")
+    uint32_t version;     ///< The version of the format
+    uint32_t weight_size; ///< The size of one value, in bytes
+    uint32_t scalars;     ///< The number of scalars
+    uint64_t values;      ///< The number of values
+    uint64_t checksum;    ///< The checksum of the scalars and the values
+};
+
+/*!
+ * \brief The flat state of a training.
+ *
+ * The state is stored and loaded by visiting the same variables in the same
+ * order. Arithmetic variables are stored as scalars, the tensors are copied
+ * into the values.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct checkpoint_state {
+    std::vector<double> scalars; ///< The scalars (progress and scalar state of the trainer)
+    std::vector<T> values;       ///< The values of the weights and of the updater
+
+    bool valid = true; ///< Indicates if all the loaded variables were found in the state
+
+    /*!
+     * \brief Clear the state, keeping its storage
+     */
+    void clear() {
+        scalars.clear();
+        values.clear();
+    }
+
+    /*!
+     * \brief Rewind the state before loading it
+     */
+    void rewind() {
+        scalar_cursor = 0;
+        value_cursor  = 0;
+        valid         = true;
+    }
+
+    /*!
+     * \brief Indicates if the whole state has been loaded
+     */
+    bool consumed() const {
+        return valid && scalar_cursor == scalars.size() && value_cursor == values.size();
+    }
+
+    /*!
+     * \brief Append the given variable to the state
+     */
+    template <typename E>
+    void store(const E& e) {
+        if constexpr (std::is_arithmetic_v<E>) {
+            scalars.push_back(double(e));
+        } else {
+            e.ensure_cpu_up_to_date();
+
+            values.insert(values.end(), e.memory_start(), e.memory_start() + etl::size(e));
+        }
+    }
+
+    /*!
+     * \brief Load the given variable from the current position of the state
+     */
+    template <typename E>
+    void load(E& e) {
+        if constexpr (std::is_arithmetic_v<E>) {
+            if (scalar_cursor < scalars.size()) {
+                e = E(scalars[scalar_cursor++]);
+            } else {
+                valid = false;
+            }
+        } else {
+            const size_t n = etl::size(e);
+
+            if (value_cursor + n <= values.size()) {
+                e.ensure_cpu_up_to_date();
+
+                std::copy(values.begin() + value_cursor, values.begin() + value_cursor + n, e.memory_start());
+
+                e.invalidate_gpu();
+
+                value_cursor += n;
+            } else {
+                valid = false;
+            }
+        }
+    }
+
+private:
+    size_t scalar_cursor = 0; ///< The position of the next scalar to load
+    size_t value_cursor  = 0; ///< The position of the next value to load
+};
+
+namespace checkpoint_detail {
+
+/*!
+ * \brief Write n bytes to the given file descriptor
+ */
+inline bool write_all(int fd, const void* data, size_t n) {
+    auto* bytes = static_cast<const char*>(data);
+
+    while (n) {
+        auto written = ::write(fd, bytes, n);
+
+        if (written <= 0) {
+            return false;
+        }
+
+        bytes += written;
+        n -= written;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Compute the checksum of the given state
+ */
+template <typename T>
+uint64_t checksum(const checkpoint_state<T>& state) {
+    auto a = model_checksum(reinterpret_cast<const char*>(state.scalars.data()), state.scalars.size() * sizeof(double));
+    auto b = model_checksum(reinterpret_cast<const char*>(state.values.data()), state.values.size() * sizeof(T));
+
+    return a ^ (b * 1099511628211UL);
+}
+
+} // end of namespace checkpoint_detail
+
+/*!
+ * \brief Write the given state to a checkpoint file.
+ *
+ * The state is written to a temporary file, synced to disk and then renamed
+ * over the given path.
+ *
+ * \param path The path of the checkpoint
+ * \param state The state to write
+ * \return true if the checkpoint was written, false otherwise
+ */
+template <typename T>
+bool write_checkpoint(const std::string& path, const checkpoint_state<T>& state) {
+    checkpoint_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "DLLC", 4);
+
+    header.version     = checkpoint_header::current_version;
+    header.weight_size = sizeof(T);
+    header.scalars     = state.scalars.size();
+    header.values      = state.values.size();
+    header.checksum    = checkpoint_detail::checksum(state);
+
+    const std::string tmp = path + ".tmp";
+
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        std::cerr << "ERROR: Impossible to open " << tmp << std::endl;
+        return false;
+    }
+
+    bool ok = checkpoint_detail::write_all(fd, &header, sizeof(header))
+              && checkpoint_detail::write_all(fd, state.scalars.data(), state.scalars.size() * sizeof(double))
+              && checkpoint_detail::write_all(fd, state.values.data(), state.values.size() * sizeof(T))
+              && ::fsync(fd) == 0;
+
+    ok = ::close(fd) == 0 && ok;
+
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "ERROR: Impossible to write the checkpoint " << path << std::endl;
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Read a checkpoint file
+ *
+ * \param path The path of the checkpoint
+ * \param state The state to fill
+ * \return true if a valid checkpoint was read, false otherwise
+ */
+template <typename T>
+bool read_checkpoint(const std::string& path, checkpoint_state<T>& state) {
+    std::ifstream is(path, std::ifstream::binary);
+
+    if (!is) {
+        return false;
+    }
+
+    checkpoint_header header;
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (!is || std::memcmp(header.magic, "DLLC", 4) != 0 || header.version != checkpoint_header::current_version || header.weight_size != sizeof(T)) {
+        std::cerr << "ERROR: Invalid checkpoint: " << path << std::endl;
+        return false;
+    }
+
+    state.scalars.resize(header.scalars);
+    state.values.resize(header.values);
+
+    is.read(reinterpret_cast<char*>(state.scalars.data()), state.scalars.size() * sizeof(double));
+    is.read(reinterpret_cast<char*>(state.values.data()), state.values.size() * sizeof(T));
+
+    if (!is || checkpoint_detail::checksum(state) != header.checksum) {
+        std::cerr << "ERROR: Corrupted checkpoint: " << path << std::endl;
+        return false;
+    }
+
+    state.rewind();
+
+    return true;
+}
+
+/*!
+ * \brief Writer of checkpoints on a background thread.
+ *
+ * The training fills the staging state and submits it. The staging state is
+ * then exchanged with the state of the writer thread, so the training only
+ * waits if the previous checkpoint is still being written.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct checkpoint_writer {
+    checkpoint_state<T> staging; ///< The state being filled by the training
+
+    checkpoint_writer() : thread([this] { run(); }) {}
+
+    checkpoint_writer(const checkpoint_writer& rhs) = delete;
+    checkpoint_writer& operator=(const checkpoint_writer& rhs) = delete;
+
+    /*!
+     * \brief Finish the pending checkpoint and stop the writer thread
+     */
+    ~checkpoint_writer() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            done = true;
+        }
+
+        condition.notify_all();
+        thread.join();
+    }
+
+    /*!
+     * \brief Hand the staging state over to the writer thread
+     * \param path The path of the checkpoint
+     */
+    void submit(const std::string& path) {
+        std::unique_lock<std::mutex> l(lock);
+
+        condition.wait(l, [this] { return !pending; });
+
+        std::swap(staging, writing);
+
+        this->path = path;
+        pending    = true;
+
+        l.unlock();
+        condition.notify_all();
+    }
+
+    /*!
+     * \brief Wait for the pending checkpoint to be written
+     * \return true if the last checkpoint was written, false otherwise
+     */
+    bool wait() {
+        std::unique_lock<std::mutex> l(lock);
+
+        condition.wait(l, [this] { return !pending; });
+
+        return status;
+    }
+
+private:
+    /*!
+     * \brief The loop of the writer thread
+     */
+    void run() {
+        std::unique_lock<std::mutex> l(lock);
+
+        while (true) {
+            condition.wait(l, [this] { return pending || done; });
+
+            if (!pending) {
+                return;
+            }
+
+            auto target = path;
+
+            l.unlock();
+            bool written = write_checkpoint(target, writing);
+            l.lock();
+
+            status  = written;
+            pending = false;
+
+            condition.notify_all();
+        }
+    }
+
+    checkpoint_state<T> writing; ///< The state being written
+    std::string path;            ///< The path of the checkpoint being written
+
+    std::mutex lock;                   ///< The lock protecting the hand-over
+    std::condition_variable condition; ///< The condition of the hand-over
+    bool pending = false;              ///< Indicates that a checkpoint is being written
+    bool done    = false;              ///< Indicates that the writer must stop
+    bool status  = true;               ///< The status of the last checkpoint
+
+    std::thread thread; ///< The writer thread (last, started once the other members are initialized)
+};
+
+} //end of dll namespace
@@ -7,6 +7,196 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath> //for std::isfinite
+#include <cstdint>
+#include <cstring>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp" // for parallel_range
+
+namespace dll {
+
+/*!
+ * \brief Indicates if all the values of the given ETL expression are finite
+ * (no NaN and no infinity).
+ *
+ * Contrary to the NaN checks, this is always available, to detect overflows
+ * during training.
+ */
+template <typename E>
+bool is_finite_etl(const E& value) {
+    return value.is_finite();
+}
+
+namespace checks_detail {
+
+/*!
+ * \brief The bits of the exponent of a floating point type, all set for NaN
+ * and infinities
+ */
+template <typename T>
+struct exponent_bits;
+
+/*!
+ * \copydoc exponent_bits
+ */
+template <>
+struct exponent_bits<float> {
+    using type                  = uint32_t;    ///< The integer type of the same size
+    static constexpr type value = 0x7F800000U; ///< The mask of the exponent
+};
+
+/*!
+ * \copydoc exponent_bits
+ */
+template <>
+struct exponent_bits<double> {
+    using type                  = uint64_t;              ///< The integer type of the same size
+    static constexpr type value = 0x7FF0000000000000ULL; ///< The mask of the exponent
+};
+
+/*!
+ * \brief Indicates if all the values of the block are finite.
+ *
+ * The loop has no early exit and no branch, only integer operations on the
+ * bits of the values, and is vectorized by the compiler (also with
+ * -ffast-math, which would fold floating point tests).
+ */
+template <typename T>
+bool block_finite(const T* values, size_t n) {
+    using bits_t       = typename exponent_bits<T>::type;
+    constexpr bits_t e = exponent_bits<T>::value;
+
+    bits_t bad = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        bits_t bits;
+        std::memcpy(&bits, values + i, sizeof(T));
+        bad |= bits_t((bits & e) == e);
+    }
+
+    return !bad;
+}
+
+/*!
+ * \brief Returns the index of the first non-finite value in [first, last), or
+ * last if all of them are finite.
+ *
+ * Only the offending block is scanned element by element.
+ */
+template <typename T>
+size_t first_non_finite(const T* values, size_t first, size_t last) {
+    constexpr size_t block = 1024;
+
+    for (size_t b = first; b < last; b += block) {
+        const size_t end = std::min(last, b + block);
+
+        if (!block_finite(values + b, end - b)) {
+            for (size_t i = b; i < end; ++i) {
+                if (!std::isfinite(values[i])) {
+                    return i;
+                }
+            }
+        }
+    }
+
+    return last;
+}
+
+} //end of namespace checks_detail
+
+/*!
+ * \brief Returns the index of the first non-finite value (NaN or infinity)
+ * of the given memory, or n if all the values are finite.
+ *
+ * Large ranges are split in chunks checked in parallel.
+ *
+ * \param values The values to check
+ * \param n The number of values
+ */
+template <typename T>
+size_t first_non_finite(const T* values, size_t n) {
+    std::atomic<size_t> first_bad{n};
+
+    parallel_range(n, n, [values, &first_bad](size_t first, size_t last) {
+        // A previous chunk already found a value
+        if (first_bad.load(std::memory_order_relaxed) < first) {
+            return;
+        }
+
+        const size_t i = checks_detail::first_non_finite(values, first, last);
+
+        if (i < last) {
+            size_t current = first_bad.load();
+
+            while (i < current && !first_bad.compare_exchange_weak(current, i)) {}
+        }
+    });
+
+    return first_bad.load();
+}
+
+/*!
+ * \brief Returns the index of the first non-finite value (NaN or infinity)
+ * of the given ETL expression, or its size if all the values are finite.
+ */
+template <typename E>
+size_t first_non_finite_etl(const E& value) {
+    if constexpr (etl::is_dma<std::decay_t<E>>) {
+        value.ensure_cpu_up_to_date();
+
+        return first_non_finite(value.memory_start(), etl::size(value));
+    } else {
+        const size_t n = etl::size(value);
+
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::isfinite(value[i])) {
+                return i;
+            }
+        }
+
+        return n;
+    }
+}
+
+/*!
+ * \brief The result of a finite check of the network
+ */
+struct finite_report {
+    bool finite     = true; ///< Indicates if all the checked values are finite
+    size_t layer    = 0;    ///< The first offending layer
+    size_t variable = 0;    ///< The first offending variable (or tensor) of the layer
+    size_t index    = 0;    ///< The index of the first non-finite value in the variable
+
+    /*!
+     * \brief Check the given ETL expression, recording it as the offending
+     * one if it is the first non-finite one
+     * \return true if the expression is finite, false otherwise
+     */
+    template <typename E>
+    bool check(const E& value, size_t l, size_t v) {
+        if (!finite) {
+            return false;
+        }
+
+        const size_t i = first_non_finite_etl(value);
+
+        if (i < etl::size(value)) {
+            finite   = false;
+            layer    = l;
+            variable = v;
+            index    = i;
+        }
+
+        return finite;
+    }
+};
+
+} //end of dll namespace
+
 #ifndef NAN_DEBUG
 
 #define nan_check(value) ((void)0)
@@ -17,21 +207,14 @@
 
 #else
 
-#include <cmath> //for std::isfinite
-
 #include "cpp_utils/assert.hpp"
 
 #define nan_check(value) cpp_assert(std::isfinite(((value))), "NaN Verify");
-#define nan_check_etl(value) cpp_assert(((value)).is_finite(), "NaN Verify");
-#define nan_check_deep(list)                           \
-    for (auto& _nan : ((list))) {                      \
-        cpp_assert(std::isfinite(_nan), "NaN Verify"); \
-    }
-#define nan_check_deep_deep(l)                               \
-    for (auto& _nan_a : ((l))) {                             \
-        for (auto& _nan_b : _nan_a) {                        \
-            cpp_assert(std::isfinite(_nan_b), "NaN Verify"); \
-        }                                                    \
+#define nan_check_etl(value) cpp_assert(dll::first_non_finite_etl(((value))) == etl::size(((value))), "NaN Verify");
+#define nan_check_deep(list) nan_check_etl(list)
+#define nan_check_deep_deep(l)   \
+    for (auto& _nan_a : ((l))) { \
+        nan_check_etl(_nan_a);   \
     }
 #define nan_check_deep_3(l1, l2, l3) \
     nan_check_deep(l1);              \
@@ -0,0 +1,461 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the volumetric (3D) convolutional layers
+ *
+ * The valid correlations of volumes (NC x NV1 x NV2 x NV3) with filters
+ * (K x NC x NW1 x NW2 x NW3) are computed either directly or as products
+ * with the columns of the input (im2col).
+ *
+ * The direct kernel computes all the filters of an output depth slice
+ * together: each input depth slice of the window is read once for all the
+ * filters, while it is still in cache. It is used when the product would be
+ * too small to amortize the extraction of the columns.
+ *
+ * The columns are extracted by slabs of output depth slices, so that the
+ * workspace (in the arena of the thread) stays small even for large
+ * volumes. The backward pass and the gradients of the filters are computed
+ * with the same columns.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/arena.hpp"
+#include "dll/util/cpu_dispatch.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The geometry of a volumetric convolution
+ */
+struct conv_3d_shape {
+    size_t nc;  ///< The number of input channels
+    size_t nv1; ///< The depth of the input
+    size_t nv2; ///< The height of the input
+    size_t nv3; ///< The width of the input
+    size_t k;   ///< The number of filters
+    size_t nw1; ///< The depth of the filters
+    size_t nw2; ///< The height of the filters
+    size_t nw3; ///< The width of the filters
+
+    /*!
+     * \brief Returns the depth of the output
+     */
+    size_t nh1() const {
+        return nv1 - nw1 + 1;
+    }
+
+    /*!
+     * \brief Returns the height of the output
+     */
+    size_t nh2() const {
+        return nv2 - nw2 + 1;
+    }
+
+    /*!
+     * \brief Returns the width of the output
+     */
+    size_t nh3() const {
+        return nv3 - nw3 + 1;
+    }
+
+    /*!
+     * \brief Returns the number of values of a window (the rows of the
+     * columns)
+     */
+    size_t window() const {
+        return nc * nw1 * nw2 * nw3;
+    }
+
+    /*!
+     * \brief Returns the size of one input
+     */
+    size_t input_size() const {
+        return nc * nv1 * nv2 * nv3;
+    }
+
+    /*!
+     * \brief Returns the size of one output
+     */
+    size_t output_size() const {
+        return k * nh1() * nh2() * nh3();
+    }
+};
+
+constexpr size_t conv_3d_slab_values = 1UL << 18; ///< The largest number of values of the columns of a slab
+
+/*!
+ * \brief Returns the number of output depth slices of a slab of columns
+ */
+inline size_t conv_3d_slab(const conv_3d_shape& s) {
+    return std::clamp<size_t>(conv_3d_slab_values / (s.window() * s.nh2() * s.nh3()), 1, s.nh1());
+}
+
+/*!
+ * \brief Indicates if the forward pass is computed with the direct kernel
+ * rather than with the products with the columns
+ */
+inline bool conv_3d_direct(const conv_3d_shape& s) {
+    return s.k < 8 || s.window() < 32;
+}
+
+namespace conv_3d_detail {
+
+/*!
+ * \brief Accumulate the correlation of one input depth slice (nv2 x nv3)
+ * with one depth slice of a filter (nw2 x nw3) into one output depth slice
+ * (nh2 x nh3)
+ */
+template <typename T>
+DLL_CPU_BODY void plane_body(T* out, const T* in, const T* w, size_t nv3, size_t nh2, size_t nh3, size_t nw2, size_t nw3) {
+    for (size_t m2 = 0; m2 < nw2; ++m2) {
+        for (size_t m3 = 0; m3 < nw3; ++m3) {
+            const T wv = w[m2 * nw3 + m3];
+
+            for (size_t p2 = 0; p2 < nh2; ++p2) {
+                const T* src = in + (p2 + m2) * nv3 + m3;
+                T* dst       = out + p2 * nh3;
+
+                for (size_t p3 = 0; p3 < nh3; ++p3) {
+                    dst[p3] += wv * src[p3];
+                }
+            }
+        }
+    }
+}
+
+DLL_CPU_KERNEL(plane)
+
+/*!
+ * \brief Extract the columns of the output depth slices [d0, d0 + sd) of
+ * one sample: the column (c, m1, m2, m3) holds in(c, p1 + m1, p2 + m2, p3 +
+ * m3) for each position (p1, p2, p3) of the slab.
+ *
+ * \param cols The columns (window x (sd x nh2 x nh3))
+ * \param in The input of the sample (nc x nv1 x nv2 x nv3)
+ */
+template <typename T>
+void im2col(T* cols, const T* in, conv_3d_shape s, size_t d0, size_t sd) {
+    const size_t nh2   = s.nh2();
+    const size_t nh3   = s.nh3();
+    const size_t width = sd * nh2 * nh3;
+
+    parallel_range(s.nc, s.window() * width, [=](size_t first, size_t last) {
+        for (size_t c = first; c < last; ++c) {
+            for (size_t m1 = 0; m1 < s.nw1; ++m1) {
+                for (size_t m2 = 0; m2 < s.nw2; ++m2) {
+                    for (size_t m3 = 0; m3 < s.nw3; ++m3) {
+                        T* col = cols + (((c * s.nw1 + m1) * s.nw2 + m2) * s.nw3 + m3) * width;
+
+                        for (size_t p1 = 0; p1 < sd; ++p1) {
+                            const T* src = in + ((c * s.nv1 + d0 + p1 + m1) * s.nv2 + m2) * s.nv3 + m3;
+
+                            for (size_t p2 = 0; p2 < nh2; ++p2) {
+                                std::copy_n(src + p2 * s.nv3, nh3, col + (p1 * nh2 + p2) * nh3);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Accumulate the columns of the output depth slices [d0, d0 + sd)
+ * of one sample into its input, the reverse of im2col
+ *
+ * \param in The input of the sample (nc x nv1 x nv2 x nv3)
+ * \param cols The columns (window x (sd x nh2 x nh3))
+ */
+template <typename T>
+void col2im(T* in, const T* cols, conv_3d_shape s, size_t d0, size_t sd) {
+    const size_t nh2   = s.nh2();
+    const size_t nh3   = s.nh3();
+    const size_t width = sd * nh2 * nh3;
+
+    // Each chunk owns a range of the channels, no conflicts between chunks
+    parallel_range(s.nc, s.window() * width, [=](size_t first, size_t last) {
+        for (size_t c = first; c < last; ++c) {
+            for (size_t m1 = 0; m1 < s.nw1; ++m1) {
+                for (size_t m2 = 0; m2 < s.nw2; ++m2) {
+                    for (size_t m3 = 0; m3 < s.nw3; ++m3) {
+                        const T* col = cols + (((c * s.nw1 + m1) * s.nw2 + m2) * s.nw3 + m3) * width;
+
+                        for (size_t p1 = 0; p1 < sd; ++p1) {
+                            T* dst = in + ((c * s.nv1 + d0 + p1 + m1) * s.nv2 + m2) * s.nv3 + m3;
+
+                            for (size_t p2 = 0; p2 < nh2; ++p2) {
+                                const T* src = col + (p1 * nh2 + p2) * nh3;
+                                T* dst_row   = dst + p2 * s.nv3;
+
+                                for (size_t p3 = 0; p3 < nh3; ++p3) {
+                                    dst_row[p3] += src[p3];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Copy the depth slices [d0, d0 + sd) of all the channels of one
+ * sample (k x nh1 x plane) into a contiguous slab (k x sd x plane), or
+ * back if Back is set
+ */
+template <bool Back, typename T>
+void copy_slab(T* slab, T* full, size_t k, size_t nh1, size_t plane, size_t d0, size_t sd) {
+    for (size_t kk = 0; kk < k; ++kk) {
+        T* f = full + (kk * nh1 + d0) * plane;
+        T* l = slab + kk * sd * plane;
+
+        if (Back) {
+            std::copy_n(l, sd * plane, f);
+        } else {
+            std::copy_n(f, sd * plane, l);
+        }
+    }
+}
+
+} //end of namespace conv_3d_detail
+
+/*!
+ * \brief Compute the forward correlation of a batch of volumes, with the
+ * direct kernel: the output depth slices of all the samples are split
+ * between the threads.
+ *
+ * \param out The output (batch x k x nh1 x nh2 x nh3)
+ * \param in The input (batch x nc x nv1 x nv2 x nv3)
+ * \param w The filters (k x nc x nw1 x nw2 x nw3)
+ */
+template <typename T>
+void conv_3d_direct_forward(T* out, const T* in, const T* w, size_t batch, conv_3d_shape s) {
+    const size_t nh1   = s.nh1();
+    const size_t plane = s.nh2() * s.nh3();
+
+    parallel_range(batch * nh1, batch * s.output_size() * s.window(), [=](size_t first, size_t last) {
+        for (size_t t = first; t < last; ++t) {
+            const size_t i  = t / nh1;
+            const size_t p1 = t % nh1;
+
+            for (size_t kk = 0; kk < s.k; ++kk) {
+                std::fill_n(out + ((i * s.k + kk) * nh1 + p1) * plane, plane, T(0));
+            }
+
+            // Each input depth slice is used by all the filters while in cache
+            for (size_t c = 0; c < s.nc; ++c) {
+                for (size_t m1 = 0; m1 < s.nw1; ++m1) {
+                    const T* in_plane = in + ((i * s.nc + c) * s.nv1 + p1 + m1) * s.nv2 * s.nv3;
+
+                    for (size_t kk = 0; kk < s.k; ++kk) {
+                        T* out_plane = out + ((i * s.k + kk) * nh1 + p1) * plane;
+                        const T* w_p = w + ((kk * s.nc + c) * s.nw1 + m1) * s.nw2 * s.nw3;
+
+                        conv_3d_detail::plane(out_plane, in_plane, w_p, s.nv3, s.nh2(), s.nh3(), s.nw2, s.nw3);
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the forward correlation of a batch of volumes
+ *
+ * \param out The output (batch x k x nh1 x nh2 x nh3)
+ * \param in The input (batch x nc x nv1 x nv2 x nv3)
+ * \param w The filters (k x nc x nw1 x nw2 x nw3)
+ */
+template <typename O, typename I, typename W>
+void conv_3d_forward(O& out, const I& in, const W& w, conv_3d_shape s) {
+    using T = etl::value_t<std::decay_t<O>>;
+
+    const size_t batch = etl::dim<0>(in);
+
+    in.ensure_cpu_up_to_date();
+    w.ensure_cpu_up_to_date();
+
+    if (conv_3d_direct(s)) {
+        conv_3d_direct_forward(out.memory_start(), in.memory_start(), w.memory_start(), batch, s);
+
+        out.invalidate_gpu();
+
+        return;
+    }
+
+    const size_t nh1    = s.nh1();
+    const size_t plane  = s.nh2() * s.nh3();
+    const size_t window = s.window();
+    const size_t sd     = conv_3d_slab(s);
+
+    auto w_m = etl::reshape(w, s.k, window);
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> cols(scope.allocate<T>(window * sd * plane), window, sd * plane);
+    etl::custom_dyn_matrix<T, 2> slab(scope.allocate<T>(s.k * sd * plane), s.k, sd * plane);
+
+    T* out_m = out.memory_start();
+
+    for (size_t i = 0; i < batch; ++i) {
+        T* out_i = out_m + i * s.output_size();
+
+        for (size_t d0 = 0; d0 < nh1; d0 += sd) {
+            const size_t n = std::min(sd, nh1 - d0);
+
+            etl::custom_dyn_matrix<T, 2> cols_n(cols.memory_start(), window, n * plane);
+            etl::custom_dyn_matrix<T, 2> slab_n(slab.memory_start(), s.k, n * plane);
+
+            conv_3d_detail::im2col(cols_n.memory_start(), in.memory_start() + i * s.input_size(), s, d0, n);
+
+            cols_n.invalidate_gpu();
+
+            if (n == nh1) {
+                // A single slab is directly the output of the sample
+                etl::custom_dyn_matrix<T, 2> out_s(out_i, s.k, nh1 * plane);
+
+                out_s = w_m * cols_n;
+                out_s.ensure_cpu_up_to_date();
+            } else {
+                slab_n = w_m * cols_n;
+                slab_n.ensure_cpu_up_to_date();
+
+                conv_3d_detail::copy_slab<true>(slab_n.memory_start(), out_i, s.k, nh1, plane, d0, n);
+            }
+        }
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the errors of the input of a volumetric convolution (the
+ * full convolution of the errors with the filters)
+ *
+ * \param out The errors of the input (batch x nc x nv1 x nv2 x nv3)
+ * \param errors The errors of the output (batch x k x nh1 x nh2 x nh3)
+ * \param w The filters (k x nc x nw1 x nw2 x nw3)
+ */
+template <typename O, typename E, typename W>
+void conv_3d_backward(O& out, const E& errors, const W& w, conv_3d_shape s) {
+    using T = etl::value_t<std::decay_t<O>>;
+
+    const size_t batch  = etl::dim<0>(errors);
+    const size_t nh1    = s.nh1();
+    const size_t plane  = s.nh2() * s.nh3();
+    const size_t window = s.window();
+    const size_t sd     = conv_3d_slab(s);
+
+    auto w_m = etl::reshape(w, s.k, window);
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> cols(scope.allocate<T>(window * sd * plane), window, sd * plane);
+    etl::custom_dyn_matrix<T, 2> slab(scope.allocate<T>(s.k * sd * plane), s.k, sd * plane);
+
+    errors.ensure_cpu_up_to_date();
+    out.ensure_cpu_up_to_date();
+
+    T* out_m = out.memory_start();
+
+    std::fill_n(out_m, batch * s.input_size(), T(0));
+
+    for (size_t i = 0; i < batch; ++i) {
+        T* errors_i = const_cast<T*>(errors.memory_start()) + i * s.output_size();
+
+        for (size_t d0 = 0; d0 < nh1; d0 += sd) {
+            const size_t n = std::min(sd, nh1 - d0);
+
+            etl::custom_dyn_matrix<T, 2> cols_n(cols.memory_start(), window, n * plane);
+            etl::custom_dyn_matrix<T, 2> slab_n(slab.memory_start(), s.k, n * plane);
+
+            if (n == nh1) {
+                cols_n = etl::transpose(w_m) * etl::custom_dyn_matrix<T, 2>(errors_i, s.k, nh1 * plane);
+            } else {
+                conv_3d_detail::copy_slab<false>(slab_n.memory_start(), errors_i, s.k, nh1, plane, d0, n);
+
+                slab_n.invalidate_gpu();
+
+                cols_n = etl::transpose(w_m) * slab_n;
+            }
+
+            cols_n.ensure_cpu_up_to_date();
+
+            conv_3d_detail::col2im(out_m + i * s.input_size(), cols_n.memory_start(), s, d0, n);
+        }
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a volumetric convolution
+ * (the correlation of the input with the errors), summed over the batch
+ *
+ * \param grad The gradients of the filters (k x nc x nw1 x nw2 x nw3)
+ * \param in The input (batch x nc x nv1 x nv2 x nv3)
+ * \param errors The errors of the output (batch x k x nh1 x nh2 x nh3)
+ */
+template <typename G, typename I, typename E>
+void conv_3d_gradients(G& grad, const I& in, const E& errors, conv_3d_shape s) {
+    using T = etl::value_t<std::decay_t<G>>;
+
+    const size_t batch  = etl::dim<0>(errors);
+    const size_t nh1    = s.nh1();
+    const size_t plane  = s.nh2() * s.nh3();
+    const size_t window = s.window();
+    const size_t sd     = conv_3d_slab(s);
+
+    auto grad_m = etl::reshape(grad, s.k, window);
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> cols(scope.allocate<T>(window * sd * plane), window, sd * plane);
+    etl::custom_dyn_matrix<T, 2> slab(scope.allocate<T>(s.k * sd * plane), s.k, sd * plane);
+
+    grad = T(0);
+
+    in.ensure_cpu_up_to_date();
+    errors.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < batch; ++i) {
+        T* errors_i = const_cast<T*>(errors.memory_start()) + i * s.output_size();
+
+        for (size_t d0 = 0; d0 < nh1; d0 += sd) {
+            const size_t n = std::min(sd, nh1 - d0);
+
+            etl::custom_dyn_matrix<T, 2> cols_n(cols.memory_start(), window, n * plane);
+            etl::custom_dyn_matrix<T, 2> slab_n(slab.memory_start(), s.k, n * plane);
+
+            conv_3d_detail::im2col(cols_n.memory_start(), in.memory_start() + i * s.input_size(), s, d0, n);
+
+            cols_n.invalidate_gpu();
+
+            if (n == nh1) {
+                grad_m += etl::custom_dyn_matrix<T, 2>(errors_i, s.k, nh1 * plane) * etl::transpose(cols_n);
+            } else {
+                conv_3d_detail::copy_slab<false>(slab_n.memory_start(), errors_i, s.k, nh1, plane, d0, n);
+
+                slab_n.invalidate_gpu();
+
+                grad_m += slab_n * etl::transpose(cols_n);
+            }
+        }
+    }
+}
+
+} //end of dll namespace
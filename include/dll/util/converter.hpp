@@ -5,13 +5,29 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+/*!
+ * \file
+ * \brief Conversion of the samples given by the user into the inputs of the
+ * layers.
+ *
+ * A collection of samples is converted in a single pass into one contiguous
+ * batch and a std::vector of the weight type is viewed as a 1D input
+ * without any copy.
+ */
+
 #pragma once
 
 #include "cpp_utils/tmp.hpp"
+#include "cpp_utils/assert.hpp"
 
+#include <array>
 #include <list>
 #include <vector>
 #include <deque>
+#include <algorithm>
+#include <utility>
+
+#include "etl/etl.hpp"
 
 namespace dll {
 
@@ -466,4 +482,148 @@ struct converter_many <Container<From>, Container<To>> {
     }
 };
 
+/*!
+ * \brief View a sample as an input of type *To*, without any copy when
+ * possible, or convert it (with converter_one) otherwise.
+ */
+template<typename From, typename To, typename Enable = void>
+struct converter_view {
+    /*!
+     * \brief Convert from the given container into the specific type
+     * \param l The layer for which to convert
+     * \param from The container to convert from
+     * \return the converted result
+     */
+    template<typename L>
+    static decltype(auto) convert(const L& l, const From& from){
+        return converter_one<From, To>::convert(l, from);
+    }
+};
+
+// View a vector<T> as a dyn_vector<T>
+
+/*!
+ * \copydoc converter_view
+ */
+template<typename T, typename A>
+struct converter_view<std::vector<T, A>, etl::dyn_matrix<T, 1>> {
+    /*!
+     * \brief View the given container as the specific type
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return a view on the memory of the container
+     */
+    template<typename L>
+    static etl::custom_dyn_matrix<T, 1> convert(const L&, const std::vector<T, A>& from){
+        // The view is only read by the layer
+        return etl::custom_dyn_matrix<T, 1>(const_cast<T*>(from.data()), from.size());
+    }
+};
+
+// View a vector<T> as a fast_dyn_vector<T, N>
+
+/*!
+ * \copydoc converter_view
+ */
+template<typename T, typename A, size_t N>
+struct converter_view<std::vector<T, A>, etl::fast_dyn_matrix<T, N>> {
+    /*!
+     * \brief View the given container as the specific type
+     * \param l The layer for which to convert
+     * \param from The container to view
+     * \return a view on the memory of the container
+     */
+    template<typename L>
+    static etl::custom_dyn_matrix<T, 1> convert(const L&, const std::vector<T, A>& from){
+        cpp_assert(from.size() == N, "Invalid size of the input");
+
+        // The view is only read by the layer
+        return etl::custom_dyn_matrix<T, 1>(const_cast<T*>(from.data()), N);
+    }
+};
+
+/*!
+ * \brief Returns the given sample as an input of the given layer, a view on
+ * the sample if possible.
+ *
+ * \param l The layer for which to convert
+ * \param from The sample to convert
+ */
+template<typename L, typename From>
+decltype(auto) convert_input(const L& l, const From& from){
+    return converter_view<From, typename L::input_one_t>::convert(l, from);
+}
+
+namespace converter_detail {
+
+/*!
+ * \brief Create a batch of n samples of the given dimensions
+ */
+template<typename T, size_t D, size_t... I>
+etl::dyn_matrix<T, D + 1> make_batch(size_t n, const std::array<size_t, D>& dims, std::index_sequence<I...> /*seq*/){
+    return etl::dyn_matrix<T, D + 1>(n, dims[I]...);
+}
+
+} //end of namespace converter_detail
+
+/*!
+ * \brief Convert a range of samples (STL containers or ETL containers) into
+ * one contiguous batch of inputs of the given layer.
+ *
+ * The batch is allocated once and each sample is copied (and converted to
+ * the weight type of the layer) directly into its row.
+ *
+ * \param l The layer for which to convert
+ * \param first The beginning of the range of samples
+ * \param last The end of the range of samples
+ *
+ * \return the batch of inputs (n x the dimensions of one input)
+ */
+template<typename L, typename Iterator>
+auto convert_batch(const L& l, Iterator first, Iterator last){
+    debug_convert("converter::batch");
+
+    using input_t = typename L::input_one_t;
+    using T       = etl::value_t<input_t>;
+
+    constexpr size_t D = etl::decay_traits<input_t>::dimensions();
+
+    std::array<size_t, D> dims;
+
+    if constexpr (etl::is_fast<input_t>) {
+        for (size_t d = 0; d < D; ++d) {
+            dims[d] = etl::decay_traits<input_t>::dim(d);
+        }
+    } else {
+        input_t shape;
+        l.prepare_input(shape);
+
+        for (size_t d = 0; d < D; ++d) {
+            dims[d] = etl::dim(shape, d);
+        }
+    }
+
+    auto batch = converter_detail::make_batch<T>(std::distance(first, last), dims, std::make_index_sequence<D>());
+
+    const size_t size = etl::size(batch) / std::max(size_t(1), etl::dim<0>(batch));
+
+    T* out = batch.memory_start();
+
+    for (; first != last; ++first, out += size) {
+        auto& sample = *first;
+
+        cpp_assert(size_t(sample.size()) == size, "Invalid size of the sample");
+
+        if constexpr (etl::is_etl_expr<std::decay_t<decltype(sample)>>) {
+            sample.ensure_cpu_up_to_date();
+        }
+
+        std::transform(sample.begin(), sample.end(), out, [](auto value) { return static_cast<T>(value); });
+    }
+
+    batch.invalidate_gpu();
+
+    return batch;
+}
+
 } //end of dll namespace
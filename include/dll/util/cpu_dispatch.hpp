@@ -0,0 +1,192 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Runtime selection of the instruction set of the raw kernels
+ *
+ * When DLL_CPU_DISPATCH is defined (x86 with GCC or Clang), the kernels
+ * declared with DLL_CPU_KERNEL are compiled three times: for the baseline of
+ * the build, for AVX2 (with FMA) and for AVX-512. The best version supported
+ * by the processor is selected at runtime, with cpuid, so that a binary
+ * built for the baseline is still vectorized with the wide instructions on
+ * the recent processors.
+ *
+ * The instruction set can be lowered with the DLL_CPU_ISA environment
+ * variable (generic, avx2 or avx512) or with set_cpu_isa(), but never
+ * raised above the instruction set of the processor.
+ *
+ * On the other architectures (and without DLL_CPU_DISPATCH), the kernels are
+ * only compiled for the baseline of the build. ARM64 always has NEON, which
+ * is the baseline of its builds.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#if defined(DLL_CPU_DISPATCH) && (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define DLL_CPU_DISPATCH_X86
+#endif
+
+namespace dll {
+
+/*!
+ * \brief The instruction sets of the raw kernels
+ */
+enum class cpu_isa {
+    GENERIC, ///< The baseline of the build
+    AVX2,    ///< AVX2 and FMA
+    AVX512   ///< AVX-512 (foundation), AVX2 and FMA
+};
+
+/*!
+ * \brief Returns a string representation of an instruction set
+ */
+inline const char* to_string(cpu_isa isa) {
+    switch (isa) {
+        case cpu_isa::GENERIC:
+            return "generic";
+        case cpu_isa::AVX2:
+            return "avx2";
+        case cpu_isa::AVX512:
+            return "avx512";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * \brief Returns the best instruction set of the processor that has
+ * kernels in this build
+ */
+inline cpu_isa detect_cpu_isa() {
+#ifdef DLL_CPU_DISPATCH_X86
+    __builtin_cpu_init();
+
+    const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    if (avx2 && __builtin_cpu_supports("avx512f")) {
+        return cpu_isa::AVX512;
+    } else if (avx2) {
+        return cpu_isa::AVX2;
+    }
+#endif
+
+    return cpu_isa::GENERIC;
+}
+
+namespace cpu_detail {
+
+/*!
+ * \brief Returns the instruction set of the processor, lowered to the
+ * DLL_CPU_ISA environment variable, if set
+ */
+inline cpu_isa initial_isa() {
+    cpu_isa isa = detect_cpu_isa();
+
+    if (const char* forced = std::getenv("DLL_CPU_ISA")) {
+        if (!std::strcmp(forced, "generic")) {
+            isa = cpu_isa::GENERIC;
+        } else if (!std::strcmp(forced, "avx2") && isa > cpu_isa::AVX2) {
+            isa = cpu_isa::AVX2;
+        }
+    }
+
+    return isa;
+}
+
+/*!
+ * \brief Returns the selected instruction set
+ */
+inline std::atomic<cpu_isa>& selected_isa() {
+    static std::atomic<cpu_isa> isa{initial_isa()};
+    return isa;
+}
+
+} //end of namespace cpu_detail
+
+/*!
+ * \brief Returns the instruction set used by the raw kernels
+ */
+inline cpu_isa active_cpu_isa() {
+    return cpu_detail::selected_isa().load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Select the instruction set of the raw kernels, lowered to the
+ * instruction set of the processor
+ *
+ * \return The selected instruction set
+ */
+inline cpu_isa set_cpu_isa(cpu_isa isa) {
+    const cpu_isa supported = detect_cpu_isa();
+    const cpu_isa selected  = isa > supported ? supported : isa;
+
+    cpu_detail::selected_isa().store(selected, std::memory_order_relaxed);
+
+    return selected;
+}
+
+} //end of dll namespace
+
+#ifdef DLL_CPU_DISPATCH_X86
+
+/*!
+ * \brief The body of a kernel, inlined in each version of the kernel
+ */
+#define DLL_CPU_BODY __attribute__((always_inline)) inline
+
+/*!
+ * \brief Define the kernel name from its body name##_body: one version per
+ * instruction set and a function calling the version of the active
+ * instruction set
+ */
+#define DLL_CPU_KERNEL(name)                                                                   \
+    template <typename... Args>                                                                \
+    __attribute__((target("avx512f,avx2,fma"))) decltype(auto) name##_avx512(Args&&... args) { \
+        return name##_body(std::forward<Args>(args)...);                                       \
+    }                                                                                          \
+                                                                                               \
+    template <typename... Args>                                                                \
+    __attribute__((target("avx2,fma"))) decltype(auto) name##_avx2(Args&&... args) {           \
+        return name##_body(std::forward<Args>(args)...);                                       \
+    }                                                                                          \
+                                                                                               \
+    template <typename... Args>                                                                \
+    decltype(auto) name(Args&&... args) {                                                      \
+        switch (::dll::active_cpu_isa()) {                                                     \
+            case ::dll::cpu_isa::AVX512:                                                       \
+                return name##_avx512(std::forward<Args>(args)...);                             \
+            case ::dll::cpu_isa::AVX2:                                                         \
+                return name##_avx2(std::forward<Args>(args)...);                               \
+            default:                                                                           \
+                return name##_body(std::forward<Args>(args)...);                               \
+        }                                                                                      \
+    }
+
+#else
+
+/*!
+ * \brief The body of a kernel
+ */
+#define DLL_CPU_BODY inline
+
+/*!
+ * \brief Define the kernel name from its body name##_body, for the
+ * baseline of the build only
+ */
+#define DLL_CPU_KERNEL(name)                             \
+    template <typename... Args>                          \
+    decltype(auto) name(Args&&... args) {                \
+        return name##_body(std::forward<Args>(args)...); \
+    }
+
+#endif
@@ -0,0 +1,229 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Direct (GEMM + col2im) kernels of the deconvolutional layers
+ *
+ * The full convolution of the forward pass is computed as one product of
+ * the filters with each sample (every input value times every filter value,
+ * i.e. the columns of the output), followed by the accumulation of the
+ * columns into the output (col2im). The zeros of the padding of the full
+ * convolution are never multiplied.
+ *
+ * The valid convolutions of the backward pass and of the gradients are
+ * computed as products with the columns of the errors (im2col).
+ *
+ * The columns are a workspace in the arena of the thread, reused by all the
+ * layers and all the batches.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/arena.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the convolutions of a deconvolutional layer are
+ * computed with the direct kernels. With CUDNN, the convolutions are left to
+ * ETL.
+ */
+template <typename O, typename I>
+constexpr bool direct_deconv = !etl::cudnn_enabled && etl::is_dma<std::decay_t<O>> && etl::is_dma<std::decay_t<I>>
+                               && etl::dimensions<std::decay_t<O>>() == 4 && etl::dimensions<std::decay_t<I>>() == 4;
+
+/*!
+ * \brief Accumulate the columns of one sample into its output, the column
+ * (m1, m2) of the input value (p1, p2) going to (p1 + nw1 - 1 - m1, p2 +
+ * nw2 - 1 - m2) (the filters are flipped).
+ *
+ * \param out The output of the sample (k x nh1 x nh2)
+ * \param cols The columns of the sample ((k x nw1 x nw2) x (nv1 x nv2))
+ */
+template <typename T>
+void deconv_col2im(T* out, const T* cols, size_t k, size_t nv1, size_t nv2, size_t nw1, size_t nw2) {
+    const size_t nh1 = nv1 + nw1 - 1;
+    const size_t nh2 = nv2 + nw2 - 1;
+
+    parallel_range(k, k * nw1 * nw2 * nv1 * nv2, [=](size_t first, size_t last) {
+        std::fill(out + first * nh1 * nh2, out + last * nh1 * nh2, T(0));
+
+        for (size_t kk = first; kk < last; ++kk) {
+            T* out_k = out + kk * nh1 * nh2;
+
+            for (size_t m1 = 0; m1 < nw1; ++m1) {
+                for (size_t m2 = 0; m2 < nw2; ++m2) {
+                    const T* col = cols + ((kk * nw1 + m1) * nw2 + m2) * nv1 * nv2;
+                    T* base      = out_k + (nw1 - 1 - m1) * nh2 + (nw2 - 1 - m2);
+
+                    for (size_t p1 = 0; p1 < nv1; ++p1) {
+                        const T* src = col + p1 * nv2;
+                        T* dst       = base + p1 * nh2;
+
+                        for (size_t p2 = 0; p2 < nv2; ++p2) {
+                            dst[p2] += src[p2];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Extract the columns of the valid correlation of one sample of the
+ * errors: the column (kk, m1, m2) holds errors(kk, p1 + m1, p2 + m2) for each
+ * position (p1, p2) of the input.
+ *
+ * \param cols The columns ((k x nw1 x nw2) x (nv1 x nv2))
+ * \param errors The errors of the sample (k x nh1 x nh2)
+ */
+template <typename T>
+void deconv_im2col(T* cols, const T* errors, size_t k, size_t nv1, size_t nv2, size_t nw1, size_t nw2) {
+    const size_t nh1 = nv1 + nw1 - 1;
+    const size_t nh2 = nv2 + nw2 - 1;
+
+    parallel_range(k, k * nw1 * nw2 * nv1 * nv2, [=](size_t first, size_t last) {
+        for (size_t kk = first; kk < last; ++kk) {
+            const T* errors_k = errors + kk * nh1 * nh2;
+
+            for (size_t m1 = 0; m1 < nw1; ++m1) {
+                for (size_t m2 = 0; m2 < nw2; ++m2) {
+                    T* col        = cols + ((kk * nw1 + m1) * nw2 + m2) * nv1 * nv2;
+                    const T* base = errors_k + m1 * nh2 + m2;
+
+                    for (size_t p1 = 0; p1 < nv1; ++p1) {
+                        std::copy_n(base + p1 * nh2, nv2, col + p1 * nv2);
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the forward pass of a deconvolutional layer, the same as
+ * etl::conv_4d_full_flipped(in, w)
+ *
+ * \param out The output (B x K x NH1 x NH2)
+ * \param in The input (B x NC x NV1 x NV2)
+ * \param w The filters (NC x K x NW1 x NW2)
+ */
+template <typename O, typename I, typename W>
+void deconv_forward(O& out, const I& in, const W& w) {
+    using T = etl::value_t<std::decay_t<O>>;
+
+    const size_t batch = etl::dim<0>(in);
+    const size_t nc    = etl::dim<1>(in);
+    const size_t nv1   = etl::dim<2>(in);
+    const size_t nv2   = etl::dim<3>(in);
+    const size_t k     = etl::dim<1>(w);
+    const size_t nw1   = etl::dim<2>(w);
+    const size_t nw2   = etl::dim<3>(w);
+
+    auto w_m = etl::reshape(w, nc, k * nw1 * nw2);
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> cols(scope.allocate<T>(k * nw1 * nw2 * nv1 * nv2), k * nw1 * nw2, nv1 * nv2);
+
+    out.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < batch; ++i) {
+        cols = etl::transpose(w_m) * etl::reshape(in(i), nc, nv1 * nv2);
+
+        cols.ensure_cpu_up_to_date();
+
+        deconv_col2im(out(i).memory_start(), cols.memory_start(), k, nv1, nv2, nw1, nw2);
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the backward pass of a deconvolutional layer, the same as
+ * etl::conv_4d_valid_flipped(errors, w)
+ *
+ * \param out The errors of the input (B x NC x NV1 x NV2)
+ * \param errors The errors of the output (B x K x NH1 x NH2)
+ * \param w The filters (NC x K x NW1 x NW2)
+ */
+template <typename O, typename E, typename W>
+void deconv_backward(O& out, const E& errors, const W& w) {
+    using T = etl::value_t<std::decay_t<O>>;
+
+    const size_t batch = etl::dim<0>(out);
+    const size_t nc    = etl::dim<1>(out);
+    const size_t nv1   = etl::dim<2>(out);
+    const size_t nv2   = etl::dim<3>(out);
+    const size_t k     = etl::dim<1>(w);
+    const size_t nw1   = etl::dim<2>(w);
+    const size_t nw2   = etl::dim<3>(w);
+
+    auto w_m = etl::reshape(w, nc, k * nw1 * nw2);
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> cols(scope.allocate<T>(k * nw1 * nw2 * nv1 * nv2), k * nw1 * nw2, nv1 * nv2);
+
+    errors.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < batch; ++i) {
+        deconv_im2col(cols.memory_start(), errors(i).memory_start(), k, nv1, nv2, nw1, nw2);
+
+        cols.invalidate_gpu();
+
+        etl::reshape(out(i), nc, nv1 * nv2) = w_m * cols;
+    }
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a deconvolutional layer,
+ * the same as etl::conv_4d_valid_filter_flipped(errors, in)
+ *
+ * \param grad The gradients of the filters (NC x K x NW1 x NW2)
+ * \param errors The errors of the output (B x K x NH1 x NH2)
+ * \param in The input (B x NC x NV1 x NV2)
+ */
+template <typename G, typename E, typename I>
+void deconv_gradients(G& grad, const E& errors, const I& in) {
+    using T = etl::value_t<std::decay_t<G>>;
+
+    const size_t batch = etl::dim<0>(in);
+    const size_t nc    = etl::dim<1>(in);
+    const size_t nv1   = etl::dim<2>(in);
+    const size_t nv2   = etl::dim<3>(in);
+    const size_t k     = etl::dim<1>(grad);
+    const size_t nw1   = etl::dim<2>(grad);
+    const size_t nw2   = etl::dim<3>(grad);
+
+    auto grad_m = etl::reshape(grad, nc, k * nw1 * nw2);
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> cols(scope.allocate<T>(k * nw1 * nw2 * nv1 * nv2), k * nw1 * nw2, nv1 * nv2);
+
+    grad = T(0);
+
+    errors.ensure_cpu_up_to_date();
+
+    for (size_t i = 0; i < batch; ++i) {
+        deconv_im2col(cols.memory_start(), errors(i).memory_start(), k, nv1, nv2, nw1, nw2);
+
+        cols.invalidate_gpu();
+
+        grad_m += etl::reshape(in(i), nc, nv1 * nv2) * etl::transpose(cols);
+    }
+}
+
+} //end of dll namespace
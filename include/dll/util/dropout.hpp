@@ -0,0 +1,64 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Inverted dropout with masks regenerated from a counter-based
+ * generator
+ *
+ * The mask of a value only depends on (seed, step, index), so the backward
+ * pass regenerates the mask of the forward pass instead of storing it and
+ * the values can be split between threads without sharing any engine.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Apply an inverted dropout mask to n values
+ *
+ * Each value of in is dropped with a probability p, the kept values are
+ * scaled by 1 / (1 - p). out and in can be the same memory.
+ *
+ * \param out The output values
+ * \param in The input values
+ * \param n The number of values
+ * \param p The dropout probability
+ * \param seed The seed of the layer
+ * \param step The index of the batch (identifies the mask)
+ */
+template <typename T>
+void counter_dropout(T* out, const T* in, size_t n, float p, uint64_t seed, uint64_t step) {
+    // A value is kept if its 32 random bits are above the threshold
+    const uint32_t threshold = uint32_t(std::min(double(p), 1.0) * 4294967295.0);
+    const T scale            = p < 1.0f ? T(1.0 / (1.0 - p)) : T(0);
+
+    const size_t blocks = (n + 3) / 4;
+
+    parallel_range(blocks, n, [=](size_t first, size_t last) {
+        for (size_t block = first; block < last; ++block) {
+            uint32_t ctr[4] = {uint32_t(block), uint32_t(uint64_t(block) >> 32), uint32_t(step), uint32_t(step >> 32)};
+
+            philox_4x32(ctr, seed);
+
+            for (size_t l = 0; l < 4 && 4 * block + l < n; ++l) {
+                const size_t i = 4 * block + l;
+
+                out[i] = ctr[l] >= threshold ? in[i] * scale : T(0);
+            }
+        }
+    });
+}
+
+} //end of dll namespace
@@ -0,0 +1,115 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Fused epilogue of the backward pass of the dense and convolutional
+ * layers
+ *
+ * The errors of a layer are multiplied by the derivative of its activation
+ * function before they are back-propagated (adapt_errors), and the gradients
+ * of its biases are the sums of the same errors. Both are computed in a
+ * single pass over the errors, instead of a pass for the derivative and
+ * another one to reduce the biases in compute_gradients.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <tuple>
+
+#include "etl/etl.hpp"
+
+#include "dll/function.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Indicates if the errors of a layer with the given activation
+ * function are adapted in the same pass as the reduction of its biases
+ */
+template <function F, bool NoBias>
+static constexpr bool fused_bias_errors = !NoBias && F != function::IDENTITY && F != function::SOFTMAX;
+
+/*!
+ * \brief Multiply the errors by the derivative of the activation function
+ * (from the output) and sum them into the gradients of the biases.
+ *
+ * \param errors The errors (n x k x s), adapted in place
+ * \param output The output of the layer (n x k x s)
+ * \param bias_grad The gradients of the biases (k)
+ * \param n The number of samples
+ * \param k The number of biases
+ * \param s The number of values sharing a bias (1 for dense layers)
+ */
+template <function F, typename T, typename G>
+void adapt_errors_bias(T* errors, const T* output, G* bias_grad, size_t n, size_t k, size_t s) {
+    // Each chunk owns a range of the biases, no reduction between chunks
+    parallel_range(k, n * k * s, [=](size_t first, size_t last) {
+        std::fill(bias_grad + first, bias_grad + last, G(0));
+
+        for (size_t i = 0; i < n; ++i) {
+            if (s == 1) {
+                T* e       = errors + i * k;
+                const T* o = output + i * k;
+
+                for (size_t c = first; c < last; ++c) {
+                    e[c] *= f_derivative_scalar<F>(o[c]);
+                    bias_grad[c] += e[c];
+                }
+            } else {
+                for (size_t c = first; c < last; ++c) {
+                    T* e       = errors + (i * k + c) * s;
+                    const T* o = output + (i * k + c) * s;
+
+                    T sum = 0;
+
+                    for (size_t x = 0; x < s; ++x) {
+                        e[x] *= f_derivative_scalar<F>(o[x]);
+                        sum += e[x];
+                    }
+
+                    bias_grad[c] += sum;
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Adapt the errors of the context of a layer to the derivative of its
+ * activation function and compute the gradients of its biases (by default the
+ * second trainable parameter) in the same pass.
+ *
+ * The context remembers that the gradients of the biases are computed, for
+ * compute_gradients.
+ *
+ * \tparam B The index of the biases in the trainable parameters
+ * \param context The training context of the layer
+ */
+template <function F, size_t B = 1, typename C>
+void adapt_errors_bias(C& context) {
+    auto& errors = context.errors;
+    auto& grad   = std::get<B>(context.up.context)->grad;
+
+    context.output.ensure_cpu_up_to_date();
+    errors.ensure_cpu_up_to_date();
+    grad.ensure_cpu_up_to_date();
+
+    const size_t n = etl::dim<0>(errors);
+    const size_t k = etl::size(grad);
+
+    adapt_errors_bias<F>(errors.memory_start(), context.output.memory_start(), grad.memory_start(), n, k, etl::size(errors) / (n * k));
+
+    errors.invalidate_gpu();
+    grad.invalidate_gpu();
+
+    context.bias_reduced = true;
+}
+
+} //end of dll namespace
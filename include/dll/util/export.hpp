@@ -12,12 +12,18 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <string>
+#include <type_traits>
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 #include "format.hpp"
 
+#include "dll/generators/mmap_dataset.hpp"
+
 namespace dll {
 
 /*!
@@ -39,4 +45,131 @@ void export_features_dll(const Features& features, const std::string& file) {
     os << '\n';
 }
 
+/*!
+ * \brief Export the given features to the given file with using the binary
+ * format (raw single-precision values)
+ * \param features The features to be exported
+ * \param file The file into which to export the features
+ */
+template <typename Features>
+void export_features_binary(const Features& features, const std::string& file) {
+    std::vector<float> values(features.begin(), features.end());
+
+    std::ofstream os(file, std::ofstream::binary);
+    os.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+}
+
+/*!
+ * \brief Export the given features to the given file with using the
+ * memory-mapped dataset format (a dataset of one sample)
+ * \param features The features to be exported
+ * \param file The file into which to export the features
+ */
+template <typename Features>
+void export_features_mmap(const Features& features, const std::string& file) {
+    mmap_dataset_writer writer;
+
+    if (writer.open(file, 1, {size_t(etl::size(features))}, 0)) {
+        writer.write(features);
+        writer.close();
+    }
+}
+
+/*!
+ * \brief Writer of the features of many samples into a single file.
+ *
+ * The features are written a batch of samples at a time, each batch being
+ * encoded in memory and then written at once.
+ */
+struct feature_exporter {
+    /*!
+     * \brief Open the given file for writing
+     * \param path The path of the file to write
+     * \param f The format of the file
+     * \param samples The number of samples that will be written
+     * \param dims The dimensions of the features of one sample
+     * \param n_classes The number of classes of the labels (MMAP format)
+     * \return true if the file was opened, false otherwise
+     */
+    bool open(const std::string& path, format f, size_t samples, const std::vector<size_t>& dims, size_t n_classes = 0) {
+        this->f = f;
+
+        sample_size = 1;
+
+        for (auto d : dims) {
+            sample_size *= d;
+        }
+
+        if (f == format::MMAP) {
+            return writer.open(path, samples, dims, n_classes);
+        }
+
+        os.open(path, f == format::BINARY ? std::ofstream::binary : std::ofstream::out);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Append the features of n samples
+     * \param values The features of the samples (n x sample size)
+     * \param labels The label of each sample (only used by the MMAP format)
+     * \param n The number of samples
+     */
+    template <typename T>
+    void write(const T* values, const uint32_t* labels, size_t n) {
+        if (f == format::MMAP) {
+            writer.write_records(values, labels, n);
+        } else if (f == format::BINARY) {
+            if constexpr (std::is_same_v<T, float>) {
+                os.write(reinterpret_cast<const char*>(values), n * sample_size * sizeof(float));
+            } else {
+                std::vector<float> converted(values, values + n * sample_size);
+                os.write(reinterpret_cast<const char*>(converted.data()), converted.size() * sizeof(float));
+            }
+        } else {
+            text.clear();
+
+            char buffer[32];
+
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = 0; j < sample_size; ++j) {
+                    int length = std::snprintf(buffer, sizeof(buffer), j ? ";%g" : "%g", double(values[i * sample_size + j]));
+                    text.append(buffer, length);
+                }
+
+                text.push_back('\n');
+            }
+
+            os.write(text.data(), text.size());
+        }
+    }
+
+    /*!
+     * \brief Close the file
+     * \return true if all the features were written, false otherwise
+     */
+    bool close() {
+        if (f == format::MMAP) {
+            return writer.close();
+        }
+
+        os.close();
+
+        return bool(os);
+    }
+
+private:
+    format f           = format::DLL; ///< The format of the file
+    size_t sample_size = 0;           ///< The number of features of one sample
+
+    mmap_dataset_writer writer; ///< The writer of the MMAP format
+    std::ofstream os;           ///< The output stream of the DLL and BINARY formats
+    std::string text;           ///< The encoded batch (DLL format)
+};
+
 } //end of dll namespace
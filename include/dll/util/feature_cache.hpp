@@ -0,0 +1,279 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief A sharded LRU cache of the output features of a network, keyed by
+ * the bytes of the input samples.
+ */
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <utility>
+#include <unordered_map>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/timers.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A cache of the output features of a network.
+ *
+ * The entries are keyed by a hash of the bytes of the input and of the
+ * version of the model, the input bytes being compared on a hash match.
+ * The entries are split between independent shards, each with its own
+ * lock and its own least-recently-used list, so that concurrent lookups
+ * rarely contend. Each shard evicts its least recently used entries when
+ * its part of the memory limit is exceeded.
+ *
+ * The hits and the misses are counted in the "feature_cache:hit" and
+ * "feature_cache:miss" timers.
+ *
+ * \tparam T The type of the features
+ */
+template <typename T>
+struct feature_cache {
+    static constexpr size_t max_dimensions = 4; ///< The maximum number of dimensions of the features
+
+    /*!
+     * \brief One cached output
+     */
+    struct entry {
+        uint64_t hash;                            ///< The hash of the key
+        uint64_t version;                         ///< The version of the model
+        std::vector<uint8_t> key;                 ///< The bytes of the input
+        std::vector<T> values;                    ///< The features
+        std::array<size_t, max_dimensions> dims;  ///< The dimensions of the features
+
+        /*!
+         * \brief Returns the memory used by the entry
+         */
+        size_t bytes() const {
+            return sizeof(entry) + key.size() + values.size() * sizeof(T);
+        }
+    };
+
+    /*!
+     * \brief An independent part of the cache
+     */
+    struct alignas(64) shard {
+        std::mutex lock;                                                             ///< The lock of the shard
+        std::list<entry> lru;                                                        ///< The entries, the most recently used first
+        std::unordered_multimap<uint64_t, typename std::list<entry>::iterator> index; ///< The entries by hash
+        size_t bytes = 0;                                                            ///< The memory used by the entries
+    };
+
+    size_t max_bytes;                           ///< The memory limit of the cache
+    std::vector<std::unique_ptr<shard>> shards; ///< The shards of the cache
+
+    std::atomic<size_t> hits{0};   ///< The number of hits
+    std::atomic<size_t> misses{0}; ///< The number of misses
+
+    /*!
+     * \brief Create a cache
+     * \param max_bytes The memory limit of the cache
+     * \param n_shards The number of shards
+     */
+    explicit feature_cache(size_t max_bytes, size_t n_shards = 16) : max_bytes(max_bytes) {
+        for (size_t s = 0; s < std::max(n_shards, size_t(1)); ++s) {
+            shards.push_back(std::make_unique<shard>());
+        }
+    }
+
+    /*!
+     * \brief Compute the hash of the given key (FNV-1a)
+     */
+    static uint64_t hash_of(const void* key, size_t n, uint64_t version) {
+        uint64_t h = 14695981039346656037ULL ^ (version * 1099511628211ULL);
+
+        const auto* bytes = static_cast<const uint8_t*>(key);
+
+        for (size_t i = 0; i < n; ++i) {
+            h ^= bytes[i];
+            h *= 1099511628211ULL;
+        }
+
+        return h;
+    }
+
+    /*!
+     * \brief Returns the cached features of the given input, if any
+     *
+     * \param key The bytes of the input
+     * \param n The number of bytes of the input
+     * \param version The version of the model
+     *
+     * \tparam R The type of the features
+     */
+    template <typename R>
+    std::optional<R> get(const void* key, size_t n, uint64_t version) {
+        const uint64_t h = hash_of(key, n, version);
+
+        auto& s = *shards[h % shards.size()];
+
+        std::lock_guard<std::mutex> l(s.lock);
+
+        auto range = s.index.equal_range(h);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            auto& e = *it->second;
+
+            if (e.version == version && e.key.size() == n && std::memcmp(e.key.data(), key, n) == 0) {
+                // Move the entry to the front of the list
+                s.lru.splice(s.lru.begin(), s.lru, it->second);
+
+                ++hits;
+                increment_timer("feature_cache:hit", 0);
+
+                return make_features<R>(e, std::make_index_sequence<etl::decay_traits<R>::dimensions()>());
+            }
+        }
+
+        ++misses;
+        increment_timer("feature_cache:miss", 0);
+
+        return std::nullopt;
+    }
+
+    /*!
+     * \brief Cache the features of the given input
+     *
+     * \param key The bytes of the input
+     * \param n The number of bytes of the input
+     * \param version The version of the model
+     * \param features The features of the input
+     */
+    template <typename R>
+    void put(const void* key, size_t n, uint64_t version, const R& features) {
+        static_assert(etl::decay_traits<R>::dimensions() <= max_dimensions, "Too many dimensions for the feature cache");
+
+        const uint64_t h = hash_of(key, n, version);
+
+        entry e;
+        e.hash    = h;
+        e.version = version;
+        e.key.assign(static_cast<const uint8_t*>(key), static_cast<const uint8_t*>(key) + n);
+        e.values.assign(features.memory_start(), features.memory_end());
+
+        for (size_t d = 0; d < etl::decay_traits<R>::dimensions(); ++d) {
+            e.dims[d] = etl::dim(features, d);
+        }
+
+        auto& s = *shards[h % shards.size()];
+
+        const size_t limit = max_bytes / shards.size();
+
+        if (e.bytes() > limit) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> l(s.lock);
+
+        // Another thread may have cached the same input
+        auto range = s.index.equal_range(h);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            auto& other = *it->second;
+
+            if (other.version == version && other.key == e.key) {
+                return;
+            }
+        }
+
+        s.bytes += e.bytes();
+        s.lru.push_front(std::move(e));
+        s.index.emplace(h, s.lru.begin());
+
+        // Evict the least recently used entries
+        while (s.bytes > limit) {
+            auto last = std::prev(s.lru.end());
+
+            auto range = s.index.equal_range(last->hash);
+
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second == last) {
+                    s.index.erase(it);
+                    break;
+                }
+            }
+
+            s.bytes -= last->bytes();
+            s.lru.erase(last);
+        }
+    }
+
+    /*!
+     * \brief Returns the number of cached entries
+     */
+    size_t size() const {
+        size_t n = 0;
+
+        for (auto& s : shards) {
+            std::lock_guard<std::mutex> l(s->lock);
+            n += s->lru.size();
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Returns the memory used by the cached entries
+     */
+    size_t memory() const {
+        size_t n = 0;
+
+        for (auto& s : shards) {
+            std::lock_guard<std::mutex> l(s->lock);
+            n += s->bytes;
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Remove all the entries of the cache
+     */
+    void clear() {
+        for (auto& s : shards) {
+            std::lock_guard<std::mutex> l(s->lock);
+
+            s->lru.clear();
+            s->index.clear();
+            s->bytes = 0;
+        }
+    }
+
+private:
+    /*!
+     * \brief Create the features of the given entry
+     */
+    template <typename R, size_t... I>
+    static R make_features(const entry& e, std::index_sequence<I...>) {
+        if constexpr (etl::all_fast<R>) {
+            R result;
+            std::copy(e.values.begin(), e.values.end(), result.memory_start());
+            return result;
+        } else {
+            R result(e.dims[I]...);
+            std::copy(e.values.begin(), e.values.end(), result.memory_start());
+            return result;
+        }
+    }
+};
+
+} //end of dll namespace
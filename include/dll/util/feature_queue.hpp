@@ -0,0 +1,112 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Bounded queue of batches, between two threads
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace dll {
+
+/*!
+ * \brief A bounded queue of batches of features, filled by the thread
+ * training one layer and drained by the thread training the next layer.
+ *
+ * The producer blocks when the queue is full, so that the faster layer
+ * cannot run too far ahead of the slower one.
+ *
+ * \tparam Batch The type of a batch of features
+ */
+template <typename Batch>
+struct feature_queue {
+    /*!
+     * \brief Create a new queue
+     * \param capacity The maximum number of batches in the queue
+     * \param samples The number of samples of one epoch
+     * \param batches The number of batches of one epoch
+     */
+    feature_queue(size_t capacity, size_t samples, size_t batches) : capacity(capacity), samples(samples), epoch_batches(batches) {}
+
+    /*!
+     * \brief Push a batch in the queue, waiting for some room if necessary
+     */
+    void push(Batch&& batch) {
+        std::unique_lock<std::mutex> l(lock);
+
+        not_full.wait(l, [this] { return queue.size() < capacity; });
+
+        queue.push_back(std::move(batch));
+
+        not_empty.notify_one();
+    }
+
+    /*!
+     * \brief Pop a batch from the queue, waiting for one if necessary.
+     * \return false if the queue is closed and empty, true otherwise
+     */
+    bool pop(Batch& batch) {
+        std::unique_lock<std::mutex> l(lock);
+
+        not_empty.wait(l, [this] { return !queue.empty() || closed; });
+
+        if (queue.empty()) {
+            return false;
+        }
+
+        batch = std::move(queue.front());
+        queue.pop_front();
+
+        not_full.notify_one();
+
+        return true;
+    }
+
+    /*!
+     * \brief Indicates that no more batch will be pushed
+     */
+    void close() {
+        std::unique_lock<std::mutex> l(lock);
+
+        closed = true;
+
+        not_empty.notify_all();
+    }
+
+    /*!
+     * \brief Returns the number of samples of one epoch
+     */
+    size_t size() const {
+        return samples;
+    }
+
+    /*!
+     * \brief Returns the number of batches of one epoch
+     */
+    size_t batches() const {
+        return epoch_batches;
+    }
+
+private:
+    const size_t capacity;      ///< The maximum number of batches in the queue
+    const size_t samples;       ///< The number of samples of one epoch
+    const size_t epoch_batches; ///< The number of batches of one epoch
+
+    std::deque<Batch> queue; ///< The batches
+    bool closed = false;     ///< Indicates if the producer is done
+
+    std::mutex lock;                   ///< The lock protecting the queue
+    std::condition_variable not_empty; ///< Signaled when a batch is pushed
+    std::condition_variable not_full;  ///< Signaled when a batch is popped
+};
+
+} //end of dll namespace
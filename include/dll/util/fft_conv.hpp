@@ -0,0 +1,304 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Convolutions in the frequency domain, for the training of CRBM
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <complex>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Engine computing the convolutions of the training of a CRBM in the
+ * frequency domain.
+ *
+ * All the images are padded to the same power-of-two size, large enough to
+ * hold the full convolutions without any wrap-around. The spectra of the
+ * filters are computed once per batch and the spectra of the inputs can be
+ * kept and reused between the Gibbs steps and the gradients. Since the
+ * transforms are linear, the sum over the channels (or over the filters, or
+ * over the batch) is done in the frequency domain, with a single inverse
+ * transform per output image.
+ */
+template <typename T>
+struct fft_conv_engine {
+    using complex_t = std::complex<T>;      ///< The type of the complex values
+    using spectra_t = std::vector<complex_t>; ///< The spectra of a set of images
+
+    bool enabled = false; ///< Indicates if the FFT convolutions are used
+
+    spectra_t v_fft;  ///< The spectra of the visible units
+    spectra_t vf_fft; ///< The spectra of the expected visible units
+    spectra_t h_fft;  ///< The spectra of the hidden units
+
+    /*!
+     * \brief Indicates if the convolutions of a layer of the given shape are
+     * faster in the frequency domain.
+     *
+     * The cost of the direct convolution of a pair of images is compared to
+     * the cost of the product of their spectra, with the cost of the
+     * transforms shared between the channels and the filters.
+     */
+    static bool preferred(size_t nc, size_t k, size_t nv1, size_t nv2, size_t nw1, size_t nw2) {
+        const double nh     = double(nv1 - nw1 + 1) * double(nv2 - nw2 + 1);
+        const double p      = double(next_power_of_two(nv1)) * double(next_power_of_two(nv2));
+        const double direct = nh * nw1 * nw2;
+        const double fft    = 4.0 * p + 5.0 * p * std::log2(p) * (1.0 / nc + 1.0 / k);
+
+        return fft < direct;
+    }
+
+    /*!
+     * \brief Compute the spectra of the filters for a new batch
+     * \param w The filters (K x NC x NW1 x NW2)
+     * \param nv1 The first dimension of the visible units
+     * \param nv2 The second dimension of the visible units
+     */
+    template <typename W>
+    void prepare(const W& w, size_t nv1, size_t nv2) {
+        n1 = next_power_of_two(nv1);
+        n2 = next_power_of_two(nv2);
+
+        column.resize(n1);
+        acc.resize(n1 * n2);
+
+        forward(w_fft, w);
+    }
+
+    /*!
+     * \brief Compute the spectra of each image of the given 4D input
+     */
+    template <typename X>
+    void forward(spectra_t& out, const X& x) {
+        const size_t n  = etl::dim<0>(x) * etl::dim<1>(x);
+        const size_t r  = etl::dim<2>(x);
+        const size_t c  = etl::dim<3>(x);
+        const size_t nn = n1 * n2;
+
+        x.ensure_cpu_up_to_date();
+
+        out.assign(n * nn, complex_t(0));
+
+        const auto* in = x.memory_start();
+
+        for (size_t i = 0; i < n; ++i) {
+            auto* image = out.data() + i * nn;
+
+            for (size_t a = 0; a < r; ++a) {
+                for (size_t b = 0; b < c; ++b) {
+                    image[a * n2 + b] = in[(i * r + a) * c + b];
+                }
+            }
+
+            fft_2d(image, false);
+        }
+    }
+
+    /*!
+     * \brief Compute the valid convolutions with the flipped filters, from
+     * the spectra of the visible units: h[b,k] = sum_c v[b,c] (*) w[k,c]
+     */
+    template <typename H>
+    void valid(H& h, const spectra_t& v) {
+        const size_t B = etl::dim<0>(h);
+        const size_t K = etl::dim<1>(h);
+        const size_t C = w_fft.size() / (K * n1 * n2);
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t k = 0; k < K; ++k) {
+                std::fill(acc.begin(), acc.end(), complex_t(0));
+
+                for (size_t c = 0; c < C; ++c) {
+                    multiply_add(image(v, b * C + c), image(w_fft, k * C + c), true);
+                }
+
+                inverse(h, b * K + k);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the full convolutions, from the spectra of the hidden
+     * units: v[b,c] = sum_k h[b,k] * w[k,c]
+     */
+    template <typename V>
+    void full(V& v, const spectra_t& h) {
+        const size_t B = etl::dim<0>(v);
+        const size_t C = etl::dim<1>(v);
+        const size_t K = w_fft.size() / (C * n1 * n2);
+
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t c = 0; c < C; ++c) {
+                std::fill(acc.begin(), acc.end(), complex_t(0));
+
+                for (size_t k = 0; k < K; ++k) {
+                    multiply_add(image(h, b * K + k), image(w_fft, k * C + c), false);
+                }
+
+                inverse(v, b * C + c);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the valid convolutions of the visible units with the
+     * flipped hidden units, from their spectra: w[k,c] = sum_b v[b,c] (*) h[b,k]
+     */
+    template <typename W>
+    void valid_filter(W& w, const spectra_t& v, const spectra_t& h) {
+        const size_t K = etl::dim<0>(w);
+        const size_t C = etl::dim<1>(w);
+        const size_t B = v.size() / (C * n1 * n2);
+
+        for (size_t k = 0; k < K; ++k) {
+            for (size_t c = 0; c < C; ++c) {
+                std::fill(acc.begin(), acc.end(), complex_t(0));
+
+                for (size_t b = 0; b < B; ++b) {
+                    multiply_add(image(v, b * C + c), image(h, b * K + k), true);
+                }
+
+                inverse(w, k * C + c);
+            }
+        }
+    }
+
+private:
+    size_t n1 = 0; ///< The padded first dimension
+    size_t n2 = 0; ///< The padded second dimension
+
+    spectra_t w_fft;  ///< The spectra of the filters
+    spectra_t acc;    ///< The accumulated spectra of one output
+    spectra_t column; ///< Temporary column for the 2D transforms
+
+    static size_t next_power_of_two(size_t n) {
+        size_t p = 1;
+
+        while (p < n) {
+            p <<= 1;
+        }
+
+        return p;
+    }
+
+    const complex_t* image(const spectra_t& spectra, size_t i) const {
+        return spectra.data() + i * n1 * n2;
+    }
+
+    /*!
+     * \brief acc += a * b (or a * conj(b) for a correlation)
+     */
+    void multiply_add(const complex_t* a, const complex_t* b, bool conjugate) {
+        const size_t nn = n1 * n2;
+
+        if (conjugate) {
+            for (size_t i = 0; i < nn; ++i) {
+                acc[i] += a[i] * std::conj(b[i]);
+            }
+        } else {
+            for (size_t i = 0; i < nn; ++i) {
+                acc[i] += a[i] * b[i];
+            }
+        }
+    }
+
+    /*!
+     * \brief Transform back the accumulated spectra into the i-th image of
+     * the given 4D output
+     */
+    template <typename O>
+    void inverse(O& out, size_t i) {
+        fft_2d(acc.data(), true);
+
+        out.ensure_cpu_up_to_date();
+
+        const size_t r = etl::dim<2>(out);
+        const size_t c = etl::dim<3>(out);
+
+        const T scale = T(1) / T(n1 * n2);
+
+        auto* o = out.memory_start() + i * r * c;
+
+        for (size_t a = 0; a < r; ++a) {
+            for (size_t b = 0; b < c; ++b) {
+                o[a * c + b] = acc[a * n2 + b].real() * scale;
+            }
+        }
+
+        out.invalidate_gpu();
+    }
+
+    /*!
+     * \brief In-place radix-2 transform of n values
+     */
+    static void fft_1d(complex_t* x, size_t n, bool inv) {
+        for (size_t i = 1, j = 0; i < n; ++i) {
+            size_t bit = n >> 1;
+
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+
+            j ^= bit;
+
+            if (i < j) {
+                std::swap(x[i], x[j]);
+            }
+        }
+
+        for (size_t len = 2; len <= n; len <<= 1) {
+            const T angle = T(2.0 * M_PI / len) * (inv ? T(1) : T(-1));
+            const complex_t wl(std::cos(angle), std::sin(angle));
+
+            for (size_t i = 0; i < n; i += len) {
+                complex_t w(1);
+
+                for (size_t j = 0; j < len / 2; ++j) {
+                    const complex_t u = x[i + j];
+                    const complex_t v = x[i + j + len / 2] * w;
+
+                    x[i + j]           = u + v;
+                    x[i + j + len / 2] = u - v;
+
+                    w *= wl;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief In-place (unscaled) 2D transform of a padded image
+     */
+    void fft_2d(complex_t* x, bool inv) {
+        for (size_t a = 0; a < n1; ++a) {
+            fft_1d(x + a * n2, n2, inv);
+        }
+
+        for (size_t b = 0; b < n2; ++b) {
+            for (size_t a = 0; a < n1; ++a) {
+                column[a] = x[a * n2 + b];
+            }
+
+            fft_1d(column.data(), n1, inv);
+
+            for (size_t a = 0; a < n1; ++a) {
+                x[a * n2 + b] = column[a];
+            }
+        }
+    }
+};
+
+} //end of dll namespace
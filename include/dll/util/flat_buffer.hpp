@@ -0,0 +1,262 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Contiguous buffer holding several tensors back to back
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/arena.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A single contiguous (and aligned) buffer holding the values of
+ * several tensors back to back.
+ *
+ * The tensors are packed into the buffer, or unpacked from it, in the same
+ * order, so that an operation on all the tensors (copy, reduction, ...) can
+ * be done with a single linear operation on the buffer.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct flat_buffer {
+    etl::dyn_vector<T> values; ///< The values of all the tensors
+
+    /*!
+     * \brief Make sure the buffer can hold n values and rewind it
+     */
+    void resize(size_t n) {
+        if (etl::size(values) != n) {
+            values = etl::dyn_vector<T>(n);
+
+            // The flat buffers of large networks are backed by huge pages
+            advise_huge_pages(values);
+        }
+
+        cursor = 0;
+    }
+
+    /*!
+     * \brief Rewind the buffer to its first value
+     */
+    void rewind() {
+        cursor = 0;
+    }
+
+    /*!
+     * \brief Returns the number of values of the buffer
+     */
+    size_t size() const {
+        return etl::size(values);
+    }
+
+    /*!
+     * \brief Returns a pointer to the first value of the buffer
+     */
+    T* data() {
+        return values.memory_start();
+    }
+
+    /*!
+     * \brief Returns the sum of the squares of the values of the buffer
+     */
+    double squared_norm() const {
+        const T* in = values.memory_start();
+
+        double sum = 0.0;
+
+        for (size_t i = 0; i < size(); ++i) {
+            sum += double(in[i]) * double(in[i]);
+        }
+
+        return sum;
+    }
+
+    /*!
+     * \brief Copy the given tensor at the current position of the buffer
+     */
+    template <typename E>
+    void pack(const E& e) {
+        const size_t n = etl::size(e);
+
+        cpp_assert(cursor + n <= size(), "Flat buffer is too small");
+
+        e.ensure_cpu_up_to_date();
+
+        std::copy(e.memory_start(), e.memory_start() + n, values.memory_start() + cursor);
+
+        cursor += n;
+    }
+
+    /*!
+     * \brief Add the given tensor to the values at the current position of
+     * the buffer
+     */
+    template <typename E>
+    void add(const E& e) {
+        const size_t n = etl::size(e);
+
+        cpp_assert(cursor + n <= size(), "Flat buffer is too small");
+
+        e.ensure_cpu_up_to_date();
+
+        const auto* in = e.memory_start();
+        T* out         = values.memory_start() + cursor;
+
+        for (size_t i = 0; i < n; ++i) {
+            out[i] += in[i];
+        }
+
+        cursor += n;
+    }
+
+    /*!
+     * \brief Copy the values at the current position of the buffer into the
+     * given tensor
+     */
+    template <typename E>
+    void unpack(E& e) {
+        const size_t n = etl::size(e);
+
+        cpp_assert(cursor + n <= size(), "Flat buffer is too small");
+
+        e.ensure_cpu_up_to_date();
+
+        std::copy(values.memory_start() + cursor, values.memory_start() + cursor + n, e.memory_start());
+
+        e.invalidate_gpu();
+
+        cursor += n;
+    }
+
+    /*!
+     * \brief Exchange the values at the current position of the buffer with
+     * the values of the given tensor
+     */
+    template <typename E>
+    void swap(E& e) {
+        const size_t n = etl::size(e);
+
+        cpp_assert(cursor + n <= size(), "Flat buffer is too small");
+
+        e.ensure_cpu_up_to_date();
+
+        std::swap_ranges(e.memory_start(), e.memory_start() + n, values.memory_start() + cursor);
+
+        e.invalidate_gpu();
+
+        cursor += n;
+    }
+
+    /*!
+     * \brief Returns a pointer to the values at the current position of the
+     * buffer and skip the size of the given tensor
+     */
+    template <typename E>
+    T* skip(const E& e) {
+        const size_t n = etl::size(e);
+
+        cpp_assert(cursor + n <= size(), "Flat buffer is too small");
+
+        T* position = values.memory_start() + cursor;
+
+        cursor += n;
+
+        return position;
+    }
+
+private:
+    size_t cursor = 0; ///< The current position in the buffer
+};
+
+/*!
+ * \brief A copy of several tensors into a flat buffer, done by a background
+ * thread.
+ *
+ * The tensors are only read by the copy, which can therefore overlap any
+ * computation that does not modify them. The copy must be waited for before
+ * the tensors (or the buffer) are modified.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct background_pack {
+    background_pack() = default;
+
+    background_pack(const background_pack& rhs) = delete;
+    background_pack& operator=(const background_pack& rhs) = delete;
+
+    /*!
+     * \brief Wait for the copy before destroying it
+     */
+    ~background_pack() {
+        wait();
+    }
+
+    /*!
+     * \brief Add the given tensor to the next copy
+     */
+    template <typename E>
+    void add(const E& e) {
+        cpp_assert(!thread.joinable(), "The previous copy must be waited for");
+
+        e.ensure_cpu_up_to_date();
+
+        segments.emplace_back(e.memory_start(), etl::size(e));
+    }
+
+    /*!
+     * \brief Start copying the added tensors, back to back, into the given
+     * buffer
+     */
+    void start(flat_buffer<T>& buffer) {
+        cpp_assert(!thread.joinable(), "The previous copy must be waited for");
+
+        thread = std::thread([this, out = buffer.data()]() mutable {
+            for (auto& [values, n] : segments) {
+                out = std::copy(values, values + n, out);
+            }
+        });
+    }
+
+    /*!
+     * \brief Indicates if a copy is running
+     */
+    bool pending() const {
+        return thread.joinable();
+    }
+
+    /*!
+     * \brief Wait for the end of the current copy, if any
+     */
+    void wait() {
+        if (thread.joinable()) {
+            thread.join();
+        }
+
+        segments.clear();
+    }
+
+private:
+    std::vector<std::pair<const T*, size_t>> segments; ///< The tensors to copy (values and sizes)
+    std::thread thread;                                ///< The thread doing the copy
+};
+
+} //end of dll namespace
@@ -18,7 +18,9 @@ namespace dll {
  * \brief An activation function
  */
 enum class format {
-    DLL ///< Default simple format of the DLL library
+    DLL,    ///< Default simple format of the DLL library (text, one sample per line)
+    BINARY, ///< Raw single-precision values, sample after sample
+    MMAP    ///< Memory-mapped dataset format (see generators/mmap_dataset.hpp)
 };
 
 } //end of dll namespace
@@ -0,0 +1,494 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Kernels of the grouped and depthwise convolutional layers
+ *
+ * The channels and the filters are split into G groups, each filter only
+ * sees the NC / G channels of its group. The depthwise convolution is the
+ * grouped convolution with one channel per group. The convolutions are
+ * computed with 'same' padding (odd filters).
+ *
+ * Each output plane only depends on a few input planes, a product with the
+ * columns would be mostly padding, so the kernels are direct: one plane of
+ * the filter is accumulated at a time, along contiguous rows, with the
+ * borders clipped from the loops rather than tested for each value. The row
+ * loops are dispatched to the wide instruction sets.
+ *
+ * The separable convolution (depthwise, then pointwise) is computed sample
+ * by sample: the output of the depthwise convolution of a sample is only a
+ * workspace in the arena of the thread, consumed from cache by the product
+ * with the pointwise filters, it is never stored for the whole batch.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/arena.hpp"
+#include "dll/util/cpu_dispatch.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The geometry of a grouped convolution with 'same' padding
+ */
+struct grouped_conv_shape {
+    size_t nc;  ///< The number of input channels
+    size_t nv1; ///< The first dimension of the input
+    size_t nv2; ///< The second dimension of the input
+    size_t k;   ///< The number of filters
+    size_t nw1; ///< The first dimension of the filters
+    size_t nw2; ///< The second dimension of the filters
+    size_t g;   ///< The number of groups
+
+    /*!
+     * \brief Returns the number of input channels of a group
+     */
+    size_t cg() const {
+        return nc / g;
+    }
+
+    /*!
+     * \brief Returns the number of filters of a group
+     */
+    size_t kg() const {
+        return k / g;
+    }
+
+    /*!
+     * \brief Returns the size of one input
+     */
+    size_t input_size() const {
+        return nc * nv1 * nv2;
+    }
+
+    /*!
+     * \brief Returns the size of one output
+     */
+    size_t output_size() const {
+        return k * nv1 * nv2;
+    }
+
+    /*!
+     * \brief Returns the number of weights of the filters
+     */
+    size_t weights() const {
+        return k * cg() * nw1 * nw2;
+    }
+};
+
+namespace grouped_conv_detail {
+
+/*!
+ * \brief Returns the range [first, last) of the outputs that read a valid
+ * input (not the padding) with the given offset of the filter
+ */
+inline std::pair<size_t, size_t> valid_range(size_t m, size_t p, size_t n) {
+    const size_t first = m < p ? p - m : 0;
+    const size_t last  = n + p > m ? std::min(n, n + p - m) : 0;
+
+    return {first, std::max(first, last)};
+}
+
+/*!
+ * \brief Accumulate the correlation of one input plane with one plane of a
+ * filter into one output plane (n1 x n2), with 'same' padding
+ */
+template <typename T>
+DLL_CPU_BODY void forward_plane_body(T* out, const T* in, const T* w, size_t n1, size_t n2, size_t nw1, size_t nw2) {
+    const size_t p1 = (nw1 - 1) / 2;
+    const size_t p2 = (nw2 - 1) / 2;
+
+    for (size_t m1 = 0; m1 < nw1; ++m1) {
+        const auto [first1, last1] = valid_range(m1, p1, n1);
+
+        for (size_t m2 = 0; m2 < nw2; ++m2) {
+            const auto [first2, last2] = valid_range(m2, p2, n2);
+
+            const T wv = w[m1 * nw2 + m2];
+
+            for (size_t o1 = first1; o1 < last1; ++o1) {
+                const T* src = in + (o1 + m1 - p1) * n2 + first2 + m2 - p2;
+                T* dst       = out + o1 * n2 + first2;
+
+                for (size_t j = 0; j < last2 - first2; ++j) {
+                    dst[j] += wv * src[j];
+                }
+            }
+        }
+    }
+}
+
+DLL_CPU_KERNEL(forward_plane)
+
+/*!
+ * \brief Accumulate the errors of one output plane, through one plane of a
+ * filter, into the errors of one input plane (n1 x n2)
+ */
+template <typename T>
+DLL_CPU_BODY void backward_plane_body(T* in, const T* errors, const T* w, size_t n1, size_t n2, size_t nw1, size_t nw2) {
+    const size_t p1 = (nw1 - 1) / 2;
+    const size_t p2 = (nw2 - 1) / 2;
+
+    for (size_t m1 = 0; m1 < nw1; ++m1) {
+        const auto [first1, last1] = valid_range(m1, p1, n1);
+
+        for (size_t m2 = 0; m2 < nw2; ++m2) {
+            const auto [first2, last2] = valid_range(m2, p2, n2);
+
+            const T wv = w[m1 * nw2 + m2];
+
+            for (size_t o1 = first1; o1 < last1; ++o1) {
+                const T* src = errors + o1 * n2 + first2;
+                T* dst       = in + (o1 + m1 - p1) * n2 + first2 + m2 - p2;
+
+                for (size_t j = 0; j < last2 - first2; ++j) {
+                    dst[j] += wv * src[j];
+                }
+            }
+        }
+    }
+}
+
+DLL_CPU_KERNEL(backward_plane)
+
+/*!
+ * \brief Accumulate the gradients of one plane of a filter from one input
+ * plane and the errors of one output plane (n1 x n2)
+ */
+template <typename T>
+DLL_CPU_BODY void filter_plane_body(T* grad, const T* in, const T* errors, size_t n1, size_t n2, size_t nw1, size_t nw2) {
+    const size_t p1 = (nw1 - 1) / 2;
+    const size_t p2 = (nw2 - 1) / 2;
+
+    for (size_t m1 = 0; m1 < nw1; ++m1) {
+        const auto [first1, last1] = valid_range(m1, p1, n1);
+
+        for (size_t m2 = 0; m2 < nw2; ++m2) {
+            const auto [first2, last2] = valid_range(m2, p2, n2);
+
+            T acc = 0;
+
+            for (size_t o1 = first1; o1 < last1; ++o1) {
+                const T* e = errors + o1 * n2 + first2;
+                const T* x = in + (o1 + m1 - p1) * n2 + first2 + m2 - p2;
+
+                for (size_t j = 0; j < last2 - first2; ++j) {
+                    acc += e[j] * x[j];
+                }
+            }
+
+            grad[m1 * nw2 + m2] += acc;
+        }
+    }
+}
+
+DLL_CPU_KERNEL(filter_plane)
+
+} //end of namespace grouped_conv_detail
+
+/*!
+ * \brief Compute the grouped correlation of a batch, the output planes
+ * being split between the threads
+ *
+ * \param out The output (batch x k x nv1 x nv2)
+ * \param in The input (batch x nc x nv1 x nv2)
+ * \param w The filters (k x nc / g x nw1 x nw2)
+ */
+template <typename T>
+void grouped_conv_forward(T* out, const T* in, const T* w, size_t batch, grouped_conv_shape s) {
+    const size_t plane = s.nv1 * s.nv2;
+    const size_t cg    = s.cg();
+    const size_t kg    = s.kg();
+
+    parallel_range(batch * s.k, batch * s.output_size() * cg * s.nw1 * s.nw2, [=](size_t first, size_t last) {
+        for (size_t t = first; t < last; ++t) {
+            const size_t i  = t / s.k;
+            const size_t kk = t % s.k;
+            const size_t c0 = (kk / kg) * cg;
+
+            T* out_p = out + t * plane;
+
+            std::fill_n(out_p, plane, T(0));
+
+            for (size_t cl = 0; cl < cg; ++cl) {
+                const T* in_p = in + (i * s.nc + c0 + cl) * plane;
+                const T* w_p  = w + (kk * cg + cl) * s.nw1 * s.nw2;
+
+                grouped_conv_detail::forward_plane(out_p, in_p, w_p, s.nv1, s.nv2, s.nw1, s.nw2);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the errors of the input of a grouped convolution, the
+ * input planes being split between the threads
+ *
+ * \param out The errors of the input (batch x nc x nv1 x nv2)
+ * \param errors The errors of the output (batch x k x nv1 x nv2)
+ * \param w The filters (k x nc / g x nw1 x nw2)
+ */
+template <typename T>
+void grouped_conv_backward(T* out, const T* errors, const T* w, size_t batch, grouped_conv_shape s) {
+    const size_t plane = s.nv1 * s.nv2;
+    const size_t cg    = s.cg();
+    const size_t kg    = s.kg();
+
+    parallel_range(batch * s.nc, batch * s.output_size() * cg * s.nw1 * s.nw2, [=](size_t first, size_t last) {
+        for (size_t t = first; t < last; ++t) {
+            const size_t i  = t / s.nc;
+            const size_t c  = t % s.nc;
+            const size_t k0 = (c / cg) * kg;
+            const size_t cl = c % cg;
+
+            T* out_p = out + t * plane;
+
+            std::fill_n(out_p, plane, T(0));
+
+            for (size_t kl = 0; kl < kg; ++kl) {
+                const T* errors_p = errors + (i * s.k + k0 + kl) * plane;
+                const T* w_p      = w + ((k0 + kl) * cg + cl) * s.nw1 * s.nw2;
+
+                grouped_conv_detail::backward_plane(out_p, errors_p, w_p, s.nv1, s.nv2, s.nw1, s.nw2);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a grouped convolution,
+ * summed over the batch, the planes of the filters being split between the
+ * threads
+ *
+ * \param grad The gradients of the filters (k x nc / g x nw1 x nw2)
+ * \param in The input (batch x nc x nv1 x nv2)
+ * \param errors The errors of the output (batch x k x nv1 x nv2)
+ */
+template <typename T>
+void grouped_conv_gradients(T* grad, const T* in, const T* errors, size_t batch, grouped_conv_shape s) {
+    const size_t plane = s.nv1 * s.nv2;
+    const size_t cg    = s.cg();
+    const size_t kg    = s.kg();
+    const size_t nw    = s.nw1 * s.nw2;
+
+    parallel_range(s.k * cg, batch * s.output_size() * cg * nw, [=](size_t first, size_t last) {
+        for (size_t f = first; f < last; ++f) {
+            const size_t kk = f / cg;
+            const size_t c  = (kk / kg) * cg + f % cg;
+
+            T* grad_p = grad + f * nw;
+
+            std::fill_n(grad_p, nw, T(0));
+
+            for (size_t i = 0; i < batch; ++i) {
+                const T* in_p     = in + (i * s.nc + c) * plane;
+                const T* errors_p = errors + (i * s.k + kk) * plane;
+
+                grouped_conv_detail::filter_plane(grad_p, in_p, errors_p, s.nv1, s.nv2, s.nw1, s.nw2);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Compute the grouped correlation of a batch of tensors
+ *
+ * \param out The output (batch x k x nv1 x nv2)
+ * \param in The input (batch x nc x nv1 x nv2)
+ * \param w The filters (k x nc / g x nw1 x nw2)
+ * \param s The geometry of the convolution
+ */
+template <typename O, typename I, typename W>
+void grouped_conv_forward(O& out, const I& in, const W& w, grouped_conv_shape s) {
+    in.ensure_cpu_up_to_date();
+    w.ensure_cpu_up_to_date();
+
+    grouped_conv_forward(out.memory_start(), in.memory_start(), w.memory_start(), etl::dim<0>(in), s);
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the errors of the input of a grouped convolution of a batch
+ * of tensors
+ *
+ * \param out The errors of the input (batch x nc x nv1 x nv2)
+ * \param errors The errors of the output (batch x k x nv1 x nv2)
+ * \param w The filters (k x nc / g x nw1 x nw2)
+ * \param s The geometry of the convolution
+ */
+template <typename O, typename E, typename W>
+void grouped_conv_backward(O& out, const E& errors, const W& w, grouped_conv_shape s) {
+    errors.ensure_cpu_up_to_date();
+    w.ensure_cpu_up_to_date();
+
+    grouped_conv_backward(out.memory_start(), errors.memory_start(), w.memory_start(), etl::dim<0>(errors), s);
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the filters of a grouped convolution of a
+ * batch of tensors
+ *
+ * \param grad The gradients of the filters (k x nc / g x nw1 x nw2)
+ * \param in The input (batch x nc x nv1 x nv2)
+ * \param errors The errors of the output (batch x k x nv1 x nv2)
+ * \param s The geometry of the convolution
+ */
+template <typename G, typename I, typename E>
+void grouped_conv_gradients(G& grad, const I& in, const E& errors, grouped_conv_shape s) {
+    in.ensure_cpu_up_to_date();
+    errors.ensure_cpu_up_to_date();
+
+    grouped_conv_gradients(grad.memory_start(), in.memory_start(), errors.memory_start(), etl::dim<0>(errors), s);
+
+    grad.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the forward pass of a separable convolution: the
+ * depthwise convolution of each sample, then the product with the
+ * pointwise filters
+ *
+ * \param out The output (batch x k x nv1 x nv2)
+ * \param in The input (batch x nc x nv1 x nv2)
+ * \param dw The depthwise filters (nc x 1 x nw1 x nw2)
+ * \param pw The pointwise filters (k x nc)
+ * \param s The geometry of the depthwise convolution
+ */
+template <typename O, typename I, typename DW, typename PW>
+void separable_conv_forward(O& out, const I& in, const DW& dw, const PW& pw, grouped_conv_shape s) {
+    using T = etl::value_t<std::decay_t<O>>;
+
+    const size_t batch = etl::dim<0>(in);
+    const size_t k     = etl::dim<0>(pw);
+    const size_t plane = s.nv1 * s.nv2;
+
+    in.ensure_cpu_up_to_date();
+    dw.ensure_cpu_up_to_date();
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> mid(scope.allocate<T>(s.nc * plane), s.nc, plane);
+
+    T* out_m = out.memory_start();
+
+    for (size_t i = 0; i < batch; ++i) {
+        grouped_conv_forward(mid.memory_start(), in.memory_start() + i * s.input_size(), dw.memory_start(), 1, s);
+
+        mid.invalidate_gpu();
+
+        etl::custom_dyn_matrix<T, 2> out_i(out_m + i * k * plane, k, plane);
+
+        out_i = pw * mid;
+        out_i.ensure_cpu_up_to_date();
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the errors of the input of a separable convolution
+ *
+ * \param out The errors of the input (batch x nc x nv1 x nv2)
+ * \param errors The errors of the output (batch x k x nv1 x nv2)
+ * \param dw The depthwise filters (nc x 1 x nw1 x nw2)
+ * \param pw The pointwise filters (k x nc)
+ * \param s The geometry of the depthwise convolution
+ */
+template <typename O, typename E, typename DW, typename PW>
+void separable_conv_backward(O& out, const E& errors, const DW& dw, const PW& pw, grouped_conv_shape s) {
+    using T = etl::value_t<std::decay_t<O>>;
+
+    const size_t batch = etl::dim<0>(errors);
+    const size_t k     = etl::dim<0>(pw);
+    const size_t plane = s.nv1 * s.nv2;
+
+    errors.ensure_cpu_up_to_date();
+    dw.ensure_cpu_up_to_date();
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> mid(scope.allocate<T>(s.nc * plane), s.nc, plane);
+
+    T* out_m    = out.memory_start();
+    T* errors_m = const_cast<T*>(errors.memory_start());
+
+    for (size_t i = 0; i < batch; ++i) {
+        mid = etl::transpose(pw) * etl::custom_dyn_matrix<T, 2>(errors_m + i * k * plane, k, plane);
+        mid.ensure_cpu_up_to_date();
+
+        grouped_conv_backward(out_m + i * s.input_size(), mid.memory_start(), dw.memory_start(), 1, s);
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Compute the gradients of the depthwise and of the pointwise
+ * filters of a separable convolution, summed over the batch.
+ *
+ * The output of the depthwise convolution is computed again, sample by
+ * sample, rather than kept from the forward pass.
+ *
+ * \param dw_grad The gradients of the depthwise filters (nc x 1 x nw1 x nw2)
+ * \param pw_grad The gradients of the pointwise filters (k x nc)
+ * \param in The input (batch x nc x nv1 x nv2)
+ * \param errors The errors of the output (batch x k x nv1 x nv2)
+ * \param dw The depthwise filters (nc x 1 x nw1 x nw2)
+ * \param pw The pointwise filters (k x nc)
+ * \param s The geometry of the depthwise convolution
+ */
+template <typename DG, typename PG, typename I, typename E, typename DW, typename PW>
+void separable_conv_gradients(DG& dw_grad, PG& pw_grad, const I& in, const E& errors, const DW& dw, const PW& pw, grouped_conv_shape s) {
+    using T = etl::value_t<std::decay_t<DG>>;
+
+    const size_t batch = etl::dim<0>(errors);
+    const size_t k     = etl::dim<0>(pw);
+    const size_t plane = s.nv1 * s.nv2;
+
+    in.ensure_cpu_up_to_date();
+    errors.ensure_cpu_up_to_date();
+    dw.ensure_cpu_up_to_date();
+
+    arena_scope scope;
+
+    etl::custom_dyn_matrix<T, 2> mid(scope.allocate<T>(s.nc * plane), s.nc, plane);
+
+    // The errors of the depthwise outputs of all the samples
+    T* mid_errors = scope.allocate<T>(batch * s.nc * plane);
+    T* errors_m   = const_cast<T*>(errors.memory_start());
+
+    pw_grad = T(0);
+
+    for (size_t i = 0; i < batch; ++i) {
+        etl::custom_dyn_matrix<T, 2> errors_i(errors_m + i * k * plane, k, plane);
+        etl::custom_dyn_matrix<T, 2> mid_errors_i(mid_errors + i * s.nc * plane, s.nc, plane);
+
+        grouped_conv_forward(mid.memory_start(), in.memory_start() + i * s.input_size(), dw.memory_start(), 1, s);
+
+        mid.invalidate_gpu();
+
+        pw_grad += errors_i * etl::transpose(mid);
+
+        mid_errors_i = etl::transpose(pw) * errors_i;
+        mid_errors_i.ensure_cpu_up_to_date();
+    }
+
+    grouped_conv_gradients(dw_grad.memory_start(), in.memory_start(), mid_errors, batch, s);
+
+    dw_grad.invalidate_gpu();
+}
+
+} //end of dll namespace
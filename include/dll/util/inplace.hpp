@@ -0,0 +1,141 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Traits of the layers that do not need their own output buffer.
+ *
+ * Element-wise transform layers can overwrite their input with their output
+ * (and their errors with the errors of their input) and the shape layers (and
+ * dropout, at test time) are the identity, their output is their input. The
+ * activation layers following a layer without activation function can be
+ * fused into its forward pass, and so can the upsample layers preceding a
+ * convolutional layer.
+ */
+
+#pragma once
+
+#include <type_traits>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_fwd.hpp"
+#include "dll/function.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Traits to test if a layer can be applied in-place on its input
+ * (element-wise forward and backward, the backward not needing the input)
+ */
+template <typename Layer>
+struct is_inplace_layer : std::false_type {};
+
+template <typename Desc>
+struct is_inplace_layer<activation_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_inplace_layer<dropout_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_inplace_layer<dyn_dropout_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_inplace_layer<scale_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_inplace_layer<rectifier_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_inplace_layer<binarize_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer is the identity at test time (its output
+ * can alias its input)
+ */
+template <typename Layer>
+struct is_identity_layer : std::false_type {};
+
+template <typename Desc>
+struct is_identity_layer<shape_1d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_identity_layer<dyn_shape_1d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_identity_layer<shape_3d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_identity_layer<dyn_shape_3d_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_identity_layer<dropout_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_identity_layer<dyn_dropout_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if the activation function of an activation layer
+ * following the layer can be fused into its forward pass (layers without
+ * activation function, see forward_batch_activated)
+ */
+template <typename Layer>
+struct is_activation_fusable_layer : std::false_type {};
+
+template <typename Desc>
+struct is_activation_fusable_layer<dense_layer_impl<Desc>> : std::bool_constant<Desc::activation_function == function::IDENTITY> {};
+
+template <typename Desc>
+struct is_activation_fusable_layer<dyn_dense_layer_impl<Desc>> : std::bool_constant<Desc::activation_function == function::IDENTITY> {};
+
+template <typename Desc>
+struct is_activation_fusable_layer<conv_layer_impl<Desc>> : std::bool_constant<Desc::activation_function == function::IDENTITY> {};
+
+template <typename Desc>
+struct is_activation_fusable_layer<dyn_conv_layer_impl<Desc>> : std::bool_constant<Desc::activation_function == function::IDENTITY> {};
+
+/*!
+ * \brief Traits to test if an upsample layer preceding the layer can be fused
+ * into its forward pass (see forward_batch_upsampled)
+ */
+template <typename Layer>
+struct is_upsample_fusable_layer : std::false_type {};
+
+template <typename Desc>
+struct is_upsample_fusable_layer<conv_layer_impl<Desc>> : std::true_type {};
+
+template <typename Desc>
+struct is_upsample_fusable_layer<dyn_conv_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer is an upsample layer that can be fused
+ * into the next layer (upsampling of the spatial dimensions only, known at
+ * compile time)
+ */
+template <typename Layer>
+struct is_fusable_upsample_layer : std::false_type {};
+
+template <typename Desc>
+struct is_fusable_upsample_layer<upsample_3d_layer_impl<Desc>> : std::bool_constant<Desc::C1 == 1> {};
+
+/*!
+ * \brief Traits to test if a layer is an activation layer
+ */
+template <typename Layer>
+struct is_activation_layer : std::false_type {};
+
+template <typename Desc>
+struct is_activation_layer<activation_layer_impl<Desc>> : std::true_type {};
+
+/*!
+ * \brief Indicates if a layer needs its input for the backward pass or for
+ * its gradients, i.e. if the trainer must keep a copy of it
+ */
+template <typename Layer>
+static constexpr bool keeps_input = !is_inplace_layer<Layer>::value && !is_identity_layer<Layer>::value;
+
+} //end of dll namespace
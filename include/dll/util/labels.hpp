@@ -9,6 +9,7 @@
 
 #include <iterator>
 #include <vector>
+#include <algorithm>
 
 namespace dll {
 
@@ -43,6 +44,39 @@ std::vector<fake_label_array<std::remove_cv_t<typename std::iterator_traits<Iter
     return fake;
 }
 
+/*!
+ * \brief Scatter class indices as one-hot rows into the first rows of a
+ * label batch.
+ *
+ * The rows are cleared at once and a single one is then written in each
+ * row, directly in the memory of the batch. The classes that are out of
+ * range leave their row at zero.
+ *
+ * \param labels The label batch to fill (one contiguous row of classes per label)
+ * \param n The number of labels to scatter
+ * \param label A functor returning the class of the i-th label
+ */
+template <typename L, typename Label>
+void one_hot_scatter(L&& labels, size_t n, Label&& label) {
+    using value_type = etl::value_t<std::decay_t<L>>;
+
+    const size_t classes = etl::dim<1>(labels);
+
+    auto* out = labels.memory_start();
+
+    std::fill_n(out, n * classes, value_type(0));
+
+    for (size_t i = 0; i < n; ++i) {
+        const size_t l = label(i);
+
+        if (l < classes) {
+            out[i * classes + l] = value_type(1);
+        }
+    }
+
+    labels.invalidate_gpu();
+}
+
 template <typename Label>
 etl::dyn_vector<float> make_fake_etl(Label& value, size_t n) {
     etl::dyn_vector<float> label(n, 0.0);
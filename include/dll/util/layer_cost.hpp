@@ -0,0 +1,170 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Analytical cost (floating point operations and bytes moved) of the
+ * layers.
+ *
+ * The bytes count each tensor once per pass (the input, the weights and the
+ * output), as if the caches were perfect. The weights are read once per
+ * batch, so the arithmetic intensity of the weighted layers grows with the
+ * batch size. The counts are estimations, they don't depend on the
+ * implementation (BLAS, FFT, ...) that is selected at runtime.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief The cost of one pass over a batch
+ */
+struct pass_cost {
+    size_t flops = 0; ///< The number of floating point operations
+    size_t bytes = 0; ///< The number of bytes moved
+
+    /*!
+     * \brief Returns the arithmetic intensity of the pass (FLOP per byte)
+     */
+    double intensity() const {
+        return bytes ? double(flops) / double(bytes) : 0.0;
+    }
+};
+
+/*!
+ * \brief The cost of the passes of a layer over a batch
+ */
+struct layer_cost {
+    pass_cost forward;   ///< The cost of the forward pass
+    pass_cost backward;  ///< The cost of the backpropagation of the errors
+    pass_cost gradients; ///< The cost of the computation of the gradients
+};
+
+/*!
+ * \brief Compute the cost of a layer with weights (dense, convolution,
+ * recurrent, ...) over a batch.
+ *
+ * \param weight_size The size of one value, in bytes
+ * \param batch The number of samples in the batch
+ * \param inputs The number of inputs of one sample
+ * \param outputs The number of outputs of one sample
+ * \param weights The number of weights
+ * \param biases The number of biases
+ * \param macs The number of multiply-accumulate of one sample
+ */
+inline layer_cost weighted_layer_cost(size_t weight_size, size_t batch, size_t inputs, size_t outputs, size_t weights, size_t biases, size_t macs) {
+    layer_cost cost;
+
+    // Products, then bias and activation
+    cost.forward.flops = batch * (2 * macs + 2 * outputs);
+    cost.forward.bytes = weight_size * (batch * inputs + weights + biases + batch * outputs);
+
+    // Products with the transposed weights
+    cost.backward.flops = batch * 2 * macs;
+    cost.backward.bytes = weight_size * (batch * outputs + weights + batch * inputs);
+
+    // Products of the inputs and the errors, then the sum of the errors
+    cost.gradients.flops = batch * (2 * macs + outputs);
+    cost.gradients.bytes = weight_size * (batch * inputs + batch * outputs + weights + biases);
+
+    return cost;
+}
+
+/*!
+ * \brief Compute the cost of a RBM over a batch.
+ *
+ * The forward and backward passes are the ones of the equivalent neural
+ * layer. The gradients are the ones of one step of contrastive divergence
+ * (three activations and two outer products).
+ *
+ * \copydetails weighted_layer_cost
+ */
+inline layer_cost rbm_layer_cost(size_t weight_size, size_t batch, size_t inputs, size_t outputs, size_t weights, size_t biases, size_t macs) {
+    auto cost = weighted_layer_cost(weight_size, batch, inputs, outputs, weights, biases, macs);
+
+    cost.gradients.flops = batch * (10 * macs + 4 * (inputs + outputs));
+    cost.gradients.bytes = weight_size * (batch * 2 * (inputs + outputs) + 4 * weights + 2 * biases);
+
+    return cost;
+}
+
+/*!
+ * \brief Compute the cost of a layer operating on each value (pooling,
+ * normalization, activation, ...) over a batch.
+ *
+ * \param weight_size The size of one value, in bytes
+ * \param batch The number of samples in the batch
+ * \param inputs The number of inputs of one sample
+ * \param outputs The number of outputs of one sample
+ * \param forward The number of operations per input in the forward pass
+ * \param backward The number of operations per input in the backward pass
+ * \param gradients The number of operations per input for the gradients
+ * \param parameters The number of trainable parameters
+ */
+inline layer_cost elementwise_layer_cost(size_t weight_size, size_t batch, size_t inputs, size_t outputs, size_t forward, size_t backward, size_t gradients = 0, size_t parameters = 0) {
+    layer_cost cost;
+
+    cost.forward.flops = batch * inputs * forward;
+    cost.forward.bytes = weight_size * (batch * (inputs + outputs) + parameters);
+
+    // The errors of the output and (for most layers) the input or the output
+    // itself are read
+    cost.backward.flops = batch * inputs * backward;
+    cost.backward.bytes = weight_size * (batch * (2 * inputs + 2 * outputs) + parameters);
+
+    if (gradients) {
+        cost.gradients.flops = batch * inputs * gradients;
+        cost.gradients.bytes = weight_size * (batch * (inputs + outputs) + 2 * parameters);
+    }
+
+    return cost;
+}
+
+/*!
+ * \brief Traits indicating if a layer computes its own cost
+ */
+template <typename Layer, typename Enable = void>
+struct has_layer_cost : std::false_type {};
+
+/*!
+ * \copydoc has_layer_cost
+ */
+template <typename Layer>
+struct has_layer_cost<Layer, std::void_t<decltype(std::declval<const Layer&>().cost(size_t(1)))>> : std::true_type {};
+
+/*!
+ * \brief Returns the cost of the given layer over a batch of the given
+ * size. The layers without a cost model are considered as one operation per
+ * value.
+ *
+ * \param layer The layer
+ * \param input_shape The shape of one input of the layer
+ * \param batch The number of samples in the batch
+ * \tparam Weight The type of the values of the network
+ */
+template <typename Weight, typename Layer>
+layer_cost cost_of_layer(const Layer& layer, const std::vector<size_t>& input_shape, size_t batch) {
+    if constexpr (has_layer_cost<Layer>::value) {
+        return layer.cost(batch);
+    } else {
+        size_t inputs = 1;
+
+        for (auto d : input_shape) {
+            inputs *= d;
+        }
+
+        return elementwise_layer_cost(sizeof(Weight), batch, inputs, inputs, 1, 1);
+    }
+}
+
+} //end of dll namespace
@@ -0,0 +1,316 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Low-rank factorization of the weights of the dense layers.
+ *
+ * The weights W (visible x hidden) of a dense layer are approximated by the
+ * product of two thin matrices (visible x rank) and (rank x hidden), from a
+ * truncated SVD of W computed with a randomized range finder. The rank of
+ * each layer is chosen from a budget: the smallest rank keeping the
+ * requested ratio of the energy (squared Frobenius norm) of W, within the
+ * maximum cost relative to the original product.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The budget of the low-rank factorization of a layer
+ */
+struct low_rank_budget {
+    double energy           = 0.99; ///< The ratio of the energy of the weights to keep
+    double max_cost         = 0.5;  ///< The maximum cost of the factorized layer, relative to the original layer
+    size_t power_iterations = 2;    ///< The number of power iterations of the randomized SVD
+    size_t oversampling     = 10;   ///< The number of additional vectors of the randomized SVD
+
+    /*!
+     * \brief Returns the maximum rank of a layer of the given dimensions
+     */
+    size_t max_rank(size_t visible, size_t hidden) const {
+        const size_t r = size_t(max_cost * double(visible * hidden) / double(visible + hidden));
+
+        return std::max(size_t(1), std::min(r, std::min(visible, hidden)));
+    }
+};
+
+/*!
+ * \brief The low-rank factors of the weights of a dense layer
+ */
+template <typename T>
+struct low_rank_factors {
+    size_t rank   = 0;   ///< The chosen rank
+    double energy = 0.0; ///< The ratio of the energy of the weights kept by the factors
+
+    etl::dyn_matrix<T, 2> first;  ///< The first factor (visible x rank)
+    etl::dyn_matrix<T, 2> second; ///< The second factor (rank x hidden)
+};
+
+namespace low_rank_detail {
+
+/*!
+ * \brief Orthonormalize the columns of the given matrix (modified
+ * Gram-Schmidt), the columns that are not independent are set to zero.
+ */
+template <typename M>
+void orthonormalize(M& q) {
+    const size_t n = etl::dim<0>(q);
+    const size_t l = etl::dim<1>(q);
+
+    for (size_t j = 0; j < l; ++j) {
+        for (size_t k = 0; k < j; ++k) {
+            double d = 0.0;
+
+            for (size_t i = 0; i < n; ++i) {
+                d += double(q(i, k)) * double(q(i, j));
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                q(i, j) -= d * q(i, k);
+            }
+        }
+
+        double norm = 0.0;
+
+        for (size_t i = 0; i < n; ++i) {
+            norm += double(q(i, j)) * double(q(i, j));
+        }
+
+        norm = std::sqrt(norm);
+
+        for (size_t i = 0; i < n; ++i) {
+            q(i, j) = norm > 1e-10 ? q(i, j) / norm : 0;
+        }
+    }
+}
+
+/*!
+ * \brief Compute the eigen decomposition of a symmetric matrix with the
+ * cyclic Jacobi method.
+ *
+ * \param a The symmetric matrix (n x n, row-major), destroyed
+ * \param n The dimension of the matrix
+ * \param values The eigen values
+ * \param vectors The eigen vectors, in columns (n x n, row-major)
+ */
+inline void jacobi_eigen(std::vector<double>& a, size_t n, std::vector<double>& values, std::vector<double>& vectors) {
+    vectors.assign(n * n, 0.0);
+
+    for (size_t i = 0; i < n; ++i) {
+        vectors[i * n + i] = 1.0;
+    }
+
+    for (size_t sweep = 0; sweep < 50; ++sweep) {
+        double off = 0.0;
+
+        for (size_t p = 0; p < n; ++p) {
+            for (size_t q = p + 1; q < n; ++q) {
+                off += a[p * n + q] * a[p * n + q];
+            }
+        }
+
+        if (off < 1e-20) {
+            break;
+        }
+
+        for (size_t p = 0; p < n; ++p) {
+            for (size_t q = p + 1; q < n; ++q) {
+                const double apq = a[p * n + q];
+
+                if (std::abs(apq) < 1e-30) {
+                    continue;
+                }
+
+                const double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                const double t     = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c     = 1.0 / std::sqrt(t * t + 1.0);
+                const double s     = t * c;
+
+                for (size_t k = 0; k < n; ++k) {
+                    const double akp = a[k * n + p];
+                    const double akq = a[k * n + q];
+
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+
+                for (size_t k = 0; k < n; ++k) {
+                    const double apk = a[p * n + k];
+                    const double aqk = a[q * n + k];
+
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+
+                for (size_t k = 0; k < n; ++k) {
+                    const double vkp = vectors[k * n + p];
+                    const double vkq = vectors[k * n + q];
+
+                    vectors[k * n + p] = c * vkp - s * vkq;
+                    vectors[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    values.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = a[i * n + i];
+    }
+}
+
+} //end of namespace low_rank_detail
+
+/*!
+ * \brief Factorize the given weights into two thin matrices, following the
+ * given budget.
+ *
+ * \param w The weights (visible x hidden)
+ * \param budget The budget of the factorization
+ *
+ * \return The factors of the weights
+ */
+template <typename T, typename W>
+low_rank_factors<T> factorize_low_rank(const W& w, const low_rank_budget& budget) {
+    const size_t nv = etl::dim<0>(w);
+    const size_t nh = etl::dim<1>(w);
+
+    const size_t k = budget.max_rank(nv, nh);
+    const size_t l = std::min(k + budget.oversampling, std::min(nv, nh));
+
+    etl::dyn_matrix<T, 2> a(nv, nh);
+    a = w;
+
+    // Randomized range finder of the columns of the weights
+
+    etl::dyn_matrix<T, 2> omega(nh, l);
+
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    for (auto& v : omega) {
+        v = normal(dll::rand_engine());
+    }
+
+    etl::dyn_matrix<T, 2> q(nv, l);
+    etl::dyn_matrix<T, 2> z(nh, l);
+
+    q = a * omega;
+    low_rank_detail::orthonormalize(q);
+
+    for (size_t it = 0; it < budget.power_iterations; ++it) {
+        z = etl::transpose(a) * q;
+        low_rank_detail::orthonormalize(z);
+
+        q = a * z;
+        low_rank_detail::orthonormalize(q);
+    }
+
+    // SVD of the small projection B = Q^T W, from the eigen decomposition of B B^T
+
+    etl::dyn_matrix<T, 2> b(l, nh);
+    b = etl::transpose(q) * a;
+
+    std::vector<double> c(l * l, 0.0);
+
+    for (size_t i = 0; i < l; ++i) {
+        for (size_t j = i; j < l; ++j) {
+            double s = 0.0;
+
+            for (size_t h = 0; h < nh; ++h) {
+                s += double(b(i, h)) * double(b(j, h));
+            }
+
+            c[i * l + j] = s;
+            c[j * l + i] = s;
+        }
+    }
+
+    std::vector<double> values;
+    std::vector<double> vectors;
+
+    low_rank_detail::jacobi_eigen(c, l, values, vectors);
+
+    std::vector<size_t> order(l);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&values](size_t x, size_t y) { return values[x] > values[y]; });
+
+    // Choose the rank from the energy of the singular values
+
+    double total = 0.0;
+
+    for (size_t i = 0; i < nv; ++i) {
+        for (size_t j = 0; j < nh; ++j) {
+            total += double(a(i, j)) * double(a(i, j));
+        }
+    }
+
+    low_rank_factors<T> factors;
+
+    double kept = 0.0;
+
+    for (size_t r = 0; r < k; ++r) {
+        kept += std::max(values[order[r]], 0.0);
+
+        factors.rank = r + 1;
+
+        if (total <= 0.0 || kept >= budget.energy * total) {
+            break;
+        }
+    }
+
+    factors.energy = total > 0.0 ? std::min(1.0, kept / total) : 1.0;
+
+    // W ~= (Q U sqrt(S)) (sqrt(S)^-1 U^T B)
+
+    const size_t r = factors.rank;
+
+    factors.first  = etl::dyn_matrix<T, 2>(nv, r);
+    factors.second = etl::dyn_matrix<T, 2>(r, nh);
+
+    for (size_t j = 0; j < r; ++j) {
+        const size_t e     = order[j];
+        const double sigma = std::sqrt(std::max(values[e], 0.0));
+        const double s     = std::sqrt(sigma);
+
+        for (size_t i = 0; i < nv; ++i) {
+            double v = 0.0;
+
+            for (size_t m = 0; m < l; ++m) {
+                v += double(q(i, m)) * vectors[m * l + e];
+            }
+
+            factors.first(i, j) = v * s;
+        }
+
+        for (size_t h = 0; h < nh; ++h) {
+            double v = 0.0;
+
+            for (size_t m = 0; m < l; ++m) {
+                v += vectors[m * l + e] * double(b(m, h));
+            }
+
+            factors.second(j, h) = s > 0.0 ? v / s : 0.0;
+        }
+    }
+
+    return factors;
+}
+
+} //end of dll namespace
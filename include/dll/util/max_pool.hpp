@@ -0,0 +1,171 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Max pooling kernels recording the position of the maximum of each
+ * pooling window
+ *
+ * The training forward pass stores the index of the maximum inside each
+ * window, so that the backward pass is a scatter of the errors instead of a
+ * new scan of the input windows. The activation function of the pooled
+ * values can be fused in the kernels (max pooling commutes with any
+ * non-decreasing function).
+ *
+ * The kernels can be specialised for a window known at compile time (the
+ * windows of the static layers, and the common windows of the dynamic
+ * layers, selected once when the layer is initialized).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#include "dll/function.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/shape_dispatch.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The type of the index of the maximum in a pooling window
+ */
+template <size_t Window>
+using max_pool_index_t = std::conditional_t<(Window <= 256), uint8_t, uint16_t>;
+
+/*!
+ * \brief Max pool the input and record the index of the maximum of each
+ * window, then apply the activation function F on the pooled values
+ *
+ * \param out The output (n x i2 / c1 x i3 / c2)
+ * \param indices The index of the maximum of each window (same size as out), or nullptr
+ * \param in The input (n x i2 x i3)
+ * \param n The number of images (batch x channels)
+ *
+ * \tparam C1 The first dimension of the window, if known at compile time (0 otherwise)
+ * \tparam C2 The second dimension of the window, if known at compile time (0 otherwise)
+ */
+template <function F, size_t C1 = 0, size_t C2 = 0, typename T, typename I>
+void max_pool_2d_forward(T* out, I* indices, const T* in, size_t n, size_t i2, size_t i3, size_t c1, size_t c2) {
+    const size_t o2 = i2 / c1;
+    const size_t o3 = i3 / c2;
+
+    parallel_range(n, n * i2 * i3, [=](size_t first, size_t last) {
+        // Constants for the specialised windows
+        const size_t w1 = C1 ? C1 : c1;
+        const size_t w2 = C2 ? C2 : c2;
+
+        for (size_t image = first; image < last; ++image) {
+            const T* x = in + image * i2 * i3;
+            T* y       = out + image * o2 * o3;
+            I* idx     = indices ? indices + image * o2 * o3 : nullptr;
+
+            for (size_t j = 0; j < o2; ++j) {
+                for (size_t k = 0; k < o3; ++k) {
+                    const T* window = x + j * w1 * i3 + k * w2;
+
+                    T max      = window[0];
+                    size_t arg = 0;
+
+                    for (size_t jj = 0; jj < w1; ++jj) {
+                        for (size_t kk = 0; kk < w2; ++kk) {
+                            if (window[jj * i3 + kk] > max) {
+                                max = window[jj * i3 + kk];
+                                arg = jj * w2 + kk;
+                            }
+                        }
+                    }
+
+                    y[j * o3 + k] = f_activate_scalar<F>(max);
+
+                    if (idx) {
+                        idx[j * o3 + k] = I(arg);
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Scatter the errors of the pooled values to the position of the
+ * maximum of each window
+ *
+ * \param out The errors of the input (n x i2 x i3)
+ * \param errors The errors of the output (n x i2 / c1 x i3 / c2)
+ * \param output The output of the layer, used for the derivative of F
+ * \param indices The index of the maximum of each window
+ * \param n The number of images (batch x channels)
+ *
+ * \tparam C1 The first dimension of the window, if known at compile time (0 otherwise)
+ * \tparam C2 The second dimension of the window, if known at compile time (0 otherwise)
+ */
+template <function F, size_t C1 = 0, size_t C2 = 0, typename T, typename I>
+void max_pool_2d_backward(T* out, const T* errors, const T* output, const I* indices, size_t n, size_t i2, size_t i3, size_t c1, size_t c2) {
+    const size_t o2 = i2 / c1;
+    const size_t o3 = i3 / c2;
+
+    parallel_range(n, n * i2 * i3, [=](size_t first, size_t last) {
+        // Constants for the specialised windows
+        const size_t w1 = C1 ? C1 : c1;
+        const size_t w2 = C2 ? C2 : c2;
+
+        std::fill(out + first * i2 * i3, out + last * i2 * i3, T(0));
+
+        for (size_t image = first; image < last; ++image) {
+            T* x         = out + image * i2 * i3;
+            const T* e   = errors + image * o2 * o3;
+            const T* y   = output + image * o2 * o3;
+            const I* idx = indices + image * o2 * o3;
+
+            for (size_t j = 0; j < o2; ++j) {
+                for (size_t k = 0; k < o3; ++k) {
+                    const size_t o   = j * o3 + k;
+                    const size_t arg = idx[o];
+
+                    x[(j * w1 + arg / w2) * i3 + k * w2 + arg % w2] = f_derivative_scalar<F>(y[o]) * e[o];
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief The windows with specialised max pooling kernels in the dynamic
+ * layers
+ */
+using max_pool_2d_shapes = shape_list<shape_2d<2, 2>, shape_2d<3, 3>, shape_2d<4, 4>, shape_2d<2, 1>, shape_2d<1, 2>>;
+
+/*!
+ * \brief The max pooling kernels of a dynamic layer, specialised for its
+ * window if it is a common one
+ */
+template <function F, typename T, typename I>
+struct max_pool_2d_kernels {
+    using forward_t  = void (*)(T*, I*, const T*, size_t, size_t, size_t, size_t, size_t);               ///< The type of the forward kernel
+    using backward_t = void (*)(T*, const T*, const T*, const I*, size_t, size_t, size_t, size_t, size_t); ///< The type of the backward kernel
+
+    forward_t forward   = &max_pool_2d_forward<F, 0, 0, T, I>;  ///< The forward kernel
+    backward_t backward = &max_pool_2d_backward<F, 0, 0, T, I>; ///< The backward kernel
+
+    /*!
+     * \brief Select the kernels for the given window
+     * \return true if the kernels are specialised for the window, false otherwise
+     */
+    bool select(size_t c1, size_t c2) {
+        return dispatch_shape(max_pool_2d_shapes(), c1, c2, [this](auto shape) {
+            using shape_t = decltype(shape);
+
+            forward  = &max_pool_2d_forward<F, shape_t::dim1, shape_t::dim2, T, I>;
+            backward = &max_pool_2d_backward<F, shape_t::dim1, shape_t::dim2, T, I>;
+        });
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,415 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Accounting of the memory used by the networks, per subsystem and
+ * per layer.
+ *
+ * The owners of the large buffers (the network for its weights, the trainer
+ * for its contexts, gradients and optimizer state, the generators for their
+ * caches, ...) hold a memory_record for each of them. The records update
+ * the current and peak bytes of their subsystem and layer in the global
+ * memory_tracker. The buffers themselves are still allocated by ETL, only
+ * their size is accounted.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dll/updater_type.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The subsystems that own memory
+ */
+enum class memory_subsystem : size_t {
+    WEIGHTS,     ///< The trainable parameters of the layers
+    ACTIVATIONS, ///< The training contexts (input, output and errors of the layers)
+    GRADIENTS,   ///< The gradients of the parameters
+    OPTIMIZER,   ///< The state of the updater (momentum, moments, ...)
+    GENERATORS,  ///< The caches of the data generators
+    CACHES,      ///< The caches of the layers (recurrent states, indices, ...)
+    COUNT        ///< The number of subsystems
+};
+
+constexpr size_t memory_subsystems = size_t(memory_subsystem::COUNT); ///< The number of subsystems
+constexpr size_t max_memory_layers = 64;                              ///< The number of layers accounted separately
+constexpr size_t no_memory_layer   = max_memory_layers;               ///< The index used for memory not tied to a layer
+
+/*!
+ * \brief Returns a string representation of a memory subsystem
+ */
+inline const char* to_string(memory_subsystem subsystem) {
+    switch (subsystem) {
+        case memory_subsystem::WEIGHTS:
+            return "weights";
+        case memory_subsystem::ACTIVATIONS:
+            return "activations";
+        case memory_subsystem::GRADIENTS:
+            return "gradients";
+        case memory_subsystem::OPTIMIZER:
+            return "optimizer";
+        case memory_subsystem::GENERATORS:
+            return "generators";
+        case memory_subsystem::CACHES:
+            return "caches";
+        case memory_subsystem::COUNT:
+            break;
+    }
+
+    return "unknown";
+}
+
+/*!
+ * \brief A current and peak number of bytes
+ */
+struct memory_counter {
+    std::atomic<size_t> current{0}; ///< The bytes currently used
+    std::atomic<size_t> peak{0};    ///< The maximum bytes used at the same time
+
+    /*!
+     * \brief Account the allocation of the given number of bytes
+     */
+    void allocate(size_t bytes) {
+        auto now  = current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        auto high = peak.load(std::memory_order_relaxed);
+
+        while (now > high && !peak.compare_exchange_weak(high, now, std::memory_order_relaxed)) {}
+    }
+
+    /*!
+     * \brief Account the release of the given number of bytes
+     */
+    void release(size_t bytes) {
+        current.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+};
+
+/*!
+ * \brief The global accounting of the memory
+ */
+struct memory_tracker {
+    memory_counter total;                                                                    ///< All the accounted memory
+    std::array<memory_counter, memory_subsystems> subsystems;                                ///< The memory of each subsystem
+    std::array<std::array<memory_counter, max_memory_layers + 1>, memory_subsystems> layers; ///< The memory of each subsystem for each layer
+
+    /*!
+     * \brief Account an allocation
+     */
+    void allocate(memory_subsystem subsystem, size_t layer, size_t bytes) {
+        total.allocate(bytes);
+        subsystems[size_t(subsystem)].allocate(bytes);
+        layers[size_t(subsystem)][std::min(layer, no_memory_layer)].allocate(bytes);
+    }
+
+    /*!
+     * \brief Account a release
+     */
+    void release(memory_subsystem subsystem, size_t layer, size_t bytes) {
+        total.release(bytes);
+        subsystems[size_t(subsystem)].release(bytes);
+        layers[size_t(subsystem)][std::min(layer, no_memory_layer)].release(bytes);
+    }
+};
+
+/*!
+ * \brief Returns the global memory tracker
+ */
+inline memory_tracker& get_memory_tracker() {
+    static memory_tracker tracker;
+    return tracker;
+}
+
+/*!
+ * \brief Returns the bytes currently used by the given subsystem
+ */
+inline size_t memory_current(memory_subsystem subsystem) {
+    return get_memory_tracker().subsystems[size_t(subsystem)].current.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns the peak bytes used by the given subsystem
+ */
+inline size_t memory_peak(memory_subsystem subsystem) {
+    return get_memory_tracker().subsystems[size_t(subsystem)].peak.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns the bytes currently used by the given subsystem for the
+ * given layer
+ */
+inline size_t memory_current(memory_subsystem subsystem, size_t layer) {
+    return get_memory_tracker().layers[size_t(subsystem)][std::min(layer, no_memory_layer)].current.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns the peak bytes used by the given subsystem for the given
+ * layer
+ */
+inline size_t memory_peak(memory_subsystem subsystem, size_t layer) {
+    return get_memory_tracker().layers[size_t(subsystem)][std::min(layer, no_memory_layer)].peak.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns the bytes currently accounted (all subsystems)
+ */
+inline size_t memory_current() {
+    return get_memory_tracker().total.current.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns the peak bytes accounted at the same time (all subsystems)
+ */
+inline size_t memory_peak() {
+    return get_memory_tracker().total.peak.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Returns a human-readable string of the given number of bytes
+ */
+inline std::string memory_str(size_t bytes) {
+    char buffer[32];
+
+    if (bytes >= 1024UL * 1024 * 1024) {
+        snprintf(buffer, 32, "%.2fGB", bytes / (1024.0 * 1024.0 * 1024.0));
+    } else if (bytes >= 1024UL * 1024) {
+        snprintf(buffer, 32, "%.2fMB", bytes / (1024.0 * 1024.0));
+    } else if (bytes >= 1024UL) {
+        snprintf(buffer, 32, "%.2fKB", bytes / 1024.0);
+    } else {
+        snprintf(buffer, 32, "%luB", bytes);
+    }
+
+    return buffer;
+}
+
+/*!
+ * \brief Print the current and peak memory of each subsystem
+ */
+inline void dump_memory() {
+    std::cout << "Memory: current " << memory_str(memory_current()) << " peak " << memory_str(memory_peak()) << std::endl;
+
+    for (size_t s = 0; s < memory_subsystems; ++s) {
+        auto subsystem = memory_subsystem(s);
+
+        if (memory_peak(subsystem)) {
+            char buffer[128];
+            snprintf(buffer, 128, "  %-12s current %10s peak %10s", to_string(subsystem), memory_str(memory_current(subsystem)).c_str(), memory_str(memory_peak(subsystem)).c_str());
+            std::cout << buffer << std::endl;
+        }
+    }
+}
+
+/*!
+ * \brief The accounting of one buffer, released when the record is
+ * destroyed.
+ */
+struct memory_record {
+    memory_subsystem subsystem = memory_subsystem::CACHES; ///< The subsystem owning the buffer
+    size_t layer               = no_memory_layer;          ///< The layer owning the buffer
+    size_t bytes               = 0;                        ///< The size of the buffer
+
+    memory_record() = default;
+
+    /*!
+     * \brief Account a buffer of the given size
+     */
+    memory_record(memory_subsystem subsystem, size_t layer, size_t bytes) : subsystem(subsystem), layer(layer), bytes(bytes) {
+        get_memory_tracker().allocate(subsystem, layer, bytes);
+    }
+
+    memory_record(const memory_record& rhs) = delete;
+    memory_record& operator=(const memory_record& rhs) = delete;
+
+    memory_record(memory_record&& rhs) noexcept : subsystem(rhs.subsystem), layer(rhs.layer), bytes(rhs.bytes) {
+        rhs.bytes = 0;
+    }
+
+    memory_record& operator=(memory_record&& rhs) noexcept {
+        if (this != &rhs) {
+            resize(0);
+
+            subsystem = rhs.subsystem;
+            layer     = rhs.layer;
+            bytes     = rhs.bytes;
+            rhs.bytes = 0;
+        }
+
+        return *this;
+    }
+
+    /*!
+     * \brief Release the buffer
+     */
+    ~memory_record() {
+        resize(0);
+    }
+
+    /*!
+     * \brief Update the size of the buffer
+     */
+    void resize(size_t new_bytes) {
+        if (new_bytes > bytes) {
+            get_memory_tracker().allocate(subsystem, layer, new_bytes - bytes);
+        } else if (new_bytes < bytes) {
+            get_memory_tracker().release(subsystem, layer, bytes - new_bytes);
+        }
+
+        bytes = new_bytes;
+    }
+};
+
+/*!
+ * \brief Returns the size, in bytes, of the values of the given containers
+ */
+template <typename... C>
+size_t memory_size(const C&... containers) {
+    return (size_t(0) + ... + (containers.size() * sizeof(typename C::value_type)));
+}
+
+/*!
+ * \brief Returns the number of arrays of the size of the parameters kept
+ * by the given updater (excluding the gradients)
+ */
+constexpr size_t updater_state_arrays(updater_type updater) {
+    switch (updater) {
+        case updater_type::SGD:
+            return 0;
+        case updater_type::MOMENTUM:
+        case updater_type::RMSPROP:
+        case updater_type::ADAGRAD:
+        case updater_type::LARS:
+            return 1;
+        case updater_type::NESTEROV:
+        case updater_type::ADAM:
+        case updater_type::ADAMAX:
+            return 2;
+        case updater_type::ADADELTA:
+        case updater_type::LAMB:
+            return 3;
+        case updater_type::ADAM_CORRECT:
+        case updater_type::NADAM:
+            return 4;
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Traits indicating if the sizes of the input and output of a layer
+ * can be queried
+ */
+template <typename Layer, typename Enable = void>
+struct has_layer_sizes : std::false_type {};
+
+/*!
+ * \copydoc has_layer_sizes
+ */
+template <typename Layer>
+struct has_layer_sizes<Layer, std::void_t<decltype(std::declval<const Layer&>().input_size()), decltype(std::declval<const Layer&>().output_size())>> : std::true_type {};
+
+/*!
+ * \brief The predicted memory of the training of a network
+ */
+struct memory_estimate {
+    /*!
+     * \brief The predicted memory of one layer, in bytes
+     */
+    struct layer {
+        std::string name;          ///< The description of the layer
+        size_t weights     = 0;    ///< The trainable parameters
+        size_t activations = 0;    ///< The training context (input, output and errors)
+        size_t gradients   = 0;    ///< The gradients of the parameters
+        size_t optimizer   = 0;    ///< The state of the updater
+        bool known         = true; ///< Indicates if the sizes of the layer are known before allocation
+
+        /*!
+         * \brief Returns the total memory of the layer
+         */
+        size_t total() const {
+            return weights + activations + gradients + optimizer;
+        }
+    };
+
+    std::vector<layer> layers; ///< The estimate of each layer
+
+    /*!
+     * \brief Returns the predicted peak memory of the training, in bytes
+     * (every buffer is alive during the whole training)
+     */
+    size_t peak() const {
+        size_t peak = 0;
+
+        for (auto& l : layers) {
+            peak += l.total();
+        }
+
+        return peak;
+    }
+
+    /*!
+     * \brief Returns the predicted memory of the inference only, in bytes
+     */
+    size_t inference() const {
+        size_t total = 0;
+
+        for (auto& l : layers) {
+            total += l.weights;
+        }
+
+        return total;
+    }
+
+    /*!
+     * \brief Indicates if all the layers could be estimated
+     */
+    bool complete() const {
+        for (auto& l : layers) {
+            if (!l.known) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+/*!
+ * \brief The residency decision of a dataset under a memory budget
+ */
+struct memory_plan {
+    size_t budget  = 0; ///< The memory budget, in bytes (0 for no budget)
+    size_t fixed   = 0; ///< The predicted memory of the training itself, in bytes
+    size_t dataset = 0; ///< The memory taken by the dataset once resident, in bytes
+
+    /*!
+     * \brief Indicates if the dataset can be kept in memory
+     */
+    bool resident() const {
+        return !budget || (fixed <= budget && dataset <= budget - fixed);
+    }
+
+    /*!
+     * \brief Indicates if the dataset must be streamed
+     */
+    bool streaming() const {
+        return !resident();
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,537 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Live export of the training metrics (StatsD and Prometheus).
+ *
+ * The training thread only pushes raw samples (a name, a value and a kind)
+ * into a lock-free single-producer single-consumer ring. A background
+ * exporter thread drains the ring, aggregates the samples (last value of the
+ * gauges, sum of the counters, percentiles of the timings over the last
+ * interval), reads the memory use of the process and publishes everything:
+ * the samples are sent to StatsD over UDP and the aggregates are served to
+ * Prometheus over HTTP (GET /metrics). No formatting, system call or lock is
+ * done on the training thread.
+ *
+ * The endpoints can be configured from the environment:
+ *  - DLL_METRICS_STATSD=host:port
+ *  - DLL_METRICS_PROMETHEUS=port
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief The kind of a metric
+ */
+enum class metric_kind : uint8_t {
+    GAUGE,   ///< The last value is kept
+    COUNTER, ///< The values are summed
+    TIMING   ///< The percentiles of the values are computed (in milliseconds)
+};
+
+/*!
+ * \brief A raw sample of a metric
+ */
+struct metric_sample {
+    const char* name; ///< The name of the metric (a static string)
+    double value;     ///< The value of the sample
+    metric_kind kind; ///< The kind of metric
+};
+
+/*!
+ * \brief Lock-free ring of samples, with a single producer and a single
+ * consumer. When the ring is full, the new samples are dropped (and
+ * counted) rather than blocking the producer.
+ *
+ * \tparam N The capacity of the ring
+ * \tparam T The type of the samples
+ */
+template <size_t N, typename T = metric_sample>
+struct metric_ring {
+    static_assert((N & (N - 1)) == 0, "The size of the ring must be a power of two");
+
+    std::array<T, N> samples;             ///< The samples
+    alignas(64) std::atomic<size_t> head; ///< The next sample to write (producer)
+    alignas(64) std::atomic<size_t> tail; ///< The next sample to read (consumer)
+    std::atomic<size_t> dropped;          ///< The number of samples dropped because the ring was full
+
+    metric_ring() : head(0), tail(0), dropped(0) {}
+
+    /*!
+     * \brief Push a sample (producer only)
+     * \return true if the sample was pushed, false if it was dropped
+     */
+    bool push(const T& sample) {
+        auto h = head.load(std::memory_order_relaxed);
+
+        if (h - tail.load(std::memory_order_acquire) == N) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        samples[h % N] = sample;
+        head.store(h + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /*!
+     * \brief Pop a sample (consumer only)
+     * \return true if a sample was popped, false if the ring is empty
+     */
+    bool pop(T& sample) {
+        auto t = tail.load(std::memory_order_relaxed);
+
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        sample = samples[t % N];
+        tail.store(t + 1, std::memory_order_release);
+
+        return true;
+    }
+};
+
+/*!
+ * \brief The configuration of the metrics exporter
+ */
+struct metrics_config {
+    std::string prefix       = "dll"; ///< The prefix of the names of the metrics
+    std::string statsd_host;          ///< The StatsD host (disabled if empty)
+    uint16_t statsd_port     = 8125;  ///< The StatsD port
+    uint16_t prometheus_port = 0;     ///< The port of the Prometheus endpoint (disabled if 0)
+    size_t interval_ms       = 1000;  ///< The interval between two aggregations
+
+    /*!
+     * \brief Returns the configuration from the environment
+     */
+    static metrics_config from_environment() {
+        metrics_config config;
+
+        if (const char* value = std::getenv("DLL_METRICS_STATSD")) {
+            std::string statsd(value);
+
+            auto colon = statsd.rfind(':');
+
+            config.statsd_host = statsd.substr(0, colon);
+
+            if (colon != std::string::npos) {
+                config.statsd_port = uint16_t(std::atoi(statsd.c_str() + colon + 1));
+            }
+        }
+
+        if (const char* value = std::getenv("DLL_METRICS_PROMETHEUS")) {
+            config.prometheus_port = uint16_t(std::atoi(value));
+        }
+
+        return config;
+    }
+};
+
+/*!
+ * \brief The aggregated value of a metric
+ */
+struct metric_value {
+    std::string name;                  ///< The name of the metric
+    metric_kind kind;                  ///< The kind of the metric
+    double value = 0.0;                ///< The last value (gauge) or the sum (counter)
+    std::vector<double> window;        ///< The timings of the current interval
+    std::array<double, 3> quantiles{}; ///< The 50th, 90th and 99th percentiles of the last interval
+    size_t count = 0;                  ///< The total number of timings
+    double sum   = 0.0;                ///< The total of the timings
+};
+
+/*!
+ * \brief Returns the resident memory of the process, in bytes (0 if it
+ * cannot be read)
+ */
+inline size_t resident_memory() {
+    size_t pages    = 0;
+    size_t resident = 0;
+
+    if (FILE* file = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(file, "%zu %zu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+
+        std::fclose(file);
+    }
+
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+}
+
+/*!
+ * \brief Exporter of the metrics to StatsD and Prometheus, from a background
+ * thread.
+ *
+ * push() must always be called from the same (training) thread.
+ */
+struct metrics_exporter {
+    static constexpr size_t ring_size = 1 << 14; ///< The number of samples that can be waiting
+
+    metrics_config config;            ///< The configuration
+    metric_ring<ring_size> ring;      ///< The samples waiting for the exporter
+    std::vector<metric_value> values; ///< The aggregated values (exporter thread only)
+    double last_samples = 0.0;        ///< The number of samples at the last aggregation
+
+    std::thread thread;               ///< The exporter thread
+    std::atomic<bool> running{false}; ///< Indicates if the exporter thread must continue
+
+    int statsd_socket     = -1;          ///< The UDP socket to StatsD
+    int prometheus_socket = -1;          ///< The listening socket of the Prometheus endpoint
+    sockaddr_storage statsd_address;     ///< The address of StatsD
+    socklen_t statsd_address_length = 0; ///< The length of the address of StatsD
+
+    /*!
+     * \brief Create an exporter with the given configuration
+     */
+    explicit metrics_exporter(metrics_config config = metrics_config::from_environment()) : config(std::move(config)) {}
+
+    metrics_exporter(const metrics_exporter& rhs) = delete;
+    metrics_exporter& operator=(const metrics_exporter& rhs) = delete;
+
+    /*!
+     * \brief Stop the exporter
+     */
+    ~metrics_exporter() {
+        stop();
+    }
+
+    /*!
+     * \brief Push a sample (training thread)
+     */
+    void push(const char* name, double value, metric_kind kind) {
+        ring.push({name, value, kind});
+    }
+
+    /*!
+     * \brief Start the endpoints and the exporter thread
+     */
+    void start() {
+        if (running.load()) {
+            return;
+        }
+
+        open_statsd();
+        open_prometheus();
+
+        running.store(true);
+        thread = std::thread([this] { run(); });
+    }
+
+    /*!
+     * \brief Stop the exporter thread, after exporting the last samples
+     */
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+
+        thread.join();
+
+        if (statsd_socket != -1) {
+            close(statsd_socket);
+            statsd_socket = -1;
+        }
+
+        if (prometheus_socket != -1) {
+            close(prometheus_socket);
+            prometheus_socket = -1;
+        }
+    }
+
+    /*!
+     * \brief Drain the ring, send the samples to StatsD and aggregate them
+     * (exporter thread, or any thread once the exporter is stopped)
+     */
+    void drain() {
+        std::string packet;
+        metric_sample sample;
+
+        while (ring.pop(sample)) {
+            auto& value = find(sample.name, sample.kind);
+
+            switch (sample.kind) {
+                case metric_kind::GAUGE:
+                    value.value = sample.value;
+                    break;
+                case metric_kind::COUNTER:
+                    value.value += sample.value;
+                    break;
+                case metric_kind::TIMING:
+                    value.window.push_back(sample.value);
+                    ++value.count;
+                    value.sum += sample.value;
+                    break;
+            }
+
+            if (statsd_socket != -1) {
+                static constexpr const char* suffix[] = {"g", "c", "ms"};
+
+                char line[256];
+                snprintf(line, 256, "%s.%s:%g|%s\n", config.prefix.c_str(), sample.name, sample.value, suffix[size_t(sample.kind)]);
+
+                // Keep the datagrams under the usual MTU
+                if (packet.size() + std::strlen(line) > 1400) {
+                    send_statsd(packet);
+                    packet.clear();
+                }
+
+                packet += line;
+            }
+        }
+
+        if (!packet.empty()) {
+            send_statsd(packet);
+        }
+    }
+
+    /*!
+     * \brief Aggregate the interval: compute the percentiles of the timings
+     * and the rates of the counters and update the process metrics
+     * \param seconds The duration of the interval
+     */
+    void aggregate(double seconds) {
+        drain();
+
+        for (auto& value : values) {
+            if (value.kind == metric_kind::TIMING && !value.window.empty()) {
+                std::sort(value.window.begin(), value.window.end());
+
+                const double ranks[3] = {0.5, 0.9, 0.99};
+
+                for (size_t i = 0; i < 3; ++i) {
+                    value.quantiles[i] = value.window[std::min(value.window.size() - 1, size_t(ranks[i] * value.window.size()))];
+                }
+
+                value.window.clear();
+            }
+        }
+
+        // The throughput of the interval
+        const double samples = find("samples", metric_kind::COUNTER).value;
+
+        if (seconds > 0.0) {
+            find("samples_per_second", metric_kind::GAUGE).value = (samples - last_samples) / seconds;
+        }
+
+        last_samples = samples;
+
+        find("resident_memory_bytes", metric_kind::GAUGE).value = double(resident_memory());
+        find("dropped_samples", metric_kind::GAUGE).value       = double(ring.dropped.load(std::memory_order_relaxed));
+    }
+
+    /*!
+     * \brief Returns the aggregated metrics in the text format of Prometheus
+     */
+    std::string prometheus_text() const {
+        std::string text;
+        char line[512];
+
+        for (auto& value : values) {
+            auto name = config.prefix + "_" + value.name;
+
+            switch (value.kind) {
+                case metric_kind::GAUGE:
+                    snprintf(line, 512, "# TYPE %s gauge\n%s %.17g\n", name.c_str(), name.c_str(), value.value);
+                    text += line;
+                    break;
+                case metric_kind::COUNTER:
+                    snprintf(line, 512, "# TYPE %s_total counter\n%s_total %.17g\n", name.c_str(), name.c_str(), value.value);
+                    text += line;
+                    break;
+                case metric_kind::TIMING:
+                    snprintf(line, 512, "# TYPE %s_ms summary\n", name.c_str());
+                    text += line;
+
+                    const char* quantiles[3] = {"0.5", "0.9", "0.99"};
+
+                    for (size_t i = 0; i < 3; ++i) {
+                        snprintf(line, 512, "%s_ms{quantile=\"%s\"} %.17g\n", name.c_str(), quantiles[i], value.quantiles[i]);
+                        text += line;
+                    }
+
+                    snprintf(line, 512, "%s_ms_sum %.17g\n%s_ms_count %zu\n", name.c_str(), value.sum, name.c_str(), value.count);
+                    text += line;
+                    break;
+            }
+        }
+
+        return text;
+    }
+
+private:
+    /*!
+     * \brief Returns the aggregated value of the given metric, creating it
+     * if necessary
+     */
+    metric_value& find(const char* name, metric_kind kind) {
+        for (auto& value : values) {
+            if (value.name == name) {
+                return value;
+            }
+        }
+
+        values.emplace_back();
+        values.back().name = name;
+        values.back().kind = kind;
+
+        return values.back();
+    }
+
+    /*!
+     * \brief Open the UDP socket to StatsD, if configured
+     */
+    void open_statsd() {
+        if (config.statsd_host.empty()) {
+            return;
+        }
+
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        addrinfo* result = nullptr;
+
+        if (getaddrinfo(config.statsd_host.c_str(), std::to_string(config.statsd_port).c_str(), &hints, &result) || !result) {
+            std::cerr << "dll: metrics: cannot resolve StatsD host " << config.statsd_host << std::endl;
+            return;
+        }
+
+        statsd_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+
+        std::memcpy(&statsd_address, result->ai_addr, result->ai_addrlen);
+        statsd_address_length = result->ai_addrlen;
+
+        freeaddrinfo(result);
+    }
+
+    /*!
+     * \brief Open the listening socket of the Prometheus endpoint, if
+     * configured
+     */
+    void open_prometheus() {
+        if (!config.prometheus_port) {
+            return;
+        }
+
+        prometheus_socket = socket(AF_INET, SOCK_STREAM, 0);
+
+        int reuse = 1;
+        setsockopt(prometheus_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port        = htons(config.prometheus_port);
+
+        if (bind(prometheus_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) || listen(prometheus_socket, 4)) {
+            std::cerr << "dll: metrics: cannot listen on port " << config.prometheus_port << std::endl;
+            close(prometheus_socket);
+            prometheus_socket = -1;
+        }
+    }
+
+    /*!
+     * \brief Send a packet to StatsD
+     */
+    void send_statsd(const std::string& packet) {
+        sendto(statsd_socket, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr*>(&statsd_address), statsd_address_length);
+    }
+
+    /*!
+     * \brief Answer one scrape of Prometheus
+     */
+    void serve_prometheus() {
+        int client = accept(prometheus_socket, nullptr, nullptr);
+
+        if (client == -1) {
+            return;
+        }
+
+        // The request itself does not matter, there is only one page
+        char request[1024];
+        static_cast<void>(recv(client, request, sizeof(request), 0));
+
+        auto body = prometheus_text();
+
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+        for (size_t sent = 0; sent < response.size();) {
+            auto n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+
+            if (n <= 0) {
+                break;
+            }
+
+            sent += size_t(n);
+        }
+
+        close(client);
+    }
+
+    /*!
+     * \brief The loop of the exporter thread
+     */
+    void run() {
+        auto last = std::chrono::steady_clock::now();
+
+        while (running.load(std::memory_order_relaxed)) {
+            // Wait for a scrape until the next aggregation
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - last).count();
+            auto timeout = std::max<int64_t>(int64_t(config.interval_ms) - elapsed, 0);
+
+            if (prometheus_socket != -1) {
+                pollfd fd{prometheus_socket, POLLIN, 0};
+
+                if (poll(&fd, 1, int(std::min<int64_t>(timeout, 100))) > 0) {
+                    serve_prometheus();
+                }
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(std::min<int64_t>(timeout, 100)));
+            }
+
+            auto now = std::chrono::steady_clock::now();
+
+            if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last).count() >= int64_t(config.interval_ms)) {
+                aggregate(std::chrono::duration<double>(now - last).count());
+                last = now;
+            }
+        }
+
+        // Export the last samples
+        aggregate(std::chrono::duration<double>(std::chrono::steady_clock::now() - last).count());
+    }
+};
+
+} //end of dll namespace
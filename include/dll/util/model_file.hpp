@@ -0,0 +1,328 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Versioned model file format designed to be memory-mapped.
+ *
+ * A file is made of a fixed header, followed by an index with one entry per
+ * tensor (offset, size, checksum and a hash of the description of the layer
+ * owning it) and then by the tensors themselves, each starting on a 64 bytes
+ * boundary. A mapping of the file is shared by all the processes loading the
+ * same model and the layers read their weights directly from the mapping.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief Compute the checksum of the given memory (64-bit, eight bytes at
+ * a time)
+ */
+inline uint64_t model_checksum(const char* data, size_t n) {
+    uint64_t hash = 14695981039346656037UL;
+
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+
+        hash = (hash ^ word) * 1099511628211UL;
+        hash ^= hash >> 29;
+    }
+
+    for (; i < n; ++i) {
+        hash = (hash ^ uint8_t(data[i])) * 1099511628211UL;
+    }
+
+    return hash;
+}
+
+/*!
+ * \brief The header of a model file
+ */
+struct model_file_header {
+    static constexpr uint32_t current_version = 1;  ///< The version of the format
+    static constexpr size_t data_alignment    = 64; ///< The alignment of the tensors
+
+    char magic[4];        ///< The magic number ("DLLM")
+    uint32_t version;     ///< The version of the format
+    uint32_t weight_size; ///< The size of one value of the network, in bytes
+    uint32_t entries;     ///< The number of tensors in the file
+    uint64_t file_size;   ///< The total size of the file
+
+    /*!
+     * \brief Indicates if the header is valid for a file of the given length
+     * \param length The length of the file, in bytes
+     */
+    bool valid(size_t length) const {
+        return std::memcmp(magic, "DLLM", 4) == 0 && version == current_version && file_size <= length;
+    }
+};
+
+/*!
+ * \brief The entry of a tensor in the index of a model file
+ */
+struct model_file_entry {
+    uint64_t offset;   ///< The offset of the tensor in the file
+    uint64_t size;     ///< The size of the tensor, in bytes
+    uint64_t checksum; ///< The checksum of the tensor
+    uint64_t layer;    ///< The hash of the description of the layer owning the tensor
+};
+
+/*!
+ * \brief Indicates if the given file is a model file
+ */
+inline bool is_model_file(const std::string& path) {
+    std::ifstream is(path, std::ifstream::binary);
+
+    char magic[4] = {0, 0, 0, 0};
+    is.read(magic, 4);
+
+    return is && std::memcmp(magic, "DLLM", 4) == 0;
+}
+
+/*!
+ * \brief Writer of a model file.
+ *
+ * The tensors are added in order and the file is written at once.
+ */
+struct model_file_writer {
+    /*!
+     * \brief Add a tensor to the file
+     * \param data The bytes of the tensor
+     * \param layer The description of the layer owning the tensor
+     */
+    void add(std::string data, const std::string& layer) {
+        model_file_entry entry;
+        entry.offset   = 0;
+        entry.size     = data.size();
+        entry.checksum = model_checksum(data.data(), data.size());
+        entry.layer    = model_checksum(layer.data(), layer.size());
+
+        index.push_back(entry);
+        tensors.push_back(std::move(data));
+    }
+
+    /*!
+     * \brief Write the file
+     * \param path The path of the file to write
+     * \param weight_size The size of one value of the network
+     * \return true if the file was completely written, false otherwise
+     */
+    bool write(const std::string& path, size_t weight_size) {
+        auto align = [](size_t offset) {
+            return ((offset + model_file_header::data_alignment - 1) / model_file_header::data_alignment) * model_file_header::data_alignment;
+        };
+
+        model_file_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "DLLM", 4);
+
+        header.version     = model_file_header::current_version;
+        header.weight_size = weight_size;
+        header.entries     = index.size();
+
+        size_t offset = align(sizeof(header) + index.size() * sizeof(model_file_entry));
+
+        for (auto& entry : index) {
+            entry.offset = offset;
+            offset       = align(offset + entry.size);
+        }
+
+        header.file_size = offset;
+
+        std::ofstream os(path, std::ofstream::binary);
+
+        if (!os) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return false;
+        }
+
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(model_file_entry));
+
+        static const char padding[model_file_header::data_alignment] = {};
+
+        size_t position = sizeof(header) + index.size() * sizeof(model_file_entry);
+
+        for (size_t i = 0; i < index.size(); ++i) {
+            os.write(padding, index[i].offset - position);
+            os.write(tensors[i].data(), tensors[i].size());
+
+            position = index[i].offset + index[i].size;
+        }
+
+        os.write(padding, header.file_size - position);
+
+        return bool(os);
+    }
+
+private:
+    std::vector<model_file_entry> index; ///< The index of the tensors
+    std::vector<std::string> tensors;    ///< The bytes of the tensors
+};
+
+/*!
+ * \brief Read-only stream buffer over a range of memory, so that a mapped
+ * tensor can be read without any intermediate copy.
+ */
+struct memory_streambuf : std::streambuf {
+    /*!
+     * \brief Construct a stream buffer over [data, data + n)
+     */
+    memory_streambuf(const char* data, size_t n) {
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + n);
+    }
+
+    /*!
+     * \brief Returns the number of bytes that have been read
+     */
+    size_t consumed() const {
+        return gptr() - eback();
+    }
+};
+
+/*!
+ * \brief A read-only shared mapping of a model file.
+ *
+ * The mapping is shared, so the pages of the same model are only held once
+ * in memory for all the processes using it.
+ */
+struct mapped_model_file {
+    model_file_header header; ///< The header of the file
+
+    /*!
+     * \brief Map the given file and validate its header and index
+     * \param path The path to the model file
+     */
+    explicit mapped_model_file(const std::string& path) {
+        std::memset(&header, 0, sizeof(header));
+
+        fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            std::cerr << "ERROR: Impossible to open " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+
+        if (::fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(header)) {
+            std::cerr << "ERROR: Invalid model file: " << path << std::endl;
+            return;
+        }
+
+        length = st.st_size;
+        memory = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (memory == MAP_FAILED) {
+            memory = nullptr;
+            std::cerr << "ERROR: Impossible to map " << path << std::endl;
+            return;
+        }
+
+        std::memcpy(&header, memory, sizeof(header));
+
+        if (!header.valid(length) || sizeof(header) + header.entries * sizeof(model_file_entry) > length) {
+            std::cerr << "ERROR: Invalid model file: " << path << std::endl;
+            std::memset(&header, 0, sizeof(header));
+            return;
+        }
+
+        index.resize(header.entries);
+        std::memcpy(index.data(), static_cast<const char*>(memory) + sizeof(header), header.entries * sizeof(model_file_entry));
+
+        for (auto& entry : index) {
+            if (entry.offset % model_file_header::data_alignment || entry.offset + entry.size > header.file_size) {
+                std::cerr << "ERROR: Invalid model file: " << path << std::endl;
+                std::memset(&header, 0, sizeof(header));
+                return;
+            }
+        }
+
+        // The tensors are read in order
+        ::madvise(memory, length, MADV_SEQUENTIAL);
+    }
+
+    mapped_model_file(const mapped_model_file& rhs) = delete;
+    mapped_model_file& operator=(const mapped_model_file& rhs) = delete;
+
+    /*!
+     * \brief Unmap the file
+     */
+    ~mapped_model_file() {
+        if (memory) {
+            ::munmap(memory, length);
+        }
+
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /*!
+     * \brief Indicates if the file was correctly mapped
+     */
+    bool valid() const {
+        return header.version == model_file_header::current_version;
+    }
+
+    /*!
+     * \brief Returns the number of tensors of the file
+     */
+    size_t size() const {
+        return index.size();
+    }
+
+    /*!
+     * \brief Returns the entry of the given tensor
+     */
+    const model_file_entry& entry(size_t i) const {
+        return index[i];
+    }
+
+    /*!
+     * \brief Returns a pointer to the bytes of the given tensor
+     */
+    const char* data(size_t i) const {
+        return static_cast<const char*>(memory) + index[i].offset;
+    }
+
+    /*!
+     * \brief Indicates if the given tensor belongs to a layer with the given
+     * description and is not corrupted
+     */
+    bool check(size_t i, const std::string& layer) const {
+        return index[i].layer == model_checksum(layer.data(), layer.size()) && index[i].checksum == model_checksum(data(i), index[i].size);
+    }
+
+private:
+    int fd        = -1;      ///< The file descriptor
+    void* memory  = nullptr; ///< The mapped memory
+    size_t length = 0;       ///< The length of the mapping
+
+    std::vector<model_file_entry> index; ///< The index of the tensors
+};
+
+} //end of dll namespace
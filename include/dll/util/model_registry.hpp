@@ -0,0 +1,269 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Registry of the networks served by a process.
+ *
+ * The networks are loaded from model files and published by name. A lookup
+ * returns a snapshot (a shared pointer) of the current version of a network.
+ * A reload builds the new version on the side and then exchanges the
+ * pointer atomically: the requests in flight keep using the version they
+ * started with, which is released once its last user is done.
+ *
+ * Networks loaded from model files with the same tensors (same checksums
+ * in the index) share the same instance.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "dll/util/model_file.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A registry of networks of the same type, with atomic hot reload.
+ *
+ * The lookups never take a lock: the table of the names is itself a
+ * snapshot replaced atomically when a name is added or removed. Only the
+ * writers (load and remove) are serialized.
+ *
+ * A version is shared by all the requests using it, so the forward passes
+ * on one version must be serialized by the caller if the layers of the
+ * network keep state during inference.
+ *
+ * \tparam DBN The type of the networks
+ */
+template <typename DBN>
+struct model_registry {
+    using network_t = DBN;                        ///< The type of the networks
+    using model_ptr = std::shared_ptr<const DBN>; ///< A version of a network
+
+    /*!
+     * \brief Construct a registry creating the networks with the given functor
+     * \param factory The functor creating an (initialized) empty network
+     */
+    explicit model_registry(std::function<std::unique_ptr<DBN>()> factory = [] { return std::make_unique<DBN>(); })
+            : factory(std::move(factory)), table(std::make_shared<const table_t>()) {}
+
+    model_registry(const model_registry& rhs) = delete;
+    model_registry& operator=(const model_registry& rhs) = delete;
+
+    /*!
+     * \brief Load (or reload) the network of the given name from the given file.
+     *
+     * The current version stays in use until the new one is completely
+     * loaded. If the file cannot be loaded, the current version is kept.
+     *
+     * \param name The name of the network
+     * \param file The model file
+     * \return true if the network was loaded, false otherwise
+     */
+    bool load(const std::string& name, const std::string& file) {
+        auto model = load_model(file);
+
+        if (!model) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> l(writer_lock);
+
+        auto current = std::atomic_load(&table);
+        auto it      = current->find(name);
+
+        if (it != current->end()) {
+            std::atomic_store(&it->second->model, model);
+        } else {
+            auto next  = std::make_shared<table_t>(*current);
+            auto entry = std::make_shared<slot>();
+
+            entry->model  = model;
+            (*next)[name] = entry;
+
+            std::atomic_store(&table, std::shared_ptr<const table_t>(std::move(next)));
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Publish a snapshot of the given network (for instance a
+     * network being trained online) under the given name.
+     *
+     * The network is stored into the given file and the new version is
+     * loaded from it, so the snapshot is independent of the network, which
+     * can go on training. The current version stays in use until the new one
+     * is completely loaded.
+     *
+     * \param name The name of the network
+     * \param network The network to publish
+     * \param file The model file of the snapshot
+     * \return true if the network was published, false otherwise
+     */
+    bool publish(const std::string& name, const DBN& network, const std::string& file) {
+        return network.store(file) && load(name, file);
+    }
+
+    /*!
+     * \brief Returns the current version of the network of the given name
+     * (nullptr if there is none)
+     */
+    model_ptr get(const std::string& name) const {
+        auto current = std::atomic_load(&table);
+        auto it      = current->find(name);
+
+        if (it == current->end()) {
+            return nullptr;
+        }
+
+        return std::atomic_load(&it->second->model);
+    }
+
+    /*!
+     * \brief Remove the network of the given name from the registry
+     * \return true if the network was in the registry, false otherwise
+     */
+    bool remove(const std::string& name) {
+        std::lock_guard<std::mutex> l(writer_lock);
+
+        auto current = std::atomic_load(&table);
+
+        if (!current->count(name)) {
+            return false;
+        }
+
+        auto next = std::make_shared<table_t>(*current);
+        next->erase(name);
+
+        std::atomic_store(&table, std::shared_ptr<const table_t>(std::move(next)));
+
+        return true;
+    }
+
+    /*!
+     * \brief Returns the number of names in the registry
+     */
+    size_t size() const {
+        return std::atomic_load(&table)->size();
+    }
+
+    /*!
+     * \brief Returns the number of distinct networks held by the registry
+     * (and by the requests still using an old version)
+     */
+    size_t instances() const {
+        std::lock_guard<std::mutex> l(blobs_lock);
+
+        size_t n = 0;
+
+        for (auto& blob : blobs) {
+            n += !blob.second.expired();
+        }
+
+        return n;
+    }
+
+private:
+    /*!
+     * \brief The current version of one name
+     */
+    struct slot {
+        model_ptr model; ///< The current version (accessed atomically)
+    };
+
+    using table_t = std::unordered_map<std::string, std::shared_ptr<slot>>;
+
+    /*!
+     * \brief Compute the key identifying the tensors of the given model
+     * file, from its index (0 if it is not a valid model file)
+     */
+    static uint64_t blob_key(const std::string& file) {
+        if (!is_model_file(file)) {
+            return 0;
+        }
+
+        mapped_model_file model(file);
+
+        if (!model.valid()) {
+            return 0;
+        }
+
+        uint64_t key = 14695981039346656037UL ^ model.header.weight_size;
+
+        for (size_t i = 0; i < model.size(); ++i) {
+            key = (key ^ model.entry(i).size) * 1099511628211UL;
+            key = (key ^ model.entry(i).checksum) * 1099511628211UL;
+            key = (key ^ model.entry(i).layer) * 1099511628211UL;
+        }
+
+        return key ? key : 1;
+    }
+
+    /*!
+     * \brief Load the network of the given file, reusing a live network with
+     * the same tensors.
+     */
+    model_ptr load_model(const std::string& file) {
+        auto key = blob_key(file);
+
+        if (key) {
+            std::lock_guard<std::mutex> l(blobs_lock);
+
+            auto it = blobs.find(key);
+
+            if (it != blobs.end()) {
+                if (auto model = it->second.lock()) {
+                    return model;
+                }
+            }
+        }
+
+        std::shared_ptr<DBN> model = factory();
+
+        if (!model->load(file)) {
+            return nullptr;
+        }
+
+        if (key) {
+            std::lock_guard<std::mutex> l(blobs_lock);
+
+            // Forget the networks that are not used anymore
+            for (auto it = blobs.begin(); it != blobs.end();) {
+                it = it->second.expired() ? blobs.erase(it) : std::next(it);
+            }
+
+            auto& blob = blobs[key];
+
+            // Another writer may have loaded the same tensors in the meantime
+            if (auto existing = blob.lock()) {
+                return existing;
+            }
+
+            blob = model;
+        }
+
+        return model;
+    }
+
+    std::function<std::unique_ptr<DBN>()> factory; ///< The factory of the networks
+
+    std::shared_ptr<const table_t> table; ///< The names of the networks (accessed atomically)
+    std::mutex writer_lock;               ///< The lock serializing the writers
+
+    std::unordered_map<uint64_t, std::weak_ptr<const DBN>> blobs; ///< The live networks by their tensors
+    mutable std::mutex blobs_lock;                                 ///< The lock protecting the blobs
+};
+
+} //end of dll namespace
@@ -0,0 +1,175 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Topology of the NUMA nodes and pinning of the threads.
+ *
+ * The nodes are read from /sys/devices/system/node, restricted to the CPUs
+ * the process is allowed to run on. Without NUMA information, all the CPUs
+ * are considered as one node.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace dll {
+
+/*!
+ * \brief Parse a list of CPUs of the kernel ("0-3,8,10-11")
+ */
+inline std::vector<size_t> parse_cpu_list(const std::string& list) {
+    std::vector<size_t> cpus;
+
+    size_t i = 0;
+
+    while (i < list.size()) {
+        size_t end = list.find(',', i);
+
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+
+        const std::string range = list.substr(i, end - i);
+        const size_t dash       = range.find('-');
+
+        try {
+            if (dash == std::string::npos) {
+                cpus.push_back(std::stoul(range));
+            } else {
+                const size_t first = std::stoul(range.substr(0, dash));
+                const size_t last  = std::stoul(range.substr(dash + 1));
+
+                for (size_t cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+        } catch (const std::exception&) {
+            // Ignore the invalid ranges (the trailing new line, for instance)
+        }
+
+        i = end + 1;
+    }
+
+    return cpus;
+}
+
+/*!
+ * \brief Returns the CPUs the process is allowed to run on
+ */
+inline std::vector<size_t> allowed_cpus() {
+    std::vector<size_t> cpus;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (!sched_getaffinity(0, sizeof(set), &set)) {
+        for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+
+    return cpus;
+}
+
+/*!
+ * \brief Returns the allowed CPUs of each NUMA node of the machine (the nodes
+ * without allowed CPUs are not returned)
+ */
+inline const std::vector<std::vector<size_t>>& numa_nodes() {
+    static const std::vector<std::vector<size_t>> nodes = [] {
+        const auto allowed = allowed_cpus();
+
+        std::vector<std::vector<size_t>> nodes;
+
+        for (size_t node = 0;; ++node) {
+            std::ifstream is("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+            if (!is) {
+                break;
+            }
+
+            std::string list;
+            std::getline(is, list);
+
+            std::vector<size_t> cpus;
+
+            for (auto cpu : parse_cpu_list(list)) {
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                    cpus.push_back(cpu);
+                }
+            }
+
+            if (!cpus.empty()) {
+                nodes.push_back(std::move(cpus));
+            }
+        }
+
+        if (nodes.empty()) {
+            nodes.push_back(allowed);
+        }
+
+        return nodes;
+    }();
+
+    return nodes;
+}
+
+/*!
+ * \brief Pin the current thread to the given CPUs
+ * \return true if the thread has been pinned, false otherwise
+ */
+inline bool pin_thread(const std::vector<size_t>& cpus) {
+    if (cpus.empty()) {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (auto cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    return !sched_setaffinity(0, sizeof(set), &set);
+}
+
+/*!
+ * \brief Pin the given thread to the given CPUs
+ * \return true if the thread has been pinned, false otherwise
+ */
+inline bool pin_thread(std::thread& thread, const std::vector<size_t>& cpus) {
+    if (cpus.empty() || !thread.joinable()) {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (auto cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    return !pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+} //end of dll namespace
@@ -0,0 +1,164 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Single-sweep probabilistic max pooling kernel
+ */
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+#include "dll/util/random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Probabilistic max pooling of a batch of hidden units.
+ *
+ * For each C x C block of each image, the block softmax (with one extra
+ * "all-off" state), the pooled activation and the samples are computed in a
+ * single sweep over the block. The maximum of the block is subtracted
+ * before the exponentials, so that large activations cannot overflow.
+ *
+ * The hidden samples are drawn from the multinomial distribution of the
+ * block, so at most one unit of a block is on, and the pooling unit is on
+ * exactly when one of the units of the block is on.
+ *
+ * The images are processed in parallel when the tensor is large enough,
+ * unless the kernel is called from a serial section.
+ *
+ * \param h The hidden units (Batch x K x NH1 x NH2), containing the
+ * convolutions on input and the activation probabilities on output
+ * \param h_s The hidden samples, or nullptr
+ * \param p_a The pooled activation probabilities, or nullptr
+ * \param p_s The pooled samples, or nullptr
+ * \param b The biases of the K filters
+ * \param batch The number of samples
+ * \param k The number of filters
+ * \param nh1 The first dimension of the hidden units
+ * \param nh2 The second dimension of the hidden units
+ * \param c The pooling factor
+ * \param scale The factor applied to the biased activations
+ */
+template <typename T>
+void p_max_pool_kernel(T* h, T* h_s, T* p_a, T* p_s, const T* b, size_t batch, size_t k, size_t nh1, size_t nh2, size_t c, T scale) {
+    const size_t np1    = nh1 / c;
+    const size_t np2    = nh2 / c;
+    const size_t images = batch * k;
+    const bool sample   = h_s || p_s;
+
+    auto work = [=](size_t first, size_t last, fast_uniform_generator& g) {
+        std::vector<T> u(np1 * np2);
+
+        for (size_t i = first; i < last; ++i) {
+            const T bias = b[i % k];
+
+            T* hi = h + i * nh1 * nh2;
+
+            if (sample) {
+                g.generate(u.data(), u.size());
+            }
+
+            for (size_t p1 = 0; p1 < np1; ++p1) {
+                for (size_t p2 = 0; p2 < np2; ++p2) {
+                    T* block = hi + p1 * c * nh2 + p2 * c;
+
+                    // The maximum includes the "all-off" state (x = 0)
+                    T m = T(0);
+
+                    for (size_t a = 0; a < c; ++a) {
+                        for (size_t d = 0; d < c; ++d) {
+                            T& x = block[a * nh2 + d];
+
+                            x = scale * (x + bias);
+                            m = std::max(m, x);
+                        }
+                    }
+
+                    const T off = std::exp(-m);
+                    T sum       = off;
+
+                    for (size_t a = 0; a < c; ++a) {
+                        for (size_t d = 0; d < c; ++d) {
+                            T& x = block[a * nh2 + d];
+
+                            x = std::exp(x - m);
+                            sum += x;
+                        }
+                    }
+
+                    const T inv     = T(1) / sum;
+                    const T r       = sample ? u[p1 * np2 + p2] : T(1);
+                    const size_t pi = (i * np1 + p1) * np2 + p2;
+
+                    T cumulative = T(0);
+                    bool on      = false;
+
+                    for (size_t a = 0; a < c; ++a) {
+                        for (size_t d = 0; d < c; ++d) {
+                            const size_t j = a * nh2 + d;
+
+                            block[j] *= inv;
+
+                            if (h_s) {
+                                const bool selected = !on && r < cumulative + block[j];
+
+                                h_s[(block - h) + j] = selected ? T(1) : T(0);
+                                on                   = on || selected;
+                            }
+
+                            cumulative += block[j];
+                        }
+                    }
+
+                    if (p_a) {
+                        p_a[pi] = T(1) - off * inv;
+                    }
+
+                    if (p_s) {
+                        p_s[pi] = r < cumulative ? T(1) : T(0);
+                    }
+                }
+            }
+        }
+    };
+
+    auto& engine = dll::rand_engine();
+
+    const bool parallel  = can_parallelize() && nh1 * nh2 * images >= (1UL << 15);
+    const size_t threads = parallel ? std::min(kernel_threads(), images) : 1;
+
+    // Each thread has its own stream, split from a single draw of the engine
+    const random_stream stream(uint64_t(engine()) << 32 | uint64_t(engine()));
+
+    std::vector<fast_uniform_generator> generators;
+    generators.reserve(threads);
+
+    for (size_t t = 0; t < threads; ++t) {
+        generators.emplace_back(stream.split(t));
+    }
+
+    if (threads == 1) {
+        work(0, images, generators[0]);
+        return;
+    }
+
+    parallel_chunks(images, threads, [&](size_t t, size_t first, size_t last) {
+        work(first, last, generators[t]);
+    });
+}
+
+} //end of dll namespace
@@ -0,0 +1,248 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Products of small batches with pre-packed weights, for the dense
+ * layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Engine computing the forward (input * W) and backward
+ * (errors * W^T) products of a dense layer for small batches, with the
+ * weights packed into panels.
+ *
+ * A panel holds a block of columns of the matrix, row after row, so that
+ * the product of a few samples with a panel is a single contiguous sweep
+ * over it, with all the outputs of the block accumulated in registers. The
+ * panels of the weights and of their transpose are packed the first time
+ * they are used and then cached. They are only packed again once they have
+ * been invalidated (after the weights have been changed). During inference
+ * the weights never change, so the panels are packed once.
+ *
+ * Large batches are left to the BLAS kernels, which amortize their own
+ * packing over the batch.
+ */
+template <typename T>
+struct packed_dense_engine {
+    static constexpr size_t panel     = 16; ///< The number of columns of a panel
+    static constexpr size_t rows      = 4;  ///< The number of samples computed together
+    static constexpr size_t max_batch = 16; ///< The largest batch computed with the panels
+
+    /*!
+     * \brief Indicates if the products are computed by the engine, with
+     * CUBLAS they are left to CUBLAS
+     */
+    static constexpr bool supported = !etl::cublas_enabled;
+
+    packed_dense_engine() = default;
+
+    /*!
+     * \brief Copying an engine does not copy its panels, they are packed
+     * again on the next product
+     */
+    packed_dense_engine(const packed_dense_engine& /*rhs*/) {}
+
+    /*!
+     * \brief Copying an engine does not copy its panels, they are packed
+     * again on the next product
+     */
+    packed_dense_engine& operator=(const packed_dense_engine& /*rhs*/) {
+        invalidate();
+        return *this;
+    }
+
+    /*!
+     * \brief Invalidate the panels, they will be packed again before the
+     * next product
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+        forward_valid  = false;
+        backward_valid = false;
+    }
+
+    /*!
+     * \brief Compute out = in * w
+     *
+     * \param out The output (n x h)
+     * \param in The input (n x v)
+     * \param w The weights (v x h)
+     * \param n The number of samples
+     */
+    template <typename W>
+    void forward(T* out, const T* in, const W& w, size_t n) {
+        const size_t v = etl::dim<0>(w);
+        const size_t h = etl::dim<1>(w);
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (!forward_valid) {
+                pack(forward_panels, w, false);
+                forward_valid = true;
+            }
+        }
+
+        multiply(out, in, forward_panels.data(), n, v, h);
+    }
+
+    /*!
+     * \brief Compute out = errors * w^T
+     *
+     * \param out The output (n x v)
+     * \param errors The errors (n x h)
+     * \param w The weights (v x h)
+     * \param n The number of samples
+     */
+    template <typename W>
+    void backward(T* out, const T* errors, const W& w, size_t n) {
+        const size_t v = etl::dim<0>(w);
+        const size_t h = etl::dim<1>(w);
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            if (!backward_valid) {
+                pack(backward_panels, w, true);
+                backward_valid = true;
+            }
+        }
+
+        multiply(out, errors, backward_panels.data(), n, h, v);
+    }
+
+private:
+    std::mutex lock;             ///< The lock protecting the panels
+    bool forward_valid  = false; ///< Indicates if the panels of the weights are up to date
+    bool backward_valid = false; ///< Indicates if the panels of the transposed weights are up to date
+
+    std::vector<T> forward_panels;  ///< The panels of the weights (v x h)
+    std::vector<T> backward_panels; ///< The panels of the transposed weights (h x v)
+
+    /*!
+     * \brief Pack the weights (or their transpose) into panels, the last
+     * panel being padded with zeroes
+     */
+    template <typename W>
+    static void pack(std::vector<T>& panels, const W& w, bool transposed) {
+        const size_t v = etl::dim<0>(w);
+        const size_t h = etl::dim<1>(w);
+
+        const size_t depth = transposed ? h : v;
+        const size_t width = transposed ? v : h;
+
+        const size_t n_panels = (width + panel - 1) / panel;
+
+        panels.resize(n_panels * depth * panel);
+
+        w.ensure_cpu_up_to_date();
+
+        const T* w_m = w.memory_start();
+        T* p_m       = panels.data();
+
+        parallel_range(n_panels, depth * width, [=](size_t first, size_t last) {
+            for (size_t p = first; p < last; ++p) {
+                T* current = p_m + p * depth * panel;
+
+                for (size_t k = 0; k < depth; ++k) {
+                    for (size_t j = 0; j < panel; ++j) {
+                        const size_t c = p * panel + j;
+
+                        if (c >= width) {
+                            current[k * panel + j] = T(0);
+                        } else {
+                            current[k * panel + j] = transposed ? w_m[c * h + k] : w_m[k * h + c];
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    /*!
+     * \brief Compute the product of R samples with a panel
+     *
+     * \param out The first output of the block
+     * \param in The first input of the block
+     * \param current The panel
+     * \param depth The size of an input
+     * \param width The size of an output
+     * \param columns The number of (valid) columns of the panel
+     */
+    template <size_t R>
+    static void block(T* out, const T* in, const T* current, size_t depth, size_t width, size_t columns) {
+        T acc[R][panel] = {};
+
+        for (size_t k = 0; k < depth; ++k) {
+            const T* row = current + k * panel;
+
+            for (size_t r = 0; r < R; ++r) {
+                const T x = in[r * depth + k];
+
+                for (size_t j = 0; j < panel; ++j) {
+                    acc[r][j] += x * row[j];
+                }
+            }
+        }
+
+        for (size_t r = 0; r < R; ++r) {
+            std::copy(acc[r], acc[r] + columns, out + r * width);
+        }
+    }
+
+    /*!
+     * \brief Compute out (n x width) = in (n x depth) * M (depth x width),
+     * with M packed into panels, the panels being split between the threads
+     */
+    static void multiply(T* out, const T* in, const T* panels, size_t n, size_t depth, size_t width) {
+        const size_t n_panels = (width + panel - 1) / panel;
+
+        parallel_range(n_panels, n * depth * width, [=](size_t first, size_t last) {
+            for (size_t p = first; p < last; ++p) {
+                const T* current     = panels + p * depth * panel;
+                const size_t columns = std::min(panel, width - p * panel);
+
+                T* out_p = out + p * panel;
+
+                size_t i = 0;
+
+                for (; i + rows <= n; i += rows) {
+                    block<rows>(out_p + i * width, in + i * depth, current, depth, width, columns);
+                }
+
+                switch (n - i) {
+                    case 3:
+                        block<3>(out_p + i * width, in + i * depth, current, depth, width, columns);
+                        break;
+                    case 2:
+                        block<2>(out_p + i * width, in + i * depth, current, depth, width, columns);
+                        break;
+                    case 1:
+                        block<1>(out_p + i * width, in + i * depth, current, depth, width, columns);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        });
+    }
+};
+
+} //end of dll namespace
@@ -0,0 +1,247 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Split of the raw kernels between the threads of the scheduler, and
+ * of the work between the NUMA nodes
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/scheduler.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Returns the number of threads the raw kernels can use.
+ *
+ * This is the DLL_THREADS environment variable when set (dllp sets it for
+ * each of its parallel tasks), otherwise the number of CPUs the process is
+ * allowed to run on.
+ */
+inline size_t thread_budget() {
+    static const size_t budget = [] {
+        if (const char* value = std::getenv("DLL_THREADS")) {
+            auto threads = std::atol(value);
+
+            if (threads > 0) {
+                return size_t(threads);
+            }
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        if (!sched_getaffinity(0, sizeof(set), &set) && CPU_COUNT(&set) > 0) {
+            return size_t(CPU_COUNT(&set));
+        }
+
+        return size_t(std::max(1U, std::thread::hardware_concurrency()));
+    }();
+
+    return budget;
+}
+
+/*!
+ * \brief Returns the limit of threads of the raw kernels for the current
+ * thread (0 for no limit). This is set by the tuning of the layers.
+ */
+inline size_t& thread_limit() {
+    static thread_local size_t limit = 0;
+    return limit;
+}
+
+/*!
+ * \brief Returns the scheduler shared by all the parallel components of the
+ * library, with one worker less than the thread budget (the thread waiting
+ * for the tasks runs them as well)
+ */
+inline task_scheduler& get_scheduler() {
+    static task_scheduler scheduler(thread_budget() - 1);
+    return scheduler;
+}
+
+/*!
+ * \brief Returns the scheduler of the given NUMA node, whose workers are
+ * pinned to the CPUs of the node. The thread budget is split between the
+ * nodes.
+ */
+inline task_scheduler& get_node_scheduler(size_t node) {
+    static const auto schedulers = [] {
+        auto& nodes = numa_nodes();
+
+        std::vector<std::unique_ptr<task_scheduler>> schedulers;
+
+        for (auto& cpus : nodes) {
+            const size_t workers = std::max(size_t(1), std::min(cpus.size(), thread_budget() / nodes.size()));
+
+            schedulers.push_back(std::make_unique<task_scheduler>(workers, cpus));
+        }
+
+        return schedulers;
+    }();
+
+    return *schedulers[node % schedulers.size()];
+}
+
+/*!
+ * \brief Returns the scheduler of the current thread: the scheduler of the
+ * running task, if any, or the shared scheduler
+ */
+inline task_scheduler& local_scheduler() {
+    auto* scheduler = task_scheduler::current();
+    return scheduler ? *scheduler : get_scheduler();
+}
+
+/*!
+ * \brief Returns the number of threads the raw kernels can use from the
+ * current thread: the threads of its scheduler that are not reserved,
+ * reduced to the thread limit, if any.
+ */
+inline size_t kernel_threads() {
+    const size_t limit   = thread_limit();
+    const size_t threads = local_scheduler().concurrency();
+    return limit ? std::min(limit, threads) : threads;
+}
+
+/*!
+ * \brief Indicates if the raw kernels can be parallelized from the current
+ * thread.
+ *
+ * Inside a serial section, the caller is already running in parallel, except
+ * for the tasks of the scheduler, whose nested loops are scheduled as any
+ * other task, and for the threads within a resource budget, which only make
+ * ETL serial.
+ */
+inline bool can_parallelize() {
+    return !etl::local_context().serial || task_scheduler::current();
+}
+
+/*!
+ * \brief Run work(chunk, first, last) over the range [0, n) split into the
+ * given number of chunks, in tasks of the local scheduler. The first chunk
+ * is run by the current thread.
+ *
+ * \param n The size of the range
+ * \param chunks The number of chunks
+ * \param work The functor to run on each chunk
+ */
+template <typename Functor>
+void parallel_chunks(size_t n, size_t chunks, Functor&& work) {
+    const size_t per_chunk = (n + chunks - 1) / chunks;
+
+    task_group group(local_scheduler());
+
+    for (size_t c = 1; c < chunks; ++c) {
+        const size_t first = std::min(n, c * per_chunk);
+        const size_t last  = std::min(n, first + per_chunk);
+
+        if (first < last) {
+            group.run([&work, c, first, last] { work(c, first, last); });
+        }
+    }
+
+    work(size_t(0), size_t(0), std::min(n, per_chunk));
+
+    group.wait();
+}
+
+/*!
+ * \brief Run work(i) for each i in [0, n), each in a task of the local
+ * scheduler. The first index is run by the current thread.
+ *
+ * \param n The number of indices
+ * \param work The functor to run on each index
+ */
+template <typename Functor>
+void parallel_for(size_t n, Functor&& work) {
+    if (!n) {
+        return;
+    }
+
+    task_group group(local_scheduler());
+
+    for (size_t i = 1; i < n; ++i) {
+        group.run([&work, i] { work(i); });
+    }
+
+    work(size_t(0));
+
+    group.wait();
+}
+
+/*!
+ * \brief Run work(node) for each node in [0, n), in a task of the scheduler
+ * of the NUMA node, and wait for all of them without running them on the
+ * current thread. The first exception of the nodes is rethrown.
+ *
+ * \param n The number of nodes
+ * \param work The functor to run on each node
+ */
+template <typename Functor>
+void parallel_nodes(size_t n, Functor&& work) {
+    std::vector<std::unique_ptr<task_group>> groups;
+
+    for (size_t node = 0; node < n; ++node) {
+        groups.push_back(std::make_unique<task_group>(get_node_scheduler(node)));
+        groups.back()->run([&work, node] { work(node); });
+    }
+
+    std::exception_ptr error;
+
+    for (auto& group : groups) {
+        try {
+            group->join();
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/*!
+ * \brief Run work(first, last) over the range [0, n), split between threads
+ * if the total work is large enough.
+ *
+ * \param n The size of the range
+ * \param cost The total number of values processed by the work
+ * \param work The functor to run on each sub range
+ */
+template <typename Functor>
+void parallel_range(size_t n, size_t cost, Functor&& work) {
+    const bool parallel  = can_parallelize() && n > 1 && cost >= (1UL << 15);
+    const size_t threads = parallel ? std::min(kernel_threads(), n) : 1;
+
+    if (threads == 1) {
+        work(size_t(0), n);
+        return;
+    }
+
+    parallel_chunks(n, threads, [&work](size_t /*chunk*/, size_t first, size_t last) {
+        work(first, last);
+    });
+}
+
+} //end of dll namespace
@@ -0,0 +1,217 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Hardware performance counters of the timed scopes.
+ *
+ * When DLL_PERF_COUNTERS is defined (Linux only), each thread opens a group
+ * of counters with perf_event_open (cycles, instructions, last level cache
+ * misses and packed vector operations) and each auto_timer records the
+ * counts of its scope next to its duration. The counters only count the
+ * user-space code of the calling thread, so they work with the default
+ * perf_event_paranoid setting.
+ *
+ * The vector operations are counted with a raw event, by default the
+ * FP_ARITH_INST_RETIRED packed events of Intel processors (Skylake and
+ * later). It can be changed by defining DLL_PERF_VECTOR_EVENT to another
+ * raw event. The counters that cannot be opened are reported as missing.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#ifdef DLL_PERF_COUNTERS
+
+#include <cstring>
+#include <utility>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef DLL_PERF_VECTOR_EVENT
+// FP_ARITH_INST_RETIRED.{128B,256B}_PACKED_{DOUBLE,SINGLE}
+#define DLL_PERF_VECTOR_EVENT 0x3CC7
+#endif
+
+#endif
+
+namespace dll {
+
+constexpr size_t perf_events = 4; ///< The number of hardware counters
+
+/*!
+ * \brief The names of the hardware counters
+ */
+inline const char* perf_event_name(size_t event) {
+    static constexpr const char* names[perf_events] = {"Cycles", "Instructions", "LLC misses", "Vector ops"};
+    return names[event];
+}
+
+/*!
+ * \brief The values of the hardware counters at one point in time
+ */
+struct perf_sample {
+    std::array<uint64_t, perf_events> values{}; ///< The value of each counter
+};
+
+#ifdef DLL_PERF_COUNTERS
+
+/*!
+ * \brief The group of hardware counters of one thread
+ */
+struct perf_counters {
+    int leader = -1;                           ///< The descriptor of the group leader (-1 if unavailable)
+    std::array<int, perf_events> descriptors;  ///< The descriptor of each counter (-1 if unavailable)
+    std::array<size_t, perf_events> positions; ///< The position of each counter in the group
+    size_t opened = 0;                         ///< The number of counters in the group
+
+    /*!
+     * \brief Open the counters of the calling thread
+     */
+    perf_counters() {
+        descriptors.fill(-1);
+        positions.fill(0);
+
+        const std::array<std::pair<uint32_t, uint64_t>, perf_events> events = {{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_RAW, uint64_t(DLL_PERF_VECTOR_EVENT)}
+        }};
+
+        for (size_t i = 0; i < perf_events; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+
+            attr.size           = sizeof(attr);
+            attr.type           = events[i].first;
+            attr.config         = events[i].second;
+            attr.disabled       = leader == -1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_GROUP;
+
+            int fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0));
+
+            if (fd == -1) {
+                // Without the cycles, there is no group at all
+                if (leader == -1) {
+                    return;
+                }
+
+                continue;
+            }
+
+            if (leader == -1) {
+                leader = fd;
+            }
+
+            descriptors[i] = fd;
+            positions[i]   = opened++;
+        }
+
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    perf_counters(const perf_counters& rhs) = delete;
+    perf_counters& operator=(const perf_counters& rhs) = delete;
+
+    /*!
+     * \brief Close the counters
+     */
+    ~perf_counters() {
+        for (auto fd : descriptors) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+    }
+
+    /*!
+     * \brief Indicates if the given counter is available
+     */
+    bool available(size_t event) const {
+        return descriptors[event] != -1;
+    }
+
+    /*!
+     * \brief Read the current values of the counters, with one system call
+     */
+    perf_sample read() const {
+        perf_sample sample;
+
+        if (leader == -1) {
+            return sample;
+        }
+
+        // The number of counters followed by their values
+        std::array<uint64_t, perf_events + 1> buffer{};
+
+        if (::read(leader, buffer.data(), sizeof(buffer)) <= 0) {
+            return sample;
+        }
+
+        for (size_t i = 0; i < perf_events; ++i) {
+            if (descriptors[i] != -1) {
+                sample.values[i] = buffer[1 + positions[i]];
+            }
+        }
+
+        return sample;
+    }
+};
+
+/*!
+ * \brief Returns the hardware counters of the calling thread
+ */
+inline perf_counters& local_perf_counters() {
+    static thread_local perf_counters counters;
+    return counters;
+}
+
+/*!
+ * \brief Read the hardware counters of the calling thread
+ */
+inline perf_sample read_perf_counters() {
+    return local_perf_counters().read();
+}
+
+/*!
+ * \brief Indicates if the given hardware counter can be read by the calling
+ * thread
+ */
+inline bool perf_counter_available(size_t event) {
+    return local_perf_counters().available(event);
+}
+
+#else
+
+/*!
+ * \brief Read the hardware counters of the calling thread (always zero since
+ * the counters are disabled)
+ */
+inline perf_sample read_perf_counters() {
+    return {};
+}
+
+/*!
+ * \brief Indicates if the given hardware counter can be read (never since the
+ * counters are disabled)
+ */
+inline bool perf_counter_available(size_t /*event*/) {
+    return false;
+}
+
+#endif
+
+} //end of dll namespace
@@ -0,0 +1,158 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Partition of a network into pipeline stages and schedule of the
+ * micro-batches through the stages.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace dll {
+
+/*!
+ * \brief The order of the passes of the micro-batches on each stage
+ */
+enum class pipeline_schedule {
+    GPIPE,      ///< All the forward passes, then all the backward passes (GPipe)
+    ONE_F_ONE_B ///< One forward pass and one backward pass, once the pipeline is full (1F1B)
+};
+
+/*!
+ * \brief One pass of one micro-batch on a stage
+ */
+struct pipeline_pass {
+    bool forward; ///< Indicates if the pass is a forward pass (backward pass otherwise)
+    size_t micro; ///< The micro-batch
+};
+
+/*!
+ * \brief Returns the passes of the given stage, in order.
+ *
+ * On each stage, the forward passes are done in the order of the
+ * micro-batches and the backward passes as well. With 1F1B, the stage s
+ * does stages - s - 1 forward passes before alternating one forward pass
+ * and one backward pass, so that at most stages - s micro-batches wait for
+ * their backward pass on the stage.
+ *
+ * \param schedule The schedule of the pipeline
+ * \param stage The stage
+ * \param stages The number of stages
+ * \param micros The number of micro-batches
+ */
+inline std::vector<pipeline_pass> pipeline_passes(pipeline_schedule schedule, size_t stage, size_t stages, size_t micros) {
+    std::vector<pipeline_pass> passes;
+
+    const size_t warmup = schedule == pipeline_schedule::GPIPE ? micros : std::min(stages - stage - 1, micros);
+
+    size_t forwards  = 0;
+    size_t backwards = 0;
+
+    for (; forwards < warmup; ++forwards) {
+        passes.push_back({true, forwards});
+    }
+
+    while (backwards < micros) {
+        if (forwards < micros) {
+            passes.push_back({true, forwards++});
+        }
+
+        passes.push_back({false, backwards++});
+    }
+
+    return passes;
+}
+
+/*!
+ * \brief Split the layers into stages of consecutive layers with balanced
+ * costs.
+ *
+ * \param costs The cost of each layer
+ * \param stages The number of stages
+ * \return The first layer of each stage, followed by the number of layers
+ */
+inline std::vector<size_t> balance_stages(const std::vector<size_t>& costs, size_t stages) {
+    const size_t layers = costs.size();
+
+    stages = std::max<size_t>(1, std::min(stages, layers));
+
+    size_t total = 0;
+
+    for (auto cost : costs) {
+        total += cost;
+    }
+
+    std::vector<size_t> bounds(1, 0);
+
+    size_t acc = 0;
+
+    for (size_t l = 0; l < layers && bounds.size() < stages; ++l) {
+        acc += costs[l];
+
+        // Each stage needs at least one layer
+        const size_t remaining = stages - bounds.size();
+
+        if ((acc * stages >= total * bounds.size() && l + 1 < layers) || layers - l - 1 == remaining) {
+            bounds.push_back(l + 1);
+        }
+    }
+
+    bounds.push_back(layers);
+
+    return bounds;
+}
+
+/*!
+ * \brief The completed passes of the micro-batches on each stage, shared by
+ * the threads of the stages.
+ */
+struct pipeline_board {
+    /*!
+     * \brief Create a board for the given number of stages and
+     * micro-batches, with no completed pass
+     */
+    pipeline_board(size_t stages, size_t micros) : micros(micros), forwarded(stages * micros, false), backwarded(stages * micros, false) {}
+
+    /*!
+     * \brief Mark the pass of the micro-batch on the stage as completed
+     */
+    void done(bool forward, size_t stage, size_t micro) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+
+            (forward ? forwarded : backwarded)[stage * micros + micro] = true;
+        }
+
+        condition.notify_all();
+    }
+
+    /*!
+     * \brief Wait for the pass of the micro-batch on the stage
+     */
+    void wait(bool forward, size_t stage, size_t micro) {
+        std::unique_lock<std::mutex> l(lock);
+
+        auto& passes = forward ? forwarded : backwarded;
+
+        condition.wait(l, [&] { return bool(passes[stage * micros + micro]); });
+    }
+
+private:
+    size_t micros;                     ///< The number of micro-batches
+    std::vector<bool> forwarded;       ///< The completed forward passes
+    std::vector<bool> backwarded;      ///< The completed backward passes
+    std::mutex lock;                   ///< The lock of the board
+    std::condition_variable condition; ///< Notified at each completed pass
+};
+
+} //end of dll namespace
@@ -0,0 +1,199 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Placement of the layers of a network on the CPU or on the GPU.
+ *
+ * With GPU support (ETL_GPU), the layers placed on the CPU evaluate their
+ * kernels on the CPU. Without GPU support, all the layers are on the CPU and
+ * the placement has no effect.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The profiled costs of one layer, in milliseconds
+ */
+struct placement_costs {
+    double gpu      = 0.0; ///< The time of a training batch of the layer on the GPU
+    double cpu      = 0.0; ///< The time of a training batch of the layer on the CPU
+    double transfer = 0.0; ///< The time to move the output of the layer to the other device, and its errors back
+};
+
+/*!
+ * \brief Returns the time of a training batch of the layers with the given
+ * placement, transfers included.
+ *
+ * The batches come from the GPU (see device_batches), so a first layer on
+ * the CPU pays the transfer of the input.
+ *
+ * \param costs The profiled costs of each layer
+ * \param cpu The layers placed on the CPU
+ * \param input The time to move the input batch to the CPU
+ */
+inline double placement_time(const std::vector<placement_costs>& costs, const std::vector<bool>& cpu, double input = 0.0) {
+    double time = 0.0;
+
+    for (size_t l = 0; l < costs.size(); ++l) {
+        time += cpu[l] ? costs[l].cpu : costs[l].gpu;
+
+        if (l == 0 ? cpu[l] : cpu[l] != cpu[l - 1]) {
+            time += l == 0 ? input : costs[l - 1].transfer;
+        }
+    }
+
+    return time;
+}
+
+/*!
+ * \brief Returns the placement of the layers minimizing the time of a
+ * training batch, transfers included (see placement_time()).
+ *
+ * The placement is chosen with dynamic programming over the layers, with
+ * the device of the previous layer as state.
+ *
+ * \param costs The profiled costs of each layer
+ * \param input The time to move the input batch to the CPU
+ * \return The layers placed on the CPU
+ */
+inline std::vector<bool> best_placement(const std::vector<placement_costs>& costs, double input = 0.0) {
+    const size_t layers = costs.size();
+
+    std::vector<bool> cpu(layers, false);
+
+    if (!layers) {
+        return cpu;
+    }
+
+    // The best time of the layers [0, l], with the layer l on each device
+    // (0 for the GPU, 1 for the CPU), and the device of the previous layer
+    std::vector<std::pair<double, double>> best(layers);
+    std::vector<std::pair<bool, bool>> from(layers);
+
+    best[0] = {costs[0].gpu, costs[0].cpu + input};
+
+    for (size_t l = 1; l < layers; ++l) {
+        const double t = costs[l - 1].transfer;
+
+        const double gpu_gpu = best[l - 1].first;
+        const double cpu_gpu = best[l - 1].second + t;
+        const double gpu_cpu = best[l - 1].first + t;
+        const double cpu_cpu = best[l - 1].second;
+
+        best[l].first  = costs[l].gpu + std::min(gpu_gpu, cpu_gpu);
+        best[l].second = costs[l].cpu + std::min(gpu_cpu, cpu_cpu);
+
+        from[l] = {cpu_gpu < gpu_gpu, cpu_cpu <= gpu_cpu};
+    }
+
+    // Walk back from the best device of the last layer
+
+    bool device = best[layers - 1].second < best[layers - 1].first;
+
+    for (size_t l = layers; l-- > 0;) {
+        cpu[l] = device;
+        device = device ? from[l].second : from[l].first;
+    }
+
+    return cpu;
+}
+
+/*!
+ * \brief Evaluate the kernels on the device of a layer for the duration of
+ * the scope.
+ *
+ * A scope forced on the CPU (a CPU lane of a batch server for instance)
+ * stays on the CPU.
+ */
+struct placement_scope {
+    /*!
+     * \brief Evaluate on the CPU if cpu is set, on the current device
+     * otherwise
+     */
+    explicit placement_scope(bool cpu) {
+#ifdef ETL_GPU
+        previous                 = etl::local_context().cpu;
+        etl::local_context().cpu = previous || cpu;
+#else
+        cpp_unused(cpu);
+#endif
+    }
+
+    placement_scope(const placement_scope& rhs) = delete;
+    placement_scope& operator=(const placement_scope& rhs) = delete;
+
+    /*!
+     * \brief Restore the previous device
+     */
+    ~placement_scope() {
+#ifdef ETL_GPU
+        etl::local_context().cpu = previous;
+#endif
+    }
+
+private:
+    bool previous = false; ///< The previous state of the CPU evaluation
+};
+
+/*!
+ * \brief Make the given values up to date on the device of a layer.
+ *
+ * Within a segment of layers on the same device, the values are already up
+ * to date and nothing is moved. The transfers only happen at the boundaries
+ * of the placement.
+ */
+template <typename E>
+void place_values(bool cpu, const E& values) {
+#ifdef ETL_GPU
+    if (cpu) {
+        values.ensure_cpu_up_to_date();
+    } else {
+        values.ensure_gpu_up_to_date();
+    }
+#else
+    cpp_unused(cpu);
+    cpp_unused(values);
+#endif
+}
+
+/*!
+ * \brief Traits indicating if a context holds the placement of its layer
+ */
+template <typename Context, typename Enable = void>
+struct has_placement : std::false_type {};
+
+/*!
+ * \copydoc has_placement
+ */
+template <typename Context>
+struct has_placement<Context, std::void_t<decltype(std::declval<const Context&>().cpu)>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the layer of the given context is placed on the CPU
+ */
+template <typename Context>
+bool placed_on_cpu([[maybe_unused]] const Context& context) {
+    if constexpr (has_placement<Context>::value) {
+        return context.cpu;
+    } else {
+        return false;
+    }
+}
+
+} //end of dll namespace
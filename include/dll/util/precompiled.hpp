@@ -0,0 +1,31 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Explicit instantiation of the common layer configurations
+ *
+ * The layer headers declare their common configurations (single precision)
+ * with DLL_PRECOMPILED_TEMPLATE. By default, this does nothing. If
+ * DLL_PRECOMPILED is defined, they are declared extern and are not
+ * instantiated again in each translation unit, but must be linked from the
+ * precompiled library (src/precompiled). This library is compiled with
+ * DLL_PRECOMPILED_INSTANTIATION, which explicitly instantiates them.
+ *
+ * The library and its users must be compiled with the same flags (the ETL
+ * and DLL modes).
+ */
+
+#pragma once
+
+#if defined(DLL_PRECOMPILED_INSTANTIATION)
+#define DLL_PRECOMPILED_TEMPLATE(...) template __VA_ARGS__;
+#elif defined(DLL_PRECOMPILED)
+#define DLL_PRECOMPILED_TEMPLATE(...) extern template __VA_ARGS__;
+#else
+#define DLL_PRECOMPILED_TEMPLATE(...)
+#endif
@@ -0,0 +1,417 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Structured pruning of the dense and convolutional layers and
+ * block-sparse storage of the weights of the dense layers.
+ *
+ * The structured pruning removes the whole hidden units of the dense layers
+ * and the whole filters of the convolutional layers with the smallest L2
+ * norms, by setting their weights and bias to zero. The pruned units can
+ * then be removed from the network by compacting it into a dynamic network.
+ * The block-sparse storage only keeps the non-zero blocks of the weights of
+ * a dense layer, making the forward propagation of unstructured sparse
+ * weights faster.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <numeric>
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/layer_traits.hpp"
+#include "dll/util/winograd_conv.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A gradual schedule of the structured pruning during fine-tuning.
+ *
+ * The ratio of pruned units grows from zero at the start epoch up to the
+ * final ratio at the end epoch, following a cubic curve: most of the units
+ * are pruned early, when the network can still recover from it.
+ */
+struct pruning_schedule {
+    double ratio     = 0.0; ///< The final ratio of pruned units (0.0 to disable)
+    size_t start     = 0;   ///< The first epoch of pruning
+    size_t end       = 0;   ///< The epoch at which the final ratio is reached
+    size_t frequency = 1;   ///< The number of epochs between two pruning steps
+
+    /*!
+     * \brief Indicates if the pruning is enabled
+     */
+    bool enabled() const {
+        return ratio > 0.0;
+    }
+
+    /*!
+     * \brief Indicates if the units must be pruned at the end of the given
+     * epoch
+     */
+    bool step(size_t epoch) const {
+        return enabled() && epoch >= start && (epoch >= end || (epoch - start) % std::max(frequency, size_t(1)) == 0);
+    }
+
+    /*!
+     * \brief Returns the ratio of pruned units at the end of the given epoch
+     */
+    double ratio_at(size_t epoch) const {
+        if (!enabled() || epoch < start) {
+            return 0.0;
+        }
+
+        if (epoch >= end) {
+            return ratio;
+        }
+
+        const double t = double(epoch - start + 1) / double(end - start + 1);
+
+        return ratio * (1.0 - std::pow(1.0 - t, 3.0));
+    }
+};
+
+/*!
+ * \brief Indicates if the units of the given layer can be pruned (standard
+ * dense and convolutional layers)
+ */
+template <typename Layer>
+constexpr bool is_prunable_layer() {
+    return decay_layer_traits<Layer>::is_standard_dense_layer() || decay_layer_traits<Layer>::is_standard_convolutional_layer();
+}
+
+namespace prune_detail {
+
+/*!
+ * \brief Returns the number of units (hidden units or filters) of the layer
+ */
+template <typename Layer>
+size_t units(const Layer& layer) {
+    if constexpr (decay_layer_traits<Layer>::is_dense_layer()) {
+        return etl::dim<1>(layer.w);
+    } else {
+        return etl::dim<0>(layer.w);
+    }
+}
+
+/*!
+ * \brief Returns the number of inputs (visible units or channels) of the layer
+ */
+template <typename Layer>
+size_t inputs(const Layer& layer) {
+    if constexpr (decay_layer_traits<Layer>::is_dense_layer()) {
+        return etl::dim<0>(layer.w);
+    } else {
+        return etl::dim<1>(layer.w);
+    }
+}
+
+/*!
+ * \brief Returns the dimensions of the input images of a convolutional layer
+ */
+template <typename Layer>
+std::pair<size_t, size_t> visible_dims(const Layer& layer) {
+    if constexpr (decay_layer_traits<Layer>::is_dynamic()) {
+        return {layer.nv1, layer.nv2};
+    } else {
+        cpp_unused(layer);
+
+        return {Layer::NV1, Layer::NV2};
+    }
+}
+
+/*!
+ * \brief Returns the squared L2 norm of the weights of each unit of the
+ * layer.
+ */
+template <typename Layer>
+std::vector<double> norms(const Layer& layer) {
+    const size_t n = units(layer);
+
+    std::vector<double> result(n, 0.0);
+
+    if constexpr (decay_layer_traits<Layer>::is_dense_layer()) {
+        for (size_t i = 0; i < etl::dim<0>(layer.w); ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                result[j] += double(layer.w(i, j)) * double(layer.w(i, j));
+            }
+        }
+    } else {
+        const size_t s = etl::size(layer.w) / n;
+
+        for (size_t k = 0; k < n; ++k) {
+            const auto* wk = layer.w.memory_start() + k * s;
+
+            for (size_t i = 0; i < s; ++i) {
+                result[k] += double(wk[i]) * double(wk[i]);
+            }
+        }
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Set the weights and the bias of the given unit of the layer to zero
+ */
+template <typename Layer>
+void clear_unit(Layer& layer, size_t unit) {
+    if constexpr (decay_layer_traits<Layer>::is_dense_layer()) {
+        for (size_t i = 0; i < etl::dim<0>(layer.w); ++i) {
+            layer.w(i, unit) = 0;
+        }
+    } else {
+        layer.w(unit) = 0;
+    }
+
+    layer.b[unit] = 0;
+}
+
+} //end of namespace prune_detail
+
+/*!
+ * \brief Returns the units of the layer that have not been pruned (the units
+ * with at least one non-zero weight or a non-zero bias).
+ */
+template <typename Layer>
+std::vector<size_t> kept_units(const Layer& layer) {
+    auto n = prune_detail::norms(layer);
+
+    std::vector<size_t> kept;
+
+    for (size_t u = 0; u < n.size(); ++u) {
+        if (n[u] > 0.0 || layer.b[u] != 0) {
+            kept.push_back(u);
+        }
+    }
+
+    return kept;
+}
+
+/*!
+ * \brief Prune the units with the smallest norms of the given layer, until
+ * the given ratio of its units is pruned.
+ *
+ * The units already pruned count in the ratio, so that the pruning can be
+ * applied gradually.
+ *
+ * \param layer The layer to prune
+ * \param ratio The ratio of units to prune
+ *
+ * \return The number of pruned units of the layer
+ */
+template <typename Layer>
+size_t prune_units(Layer& layer, double ratio) {
+    auto n = prune_detail::norms(layer);
+
+    const size_t units = n.size();
+
+    // Always keep at least one unit
+    const size_t target = std::min(size_t(std::round(ratio * units)), units - 1);
+
+    std::vector<size_t> order(units);
+    std::iota(order.begin(), order.end(), 0);
+
+    std::stable_sort(order.begin(), order.end(), [&n](size_t a, size_t b) { return n[a] < n[b]; });
+
+    for (size_t i = 0; i < target; ++i) {
+        prune_detail::clear_unit(layer, order[i]);
+    }
+
+    dll::invalidate_transforms(layer);
+
+    return target;
+}
+
+/*!
+ * \brief Prune the BxB blocks of weights with the smallest norms of the
+ * given dense layer, until the given ratio of its blocks is pruned.
+ *
+ * Unlike the pruning of the units, the shape of the layer cannot be
+ * reduced, but the pruned weights can be stored in block_sparse_weights.
+ *
+ * \param layer The dense layer to prune
+ * \param ratio The ratio of blocks to prune
+ *
+ * \return The number of pruned blocks of the layer
+ */
+template <size_t B = 4, typename Layer>
+size_t prune_blocks(Layer& layer, double ratio) {
+    static_assert(decay_layer_traits<Layer>::is_dense_layer(), "Only the weights of dense layers can be pruned by blocks");
+
+    const size_t visible = etl::dim<0>(layer.w);
+    const size_t hidden  = etl::dim<1>(layer.w);
+
+    const size_t rows    = (visible + B - 1) / B;
+    const size_t columns = (hidden + B - 1) / B;
+
+    std::vector<double> n(rows * columns, 0.0);
+
+    for (size_t i = 0; i < visible; ++i) {
+        for (size_t j = 0; j < hidden; ++j) {
+            n[(i / B) * columns + j / B] += double(layer.w(i, j)) * double(layer.w(i, j));
+        }
+    }
+
+    const size_t target = size_t(std::round(ratio * n.size()));
+
+    std::vector<size_t> order(n.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    std::stable_sort(order.begin(), order.end(), [&n](size_t a, size_t b) { return n[a] < n[b]; });
+
+    for (size_t k = 0; k < target; ++k) {
+        const size_t br = order[k] / columns;
+        const size_t bc = order[k] % columns;
+
+        for (size_t i = br * B; i < std::min(visible, (br + 1) * B); ++i) {
+            for (size_t j = bc * B; j < std::min(hidden, (bc + 1) * B); ++j) {
+                layer.w(i, j) = 0;
+            }
+        }
+    }
+
+    return target;
+}
+
+/*!
+ * \brief Block-sparse (BSR) weights of a dense layer.
+ *
+ * The weights (visible x hidden) are split into blocks of BxB values and
+ * only the blocks with at least one non-zero value are stored, row of
+ * blocks by row of blocks. The forward propagation only multiplies the
+ * stored blocks.
+ *
+ * \tparam T The type of the weights
+ * \tparam B The size of the blocks
+ */
+template <typename T, size_t B = 4>
+struct block_sparse_weights {
+    static constexpr size_t block = B; ///< The size of the blocks
+
+    size_t visible = 0;    ///< The number of visible units
+    size_t hidden  = 0;    ///< The number of hidden units
+    bool enabled   = true; ///< Indicates if the block-sparse path is used
+
+    std::vector<size_t> row_start; ///< The first block of each row of blocks
+    std::vector<size_t> columns;   ///< The column of blocks of each block
+    std::vector<T> values;         ///< The values of the blocks (BxB, row-major)
+
+    /*!
+     * \brief Returns the number of rows of blocks
+     */
+    size_t block_rows() const {
+        return (visible + B - 1) / B;
+    }
+
+    /*!
+     * \brief Returns the number of columns of blocks
+     */
+    size_t block_columns() const {
+        return (hidden + B - 1) / B;
+    }
+
+    /*!
+     * \brief Returns the ratio of stored blocks
+     */
+    double density() const {
+        const size_t total = block_rows() * block_columns();
+
+        return total ? double(columns.size()) / double(total) : 0.0;
+    }
+
+    /*!
+     * \brief Compress the given weights
+     * \param w The weights of the layer (visible x hidden)
+     */
+    template <typename W>
+    void compress(const W& w) {
+        visible = etl::dim<0>(w);
+        hidden  = etl::dim<1>(w);
+
+        row_start.assign(1, 0);
+        columns.clear();
+        values.clear();
+
+        for (size_t br = 0; br < block_rows(); ++br) {
+            for (size_t bc = 0; bc < block_columns(); ++bc) {
+                bool zero = true;
+
+                for (size_t i = br * B; i < std::min(visible, (br + 1) * B); ++i) {
+                    for (size_t j = bc * B; j < std::min(hidden, (bc + 1) * B); ++j) {
+                        zero = zero && w(i, j) == T(0);
+                    }
+                }
+
+                if (zero) {
+                    continue;
+                }
+
+                columns.push_back(bc);
+
+                for (size_t i = br * B; i < (br + 1) * B; ++i) {
+                    for (size_t j = bc * B; j < (bc + 1) * B; ++j) {
+                        values.push_back(i < visible && j < hidden ? T(w(i, j)) : T(0));
+                    }
+                }
+            }
+
+            row_start.push_back(columns.size());
+        }
+    }
+
+    /*!
+     * \brief Compute the (pre-activation) output of the layer
+     * \param output The output batch (Batch x hidden)
+     * \param input The input batch (Batch x visible)
+     */
+    template <typename O, typename I>
+    void forward(O&& output, const I& input) const {
+        const size_t batch = etl::dim<0>(input);
+
+        const size_t vp = block_rows() * B;
+        const size_t hp = block_columns() * B;
+
+        // The rows are padded to a multiple of the blocks
+        std::vector<T> x(vp, T(0));
+        std::vector<T> h(hp);
+
+        for (size_t s = 0; s < batch; ++s) {
+            for (size_t i = 0; i < visible; ++i) {
+                x[i] = input[s * visible + i];
+            }
+
+            std::fill(h.begin(), h.end(), T(0));
+
+            for (size_t br = 0; br < block_rows(); ++br) {
+                const T* xb = x.data() + br * B;
+
+                for (size_t k = row_start[br]; k < row_start[br + 1]; ++k) {
+                    const T* v = values.data() + k * B * B;
+                    T* hb      = h.data() + columns[k] * B;
+
+                    for (size_t i = 0; i < B; ++i) {
+                        for (size_t j = 0; j < B; ++j) {
+                            hb[j] += xb[i] * v[i * B + j];
+                        }
+                    }
+                }
+            }
+
+            for (size_t j = 0; j < hidden; ++j) {
+                output[s * hidden + j] = h[j];
+            }
+        }
+    }
+};
+
+} //end of dll namespace
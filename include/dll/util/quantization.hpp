@@ -0,0 +1,458 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Post-training INT8 quantization support for dense and
+ * convolutional layers and quantized tables for embedding layers.
+ *
+ * The weights are quantized symmetrically with one scale per output (hidden
+ * unit or filter). The inputs are quantized symmetrically with one scale per
+ * layer, computed from the activation ranges recorded during calibration.
+ * The products are accumulated in 32 bits integers and then scaled back to
+ * floating point, before the biases and activation are applied.
+ *
+ * The embedding tables are quantized row-wise (8 or 4 bits), with a scale
+ * and an offset per row, and the rows are dequantized while being gathered.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+namespace quant_detail {
+
+/*!
+ * \brief Compute the symmetric quantization scale for the given absolute max
+ */
+inline float scale_of(float absmax) {
+    return absmax > 0.0f ? absmax / 127.0f : 1.0f;
+}
+
+/*!
+ * \brief Quantize one value with the given inverse scale
+ */
+inline int8_t quantize(float value, float inv_scale) {
+    return int8_t(std::max(-127.0f, std::min(127.0f, std::round(value * inv_scale))));
+}
+
+/*!
+ * \brief Quantize a complete (flat) expression into the given vector
+ */
+template <typename E>
+void quantize_all(std::vector<int8_t>& q, const E& input, float scale) {
+    const size_t n = etl::size(input);
+    const float inv_scale = 1.0f / scale;
+
+    q.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        q[i] = quantize(input[i], inv_scale);
+    }
+}
+
+} //end of quant_detail namespace
+
+/*!
+ * \brief Quantized weights of a dense layer.
+ */
+struct quantized_dense_weights {
+    size_t visible = 0;        ///< The number of visible units
+    size_t hidden  = 0;        ///< The number of hidden units
+    float input_scale = 1.0f;  ///< The scale of the input
+    bool enabled = true;       ///< Indicates if the quantized path is used
+
+    std::vector<int8_t> w;     ///< The quantized weights, transposed (hidden x visible)
+    std::vector<float> scales; ///< The scale of each hidden unit
+
+    /*!
+     * \brief Quantize the given weights
+     * \param weights The weights of the layer (visible x hidden)
+     * \param input_absmax The maximum absolute value of the input during calibration
+     */
+    template <typename W>
+    void quantize(const W& weights, float input_absmax) {
+        visible     = etl::dim<0>(weights);
+        hidden      = etl::dim<1>(weights);
+        input_scale = quant_detail::scale_of(input_absmax);
+
+        w.resize(visible * hidden);
+        scales.resize(hidden);
+
+        for (size_t j = 0; j < hidden; ++j) {
+            float absmax = 0.0f;
+
+            for (size_t i = 0; i < visible; ++i) {
+                absmax = std::max(absmax, std::abs(float(weights(i, j))));
+            }
+
+            scales[j] = quant_detail::scale_of(absmax);
+
+            const float inv_scale = 1.0f / scales[j];
+
+            for (size_t i = 0; i < visible; ++i) {
+                w[j * visible + i] = quant_detail::quantize(weights(i, j), inv_scale);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the (pre-activation) output of the layer
+     * \param output The output batch (B x hidden)
+     * \param input The input batch (B x visible)
+     */
+    template <typename O, typename I>
+    void forward(O&& output, const I& input) const {
+        const size_t B = etl::dim<0>(input);
+
+        std::vector<int8_t> qx;
+        quant_detail::quantize_all(qx, input, input_scale);
+
+        for (size_t b = 0; b < B; ++b) {
+            const int8_t* x = qx.data() + b * visible;
+
+            for (size_t j = 0; j < hidden; ++j) {
+                const int8_t* wj = w.data() + j * visible;
+
+                int32_t acc = 0;
+
+                for (size_t i = 0; i < visible; ++i) {
+                    acc += int32_t(x[i]) * int32_t(wj[i]);
+                }
+
+                output[b * hidden + j] = float(acc) * (input_scale * scales[j]);
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Quantized weights of a (valid) convolutional layer.
+ */
+struct quantized_conv_weights {
+    size_t k  = 0;            ///< The number of filters
+    size_t c  = 0;            ///< The number of input channels
+    size_t w1 = 0;            ///< The first dimension of the filters
+    size_t w2 = 0;            ///< The second dimension of the filters
+    float input_scale = 1.0f; ///< The scale of the input
+    bool enabled = true;      ///< Indicates if the quantized path is used
+
+    std::vector<int8_t> w;     ///< The quantized filters (K x C x W1 x W2)
+    std::vector<float> scales; ///< The scale of each filter
+
+    /*!
+     * \brief Quantize the given filters
+     * \param weights The filters of the layer (K x C x W1 x W2)
+     * \param input_absmax The maximum absolute value of the input during calibration
+     */
+    template <typename W>
+    void quantize(const W& weights, float input_absmax) {
+        k  = etl::dim<0>(weights);
+        c  = etl::dim<1>(weights);
+        w1 = etl::dim<2>(weights);
+        w2 = etl::dim<3>(weights);
+
+        input_scale = quant_detail::scale_of(input_absmax);
+
+        const size_t filter = c * w1 * w2;
+
+        w.resize(k * filter);
+        scales.resize(k);
+
+        for (size_t kk = 0; kk < k; ++kk) {
+            float absmax = 0.0f;
+
+            for (size_t i = 0; i < filter; ++i) {
+                absmax = std::max(absmax, std::abs(float(weights[kk * filter + i])));
+            }
+
+            scales[kk] = quant_detail::scale_of(absmax);
+
+            const float inv_scale = 1.0f / scales[kk];
+
+            for (size_t i = 0; i < filter; ++i) {
+                w[kk * filter + i] = quant_detail::quantize(weights[kk * filter + i], inv_scale);
+            }
+        }
+    }
+
+    /*!
+     * \brief Compute the (pre-activation) output of the layer
+     * \param output The output batch (B x K x H1 x H2)
+     * \param input The input batch (B x C x V1 x V2)
+     * \param v1 The first dimension of the input
+     * \param v2 The second dimension of the input
+     */
+    template <typename O, typename I>
+    void forward(O&& output, const I& input, size_t v1, size_t v2) const {
+        const size_t B  = etl::dim<0>(input);
+        const size_t h1 = v1 - w1 + 1;
+        const size_t h2 = v2 - w2 + 1;
+
+        std::vector<int8_t> qx;
+        quant_detail::quantize_all(qx, input, input_scale);
+
+        for (size_t b = 0; b < B; ++b) {
+            const int8_t* x = qx.data() + b * c * v1 * v2;
+
+            for (size_t kk = 0; kk < k; ++kk) {
+                const int8_t* f = w.data() + kk * c * w1 * w2;
+                const float s   = input_scale * scales[kk];
+
+                for (size_t i = 0; i < h1; ++i) {
+                    for (size_t j = 0; j < h2; ++j) {
+                        int32_t acc = 0;
+
+                        for (size_t cc = 0; cc < c; ++cc) {
+                            for (size_t m = 0; m < w1; ++m) {
+                                const int8_t* xr = x + (cc * v1 + i + m) * v2 + j;
+                                const int8_t* fr = f + (cc * w1 + m) * w2;
+
+                                for (size_t n = 0; n < w2; ++n) {
+                                    acc += int32_t(xr[n]) * int32_t(fr[n]);
+                                }
+                            }
+                        }
+
+                        output[((b * k + kk) * h1 + i) * h2 + j] = float(acc) * s;
+                    }
+                }
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Row-wise quantized table of an embedding layer.
+ *
+ * Each row is quantized asymmetrically on 8 or 4 bits, with its own scale
+ * and offset (the minimum of the row): value = offset + scale * q. With 4
+ * bits, two values are packed per byte (the first in the low nibble).
+ */
+struct quantized_embedding_table {
+    size_t bits = 8;     ///< The number of bits per value (8 or 4)
+    size_t rows = 0;     ///< The number of rows (vocabulary size)
+    size_t cols = 0;     ///< The number of columns (embedding size)
+    size_t stride = 0;   ///< The number of bytes of one quantized row
+    bool enabled = true; ///< Indicates if the quantized path is used
+
+    std::vector<uint8_t> q;     ///< The quantized rows (rows x stride)
+    std::vector<float> scales;  ///< The scale of each row
+    std::vector<float> offsets; ///< The offset of each row
+
+    /*!
+     * \brief Quantize the given table
+     * \param weights The table of the layer (rows x cols)
+     * \param b The number of bits per value (8 or 4)
+     */
+    template <typename W>
+    void quantize(const W& weights, size_t b = 8) {
+        cpp_assert(b == 8 || b == 4, "Embedding tables can only be quantized on 8 or 4 bits");
+
+        bits   = b;
+        rows   = etl::dim<0>(weights);
+        cols   = etl::dim<1>(weights);
+        stride = bits == 8 ? cols : (cols + 1) / 2;
+
+        q.assign(rows * stride, 0);
+        scales.resize(rows);
+        offsets.resize(rows);
+
+        weights.ensure_cpu_up_to_date();
+
+        const auto* w   = weights.memory_start();
+        const float top = bits == 8 ? 255.0f : 15.0f;
+
+        for (size_t r = 0; r < rows; ++r) {
+            const auto* row = w + r * cols;
+
+            float lo = cols ? float(row[0]) : 0.0f;
+            float hi = lo;
+
+            for (size_t c = 1; c < cols; ++c) {
+                lo = std::min(lo, float(row[c]));
+                hi = std::max(hi, float(row[c]));
+            }
+
+            scales[r]  = hi > lo ? (hi - lo) / top : 1.0f;
+            offsets[r] = lo;
+
+            const float inv_scale = 1.0f / scales[r];
+
+            uint8_t* qr = q.data() + r * stride;
+
+            for (size_t c = 0; c < cols; ++c) {
+                auto v = uint8_t(std::max(0.0f, std::min(top, std::round((float(row[c]) - lo) * inv_scale))));
+
+                if (bits == 8) {
+                    qr[c] = v;
+                } else {
+                    qr[c / 2] |= (c % 2) ? uint8_t(v << 4) : v;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the quantized value of the given column of a row
+     */
+    uint8_t value(const uint8_t* qr, size_t c) const {
+        return bits == 8 ? qr[c] : uint8_t((qr[c / 2] >> ((c % 2) * 4)) & 0xF);
+    }
+
+    /*!
+     * \brief Gather and dequantize the rows of the given indices
+     * \param out The output, one row of cols values per index
+     * \param input The indices of the rows
+     */
+    template <typename O, typename In>
+    void gather(O& out, const In& input) const {
+        const size_t m = etl::size(input);
+
+        cpp_assert(etl::size(out) == m * cols, "Invalid output of rows gathering");
+
+        input.ensure_cpu_up_to_date();
+
+        for (size_t i = 0; i < m; ++i) {
+            const size_t r = input[i];
+
+            cpp_assert(r < rows, "Invalid index for rows gathering");
+
+            const uint8_t* qr = q.data() + r * stride;
+            const float s     = scales[r];
+            const float o     = offsets[r];
+
+            if constexpr (etl::is_dma<O>) {
+                auto* row = out.memory_start() + i * cols;
+
+                for (size_t c = 0; c < cols; ++c) {
+                    row[c] = o + s * value(qr, c);
+                }
+            } else {
+                for (size_t c = 0; c < cols; ++c) {
+                    out[i * cols + c] = o + s * value(qr, c);
+                }
+            }
+        }
+
+        if constexpr (etl::is_dma<O>) {
+            out.invalidate_gpu();
+        }
+    }
+
+    /*!
+     * \brief Returns the memory of the quantized table, in bytes
+     */
+    size_t memory() const {
+        return q.size() + (scales.size() + offsets.size()) * sizeof(float);
+    }
+
+    /*!
+     * \brief Serialize the quantized table into a string of bytes
+     */
+    std::string serialize() const {
+        const uint64_t header[3] = {bits, rows, cols};
+
+        std::string data(sizeof(header) + 2 * rows * sizeof(float) + q.size(), '\0');
+
+        char* out = &data[0];
+
+        std::memcpy(out, header, sizeof(header));
+        out += sizeof(header);
+
+        std::memcpy(out, scales.data(), rows * sizeof(float));
+        out += rows * sizeof(float);
+
+        std::memcpy(out, offsets.data(), rows * sizeof(float));
+        out += rows * sizeof(float);
+
+        std::memcpy(out, q.data(), q.size());
+
+        return data;
+    }
+
+    /*!
+     * \brief Load the quantized table from the given bytes
+     * \param data The serialized table
+     * \param n The number of bytes
+     * \return true if the table was loaded, false if the bytes are invalid
+     */
+    bool deserialize(const char* data, size_t n) {
+        uint64_t header[3];
+
+        if (n < sizeof(header)) {
+            return false;
+        }
+
+        std::memcpy(header, data, sizeof(header));
+
+        if (header[0] != 8 && header[0] != 4) {
+            return false;
+        }
+
+        const size_t s = header[0] == 8 ? header[2] : (header[2] + 1) / 2;
+
+        if (n != sizeof(header) + 2 * header[1] * sizeof(float) + header[1] * s) {
+            return false;
+        }
+
+        bits   = header[0];
+        rows   = header[1];
+        cols   = header[2];
+        stride = s;
+
+        scales.resize(rows);
+        offsets.resize(rows);
+        q.resize(rows * stride);
+
+        data += sizeof(header);
+
+        std::memcpy(scales.data(), data, rows * sizeof(float));
+        data += rows * sizeof(float);
+
+        std::memcpy(offsets.data(), data, rows * sizeof(float));
+        data += rows * sizeof(float);
+
+        std::memcpy(q.data(), data, q.size());
+
+        enabled = true;
+
+        return true;
+    }
+};
+
+/*!
+ * \brief Traits to test if a layer supports INT8 quantization
+ */
+template <typename Layer, typename Enable = void>
+struct is_quantizable_layer : std::false_type {};
+
+template <typename Layer>
+struct is_quantizable_layer<Layer, std::void_t<decltype(std::declval<Layer&>().quantized)>> : std::true_type {};
+
+/*!
+ * \brief Traits to test if a layer has a quantizable embedding table
+ */
+template <typename Layer, typename Enable = void>
+struct is_quantizable_embedding : std::false_type {};
+
+template <typename Layer>
+struct is_quantizable_embedding<Layer, std::void_t<decltype(std::declval<Layer&>().quantized_table)>> : std::true_type {};
+
+} //end of dll namespace
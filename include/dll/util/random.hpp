@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
 #include <random>
 
 namespace dll {
@@ -62,4 +66,375 @@ inline random_engine& rand_engine(){
     return engine;
 }
 
+/*!
+ * \brief Philox4x32-10 counter-based generator.
+ *
+ * The values are a pure function of the counter and of the key, so the same
+ * random values can be generated again later (or by several threads at
+ * once, on different counters) without storing them and without any shared
+ * state.
+ *
+ * \param ctr The counter, replaced by the four random values
+ * \param key The key (seed)
+ */
+inline void philox_4x32(uint32_t (&ctr)[4], uint64_t key) {
+    uint32_t k0 = uint32_t(key);
+    uint32_t k1 = uint32_t(key >> 32);
+
+    for (size_t r = 0; r < 10; ++r) {
+        const uint64_t p0 = uint64_t(0xD2511F53) * ctr[0];
+        const uint64_t p1 = uint64_t(0xCD9E8D57) * ctr[2];
+
+        const uint32_t c0 = uint32_t(p1 >> 32) ^ ctr[1] ^ k0;
+        const uint32_t c2 = uint32_t(p0 >> 32) ^ ctr[3] ^ k1;
+
+        ctr[0] = c0;
+        ctr[1] = uint32_t(p1);
+        ctr[2] = c2;
+        ctr[3] = uint32_t(p0);
+
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+}
+
+/*!
+ * \brief Mix the bits of the given value (splitmix64 finalizer)
+ */
+inline uint64_t mix_key(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/*!
+ * \brief A splittable stream of random values, based on Philox4x32-10.
+ *
+ * The n-th value of a stream is a pure function of its key and of n, so a
+ * stream gives the same values regardless of the thread that uses it.
+ * Independent streams are derived from a parent stream with split, with a
+ * logical id (a layer, an epoch, a batch, ...), never from a thread id, so
+ * that parallel runs are reproducible for a given dll::seed().
+ *
+ * The stream is a UniformRandomBitGenerator and can be used with the
+ * standard distributions. The bulk functions generate the values of
+ * several counters at once, which the compiler can vectorize.
+ */
+struct random_stream {
+    using result_type = uint32_t; ///< The type of the generated values
+
+    static constexpr size_t lanes = 8; ///< The number of counters generated together in bulk
+
+    /*!
+     * \brief Create a stream with the given key
+     */
+    explicit random_stream(uint64_t key = 0) : key(key) {}
+
+    /*!
+     * \brief Returns the minimum generated value
+     */
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    /*!
+     * \brief Returns the maximum generated value
+     */
+    static constexpr result_type max() {
+        return 0xFFFFFFFF;
+    }
+
+    /*!
+     * \brief Returns the next random value of the stream
+     */
+    result_type operator()() {
+        if (index == 4) {
+            uint32_t ctr[4] = {uint32_t(counter), uint32_t(counter >> 32), 0, 0};
+
+            philox_4x32(ctr, key);
+
+            std::copy(ctr, ctr + 4, buffer);
+
+            ++counter;
+            index = 0;
+        }
+
+        return buffer[index++];
+    }
+
+    /*!
+     * \brief Derive an independent stream from this one
+     * \param id The logical id of the child stream
+     */
+    random_stream split(uint64_t id) const {
+        return random_stream(mix_key(key ^ mix_key(id + 1)));
+    }
+
+    /*!
+     * \brief Returns the key of the stream
+     */
+    uint64_t stream_key() const {
+        return key;
+    }
+
+    /*!
+     * \brief Fill the given memory with n random bits.
+     *
+     * The bulk functions start on a new counter, the values remaining from
+     * the last call to operator() are skipped.
+     */
+    void bits(uint32_t* out, size_t n) {
+        const size_t blocks = (n + 3) / 4;
+
+        size_t b = 0;
+
+        for (; b + lanes <= blocks; b += lanes) {
+            uint32_t c0[lanes];
+            uint32_t c1[lanes];
+            uint32_t c2[lanes];
+            uint32_t c3[lanes];
+
+            for (size_t l = 0; l < lanes; ++l) {
+                c0[l] = uint32_t(counter + l);
+                c1[l] = uint32_t((counter + l) >> 32);
+                c2[l] = 0;
+                c3[l] = 0;
+            }
+
+            uint32_t k0 = uint32_t(key);
+            uint32_t k1 = uint32_t(key >> 32);
+
+            // The same rounds as philox_4x32, on all the lanes at once
+            for (size_t r = 0; r < 10; ++r) {
+                for (size_t l = 0; l < lanes; ++l) {
+                    const uint64_t p0 = uint64_t(0xD2511F53) * c0[l];
+                    const uint64_t p1 = uint64_t(0xCD9E8D57) * c2[l];
+
+                    c0[l] = uint32_t(p1 >> 32) ^ c1[l] ^ k0;
+                    c1[l] = uint32_t(p1);
+                    c2[l] = uint32_t(p0 >> 32) ^ c3[l] ^ k1;
+                    c3[l] = uint32_t(p0);
+                }
+
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+
+            for (size_t l = 0; l < lanes; ++l) {
+                store(out, n, 4 * (b + l), c0[l], c1[l], c2[l], c3[l]);
+            }
+
+            counter += lanes;
+        }
+
+        for (; b < blocks; ++b) {
+            uint32_t ctr[4] = {uint32_t(counter), uint32_t(counter >> 32), 0, 0};
+
+            philox_4x32(ctr, key);
+
+            store(out, n, 4 * b, ctr[0], ctr[1], ctr[2], ctr[3]);
+
+            ++counter;
+        }
+
+        index = 4;
+    }
+
+    /*!
+     * \brief Fill the given memory with n uniform values in [a, b)
+     */
+    template <typename T>
+    void uniform(T* out, size_t n, T a = T(0), T b = T(1)) {
+        generate(out, n, [a, b](uint32_t x) {
+            return a + (b - a) * T((x >> 8) * (1.0 / 16777216.0));
+        });
+    }
+
+    /*!
+     * \brief Fill the given memory with n values drawn from a Bernoulli
+     * distribution of probability p (1 with a probability p, 0 otherwise)
+     */
+    template <typename T>
+    void bernoulli(T* out, size_t n, double p) {
+        const uint64_t threshold = uint64_t(std::min(std::max(p, 0.0), 1.0) * 4294967296.0);
+
+        generate(out, n, [threshold](uint32_t x) {
+            return uint64_t(x) < threshold ? T(1) : T(0);
+        });
+    }
+
+    /*!
+     * \brief Fill the given memory with n values drawn from a normal
+     * distribution (Box-Muller transform)
+     */
+    template <typename T>
+    void normal(T* out, size_t n, T mean = T(0), T stddev = T(1)) {
+        constexpr size_t chunk = 256;
+
+        uint32_t raw[chunk];
+
+        for (size_t i = 0; i < n; i += chunk) {
+            const size_t m = std::min(chunk, n - i);
+
+            // Each pair of values is computed from a pair of uniform values
+            bits(raw, m + (m & 1));
+
+            for (size_t j = 0; j < m; j += 2) {
+                // u1 is in (0, 1], to avoid the logarithm of zero
+                const double u1 = ((raw[j] >> 8) + 1) * (1.0 / 16777216.0);
+                const double u2 = (raw[j + 1] >> 8) * (1.0 / 16777216.0);
+
+                const double r     = std::sqrt(-2.0 * std::log(u1));
+                const double theta = 6.283185307179586 * u2;
+
+                out[i + j] = mean + stddev * T(r * std::cos(theta));
+
+                if (j + 1 < m) {
+                    out[i + j + 1] = mean + stddev * T(r * std::sin(theta));
+                }
+            }
+        }
+    }
+
+private:
+    /*!
+     * \brief Store the four values of a block, if inside the output
+     */
+    static void store(uint32_t* out, size_t n, size_t i, uint32_t v0, uint32_t v1, uint32_t v2, uint32_t v3) {
+        if (i + 4 <= n) {
+            out[i]     = v0;
+            out[i + 1] = v1;
+            out[i + 2] = v2;
+            out[i + 3] = v3;
+        } else {
+            const uint32_t v[4] = {v0, v1, v2, v3};
+
+            for (size_t l = 0; i + l < n; ++l) {
+                out[i + l] = v[l];
+            }
+        }
+    }
+
+    /*!
+     * \brief Fill the given memory with n values computed from random bits
+     */
+    template <typename T, typename Functor>
+    void generate(T* out, size_t n, Functor&& functor) {
+        constexpr size_t chunk = 256;
+
+        uint32_t raw[chunk];
+
+        for (size_t i = 0; i < n; i += chunk) {
+            const size_t m = std::min(chunk, n - i);
+
+            bits(raw, m);
+
+            for (size_t j = 0; j < m; ++j) {
+                out[i + j] = functor(raw[j]);
+            }
+        }
+    }
+
+    uint64_t key;         ///< The key of the stream
+    uint64_t counter = 0; ///< The next counter
+    uint32_t buffer[4];   ///< The values of the last counter
+    size_t index     = 4; ///< The next value in the buffer
+};
+
+/*!
+ * \brief A fast generator of uniform values in [0,1).
+ *
+ * The generator is made of several independent xorshift streams that are
+ * advanced together, so that the inner loop can be vectorized by the
+ * compiler. It is only meant for the sampling of units, where the quality of
+ * the random engine is not critical.
+ */
+struct fast_uniform_generator {
+    static constexpr size_t lanes = 8; ///< The number of independent streams
+
+    /*!
+     * \brief Seed the streams from the given engine.
+     *
+     * Generators can be seeded from the shared engine by several threads
+     * at once (batch-parallel training), so the seeding is serialized.
+     */
+    explicit fast_uniform_generator(random_engine& g) {
+        static std::mutex seed_lock;
+        std::lock_guard<std::mutex> lock(seed_lock);
+
+        for (size_t l = 0; l < lanes; ++l) {
+            do {
+                state[l] = uint32_t(g());
+            } while (!state[l]);
+        }
+    }
+
+    /*!
+     * \brief Seed the streams from the given random stream.
+     *
+     * Unlike the seeding from the shared engine, this needs no lock and
+     * does not depend on the order in which the threads are seeded.
+     */
+    explicit fast_uniform_generator(random_stream g) {
+        for (size_t l = 0; l < lanes; ++l) {
+            do {
+                state[l] = uint32_t(g());
+            } while (!state[l]);
+        }
+    }
+
+    /*!
+     * \brief Fill the given memory with n uniform values in [0,1)
+     */
+    template <typename T>
+    void generate(T* out, size_t n) {
+        size_t i = 0;
+
+        for (; i + lanes <= n; i += lanes) {
+            for (size_t l = 0; l < lanes; ++l) {
+                out[i + l] = next(l);
+            }
+        }
+
+        for (size_t l = 0; i < n; ++i, ++l) {
+            out[i] = next(l);
+        }
+    }
+
+private:
+    /*!
+     * \brief Advance the given stream and returns its value in [0,1)
+     */
+    float next(size_t l) {
+        uint32_t x = state[l];
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        state[l] = x;
+
+        return float(x >> 8) * (1.0f / 16777216.0f);
+    }
+
+    uint32_t state[lanes]; ///< The state of each stream
+};
+
+/*!
+ * \brief Returns the random stream of the given logical ids, derived from
+ * the DLL seed.
+ *
+ * For instance, make_random_stream(layer, epoch, batch) always gives the
+ * same values for the same seed, regardless of the number of threads.
+ */
+template <typename... Ids>
+random_stream make_random_stream(Ids... ids) {
+    random_stream stream(mix_key(seed()));
+
+    ((stream = stream.split(uint64_t(ids))), ...);
+
+    return stream;
+}
+
 } //end of dll namespace
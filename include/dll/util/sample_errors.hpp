@@ -0,0 +1,69 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Per-sample operations on the errors of the output of a network
+ */
+
+#pragma once
+
+#include <cmath>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Compute the norm of the errors of each of the first n samples
+ * \param errors The errors of the output (batch first)
+ * \param n The number of samples
+ * \param norms The norm of each sample
+ */
+template <typename E>
+void sample_error_norms(const E& errors, size_t n, double* norms) {
+    const size_t s = etl::size(errors) / etl::dim<0>(errors);
+
+    errors.ensure_cpu_up_to_date();
+
+    const auto* err = errors.memory_start();
+
+    for (size_t i = 0; i < n; ++i) {
+        double sum = 0.0;
+
+        for (size_t j = 0; j < s; ++j) {
+            sum += double(err[i * s + j]) * double(err[i * s + j]);
+        }
+
+        norms[i] = std::sqrt(sum);
+    }
+}
+
+/*!
+ * \brief Multiply the errors of each of the first n samples by its weight
+ * \param errors The errors of the output (batch first)
+ * \param n The number of samples
+ * \param weights The weight of each sample
+ */
+template <typename E, typename W>
+void weight_sample_errors(E& errors, size_t n, const W* weights) {
+    const size_t s = etl::size(errors) / etl::dim<0>(errors);
+
+    errors.ensure_cpu_up_to_date();
+
+    auto* err = errors.memory_start();
+
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < s; ++j) {
+            err[i * s + j] *= weights[i];
+        }
+    }
+
+    errors.invalidate_gpu();
+}
+
+} //end of dll namespace
@@ -0,0 +1,500 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Work-stealing task scheduler shared by the parallel components of
+ * the library.
+ *
+ * Each worker thread has its own deque of tasks: it pushes and pops its own
+ * tasks at the back and steals the tasks of the others from the front. The
+ * threads that are not workers submit their tasks to a shared queue. A
+ * thread waiting for a group of tasks runs the pending tasks while it waits,
+ * so that nested parallel loops never create new threads nor block the
+ * workers.
+ *
+ * The tasks run with serial ETL operations, ETL having its own thread pool.
+ *
+ * The workers of a scheduler can be pinned to a set of CPUs (the CPUs of a
+ * NUMA node). The loops nested in a task are scheduled on the scheduler
+ * running the task.
+ *
+ * Detached tasks (spawn) belong to no group and are only run by the
+ * workers: nobody waits for them.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/numa.hpp"
+
+namespace dll {
+
+struct task_group;
+
+/*!
+ * \brief A work-stealing scheduler with a fixed number of worker threads
+ */
+struct task_scheduler {
+    /*!
+     * \brief Create a scheduler with the given number of worker threads
+     * (the threads waiting for tasks also run them)
+     * \param workers The number of worker threads
+     * \param cpus The CPUs the workers are pinned to (not pinned if empty)
+     */
+    explicit task_scheduler(size_t workers, std::vector<size_t> cpus = {}) : n_workers(workers), cpus(std::move(cpus)) {
+        // The last queue is the one of the threads that are not workers
+        for (size_t w = 0; w < workers + 1; ++w) {
+            queues.push_back(std::make_unique<queue>());
+        }
+
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([this, w] { loop(w); });
+        }
+    }
+
+    task_scheduler(const task_scheduler& rhs) = delete;
+    task_scheduler& operator=(const task_scheduler& rhs) = delete;
+
+    /*!
+     * \brief Stop and join the workers
+     */
+    ~task_scheduler() {
+        {
+            std::unique_lock<std::mutex> ulock(sleep_lock);
+            stop_flag = true;
+        }
+
+        sleep_condition.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /*!
+     * \brief Returns the number of worker threads
+     */
+    size_t workers() const {
+        return n_workers;
+    }
+
+    /*!
+     * \brief Returns the number of threads that can run tasks at the same
+     * time: the active workers and the waiting thread
+     */
+    size_t concurrency() const {
+        const size_t busy = reserved.load(std::memory_order_relaxed);
+        return 1 + (busy < workers() ? workers() - busy : 0);
+    }
+
+    /*!
+     * \brief Indicates if the current thread is running a task
+     */
+    static bool in_task() {
+        return task_depth() > 0;
+    }
+
+    /*!
+     * \brief Returns the scheduler of the task running on the current
+     * thread, or of the worker, if any
+     */
+    static task_scheduler*& current() {
+        static thread_local task_scheduler* scheduler = nullptr;
+        return scheduler;
+    }
+
+    /*!
+     * \brief Reserve threads for work outside the scheduler (the dedicated
+     * threads of the generators, for instance). The reserved workers do not
+     * take new tasks until the threads are released.
+     */
+    void reserve(size_t n) {
+        reserved.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Release threads previously reserved
+     */
+    void release(size_t n) {
+        reserved.fetch_sub(n, std::memory_order_relaxed);
+
+        sleep_condition.notify_all();
+    }
+
+    /*!
+     * \brief Submit a detached task, that is not waited for. The task must
+     * handle its own errors. Without workers, the task is run on the
+     * current thread.
+     */
+    template <typename Functor>
+    void spawn(Functor&& functor) {
+        task t{std::forward<Functor>(functor), nullptr};
+
+        if (!workers()) {
+            execute(t);
+            return;
+        }
+
+        push(std::move(t));
+    }
+
+    /*!
+     * \brief Run one pending task, if any, on the current thread
+     * \return true if a task was run, false otherwise
+     */
+    bool run_one() {
+        task t;
+
+        if (pop(current_queue(), t)) {
+            execute(t);
+            return true;
+        }
+
+        return false;
+    }
+
+private:
+    /*!
+     * \brief A task and its group
+     */
+    struct task {
+        std::function<void()> functor; ///< The work
+        task_group* group = nullptr;   ///< The group of the task (nullptr for detached tasks)
+    };
+
+    /*!
+     * \brief The deque of tasks of one worker
+     */
+    struct queue {
+        std::mutex lock;         ///< The lock of the deque
+        std::deque<task> tasks; ///< The tasks
+    };
+
+    const size_t n_workers;                     ///< The number of workers
+    const std::vector<size_t> cpus;             ///< The CPUs of the workers (all if empty)
+    std::vector<std::unique_ptr<queue>> queues; ///< The deques of the workers and the shared queue
+    std::vector<std::thread> threads;           ///< The workers
+
+    std::mutex sleep_lock;                   ///< The lock for the idle workers
+    std::condition_variable sleep_condition; ///< The condition of the idle workers
+    std::atomic<size_t> pending{0};          ///< The number of queued tasks
+    std::atomic<size_t> reserved{0};         ///< The number of workers reserved for other threads
+    bool stop_flag = false;                  ///< Indicates that the workers must stop
+
+    static constexpr size_t no_worker = std::numeric_limits<size_t>::max(); ///< The index of the threads that are not workers
+
+    /*!
+     * \brief Returns the index of the worker of the current thread
+     */
+    static size_t& worker_index() {
+        static thread_local size_t index = no_worker;
+        return index;
+    }
+
+    /*!
+     * \brief Returns the number of nested tasks running on the current thread
+     */
+    static size_t& task_depth() {
+        static thread_local size_t depth = 0;
+        return depth;
+    }
+
+    /*!
+     * \brief Returns the queue of the current thread
+     */
+    size_t current_queue() const {
+        const size_t index = worker_index();
+        return index == no_worker || index >= workers() ? workers() : index;
+    }
+
+    /*!
+     * \brief Queue a task of the given group
+     */
+    void push(task t) {
+        auto& q = *queues[current_queue()];
+
+        {
+            std::unique_lock<std::mutex> ulock(q.lock);
+            q.tasks.push_back(std::move(t));
+        }
+
+        {
+            std::unique_lock<std::mutex> ulock(sleep_lock);
+            pending.fetch_add(1, std::memory_order_release);
+        }
+
+        sleep_condition.notify_all();
+    }
+
+    /*!
+     * \brief Take a task, from the back of the own queue or stolen from the
+     * front of the other ones
+     */
+    bool pop(size_t self, task& t) {
+        if (!pending.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        {
+            auto& q = *queues[self];
+            std::unique_lock<std::mutex> ulock(q.lock);
+
+            if (!q.tasks.empty()) {
+                t = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < queues.size(); ++i) {
+            auto& q = *queues[(self + i) % queues.size()];
+            std::unique_lock<std::mutex> ulock(q.lock);
+
+            if (!q.tasks.empty()) {
+                t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Indicates if the given worker can take tasks
+     */
+    bool active(size_t w) const {
+        return w + reserved.load(std::memory_order_relaxed) < workers();
+    }
+
+    /*!
+     * \brief Run a task on the current thread
+     */
+    void execute(task& t);
+
+    /*!
+     * \brief The loop of a worker
+     */
+    void loop(size_t w) {
+        worker_index() = w;
+        current()      = this;
+
+        pin_thread(cpus);
+
+        task t;
+
+        while (true) {
+            if (active(w) && pop(w, t)) {
+                execute(t);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> ulock(sleep_lock);
+
+            sleep_condition.wait(ulock, [this, w] {
+                return stop_flag || (active(w) && pending.load(std::memory_order_acquire));
+            });
+
+            if (stop_flag) {
+                return;
+            }
+        }
+    }
+
+    friend struct task_group;
+};
+
+/*!
+ * \brief A group of tasks to wait for.
+ *
+ * The first exception thrown by a task of the group is rethrown by wait()
+ * and join().
+ */
+struct task_group {
+    /*!
+     * \brief Create a group submitting to the given scheduler
+     */
+    explicit task_group(task_scheduler& scheduler) : scheduler(scheduler) {}
+
+    task_group(const task_group& rhs) = delete;
+    task_group& operator=(const task_group& rhs) = delete;
+
+    /*!
+     * \brief Wait for the tasks before destruction
+     */
+    ~task_group() {
+        while (remaining.load(std::memory_order_acquire)) {
+            help();
+        }
+
+        // The last task may still be notifying the joining threads
+        std::unique_lock<std::mutex> ulock(done_lock);
+    }
+
+    /*!
+     * \brief Submit a task to the group
+     */
+    template <typename Functor>
+    void run(Functor&& functor) {
+        remaining.fetch_add(1, std::memory_order_relaxed);
+        scheduler.push({std::forward<Functor>(functor), this});
+    }
+
+    /*!
+     * \brief Wait for all the tasks of the group, running pending tasks in
+     * the meantime
+     */
+    void wait() {
+        while (remaining.load(std::memory_order_acquire)) {
+            help();
+        }
+
+        rethrow();
+    }
+
+    /*!
+     * \brief Wait for all the tasks of the group without running them on the
+     * current thread (the tasks submitted to the workers pinned to other
+     * CPUs, for instance)
+     */
+    void join() {
+        {
+            std::unique_lock<std::mutex> ulock(done_lock);
+            done_condition.wait(ulock, [this] { return !remaining.load(std::memory_order_acquire); });
+        }
+
+        rethrow();
+    }
+
+private:
+    task_scheduler& scheduler;              ///< The scheduler running the tasks
+    std::atomic<size_t> remaining{0};       ///< The number of tasks not finished
+    std::mutex error_lock;                  ///< The lock protecting the error
+    std::exception_ptr error;               ///< The first exception of the tasks
+    std::mutex done_lock;                   ///< The lock of the last tasks
+    std::condition_variable done_condition; ///< The condition of the threads joining the group
+
+    /*!
+     * \brief Rethrow the first exception of the tasks, if any
+     */
+    void rethrow() {
+        // The last task may still be notifying the joining threads
+        { std::unique_lock<std::mutex> ulock(done_lock); }
+
+        if (error) {
+            auto e = error;
+            error  = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    /*!
+     * \brief Run a pending task, or yield if there are none
+     */
+    void help() {
+        if (!scheduler.run_one()) {
+            std::this_thread::yield();
+        }
+    }
+
+    /*!
+     * \brief Mark a task as finished
+     */
+    void finish(std::exception_ptr e) {
+        if (e) {
+            std::unique_lock<std::mutex> ulock(error_lock);
+
+            if (!error) {
+                error = e;
+            }
+        }
+
+        std::unique_lock<std::mutex> ulock(done_lock);
+
+        if (remaining.fetch_sub(1, std::memory_order_release) == 1) {
+            done_condition.notify_all();
+        }
+    }
+
+    friend struct task_scheduler;
+};
+
+inline void task_scheduler::execute(task& t) {
+    // ETL is not parallelized inside the tasks
+    const bool serial           = etl::local_context().serial;
+    etl::local_context().serial = true;
+
+    auto* previous = current();
+    current()      = this;
+
+    ++task_depth();
+
+    std::exception_ptr e;
+
+    try {
+        t.functor();
+    } catch (...) {
+        e = std::current_exception();
+    }
+
+    --task_depth();
+
+    current() = previous;
+
+    etl::local_context().serial = serial;
+
+    auto* group = t.group;
+    t.functor   = nullptr;
+
+    // The errors of the detached tasks are their own
+    if (group) {
+        group->finish(e);
+    }
+}
+
+/*!
+ * \brief Reserve threads of a scheduler for the lifetime of the object
+ */
+struct thread_reservation {
+    /*!
+     * \brief Reserve the given number of threads
+     */
+    thread_reservation(task_scheduler& scheduler, size_t n) : scheduler(&scheduler), n(n) {
+        scheduler.reserve(n);
+    }
+
+    thread_reservation(const thread_reservation& rhs) = delete;
+    thread_reservation& operator=(const thread_reservation& rhs) = delete;
+
+    /*!
+     * \brief Release the threads
+     */
+    ~thread_reservation() {
+        scheduler->release(n);
+    }
+
+private:
+    task_scheduler* scheduler; ///< The scheduler
+    size_t n;                  ///< The number of reserved threads
+};
+
+} //end of dll namespace
@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Selection of the kernels specialised for a shape known at runtime
+ *
+ * A kernel templated on its shape (0 for a dimension only known at runtime)
+ * is instantiated for a precompiled list of common shapes. The dynamic
+ * layers select the instantiation matching their shape once, when they are
+ * initialized, and keep a pointer to it.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace dll {
+
+/*!
+ * \brief A 2D shape known at compile time (0 for a dimension only known at
+ * runtime)
+ */
+template <size_t D1, size_t D2>
+struct shape_2d {
+    static constexpr size_t dim1 = D1; ///< The first dimension
+    static constexpr size_t dim2 = D2; ///< The second dimension
+};
+
+/*!
+ * \brief The 2D shape whose dimensions are only known at runtime
+ */
+using dynamic_shape_2d = shape_2d<0, 0>;
+
+/*!
+ * \brief A list of shapes with specialised kernels
+ */
+template <typename... Shapes>
+struct shape_list {};
+
+/*!
+ * \brief Call functor(Shape()) with the shape of the list matching (d1, d2),
+ * or with dynamic_shape_2d if there is none.
+ *
+ * \param d1 The first dimension
+ * \param d2 The second dimension
+ * \param functor The functor to call with the shape
+ *
+ * \return true if the shape is part of the list, false otherwise
+ */
+template <typename... Shapes, typename Functor>
+bool dispatch_shape(shape_list<Shapes...> /*list*/, size_t d1, size_t d2, Functor&& functor) {
+    const bool found = ((d1 == Shapes::dim1 && d2 == Shapes::dim2 && (functor(Shapes()), true)) || ...);
+
+    if (!found) {
+        functor(dynamic_shape_2d());
+    }
+
+    return found;
+}
+
+} //end of dll namespace
@@ -0,0 +1,503 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Compressed (CSR) batches of sparse inputs and sparse row accesses
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A batch of inputs compressed in the Compressed Sparse Row format.
+ *
+ * Only the non-zero values of the inputs are kept, with their column. The
+ * products with the weights then only touch the rows of the weights that
+ * correspond to non-zero inputs, which is much faster than a dense product
+ * for very sparse inputs (bag-of-words, one-hot, ...).
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct sparse_batch {
+    size_t rows    = 0; ///< The number of samples of the batch
+    size_t columns = 0; ///< The number of values of one sample
+
+    std::vector<size_t> row_start; ///< The first non-zero of each row (rows + 1)
+    std::vector<size_t> indices;   ///< The column of each non-zero
+    std::vector<T> values;         ///< The non-zero values
+
+    /*!
+     * \brief Compress the given dense batch
+     * \param x The batch, its first dimension being the samples
+     */
+    template <typename X>
+    void compress(const X& x) {
+        rows    = etl::dim<0>(x);
+        columns = etl::size(x) / rows;
+
+        row_start.resize(rows + 1);
+        indices.clear();
+        values.clear();
+
+        for (size_t r = 0; r < rows; ++r) {
+            row_start[r] = values.size();
+
+            for (size_t c = 0; c < columns; ++c) {
+                const T v = x[r * columns + c];
+
+                if (v != T(0)) {
+                    indices.push_back(c);
+                    values.push_back(v);
+                }
+            }
+        }
+
+        row_start[rows] = values.size();
+    }
+
+    /*!
+     * \brief Returns the ratio of non-zero values
+     */
+    double density() const {
+        return rows * columns ? double(values.size()) / double(rows * columns) : 0.0;
+    }
+
+    /*!
+     * \brief Compute out = X * w
+     * \param out The output (rows x N)
+     * \param w The weights (columns x N)
+     */
+    template <typename O, typename W>
+    void multiply(O&& out, const W& w) const {
+        const size_t n = etl::dim<1>(w);
+
+        cpp_assert(etl::size(out) == rows * n, "Invalid output of sparse product");
+        cpp_assert(etl::dim<0>(w) == columns, "Invalid weights of sparse product");
+
+        w.ensure_cpu_up_to_date();
+
+        out = T(0);
+        out.ensure_cpu_up_to_date();
+
+        const T* wm = w.memory_start();
+        T* o        = out.memory_start();
+
+        for (size_t r = 0; r < rows; ++r) {
+            T* o_r = o + r * n;
+
+            for (size_t k = row_start[r]; k < row_start[r + 1]; ++k) {
+                const T v    = values[k];
+                const T* w_k = wm + indices[k] * n;
+
+                for (size_t j = 0; j < n; ++j) {
+                    o_r[j] += v * w_k[j];
+                }
+            }
+        }
+
+        out.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the sum of the outer products of the samples with the
+     * given batch: g = X^T * d
+     * \param g The output (columns x N)
+     * \param d The batch (rows x N)
+     */
+    template <typename G, typename D>
+    void outer(G&& g, const D& d) const {
+        const size_t n = etl::dim<1>(g);
+
+        cpp_assert(etl::dim<0>(g) == columns, "Invalid output of sparse outer product");
+        cpp_assert(etl::size(d) == rows * n, "Invalid batch of sparse outer product");
+
+        d.ensure_cpu_up_to_date();
+
+        g = T(0);
+        g.ensure_cpu_up_to_date();
+
+        const T* dm = d.memory_start();
+        T* gm       = g.memory_start();
+
+        for (size_t r = 0; r < rows; ++r) {
+            const T* d_r = dm + r * n;
+
+            for (size_t k = row_start[r]; k < row_start[r + 1]; ++k) {
+                const T v = values[k];
+                T* g_k    = gm + indices[k] * n;
+
+                for (size_t j = 0; j < n; ++j) {
+                    g_k[j] += v * d_r[j];
+                }
+            }
+        }
+
+        g.invalidate_gpu();
+    }
+};
+
+/*!
+ * \brief The rows of a weight matrix touched by a batch of indices (for
+ * instance the words of an embedding layer), and the sparse computation of
+ * the gradients of these rows.
+ *
+ * Only the touched rows of the gradients are written, the other rows are
+ * kept at zero. The rows touched by the previous batch are reset before
+ * the new gradients are accumulated, unless the whole gradients have been
+ * modified in between (dense is then set and the gradients are fully
+ * reset).
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+struct sparse_rows {
+    std::vector<size_t> rows; ///< The touched rows (sorted, unique)
+    bool dense = true;        ///< Indicates that all the rows of the gradients must be reset
+
+    /*!
+     * \brief Compute the gradients of the touched rows: each row of the
+     * gradients is the sum of the errors of the inputs with its index.
+     *
+     * \param grad The gradients (rows x N)
+     * \param input The batch of indices
+     * \param errors The errors (one N vector per index)
+     */
+    template <typename G, typename In, typename E>
+    void gradients(G& grad, const In& input, const E& errors) {
+        const size_t n = etl::dim<1>(grad);
+        const size_t m = etl::size(input);
+
+        cpp_assert(etl::size(errors) == m * n, "Invalid errors of sparse gradients");
+
+        input.ensure_cpu_up_to_date();
+        errors.ensure_cpu_up_to_date();
+
+        T* g = reset(grad);
+
+        const auto* in = input.memory_start();
+        const auto* e  = errors.memory_start();
+
+        for (size_t i = 0; i < m; ++i) {
+            const size_t r = in[i];
+
+            cpp_assert(r < etl::dim<0>(grad), "Invalid index for sparse gradients");
+
+            T* g_r       = g + r * n;
+            const T* e_i = e + i * n;
+
+            for (size_t j = 0; j < n; ++j) {
+                g_r[j] += e_i[j];
+            }
+
+            rows.push_back(r);
+        }
+
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+        grad.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the gradients of the touched rows of a hashed table:
+     * each index is mapped to several rows (buckets), that all receive the
+     * errors of the index.
+     *
+     * \param grad The gradients (rows x N)
+     * \param buckets The rows of each index (hashes per index)
+     * \param hashes The number of rows per index
+     * \param errors The errors (one N vector per index)
+     */
+    template <typename G, typename E>
+    void hashed_gradients(G& grad, const std::vector<size_t>& buckets, size_t hashes, const E& errors) {
+        const size_t n = etl::dim<1>(grad);
+        const size_t m = buckets.size() / hashes;
+
+        cpp_assert(etl::size(errors) == m * n, "Invalid errors of sparse gradients");
+
+        errors.ensure_cpu_up_to_date();
+
+        T* g = reset(grad);
+
+        const auto* e = errors.memory_start();
+
+        for (size_t i = 0; i < m; ++i) {
+            const T* e_i = e + i * n;
+
+            for (size_t h = 0; h < hashes; ++h) {
+                const size_t r = buckets[i * hashes + h];
+
+                cpp_assert(r < etl::dim<0>(grad), "Invalid index for sparse gradients");
+
+                T* g_r = g + r * n;
+
+                for (size_t j = 0; j < n; ++j) {
+                    g_r[j] += e_i[j];
+                }
+
+                rows.push_back(r);
+            }
+        }
+
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+        grad.invalidate_gpu();
+    }
+
+private:
+    /*!
+     * \brief Reset the rows of the gradients touched by the previous batch
+     * (or all the gradients when they are dense)
+     * \return A pointer to the gradients
+     */
+    template <typename G>
+    T* reset(G& grad) {
+        const size_t n = etl::dim<1>(grad);
+
+        if (dense) {
+            grad  = T(0);
+            dense = false;
+        }
+
+        grad.ensure_cpu_up_to_date();
+
+        T* g = grad.memory_start();
+
+        for (auto r : rows) {
+            std::fill(g + r * n, g + (r + 1) * n, T(0));
+        }
+
+        rows.clear();
+
+        return g;
+    }
+};
+
+/*!
+ * \brief The decoupled weight decay of the rows of a weight matrix, applied
+ * lazily.
+ *
+ * At each step, all the rows are multiplied by (1 - l2) and shrunk towards
+ * zero by l1, the rates being already scaled by the learning rate. Instead
+ * of touching all the rows at each step, the decay of all the steps is
+ * accumulated into a clock and each row records the clock at its last
+ * update. The pending decay of a row is folded into it when the row is next
+ * updated, or when all the rows are flushed, so that the decay of a step
+ * costs O(touched rows).
+ *
+ * The pending decay is exact for L1 or L2 alone. With both, the shrinkage
+ * of the pending steps is applied after their scaling.
+ */
+struct lazy_row_decay {
+    double log_scale = 0.0;            ///< The sum of the logarithms of the L2 factors of all the steps
+    double shrink    = 0.0;            ///< The sum of the L1 shrinkages of all the steps
+    std::vector<double> row_log_scale; ///< The value of log_scale at the last update of each row
+    std::vector<double> row_shrink;    ///< The value of shrink at the last update of each row
+
+    /*!
+     * \brief Make sure the decay holds the given number of rows, all up to
+     * date
+     */
+    void resize(size_t rows) {
+        if (row_log_scale.size() != rows) {
+            row_log_scale.assign(rows, log_scale);
+            row_shrink.assign(rows, shrink);
+        }
+    }
+
+    /*!
+     * \brief Advance the clock by one step
+     * \param l1 The L1 shrinkage of the step
+     * \param l2 The L2 decay rate of the step (lower than one)
+     */
+    void step(double l1, double l2) {
+        log_scale += std::log1p(-l2);
+        shrink += l1;
+    }
+
+    /*!
+     * \brief Fold the pending decay into the row r
+     * \param row The values of the row
+     * \param k The number of values of the row
+     * \param r The index of the row
+     */
+    template <typename T>
+    void apply(T* row, size_t k, size_t r) {
+        const T scale = std::exp(log_scale - row_log_scale[r]);
+        const T s     = shrink - row_shrink[r];
+
+        if (scale != T(1) || s != T(0)) {
+            for (size_t j = 0; j < k; ++j) {
+                const T x = scale * row[j];
+
+                row[j] = x > s ? x - s : (x < -s ? x + s : T(0));
+            }
+        }
+
+        row_log_scale[r] = log_scale;
+        row_shrink[r]    = shrink;
+    }
+
+    /*!
+     * \brief Fold the pending decay into all the rows of the given weights
+     */
+    template <typename W>
+    void flush(W& w) {
+        const size_t k = etl::dim<1>(w);
+
+        w.ensure_cpu_up_to_date();
+
+        auto* wm = w.memory_start();
+
+        for (size_t r = 0; r < row_log_scale.size(); ++r) {
+            apply(wm + r * k, k, r);
+        }
+
+        w.invalidate_gpu();
+    }
+};
+
+/*!
+ * \brief Gather the rows of the given weights selected by a batch of indices
+ * (embedding lookup): the i-th row of the output is the row in[i] of w.
+ *
+ * Each row is copied contiguously and the row of the next index is
+ * prefetched while the current one is copied.
+ *
+ * \param out The output (one N vector per index)
+ * \param input The batch of indices
+ * \param w The weights (rows x N)
+ */
+template <typename O, typename In, typename W>
+void gather_rows(O& out, const In& input, const W& w) {
+    const size_t n = etl::dim<1>(w);
+    const size_t m = etl::size(input);
+
+    cpp_assert(etl::size(out) == m * n, "Invalid output of rows gathering");
+
+    input.ensure_cpu_up_to_date();
+    w.ensure_cpu_up_to_date();
+
+    const auto* in = input.memory_start();
+    const auto* wm = w.memory_start();
+    auto* o        = out.memory_start();
+
+    for (size_t i = 0; i < m; ++i) {
+        const size_t r = in[i];
+
+        cpp_assert(r < etl::dim<0>(w), "Invalid index for rows gathering");
+
+#ifdef __GNUC__
+        if (i + 1 < m) {
+            __builtin_prefetch(wm + size_t(in[i + 1]) * n);
+        }
+#endif
+
+        std::copy(wm + r * n, wm + (r + 1) * n, o + i * n);
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Gather the sum of the rows of the given weights selected by the
+ * buckets of a batch of hashed indices: the i-th row of the output is the
+ * sum of the rows of the buckets of the index i.
+ *
+ * The rows are accumulated contiguously and the rows of the next index are
+ * prefetched while the current ones are accumulated.
+ *
+ * \param out The output (one N vector per index)
+ * \param buckets The rows of each index (hashes per index)
+ * \param hashes The number of rows per index
+ * \param w The weights (rows x N)
+ */
+template <typename O, typename W>
+void gather_hashed_rows(O& out, const std::vector<size_t>& buckets, size_t hashes, const W& w) {
+    const size_t n = etl::dim<1>(w);
+    const size_t m = buckets.size() / hashes;
+
+    cpp_assert(etl::size(out) == m * n, "Invalid output of rows gathering");
+
+    w.ensure_cpu_up_to_date();
+
+    const auto* wm = w.memory_start();
+    auto* o        = out.memory_start();
+
+    for (size_t i = 0; i < m; ++i) {
+        const size_t* b = buckets.data() + i * hashes;
+
+#ifdef __GNUC__
+        if (i + 1 < m) {
+            for (size_t h = 0; h < hashes; ++h) {
+                __builtin_prefetch(wm + b[hashes + h] * n);
+            }
+        }
+#endif
+
+        auto* o_i = o + i * n;
+
+        cpp_assert(b[0] < etl::dim<0>(w), "Invalid index for rows gathering");
+
+        std::copy(wm + b[0] * n, wm + (b[0] + 1) * n, o_i);
+
+        for (size_t h = 1; h < hashes; ++h) {
+            cpp_assert(b[h] < etl::dim<0>(w), "Invalid index for rows gathering");
+
+            const auto* w_h = wm + b[h] * n;
+
+            for (size_t j = 0; j < n; ++j) {
+                o_i[j] += w_h[j];
+            }
+        }
+    }
+
+    out.invalidate_gpu();
+}
+
+/*!
+ * \brief Returns the given batch of indices (Batch x N) in time-major order
+ * (N x Batch), the order of the rows of a time-major embedding output.
+ *
+ * \param input The batch of indices
+ */
+template <typename In>
+etl::dyn_matrix<etl::value_t<In>, 2> time_major_indices(const In& input) {
+    const size_t batch = etl::dim<0>(input);
+    const size_t n     = etl::size(input) / batch;
+
+    input.ensure_cpu_up_to_date();
+
+    etl::dyn_matrix<etl::value_t<In>, 2> indices(n, batch);
+
+    const auto* in = input.memory_start();
+    auto* out      = indices.memory_start();
+
+    for (size_t b = 0; b < batch; ++b) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i * batch + b] = in[b * n + i];
+        }
+    }
+
+    indices.invalidate_gpu();
+
+    return indices;
+}
+
+} //end of dll namespace
@@ -9,11 +9,21 @@
 
 #include <chrono>
 
+#include "dll/util/trace.hpp"
+#include "dll/util/perf_counters.hpp"
+
 #ifndef DLL_NO_TIMERS
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <iosfwd>
 #include <iomanip>
+#include <numeric>
 #include <sstream>
+#include <vector>
 
 #endif
 
@@ -70,89 +80,282 @@ inline void dump_timers_pretty() {
     std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
 }
 
+inline void increment_timer(const char* /*name*/, size_t /*duration*/) {}
+
+/*!
+ * \brief Dump the timers with their achieved throughput.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void dump_timers_roofline() {
+    std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
+}
+
+inline void increment_timer(const char* /*name*/, size_t /*duration*/, size_t /*flops*/, size_t /*bytes*/) {}
+
+/*!
+ * \brief Dump the hardware counters of the timers.
+ *
+ * This has no effect if the timers were disabled.
+ */
+inline void dump_timers_counters() {
+    std::cout << "Timers have been disabled by defining DLL_NO_TIMERS" << std::endl;
+}
+
 struct auto_timer {
     auto_timer(const char* /*name*/) {}
+
+    template <typename Cost>
+    void work(const Cost& /*cost*/) {}
 };
 
 struct unsafe_auto_timer {
     unsafe_auto_timer(const char* /*name*/) {}
+
+    template <typename Cost>
+    void work(const Cost& /*cost*/) {}
 };
 
 #else
 
-constexpr size_t max_timers = 128; ///< The maximum number of timers
+constexpr size_t max_timers       = 128; ///< The maximum number of timers
+constexpr size_t timer_cache_size = 64;  ///< The number of names cached by each thread
 
 /*!
- * \brief A timer
+ * \brief The value of a timer, merged over all the threads
  */
 struct timer_t {
-    const char* name;             ///< The name of the timer
-    std::atomic<size_t> count;    ///< The number of times it was incremented
-    std::atomic<size_t> duration; ///< The total duration
+    const char* name; ///< The name of the timer
+    size_t count;     ///< The number of times it was incremented
+    size_t duration;  ///< The total duration
+    size_t flops;     ///< The floating point operations done by the timed code
+    size_t bytes;     ///< The bytes moved by the timed code
+
+#ifdef DLL_PERF_COUNTERS
+    perf_sample counters; ///< The hardware counters of the timed code
+#endif
+};
+
+/*!
+ * \brief The values of the timers recorded by one thread.
+ *
+ * Only the owner thread writes the values, so an update is a plain (relaxed)
+ * load and store, without any read-modify-write. The values are read by the
+ * dump functions from any thread.
+ */
+struct alignas(64) timer_shard {
+    std::array<std::atomic<size_t>, max_timers> counts;    ///< The counts of the timers
+    std::array<std::atomic<size_t>, max_timers> durations; ///< The durations of the timers
+    std::array<std::atomic<size_t>, max_timers> flops;     ///< The operations of the timers
+    std::array<std::atomic<size_t>, max_timers> bytes;     ///< The bytes of the timers
+
+#ifdef DLL_PERF_COUNTERS
+    std::array<std::array<std::atomic<uint64_t>, perf_events>, max_timers> counters; ///< The hardware counters of the timers
+#endif
+
+    std::array<const char*, timer_cache_size> cache_names; ///< The last names resolved by the owner
+    std::array<size_t, timer_cache_size> cache_slots;      ///< The slots of the cached names
+
+    std::atomic<bool> owned; ///< Indicates if a thread owns the shard
+    timer_shard* next;       ///< The next shard
 
     /*!
-     * \brief Initialize an empty counter
+     * \brief Create an empty shard, owned by the calling thread
      */
-    timer_t()
-            : name(nullptr), count(0), duration(0) {}
+    timer_shard() : owned(true), next(nullptr) {
+        for (size_t i = 0; i < max_timers; ++i) {
+            counts[i].store(0, std::memory_order_relaxed);
+            durations[i].store(0, std::memory_order_relaxed);
+            flops[i].store(0, std::memory_order_relaxed);
+            bytes[i].store(0, std::memory_order_relaxed);
+
+#ifdef DLL_PERF_COUNTERS
+            for (auto& counter : counters[i]) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+#endif
+        }
+
+        cache_names.fill(nullptr);
+    }
 
     /*!
-     * \brief Copy a timer
+     * \brief Add the given duration to the timer in the given slot
      */
-    timer_t(const timer_t& rhs)
-            : name(rhs.name), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    void add(size_t slot, size_t duration) {
+        durations[slot].store(durations[slot].load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+        counts[slot].store(counts[slot].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
 
     /*!
-     * \brief Copy assign a timer
+     * \brief Add the given work to the timer in the given slot
      */
-    timer_t& operator=(const timer_t& rhs) {
-        if (&rhs != this) {
-            name     = rhs.name;
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    void add_work(size_t slot, size_t operations, size_t moved) {
+        flops[slot].store(flops[slot].load(std::memory_order_relaxed) + operations, std::memory_order_relaxed);
+        bytes[slot].store(bytes[slot].load(std::memory_order_relaxed) + moved, std::memory_order_relaxed);
+    }
+
+#ifdef DLL_PERF_COUNTERS
+    /*!
+     * \brief Add the given counts of the hardware counters to the timer in
+     * the given slot
+     */
+    void add_counters(size_t slot, const perf_sample& sample) {
+        for (size_t e = 0; e < perf_events; ++e) {
+            counters[slot][e].store(counters[slot][e].load(std::memory_order_relaxed) + sample.values[e], std::memory_order_relaxed);
         }
+    }
+#endif
+};
 
-        return *this;
+/*!
+ * \brief The structure holding all the timers.
+ *
+ * A name gets a slot the first time it is used, with a compare-and-swap, and
+ * keeps it until the end of the program. Each thread records its timers in
+ * its own shard (reused once the thread exits) and resolves the slot of a
+ * name once, in its cache, so that timing does not touch any shared cache
+ * line. The shards are only merged when the timers are dumped.
+ */
+struct timers_t {
+    std::array<std::atomic<const char*>, max_timers> names; ///< The names of the slots
+    std::atomic<timer_shard*> shards;                       ///< The shards of the threads (never released)
+
+    /*!
+     * \brief Create an empty set of timers
+     */
+    timers_t() : shards(nullptr) {
+        for (auto& name : names) {
+            name.store(nullptr, std::memory_order_relaxed);
+        }
     }
 
     /*!
-     * \brief Move construct a timer
+     * \brief Returns the slot of the given name, registering it if necessary
+     * (max_timers if all the slots are used)
      */
-    timer_t(timer_t&& rhs)
-            : name(std::move(rhs.name)), count(rhs.count.load()), duration(rhs.duration.load()) {}
+    size_t slot(const char* name) {
+        for (size_t i = 0; i < max_timers; ++i) {
+            auto current = names[i].load(std::memory_order_acquire);
+
+            if (!current && names[i].compare_exchange_strong(current, name, std::memory_order_acq_rel)) {
+                return i;
+            }
+
+            if (current == name) {
+                return i;
+            }
+        }
+
+        return max_timers;
+    }
 
     /*!
-     * \brief Move assign a timer
+     * \brief Returns a shard for the calling thread, reusing the shard of
+     * a thread that has exited if there is one
      */
-    timer_t& operator=(timer_t&& rhs) {
-        if (&rhs != this) {
-            name     = std::move(rhs.name);
-            count    = rhs.count.load();
-            duration = rhs.duration.load();
+    timer_shard* acquire_shard() {
+        for (auto* shard = shards.load(std::memory_order_acquire); shard; shard = shard->next) {
+            bool owned = false;
+
+            if (!shard->owned.load(std::memory_order_relaxed) && shard->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+                return shard;
+            }
         }
 
-        return *this;
+        auto* shard = new timer_shard;
+
+        shard->next = shards.load(std::memory_order_relaxed);
+
+        while (!shards.compare_exchange_weak(shard->next, shard, std::memory_order_release, std::memory_order_relaxed)) {}
+
+        return shard;
     }
-};
 
-/*!
- * \brief The structure holding all the timers
- */
-struct timers_t {
-    std::array<timer_t, max_timers> timers; ///< The timers
-    std::mutex lock; ///< The lock to protect the timers
+    /*!
+     * \brief Reset the status of the timers.
+     *
+     * The names keep their slots. The increments made by other threads
+     * during the reset may be lost.
+     */
+    void reset() {
+        for (auto* shard = shards.load(std::memory_order_acquire); shard; shard = shard->next) {
+            for (size_t i = 0; i < max_timers; ++i) {
+                shard->counts[i].store(0, std::memory_order_relaxed);
+                shard->durations[i].store(0, std::memory_order_relaxed);
+                shard->flops[i].store(0, std::memory_order_relaxed);
+                shard->bytes[i].store(0, std::memory_order_relaxed);
+
+#ifdef DLL_PERF_COUNTERS
+                for (auto& counter : shard->counters[i]) {
+                    counter.store(0, std::memory_order_relaxed);
+                }
+#endif
+            }
+        }
+    }
 
     /*!
-     * \brief Reset the status of the timers
+     * \brief Returns the values of the used timers, merged over the threads
+     * and sorted by duration (DESC).
+     *
+     * A label used from several translation units may have several
+     * addresses, the values of the timers with the same label are merged.
      */
-    void reset(){
-        std::lock_guard<std::mutex> l(lock);
+    std::vector<timer_t> values() {
+        std::vector<timer_t> result;
+
+        for (size_t i = 0; i < max_timers; ++i) {
+            auto name = names[i].load(std::memory_order_acquire);
+
+            if (!name) {
+                continue;
+            }
+
+            timer_t timer{};
+            timer.name = name;
+
+            for (auto* shard = shards.load(std::memory_order_acquire); shard; shard = shard->next) {
+                timer.count += shard->counts[i].load(std::memory_order_relaxed);
+                timer.duration += shard->durations[i].load(std::memory_order_relaxed);
+                timer.flops += shard->flops[i].load(std::memory_order_relaxed);
+                timer.bytes += shard->bytes[i].load(std::memory_order_relaxed);
+
+#ifdef DLL_PERF_COUNTERS
+                for (size_t e = 0; e < perf_events; ++e) {
+                    timer.counters.values[e] += shard->counters[i][e].load(std::memory_order_relaxed);
+                }
+#endif
+            }
+
+            if (!timer.count) {
+                continue;
+            }
 
-        for(auto& timer : timers){
-            timer.name = nullptr;
-            timer.duration = 0;
-            timer.count = 0;
+            auto it = std::find_if(result.begin(), result.end(), [name](auto& value) { return std::strcmp(value.name, name) == 0; });
+
+            if (it == result.end()) {
+                result.push_back(timer);
+            } else {
+                it->count += timer.count;
+                it->duration += timer.duration;
+                it->flops += timer.flops;
+                it->bytes += timer.bytes;
+
+#ifdef DLL_PERF_COUNTERS
+                for (size_t e = 0; e < perf_events; ++e) {
+                    it->counters.values[e] += timer.counters.values[e];
+                }
+#endif
+            }
         }
+
+        //Sort the timers by duration (DESC)
+        std::sort(result.begin(), result.end(), [](auto& left, auto& right) {
+            return left.duration > right.duration;
+        });
+
+        return result;
     }
 };
 
@@ -164,6 +367,53 @@ inline timers_t& get_timers() {
     return timers;
 }
 
+/*!
+ * \brief The owner of the shard of a thread, releasing it when the thread
+ * exits
+ */
+struct timer_shard_owner {
+    timer_shard* shard; ///< The shard of the thread
+
+    timer_shard_owner() : shard(get_timers().acquire_shard()) {}
+
+    timer_shard_owner(const timer_shard_owner& rhs) = delete;
+    timer_shard_owner& operator=(const timer_shard_owner& rhs) = delete;
+
+    ~timer_shard_owner() {
+        shard->owned.store(false, std::memory_order_release);
+    }
+};
+
+/*!
+ * \brief Get the shard of the timers of the calling thread
+ */
+inline timer_shard& local_timer_shard() {
+    static thread_local timer_shard_owner owner;
+    return *owner.shard;
+}
+
+/*!
+ * \brief Returns the slot of the timer with the given name, for the calling
+ * thread (max_timers if it cannot be registered)
+ */
+inline size_t local_timer_slot(timer_shard& shard, const char* name) {
+    // The names are mostly string literals, the address identifies the call site
+    const size_t key = (reinterpret_cast<uintptr_t>(name) >> 3) % timer_cache_size;
+
+    if (shard.cache_names[key] == name) {
+        return shard.cache_slots[key];
+    }
+
+    auto slot = get_timers().slot(name);
+
+    if (slot < max_timers) {
+        shard.cache_names[key] = name;
+        shard.cache_slots[key] = slot;
+    }
+
+    return slot;
+}
+
 inline std::string to_string_precision(double duration, int precision = 6) {
     std::ostringstream out;
     out << std::setprecision(precision) << duration;
@@ -196,22 +446,15 @@ inline void reset_timers() {
  * This has no effect if the timers were disabled.
  */
 inline void dump_timers() {
-    decltype(auto) timers = get_timers().timers;
-
-    //Sort the timers by duration (DESC)
-    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
-        return left.duration > right.duration;
-    });
+    auto timers = get_timers().values();
 
     // Print all the used timers
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-            std::cout << timer.name << "(" << count << ") : "
-                      << duration_str(duration)
-                      << " (" << duration_str(duration / count) << ")" << std::endl;
-        }
+    for (auto& timer : timers) {
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+        std::cout << timer.name << "(" << count << ") : "
+                  << duration_str(duration)
+                  << " (" << duration_str(duration / count) << ")" << std::endl;
     }
 }
 
@@ -222,36 +465,126 @@ inline void dump_timers() {
  * The total is the counter with the maximum total time
  */
 inline void dump_timers_one() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = get_timers().values();
 
     if(timers.empty()){
         return;
     }
 
-    //Sort the timers by duration (DESC)
-    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
-        return left.duration > right.duration;
-    });
-
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
     // Print all the used timers
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-            std::cout << timer.name << "(" << count << ") : "
-                      << duration_str(duration)
-                      << " (" << 100.0 * (duration / total_duration) << "%, " << duration_str(duration / count) << ")" << std::endl;
+    for (auto& timer : timers) {
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+        std::cout << timer.name << "(" << count << ") : "
+                  << duration_str(duration)
+                  << " (" << 100.0 * (duration / total_duration) << "%, " << duration_str(duration / count) << ")" << std::endl;
+    }
+}
+
+/*!
+ * \brief Dump the hardware counters of the timers (cycles, instructions,
+ * last level cache misses and packed vector operations), with the
+ * instructions per cycle and the ratio of vector instructions.
+ *
+ * The counters are only recorded when DLL_PERF_COUNTERS is defined. The
+ * counts of a timer include the counts of the timers nested in it.
+ */
+inline void dump_timers_counters() {
+#ifdef DLL_PERF_COUNTERS
+    auto timers = get_timers().values();
+
+    if (timers.empty()) {
+        std::cout << "No timers have been recorded!" << std::endl;
+        return;
+    }
+
+    std::cout << std::endl;
+
+    constexpr size_t columns = 3 + perf_events + 2;
+
+    std::string column_name[columns];
+    column_name[0] = "Timer";
+    column_name[1] = "Count";
+    column_name[2] = "Total";
+
+    for (size_t e = 0; e < perf_events; ++e) {
+        column_name[3 + e] = perf_event_name(e);
+    }
+
+    column_name[3 + perf_events]     = "IPC";
+    column_name[3 + perf_events + 1] = "Vector %";
+
+    std::vector<std::array<std::string, columns>> rows;
+
+    for (auto& timer : timers) {
+        auto& values = timer.counters.values;
+
+        rows.emplace_back();
+        auto& row = rows.back();
+
+        row[0] = timer.name;
+        row[1] = std::to_string(timer.count);
+        row[2] = duration_str(timer.duration);
+
+        for (size_t e = 0; e < perf_events; ++e) {
+            row[3 + e] = perf_counter_available(e) ? std::to_string(values[e]) : "-";
         }
+
+        row[3 + perf_events]     = values[0] ? to_string_precision(double(values[1]) / double(values[0]), 3) : "-";
+        row[3 + perf_events + 1] = values[1] && perf_counter_available(3) ? to_string_precision(100.0 * double(values[3]) / double(values[1]), 3) : "-";
     }
+
+    size_t column_length[columns];
+
+    for (size_t i = 0; i < columns; ++i) {
+        column_length[i] = column_name[i].size();
+
+        for (auto& row : rows) {
+            column_length[i] = std::max(column_length[i], row[i].size());
+        }
+    }
+
+    const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length, column_length + columns, 0);
+
+    auto print_row = [&](const std::array<std::string, columns>& row, bool header) {
+        std::string line = " |";
+
+        for (size_t i = 0; i < columns; ++i) {
+            std::string padding(column_length[i] - row[i].size(), ' ');
+
+            // The names are left-aligned and the numbers right-aligned
+            line += " " + (header || i < 3 ? row[i] + padding : padding + row[i]) + " |";
+        }
+
+        std::cout << line << '\n';
+    };
+
+    std::array<std::string, columns> header;
+    std::copy(column_name, column_name + columns, header.begin());
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+
+    print_row(header, true);
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+
+    for (auto& row : rows) {
+        print_row(row, false);
+    }
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+#else
+    std::cout << "Hardware counters are only recorded when DLL_PERF_COUNTERS is defined" << std::endl;
+#endif
 }
 
 /*!
  * \brief Dump all timers values to the console in the form of a nice table.
  */
 inline void dump_timers_pretty() {
-    decltype(auto) timers = get_timers().timers;
+    auto timers = get_timers().values();
 
     if(timers.empty()){
         std::cout << "No timers have been recorded!" << std::endl;
@@ -260,12 +593,7 @@ inline void dump_timers_pretty() {
 
     std::cout << std::endl;
 
-    //Sort the timers by duration (DESC)
-    std::sort(timers.begin(), timers.end(), [](auto& left, auto& right) {
-        return left.duration > right.duration;
-    });
-
-    double total_duration = timers.front().duration.load();
+    double total_duration = timers.front().duration;
 
     constexpr size_t columns = 5;
 
@@ -284,16 +612,14 @@ inline void dump_timers_pretty() {
     column_length[4] = column_name[4].size();
 
     // Compute the width of each column
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-
-            column_length[1] = std::max(column_length[1], std::string(timer.name).size());
-            column_length[2] = std::max(column_length[2], std::to_string(count).size());
-            column_length[3] = std::max(column_length[3], duration_str(duration).size());
-            column_length[4] = std::max(column_length[4], duration_str(duration / count).size());
-        }
+    for (auto& timer : timers) {
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+
+        column_length[1] = std::max(column_length[1], std::string(timer.name).size());
+        column_length[2] = std::max(column_length[2], std::to_string(count).size());
+        column_length[3] = std::max(column_length[3], duration_str(duration).size());
+        column_length[4] = std::max(column_length[4], duration_str(duration / count).size());
     }
 
     const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length, column_length + columns, 0);
@@ -310,39 +636,199 @@ inline void dump_timers_pretty() {
     std::cout << " " << std::string(line_length, '-') << '\n';
 
     // Print all the used timers
-    for (decltype(auto) timer : timers) {
-        if (timer.name) {
-            size_t count = timer.count;
-            size_t duration = timer.duration;
-
-            printf(" | %*.3f%% | %-*s | %-*s | %-*s | %-*s |\n",
-                int(column_length[0] - 1), 100.0 * (duration / double(total_duration)),
-                int(column_length[1]), timer.name,
-                int(column_length[2]), std::to_string(count).c_str(),
-                int(column_length[3]), duration_str(duration).c_str(),
-                int(column_length[4]), duration_str(duration / count).c_str());
+    for (auto& timer : timers) {
+        size_t count = timer.count;
+        size_t duration = timer.duration;
+
+        printf(" | %*.3f%% | %-*s | %-*s | %-*s | %-*s |\n",
+            int(column_length[0] - 1), 100.0 * (duration / double(total_duration)),
+            int(column_length[1]), timer.name,
+            int(column_length[2]), std::to_string(count).c_str(),
+            int(column_length[3]), duration_str(duration).c_str(),
+            int(column_length[4]), duration_str(duration / count).c_str());
+    }
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+
+#ifdef DLL_PERF_COUNTERS
+    dump_timers_counters();
+#endif
+}
+
+/*!
+ * \brief Dump the timers that recorded their work in a roofline-style
+ * table: the achieved GFLOP/s and GB/s and the arithmetic intensity.
+ *
+ * The work is the analytical cost of the layers (see util/layer_cost.hpp),
+ * the throughputs are only as precise as this cost model.
+ */
+inline void dump_timers_roofline() {
+    auto timers = get_timers().values();
+
+    timers.erase(std::remove_if(timers.begin(), timers.end(), [](auto& timer) { return !timer.flops && !timer.bytes; }), timers.end());
+
+    if(timers.empty()){
+        std::cout << "No work has been recorded!" << std::endl;
+        return;
+    }
+
+    std::cout << std::endl;
+
+    constexpr size_t columns = 6;
+
+    std::string column_name[columns];
+    column_name[0] = "Timer";
+    column_name[1] = "Count";
+    column_name[2] = "Total";
+    column_name[3] = "GFLOP/s";
+    column_name[4] = "GB/s";
+    column_name[5] = "FLOP/B";
+
+    std::vector<std::array<std::string, columns>> rows;
+
+    for (auto& timer : timers) {
+        // The durations are in nanoseconds: flops per ns = GFLOP/s
+        double seconds = std::max(double(timer.duration), 1.0);
+
+        rows.emplace_back();
+        auto& row = rows.back();
+
+        row[0] = timer.name;
+        row[1] = std::to_string(timer.count);
+        row[2] = duration_str(timer.duration);
+        row[3] = to_string_precision(timer.flops / seconds, 4);
+        row[4] = to_string_precision(timer.bytes / seconds, 4);
+        row[5] = to_string_precision(timer.bytes ? double(timer.flops) / double(timer.bytes) : 0.0, 4);
+    }
+
+    size_t column_length[columns];
+
+    for (size_t i = 0; i < columns; ++i) {
+        column_length[i] = column_name[i].size();
+
+        for (auto& row : rows) {
+            column_length[i] = std::max(column_length[i], row[i].size());
         }
     }
 
+    const size_t line_length = (columns + 1) * 1 + 2 + (columns - 1) * 2 + std::accumulate(column_length, column_length + columns, 0);
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+
+    printf(" | %-*s | %-*s | %-*s | %-*s | %-*s | %-*s |\n",
+        int(column_length[0]), column_name[0].c_str(),
+        int(column_length[1]), column_name[1].c_str(),
+        int(column_length[2]), column_name[2].c_str(),
+        int(column_length[3]), column_name[3].c_str(),
+        int(column_length[4]), column_name[4].c_str(),
+        int(column_length[5]), column_name[5].c_str());
+
+    std::cout << " " << std::string(line_length, '-') << '\n';
+
+    for (auto& row : rows) {
+        printf(" | %-*s | %-*s | %-*s | %*s | %*s | %*s |\n",
+            int(column_length[0]), row[0].c_str(),
+            int(column_length[1]), row[1].c_str(),
+            int(column_length[2]), row[2].c_str(),
+            int(column_length[3]), row[3].c_str(),
+            int(column_length[4]), row[4].c_str(),
+            int(column_length[5]), row[5].c_str());
+    }
+
     std::cout << " " << std::string(line_length, '-') << '\n';
 }
 
+/*!
+ * \brief Increment the timer with the given name by the given duration.
+ *
+ * This can be used to record durations that are not measured by an
+ * auto_timer or as a simple counter (histogram bucket for instance).
+ *
+ * \param name The name of the timer. The pointer is used as identifier, it
+ * must remain valid and should be a static string.
+ * \param duration The duration, in nanoseconds
+ * \param flops The floating point operations done during the duration
+ * \param bytes The bytes moved during the duration
+ */
+inline void increment_timer(const char* name, size_t duration, size_t flops = 0, size_t bytes = 0) {
+    decltype(auto) shard = local_timer_shard();
+
+    auto slot = local_timer_slot(shard, name);
+
+    if (slot < max_timers) {
+        shard.add(slot, duration);
+
+        if (flops || bytes) {
+            shard.add_work(slot, flops, bytes);
+        }
+    } else {
+        std::cerr << "Unable to register timer " << name << std::endl;
+    }
+}
+
+#ifdef DLL_PERF_COUNTERS
+/*!
+ * \brief Increment the hardware counters of the timer with the given name
+ * by the counts between the given sample and now.
+ *
+ * \param name The name of the timer.
+ * \param start The values of the counters at the start of the timed code
+ */
+inline void increment_timer_counters(const char* name, const perf_sample& start) {
+    auto end = read_perf_counters();
+
+    perf_sample delta;
+
+    for (size_t e = 0; e < perf_events; ++e) {
+        delta.values[e] = end.values[e] - start.values[e];
+    }
+
+    decltype(auto) shard = local_timer_shard();
+
+    auto slot = local_timer_slot(shard, name);
+
+    if (slot < max_timers) {
+        shard.add_counters(slot, delta);
+    }
+}
+#endif
+
 /*!
  * \brief Automatic timer with RAII.
  */
 struct auto_timer {
-    const char* name;                               ///< The name of the timer
+    const char* name;                                         ///< The name of the timer
     std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
     std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
+    size_t flops = 0;                                         ///< The operations done by the timed code
+    size_t bytes = 0;                                         ///< The bytes moved by the timed code
+
+#ifdef DLL_PERF_COUNTERS
+    perf_sample counters; ///< The hardware counters at the start
+#endif
 
     /*!
      * \brief Create an auto_timer witht the given name
      * \param name The name of the timer
      */
     auto_timer(const char* name) : name(name) {
+#ifdef DLL_PERF_COUNTERS
+        counters = read_perf_counters();
+#endif
+
         start = std::chrono::steady_clock::now();
     }
 
+    /*!
+     * \brief Set the work done by the timed code
+     * \param cost The cost (flops and bytes) of the timed code
+     */
+    template <typename Cost>
+    void work(const Cost& cost) {
+        flops = cost.flops;
+        bytes = cost.bytes;
+    }
+
     /*!
      * \brief Destructs the timer, effectively incrementing the timer.
      */
@@ -350,67 +836,57 @@ struct auto_timer {
         end           = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
-        decltype(auto) timers = get_timers();
-
-        // Try to increment without the lock
-
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
+        increment_timer(name, duration, flops, bytes);
 
-                return;
-            }
-        }
-
-        {
-            std::lock_guard<std::mutex> lock(timers.lock);
-
-            // Retry again to increment with lock
-
-            for (decltype(auto) timer : timers.timers) {
-                if (timer.name == name) {
-                    timer.duration += duration;
-                    ++timer.count;
-
-                    return;
-                }
-            }
-
-            // At this point the timer does not exist, create it
-
-            for (decltype(auto) timer : timers.timers) {
-                if (!timer.name) {
-                    timer.name     = name;
-                    timer.duration = duration;
-                    timer.count    = 1;
+#ifdef DLL_PERF_COUNTERS
+        increment_timer_counters(name, counters);
+#endif
 
-                    return;
-                }
-            }
+        if (tracing()) {
+            trace_scope(name, start, end);
         }
-
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
     }
 };
 
 /*!
  * \brief Automatic timer with RAII, without synchronization.
+ *
+ * Since the timers of each thread are recorded separately, this is now the
+ * same as auto_timer.
  */
 struct unsafe_auto_timer {
     const char* name;                                         ///< The name of the timer
     std::chrono::time_point<std::chrono::steady_clock> start; ///< The start time
     std::chrono::time_point<std::chrono::steady_clock> end;   ///< The end time
+    size_t flops = 0;                                         ///< The operations done by the timed code
+    size_t bytes = 0;                                         ///< The bytes moved by the timed code
+
+#ifdef DLL_PERF_COUNTERS
+    perf_sample counters; ///< The hardware counters at the start
+#endif
 
     /*!
      * \brief Create an unsafe_auto_timer witht the given name
      * \param name The name of the timer
      */
     unsafe_auto_timer(const char* name) : name(name) {
+#ifdef DLL_PERF_COUNTERS
+        counters = read_perf_counters();
+#endif
+
         start = std::chrono::steady_clock::now();
     }
 
+    /*!
+     * \brief Set the work done by the timed code
+     * \param cost The cost (flops and bytes) of the timed code
+     */
+    template <typename Cost>
+    void work(const Cost& cost) {
+        flops = cost.flops;
+        bytes = cost.bytes;
+    }
+
     /*!
      * \brief Destructs the timer, effectively incrementing the timer.
      */
@@ -418,33 +894,15 @@ struct unsafe_auto_timer {
         end           = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
-        decltype(auto) timers = get_timers();
-
-        // Increment the timer if it exists
-
-        for (decltype(auto) timer : timers.timers) {
-            if (timer.name == name) {
-                timer.duration += duration;
-                ++timer.count;
+        increment_timer(name, duration, flops, bytes);
 
-                return;
-            }
-        }
-
-        // At this point the timer does not exist, create it
-
-        for (decltype(auto) timer : timers.timers) {
-            if (!timer.name) {
-                timer.name     = name;
-                timer.duration = duration;
-                timer.count    = 1;
+#ifdef DLL_PERF_COUNTERS
+        increment_timer_counters(name, counters);
+#endif
 
-                return;
-            }
+        if (tracing()) {
+            trace_scope(name, start, end);
         }
-
-        // If there are no more timers
-        std::cerr << "Unable to register timer " << name << std::endl;
     }
 };
 
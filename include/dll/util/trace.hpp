@@ -0,0 +1,241 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Hierarchical trace of the timed scopes.
+ *
+ * When tracing is started, each auto_timer also records its scope (name,
+ * thread, begin and end) in a ring buffer owned by its thread. The trace
+ * can then be exported in the Chrome trace format (JSON), which can be
+ * opened in chrome://tracing or in Perfetto. Since the scopes of a thread
+ * are properly nested, the viewers show the hierarchy of the calls (the
+ * layers inside the forward pass inside the training of a batch, ...) on
+ * the timeline of each thread.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace dll {
+
+constexpr size_t trace_buffer_size = 1 << 16; ///< The number of scopes kept by each thread
+
+/*!
+ * \brief A traced scope
+ */
+struct trace_event {
+    const char* name; ///< The name of the scope
+    int64_t begin;    ///< The begin of the scope, in nanoseconds since the start of the trace
+    int64_t end;      ///< The end of the scope, in nanoseconds since the start of the trace
+};
+
+/*!
+ * \brief The ring buffer of the scopes of one thread.
+ *
+ * Only the owner thread writes the events. When the buffer is full, the
+ * oldest events are overwritten.
+ */
+struct trace_buffer {
+    std::vector<trace_event> events; ///< The events (allocated when the first event is recorded)
+    std::atomic<size_t> written;     ///< The number of events recorded since the last reset
+    std::atomic<bool> owned;         ///< Indicates if a thread owns the buffer
+    size_t tid;                      ///< The id of the thread in the trace
+    trace_buffer* next;              ///< The next buffer
+
+    /*!
+     * \brief Create an empty buffer, owned by the calling thread
+     */
+    explicit trace_buffer(size_t tid) : written(0), owned(true), tid(tid), next(nullptr) {}
+
+    /*!
+     * \brief Record a scope
+     */
+    void record(const char* name, int64_t begin, int64_t end) {
+        if (events.empty()) {
+            events.resize(trace_buffer_size);
+        }
+
+        auto n = written.load(std::memory_order_relaxed);
+
+        events[n % trace_buffer_size] = {name, begin, end};
+
+        written.store(n + 1, std::memory_order_release);
+    }
+};
+
+/*!
+ * \brief The state of the tracing
+ */
+struct trace_t {
+    std::atomic<bool> enabled;          ///< Indicates if the scopes are traced
+    std::atomic<int64_t> epoch;         ///< The start of the trace (steady clock, in nanoseconds)
+    std::atomic<size_t> threads;        ///< The number of thread ids given
+    std::atomic<trace_buffer*> buffers; ///< The buffers of the threads (never released)
+
+    trace_t() : enabled(false), epoch(0), threads(0), buffers(nullptr) {}
+
+    /*!
+     * \brief Returns a buffer for the calling thread, reusing the buffer of
+     * a thread that has exited if there is one (the threads sharing a
+     * buffer never overlap in time, they share the same line in the trace)
+     */
+    trace_buffer* acquire_buffer() {
+        for (auto* buffer = buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+            bool owned = false;
+
+            if (!buffer->owned.load(std::memory_order_relaxed) && buffer->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+                return buffer;
+            }
+        }
+
+        auto* buffer = new trace_buffer(threads++);
+
+        buffer->next = buffers.load(std::memory_order_relaxed);
+
+        while (!buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed)) {}
+
+        return buffer;
+    }
+};
+
+/*!
+ * \brief Get a reference to the trace structure
+ */
+inline trace_t& get_trace() {
+    static trace_t trace;
+    return trace;
+}
+
+/*!
+ * \brief The owner of the trace buffer of a thread, releasing it when the
+ * thread exits
+ */
+struct trace_buffer_owner {
+    trace_buffer* buffer; ///< The buffer of the thread
+
+    trace_buffer_owner() : buffer(get_trace().acquire_buffer()) {}
+
+    trace_buffer_owner(const trace_buffer_owner& rhs) = delete;
+    trace_buffer_owner& operator=(const trace_buffer_owner& rhs) = delete;
+
+    ~trace_buffer_owner() {
+        buffer->owned.store(false, std::memory_order_release);
+    }
+};
+
+/*!
+ * \brief Convert a time point of the steady clock to nanoseconds
+ */
+inline int64_t trace_time(std::chrono::time_point<std::chrono::steady_clock> time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+/*!
+ * \brief Indicates if the scopes are currently traced
+ */
+inline bool tracing() {
+    return get_trace().enabled.load(std::memory_order_relaxed);
+}
+
+/*!
+ * \brief Record a scope of the calling thread
+ * \param name The name of the scope. The pointer must remain valid until the
+ * trace is exported (a static string).
+ * \param begin The begin of the scope
+ * \param end The end of the scope
+ */
+inline void trace_scope(const char* name, std::chrono::time_point<std::chrono::steady_clock> begin, std::chrono::time_point<std::chrono::steady_clock> end) {
+    static thread_local trace_buffer_owner owner;
+
+    auto epoch = get_trace().epoch.load(std::memory_order_relaxed);
+
+    owner.buffer->record(name, trace_time(begin) - epoch, trace_time(end) - epoch);
+}
+
+/*!
+ * \brief Start tracing the scopes, discarding the previous trace.
+ *
+ * This must not be called while other threads are recording scopes.
+ */
+inline void start_trace() {
+    auto& trace = get_trace();
+
+    for (auto* buffer = trace.buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        buffer->written.store(0, std::memory_order_relaxed);
+    }
+
+    trace.epoch.store(trace_time(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    trace.enabled.store(true, std::memory_order_release);
+}
+
+/*!
+ * \brief Stop tracing the scopes
+ */
+inline void stop_trace() {
+    get_trace().enabled.store(false, std::memory_order_release);
+}
+
+/*!
+ * \brief Export the trace to the given file, in the Chrome trace format (JSON)
+ * that can be opened in chrome://tracing and Perfetto.
+ *
+ * The trace must be stopped and the traced threads must not be in the
+ * middle of a scope.
+ *
+ * \param file The path of the file
+ * \return true if the trace was written, false otherwise
+ */
+inline bool export_trace(const std::string& file) {
+    std::ofstream os(file);
+
+    if (!os) {
+        return false;
+    }
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    const char* comma = "\n";
+    char buffer[64];
+
+    for (auto* thread = get_trace().buffers.load(std::memory_order_acquire); thread; thread = thread->next) {
+        auto written = thread->written.load(std::memory_order_acquire);
+
+        if (!written) {
+            continue;
+        }
+
+        os << comma << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->tid
+           << ",\"args\":{\"name\":\"thread " << thread->tid << "\"}}";
+        comma = ",\n";
+
+        // Only the last events are kept in the ring buffer
+        size_t first = written > trace_buffer_size ? written - trace_buffer_size : 0;
+
+        for (size_t i = first; i < written; ++i) {
+            auto& event = thread->events[i % trace_buffer_size];
+
+            // The time stamps are in microseconds
+            std::snprintf(buffer, sizeof(buffer), "\"ts\":%.3f,\"dur\":%.3f", event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+
+            os << comma << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->tid << "," << buffer << "}";
+        }
+    }
+
+    os << "\n]}\n";
+
+    return bool(os);
+}
+
+} //end of dll namespace
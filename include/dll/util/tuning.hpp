@@ -0,0 +1,254 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Runtime selection of the kernels and of the threads of the layers,
+ * and the file caching the choices of the auto-tuner.
+ *
+ * The tuning file is a text file, one line per layer shape and per CPU
+ * model, the fields being separated by tabulations:
+ *
+ *     <cpu model>	<layer>	<kernel>	<threads>	<time (ms)>
+ */
+
+#pragma once
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The implementation of the convolutions of a layer
+ */
+enum class conv_kernel {
+    AUTO,    ///< The default implementation of the layer
+    DIRECT,  ///< The convolutions of ETL
+    WINOGRAD ///< The Winograd convolutions (3x3 filters only)
+};
+
+/*!
+ * \brief Returns a string representation of a convolution kernel
+ */
+inline const char* to_string(conv_kernel kernel) {
+    switch (kernel) {
+        case conv_kernel::AUTO:
+            return "auto";
+        case conv_kernel::DIRECT:
+            return "direct";
+        case conv_kernel::WINOGRAD:
+            return "winograd";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * \brief Returns the convolution kernel of the given string representation
+ * (AUTO if the string is unknown)
+ */
+inline conv_kernel conv_kernel_from_string(const std::string& str) {
+    if (str == "direct") {
+        return conv_kernel::DIRECT;
+    } else if (str == "winograd") {
+        return conv_kernel::WINOGRAD;
+    }
+
+    return conv_kernel::AUTO;
+}
+
+/*!
+ * \brief The runtime tuning of one layer
+ */
+struct layer_tuning {
+    conv_kernel kernel = conv_kernel::AUTO; ///< The implementation of the convolutions
+    size_t threads     = 0;                 ///< The threads of the kernels (0 for the thread budget, 1 for serial)
+};
+
+/*!
+ * \brief Apply the tuning of a layer for the duration of the scope.
+ *
+ * One thread runs the kernels of ETL serially, otherwise the threads limit
+ * the raw kernels of DLL, ETL always using its own thread pool.
+ */
+struct tuning_scope {
+    /*!
+     * \brief Apply the given tuning
+     */
+    explicit tuning_scope(const layer_tuning& tuning) : limit(thread_limit()), serial(etl::local_context().serial) {
+        if (tuning.threads) {
+            thread_limit() = tuning.threads;
+
+            if (tuning.threads == 1) {
+                etl::local_context().serial = true;
+            }
+        }
+    }
+
+    tuning_scope(const tuning_scope& rhs) = delete;
+    tuning_scope& operator=(const tuning_scope& rhs) = delete;
+
+    /*!
+     * \brief Restore the previous tuning
+     */
+    ~tuning_scope() {
+        thread_limit()              = limit;
+        etl::local_context().serial = serial;
+    }
+
+private:
+    size_t limit; ///< The previous thread limit
+    bool serial;  ///< The previous serial state of ETL
+};
+
+/*!
+ * \brief Traits indicating if a layer can be tuned at runtime
+ */
+template <typename Layer, typename Enable = void>
+struct has_layer_tuning : std::false_type {};
+
+/*!
+ * \copydoc has_layer_tuning
+ */
+template <typename Layer>
+struct has_layer_tuning<Layer, std::void_t<decltype(std::declval<Layer&>().tuning)>> : std::true_type {};
+
+/*!
+ * \brief Traits indicating if a layer has several convolution kernels
+ */
+template <typename Layer, typename Enable = void>
+struct has_conv_kernels : std::false_type {};
+
+/*!
+ * \copydoc has_conv_kernels
+ */
+template <typename Layer>
+struct has_conv_kernels<Layer, std::void_t<decltype(std::declval<const Layer&>().winograd_supported())>> : std::true_type {};
+
+/*!
+ * \brief Returns the model of the CPU, used to key the tuning file
+ */
+inline std::string cpu_model() {
+    static const std::string model = [] {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+
+        while (std::getline(cpuinfo, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                auto colon = line.find(':');
+
+                if (colon != std::string::npos && colon + 2 <= line.size()) {
+                    return line.substr(colon + 2);
+                }
+            }
+        }
+
+        return std::string("unknown");
+    }();
+
+    return model;
+}
+
+/*!
+ * \brief Returns the default path of the tuning file, DLL_TUNING_FILE when
+ * set or dll_tuning.txt otherwise
+ */
+inline std::string default_tuning_file() {
+    auto* file = std::getenv("DLL_TUNING_FILE");
+    return file ? file : "dll_tuning.txt";
+}
+
+/*!
+ * \brief The tuning chosen for one layer shape
+ */
+struct tuning_record {
+    layer_tuning tuning; ///< The chosen tuning
+    double time = 0.0;   ///< The time of one training batch of the layer with this tuning, in milliseconds
+};
+
+/*!
+ * \brief The cache of the tuning of the layers, for all the CPU models
+ */
+struct tuning_cache {
+    std::map<std::pair<std::string, std::string>, tuning_record> records; ///< The records, by CPU model and layer
+
+    /*!
+     * \brief Load the cache from the given file
+     * \return true if the file has been read, false otherwise
+     */
+    bool load(const std::string& file) {
+        std::ifstream is(file);
+
+        if (!is) {
+            return false;
+        }
+
+        std::string line;
+
+        while (std::getline(is, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            std::istringstream ls(line);
+
+            std::string cpu;
+            std::string layer;
+            std::string kernel;
+            tuning_record record;
+
+            if (std::getline(ls, cpu, '\t') && std::getline(ls, layer, '\t') && std::getline(ls, kernel, '\t') && (ls >> record.tuning.threads >> record.time)) {
+                record.tuning.kernel = conv_kernel_from_string(kernel);
+                records[{cpu, layer}] = record;
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Store the cache into the given file
+     * \return true if the file has been written, false otherwise
+     */
+    bool store(const std::string& file) const {
+        std::ofstream os(file);
+
+        os << "# <cpu model>\t<layer>\t<kernel>\t<threads>\t<time (ms)>\n";
+
+        for (auto& [key, record] : records) {
+            os << key.first << "\t" << key.second << "\t" << to_string(record.tuning.kernel) << "\t" << record.tuning.threads << "\t" << record.time << "\n";
+        }
+
+        return bool(os);
+    }
+
+    /*!
+     * \brief Returns the record of the given layer on the current CPU, if any
+     */
+    const tuning_record* find(const std::string& layer) const {
+        auto it = records.find({cpu_model(), layer});
+        return it == records.end() ? nullptr : &it->second;
+    }
+
+    /*!
+     * \brief Set the record of the given layer on the current CPU
+     */
+    void set(const std::string& layer, const tuning_record& record) {
+        records[{cpu_model(), layer}] = record;
+    }
+};
+
+} //end of dll namespace
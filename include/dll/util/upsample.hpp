@@ -0,0 +1,246 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Nearest-neighbour upsampling kernels
+ *
+ * The forward kernel writes each upsampled row once and copies it for the
+ * other rows (and planes) of the window. The backward kernel reduces the
+ * rows of a window element-wise, in contiguous memory, before reducing the
+ * columns of the window.
+ *
+ * A convolution of an upsampled input is also computed directly from the
+ * input: each phase of the output (its position inside an upsampling window)
+ * is a valid convolution of the input with the filters folded for this
+ * phase, which are smaller than the original filters.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/arena.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/shape_dispatch.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Upsample the input by repeating each value c1 x c2 x c3 times
+ *
+ * \param out The output (n x i1 * c1 x i2 * c2 x i3 * c3)
+ * \param in The input (n x i1 x i2 x i3)
+ * \param n The number of images
+ *
+ * \tparam C2 The second dimension of the window, if known at compile time (0 otherwise)
+ * \tparam C3 The third dimension of the window, if known at compile time (0 otherwise)
+ */
+template <size_t C2 = 0, size_t C3 = 0, typename T>
+void upsample_3d_forward(T* out, const T* in, size_t n, size_t i1, size_t i2, size_t i3, size_t c1, size_t c2, size_t c3) {
+    const size_t o2 = i2 * (C2 ? C2 : c2);
+    const size_t o3 = i3 * (C3 ? C3 : c3);
+
+    parallel_range(n * i1, n * i1 * c1 * o2 * o3, [=](size_t first, size_t last) {
+        // Constants for the specialised windows
+        const size_t w2 = C2 ? C2 : c2;
+        const size_t w3 = C3 ? C3 : c3;
+
+        // Each plane of the input gives c1 planes of the output
+        for (size_t p = first; p < last; ++p) {
+            const T* x = in + p * i2 * i3;
+            T* y       = out + p * c1 * o2 * o3;
+
+            for (size_t j = 0; j < i2; ++j) {
+                T* row = y + j * w2 * o3;
+
+                for (size_t k = 0; k < i3; ++k) {
+                    for (size_t kk = 0; kk < w3; ++kk) {
+                        row[k * w3 + kk] = x[j * i3 + k];
+                    }
+                }
+
+                for (size_t jj = 1; jj < w2; ++jj) {
+                    std::copy(row, row + o3, row + jj * o3);
+                }
+            }
+
+            for (size_t d = 1; d < c1; ++d) {
+                std::copy(y, y + o2 * o3, y + d * o2 * o3);
+            }
+        }
+    });
+}
+
+/*!
+ * \brief Reduce the errors of each upsampling window to the errors of its
+ * input value, keeping the maximum of the window
+ *
+ * \param out The errors of the input (n x i1 x i2 x i3)
+ * \param errors The errors of the output (n x i1 * c1 x i2 * c2 x i3 * c3)
+ * \param n The number of images
+ *
+ * \tparam C2 The second dimension of the window, if known at compile time (0 otherwise)
+ * \tparam C3 The third dimension of the window, if known at compile time (0 otherwise)
+ */
+template <size_t C2 = 0, size_t C3 = 0, typename T>
+void upsample_3d_backward(T* out, const T* errors, size_t n, size_t i1, size_t i2, size_t i3, size_t c1, size_t c2, size_t c3) {
+    const size_t o2 = i2 * (C2 ? C2 : c2);
+    const size_t o3 = i3 * (C3 ? C3 : c3);
+
+    parallel_range(n * i1, n * i1 * c1 * o2 * o3, [=](size_t first, size_t last) {
+        // Constants for the specialised windows
+        const size_t w2 = C2 ? C2 : c2;
+        const size_t w3 = C3 ? C3 : c3;
+
+        // The maximum of the rows of the window of the current row
+        arena_scope scope;
+        T* acc = scope.allocate<T>(o3);
+
+        for (size_t p = first; p < last; ++p) {
+            const T* e = errors + p * c1 * o2 * o3;
+            T* x       = out + p * i2 * i3;
+
+            for (size_t j = 0; j < i2; ++j) {
+                std::copy(e + j * w2 * o3, e + (j * w2 + 1) * o3, acc);
+
+                for (size_t d = 0; d < c1; ++d) {
+                    for (size_t jj = d ? 0 : 1; jj < w2; ++jj) {
+                        const T* row = e + d * o2 * o3 + (j * w2 + jj) * o3;
+
+                        for (size_t k = 0; k < o3; ++k) {
+                            acc[k] = std::max(acc[k], row[k]);
+                        }
+                    }
+                }
+
+                for (size_t k = 0; k < i3; ++k) {
+                    T max = acc[k * w3];
+
+                    for (size_t kk = 1; kk < w3; ++kk) {
+                        max = std::max(max, acc[k * w3 + kk]);
+                    }
+
+                    x[j * i3 + k] = max;
+                }
+            }
+        }
+    });
+}
+
+/*!
+ * \brief The windows with specialised upsampling kernels in the dynamic
+ * layers (second and third dimensions)
+ */
+using upsample_3d_shapes = shape_list<shape_2d<2, 2>, shape_2d<3, 3>, shape_2d<4, 4>>;
+
+/*!
+ * \brief The upsampling kernels of a dynamic layer, specialised for its
+ * window if it is a common one
+ */
+template <typename T>
+struct upsample_3d_kernels {
+    using kernel_t = void (*)(T*, const T*, size_t, size_t, size_t, size_t, size_t, size_t, size_t); ///< The type of the kernels
+
+    kernel_t forward  = &upsample_3d_forward<0, 0, T>;  ///< The forward kernel
+    kernel_t backward = &upsample_3d_backward<0, 0, T>; ///< The backward kernel
+
+    /*!
+     * \brief Select the kernels for the given window
+     * \return true if the kernels are specialised for the window, false otherwise
+     */
+    bool select(size_t c2, size_t c3) {
+        return dispatch_shape(upsample_3d_shapes(), c2, c3, [this](auto shape) {
+            using shape_t = decltype(shape);
+
+            forward  = &upsample_3d_forward<shape_t::dim1, shape_t::dim2, T>;
+            backward = &upsample_3d_backward<shape_t::dim1, shape_t::dim2, T>;
+        });
+    }
+};
+
+/*!
+ * \brief Compute the valid convolution (machine learning convention) of the
+ * input upsampled by s1 x s2 in its spatial dimensions with the given
+ * filters, without upsampling the input.
+ *
+ * The output (i, j) of the phase (a, b) = (i % s1, j % s2) only reads the
+ * inputs (i / s1 + p', j / s2 + q'), and is therefore a valid convolution of
+ * the input with the filters summed over the taps reading the same input
+ * (p' = (a + p) / s1, q' = (b + q) / s2).
+ *
+ * \param output The output (B x K x s1 * H - F1 + 1 x s2 * W - F2 + 1)
+ * \param input The input, before the upsampling (B x C x H x W)
+ * \param w The filters (K x C x F1 x F2)
+ * \param s1 The upsampling factor of the first spatial dimension
+ * \param s2 The upsampling factor of the second spatial dimension
+ */
+template <typename Output, typename Input, typename W>
+void upsample_conv_forward(Output&& output, const Input& input, const W& w, size_t s1, size_t s2) {
+    using T = etl::value_t<W>;
+
+    const size_t K  = etl::dim<0>(w);
+    const size_t C  = etl::dim<1>(w);
+    const size_t F1 = etl::dim<2>(w);
+    const size_t F2 = etl::dim<3>(w);
+
+    const size_t B  = etl::dim<0>(input);
+    const size_t O1 = etl::dim<2>(output);
+    const size_t O2 = etl::dim<3>(output);
+
+    for (size_t a = 0; a < std::min(s1, O1); ++a) {
+        const size_t fa = (a + F1 - 1) / s1 + 1;
+        const size_t na = (O1 - 1 - a) / s1 + 1;
+
+        for (size_t b = 0; b < std::min(s2, O2); ++b) {
+            const size_t fb = (b + F2 - 1) / s2 + 1;
+            const size_t nb = (O2 - 1 - b) / s2 + 1;
+
+            // The folded filters and the phase are in the arena of the thread
+            arena_scope scope;
+
+            // Fold the filters for this phase
+
+            etl::custom_dyn_matrix<T, 4> folded(scope.allocate<T>(K * C * fa * fb), K, C, fa, fb);
+
+            folded = T(0);
+
+            for (size_t k = 0; k < K; ++k) {
+                for (size_t c = 0; c < C; ++c) {
+                    for (size_t p = 0; p < F1; ++p) {
+                        for (size_t q = 0; q < F2; ++q) {
+                            folded(k, c, (a + p) / s1, (b + q) / s2) += w(k, c, p, q);
+                        }
+                    }
+                }
+            }
+
+            const size_t p1 = etl::dim<2>(input) - fa + 1;
+            const size_t p2 = etl::dim<3>(input) - fb + 1;
+
+            etl::custom_dyn_matrix<T, 4> phase(scope.allocate<T>(B * K * p1 * p2), B, K, p1, p2);
+
+            phase = etl::ml::convolution_forward(input, folded);
+
+            // Interleave the phase into the output
+
+            for (size_t i = 0; i < B; ++i) {
+                for (size_t k = 0; k < K; ++k) {
+                    for (size_t u = 0; u < na; ++u) {
+                        for (size_t v = 0; v < nb; ++v) {
+                            output(i, k, u * s1 + a, v * s2 + b) = phase(i, k, u, v);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+} //end of dll namespace
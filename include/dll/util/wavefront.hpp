@@ -0,0 +1,179 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Wavefront forward propagation of a stack of recurrent layers.
+ *
+ * Instead of computing all the time steps of a layer before starting the
+ * next layer, each layer runs on its own thread and computes its time step
+ * t as soon as the previous layer has computed its own time step t. Once
+ * the pipeline is full, the layer L computes the time step t while the
+ * layer L + 1 computes the time step t - 1.
+ *
+ * The layers must expose the step by step forward propagation of the
+ * recurrent layers (wavefront_begin, wavefront_input, wavefront_step,
+ * wavefront_state and wavefront_end), have the same number of time steps
+ * and process the sequences in the same direction.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "cpp_utils/assert.hpp"
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "etl/etl.hpp"
+
+#include "dll/util/parallel.hpp" // for can_parallelize
+
+namespace dll {
+
+/*!
+ * \brief Indicates if a layer can be forward propagated step by step
+ */
+template <typename Layer, typename = void>
+struct is_wavefront_layer : std::false_type {};
+
+/*!
+ * \copydoc is_wavefront_layer
+ */
+template <typename Layer>
+struct is_wavefront_layer<Layer, std::void_t<decltype(std::declval<const Layer&>().wavefront_step(size_t(0)))>> : std::true_type {};
+
+/*!
+ * \brief Indicates if the given wavefront layers process their sequences in
+ * the same direction
+ */
+template <bool Wavefront, typename First, typename... Layers>
+struct same_direction : std::false_type {};
+
+/*!
+ * \copydoc same_direction
+ */
+template <typename First, typename... Layers>
+struct same_direction<true, First, Layers...> : std::bool_constant<((Layers::reverse == First::reverse) && ...)> {};
+
+/*!
+ * \brief Indicates if a stack of layers can be forward propagated as a
+ * wavefront: several recurrent layers processing their sequences in the
+ * same direction.
+ */
+template <typename First, typename... Layers>
+static constexpr bool wavefront_stack = sizeof...(Layers) > 0
+                                        && same_direction<is_wavefront_layer<First>::value && (is_wavefront_layer<Layers>::value && ...), First, Layers...>::value;
+
+namespace wavefront_detail {
+
+/*!
+ * \brief Compute all the time steps of the Ith layer of the stack, each
+ * time step waiting for the same step of the previous layer
+ */
+template <size_t I, typename Layers, typename Done>
+void run_layer(const Layers& layers, Done& done, size_t time_steps) {
+    auto& layer = std::get<I>(layers);
+
+    for (size_t t = 0; t < time_steps; ++t) {
+        if constexpr (I == 0) {
+            layer.wavefront_step(t);
+        } else {
+            while (done[I - 1].load(std::memory_order_acquire) <= t) {
+                std::this_thread::yield();
+            }
+
+            layer.wavefront_step(t, std::get<I - 1>(layers).wavefront_state(t));
+        }
+
+        done[I].store(t + 1, std::memory_order_release);
+    }
+}
+
+/*!
+ * \brief Run the layers of the stack, the first on the current thread and
+ * the others on their own threads
+ */
+template <typename Layers, typename Done, size_t... I>
+void run_layers(const Layers& layers, Done& done, size_t time_steps, std::index_sequence<0, I...> /*seq*/) {
+    if (!can_parallelize()) {
+        // The pipeline is then only a sequence of whole layers
+        run_layer<0>(layers, done, time_steps);
+        (run_layer<I>(layers, done, time_steps), ...);
+        return;
+    }
+
+    // The kernels of the other layers are serial, only the first layer
+    // shares the threads of ETL
+    std::array<std::thread, sizeof...(I)> threads{{std::thread([&layers, &done, time_steps] {
+        etl::local_context().serial = true;
+        run_layer<I>(layers, done, time_steps);
+    })...}};
+
+    run_layer<0>(layers, done, time_steps);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+/*!
+ * \brief Call the finish functor for each layer of the stack, in order
+ */
+template <typename Layers, typename Finish, size_t... I>
+void finish_layers(const Layers& layers, Finish& finish, std::index_sequence<I...> /*seq*/) {
+    (finish(std::integral_constant<size_t, I>(), std::get<I>(layers)), ...);
+}
+
+} //end of namespace wavefront_detail
+
+/*!
+ * \brief Forward propagate a batch through a stack of recurrent layers, as
+ * a wavefront.
+ *
+ * The caches of the layers are the same as with forward_batch, which makes
+ * this usable for training as well. Once all the layers are done,
+ * finish(std::integral_constant<size_t, I>(), layer) is called for each
+ * layer I, in order, and can write the output of the layers it needs
+ * (layer.wavefront_end(output)).
+ *
+ * \param layers The tuple of the layers
+ * \param input The batch of input of the first layer
+ * \param finish The functor called for each layer once all the layers are done
+ */
+template <typename Layers, typename V, typename Finish>
+void wavefront_forward(const Layers& layers, const V& input, Finish&& finish) {
+    static constexpr size_t N = std::tuple_size_v<Layers>;
+
+    const size_t Batch      = etl::dim<0>(input);
+    const size_t time_steps = std::get<0>(layers).time_steps;
+
+    std::array<std::atomic<size_t>, N> done;
+
+    for (auto& d : done) {
+        d.store(0);
+    }
+
+    cpp::for_each(layers, [Batch, time_steps](auto& layer) {
+        cpp_assert(layer.time_steps == time_steps, "The layers of a wavefront must have the same number of time steps");
+        cpp_unused(time_steps);
+
+        layer.wavefront_begin(Batch);
+    });
+
+    std::get<0>(layers).wavefront_input(input);
+
+    wavefront_detail::run_layers(layers, done, time_steps, std::make_index_sequence<N>());
+
+    wavefront_detail::finish_layers(layers, finish, std::make_index_sequence<N>());
+}
+
+} //end of dll namespace
@@ -0,0 +1,361 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Winograd F(2x2, 3x3) convolutions, for the 3x3 convolutional layers
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "dll/util/arena.hpp"
+#include "dll/util/parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Engine computing the forward and backward (data) convolutions of a
+ * layer with 3x3 filters and a stride of 1 with the Winograd F(2x2, 3x3)
+ * algorithm.
+ *
+ * Each 2x2 tile of the output is computed from a 4x4 tile of the input with
+ * 16 multiplications per channel, instead of 36 for the direct convolution.
+ * The transforms of the filters are cached and only recomputed once they
+ * have been invalidated (after the weights have been changed).
+ */
+template <typename T>
+struct winograd_conv_engine {
+    /*!
+     * \brief Indicates if the convolutions of a layer with the given filters
+     * are computed with the Winograd algorithm.
+     *
+     * With CUDNN, the convolutions are left to CUDNN.
+     */
+    static constexpr bool supported(size_t nw1, size_t nw2) {
+        return !etl::cudnn_enabled && nw1 == 3 && nw2 == 3;
+    }
+
+    winograd_conv_engine() = default;
+
+    /*!
+     * \brief Copying an engine does not copy its transforms, they are
+     * computed again on the next convolution
+     */
+    winograd_conv_engine(const winograd_conv_engine& /*rhs*/) {}
+
+    /*!
+     * \brief Copying an engine does not copy its transforms, they are
+     * computed again on the next convolution
+     */
+    winograd_conv_engine& operator=(const winograd_conv_engine& /*rhs*/) {
+        invalidate();
+        return *this;
+    }
+
+    /*!
+     * \brief Invalidate the transforms of the filters, they will be computed
+     * again before the next convolution
+     */
+    void invalidate() {
+        std::lock_guard<std::mutex> l(lock);
+        valid = false;
+    }
+
+    /*!
+     * \brief Compute the forward convolution of the batch with the filters
+     *
+     * \param out The output (B x K x M1 x M2), with M = NV + 2 * pad - 2
+     * \param in The input (B x NC x NV1 x NV2)
+     * \param w The filters (K x NC x 3 x 3)
+     * \param nv1 The first dimension of the input
+     * \param nv2 The second dimension of the input
+     * \param pad The padding of the input
+     */
+    template <typename O, typename I, typename W>
+    void forward(O& out, const I& in, const W& w, size_t nv1, size_t nv2, size_t pad) {
+        prepare(w);
+
+        const size_t batch = etl::dim<0>(in);
+
+        in.ensure_cpu_up_to_date();
+
+        correlate(out.memory_start(), in.memory_start(), u_forward.data(), batch, nc, k, nv1, nv2, nv1 + 2 * pad - 2, nv2 + 2 * pad - 2, pad);
+
+        out.invalidate_gpu();
+    }
+
+    /*!
+     * \brief Compute the backward (data) convolution of the errors with the
+     * filters, i.e. the full convolution of the errors with the filters.
+     *
+     * \param out The output (B x NC x NV1 x NV2), with NV = NH + 2 - 2 * pad
+     * \param errors The errors (B x K x NH1 x NH2)
+     * \param w The filters (K x NC x 3 x 3)
+     * \param nh1 The first dimension of the errors
+     * \param nh2 The second dimension of the errors
+     * \param pad The padding of the forward convolution
+     */
+    template <typename O, typename E, typename W>
+    void backward(O& out, const E& errors, const W& w, size_t nh1, size_t nh2, size_t pad) {
+        prepare(w);
+
+        const size_t batch = etl::dim<0>(errors);
+        const size_t p     = 2 - pad;
+
+        errors.ensure_cpu_up_to_date();
+
+        correlate(out.memory_start(), errors.memory_start(), u_backward.data(), batch, k, nc, nh1, nh2, nh1 + 2 * p - 2, nh2 + 2 * p - 2, p);
+
+        out.invalidate_gpu();
+    }
+
+private:
+    std::mutex lock;  ///< The lock protecting the transforms
+    bool valid = false; ///< Indicates if the transforms are up to date
+
+    size_t k  = 0; ///< The number of filters
+    size_t nc = 0; ///< The number of channels
+
+    std::vector<T> u_forward;  ///< The transforms of the filters (K x NC x 16)
+    std::vector<T> u_backward; ///< The transforms of the flipped filters (NC x K x 16)
+
+    /*!
+     * \brief Compute the transforms of the filters, if they are not up to date
+     */
+    template <typename W>
+    void prepare(const W& w) {
+        std::lock_guard<std::mutex> l(lock);
+
+        if (valid) {
+            return;
+        }
+
+        k  = etl::dim<0>(w);
+        nc = etl::dim<1>(w);
+
+        u_forward.resize(k * nc * 16);
+        u_backward.resize(k * nc * 16);
+
+        w.ensure_cpu_up_to_date();
+
+        const T* g = w.memory_start();
+
+        for (size_t kk = 0; kk < k; ++kk) {
+            for (size_t c = 0; c < nc; ++c) {
+                const T* g_kc = g + (kk * nc + c) * 9;
+
+                T flipped[9];
+
+                for (size_t i = 0; i < 9; ++i) {
+                    flipped[i] = g_kc[8 - i];
+                }
+
+                transform_filter(u_forward.data() + (kk * nc + c) * 16, g_kc);
+                transform_filter(u_backward.data() + (c * k + kk) * 16, flipped);
+            }
+        }
+
+        valid = true;
+    }
+
+    /*!
+     * \brief Compute U = G g G^T for a 3x3 filter
+     */
+    static void transform_filter(T* u, const T* g) {
+        T t[12];
+
+        // G g (4x3)
+        for (size_t j = 0; j < 3; ++j) {
+            t[0 * 3 + j] = g[0 * 3 + j];
+            t[1 * 3 + j] = T(0.5) * (g[0 * 3 + j] + g[1 * 3 + j] + g[2 * 3 + j]);
+            t[2 * 3 + j] = T(0.5) * (g[0 * 3 + j] - g[1 * 3 + j] + g[2 * 3 + j]);
+            t[3 * 3 + j] = g[2 * 3 + j];
+        }
+
+        // (G g) G^T (4x4)
+        for (size_t i = 0; i < 4; ++i) {
+            const T* r = t + i * 3;
+
+            u[i * 4 + 0] = r[0];
+            u[i * 4 + 1] = T(0.5) * (r[0] + r[1] + r[2]);
+            u[i * 4 + 2] = T(0.5) * (r[0] - r[1] + r[2]);
+            u[i * 4 + 3] = r[2];
+        }
+    }
+
+    /*!
+     * \brief Compute V = B^T d B for a 4x4 tile of the input
+     */
+    static void transform_input(T* v, const T* d) {
+        T t[16];
+
+        // B^T d
+        for (size_t j = 0; j < 4; ++j) {
+            t[0 * 4 + j] = d[0 * 4 + j] - d[2 * 4 + j];
+            t[1 * 4 + j] = d[1 * 4 + j] + d[2 * 4 + j];
+            t[2 * 4 + j] = d[2 * 4 + j] - d[1 * 4 + j];
+            t[3 * 4 + j] = d[1 * 4 + j] - d[3 * 4 + j];
+        }
+
+        // (B^T d) B
+        for (size_t i = 0; i < 4; ++i) {
+            const T* r = t + i * 4;
+
+            v[i * 4 + 0] = r[0] - r[2];
+            v[i * 4 + 1] = r[1] + r[2];
+            v[i * 4 + 2] = r[2] - r[1];
+            v[i * 4 + 3] = r[1] - r[3];
+        }
+    }
+
+    /*!
+     * \brief Compute Y = A^T m A, the 2x2 output tile
+     */
+    static void transform_output(T* y, const T* m) {
+        T t[8];
+
+        // A^T m
+        for (size_t j = 0; j < 4; ++j) {
+            t[0 * 4 + j] = m[0 * 4 + j] + m[1 * 4 + j] + m[2 * 4 + j];
+            t[1 * 4 + j] = m[1 * 4 + j] - m[2 * 4 + j] - m[3 * 4 + j];
+        }
+
+        // (A^T m) A
+        for (size_t i = 0; i < 2; ++i) {
+            const T* r = t + i * 4;
+
+            y[i * 2 + 0] = r[0] + r[1] + r[2];
+            y[i * 2 + 1] = r[1] - r[2] - r[3];
+        }
+    }
+
+    /*!
+     * \brief Compute the correlations of each input with the transformed
+     * filters, summed over the input channels.
+     *
+     * \param out The output (batch x cout x m1 x m2)
+     * \param in The input (batch x cin x n1 x n2)
+     * \param u The transformed filters (cout x cin x 16)
+     * \param pad The padding of the input
+     */
+    static void correlate(T* out, const T* in, const T* u, size_t batch, size_t cin, size_t cout, size_t n1, size_t n2, size_t m1, size_t m2, size_t pad) {
+        const size_t t1    = (m1 + 1) / 2;
+        const size_t t2    = (m2 + 1) / 2;
+        const size_t tiles = t1 * t2;
+
+        auto work = [=](size_t first, size_t last) {
+            arena_scope scope;
+
+            T* v = scope.allocate<T>(tiles * cin * 16);
+
+            T d[16];
+            T m[16];
+            T y[4];
+
+            for (size_t b = first; b < last; ++b) {
+                const T* in_b = in + b * cin * n1 * n2;
+                T* out_b      = out + b * cout * m1 * m2;
+
+                // Transform all the input tiles (tile-major, then channel)
+
+                for (size_t c = 0; c < cin; ++c) {
+                    const T* in_c = in_b + c * n1 * n2;
+
+                    for (size_t ty = 0; ty < t1; ++ty) {
+                        for (size_t tx = 0; tx < t2; ++tx) {
+                            for (size_t i = 0; i < 4; ++i) {
+                                const long row = long(2 * ty + i) - long(pad);
+
+                                for (size_t j = 0; j < 4; ++j) {
+                                    const long col = long(2 * tx + j) - long(pad);
+
+                                    const bool inside = row >= 0 && row < long(n1) && col >= 0 && col < long(n2);
+
+                                    d[i * 4 + j] = inside ? in_c[row * n2 + col] : T(0);
+                                }
+                            }
+
+                            transform_input(v + ((ty * t2 + tx) * cin + c) * 16, d);
+                        }
+                    }
+                }
+
+                // Element-wise products summed over the channels
+
+                for (size_t o = 0; o < cout; ++o) {
+                    const T* u_o = u + o * cin * 16;
+                    T* out_o     = out_b + o * m1 * m2;
+
+                    for (size_t ty = 0; ty < t1; ++ty) {
+                        for (size_t tx = 0; tx < t2; ++tx) {
+                            const T* v_t = v + (ty * t2 + tx) * cin * 16;
+
+                            std::fill(m, m + 16, T(0));
+
+                            for (size_t c = 0; c < cin; ++c) {
+                                for (size_t i = 0; i < 16; ++i) {
+                                    m[i] += u_o[c * 16 + i] * v_t[c * 16 + i];
+                                }
+                            }
+
+                            transform_output(y, m);
+
+                            for (size_t i = 0; i < 2 && 2 * ty + i < m1; ++i) {
+                                for (size_t j = 0; j < 2 && 2 * tx + j < m2; ++j) {
+                                    out_o[(2 * ty + i) * m2 + 2 * tx + j] = y[i * 2 + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        };
+
+        const bool parallel  = can_parallelize() && batch > 1 && batch * cout * m1 * m2 * cin >= (1UL << 18);
+        const size_t threads = parallel ? std::min(kernel_threads(), batch) : 1;
+
+        if (threads == 1) {
+            work(0, batch);
+            return;
+        }
+
+        parallel_chunks(batch, threads, [&work](size_t /*chunk*/, size_t first, size_t last) {
+            work(first, last);
+        });
+    }
+};
+
+/*!
+ * \brief Indicates if a layer caches transforms of its weights, that must be
+ * invalidated when its weights are changed.
+ */
+template <typename Layer, typename Enable = void>
+struct has_weights_transforms : std::false_type {};
+
+template <typename Layer>
+struct has_weights_transforms<Layer, std::void_t<decltype(std::declval<Layer&>().invalidate_transforms())>> : std::true_type {};
+
+/*!
+ * \brief Invalidate the cached transforms of the weights of the given
+ * layer, if any. This must be called after the weights have been changed.
+ */
+template <typename Layer>
+void invalidate_transforms([[maybe_unused]] Layer& layer) {
+    if constexpr (has_weights_transforms<Layer>::value) {
+        layer.invalidate_transforms();
+    }
+}
+
+} //end of dll namespace
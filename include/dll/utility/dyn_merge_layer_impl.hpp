@@ -10,6 +10,7 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/branches.hpp" // for forward_branches
 
 namespace dll {
 
@@ -139,10 +140,9 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void test_forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.test_forward_batch(input);
-
-            etl::batch_merge(output, sub_output, i);
+        // The branches are independent
+        forward_branches<D>(layers, output, [&input](auto& layer) {
+            return layer.test_forward_batch(input);
         });
     }
 
@@ -169,10 +169,9 @@ struct dyn_merge_layer_impl <dyn_merge_layer_desc<D, Layers...>> final : layer<d
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& input) const {
-        cpp::for_each_i(layers, [&input, &output](size_t i, auto& layer){
-            auto sub_output = layer.forward_batch(input);
-
-            etl::batch_merge(output, sub_output, i);
+        // The branches are independent
+        forward_branches<D>(layers, output, [&input](auto& layer) {
+            return layer.forward_batch(input);
         });
     }
 
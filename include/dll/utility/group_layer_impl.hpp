@@ -10,6 +10,7 @@
 #include "dll/neural_layer.hpp"
 
 #include "dll/util/timers.hpp" // for auto_timer
+#include "dll/util/wavefront.hpp" // for wavefront_forward
 
 namespace dll {
 
@@ -33,7 +34,8 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
     using input_t      = std::vector<input_one_t>;            ///< The type of the input
     using output_t     = std::vector<output_one_t>;           ///< The type of the output
 
-    static constexpr size_t n_layers = sizeof...(Layers); ///< The number of layers
+    static constexpr size_t n_layers = sizeof...(Layers);          ///< The number of layers
+    static constexpr bool wavefront  = wavefront_stack<Layers...>; ///< Indicates if the layers are forward propagated as a wavefront
 
     std::tuple<Layers...> layers; ///< The layers to group
 
@@ -121,7 +123,11 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
      */
     template <typename H1, typename V>
     void test_forward_batch(H1&& output, const V& input) const {
-        test_forward_batch_sub<0>(output, input);
+        if constexpr (wavefront) {
+            wavefront_forward_batch(output, input);
+        } else {
+            test_forward_batch_sub<0>(output, input);
+        }
     }
 
     template <size_t L, typename H1, typename V>
@@ -143,7 +149,11 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
      */
     template <typename H1, typename V>
     void train_forward_batch(H1&& output, const V& input) const {
-        train_forward_batch_sub<0>(output, input);
+        if constexpr (wavefront) {
+            wavefront_forward_batch(output, input);
+        } else {
+            train_forward_batch_sub<0>(output, input);
+        }
     }
 
     template <size_t L, typename H1, typename V>
@@ -165,7 +175,29 @@ struct group_layer_impl<group_layer_desc<Layers...>> final : layer<group_layer_i
      */
     template <typename H1, typename V>
     void forward_batch(H1&& output, const V& input) const {
-        forward_batch_sub<0>(output, input);
+        if constexpr (wavefront) {
+            wavefront_forward_batch(output, input);
+        } else {
+            forward_batch_sub<0>(output, input);
+        }
+    }
+
+    /*!
+     * \brief Apply the recurrent layers of the group to the given batch of
+     * input, as a wavefront (see wavefront_forward).
+     *
+     * \param input A batch of input
+     * \param output A batch of output that will be filled
+     */
+    template <typename H1, typename V>
+    void wavefront_forward_batch(H1&& output, const V& input) const {
+        dll::auto_timer timer("group:wavefront");
+
+        wavefront_forward(layers, input, [&output](auto i, auto& layer) {
+            if constexpr (decltype(i)::value == n_layers - 1) {
+                layer.wavefront_end(output);
+            }
+        });
     }
 
     /*!
@@ -9,6 +9,7 @@
 
 #include <fstream>
 #include <cstring>
+#include <memory>
 
 #include <sys/stat.h>
 
@@ -17,6 +18,9 @@
 #include "trainer/rbm_training_context.hpp"
 #include "layer_traits.hpp"
 #include "dbn_traits.hpp"
+#include "util/metrics.hpp"
+#include "util/async_log.hpp"
+#include "generators/stall_timer.hpp"
 
 namespace dll {
 
@@ -214,6 +218,10 @@ struct default_dbn_watcher {
             std::cout << "   learning_rate=" << dbn.learning_rate << std::endl;
         }
 
+        if (dbn.schedule.enabled()) {
+            std::cout << "     lr_schedule=" << dll::to_string(dbn.schedule) << std::endl;
+        }
+
         if (UT == updater_type::MOMENTUM) {
             std::cout << "        momentum=" << dbn.momentum << std::endl;
         }
@@ -222,11 +230,16 @@ struct default_dbn_watcher {
             std::cout << "        momentum=" << dbn.momentum << std::endl;
         }
 
+        if (UT == updater_type::LARS) {
+            std::cout << "        momentum=" << dbn.momentum << std::endl;
+            std::cout << "             eta=" << dbn.lars_eta << std::endl;
+        }
+
         if (UT == updater_type::ADADELTA) {
             std::cout << "            beta=" << dbn.adadelta_beta << std::endl;
         }
 
-        if (UT == updater_type::ADAM || UT == updater_type::ADAM_CORRECT || UT == updater_type::ADAMAX || UT == updater_type::NADAM) {
+        if (UT == updater_type::ADAM || UT == updater_type::ADAM_CORRECT || UT == updater_type::ADAMAX || UT == updater_type::NADAM || UT == updater_type::LAMB) {
             std::cout << "           beta1=" << dbn.adam_beta1 << std::endl;
             std::cout << "           beta2=" << dbn.adam_beta2 << std::endl;
         }
@@ -252,6 +265,10 @@ struct default_dbn_watcher {
     size_t total_batch_duration = 0;
     size_t total_batches = 0;
 
+    double ft_stall       = 0.0;   ///< The time waited for the generator during the last epoch, in seconds
+    double ft_stall_ratio = 0.0;   ///< The fraction of the last epoch spent waiting for the generator
+    bool ft_stall_bound   = false; ///< Indicates if the last epoch was generator-bound
+
     /*!
      * \brief One fine-tuning epoch is starting
      * \param epoch The current epoch
@@ -265,6 +282,48 @@ struct default_dbn_watcher {
         last_line_length = 0;
     }
 
+    /*!
+     * \brief Write the current learning rate into the given buffer, if the
+     * network follows a schedule, or an empty string otherwise
+     */
+    static void schedule_string(char (&buffer)[64], const DBN& dbn) {
+        if (dbn.schedule.enabled()) {
+            snprintf(buffer, 64, " lr: %.3e", double(dbn.learning_rate));
+        } else {
+            buffer[0] = '\0';
+        }
+    }
+
+    /*!
+     * \brief Indicates the time the training waited for the generator during
+     * the epoch, reported with the end of the epoch
+     * \param epoch The current epoch
+     * \param stall The time spent waiting for the batches, in seconds
+     * \param duration The time spent training the epoch, in seconds
+     */
+    void ft_epoch_stall(size_t epoch, double stall, double duration) {
+        ft_stall       = stall;
+        ft_stall_bound = is_generator_bound(stall, duration);
+        ft_stall_ratio = duration > 0.0 ? stall / duration : 0.0;
+
+        cpp_unused(epoch);
+    }
+
+    /*!
+     * \brief Write whether the last epoch was bound by the generator into the
+     * given buffer, or an empty string if the stalls were not measured or
+     * were negligible
+     */
+    void stall_string(char (&buffer)[64]) {
+        if (ft_stall_bound) {
+            snprintf(buffer, 64, " generator-bound (waited %.0fms, %.0f%%)", 1000.0 * ft_stall, 100.0 * ft_stall_ratio);
+        } else {
+            buffer[0] = '\0';
+        }
+
+        ft_stall_bound = false;
+    }
+
     /*!
      * \brief One fine-tuning epoch is over
      * \param epoch The current epoch
@@ -273,18 +332,22 @@ struct default_dbn_watcher {
      * \param dbn The network being trained
      */
     void ft_epoch_end(size_t epoch, double error, double loss, const DBN& dbn) {
-        cpp_unused(dbn);
-
         auto duration = ft_epoch_timer.stop();
 
+        char stall[64];
+        stall_string(stall);
+
+        char lr[64];
+        schedule_string(lr, dbn);
+
         char buffer[512];
 
         if (dbn_traits<DBN>::error_on_epoch()){
-            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld - error: %.5f loss: %.5f time %ldms \n",
-                epoch, ft_max_epochs, max_batches, max_batches, error, loss, duration);
+            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld - error: %.5f loss: %.5f%s time %ldms%s \n",
+                epoch, ft_max_epochs, max_batches, max_batches, error, loss, lr, duration, stall);
         } else {
-            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld - loss: %.5f time %ldms \n",
-                epoch, ft_max_epochs, max_batches, max_batches, loss, duration);
+            snprintf(buffer, 512, "epoch %3ld/%ld batch %4ld/%4ld - loss: %.5f%s time %ldms%s \n",
+                epoch, ft_max_epochs, max_batches, max_batches, loss, lr, duration, stall);
         }
 
         if (dbn_traits<DBN>::is_verbose()){
@@ -304,18 +367,22 @@ struct default_dbn_watcher {
      * \param dbn The network being trained
      */
     void ft_epoch_end(size_t epoch, double train_error, double train_loss, double val_error, double val_loss, const DBN& dbn) {
-        cpp_unused(dbn);
-
         auto duration = ft_epoch_timer.stop();
 
+        char stall[64];
+        stall_string(stall);
+
+        char lr[64];
+        schedule_string(lr, dbn);
+
         char buffer[512];
 
         if constexpr (dbn_traits<DBN>::error_on_epoch()){
-            snprintf(buffer, 512, "epoch %3ld/%ld - error: %.5f loss: %.5f val_error: %.5f val_loss: %.5f time %ldms \n",
-                epoch, ft_max_epochs, train_error, train_loss, val_error, val_loss, duration);
+            snprintf(buffer, 512, "epoch %3ld/%ld - error: %.5f loss: %.5f val_error: %.5f val_loss: %.5f%s time %ldms%s \n",
+                epoch, ft_max_epochs, train_error, train_loss, val_error, val_loss, lr, duration, stall);
         } else {
-            snprintf(buffer, 512, "epoch %3ld/%ld - loss: %.5f val_loss: %.5f time %ldms \n",
-                epoch, ft_max_epochs, train_loss, val_loss, duration);
+            snprintf(buffer, 512, "epoch %3ld/%ld - loss: %.5f val_loss: %.5f%s time %ldms%s \n",
+                epoch, ft_max_epochs, train_loss, val_loss, lr, duration, stall);
         }
 
         if constexpr (dbn_traits<DBN>::is_verbose()){
@@ -530,4 +597,378 @@ struct mute_dbn_watcher {
     void fine_tuning_end(const DBN& /*dbn*/) {}
 };
 
+/*!
+ * \brief Watcher for RBM pretraining publishing the metrics to StatsD and
+ * Prometheus (see util/metrics.hpp) instead of printing them.
+ * \tparam R The RBM type
+ */
+template <typename R>
+struct metrics_rbm_watcher {
+    std::unique_ptr<metrics_exporter> exporter;                  ///< The exporter of the metrics
+    std::chrono::time_point<std::chrono::steady_clock> last_batch; ///< The end of the last batch
+
+    /*!
+     * \brief Indicates that the training of the given RBM started.
+     * \param rbm The rbm that started training.
+     */
+    template <typename RBM = R>
+    void training_begin(const RBM& rbm) {
+        exporter = std::make_unique<metrics_exporter>();
+        exporter->start();
+
+        last_batch = std::chrono::steady_clock::now();
+
+        cpp_unused(rbm);
+    }
+
+    /*!
+     * \brief Indicates the end of an epoch of pretraining.
+     * \param epoch The epoch that just finished training
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        exporter->push("epoch", double(epoch), metric_kind::GAUGE);
+        exporter->push("reconstruction_error", context.reconstruction_error, metric_kind::GAUGE);
+        exporter->push("sparsity", context.sparsity, metric_kind::GAUGE);
+
+        if (rbm_layer_traits<RBM>::free_energy()) {
+            exporter->push("free_energy", context.free_energy, metric_kind::GAUGE);
+        }
+
+        cpp_unused(rbm);
+    }
+
+    /*!
+     * \brief Indicates the end of a batch of pretraining.
+     * \param batch The batch that just finished training
+     * \param batches The total number of batches
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
+        auto now = std::chrono::steady_clock::now();
+
+        exporter->push("batch_latency", std::chrono::duration<double, std::milli>(now - last_batch).count(), metric_kind::TIMING);
+        exporter->push("samples", double(RBM::batch_size), metric_kind::COUNTER);
+        exporter->push("batch_error", context.batch_error, metric_kind::GAUGE);
+
+        last_batch = now;
+
+        cpp_unused(rbm);
+        cpp_unused(batch);
+        cpp_unused(batches);
+    }
+
+    /*!
+     * \brief Indicates the end of pretraining.
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void training_end(const RBM& rbm) {
+        exporter->stop();
+
+        cpp_unused(rbm);
+    }
+};
+
+/*!
+ * \brief Watcher for DBN training publishing the metrics (throughput,
+ * latency of the batches, depth of the generator queue, loss, error and
+ * memory use) to StatsD and Prometheus (see util/metrics.hpp) instead of
+ * printing them. The training thread only pushes the raw values.
+ */
+template <typename DBN>
+struct metrics_dbn_watcher : mute_dbn_watcher<DBN> {
+    std::unique_ptr<metrics_exporter> exporter;                   ///< The exporter of the metrics
+    std::chrono::time_point<std::chrono::steady_clock> batch_start; ///< The start of the current batch
+
+    /*!
+     * \brief Fine-tuning of the given network just started
+     * \param dbn The DBN that is being trained
+     * \param max_epochs The maximum number of epochs to train the network
+     */
+    void fine_tuning_begin(const DBN& dbn, size_t max_epochs) {
+        exporter = std::make_unique<metrics_exporter>();
+        exporter->start();
+
+        exporter->push("max_epochs", double(max_epochs), metric_kind::GAUGE);
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is ended
+     */
+    void ft_epoch_end(size_t epoch, double error, double loss, const DBN& dbn) {
+        exporter->push("epoch", double(epoch), metric_kind::GAUGE);
+        exporter->push("error", error, metric_kind::GAUGE);
+        exporter->push("loss", loss, metric_kind::GAUGE);
+        exporter->push("learning_rate", double(dbn.learning_rate), metric_kind::GAUGE);
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is ended, with validation
+     */
+    void ft_epoch_end(size_t epoch, double train_error, double train_loss, double val_error, double val_loss, const DBN& dbn) {
+        ft_epoch_end(epoch, train_error, train_loss, dbn);
+
+        exporter->push("val_error", val_error, metric_kind::GAUGE);
+        exporter->push("val_loss", val_loss, metric_kind::GAUGE);
+    }
+
+    /*!
+     * \brief Indicates the beginning of a fine-tuning batch
+     */
+    void ft_batch_start(size_t /*epoch*/, const DBN& /*dbn*/) {
+        batch_start = std::chrono::steady_clock::now();
+    }
+
+    /*!
+     * \brief Indicates the end of a fine-tuning batch
+     * \param epoch The current epoch
+     * \param batch The current batch
+     * \param batches THe total number of batches
+     * \param batch_error The batch error
+     * \param batch_loss The batch loss
+     * \param dbn The DBN being trained
+     */
+    void ft_batch_end(size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss, const DBN& dbn) {
+        auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch_start).count();
+
+        exporter->push("batch_latency", duration, metric_kind::TIMING);
+        exporter->push("samples", double(DBN::batch_size), metric_kind::COUNTER);
+        exporter->push("batch_error", batch_error, metric_kind::GAUGE);
+        exporter->push("batch_loss", batch_loss, metric_kind::GAUGE);
+
+        cpp_unused(epoch);
+        cpp_unused(batch);
+        cpp_unused(batches);
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief Indicates the number of batches ready ahead of the training
+     * in the generator, after a fine-tuning batch
+     */
+    void ft_batch_queue(size_t ready) {
+        exporter->push("generator_queue_depth", double(ready), metric_kind::GAUGE);
+    }
+
+    /*!
+     * \brief Indicates the time the training waited for the generator during
+     * a fine-tuning epoch
+     */
+    void ft_epoch_stall(size_t epoch, double stall, double duration) {
+        exporter->push("generator_stall", 1000.0 * stall, metric_kind::TIMING);
+        exporter->push("generator_stall_ratio", duration > 0.0 ? stall / duration : 0.0, metric_kind::GAUGE);
+
+        cpp_unused(epoch);
+    }
+
+    /*!
+     * \brief Fine-tuning of the given network just finished
+     * \param dbn The DBN that is being trained
+     */
+    void fine_tuning_end(const DBN& dbn) {
+        exporter->stop();
+
+        cpp_unused(dbn);
+    }
+};
+
+/*!
+ * \brief Watcher for RBM pretraining writing the progress from a background
+ * thread (see util/async_log.hpp). The training thread only pushes compact
+ * records, the batch lines are rate-limited.
+ * \tparam R The RBM type
+ */
+template <typename R>
+struct async_rbm_watcher : default_rbm_watcher<R> {
+    using base_type = default_rbm_watcher<R>; ///< The type of the base watcher
+
+    std::unique_ptr<async_logger> logger; ///< The logger of the progress
+
+    /*!
+     * \brief Indicates that the training of the given RBM started.
+     * \param rbm The rbm that started training.
+     */
+    template <typename RBM = R>
+    void training_begin(const RBM& rbm) {
+        base_type::training_begin(rbm);
+
+        std::cout.flush();
+
+        logger = std::make_unique<async_logger>();
+        logger->start();
+    }
+
+    /*!
+     * \brief Indicates the end of an epoch of pretraining.
+     * \param epoch The epoch that just finished training
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void epoch_end(size_t epoch, const rbm_training_context& context, const RBM& rbm) {
+        log_record record{};
+        record.event     = log_event::RBM_EPOCH;
+        record.flag      = rbm_layer_traits<RBM>::free_energy();
+        record.epoch     = uint32_t(epoch);
+        record.values[0] = context.reconstruction_error;
+        record.values[1] = context.sparsity;
+        record.values[2] = context.free_energy;
+
+        logger->push(record);
+
+        cpp_unused(rbm);
+    }
+
+    /*!
+     * \brief Indicates the end of a batch of pretraining.
+     * \param batch The batch that just finished training
+     * \param batches The total number of batches
+     * \param context The RBM's training context
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void batch_end(const RBM& rbm, const rbm_training_context& context, size_t batch, size_t batches) {
+        log_record record{};
+        record.event     = log_event::RBM_BATCH;
+        record.batch     = uint32_t(batch);
+        record.batches   = uint32_t(batches);
+        record.values[0] = context.batch_error;
+        record.values[1] = context.batch_sparsity;
+
+        logger->push(record);
+
+        cpp_unused(rbm);
+    }
+
+    /*!
+     * \brief Indicates the end of pretraining.
+     * \param rbm The RBM being trained
+     */
+    template <typename RBM = R>
+    void training_end(const RBM& rbm) {
+        logger->stop();
+
+        base_type::training_end(rbm);
+    }
+};
+
+/*!
+ * \brief Watcher for DBN training writing the progress of the fine-tuning
+ * from a background thread (see util/async_log.hpp). The training thread
+ * only pushes compact records, the batch lines are rate-limited.
+ */
+template <typename DBN>
+struct async_dbn_watcher : default_dbn_watcher<DBN> {
+    using base_type = default_dbn_watcher<DBN>; ///< The type of the base watcher
+
+    std::unique_ptr<async_logger> logger; ///< The logger of the progress
+
+    /*!
+     * \brief Fine-tuning of the given network just started
+     * \param dbn The DBN that is being trained
+     * \param max_epochs The maximum number of epochs to train the network
+     */
+    void fine_tuning_begin(const DBN& dbn, size_t max_epochs) {
+        base_type::fine_tuning_begin(dbn, max_epochs);
+
+        std::cout.flush();
+
+        logger = std::make_unique<async_logger>();
+        logger->start();
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is over
+     * \param epoch The current epoch
+     * \param error The current error
+     * \param loss The current loss
+     * \param dbn The network being trained
+     */
+    void ft_epoch_end(size_t epoch, double error, double loss, const DBN& dbn) {
+        log_record record{};
+        record.event     = log_event::FT_EPOCH;
+        record.flag      = dbn_traits<DBN>::error_on_epoch();
+        record.epoch     = uint32_t(epoch);
+        record.epochs    = uint32_t(this->ft_max_epochs);
+        record.duration  = uint32_t(this->ft_epoch_timer.stop());
+        record.values[0] = error;
+        record.values[1] = loss;
+
+        logger->push(record);
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief One fine-tuning epoch is over
+     * \param epoch The current epoch
+     * \param train_error The current error
+     * \param train_loss The current loss
+     * \param val_error The current validation error
+     * \param val_loss The current validation loss
+     * \param dbn The network being trained
+     */
+    void ft_epoch_end(size_t epoch, double train_error, double train_loss, double val_error, double val_loss, const DBN& dbn) {
+        log_record record{};
+        record.event     = log_event::FT_VAL_EPOCH;
+        record.flag      = dbn_traits<DBN>::error_on_epoch();
+        record.epoch     = uint32_t(epoch);
+        record.epochs    = uint32_t(this->ft_max_epochs);
+        record.duration  = uint32_t(this->ft_epoch_timer.stop());
+        record.values[0] = train_error;
+        record.values[1] = train_loss;
+        record.values[2] = val_error;
+        record.values[3] = val_loss;
+
+        logger->push(record);
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief Indicates the end of a fine-tuning batch
+     * \param epoch The current epoch
+     * \param batch The current batch
+     * \param batches THe total number of batches
+     * \param batch_error The batch error
+     * \param batch_loss The batch loss
+     * \param dbn The DBN being trained
+     */
+    void ft_batch_end(size_t epoch, size_t batch, size_t batches, double batch_error, double batch_loss, const DBN& dbn) {
+        log_record record{};
+        record.event     = log_event::FT_BATCH;
+        record.flag      = true;
+        record.epoch     = uint32_t(epoch);
+        record.epochs    = uint32_t(this->ft_max_epochs);
+        record.batch     = uint32_t(batch);
+        record.batches   = uint32_t(batches);
+        record.duration  = uint32_t(this->ft_batch_timer.stop());
+        record.values[0] = batch_error;
+        record.values[1] = batch_loss;
+
+        logger->push(record);
+
+        this->max_batches = batches;
+
+        cpp_unused(dbn);
+    }
+
+    /*!
+     * \brief Fine-tuning of the given network just finished
+     * \param dbn The DBN that is being trained
+     */
+    void fine_tuning_end(const DBN& dbn) {
+        logger->stop();
+
+        base_type::fine_tuning_end(dbn);
+    }
+};
+
 } //end of dll namespace
@@ -0,0 +1,56 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "layer.hpp"
+
+namespace dllp {
+
+/*!
+ * \brief Generate a standalone inference source for the given network, with
+ * the weights of the given model file baked in.
+ *
+ * \param layers The layers of the network
+ * \param model_file The model file with the trained weights
+ * \param output_file The source file to generate
+ * \return true if the source was generated, false otherwise
+ */
+bool generate_inference(const layers_t& layers, const std::string& model_file, const std::string& output_file);
+
+/*!
+ * \brief Print the definition of an aligned constant array
+ * \param out The stream to print to
+ * \param name The name of the array
+ * \param values The values of the array
+ * \param n The number of values
+ * \return true if all the values could be printed, false otherwise
+ */
+bool print_inference_array(std::ostream& out, const std::string& name, const float* values, size_t n);
+
+/*!
+ * \brief Print the code applying the given activation function in place
+ * \param out The stream to print to
+ * \param activation The activation function, as in the configuration
+ * \param n The number of values
+ * \param values The expression of the values
+ */
+void print_inference_activation(std::ostream& out, const std::string& activation, size_t n, const std::string& values);
+
+/*!
+ * \brief Print the pragma unrolling the next loop, if it is small enough
+ * \param out The stream to print to
+ * \param n The number of iterations of the loop
+ * \param indent The indentation of the loop
+ */
+void print_inference_unroll(std::ostream& out, size_t n, const std::string& indent);
+
+} //end of namespace dllp
@@ -12,6 +12,7 @@
 #include <iostream>
 
 #include "dll/processor/processor.hpp"
+#include "dll/util/model_file.hpp"
 
 namespace dllp {
 
@@ -19,6 +20,57 @@ struct layer;
 
 using layers_t = std::vector<std::unique_ptr<dllp::layer>>;
 
+/*!
+ * \brief The values of the generated program.
+ *
+ * In static mode, the values are printed directly in the generated code. In
+ * dynamic mode, they are collected to be passed to the generated program at
+ * runtime, so that the code only depends on the structure of the network.
+ */
+struct runtime_parameters {
+    bool dynamic = false;            ///< Indicates if the values are passed at runtime
+    std::vector<std::string> values; ///< The values passed at runtime
+
+    /*!
+     * \brief Returns the code of the given floating point value
+     */
+    std::string real(double value);
+
+    /*!
+     * \brief Returns the code of the given integer value
+     */
+    std::string integer(long value);
+
+    /*!
+     * \brief Returns the code of the given string value
+     */
+    std::string string(const std::string& value);
+};
+
+/*!
+ * \brief The tensors of a trained model, consumed in order by the layers
+ * that have weights
+ */
+struct inference_weights {
+    const dll::mapped_model_file& model; ///< The model file
+    size_t next = 0;                     ///< The next tensor
+
+    explicit inference_weights(const dll::mapped_model_file& model) : model(model) {}
+
+    /*!
+     * \brief Returns the values of the next tensor (the weights followed by
+     * the biases of a layer), nullptr if it does not have the given number
+     * of values
+     */
+    const float* next_tensor(size_t values) {
+        if (next >= model.size() || model.entry(next).size != values * sizeof(float)) {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const float*>(model.data(next++));
+    }
+};
+
 /*!
  * \brief A layer (in the processor configuration)
  */
@@ -29,6 +81,14 @@ struct layer {
      */
     virtual void print(std::ostream& out) const = 0;
 
+    /*!
+     * \brief Print the code of the dynamic version of the layer to the given stream
+     * \param out The stream to print to
+     */
+    virtual void print_dyn(std::ostream& out) const {
+        print(out);
+    }
+
     /*!
      * \brief Returns the number of hidden unit
      */
@@ -36,6 +96,13 @@ struct layer {
         return 0;
     }
 
+    /*!
+     * \brief Returns the number of inputs of the layer (0 if it is not known)
+     */
+    virtual size_t visible_get() const {
+        return 0;
+    }
+
     /*!
      * \brief Indicates if the layer is a transform layer
      */
@@ -73,7 +140,28 @@ struct layer {
 
     virtual bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) = 0;
 
-    virtual void set(std::ostream& /*out*/, const std::string& /*lhs*/) const {/* Nothing */};
+    virtual void set(std::ostream& /*out*/, const std::string& /*lhs*/, runtime_parameters& /*params*/) const {/* Nothing */};
+
+    /*!
+     * \brief Print the code initializing the dynamic version of the layer
+     * \param out The stream to print to
+     * \param lhs The expression of the layer
+     * \param params The values of the generated program
+     */
+    virtual void init(std::ostream& /*out*/, const std::string& /*lhs*/, runtime_parameters& /*params*/) const {/* Nothing */};
+
+    /*!
+     * \brief Print the standalone inference code of the layer, a function
+     * name(const float* input, float* output), with its weights
+     * \param out The stream to print to
+     * \param name The name of the function
+     * \param input_size The number of inputs of the layer
+     * \param weights The trained weights
+     * \return true if the code was generated, false if the layer is not supported
+     */
+    virtual bool inference(std::ostream& /*out*/, const std::string& /*name*/, size_t /*input_size*/, inference_weights& /*weights*/) const {
+        return false;
+    }
 };
 
 enum class parse_result {
@@ -86,6 +174,7 @@ struct function_layer : layer {
     std::string activation;
 
     void print(std::ostream& out) const override;
+    bool inference(std::ostream& out, const std::string& name, size_t input_size, inference_weights& weights) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 
     bool is_transform() const override;
@@ -116,7 +205,7 @@ struct base_rbm_layer : layer {
     bool shuffle       = false; ///< Indicates if the RBM is trained with shuffle
 
     void print(std::ostream& out) const override;
-    void set(std::ostream& out, const std::string& lhs) const override;
+    void set(std::ostream& out, const std::string& lhs, runtime_parameters& params) const override;
 
     parse_result base_parse(const std::vector<std::string>& lines, size_t& i);
 };
@@ -126,6 +215,8 @@ struct rbm_layer : base_rbm_layer {
     size_t hidden  = 0; ///< The number of hidden units
 
     void print(std::ostream& out) const override;
+    void print_dyn(std::ostream& out) const override;
+    void init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 
     size_t hidden_get() const override;
@@ -140,6 +231,8 @@ struct conv_rbm_layer : base_rbm_layer {
     size_t w2 = 0; ///< The second dimension of the filters
 
     void print(std::ostream& out) const override;
+    void print_dyn(std::ostream& out) const override;
+    void init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 
     bool is_conv() const override;
@@ -159,6 +252,8 @@ struct conv_rbm_mp_layer : base_rbm_layer {
     size_t p  = 0;
 
     void print(std::ostream& out) const override;
+    void print_dyn(std::ostream& out) const override;
+    void init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 
     bool is_conv() const override;
@@ -175,9 +270,13 @@ struct dense_layer : layer {
     std::string activation;
 
     void print(std::ostream& out) const override;
+    void print_dyn(std::ostream& out) const override;
+    void init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const override;
+    bool inference(std::ostream& out, const std::string& name, size_t input_size, inference_weights& weights) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 
     size_t hidden_get() const override;
+    size_t visible_get() const override;
 };
 
 struct conv_layer : layer {
@@ -191,10 +290,14 @@ struct conv_layer : layer {
     std::string activation;
 
     void print(std::ostream& out) const override;
+    void print_dyn(std::ostream& out) const override;
+    void init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const override;
+    bool inference(std::ostream& out, const std::string& name, size_t input_size, inference_weights& weights) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 
     bool is_conv() const override;
     size_t hidden_get() const override;
+    size_t visible_get() const override;
     size_t hidden_get_1() const override;
     size_t hidden_get_2() const override;
     size_t hidden_get_3() const override;
@@ -209,10 +312,18 @@ struct pooling_layer : layer {
     size_t c3 = 0; ///< The pooling factor of the first dimension
 
     void print(std::ostream& out) const override;
+    void init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const override;
+
+    /*!
+     * \brief Print the inference code of the pooling (max or average)
+     */
+    bool pooling_inference(std::ostream& out, const std::string& name, bool max) const;
+
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 
     bool is_conv() const override;
     size_t hidden_get() const override;
+    size_t visible_get() const override;
     size_t hidden_get_1() const override;
     size_t hidden_get_2() const override;
     size_t hidden_get_3() const override;
@@ -220,11 +331,15 @@ struct pooling_layer : layer {
 
 struct mp_layer : pooling_layer {
     void print(std::ostream& out) const override;
+    void print_dyn(std::ostream& out) const override;
+    bool inference(std::ostream& out, const std::string& name, size_t input_size, inference_weights& weights) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 };
 
 struct avgp_layer : pooling_layer {
     void print(std::ostream& out) const override;
+    void print_dyn(std::ostream& out) const override;
+    bool inference(std::ostream& out, const std::string& name, size_t input_size, inference_weights& weights) const override;
     bool parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) override;
 };
 
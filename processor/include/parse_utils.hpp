@@ -26,6 +26,7 @@ bool valid_trainer(const std::string& unit);
 bool valid_ft_trainer(const std::string& unit);
 bool valid_activation(const std::string& unit);
 bool valid_sparsity(const std::string& unit);
+bool valid_profile(const std::string& profile);
 
 std::string unit_type(const std::string& unit);
 std::string activation_function(const std::string& unit);
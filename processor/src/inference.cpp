@@ -0,0 +1,223 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "inference.hpp"
+
+namespace {
+
+/*!
+ * \brief The largest loop that is completely unrolled
+ */
+constexpr size_t max_unroll = 16;
+
+} //end of anonymous namespace
+
+bool dllp::print_inference_array(std::ostream& out, const std::string& name, const float* values, size_t n) {
+    out << "alignas(64) constexpr float " << name << "[" << n << "] = {";
+
+    char buffer[32];
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!std::isfinite(values[i])) {
+            std::cout << "dllp: error: " << name << " contains a non-finite value" << std::endl;
+            return false;
+        }
+
+        std::snprintf(buffer, sizeof(buffer), "%.9g", double(values[i]));
+
+        std::string value(buffer);
+
+        // Make sure the literal is a floating point literal
+        if (value.find_first_of(".e") == std::string::npos) {
+            value += ".0";
+        }
+
+        out << (i % 8 ? " " : "\n    ") << value << "f" << (i + 1 < n ? "," : "");
+    }
+
+    out << "\n};\n\n";
+
+    return true;
+}
+
+void dllp::print_inference_activation(std::ostream& out, const std::string& activation, size_t n, const std::string& values) {
+    if (activation == "identity") {
+        return;
+    }
+
+    out << "\n";
+
+    if (activation == "softmax") {
+        out << "    float max = " << values << "[0];\n\n";
+        out << "    for (size_t j = 1; j < " << n << "; ++j) {\n";
+        out << "        max = " << values << "[j] > max ? " << values << "[j] : max;\n";
+        out << "    }\n\n";
+        out << "    float sum = 0.0f;\n\n";
+        out << "    for (size_t j = 0; j < " << n << "; ++j) {\n";
+        out << "        " << values << "[j] = std::exp(" << values << "[j] - max);\n";
+        out << "        sum += " << values << "[j];\n";
+        out << "    }\n\n";
+        out << "    for (size_t j = 0; j < " << n << "; ++j) {\n";
+        out << "        " << values << "[j] /= sum;\n";
+        out << "    }\n";
+        return;
+    }
+
+    out << "    for (size_t j = 0; j < " << n << "; ++j) {\n";
+
+    if (activation == "relu") {
+        out << "        " << values << "[j] = " << values << "[j] > 0.0f ? " << values << "[j] : 0.0f;\n";
+    } else if (activation == "tanh") {
+        out << "        " << values << "[j] = std::tanh(" << values << "[j]);\n";
+    } else {
+        out << "        " << values << "[j] = 1.0f / (1.0f + std::exp(-" << values << "[j]));\n";
+    }
+
+    out << "    }\n";
+}
+
+void dllp::print_inference_unroll(std::ostream& out, size_t n, const std::string& indent) {
+    if (n <= max_unroll) {
+        out << indent << "#pragma GCC unroll " << n << "\n";
+    }
+}
+
+bool dllp::generate_inference(const layers_t& layers, const std::string& model_file, const std::string& output_file) {
+    if (!dll::is_model_file(model_file)) {
+        std::cout << "dllp: error: " << model_file << " is not a model file" << std::endl;
+        return false;
+    }
+
+    dll::mapped_model_file model(model_file);
+
+    if (!model.valid()) {
+        std::cout << "dllp: error: Impossible to read " << model_file << std::endl;
+        return false;
+    }
+
+    if (model.header.weight_size != sizeof(float)) {
+        std::cout << "dllp: error: codegen only supports single-precision models" << std::endl;
+        return false;
+    }
+
+    if (layers.empty()) {
+        std::cout << "dllp: error: codegen needs at least one layer" << std::endl;
+        return false;
+    }
+
+    std::ostringstream functions;
+
+    inference_weights weights(model);
+
+    const size_t first_size = layers.front()->visible_get();
+
+    if (!first_size) {
+        std::cout << "dllp: error: codegen does not support the first layer" << std::endl;
+        return false;
+    }
+
+    size_t input_size = first_size;
+    size_t max_size   = first_size;
+
+    for (size_t i = 0; i < layers.size(); ++i) {
+        auto name = "layer_" + std::to_string(i);
+
+        if (!layers[i]->is_transform() && !layers[i]->hidden_get()) {
+            std::cout << "dllp: error: codegen cannot compute the size of layer " << (i + 1) << std::endl;
+            return false;
+        }
+
+        if (!layers[i]->inference(functions, name, input_size, weights)) {
+            std::cout << "dllp: error: codegen does not support layer " << (i + 1) << " or its weights do not match the model file" << std::endl;
+            return false;
+        }
+
+        if (!layers[i]->is_transform()) {
+            input_size = layers[i]->hidden_get();
+        }
+
+        max_size = std::max(max_size, input_size);
+    }
+
+    if (weights.next != model.size()) {
+        std::cout << "dllp: error: the model file does not match the network" << std::endl;
+        return false;
+    }
+
+    std::ostringstream out;
+
+    out << "// Generated by dllp from " << model_file << "\n";
+    out << "// Standalone inference of the network, without any dependency\n\n";
+    out << "#include <cmath>\n";
+    out << "#include <cstddef>\n\n";
+    out << "namespace dllp_inference {\n\n";
+    out << "using std::size_t;\n\n";
+    out << "constexpr size_t input_size = " << first_size << ";\n";
+    out << "constexpr size_t output_size = " << input_size << ";\n";
+    out << "constexpr size_t workspace_size = " << max_size << ";\n\n";
+    out << "struct workspace {\n";
+    out << "    alignas(64) float buffers[2][workspace_size];\n";
+    out << "};\n\n";
+
+    out << functions.str();
+
+    out << "inline void predict(const float* input, float* output, workspace& w) {\n";
+
+    for (size_t i = 0; i < layers.size(); ++i) {
+        auto source      = i == 0 ? std::string("input") : "w.buffers[" + std::to_string((i - 1) % 2) + "]";
+        auto destination = i + 1 == layers.size() ? std::string("output") : "w.buffers[" + std::to_string(i % 2) + "]";
+
+        out << "    layer_" << i << "(" << source << ", " << destination << ");\n";
+    }
+
+    out << "}\n\n";
+
+    out << "inline size_t predict_label(const float* input, workspace& w) {\n";
+    out << "    float output[output_size];\n\n";
+    out << "    predict(input, output, w);\n\n";
+    out << "    size_t label = 0;\n\n";
+    out << "    for (size_t j = 1; j < output_size; ++j) {\n";
+    out << "        label = output[j] > output[label] ? j : label;\n";
+    out << "    }\n\n";
+    out << "    return label;\n";
+    out << "}\n\n";
+
+    out << "} //end of namespace dllp_inference\n\n";
+
+    out << "#ifdef DLLP_INFERENCE_MAIN\n\n";
+    out << "#include <iostream>\n\n";
+    out << "// Read the samples (input_size values each) on stdin and print their labels\n";
+    out << "int main() {\n";
+    out << "    static dllp_inference::workspace w;\n";
+    out << "    static float input[dllp_inference::input_size];\n\n";
+    out << "    while (true) {\n";
+    out << "        for (size_t i = 0; i < dllp_inference::input_size; ++i) {\n";
+    out << "            if (!(std::cin >> input[i])) {\n";
+    out << "                return 0;\n";
+    out << "            }\n";
+    out << "        }\n\n";
+    out << "        std::cout << dllp_inference::predict_label(input, w) << '\\n';\n";
+    out << "    }\n";
+    out << "}\n\n";
+    out << "#endif //DLLP_INFERENCE_MAIN\n";
+
+    std::ofstream stream(output_file);
+    stream << out.str();
+
+    if (!stream) {
+        std::cout << "dllp: error: Impossible to write " << output_file << std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -5,8 +5,65 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
 #include "layer.hpp"
 #include "parse_utils.hpp"
+#include "inference.hpp"
+
+namespace {
+
+/*!
+ * \brief Transform the options printed after the sizes of a layer into the
+ * options of its dynamic version (which has no sizes)
+ */
+std::string dyn_options(const std::string& options) {
+    auto comma = options.find(", ");
+
+    if (comma == std::string::npos) {
+        return options;
+    }
+
+    return options.substr(comma + 2);
+}
+
+} //end of anonymous namespace
+
+std::string dllp::runtime_parameters::real(double value) {
+    std::stringstream stream;
+
+    if (!dynamic) {
+        stream << value;
+        return stream.str();
+    }
+
+    stream << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+    values.push_back(stream.str());
+
+    return "params.real(" + std::to_string(values.size() - 1) + ")";
+}
+
+std::string dllp::runtime_parameters::integer(long value) {
+    if (!dynamic) {
+        return std::to_string(value);
+    }
+
+    values.push_back(std::to_string(value));
+
+    return "params.integer(" + std::to_string(values.size() - 1) + ")";
+}
+
+std::string dllp::runtime_parameters::string(const std::string& value) {
+    if (!dynamic) {
+        return "\"" + value + "\"";
+    }
+
+    values.push_back(value);
+
+    return "params.string(" + std::to_string(values.size() - 1) + ")";
+}
 
 dllp::parse_result dllp::base_rbm_layer::base_parse(const std::vector<std::string>& lines, size_t& i) {
     std::string value;
@@ -73,34 +130,34 @@ dllp::parse_result dllp::base_rbm_layer::base_parse(const std::vector<std::strin
     return parse_result::NOT_PARSED;
 }
 
-void dllp::base_rbm_layer::set(std::ostream& out, const std::string& lhs) const {
+void dllp::base_rbm_layer::set(std::ostream& out, const std::string& lhs, runtime_parameters& params) const {
     if (learning_rate != dll::processor::stupid_default) {
-        out << lhs << ".learning_rate = " << learning_rate << ";\n";
+        out << lhs << ".learning_rate = " << params.real(learning_rate) << ";\n";
     }
 
     if (momentum != dll::processor::stupid_default) {
-        out << lhs << ".initial_momentum = " << momentum << ";\n";
-        out << lhs << ".final_momentum = " << momentum << ";\n";
+        out << lhs << ".initial_momentum = " << params.real(momentum) << ";\n";
+        out << lhs << ".final_momentum = " << params.real(momentum) << ";\n";
     }
 
     if (l1_weight_cost != dll::processor::stupid_default) {
-        out << lhs << ".l1_weight_cost = " << l1_weight_cost << ";\n";
+        out << lhs << ".l1_weight_cost = " << params.real(l1_weight_cost) << ";\n";
     }
 
     if (l2_weight_cost != dll::processor::stupid_default) {
-        out << lhs << ".l2_weight_cost = " << l2_weight_cost << ";\n";
+        out << lhs << ".l2_weight_cost = " << params.real(l2_weight_cost) << ";\n";
     }
 
     if (sparsity_target != dll::processor::stupid_default) {
-        out << lhs << ".sparsity_target = " << sparsity_target << ";\n";
+        out << lhs << ".sparsity_target = " << params.real(sparsity_target) << ";\n";
     }
 
     if (pbias != dll::processor::stupid_default) {
-        out << lhs << ".pbias = " << pbias << ";\n";
+        out << lhs << ".pbias = " << params.real(pbias) << ";\n";
     }
 
     if (pbias_lambda != dll::processor::stupid_default) {
-        out << lhs << ".pbias_lambda = " << pbias_lambda << ";\n";
+        out << lhs << ".pbias_lambda = " << params.real(pbias_lambda) << ";\n";
     }
 }
 
@@ -141,6 +198,17 @@ void dllp::rbm_layer::print(std::ostream& out) const {
     out << ">::layer_t";
 }
 
+void dllp::rbm_layer::print_dyn(std::ostream& out) const {
+    std::stringstream options;
+    base_rbm_layer::print(options);
+
+    out << "dll::dyn_rbm_desc<" << dyn_options(options.str()) << ">::layer_t";
+}
+
+void dllp::rbm_layer::init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const {
+    out << lhs << ".init_layer(" << params.integer(visible) << ", " << params.integer(hidden) << ");\n";
+}
+
 bool dllp::rbm_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     std::string value;
 
@@ -204,6 +272,18 @@ void dllp::conv_rbm_layer::print(std::ostream& out) const {
     out << ">::layer_t";
 }
 
+void dllp::conv_rbm_layer::print_dyn(std::ostream& out) const {
+    std::stringstream options;
+    base_rbm_layer::print(options);
+
+    out << "dll::dyn_conv_rbm_desc<" << dyn_options(options.str()) << ">::layer_t";
+}
+
+void dllp::conv_rbm_layer::init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const {
+    out << lhs << ".init_layer(" << params.integer(c) << ", " << params.integer(v1) << ", " << params.integer(v2)
+        << ", " << params.integer(k) << ", " << params.integer(w1) << ", " << params.integer(w2) << ");\n";
+}
+
 bool dllp::conv_rbm_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     std::string value;
 
@@ -294,6 +374,18 @@ void dllp::conv_rbm_mp_layer::print(std::ostream& out) const {
     out << ">::layer_t";
 }
 
+void dllp::conv_rbm_mp_layer::print_dyn(std::ostream& out) const {
+    std::stringstream options;
+    base_rbm_layer::print(options);
+
+    out << "dll::dyn_conv_rbm_mp_desc<" << dyn_options(options.str()) << ">::layer_t";
+}
+
+void dllp::conv_rbm_mp_layer::init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const {
+    out << lhs << ".init_layer(" << params.integer(c) << ", " << params.integer(v1) << ", " << params.integer(v2)
+        << ", " << params.integer(k) << ", " << params.integer(w1) << ", " << params.integer(w2) << ", " << params.integer(p) << ");\n";
+}
+
 bool dllp::conv_rbm_mp_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     std::string value;
 
@@ -388,6 +480,46 @@ void dllp::dense_layer::print(std::ostream& out) const {
     out << ">::layer_t";
 }
 
+void dllp::dense_layer::print_dyn(std::ostream& out) const {
+    out << "dll::dyn_dense_layer_desc<";
+
+    if (!activation.empty()) {
+        out << "dll::activation<dll::function::" << activation_function(activation) << ">";
+    }
+
+    out << ">::layer_t";
+}
+
+void dllp::dense_layer::init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const {
+    out << lhs << ".init_layer(" << params.integer(visible) << ", " << params.integer(hidden) << ");\n";
+}
+
+bool dllp::dense_layer::inference(std::ostream& out, const std::string& name, size_t /*input_size*/, inference_weights& weights) const {
+    const auto* w = weights.next_tensor(visible * hidden + hidden);
+
+    if (!w || !print_inference_array(out, name + "_w", w, visible * hidden) || !print_inference_array(out, name + "_b", w + visible * hidden, hidden)) {
+        return false;
+    }
+
+    out << "inline void " << name << "(const float* input, float* output) {\n";
+    out << "    for (size_t j = 0; j < " << hidden << "; ++j) {\n";
+    out << "        output[j] = " << name << "_b[j];\n";
+    out << "    }\n\n";
+    out << "    for (size_t i = 0; i < " << visible << "; ++i) {\n";
+    out << "        const float v = input[i];\n\n";
+    print_inference_unroll(out, hidden, "        ");
+    out << "        for (size_t j = 0; j < " << hidden << "; ++j) {\n";
+    out << "            output[j] += v * " << name << "_w[i * " << hidden << " + j];\n";
+    out << "        }\n";
+    out << "    }\n";
+
+    print_inference_activation(out, activation.empty() ? "sigmoid" : activation, hidden, "output");
+
+    out << "}\n\n";
+
+    return true;
+}
+
 bool dllp::dense_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     std::string value;
 
@@ -435,6 +567,10 @@ size_t dllp::dense_layer::hidden_get() const {
     return hidden;
 }
 
+size_t dllp::dense_layer::visible_get() const {
+    return visible;
+}
+
 bool dllp::conv_layer::is_conv() const {
     return true;
 }
@@ -449,6 +585,58 @@ void dllp::conv_layer::print(std::ostream& out) const {
     out << ">::layer_t";
 }
 
+void dllp::conv_layer::print_dyn(std::ostream& out) const {
+    out << "dll::dyn_conv_layer_desc<";
+
+    if (!activation.empty()) {
+        out << "dll::activation<dll::function::" << activation_function(activation) << ">";
+    }
+
+    out << ">::layer_t";
+}
+
+void dllp::conv_layer::init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const {
+    out << lhs << ".init_layer(" << params.integer(c) << ", " << params.integer(v1) << ", " << params.integer(v2)
+        << ", " << params.integer(k) << ", " << params.integer(w1) << ", " << params.integer(w2) << ");\n";
+}
+
+bool dllp::conv_layer::inference(std::ostream& out, const std::string& name, size_t /*input_size*/, inference_weights& weights) const {
+    const size_t h1 = hidden_get_2();
+    const size_t h2 = hidden_get_3();
+
+    const auto* w = weights.next_tensor(k * c * w1 * w2 + k);
+
+    if (!w || !print_inference_array(out, name + "_w", w, k * c * w1 * w2) || !print_inference_array(out, name + "_b", w + k * c * w1 * w2, k)) {
+        return false;
+    }
+
+    out << "inline void " << name << "(const float* input, float* output) {\n";
+    out << "    for (size_t k = 0; k < " << k << "; ++k) {\n";
+    out << "        for (size_t i = 0; i < " << h1 << "; ++i) {\n";
+    out << "            for (size_t j = 0; j < " << h2 << "; ++j) {\n";
+    out << "                float sum = " << name << "_b[k];\n\n";
+    out << "                for (size_t c = 0; c < " << c << "; ++c) {\n";
+    print_inference_unroll(out, w1, "                    ");
+    out << "                    for (size_t a = 0; a < " << w1 << "; ++a) {\n";
+    print_inference_unroll(out, w2, "                        ");
+    out << "                        for (size_t b = 0; b < " << w2 << "; ++b) {\n";
+    out << "                            sum += input[(c * " << v1 << " + i + a) * " << v2 << " + j + b] * " << name
+        << "_w[((k * " << c << " + c) * " << w1 << " + a) * " << w2 << " + b];\n";
+    out << "                        }\n";
+    out << "                    }\n";
+    out << "                }\n\n";
+    out << "                output[(k * " << h1 << " + i) * " << h2 << " + j] = sum;\n";
+    out << "            }\n";
+    out << "        }\n";
+    out << "    }\n";
+
+    print_inference_activation(out, activation.empty() ? "sigmoid" : activation, k * h1 * h2, "output");
+
+    out << "}\n\n";
+
+    return true;
+}
+
 bool dllp::conv_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     std::string value;
 
@@ -513,6 +701,10 @@ size_t dllp::conv_layer::hidden_get() const {
     return k * (v1 - w1 + 1) * (v2 - w2 + 1);
 }
 
+size_t dllp::conv_layer::visible_get() const {
+    return c * v1 * v2;
+}
+
 size_t dllp::conv_layer::hidden_get_1() const {
     return k;
 }
@@ -534,6 +726,58 @@ void dllp::pooling_layer::print(std::ostream& out) const {
     out << ">::layer_t";
 }
 
+void dllp::pooling_layer::init(std::ostream& out, const std::string& lhs, runtime_parameters& params) const {
+    out << lhs << ".init_layer(" << params.integer(c) << ", " << params.integer(v1) << ", " << params.integer(v2)
+        << ", " << params.integer(c1) << ", " << params.integer(c2) << ", " << params.integer(c3) << ");\n";
+}
+
+bool dllp::pooling_layer::pooling_inference(std::ostream& out, const std::string& name, bool max) const {
+    const size_t o1 = hidden_get_1();
+    const size_t o2 = hidden_get_2();
+    const size_t o3 = hidden_get_3();
+
+    out << "inline void " << name << "(const float* input, float* output) {\n";
+    out << "    for (size_t c = 0; c < " << o1 << "; ++c) {\n";
+    out << "        for (size_t i = 0; i < " << o2 << "; ++i) {\n";
+    out << "            for (size_t j = 0; j < " << o3 << "; ++j) {\n";
+
+    if (max) {
+        out << "                float value = input[((c * " << c1 << ") * " << v1 << " + i * " << c2 << ") * " << v2 << " + j * " << c3 << "];\n\n";
+    } else {
+        out << "                float value = 0.0f;\n\n";
+    }
+
+    out << "                for (size_t a = 0; a < " << c1 << "; ++a) {\n";
+    print_inference_unroll(out, c2, "                    ");
+    out << "                    for (size_t b = 0; b < " << c2 << "; ++b) {\n";
+    print_inference_unroll(out, c3, "                        ");
+    out << "                        for (size_t d = 0; d < " << c3 << "; ++d) {\n";
+    out << "                            const float x = input[((c * " << c1 << " + a) * " << v1 << " + i * " << c2 << " + b) * " << v2 << " + j * " << c3 << " + d];\n";
+
+    if (max) {
+        out << "                            value = x > value ? x : value;\n";
+    } else {
+        out << "                            value += x;\n";
+    }
+
+    out << "                        }\n";
+    out << "                    }\n";
+    out << "                }\n\n";
+
+    if (max) {
+        out << "                output[(c * " << o2 << " + i) * " << o3 << " + j] = value;\n";
+    } else {
+        out << "                output[(c * " << o2 << " + i) * " << o3 << " + j] = value / " << (c1 * c2 * c3) << ".0f;\n";
+    }
+
+    out << "            }\n";
+    out << "        }\n";
+    out << "    }\n";
+    out << "}\n\n";
+
+    return true;
+}
+
 bool dllp::pooling_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     std::string value;
 
@@ -588,6 +832,10 @@ size_t dllp::pooling_layer::hidden_get() const {
     return hidden_get_1() * hidden_get_2() * hidden_get_3();
 }
 
+size_t dllp::pooling_layer::visible_get() const {
+    return c * v1 * v2;
+}
+
 size_t dllp::pooling_layer::hidden_get_1() const {
     return c / c1;
 }
@@ -605,6 +853,14 @@ void dllp::mp_layer::print(std::ostream& out) const {
     pooling_layer::print(out);
 }
 
+void dllp::mp_layer::print_dyn(std::ostream& out) const {
+    out << "dll::dyn_mp_3d_layer_desc<>::layer_t";
+}
+
+bool dllp::mp_layer::inference(std::ostream& out, const std::string& name, size_t /*input_size*/, inference_weights& /*weights*/) const {
+    return pooling_inference(out, name, true);
+}
+
 bool dllp::mp_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     return pooling_layer::parse(layers, lines, i);
 }
@@ -614,6 +870,14 @@ void dllp::avgp_layer::print(std::ostream& out) const {
     pooling_layer::print(out);
 }
 
+void dllp::avgp_layer::print_dyn(std::ostream& out) const {
+    out << "dll::dyn_avgp_3d_layer_desc<>::layer_t";
+}
+
+bool dllp::avgp_layer::inference(std::ostream& out, const std::string& name, size_t /*input_size*/, inference_weights& /*weights*/) const {
+    return pooling_inference(out, name, false);
+}
+
 bool dllp::avgp_layer::parse(const layers_t& layers, const std::vector<std::string>& lines, size_t& i) {
     return pooling_layer::parse(layers, lines, i);
 }
@@ -628,6 +892,19 @@ void dllp::function_layer::print(std::ostream& out) const {
         << ">::layer_t";
 }
 
+bool dllp::function_layer::inference(std::ostream& out, const std::string& name, size_t input_size, inference_weights& /*weights*/) const {
+    out << "inline void " << name << "(const float* input, float* output) {\n";
+    out << "    for (size_t j = 0; j < " << input_size << "; ++j) {\n";
+    out << "        output[j] = input[j];\n";
+    out << "    }\n";
+
+    print_inference_activation(out, activation, input_size, "output");
+
+    out << "}\n\n";
+
+    return true;
+}
+
 bool dllp::function_layer::parse(const layers_t& /*layers*/, const std::vector<std::string>& lines, size_t& i) {
     std::string value;
 
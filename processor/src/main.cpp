@@ -22,10 +22,14 @@
 namespace {
 
 void print_usage() {
-    std::cout << "Usage: dllp conf_file action" << std::endl;
+    std::cout << "Usage: dllp [options] conf_file [conf_file...] action..." << std::endl;
 }
 
-void parse_options(int argc, char* argv[], dll::processor::options& opt, std::vector<std::string>& actions, std::string& source_file) {
+bool is_action(const std::string& arg) {
+    return arg == "auto" || arg == "pretrain" || arg == "train" || arg == "test" || arg == "save" || arg == "load" || arg == "codegen";
+}
+
+void parse_options(int argc, char* argv[], dll::processor::options& opt, std::vector<std::string>& actions, std::vector<std::string>& source_files) {
     size_t i = 1;
 
     while (true) {
@@ -41,12 +45,30 @@ void parse_options(int argc, char* argv[], dll::processor::options& opt, std::ve
         } else if (std::string(argv[i]) == "--cache") {
             opt.cache = true;
             ++i;
+        } else if (std::string(argv[i]) == "--no-cache") {
+            opt.cache = false;
+            ++i;
+        } else if (std::string(argv[i]) == "--dyn") {
+            opt.dynamic = true;
+            ++i;
+        } else if (std::string(argv[i]) == "--profile" && i + 1 < size_t(argc)) {
+            opt.profile = argv[i + 1];
+            i += 2;
+        } else if (std::string(argv[i]) == "--jobs" && i + 1 < size_t(argc)) {
+            opt.jobs = std::stol(argv[i + 1]);
+            i += 2;
         } else {
             break;
         }
     }
 
-    source_file = argv[i++];
+    source_files.emplace_back(argv[i++]);
+
+    //The following configuration files are run in parallel
+
+    for (; i < size_t(argc) && !is_action(argv[i]); ++i) {
+        source_files.emplace_back(argv[i]);
+    }
 
     for (; i < size_t(argc); ++i) {
         actions.emplace_back(argv[i]);
@@ -75,11 +97,11 @@ int main(int argc, char* argv[]) {
 
     dll::processor::options opt;
     std::vector<std::string> actions;
-    std::string source_file;
+    std::vector<std::string> source_files;
 
-    parse_options(argc, argv, opt, actions, source_file);
+    parse_options(argc, argv, opt, actions, source_files);
 
-    //Process the file
+    //Process the files
 
-    return dll::processor::process_file(opt, actions, source_file);
+    return dll::processor::process_files(opt, actions, source_files);
 }
@@ -90,6 +90,10 @@ bool dllp::valid_sparsity(const std::string& sparsity) {
     return sparsity == "global" || sparsity == "local" || sparsity == "lee";
 }
 
+bool dllp::valid_profile(const std::string& profile) {
+    return profile == "default" || profile == "native" || profile == "max";
+}
+
 std::vector<std::string> dllp::read_lines(const std::string& source_file) {
     std::vector<std::string> lines;
 
@@ -11,14 +11,25 @@
 #include <fstream>
 #include <memory>
 #include <cstdlib>
-
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include "cpp_utils/string.hpp"
 
 #include "parse_utils.hpp"
 #include "layer.hpp"
+#include "inference.hpp"
 
 #include "dll/processor/processor.hpp"
 
@@ -54,6 +65,34 @@ std::string command_result(const std::string& command) {
     return out;
 }
 
+/*!
+ * \brief Parse a comma-separated list of files
+ */
+std::vector<std::string> parse_files(const std::string& value) {
+    std::vector<std::string> files;
+
+    std::stringstream stream(value);
+    std::string file;
+
+    while (std::getline(stream, file, ',')) {
+        std::string trimmed(cpp::trim(file));
+
+        if (!trimmed.empty()) {
+            files.push_back(trimmed);
+        }
+    }
+
+    return files;
+}
+
+/*!
+ * \brief Returns the divisor of the pre-scaling of a streaming datasource
+ * (the scale of the datasource must be the inverse of an integer)
+ */
+size_t scale_divisor(double scale) {
+    return scale > 0.0 ? size_t(std::lround(1.0 / scale)) : 0;
+}
+
 dll::processor::datasource parse_datasource(const std::vector<std::string>& lines, size_t& i) {
     dll::processor::datasource source;
 
@@ -84,15 +123,37 @@ dll::processor::datasource parse_datasource(const std::vector<std::string>& line
             source.shift   = true;
             source.shift_d = std::stod(extract_value(lines[i], "shift: "));
             ++i;
+        } else if (starts_with(lines[i], "shards: ")) {
+            source.shards = parse_files(extract_value(lines[i], "shards: "));
+            ++i;
+        } else if (starts_with(lines[i], "prefetch: ")) {
+            source.prefetch = std::stol(extract_value(lines[i], "prefetch: "));
+            ++i;
+        } else if (starts_with(lines[i], "workers: ")) {
+            source.workers = std::stol(extract_value(lines[i], "workers: "));
+            ++i;
         } else {
             break;
         }
     }
 
-    if (source.source_file.empty()) {
+    if (source.empty()) {
         std::cout << "dllp:: error: missing source" << std::endl;
     }
 
+    // The transformations of the streaming generators are fixed at generation
+    if (source.streaming()) {
+        if (source.shift || source.normal_noise) {
+            std::cout << "dllp: error: shift and normal_noise are not supported on a streaming datasource" << std::endl;
+        }
+
+        if (source.scale && std::abs(scale_divisor(source.scale_d) * source.scale_d - 1.0) > 1e-6) {
+            std::cout << "dllp: error: the scale of a streaming datasource must be the inverse of an integer" << std::endl;
+        }
+    } else if (!source.shards.empty() || source.prefetch || source.workers) {
+        std::cout << "dllp: error: shards, prefetch and workers are only supported with the mmap reader" << std::endl;
+    }
+
     return source;
 }
 
@@ -113,10 +174,14 @@ void parse_datasource_pack(dll::processor::datasource_pack& pack, const std::vec
 
     pack.samples.limit = limit;
     pack.labels.limit  = limit;
+
+    if (pack.samples.streaming() && limit != size_t(-1)) {
+        std::cout << "dllp: warning: the limit is ignored on a streaming datasource" << std::endl;
+    }
 }
 
-void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions);
-bool compile(const options& opt);
+std::string generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions, dllp::runtime_parameters& params, const std::string& build);
+bool compile_program(const dllp::options& opt, const std::string& source, const std::string& cflags, const std::string& ldflags, std::string& executable);
 
 void process_includes(std::vector<std::string>& lines){
     for (size_t i = 0; i < lines.size();) {
@@ -184,6 +249,15 @@ bool process_options(size_t& i, const std::vector<std::string>& lines, dll::proc
                     ++i;
                 } else if (dllp::starts_with(lines[i], "big_batch: ")) {
                     t.general_desc.big_batch = std::stol(dllp::extract_value(lines[i], "big_batch: "));
+                    ++i;
+                } else if (dllp::starts_with(lines[i], "profile: ")) {
+                    t.general_desc.profile = dllp::extract_value(lines[i], "profile: ");
+
+                    if (!dllp::valid_profile(t.general_desc.profile)) {
+                        std::cout << "dllp: error: invalid profile must be one of [default, native, max]" << std::endl;
+                        return false;
+                    }
+
                     ++i;
                 } else {
                     break;
@@ -391,110 +465,134 @@ bool parse_file(const std::string& source_file, dll::processor::task& t, std::ve
     return true;
 }
 
-bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers) {
-    bool process = true;
+std::string datasource_to_string(const std::string& lhs, const dll::processor::datasource& ds, dllp::runtime_parameters& params) {
+    std::string result;
 
-    if (opt.cache) {
-        struct stat attr_conf;
-        struct stat attr_exec;
+    result += lhs + ".source_file = " + params.string(ds.source_file) + ";\n";
+    result += lhs + ".reader = " + params.string(ds.reader) + ";\n";
+    result += lhs + ".binarize = " + params.integer(ds.binarize) + ";\n";
+    result += lhs + ".normalize = " + params.integer(ds.normalize) + ";\n";
+    result += lhs + ".scale = " + params.integer(ds.scale) + ";\n";
+    result += lhs + ".scale_d = " + params.real(ds.scale_d) + ";\n";
+    result += lhs + ".normal_noise = " + params.integer(ds.normal_noise) + ";\n";
+    result += lhs + ".normal_noise_d = " + params.real(ds.normal_noise_d) + ";\n";
+    result += lhs + ".limit = " + params.integer(ds.limit) + ";\n";
 
-        if (!stat(source_file.c_str(), &attr_conf)) {
-            if (!stat("./.dbn.out", &attr_exec)) {
-                auto mtime_conf = attr_conf.st_mtime;
-                auto mtime_exec = attr_exec.st_mtime;
+    if (!ds.shards.empty()) {
+        result += lhs + ".shards = {";
 
-                if (mtime_exec > mtime_conf) {
-                    if (!opt.quiet) {
-                        std::cout << "Skip compilation" << std::endl;
-                    }
-                    process = false;
-                }
-            }
+        std::string comma = "";
+
+        for (auto& shard : ds.shards) {
+            result += comma + params.string(shard);
+            comma = ", ";
         }
+
+        result += "};\n";
     }
 
-    if (process) {
-        //Generate the CPP file
-        dllp::generate(layers, t, actions);
+    return result;
+}
 
-        //Compile the generate file
-        if (!dllp::compile(opt)) {
-            return false;
-        }
+/*!
+ * \brief Returns the type of the streaming generator of the given
+ * datasource, in the generated program.
+ *
+ * The batch size, the prefetch, the workers and the pre-transformations are
+ * parameters of the generator descriptor, they are therefore fixed at
+ * generation, even in dynamic mode.
+ */
+std::string stream_to_string(const dll::processor::datasource& ds, bool categorical) {
+    if (!ds.streaming()) {
+        return "dll::processor::no_stream";
     }
 
-    return true;
-}
+    std::string desc = "dll::batch_size<dbn_t::batch_size>";
 
-std::string datasource_to_string(const std::string& lhs, const dll::processor::datasource& ds) {
-    std::string result;
+    if (ds.prefetch) {
+        desc += ", dll::big_batch_size<" + std::to_string(ds.prefetch) + ">";
+    }
+
+    if (ds.workers) {
+        desc += ", dll::read_threads<" + std::to_string(ds.workers) + ">";
+    }
 
-    result += lhs + ".source_file = \"" + ds.source_file + "\";\n";
-    result += lhs + ".reader = \"" + ds.reader + "\";\n";
-    result += lhs + ".binarize = " + (ds.binarize ? "true" : "false") + ";\n";
-    result += lhs + ".normalize = " + (ds.normalize ? "true" : "false") + ";\n";
-    result += lhs + ".scale = " + (ds.scale ? "true" : "false") + ";\n";
-    result += lhs + ".scale_d = " + std::to_string(ds.scale_d) + ";\n";
-    result += lhs + ".normal_noise = " + (ds.normal_noise ? "true" : "false") + ";\n";
-    result += lhs + ".normal_noise_d = " + std::to_string(ds.normal_noise_d) + ";\n";
-    result += lhs + ".limit = " + std::to_string(ds.limit) + ";\n";
+    if (categorical) {
+        desc += ", dll::categorical";
+    }
 
-    return result;
+    if (ds.scale) {
+        desc += ", dll::scale_pre<" + std::to_string(scale_divisor(ds.scale_d)) + ">";
+    }
+
+    if (ds.binarize) {
+        desc += ", dll::binarize_pre<30>";
+    }
+
+    if (ds.normalize) {
+        desc += ", dll::normalize_pre";
+    }
+
+    if (ds.sharded()) {
+        return "dll::processor::stream<true, dll::sharded_data_generator_desc<" + desc + ">>";
+    } else {
+        return "dll::processor::stream<false, dll::mmap_data_generator_desc<" + desc + ">>";
+    }
 }
 
-std::string pt_desc_to_string(const std::string& lhs, const dll::processor::pretraining_desc& desc) {
+std::string pt_desc_to_string(const std::string& lhs, const dll::processor::pretraining_desc& desc, dllp::runtime_parameters& params) {
     std::string result;
 
-    result += lhs + ".epochs = " + std::to_string(desc.epochs) + ";";
+    result += lhs + ".epochs = " + params.integer(desc.epochs) + ";";
 
     return result;
 }
 
-std::string ft_desc_to_string(const std::string& lhs, const dll::processor::training_desc& desc) {
+std::string ft_desc_to_string(const std::string& lhs, const dll::processor::training_desc& desc, dllp::runtime_parameters& params) {
     std::string result;
 
-    result += lhs + ".epochs = " + std::to_string(desc.epochs) + ";";
+    result += lhs + ".epochs = " + params.integer(desc.epochs) + ";";
 
     return result;
 }
 
-std::string w_desc_to_string(const std::string& lhs, const dll::processor::weights_desc& desc) {
+std::string w_desc_to_string(const std::string& lhs, const dll::processor::weights_desc& desc, dllp::runtime_parameters& params) {
     std::string result;
 
-    result += lhs + ".file = \"" + desc.file + "\";";
+    result += lhs + ".file = " + params.string(desc.file) + ";";
 
     return result;
 }
 
-std::string task_to_string(const std::string& name, const dll::processor::task& t) {
+std::string task_to_string(const std::string& name, const dll::processor::task& t, dllp::runtime_parameters& params) {
     std::string result;
 
     result += "   dll::processor::task ";
     result += name;
     result += ";\n\n";
-    result += datasource_to_string("   " + name + ".pretraining.samples", t.pretraining.samples);
+    result += datasource_to_string("   " + name + ".pretraining.samples", t.pretraining.samples, params);
     result += "\n";
-    result += datasource_to_string("   " + name + ".pretraining_clean.samples", t.pretraining_clean.samples);
+    result += datasource_to_string("   " + name + ".pretraining_clean.samples", t.pretraining_clean.samples, params);
     result += "\n";
-    result += datasource_to_string("   " + name + ".training.samples", t.training.samples);
+    result += datasource_to_string("   " + name + ".training.samples", t.training.samples, params);
     result += "\n";
-    result += datasource_to_string("   " + name + ".training.labels", t.training.labels);
+    result += datasource_to_string("   " + name + ".training.labels", t.training.labels, params);
     result += "\n";
-    result += datasource_to_string("   " + name + ".testing.samples", t.testing.samples);
+    result += datasource_to_string("   " + name + ".testing.samples", t.testing.samples, params);
     result += "\n";
-    result += datasource_to_string("   " + name + ".testing.labels", t.testing.labels);
+    result += datasource_to_string("   " + name + ".testing.labels", t.testing.labels, params);
     result += "\n";
-    result += pt_desc_to_string("   " + name + ".pt_desc", t.pt_desc);
+    result += pt_desc_to_string("   " + name + ".pt_desc", t.pt_desc, params);
     result += "\n";
-    result += ft_desc_to_string("   " + name + ".ft_desc", t.ft_desc);
+    result += ft_desc_to_string("   " + name + ".ft_desc", t.ft_desc, params);
     result += "\n";
-    result += w_desc_to_string("   " + name + ".w_desc", t.w_desc);
+    result += w_desc_to_string("   " + name + ".w_desc", t.w_desc, params);
     result += "\n";
 
     return result;
 }
 
-std::string vector_to_string(const std::string& name, const std::vector<std::string>& vec) {
+std::string vector_to_string(const std::string& name, const std::vector<std::string>& vec, dllp::runtime_parameters& params) {
     std::string result;
 
     result += "   std::vector<std::string> ";
@@ -503,9 +601,7 @@ std::string vector_to_string(const std::string& name, const std::vector<std::str
     std::string comma = "";
     for (auto& value : vec) {
         result += comma;
-        result += "\"";
-        result += value;
-        result += "\"";
+        result += params.string(value);
         comma = ", ";
     }
     result += "};";
@@ -534,7 +630,7 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
         } else {
             return "etl::fast_dyn_vector<float, 784>";
         }
-    } else if(reader == "text"){
+    } else if(reader == "text" || reader == "mmap"){
         if(layers.front()->is_conv()){
             return "etl::dyn_matrix<float, 3>";
         } else {
@@ -546,21 +642,36 @@ std::string get_data_type(const std::vector<std::unique_ptr<dllp::layer>>& layer
     }
 }
 
-void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions) {
-    std::ofstream out_stream(".dbn.cpp");
+std::string common_includes() {
+    std::string includes;
+
+    includes += "#include <memory>\n";
+
+    includes += "#include \"dll/processor/processor.hpp\"\n";
+    includes += "#include \"dll/rbm/rbm.hpp\"\n";
+    includes += "#include \"dll/rbm/conv_rbm.hpp\"\n";
+    includes += "#include \"dll/rbm/conv_rbm_mp.hpp\"\n";
+    includes += "#include \"dll/neural/dense_layer.hpp\"\n";
+    includes += "#include \"dll/neural/conv_layer.hpp\"\n";
+    includes += "#include \"dll/pooling/mp_layer.hpp\"\n";
+    includes += "#include \"dll/pooling/avgp_layer.hpp\"\n";
+    includes += "#include \"dll/neural/activation_layer.hpp\"\n";
+    includes += "#include \"dll/rbm/dyn_rbm.hpp\"\n";
+    includes += "#include \"dll/rbm/dyn_conv_rbm.hpp\"\n";
+    includes += "#include \"dll/rbm/dyn_conv_rbm_mp.hpp\"\n";
+    includes += "#include \"dll/neural/dyn_dense_layer.hpp\"\n";
+    includes += "#include \"dll/neural/dyn_conv_layer.hpp\"\n";
+    includes += "#include \"dll/pooling/dyn_mp_layer.hpp\"\n";
+    includes += "#include \"dll/pooling/dyn_avgp_layer.hpp\"\n";
+    includes += "#include \"dll/dbn.hpp\"\n";
+
+    return includes;
+}
 
-    out_stream << "#include <memory>\n";
+std::string generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll::processor::task& t, const std::vector<std::string>& actions, dllp::runtime_parameters& params, const std::string& build) {
+    std::stringstream out_stream;
 
-    out_stream << "#include \"dll/processor/processor.hpp\"\n";
-    out_stream << "#include \"dll/rbm/rbm.hpp\"\n";
-    out_stream << "#include \"dll/rbm/conv_rbm.hpp\"\n";
-    out_stream << "#include \"dll/rbm/conv_rbm_mp.hpp\"\n";
-    out_stream << "#include \"dll/neural/dense_layer.hpp\"\n";
-    out_stream << "#include \"dll/neural/conv_layer.hpp\"\n";
-    out_stream << "#include \"dll/pooling/mp_layer.hpp\"\n";
-    out_stream << "#include \"dll/pooling/avgp_layer.hpp\"\n";
-    out_stream << "#include \"dll/neural/activation_layer.hpp\"\n";
-    out_stream << "#include \"dll/dbn.hpp\"\n";
+    out_stream << common_includes();
 
     out_stream << "using dbn_t = dll::dbn_desc<dll::dbn_layers<\n";
 
@@ -568,7 +679,13 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
 
     for (auto& layer : layers) {
         out_stream << comma;
-        layer->print(out_stream);
+
+        if (params.dynamic) {
+            layer->print_dyn(out_stream);
+        } else {
+            layer->print(out_stream);
+        }
+
         comma = "\n, ";
     }
 
@@ -605,29 +722,44 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
     out_stream << ">::dbn_t;\n\n";
 
     out_stream << "int main(int argc, char* argv[]){\n";
+    out_stream << "   std::cout << \"" << build << "\" << std::endl;\n\n";
+    if (params.dynamic) {
+        out_stream << "   dll::processor::parameters params;\n\n";
+        out_stream << "   if (argc < 2 || !params.load(argv[1])) {\n";
+        out_stream << "      std::cout << \"dllp: error: Impossible to read the runtime parameters\" << std::endl;\n";
+        out_stream << "      return 1;\n";
+        out_stream << "   }\n\n";
+    }
+
     out_stream << "   auto dbn = std::make_unique<dbn_t>();\n";
 
+    if (params.dynamic) {
+        for (size_t i = 0; i < layers.size(); ++i) {
+            layers[i]->init(out_stream, "   dbn->layer_get<" + std::to_string(i) + ">()", params);
+        }
+    }
+
     if (t.ft_desc.learning_rate != dll::processor::stupid_default) {
-        out_stream << "   dbn->learning_rate = " << t.ft_desc.learning_rate << ";\n";
+        out_stream << "   dbn->learning_rate = " << params.real(t.ft_desc.learning_rate) << ";\n";
     }
 
     if (t.ft_desc.momentum != dll::processor::stupid_default) {
-        out_stream << "   dbn->initial_momentum = " << t.ft_desc.momentum << ";\n";
-        out_stream << "   dbn->final_momentum = " << t.ft_desc.momentum << ";\n";
+        out_stream << "   dbn->initial_momentum = " << params.real(t.ft_desc.momentum) << ";\n";
+        out_stream << "   dbn->final_momentum = " << params.real(t.ft_desc.momentum) << ";\n";
     }
 
     if (t.ft_desc.l1_weight_cost != dll::processor::stupid_default) {
-        out_stream << "   dbn->l1_weight_cost = " << t.ft_desc.l1_weight_cost << ";\n";
+        out_stream << "   dbn->l1_weight_cost = " << params.real(t.ft_desc.l1_weight_cost) << ";\n";
     }
 
     if (t.ft_desc.l2_weight_cost != dll::processor::stupid_default) {
-        out_stream << "   dbn->l2_weight_cost = " << t.ft_desc.l2_weight_cost << ";\n";
+        out_stream << "   dbn->l2_weight_cost = " << params.real(t.ft_desc.l2_weight_cost) << ";\n";
     }
 
     for (size_t i = 0; i < layers.size(); ++i) {
         auto& layer = layers[i];
 
-        layer->set(out_stream, "   dbn->layer_get<" + std::to_string(i) + ">()");
+        layer->set(out_stream, "   dbn->layer_get<" + std::to_string(i) + ">()", params);
     }
 
     auto final_actions = actions;
@@ -636,15 +768,20 @@ void generate(const std::vector<std::unique_ptr<dllp::layer>>& layers, const dll
         final_actions = t.default_actions;
     }
 
-    out_stream << task_to_string("t", t) << "\n";
-    out_stream << vector_to_string("actions", final_actions) << "\n";
+    out_stream << task_to_string("t", t, params) << "\n";
+    out_stream << vector_to_string("actions", final_actions, params) << "\n";
     out_stream << "   using data_type = " << get_data_type(layers, t) << ";\n";
     out_stream << "   static constexpr bool three = " << layers.front()->is_conv() << ";\n";
-    out_stream << "   dll::processor::execute<data_type, three>(*dbn, t, actions);\n";
+    out_stream << "   using pt_stream = " << stream_to_string(t.pretraining.samples, false) << ";\n";
+    out_stream << "   using ft_stream = " << stream_to_string(t.training.samples, true) << ";\n";
+    out_stream << "   using test_stream = " << stream_to_string(t.testing.samples, true) << ";\n";
+    out_stream << "   dll::processor::execute<data_type, three, pt_stream, ft_stream, test_stream>(*dbn, t, actions);\n";
     out_stream << "}\n";
+
+    return out_stream.str();
 }
 
-bool append_pkg_flags(std::string& flags, const std::string& pkg) {
+bool append_pkg_flags(std::string& flags, std::string& libs, const std::string& pkg) {
     auto cflags = command_result("pkg-config --cflags " + pkg);
 
     if (cflags.empty()) {
@@ -662,51 +799,146 @@ bool append_pkg_flags(std::string& flags, const std::string& pkg) {
     }
 
     flags += " " + cflags + " ";
-    flags += " " + ldflags + " ";
+    libs += " " + ldflags + " ";
 
     return true;
 }
 
-bool compile(const options& opt) {
-    if (!opt.quiet) {
-        std::cout << "Compiling the program..." << std::endl;
+bool pkg_exists(const std::string& pkg) {
+    return system(("pkg-config --exists " + pkg).c_str()) == 0;
+}
+
+/*!
+ * \brief Compute the compilation flags of the given profile
+ *
+ * The default profile uses the flags of the previous versions of dllp. The
+ * native profile optimizes for the current machine and enables the parallel
+ * kernels of ETL. The max profile adds LTO and enables every BLAS and GPU
+ * library found by pkg-config, as the main Makefile does.
+ */
+bool compile_flags(const options& opt, const std::string& profile, std::string& cflags, std::string& ldflags) {
+    cflags += " -g ";
+
+    if (profile == "default") {
+        cflags += " -O2 -DETL_VECTORIZE_FULL ";
+    } else {
+        cflags += " -O3 -march=native -DETL_VECTORIZE_FULL -DETL_PARALLEL ";
     }
 
-    const auto* cxx = std::getenv("CXX");
+    if (profile == "max") {
+        cflags += " -flto ";
+        ldflags += " -flto ";
+    }
 
-    std::string compile_command(cxx);
+    cflags += " -std=c++1z ";
+    cflags += " -pthread ";
+
+    bool mkl    = opt.mkl;
+    bool blas   = false;
+    bool cublas = opt.cublas;
+    bool cufft  = opt.cufft;
+    bool cudnn  = false;
 
-    compile_command += " -o .dbn.out ";
-    compile_command += " -g ";
-    compile_command += " -O2 -DETL_VECTORIZE_FULL ";
-    compile_command += " -std=c++1z ";
-    compile_command += " -pthread ";
-    compile_command += " .dbn.cpp ";
+    if (profile == "max") {
+        if (!mkl) {
+            mkl  = pkg_exists("mkl");
+            blas = !mkl && pkg_exists("cblas");
+        }
+
+        cublas = cublas || pkg_exists("cublas");
+        cufft  = cufft || pkg_exists("cufft");
+        cudnn  = pkg_exists("cudnn");
+    }
 
-    if (opt.mkl) {
-        compile_command += " -DETL_MKL_MODE ";
+    if (mkl) {
+        cflags += " -DETL_MKL_MODE ";
 
-        if (!append_pkg_flags(compile_command, "mkl")) {
+        if (!append_pkg_flags(cflags, ldflags, "mkl")) {
             return false;
         }
     }
 
-    if (opt.cublas) {
-        compile_command += " -DETL_CUBLAS_MODE ";
+    if (blas) {
+        cflags += " -DETL_BLAS_MODE ";
 
-        if (!append_pkg_flags(compile_command, "cublas")) {
+        if (!append_pkg_flags(cflags, ldflags, "cblas")) {
             return false;
         }
     }
 
-    if (opt.cufft) {
-        compile_command += " -DETL_CUFFT_MODE ";
+    if (cublas) {
+        cflags += " -DETL_CUBLAS_MODE ";
 
-        if (!append_pkg_flags(compile_command, "cufft")) {
+        if (!append_pkg_flags(cflags, ldflags, "cublas")) {
             return false;
         }
     }
 
+    if (cufft) {
+        cflags += " -DETL_CUFFT_MODE ";
+
+        if (!append_pkg_flags(cflags, ldflags, "cufft")) {
+            return false;
+        }
+    }
+
+    if (cudnn) {
+        cflags += " -DETL_CUDNN_MODE ";
+
+        if (!append_pkg_flags(cflags, ldflags, "cudnn")) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Returns the description of the build, printed by the generated
+ * program so that its results can be reproduced
+ */
+std::string build_description(const std::string& profile, const std::string& cflags, const std::string& ldflags) {
+    std::string flags;
+
+    for (auto& part : {cflags, ldflags}) {
+        std::stringstream stream(part);
+        std::string flag;
+
+        while (stream >> flag) {
+            for (char c : flag) {
+                if (c == '"' || c == '\\') {
+                    flags += '\\';
+                }
+
+                flags += c;
+            }
+
+            flags += ' ';
+        }
+    }
+
+    if (!flags.empty()) {
+        flags.pop_back();
+    }
+
+    return "Build profile: " + profile + " (" + flags + ")";
+}
+
+bool compile(const options& opt, const std::string& cflags, const std::string& ldflags, const std::string& source, const std::string& output, const std::string& extra) {
+    if (!opt.quiet) {
+        std::cout << "Compiling the program..." << std::endl;
+    }
+
+    const auto* cxx = std::getenv("CXX");
+
+    std::string compile_command(cxx);
+
+    compile_command += " -o " + output + " ";
+    compile_command += cflags;
+    compile_command += extra;
+    compile_command += " " + source + " ";
+    compile_command += ldflags;
+
     int compile_result = system(compile_command.c_str());
 
     if (compile_result) {
@@ -721,9 +953,540 @@ bool compile(const options& opt) {
     return true;
 }
 
+// Compilation cache
+//
+// The generated source and the compilation flags are hashed together and the
+// executable is kept in the cache under this hash. The dependencies of the
+// executable, as found by the compiler, are kept along with it so that a
+// change to the headers of the library invalidates the cached executable.
+// The common includes are compiled once into a precompiled header.
+
+uint64_t hash_string(const std::string& value, uint64_t hash = 14695981039346656037UL) {
+    for (unsigned char c : value) {
+        hash ^= c;
+        hash *= 1099511628211UL;
+    }
+
+    return hash;
+}
+
+std::string to_hex(uint64_t value) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016lx", static_cast<unsigned long>(value));
+    return buffer;
+}
+
+std::string cache_directory() {
+    const auto* dir = std::getenv("DLLP_CACHE_DIR");
+
+    return dir ? dir : ".dllp_cache";
+}
+
+bool modification_time(const std::string& file, time_t& mtime) {
+    struct stat attr;
+
+    if (stat(file.c_str(), &attr)) {
+        return false;
+    }
+
+    mtime = attr.st_mtime;
+
+    return true;
+}
+
+bool read_file(const std::string& file, std::string& content) {
+    std::ifstream stream(file, std::ios::binary);
+
+    if (!stream) {
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    content = buffer.str();
+
+    return true;
+}
+
+bool write_file(const std::string& file, const std::string& content) {
+    std::string existing;
+
+    // Rewriting an identical file would only invalidate what depends on it
+    if (read_file(file, existing) && existing == content) {
+        return true;
+    }
+
+    std::ofstream stream(file, std::ios::binary);
+    stream << content;
+
+    return bool(stream);
+}
+
+/*!
+ * \brief Indicates if the given target is more recent than all the
+ * dependencies listed in the given dependency file (make format,
+ * as generated by -MD)
+ */
+bool up_to_date(const std::string& target, const std::string& dep_file) {
+    time_t target_time;
+    std::string deps;
+
+    if (!modification_time(target, target_time) || !read_file(dep_file, deps)) {
+        return false;
+    }
+
+    auto colon = deps.find(": ");
+
+    if (colon == std::string::npos) {
+        return false;
+    }
+
+    std::string dep;
+
+    auto check = [&dep, target_time]() {
+        time_t dep_time;
+
+        if (!dep.empty() && (!modification_time(dep, dep_time) || dep_time > target_time)) {
+            return false;
+        }
+
+        dep.clear();
+
+        return true;
+    };
+
+    for (size_t i = colon + 2; i < deps.size(); ++i) {
+        char c = deps[i];
+
+        if (c == '\\' && i + 1 < deps.size() && deps[i + 1] == ' ') {
+            dep += ' ';
+            ++i;
+        } else if (c == '\\' && i + 1 < deps.size() && deps[i + 1] == '\n') {
+            ++i;
+        } else if (c == ' ' || c == '\n' || c == '\t') {
+            if (!check()) {
+                return false;
+            }
+        } else {
+            dep += c;
+        }
+    }
+
+    return check();
+}
+
+/*!
+ * \brief Build the precompiled header of the common includes, for the given
+ * flags, and returns the flags to use it (empty if it cannot be used).
+ *
+ * The dependencies of an executable built with the precompiled header do not
+ * include the headers it contains, so the precompiled file is returned in
+ * order to check the executable against it.
+ */
+std::string precompiled_header(const options& opt, const std::string& cflags, std::string& output) {
+    const auto* cxx = std::getenv("CXX");
+
+    auto dir = cache_directory() + "/pch-" + to_hex(hash_string(cflags, hash_string(cxx)));
+
+    mkdir(dir.c_str(), 0755);
+
+    auto header = dir + "/dllp_pch.hpp";
+    auto deps   = header + ".d";
+
+    output = header + ".gch";
+
+    if (!write_file(header, common_includes())) {
+        return "";
+    }
+
+    if (!up_to_date(output, deps)) {
+        if (!opt.quiet) {
+            std::cout << "Precompiling the common headers..." << std::endl;
+        }
+
+        std::string command(cxx);
+
+        command += " -x c++-header ";
+        command += cflags;
+        command += " -MD -MF " + deps;
+        command += " -o " + output + ".tmp ";
+        command += header;
+
+        if (system(command.c_str()) || rename((output + ".tmp").c_str(), output.c_str())) {
+            std::cout << "dllp: warning: Impossible to precompile the common headers" << std::endl;
+            std::remove((output + ".tmp").c_str());
+            return "";
+        }
+    }
+
+    return " -include " + header + " ";
+}
+
+bool compile_exe(const dllp::options& opt, const std::vector<std::string>& actions, const dll::processor::task& t, const std::vector<std::unique_ptr<dllp::layer>>& layers, std::string& command) {
+    //Generate the CPP file
+    runtime_parameters params;
+    params.dynamic = opt.dynamic;
+
+    auto profile = opt.profile.empty() ? t.general_desc.profile : opt.profile;
+
+    if (!valid_profile(profile)) {
+        std::cout << "dllp: error: invalid profile must be one of [default, native, max]" << std::endl;
+        return false;
+    }
+
+    std::string cflags;
+    std::string ldflags;
+
+    if (!compile_flags(opt, profile, cflags, ldflags)) {
+        return false;
+    }
+
+    auto source = generate(layers, t, actions, params, build_description(profile, cflags, ldflags));
+
+    std::string executable;
+    std::string arguments;
+
+    if (params.dynamic) {
+        std::string content;
+
+        for (auto& value : params.values) {
+            content += value + "\n";
+        }
+
+        // With the cache, the parameters of several tasks can be used at the same time
+        std::string params_file = ".dbn.params";
+
+        if (opt.cache) {
+            mkdir(cache_directory().c_str(), 0755);
+            params_file = cache_directory() + "/" + to_hex(hash_string(content)) + ".params";
+        }
+
+        if (!write_file(params_file, content)) {
+            std::cout << "dllp: error: Impossible to write " << params_file << std::endl;
+            return false;
+        }
+
+        arguments = " " + params_file;
+    }
+
+    if (!compile_program(opt, source, cflags, ldflags, executable)) {
+        return false;
+    }
+
+    command = executable + arguments;
+
+    return true;
+}
+
+bool compile_program(const dllp::options& opt, const std::string& source, const std::string& cflags, const std::string& ldflags, std::string& executable) {
+    if (!opt.cache) {
+        executable = "./.dbn.out";
+
+        if (!write_file(".dbn.cpp", source)) {
+            std::cout << "dllp: error: Impossible to write .dbn.cpp" << std::endl;
+            return false;
+        }
+
+        return compile(opt, cflags, ldflags, ".dbn.cpp", executable, "");
+    }
+
+    //Look for the executable in the cache
+
+    auto dir = cache_directory();
+    auto key = to_hex(hash_string(source, hash_string(cflags + "|" + ldflags, hash_string(std::getenv("CXX")))));
+
+    auto source_file = dir + "/" + key + ".cpp";
+    auto deps_file   = dir + "/" + key + ".d";
+
+    executable = dir + "/" + key + ".out";
+
+    mkdir(dir.c_str(), 0755);
+
+    std::string pch_file;
+    auto pch_flags = precompiled_header(opt, cflags, pch_file);
+
+    time_t pch_time = 0;
+    time_t exe_time = 0;
+
+    bool pch_older = pch_flags.empty() || (modification_time(pch_file, pch_time) && modification_time(executable, exe_time) && pch_time <= exe_time);
+
+    if (pch_older && up_to_date(executable, deps_file)) {
+        if (!opt.quiet) {
+            std::cout << "Skip compilation" << std::endl;
+        }
+
+        return true;
+    }
+
+    if (!write_file(source_file, source)) {
+        std::cout << "dllp: error: Impossible to write " << source_file << std::endl;
+        return false;
+    }
+
+    auto extra = pch_flags + " -MD -MF " + deps_file + " ";
+
+    //Compile next to the cached executable, so that an interrupted compilation is never a hit
+
+    if (!compile(opt, cflags, ldflags, source_file, executable + ".tmp", extra)) {
+        return false;
+    }
+
+    if (rename((executable + ".tmp").c_str(), executable.c_str())) {
+        std::cout << "dllp: error: Impossible to store " << executable << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Parallel tasks
+
+/*!
+ * \brief Returns the CPUs the process can run on, ordered by NUMA node, so
+ * that a contiguous range of CPUs stays on as few nodes as possible
+ */
+std::vector<int> available_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    std::vector<int> cpus;
+
+    if (sched_getaffinity(0, sizeof(set), &set)) {
+        for (size_t cpu = 0; cpu < std::max(1U, std::thread::hardware_concurrency()); ++cpu) {
+            cpus.push_back(cpu);
+        }
+
+        return cpus;
+    }
+
+    std::vector<bool> seen(CPU_SETSIZE, false);
+
+    auto add = [&](int cpu) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &set) && !seen[cpu]) {
+            seen[cpu] = true;
+            cpus.push_back(cpu);
+        }
+    };
+
+    for (size_t node = 0; node < 64; ++node) {
+        std::ifstream stream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+
+        if (!stream || !std::getline(stream, list)) {
+            continue;
+        }
+
+        // The list is made of ranges: 0-3,8-11
+        std::stringstream ranges(list);
+        std::string range;
+
+        while (std::getline(ranges, range, ',')) {
+            auto dash  = range.find('-');
+            int first  = std::atoi(range.c_str());
+            int last   = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+
+            for (int cpu = first; cpu <= last; ++cpu) {
+                add(cpu);
+            }
+        }
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        add(cpu);
+    }
+
+    return cpus;
+}
+
+/*!
+ * \brief Returns the log file of the given task
+ */
+std::string task_log(const std::string& source_file, size_t i) {
+    auto name = source_file.substr(source_file.find_last_of('/') + 1);
+    auto dot  = name.find_last_of('.');
+
+    if (dot != std::string::npos && dot > 0) {
+        name = name.substr(0, dot);
+    }
+
+    return name + "." + std::to_string(i) + ".log";
+}
+
+/*!
+ * \brief Run the given commands concurrently.
+ *
+ * The CPUs are split into as many contiguous slots as concurrent tasks. Each
+ * task is bound to the CPUs of its slot and its thread budget (DLL, OpenMP
+ * and MKL) is set to the size of the slot. The output of each task goes to
+ * its own log file.
+ *
+ * \return 0 if all the tasks succeeded, 1 otherwise
+ */
+int run_parallel(const options& opt, const std::vector<std::string>& source_files, const std::vector<std::string>& commands) {
+    auto cpus = available_cpus();
+
+    const size_t n = commands.size();
+
+    size_t jobs = opt.jobs ? std::min(opt.jobs, n) : n;
+    jobs        = std::max<size_t>(1, std::min(jobs, cpus.size()));
+
+    std::vector<std::vector<int>> slots(jobs);
+
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        slots[i * jobs / cpus.size()].push_back(cpus[i]);
+    }
+
+    std::vector<pid_t> pids(jobs, 0);
+    std::vector<size_t> tasks(jobs, 0);
+
+    size_t next    = 0;
+    size_t running = 0;
+    int result     = 0;
+
+    auto launch = [&](size_t slot) {
+        auto log = task_log(source_files[next], next);
+
+        if (!opt.quiet) {
+            std::cout << "dllp: Executing " << source_files[next] << " on " << slots[slot].size() << " cores (log: " << log << ")" << std::endl;
+        }
+
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+
+            for (auto cpu : slots[slot]) {
+                CPU_SET(cpu, &set);
+            }
+
+            sched_setaffinity(0, sizeof(set), &set);
+
+            auto threads = std::to_string(slots[slot].size());
+
+            setenv("DLL_THREADS", threads.c_str(), 1);
+            setenv("OMP_NUM_THREADS", threads.c_str(), 1);
+            setenv("MKL_NUM_THREADS", threads.c_str(), 1);
+
+            int fd = ::open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+            if (fd >= 0) {
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                ::close(fd);
+            }
+
+            execl("/bin/sh", "sh", "-c", commands[next].c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+
+        if (pid < 0) {
+            std::cout << "dllp: error: Impossible to execute " << source_files[next] << std::endl;
+            result = 1;
+        } else {
+            pids[slot]  = pid;
+            tasks[slot] = next;
+            ++running;
+        }
+
+        ++next;
+    };
+
+    for (size_t slot = 0; slot < jobs && next < n; ++slot) {
+        launch(slot);
+    }
+
+    while (running) {
+        int status = 0;
+        pid_t pid  = wait(&status);
+
+        if (pid < 0) {
+            break;
+        }
+
+        auto slot = std::find(pids.begin(), pids.end(), pid) - pids.begin();
+
+        if (size_t(slot) == jobs) {
+            continue;
+        }
+
+        --running;
+        pids[slot] = 0;
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            std::cout << "dllp: error: " << source_files[tasks[slot]] << " failed (log: " << task_log(source_files[tasks[slot]], tasks[slot]) << ")" << std::endl;
+            result = 1;
+        } else if (!opt.quiet) {
+            std::cout << "dllp: " << source_files[tasks[slot]] << " done" << std::endl;
+        }
+
+        if (next < n) {
+            launch(slot);
+        }
+    }
+
+    return result;
+}
+
+/*!
+ * \brief Remove the codegen action from the given list
+ * \return true if the action was present, false otherwise
+ */
+bool remove_codegen(std::vector<std::string>& actions) {
+    auto it = std::remove(actions.begin(), actions.end(), "codegen");
+
+    if (it == actions.end()) {
+        return false;
+    }
+
+    actions.erase(it, actions.end());
+
+    return true;
+}
+
+/*!
+ * \brief Remove the codegen action (handled by dllp itself) from the given
+ * actions and from the default actions of the task, if they are used
+ * \return true if the action was present, false otherwise
+ */
+bool extract_codegen(std::vector<std::string>& actions, dll::processor::task& t) {
+    bool codegen = remove_codegen(actions);
+
+    if (std::find(actions.begin(), actions.end(), "auto") != actions.end()) {
+        codegen = remove_codegen(t.default_actions) || codegen;
+    }
+
+    return codegen;
+}
+
+/*!
+ * \brief Generate the standalone inference source of the given network,
+ * from its weights file, next to the configuration
+ */
+bool codegen(const options& opt, const std::string& source_file, const dll::processor::task& t, const layers_t& layers) {
+    auto name = source_file.substr(source_file.find_last_of('/') + 1);
+    auto dot  = name.find_last_of('.');
+
+    if (dot != std::string::npos && dot > 0) {
+        name = name.substr(0, dot);
+    }
+
+    auto output = name + "_inference.cpp";
+
+    if (!generate_inference(layers, t.w_desc.file, output)) {
+        return false;
+    }
+
+    if (!opt.quiet) {
+        std::cout << "dllp: generated " << output << std::endl;
+    }
+
+    return true;
+}
+
 } //end of namespace dllp
 
-int dll::processor::process_file(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file) {
+int dll::processor::process_file(const dllp::options& opt, const std::vector<std::string>& all_actions, const std::string& source_file) {
     //1. Parse the configuration file
 
     dll::processor::task t;
@@ -733,9 +1496,18 @@ int dll::processor::process_file(const dllp::options& opt, const std::vector<std
         return 1;
     }
 
+    auto actions      = all_actions;
+    bool with_codegen = dllp::extract_codegen(actions, t);
+
+    if (actions.empty()) {
+        return with_codegen && dllp::codegen(opt, source_file, t, layers) ? 0 : 1;
+    }
+
     //2. Generate the executable
 
-    if (!dllp::compile_exe(opt, actions, source_file, t, layers)) {
+    std::string command;
+
+    if (!dllp::compile_exe(opt, actions, t, layers, command)) {
         return 1;
     }
 
@@ -745,17 +1517,81 @@ int dll::processor::process_file(const dllp::options& opt, const std::vector<std
         std::cout << "Executing the program" << std::endl;
     }
 
-    auto exec_result = system("./.dbn.out");
+    auto exec_result = system(command.c_str());
 
     if (exec_result) {
         std::cout << "Impossible to execute the generated file" << std::endl;
         return exec_result;
     }
 
+    //4. Generate the inference code from the (new) weights
+
+    if (with_codegen && !dllp::codegen(opt, source_file, t, layers)) {
+        return 1;
+    }
+
     return 0;
 }
 
-std::string dll::processor::process_file_result(const dllp::options& opt, const std::vector<std::string>& actions, const std::string& source_file) {
+int dll::processor::process_files(const dllp::options& opt, const std::vector<std::string>& all_actions, const std::vector<std::string>& source_files) {
+    if (source_files.size() == 1) {
+        return process_file(opt, all_actions, source_files.front());
+    }
+
+    // The tasks can only run at the same time from distinct executables
+    auto task_opt = opt;
+
+    if (!task_opt.cache) {
+        std::cout << "dllp: warning: parallel tasks always use the compilation cache" << std::endl;
+        task_opt.cache = true;
+    }
+
+    //1. Parse the configuration files and generate the executables
+
+    std::vector<dll::processor::task> tasks(source_files.size());
+    std::vector<std::vector<std::unique_ptr<dllp::layer>>> networks(source_files.size());
+    std::vector<bool> with_codegen(source_files.size());
+    std::vector<std::string> commands;
+
+    for (size_t i = 0; i < source_files.size(); ++i) {
+        if (!dllp::parse_file(source_files[i], tasks[i], networks[i])) {
+            return 1;
+        }
+
+        auto actions    = all_actions;
+        with_codegen[i] = dllp::extract_codegen(actions, tasks[i]);
+
+        if (actions.empty()) {
+            continue;
+        }
+
+        std::string command;
+
+        if (!dllp::compile_exe(task_opt, actions, tasks[i], networks[i], command)) {
+            return 1;
+        }
+
+        commands.push_back(command);
+    }
+
+    //2. Run the generated programs concurrently
+
+    if (!commands.empty() && dllp::run_parallel(task_opt, source_files, commands)) {
+        return 1;
+    }
+
+    //3. Generate the inference code from the (new) weights
+
+    for (size_t i = 0; i < source_files.size(); ++i) {
+        if (with_codegen[i] && !dllp::codegen(opt, source_files[i], tasks[i], networks[i])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+std::string dll::processor::process_file_result(const dllp::options& opt, const std::vector<std::string>& all_actions, const std::string& source_file) {
     //1. Parse the configuration file
 
     dll::processor::task t;
@@ -765,13 +1601,30 @@ std::string dll::processor::process_file_result(const dllp::options& opt, const
         return "";
     }
 
-    //2. Generate the executable
+    auto actions      = all_actions;
+    bool with_codegen = dllp::extract_codegen(actions, t);
 
-    if (!dllp::compile_exe(opt, actions, source_file, t, layers)) {
-        return "";
+    std::string result;
+
+    if (!actions.empty()) {
+        //2. Generate the executable
+
+        std::string command;
+
+        if (!dllp::compile_exe(opt, actions, t, layers, command)) {
+            return "";
+        }
+
+        //3. Execute and keep the result
+
+        result = dllp::command_result(command);
     }
 
-    //3. Execute and return the result directly
+    //4. Generate the inference code from the (new) weights
+
+    if (with_codegen && !dllp::codegen(opt, source_file, t, layers)) {
+        return "";
+    }
 
-    return dllp::command_result("./.dbn.out");
+    return result;
 }
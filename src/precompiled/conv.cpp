@@ -0,0 +1,11 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// Explicit instantiation of the common configurations of the convolutional layers
+// (compiled with DLL_PRECOMPILED_INSTANTIATION, see dll/util/precompiled.hpp)
+
+#include "dll/neural/conv_layer.hpp"
@@ -0,0 +1,269 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Measure of the end-to-end throughput of the perf workloads and
+ * comparison with a baseline.
+ *
+ * Each workload is run a few times after some warmup runs. The harness
+ * measures the number of samples trained per second (best run), the time to
+ * the end of the first batch (from the trace of the timed scopes) and the
+ * peak resident memory of the run.
+ *
+ * The baseline is a text file, one line per workload:
+ *
+ *     <name> <samples/s> <first batch (ms)> <peak RSS (MB)>
+ *
+ * Its path is given by DLL_PERF_BASELINE (default: perf_baseline.txt). A
+ * workload is a regression when its throughput is lower, or its first batch
+ * or memory higher, than the baseline by more than DLL_PERF_TOLERANCE
+ * (default: 0.1). When DLL_PERF_UPDATE is set, the baseline is updated with
+ * the new measures instead.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dll/util/timers.hpp"
+#include "dll/util/trace.hpp"
+
+namespace dll_perf {
+
+/*!
+ * \brief The measures of one workload
+ */
+struct measure {
+    double samples_per_second = 0.0; ///< The throughput of the training
+    double first_batch        = 0.0; ///< The time to the end of the first batch, in milliseconds (0 if unknown)
+    double peak_rss           = 0.0; ///< The peak resident memory, in megabytes (0 if unknown)
+};
+
+/*!
+ * \brief Reset the peak resident memory of the process (Linux only)
+ */
+inline void reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+
+    if (clear_refs) {
+        clear_refs << "5";
+    }
+}
+
+/*!
+ * \brief Returns the peak resident memory of the process, in megabytes, since
+ * the last reset (0 if unknown)
+ */
+inline double peak_rss() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::atof(line.c_str() + 6) / 1024.0;
+        }
+    }
+
+    return 0.0;
+}
+
+/*!
+ * \brief Returns the end of the first traced scope with the given name, in
+ * milliseconds since the start of the trace (0 if it was not recorded)
+ */
+inline double first_scope_end(const std::string& name) {
+    double first = 0.0;
+
+    for (auto* thread = dll::get_trace().buffers.load(std::memory_order_acquire); thread; thread = thread->next) {
+        auto written = thread->written.load(std::memory_order_acquire);
+
+        // The first scopes have been overwritten
+        if (written > dll::trace_buffer_size) {
+            return 0.0;
+        }
+
+        for (size_t i = 0; i < written; ++i) {
+            auto& event = thread->events[i];
+
+            if (name == event.name) {
+                double end = event.end / 1e6;
+                first      = first == 0.0 ? end : std::min(first, end);
+                break;
+            }
+        }
+    }
+
+    return first;
+}
+
+/*!
+ * \brief Measure a workload.
+ *
+ * \param name The name of the workload
+ * \param samples The number of samples trained by one run of the workload
+ * \param batch_scope The name of the timed scope of one batch
+ * \param warmup The number of runs before the measures
+ * \param repetitions The number of measured runs
+ * \param functor The workload, doing one run (construction and training)
+ */
+template <typename Functor>
+measure run_workload(const std::string& name, size_t samples, const std::string& batch_scope, size_t warmup, size_t repetitions, Functor&& functor) {
+    for (size_t i = 0; i < warmup; ++i) {
+        functor();
+    }
+
+    measure result;
+
+    for (size_t i = 0; i < std::max(repetitions, size_t(1)); ++i) {
+        dll::reset_timers();
+        reset_peak_rss();
+        dll::start_trace();
+
+        auto start = std::chrono::steady_clock::now();
+
+        functor();
+
+        auto end = std::chrono::steady_clock::now();
+
+        dll::stop_trace();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double first   = first_scope_end(batch_scope);
+
+        result.samples_per_second = std::max(result.samples_per_second, samples / seconds);
+        result.peak_rss           = std::max(result.peak_rss, peak_rss());
+
+        if (first > 0.0) {
+            result.first_batch = result.first_batch == 0.0 ? first : std::min(result.first_batch, first);
+        }
+    }
+
+    printf("perf: %-24s %12.1f samples/s, first batch %10.2fms, peak RSS %10.1fMB\n", name.c_str(), result.samples_per_second, result.first_batch, result.peak_rss);
+
+    return result;
+}
+
+/*!
+ * \brief Returns the path of the baseline file
+ */
+inline std::string baseline_file() {
+    auto* file = std::getenv("DLL_PERF_BASELINE");
+    return file ? file : "perf_baseline.txt";
+}
+
+/*!
+ * \brief Returns the relative tolerance of the comparison with the baseline
+ */
+inline double baseline_tolerance() {
+    auto* tolerance = std::getenv("DLL_PERF_TOLERANCE");
+    return tolerance ? std::atof(tolerance) : 0.1;
+}
+
+/*!
+ * \brief Load the baseline file (empty if it does not exist)
+ */
+inline std::map<std::string, measure> load_baseline(const std::string& file) {
+    std::map<std::string, measure> baseline;
+
+    std::ifstream is(file);
+    std::string line;
+
+    while (std::getline(is, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream ls(line);
+
+        std::string name;
+        measure m;
+
+        if (ls >> name >> m.samples_per_second >> m.first_batch >> m.peak_rss) {
+            baseline[name] = m;
+        }
+    }
+
+    return baseline;
+}
+
+/*!
+ * \brief Store the baseline file
+ */
+inline void store_baseline(const std::string& file, const std::map<std::string, measure>& baseline) {
+    std::ofstream os(file);
+
+    os << "# <name> <samples/s> <first batch (ms)> <peak RSS (MB)>\n";
+
+    for (auto& [name, m] : baseline) {
+        os << name << " " << m.samples_per_second << " " << m.first_batch << " " << m.peak_rss << "\n";
+    }
+}
+
+/*!
+ * \brief Compare the measures of a workload with the baseline (or update the
+ * baseline with DLL_PERF_UPDATE).
+ *
+ * \return false if the workload is a regression compared to the baseline,
+ * true otherwise (including when there is no baseline for the workload)
+ */
+inline bool check_baseline(const std::string& name, const measure& result) {
+    auto file     = baseline_file();
+    auto baseline = load_baseline(file);
+
+    if (std::getenv("DLL_PERF_UPDATE")) {
+        baseline[name] = result;
+        store_baseline(file, baseline);
+
+        std::cout << "perf: " << name << " stored in " << file << std::endl;
+
+        return true;
+    }
+
+    auto it = baseline.find(name);
+
+    if (it == baseline.end()) {
+        std::cout << "perf: " << name << " has no baseline in " << file << std::endl;
+        return true;
+    }
+
+    auto& base = it->second;
+    auto tol   = baseline_tolerance();
+
+    bool ok = true;
+
+    // A measure is only compared when it is known on both sides
+    auto check = [&](const char* what, double value, double reference, bool higher_is_better) {
+        if (value <= 0.0 || reference <= 0.0) {
+            return;
+        }
+
+        double ratio = value / reference;
+
+        if (higher_is_better ? ratio < 1.0 - tol : ratio > 1.0 + tol) {
+            printf("perf: %s regressed on %s: %.2f (baseline %.2f, %+.1f%%)\n", name.c_str(), what, value, reference, 100.0 * (ratio - 1.0));
+            ok = false;
+        }
+    };
+
+    check("samples/s", result.samples_per_second, base.samples_per_second, true);
+    check("first batch (ms)", result.first_batch, base.first_batch, false);
+    check("peak RSS (MB)", result.peak_rss, base.peak_rss, false);
+
+    return ok;
+}
+
+} //end of dll_perf namespace
@@ -0,0 +1,176 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "catch.hpp"
+
+#include "perf_harness.hpp"
+
+#include "dll/rbm/rbm.hpp"
+#include "dll/rbm/conv_rbm_mp.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/neural/lstm_layer.hpp"
+#include "dll/neural/recurrent_last_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// End-to-end throughput of canonical workloads, compared with the baseline
+// (see perf_harness.hpp). Run with "[regression]" and DLL_PERF_UPDATE=1 once
+// to create the baseline of a machine.
+
+namespace {
+
+constexpr size_t warmup      = 1; ///< The number of runs before the measures
+constexpr size_t repetitions = 3; ///< The number of measured runs
+
+} // end of anonymous namespace
+
+// The MNIST DBN of dbn_perf.cpp (pretraining)
+TEST_CASE("perf/regression/mnist_dbn", "[perf][regression]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 300, dll::momentum, dll::batch_size<24>, dll::init_weights>::layer_t,
+            dll::rbm_desc<300, 1000, dll::momentum, dll::batch_size<24>>::layer_t,
+            dll::rbm_desc<1000, 10, dll::momentum, dll::batch_size<24>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_size<24>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(2400);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    constexpr size_t epochs = 2;
+
+    auto result = dll_perf::run_workload("mnist_dbn", epochs * dbn_t::layers * dataset.training_images.size(), "cd:update:normal", warmup, repetitions, [&] {
+        auto dbn = std::make_unique<dbn_t>();
+        dbn->pretrain(dataset.training_images, epochs);
+    });
+
+    CHECK(dll_perf::check_baseline("mnist_dbn", result));
+}
+
+// The CRBM with max pooling of crbm_mp_perf.cpp
+TEST_CASE("perf/regression/crbm_mp", "[perf][regression]") {
+    using rbm_t = dll::conv_rbm_mp_desc_square<
+        1, 28, 40, 17, 2,
+        dll::batch_size<50>,
+        dll::momentum, dll::weight_type<float>>::layer_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    constexpr size_t epochs = 5;
+
+    auto result = dll_perf::run_workload("crbm_mp", epochs * dataset.training_images.size(), "cd:update:conv", warmup, repetitions, [&] {
+        auto rbm = std::make_unique<rbm_t>();
+        rbm->train(dataset.training_images, epochs);
+    });
+
+    CHECK(dll_perf::check_baseline("crbm_mp", result));
+}
+
+// The convolutional network of conv_sgd_perf.cpp
+TEST_CASE("perf/regression/conv_sgd", "[perf][regression]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5>::layer_t,
+            dll::conv_layer_desc<6, 24, 24, 6, 5, 5>::layer_t,
+            dll::dense_layer_desc<6 * 20 * 20, 500>::layer_t,
+            dll::dense_layer_desc<500, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(3000);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    constexpr size_t epochs = 2;
+
+    auto result = dll_perf::run_workload("conv_sgd", epochs * dataset.training_images.size(), "net:trainer:train:epoch:batch", warmup, repetitions, [&] {
+        auto dbn = std::make_unique<dbn_t>();
+        dbn->fine_tune(dataset.training_images, dataset.training_labels, epochs);
+    });
+
+    CHECK(dll_perf::check_baseline("conv_sgd", result));
+}
+
+// The LSTM of the mnist_lstm example
+TEST_CASE("perf/regression/mnist_lstm", "[perf][regression]") {
+    constexpr size_t time_steps      = 28;
+    constexpr size_t sequence_length = 28;
+    constexpr size_t hidden_units    = 100;
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units, dll::last_only>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>>,
+        dll::updater<dll::updater_type::ADAM>, dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, time_steps, sequence_length>>(5000);
+    REQUIRE(!dataset.training_images.empty());
+
+    for (auto& image : dataset.training_images) {
+        image *= 1.0 / 255.0;
+    }
+
+    constexpr size_t epochs = 2;
+
+    auto result = dll_perf::run_workload("mnist_lstm", epochs * dataset.training_images.size(), "net:trainer:train:epoch:batch", warmup, repetitions, [&] {
+        auto dbn = std::make_unique<dbn_t>();
+        dbn->fine_tune(dataset.training_images, dataset.training_labels, epochs);
+    });
+
+    CHECK(dll_perf::check_baseline("mnist_lstm", result));
+}
+
+// The first network of imagenet_perf.cpp, on random images
+TEST_CASE("perf/regression/imagenet", "[perf][regression][slow]") {
+    constexpr size_t N = 512;
+    constexpr size_t B = 128;
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<3, 254, 254, 10, 3, 3>::layer_t,
+            dll::mp_2d_layer_desc<10, 252, 252, 2, 2>::layer_t,
+
+            dll::conv_layer_desc<10, 126, 126, 10, 3, 3>::layer_t,
+            dll::mp_2d_layer_desc<10, 124, 124, 2, 2>::layer_t,
+
+            dll::conv_layer_desc<10, 62, 62, 10, 3, 3>::layer_t,
+            dll::mp_2d_layer_desc<10, 60, 60, 2, 2>::layer_t,
+
+            dll::conv_layer_desc<10, 30, 30, 10, 3, 3>::layer_t,
+            dll::mp_2d_layer_desc<10, 28, 28, 2, 2>::layer_t,
+
+            dll::conv_layer_desc<10, 14, 14, 10, 3, 3>::layer_t,
+            dll::mp_2d_layer_desc<10, 12, 12, 2, 2>::layer_t,
+
+            dll::dense_layer_desc<10 * 6 * 6, 500>::layer_t,
+            dll::dense_layer_desc<500, 1000, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_mode, dll::big_batch_size<5>, dll::batch_size<B>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    std::vector<etl::fast_dyn_matrix<float, 3, 254, 254>> training_images(N);
+    std::vector<size_t> training_labels(N);
+
+    for (size_t i = 0; i < N; ++i) {
+        training_images[i] = etl::normal_generator();
+        training_labels[i] = i % 1000;
+    }
+
+    auto result = dll_perf::run_workload("imagenet", N, "net:trainer:train:epoch:batch", warmup, repetitions, [&] {
+        auto dbn = std::make_unique<dbn_t>();
+        dbn->fine_tune(training_images, training_labels, 1);
+    });
+
+    CHECK(dll_perf::check_baseline("imagenet", result));
+}
@@ -328,3 +328,430 @@ TEST_CASE("unit/augment/mnist/8", "[dbn][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.3);
 }
+
+// Use several augmentation workers for an in-memory generator
+TEST_CASE("unit/augment/mnist/9", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<
+        dll::batch_size<20>, dll::big_batch_size<4>, dll::augmentation_workers<3>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 60);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use several augmentation workers for an out-memory generator
+TEST_CASE("unit/augment/mnist/10", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::outmemory_data_generator_desc<
+        dll::batch_size<25>, dll::big_batch_size<4>, dll::augmentation_workers<2>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use an in-memory generator with uint8 storage
+TEST_CASE("unit/augment/mnist/11", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>, dll::uint8_storage>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    // The batches are converted and scaled from the uint8 cache
+    auto batch = train_generator->data_batch();
+
+    REQUIRE(etl::dim<0>(batch) == 25);
+
+    for (size_t i = 0; i < 28 * 28; ++i) {
+        CHECK(batch(1, i) == Approx(dataset.training_images[1][i] / 255.0f));
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use an augmented in-memory generator with uint8 storage
+TEST_CASE("unit/augment/mnist/12", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<
+        dll::batch_size<25>, dll::big_batch_size<4>, dll::augmentation_workers<2>, dll::noise<20>, dll::categorical, dll::scale_pre<255>, dll::uint8_storage>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Measure the time the training waits for an augmented generator
+TEST_CASE("unit/augment/mnist/13", "[dbn][unit]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::big_batch_size<2>, dll::noise<20>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    train_generator->set_train();
+    train_generator->reset_stall();
+
+    // Consuming the batches as fast as possible must wait for the augmentation
+    size_t batches = 0;
+
+    while (train_generator->has_next_batch()) {
+        auto batch = train_generator->data_batch();
+        cpp_unused(batch);
+        train_generator->next_batch();
+        ++batches;
+    }
+
+    REQUIRE(batches == 20);
+    REQUIRE(train_generator->stall_count() <= batches);
+    REQUIRE(train_generator->stall_time() >= 0.0);
+
+    train_generator->reset_stall();
+
+    REQUIRE(train_generator->stall_count() == 0);
+    REQUIRE(train_generator->stall_time() == 0.0);
+
+    REQUIRE(dll::is_generator_bound(0.5, 1.0));
+    REQUIRE(!dll::is_generator_bound(0.01, 1.0));
+    REQUIRE(!dll::is_generator_bound(0.0, 0.0));
+}
+
+// The parallel evaluation gives the metrics of the serial evaluation
+TEST_CASE("unit/augment/mnist/14", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    // The last batch is not complete
+    decltype(dataset.test_images) test_images(dataset.test_images.begin(), dataset.test_images.begin() + 490);
+    decltype(dataset.test_labels) test_labels(dataset.test_labels.begin(), dataset.test_labels.begin() + 490);
+
+    auto test_generator = dll::make_generator(
+        test_images, test_labels,
+        test_images.size(), 10,
+        generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->fine_tune(*train_generator, 5);
+
+    auto serial = dbn->evaluate_metrics(*test_generator, [&dbn](auto&& input_batch) { return dbn->forward_batch(input_batch); });
+    auto parallel = dbn->evaluate_metrics_parallel(*test_generator);
+
+    REQUIRE(std::get<0>(parallel) == Approx(std::get<0>(serial)));
+    REQUIRE(std::get<1>(parallel) == Approx(std::get<1>(serial)));
+}
+
+// The validation overlaps the training, with and without lag
+TEST_CASE("unit/augment/mnist/15", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::async_validation, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        generator_t{});
+
+    for (bool lag : {true, false}) {
+        auto dbn = std::make_unique<dbn_t>();
+
+        dbn->validation_lag = lag;
+
+        REQUIRE(dbn->fine_tune_val(*train_generator, *test_generator, 20) < 0.2);
+
+        // The network is left with the weights of the last (or best) epoch
+        auto test_error = dbn->evaluate_error(*test_generator);
+        std::cout << "test_error:" << test_error << std::endl;
+        REQUIRE(test_error < 0.3);
+    }
+}
+
+// Use in-memory generators with compressed storage
+TEST_CASE("unit/augment/mnist/16", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>, dll::compressed_storage>;
+    using augmented_generator_t = dll::inmemory_data_generator_desc<
+        dll::batch_size<25>, dll::big_batch_size<4>, dll::augmentation_workers<2>, dll::noise<20>, dll::categorical, dll::scale_pre<255>, dll::compressed_storage>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        augmented_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        train_generator_t{});
+
+    // The MNIST images are mostly background, they compress well
+    REQUIRE(test_generator->size() == dataset.test_images.size());
+    REQUIRE(test_generator->input_cache.ratio() > 2.0);
+
+    // The batches are decompressed, converted and scaled from the compressed cache
+    auto batch = test_generator->data_batch();
+
+    REQUIRE(etl::dim<0>(batch) == 25);
+
+    for (size_t s = 0; s < 25; ++s) {
+        for (size_t i = 0; i < 28 * 28; ++i) {
+            REQUIRE(batch(s, i) == Approx(dataset.test_images[s][i] / 255.0f));
+        }
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Gather the rows and scatter the one-hot labels of a batch
+TEST_CASE("unit/augment/labels/1", "[unit][generator]") {
+    etl::dyn_matrix<float, 2> cache(10, 7);
+    etl::dyn_matrix<float, 2> batch(4, 7);
+
+    for (size_t i = 0; i < 10; ++i) {
+        cache(i) = float(i);
+    }
+
+    std::vector<size_t> rows{7, 2, 9, 2};
+
+    dll::gather_rows(batch, cache, rows.size(), [&rows](size_t i) { return rows[i]; });
+
+    for (size_t i = 0; i < rows.size(); ++i) {
+        for (size_t j = 0; j < 7; ++j) {
+            REQUIRE(batch(i, j) == float(rows[i]));
+        }
+    }
+
+    etl::dyn_matrix<float, 2> labels(4, 5);
+    labels = 3.0f;
+
+    std::vector<size_t> classes{4, 0, 2, 11};
+
+    dll::one_hot_scatter(labels, classes.size(), [&classes](size_t i) { return classes[i]; });
+
+    for (size_t i = 0; i < classes.size(); ++i) {
+        for (size_t j = 0; j < 5; ++j) {
+            REQUIRE(labels(i, j) == (j == classes[i] ? 1.0f : 0.0f));
+        }
+    }
+}
+
+// Cropping and mirroring while gathering is the same as mirroring the crop
+TEST_CASE("unit/augment/crop_mirror/1", "[unit][generator]") {
+    using crop_desc   = dll::inmemory_data_generator_desc<dll::random_crop<20, 20>, dll::horizontal_mirroring, dll::vertical_mirroring>;
+    using mirror_desc = dll::inmemory_data_generator_desc<dll::horizontal_mirroring>;
+
+    etl::fast_dyn_matrix<float, 1, 28, 28> image;
+    image = etl::sequence_generator(0.0);
+
+    auto check = [&image](auto a, auto b, auto& x, auto& y) {
+        for (size_t i = 0; i < 50; ++i) {
+            a.crop_mirror(x, image);
+
+            b.cropper.transform_first(y, image, b.engine);
+            b.mirrorer.transform(y, b.engine);
+
+            for (size_t j = 0; j < etl::size(x); ++j) {
+                REQUIRE(x[j] == y[j]);
+            }
+        }
+    };
+
+    etl::fast_dyn_matrix<float, 1, 20, 20> crop_x;
+    etl::fast_dyn_matrix<float, 1, 20, 20> crop_y;
+
+    check(dll::augmentation_worker<crop_desc>(image, 0), dll::augmentation_worker<crop_desc>(image, 0), crop_x, crop_y);
+
+    etl::fast_dyn_matrix<float, 1, 28, 28> mirror_x;
+    etl::fast_dyn_matrix<float, 1, 28, 28> mirror_y;
+
+    check(dll::augmentation_worker<mirror_desc>(image, 0), dll::augmentation_worker<mirror_desc>(image, 0), mirror_x, mirror_y);
+}
+
+// The classification metrics are consistent with the evaluation metrics
+TEST_CASE("unit/augment/mnist/17", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    // The last batch is not complete
+    decltype(dataset.test_images) test_images(dataset.test_images.begin(), dataset.test_images.begin() + 490);
+    decltype(dataset.test_labels) test_labels(dataset.test_labels.begin(), dataset.test_labels.begin() + 490);
+
+    auto test_generator = dll::make_generator(
+        test_images, test_labels,
+        test_images.size(), 10,
+        generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->fine_tune(*train_generator, 5);
+
+    auto metrics        = dbn->evaluate_metrics(*test_generator);
+    auto classification = dbn->evaluate_classification(*test_generator, 10);
+
+    REQUIRE(classification.samples == 490);
+    REQUIRE(classification.accuracy() == Approx(1.0 - std::get<0>(metrics)));
+    REQUIRE(classification.top_k_accuracy() == Approx(1.0));
+
+    size_t total = 0;
+
+    for (size_t l = 0; l < 10; ++l) {
+        for (size_t p = 0; p < 10; ++p) {
+            total += classification.count(l, p);
+        }
+    }
+
+    REQUIRE(total == 490);
+}
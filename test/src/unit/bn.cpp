@@ -204,3 +204,152 @@ TEST_CASE("unit/bn/5", "[unit][bn]") {
     FT_CHECK_2_VAL(net, dataset, 50, 5e-2);
     TEST_CHECK_2(net, dataset, 0.25);
 }
+
+// Folding of BN into the previous layers for inference
+TEST_CASE("unit/bn/6", "[unit][bn][freeze]") {
+    using network_t = dll::network_desc<
+        dll::network_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::no_activation>::layer_t,
+            dll::batch_normalization_4d_layer_desc<6, 24, 24>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<6 * 24 * 24, 200, dll::no_bias, dll::no_activation>::layer_t,
+            dll::batch_normalization_2d_layer_desc<200>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+
+            dll::dense_layer_desc<200, 10, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SOFTMAX>::layer_t
+        >,
+        dll::updater<dll::updater_type::ADADELTA>, dll::batch_size<25>>::network_t;
+
+    auto dataset = dll::make_mnist_dataset_val(0, 500, 1500, dll::batch_size<25>{}, dll::scale_pre<255>{});
+
+    auto net = std::make_unique<network_t>();
+
+    FT_CHECK_2_VAL(net, dataset, 20, 0.1);
+
+    auto& generator = dataset.test();
+
+    generator.reset();
+    generator.set_test();
+
+    auto expected = net->forward_batch(generator.data_batch());
+
+    REQUIRE(net->freeze_for_inference() == 2);
+
+    auto output = net->forward_batch(generator.data_batch());
+
+    auto session = net->make_inference_session(25);
+    auto session_output = session.forward_batch(generator.data_batch());
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-3));
+        REQUIRE(session_output[i] == Approx(expected[i]).epsilon(1e-3));
+    }
+
+    TEST_CHECK_2(net, dataset, 0.25);
+}
+
+// Single-pass statistics against the two-pass definition
+TEST_CASE("unit/bn/stats/1", "[unit][bn]") {
+    etl::fast_dyn_matrix<float, 9, 4, 5, 3> input;
+    input = 10.0 + etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 4> mean;
+    etl::fast_dyn_matrix<float, 4> var;
+
+    dll::batch_norm_4d_stats(input.memory_start(), mean.memory_start(), var.memory_start(), 9, 4, 15);
+
+    for (size_t k = 0; k < 4; ++k) {
+        double m = 0;
+        double v = 0;
+
+        for (size_t b = 0; b < 9; ++b) {
+            m += etl::sum(input(b)(k));
+        }
+
+        m /= 9 * 15;
+
+        for (size_t b = 0; b < 9; ++b) {
+            v += etl::sum((input(b)(k) - m) >> (input(b)(k) - m));
+        }
+
+        v /= 9 * 15;
+
+        REQUIRE(mean[k] == Approx(m).epsilon(1e-4));
+        REQUIRE(var[k] == Approx(v).epsilon(1e-3));
+    }
+
+    etl::fast_dyn_matrix<float, 9, 60> input_2d;
+    input_2d = 10.0 + etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 60> mean_2d;
+    etl::fast_dyn_matrix<float, 60> var_2d;
+
+    dll::batch_norm_2d_stats(input_2d.memory_start(), mean_2d.memory_start(), var_2d.memory_start(), 9, 60);
+
+    for (size_t k = 0; k < 60; ++k) {
+        double m = 0;
+        double v = 0;
+
+        for (size_t b = 0; b < 9; ++b) {
+            m += input_2d(b, k);
+        }
+
+        m /= 9;
+
+        for (size_t b = 0; b < 9; ++b) {
+            v += (input_2d(b, k) - m) * (input_2d(b, k) - m);
+        }
+
+        v /= 9;
+
+        REQUIRE(mean_2d[k] == Approx(m).epsilon(1e-4));
+        REQUIRE(var_2d[k] == Approx(v).epsilon(1e-3));
+    }
+}
+
+// Synchronized statistics of the data-parallel replicas against the whole batch
+TEST_CASE("unit/bn/sync/1", "[unit][bn][sgd]") {
+    using layers_t = dll::dbn_layers<
+        dll::dense_layer_desc<28 * 28, 100, dll::no_bias, dll::no_activation>::layer_t,
+        dll::batch_normalization_2d_layer_desc<100>::layer_t,
+        dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+        dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>;
+
+    using dbn_t  = dll::dbn_desc<layers_t, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t;
+    using sync_t = dll::dbn_desc<layers_t, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>, dll::data_parallel<4>, dll::sync_batch_norm>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(300);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto ref = std::make_unique<dbn_t>();
+    auto dbn = std::make_unique<sync_t>();
+
+    dbn->template layer_get<0>().w = ref->template layer_get<0>().w;
+    dbn->template layer_get<3>().w = ref->template layer_get<3>().w;
+    dbn->template layer_get<3>().b = ref->template layer_get<3>().b;
+
+    // Without updates, the running statistics only depend on the batches
+
+    ref->learning_rate = 0.0;
+    dbn->learning_rate = 0.0;
+
+    ref->fine_tune(dataset.training_images, dataset.training_labels, 1);
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 1);
+
+    auto& ref_bn = ref->template layer_get<1>();
+    auto& bn     = dbn->template layer_get<1>();
+
+    for (size_t k = 0; k < 100; ++k) {
+        REQUIRE(bn.mean[k] == Approx(ref_bn.mean[k]).epsilon(1e-3).margin(1e-4));
+        REQUIRE(bn.var[k] == Approx(ref_bn.var[k]).epsilon(1e-2).margin(1e-4));
+    }
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+}
@@ -15,6 +15,8 @@
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/pooling/upsample_layer.hpp"
 #include "dll/dbn.hpp"
+#include "dll/util/deconv.hpp"
+#include "dll/util/upsample.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -51,6 +53,116 @@ TEST_CASE("conv/ae/deconv/1", "[dense][dbn][mnist][sgd][ae]") {
     REQUIRE(test_error < 0.3);
 }
 
+TEST_CASE("conv/ae/deconv/kernels", "[conv][deconv][unit]") {
+    etl::fast_matrix<float, 2, 3, 9, 7> v;
+    etl::fast_matrix<float, 3, 4, 5, 3> w;
+    etl::fast_matrix<float, 2, 4, 13, 9> h;
+
+    v = etl::uniform_generator(-1.0, 1.0);
+    w = etl::uniform_generator(-1.0, 1.0);
+    h = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, 2, 4, 13, 9> h_d;
+    dll::deconv_forward(h_d, v, w);
+
+    auto h_ref = etl::force_temporary(etl::conv_4d_full_flipped(v, w));
+
+    for (size_t i = 0; i < etl::size(h_d); ++i) {
+        REQUIRE(h_d[i] == Approx(h_ref[i]).epsilon(1e-3));
+    }
+
+    etl::fast_matrix<float, 2, 3, 9, 7> v_d;
+    dll::deconv_backward(v_d, h, w);
+
+    auto v_ref = etl::force_temporary(etl::conv_4d_valid_flipped(h, w));
+
+    for (size_t i = 0; i < etl::size(v_d); ++i) {
+        REQUIRE(v_d[i] == Approx(v_ref[i]).epsilon(1e-3));
+    }
+
+    etl::fast_matrix<float, 3, 4, 5, 3> w_d;
+    dll::deconv_gradients(w_d, h, v);
+
+    auto w_ref = etl::force_temporary(etl::conv_4d_valid_filter_flipped(h, v));
+
+    for (size_t i = 0; i < etl::size(w_d); ++i) {
+        REQUIRE(w_d[i] == Approx(w_ref[i]).epsilon(1e-3));
+    }
+}
+
+TEST_CASE("conv/ae/upsample/kernels", "[conv][upsample][unit]") {
+    etl::fast_matrix<float, 2, 3, 5, 4> v;
+    etl::fast_matrix<float, 4, 3, 3, 3> w;
+    etl::fast_matrix<float, 2, 3, 10, 8> h;
+
+    v = etl::uniform_generator(-1.0, 1.0);
+    w = etl::uniform_generator(-1.0, 1.0);
+    h = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_matrix<float, 2, 3, 10, 8> up;
+    dll::upsample_3d_forward<2, 2>(up.memory_start(), v.memory_start(), 2, 3, 5, 4, 1, 2, 2);
+
+    auto up_ref = etl::force_temporary(etl::upsample_3d<1, 2, 2>(v));
+
+    for (size_t i = 0; i < etl::size(up); ++i) {
+        REQUIRE(up[i] == Approx(up_ref[i]).epsilon(1e-3));
+    }
+
+    etl::fast_matrix<float, 2, 3, 5, 4> down;
+    dll::upsample_3d_backward(down.memory_start(), h.memory_start(), 2, 3, 5, 4, 1, 2, 2);
+
+    auto down_ref = etl::force_temporary(etl::max_pool_3d<1, 2, 2>(h));
+
+    for (size_t i = 0; i < etl::size(down); ++i) {
+        REQUIRE(down[i] == Approx(down_ref[i]).epsilon(1e-3));
+    }
+
+    etl::fast_matrix<float, 2, 4, 8, 6> conv;
+    dll::upsample_conv_forward(conv, v, w, 2, 2);
+
+    auto conv_ref = etl::force_temporary(etl::ml::convolution_forward(up_ref, w));
+
+    for (size_t i = 0; i < etl::size(conv); ++i) {
+        REQUIRE(conv[i] == Approx(conv_ref[i]).epsilon(1e-3));
+    }
+}
+
+TEST_CASE("conv/ae/upsample/session", "[conv][upsample][unit]") {
+    using network_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer<1, 28, 28, 4, 5, 5, dll::relu>,
+            dll::mp_3d_layer<4, 24, 24, 1, 2, 2>,
+            dll::upsample_3d_layer<4, 12, 12, 1, 2, 2>,
+            dll::conv_layer<4, 24, 24, 1, 3, 3, dll::sigmoid>
+        >, dll::batch_size<10>>::network_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(10);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<network_t>();
+
+    etl::fast_dyn_matrix<float, 10, 1, 28, 28> batch;
+
+    for (size_t i = 0; i < 10; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    auto expected = dbn->forward_batch(batch);
+
+    // The upsampled input is never computed by the session
+    REQUIRE(dll::session_detail::fuses_upsample<network_t, 2>());
+    REQUIRE(!dll::session_detail::needs_buffer<network_t, 2>());
+
+    auto session = dbn->make_inference_session(10);
+    auto session_output = session.forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(session_output[i] == Approx(expected[i]).epsilon(1e-3));
+    }
+}
+
 // Conv <> Conv
 TEST_CASE("conv/ae/1", "[dense][dbn][mnist][sgd][ae]") {
     using network_t = dll::dbn_desc<
@@ -92,3 +92,83 @@ TEST_CASE("unit/conv/sgd/8", "[unit][conv][dbn][mnist][sgd]") {
     FT_CHECK(25, 6e-2);
     TEST_CHECK(0.25);
 }
+
+TEST_CASE("unit/conv/sgd/9", "[unit][conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 5, 5, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::mp_2d_layer_desc<6, 24, 24, 2, 2, dll::activation<dll::function::RELU>, dll::argmax_indices>::layer_t,
+            dll::conv_layer_desc<6, 12, 12, 5, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<5 * 10 * 10, 100, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(2000);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.005;
+
+    FT_CHECK(50, 6e-2);
+    TEST_CHECK(0.25);
+}
+
+TEST_CASE("unit/conv/mp/dyn", "[unit][conv][mp]") {
+    using layer_t = dll::dyn_mp_2d_layer_desc<>::layer_t;
+
+    // A specialised window and a generic one
+    for (auto [c1, c2] : {std::make_pair(2UL, 2UL), std::make_pair(3UL, 2UL)}) {
+        layer_t layer;
+        layer.init_layer(3, 12, 12, c1, c2);
+
+        etl::dyn_matrix<float, 4> input(2, 3, 12, 12);
+        etl::dyn_matrix<float, 4> output(2, 3, 12 / c1, 12 / c2);
+
+        input = etl::uniform_generator(-1.0, 1.0);
+
+        layer.forward_batch(output, input);
+
+        auto ref = etl::force_temporary(etl::ml::max_pool_forward(input, c1, c2));
+
+        for (size_t i = 0; i < etl::size(output); ++i) {
+            REQUIRE(output[i] == Approx(ref[i]));
+        }
+    }
+}
+
+TEST_CASE("unit/conv/avgp/dyn", "[unit][conv][avgp]") {
+    using layer_t = dll::dyn_avgp_2d_layer_desc<>::layer_t;
+
+    // A specialised window, a generic one and a global pooling
+    for (auto [c1, c2] : {std::make_pair(2UL, 2UL), std::make_pair(3UL, 2UL), std::make_pair(12UL, 12UL)}) {
+        layer_t layer;
+        layer.init_layer(3, 12, 12, c1, c2);
+
+        etl::dyn_matrix<float, 4> input(2, 3, 12, 12);
+        etl::dyn_matrix<float, 4> output(2, 3, 12 / c1, 12 / c2);
+        etl::dyn_matrix<float, 4> errors(2, 3, 12 / c1, 12 / c2);
+        etl::dyn_matrix<float, 4> input_errors(2, 3, 12, 12);
+
+        input  = etl::uniform_generator(-1.0, 1.0);
+        errors = etl::uniform_generator(-1.0, 1.0);
+
+        layer.forward_batch(output, input);
+
+        auto ref = etl::force_temporary(etl::ml::avg_pool_forward(input, c1, c2));
+
+        for (size_t i = 0; i < etl::size(output); ++i) {
+            REQUIRE(output[i] == Approx(ref[i]));
+        }
+
+        layer.kernels.backward(input_errors.memory_start(), errors.memory_start(), 2 * 3, 12, 12, c1, c2);
+
+        auto errors_ref = etl::force_temporary(etl::ml::avg_pool_backward(input, output, errors, c1, c2));
+
+        for (size_t i = 0; i < etl::size(input_errors); ++i) {
+            REQUIRE(input_errors[i] == Approx(errors_ref[i]));
+        }
+    }
+}
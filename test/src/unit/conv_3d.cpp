@@ -0,0 +1,186 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <random>
+#include <vector>
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_3d_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/dbn.hpp"
+
+namespace {
+
+/*!
+ * \brief Compute the valid correlation of the volumes of a batch with the
+ * filters of a layer, directly from the definition
+ */
+template <typename Layer, typename I, typename O>
+void reference_conv_3d(const Layer& layer, const I& input, O& output) {
+    const size_t nh1 = etl::dim<2>(output);
+    const size_t nh2 = etl::dim<3>(output);
+    const size_t nh3 = etl::dim<4>(output);
+
+    for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+        for (size_t k = 0; k < etl::dim<1>(output); ++k) {
+            for (size_t p1 = 0; p1 < nh1; ++p1) {
+                for (size_t p2 = 0; p2 < nh2; ++p2) {
+                    for (size_t p3 = 0; p3 < nh3; ++p3) {
+                        double acc = layer.b(k);
+
+                        for (size_t c = 0; c < etl::dim<1>(layer.w); ++c) {
+                            for (size_t m1 = 0; m1 < etl::dim<2>(layer.w); ++m1) {
+                                for (size_t m2 = 0; m2 < etl::dim<3>(layer.w); ++m2) {
+                                    for (size_t m3 = 0; m3 < etl::dim<4>(layer.w); ++m3) {
+                                        acc += layer.w(k, c, m1, m2, m3) * input(i, c, p1 + m1, p2 + m2, p3 + m3);
+                                    }
+                                }
+                            }
+                        }
+
+                        output(i, k, p1, p2, p3) = acc;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Generate volumes with a bright cube either in the front half
+ * (label 0) or in the back half (label 1) of the volume
+ */
+template <typename Volume>
+void generate_volumes(std::vector<Volume>& volumes, std::vector<size_t>& labels, size_t n) {
+    std::default_random_engine rand_engine(42);
+    std::uniform_real_distribution<float> noise(0.0f, 0.2f);
+    std::uniform_int_distribution<size_t> position(0, 1);
+
+    for (size_t i = 0; i < n; ++i) {
+        Volume volume;
+
+        for (auto& v : volume) {
+            v = noise(rand_engine);
+        }
+
+        const size_t label = i % 2;
+        const size_t d     = label * 4 + position(rand_engine);
+        const size_t y     = 2 + position(rand_engine);
+        const size_t x     = 2 + position(rand_engine);
+
+        for (size_t a = 0; a < 3; ++a) {
+            for (size_t b = 0; b < 3; ++b) {
+                for (size_t c = 0; c < 3; ++c) {
+                    volume(0, d + a, y + b, x + c) = 1.0f;
+                }
+            }
+        }
+
+        volumes.push_back(volume);
+        labels.push_back(label);
+    }
+}
+
+} // end of anonymous namespace
+
+// Direct kernel (few filters)
+TEST_CASE("unit/conv_3d/forward/0", "[unit][conv_3d]") {
+    using layer_t = dll::conv_3d_layer_desc<2, 7, 6, 9, 3, 3, 2, 4, dll::no_activation>::layer_t;
+
+    layer_t layer;
+    layer.b = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 2, 7, 6, 9> input;
+    etl::fast_dyn_matrix<float, 3, 3, 5, 5, 6> output;
+    etl::fast_dyn_matrix<float, 3, 3, 5, 5, 6> expected;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(output, input);
+
+    reference_conv_3d(layer, input, expected);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
+
+// Products with the columns (many filters)
+TEST_CASE("unit/conv_3d/forward/1", "[unit][conv_3d]") {
+    using layer_t = dll::conv_3d_layer_desc<3, 8, 8, 8, 8, 3, 3, 3, dll::no_activation>::layer_t;
+
+    layer_t layer;
+    layer.b = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 2, 3, 8, 8, 8> input;
+    etl::fast_dyn_matrix<float, 2, 8, 6, 6, 6> output;
+    etl::fast_dyn_matrix<float, 2, 8, 6, 6, 6> expected;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(output, input);
+
+    reference_conv_3d(layer, input, expected);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
+
+// The dynamic layer computes the same output as the static one
+TEST_CASE("unit/conv_3d/dyn/0", "[unit][conv_3d]") {
+    using layer_t     = dll::conv_3d_layer_desc<3, 8, 8, 8, 8, 3, 3, 3, dll::relu>::layer_t;
+    using dyn_layer_t = dll::dyn_conv_3d_layer_desc<dll::relu>::layer_t;
+
+    layer_t layer;
+    dyn_layer_t dyn_layer;
+
+    dyn_layer.init_layer(3, 8, 8, 8, 8, 3, 3, 3);
+    dyn_layer.w = layer.w;
+    dyn_layer.b = etl::uniform_generator(-1.0, 1.0);
+    layer.b     = dyn_layer.b;
+
+    etl::fast_dyn_matrix<float, 2, 3, 8, 8, 8> input;
+    etl::dyn_matrix<float, 5> output(2, 8, 6, 6, 6);
+    etl::dyn_matrix<float, 5> expected(2, 8, 6, 6, 6);
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(expected, input);
+    dyn_layer.forward_batch(output, input);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/conv_3d/sgd/0", "[unit][conv_3d][dbn][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_3d_layer_desc<1, 8, 8, 8, 4, 3, 3, 3, dll::relu>::layer_t,
+            dll::dense_layer_desc<4 * 6 * 6 * 6, 2, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>
+    >::dbn_t;
+
+    std::vector<etl::fast_dyn_matrix<float, 1, 8, 8, 8>> volumes;
+    std::vector<size_t> labels;
+
+    generate_volumes(volumes, labels, 100);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.01;
+
+    auto ft_error = dbn->fine_tune(volumes, labels, 20);
+    std::cout << "ft_error:" << ft_error << std::endl;
+    REQUIRE(ft_error < 0.1);
+
+    auto test_error = dbn->evaluate_error(volumes, labels);
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.1);
+}
@@ -421,3 +421,40 @@ TEST_CASE("unit/augment/conv/mnist/11", "[dbn][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     CHECK(test_error < 0.3);
 }
+
+// Use an in-memory generator with elastic distortions from a bank of fields
+TEST_CASE("unit/augment/conv/mnist/12", "[dbn][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer_desc<1, 28, 28, 6, 3, 3>::layer_t,
+            dll::mp_2d_layer_desc<6, 26, 26, 2, 2>::layer_t,
+            dll::dense_layer_desc<6 * 13 * 13, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::updater<dll::updater_type::MOMENTUM>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(400);
+    REQUIRE(!dataset.training_images.empty());
+
+    using train_generator_t = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::elastic_distortion<5>, dll::elastic_bank<16>, dll::categorical, dll::scale_pre<255>>;
+    using test_generator_t  = dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        train_generator_t{});
+
+    auto test_generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        test_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
@@ -14,6 +14,7 @@
 #include "dll/neural/dense_layer.hpp"
 #include "dll/dbn.hpp"
 #include "dll/pooling/mp_layer.hpp"
+#include "dll/util/winograd_conv.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -58,3 +59,59 @@ TEST_CASE("unit/conv/same/2", "[conv][dbn][mnist][sgd]") {
     FT_CHECK(100, 5e-2);
     TEST_CHECK(0.2);
 }
+
+TEST_CASE("unit/conv/winograd/1", "[conv][winograd][unit]") {
+    etl::fast_matrix<float, 2, 3, 9, 7> v;
+    etl::fast_matrix<float, 4, 3, 3, 3> w;
+    etl::fast_matrix<float, 2, 4, 7, 5> h;
+    etl::fast_matrix<float, 2, 4, 9, 7> h_same;
+
+    v      = etl::uniform_generator(-1.0, 1.0);
+    w      = etl::uniform_generator(-1.0, 1.0);
+    h      = etl::uniform_generator(-1.0, 1.0);
+    h_same = etl::uniform_generator(-1.0, 1.0);
+
+    dll::winograd_conv_engine<float> winograd;
+
+    // Valid convolution
+
+    etl::fast_matrix<float, 2, 4, 7, 5> h_w;
+    winograd.forward(h_w, v, w, 9, 7, 0);
+
+    auto h_ref = etl::force_temporary(etl::ml::convolution_forward(v, w));
+
+    for (size_t i = 0; i < etl::size(h_w); ++i) {
+        REQUIRE(h_w[i] == Approx(h_ref[i]).epsilon(1e-3));
+    }
+
+    etl::fast_matrix<float, 2, 3, 9, 7> v_w;
+    winograd.backward(v_w, h, w, 7, 5, 0);
+
+    auto v_ref = etl::force_temporary(etl::ml::convolution_backward(h, w));
+
+    for (size_t i = 0; i < etl::size(v_w); ++i) {
+        REQUIRE(v_w[i] == Approx(v_ref[i]).epsilon(1e-3));
+    }
+
+    // Same convolution, after a change of the filters
+
+    w *= 0.5;
+    winograd.invalidate();
+
+    etl::fast_matrix<float, 2, 4, 9, 7> h_same_w;
+    winograd.forward(h_same_w, v, w, 9, 7, 1);
+
+    auto h_same_ref = etl::force_temporary(etl::ml::convolution_forward<1, 1, 1, 1>(v, w));
+
+    for (size_t i = 0; i < etl::size(h_same_w); ++i) {
+        REQUIRE(h_same_w[i] == Approx(h_same_ref[i]).epsilon(1e-3));
+    }
+
+    winograd.backward(v_w, h_same, w, 9, 7, 1);
+
+    auto v_same_ref = etl::force_temporary(etl::ml::convolution_backward<1, 1, 1, 1>(h_same, w));
+
+    for (size_t i = 0; i < etl::size(v_w); ++i) {
+        REQUIRE(v_w[i] == Approx(v_same_ref[i]).epsilon(1e-3));
+    }
+}
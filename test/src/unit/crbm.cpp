@@ -12,6 +12,7 @@
 #include "cpp_utils/data.hpp"
 
 #include "dll/rbm/conv_rbm.hpp"
+#include "dll/util/fft_conv.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -160,3 +161,45 @@ TEST_CASE("unit/crbm/mnist/7", "[crbm][unit]") {
     auto error = rbm.train(dataset.training_images, 50);
     REQUIRE(error < 7e-2);
 }
+
+TEST_CASE("unit/crbm/fft/1", "[crbm][fft][unit]") {
+    etl::fast_matrix<float, 2, 3, 12, 12> v;
+    etl::fast_matrix<float, 4, 3, 5, 5> w;
+    etl::fast_matrix<float, 2, 4, 8, 8> h;
+
+    v = etl::uniform_generator(-1.0, 1.0);
+    w = etl::uniform_generator(-1.0, 1.0);
+    h = etl::uniform_generator(-1.0, 1.0);
+
+    dll::fft_conv_engine<float> fft;
+    fft.prepare(w, 12, 12);
+
+    etl::fast_matrix<float, 2, 4, 8, 8> h_fft;
+    fft.forward(fft.v_fft, v);
+    fft.valid(h_fft, fft.v_fft);
+
+    auto h_ref = etl::force_temporary(etl::conv_4d_valid_flipped(v, w));
+
+    for (size_t i = 0; i < etl::size(h_fft); ++i) {
+        REQUIRE(h_fft[i] == Approx(h_ref[i]).epsilon(1e-3));
+    }
+
+    etl::fast_matrix<float, 2, 3, 12, 12> v_fft;
+    fft.forward(fft.h_fft, h);
+    fft.full(v_fft, fft.h_fft);
+
+    auto v_ref = etl::force_temporary(etl::conv_4d_full(h, w));
+
+    for (size_t i = 0; i < etl::size(v_fft); ++i) {
+        REQUIRE(v_fft[i] == Approx(v_ref[i]).epsilon(1e-3));
+    }
+
+    etl::fast_matrix<float, 4, 3, 5, 5> w_fft;
+    fft.valid_filter(w_fft, fft.v_fft, fft.h_fft);
+
+    auto w_ref = etl::force_temporary(etl::conv_4d_valid_filter_flipped(v, h));
+
+    for (size_t i = 0; i < etl::size(w_fft); ++i) {
+        REQUIRE(w_fft[i] == Approx(w_ref[i]).epsilon(1e-3));
+    }
+}
@@ -157,3 +157,55 @@ TEST_CASE("unit/crbm_mp/mnist/7", "[crbm_mp][lee][gaussian][unit]") {
     auto error = rbm.train(dataset.training_images, 30);
     REQUIRE(error < 0.1);
 }
+
+TEST_CASE("unit/crbm_mp/pmp/1", "[crbm_mp][pmp][unit]") {
+    etl::fast_matrix<float, 2, 3, 4, 4> x;
+    etl::fast_vector<float, 3> b;
+
+    x = etl::normal_generator(0.0, 4.0);
+    b = etl::normal_generator(0.0, 1.0);
+
+    etl::fast_matrix<float, 2, 3, 4, 4> b_rep;
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t k = 0; k < 3; ++k) {
+            b_rep(i)(k) = b(k);
+        }
+    }
+
+    etl::fast_matrix<float, 2, 3, 4, 4> h_ref = etl::p_max_pool_h(b_rep + x, 2, 2);
+    etl::fast_matrix<float, 2, 3, 2, 2> p_ref = etl::p_max_pool_p(b_rep + x, 2, 2);
+
+    etl::fast_matrix<float, 2, 3, 4, 4> h_s;
+    etl::fast_matrix<float, 2, 3, 2, 2> p_a;
+    etl::fast_matrix<float, 2, 3, 2, 2> p_s;
+
+    dll::p_max_pool_kernel(x.memory_start(), h_s.memory_start(), p_a.memory_start(), p_s.memory_start(), b.memory_start(), 2, 3, 4, 4, 2, 1.0f);
+
+    for (size_t i = 0; i < etl::size(x); ++i) {
+        REQUIRE(x[i] == Approx(h_ref[i]).epsilon(1e-4));
+    }
+
+    for (size_t i = 0; i < etl::size(p_a); ++i) {
+        REQUIRE(p_a[i] == Approx(p_ref[i]).epsilon(1e-4));
+    }
+
+    // At most one unit of each block is on, exactly when the pooling unit is on
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t k = 0; k < 3; ++k) {
+            for (size_t p1 = 0; p1 < 2; ++p1) {
+                for (size_t p2 = 0; p2 < 2; ++p2) {
+                    float on = 0.0f;
+
+                    for (size_t a = 0; a < 2; ++a) {
+                        for (size_t d = 0; d < 2; ++d) {
+                            on += h_s(i, k, p1 * 2 + a, p2 * 2 + d);
+                        }
+                    }
+
+                    REQUIRE(on == p_s(i, k, p1, p2));
+                }
+            }
+        }
+    }
+}
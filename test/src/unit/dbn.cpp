@@ -84,6 +84,22 @@ TEST_CASE("unit/dbn/mnist/2", "[dbn][unit]") {
     auto error = dll::test_set(dbn, dataset.training_images, dataset.training_labels, dll::label_predictor());
     std::cout << "test_error:" << error << std::endl;
     REQUIRE(error < 0.3);
+
+    auto predictions = dbn->predict_labels_batch(dataset.training_images, 10);
+
+    REQUIRE(predictions.size() == dataset.training_images.size());
+
+    size_t errors = 0;
+
+    for (size_t i = 0; i < predictions.size(); ++i) {
+        if (predictions[i] != dataset.training_labels[i]) {
+            ++errors;
+        }
+    }
+
+    auto batch_error = double(errors) / predictions.size();
+    std::cout << "batch_error:" << batch_error << std::endl;
+    REQUIRE(batch_error < 0.3);
 }
 
 TEST_CASE("unit/dbn/mnist/3", "[dbn][unit]") {
@@ -431,3 +447,151 @@ TEST_CASE("unit/dbn/mnist/12", "[dbn][unit]") {
 
     dll::dump_timers();
 }
+
+TEST_CASE("unit/dbn/mnist/13", "[dbn][pipeline][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::pipeline_pre, dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+TEST_CASE("unit/dbn/mnist/14", "[dbn][store][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::feature_store<16>, dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+// Cache the features of the lower layers in batch mode
+TEST_CASE("unit/dbn/mnist/142", "[dbn][store][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::batch_mode, dll::feature_store<16>, dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->batch_mode());
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+// Stream the dataset and the features once over the memory budget
+TEST_CASE("unit/dbn/mnist/143", "[dbn][store][unit]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 150, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<150, 200, dll::momentum, dll::batch_size<25>>::layer_t,
+            dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::layer_t>,
+        dll::memory_budget, dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(250);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->plan_memory(1UL << 30).resident());
+
+    dbn->memory_limit = dbn->estimate_memory().peak() + 1024;
+
+    REQUIRE(dbn->plan_memory(512).resident());
+    REQUIRE(dbn->plan_memory(250 * (28 * 28 + 10) * sizeof(float)).streaming());
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 5);
+
+    REQUIRE(error < 5e-2);
+
+    TEST_CHECK(0.25);
+}
+
+// Store the SVM model in the stream of the network and predict in batch
+TEST_CASE("unit/dbn/mnist/15", "[dbn][svm][store][unit]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::layer_t,
+            dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::layer_t>,
+        dll::batch_size<25>, dll::trainer<dll::cg_trainer>>::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(200);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 10);
+
+    REQUIRE(dbn->svm_train(dataset.training_images, dataset.training_labels));
+
+    std::stringstream buffer;
+    dbn->store(buffer);
+
+    auto loaded = std::make_unique<dbn_t>();
+    loaded->load(buffer);
+
+    REQUIRE(loaded->svm_loaded);
+
+    auto predictions = loaded->svm_predict_batch(dataset.training_images);
+
+    REQUIRE(predictions.size() == dataset.training_images.size());
+
+    for (size_t i = 0; i < predictions.size(); ++i) {
+        REQUIRE(predictions[i] == dbn->svm_predict(dataset.training_images[i]));
+    }
+}
@@ -49,3 +49,46 @@ TEST_CASE("dbn/ae/1", "[unit][rbm][dbn][mnist][sgd][ae]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+TEST_CASE("dbn/ae/shared_labels", "[unit][generator][mnist][ae]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto& images = dataset.training_images;
+
+    // Without noise, the label batches are the data batches
+
+    auto plain = dll::make_generator(images, images, images.size(), 10, dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::autoencoder>{});
+
+    REQUIRE(plain->shared_labels);
+    REQUIRE(etl::size(plain->label_cache) == 0);
+
+    plain->reset_shuffle();
+
+    REQUIRE(plain->has_next_batch());
+    REQUIRE(etl::dim<0>(plain->label_batch()) == 25);
+    REQUIRE(etl::sum(plain->label_batch() - plain->data_batch()) == 0.0f);
+
+    // With noise, the labels are the clean inputs of the noisy batch
+
+    auto noisy = dll::make_generator(images, images, images.size(), 10, dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::autoencoder, dll::noise<30>>{});
+
+    REQUIRE(noisy->shared_labels);
+    REQUIRE(etl::size(noisy->label_cache) == 0);
+
+    noisy->set_train();
+    noisy->reset();
+
+    REQUIRE(noisy->has_next_batch());
+
+    auto data   = noisy->data_batch();
+    auto labels = noisy->label_batch();
+
+    for (size_t i = 0; i < 25; ++i) {
+        REQUIRE(etl::sum(labels(i) - images[i]) == 0.0f);
+    }
+
+    REQUIRE(etl::sum(etl::abs(labels - data)) > 0.0f);
+}
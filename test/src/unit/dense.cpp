@@ -6,14 +6,22 @@
 //=======================================================================
 
 #include <deque>
+#include <thread>
 
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
+#include "dll/neural/tied_dense_layer.hpp"
 #include "dll/transform/shape_1d_layer.hpp"
 #include "dll/neural/activation_layer.hpp"
+#include "dll/neural/dropout_layer.hpp"
 #include "dll/dbn.hpp"
+#include "dll/trainer/sweep_trainer.hpp"
 #include "dll/datasets.hpp"
+#include "dll/batch_server.hpp"
+#include "dll/ensemble.hpp"
+#include "dll/util/model_registry.hpp"
+#include "dll/util/cce.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -310,3 +318,1815 @@ TEST_CASE("unit/dense/sgd/14", "[unit][dense][dbn][mnist][sgd]") {
     FT_CHECK(50, 5e-2);
     TEST_CHECK(0.2);
 }
+
+// Test the batching server against forward_one
+TEST_CASE("unit/dense/server/0", "[unit][dense][dbn][mnist][server]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(10, 0.2);
+
+    dll::batch_server<dbn_t> server(*dbn, 16, std::chrono::microseconds(500), 2);
+
+    std::vector<std::future<dll::batch_server<dbn_t>::output_one_t>> futures;
+
+    for (auto& image : dataset.test_images) {
+        futures.push_back(server.submit(image));
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        auto output   = futures[i].get();
+        auto expected = dbn->forward_one(dataset.test_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output[j] == Approx(expected[j]));
+        }
+    }
+}
+
+// Test the ensemble against the average and the votes of its members
+TEST_CASE("unit/dense/ensemble/0", "[unit][dense][dbn][mnist][server]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    std::vector<std::unique_ptr<dbn_t>> networks;
+    std::vector<const dbn_t*> members;
+
+    for (size_t j = 0; j < 3; ++j) {
+        networks.push_back(std::make_unique<dbn_t>());
+        networks.back()->fine_tune(dataset.training_images, dataset.training_labels, 2);
+        members.push_back(networks.back().get());
+    }
+
+    dll::dbn_ensemble<dbn_t> ensemble(members, 20);
+
+    REQUIRE(ensemble.size() == 3);
+    REQUIRE(ensemble.stacked);
+
+    // The batch is given in double, it is converted once for all the members
+    etl::dyn_matrix<double, 2> input(20, 28 * 28);
+    etl::dyn_matrix<float, 2> batch(20, 28 * 28);
+
+    for (size_t i = 0; i < 20; ++i) {
+        batch(i) = dataset.training_images[i];
+        input(i) = batch(i);
+    }
+
+    etl::dyn_matrix<float, 2> expected(20, 10);
+    expected = 0;
+
+    std::vector<std::vector<size_t>> counts(20, std::vector<size_t>(10, 0));
+
+    for (auto& network : networks) {
+        auto output = network->forward_batch(batch);
+
+        expected += output / 3.0f;
+
+        for (size_t i = 0; i < 20; ++i) {
+            ++counts[i][etl::max_index(output(i))];
+        }
+    }
+
+    auto average = ensemble.forward_batch(input);
+
+    for (size_t i = 0; i < 20; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(average(i, j) == Approx(expected(i, j)));
+        }
+    }
+
+    auto& votes = ensemble.vote(input);
+
+    REQUIRE(votes.size() == 20);
+
+    for (size_t i = 0; i < 20; ++i) {
+        REQUIRE(votes[i] == size_t(std::max_element(counts[i].begin(), counts[i].end()) - counts[i].begin()));
+    }
+}
+
+// Test the batching server with several lanes against forward_one
+TEST_CASE("unit/dense/server/1", "[unit][dense][dbn][mnist][server]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(10, 0.2);
+
+    dll::batch_server<dbn_t> server(*dbn, 16, std::chrono::microseconds(500), dll::server_devices{1, 2});
+
+    std::vector<std::future<dll::batch_server<dbn_t>::output_one_t>> futures;
+
+    for (auto& image : dataset.test_images) {
+        futures.push_back(server.submit(image));
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        auto output   = futures[i].get();
+        auto expected = dbn->forward_one(dataset.test_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(output[j] == Approx(expected[j]));
+        }
+    }
+
+    auto throughputs = server.throughputs();
+
+    REQUIRE(throughputs.size() == 3);
+    REQUIRE(*std::max_element(throughputs.begin(), throughputs.end()) > 0.0);
+
+    REQUIRE(dll::server_detail::lane_share(16, 0.0, 100.0) == 16);
+    REQUIRE(dll::server_detail::lane_share(16, 50.0, 100.0) == 8);
+    REQUIRE(dll::server_detail::lane_share(16, 1.0, 100.0) == 1);
+}
+
+// Test the asynchronous forward propagation against forward_batch
+TEST_CASE("unit/dense/async/0", "[unit][dense][dbn][mnist][async]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(10, 0.2);
+
+    etl::dyn_matrix<float, 2> batch(20, 28 * 28);
+
+    for (size_t i = 0; i < 20; ++i) {
+        batch(i) = dataset.test_images[i];
+    }
+
+    auto operation = dbn->forward_async(batch);
+    auto expired   = dbn->forward_async(batch, std::chrono::steady_clock::now() - std::chrono::seconds(1));
+
+    auto result = operation.get();
+
+    REQUIRE(result);
+    REQUIRE(result.status == dll::forward_status::DONE);
+
+    auto expected = etl::force_temporary(dbn->forward_batch(batch));
+
+    for (size_t i = 0; i < 20; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(result.output(i, j) == Approx(expected(i, j)));
+        }
+    }
+
+    REQUIRE(expired.get().status == dll::forward_status::EXPIRED);
+}
+
+TEST_CASE("unit/dense/quantize/0", "[unit][dense][dbn][mnist][quantize]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(10, 0.2);
+
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<10>, dll::categorical>;
+
+    auto generator = dll::make_generator(
+        dataset.test_images, dataset.test_labels,
+        dataset.test_images.size(), 10,
+        generator_t{});
+
+    auto float_error = dbn->evaluate_error(*generator);
+
+    dbn->quantize(*generator);
+
+    REQUIRE(dbn->is_quantized());
+
+    auto int8_error = dbn->evaluate_error(*generator);
+
+    std::cout << "float_error:" << float_error << " int8_error:" << int8_error << std::endl;
+    CHECK(int8_error < float_error + 0.05);
+
+    dbn->set_quantized(false);
+
+    REQUIRE(!dbn->is_quantized());
+    REQUIRE(dbn->evaluate_error(*generator) == Approx(float_error));
+}
+
+TEST_CASE("unit/dense/bf16/0", "[unit][dense][dbn][mnist][bf16]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::bf16_storage>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(10, 0.2);
+
+    std::stringstream buffer;
+    dbn->store(buffer);
+
+    // Half the size of the single precision weights
+    REQUIRE(buffer.str().size() == 2 * (28 * 28 * 100 + 100 + 100 * 10 + 10));
+
+    auto loaded = std::make_unique<dbn_t>();
+    loaded->load(buffer);
+
+    auto& w  = dbn->template layer_get<0>().w;
+    auto& lw = loaded->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(lw[i] == Approx(w[i]).epsilon(1e-2));
+    }
+
+    auto error = dbn->evaluate_error(dataset.test_images, dataset.test_labels);
+    REQUIRE(loaded->evaluate_error(dataset.test_images, dataset.test_labels) == Approx(error).epsilon(0.05));
+}
+
+TEST_CASE("unit/dense/model_file/1", "[unit][dense][dbn][model]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::batch_size<10>>::dbn_t other_dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->store("model_file_1.dllm"));
+    REQUIRE(dll::is_model_file("model_file_1.dllm"));
+
+    auto loaded = std::make_unique<dbn_t>();
+    REQUIRE(loaded->load("model_file_1.dllm"));
+
+    auto& w  = dbn->template layer_get<0>().w;
+    auto& lw = loaded->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(lw[i] == w[i]);
+    }
+
+    auto& b  = dbn->template layer_get<1>().b;
+    auto& lb = loaded->template layer_get<1>().b;
+
+    for (size_t i = 0; i < etl::size(b); ++i) {
+        REQUIRE(lb[i] == b[i]);
+    }
+
+    // A network with different layers is rejected
+    auto other = std::make_unique<other_dbn_t>();
+    REQUIRE(!other->load("model_file_1.dllm"));
+
+    // A corrupted tensor is rejected
+    {
+        dll::mapped_model_file model("model_file_1.dllm");
+        REQUIRE(model.valid());
+        REQUIRE(model.size() >= 2);
+        REQUIRE(model.entry(0).offset % 64 == 0);
+
+        std::fstream fs("model_file_1.dllm", std::fstream::in | std::fstream::out | std::fstream::binary);
+        fs.seekp(model.entry(1).offset);
+        fs.put(char(0x5A));
+        fs.put(char(0xA5));
+    }
+
+    REQUIRE(!loaded->load("model_file_1.dllm"));
+
+    std::remove("model_file_1.dllm");
+}
+
+TEST_CASE("unit/dense/model_registry/1", "[unit][dense][dbn][model]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto first  = std::make_unique<dbn_t>();
+    auto second = std::make_unique<dbn_t>();
+
+    REQUIRE(first->store("model_registry_1.dllm"));
+    REQUIRE(second->store("model_registry_2.dllm"));
+
+    dll::model_registry<dbn_t> registry;
+
+    // The same weights are only loaded once
+    REQUIRE(registry.load("a", "model_registry_1.dllm"));
+    REQUIRE(registry.load("b", "model_registry_1.dllm"));
+    REQUIRE(registry.size() == 2);
+    REQUIRE(registry.instances() == 1);
+    REQUIRE(registry.get("a") == registry.get("b"));
+
+    etl::fast_dyn_matrix<float, 28 * 28> input;
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    auto in_flight = registry.get("a");
+    auto expected  = etl::dyn_vector<float>(in_flight->forward_one(input));
+
+    // The reload does not change the version in use
+    REQUIRE(registry.load("a", "model_registry_2.dllm"));
+    REQUIRE(registry.get("a") != in_flight);
+    REQUIRE(registry.get("b") == in_flight);
+    REQUIRE(registry.instances() == 2);
+
+    auto output = etl::dyn_vector<float>(in_flight->forward_one(input));
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == expected[i]);
+    }
+
+    // A failed reload keeps the current version
+    REQUIRE(!registry.load("a", "model_registry_missing.dllm"));
+    REQUIRE(registry.get("a"));
+
+    REQUIRE(registry.remove("b"));
+    REQUIRE(!registry.get("b"));
+
+    in_flight.reset();
+
+    REQUIRE(registry.instances() == 1);
+
+    std::remove("model_registry_1.dllm");
+    std::remove("model_registry_2.dllm");
+}
+
+// Train online on a stream fed by another thread and publish snapshots
+TEST_CASE("unit/dense/stream/1", "[unit][dense][dbn][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    // The ring is much smaller than the stream
+    auto stream = dll::make_stream_generator<10, true>(64, 10, 28 * 28);
+
+    std::thread producer([&] {
+        for (size_t epoch = 0; epoch < 20; ++epoch) {
+            for (size_t i = 0; i < dataset.training_images.size(); ++i) {
+                stream->push(dataset.training_images[i], dataset.training_labels[i]);
+            }
+        }
+
+        stream->close();
+    });
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    dll::model_registry<dbn_t> registry;
+
+    size_t published = 0;
+
+    auto error = dbn->fine_tune_stream(*stream, 0, 250, [&](const dbn_t& net, size_t /*step*/) {
+        REQUIRE(registry.publish("online", net, "stream_1.dllm"));
+        ++published;
+    });
+
+    producer.join();
+
+    std::cout << "error:" << error << std::endl;
+
+    REQUIRE(stream->size() == 20 * 500);
+    REQUIRE(published == 4);
+    REQUIRE(registry.get("online"));
+    CHECK(error < 0.2);
+
+    auto test_error = dll::test_set(dbn, dataset.test_images, dataset.test_labels, dll::predictor());
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+
+    std::remove("stream_1.dllm");
+}
+
+TEST_CASE("unit/dense/sgd/plan", "[unit][dense][dbn][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200>::layer_t,
+            dll::dense_layer_desc<200, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    auto plan = trainer.memory_plan();
+
+    REQUIRE(plan.buffers.size() == 9);
+    REQUIRE(plan.total_size() == 10 * sizeof(float) * ((784 + 200 + 200) + (200 + 100 + 100) + (100 + 10 + 10)));
+    REQUIRE(plan.arena_size < plan.total_size());
+
+    // Buffers alive at the same time must never overlap
+    for (auto& a : plan.buffers) {
+        for (auto& b : plan.buffers) {
+            if (&a != &b && a.first <= b.last && b.first <= a.last) {
+                REQUIRE((a.offset + a.size <= b.offset || b.offset + b.size <= a.offset));
+            }
+        }
+    }
+}
+
+// The fused CCE kernel computes the same errors and metrics as ETL
+TEST_CASE("unit/dense/cce/fused", "[unit][dense][sgd]") {
+    etl::dyn_matrix<float, 2> x(8, 5);
+    x = etl::normal_generator(0.0, 1.0);
+
+    etl::dyn_matrix<float, 2> output(8, 5);
+    etl::dyn_matrix<float, 2> labels(6, 5);
+    etl::dyn_vector<float> indices(6);
+
+    for (size_t i = 0; i < 8; ++i) {
+        output(i) = etl::stable_softmax(x(i));
+    }
+
+    labels = 0;
+
+    for (size_t i = 0; i < 6; ++i) {
+        indices[i]             = (i * 3) % 5;
+        labels(i, (i * 3) % 5) = 1.0;
+    }
+
+    etl::dyn_matrix<float, 2> errors(8, 5);
+    errors = 1.0;
+
+    auto [misses, log_sum] = dll::cce_errors_metrics(errors, output, labels, 6);
+
+    auto soutput = etl::slice(output, 0, 6);
+
+    REQUIRE(log_sum == Approx(etl::ml::cce_loss(soutput, labels, 1.0)).epsilon(1e-4));
+    REQUIRE(misses / 6.0 == Approx(etl::ml::cce_error(soutput, labels, 1.0 / 6.0)));
+
+    for (size_t i = 0; i < 8; ++i) {
+        for (size_t j = 0; j < 5; ++j) {
+            REQUIRE(errors(i, j) == Approx(i < 6 ? labels(i, j) - output(i, j) : 0.0f));
+        }
+    }
+
+    // The sparse labels give the same results
+    etl::dyn_matrix<float, 2> sparse_errors(8, 5);
+
+    auto [sparse_misses, sparse_log_sum] = dll::cce_errors_metrics(sparse_errors, output, indices, 6);
+
+    REQUIRE(sparse_misses == misses);
+    REQUIRE(sparse_log_sum == Approx(log_sum));
+
+    for (size_t i = 0; i < etl::size(errors); ++i) {
+        REQUIRE(sparse_errors[i] == Approx(errors[i]));
+    }
+}
+
+// Test batches smaller than the capacity of the contexts
+TEST_CASE("unit/dense/sgd/partial", "[unit][dense][dbn][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28, 20>::layer_t,
+            dll::dense_layer_desc<20, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    for (size_t n : {1UL, 3UL, 10UL, 4UL}) {
+        etl::dyn_matrix<float, 2> inputs(n, 28);
+        inputs = etl::uniform_generator(-1.0, 1.0);
+
+        auto& outputs = trainer.template forward_batch_helper<false>(inputs);
+
+        for (size_t i = 0; i < n; ++i) {
+            auto expected = dbn->forward_one(etl::dyn_vector<float>(inputs(i)));
+
+            for (size_t j = 0; j < 10; ++j) {
+                REQUIRE(outputs(i, j) == Approx(expected[j]).epsilon(1e-4));
+            }
+        }
+
+        // The remaining samples of the contexts are cleared
+        for (size_t i = n; i < 10; ++i) {
+            REQUIRE(std::get<0>(trainer.full_context).second->input(i, 0) == 0.0f);
+        }
+    }
+}
+
+TEST_CASE("unit/dense/sgd/checkpointing", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dense_layer_desc<150, 100>::layer_t,
+            dll::dense_layer_desc<100, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>, dll::checkpointing<2>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/parallel", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>, dll::data_parallel<4>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/numa", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>, dll::data_parallel<4>, dll::numa>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+
+    // The copies of the nodes hold the trained weights
+    dll::sgd_trainer<dbn_t> trainer(*dbn);
+
+    REQUIRE(!trainer.node_networks.empty());
+    REQUIRE(trainer.node_replicas.back() == 4);
+    REQUIRE(trainer.node_networks[0]->template layer_get<1>().w(0, 0) == Approx(dbn->template layer_get<1>().w(0, 0)));
+}
+
+TEST_CASE("unit/dense/sgd/pipeline", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<20>, dll::data_parallel<4>, dll::pipeline_stages<2>>::dbn_t dbn_t;
+
+    // The schedules of the stages
+    auto gpipe = dll::pipeline_passes(dll::pipeline_schedule::GPIPE, 0, 2, 4);
+    auto ofob  = dll::pipeline_passes(dll::pipeline_schedule::ONE_F_ONE_B, 0, 2, 4);
+
+    REQUIRE(gpipe.size() == 8);
+    REQUIRE(gpipe[3].forward);
+    REQUIRE(!gpipe[4].forward);
+    REQUIRE(ofob[1].forward);
+    REQUIRE(!ofob[2].forward);
+    REQUIRE(ofob[2].micro == 0);
+
+    // The partition balances the parameters
+    REQUIRE(dll::balance_stages({100, 1, 1}, 2) == std::vector<size_t>({0, 1, 3}));
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+
+    // An explicit partition with the GPipe schedule
+    dbn->pipeline_partition = {2};
+    dbn->pipeline           = dll::pipeline_schedule::GPIPE;
+
+    FT_CHECK(5, 0.2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dense/sgd/async", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::async_sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+}
+
+TEST_CASE("unit/dense/lbfgs/0", "[unit][dense][dbn][mnist][lbfgs]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 30>::layer_t,
+            dll::dense_layer_desc<30, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::lbfgs_trainer>, dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(300);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // Each epoch is one iteration of L-BFGS, which never increases the loss
+    auto before = dbn->evaluate_error(dataset.training_images, dataset.training_labels);
+
+    auto after = dbn->fine_tune(dataset.training_images, dataset.training_labels, 30);
+
+    REQUIRE(after < before);
+    REQUIRE(after < 0.3);
+
+    TEST_CHECK(0.4);
+}
+
+TEST_CASE("unit/dense/sgd/distributed", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(400);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    constexpr size_t ranks = 2;
+
+    dll::local_group group(ranks);
+
+    std::vector<std::unique_ptr<dbn_t>> dbns;
+    std::vector<double> errors(ranks);
+
+    for (size_t r = 0; r < ranks; ++r) {
+        dbns.push_back(std::make_unique<dbn_t>());
+        dbns.back()->comm = &group.get(r);
+    }
+
+    std::vector<std::thread> threads;
+
+    for (size_t r = 0; r < ranks; ++r) {
+        threads.emplace_back([&, r] {
+            // Each rank trains on its own shard of the dataset
+            const size_t shard = dataset.training_images.size() / ranks;
+
+            std::vector<etl::fast_dyn_matrix<float, 28 * 28>> images(dataset.training_images.begin() + r * shard, dataset.training_images.begin() + (r + 1) * shard);
+            std::vector<uint8_t> labels(dataset.training_labels.begin() + r * shard, dataset.training_labels.begin() + (r + 1) * shard);
+
+            errors[r] = dbns[r]->fine_tune(images, labels, 25);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // The error is aggregated over all the ranks
+    REQUIRE(errors[0] == Approx(errors[1]));
+    CHECK(errors[0] < 0.2);
+
+    // All the ranks have the same weights
+    auto& w0 = dbns[0]->template layer_get<0>().w;
+    auto& w1 = dbns[1]->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(w0); ++i) {
+        REQUIRE(w0[i] == Approx(w1[i]));
+    }
+}
+
+TEST_CASE("unit/dense/sgd/sparse_labels", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    // Without categorical, the labels are the indices of the classes
+    using generator_t = dll::inmemory_data_generator_desc<dll::batch_size<10>>;
+
+    auto generator = dll::make_generator(
+        dataset.training_images, dataset.training_labels,
+        dataset.training_images.size(), 10,
+        generator_t{});
+
+    REQUIRE(etl::dimensions(generator->label_batch()) == 1);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*generator, 25);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 0.2);
+
+    TEST_CHECK(0.3);
+}
+
+// Test Sigmoid network with sparse inputs
+TEST_CASE("unit/dense/sgd/sparse_input", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 10, dll::softmax, dll::sparse_input>::layer_t>,
+        dll::batch_size<20>
+    >::dbn_t;
+
+    // Load the dataset
+    auto dataset = dll::make_mnist_dataset_sub(0, 1000, dll::binarize_pre<30>{}, dll::batch_size<20>{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.03;
+
+    FT_CHECK_DATASET(50, 5e-2);
+    TEST_CHECK_DATASET(0.3);
+}
+
+// Test the fused updater, with decay and clipping
+TEST_CASE("unit/dense/sgd/fused", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::weight_decay<>, dll::clip_gradients, dll::fused_updater,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the fused updater, with the gradients clipped by their global norm
+TEST_CASE("unit/dense/sgd/global_clip", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::weight_decay<>, dll::clip_gradients, dll::clip_global_norm, dll::fused_updater,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+    dbn->gradient_clip = 1.0;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the backup of the weights in a flat buffer
+TEST_CASE("unit/dense/sgd/flat", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::flat_parameters, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->parameters_size() == 28 * 28 * 100 + 100 + 100 * 10 + 10);
+
+    dbn->backup_weights();
+
+    etl::dyn_matrix<float, 2> w = dbn->template layer_get<0>().w;
+
+    dbn->template layer_get<0>().w = 0.0;
+    dbn->template layer_get<1>().b = 0.0;
+
+    dbn->restore_weights();
+
+    REQUIRE(etl::sum(dbn->template layer_get<0>().w - w) == 0.0);
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the asynchronous backup of the weights, with early stopping
+TEST_CASE("unit/dense/sgd/backup", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::early_stopping<dll::strategy::ERROR_BEST>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->backup_weights_async();
+
+    etl::dyn_matrix<float, 2> w = dbn->template layer_get<0>().w;
+
+    dbn->wait_backup();
+
+    dbn->template layer_get<0>().w = 0.0;
+    dbn->template layer_get<1>().b = 0.0;
+
+    dbn->restore_weights();
+
+    REQUIRE(etl::sum(dbn->template layer_get<0>().w - w) == 0.0);
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the updates overlapped with the backward pass
+TEST_CASE("unit/dense/sgd/overlap", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 150>::layer_t,
+            dll::dense_layer_desc<150, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::overlap_updates, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(25, 0.2);
+    TEST_CHECK(0.3);
+}
+
+// Test the accumulation of the gradients of several batches
+TEST_CASE("unit/dense/sgd/accumulate", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::accumulate_gradients<4>, dll::trainer<dll::sgd_trainer>, dll::batch_size<5>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the periodic finite checks of SGD
+TEST_CASE("unit/dense/sgd/check_finite", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::check_finite<2>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the fine-tuning of the top layers only, the first layers being frozen
+TEST_CASE("unit/dense/sgd/freeze", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::freeze_layers<2>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    etl::dyn_matrix<float, 2> w_0 = dbn->template layer_get<0>().w;
+    etl::dyn_matrix<float, 2> w_1 = dbn->template layer_get<1>().w;
+
+    FT_CHECK(50, 0.2);
+    TEST_CHECK(0.4);
+
+    // The frozen layers are not modified
+    REQUIRE(w_0 == dbn->template layer_get<0>().w);
+    REQUIRE(w_1 == dbn->template layer_get<1>().w);
+}
+
+// Test the fine-tuning of the top layers from the cached features of the frozen layers
+TEST_CASE("unit/dense/sgd/trunk_cache", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::freeze_layers<1>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+    dbn->cache_trunk   = true;
+    dbn->compact_trunk = true;
+
+    etl::dyn_matrix<float, 2> w = dbn->template layer_get<0>().w;
+
+    FT_CHECK(50, 0.2);
+    TEST_CHECK(0.4);
+
+    // The frozen layer is not modified
+    REQUIRE(w == dbn->template layer_get<0>().w);
+}
+
+// Test the LARS updater
+TEST_CASE("unit/dense/sgd/lars", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::lars, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 1.0;
+    dbn->lars_eta      = 0.02;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the LAMB updater, with the fused kernels
+TEST_CASE("unit/dense/sgd/lamb", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::lamb, dll::fused_updater, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.01;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the schedule of the learning rate
+TEST_CASE("unit/dense/sgd/schedule", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate   = 0.1;
+    dbn->schedule.type   = dll::lr_schedule_type::COSINE;
+    dbn->schedule.warmup = 35;
+
+    REQUIRE(dbn->schedule.factor(0, 1000) == Approx(0.0));
+    REQUIRE(dbn->schedule.factor(35, 1000) == Approx(1.0));
+    REQUIRE(dbn->schedule.factor(1000, 1000) == Approx(0.0).margin(1e-6));
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+
+    // The base learning rate is restored after the training
+    REQUIRE(dbn->learning_rate == Approx(0.1));
+}
+
+// Test mixed precision training with dynamic loss scaling
+TEST_CASE("unit/dense/sgd/mixed", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::mixed_precision, dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate       = 0.1;
+    dbn->loss_scale_interval = 50;
+
+    FT_CHECK(50, 5e-2);
+    TEST_CHECK(0.3);
+}
+
+// Test the moving average of the weights
+TEST_CASE("unit/dense/sgd/ema", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::ema_weights, dll::fused_updater, dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+    dbn->ema_decay     = 0.99;
+
+    FT_CHECK(50, 5e-2);
+
+    REQUIRE(dbn->ema.size() == dbn->parameters_size());
+
+    dbn->swap_ema_weights();
+
+    TEST_CHECK(0.3);
+
+    // Swap back the trained weights
+    dbn->swap_ema_weights();
+
+    TEST_CHECK(0.3);
+}
+
+// Test the background checkpoints and the resume of the training
+TEST_CASE("unit/dense/sgd/resume", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate      = 0.001;
+    dbn->checkpoint_file    = "sgd_resume.dllc";
+    dbn->checkpoint_batches = 10;
+
+    FT_CHECK(10, 0.2);
+
+    // The checkpoint of the last epoch: nothing left to train
+    auto resumed = std::make_unique<dbn_t>();
+
+    resumed->learning_rate   = 0.001;
+    resumed->checkpoint_file = "sgd_resume.dllc";
+    resumed->resume          = true;
+
+    resumed->fine_tune(dataset.training_images, dataset.training_labels, 10);
+
+    auto& w  = dbn->template layer_get<0>().w;
+    auto& rw = resumed->template layer_get<0>().w;
+
+    for (size_t i = 0; i < etl::size(w); ++i) {
+        REQUIRE(rw[i] == w[i]);
+    }
+
+    // Continue the training, with the state of the updater
+    auto error = resumed->fine_tune(dataset.training_images, dataset.training_labels, 15);
+
+    CHECK(error < 0.1);
+
+    std::remove("sgd_resume.dllc");
+}
+
+// Test the training of several replicas in a single sweep
+TEST_CASE("unit/dense/sgd/sweep", "[unit][dense][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<10>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    std::vector<std::unique_ptr<dbn_t>> dbns;
+    std::vector<dbn_t*> replicas;
+
+    for (size_t i = 0; i < 4; ++i) {
+        dbns.push_back(std::make_unique<dbn_t>());
+        dbns.back()->learning_rate = 0.05 * (i + 1);
+        replicas.push_back(dbns.back().get());
+    }
+
+    dll::sweep_trainer<dbn_t> sweep(replicas);
+
+    auto errors = sweep.train(dataset.training_images, dataset.training_labels, 50);
+
+    REQUIRE(errors.size() == 4);
+
+    for (auto& dbn : dbns) {
+        CHECK(errors[&dbn - &dbns[0]] < 5e-2);
+        TEST_CHECK(0.3);
+    }
+}
+
+// Test the in-place transform layers (training, session and collections)
+TEST_CASE("unit/dense/inplace/0", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::shape_1d_layer_desc<28 * 28>::layer_t,
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SIGMOID>::layer_t,
+            dll::dropout_layer_desc<20>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::SOFTMAX>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 0.1);
+    TEST_CHECK(0.3);
+
+    etl::fast_dyn_matrix<float, 25, 28 * 28> batch;
+
+    for (size_t i = 0; i < 25; ++i) {
+        batch(i) = dataset.test_images[i];
+    }
+
+    auto expected = dbn->forward_batch(batch);
+
+    // The activations are fused into the dense layers
+    REQUIRE(dll::session_detail::fuses_next<dbn_t, 1>());
+    REQUIRE(dll::session_detail::fuses_next<dbn_t, 4>());
+    REQUIRE(!dll::session_detail::fuses_next<dbn_t, 2>());
+    REQUIRE(!dll::session_detail::needs_buffer<dbn_t, 1>());
+    REQUIRE(dll::session_detail::needs_buffer<dbn_t, 2>());
+
+    // The session fuses the activations and applies the dropout in-place
+    auto session = dbn->make_inference_session(25);
+    auto session_output = session.forward_batch(batch);
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(session_output[i] == Approx(expected[i]).epsilon(1e-3));
+    }
+
+    // The collections reuse the outputs of the previous layers
+    std::vector<etl::fast_dyn_matrix<float, 28 * 28>> samples(dataset.test_images.begin(), dataset.test_images.begin() + 25);
+
+    auto outputs = dbn->forward_many(samples);
+
+    REQUIRE(outputs.size() == 25);
+
+    for (size_t i = 0; i < 25; ++i) {
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(outputs[i][j] == Approx(expected(i, j)).epsilon(1e-3));
+        }
+    }
+}
+
+// Test the single-sample sessions of forward_one
+TEST_CASE("unit/dense/one/0", "[unit][dense][dbn][mnist][sgd]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100, dll::no_activation>::layer_t,
+            dll::activation_layer_desc<dll::function::RELU>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(25, 0.1);
+    TEST_CHECK(0.3);
+
+    // The pooled session is reused by the next calls, even after training
+    for (size_t t = 0; t < 2; ++t) {
+        for (size_t i = 0; i < 10; ++i) {
+            auto expected = dbn->test_forward_one(dataset.test_images[i]);
+            auto output   = dbn->forward_one(dataset.test_images[i]);
+
+            for (size_t j = 0; j < 10; ++j) {
+                REQUIRE(output[j] == Approx(expected[j]).epsilon(1e-3));
+            }
+        }
+
+        dbn->fine_tune(dataset.training_images, dataset.training_labels, 1);
+    }
+}
+
+// Test the concatenated outputs of all the layers, per sample and in batch
+TEST_CASE("unit/dense/full/0", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->full_output_size() == 60);
+
+    etl::fast_dyn_matrix<float, 7, 28 * 28> batch;
+
+    for (size_t i = 0; i < 7; ++i) {
+        batch(i) = dataset.training_images[i];
+    }
+
+    etl::dyn_matrix<float, 2> features(7, 60);
+
+    dbn->full_activation_probabilities_batch(batch, features);
+
+    for (size_t i = 0; i < 7; ++i) {
+        auto expected = dbn->full_activation_probabilities(dataset.training_images[i]);
+
+        for (size_t j = 0; j < 60; ++j) {
+            REQUIRE(features(i, j) == Approx(expected[j]).epsilon(1e-4));
+        }
+    }
+}
+
+// Test the accounting and the estimation of the memory
+TEST_CASE("unit/dense/memory/0", "[unit][dense][dbn][memory]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<100, 50>::layer_t,
+            dll::dense_layer_desc<50, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::ADAM>, dll::batch_size<10>
+    >::dbn_t;
+
+    const size_t before = dll::memory_current(dll::memory_subsystem::WEIGHTS);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    const size_t weights_0 = (100 * 50 + 50) * sizeof(float);
+    const size_t weights_1 = (50 * 10 + 10) * sizeof(float);
+
+    REQUIRE(dll::memory_current(dll::memory_subsystem::WEIGHTS) == before + weights_0 + weights_1);
+    REQUIRE(dll::memory_peak(dll::memory_subsystem::WEIGHTS) >= before + weights_0 + weights_1);
+
+    auto estimate = dbn->estimate_memory();
+
+    REQUIRE(estimate.complete());
+    REQUIRE(estimate.layers.size() == 2);
+    REQUIRE(estimate.layers[0].weights == weights_0);
+    REQUIRE(estimate.layers[0].gradients == weights_0);
+    REQUIRE(estimate.layers[0].optimizer == 2 * weights_0);
+    REQUIRE(estimate.layers[0].activations == 10 * (100 + 2 * 50) * sizeof(float));
+    REQUIRE(estimate.inference() == weights_0 + weights_1);
+    REQUIRE(estimate.peak() == estimate.layers[0].total() + estimate.layers[1].total());
+
+    dbn.reset();
+
+    REQUIRE(dll::memory_current(dll::memory_subsystem::WEIGHTS) == before);
+}
+
+// Test the forward propagation of STL samples
+TEST_CASE("unit/dense/stl/0", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    FT_CHECK(10, 0.1);
+
+    std::vector<std::vector<float>> float_samples;
+    std::vector<std::deque<double>> double_samples;
+
+    for (size_t i = 0; i < 25; ++i) {
+        auto& image = dataset.test_images[i];
+
+        float_samples.emplace_back(image.begin(), image.end());
+        double_samples.emplace_back(image.begin(), image.end());
+    }
+
+    // The vectors of floats are viewed and the deques are converted
+    for (size_t i = 0; i < 25; ++i) {
+        auto expected = dbn->forward_one(dataset.test_images[i]);
+
+        auto viewed    = dbn->forward_one(float_samples[i]);
+        auto converted = dbn->forward_one(double_samples[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(viewed[j] == Approx(expected[j]));
+            REQUIRE(converted[j] == Approx(expected[j]));
+        }
+
+        REQUIRE(dbn->predict(float_samples[i]) == dbn->predict(dataset.test_images[i]));
+    }
+
+    // The ranges are converted once into a single batch
+    auto batch = dll::convert_batch(dbn->layer_get<0>(), double_samples.begin(), double_samples.end());
+
+    REQUIRE(etl::dim<0>(batch) == 25);
+    REQUIRE(etl::dim<1>(batch) == 28 * 28);
+
+    for (size_t i = 0; i < 25; ++i) {
+        for (size_t j = 0; j < 28 * 28; ++j) {
+            REQUIRE(batch(i, j) == dataset.test_images[i][j]);
+        }
+    }
+
+    auto outputs = dbn->forward_range(float_samples.begin(), float_samples.end());
+
+    for (size_t i = 0; i < 25; ++i) {
+        auto expected = dbn->forward_one(dataset.test_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(outputs(i, j) == Approx(expected[j]));
+        }
+    }
+}
+
+// Top-k and early-exit predictions
+TEST_CASE("unit/dense/exit/0", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 25);
+
+    auto batch = dll::convert_batch(dbn->layer_get<0>(), dataset.training_images.begin(), dataset.training_images.begin() + 100);
+
+    auto topk = dbn->predict_topk(batch, 3);
+
+    REQUIRE(topk.size() == 100);
+
+    for (size_t i = 0; i < 100; ++i) {
+        auto output = dbn->forward_one(dataset.training_images[i]);
+
+        REQUIRE(topk[i].size() == 3);
+        REQUIRE(topk[i][0] == dbn->predict(dataset.training_images[i]));
+        REQUIRE(output[topk[i][0]] >= output[topk[i][1]]);
+        REQUIRE(output[topk[i][1]] >= output[topk[i][2]]);
+    }
+
+    // No sample is confident enough to exit
+    dbn->fit_exit_head<0>(dataset.training_images, dataset.training_labels, 10, 2.0, 50);
+
+    auto full = dbn->predict_early_exit(batch);
+
+    for (size_t i = 0; i < 100; ++i) {
+        REQUIRE(full[i] == topk[i][0]);
+    }
+
+    // Most samples exit at the head
+    dbn->exit_heads.front().threshold = 0.5;
+
+    auto early = dbn->predict_early_exit(batch);
+
+    size_t errors = 0;
+
+    for (size_t i = 0; i < 100; ++i) {
+        REQUIRE(early[i] < 10);
+
+        if (early[i] != dataset.training_labels[i]) {
+            ++errors;
+        }
+    }
+
+    std::cout << "early_exit_error:" << errors / 100.0 << std::endl;
+    REQUIRE(errors < 30);
+}
+
+// Structured pruning during fine-tuning, compaction and block-sparse weights
+TEST_CASE("unit/dense/prune/0", "[unit][dense][dbn][mnist][prune]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    using compact_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_dense_layer_desc<>::layer_t,
+            dll::dyn_dense_layer_desc<dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    dbn->pruning.ratio = 0.5;
+    dbn->pruning.start = 2;
+    dbn->pruning.end   = 6;
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 10);
+    std::cout << "pruned_error:" << error << std::endl;
+    REQUIRE(error < 0.2);
+
+    // The output layer is never pruned
+    REQUIRE(dll::kept_units(dbn->layer_get<0>()).size() == 50);
+    REQUIRE(dll::kept_units(dbn->layer_get<1>()).size() == 10);
+
+    auto compact = std::make_unique<compact_t>();
+
+    dbn->compact(*compact);
+
+    REQUIRE(dll::input_size(compact->layer_get<0>()) == 28 * 28);
+    REQUIRE(dll::output_size(compact->layer_get<0>()) == 50);
+    REQUIRE(dll::input_size(compact->layer_get<1>()) == 50);
+
+    auto batch = dll::convert_batch(dbn->layer_get<0>(), dataset.training_images.begin(), dataset.training_images.begin() + 25);
+
+    auto expected = etl::force_temporary(dbn->forward_batch(batch));
+    auto compacted = etl::force_temporary(compact->forward_batch(batch));
+
+    for (size_t i = 0; i < etl::size(expected); ++i) {
+        REQUIRE(compacted[i] == Approx(expected[i]));
+    }
+
+    // Unstructured pruning of the blocks of the weights
+    dbn->prune_weight_blocks(0.75);
+    dbn->sparsify(0.3);
+
+    REQUIRE(dbn->layer_get<0>().block_sparse);
+    REQUIRE(dbn->layer_get<0>().block_sparse->density() <= 0.3);
+
+    auto sparse = etl::force_temporary(dbn->forward_batch(batch));
+
+    dbn->set_block_sparse(false);
+
+    auto dense = etl::force_temporary(dbn->forward_batch(batch));
+
+    for (size_t i = 0; i < etl::size(dense); ++i) {
+        REQUIRE(sparse[i] == Approx(dense[i]));
+    }
+}
+
+// Low-rank factorization of a dense layer into two dense layers
+TEST_CASE("unit/dense/low_rank/0", "[unit][dense][dbn][mnist][low_rank]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 200>::layer_t,
+            dll::dense_layer_desc<200, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    using low_rank_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dyn_dense_layer_desc<dll::no_activation>::layer_t,
+            dll::dyn_dense_layer_desc<>::layer_t,
+            dll::dyn_dense_layer_desc<dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.1;
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 10);
+    REQUIRE(error < 0.2);
+
+    auto net = std::make_unique<low_rank_t>();
+
+    net->learning_rate = 0.05;
+
+    dll::low_rank_budget budget;
+    budget.energy   = 0.95;
+    budget.max_cost = 0.5;
+
+    auto ranks = dbn->low_rank<0>(*net, budget, dataset.training_images, dataset.training_labels, 2);
+
+    REQUIRE(ranks.size() == 1);
+    REQUIRE(ranks[0] >= 1);
+    REQUIRE(ranks[0] <= budget.max_rank(28 * 28, 200));
+
+    REQUIRE(dll::output_size(net->layer_get<0>()) == ranks[0]);
+    REQUIRE(dll::input_size(net->layer_get<1>()) == ranks[0]);
+    REQUIRE(dll::output_size(net->layer_get<2>()) == 10);
+
+    auto low_rank_error = net->evaluate_error(dataset.training_images, dataset.training_labels);
+    std::cout << "low_rank_error:" << low_rank_error << std::endl;
+    REQUIRE(low_rank_error < 0.25);
+}
+
+// Cache of the features of the inputs already seen
+TEST_CASE("unit/dense/feature_cache/0", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::dense_layer_desc<100, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    dbn->enable_feature_cache(1024 * 1024, 4);
+
+    std::vector<etl::dyn_matrix<float, 1>> first;
+
+    for (size_t i = 0; i < 10; ++i) {
+        first.push_back(dbn->features(dataset.training_images[i]));
+    }
+
+    REQUIRE(dbn->features_cache->misses == 10);
+    REQUIRE(dbn->features_cache->size() == 10);
+
+    for (size_t i = 0; i < 10; ++i) {
+        auto cached   = dbn->features(dataset.training_images[i]);
+        auto expected = dbn->forward_one(dataset.training_images[i]);
+
+        for (size_t j = 0; j < 10; ++j) {
+            REQUIRE(cached[j] == Approx(expected[j]));
+            REQUIRE(cached[j] == first[i][j]);
+        }
+    }
+
+    REQUIRE(dbn->features_cache->hits == 10);
+
+    // A new version of the model does not use the previous features
+    ++dbn->model_version;
+
+    dbn->features(dataset.training_images[0]);
+
+    REQUIRE(dbn->features_cache->misses == 11);
+
+    // The memory limit is respected
+    dbn->enable_feature_cache(4096, 1);
+
+    for (size_t i = 0; i < 100; ++i) {
+        dbn->features(dataset.training_images[i]);
+    }
+
+    REQUIRE(dbn->features_cache->memory() <= 4096);
+    REQUIRE(dbn->features_cache->size() < 100);
+}
+
+TEST_CASE("unit/dense/ann/0", "[unit][dense][dbn][mnist]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 64>::layer_t,
+            dll::dense_layer_desc<64, 10, dll::softmax>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<25>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->fine_tune(dataset.training_images, dataset.training_labels, 2);
+
+    dll::ann_config config;
+    config.lists     = 8;
+    config.subspaces = 8;
+    config.codewords = 64;
+    config.probes    = 4;
+
+    auto index = dbn->build_ann_index<0>(dataset.training_images, config);
+
+    REQUIRE(index.size() == dataset.training_images.size());
+    REQUIRE(index.dimension == 64);
+
+    // Most of the samples find themselves among their nearest neighbours
+    size_t found = 0;
+
+    for (size_t i = 0; i < 100; ++i) {
+        auto neighbours = dbn->ann_search<0>(index, dataset.training_images[i], 10);
+
+        REQUIRE(neighbours.size() == 10);
+
+        for (auto& n : neighbours) {
+            found += n.first == i;
+        }
+    }
+
+    REQUIRE(found >= 80);
+
+    // The index is stored next to the network
+    REQUIRE(dbn->store("ann.dat", index));
+
+    auto dbn_2 = std::make_unique<dbn_t>();
+    dll::ann_index<float> index_2;
+
+    REQUIRE(dbn_2->load("ann.dat", index_2));
+    REQUIRE(index_2.size() == index.size());
+
+    auto a = dbn->ann_search<0>(index, dataset.training_images[0], 5);
+    auto b = dbn_2->ann_search<0>(index_2, dataset.training_images[0], 5);
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        REQUIRE(a[i].first == b[i].first);
+        REQUIRE(a[i].second == Approx(b[i].second));
+    }
+
+    // The network alone can still be loaded
+    auto dbn_3 = std::make_unique<dbn_t>();
+    REQUIRE(dbn_3->load("ann.dat"));
+}
+
+TEST_CASE("unit/dense/tied/0", "[unit][dense][dbn][mnist][sgd][ae]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 100>::layer_t,
+            dll::tied_dense_layer_desc<100, 28 * 28, 0>::layer_t>,
+        dll::trainer<dll::sgd_trainer>, dll::batch_size<10>
+    >::dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 28 * 28>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    dll_test::mnist_scale(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // The decoder only owns its biases
+    REQUIRE(dbn->template layer_get<1>().w == &dbn->template layer_get<0>().w);
+    REQUIRE(dbn_t::layer_type<1>::parameters() == 28 * 28);
+
+    etl::fast_matrix<float, 28 * 28, 100> w_0;
+    w_0 = dbn->template layer_get<0>().w;
+
+    dbn->learning_rate = 0.1;
+
+    auto ft_error = dbn->fine_tune_ae(dataset.training_images, 25);
+    std::cout << "ft_error:" << ft_error << std::endl;
+
+    CHECK(ft_error < 5e-2);
+
+    // The shared weights have been trained by both layers
+    REQUIRE(etl::sum(etl::abs(dbn->template layer_get<0>().w - w_0)) > 0.0f);
+
+    auto test_error = dll::test_set_ae(*dbn, dataset.test_images);
+    std::cout << "test_error:" << test_error << std::endl;
+    REQUIRE(test_error < 0.1);
+}
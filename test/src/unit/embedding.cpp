@@ -12,6 +12,7 @@
 #include "cpp_utils/tuple_utils.hpp"
 
 #include "dll/neural/embedding_layer.hpp"
+#include "dll/neural/hashed_embedding_layer.hpp"
 #include "dll/neural/conv_layer.hpp"
 #include "dll/pooling/mp_layer.hpp"
 #include "dll/neural/dense_layer.hpp"
@@ -142,3 +143,223 @@ TEST_CASE("unit/embedding/2", "[unit][embedding]") {
     REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
     REQUIRE(net->evaluate_error(samples, labels) < 5e-2);
 }
+
+// Simple embedding with sparse gradients (lazy ADAM)
+TEST_CASE("unit/embedding/3", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding, dll::sparse_gradients>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam (lazy on the embeddings)
+        , dll::batch_size<50>                        // The mini-batch size
+        , dll::shuffle                               // Shuffle before each epoch
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
+
+// Three group CNN with concurrent branches
+TEST_CASE("unit/embedding/4", "[unit][embedding]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 16;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>
+            , dll::merge_layer<
+                0
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 3, embedding>
+                    , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 4, embedding>
+                    , dll::mp_2d_layer<16, length - 4 + 1, 1, length - 4 + 1, 1>
+                >
+                , dll::group_layer<
+                      dll::conv_layer<1, length, embedding, 16, 5, embedding>
+                    , dll::mp_2d_layer<16, length - 5 + 1, 1, length - 5 + 1, 1>
+                >
+            >
+            , dll::dense_layer<48, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<50>
+        , dll::shuffle
+        , dll::threads<4>                            // Branches run concurrently
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+
+    const double error = net->evaluate_error(samples, labels);
+
+    REQUIRE(error < 5e-2);
+
+    // The serial branches must give the same results
+    dll::thread_limit() = 1;
+    REQUIRE(net->evaluate_error(samples, labels) == Approx(error));
+    dll::thread_limit() = 0;
+}
+
+// Quantized embedding tables for inference
+TEST_CASE("unit/embedding/5", "[unit][embedding][quantize]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<50>
+        , dll::shuffle
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+
+    const double error = net->evaluate_error(samples, labels);
+
+    net->quantize_embeddings(8);
+
+    REQUIRE(net->is_quantized());
+    REQUIRE(net->template layer_get<0>().quantized_table->memory() < 26 * embedding * sizeof(float));
+    REQUIRE(net->evaluate_error(samples, labels) < error + 0.05);
+
+    net->quantize_embeddings(4);
+
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+
+    const double quantized_error = net->evaluate_error(samples, labels);
+
+    // The quantized table is stored in the model file
+    REQUIRE(net->store("/tmp/dll_embedding_5.dllm"));
+
+    auto loaded = std::make_unique<embedding_network_t>();
+
+    REQUIRE(loaded->load("/tmp/dll_embedding_5.dllm"));
+    REQUIRE(loaded->is_quantized());
+    REQUIRE(loaded->template layer_get<0>().quantized_table->bits == 4);
+    REQUIRE(loaded->evaluate_error(samples, labels) == Approx(quantized_error));
+
+    loaded->set_quantized(false);
+
+    REQUIRE(!loaded->is_quantized());
+    REQUIRE(loaded->evaluate_error(samples, labels) == Approx(error));
+}
+
+// Hashed embedding of large token ids into a small shared table
+TEST_CASE("unit/embedding/6", "[unit][embedding][hashed]") {
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    // The ids of the tokens are spread over a large vocabulary
+    for (auto& sample : samples) {
+        sample = sample * 7919.0f + 100000.0f;
+    }
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::hashed_embedding_layer<64, length, embedding, 2, dll::sparse_gradients>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::NADAM>
+        , dll::batch_size<50>
+        , dll::shuffle
+    >::network_t;
+
+    using layer_t = embedding_network_t::layer_type<0>;
+
+    REQUIRE(layer_t::parameters() == 64 * embedding);
+    REQUIRE(layer_t::bucket(123456789012UL, 0) < 64);
+    REQUIRE(layer_t::bucket(123456789012UL, 0) == layer_t::bucket(123456789012UL, 0));
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 0.1);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
+
+// Embedding with sparse gradients and lazy decoupled weight decay
+TEST_CASE("unit/embedding/7", "[unit][embedding][decay]") {
+    // The pending decay of the steps is folded into the rows on demand
+    dll::lazy_row_decay decay;
+    decay.resize(2);
+
+    decay.step(0.0, 0.5);
+    decay.step(0.0, 0.5);
+
+    std::vector<float> rows{4.0f, -8.0f, 2.0f, 2.0f};
+
+    decay.apply(rows.data(), 2, 0);
+
+    REQUIRE(rows[0] == Approx(1.0f));
+    REQUIRE(rows[1] == Approx(-2.0f));
+    REQUIRE(rows[2] == Approx(2.0f));
+
+    // The L1 shrinkage stops at zero
+    decay.step(1.5, 0.0);
+    decay.apply(rows.data(), 2, 0);
+
+    REQUIRE(rows[0] == Approx(0.0f));
+    REQUIRE(rows[1] == Approx(-0.5f));
+
+    decay.apply(rows.data() + 2, 2, 1);
+
+    REQUIRE(rows[2] == Approx(0.0f));
+    REQUIRE(rows[3] == Approx(0.0f));
+
+    std::vector<size_t> labels;
+    auto samples = generate_samples(labels);
+
+    constexpr size_t embedding = 8;
+    constexpr size_t length = 15;
+
+    using embedding_network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::embedding_layer<26, length, embedding, dll::sparse_gradients>,
+              dll::conv_layer<1, length, embedding, 16, 3, embedding>
+            , dll::mp_2d_layer<16, length - 3 + 1, 1, length - 3 + 1, 1>
+            , dll::dense_layer<16, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam (lazy on the embeddings)
+        , dll::weight_decay<dll::decay_type::L2>     // Decoupled on the embeddings
+        , dll::lazy_decay                            // Only on the touched rows
+        , dll::batch_size<50>
+        , dll::shuffle
+    >::network_t;
+
+    auto net = std::make_unique<embedding_network_t>();
+
+    REQUIRE(net->fine_tune(samples, labels, 50) < 5e-2);
+    REQUIRE(net->evaluate_error(samples, labels) < 0.25);
+}
@@ -0,0 +1,187 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "dll_test.hpp"
+
+#include "dll/neural/conv_same_layer.hpp"
+#include "dll/neural/grouped_conv_layer.hpp"
+#include "dll/neural/separable_conv_layer.hpp"
+#include "dll/neural/dense_layer.hpp"
+#include "dll/pooling/mp_layer.hpp"
+#include "dll/dbn.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+namespace {
+
+/*!
+ * \brief Compute the grouped correlation ('same' padding) of a batch with
+ * the given filters, directly from the definition
+ */
+template <typename W, typename I, typename O>
+void reference_grouped_conv(const W& w, size_t g, const I& input, O& output) {
+    const long nv1 = etl::dim<2>(input);
+    const long nv2 = etl::dim<3>(input);
+    const long nw1 = etl::dim<2>(w);
+    const long nw2 = etl::dim<3>(w);
+    const size_t k  = etl::dim<1>(output);
+    const size_t cg = etl::dim<1>(w);
+
+    for (size_t i = 0; i < etl::dim<0>(output); ++i) {
+        for (size_t kk = 0; kk < k; ++kk) {
+            const size_t c0 = (kk / (k / g)) * cg;
+
+            for (long p1 = 0; p1 < nv1; ++p1) {
+                for (long p2 = 0; p2 < nv2; ++p2) {
+                    double acc = 0.0;
+
+                    for (size_t c = 0; c < cg; ++c) {
+                        for (long m1 = 0; m1 < nw1; ++m1) {
+                            for (long m2 = 0; m2 < nw2; ++m2) {
+                                const long x1 = p1 + m1 - (nw1 - 1) / 2;
+                                const long x2 = p2 + m2 - (nw2 - 1) / 2;
+
+                                if (x1 >= 0 && x2 >= 0 && x1 < nv1 && x2 < nv2) {
+                                    acc += w(kk, c, m1, m2) * input(i, c0 + c, x1, x2);
+                                }
+                            }
+                        }
+                    }
+
+                    output(i, kk, p1, p2) = acc;
+                }
+            }
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+TEST_CASE("unit/grouped_conv/forward/0", "[unit][grouped_conv]") {
+    using layer_t = dll::grouped_conv_layer_desc<4, 7, 9, 6, 3, 5, 2, dll::no_activation, dll::no_bias>::layer_t;
+
+    layer_t layer;
+
+    etl::fast_dyn_matrix<float, 3, 4, 7, 9> input;
+    etl::fast_dyn_matrix<float, 3, 6, 7, 9> output;
+    etl::fast_dyn_matrix<float, 3, 6, 7, 9> expected;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(output, input);
+
+    reference_grouped_conv(layer.w, 2, input, expected);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/grouped_conv/depthwise/0", "[unit][grouped_conv]") {
+    using layer_t = dll::depthwise_conv_layer_desc<5, 8, 8, 3, 3, dll::no_activation, dll::no_bias>::layer_t;
+
+    layer_t layer;
+
+    etl::fast_dyn_matrix<float, 2, 5, 8, 8> input;
+    etl::fast_dyn_matrix<float, 2, 5, 8, 8> output;
+    etl::fast_dyn_matrix<float, 2, 5, 8, 8> expected;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(output, input);
+
+    reference_grouped_conv(layer.w, 5, input, expected);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
+
+// The dynamic layer computes the same output as the static one
+TEST_CASE("unit/grouped_conv/dyn/0", "[unit][grouped_conv]") {
+    using layer_t     = dll::grouped_conv_layer_desc<4, 7, 9, 6, 3, 5, 2, dll::relu>::layer_t;
+    using dyn_layer_t = dll::dyn_grouped_conv_layer_desc<dll::relu>::layer_t;
+
+    layer_t layer;
+    dyn_layer_t dyn_layer;
+
+    dyn_layer.init_layer(4, 7, 9, 6, 3, 5, 2);
+    dyn_layer.w = layer.w;
+    dyn_layer.b = etl::uniform_generator(-1.0, 1.0);
+    layer.b     = dyn_layer.b;
+
+    etl::fast_dyn_matrix<float, 3, 4, 7, 9> input;
+    etl::dyn_matrix<float, 4> output(3, 6, 7, 9);
+    etl::dyn_matrix<float, 4> expected(3, 6, 7, 9);
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(expected, input);
+    dyn_layer.forward_batch(output, input);
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
+
+// The fused block computes the depthwise then the pointwise convolution
+TEST_CASE("unit/grouped_conv/separable/0", "[unit][grouped_conv]") {
+    using layer_t = dll::separable_conv_layer_desc<3, 6, 7, 4, 3, 3, dll::no_activation>::layer_t;
+
+    layer_t layer;
+    layer.b = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 2, 3, 6, 7> input;
+    etl::fast_dyn_matrix<float, 2, 3, 6, 7> depthwise;
+    etl::fast_dyn_matrix<float, 2, 4, 6, 7> output;
+
+    input = etl::uniform_generator(-1.0, 1.0);
+
+    layer.forward_batch(output, input);
+
+    reference_grouped_conv(layer.dw, 3, input, depthwise);
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t k = 0; k < 4; ++k) {
+            for (size_t j = 0; j < 6 * 7; ++j) {
+                double expected = layer.b(k);
+
+                for (size_t c = 0; c < 3; ++c) {
+                    expected += layer.pw(k, c) * depthwise(i, c, j / 7, j % 7);
+                }
+
+                REQUIRE(output(i, k, j / 7, j % 7) == Approx(expected).epsilon(1e-4));
+            }
+        }
+    }
+}
+
+TEST_CASE("unit/grouped_conv/sgd/0", "[unit][grouped_conv][dbn][mnist][sgd]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_same_desc<1, 28, 28, 4, 3, 3, dll::relu>::layer_t,
+            dll::depthwise_conv_layer_desc<4, 28, 28, 3, 3, dll::relu>::layer_t,
+            dll::separable_conv_layer_desc<4, 28, 28, 8, 3, 3, dll::relu>::layer_t,
+            dll::mp_3d_layer_desc<8, 28, 28, 1, 2, 2>::layer_t,
+            dll::dense_layer_desc<8 * 14 * 14, 10, dll::softmax>::layer_t>,
+        dll::updater<dll::updater_type::NADAM>, dll::trainer<dll::sgd_trainer>, dll::batch_size<20>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(600);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->learning_rate = 0.001;
+
+    dbn->display();
+
+    FT_CHECK(25, 5e-2);
+    TEST_CHECK(0.25);
+}
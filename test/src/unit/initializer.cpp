@@ -219,3 +219,31 @@ TEST_CASE("initializer/he", "[dense][unit][mnist][sgd]") {
 
     TEST_CHECK(0.2);
 }
+
+TEST_CASE("initializer/parallel", "[unit][init]") {
+    etl::dyn_matrix<float, 2> a(1000, 300);
+    etl::dyn_matrix<float, 2> b(1000, 300);
+
+    // The values only depend on the seed, not on the number of threads
+    dll::set_seed(42);
+    dll::rand_engine().seed(42);
+    dll::init_normal<>::initialize(a, 300, 1000);
+
+    dll::rand_engine().seed(42);
+    dll::thread_limit() = 1;
+    dll::init_normal<>::initialize(b, 300, 1000);
+    dll::thread_limit() = 0;
+
+    for (size_t i = 0; i < etl::size(a); ++i) {
+        REQUIRE(a[i] == b[i]);
+    }
+
+    REQUIRE(std::abs(etl::mean(a)) < 0.01);
+    REQUIRE(std::abs(etl::stddev(a) - 1.0) < 0.01);
+
+    dll::init_uniform<>::initialize(a, 300, 1000);
+
+    REQUIRE(etl::min(a) >= -0.05f);
+    REQUIRE(etl::max(a) < 0.05f);
+    REQUIRE(std::abs(etl::mean(a)) < 0.001);
+}
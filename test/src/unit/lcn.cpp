@@ -260,3 +260,28 @@ TEST_CASE("unit/cdbn/lcn/mnist/8", "[cdbn][lcn][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.1);
 }
+
+// The separable kernel against the direct 2D filter
+TEST_CASE("unit/lcn/separable/1", "[lcn][unit]") {
+    using layer_t = dll::lcn_layer_desc<5>::layer_t;
+
+    layer_t layer;
+
+    etl::fast_dyn_matrix<float, 2, 3, 13, 11> input;
+    etl::fast_dyn_matrix<float, 2, 3, 13, 11> output;
+    etl::fast_dyn_matrix<float, 2, 3, 13, 11> expected;
+
+    input = etl::uniform_generator(0.0, 1.0);
+
+    layer.forward_batch(output, input);
+
+    auto w = layer_t::filter<float>(layer.sigma);
+
+    for (size_t b = 0; b < 2; ++b) {
+        dll::lcn_compute(expected(b), input(b), w, 5, 2);
+    }
+
+    for (size_t i = 0; i < etl::size(output); ++i) {
+        REQUIRE(output[i] == Approx(expected[i]).epsilon(1e-3));
+    }
+}
@@ -85,3 +85,202 @@ TEST_CASE("unit/lstm/3", "[unit][lstm]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Inference session on a LSTM
+TEST_CASE("unit/lstm/4", "[unit][lstm][session]") {
+    auto dataset = dll::make_mnist_dataset_nc_sub(0, 1000, dll::batch_size<100>{}, dll::scale_pre<255>{});
+
+    constexpr size_t time_steps      = 28;
+    constexpr size_t sequence_length = 28;
+    constexpr size_t hidden_units    = 30;
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::lstm_layer<time_steps, sequence_length, hidden_units, dll::last_only>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 10, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam
+        , dll::batch_size<100>                       // The mini-batch size
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    REQUIRE(net->fine_tune(dataset.train(), 10) < 0.5);
+
+    auto session = net->make_inference_session(100);
+
+    auto& generator = dataset.test();
+
+    generator.reset();
+    generator.set_test();
+
+    while (generator.has_next_batch()) {
+        auto expected = net->forward_batch(generator.data_batch());
+        auto output   = session.forward_batch(generator.data_batch());
+
+        REQUIRE(etl::dim<0>(output) == etl::dim<0>(expected));
+
+        for (size_t i = 0; i < etl::size(expected); ++i) {
+            REQUIRE(output[i] == Approx(expected[i]));
+        }
+
+        generator.next_batch();
+    }
+}
+
+// Stateful LSTM fed chunk by chunk
+TEST_CASE("unit/lstm/stateful/1", "[unit][lstm]") {
+    using full_t  = dll::lstm_layer_desc<8, 5, 6>::layer_t;
+    using chunk_t = dll::lstm_layer_desc<4, 5, 6, dll::stateful>::layer_t;
+
+    full_t full;
+    chunk_t chunk;
+
+    chunk.w_i = full.w_i;
+    chunk.u_i = full.u_i;
+    chunk.b_i = full.b_i;
+    chunk.w_g = full.w_g;
+    chunk.u_g = full.u_g;
+    chunk.b_g = full.b_g;
+    chunk.w_f = full.w_f;
+    chunk.u_f = full.u_f;
+    chunk.b_f = full.b_f;
+    chunk.w_o = full.w_o;
+    chunk.u_o = full.u_o;
+    chunk.b_o = full.b_o;
+
+    etl::fast_dyn_matrix<float, 2, 8, 5> x;
+    etl::fast_dyn_matrix<float, 2, 4, 5> x_1;
+    etl::fast_dyn_matrix<float, 2, 4, 5> x_2;
+
+    x = etl::uniform_generator(-1.0, 1.0);
+
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t t = 0; t < 4; ++t) {
+            x_1(b)(t) = x(b)(t);
+            x_2(b)(t) = x(b)(t + 4);
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 2, 8, 6> y;
+    etl::fast_dyn_matrix<float, 2, 4, 6> y_1;
+    etl::fast_dyn_matrix<float, 2, 4, 6> y_2;
+
+    full.forward_batch(y, x);
+    chunk.forward_batch(y_1, x_1);
+    chunk.forward_batch(y_2, x_2);
+
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t t = 0; t < 4; ++t) {
+            for (size_t j = 0; j < 6; ++j) {
+                REQUIRE(y_1(b, t, j) == Approx(y(b, t, j)).epsilon(1e-4));
+                REQUIRE(y_2(b, t, j) == Approx(y(b, t + 4, j)).epsilon(1e-4));
+            }
+        }
+    }
+
+    // A new sequence starts from zero states
+
+    chunk.reset_state();
+
+    etl::fast_dyn_matrix<float, 2, 4, 6> y_3;
+    chunk.forward_batch(y_3, x_1);
+
+    for (size_t i = 0; i < etl::size(y_3); ++i) {
+        REQUIRE(y_3[i] == Approx(y_1[i]).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("unit/lstm/embedding_input/1", "[unit][lstm]") {
+    using plain_t = dll::lstm_layer_desc<6, 5, 4>::layer_t;
+    using embed_t = dll::lstm_layer_desc<6, 5, 4, dll::embedding_input>::layer_t;
+
+    plain_t plain;
+    embed_t embed;
+
+    embed.w_i = plain.w_i;
+    embed.u_i = plain.u_i;
+    embed.b_i = plain.b_i;
+    embed.w_g = plain.w_g;
+    embed.u_g = plain.u_g;
+    embed.b_g = plain.b_g;
+    embed.w_f = plain.w_f;
+    embed.u_f = plain.u_f;
+    embed.b_f = plain.b_f;
+    embed.w_o = plain.w_o;
+    embed.u_o = plain.u_o;
+    embed.b_o = plain.b_o;
+
+    // Only three distinct vectors, as the output of an embedding layer
+
+    etl::fast_dyn_matrix<float, 3, 5> vocab;
+    vocab = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 2, 6, 5> x;
+
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t t = 0; t < 6; ++t) {
+            x(b)(t) = vocab((b + t * t) % 3);
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 2, 6, 4> y_plain;
+    etl::fast_dyn_matrix<float, 2, 6, 4> y_embed;
+
+    plain.forward_batch(y_plain, x);
+    embed.forward_batch(y_embed, x);
+
+    for (size_t i = 0; i < etl::size(y_plain); ++i) {
+        REQUIRE(y_embed[i] == Approx(y_plain[i]).epsilon(1e-4));
+    }
+}
+
+// Each sequence of the batch only runs for its own length
+TEST_CASE("unit/lstm/masked/1", "[unit][lstm]") {
+    using layer_t = dll::lstm_layer_desc<6, 5, 4>::layer_t;
+
+    layer_t masked;
+    layer_t single;
+
+    single.w_i = masked.w_i;
+    single.u_i = masked.u_i;
+    single.b_i = masked.b_i;
+    single.w_g = masked.w_g;
+    single.u_g = masked.u_g;
+    single.b_g = masked.b_g;
+    single.w_f = masked.w_f;
+    single.u_f = masked.u_f;
+    single.b_f = masked.b_f;
+    single.w_o = masked.w_o;
+    single.u_o = masked.u_o;
+    single.b_o = masked.b_o;
+
+    // The padding steps are not zero, they must never be read
+
+    etl::fast_dyn_matrix<float, 3, 6, 5> x;
+    x = etl::uniform_generator(-1.0, 1.0);
+
+    const std::vector<size_t> lengths{5, 5, 1};
+
+    etl::fast_dyn_matrix<float, 3, 6, 4> y;
+
+    masked.sample_steps = lengths;
+    masked.forward_batch(y, x);
+
+    for (size_t b = 0; b < 3; ++b) {
+        etl::fast_dyn_matrix<float, 1, 6, 5> x_b;
+        etl::fast_dyn_matrix<float, 1, 6, 4> y_b;
+
+        x_b(0) = x(b);
+
+        single.active_steps = lengths[b];
+        single.forward_batch(y_b, x_b);
+
+        for (size_t t = 0; t < 6; ++t) {
+            for (size_t j = 0; j < 4; ++j) {
+                REQUIRE(y(b, t, j) == Approx(y_b(0, t, j)).epsilon(1e-4));
+            }
+        }
+    }
+}
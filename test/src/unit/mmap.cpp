@@ -0,0 +1,500 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * \file
+ * \brief Tests for the memory-mapped dataset format and generator
+ */
+
+#include "dll_test.hpp"
+
+#include "dll/dbn.hpp"
+#include "dll/neural/dense_layer.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "mnist/mnist_utils.hpp"
+
+// Check that the records are read back as they were written
+TEST_CASE("unit/mmap/format/1", "[unit][mmap]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_format_1.dlld", dataset.training_images, dataset.training_labels, 10, dll::mmap_dataset_type::UINT8));
+
+    auto generator = dll::make_mmap_generator<1>("mmap_format_1.dlld", dll::mmap_data_generator_desc<dll::batch_size<32>>{});
+
+    REQUIRE(generator->size() == 100);
+    REQUIRE(generator->batches() == 4);
+    REQUIRE(!generator->zero_copy);
+
+    size_t i = 0;
+
+    while (generator->has_next_batch()) {
+        auto data   = generator->data_batch();
+        auto labels = generator->label_batch();
+
+        for (size_t b = 0; b < etl::dim<0>(data); ++b, ++i) {
+            for (size_t j = 0; j < 28 * 28; ++j) {
+                REQUIRE(data(b, j) == dataset.training_images[i][j]);
+            }
+
+            REQUIRE(labels[b] == float(dataset.training_labels[i]));
+        }
+
+        generator->next_batch();
+    }
+
+    REQUIRE(i == 100);
+}
+
+// Use a zero-copy memory-mapped generator for fine-tuning
+TEST_CASE("unit/mmap/mnist/1", "[dbn][unit][mmap]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    REQUIRE(dll::write_mmap_dataset("mmap_mnist_1.train.dlld", dataset.training_images, dataset.training_labels, 10));
+    REQUIRE(dll::write_mmap_dataset("mmap_mnist_1.test.dlld", dataset.test_images, dataset.test_labels, 10));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::categorical>;
+
+    auto train_generator = dll::make_mmap_generator<1>("mmap_mnist_1.train.dlld", generator_t{});
+    auto test_generator  = dll::make_mmap_generator<1>("mmap_mnist_1.test.dlld", generator_t{});
+
+    REQUIRE(train_generator->zero_copy);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+// Use a shuffled uint8 memory-mapped generator for fine-tuning
+TEST_CASE("unit/mmap/mnist/2", "[dbn][unit][mmap]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_mnist_2.train.dlld", dataset.training_images, dataset.training_labels, 10, dll::mmap_dataset_type::UINT8));
+    REQUIRE(dll::write_mmap_dataset("mmap_mnist_2.test.dlld", dataset.test_images, dataset.test_labels, 10, dll::mmap_dataset_type::UINT8));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_mmap_generator<1>("mmap_mnist_2.train.dlld", generator_t{});
+    auto test_generator  = dll::make_mmap_generator<1>("mmap_mnist_2.test.dlld", generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+}
+
+TEST_CASE("unit/mmap/mnist/3", "[dbn][unit][mmap]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_mnist_3.train.dlld", dataset.training_images, dataset.training_labels, 10, dll::mmap_dataset_type::UINT8));
+
+    using generator_t = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>, dll::shuffle_shards<100>>;
+
+    auto train_generator = dll::make_mmap_generator<1>("mmap_mnist_3.train.dlld", generator_t{});
+
+    train_generator->shuffle();
+
+    // Each shard is read completely before the next one
+    REQUIRE(train_generator->order.size() == 500);
+
+    for (size_t i = 0; i < 500; ++i) {
+        CHECK(train_generator->order[i] / 100 == train_generator->order[(i / 100) * 100] / 100);
+    }
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+}
+
+// Read the dataset from several shards
+TEST_CASE("unit/mmap/shards/1", "[unit][mmap]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(300);
+    REQUIRE(!dataset.training_images.empty());
+
+    std::vector<std::string> files;
+
+    for (size_t s = 0; s < 3; ++s) {
+        std::vector<etl::dyn_matrix<float, 1>> images(dataset.training_images.begin() + s * 100, dataset.training_images.begin() + (s + 1) * 100);
+        std::vector<uint8_t> labels(dataset.training_labels.begin() + s * 100, dataset.training_labels.begin() + (s + 1) * 100);
+
+        files.push_back("mmap_shards_1." + std::to_string(s) + ".dlld");
+
+        REQUIRE(dll::write_mmap_dataset(files.back(), images, labels, 10, dll::mmap_dataset_type::UINT8));
+    }
+
+    using generator_t = dll::sharded_data_generator_desc<dll::batch_size<32>, dll::big_batch_size<3>, dll::read_threads<2>>;
+
+    auto generator = dll::make_sharded_generator<1>(files, generator_t{});
+
+    REQUIRE(generator->size() == 300);
+    REQUIRE(generator->batches() == 12);
+
+    // The first batches are interleaved between the shards
+    for (size_t b = 0; b < 3; ++b) {
+        REQUIRE(generator->has_next_batch());
+
+        auto data   = generator->data_batch();
+        auto labels = generator->label_batch();
+
+        REQUIRE(etl::dim<0>(data) == 32);
+
+        for (size_t i = 0; i < 28 * 28; ++i) {
+            CHECK(data(0, i) == dataset.training_images[b * 100][i]);
+        }
+
+        CHECK(labels(0) == dataset.training_labels[b * 100]);
+
+        generator->next_batch();
+    }
+
+    // Each rank gets its own shards
+    auto rank_0 = dll::make_sharded_generator<1>(files, generator_t{}, 0, 2);
+    auto rank_1 = dll::make_sharded_generator<1>(files, generator_t{}, 1, 2);
+
+    CHECK(rank_0->size() == 200);
+    CHECK(rank_1->size() == 100);
+
+    size_t seen = 0;
+
+    rank_0->reset_shuffle();
+
+    while (rank_0->has_next_batch()) {
+        seen += etl::dim<0>(rank_0->data_batch());
+        rank_0->next_batch();
+    }
+
+    CHECK(seen == 200);
+}
+
+// Export the features of a network in batch and read them back
+TEST_CASE("unit/mmap/export/1", "[dbn][unit][mmap]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 30>::layer_t,
+            dll::dense_layer_desc<30, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(110);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto generator = dll::make_generator(dataset.training_images, dataset.training_labels, dataset.training_images.size(), 10, dll::inmemory_data_generator_desc<dll::batch_size<25>, dll::categorical>{});
+
+    REQUIRE(dbn->export_features(*generator, "mmap_export_1.dlld", dll::format::MMAP));
+    REQUIRE(dbn->export_features(*generator, "mmap_export_1.bin", dll::format::BINARY));
+
+    auto features = dll::make_mmap_generator<1>("mmap_export_1.dlld", dll::mmap_data_generator_desc<dll::batch_size<10>>{});
+
+    REQUIRE(features->size() == 110);
+
+    std::ifstream binary("mmap_export_1.bin", std::ifstream::binary);
+    std::vector<float> raw(110 * 10);
+    binary.read(reinterpret_cast<char*>(raw.data()), raw.size() * sizeof(float));
+    REQUIRE(binary);
+
+    size_t i = 0;
+
+    while (features->has_next_batch()) {
+        auto data   = features->data_batch();
+        auto labels = features->label_batch();
+
+        for (size_t b = 0; b < etl::dim<0>(data); ++b, ++i) {
+            auto expected = dbn->forward_one(dataset.training_images[i]);
+
+            for (size_t j = 0; j < 10; ++j) {
+                REQUIRE(data(b, j) == Approx(expected[j]));
+                REQUIRE(raw[i * 10 + j] == Approx(expected[j]));
+            }
+
+            REQUIRE(labels[b] == float(dataset.training_labels[i]));
+        }
+
+        features->next_batch();
+    }
+
+    REQUIRE(i == 110);
+
+    std::remove("mmap_export_1.dlld");
+    std::remove("mmap_export_1.bin");
+}
+
+// Check that a pipeline decodes and scales the records in order
+TEST_CASE("unit/mmap/pipeline/1", "[unit][mmap]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_pipeline_1.dlld", dataset.training_images, dataset.training_labels, 10, dll::mmap_dataset_type::UINT8));
+
+    auto generator = dll::make_mmap_pipeline<1>("mmap_pipeline_1.dlld").scale(255.0f).prefetch(3).threads(2).batch<32>();
+
+    REQUIRE(generator->size() == 100);
+    REQUIRE(generator->batches() == 4);
+
+    size_t i = 0;
+
+    while (generator->has_next_batch()) {
+        auto data   = generator->data_batch();
+        auto labels = generator->label_batch();
+
+        for (size_t b = 0; b < etl::dim<0>(data); ++b, ++i) {
+            for (size_t j = 0; j < 28 * 28; ++j) {
+                REQUIRE(data(b, j) == Approx(dataset.training_images[i][j] / 255.0f));
+            }
+
+            REQUIRE(labels[b] == float(dataset.training_labels[i]));
+        }
+
+        generator->next_batch();
+    }
+
+    REQUIRE(i == 100);
+
+    std::remove("mmap_pipeline_1.dlld");
+}
+
+// Use a shuffled and augmented pipeline for fine-tuning
+TEST_CASE("unit/mmap/pipeline/2", "[dbn][unit][mmap]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    auto noise = [](auto& sample, dll::random_engine& engine) {
+        std::uniform_real_distribution<float> dist(0.0f, 1e-3f);
+
+        for (auto& value : sample) {
+            value += dist(engine);
+        }
+    };
+
+    auto train_generator = dll::make_range_pipeline<1>(dataset.training_images.begin(), dataset.training_images.end(), dataset.training_labels.begin(), dataset.training_labels.end())
+                               .scale(255.0f)
+                               .augment(noise)
+                               .shuffle(100)
+                               .batch<25, true>();
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+}
+
+// Draw class-balanced epochs from an imbalanced dataset
+TEST_CASE("unit/mmap/balanced/1", "[unit][mmap]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    // 450 samples of the first class, 50 of the second
+    std::vector<uint8_t> labels(500);
+
+    for (size_t i = 0; i < 500; ++i) {
+        labels[i] = i % 10 == 0 ? 1 : 0;
+    }
+
+    REQUIRE(dll::write_mmap_dataset("mmap_balanced_1.dlld", dataset.training_images, labels, 2, dll::mmap_dataset_type::UINT8));
+
+    auto generator = dll::make_mmap_generator<1>("mmap_balanced_1.dlld", dll::mmap_data_generator_desc<dll::batch_size<50>, dll::balanced_sampling>{});
+
+    REQUIRE(generator->size() == 500);
+
+    auto count_second = [](auto& g) {
+        size_t second = 0;
+
+        g.reset_shuffle();
+
+        while (g.has_next_batch()) {
+            auto batch = g.label_batch();
+
+            for (size_t b = 0; b < etl::dim<0>(batch); ++b) {
+                second += batch[b] == 1.0f;
+            }
+
+            g.next_batch();
+        }
+
+        return second;
+    };
+
+    auto second = count_second(*generator);
+
+    REQUIRE(second > 175);
+    REQUIRE(second < 325);
+
+    // With weights, the second class is drawn three times more
+    generator->set_class_weights({1.0, 3.0});
+
+    second = count_second(*generator);
+
+    REQUIRE(second > 300);
+    REQUIRE(second < 450);
+
+    // The same sampling is available in the pipelines
+    auto pipeline = dll::make_mmap_pipeline<1>("mmap_balanced_1.dlld").balance().batch<50>();
+
+    second = count_second(*pipeline);
+
+    REQUIRE(second > 175);
+    REQUIRE(second < 325);
+
+    std::remove("mmap_balanced_1.dlld");
+}
+
+// Draw the samples with a high loss more often, with unbiased weights
+TEST_CASE("unit/mmap/importance/1", "[unit][mmap]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_importance_1.dlld", dataset.training_images, dataset.training_labels, 10, dll::mmap_dataset_type::UINT8));
+
+    auto generator = dll::make_mmap_generator<1>("mmap_importance_1.dlld", dll::mmap_data_generator_desc<dll::batch_size<50>, dll::importance_sampling>{});
+
+    REQUIRE(generator->size() == 500);
+
+    // Until all the samples have a loss, the epochs are permutations
+    generator->reset_shuffle();
+
+    std::vector<size_t> seen(500, 0);
+
+    while (generator->has_next_batch()) {
+        auto weights = generator->sample_weights();
+
+        REQUIRE(weights.size() == 50);
+
+        std::vector<double> losses(weights.size());
+
+        for (size_t b = 0; b < weights.size(); ++b) {
+            const size_t i = generator->order[generator->current + b];
+
+            REQUIRE(weights[b] == 1.0f);
+
+            ++seen[i];
+
+            // One sample in ten has a high loss
+            losses[b] = i % 10 == 0 ? 10.0 : 0.1;
+        }
+
+        generator->update_sample_losses(losses);
+        generator->next_batch();
+    }
+
+    for (auto s : seen) {
+        REQUIRE(s == 1);
+    }
+
+    // The samples with a high loss are now drawn more often
+    generator->reset_shuffle();
+
+    size_t high = 0;
+
+    std::vector<double> sum_weights(2, 0.0);
+
+    while (generator->has_next_batch()) {
+        auto weights = generator->sample_weights();
+
+        for (size_t b = 0; b < weights.size(); ++b) {
+            const bool h = generator->order[generator->current + b] % 10 == 0;
+
+            high += h;
+            sum_weights[h] += weights[b];
+        }
+
+        generator->next_batch();
+    }
+
+    // p = 0.8 * 10 / 545 + 0.2 / 500 for each of the 50 high-loss samples
+    REQUIRE(high > 300);
+    REQUIRE(high < 450);
+
+    // The weighted counts estimate the size of each group
+    REQUIRE(sum_weights[1] == Approx(50.0).epsilon(0.2));
+    REQUIRE(sum_weights[0] == Approx(450.0).epsilon(0.25));
+
+    std::remove("mmap_importance_1.dlld");
+}
+
+// Fine-tune with epochs drawn from the losses of the samples
+TEST_CASE("unit/mmap/importance/2", "[dbn][unit][mmap]") {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer_desc<28 * 28, 300>::layer_t,
+            dll::dense_layer_desc<300, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::batch_size<25>, dll::shuffle>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(500);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("mmap_importance_2.train.dlld", dataset.training_images, dataset.training_labels, 10, dll::mmap_dataset_type::UINT8));
+    REQUIRE(dll::write_mmap_dataset("mmap_importance_2.test.dlld", dataset.test_images, dataset.test_labels, 10, dll::mmap_dataset_type::UINT8));
+
+    using train_generator_t = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>, dll::importance_sampling>;
+    using test_generator_t  = dll::mmap_data_generator_desc<dll::batch_size<25>, dll::categorical, dll::scale_pre<255>>;
+
+    auto train_generator = dll::make_mmap_generator<1>("mmap_importance_2.train.dlld", train_generator_t{});
+    auto test_generator  = dll::make_mmap_generator<1>("mmap_importance_2.test.dlld", test_generator_t{});
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    auto error = dbn->fine_tune(*train_generator, 50);
+    std::cout << "error:" << error << std::endl;
+    CHECK(error < 5e-2);
+
+    // All the samples have been scored by the trainer
+    REQUIRE(train_generator->importance.unseen == 0);
+    REQUIRE(train_generator->importance.active());
+
+    auto test_error = dbn->evaluate_error(*test_generator);
+    std::cout << "test_error:" << test_error << std::endl;
+    CHECK(test_error < 0.3);
+
+    std::remove("mmap_importance_2.train.dlld");
+    std::remove("mmap_importance_2.test.dlld");
+}
@@ -6,6 +6,8 @@
 //=======================================================================
 
 #include <deque>
+#include <cstdio>
+#include <fstream>
 
 #include "cpp_utils/string.hpp"
 
@@ -137,6 +139,12 @@ dll::processor::options default_options() {
     return opt;
 }
 
+dll::processor::options dyn_options() {
+    auto opt    = default_options();
+    opt.dynamic = true;
+    return opt;
+}
+
 } // end of anonymous namespace
 
 #define FT_ERROR_BELOW(min)                                \
@@ -212,6 +220,101 @@ TEST_CASE("unit/processor/dense/sgd/2", "[unit][dense][dbn][mnist][sgd][proc]")
     TEST_ERROR_BELOW(0.3);
 }
 
+TEST_CASE("unit/processor/dense/sgd/dyn/1", "[unit][dense][dbn][mnist][sgd][proc][dyn]") {
+    auto lines = get_result(dyn_options(), {"train", "test"}, "dense_sgd_2.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+TEST_CASE("unit/processor/dense/sgd/profile/1", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto opt    = default_options();
+    opt.profile = "native";
+
+    auto lines = get_result(opt, {"train", "test"}, "dense_sgd_2.conf");
+    REQUIRE(!lines.empty());
+    REQUIRE(lines.front().find("Build profile: native") == 0);
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+}
+
+TEST_CASE("unit/processor/dense/sgd/parallel/1", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto opt  = default_options();
+    opt.cache = true;
+
+    REQUIRE(dll::processor::process_files(opt, {"train", "test"}, {"test/processor/dense_sgd_1.conf", "test/processor/dense_sgd_2.conf"}) == 0);
+
+    for (auto log : {"dense_sgd_1.0.log", "dense_sgd_2.1.log"}) {
+        std::ifstream stream(log);
+        std::string output((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+        REQUIRE(output.find("Error rate: ") != std::string::npos);
+
+        std::remove(log);
+    }
+}
+
+TEST_CASE("unit/processor/dense/sgd/codegen/1", "[unit][dense][dbn][mnist][sgd][proc]") {
+    auto lines = get_result(default_options(), {"train", "save", "codegen"}, "dense_sgd_1.conf");
+    REQUIRE(!lines.empty());
+
+    std::ifstream stream("dense_sgd_1_inference.cpp");
+    std::string source((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    REQUIRE(source.find("constexpr size_t input_size = 784;") != std::string::npos);
+    REQUIRE(source.find("constexpr size_t output_size = 10;") != std::string::npos);
+    REQUIRE(source.find("inline size_t predict_label(") != std::string::npos);
+
+    std::remove("dense_sgd_1_inference.cpp");
+}
+
+// Dense (SGD) on streaming datasources
+
+TEST_CASE("unit/processor/dense/sgd/mmap/1", "[unit][dense][dbn][mnist][sgd][mmap][proc]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    REQUIRE(dll::write_mmap_dataset("proc_mmap_1.train.dlld", dataset.training_images, dataset.training_labels, 10, dll::mmap_dataset_type::UINT8));
+    REQUIRE(dll::write_mmap_dataset("proc_mmap_1.test.dlld", dataset.test_images, dataset.test_labels, 10, dll::mmap_dataset_type::UINT8));
+
+    auto lines = get_result(default_options(), {"train", "test"}, "dense_sgd_mmap.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+
+    std::remove("proc_mmap_1.train.dlld");
+    std::remove("proc_mmap_1.test.dlld");
+}
+
+TEST_CASE("unit/processor/dense/sgd/sharded/1", "[unit][dense][dbn][mnist][sgd][mmap][proc]") {
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_matrix<float, 1>>(350);
+    REQUIRE(!dataset.training_images.empty());
+
+    const size_t half = dataset.training_images.size() / 2;
+
+    std::vector<etl::dyn_matrix<float, 1>> first_images(dataset.training_images.begin(), dataset.training_images.begin() + half);
+    std::vector<etl::dyn_matrix<float, 1>> second_images(dataset.training_images.begin() + half, dataset.training_images.end());
+    std::vector<uint8_t> first_labels(dataset.training_labels.begin(), dataset.training_labels.begin() + half);
+    std::vector<uint8_t> second_labels(dataset.training_labels.begin() + half, dataset.training_labels.end());
+
+    REQUIRE(dll::write_mmap_dataset("proc_sharded_1.0.dlld", first_images, first_labels, 10, dll::mmap_dataset_type::UINT8));
+    REQUIRE(dll::write_mmap_dataset("proc_sharded_1.1.dlld", second_images, second_labels, 10, dll::mmap_dataset_type::UINT8));
+    REQUIRE(dll::write_mmap_dataset("proc_sharded_1.test.dlld", dataset.test_images, dataset.test_labels, 10, dll::mmap_dataset_type::UINT8));
+
+    auto lines = get_result(default_options(), {"train", "test"}, "dense_sgd_sharded.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(5e-2);
+    TEST_ERROR_BELOW(0.3);
+
+    std::remove("proc_sharded_1.0.dlld");
+    std::remove("proc_sharded_1.1.dlld");
+    std::remove("proc_sharded_1.test.dlld");
+}
+
 // Conv+Dense (SGD)
 
 TEST_CASE("unit/processor/conv/sgd/1", "[unit][conv][dense][dbn][mnist][sgd][proc]") {
@@ -230,6 +333,14 @@ TEST_CASE("unit/processor/conv/sgd/2", "[unit][conv][dense][dbn][mnist][sgd][pro
     TEST_ERROR_BELOW(0.3);
 }
 
+TEST_CASE("unit/processor/conv/sgd/dyn/1", "[unit][conv][dense][dbn][mnist][sgd][proc][dyn]") {
+    auto lines = get_result(dyn_options(), {"train", "test"}, "conv_sgd_1.conf");
+    REQUIRE(!lines.empty());
+
+    FT_ERROR_BELOW(0.1);
+    TEST_ERROR_BELOW(0.2);
+}
+
 TEST_CASE("unit/processor/conv/sgd/3", "[unit][conv][dense][dbn][mnist][sgd][proc]") {
     auto lines = get_result(default_options(), {"train", "test"}, "conv_sgd_3.conf");
     REQUIRE(!lines.empty());
@@ -5,6 +5,8 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <numeric>
+
 #include "dll_test.hpp"
 
 #define DLL_SVM_SUPPORT
@@ -13,6 +15,7 @@
 #include "dll/rbm/conv_rbm.hpp"
 #include "dll/dbn.hpp"
 #include "dll/transform/random_layer.hpp"
+#include "dll/util/dropout.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -73,3 +76,102 @@ TEST_CASE("unit/cdbn/random/mnist/2", "[cdbn][rectifier][svm][unit]") {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 1.0);
 }
+
+TEST_CASE("unit/random/philox/1", "[unit][random]") {
+    // Known answer of Philox4x32-10 for a zero counter and key
+    uint32_t ctr[4] = {0, 0, 0, 0};
+    dll::philox_4x32(ctr, 0);
+
+    REQUIRE(ctr[0] == 0x6627e8d5);
+    REQUIRE(ctr[1] == 0xe169c58d);
+    REQUIRE(ctr[2] == 0xbc57ac4c);
+    REQUIRE(ctr[3] == 0x9b00dbd8);
+
+    // The same (seed, step) always gives the same mask
+
+    etl::dyn_vector<float> x(10001);
+    etl::dyn_vector<float> y_1(10001);
+    etl::dyn_vector<float> y_2(10001);
+    etl::dyn_vector<float> y_3(10001);
+
+    x = 1.0;
+
+    dll::counter_dropout(y_1.memory_start(), x.memory_start(), 10001, 0.25f, 42, 3);
+    dll::counter_dropout(y_2.memory_start(), x.memory_start(), 10001, 0.25f, 42, 3);
+    dll::counter_dropout(y_3.memory_start(), x.memory_start(), 10001, 0.25f, 42, 4);
+
+    size_t kept      = 0;
+    size_t different = 0;
+
+    for (size_t i = 0; i < 10001; ++i) {
+        REQUIRE(y_1[i] == y_2[i]);
+        REQUIRE((y_1[i] == 0.0f || y_1[i] == Approx(1.0f / 0.75f)));
+
+        kept += y_1[i] != 0.0f;
+        different += y_1[i] != y_3[i];
+    }
+
+    REQUIRE(kept > 7000);
+    REQUIRE(kept < 8000);
+    REQUIRE(different > 0);
+}
+
+TEST_CASE("unit/random/stream/1", "[unit][random]") {
+    dll::random_stream a(42);
+    dll::random_stream b(42);
+
+    // The bulk generation gives the same values as the scalar one
+    std::vector<uint32_t> bits(1001);
+    b.bits(bits.data(), bits.size());
+
+    for (size_t i = 0; i < bits.size(); ++i) {
+        REQUIRE(a() == bits[i]);
+    }
+
+    // The split streams are independent, but reproducible
+    auto c = dll::random_stream(42).split(1);
+    auto d = dll::random_stream(42).split(1);
+    auto e = dll::random_stream(42).split(2);
+
+    size_t same = 0;
+
+    for (size_t i = 0; i < 100; ++i) {
+        const auto value = c();
+
+        REQUIRE(value == d());
+        same += value == e();
+    }
+
+    REQUIRE(same < 5);
+
+    // The distributions have the expected moments
+
+    std::vector<float> values(100000);
+
+    auto f = dll::make_random_stream(3, 7);
+
+    f.uniform(values.data(), values.size());
+
+    double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    REQUIRE(mean == Approx(0.5).epsilon(0.01));
+    REQUIRE(*std::min_element(values.begin(), values.end()) >= 0.0f);
+    REQUIRE(*std::max_element(values.begin(), values.end()) < 1.0f);
+
+    f.bernoulli(values.data(), values.size(), 0.25);
+
+    mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    REQUIRE(mean == Approx(0.25).epsilon(0.02));
+
+    f.normal(values.data(), values.size(), 1.0f, 2.0f);
+
+    mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+
+    double var = 0.0;
+    for (auto value : values) {
+        var += (value - mean) * (value - mean);
+    }
+    var /= values.size();
+
+    REQUIRE(mean == Approx(1.0).epsilon(0.02));
+    REQUIRE(var == Approx(4.0).epsilon(0.02));
+}
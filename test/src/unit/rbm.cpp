@@ -12,6 +12,8 @@
 #include "cpp_utils/data.hpp"
 
 #include "dll/rbm/rbm.hpp"
+#include "dll/util/bfloat16.hpp"
+#include "dll/util/bit_pack.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -212,3 +214,159 @@ TEST_CASE("unit/rbm/mnist/10", "[rbm][pcd][unit]") {
         REQUIRE(error < 15e-2);
     }
 }
+
+TEST_CASE("unit/rbm/mnist/11", "[rbm][pt][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::momentum,
+        dll::trainer_rbm<dll::pt1_trainer_t>>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    if (std::isfinite(error)) {
+        REQUIRE(error < 15e-2);
+    }
+}
+
+TEST_CASE("unit/rbm/mnist/12", "[rbm][sparse_input][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::sparse_input>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 1e-2);
+
+    auto rec_error = rbm.reconstruction_error(dataset.training_images[4]);
+
+    REQUIRE(rec_error < 1e-2);
+}
+
+TEST_CASE("unit/rbm/mnist/13", "[rbm][free_energy][unit]") {
+    using rbm_t = dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<10>,
+        dll::free_energy>::layer_t;
+
+    auto rbm = std::make_unique<rbm_t>();
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(10);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm->train(dataset.training_images, 5);
+
+    etl::dyn_matrix<float, 2> batch(10, 28 * 28);
+
+    double expected = 0.0;
+
+    for (size_t i = 0; i < 10; ++i) {
+        batch(i) = dataset.training_images[i];
+        expected += rbm->free_energy(dataset.training_images[i]);
+    }
+
+    // The free energy is computed by the trainer from the positive phase
+    dll::cd1_trainer_t<rbm_t> trainer(*rbm);
+    dll::rbm_training_context context;
+
+    trainer.train_batch(batch, batch, context);
+
+    REQUIRE(context.batch_free_energy == Approx(expected).epsilon(1e-3));
+}
+
+TEST_CASE("unit/rbm/mnist/14", "[rbm][mixed_precision][unit]") {
+    using rbm_t = dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::mixed_precision>::layer_t;
+
+    auto rbm = std::make_unique<rbm_t>();
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm->train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-2);
+
+    // The weights must be representable in bfloat16
+    for (size_t i = 0; i < etl::size(rbm->w); ++i) {
+        REQUIRE(dll::from_bf16(dll::to_bf16(rbm->w[i])) == rbm->w[i]);
+    }
+}
+
+TEST_CASE("unit/rbm/mnist/15", "[rbm][bit_packed][unit]") {
+    dll::rbm_desc<
+        28 * 28, 100,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::bit_packed>::layer_t rbm;
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::dyn_vector<float>>(100);
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 50);
+
+    REQUIRE(error < 1e-2);
+
+    auto rec_error = rbm.reconstruction_error(dataset.training_images[4]);
+
+    REQUIRE(rec_error < 1e-2);
+}
+
+// The packed products are the same as the dense products
+TEST_CASE("unit/rbm/bit_packed/kernels", "[rbm][bit_packed][unit]") {
+    etl::dyn_matrix<float, 2> x(7, 130);
+    etl::dyn_matrix<float, 2> w(130, 9);
+    etl::dyn_matrix<float, 2> wt(9, 130);
+
+    x  = etl::uniform_generator(0.0, 1.0);
+    w  = etl::normal_generator(0.0, 1.0);
+    wt = etl::normal_generator(0.0, 1.0);
+
+    for (size_t i = 0; i < etl::size(x); ++i) {
+        x[i] = x[i] > 0.5f ? 1.0f : 0.0f;
+    }
+
+    dll::packed_binary_batch<float> packed;
+    packed.pack(x);
+
+    REQUIRE(packed.words == 3);
+    REQUIRE(packed.active() == size_t(etl::sum(x)));
+
+    etl::dyn_matrix<float, 2> out(7, 9);
+    etl::dyn_matrix<float, 2> expected(7, 9);
+
+    packed.multiply(out, w);
+    expected = x * w;
+
+    for (size_t i = 0; i < etl::size(out); ++i) {
+        REQUIRE(out[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+
+    packed.multiply_transpose(out, wt);
+    expected = x * etl::transpose(wt);
+
+    for (size_t i = 0; i < etl::size(out); ++i) {
+        REQUIRE(out[i] == Approx(expected[i]).epsilon(1e-4));
+    }
+}
@@ -5,11 +5,14 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <random>
+
 #include "dll_test.hpp"
 
 #include "dll/neural/dense_layer.hpp"
 #include "dll/neural/rnn_layer.hpp"
 #include "dll/neural/recurrent_last_layer.hpp"
+#include "dll/utility/group_layer.hpp"
 #include "dll/network.hpp"
 #include "dll/datasets.hpp"
 
@@ -85,3 +88,308 @@ TEST_CASE("unit/rnn/3", "[unit][rnn]") {
     REQUIRE(net->fine_tune(dataset.train(), 50) < 0.5);
     REQUIRE(net->evaluate_error(dataset.test()) < 0.5);
 }
+
+// Time-major layout of the recurrent stack
+TEST_CASE("unit/rnn/time_major/1", "[unit][rnn]") {
+    using plain_t = dll::rnn_layer_desc<6, 5, 4>::layer_t;
+    using major_t = dll::rnn_layer_desc<6, 5, 4, dll::time_major>::layer_t;
+
+    using plain_last_t = dll::recurrent_last_layer_desc<6, 4>::layer_t;
+    using major_last_t = dll::recurrent_last_layer_desc<6, 4, dll::time_major>::layer_t;
+
+    plain_t plain;
+    major_t major;
+
+    major.w = plain.w;
+    major.u = plain.u;
+    major.b = plain.b;
+
+    etl::fast_dyn_matrix<float, 3, 6, 5> x;
+    etl::fast_dyn_matrix<float, 3, 6, 5> x_major;
+
+    x = etl::uniform_generator(-1.0, 1.0);
+
+    // The same memory, laid out time step by time step
+
+    for (size_t b = 0; b < 3; ++b) {
+        for (size_t t = 0; t < 6; ++t) {
+            for (size_t i = 0; i < 5; ++i) {
+                x_major[(t * 3 + b) * 5 + i] = x(b, t, i);
+            }
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 3, 6, 4> y;
+    etl::fast_dyn_matrix<float, 3, 6, 4> y_major;
+
+    plain.forward_batch(y, x);
+    major.forward_batch(y_major, x_major);
+
+    for (size_t b = 0; b < 3; ++b) {
+        for (size_t t = 0; t < 6; ++t) {
+            for (size_t j = 0; j < 4; ++j) {
+                REQUIRE(y_major[(t * 3 + b) * 4 + j] == Approx(y(b, t, j)).epsilon(1e-4));
+            }
+        }
+    }
+
+    plain_last_t plain_last;
+    major_last_t major_last;
+
+    etl::fast_dyn_matrix<float, 3, 4> h;
+    etl::fast_dyn_matrix<float, 3, 4> h_major;
+
+    plain_last.forward_batch(h, y);
+    major_last.forward_batch(h_major, y_major);
+
+    for (size_t i = 0; i < etl::size(h); ++i) {
+        REQUIRE(h_major[i] == Approx(h[i]).epsilon(1e-4));
+    }
+}
+
+// Stacked RNN layers forward propagated as a wavefront
+TEST_CASE("unit/rnn/wavefront/1", "[unit][rnn]") {
+    using first_t  = dll::rnn_layer_desc<6, 5, 4>::layer_t;
+    using second_t = dll::rnn_layer_desc<6, 4, 3>::layer_t;
+    using group_t  = dll::group_layer_desc<first_t, second_t>::layer_t;
+
+    static_assert(group_t::wavefront, "The stacked RNN layers must be a wavefront");
+
+    first_t first;
+    second_t second;
+    group_t group;
+
+    std::get<0>(group.layers).w = first.w;
+    std::get<0>(group.layers).u = first.u;
+    std::get<0>(group.layers).b = first.b;
+    std::get<1>(group.layers).w = second.w;
+    std::get<1>(group.layers).u = second.u;
+    std::get<1>(group.layers).b = second.b;
+
+    etl::fast_dyn_matrix<float, 3, 6, 5> x;
+    x = etl::uniform_generator(-1.0, 1.0);
+
+    etl::fast_dyn_matrix<float, 3, 6, 4> h;
+    etl::fast_dyn_matrix<float, 3, 6, 3> y;
+    etl::fast_dyn_matrix<float, 3, 6, 3> y_wave;
+
+    first.forward_batch(h, x);
+    second.forward_batch(y, h);
+    group.forward_batch(y_wave, x);
+
+    for (size_t i = 0; i < etl::size(y); ++i) {
+        REQUIRE(y_wave[i] == Approx(y[i]).epsilon(1e-4));
+    }
+}
+
+// Reversed RNN layer
+TEST_CASE("unit/rnn/reverse/1", "[unit][rnn]") {
+    using plain_t   = dll::rnn_layer_desc<6, 5, 4>::layer_t;
+    using reverse_t = dll::rnn_layer_desc<6, 5, 4, dll::reverse>::layer_t;
+
+    plain_t plain;
+    reverse_t reverse;
+
+    reverse.w = plain.w;
+    reverse.u = plain.u;
+    reverse.b = plain.b;
+
+    etl::fast_dyn_matrix<float, 2, 6, 5> x;
+    etl::fast_dyn_matrix<float, 2, 6, 5> x_rev;
+
+    x = etl::uniform_generator(-1.0, 1.0);
+
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t t = 0; t < 6; ++t) {
+            x_rev(b)(t) = x(b)(5 - t);
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 2, 6, 4> y;
+    etl::fast_dyn_matrix<float, 2, 6, 4> y_rev;
+
+    plain.forward_batch(y, x_rev);
+    reverse.forward_batch(y_rev, x);
+
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t t = 0; t < 6; ++t) {
+            for (size_t j = 0; j < 4; ++j) {
+                REQUIRE(y_rev(b, t, j) == Approx(y(b, 5 - t, j)).epsilon(1e-4));
+            }
+        }
+    }
+}
+
+// The padding steps of a batch are not computed
+TEST_CASE("unit/rnn/active_steps/1", "[unit][rnn]") {
+    using padded_t = dll::rnn_layer_desc<6, 5, 4>::layer_t;
+    using short_t  = dll::rnn_layer_desc<4, 5, 4>::layer_t;
+
+    using padded_last_t = dll::recurrent_last_layer_desc<6, 4>::layer_t;
+    using short_last_t  = dll::recurrent_last_layer_desc<4, 4>::layer_t;
+
+    padded_t padded;
+    short_t plain;
+
+    plain.w = padded.w;
+    plain.u = padded.u;
+    plain.b = padded.b;
+
+    etl::fast_dyn_matrix<float, 3, 6, 5> x;
+    etl::fast_dyn_matrix<float, 3, 4, 5> x_short;
+
+    x = etl::uniform_generator(-1.0, 1.0);
+
+    for (size_t b = 0; b < 3; ++b) {
+        for (size_t t = 0; t < 4; ++t) {
+            x_short(b)(t) = x(b)(t);
+        }
+    }
+
+    etl::fast_dyn_matrix<float, 3, 6, 4> y;
+    etl::fast_dyn_matrix<float, 3, 4, 4> y_short;
+
+    padded.active_steps = 4;
+
+    padded.forward_batch(y, x);
+    plain.forward_batch(y_short, x_short);
+
+    for (size_t b = 0; b < 3; ++b) {
+        for (size_t t = 0; t < 6; ++t) {
+            for (size_t j = 0; j < 4; ++j) {
+                if (t < 4) {
+                    REQUIRE(y(b, t, j) == Approx(y_short(b, t, j)).epsilon(1e-4));
+                } else {
+                    REQUIRE(y(b, t, j) == 0.0f);
+                }
+            }
+        }
+    }
+
+    padded_last_t padded_last;
+    short_last_t short_last;
+
+    padded_last.active_steps = 4;
+
+    etl::fast_dyn_matrix<float, 3, 4> h;
+    etl::fast_dyn_matrix<float, 3, 4> h_short;
+
+    padded_last.forward_batch(h, y);
+    short_last.forward_batch(h_short, y_short);
+
+    for (size_t i = 0; i < etl::size(h); ++i) {
+        REQUIRE(h[i] == Approx(h_short[i]).epsilon(1e-4));
+    }
+}
+
+// Training on length-bucketed batches of sequences
+TEST_CASE("unit/rnn/sequences/1", "[unit][rnn]") {
+    constexpr size_t time_steps      = 12;
+    constexpr size_t sequence_length = 2;
+    constexpr size_t hidden_units    = 16;
+
+    std::default_random_engine rand_engine(42);
+    std::uniform_int_distribution<size_t> length_dist(2, time_steps);
+    std::uniform_real_distribution<float> value_dist(-1.0f, 1.0f);
+
+    std::vector<etl::fast_dyn_matrix<float, time_steps, sequence_length>> samples(500);
+    std::vector<size_t> lengths;
+    std::vector<size_t> labels;
+
+    // The class is the sign of the sum of the first feature of the sequence
+
+    for (auto& sample : samples) {
+        const size_t length = length_dist(rand_engine);
+
+        sample = 0.0f;
+
+        float sum = 0.0f;
+
+        for (size_t t = 0; t < length; ++t) {
+            sample(t, 0) = value_dist(rand_engine);
+            sample(t, 1) = value_dist(rand_engine);
+
+            sum += sample(t, 0);
+        }
+
+        lengths.push_back(length);
+        labels.push_back(sum > 0.0f ? 1 : 0);
+    }
+
+    auto generator = dll::make_generator(samples, lengths, labels, 2, dll::sequence_generator_desc<dll::batch_size<25>, dll::categorical>{});
+
+    // Each batch only holds sequences of similar lengths
+
+    REQUIRE(generator->batches() == 20);
+    REQUIRE(generator->average_steps() < time_steps);
+
+    for (generator->reset(); generator->has_next_batch(); generator->next_batch()) {
+        REQUIRE(generator->batch_steps() <= time_steps);
+    }
+
+    using network_t = dll::dyn_network_desc<
+        dll::network_layers<
+            dll::rnn_layer<time_steps, sequence_length, hidden_units, dll::last_only>,
+            dll::recurrent_last_layer<time_steps, hidden_units>,
+            dll::dense_layer<hidden_units, 2, dll::softmax>
+        >
+        , dll::updater<dll::updater_type::ADAM>      // Adam
+        , dll::batch_size<25>                        // The mini-batch size
+    >::network_t;
+
+    auto net = std::make_unique<network_t>();
+
+    REQUIRE(net->fine_tune(*generator, 30) < 0.2);
+    REQUIRE(net->evaluate_error(*generator) < 0.2);
+}
+
+// Each sequence of the batch only runs for its own length
+TEST_CASE("unit/rnn/masked/1", "[unit][rnn]") {
+    using layer_t = dll::rnn_layer_desc<6, 5, 4>::layer_t;
+    using last_t  = dll::recurrent_last_layer_desc<6, 4>::layer_t;
+
+    layer_t masked;
+    layer_t single;
+
+    single.w = masked.w;
+    single.u = masked.u;
+    single.b = masked.b;
+
+    // The padding steps are not zero, they must never be read
+
+    etl::fast_dyn_matrix<float, 3, 6, 5> x;
+    x = etl::uniform_generator(-1.0, 1.0);
+
+    const std::vector<size_t> lengths{6, 4, 2};
+
+    etl::fast_dyn_matrix<float, 3, 6, 4> y;
+
+    masked.sample_steps = lengths;
+    masked.forward_batch(y, x);
+
+    last_t last;
+    last.sample_steps = lengths;
+
+    etl::fast_dyn_matrix<float, 3, 4> h;
+    last.forward_batch(h, y);
+
+    for (size_t b = 0; b < 3; ++b) {
+        etl::fast_dyn_matrix<float, 1, 6, 5> x_b;
+        etl::fast_dyn_matrix<float, 1, 6, 4> y_b;
+
+        x_b(0) = x(b);
+
+        single.active_steps = lengths[b];
+        single.forward_batch(y_b, x_b);
+
+        for (size_t t = 0; t < 6; ++t) {
+            for (size_t j = 0; j < 4; ++j) {
+                REQUIRE(y(b, t, j) == Approx(y_b(0, t, j)).epsilon(1e-4));
+            }
+        }
+
+        for (size_t j = 0; j < 4; ++j) {
+            REQUIRE(h(b, j) == Approx(y_b(0, lengths[b] - 1, j)).epsilon(1e-4));
+        }
+    }
+}
@@ -8,6 +8,7 @@
 #include "dll_test.hpp"
 
 #include "dll/text_reader.hpp"
+#include "dll/generators.hpp"
 
 TEST_CASE("unit/text_reader/labels/1", "[unit][reader]") {
     auto labels = dll::text::read_labels<std::vector, uint8_t>("test/text_db/labels", 20);
@@ -124,3 +125,34 @@ TEST_CASE("unit/text_reader/images/5", "[unit][reader]") {
     REQUIRE(samples[7](0, 17, 16) == 9);
     REQUIRE(samples[8](0, 17, 15) == 253);
 }
+
+// Convert the text dataset into the memory-mapped format
+TEST_CASE("unit/text_reader/mmap/1", "[unit][reader][mmap]") {
+    auto samples = dll::text::read_images<std::vector, etl::dyn_matrix<float, 1>, false>("test/text_db/images", 20);
+    auto labels  = dll::text::read_labels<std::vector, uint8_t>("test/text_db/labels", 20);
+
+    REQUIRE(dll::text::convert_to_mmap("text_mmap_1.dlld", "test/text_db/images", "test/text_db/labels", 10, dll::mmap_dataset_type::UINT8));
+
+    auto generator = dll::make_mmap_generator<3>("text_mmap_1.dlld", dll::mmap_data_generator_desc<dll::batch_size<4>>{});
+
+    REQUIRE(generator->size() == 9);
+
+    size_t i = 0;
+
+    while (generator->has_next_batch()) {
+        auto data        = generator->data_batch();
+        auto data_labels = generator->label_batch();
+
+        for (size_t b = 0; b < etl::dim<0>(data); ++b, ++i) {
+            for (size_t j = 0; j < 28 * 28; ++j) {
+                REQUIRE(data(b, 0, j / 28, j % 28) == samples[i][j]);
+            }
+
+            REQUIRE(data_labels[b] == float(labels[i]));
+        }
+
+        generator->next_batch();
+    }
+
+    REQUIRE(i == 9);
+}
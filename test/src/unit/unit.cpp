@@ -5,12 +5,37 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <thread>
+
 #include "dll_test.hpp"
 
 #define DLL_DETAIL_ONLY
 
 #include "dll/rbm/rbm.hpp"
+#include "dll/neural/dense_layer.hpp"
 #include "dll/ocv_visualizer.hpp"
+#include "dll/util/timers.hpp"
+#include "dll/util/metrics.hpp"
+#include "dll/util/async_log.hpp"
+#include "dll/util/memory.hpp"
+#include "dll/util/tuning.hpp"
+#include "dll/neural/conv_layer.hpp"
+#include "dll/trainer/autotune.hpp"
+#include "dll/util/placement.hpp"
+#include "dll/util/parallel.hpp"
+#include "dll/util/budget.hpp"
+#include "dll/util/checks.hpp"
+#include "dll/util/epilogue.hpp"
+#include "dll/util/packed_gemm.hpp"
+#include "dll/util/cpu_dispatch.hpp"
+#include "dll/util/avg_pool.hpp"
+#include "dll/util/batch_norm.hpp"
+#include "dll/util/arena.hpp"
 
 TEST_CASE("unit/unit_1", "[unit]") {
     REQUIRE(dll::detail::ct_sqrt(1) == 1);
@@ -68,3 +93,556 @@ TEST_CASE("unit/unit_5", "[unit]") {
     REQUIRE(dll::detail::best_width(444444) == 667);
     REQUIRE(dll::detail::best_height(444444) == 667);
 }
+
+#ifndef DLL_NO_TIMERS
+
+TEST_CASE("unit/timers/1", "[unit][timers]") {
+    dll::reset_timers();
+
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (size_t i = 0; i < 1000; ++i) {
+                dll::auto_timer timer("unit:timers:1");
+            }
+
+            dll::increment_timer("unit:timers:1:counter", 3);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto timers = dll::get_timers().values();
+
+    auto find = [&timers](const char* name) {
+        return std::find_if(timers.begin(), timers.end(), [name](auto& timer) { return std::string(timer.name) == name; });
+    };
+
+    REQUIRE(find("unit:timers:1") != timers.end());
+    REQUIRE(find("unit:timers:1")->count == 4000);
+    REQUIRE(find("unit:timers:1:counter") != timers.end());
+    REQUIRE(find("unit:timers:1:counter")->count == 4);
+    REQUIRE(find("unit:timers:1:counter")->duration == 12);
+
+    dll::reset_timers();
+
+    REQUIRE(dll::get_timers().values().empty());
+}
+
+TEST_CASE("unit/timers/trace/1", "[unit][timers]") {
+    dll::start_trace();
+
+    {
+        dll::auto_timer outer("unit:trace:outer");
+
+        std::thread thread([] {
+            dll::auto_timer inner("unit:trace:inner");
+        });
+
+        thread.join();
+    }
+
+    dll::stop_trace();
+
+    {
+        dll::auto_timer ignored("unit:trace:ignored");
+    }
+
+    REQUIRE(dll::export_trace("unit_trace.json"));
+
+    std::ifstream stream("unit_trace.json");
+    std::string trace((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    REQUIRE(trace.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(trace.find("\"name\":\"unit:trace:outer\",\"ph\":\"X\"") != std::string::npos);
+    REQUIRE(trace.find("\"name\":\"unit:trace:inner\",\"ph\":\"X\"") != std::string::npos);
+    REQUIRE(trace.find("unit:trace:ignored") == std::string::npos);
+
+    std::remove("unit_trace.json");
+}
+
+TEST_CASE("unit/timers/cost/1", "[unit][timers]") {
+    using layer_t = dll::dense_layer<100, 10, dll::sigmoid>;
+
+    auto cost = layer_t::cost(8);
+
+    REQUIRE(cost.forward.flops == 8 * (2 * 100 * 10 + 2 * 10));
+    REQUIRE(cost.backward.flops == 8 * 2 * 100 * 10);
+    REQUIRE(cost.forward.bytes == sizeof(float) * (8 * 100 + 100 * 10 + 10 + 8 * 10));
+    REQUIRE(cost.forward.intensity() > 0.0);
+
+    dll::reset_timers();
+
+    for (size_t i = 0; i < 10; ++i) {
+        dll::auto_timer timer("unit:timers:cost");
+        timer.work(cost.forward);
+    }
+
+    auto timers = dll::get_timers().values();
+
+    REQUIRE(timers.size() == 1);
+    REQUIRE(timers[0].count == 10);
+    REQUIRE(timers[0].flops == 10 * cost.forward.flops);
+    REQUIRE(timers[0].bytes == 10 * cost.forward.bytes);
+
+    dll::reset_timers();
+}
+
+TEST_CASE("unit/metrics/1", "[unit][metrics]") {
+    dll::metrics_exporter exporter(dll::metrics_config{});
+
+    for (size_t i = 1; i <= 100; ++i) {
+        exporter.push("batch_latency", double(i), dll::metric_kind::TIMING);
+        exporter.push("samples", 32.0, dll::metric_kind::COUNTER);
+        exporter.push("loss", 1.0 / i, dll::metric_kind::GAUGE);
+    }
+
+    exporter.aggregate(2.0);
+
+    auto text = exporter.prometheus_text();
+
+    REQUIRE(text.find("dll_batch_latency_ms{quantile=\"0.99\"} 100\n") != std::string::npos);
+    REQUIRE(text.find("dll_batch_latency_ms_count 100\n") != std::string::npos);
+    REQUIRE(text.find("dll_samples_total 3200\n") != std::string::npos);
+    REQUIRE(text.find("dll_samples_per_second 1600\n") != std::string::npos);
+    REQUIRE(text.find("dll_loss 0.01\n") != std::string::npos);
+    REQUIRE(text.find("dll_resident_memory_bytes") != std::string::npos);
+}
+
+TEST_CASE("unit/async_log/1", "[unit][log]") {
+    std::FILE* file = std::tmpfile();
+    REQUIRE(file);
+
+    dll::log_config config;
+    config.format      = dll::log_format::JSON;
+    config.output      = file;
+    config.interval_ms = 60 * 1000;
+
+    dll::async_logger logger(config);
+
+    for (uint32_t b = 0; b < 100; ++b) {
+        dll::log_record record{};
+        record.event     = dll::log_event::FT_BATCH;
+        record.epoch     = 1;
+        record.epochs    = 2;
+        record.batch     = b;
+        record.batches   = 100;
+        record.values[0] = 0.5;
+        record.values[1] = 0.25;
+
+        logger.push(record);
+    }
+
+    dll::log_record record{};
+    record.event     = dll::log_event::FT_EPOCH;
+    record.epoch     = 1;
+    record.epochs    = 2;
+    record.values[0] = 0.125;
+    logger.push(record);
+
+    logger.drain(true);
+
+    std::rewind(file);
+
+    std::string text;
+    char buffer[1024];
+
+    while (std::fgets(buffer, sizeof(buffer), file)) {
+        text += buffer;
+    }
+
+    std::fclose(file);
+
+    // The first batch and the last batch of the epoch pass the rate limit
+    REQUIRE(std::count(text.begin(), text.end(), '\n') == 3);
+    REQUIRE(text.find("{\"event\":\"batch\",\"epoch\":1,\"epochs\":2,\"batch\":1,\"batches\":100,\"error\":0.5,\"loss\":0.25,\"time_ms\":0}\n") == 0);
+    REQUIRE(text.find("\"batch\":100,") != std::string::npos);
+    REQUIRE(text.find("{\"event\":\"epoch\",\"epoch\":1,\"epochs\":2,\"error\":0.125") != std::string::npos);
+}
+
+TEST_CASE("unit/memory/1", "[unit][memory]") {
+    const size_t current = dll::memory_current(dll::memory_subsystem::CACHES);
+    const size_t layer   = dll::memory_current(dll::memory_subsystem::CACHES, 3);
+
+    {
+        dll::memory_record record(dll::memory_subsystem::CACHES, 3, 1000);
+
+        REQUIRE(dll::memory_current(dll::memory_subsystem::CACHES) == current + 1000);
+        REQUIRE(dll::memory_current(dll::memory_subsystem::CACHES, 3) == layer + 1000);
+
+        record.resize(4000);
+        record.resize(500);
+
+        REQUIRE(dll::memory_current(dll::memory_subsystem::CACHES) == current + 500);
+        REQUIRE(dll::memory_peak(dll::memory_subsystem::CACHES) >= current + 4000);
+        REQUIRE(dll::memory_peak(dll::memory_subsystem::CACHES, 3) >= layer + 4000);
+
+        dll::memory_record moved(std::move(record));
+
+        REQUIRE(record.bytes == 0);
+        REQUIRE(moved.bytes == 500);
+    }
+
+    REQUIRE(dll::memory_current(dll::memory_subsystem::CACHES) == current);
+    REQUIRE(dll::memory_current(dll::memory_subsystem::CACHES, 3) == layer);
+
+    REQUIRE(dll::updater_state_arrays(dll::updater_type::ADAM) == 2);
+    REQUIRE(dll::memory_str(2048) == "2.00KB");
+}
+
+TEST_CASE("unit/tuning/1", "[unit][tuning]") {
+    const std::string file = "unit_tuning_1.txt";
+
+    {
+        dll::tuning_cache cache;
+        cache.set("Conv: 1x12x12 -> 4x3x3 B:8", {{dll::conv_kernel::WINOGRAD, 1}, 0.5});
+        cache.set("Dense: 400 -> 10 B:8", {{dll::conv_kernel::AUTO, 0}, 0.25});
+        REQUIRE(cache.store(file));
+    }
+
+    dll::tuning_cache cache;
+    REQUIRE(cache.load(file));
+    REQUIRE(cache.records.size() == 2);
+
+    auto* conv = cache.find("Conv: 1x12x12 -> 4x3x3 B:8");
+    REQUIRE(conv);
+    REQUIRE(conv->tuning.kernel == dll::conv_kernel::WINOGRAD);
+    REQUIRE(conv->tuning.threads == 1);
+    REQUIRE(conv->time == Approx(0.5));
+
+    REQUIRE(!cache.find("Dense: 10 -> 10 B:8"));
+
+    // The serial tuning makes ETL serial for the scope only
+    const bool serial = etl::local_context().serial;
+
+    {
+        dll::tuning_scope scope(conv->tuning);
+
+        REQUIRE(etl::local_context().serial);
+        REQUIRE(dll::kernel_threads() == 1);
+    }
+
+    REQUIRE(etl::local_context().serial == serial);
+    REQUIRE(dll::thread_limit() == 0);
+
+    std::remove(file.c_str());
+}
+
+TEST_CASE("unit/tuning/2", "[unit][tuning]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_layer<1, 12, 12, 4, 3, 3>,
+            dll::dense_layer<4 * 10 * 10, 10, dll::softmax>>,
+        dll::batch_size<8>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    const std::string file = "unit_tuning_2.txt";
+    std::remove(file.c_str());
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // The first run times the two layers, the second run reads the file
+    REQUIRE(dll::autotune(*dbn, file, 1) == 2);
+    REQUIRE(dll::autotune(*dbn, file, 1) == 0);
+
+    dll::tuning_cache cache;
+    REQUIRE(cache.load(file));
+    REQUIRE(cache.records.size() == 2);
+
+    auto& conv = dbn->template layer_get<0>();
+
+    REQUIRE(conv.winograd_supported());
+    REQUIRE(conv.tuning.kernel != dll::conv_kernel::AUTO);
+
+    std::remove(file.c_str());
+}
+
+TEST_CASE("unit/tuning/3", "[unit][tuning]") {
+    // A large layer on the GPU, followed by small layers faster on the CPU
+    std::vector<dll::placement_costs> costs{{1.0, 10.0, 0.5}, {2.0, 0.5, 0.5}, {2.0, 0.5, 0.5}};
+
+    auto cpu = dll::best_placement(costs, 0.5);
+
+    REQUIRE(cpu == std::vector<bool>({false, true, true}));
+    REQUIRE(dll::placement_time(costs, cpu, 0.5) == Approx(2.5));
+
+    // The transfers are too expensive to move any layer
+    costs[0].transfer = 4.0;
+    costs[1].transfer = 4.0;
+
+    REQUIRE(dll::best_placement(costs, 0.5) == std::vector<bool>({false, false, false}));
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::dense_layer<8 * 8, 16>,
+            dll::dense_layer<16, 10, dll::softmax>>,
+        dll::batch_size<8>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    // Without GPU support, all the layers stay on the CPU
+#ifndef ETL_GPU
+    REQUIRE(dll::autoplace(*dbn, 1).empty());
+#else
+    REQUIRE(dll::autoplace(*dbn, 1).size() == 2);
+#endif
+}
+
+TEST_CASE("unit/scheduler/1", "[unit][scheduler]") {
+    // Nested loops run on the same workers
+    std::vector<size_t> values(1000, 0);
+
+    dll::parallel_for(100, [&](size_t i) {
+        dll::parallel_for(10, [&](size_t j) {
+            values[i * 10 + j] = i * 10 + j;
+        });
+    });
+
+    for (size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(values[i] == i);
+    }
+
+    // The first exception of the tasks is rethrown to the caller
+    REQUIRE_THROWS_AS(dll::parallel_for(8, [](size_t i) {
+        if (i == 5) {
+            throw std::runtime_error("task");
+        }
+    }), std::runtime_error);
+
+    auto& scheduler = dll::get_scheduler();
+
+    // The reserved workers do not run the kernels
+    {
+        dll::thread_reservation reservation(scheduler, scheduler.workers());
+
+        REQUIRE(dll::kernel_threads() == 1);
+
+        std::atomic<size_t> count{0};
+        dll::parallel_for(16, [&](size_t) { ++count; });
+        REQUIRE(count == 16);
+    }
+
+    REQUIRE(scheduler.concurrency() == scheduler.workers() + 1);
+}
+
+TEST_CASE("unit/budget/1", "[unit][budget]") {
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<dll::dense_layer<10, 10, dll::softmax>>,
+        dll::batch_size<8>, dll::threads<2>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    REQUIRE(dbn->budget.effective_threads() == 2);
+
+    // Within the scope, the kernels run on the scheduler of the network
+    {
+        auto scope = dbn->budget_scope();
+
+        REQUIRE(dll::kernel_threads() == 2);
+        REQUIRE(&dll::local_scheduler() == &dbn->scheduler());
+    }
+
+    REQUIRE(!dll::task_scheduler::current());
+
+    // The affinity sets the threads when they are not set
+    dbn->set_threads(0);
+    dbn->set_affinity(dll::allowed_cpus());
+
+    REQUIRE(dbn->budget.effective_threads() == dll::allowed_cpus().size());
+
+    {
+        auto scope = dbn->budget_scope();
+
+        REQUIRE(dll::kernel_threads() == dll::allowed_cpus().size());
+    }
+
+    dbn->set_affinity({});
+
+    REQUIRE(!dbn->budget.restricted());
+    REQUIRE(&dbn->scheduler() == &dll::get_scheduler());
+}
+
+TEST_CASE("unit/checks/1", "[unit][checks]") {
+    etl::dyn_vector<float> values(100000);
+    values = 1.0f;
+
+    REQUIRE(dll::first_non_finite_etl(values) == values.size());
+
+    values[77777] = std::numeric_limits<float>::infinity();
+    values[99999] = std::numeric_limits<float>::quiet_NaN();
+
+    REQUIRE(dll::first_non_finite_etl(values) == 77777);
+
+    values[1025] = -std::numeric_limits<float>::infinity();
+
+    REQUIRE(dll::first_non_finite_etl(values) == 1025);
+
+    dll::finite_report report;
+
+    etl::dyn_matrix<double, 2> finite(10, 10);
+    finite = 0.5;
+
+    REQUIRE(report.check(finite, 0, 0));
+    REQUIRE(!report.check(values, 1, 2));
+    REQUIRE(!report.check(finite, 2, 0));
+
+    REQUIRE(!report.finite);
+    REQUIRE(report.layer == 1);
+    REQUIRE(report.variable == 2);
+    REQUIRE(report.index == 1025);
+}
+
+TEST_CASE("unit/epilogue/1", "[unit][epilogue]") {
+    etl::dyn_matrix<float, 4> output(3, 4, 5, 6);
+    etl::dyn_matrix<float, 4> errors(3, 4, 5, 6);
+    etl::dyn_vector<float> grad(4);
+
+    output = etl::sigmoid(etl::normal_generator<float>());
+    errors = etl::normal_generator<float>();
+
+    etl::dyn_matrix<float, 4> adapted = etl::ml::sigmoid_derivative_out(output) >> errors;
+    etl::dyn_vector<float> sums       = etl::bias_batch_sum_4d(adapted);
+
+    dll::adapt_errors_bias<dll::function::SIGMOID>(errors.memory_start(), output.memory_start(), grad.memory_start(), 3, 4, 30);
+
+    REQUIRE(etl::max(etl::abs(errors - adapted)) < 1e-6f);
+    REQUIRE(etl::max(etl::abs(grad - sums)) < 1e-4f);
+
+    etl::dyn_matrix<float, 2> output_2(7, 9);
+    etl::dyn_matrix<float, 2> errors_2(7, 9);
+    etl::dyn_vector<float> grad_2(9);
+
+    output_2 = etl::relu(etl::normal_generator<float>());
+    errors_2 = etl::normal_generator<float>();
+
+    etl::dyn_matrix<float, 2> adapted_2 = etl::ml::relu_derivative_out(output_2) >> errors_2;
+    etl::dyn_vector<float> sums_2       = etl::bias_batch_sum_2d(adapted_2);
+
+    dll::adapt_errors_bias<dll::function::RELU>(errors_2.memory_start(), output_2.memory_start(), grad_2.memory_start(), 7, 9, 1);
+
+    REQUIRE(etl::max(etl::abs(errors_2 - adapted_2)) < 1e-6f);
+    REQUIRE(etl::max(etl::abs(grad_2 - sums_2)) < 1e-4f);
+}
+
+
+TEST_CASE("unit/packed_gemm/1", "[unit][packed]") {
+    etl::dyn_matrix<float, 2> w(37, 21);
+    etl::dyn_matrix<float, 2> input(7, 37);
+    etl::dyn_matrix<float, 2> errors(7, 21);
+
+    w      = etl::normal_generator<float>();
+    input  = etl::normal_generator<float>();
+    errors = etl::normal_generator<float>();
+
+    etl::dyn_matrix<float, 2> output(7, 21);
+    etl::dyn_matrix<float, 2> back(7, 37);
+
+    dll::packed_dense_engine<float> engine;
+
+    engine.forward(output.memory_start(), input.memory_start(), w, 7);
+    engine.backward(back.memory_start(), errors.memory_start(), w, 7);
+
+    etl::dyn_matrix<float, 2> expected      = input * w;
+    etl::dyn_matrix<float, 2> expected_back = errors * etl::transpose(w);
+
+    REQUIRE(etl::max(etl::abs(output - expected)) < 1e-4f);
+    REQUIRE(etl::max(etl::abs(back - expected_back)) < 1e-4f);
+
+    // The panels are only packed again once invalidated
+
+    w = 2.0 * w;
+
+    engine.forward(output.memory_start(), input.memory_start(), w, 7);
+
+    REQUIRE(etl::max(etl::abs(output - expected)) < 1e-4f);
+
+    engine.invalidate();
+
+    engine.forward(output.memory_start(), input.memory_start(), w, 7);
+
+    REQUIRE(etl::max(etl::abs(output - 2.0 * expected)) < 1e-3f);
+}
+
+TEST_CASE("unit/cpu_dispatch/1", "[unit][cpu]") {
+    const dll::cpu_isa detected = dll::detect_cpu_isa();
+    const dll::cpu_isa previous = dll::active_cpu_isa();
+
+    // The instruction set is never raised above the processor
+    REQUIRE(dll::set_cpu_isa(dll::cpu_isa::AVX512) == detected);
+
+    std::vector<float> values(1001);
+
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = 0.01f * float(i % 97);
+    }
+
+    // Every version of the kernels computes the same results
+    for (auto isa : {dll::cpu_isa::GENERIC, dll::cpu_isa::AVX2, dll::cpu_isa::AVX512}) {
+        REQUIRE(dll::set_cpu_isa(isa) <= detected);
+
+        float sum = 0;
+        float sq  = 0;
+
+        dll::bn_detail::shifted_sums(values.data(), values.size(), 0.5f, sum, sq);
+
+        float expected_sum = 0;
+        float expected_sq  = 0;
+
+        for (auto v : values) {
+            expected_sum += v - 0.5f;
+            expected_sq += (v - 0.5f) * (v - 0.5f);
+        }
+
+        REQUIRE(sum == Approx(expected_sum).epsilon(1e-4));
+        REQUIRE(sq == Approx(expected_sq).epsilon(1e-4));
+        REQUIRE(dll::avg_pool_detail::sum(values.data(), values.size()) == Approx(expected_sum + 0.5f * values.size()).epsilon(1e-4));
+    }
+
+    dll::set_cpu_isa(previous);
+}
+
+TEST_CASE("unit/arena/1", "[unit][arena]") {
+    auto& arena = dll::local_arena();
+
+    const size_t before = arena.allocated();
+
+    {
+        dll::arena_scope scope;
+
+        float* a = scope.allocate<float>(100);
+        float* b = scope.allocate<float>(3);
+
+        // The allocations are aligned and do not overlap
+        REQUIRE(reinterpret_cast<uintptr_t>(a) % dll::scratch_arena::alignment == 0);
+        REQUIRE(reinterpret_cast<uintptr_t>(b) % dll::scratch_arena::alignment == 0);
+        REQUIRE(b >= a + 100);
+
+        {
+            dll::arena_scope inner;
+
+            // Larger than the first block
+            double* c = inner.allocate<double>(1UL << 20);
+            c[(1UL << 20) - 1] = 1.0;
+
+            REQUIRE(arena.allocated() > before + (1UL << 20) * sizeof(double));
+        }
+
+        REQUIRE(scope.allocate<float>(1) >= b + 3);
+    }
+
+    REQUIRE(arena.allocated() == before);
+
+    // Once empty, the arena holds the peak in a single block, without new allocations
+    const size_t capacity = arena.capacity();
+
+    {
+        dll::arena_scope scope;
+        scope.allocate<double>(1UL << 20);
+    }
+
+    REQUIRE(arena.capacity() == capacity);
+}
+
+#endif
@@ -257,6 +257,52 @@ void fifth_ex(){
     etl::dump_counters();
 }
 
+void sixth_ex(){
+    // Fifth experiment with fused pooling : the activation of the last
+    // convolutional layer of each block is done by the pooling layer (on
+    // a quarter of the values) and the pooling layers record their argmax
+    // for the backward pass
+
+    auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>(3000);
+
+    mnist::binarize_dataset(dataset);
+
+    // Clean slate
+    etl::reset_counters();
+    dll::reset_timers();
+
+    using dbn_t = dll::dbn_desc<
+        dll::dbn_layers<
+            dll::conv_same_desc<1, 28, 28, 12, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::conv_same_desc<12, 28, 28, 12, 3, 3, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::mp_2d_layer_desc<12, 28, 28, 2, 2, dll::activation<dll::function::RELU>, dll::argmax_indices>::layer_t,
+
+            dll::conv_same_desc<12, 14, 14, 12, 3, 3, dll::activation<dll::function::RELU>>::layer_t,
+            dll::conv_same_desc<12, 14, 14, 12, 3, 3, dll::activation<dll::function::IDENTITY>>::layer_t,
+            dll::mp_2d_layer_desc<12, 14, 14, 2, 2, dll::activation<dll::function::RELU>, dll::argmax_indices>::layer_t,
+
+            dll::dense_layer_desc<12 * 7 * 7, 64, dll::activation<dll::function::RELU>>::layer_t,
+            dll::dense_layer_desc<64, 10, dll::activation<dll::function::SOFTMAX>>::layer_t>,
+        dll::updater<dll::updater_type::MOMENTUM>, dll::batch_size<100>, dll::trainer<dll::sgd_trainer>>::dbn_t;
+
+    auto net = std::make_unique<dbn_t>();
+
+    net->learning_rate = 0.001;
+    net->initial_momentum = 0.9;
+    net->momentum = 0.9;
+    net->goal = -1.0;
+
+    // Train the network for performance sake
+    net->display();
+    net->fine_tune(dataset.training_images, dataset.training_labels, 5);
+
+    std::cout << "DLL Timers" << std::endl;
+    dll::dump_timers_one();
+
+    std::cout << "ETL Counters" << std::endl;
+    etl::dump_counters();
+}
+
 } // end of anonymous namespace
 
 int main(int argc, char* argv []) {
@@ -276,6 +322,8 @@ int main(int argc, char* argv []) {
         fourth_ex();
     } else if(select == "E"){
         fifth_ex();
+    } else if(select == "F"){
+        sixth_ex();
     }
 
     return 0;
@@ -0,0 +1,70 @@
+//=======================================================================
+// Copyright (c) 2014-2017 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+// Convert the MNIST or CIFAR-10 datasets into the memory-mapped dataset
+// format, to be used with dll::make_mmap_generator
+
+#include <string>
+#include <iostream>
+
+#include "dll/generators.hpp"
+
+#include "mnist/mnist_reader.hpp"
+#include "cifar/cifar10_reader.hpp"
+
+namespace {
+
+template <typename Dataset>
+int convert(Dataset& dataset, const std::string& output, size_t n_classes, dll::mmap_dataset_type type) {
+    if (dataset.training_images.empty() || dataset.test_images.empty()) {
+        std::cerr << "Impossible to read the dataset" << std::endl;
+        return 1;
+    }
+
+    if (!dll::write_mmap_dataset(output + ".train.dlld", dataset.training_images, dataset.training_labels, n_classes, type)) {
+        return 1;
+    }
+
+    if (!dll::write_mmap_dataset(output + ".test.dlld", dataset.test_images, dataset.test_labels, n_classes, type)) {
+        return 1;
+    }
+
+    std::cout << "Converted " << dataset.training_images.size() << " training samples and "
+              << dataset.test_images.size() << " test samples" << std::endl;
+
+    return 0;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: dll_mmap_convert <mnist|cifar10> <output_prefix> [uint8|float]" << std::endl;
+        return 1;
+    }
+
+    const std::string dataset_name(argv[1]);
+    const std::string output(argv[2]);
+
+    auto type = dll::mmap_dataset_type::UINT8;
+
+    if (argc > 3 && std::string(argv[3]) == "float") {
+        type = dll::mmap_dataset_type::FLOAT;
+    }
+
+    if (dataset_name == "mnist") {
+        auto dataset = mnist::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 1, 28, 28>>();
+        return convert(dataset, output, 10, type);
+    } else if (dataset_name == "cifar10") {
+        auto dataset = cifar::read_dataset_direct<std::vector, etl::fast_dyn_matrix<float, 3, 32, 32>>();
+        return convert(dataset, output, 10, type);
+    }
+
+    std::cout << "Unknown dataset: " << dataset_name << std::endl;
+
+    return 1;
+}